@@ -69,10 +69,12 @@ if(NOT MSVC)
   check_function_exists(lsetea HAVE_LSETEA)
   check_function_exists(lsetxattr HAVE_LSETXATTR)
   check_function_exists(lutimes HAVE_LUTIMES)
+  check_function_exists(memfd_create HAVE_MEMFD_CREATE)
   check_function_exists(nanosleep HAVE_NANOSLEEP)
   check_function_exists(openat HAVE_OPENAT)
   check_function_exists(poll HAVE_POLL)
   check_function_exists(posix_fadvise HAVE_POSIX_FADVISE)
+  check_function_exists(posix_fallocate HAVE_POSIX_FALLOCATE)
   check_function_exists(prctl HAVE_PRCTL)
   check_function_exists(readdir_r HAVE_READDIR_R)
   check_function_exists(setea HAVE_SETEA)
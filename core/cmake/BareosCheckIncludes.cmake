@@ -60,6 +60,9 @@ if(NOT MSVC)
   check_include_files(sys/proplist.h HAVE_SYS_PROPLIST_H)
   check_include_files(sys/xattr.h HAVE_SYS_XATTR_H)
 
+  check_include_files(sys/fanotify.h HAVE_SYS_FANOTIFY_H)
+  check_include_files(linux/btrfs.h HAVE_LINUX_BTRFS_H)
+
   include(CheckSymbolExists)
 
   check_include_files(glusterfs/api/glfs.h HAVE_GLUSTERFS_API_GLFS_H)
@@ -49,5 +49,21 @@ int main(void)
 "
     GLFS_FTRUNCATE_HAS_FOUR_ARGS
   )
+  check_cxx_source_compiles(
+    "
+#include <glusterfs/api/glfs.h>
+static void done(glfs_fd_t*, ssize_t, struct glfs_stat*, struct glfs_stat*,
+                 void*)
+{
+}
+int main(void)
+{
+       /* new glfs_io_cbk gets the stat before and after the operation */
+       glfs_io_cbk cbk = done;
+       return cbk == NULL;
+}
+"
+    GLFS_IO_CBK_HAS_STAT_ARGS
+  )
   cmake_pop_check_state()
 endif()
@@ -160,6 +160,16 @@ if(ENABLE_LZO)
   endif()
 endif()
 
+option(ENABLE_S3 "Build the native S3 storage backend (needs libcurl)" ON)
+if(ENABLE_S3)
+  find_package(CURL)
+endif()
+
+option(ENABLE_ZSTD "Enable Zstandard support" ON)
+if(ENABLE_ZSTD)
+  bareosfindlibraryandheaders("zstd" "zstd.h" "")
+endif()
+
 include(BareosFindLibrary)
 
 bareosfindlibrary("tirpc")
@@ -160,7 +160,9 @@ BuildRequires: libacl-devel
 BuildRequires: libstdc++-devel
 BuildRequires: zlib-devel
 BuildRequires: openssl-devel
+BuildRequires: libcurl-devel
 BuildRequires: lzo-devel
+BuildRequires: libzstd-devel
 BuildRequires: logrotate
 BuildRequires: postgresql-devel
 BuildRequires: openssl
@@ -335,6 +337,12 @@ Group:      Productivity/Archiving/Backup
 Requires:   %{name}-common  = %{version}
 Requires:   %{name}-storage = %{version}
 
+%package    storage-s3
+Summary:    Native S3 Object Storage support for the Bareos Storage daemon
+Group:      Productivity/Archiving/Backup
+Requires:   %{name}-common  = %{version}
+Requires:   %{name}-storage = %{version}
+
 %if 0%{?glusterfs}
 %package    storage-glusterfs
 Summary:    GlusterFS support for the Bareos Storage daemon
@@ -797,6 +805,11 @@ This package contains the Storage backend for Object Storage (through libdroplet
 
 This package contains the Storage backend for Object Storage (via scripts).
 
+%description storage-s3
+%{dscr}
+
+This package contains the Storage backend for S3 Object Storage.
+
 %if 0%{?glusterfs}
 %description storage-glusterfs
 %{dscr}
@@ -1182,6 +1195,7 @@ mkdir -p %{?buildroot}/%{_libdir}/bareos/plugins/vmware_plugin
 #%%{plugin_dir}/*-dir.so
 %{script_dir}/delete_catalog_backup
 %{script_dir}/make_catalog_backup
+%{script_dir}/restore_catalog_backup
 %{_sbindir}/bareos-dir
 %dir %{_docdir}/%{name}
 %{_mandir}/man8/bareos-dir.8.gz
@@ -1283,6 +1297,12 @@ mkdir -p %{?buildroot}/%{_libdir}/bareos/plugins/vmware_plugin
 %attr(0640, %{director_daemon_user},%{daemon_group}) %{_sysconfdir}/%{name}/bareos-dir.d/storage/dplcompat.conf.example
 %attr(0640, %{storage_daemon_user},%{daemon_group})  %{_sysconfdir}/%{name}/bareos-sd.d/device/dplcompat.conf.example
 
+%files storage-s3
+%defattr(-, root, root)
+%{backend_dir}/libbareossd-s3*.so
+%attr(0640, %{director_daemon_user},%{daemon_group}) %{_sysconfdir}/%{name}/bareos-dir.d/storage/s3.conf.example
+%attr(0640, %{storage_daemon_user},%{daemon_group})  %{_sysconfdir}/%{name}/bareos-sd.d/device/s3.conf.example
+
 %if 0%{?glusterfs}
 %files storage-glusterfs
 %defattr(-, root, root)
@@ -1438,6 +1458,7 @@ mkdir -p %{?buildroot}/%{_libdir}/bareos/plugins/vmware_plugin
 %{_sbindir}/bwild
 %{_sbindir}/bpluginfo
 %{_sbindir}/bdedupestimate
+%{_sbindir}/bbench-sd
 %{_mandir}/man1/bwild.1.gz
 %{_mandir}/man1/bregex.1.gz
 %{_mandir}/man8/bcopy.8.gz
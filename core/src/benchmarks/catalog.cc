@@ -0,0 +1,426 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+/* The catalog phases of a backup and of its expiry against a synthetic
+ * catalog: the attributes going into the batch table, their merge by
+ * WriteBatchFileRecords(), the bvfs cache build and PruneJobs().  Each job
+ * gets files files in directories with fanout subdirectories each.
+ *
+ * Needs the same environment as the catalog unit test (DBTYPE=postgresql and
+ * a database for the configs/catalog configuration, see the catalog
+ * systemtest), the benchmarks are skipped otherwise.  The query plans of
+ * the statements behind each phase are written to catalog-plans.txt (or to
+ * CATALOG_BENCHMARK_PLANS) after the phase ran on the populated catalog. */
+
+#include <benchmark/benchmark.h>
+#include "include/bareos.h"
+#include "cats/cats.h"
+#include "cats/sql_pooling.h"
+#include "dird/dird_conf.h"
+#include "dird/dird_globals.h"
+#include "dird/director_jcr_impl.h"
+#include "dird/get_database_connection.h"
+#include "dird/jcr_util.h"
+#include "dird/job.h"
+#include "dird/ua.h"
+#include "dird/ua_prune.h"
+#include "include/filetypes.h"
+#include "include/streams.h"
+#include "lib/parse_conf.h"
+#include "lib/util.h"
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace directordaemon;
+namespace bm = benchmark;
+
+static constexpr const char* client_name = "bareos-fd";
+static constexpr const char* job_name = "backup-bareos-fd";
+static constexpr const char* fileset_name = "LinuxAll";
+static constexpr int files_per_directory = 16;
+static constexpr int full_every = 10; /* jobs, the others are incrementals */
+static constexpr time_t expired_age = 2 * 365 * 24 * 60 * 60;
+
+struct catalog_connection {
+  JobControlRecord* jcr{nullptr};
+  BareosDb* db{nullptr};
+  ClientDbRecord client{};
+  FileSetDbRecord fileset{};
+  std::string error;
+};
+
+static catalog_connection catalog;
+
+static bool SetupCatalog()
+{
+  if (getenv_std_string("DBTYPE") != "postgresql") {
+    catalog.error = "DBTYPE=postgresql is not set";
+    return false;
+  }
+  std::string working_dir = getenv_std_string("BAREOS_WORKING_DIR");
+  SetWorkingDirectory(working_dir.empty() ? "/tmp" : working_dir.c_str());
+
+  my_config = InitDirConfig(CATALOG_BENCHMARK_CONFIG, M_ERROR);
+  if (!my_config->ParseConfig()) {
+    catalog.error = "could not parse " CATALOG_BENCHMARK_CONFIG;
+    return false;
+  }
+
+  catalog.jcr = NewDirectorJcr(DirdFreeJcr);
+  catalog.jcr->dir_impl->res.catalog = static_cast<CatalogResource*>(
+      my_config->GetResWithName(R_CATALOG, "postgresql"));
+  if (!catalog.jcr->dir_impl->res.catalog) {
+    catalog.error = "the configuration has no postgresql catalog";
+    return false;
+  }
+  catalog.db = GetDatabaseConnection(catalog.jcr);
+  if (!catalog.db) {
+    catalog.error = "could not connect to the catalog";
+    return false;
+  }
+  catalog.jcr->db = catalog.db;
+
+  bstrncpy(catalog.client.Name, client_name, sizeof(catalog.client.Name));
+  bstrncpy(catalog.fileset.FileSet, fileset_name,
+           sizeof(catalog.fileset.FileSet));
+  bstrncpy(catalog.fileset.MD5, "catalog-benchmark",
+           sizeof(catalog.fileset.MD5));
+  catalog.fileset.FileSetText = const_cast<char*>("benchmark");
+  if (!catalog.db->CreateClientRecord(catalog.jcr, &catalog.client)
+      || !catalog.db->CreateFilesetRecord(catalog.jcr, &catalog.fileset)) {
+    catalog.error = catalog.db->strerror();
+    return false;
+  }
+  return true;
+}
+
+static bool Connected(bm::State& state)
+{
+  static bool connected = SetupCatalog();
+  if (!connected) { state.SkipWithError(catalog.error.c_str()); }
+  return connected;
+}
+
+static void DisconnectCatalog()
+{
+  if (catalog.db) { catalog.db->CloseDatabase(catalog.jcr); }
+  DbSqlPoolDestroy();
+  if (catalog.jcr) { FreeJcr(catalog.jcr); }
+  delete my_config;
+  my_config = nullptr;
+}
+
+// the directory of the file with number index, fanout subdirectories each
+static std::string GeneratePath(int index, int fanout)
+{
+  std::string path = "/catalog-benchmark/";
+  for (int dir = index / files_per_directory; dir > 0; dir /= fanout) {
+    path += "d" + std::to_string(dir % fanout) + "/";
+  }
+  return path;
+}
+
+static JobId_t CreateJob(time_t end_time, int level)
+{
+  static int number = 0;
+  JobDbRecord jr;
+  snprintf(jr.Job, sizeof(jr.Job), "%s.catalog-benchmark.%d_%d", job_name,
+           getpid(), ++number);
+  bstrncpy(jr.Name, job_name, sizeof(jr.Name));
+  jr.JobType = JT_BACKUP;
+  jr.JobLevel = level;
+  jr.JobStatus = JS_Running;
+  jr.SchedTime = end_time;
+  jr.ClientId = catalog.client.ClientId;
+  if (!catalog.db->CreateJobRecord(catalog.jcr, &jr)) { return 0; }
+  catalog.jcr->JobId = jr.JobId;
+  return jr.JobId;
+}
+
+// the attributes of every file go to the batch table, as from the sd
+static bool CreateAttributes(JobId_t jobid, int files, int fanout)
+{
+  char attr[] = "P0A CF2xg IGk B Po Po A 3Y BAA I BhjA7I BU+HEc BhjA7I A A C";
+  char digest[] = "tLHQ6pYOpgfggMoBhxy1HA";
+  std::string fname;
+  AttributesDbRecord ar;
+  ar.attr = attr;
+  ar.link = const_cast<char*>("");
+  ar.Digest = digest;
+  ar.Stream = STREAM_UNIX_ATTRIBUTES;
+  ar.FileType = FT_REG;
+  ar.JobId = jobid;
+  for (int i = 0; i < files; ++i) {
+    fname = GeneratePath(i, fanout) + "file" + std::to_string(i);
+    ar.fname = fname.data();
+    ar.FileIndex = i + 1;
+    if (!catalog.db->CreateAttributesRecord(catalog.jcr, &ar)) { return false; }
+  }
+  return true;
+}
+
+static bool FinishJob(JobId_t jobid, time_t end_time, int level, int files)
+{
+  JobDbRecord jr;
+  jr.JobId = jobid;
+  jr.JobStatus = JS_Terminated;
+  jr.JobLevel = level;
+  jr.EndTime = end_time;
+  jr.ClientId = catalog.client.ClientId;
+  jr.FileSetId = catalog.fileset.FileSetId;
+  jr.JobFiles = files;
+  return catalog.db->UpdateJobEndRecord(catalog.jcr, &jr);
+}
+
+// jobs complete backups, returns their jobids separated by commas
+static std::string GenerateJobs(int jobs,
+                                int files,
+                                int fanout,
+                                time_t end_time)
+{
+  std::string jobids;
+  for (int i = 0; i < jobs; ++i) {
+    int level = i % full_every == 0 ? L_FULL : L_INCREMENTAL;
+    JobId_t jobid = CreateJob(end_time, level);
+    if (!jobid || !CreateAttributes(jobid, files, fanout)
+        || !catalog.db->WriteBatchFileRecords(catalog.jcr)
+        || !FinishJob(jobid, end_time, level, files)) {
+      return {};
+    }
+    if (!jobids.empty()) { jobids += ","; }
+    jobids += std::to_string(jobid);
+  }
+  return jobids;
+}
+
+static void PurgeJobs(const std::string& jobids)
+{
+  DbLocker _{catalog.db};
+  catalog.db->PurgeJobs(jobids.c_str());
+}
+
+static int PlanHandler(void* ctx, int num_fields, char** row)
+{
+  std::ofstream& out = *static_cast<std::ofstream*>(ctx);
+  if (num_fields > 0 && row[0]) { out << row[0] << "\n"; }
+  return 0;
+}
+
+// appends the plans of the queries, they are explained but not executed
+static void CapturePlans(const std::string& phase,
+                         const std::vector<std::string>& queries)
+{
+  std::string file = getenv_std_string("CATALOG_BENCHMARK_PLANS");
+  std::ofstream out(file.empty() ? "catalog-plans.txt" : file,
+                    std::ios::app);
+  out << "== " << phase << "\n";
+
+  DbLocker _{catalog.db};
+  for (const std::string& query : queries) {
+    out << query << "\n";
+    std::string explain = "EXPLAIN (VERBOSE, COSTS) " + query;
+    if (!catalog.db->SqlQuery(explain.c_str(), PlanHandler, &out)) {
+      out << catalog.db->strerror() << "\n";
+    }
+    out << "\n";
+  }
+}
+
+static bool LastIteration(const bm::State& state)
+{
+  return state.iterations() + 1 == state.max_iterations;
+}
+
+static void BM_CreateAttributes(bm::State& state)
+{
+  if (!Connected(state)) { return; }
+  const int files = state.range(0);
+  const int fanout = state.range(1);
+  for (auto _ : state) {
+    state.PauseTiming();
+    JobId_t jobid = CreateJob(time(nullptr), L_FULL);
+    state.ResumeTiming();
+    if (!jobid || !CreateAttributes(jobid, files, fanout)) {
+      state.SkipWithError(catalog.db->strerror());
+      break;
+    }
+    state.PauseTiming();
+    catalog.db->WriteBatchFileRecords(catalog.jcr);
+    PurgeJobs(std::to_string(jobid));
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * files);
+}
+
+static void BM_WriteBatchFileRecords(bm::State& state)
+{
+  if (!Connected(state)) { return; }
+  const int files = state.range(0);
+  const int fanout = state.range(1);
+  for (auto _ : state) {
+    state.PauseTiming();
+    JobId_t jobid = CreateJob(time(nullptr), L_FULL);
+    if (!jobid || !CreateAttributes(jobid, files, fanout)) {
+      state.SkipWithError(catalog.db->strerror());
+      break;
+    }
+    state.ResumeTiming();
+    if (!catalog.db->WriteBatchFileRecords(catalog.jcr)) {
+      state.SkipWithError(catalog.db->strerror());
+      break;
+    }
+    state.PauseTiming();
+    std::string id = std::to_string(jobid);
+    if (LastIteration(state)) {
+      CapturePlans(
+          "WriteBatchFileRecords files:" + std::to_string(files)
+              + " fanout:" + std::to_string(fanout),
+          {"SELECT PathId FROM Path WHERE Path IN (SELECT Path FROM Path"
+           " JOIN File USING (PathId) WHERE JobId=" + id + ")",
+           "SELECT FileId FROM File WHERE JobId=" + id
+               + " AND Name LIKE 'file1%'"});
+    }
+    PurgeJobs(id);
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * files);
+}
+
+static void BM_BvfsUpdateCache(bm::State& state)
+{
+  if (!Connected(state)) { return; }
+  const int jobs = state.range(0);
+  const int files = state.range(1);
+  const int fanout = state.range(2);
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::string jobids = GenerateJobs(jobs, files, fanout, time(nullptr));
+    if (jobids.empty()) {
+      state.SkipWithError(catalog.db->strerror());
+      break;
+    }
+    state.ResumeTiming();
+    if (!catalog.db->BvfsUpdatePathHierarchyCache(catalog.jcr,
+                                                  jobids.c_str())) {
+      state.SkipWithError(catalog.db->strerror());
+      break;
+    }
+    state.PauseTiming();
+    if (LastIteration(state)) {
+      CapturePlans(
+          "BvfsUpdatePathHierarchyCache jobs:" + std::to_string(jobs)
+              + " files:" + std::to_string(files)
+              + " fanout:" + std::to_string(fanout),
+          {"SELECT DISTINCT PathId FROM File WHERE JobId IN (" + jobids + ")",
+           "SELECT PathId FROM PathVisibility WHERE JobId IN (" + jobids
+               + ")",
+           "SELECT PPathId FROM PathHierarchy WHERE PathId IN (SELECT PathId"
+           " FROM PathVisibility WHERE JobId IN (" + jobids + "))"});
+    }
+    PurgeJobs(jobids);
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * jobs * files);
+}
+
+static void BM_PruneJobs(bm::State& state)
+{
+  if (!Connected(state)) { return; }
+  const int jobs = state.range(0);
+  const int files = state.range(1);
+  const int fanout = state.range(2);
+  ClientResource* client = static_cast<ClientResource*>(
+      my_config->GetResWithName(R_CLIENT, client_name));
+  if (!client) {
+    state.SkipWithError("the configuration has no client bareos-fd");
+    return;
+  }
+
+  UaContext* ua = new_ua_context(catalog.jcr);
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::string jobids
+        = GenerateJobs(jobs, files, fanout, time(nullptr) - expired_age);
+    if (jobids.empty()) {
+      state.SkipWithError(catalog.db->strerror());
+      break;
+    }
+    if (LastIteration(state)) {
+      std::string before
+          = std::to_string(time(nullptr) - client->JobRetention);
+      CapturePlans(
+          "PruneJobs jobs:" + std::to_string(jobs)
+              + " files:" + std::to_string(files)
+              + " fanout:" + std::to_string(fanout),
+          {"SELECT JobId,PurgedFiles,FileSetId,JobFiles,JobStatus FROM Job"
+           " JOIN Client USING (ClientId) WHERE Type NOT IN ('A')"
+           " AND JobTDate < " + before + " AND Client.Name = '"
+               + client_name + "'",
+           "DELETE FROM File WHERE JobId IN (" + jobids + ")",
+           "DELETE FROM PathVisibility WHERE JobId IN (" + jobids + ")"});
+    }
+    state.ResumeTiming();
+    PruneJobs(ua, client, nullptr);
+    state.PauseTiming();
+    // the jobs that are still needed for a restore are kept
+    PurgeJobs(jobids);
+    state.ResumeTiming();
+  }
+  FreeUaContext(ua);
+  state.SetItemsProcessed(state.iterations() * jobs);
+}
+
+BENCHMARK(BM_CreateAttributes)
+    ->ArgNames({"files", "fanout"})
+    ->ArgsProduct({{10'000, 100'000}, {4, 64}})
+    ->Iterations(3)
+    ->Unit(bm::kMillisecond)
+    ->UseRealTime();
+BENCHMARK(BM_WriteBatchFileRecords)
+    ->ArgNames({"files", "fanout"})
+    ->ArgsProduct({{10'000, 100'000}, {4, 64}})
+    ->Iterations(3)
+    ->Unit(bm::kMillisecond)
+    ->UseRealTime();
+BENCHMARK(BM_BvfsUpdateCache)
+    ->ArgNames({"jobs", "files", "fanout"})
+    ->ArgsProduct({{1, 20}, {10'000}, {4, 64}})
+    ->Iterations(3)
+    ->Unit(bm::kMillisecond)
+    ->UseRealTime();
+BENCHMARK(BM_PruneJobs)
+    ->ArgNames({"jobs", "files", "fanout"})
+    ->ArgsProduct({{20, 100}, {1'000}, {16}})
+    ->Iterations(3)
+    ->Unit(bm::kMillisecond)
+    ->UseRealTime();
+
+int main(int argc, char** argv)
+{
+  bm::Initialize(&argc, argv);
+  if (bm::ReportUnrecognizedArguments(argc, argv)) { return 1; }
+  bm::RunSpecifiedBenchmarks();
+  bm::Shutdown();
+  DisconnectCatalog();
+  return 0;
+}
@@ -0,0 +1,111 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+
+#include <benchmark/benchmark.h>
+#include "include/bareos.h"
+#include "lib/channel.h"
+
+#include <thread>
+#include <vector>
+
+namespace bm = benchmark;
+
+// roughly the capacity of the message channel of the sd
+static constexpr std::size_t channel_capacity = 500;
+static constexpr int messages = 100'000;
+
+template <channel::channel_pair<int> (*Create)(std::size_t)>
+static void BM_Transfer(bm::State& state)
+{
+  for (auto _ : state) {
+    auto [in, out] = Create(channel_capacity);
+    std::thread producer{[in = std::move(in)]() mutable {
+      for (int i = 0; i < messages; ++i) { in.emplace(i); }
+    }};
+    int last = 0;
+    for (auto v = out.get(); v; v = out.get()) { last = *v; }
+    producer.join();
+    bm::DoNotOptimize(last);
+  }
+  state.SetItemsProcessed(state.iterations() * messages);
+}
+BENCHMARK_TEMPLATE(BM_Transfer, channel::CreateBufferedChannel<int>)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Transfer, channel::CreateSpscChannel<int>)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Transfer, channel::CreateMpmcChannel<int>)
+    ->UseRealTime();
+
+// put_many()/get_all() of batches
+template <channel::channel_pair<int> (*Create)(std::size_t)>
+static void BM_Batched(bm::State& state)
+{
+  const std::size_t batch_size = state.range(0);
+  for (auto _ : state) {
+    auto [in, out] = Create(channel_capacity);
+    std::thread producer{[&batch_size, in = std::move(in)]() mutable {
+      std::vector<int> batch;
+      for (int i = 0; i < messages; ++i) {
+        batch.push_back(i);
+        if (batch.size() == batch_size) { in.put_many(batch); }
+      }
+      in.put_many(batch);
+    }};
+    std::vector<int> batch;
+    std::size_t received = 0;
+    while (out.get_all(batch)) { received += batch.size(); }
+    producer.join();
+    bm::DoNotOptimize(received);
+  }
+  state.SetItemsProcessed(state.iterations() * messages);
+}
+BENCHMARK_TEMPLATE(BM_Batched, channel::CreateBufferedChannel<int>)
+    ->Arg(16)
+    ->Arg(128)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Batched, channel::CreateSpscChannel<int>)
+    ->Arg(16)
+    ->Arg(128)
+    ->UseRealTime();
+
+// several producers and consumers on one mpmc channel
+static void BM_MpmcContended(bm::State& state)
+{
+  const int threads = state.range(0);
+  for (auto _ : state) {
+    auto [in, out] = channel::CreateMpmcChannel<int>(channel_capacity);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+      workers.emplace_back([threads, in = in.clone()]() mutable {
+        for (int i = 0; i < messages / threads; ++i) { in.emplace(i); }
+      });
+      workers.emplace_back([out = out.clone()]() mutable {
+        while (out.get()) {}
+      });
+    }
+    in.close();
+    out.close();
+    for (auto& worker : workers) { worker.join(); }
+  }
+  state.SetItemsProcessed(state.iterations() * (messages / threads) * threads);
+}
+BENCHMARK(BM_MpmcContended)->Arg(2)->Arg(4)->UseRealTime();
@@ -0,0 +1,52 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include <benchmark/benchmark.h>
+#include "stored/crc32/crc32.h"
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace bm = benchmark;
+
+// the sd checksums whole blocks, so use the maximum block size
+static std::vector<uint8_t> corpus(1024 * 1024);
+
+bool init_corpus()
+{
+  std::mt19937 gen32;
+  std::generate(corpus.begin(), corpus.end(), gen32);
+  return true;
+}
+[[maybe_unused]] static bool corpus_initialized = init_corpus();
+
+template <uint32_t (*Crc)(const void*, size_t, uint32_t)>
+static void BM_Crc32(bm::State& state)
+{
+  for (auto _ : state) {
+    bm::DoNotOptimize(Crc(corpus.data(), corpus.size(), 0));
+  }
+  state.SetBytesProcessed(state.iterations() * corpus.size());
+}
+BENCHMARK_TEMPLATE(BM_Crc32, crc32_8bytes);
+BENCHMARK_TEMPLATE(BM_Crc32, crc32_16bytes);
+BENCHMARK_TEMPLATE(BM_Crc32, crc32_hardware);
+BENCHMARK_TEMPLATE(BM_Crc32, crc32_fast);
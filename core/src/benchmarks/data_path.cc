@@ -0,0 +1,365 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+/* The way of the file data from the fd to the device of the sd: per read
+ * buffer the fd skips holes, digests, compresses and encrypts like
+ * SendDataToSd() does and sends the result over a loopback connection.  The
+ * sd side packs the records into checksummed blocks like the append loop and
+ * writes them to /dev/null or to a file.  The results are written as json by
+ * runbenchmarks. */
+
+#include <benchmark/benchmark.h>
+#include "include/bareos.h"
+#include "include/ch.h"
+#include "lib/alist.h"
+#include "lib/bsock_tcp.h"
+#include "lib/compression.h"
+#include "lib/crypto.h"
+#include "lib/serial.h"
+#include "lib/util.h"
+#include "stored/crc32/crc32.h"
+#include "tests/bareos_test_sockets.h"
+
+#include <fcntl.h>
+#include <algorithm>
+#include <array>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace bm = benchmark;
+
+static constexpr std::size_t read_size = DEFAULT_NETWORK_BUFFER_SIZE;
+static constexpr std::size_t data_per_iteration = 64 * 1024 * 1024;
+static constexpr std::size_t block_size = 512 * 126; /* DEFAULT_BLOCK_SIZE */
+static constexpr std::size_t block_header_size = 24;
+static constexpr std::size_t record_header_size = 12;
+
+static constexpr std::array<uint32_t, 4> compressions{
+    0, COMPRESS_GZIP, COMPRESS_FZ4L, COMPRESS_ZSTD};
+
+/* Text like data that compresses about as well as source code, every fourth
+ * read buffer is a hole. */
+static std::vector<char> corpus;
+
+static bool init_corpus()
+{
+  static constexpr const char* words[]
+      = {"backup ", "restore ", "volume ", "storage ", "job ", "catalog ",
+         "if (",    ") {\n",    "return ", "0;\n",     "}\n", "  "};
+  std::mt19937 gen32;
+  corpus.resize(4 * read_size);
+  std::size_t i = 0;
+  while (i < 3 * read_size) {
+    const char* word = words[gen32() % std::size(words)];
+    for (; *word && i < 3 * read_size; ++word) { corpus[i++] = *word; }
+  }
+  return true;
+}
+[[maybe_unused]] static bool corpus_initialized = init_corpus();
+
+struct pipeline_options {
+  uint32_t compression;
+  bool digest;
+  bool sparse;
+  bool encryption;
+  const char* device;
+};
+
+// packs the records into blocks like the sd does and writes them to fd
+class BlockWriter {
+ public:
+  explicit BlockWriter(int fd) : fd_{fd}, block_(block_size) { Reset(); }
+
+  void Put(const char* data, std::size_t size)
+  {
+    char header[record_header_size]{};
+    uint32_t length = htonl(static_cast<uint32_t>(size));
+    memcpy(header + 8, &length, sizeof(length));
+    Append(header, sizeof(header));
+    Append(data, size);
+  }
+
+  void Flush()
+  {
+    if (used_ == block_header_size) { return; }
+    uint32_t checksum = crc32_fast(block_.data() + 4, used_ - 4);
+    memcpy(block_.data(), &checksum, sizeof(checksum));
+    if (write(fd_, block_.data(), used_) != static_cast<ssize_t>(used_)) {
+      errors += 1;
+    }
+    Reset();
+  }
+
+  std::size_t errors{0};
+
+ private:
+  void Reset() { used_ = block_header_size; }
+
+  // records that do not fit are continued in the next block
+  void Append(const char* data, std::size_t size)
+  {
+    while (size > 0) {
+      std::size_t n = std::min(size, block_size - used_);
+      memcpy(block_.data() + used_, data, n);
+      used_ += n;
+      data += n;
+      size -= n;
+      if (used_ == block_size) { Flush(); }
+    }
+  }
+
+  int fd_;
+  std::vector<char> block_;
+  std::size_t used_{0};
+};
+
+// the sd: stores everything up to an EOD, which it answers with an EOD
+static void ReceiveData(BareosSocket* sd, int device)
+{
+  BlockWriter writer(device);
+  for (;;) {
+    int32_t n = sd->recv();
+    if (n > 0) {
+      writer.Put(sd->msg, n);
+    } else if (n == BNET_SIGNAL && sd->message_length == BNET_EOD) {
+      writer.Flush();
+      sd->signal(BNET_EOD);
+    } else {
+      break;
+    }
+  }
+}
+
+class Fd {
+ public:
+  Fd(const pipeline_options& options, BareosSocket* sd)
+      : options_{options}, sd_{sd}
+  {
+    if (options.compression) {
+      compressed_.resize(RequiredCompressionOutputBufferSize(
+          options.compression, read_size));
+    }
+    if (options.encryption) {
+      keypair_ = crypto_keypair_new();
+      CryptoKeypairLoadCert(keypair_, DATA_PATH_TEST_CERT);
+      recipients_.append(keypair_);
+      session_ = crypto_session_new(CRYPTO_CIPHER_AES_128_CBC, &recipients_);
+    }
+  }
+
+  ~Fd()
+  {
+    if (session_) { CryptoSessionFree(session_); }
+    if (keypair_) { CryptoKeypairFree(keypair_); }
+  }
+
+  bool Valid() const { return !options_.encryption || session_; }
+
+  // one file of data_per_iteration bytes
+  bool SendFile()
+  {
+    DIGEST* digest = nullptr;
+    if (options_.digest) {
+      digest = crypto_digest_new(nullptr, CRYPTO_DIGEST_XXH128);
+    }
+    CIPHER_CONTEXT* cipher = nullptr;
+    uint32_t cipher_block_size = 0;
+    if (session_) {
+      cipher = crypto_cipher_new(session_, true, &cipher_block_size);
+      encrypted_.resize(std::max(read_size, compressed_.size())
+                        + cipher_block_size);
+    }
+
+    bool ok = true;
+    for (uint64_t offset = 0; ok && offset < data_per_iteration;
+         offset += read_size) {
+      ok = SendReadBuffer(offset, digest, cipher);
+    }
+    if (cipher) {
+      uint32_t written = 0;
+      CryptoCipherFinalize(cipher, (uint8_t*)encrypted_.data(), &written);
+      if (written) { ok = ok && sd_->send(encrypted_.data(), written); }
+      CryptoCipherFree(cipher);
+    }
+    if (digest) {
+      uint8_t hash[CRYPTO_DIGEST_MAX_SIZE];
+      uint32_t length = sizeof(hash);
+      CryptoDigestFinalize(digest, hash, &length);
+      CryptoDigestFree(digest);
+    }
+
+    // the sd answers once everything is on the device
+    return ok && sd_->signal(BNET_EOD) && sd_->recv() == BNET_SIGNAL
+           && sd_->message_length == BNET_EOD;
+  }
+
+ private:
+  bool SendReadBuffer(uint64_t offset,
+                      DIGEST* digest,
+                      CIPHER_CONTEXT* cipher)
+  {
+    const std::size_t corpus_offset = offset % corpus.size();
+    char* data = corpus.data() + corpus_offset;
+    std::size_t size = read_size;
+
+    if (options_.sparse && IsBufZero(data, size)) { return true; }
+
+    if (digest) { CryptoDigestUpdate(digest, (uint8_t*)data, size); }
+
+    if (options_.compression) {
+      auto compressed = ThreadlocalCompress(options_.compression, 1, data, size,
+                                            compressed_.data(),
+                                            compressed_.size());
+      if (compressed.holds_error()) { return false; }
+      data = compressed_.data();
+      size = compressed.value_unchecked();
+    }
+
+    if (cipher) {
+      uint32_t written = 0;
+      if (!CryptoCipherUpdate(cipher, (const uint8_t*)data, size,
+                              (const uint8_t*)encrypted_.data(), &written)) {
+        return false;
+      }
+      data = encrypted_.data();
+      size = written;
+      if (size == 0) { return true; }
+    }
+
+    // sparse data is sent with its file address in front
+    if (options_.sparse) {
+      message_.resize(OFFSET_FADDR_SIZE + size);
+      ser_declare;
+      SerBegin(message_.data(), OFFSET_FADDR_SIZE);
+      ser_uint64(offset);
+      memcpy(message_.data() + OFFSET_FADDR_SIZE, data, size);
+      data = message_.data();
+      size += OFFSET_FADDR_SIZE;
+    }
+
+    return sd_->send(data, size);
+  }
+
+  pipeline_options options_;
+  BareosSocket* sd_;
+  std::vector<char> message_;
+  std::vector<char> compressed_;
+  std::vector<char> encrypted_;
+  X509_KEYPAIR* keypair_{nullptr};
+  alist<X509_KEYPAIR*> recipients_{1, false};
+  CRYPTO_SESSION* session_{nullptr};
+};
+
+static void RunPipeline(bm::State& state, const pipeline_options& options)
+{
+  std::unique_ptr<TestSockets> sockets
+      = create_connected_server_and_client_bareos_socket();
+  if (!sockets) {
+    state.SkipWithError("could not connect the sockets");
+    return;
+  }
+
+  int device = open(options.device, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (device < 0) {
+    state.SkipWithError("could not open the device");
+    return;
+  }
+  std::thread sd{ReceiveData, sockets->server.get(), device};
+
+  {
+    Fd fd(options, sockets->client.get());
+    if (!fd.Valid()) {
+      state.SkipWithError("could not set up the encryption");
+    } else {
+      for (auto _ : state) {
+        if (!fd.SendFile()) {
+          state.SkipWithError("sending the data failed");
+          break;
+        }
+        state.PauseTiming();
+        if (lseek(device, 0, SEEK_SET) == 0) {
+          bm::DoNotOptimize(ftruncate(device, 0));
+        }
+        state.ResumeTiming();
+      }
+    }
+  }
+
+  sockets->client->signal(BNET_TERMINATE);
+  sd.join();
+  close(device);
+  state.SetBytesProcessed(state.iterations() * data_per_iteration);
+}
+
+static void BM_DataPath(bm::State& state)
+{
+  pipeline_options options{};
+  options.compression = compressions[state.range(0)];
+  options.digest = state.range(1);
+  options.sparse = state.range(2);
+  options.encryption = state.range(3);
+  options.device = "/dev/null";
+  RunPipeline(state, options);
+}
+
+static void AllCombinations(bm::internal::Benchmark* b)
+{
+  b->ArgNames({"compression", "digest", "sparse", "encryption"});
+  for (std::size_t compression = 0; compression < compressions.size();
+       ++compression) {
+#if !defined(HAVE_ZSTD)
+    if (compressions[compression] == COMPRESS_ZSTD) { continue; }
+#endif
+    for (int digest : {0, 1}) {
+      for (int sparse : {0, 1}) {
+        for (int encryption : {0, 1}) {
+          b->Args({static_cast<int64_t>(compression), digest, sparse,
+                   encryption});
+        }
+      }
+    }
+  }
+}
+BENCHMARK(BM_DataPath)->Apply(AllCombinations)->UseRealTime();
+
+// the same into a file device, without and with the fastest compression
+static void BM_DataPathToFile(bm::State& state)
+{
+  char device[] = "/tmp/bareos-data-path-XXXXXX";
+  int fd = mkstemp(device);
+  if (fd < 0) {
+    state.SkipWithError("could not create the file device");
+    return;
+  }
+  close(fd);
+
+  pipeline_options options{};
+  options.compression = compressions[state.range(0)];
+  options.device = device;
+  RunPipeline(state, options);
+  unlink(device);
+}
+BENCHMARK(BM_DataPathToFile)
+    ->ArgName("compression")
+    ->Arg(0)
+    ->Arg(2)
+    ->UseRealTime();
@@ -22,6 +22,7 @@
 #include <benchmark/benchmark.h>
 #include "include/baconfig.h"
 #include "lib/crypto.h"
+#include "lib/xxhash.h"
 #include <array>
 #include <random>
 
@@ -61,6 +62,25 @@ static void BM_XXH128(bm::State& state)
 }
 BENCHMARK(BM_XXH128);
 
+static void BM_XXH3_TREE(bm::State& state)
+{
+  for (auto _ : state) { do_digest(CRYPTO_DIGEST_XXH3_TREE); }
+}
+BENCHMARK(BM_XXH3_TREE);
+
+/* The part of the tree digest that the backup pipeline spreads over its
+ * workers, every thread hashes the chunks of its own blocks. */
+static void BM_XXH3_TREE_CHUNKS(bm::State& state)
+{
+  for (auto _ : state) {
+    for (auto i = 0; i != 1000; i++) {
+      bm::DoNotOptimize(Xxh3TreeChunkHashes(corpus.data(), corpus.size()));
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * 1000 * corpus.size());
+}
+BENCHMARK(BM_XXH3_TREE_CHUNKS)->ThreadRange(1, 8);
+
 static void BM_SHA1(bm::State& state)
 {
   for (auto _ : state) { do_digest(CRYPTO_DIGEST_SHA1); }
@@ -0,0 +1,108 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+
+#include <benchmark/benchmark.h>
+#include "include/bareos.h"
+#include "lib/htable.h"
+#include "lib/flat_htable.h"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace bm = benchmark;
+
+// looks like the accurate file list: one entry per path
+struct ChainedItem {
+  hlink link;
+  char* fname;
+};
+struct FlatItem {
+  char* fname;
+};
+
+static std::vector<std::string> MakePaths(std::size_t num)
+{
+  std::vector<std::string> paths;
+  paths.reserve(num);
+  for (std::size_t i = 0; i < num; ++i) {
+    paths.push_back("/srv/data/project" + std::to_string(i / 1000) + "/dir"
+                    + std::to_string(i / 100 % 10) + "/file"
+                    + std::to_string(i) + ".dat");
+  }
+  return paths;
+}
+
+template <typename Table, typename Item>
+static void Fill(Table& table, const std::vector<std::string>& paths)
+{
+  for (auto& path : paths) {
+    auto* item = (Item*)table.hash_malloc(sizeof(Item));
+    item->fname = table.hash_malloc(path.size() + 1);
+    memcpy(item->fname, path.c_str(), path.size() + 1);
+    table.insert(item->fname, item);
+  }
+}
+
+template <typename Table, typename Item>
+static void BM_Insert(bm::State& state)
+{
+  auto paths = MakePaths(state.range(0));
+  for (auto _ : state) {
+    Table table(paths.size());
+    Fill<Table, Item>(table, paths);
+    bm::DoNotOptimize(table.size());
+  }
+  state.SetItemsProcessed(state.iterations() * paths.size());
+}
+
+// lookups in random order, like the files of a backup vs. the catalog
+template <typename Table, typename Item>
+static void BM_Lookup(bm::State& state)
+{
+  auto paths = MakePaths(state.range(0));
+  Table table(paths.size());
+  Fill<Table, Item>(table, paths);
+
+  std::vector<std::string> queries = paths;
+  std::shuffle(queries.begin(), queries.end(), std::mt19937{1});
+
+  std::size_t i = 0;
+  for (auto _ : state) {
+    bm::DoNotOptimize(table.lookup(queries[i].data()));
+    if (++i == queries.size()) { i = 0; }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+using Chained = htable<char*, ChainedItem>;
+using Flat = flat_htable<char*, FlatItem>;
+
+BENCHMARK_TEMPLATE(BM_Insert, Chained, ChainedItem)
+    ->Arg(100'000)
+    ->Arg(2'000'000);
+BENCHMARK_TEMPLATE(BM_Insert, Flat, FlatItem)->Arg(100'000)->Arg(2'000'000);
+BENCHMARK_TEMPLATE(BM_Lookup, Chained, ChainedItem)
+    ->Arg(100'000)
+    ->Arg(2'000'000);
+BENCHMARK_TEMPLATE(BM_Lookup, Flat, FlatItem)->Arg(100'000)->Arg(2'000'000);
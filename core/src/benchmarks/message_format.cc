@@ -0,0 +1,118 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+/* Builds the per file messages of a backup, the stream header and the
+ * attribute record the fd sends to the sd and the attribute message the sd
+ * sends to the director, once with Bsnprintf() like before and once with the
+ * MessageBuilder. */
+
+#include <benchmark/benchmark.h>
+#include "include/bareos.h"
+#include "lib/bsnprintf.h"
+#include "lib/message_builder.h"
+
+namespace bm = benchmark;
+
+static constexpr const char* fname
+    = "/home/user/projects/bareos/core/src/lib/message_builder.h";
+static constexpr const char* attribs
+    = "gC F0Wk IHt B Pt Pt A BE6 BAA I BmM1cm BmM1cm BmM1cm A A C";
+static constexpr const char* job = "backup-client1.2024-06-01_10.00.00_04";
+
+class Buffer {
+ public:
+  Buffer() : buf{GetPoolMemory(PM_MESSAGE)} {}
+  ~Buffer() { FreePoolMemory(buf); }
+  POOLMEM* buf;
+};
+
+static void BM_StreamHeaderBsnprintf(bm::State& state)
+{
+  Buffer b;
+  uint32_t file_index = 0;
+  for (auto _ : state) {
+    int length = Bsnprintf(b.buf, SizeofPoolMemory(b.buf), "%ld %d 0",
+                           ++file_index, 2);
+    bm::DoNotOptimize(length);
+  }
+}
+
+static void BM_StreamHeaderBuilder(bm::State& state)
+{
+  Buffer b;
+  uint32_t file_index = 0;
+  for (auto _ : state) {
+    MessageBuilder message(b.buf);
+    message << ++file_index << ' ' << 2 << " 0";
+    bm::DoNotOptimize(message.size());
+  }
+}
+
+static void BM_AttributeRecordBsnprintf(bm::State& state)
+{
+  Buffer b;
+  uint32_t file_index = 0;
+  for (auto _ : state) {
+    int length = Bsnprintf(b.buf, SizeofPoolMemory(b.buf),
+                           "%ld %d %s%c%s%c%c%s%c%d%c", ++file_index, 3, fname,
+                           0, attribs, 0, 0, "", 0, 0, 0);
+    bm::DoNotOptimize(length);
+  }
+}
+
+static void BM_AttributeRecordBuilder(bm::State& state)
+{
+  Buffer b;
+  uint32_t file_index = 0;
+  for (auto _ : state) {
+    MessageBuilder message(b.buf);
+    message << ++file_index << ' ' << 3 << ' ' << fname << '\0' << attribs
+            << '\0' << "" << '\0' << "" << '\0' << 0u << '\0';
+    bm::DoNotOptimize(message.size());
+  }
+}
+
+static void BM_UpdCatBsnprintf(bm::State& state)
+{
+  Buffer b;
+  for (auto _ : state) {
+    int length = Bsnprintf(b.buf, SizeofPoolMemory(b.buf),
+                           "UpdCat Job=%s FileAttributes ", job);
+    bm::DoNotOptimize(length);
+  }
+}
+
+static void BM_UpdCatBuilder(bm::State& state)
+{
+  Buffer b;
+  for (auto _ : state) {
+    MessageBuilder message(b.buf);
+    message << "UpdCat Job=" << job << " FileAttributes ";
+    bm::DoNotOptimize(message.size());
+  }
+}
+
+BENCHMARK(BM_StreamHeaderBsnprintf);
+BENCHMARK(BM_StreamHeaderBuilder);
+BENCHMARK(BM_AttributeRecordBsnprintf);
+BENCHMARK(BM_AttributeRecordBuilder);
+BENCHMARK(BM_UpdCatBsnprintf);
+BENCHMARK(BM_UpdCatBuilder);
@@ -0,0 +1,107 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+
+#include <benchmark/benchmark.h>
+#include "include/bareos.h"
+#include "stored/backends/ordered_cbuf.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace bm = benchmark;
+using storagedaemon::ocbuf_item;
+using storagedaemon::ordered_circbuf;
+
+// what the chunked device queues: a chunk of a volume
+struct request {
+  const char* volname;
+  int chunk;
+  int wbuflen;
+};
+
+static int Compare(ocbuf_item* item1, ocbuf_item* item2)
+{
+  auto* r1 = static_cast<request*>(item1->data);
+  auto* r2 = static_cast<request*>(item2->data);
+  if (int cmp = strcmp(r1->volname, r2->volname); cmp != 0) { return cmp; }
+  return (r1->chunk == r2->chunk) ? 0 : (r1->chunk < r2->chunk) ? -1 : 1;
+}
+
+static void Update(void* old_item, void* new_item)
+{
+  static_cast<request*>(old_item)->wbuflen
+      = static_cast<request*>(new_item)->wbuflen;
+}
+
+static constexpr int chunks_per_producer = 20'000;
+
+/* Every producer writes its own volume, enqueueing each chunk twice (like a
+ * chunk that gets filled by two jobs) while the io threads dequeue with a
+ * reserved slot, as ChunkedDevice::DequeueChunk() does. */
+static void BM_EnqueueDequeue(bm::State& state)
+{
+  const int producers = state.range(0);
+  const int io_threads = state.range(1);
+  std::vector<std::string> volnames;
+  for (int p = 0; p < producers; ++p) {
+    volnames.push_back("Full-" + std::to_string(p));
+  }
+
+  for (auto _ : state) {
+    ordered_circbuf cb(io_threads * 10);
+    std::vector<std::thread> consumers;
+    for (int t = 0; t < io_threads; ++t) {
+      consumers.emplace_back([&cb]() {
+        while (void* data = cb.dequeue(true)) {
+          delete static_cast<request*>(data);
+          cb.unreserve_slot();
+        }
+      });
+    }
+    std::vector<std::thread> writers;
+    for (int p = 0; p < producers; ++p) {
+      writers.emplace_back([&cb, volname = volnames[p].c_str()]() {
+        for (int chunk = 0; chunk < chunks_per_producer; ++chunk) {
+          for (int len : {1, 2}) {
+            auto* req = new request{volname, chunk, len};
+            if (cb.enqueue(req, sizeof(*req), Compare, Update) != req) {
+              delete req;
+            }
+          }
+        }
+      });
+    }
+    for (auto& writer : writers) { writer.join(); }
+    while (!cb.empty()) { std::this_thread::yield(); }
+    cb.flush();
+    for (auto& consumer : consumers) { consumer.join(); }
+  }
+  state.SetItemsProcessed(state.iterations() * producers * chunks_per_producer
+                          * 2);
+}
+BENCHMARK(BM_EnqueueDequeue)
+    ->Args({1, 1})
+    ->Args({1, 8})
+    ->Args({4, 8})
+    ->Args({8, 32})
+    ->UseRealTime();
@@ -0,0 +1,141 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+/* Packs records into blocks with WriteRecordToBlock() like the sd does while
+ * appending to a volume and unpacks them with ReadRecordFromBlock() like it
+ * does while reading one.  Records of up to a few KiB fit into a block as a
+ * whole, larger ones span two or more blocks. */
+
+#include <benchmark/benchmark.h>
+#include "include/bareos.h"
+#include "include/streams.h"
+#include "stored/stored.h"
+#include "stored/device_control_record.h"
+#include "stored/backends/unix_file_device.h"
+
+#include <vector>
+
+namespace bm = benchmark;
+using namespace storagedaemon;
+
+static constexpr uint32_t block_size = 512 * 126; /* DEFAULT_BLOCK_SIZE */
+static constexpr std::size_t data_per_iteration = 16 * 1024 * 1024;
+
+class RecordBlocks {
+ public:
+  RecordBlocks()
+  {
+    dev_.max_block_size = block_size;
+    dcr_.dev = &dev_;
+    dcr_.block = new_block(&dev_);
+    dcr_.block->VolSessionId = 1;
+    dcr_.block->VolSessionTime = 1;
+    rec_ = new_record();
+  }
+
+  ~RecordBlocks()
+  {
+    FreeRecord(rec_);
+    FreeBlock(dcr_.block);
+  }
+
+  // packs the records, full blocks are kept if keep is set
+  void Pack(uint32_t record_size, bool keep)
+  {
+    DeviceBlock* block = dcr_.block;
+    rec_->data = CheckPoolMemorySize(rec_->data, record_size);
+    memset(rec_->data, 'r', record_size);
+    rec_->data_len = record_size;
+    rec_->VolSessionId = 1;
+    rec_->VolSessionTime = 1;
+    rec_->Stream = STREAM_FILE_DATA;
+
+    for (std::size_t i = 0; i < data_per_iteration / record_size; ++i) {
+      rec_->FileIndex = i + 1;
+      while (!WriteRecordToBlock(&dcr_, rec_)) { Flush(block, keep); }
+    }
+    Flush(block, keep);
+  }
+
+  // unpacks the kept blocks, returns the number of whole records
+  std::size_t Unpack()
+  {
+    DeviceBlock* block = dcr_.block;
+    std::size_t records = 0;
+    rec_->remainder = 0;
+    for (std::vector<char>& kept : blocks_) {
+      block->BlockVer = 2;
+      block->bufp = kept.data() + WRITE_BLKHDR_LENGTH;
+      block->binbuf = kept.size() - WRITE_BLKHDR_LENGTH;
+      while (ReadRecordFromBlock(&dcr_, rec_)) {
+        if (!rec_->remainder) { records += 1; }
+      }
+    }
+    EmptyBlock(block);
+    return records;
+  }
+
+ private:
+  void Flush(DeviceBlock* block, bool keep)
+  {
+    if (keep && block->binbuf > WRITE_BLKHDR_LENGTH) {
+      blocks_.emplace_back(block->buf, block->buf + block->binbuf);
+    }
+    bm::DoNotOptimize(block->buf);
+    EmptyBlock(block);
+  }
+
+  unix_file_device dev_;
+  DeviceControlRecord dcr_;
+  DeviceRecord* rec_{nullptr};
+  std::vector<std::vector<char>> blocks_;
+};
+
+static void BM_PackRecords(bm::State& state)
+{
+  const uint32_t record_size = state.range(0);
+  RecordBlocks blocks;
+  for (auto _ : state) { blocks.Pack(record_size, false); }
+  state.SetBytesProcessed(state.iterations() * data_per_iteration);
+}
+
+static void BM_UnpackRecords(bm::State& state)
+{
+  const uint32_t record_size = state.range(0);
+  RecordBlocks blocks;
+  blocks.Pack(record_size, true);
+  for (auto _ : state) {
+    if (blocks.Unpack() != data_per_iteration / record_size) {
+      state.SkipWithError("records got lost");
+      break;
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * data_per_iteration);
+}
+
+static void RecordSizes(bm::internal::Benchmark* b)
+{
+  b->ArgName("record_size");
+  for (int64_t size : {64, 512, 4096, 65536, 1024 * 1024}) { b->Arg(size); }
+}
+
+BENCHMARK(BM_PackRecords)->Apply(RecordSizes);
+BENCHMARK(BM_UnpackRecords)->Apply(RecordSizes);
@@ -0,0 +1,130 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+/* Matches the paths of a file list against the regular expressions of
+ * fileset options, once with regexec() and once with the backtracking
+ * matcher it replaced.  The last pattern makes the backtracker try every way
+ * to split a path into the nested repetitions. */
+
+#include <benchmark/benchmark.h>
+#include "include/bareos.h"
+#include "lib/bregex.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+namespace bm = benchmark;
+
+static constexpr const char* patterns[] = {
+    "\\.(o|so|a|tmp|swp)$",
+    "^/home/[^/]+/\\.cache/",
+    "/(node_modules|\\.git|__pycache__)/",
+    "^/var/(log|spool)/.*\\.[0-9]+(\\.gz)?$",
+    "^(/.*)*/x$",
+};
+
+static std::vector<std::string> paths;
+
+static bool init_paths()
+{
+  static constexpr const char* parts[]
+      = {"home", "user",    "src",  "bareos", ".cache", "node_modules",
+         "var",  "log",     ".git", "lib",    "build",  "__pycache__",
+         "core", "plugins", "doc",  "tests"};
+  static constexpr const char* names[]
+      = {"main.cc", "bregex.o", "messages.1.gz", "README", "libbareos.so",
+         "notes.txt.swp", "index.html", "data.json"};
+  std::mt19937 gen32;
+  for (int i = 0; i < 10000; ++i) {
+    std::string path;
+    for (int depth = 2 + gen32() % 8; depth > 0; --depth) {
+      path += '/';
+      path += parts[gen32() % std::size(parts)];
+    }
+    path += '/';
+    path += names[gen32() % std::size(names)];
+    paths.push_back(std::move(path));
+  }
+  return true;
+}
+[[maybe_unused]] static bool paths_initialized = init_paths();
+
+template <bool backtracking>
+static void BM_MatchPaths(bm::State& state)
+{
+  regex_t preg;
+  if (regcomp(&preg, patterns[state.range(0)], REG_EXTENDED) != 0) {
+    state.SkipWithError("could not compile the pattern");
+    return;
+  }
+  state.SetLabel(patterns[state.range(0)]);
+
+  for (auto _ : state) {
+    std::size_t matches = 0;
+    for (const std::string& path : paths) {
+      int rc = backtracking
+                   ? RegexecBacktracking(&preg, path.c_str(), 0, nullptr, 0)
+                   : regexec(&preg, path.c_str(), 0, nullptr, 0);
+      if (rc == 0) { matches += 1; }
+    }
+    bm::DoNotOptimize(matches);
+  }
+  state.SetItemsProcessed(state.iterations() * paths.size());
+  regfree(&preg);
+}
+
+// the same with the match positions, like the where regexps of restores
+template <bool backtracking>
+static void BM_MatchPathsWithSubmatches(bm::State& state)
+{
+  regex_t preg;
+  if (regcomp(&preg, patterns[state.range(0)], REG_EXTENDED) != 0) {
+    state.SkipWithError("could not compile the pattern");
+    return;
+  }
+  state.SetLabel(patterns[state.range(0)]);
+
+  regmatch_t pmatch[10];
+  for (auto _ : state) {
+    for (const std::string& path : paths) {
+      if (backtracking) {
+        RegexecBacktracking(&preg, path.c_str(), 10, pmatch, 0);
+      } else {
+        regexec(&preg, path.c_str(), 10, pmatch, 0);
+      }
+      bm::DoNotOptimize(pmatch);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * paths.size());
+  regfree(&preg);
+}
+
+static void Patterns(bm::internal::Benchmark* b)
+{
+  b->ArgName("pattern");
+  for (std::size_t i = 0; i < std::size(patterns); ++i) { b->Arg(i); }
+}
+
+BENCHMARK_TEMPLATE(BM_MatchPaths, false)->Apply(Patterns);
+BENCHMARK_TEMPLATE(BM_MatchPaths, true)->Apply(Patterns);
+BENCHMARK_TEMPLATE(BM_MatchPathsWithSubmatches, false)->Apply(Patterns);
+BENCHMARK_TEMPLATE(BM_MatchPathsWithSubmatches, true)->Apply(Patterns);
@@ -121,6 +121,9 @@ void PopulateTree(int quantity, TreeContext* t_tree)
 static void BM_populatetree(benchmark::State& state)
 {
   for (auto _ : state) { PopulateTree(state.range(0), &tree); }
+  state.counters["tree_memory"] = benchmark::Counter(
+      tree.root->total_size, benchmark::Counter::kDefaults,
+      benchmark::Counter::OneK::kIs1024);
 }
 
 static void BM_markallfiles(benchmark::State& state)
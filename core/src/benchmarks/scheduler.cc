@@ -0,0 +1,104 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include <benchmark/benchmark.h>
+#include "include/bareos.h"
+#include "dird/dird_conf.h"
+#include "dird/dird_globals.h"
+#include "dird/scheduler_private.h"
+#include "dird/scheduler_time_adapter.h"
+#include "lib/parse_conf.h"
+#include "tests/scheduler_time_source.h"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+using namespace directordaemon;
+namespace bm = benchmark;
+namespace fs = std::filesystem;
+
+class SimulatedTimeAdapter : public SchedulerTimeAdapter {
+ public:
+  SimulatedTimeAdapter()
+      : SchedulerTimeAdapter(std::make_unique<SimulatedTimeSource>())
+  {
+    default_wait_interval_ = 60;
+  }
+};
+
+/* The scheduler-hourly test configuration with jobs jobs spread over
+ * schedules schedules with three runs each. */
+static fs::path WriteConfig(int jobs, int schedules)
+{
+  fs::path dir = fs::temp_directory_path()
+                 / ("bareos-scheduler-benchmark-" + std::to_string(getpid()));
+  fs::remove_all(dir);
+  fs::copy(SCHEDULER_TEST_CONFIG, dir, fs::copy_options::recursive);
+
+  std::ofstream schedule_file(dir / "bareos-dir.d/schedule/benchmark.conf");
+  for (int i = 0; i < schedules; i++) {
+    schedule_file << "Schedule {\n"
+                  << "  Name = \"schedule-" << i << "\"\n"
+                  << "  Run = Level=Full 1st sun at " << i % 24 << ":05\n"
+                  << "  Run = Level=Differential mon-fri at " << i % 24
+                  << ":" << 10 + i % 50 << "\n"
+                  << "  Run = Level=Incremental hourly\n"
+                  << "}\n";
+  }
+
+  std::ofstream job_file(dir / "bareos-dir.d/job/benchmark.conf");
+  for (int i = 0; i < jobs; i++) {
+    job_file << "Job {\n"
+             << "  Name = \"job-" << i << "\"\n"
+             << "  JobDefs = \"HourlyDefaultJob\"\n"
+             << "  Schedule = \"schedule-" << i % schedules << "\"\n"
+             << "}\n";
+  }
+
+  return dir;
+}
+
+// what the scheduler does whenever its queue ran empty
+static void BM_FillSchedulerQueue(bm::State& state)
+{
+  OSDependentInit();
+  fs::path dir = WriteConfig(state.range(0), state.range(1));
+  my_config = InitDirConfig(dir.c_str(), M_ERROR_TERM);
+  my_config->ParseConfig();
+
+  SchedulerPrivate scheduler(std::make_unique<SimulatedTimeAdapter>(),
+                             [](JobControlRecord*) {});
+  for (auto _ : state) {
+    scheduler.FillSchedulerJobQueueOrSleep();
+    scheduler.prioritised_job_item_queue.Clear();
+  }
+
+  delete my_config;
+  my_config = nullptr;
+  fs::remove_all(dir);
+}
+
+BENCHMARK(BM_FillSchedulerQueue)
+    ->Args({100, 10})
+    ->Args({1000, 10})
+    ->Args({8000, 20})
+    ->Unit(bm::kMillisecond);
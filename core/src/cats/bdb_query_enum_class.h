@@ -91,7 +91,18 @@ class BareosDbQueryEnum {
     subscription_select_backup_unit_total_1 = 80,
     subscription_select_unclassified_client_fileset_0 = 81,
     subscription_select_unclassified_amount_data_0 = 82,
-    SQL_QUERY_NUMBER = 83
+    uar_create_restore_selection_0 = 83,
+    uar_del_restore_selection_0 = 84,
+    uar_jobid_fileindex_from_selection_3 = 85,
+    uar_jobids_fileindex_from_selection_3 = 86,
+    uar_jobid_fileindex_from_dir_selection_2 = 87,
+    bvfs_list_files_after_1 = 88,
+    bvfs_ls_sub_dirs_after_1 = 89,
+    bvfs_lsdirs_after_2 = 90,
+    bvfs_find_files_6 = 91,
+    bvfs_find_files_name_1 = 92,
+    bvfs_find_files_path_1 = 93,
+    SQL_QUERY_NUMBER = 94
   };
 };
 
@@ -34,6 +34,8 @@
 #  include "cats/bvfs.h"
 #  include "lib/edit.h"
 
+#  include <string>
+#  include <string_view>
 #  include <unordered_set>
 
 #  define dbglevel 10
@@ -283,6 +285,32 @@ void BareosDb::BvfsUpdateCache(JobControlRecord* jcr)
   EndTransaction(jcr);
 }
 
+// Number of jobs BvfsUpdateCache() considers and how many of them are cached
+bool BareosDb::BvfsGetCacheCoverage(JobControlRecord* jcr,
+                                    uint64_t& cached_jobs,
+                                    uint64_t& total_jobs)
+{
+  SQL_ROW row;
+  DbLocker _{this};
+
+  Mmsg(cmd,
+       "SELECT COUNT(*), "
+       "COALESCE(SUM(CASE WHEN HasCache = 1 THEN 1 ELSE 0 END), 0) "
+       "FROM Job "
+       "WHERE Type IN ('B','A','a') AND JobStatus IN ('T', 'W', 'f', 'A')");
+  if (!QueryDb(jcr, cmd)) { return false; }
+
+  bool retval = false;
+  if ((row = SqlFetchRow()) != NULL) {
+    total_jobs = str_to_uint64(row[0]);
+    cached_jobs = str_to_uint64(row[1]);
+    retval = true;
+  }
+  SqlFreeResult();
+
+  return retval;
+}
+
 // Update the bvfs cache for given jobids (1,2,3,4)
 bool BareosDb::BvfsUpdatePathHierarchyCache(JobControlRecord* jcr,
                                             const char* jobids)
@@ -369,7 +397,8 @@ Bvfs::Bvfs(JobControlRecord* j, BareosDb* mdb)
   jobids = GetPoolMemory(PM_NAME);
   prev_dir = GetPoolMemory(PM_NAME);
   pattern = GetPoolMemory(PM_NAME);
-  *jobids = *prev_dir = *pattern = 0;
+  after = GetPoolMemory(PM_NAME);
+  *jobids = *prev_dir = *pattern = *after = 0;
   pwd_id = 0;
   see_copies = false;
   see_all_versions = false;
@@ -384,6 +413,7 @@ Bvfs::~Bvfs()
 {
   FreePoolMemory(jobids);
   FreePoolMemory(pattern);
+  FreePoolMemory(after);
   FreePoolMemory(prev_dir);
   FreeAttr(attr);
   jcr->DecUseCount();
@@ -565,12 +595,24 @@ bool Bvfs::ls_dirs()
   if (*pattern) {
     db->FillQuery(filter, BareosDb::SQL_QUERY::match_query, pattern);
   }
+  if (*after) {
+    PoolMem after_filter(PM_MESSAGE);
+    db->FillQuery(after_filter, BareosDb::SQL_QUERY::bvfs_ls_sub_dirs_after_1,
+                  after);
+    PmStrcat(filter, after_filter.c_str());
+  }
   db->FillQuery(sub_dirs_query, BareosDb::SQL_QUERY::bvfs_ls_sub_dirs_5, pathid,
                 jobids, jobids, filter.c_str(), jobids);
 
-  db->FillQuery(union_query, BareosDb::SQL_QUERY::bvfs_lsdirs_4,
-                special_dirs_query.c_str(), sub_dirs_query.c_str(), limit,
-                offset);
+  if (*after) {
+    // "." and ".." only are on the first page
+    db->FillQuery(union_query, BareosDb::SQL_QUERY::bvfs_lsdirs_after_2,
+                  sub_dirs_query.c_str(), limit);
+  } else {
+    db->FillQuery(union_query, BareosDb::SQL_QUERY::bvfs_lsdirs_4,
+                  special_dirs_query.c_str(), sub_dirs_query.c_str(), limit,
+                  offset);
+  }
 
   /* FIXME: BvfsLsDirs does not return number of results */
   nb_record = db->BvfsLsDirs(union_query, this);
@@ -613,8 +655,94 @@ bool Bvfs::ls_files()
     db->FillQuery(filter, BareosDb::SQL_QUERY::match_query2, pattern);
   }
 
+  /* The PostgreSQL query is ordered by the file name, so it can continue
+   * behind the last one instead of skipping offset files. */
+  int64_t skip = offset;
+  if (*after && db->GetTypeIndex() == SQL_TYPE_POSTGRESQL) {
+    PoolMem after_filter(PM_MESSAGE);
+    db->FillQuery(after_filter, BareosDb::SQL_QUERY::bvfs_list_files_after_1,
+                  after);
+    PmStrcat(filter, after_filter.c_str());
+    skip = 0;
+  }
+
   build_ls_files_query(jcr, db, query, jobids, pathid, filter.c_str(), limit,
-                       offset);
+                       skip);
+  nb_record = db->BvfsBuildLsFileQuery(query, list_entries, user_data);
+
+  return nb_record == limit;
+}
+
+/* A shell pattern as a LIKE pattern: * and ? become % and _, a % or _ of the
+ * pattern is quoted.  A bracket expression matches any single character. */
+static std::string GlobToLike(std::string_view glob)
+{
+  std::string like;
+  for (std::size_t i = 0; i < glob.size(); ++i) {
+    switch (glob[i]) {
+      case '*':
+        like += '%';
+        break;
+      case '?':
+        like += '_';
+        break;
+      case '[': {
+        std::size_t end = glob.find(']', i + 2);
+        if (end == std::string_view::npos) {
+          like += '[';
+        } else {
+          like += '_';
+          i = end;
+        }
+        break;
+      }
+      case '\\':
+        if (i + 1 < glob.size()) { ++i; }
+        [[fallthrough]];
+      default:
+        if (glob[i] == '%' || glob[i] == '_' || glob[i] == '\\') {
+          like += '\\';
+        }
+        like += glob[i];
+        break;
+    }
+  }
+  return like;
+}
+
+bool Bvfs::find_files(const char* glob)
+{
+  PoolMem filter(PM_MESSAGE);
+  PoolMem query(PM_MESSAGE);
+  PoolMem esc(PM_MESSAGE);
+
+  Dmsg1(dbglevel, "find_files(%s)\n", glob);
+  if (*jobids == 0) { return false; }
+
+  // the directory part (with its slash) is matched against Path.Path
+  std::string_view name{glob};
+  std::size_t slash = name.rfind('/');
+  if (slash != std::string_view::npos) {
+    std::string like = GlobToLike(name.substr(0, slash + 1));
+    esc.check_size(like.size() * 2 + 1);
+    db->EscapeString(jcr, esc.c_str(), like.c_str(), like.size());
+    db->FillQuery(filter, BareosDb::SQL_QUERY::bvfs_find_files_path_1,
+                  esc.c_str());
+    name.remove_prefix(slash + 1);
+  }
+  if (!name.empty()) {
+    PoolMem name_filter(PM_MESSAGE);
+    std::string like = GlobToLike(name);
+    esc.check_size(like.size() * 2 + 1);
+    db->EscapeString(jcr, esc.c_str(), like.c_str(), like.size());
+    db->FillQuery(name_filter, BareosDb::SQL_QUERY::bvfs_find_files_name_1,
+                  esc.c_str());
+    PmStrcat(filter, name_filter.c_str());
+  }
+
+  db->FillQuery(query, BareosDb::SQL_QUERY::bvfs_find_files_6, jobids,
+                filter.c_str(), jobids, filter.c_str(), (int64_t)limit,
+                (int64_t)offset);
   nb_record = db->BvfsBuildLsFileQuery(query, list_entries, user_data);
 
   return nb_record == limit;
@@ -78,6 +78,16 @@ class Bvfs {
     db->EscapeString(jcr, pattern, p, len);
   }
 
+  /* Continue behind the last entry of the previous page (the name of a file
+   * for ls_files(), the full path of a directory for ls_dirs()) instead of
+   * skipping offset entries */
+  void SetAfter(const char* name)
+  {
+    uint32_t len = strlen(name);
+    after = CheckPoolMemorySize(after, len * 2 + 1);
+    db->EscapeString(jcr, after, name, len);
+  }
+
   /* Get the root point */
   DBId_t get_root();
 
@@ -94,6 +104,10 @@ class Bvfs {
 
   bool ls_files(); /* Returns true if we have more files to read */
   bool ls_dirs();  /* Returns true if we have more dir to read */
+  /* Files of any directory matching a shell pattern, on the name or with a
+   * slash on the full path, see .bvfs_find.  Returns true if we have more
+   * files to read */
+  bool find_files(const char* glob);
   void GetAllFileVersions(const char* path,
                           const char* fname,
                           const char* client);
@@ -109,7 +123,11 @@ class Bvfs {
     user_data = ctx;
   }
 
-  void ResetOffset() { offset = 0; }
+  void ResetOffset()
+  {
+    offset = 0;
+    *after = 0;
+  }
 
   /* Clear all cache */
   void clear_cache();
@@ -137,6 +155,7 @@ class Bvfs {
   uint32_t offset;
   uint32_t nb_record; /* number of records of the last query */
   POOLMEM* pattern;
+  POOLMEM* after; /* keyset cursor, see SetAfter() */
   DBId_t pwd_id;     /* Current pathid */
   POOLMEM* prev_dir; /* ls_dirs query returns all versions, take the 1st one */
   Attributes* attr;  /* Can be use by handler to call DecodeStat() */
@@ -37,6 +37,7 @@
 
 #include "include/bareos.h"
 #include "cats/column_data.h"
+#include "cats/path_id_cache.h"
 #include "lib/bstringlist.h"
 #include "lib/output_formatter.h"
 #include "lib/crypto.h"
@@ -46,6 +47,7 @@
 #include <string>
 #include <stdexcept>
 #include <system_error>
+#include <type_traits>
 #include <vector>
 template <typename T> class dlist;
 
@@ -427,6 +429,50 @@ class db_int64_ctx {
       const db_int64_ctx&); /**< prohibit class assignment */
 };
 
+/**
+ * A statement that is only parsed and planned once per connection, $1, $2,
+ * ... in its text are replaced by the parameters, which are never part of
+ * the text and so do not need to be escaped.  The server infers the types
+ * of the parameters from where they are used (e.g. "WHERE JobId=$1").
+ */
+struct prepared_statement {
+  const char* name;
+  const char* query;
+};
+
+// the parameters of a prepared statement, all of them are sent as text
+class SqlParameters {
+ public:
+  template <typename T> SqlParameters& Add(T value)
+  {
+    if constexpr (std::is_same_v<T, bool>) {
+      values_.emplace_back(value ? "1" : "0");
+    } else if constexpr (std::is_same_v<T, char>) {
+      values_.emplace_back(1, value);
+    } else if constexpr (std::is_integral_v<T>) {
+      values_.emplace_back(std::to_string(value));
+    } else {
+      values_.emplace_back(value);
+    }
+    pointers_.clear();
+    return *this;
+  }
+
+  int size() const { return static_cast<int>(values_.size()); }
+  const char* const* values() const
+  {
+    if (pointers_.size() != values_.size()) {
+      pointers_.clear();
+      for (auto& value : values_) { pointers_.push_back(value.c_str()); }
+    }
+    return pointers_.data();
+  }
+
+ private:
+  std::vector<std::string> values_;
+  mutable std::vector<const char*> pointers_;
+};
+
 /**
  * Call back context for getting a list of comma separated strings from the
  * database
@@ -511,6 +557,10 @@ class BareosDb : public BareosDbQueryEnum {
   int changes = 0;         /**< Changes during transaction */
   int fnl = 0;             /**< File name length */
   int pnl = 0;             /**< Path name length */
+  uint32_t batch_partitions_ = 1; /**< Connections used for the batch table */
+  uint32_t purge_chunk_size_ = 0;  /**< File records deleted per statement */
+  uint32_t purge_chunk_pause_ = 0; /**< Milliseconds between two of them */
+  std::vector<BareosDb*> batch_parts_{}; /**< Additional batch connections */
   bool disabled_batch_insert_
       = false;                 /**< Explicitly disabled batch insert mode ? */
   bool is_private_ = false;    /**< Private connection ? */
@@ -519,6 +569,9 @@ class BareosDb : public BareosDbQueryEnum {
   POOLMEM* fname = nullptr;    /**< Filename only */
   POOLMEM* path = nullptr;     /**< Path only */
   POOLMEM* cached_path = nullptr;   /**< Cached path name */
+  std::shared_ptr<PathIdCache> path_ids_{}; /**< Shared by the connections */
+  // PathIds inserted by the open transaction, only shared once it is committed
+  std::vector<std::pair<std::string, uint32_t>> uncommitted_path_ids_{};
   POOLMEM* esc_name = nullptr;      /**< Escaped file name */
   POOLMEM* esc_path = nullptr;      /**< Escaped path name */
   POOLMEM* esc_obj = nullptr;       /**< Escaped restore object */
@@ -528,6 +581,11 @@ class BareosDb : public BareosDbQueryEnum {
   static const char* query_names[]; /**< table of query names */
   int num_rows_ = 0; /**< Number of rows returned by last query */
 
+ protected:
+  // after the transaction has been committed or rolled back
+  void PublishPathIds();
+  void DiscardPathIds();
+
  private:
   int GetFilenameRecord(JobControlRecord* jcr);
   bool CreateBatchFileAttributesRecord(JobControlRecord* jcr,
@@ -569,10 +627,14 @@ class BareosDb : public BareosDbQueryEnum {
   bool BatchInsertAvailable(void) { return have_batch_insert_; }
   bool IsPrivate(void) { return is_private_; }
   void IncrementRefcount(void) { ref_count_++; }
+  uint32_t GetRefcount(void) const { return ref_count_; }
 
   /* bvfs.c */
   bool BvfsUpdatePathHierarchyCache(JobControlRecord* jcr, const char* jobids);
   void BvfsUpdateCache(JobControlRecord* jcr);
+  bool BvfsGetCacheCoverage(JobControlRecord* jcr,
+                            uint64_t& cached_jobs,
+                            uint64_t& total_jobs);
   int BvfsLsDirs(PoolMem& query, void* ctx);
   int BvfsBuildLsFileQuery(PoolMem& query,
                            DB_RESULT_HANDLER* ResultHandler,
@@ -602,6 +664,21 @@ class BareosDb : public BareosDbQueryEnum {
                const char* UpdateCmd,
                libbareos::source_location loc
                = libbareos::source_location::current());
+  bool QueryDb(JobControlRecord* jcr,
+               const prepared_statement& stmt,
+               const SqlParameters& params,
+               libbareos::source_location loc
+               = libbareos::source_location::current());
+  int InsertDb(JobControlRecord* jcr,
+               const prepared_statement& stmt,
+               const SqlParameters& params,
+               libbareos::source_location loc
+               = libbareos::source_location::current());
+  int UpdateDb(JobControlRecord* jcr,
+               const prepared_statement& stmt,
+               const SqlParameters& params,
+               libbareos::source_location loc
+               = libbareos::source_location::current());
   int GetSqlRecordMax(JobControlRecord* jcr);
   void SplitPathAndFile(JobControlRecord* jcr, const char* fname);
   int ListResult(void* vctx, int nb_col, char** row);
@@ -609,13 +686,28 @@ class BareosDb : public BareosDbQueryEnum {
                  OutputFormatter* send,
                  e_list_type type);
   bool OpenBatchConnection(JobControlRecord* jcr);
+  void CloseBatchPartitions(JobControlRecord* jcr);
+  void SetBatchPartitions(uint32_t partitions)
+  {
+    batch_partitions_ = partitions;
+  }
+  void SetPurgeChunks(uint32_t chunk_size, uint32_t pause_ms)
+  {
+    purge_chunk_size_ = chunk_size;
+    purge_chunk_pause_ = pause_ms;
+  }
   void DbDebugPrint(FILE* fp);
 
   /* sql_create.cc */
  private:
   bool CreateFileRecord(JobControlRecord* jcr, AttributesDbRecord* ar);
   bool CreatePathRecord(JobControlRecord* jcr, AttributesDbRecord* ar);
+  uint32_t FindCachedPathId();
+  void CachePathId(uint32_t PathId, bool inserted = false);
   void CleanupBaseFile(JobControlRecord* jcr);
+  bool MergeBatchTable(JobControlRecord* jcr);
+  BareosDb* BatchPartition(const char* path_name, int len);
+  int BatchChanges();
 
  public:
   bool CreateFileAttributesRecord(JobControlRecord* jcr,
@@ -627,10 +719,21 @@ class BareosDb : public BareosDbQueryEnum {
   bool CreatePoolRecord(JobControlRecord* jcr, PoolDbRecord* pool_dbr);
   int DeleteNullJobmediaRecords(JobControlRecord* jcr, std::uint32_t jobid);
   bool CreateJobmediaRecord(JobControlRecord* jcr, JobMediaDbRecord* jr);
+  bool CreateJobmediaRecords(JobControlRecord* jcr,
+                             const JobMediaDbRecord* jms,
+                             std::size_t count);
   bool CreateCounterRecord(JobControlRecord* jcr, CounterDbRecord* cr);
   bool CreateDeviceRecord(JobControlRecord* jcr, DeviceDbRecord* dr);
   bool CreateStorageRecord(JobControlRecord* jcr, StorageDbRecord* sr);
+  void ForgetPathIds();
   bool CreateMediatypeRecord(JobControlRecord* jcr, MediaTypeDbRecord* mr);
+  // for many resources at once, e.g. when the director starts
+  bool CreateClientRecords(JobControlRecord* jcr,
+                           const std::vector<std::string>& names);
+  bool CreateMediatypeRecords(JobControlRecord* jcr,
+                              const std::vector<std::string>& media_types);
+  bool CreateStorageRecords(JobControlRecord* jcr,
+                            std::vector<StorageDbRecord>& records);
   bool WriteBatchFileRecords(JobControlRecord* jcr);
   bool CreateAttributesRecord(JobControlRecord* jcr, AttributesDbRecord* ar);
   bool CreateRestoreObjectRecord(JobControlRecord* jcr,
@@ -652,12 +755,27 @@ class BareosDb : public BareosDbQueryEnum {
                               DeviceStatisticsDbRecord* dsr);
   bool CreateTapealertStatistics(JobControlRecord* jcr,
                                  TapealertStatsDbRecord* tsr);
+  bool CreateJobStatistics(JobControlRecord* jcr,
+                           const JobStatisticsDbRecord* jsr,
+                           std::size_t count);
+  bool CreateDeviceStatistics(JobControlRecord* jcr,
+                              const DeviceStatisticsDbRecord* dsr,
+                              std::size_t count);
+  bool CreateTapealertStatistics(JobControlRecord* jcr,
+                                 const TapealertStatsDbRecord* tsr,
+                                 std::size_t count);
 
   /* sql_delete.cc */
   bool DeletePoolRecord(JobControlRecord* jcr, PoolDbRecord* pool_dbr);
   bool DeleteMediaRecord(JobControlRecord* jcr, MediaDbRecord* mr);
+  uint64_t DeleteFileRecords(const char* jobids);
   void PurgeFiles(const char* jobids);
   void PurgeJobs(const char* jobids);
+  int DownsampleStatistics(JobControlRecord* jcr,
+                           const char* resolution,
+                           time_t from,
+                           time_t to);
+  int PruneStatistics(JobControlRecord* jcr, time_t before);
 
   /* sql_find.cc */
 
@@ -742,12 +860,14 @@ class BareosDb : public BareosDbQueryEnum {
   bool GetClientRecord(JobControlRecord* jcr, ClientDbRecord* cdbr);
   bool GetCounterRecord(JobControlRecord* jcr, CounterDbRecord* cr);
   bool GetQueryDbids(JobControlRecord* jcr, PoolMem& query, dbid_list& ids);
+  bool GetReplicationLag(JobControlRecord* jcr, int64_t& lag);
   bool GetFileList(JobControlRecord* jcr,
                    const char* jobids,
                    bool use_md5,
                    bool use_delta,
                    DB_RESULT_HANDLER* ResultHandler,
-                   void* ctx);
+                   void* ctx,
+                   bool with_deleted = false);
   bool GetBaseJobid(JobControlRecord* jcr, JobDbRecord* jr, JobId_t* jobid);
   bool AccurateGetJobids(JobControlRecord* jcr,
                          JobDbRecord* jr,
@@ -903,6 +1023,12 @@ class BareosDb : public BareosDbQueryEnum {
   bool SqlQuery(SQL_QUERY query, ...);
   bool SqlQuery(const char* query, int flags = 0);
   bool SqlQuery(const char* query, DB_RESULT_HANDLER* ResultHandler, void* ctx);
+  bool SqlQuery(const prepared_statement& stmt,
+                const SqlParameters& params,
+                int flags = 0);
+  // fills table with rows (of one text value per column) using COPY
+  bool SqlCopyIn(const char* table,
+                 const std::vector<std::vector<std::string>>& rows);
 
   /* sql_update.cc */
   bool UpdateJobStartRecord(JobControlRecord* jcr, JobDbRecord* jr);
@@ -962,6 +1088,7 @@ class BareosDb : public BareosDbQueryEnum {
   virtual void CloseDatabase(JobControlRecord* jcr) = 0;
   virtual void StartTransaction(JobControlRecord* jcr) = 0;
   virtual void EndTransaction(JobControlRecord* jcr) = 0;
+  virtual bool InTransaction() { return false; }
 
   /* By default, we use db_sql_query */
   virtual bool BigSqlQuery(const char* query,
@@ -972,12 +1099,32 @@ class BareosDb : public BareosDbQueryEnum {
   }
 
  private:
+  // the query is the text, or the one of stmt when it is set
+  bool DoQueryDb(JobControlRecord* jcr,
+                 const char* query,
+                 const prepared_statement* stmt,
+                 const SqlParameters* params,
+                 libbareos::source_location loc);
+  int DoInsertDb(JobControlRecord* jcr,
+                 const char* query,
+                 const prepared_statement* stmt,
+                 const SqlParameters* params,
+                 libbareos::source_location loc);
+  int DoUpdateDb(JobControlRecord* jcr,
+                 const char* query,
+                 const prepared_statement* stmt,
+                 const SqlParameters* params,
+                 libbareos::source_location loc);
   virtual char* EscapeObject(JobControlRecord* jcr, char* old, int len);
   virtual void SqlFieldSeek(int field) = 0;
   virtual int SqlNumFields(void) = 0;
   virtual void SqlFreeResult(void) = 0;
   virtual SQL_ROW SqlFetchRow(void) = 0;
   virtual bool SqlQueryWithoutHandler(const char* query, int flags = 0) = 0;
+  virtual bool SqlQueryPrepared(const prepared_statement& stmt,
+                                const SqlParameters& params,
+                                int flags = 0)
+      = 0;
   virtual bool SqlQueryWithHandler(const char* query,
                                    DB_RESULT_HANDLER* ResultHandler,
                                    void* ctx)
@@ -991,6 +1138,9 @@ class BareosDb : public BareosDbQueryEnum {
   virtual SQL_FIELD* SqlFetchField(void) = 0;
   virtual bool SqlFieldIsNotNull(int field_type) = 0;
   virtual bool SqlFieldIsNumeric(int field_type) = 0;
+  virtual bool SqlCopyRows(const char* table,
+                           const std::vector<std::vector<std::string>>& rows)
+      = 0;
   virtual bool SqlBatchStartFileTable(JobControlRecord* jcr) = 0;
   virtual bool SqlBatchEndFileTable(JobControlRecord* jcr, const char* error)
       = 0;
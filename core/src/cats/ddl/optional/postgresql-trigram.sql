@@ -0,0 +1,26 @@
+-- Trigram indexes for file name searches like .bvfs_find pattern=*.conf
+--
+-- A LIKE condition with a leading wildcard cannot use a btree index and
+-- reads the whole File table.  With these indexes PostgreSQL looks up the
+-- rows containing the trigrams of the pattern instead.  They are not part of
+-- the catalog schema: create them on catalogs that are searched by name
+-- often, drop them again when the insert rate of the backups matters more.
+--
+-- psql -d bareos -f postgresql-trigram.sql
+--
+-- The pg_trgm extension ships with the PostgreSQL contrib package, creating
+-- it needs superuser rights (or PostgreSQL 13 and the CREATE privilege).
+
+CREATE EXTENSION IF NOT EXISTS pg_trgm;
+
+CREATE INDEX CONCURRENTLY IF NOT EXISTS file_name_trgm_idx
+  ON File USING gin (Name gin_trgm_ops);
+CREATE INDEX CONCURRENTLY IF NOT EXISTS path_path_trgm_idx
+  ON Path USING gin (Path gin_trgm_ops);
+
+ANALYZE File;
+ANALYZE Path;
+
+-- To remove them:
+-- DROP INDEX CONCURRENTLY IF EXISTS file_name_trgm_idx;
+-- DROP INDEX CONCURRENTLY IF EXISTS path_path_trgm_idx;
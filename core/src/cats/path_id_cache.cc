@@ -0,0 +1,107 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "cats/path_id_cache.h"
+
+#include <algorithm>
+#include <functional>
+#include <map>
+
+PathIdCache::PathIdCache(std::size_t capacity)
+    : shard_capacity_{std::max<std::size_t>(capacity / num_shards, 1)}
+{
+}
+
+std::shared_ptr<PathIdCache> PathIdCache::ForCatalog(const std::string& key)
+{
+  static std::mutex mutex;
+  static std::map<std::string, std::weak_ptr<PathIdCache>> caches;
+
+  std::lock_guard lock{mutex};
+  std::weak_ptr<PathIdCache>& cache = caches[key];
+  std::shared_ptr<PathIdCache> shared = cache.lock();
+  if (!shared) {
+    shared = std::make_shared<PathIdCache>();
+    cache = shared;
+  }
+  return shared;
+}
+
+std::string PathIdCache::CatalogKey(const char* db_name,
+                                    const char* db_address,
+                                    int db_port,
+                                    const char* db_socket)
+{
+  return std::string{db_name ? db_name : ""} + '\n'
+         + (db_address ? db_address : "") + ':' + std::to_string(db_port)
+         + '\n' + (db_socket ? db_socket : "");
+}
+
+PathIdCache::Shard& PathIdCache::ShardOf(std::string_view path)
+{
+  return shards_[std::hash<std::string_view>{}(path) % num_shards];
+}
+
+uint32_t PathIdCache::Find(std::string_view path)
+{
+  Shard& shard = ShardOf(path);
+  std::lock_guard lock{shard.mutex};
+  auto found = shard.index.find(path);
+  if (found == shard.index.end()) { return 0; }
+  shard.entries.splice(shard.entries.begin(), shard.entries, found->second);
+  return found->second->second;
+}
+
+void PathIdCache::Insert(std::string_view path, uint32_t path_id)
+{
+  Shard& shard = ShardOf(path);
+  std::lock_guard lock{shard.mutex};
+  if (auto found = shard.index.find(path); found != shard.index.end()) {
+    found->second->second = path_id;
+    shard.entries.splice(shard.entries.begin(), shard.entries, found->second);
+    return;
+  }
+  if (shard.entries.size() >= shard_capacity_) {
+    shard.index.erase(shard.entries.back().first);
+    shard.entries.pop_back();
+  }
+  shard.entries.emplace_front(std::string{path}, path_id);
+  shard.index.emplace(shard.entries.front().first, shard.entries.begin());
+}
+
+void PathIdCache::Clear()
+{
+  for (Shard& shard : shards_) {
+    std::lock_guard lock{shard.mutex};
+    shard.index.clear();
+    shard.entries.clear();
+  }
+}
+
+std::size_t PathIdCache::size()
+{
+  std::size_t entries = 0;
+  for (Shard& shard : shards_) {
+    std::lock_guard lock{shard.mutex};
+    entries += shard.entries.size();
+  }
+  return entries;
+}
@@ -0,0 +1,81 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#ifndef BAREOS_CATS_PATH_ID_CACHE_H_
+#define BAREOS_CATS_PATH_ID_CACHE_H_
+
+#include <array>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+/* The PathIds of the recently used paths, shared by all connections of a
+ * process to the same catalog.  The attributes of the files of a job come in
+ * directory by directory, but concurrent jobs, the parent directories bvfs
+ * inserts and the traversal order of a file daemon interleave them, so a
+ * connection that only remembers its last path looks up most of them again.
+ *
+ * Only PathIds found by a query or committed are added.  Path rows are never
+ * changed, but pruning a directory deletes them, which clears the cache.  The
+ * orphaned Path records dbcheck deletes from its own process stay cached, so
+ * that check must not run alongside a director.  The entries are spread over
+ * a few independently locked shards, each dropping its least recently used
+ * entry when full. */
+class PathIdCache {
+ public:
+  static constexpr std::size_t default_capacity = 64 * 1024;
+
+  explicit PathIdCache(std::size_t capacity = default_capacity);
+
+  // the cache of a catalog, see CatalogKey()
+  static std::shared_ptr<PathIdCache> ForCatalog(const std::string& key);
+  static std::string CatalogKey(const char* db_name,
+                                const char* db_address,
+                                int db_port,
+                                const char* db_socket);
+
+  // 0 if the path is not cached
+  uint32_t Find(std::string_view path);
+  void Insert(std::string_view path, uint32_t path_id);
+  void Clear();
+  std::size_t size();
+
+ private:
+  static constexpr std::size_t num_shards = 16;
+
+  struct Shard {
+    using Entry = std::pair<std::string, uint32_t>;
+    std::mutex mutex{};
+    std::list<Entry> entries{}; /* most recently used first */
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> index{};
+  };
+
+  Shard& ShardOf(std::string_view path);
+
+  std::size_t shard_capacity_;
+  std::array<Shard, num_shards> shards_{};
+};
+
+#endif  // BAREOS_CATS_PATH_ID_CACHE_H_
@@ -42,7 +42,9 @@
 #  include "postgresql.h"
 #  include "lib/edit.h"
 #  include "lib/berrno.h"
+#  include "lib/lock_profile.h"
 #  include "lib/dlist.h"
+#  include "lib/metrics.h"
 
 /* pull in the generated queries definitions */
 #  include "postgresql_queries.inc"
@@ -107,6 +109,8 @@ BareosDbPostgresql::BareosDbPostgresql(JobControlRecord*,
   cmd = GetPoolMemory(PM_EMSG); /* get command buffer */
   cached_path = GetPoolMemory(PM_FNAME);
   cached_path_id = 0;
+  path_ids_ = PathIdCache::ForCatalog(
+      PathIdCache::CatalogKey(db_name, db_address, db_port, db_socket));
   ref_count_ = 1;
   fname = GetPoolMemory(PM_FNAME);
   path = GetPoolMemory(PM_FNAME);
@@ -195,6 +199,7 @@ bool BareosDbPostgresql::OpenDatabase(JobControlRecord* jcr)
           be.bstrerror(errstat));
     goto bail_out;
   }
+  lock_profile::NameLock(&lock_, std::string{"catalog "} + db_name_);
 
   {
     DbLocker _{this};
@@ -271,7 +276,10 @@ void BareosDbPostgresql::CloseDatabase(JobControlRecord* jcr)
     if (connected_) { SqlFreeResult(); }
     db_list->remove(this);
     if (db_handle_) { PQfinish(db_handle_); }
-    if (RwlIsInit(&lock_)) { RwlDestroy(&lock_); }
+    if (RwlIsInit(&lock_)) {
+      RwlDestroy(&lock_);
+      lock_profile::ForgetLock(&lock_);
+    }
     FreePoolMemory(errmsg);
     FreePoolMemory(cmd);
     FreePoolMemory(cached_path);
@@ -439,7 +447,13 @@ void BareosDbPostgresql::EndTransaction(JobControlRecord* jcr)
 
 
   if (transaction_) {
-    SqlQueryWithoutHandler("COMMIT"); /* end transaction */
+    /* after a failed statement COMMIT rolls the transaction back */
+    bool failed = PQtransactionStatus(db_handle_) != PQTRANS_INTRANS;
+    if (SqlQueryWithoutHandler("COMMIT") && !failed) { /* end transaction */
+      PublishPathIds();
+    } else {
+      DiscardPathIds();
+    }
     transaction_ = false;
     Dmsg1(400, "End PostgreSQL transaction changes=%d\n", changes);
   }
@@ -554,14 +568,48 @@ bool BareosDbPostgresql::SqlQueryWithHandler(const char* query,
  *           false on failure
  */
 bool BareosDbPostgresql::SqlQueryWithoutHandler(const char* query, int)
+{
+  AssertOwnership();
+  Dmsg1(500, "SqlQueryWithoutHandler starts with '%s'\n", query);
+
+  return RunQuery(query, [this, query] { return PQexec(db_handle_, query); });
+}
+
+/**
+ * Like SqlQueryWithoutHandler() but for a statement that is only prepared
+ * once per session, so the server does not have to parse and plan it again
+ * every time.
+ */
+bool BareosDbPostgresql::SqlQueryPrepared(const prepared_statement& stmt,
+                                          const SqlParameters& params,
+                                          int)
+{
+  AssertOwnership();
+  Dmsg1(500, "SqlQueryPrepared starts with %s\n", stmt.name);
+
+  return RunQuery(stmt.query, [this, &stmt, &params]() -> PGresult* {
+    if (prepared_.find(stmt.name) == prepared_.end()) {
+      PGresult* prepare = PQprepare(db_handle_, stmt.name, stmt.query, 0,
+                                    nullptr);
+      if (!prepare || PQresultStatus(prepare) != PGRES_COMMAND_OK) {
+        return prepare;  // reported like a failed query
+      }
+      PQclear(prepare);
+      prepared_.insert(stmt.name);
+    }
+    return PQexecPrepared(db_handle_, stmt.name, params.size(),
+                          params.values(), nullptr, nullptr, 0);
+  });
+}
+
+// runs a query by calling exec and keeps its result
+bool BareosDbPostgresql::RunQuery(const char* query,
+                                  const std::function<PGresult*()>& exec)
 {
   int i;
   bool retry = true;
   bool retval = false;
 
-  AssertOwnership();
-  Dmsg1(500, "SqlQueryWithoutHandler starts with '%s'\n", query);
-
   // We are starting a new query. reset everything.
 retry_query:
   num_rows_ = -1;
@@ -574,10 +622,16 @@ retry_query:
     result_ = NULL;
   }
 
-  for (i = 0; i < 10; i++) {
-    result_ = PQexec(db_handle_, query);
-    if (result_) { break; }
-    Bmicrosleep(5, 0);
+  {
+    static metrics::histogram query_seconds{
+        "bareos_catalog_query_seconds", "Time the catalog needed per query",
+        METRICS_SECONDS_BUCKETS};
+    metrics::scoped_timer timer{query_seconds};
+    for (i = 0; i < 10; i++) {
+      result_ = exec();
+      if (result_) { break; }
+      Bmicrosleep(5, 0);
+    }
   }
 
   status_ = PQresultStatus(result_);
@@ -608,6 +662,7 @@ retry_query:
          * transaction anyway so we better follow our old error path. */
         if (retry) {
           PQreset(db_handle_);
+          prepared_.clear(); /* they went away with the session */
 
           if (PQstatus(db_handle_) == CONNECTION_OK) {
             // Reset the connection settings.
@@ -635,7 +690,7 @@ retry_query:
       goto bail_out;
   }
 
-  Dmsg0(500, "SqlQueryWithoutHandler finishing\n");
+  Dmsg0(500, "RunQuery finishing\n");
   goto ok_out;
 
 bail_out:
@@ -32,7 +32,9 @@
 #  include "cats.h"
 #  include "libpq-fe.h"
 
+#  include <functional>
 #  include <string>
+#  include <unordered_set>
 #  include <vector>
 
 struct AttributesDbRecord;
@@ -74,6 +76,7 @@ class BareosDbPostgresql : public BareosDb {
                       int32_t* len) override;
   void StartTransaction(JobControlRecord* jcr) override;
   void EndTransaction(JobControlRecord* jcr) override;
+  bool InTransaction() override { return transaction_; }
   bool BigSqlQuery(const char* query,
                    DB_RESULT_HANDLER* ResultHandler,
                    void* ctx) override;
@@ -81,6 +84,10 @@ class BareosDbPostgresql : public BareosDb {
                            DB_RESULT_HANDLER* ResultHandler,
                            void* ctx) override;
   bool SqlQueryWithoutHandler(const char* query, int flags = 0) override;
+  bool SqlQueryPrepared(const prepared_statement& stmt,
+                        const SqlParameters& params,
+                        int flags = 0) override;
+  bool RunQuery(const char* query, const std::function<PGresult*()>& exec);
   void SqlFreeResult(void) override;
   SQL_ROW SqlFetchRow(void) override;
   const char* sql_strerror(void) override;
@@ -91,12 +98,15 @@ class BareosDbPostgresql : public BareosDb {
   SQL_FIELD* SqlFetchField(void) override;
   bool SqlFieldIsNotNull(int field_type) override;
   bool SqlFieldIsNumeric(int field_type) override;
+  bool SqlCopyRows(const char* table,
+                   const std::vector<std::vector<std::string>>& rows) override;
   bool SqlBatchStartFileTable(JobControlRecord* jcr) override;
   bool SqlBatchEndFileTable(JobControlRecord* jcr, const char* error) override;
   bool SqlBatchInsertFileTable(JobControlRecord* jcr,
                                AttributesDbRecord* ar) override;
 
   bool CheckDatabaseEncoding(JobControlRecord* jcr);
+  bool FlushCopyBuffer();
 
   int status_ = 0; /**< Status */
   bool fields_fetched_
@@ -114,6 +124,9 @@ class BareosDbPostgresql : public BareosDb {
   PGconn* db_handle_;
   PGresult* result_;
   POOLMEM* buf_; /**< Buffer to manipulate queries */
+  std::string copy_buffer_{}; /**< Pending binary COPY rows */
+  std::unordered_set<std::string> prepared_{}; /**< Names of the statements
+                                                  prepared in this session */
   static const char*
       query_definitions[]; /**< table of predefined sql queries */
 };
@@ -34,9 +34,142 @@
 #  include "lib/berrno.h"
 #  include "lib/dlist.h"
 
+#  include <netinet/in.h>
+
+/* The batch table is filled with COPY in binary format.  Compared to the
+ * text format no field has to be escaped or formatted; the rows are just
+ * appended to copy_buffer_, which is handed to libpq once it is large
+ * enough. */
+namespace {
+constexpr std::size_t copy_flush_size = 1024 * 1024;
+// the terminating zero is part of the signature
+constexpr char copy_signature[] = "PGCOPY\n\377\r\n";
+constexpr int16_t batch_fields = 9;
+
+void PutInt16(std::string& buf, uint16_t value)
+{
+  value = htons(value);
+  buf.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void PutInt32(std::string& buf, uint32_t value)
+{
+  value = htonl(value);
+  buf.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void PutInt16Field(std::string& buf, int16_t value)
+{
+  PutInt32(buf, sizeof(value));
+  PutInt16(buf, value);
+}
+
+void PutInt32Field(std::string& buf, int32_t value)
+{
+  PutInt32(buf, sizeof(value));
+  PutInt32(buf, value);
+}
+
+void PutTextField(std::string& buf, const char* text, std::size_t len)
+{
+  PutInt32(buf, len);
+  buf.append(text, len);
+}
+
+// numeric is sent as sign, weight and a list of base 10000 digits
+void PutNumericField(std::string& buf, uint64_t value)
+{
+  uint16_t digits[5];  // 2^64 has 20 decimal digits
+  int16_t ndigits = 0;
+  for (; value > 0; value /= 10000) { digits[ndigits++] = value % 10000; }
+
+  PutInt32(buf, (4 + ndigits) * sizeof(uint16_t));
+  PutInt16(buf, ndigits);
+  PutInt16(buf, ndigits > 0 ? ndigits - 1 : 0); /* weight */
+  PutInt16(buf, 0x0000);                        /* positive */
+  PutInt16(buf, 0);                             /* dscale */
+  while (ndigits > 0) { PutInt16(buf, digits[--ndigits]); }
+}
+
+// a value in the text format of COPY, only a few characters need a backslash
+void PutCopyText(std::string& buf, const std::string& value)
+{
+  for (char c : value) {
+    switch (c) {
+      case '\\':
+        buf += "\\\\";
+        break;
+      case '\t':
+        buf += "\\t";
+        break;
+      case '\n':
+        buf += "\\n";
+        break;
+      case '\r':
+        buf += "\\r";
+        break;
+      default:
+        buf += c;
+        break;
+    }
+  }
+}
+}  // namespace
+
+/**
+ * Fill table with rows in one COPY (in text format, so that the server
+ * converts every value to the type of its column).
+ * Returns: true on success
+ *          false on failure
+ */
+bool BareosDbPostgresql::SqlCopyRows(
+    const char* table,
+    const std::vector<std::vector<std::string>>& rows)
+{
+  AssertOwnership();
+  PoolMem query(PM_MESSAGE);
+  Mmsg(query, "COPY %s FROM STDIN", table);
+
+  SqlFreeResult();
+  result_ = PQexec(db_handle_, query.c_str());
+  bool ok = result_ && PQresultStatus(result_) == PGRES_COPY_IN;
+  PQclear(result_);
+  result_ = nullptr;
+  if (!ok) {
+    Dmsg1(50, "Query failed: %s\n", query.c_str());
+    return false;
+  }
+
+  std::string buf;
+  for (auto& row : rows) {
+    for (std::size_t i = 0; i < row.size(); ++i) {
+      if (i > 0) { buf += '\t'; }
+      PutCopyText(buf, row[i]);
+    }
+    buf += '\n';
+    if (buf.size() >= copy_flush_size) {
+      ok = PQputCopyData(db_handle_, buf.data(), buf.size()) == 1;
+      buf.clear();
+      if (!ok) { break; }
+    }
+  }
+  if (ok && !buf.empty()) {
+    ok = PQputCopyData(db_handle_, buf.data(), buf.size()) == 1;
+  }
+  if (PQputCopyEnd(db_handle_, ok ? nullptr : "aborted") != 1) { ok = false; }
+
+  while (PGresult* res = PQgetResult(db_handle_)) {
+    if (PQresultStatus(res) != PGRES_COMMAND_OK) { ok = false; }
+    PQclear(res);
+  }
+
+  Dmsg2(500, "SqlCopyRows copied %d rows into %s\n", rows.size(), table);
+  return ok;
+}
+
 bool BareosDbPostgresql::SqlBatchStartFileTable(JobControlRecord*)
 {
-  const char* query = "COPY batch FROM STDIN";
+  const char* query = "COPY batch FROM STDIN WITH (FORMAT binary)";
 
   Dmsg0(500, "SqlBatchStartFileTable started\n");
 
@@ -81,6 +214,13 @@ bool BareosDbPostgresql::SqlBatchStartFileTable(JobControlRecord*)
     goto bail_out;
   }
 
+  // file header: signature, flags and length of the header extension
+  copy_buffer_.clear();
+  copy_buffer_.reserve(copy_flush_size + 64 * 1024);
+  copy_buffer_.append(copy_signature, sizeof(copy_signature));
+  PutInt32(copy_buffer_, 0);
+  PutInt32(copy_buffer_, 0);
+
   Dmsg0(500, "SqlBatchStartFileTable finishing\n");
 
   return true;
@@ -94,16 +234,56 @@ bail_out:
   return false;
 }
 
+// Hand the buffered rows to libpq
+bool BareosDbPostgresql::FlushCopyBuffer()
+{
+  int res;
+  int count = 30;
+
+  if (copy_buffer_.empty()) { return true; }
+
+  do {
+    res = PQputCopyData(db_handle_, copy_buffer_.data(), copy_buffer_.size());
+  } while (res == 0 && --count > 0);
+
+  copy_buffer_.clear();
+
+  if (res <= 0) {
+    Dmsg0(500, "we failed\n");
+    status_ = 0;
+    Mmsg1(errmsg, T_("error copying in batch mode: %s"),
+          PQerrorMessage(db_handle_));
+    Dmsg1(500, "failure %s\n", errmsg);
+    return false;
+  }
+
+  return true;
+}
+
 // Set error to something to abort operation
-bool BareosDbPostgresql::SqlBatchEndFileTable(JobControlRecord*,
+bool BareosDbPostgresql::SqlBatchEndFileTable(JobControlRecord* jcr,
                                               const char* error)
 {
   int res;
   int count = 30;
+  bool flushed = true;
   PGresult* pg_result;
 
   Dmsg0(500, "SqlBatchEndFileTable started\n");
 
+  if (error) {
+    copy_buffer_.clear();
+  } else {
+    PutInt16(copy_buffer_, 0xffff); /* file trailer */
+    if (!FlushCopyBuffer()) {
+      Jmsg(jcr, M_ERROR, 0, "%s", errmsg);
+      // abort the COPY, the rows sent so far are incomplete
+      error = T_("could not send the batch rows");
+      flushed = false;
+    }
+  }
+  copy_buffer_.shrink_to_fit();
+
   do {
     res = PQputCopyEnd(db_handle_, error);
   } while (res == 0 && --count > 0);
@@ -132,83 +312,15 @@ bool BareosDbPostgresql::SqlBatchEndFileTable(JobControlRecord*,
 
   Dmsg0(500, "SqlBatchEndFileTable finishing\n");
 
-  return true;
-}
-
-/**
- * Escape strings so that PostgreSQL is happy on COPY
- *
- *   NOTE! len is the length of the old string. Your new
- *         string must be long enough (max 2*old+1) to hold
- *         the escaped output.
- */
-static char* pgsql_copy_escape(char* dest, const char* src, size_t len)
-{
-  char c = '\0';
-
-  while (len > 0 && *src) {
-    switch (*src) {
-      case '\b':
-        c = 'b';
-        break;
-      case '\f':
-        c = 'f';
-        break;
-      case '\n':
-        c = 'n';
-        break;
-      case '\\':
-        c = '\\';
-        break;
-      case '\t':
-        c = 't';
-        break;
-      case '\r':
-        c = 'r';
-        break;
-      case '\v':
-        c = 'v';
-        break;
-      case '\'':
-        c = '\'';
-        break;
-      default:
-        c = '\0';
-        break;
-    }
-
-    if (c) {
-      *dest = '\\';
-      dest++;
-      *dest = c;
-    } else {
-      *dest = *src;
-    }
-
-    len--;
-    src++;
-    dest++;
-  }
-
-  *dest = '\0';
-  return dest;
+  return flushed;
 }
 
-bool BareosDbPostgresql::SqlBatchInsertFileTable(JobControlRecord*,
+bool BareosDbPostgresql::SqlBatchInsertFileTable(JobControlRecord* jcr,
                                                  AttributesDbRecord* ar)
 {
-  int res;
-  int count = 30;
-  size_t len;
   const char* digest;
-  char ed1[50], ed2[50], ed3[50];
 
   AssertOwnership();
-  esc_name = CheckPoolMemorySize(esc_name, fnl * 2 + 1);
-  pgsql_copy_escape(esc_name, fname, fnl);
-
-  esc_path = CheckPoolMemorySize(esc_path, pnl * 2 + 1);
-  pgsql_copy_escape(esc_path, path, pnl);
 
   if (ar->Digest == NULL || ar->Digest[0] == 0) {
     digest = "0";
@@ -216,27 +328,23 @@ bool BareosDbPostgresql::SqlBatchInsertFileTable(JobControlRecord*,
     digest = ar->Digest;
   }
 
-  len = Mmsg(cmd, "%u\t%s\t%s\t%s\t%s\t%s\t%u\t%s\t%s\n", ar->FileIndex,
-             edit_int64(ar->JobId, ed1), esc_path, esc_name, ar->attr, digest,
-             ar->DeltaSeq, edit_uint64(ar->Fhinfo, ed2),
-             edit_uint64(ar->Fhnode, ed3));
-
-  do {
-    res = PQputCopyData(db_handle_, cmd, len);
-  } while (res == 0 && --count > 0);
-
-  if (res == 1) {
-    Dmsg0(500, "ok\n");
-    changes++;
-    status_ = 1;
-  }
-
-  if (res <= 0) {
-    Dmsg0(500, "we failed\n");
-    status_ = 0;
-    Mmsg1(errmsg, T_("error copying in batch mode: %s"),
-          PQerrorMessage(db_handle_));
-    Dmsg1(500, "failure %s\n", errmsg);
+  PutInt16(copy_buffer_, batch_fields);
+  PutInt32Field(copy_buffer_, ar->FileIndex);
+  PutInt32Field(copy_buffer_, ar->JobId);
+  PutTextField(copy_buffer_, path, pnl);
+  PutTextField(copy_buffer_, fname, fnl);
+  PutTextField(copy_buffer_, ar->attr, strlen(ar->attr));
+  PutTextField(copy_buffer_, digest, strlen(digest));
+  PutInt16Field(copy_buffer_, ar->DeltaSeq);
+  PutNumericField(copy_buffer_, ar->Fhinfo);
+  PutNumericField(copy_buffer_, ar->Fhnode);
+
+  changes++;
+  status_ = 1;
+
+  if (copy_buffer_.size() >= copy_flush_size && !FlushCopyBuffer()) {
+    Jmsg(jcr, M_ERROR, 0, "%s", errmsg);
+    return false;
   }
 
   Dmsg0(500, "SqlBatchInsertFileTable finishing\n");
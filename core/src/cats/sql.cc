@@ -201,12 +201,30 @@ bool BareosDb::CheckTablesVersion(JobControlRecord* jcr)
 bool BareosDb::QueryDb(JobControlRecord* jcr,
                        const char* select_cmd,
                        libbareos::source_location loc)
+{
+  return DoQueryDb(jcr, select_cmd, nullptr, nullptr, loc);
+}
+
+bool BareosDb::QueryDb(JobControlRecord* jcr,
+                       const prepared_statement& stmt,
+                       const SqlParameters& params,
+                       libbareos::source_location loc)
+{
+  return DoQueryDb(jcr, stmt.query, &stmt, &params, loc);
+}
+
+bool BareosDb::DoQueryDb(JobControlRecord* jcr,
+                         const char* select_cmd,
+                         const prepared_statement* stmt,
+                         const SqlParameters* params,
+                         libbareos::source_location loc)
 {
   AssertOwnership();
 
   SqlFreeResult();
   Dmsg1(1000, "query: %s\n", select_cmd);
-  if (!SqlQuery(select_cmd, QF_STORE_RESULT)) {
+  if (!(stmt ? SqlQuery(*stmt, *params, QF_STORE_RESULT)
+             : SqlQuery(select_cmd, QF_STORE_RESULT))) {
     msg_(loc.file_name(), loc.line(), errmsg, T_("query %s failed:\n%s\n"),
          select_cmd, sql_strerror());
     j_msg(loc.file_name(), loc.line(), jcr, M_FATAL, 0, "%s", errmsg);
@@ -227,11 +245,28 @@ bool BareosDb::QueryDb(JobControlRecord* jcr,
 int BareosDb::InsertDb(JobControlRecord* jcr,
                        const char* select_cmd,
                        libbareos::source_location loc)
+{
+  return DoInsertDb(jcr, select_cmd, nullptr, nullptr, loc);
+}
+
+int BareosDb::InsertDb(JobControlRecord* jcr,
+                       const prepared_statement& stmt,
+                       const SqlParameters& params,
+                       libbareos::source_location loc)
+{
+  return DoInsertDb(jcr, stmt.query, &stmt, &params, loc);
+}
+
+int BareosDb::DoInsertDb(JobControlRecord* jcr,
+                         const char* select_cmd,
+                         const prepared_statement* stmt,
+                         const SqlParameters* params,
+                         libbareos::source_location loc)
 {
   AssertOwnership();
   int num_rows;
 
-  if (!SqlQuery(select_cmd)) {
+  if (!(stmt ? SqlQuery(*stmt, *params) : SqlQuery(select_cmd))) {
     msg_(loc.file_name(), loc.line(), errmsg, T_("insert %s failed:\n%s\n"),
          select_cmd, sql_strerror());
     j_msg(loc.file_name(), loc.line(), jcr, M_FATAL, 0, "%s", errmsg);
@@ -263,9 +298,26 @@ int BareosDb::InsertDb(JobControlRecord* jcr,
 int BareosDb::UpdateDb(JobControlRecord* jcr,
                        const char* UpdateCmd,
                        libbareos::source_location loc)
+{
+  return DoUpdateDb(jcr, UpdateCmd, nullptr, nullptr, loc);
+}
+
+int BareosDb::UpdateDb(JobControlRecord* jcr,
+                       const prepared_statement& stmt,
+                       const SqlParameters& params,
+                       libbareos::source_location loc)
+{
+  return DoUpdateDb(jcr, stmt.query, &stmt, &params, loc);
+}
+
+int BareosDb::DoUpdateDb(JobControlRecord* jcr,
+                         const char* UpdateCmd,
+                         const prepared_statement* stmt,
+                         const SqlParameters* params,
+                         libbareos::source_location loc)
 {
   AssertOwnership();
-  if (!SqlQuery(UpdateCmd)) {
+  if (!(stmt ? SqlQuery(*stmt, *params) : SqlQuery(UpdateCmd))) {
     msg_(loc.file_name(), loc.line(), errmsg, T_("update %s failed:\n%s\n"),
          UpdateCmd, sql_strerror());
     j_msg(loc.file_name(), loc.line(), jcr, M_ERROR, 0, "%s", errmsg);
@@ -889,9 +941,30 @@ bool BareosDb::OpenBatchConnection(JobControlRecord* jcr)
       return false;
     }
   }
+
+  // Private connections for the additional partitions of the batch table
+  if (multi_db && jcr->db_batch != this
+      && jcr->db_batch->batch_parts_.empty()) {
+    for (uint32_t i = 1; i < batch_partitions_; ++i) {
+      BareosDb* part = CloneDatabaseConnection(jcr, true, true, true);
+      if (!part) {
+        Jmsg(jcr, M_WARNING, 0,
+             T_("Could only open %u of %u batch connections\n"), i,
+             batch_partitions_);
+        break;
+      }
+      jcr->db_batch->batch_parts_.push_back(part);
+    }
+  }
   return true;
 }
 
+void BareosDb::CloseBatchPartitions(JobControlRecord* jcr)
+{
+  for (auto* part : batch_parts_) { part->CloseDatabase(jcr); }
+  batch_parts_.clear();
+}
+
 void BareosDb::DbDebugPrint(FILE* fp)
 {
   fprintf(fp, "BareosDb=%p db_name=%s db_user=%s connected=%s\n", this,
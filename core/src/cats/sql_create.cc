@@ -37,6 +37,12 @@ static const int dbglevel = 100;
 #  include "cats.h"
 #  include "lib/edit.h"
 
+#  include <algorithm>
+#  include <string>
+#  include <thread>
+#  include <unordered_map>
+#  include <vector>
+
 /* -----------------------------------------------------------------------
  *
  *   Generic Routines (or almost generic)
@@ -104,44 +110,66 @@ bool BareosDb::CreateJobRecord(JobControlRecord* jcr, JobDbRecord* jr)
  */
 bool BareosDb::CreateJobmediaRecord(JobControlRecord* jcr, JobMediaDbRecord* jm)
 {
-  DbLocker _{this};
+  return CreateJobmediaRecords(jcr, jm, 1);
+}
 
-  Mmsg(cmd, "SELECT count(*) from JobMedia WHERE JobId=%lu", jm->JobId);
-  int count = GetSqlRecordMax(jcr);
-  if (count < 0) { count = 0; }
-  count++;
+/**
+ * Create the JobMedia records of one job in a row.  The Media records are
+ * updated with the EndFile and EndBlock of the last record on each of them.
+ */
+bool BareosDb::CreateJobmediaRecords(JobControlRecord* jcr,
+                                     const JobMediaDbRecord* jms,
+                                     std::size_t count)
+{
+  if (count == 0) { return true; }
 
-  /* clang-format off */
-  Mmsg(cmd,
-       "INSERT INTO JobMedia (JobId,MediaId,FirstIndex,LastIndex,"
-       "StartFile,EndFile,StartBlock,EndBlock,VolIndex,JobBytes) "
-       "VALUES (%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%llu)",
-       jm->JobId,
-       jm->MediaId,
-       jm->FirstIndex, jm->LastIndex,
-       jm->StartFile, jm->EndFile,
-       jm->StartBlock, jm->EndBlock,
-       count,
-       jm->JobBytes);
-  /* clang-format on */
+  DbLocker _{this};
+
+  Mmsg(cmd, "SELECT count(*) from JobMedia WHERE JobId=%lu", jms[0].JobId);
+  int vol_index = GetSqlRecordMax(jcr);
+  if (vol_index < 0) { vol_index = 0; }
+
+  static constexpr prepared_statement insert_jobmedia{
+      "insert_jobmedia",
+      "INSERT INTO JobMedia (JobId,MediaId,FirstIndex,LastIndex,"
+      "StartFile,EndFile,StartBlock,EndBlock,VolIndex,JobBytes) "
+      "VALUES ($1,$2,$3,$4,$5,$6,$7,$8,$9,$10)"};
+  static constexpr prepared_statement update_media_end{
+      "update_media_end",
+      "UPDATE Media SET EndFile=$1, EndBlock=$2 WHERE MediaId=$3"};
+
+  for (std::size_t i = 0; i < count; ++i) {
+    const JobMediaDbRecord* jm = &jms[i];
+    SqlParameters params;
+    params.Add(jm->JobId)
+        .Add(jm->MediaId)
+        .Add(jm->FirstIndex)
+        .Add(jm->LastIndex)
+        .Add(jm->StartFile)
+        .Add(jm->EndFile)
+        .Add(jm->StartBlock)
+        .Add(jm->EndBlock)
+        .Add(++vol_index)
+        .Add(jm->JobBytes);
+
+    if (InsertDb(jcr, insert_jobmedia, params) != 1) {
+      Mmsg2(errmsg, T_("Create JobMedia record %s failed: ERR=%s\n"),
+            insert_jobmedia.query, sql_strerror());
+      return false;
+    }
 
-  Dmsg0(300, cmd);
-  if (InsertDb(jcr, cmd) != 1) {
-    Mmsg2(errmsg, T_("Create JobMedia record %s failed: ERR=%s\n"), cmd,
-          sql_strerror());
-  } else {
     // Worked, now update the Media record with the EndFile and EndBlock
-    Mmsg(cmd, "UPDATE Media SET EndFile=%lu, EndBlock=%lu WHERE MediaId=%lu",
-         jm->EndFile, jm->EndBlock, jm->MediaId);
-    if (UpdateDb(jcr, cmd) == -1) {
-      Mmsg2(errmsg, T_("Update Media record %s failed: ERR=%s\n"), cmd,
-            sql_strerror());
-    } else {
-      return true;
+    if (i + 1 < count && jms[i + 1].MediaId == jm->MediaId) { continue; }
+    SqlParameters media;
+    media.Add(jm->EndFile).Add(jm->EndBlock).Add(jm->MediaId);
+    if (UpdateDb(jcr, update_media_end, media) == -1) {
+      Mmsg2(errmsg, T_("Update Media record %s failed: ERR=%s\n"),
+            update_media_end.query, sql_strerror());
+      return false;
     }
   }
 
-  return false;
+  return true;
 }
 
 /**
@@ -539,30 +567,235 @@ bool BareosDb::CreateClientRecord(JobControlRecord* jcr, ClientDbRecord* cr)
   return false;
 }
 
+// "('a'),('b'),..." lists of at most rows_per_list escaped names each
+static std::vector<std::string> NameValueLists(
+    BareosDb* db,
+    JobControlRecord* jcr,
+    const std::vector<std::string>& names,
+    const std::vector<int>* numbers = nullptr)
+{
+  constexpr std::size_t rows_per_list = 1000;
+  std::vector<std::string> lists;
+  std::vector<char> esc;
+  for (std::size_t i = 0; i < names.size(); ++i) {
+    if (i % rows_per_list == 0) {
+      lists.emplace_back();
+    } else {
+      lists.back() += ',';
+    }
+    esc.resize(2 * names[i].size() + 1);
+    db->EscapeString(jcr, esc.data(), names[i].c_str(), names[i].size());
+    lists.back() += "('";
+    lists.back() += esc.data();
+    lists.back() += '\'';
+    if (numbers) { lists.back() += "," + std::to_string((*numbers)[i]); }
+    lists.back() += ')';
+  }
+  return lists;
+}
+
+/**
+ * Create the Client records of all the names that do not have one yet, with
+ * multi-row inserts instead of a lookup and an insert per client.
+ */
+bool BareosDb::CreateClientRecords(JobControlRecord* jcr,
+                                   const std::vector<std::string>& names)
+{
+  DbLocker _{this};
+  for (const std::string& values : NameValueLists(this, jcr, names)) {
+    Mmsg(cmd,
+         "INSERT INTO Client (Name,Uname,AutoPrune,FileRetention,JobRetention)"
+         " SELECT v.Name,'',0,0,0 FROM (VALUES %s) AS v(Name)"
+         " WHERE NOT EXISTS (SELECT 1 FROM Client WHERE Client.Name=v.Name)",
+         values.c_str());
+    if (!SqlQuery(cmd)) {
+      Mmsg1(errmsg, T_("Create DB Client records failed. ERR=%s\n"),
+            sql_strerror());
+      return false;
+    }
+  }
+  return true;
+}
+
+// Create the MediaType records that do not exist yet
+bool BareosDb::CreateMediatypeRecords(
+    JobControlRecord* jcr,
+    const std::vector<std::string>& media_types)
+{
+  // several storages usually share a media type
+  std::vector<std::string> unique(media_types);
+  std::sort(unique.begin(), unique.end());
+  unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+
+  DbLocker _{this};
+  for (const std::string& values : NameValueLists(this, jcr, unique)) {
+    Mmsg(cmd,
+         "INSERT INTO MediaType (MediaType,ReadOnly)"
+         " SELECT v.MediaType,0 FROM (VALUES %s) AS v(MediaType)"
+         " WHERE NOT EXISTS"
+         " (SELECT 1 FROM MediaType WHERE MediaType.MediaType=v.MediaType)",
+         values.c_str());
+    if (!SqlQuery(cmd)) {
+      Mmsg1(errmsg, T_("Create DB MediaType records failed. ERR=%s\n"),
+            sql_strerror());
+      return false;
+    }
+  }
+  return true;
+}
+
+static int StorageIdHandler(void* ctx, int, char** row)
+{
+  auto* ids = static_cast<std::unordered_map<std::string, DBId_t>*>(ctx);
+  (*ids)[row[0]] = str_to_int64(row[1]);
+  return 0;
+}
+
+/**
+ * Create the missing ones of these Storage records and update AutoChanger
+ * where it differs, in one statement each for up to a thousand of them.
+ * Sets the StorageId and created of the records.
+ */
+bool BareosDb::CreateStorageRecords(JobControlRecord* jcr,
+                                    std::vector<StorageDbRecord>& records)
+{
+  std::vector<std::string> names;
+  std::vector<int> autochangers;
+  for (const StorageDbRecord& sr : records) {
+    names.push_back(sr.Name);
+    autochangers.push_back(sr.AutoChanger ? 1 : 0);
+  }
+
+  DbLocker _{this};
+  std::unordered_map<std::string, DBId_t> existing, ids;
+  for (const std::string& values : NameValueLists(this, jcr, names)) {
+    Mmsg(cmd,
+         "SELECT Storage.Name,Storage.StorageId FROM Storage"
+         " JOIN (VALUES %s) AS v(Name) ON Storage.Name=v.Name",
+         values.c_str());
+    if (!SqlQuery(cmd, StorageIdHandler, &existing)) { return false; }
+  }
+
+  for (const std::string& values :
+       NameValueLists(this, jcr, names, &autochangers)) {
+    Mmsg(cmd,
+         "INSERT INTO Storage (Name,AutoChanger)"
+         " SELECT v.Name,v.AutoChanger FROM (VALUES %s) AS v(Name,AutoChanger)"
+         " WHERE NOT EXISTS (SELECT 1 FROM Storage WHERE Storage.Name=v.Name)",
+         values.c_str());
+    if (!SqlQuery(cmd)) {
+      Mmsg1(errmsg, T_("Create DB Storage records failed. ERR=%s\n"),
+            sql_strerror());
+      return false;
+    }
+    Mmsg(cmd,
+         "UPDATE Storage SET AutoChanger=v.AutoChanger"
+         " FROM (VALUES %s) AS v(Name,AutoChanger)"
+         " WHERE Storage.Name=v.Name AND Storage.AutoChanger<>v.AutoChanger",
+         values.c_str());
+    if (!SqlQuery(cmd)) {
+      Mmsg1(errmsg, T_("Update DB Storage records failed. ERR=%s\n"),
+            sql_strerror());
+      return false;
+    }
+    Mmsg(cmd,
+         "SELECT Storage.Name,Storage.StorageId FROM Storage"
+         " JOIN (VALUES %s) AS v(Name,AutoChanger) ON Storage.Name=v.Name",
+         values.c_str());
+    if (!SqlQuery(cmd, StorageIdHandler, &ids)) { return false; }
+  }
+
+  for (StorageDbRecord& sr : records) {
+    auto id = ids.find(sr.Name);
+    if (id == ids.end()) {
+      Mmsg1(errmsg, T_("Storage record %s was not created\n"), sr.Name);
+      return false;
+    }
+    sr.StorageId = id->second;
+    sr.created = existing.count(sr.Name) == 0;
+  }
+  return true;
+}
+
 /**
  * Create a Unique record for the Path -- no duplicates
  * Returns: false on failure
  *          true on success with id in cr->ClientId
  */
+// PathId of path if it is the last one or in the shared cache, 0 otherwise
+uint32_t BareosDb::FindCachedPathId()
+{
+  if (cached_path_id != 0 && cached_path_len == pnl
+      && bstrcmp(cached_path, path)) {
+    return cached_path_id;
+  }
+  if (!path_ids_) { return 0; }
+
+  uint32_t PathId = path_ids_->Find(std::string_view{path, std::size_t(pnl)});
+  if (PathId != 0) {
+    cached_path_id = PathId;
+    cached_path_len = pnl;
+    PmStrcpy(cached_path, path);
+  }
+  return PathId;
+}
+
+/* A PathId inserted inside a transaction is not visible to the other
+ * connections and gone again if the transaction is rolled back, so it is
+ * only shared once the transaction is committed. */
+void BareosDb::CachePathId(uint32_t PathId, bool inserted)
+{
+  if (PathId == cached_path_id) { return; }
+  cached_path_id = PathId;
+  cached_path_len = pnl;
+  PmStrcpy(cached_path, path);
+  if (!path_ids_) { return; }
+  if (inserted && InTransaction()) {
+    uncommitted_path_ids_.emplace_back(std::string{path, std::size_t(pnl)},
+                                       PathId);
+  } else {
+    path_ids_->Insert(std::string_view{path, std::size_t(pnl)}, PathId);
+  }
+}
+
+void BareosDb::PublishPathIds()
+{
+  if (path_ids_) {
+    for (auto& [inserted_path, PathId] : uncommitted_path_ids_) {
+      path_ids_->Insert(inserted_path, PathId);
+    }
+  }
+  uncommitted_path_ids_.clear();
+}
+
+void BareosDb::DiscardPathIds()
+{
+  cached_path_id = 0;
+  uncommitted_path_ids_.clear();
+}
+
+// Path records were deleted, none of the cached PathIds can be trusted
+void BareosDb::ForgetPathIds()
+{
+  cached_path_id = 0;
+  uncommitted_path_ids_.clear();
+  if (path_ids_) { path_ids_->Clear(); }
+}
+
 bool BareosDb::CreatePathRecord(JobControlRecord* jcr, AttributesDbRecord* ar)
 {
   bool retval = false;
   SQL_ROW row;
   int num_rows;
 
-  errmsg[0] = 0;
-  esc_name = CheckPoolMemorySize(esc_name, 2 * pnl + 2);
-  EscapeString(jcr, esc_name, path, pnl);
+  static constexpr prepared_statement select_path{
+      "select_path", "SELECT PathId FROM Path WHERE Path=$1"};
 
-  if (cached_path_id != 0 && cached_path_len == pnl
-      && bstrcmp(cached_path, path)) {
-    ar->PathId = cached_path_id;
-    return true;
-  }
+  errmsg[0] = 0;
 
-  Mmsg(cmd, "SELECT PathId FROM Path WHERE Path='%s'", esc_name);
+  if ((ar->PathId = FindCachedPathId()) != 0) { return true; }
 
-  if (QueryDb(jcr, cmd)) {
+  if (QueryDb(jcr, select_path, SqlParameters{}.Add(path))) {
     num_rows = SqlNumRows();
     if (num_rows > 1) {
       char ed1[30];
@@ -582,11 +815,7 @@ bool BareosDb::CreatePathRecord(JobControlRecord* jcr, AttributesDbRecord* ar)
       }
       ar->PathId = str_to_int64(row[0]);
       SqlFreeResult();
-      if (ar->PathId != cached_path_id) {
-        cached_path_id = ar->PathId;
-        cached_path_len = pnl;
-        PmStrcpy(cached_path, path);
-      }
+      CachePathId(ar->PathId);
       ASSERT(ar->PathId);
       retval = true;
       goto bail_out;
@@ -594,6 +823,8 @@ bool BareosDb::CreatePathRecord(JobControlRecord* jcr, AttributesDbRecord* ar)
     SqlFreeResult();
   }
 
+  esc_name = CheckPoolMemorySize(esc_name, 2 * pnl + 2);
+  EscapeString(jcr, esc_name, path, pnl);
   Mmsg(cmd, "INSERT INTO Path (Path) VALUES ('%s')", esc_name);
 
   ar->PathId = SqlInsertAutokeyRecord(cmd, NT_("Path"));
@@ -605,11 +836,7 @@ bool BareosDb::CreatePathRecord(JobControlRecord* jcr, AttributesDbRecord* ar)
     goto bail_out;
   }
 
-  if (ar->PathId != cached_path_id) {
-    cached_path_id = ar->PathId;
-    cached_path_len = pnl;
-    PmStrcpy(cached_path, path);
-  }
+  CachePathId(ar->PathId, true);
   retval = true;
 
 bail_out:
@@ -764,52 +991,41 @@ bool BareosDb::CreateFilesetRecord(JobControlRecord* jcr, FileSetDbRecord* fsr)
  * to avoid duplicates).
  *  - then insert the join between the temp, filename and path tables into file.
  *
+ * If more than one batch connection is configured, the rows are spread over
+ * the temp tables of all of them by the hash of their path.  As every path
+ * then only appears in one temp table, the tables can be merged in parallel;
+ * only filling the Path table is serialized by its lock.
+ *
  * Returns: false on failure
  *          true on success
  */
-bool BareosDb::WriteBatchFileRecords(JobControlRecord* jcr)
+bool BareosDb::MergeBatchTable(JobControlRecord* jcr)
 {
   bool retval = false;
-  int JobStatus = jcr->getJobStatus();
-
-  if (!jcr->batch_started) { /* no files to backup ? */
-    Dmsg0(50, "db_create_file_record : no files\n");
-    return true;
-  }
-
-  DbLocker _{jcr->db_batch};
-
-  Dmsg1(50, "db_create_file_record changes=%u\n", changes);
-
-  jcr->setJobStatus(JS_AttrInserting);
 
-  Jmsg(jcr, M_INFO, 0,
-       "Insert of attributes batch table with %u entries start\n",
-       jcr->db_batch->changes);
-
-  if (!jcr->db_batch->SqlBatchEndFileTable(jcr, NULL)) {
+  if (!SqlBatchEndFileTable(jcr, NULL)) {
     Jmsg1(jcr, M_FATAL, 0, "Batch end %s\n", errmsg);
     goto bail_out;
   }
 
-  if (!jcr->db_batch->SqlQuery(SQL_QUERY::batch_lock_path_query)) {
+  if (!SqlQuery(SQL_QUERY::batch_lock_path_query)) {
     Jmsg1(jcr, M_FATAL, 0, "Lock Path table %s\n", errmsg);
     goto bail_out;
   }
 
-  if (!jcr->db_batch->SqlQuery(SQL_QUERY::batch_fill_path_query)) {
+  if (!SqlQuery(SQL_QUERY::batch_fill_path_query)) {
     Jmsg1(jcr, M_FATAL, 0, "Fill Path table %s\n", errmsg);
-    jcr->db_batch->SqlQuery(SQL_QUERY::batch_unlock_tables_query);
+    SqlQuery(SQL_QUERY::batch_unlock_tables_query);
     goto bail_out;
   }
 
-  if (!jcr->db_batch->SqlQuery(SQL_QUERY::batch_unlock_tables_query)) {
+  if (!SqlQuery(SQL_QUERY::batch_unlock_tables_query)) {
     Jmsg1(jcr, M_FATAL, 0, "Unlock Path table %s\n", errmsg);
     goto bail_out;
   }
 
   /* clang-format off */
-  if (!jcr->db_batch->SqlQuery(
+  if (!SqlQuery(
         "INSERT INTO File (FileIndex, JobId, PathId, Name, LStat, MD5, DeltaSeq, Fhinfo, Fhnode) "
         "SELECT batch.FileIndex, batch.JobId, Path.PathId, "
         "batch.Name, batch.LStat, batch.MD5, batch.DeltaSeq, batch.Fhinfo, batch.Fhnode "
@@ -820,13 +1036,79 @@ bool BareosDb::WriteBatchFileRecords(JobControlRecord* jcr)
   }
   /* clang-format on */
 
-  jcr->setJobStatus(JobStatus); /* reset entry status */
-  Jmsg(jcr, M_INFO, 0, "Insert of attributes batch table done\n");
   retval = true;
 
-
 bail_out:
   SqlQuery("DROP TABLE IF EXISTS batch");
+  changes = 0;
+
+  return retval;
+}
+
+// Number of rows in the batch tables of this batch connection
+int BareosDb::BatchChanges()
+{
+  int total = changes;
+  for (auto* part : batch_parts_) { total += part->changes; }
+  return total;
+}
+
+// Batch connection whose temp table receives the files of the given path
+BareosDb* BareosDb::BatchPartition(const char* path_name, int len)
+{
+  if (batch_parts_.empty()) { return this; }
+
+  uint32_t hash = 2166136261u; /* FNV-1a */
+  for (int i = 0; i < len; ++i) {
+    hash = (hash ^ static_cast<unsigned char>(path_name[i])) * 16777619u;
+  }
+
+  std::size_t index = hash % (batch_parts_.size() + 1);
+  return index == 0 ? this : batch_parts_[index - 1];
+}
+
+bool BareosDb::WriteBatchFileRecords(JobControlRecord* jcr)
+{
+  bool retval = false;
+  int JobStatus = jcr->getJobStatus();
+
+  if (!jcr->batch_started) { /* no files to backup ? */
+    Dmsg0(50, "db_create_file_record : no files\n");
+    return true;
+  }
+
+  DbLocker _{jcr->db_batch};
+
+  Dmsg1(50, "db_create_file_record changes=%u\n", changes);
+
+  jcr->setJobStatus(JS_AttrInserting);
+
+  Jmsg(jcr, M_INFO, 0,
+       "Insert of attributes batch table with %u entries start\n",
+       jcr->db_batch->BatchChanges());
+
+  std::vector<BareosDb*>& parts = jcr->db_batch->batch_parts_;
+  if (parts.empty()) {
+    retval = jcr->db_batch->MergeBatchTable(jcr);
+  } else {
+    std::vector<char> merged(parts.size(), false);
+    std::vector<std::thread> workers;
+    for (std::size_t i = 0; i < parts.size(); ++i) {
+      workers.emplace_back([jcr, part = parts[i], ok = &merged[i]] {
+        DbLocker part_lock{part};
+        *ok = part->MergeBatchTable(jcr);
+      });
+    }
+    retval = jcr->db_batch->MergeBatchTable(jcr);
+    for (auto& worker : workers) { worker.join(); }
+    for (char ok : merged) { retval = retval && ok; }
+  }
+
+  if (retval) {
+    jcr->setJobStatus(JobStatus); /* reset entry status */
+    Jmsg(jcr, M_INFO, 0, "Insert of attributes batch table done\n");
+  }
+
   jcr->batch_started = false;
   changes = 0;
 
@@ -857,7 +1139,7 @@ bool BareosDb::CreateBatchFileAttributesRecord(JobControlRecord* jcr,
   Dmsg1(dbglevel, "Fname=%s\n", ar->fname);
   Dmsg0(dbglevel, "put_file_into_catalog\n");
 
-  if (jcr->batch_started && jcr->db_batch->changes > BATCH_FLUSH) {
+  if (jcr->batch_started && jcr->db_batch->BatchChanges() > BATCH_FLUSH) {
     jcr->db_batch->WriteBatchFileRecords(jcr);
   }
 
@@ -870,13 +1152,29 @@ bool BareosDb::CreateBatchFileAttributesRecord(JobControlRecord* jcr,
       Jmsg(jcr, M_FATAL, 0, "%s", errmsg);
       return false;
     }
+    for (auto* part : jcr->db_batch->batch_parts_) {
+      DbLocker part_lock{part};
+      if (!part->SqlBatchStartFileTable(jcr)) {
+        Mmsg1(errmsg, "Can't start batch mode: ERR=%s", part->strerror());
+        Jmsg(jcr, M_FATAL, 0, "%s", errmsg);
+        return false;
+      }
+    }
     jcr->batch_started = true;
   }
 
   DbLocker batch_lock{jcr->db_batch};
   jcr->db_batch->SplitPathAndFile(jcr, ar->fname);
 
-  return jcr->db_batch->SqlBatchInsertFileTable(jcr, ar);
+  BareosDb* part
+      = jcr->db_batch->BatchPartition(jcr->db_batch->path, jcr->db_batch->pnl);
+  if (part == jcr->db_batch) {
+    return jcr->db_batch->SqlBatchInsertFileTable(jcr, ar);
+  }
+
+  DbLocker part_lock{part};
+  part->SplitPathAndFile(jcr, ar->fname);
+  return part->SqlBatchInsertFileTable(jcr, ar);
 }
 
 /**
@@ -900,7 +1198,7 @@ bool BareosDb::CreateFileAttributesRecord(JobControlRecord* jcr,
   SplitPathAndFile(jcr, ar->fname);
 
   if (!CreatePathRecord(jcr, ar)) { return false; }
-  Dmsg1(dbglevel, "CreatePathRecord: %s\n", esc_name);
+  Dmsg1(dbglevel, "CreatePathRecord: %s\n", path);
 
   /* Now create master File record */
   if (!CreateFileRecord(jcr, ar)) { return false; }
@@ -1273,6 +1571,10 @@ bool BareosDb::CreateNdmpEnvironmentString(JobControlRecord* jcr,
   }
 }
 
+/* Statistics records are inserted with one INSERT of at most this many rows,
+ * the statistics thread collects a few per device and job in every run. */
+static constexpr std::size_t max_statistics_rows = 500;
+
 /**
  * Create a Job Statistics record.
  * Returns: false on failure
@@ -1281,32 +1583,45 @@ bool BareosDb::CreateNdmpEnvironmentString(JobControlRecord* jcr,
 bool BareosDb::CreateJobStatistics(JobControlRecord* jcr,
                                    JobStatisticsDbRecord* jsr)
 {
-  time_t stime;
+  return CreateJobStatistics(jcr, jsr, 1);
+}
+
+// Create count Job Statistics records.
+bool BareosDb::CreateJobStatistics(JobControlRecord* jcr,
+                                   const JobStatisticsDbRecord* jsr,
+                                   std::size_t count)
+{
   char dt[MAX_TIME_LENGTH];
   char ed1[50], ed2[50], ed3[50], ed4[50];
+  PoolMem row(PM_MESSAGE);
 
   DbLocker _{this};
 
-  stime = jsr->SampleTime;
-  ASSERT(stime != 0);
-
-  bstrutime(dt, sizeof(dt), stime);
-
-  Mmsg(cmd,
-       "INSERT INTO JobStats (SampleTime, JobId, JobFiles, JobBytes, DeviceId)"
-       " VALUES ('%s', %s, %s, %s, %s)",
-       dt, edit_int64(jsr->JobId, ed1), edit_uint64(jsr->JobFiles, ed2),
-       edit_uint64(jsr->JobBytes, ed3), edit_int64(jsr->DeviceId, ed4));
-  Dmsg1(200, "Create job stats: %s\n", cmd);
+  for (std::size_t first = 0; first < count; first += max_statistics_rows) {
+    Mmsg(cmd,
+         "INSERT INTO JobStats (SampleTime, JobId, JobFiles, JobBytes, "
+         "DeviceId) VALUES ");
+    std::size_t last = std::min(count, first + max_statistics_rows);
+    for (std::size_t i = first; i < last; ++i) {
+      ASSERT(jsr[i].SampleTime != 0);
+      bstrutime(dt, sizeof(dt), jsr[i].SampleTime);
+      Mmsg(row, "%s('%s', %s, %s, %s, %s)", i == first ? "" : ", ", dt,
+           edit_int64(jsr[i].JobId, ed1), edit_uint64(jsr[i].JobFiles, ed2),
+           edit_uint64(jsr[i].JobBytes, ed3),
+           edit_int64(jsr[i].DeviceId, ed4));
+      PmStrcat(cmd, row);
+    }
+    Dmsg1(200, "Create job stats: %s\n", cmd);
 
-  if (InsertDb(jcr, cmd) != 1) {
-    Mmsg2(errmsg, T_("Create DB JobStats record %s failed. ERR=%s\n"), cmd,
-          sql_strerror());
-    Jmsg(jcr, M_ERROR, 0, "%s", errmsg);
-    return false;
-  } else {
-    return true;
+    if (InsertDb(jcr, cmd) != static_cast<int>(last - first)) {
+      Mmsg2(errmsg, T_("Create DB JobStats record %s failed. ERR=%s\n"), cmd,
+            sql_strerror());
+      Jmsg(jcr, M_ERROR, 0, "%s", errmsg);
+      return false;
+    }
   }
+
+  return true;
 }
 
 /**
@@ -1317,50 +1632,64 @@ bool BareosDb::CreateJobStatistics(JobControlRecord* jcr,
 bool BareosDb::CreateDeviceStatistics(JobControlRecord* jcr,
                                       DeviceStatisticsDbRecord* dsr)
 {
-  time_t stime;
+  return CreateDeviceStatistics(jcr, dsr, 1);
+}
+
+// Create count Device Statistics records.
+bool BareosDb::CreateDeviceStatistics(JobControlRecord* jcr,
+                                      const DeviceStatisticsDbRecord* dsr,
+                                      std::size_t count)
+{
   char dt[MAX_TIME_LENGTH];
   char ed1[50], ed2[50], ed3[50], ed4[50], ed5[50], ed6[50];
   char ed7[50], ed8[50], ed9[50], ed10[50], ed11[50], ed12[50];
+  PoolMem row(PM_MESSAGE);
 
   DbLocker _{this};
 
-  stime = dsr->SampleTime;
-  ASSERT(stime != 0);
-
-  bstrutime(dt, sizeof(dt), stime);
-
-  /* clang-format off */
-  Mmsg(cmd,
-       "INSERT INTO DeviceStats (DeviceId, SampleTime, ReadTime, WriteTime,"
-       " ReadBytes, WriteBytes, SpoolSize, NumWaiting, NumWriters, MediaId,"
-       " VolCatBytes, VolCatFiles, VolCatBlocks)"
-       " VALUES (%s, '%s', %s, %s, %s, %s, %s, %s, %s, %s, %s, %s, %s)",
-       edit_int64(dsr->DeviceId, ed1),
-       dt,
-       edit_uint64(dsr->ReadTime, ed2),
-       edit_uint64(dsr->WriteTime, ed3),
-       edit_uint64(dsr->ReadBytes, ed4),
-       edit_uint64(dsr->WriteBytes, ed5),
-       edit_uint64(dsr->SpoolSize, ed6),
-       edit_uint64(dsr->NumWaiting, ed7),
-       edit_uint64(dsr->NumWriters, ed8),
-       edit_int64(dsr->MediaId, ed9),
-       edit_uint64(dsr->VolCatBytes, ed10),
-       edit_uint64(dsr->VolCatFiles, ed11),
-       edit_uint64(dsr->VolCatBlocks, ed12));
-  /* clang-format on */
-
-  Dmsg1(200, "Create device stats: %s\n", cmd);
+  for (std::size_t first = 0; first < count; first += max_statistics_rows) {
+    Mmsg(cmd,
+         "INSERT INTO DeviceStats (DeviceId, SampleTime, ReadTime, WriteTime,"
+         " ReadBytes, WriteBytes, SpoolSize, NumWaiting, NumWriters, MediaId,"
+         " VolCatBytes, VolCatFiles, VolCatBlocks) VALUES ");
+    std::size_t last = std::min(count, first + max_statistics_rows);
+    for (std::size_t i = first; i < last; ++i) {
+      const DeviceStatisticsDbRecord& ds = dsr[i];
+      ASSERT(ds.SampleTime != 0);
+      bstrutime(dt, sizeof(dt), ds.SampleTime);
+
+      /* clang-format off */
+      Mmsg(row,
+           "%s(%s, '%s', %s, %s, %s, %s, %s, %s, %s, %s, %s, %s, %s)",
+           i == first ? "" : ", ",
+           edit_int64(ds.DeviceId, ed1),
+           dt,
+           edit_uint64(ds.ReadTime, ed2),
+           edit_uint64(ds.WriteTime, ed3),
+           edit_uint64(ds.ReadBytes, ed4),
+           edit_uint64(ds.WriteBytes, ed5),
+           edit_uint64(ds.SpoolSize, ed6),
+           edit_uint64(ds.NumWaiting, ed7),
+           edit_uint64(ds.NumWriters, ed8),
+           edit_int64(ds.MediaId, ed9),
+           edit_uint64(ds.VolCatBytes, ed10),
+           edit_uint64(ds.VolCatFiles, ed11),
+           edit_uint64(ds.VolCatBlocks, ed12));
+      /* clang-format on */
+      PmStrcat(cmd, row);
+    }
 
-  if (InsertDb(jcr, cmd) != 1) {
-    Mmsg2(errmsg, T_("Create DB DeviceStats record %s failed. ERR=%s\n"), cmd,
-          sql_strerror());
-    Jmsg(jcr, M_ERROR, 0, "%s", errmsg);
+    Dmsg1(200, "Create device stats: %s\n", cmd);
 
-    return false;
-  } else {
-    return true;
+    if (InsertDb(jcr, cmd) != static_cast<int>(last - first)) {
+      Mmsg2(errmsg, T_("Create DB DeviceStats record %s failed. ERR=%s\n"),
+            cmd, sql_strerror());
+      Jmsg(jcr, M_ERROR, 0, "%s", errmsg);
+      return false;
+    }
   }
+
+  return true;
 }
 
 /**
@@ -1371,36 +1700,43 @@ bool BareosDb::CreateDeviceStatistics(JobControlRecord* jcr,
 bool BareosDb::CreateTapealertStatistics(JobControlRecord* jcr,
                                          TapealertStatsDbRecord* tsr)
 {
-  time_t stime;
+  return CreateTapealertStatistics(jcr, tsr, 1);
+}
+
+// Create count tapealert records.
+bool BareosDb::CreateTapealertStatistics(JobControlRecord* jcr,
+                                         const TapealertStatsDbRecord* tsr,
+                                         std::size_t count)
+{
   char dt[MAX_TIME_LENGTH];
   char ed1[50], ed2[50];
+  PoolMem row(PM_MESSAGE);
 
   DbLocker _{this};
 
-  stime = tsr->SampleTime;
-  ASSERT(stime != 0);
-
-  bstrutime(dt, sizeof(dt), stime);
-
-  /* clang-format off */
-  Mmsg(cmd,
-       "INSERT INTO TapeAlerts (DeviceId, SampleTime, AlertFlags)"
-       " VALUES (%s, '%s', %s)",
-       edit_int64(tsr->DeviceId, ed1),
-       dt,
-       edit_uint64(tsr->AlertFlags, ed2));
-  /* clang-format on */
-
-  Dmsg1(200, "Create tapealert: %s\n", cmd);
+  for (std::size_t first = 0; first < count; first += max_statistics_rows) {
+    Mmsg(cmd,
+         "INSERT INTO TapeAlerts (DeviceId, SampleTime, AlertFlags) VALUES ");
+    std::size_t last = std::min(count, first + max_statistics_rows);
+    for (std::size_t i = first; i < last; ++i) {
+      ASSERT(tsr[i].SampleTime != 0);
+      bstrutime(dt, sizeof(dt), tsr[i].SampleTime);
+      Mmsg(row, "%s(%s, '%s', %s)", i == first ? "" : ", ",
+           edit_int64(tsr[i].DeviceId, ed1), dt,
+           edit_uint64(tsr[i].AlertFlags, ed2));
+      PmStrcat(cmd, row);
+    }
 
-  if (InsertDb(jcr, cmd) != 1) {
-    Mmsg2(errmsg, T_("Create DB TapeAlerts record %s failed. ERR=%s\n"), cmd,
-          sql_strerror());
-    Jmsg(jcr, M_ERROR, 0, "%s", errmsg);
+    Dmsg1(200, "Create tapealert: %s\n", cmd);
 
-    return false;
-  } else {
-    return true;
+    if (InsertDb(jcr, cmd) != static_cast<int>(last - first)) {
+      Mmsg2(errmsg, T_("Create DB TapeAlerts record %s failed. ERR=%s\n"),
+            cmd, sql_strerror());
+      Jmsg(jcr, M_ERROR, 0, "%s", errmsg);
+      return false;
+    }
   }
+
+  return true;
 }
 #endif /* HAVE_POSTGRESQL */
@@ -172,8 +172,7 @@ static int DoMediaPurge(BareosDb* mdb, MediaDbRecord* mr)
     Mmsg(query, "DELETE FROM Job WHERE JobId=%s", edit_int64(jobid, ed1));
     mdb->SqlQuery(query.c_str());
 
-    Mmsg(query, "DELETE FROM File WHERE JobId=%s", edit_int64(jobid, ed1));
-    mdb->SqlQuery(query.c_str());
+    mdb->DeleteFileRecords(edit_int64(jobid, ed1));
 
     Mmsg(query, "DELETE FROM JobMedia WHERE JobId=%s", edit_int64(jobid, ed1));
     mdb->SqlQuery(query.c_str());
@@ -201,6 +200,50 @@ bool BareosDb::DeleteMediaRecord(JobControlRecord* jcr, MediaDbRecord* mr)
   return DeleteDb(jcr, cmd) != -1;
 }
 
+/**
+ * Delete the File records of the given jobids.  A single delete of all of
+ * them takes long, holds its locks until the end and writes all of the wal
+ * at once, so at most purge_chunk_size_ records are deleted per statement
+ * (each in its own transaction) with a break of purge_chunk_pause_
+ * milliseconds in between, during which other users of the connection and
+ * the database get their turn.
+ * Returns: number of deleted records
+ */
+uint64_t BareosDb::DeleteFileRecords(const char* jobids)
+{
+  PoolMem query(PM_MESSAGE);
+
+  if (purge_chunk_size_ == 0) {
+    Mmsg(query, "DELETE FROM File WHERE JobId IN (%s)", jobids);
+    DbLocker _{this};
+    int rows = DeleteDb(nullptr, query.c_str());
+    return rows > 0 ? rows : 0;
+  }
+
+  Mmsg(query,
+       "DELETE FROM File WHERE FileId IN "
+       "(SELECT FileId FROM File WHERE JobId IN (%s) LIMIT %u)",
+       jobids, purge_chunk_size_);
+
+  uint64_t deleted = 0;
+  for (;;) {
+    int rows;
+    {
+      DbLocker _{this};
+      rows = DeleteDb(nullptr, query.c_str());
+    }
+    if (rows <= 0) { break; }
+    deleted += rows;
+    Dmsg2(100, "Deleted %d File records (%llu so far)\n", rows, deleted);
+    if (static_cast<uint32_t>(rows) < purge_chunk_size_) { break; }
+    if (purge_chunk_pause_ > 0) {
+      Bmicrosleep(purge_chunk_pause_ / 1000,
+                  (purge_chunk_pause_ % 1000) * 1000);
+    }
+  }
+  return deleted;
+}
+
 void BareosDb::PurgeFiles(const char* jobids)
 {
   if (strcmp(jobids, "") == 0) {
@@ -210,8 +253,7 @@ void BareosDb::PurgeFiles(const char* jobids)
 
   PoolMem query(PM_MESSAGE);
 
-  Mmsg(query, "DELETE FROM File WHERE JobId IN (%s)", jobids);
-  SqlQuery(query.c_str());
+  DeleteFileRecords(jobids);
 
   Mmsg(query, "DELETE FROM BaseFiles WHERE JobId IN (%s)", jobids);
   SqlQuery(query.c_str());
@@ -256,4 +298,66 @@ void BareosDb::PurgeJobs(const char* jobids)
   Mmsg(query, "DELETE FROM Job WHERE JobId IN (%s)", jobids);
   SqlQuery(query.c_str());
 }
+
+/**
+ * Thin out the DeviceStats and JobStats samples taken between from and to
+ * to the last sample per device (and job) and resolution, which is "minute"
+ * or "hour".  The samples are counters, so the last one of a minute or hour
+ * still says what happened up to then.  Tape alerts are events and are kept.
+ * Returns the number of deleted samples or -1 on failure.
+ */
+int BareosDb::DownsampleStatistics(JobControlRecord* jcr,
+                                   const char* resolution,
+                                   time_t from,
+                                   time_t to)
+{
+  char dt1[MAX_TIME_LENGTH], dt2[MAX_TIME_LENGTH];
+  static constexpr const char* tables[][2]
+      = {{"DeviceStats", "DeviceId"}, {"JobStats", "DeviceId, JobId"}};
+
+  bstrutime(dt1, sizeof(dt1), from);
+  bstrutime(dt2, sizeof(dt2), to);
+
+  DbLocker _{this};
+
+  int deleted = 0;
+  for (auto [table, key] : tables) {
+    Mmsg(cmd,
+         "DELETE FROM %s WHERE ctid IN ("
+         "SELECT ctid FROM ("
+         "SELECT ctid, row_number() OVER (PARTITION BY %s, "
+         "date_trunc('%s', SampleTime) ORDER BY SampleTime DESC) AS n "
+         "FROM %s WHERE SampleTime >= '%s' AND SampleTime < '%s') AS s "
+         "WHERE n > 1)",
+         table, key, resolution, table, dt1, dt2);
+    int rows = DeleteDb(jcr, cmd);
+    if (rows < 0) { return -1; }
+    deleted += rows;
+  }
+
+  return deleted;
+}
+
+/**
+ * Delete the statistics samples taken before the given time.
+ * Returns the number of deleted samples or -1 on failure.
+ */
+int BareosDb::PruneStatistics(JobControlRecord* jcr, time_t before)
+{
+  char dt[MAX_TIME_LENGTH];
+
+  bstrutime(dt, sizeof(dt), before);
+
+  DbLocker _{this};
+
+  int deleted = 0;
+  for (const char* table : {"DeviceStats", "JobStats", "TapeAlerts"}) {
+    Mmsg(cmd, "DELETE FROM %s WHERE SampleTime < '%s'", table, dt);
+    int rows = DeleteDb(jcr, cmd);
+    if (rows < 0) { return -1; }
+    deleted += rows;
+  }
+
+  return deleted;
+}
 #endif /* HAVE_POSTGRESQL */
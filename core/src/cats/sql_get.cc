@@ -179,10 +179,7 @@ int BareosDb::GetPathRecord(JobControlRecord* jcr)
   esc_name = CheckPoolMemorySize(esc_name, 2 * pnl + 2);
   EscapeString(jcr, esc_name, path, pnl);
 
-  if (cached_path_id != 0 && cached_path_len == pnl
-      && bstrcmp(cached_path, path)) {
-    return cached_path_id;
-  }
+  if ((PathId = FindCachedPathId()) != 0) { return PathId; }
 
   Mmsg(cmd, "SELECT PathId FROM Path WHERE Path='%s'", esc_name);
   if (QueryDb(jcr, cmd)) {
@@ -204,11 +201,7 @@ int BareosDb::GetPathRecord(JobControlRecord* jcr)
                 edit_int64(PathId, ed1));
           PathId = 0;
         } else {
-          if (PathId != cached_path_id) {
-            cached_path_id = PathId;
-            cached_path_len = pnl;
-            PmStrcpy(cached_path, path);
-          }
+          CachePathId(PathId);
         }
       }
     } else {
@@ -1208,7 +1201,8 @@ bool BareosDb::GetFileList(JobControlRecord*,
                            bool use_md5,
                            bool use_delta,
                            DB_RESULT_HANDLER* ResultHandler,
-                           void* ctx)
+                           void* ctx,
+                           bool with_deleted)
 {
   PoolMem query(PM_MESSAGE);
   PoolMem query2(PM_MESSAGE);
@@ -1229,16 +1223,17 @@ bool BareosDb::GetFileList(JobControlRecord*,
 
   /* BootStrapRecord code is optimized for JobId sorted, with Delta, we need to
    * get them ordered by date. JobTDate and JobId can be mixed if using Copy or
-   * Migration */
+   * Migration.  With with_deleted the files deleted by the jobs are returned
+   * too, they have a FileIndex of 0. */
   Mmsg(query,
        "SELECT Path.Path, T1.Name, T1.FileIndex, T1.JobId, LStat, DeltaSeq, "
        "MD5, Fhinfo, Fhnode "
        "FROM ( %s ) AS T1 "
        "JOIN Path ON (Path.PathId = T1.PathId) "
-       "WHERE FileIndex > 0 "
+       "WHERE FileIndex %s "
        "ORDER BY T1.JobTDate, FileIndex ASC", /* Return sorted by JobTDate */
                                               /* FileIndex for restore code */
-       query2.c_str());
+       query2.c_str(), with_deleted ? ">= 0" : "> 0");
 
   if (!use_md5) { strip_md5(query.c_str()); }
 
@@ -1882,5 +1877,31 @@ bool BareosDb::VerifyMediaIdsFromSingleStorage(JobControlRecord* jcr,
   return true;
 }
 
+/**
+ * Get the number of seconds this database lags behind its primary server.
+ * It is 0 when it is no replica or has replayed all it received, -1 when
+ * a replica has not replayed anything yet.
+ * Returns false if the lag could not be found out.
+ */
+bool BareosDb::GetReplicationLag(JobControlRecord* jcr, int64_t& lag)
+{
+  SQL_ROW row;
+  DbLocker _{this};
+
+  Mmsg(cmd,
+       "SELECT CASE WHEN NOT pg_is_in_recovery() "
+       "OR pg_last_wal_receive_lsn() = pg_last_wal_replay_lsn() THEN 0 "
+       "ELSE COALESCE(EXTRACT(EPOCH FROM "
+       "now() - pg_last_xact_replay_timestamp())::bigint, -1) END");
+  if (!QueryDb(jcr, cmd)) { return false; }
+
+  bool ok = false;
+  if ((row = SqlFetchRow()) != NULL && row[0]) {
+    lag = str_to_int64(row[0]);
+    ok = true;
+  }
+  SqlFreeResult();
+  return ok;
+}
 
 #endif /* HAVE_POSTGRESQL */
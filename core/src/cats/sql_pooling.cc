@@ -3,7 +3,7 @@
 
    Copyright (C) 2010-2012 Free Software Foundation Europe e.V.
    Copyright (C) 2011-2016 Planets Communications B.V.
-   Copyright (C) 2013-2023 Bareos GmbH & Co. KG
+   Copyright (C) 2013-2024 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -31,6 +31,14 @@
 #if HAVE_POSTGRESQL
 
 #  include "cats.h"
+#  include "lib/metrics.h"
+
+#  include <algorithm>
+#  include <memory>
+#  include <mutex>
+#  include <string>
+#  include <unordered_map>
+#  include <vector>
 
 /**
  * Get a non-pooled connection used when either sql pooling is
@@ -72,44 +80,205 @@ BareosDb* DbSqlGetNonPooledConnection(JobControlRecord* jcr,
   return mdb;
 }
 
+namespace {
+/* Connections of one catalog.  They are handed out instead of the one
+ * connection all jobs would otherwise share, so concurrent jobs no longer
+ * wait for each other on its lock.  Once max_connections are leased the
+ * shared connection is handed out again. */
+struct pool_settings {
+  std::string db_drivername, db_name, db_user, db_password, db_address,
+      db_socket;
+  int db_port{0};
+  bool disable_batch_insert{false}, try_reconnect{true}, exit_on_fatal{false};
+  int min_connections{0}, max_connections{0}, increment_connections{1};
+  time_t idle_timeout{0}, validate_timeout{0};
+};
+
+struct sql_pool : pool_settings {
+  struct idle_connection {
+    BareosDb* db;
+    time_t since;
+  };
+  std::vector<idle_connection> idle;
+  int leased{0};
+
+  bool Matches(const char* driver, const char* name, const char* address,
+               int port) const
+  {
+    return bstrcmp(db_drivername.c_str(), driver)
+           && bstrcmp(db_name.c_str(), name)
+           && bstrcmp(db_address.c_str(), address ? address : "")
+           && db_port == port;
+  }
+};
+
+std::mutex pool_mutex;
+std::vector<std::unique_ptr<sql_pool>> pools;
+std::unordered_map<BareosDb*, sql_pool*> leases;
+
+metrics::counter leases_total{"bareos_catalog_pool_leases",
+                              "Catalog connections leased from the pool"};
+metrics::counter exhausted_total{
+    "bareos_catalog_pool_exhausted",
+    "Times the shared catalog connection was used as the pool was exhausted"};
+metrics::callback_gauge leased_gauge{
+    "bareos_catalog_pool_leased_connections",
+    "Catalog connections currently leased from the pool", [] {
+      std::unique_lock lock(pool_mutex);
+      return static_cast<double>(leases.size());
+    }};
+metrics::callback_gauge idle_gauge{
+    "bareos_catalog_pool_idle_connections",
+    "Open catalog connections waiting in the pool", [] {
+      std::unique_lock lock(pool_mutex);
+      std::size_t idle = 0;
+      for (auto& pool : pools) { idle += pool->idle.size(); }
+      return static_cast<double>(idle);
+    }};
+metrics::callback_gauge max_gauge{
+    "bareos_catalog_pool_max_connections",
+    "Catalog connections the pools may lease at most", [] {
+      std::unique_lock lock(pool_mutex);
+      int max = 0;
+      for (auto& pool : pools) { max += pool->max_connections; }
+      return static_cast<double>(max);
+    }};
+
+sql_pool* FindPool(const char* db_drivername,
+                   const char* db_name,
+                   const char* db_address,
+                   int db_port)
+{
+  for (auto& pool : pools) {
+    if (pool->Matches(db_drivername, db_name, db_address, db_port)) {
+      return pool.get();
+    }
+  }
+  return nullptr;
+}
+
+BareosDb* OpenPoolConnection(JobControlRecord* jcr, const pool_settings& pool)
+{
+  /* Private, so that db_init_database() never hands it to someone else as
+   * the shared connection. */
+  return DbSqlGetNonPooledConnection(
+      jcr, pool.db_drivername.c_str(), pool.db_name.c_str(),
+      pool.db_user.c_str(), pool.db_password.c_str(),
+      pool.db_address.empty() ? nullptr : pool.db_address.c_str(),
+      pool.db_port, pool.db_socket.empty() ? nullptr : pool.db_socket.c_str(),
+      false, pool.disable_batch_insert, pool.try_reconnect, pool.exit_on_fatal,
+      true);
+}
+
+// closes the idle connections above min_connections that idled too long
+std::vector<BareosDb*> ExpireIdleConnections(sql_pool& pool, time_t now)
+{
+  std::vector<BareosDb*> expired;
+  if (pool.idle_timeout <= 0) { return expired; }
+  while (pool.idle.size() > static_cast<std::size_t>(pool.min_connections)
+         && now - pool.idle.front().since > pool.idle_timeout) {
+    expired.push_back(pool.idle.front().db);
+    pool.idle.erase(pool.idle.begin());
+  }
+  return expired;
+}
+}  // namespace
+
 /**
  * Initialize the sql connection pool.
- * For non pooling this is a no-op.
+ * A pool that already exists (when reloading) only gets the new settings.
+ * Pooling is disabled for a catalog with max_connections <= 1.
  */
-bool db_sql_pool_initialize(const char*,
-                            const char*,
-                            const char*,
-                            const char*,
-                            const char*,
-                            int,
-                            const char*,
-                            bool,
-                            bool,
-                            bool,
-                            int,
-                            int,
-                            int,
-                            int,
-                            int)
+bool db_sql_pool_initialize(const char* db_drivername,
+                            const char* db_name,
+                            const char* db_user,
+                            const char* db_password,
+                            const char* db_address,
+                            int db_port,
+                            const char* db_socket,
+                            bool disable_batch_insert,
+                            bool try_reconnect,
+                            bool exit_on_fatal,
+                            int min_connections,
+                            int max_connections,
+                            int increment_connections,
+                            int idle_timeout,
+                            int validate_timeout)
 {
+  if (max_connections > 1 && min_connections > max_connections) {
+    Jmsg(nullptr, M_ERROR, 0,
+         T_("MinConnections (%d) is larger than MaxConnections (%d) for "
+            "database \"%s\".\n"),
+         min_connections, max_connections, db_name);
+    return false;
+  }
+
+  std::unique_lock lock(pool_mutex);
+  sql_pool* pool = FindPool(db_drivername, db_name, db_address, db_port);
+  if (!pool) {
+    if (max_connections <= 1) { return true; }
+    pool = pools.emplace_back(std::make_unique<sql_pool>()).get();
+    pool->db_drivername = db_drivername;
+    pool->db_name = db_name;
+    pool->db_address = db_address ? db_address : "";
+    pool->db_port = db_port;
+  }
+  pool->db_user = db_user ? db_user : "";
+  pool->db_password = db_password ? db_password : "";
+  pool->db_socket = db_socket ? db_socket : "";
+  pool->disable_batch_insert = disable_batch_insert;
+  pool->try_reconnect = try_reconnect;
+  pool->exit_on_fatal = exit_on_fatal;
+  pool->min_connections = min_connections;
+  pool->max_connections = max_connections > 1 ? max_connections : 0;
+  pool->increment_connections
+      = increment_connections > 0 ? increment_connections : 1;
+  pool->idle_timeout = idle_timeout;
+  pool->validate_timeout = validate_timeout;
+
+  Dmsg3(100, "Pooling up to %d connections to database %s (keeping %d)\n",
+        pool->max_connections, db_name, pool->min_connections);
   return true;
 }
 
 /**
  * Cleanup the sql connection pools.
- * For non pooling this is a no-op.
+ * Leased connections are closed when they are given back.
  */
-void DbSqlPoolDestroy(void) {}
+void DbSqlPoolDestroy(void)
+{
+  std::vector<std::unique_ptr<sql_pool>> destroyed;
+  {
+    std::unique_lock lock(pool_mutex);
+    std::swap(destroyed, pools);
+    leases.clear();
+  }
+  for (auto& pool : destroyed) {
+    for (auto& idle : pool->idle) { idle.db->CloseDatabase(nullptr); }
+  }
+}
 
 /**
  * Flush the sql connection pools.
- * For non pooling this is a no-op.
+ * Closes all idle connections, e.g. as the catalog settings might change.
  */
-void DbSqlPoolFlush(void) {}
+void DbSqlPoolFlush(void)
+{
+  std::vector<BareosDb*> flushed;
+  {
+    std::unique_lock lock(pool_mutex);
+    for (auto& pool : pools) {
+      for (auto& idle : pool->idle) { flushed.push_back(idle.db); }
+      pool->idle.clear();
+    }
+  }
+  for (auto* db : flushed) { db->CloseDatabase(nullptr); }
+}
 
 /**
  * Get a new connection from the pool.
- * For non pooling we just call DbSqlGetNonPooledConnection.
+ * Only requests for the shared connection are served from the pool, whoever
+ * asks for multiple or private connections gets a new one as before.
  */
 BareosDb* DbSqlGetPooledConnection(JobControlRecord* jcr,
                                    const char* db_drivername,
@@ -125,6 +294,81 @@ BareosDb* DbSqlGetPooledConnection(JobControlRecord* jcr,
                                    bool exit_on_fatal,
                                    bool need_private)
 {
+  if (!mult_db_connections && !need_private) {
+    std::unique_lock lock(pool_mutex);
+    sql_pool* pool = FindPool(db_drivername, db_name, db_address, db_port);
+    if (pool && pool->max_connections > 0) {
+      time_t now = time(nullptr);
+      std::vector<BareosDb*> expired = ExpireIdleConnections(*pool, now);
+      BareosDb* db = nullptr;
+      bool validate = false;
+      if (!pool->idle.empty()) {
+        db = pool->idle.back().db;
+        validate = pool->validate_timeout > 0
+                   && now - pool->idle.back().since > pool->validate_timeout;
+        pool->idle.pop_back();
+        pool->leased += 1;
+      } else if (pool->leased < pool->max_connections) {
+        pool->leased += 1;
+      } else {
+        pool = nullptr;
+        exhausted_total.Add();
+      }
+
+      if (pool) {
+        /* Opening or validating connections takes a while, the pool is not
+         * locked meanwhile. */
+        pool_settings opened_from = *pool;
+        int leased = pool->leased;
+        lock.unlock();
+        for (auto* old : expired) { old->CloseDatabase(jcr); }
+        expired.clear();
+
+        if (db && validate && !db->SqlQuery("SELECT 1")) {
+          Dmsg1(100, "Dropping stale pooled connection to database %s\n",
+                db_name);
+          db->CloseDatabase(jcr);
+          db = nullptr;
+        }
+        std::vector<BareosDb*> extra;
+        if (!db) {
+          db = OpenPoolConnection(jcr, opened_from);
+          int wanted = std::min(opened_from.increment_connections,
+                                opened_from.max_connections - leased + 1)
+                       - 1;
+          for (int i = 0; db && i < wanted; ++i) {
+            if (BareosDb* spare = OpenPoolConnection(jcr, opened_from)) {
+              extra.push_back(spare);
+            }
+          }
+        }
+
+        lock.lock();
+        /* Reread the pool, it is gone if the pools got destroyed meanwhile
+         * and then the connections are no longer pooled. */
+        pool = FindPool(db_drivername, db_name, db_address, db_port);
+        if (pool) {
+          for (auto* spare : extra) { pool->idle.push_back({spare, now}); }
+          extra.clear();
+          if (db) {
+            leases[db] = pool;
+            leases_total.Add();
+            return db;
+          }
+          pool->leased -= 1;
+        }
+        lock.unlock();
+        for (auto* spare : extra) { spare->CloseDatabase(jcr); }
+        if (db) { return db; }
+        Dmsg1(100, "Could not open a pooled connection to database %s\n",
+              db_name);
+      } else {
+        lock.unlock();
+        for (auto* old : expired) { old->CloseDatabase(jcr); }
+      }
+    }
+  }
+
   return DbSqlGetNonPooledConnection(
       jcr, db_drivername, db_name, db_user, db_password, db_address, db_port,
       db_socket, mult_db_connections, disable_batch_insert, try_reconnect,
@@ -133,10 +377,34 @@ BareosDb* DbSqlGetPooledConnection(JobControlRecord* jcr,
 
 /**
  * Put a connection back onto the pool for reuse.
- * For non pooling we just do a CloseDatabase.
+ * Connections that are not from a pool or where abort is set are closed.
  */
-void DbSqlClosePooledConnection(JobControlRecord* jcr, BareosDb* mdb, bool)
+void DbSqlClosePooledConnection(JobControlRecord* jcr,
+                                BareosDb* mdb,
+                                bool abort)
 {
+  {
+    std::unique_lock lock(pool_mutex);
+    auto lease = leases.find(mdb);
+    /* Still in use by someone who got it via CloneDatabaseConnection(), the
+     * last one to close it puts it back. */
+    if (lease != leases.end() && mdb->GetRefcount() == 1) {
+      sql_pool* pool = lease->second;
+      leases.erase(lease);
+      pool->leased -= 1;
+      if (!abort && mdb->IsConnected()) {
+        lock.unlock();
+        mdb->EndTransaction(jcr);
+        lock.lock();
+        /* might have been destroyed while the transaction ended */
+        if (std::any_of(pools.begin(), pools.end(),
+                        [pool](auto& p) { return p.get() == pool; })) {
+          pool->idle.push_back({mdb, time(nullptr)});
+          return;
+        }
+      }
+    }
+  }
   mdb->CloseDatabase(jcr);
 }
 
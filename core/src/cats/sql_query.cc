@@ -156,4 +156,39 @@ bool BareosDb::SqlQuery(const char* query,
 
   return retval;
 }
+
+bool BareosDb::SqlQuery(const prepared_statement& stmt,
+                        const SqlParameters& params,
+                        int flags)
+{
+  bool retval;
+
+  Dmsg2(debuglevel, "called: %s with prepared query %s\n",
+        __PRETTY_FUNCTION__, stmt.name);
+
+  DbLocker _{this};
+  retval = SqlQueryPrepared(stmt, params, flags);
+  if (!retval) {
+    Mmsg(errmsg, T_("Query failed: %s: ERR=%s\n"), stmt.query, sql_strerror());
+  }
+
+  return retval;
+}
+
+bool BareosDb::SqlCopyIn(const char* table,
+                         const std::vector<std::vector<std::string>>& rows)
+{
+  bool retval;
+
+  Dmsg3(debuglevel, "called: %s with table %s and %d rows\n",
+        __PRETTY_FUNCTION__, table, rows.size());
+
+  DbLocker _{this};
+  retval = SqlCopyRows(table, rows);
+  if (!retval) {
+    Mmsg(errmsg, T_("Copy into %s failed: ERR=%s\n"), table, sql_strerror());
+  }
+
+  return retval;
+}
 #endif /* HAVE_POSTGRESQL */
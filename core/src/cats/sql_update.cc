@@ -88,27 +88,34 @@ bool BareosDb::MarkFileRecord(JobControlRecord* jcr,
  */
 bool BareosDb::UpdateJobStartRecord(JobControlRecord* jcr, JobDbRecord* jr)
 {
+  static constexpr prepared_statement update_job_start{
+      "update_job_start",
+      "UPDATE Job SET JobStatus=$1,Level=$2,StartTime=$3,"
+      "ClientId=$4,JobTDate=$5,PoolId=$6,FileSetId=$7,VolSessionId=$8,"
+      "VolSessionTime=$9 WHERE JobId=$10"};
   char dt[MAX_TIME_LENGTH];
   time_t stime;
   btime_t JobTDate;
-  char ed1[50], ed2[50], ed3[50], ed4[50], ed5[50];
 
   stime = jr->StartTime;
   bstrutime(dt, sizeof(dt), stime);
   JobTDate = (btime_t)stime;
 
-  DbLocker _{this};
-  Mmsg(cmd,
-       "UPDATE Job SET JobStatus='%c',Level='%c',StartTime='%s',"
-       "ClientId=%s,JobTDate=%s,PoolId=%s,FileSetId=%s,VolSessionId=%lu,"
-       "VolSessionTime=%lu WHERE JobId=%s",
-       (char)(jcr->getJobStatus()), (char)(jr->JobLevel), dt,
-       edit_int64(jr->ClientId, ed1), edit_uint64(JobTDate, ed2),
-       edit_int64(jr->PoolId, ed3), edit_int64(jr->FileSetId, ed4),
-       jcr->VolSessionId, jcr->VolSessionTime, edit_int64(jr->JobId, ed5));
+  SqlParameters params;
+  params.Add((char)(jcr->getJobStatus()))
+      .Add((char)(jr->JobLevel))
+      .Add(dt)
+      .Add(jr->ClientId)
+      .Add(JobTDate)
+      .Add(jr->PoolId)
+      .Add(jr->FileSetId)
+      .Add(jcr->VolSessionId)
+      .Add(jcr->VolSessionTime)
+      .Add(jr->JobId);
 
+  DbLocker _{this};
   changes = 0;
-  return UpdateDb(jcr, cmd) > 0;
+  return UpdateDb(jcr, update_job_start, params) > 0;
 }
 
 bool BareosDb::UpdateRunningJobRecord(JobControlRecord* jcr)
@@ -148,18 +155,17 @@ int BareosDb::UpdateStats(JobControlRecord* jcr, utime_t age)
  */
 bool BareosDb::UpdateJobEndRecord(JobControlRecord* jcr, JobDbRecord* jr)
 {
+  static constexpr prepared_statement update_job_end{
+      "update_job_end",
+      "UPDATE Job SET JobStatus=$1,Level=$2,EndTime=$3,"
+      "ClientId=$4,JobBytes=$5,ReadBytes=$6,JobFiles=$7,JobErrors=$8,"
+      "VolSessionId=$9,VolSessionTime=$10,PoolId=$11,FileSetId=$12,"
+      "JobTDate=$13,RealEndTime=$14,PriorJobId=$15,HasBase=$16,"
+      "PurgedFiles=$17 WHERE JobId=$18"};
   char dt[MAX_TIME_LENGTH];
   char rdt[MAX_TIME_LENGTH];
   time_t ttime;
-  char ed1[30], ed2[30], ed3[50], ed4[50];
   btime_t JobTDate;
-  char PriorJobId[50];
-
-  if (jr->PriorJobId) {
-    bstrncpy(PriorJobId, edit_int64(jr->PriorJobId, ed1), sizeof(PriorJobId));
-  } else {
-    bstrncpy(PriorJobId, "0", sizeof(PriorJobId));
-  }
 
   ttime = jr->EndTime;
   bstrutime(dt, sizeof(dt), ttime);
@@ -170,22 +176,28 @@ bool BareosDb::UpdateJobEndRecord(JobControlRecord* jcr, JobDbRecord* jr)
 
   JobTDate = ttime;
 
-  DbLocker _{this};
-
-  Mmsg(
-      cmd,
-      "UPDATE Job SET JobStatus='%c',Level='%c',EndTime='%s',"
-      "ClientId=%u,JobBytes=%s,ReadBytes=%s,JobFiles=%u,JobErrors=%u,"
-      "VolSessionId=%u,"
-      "VolSessionTime=%u,PoolId=%u,FileSetId=%u,JobTDate=%s,"
-      "RealEndTime='%s',PriorJobId=%s,HasBase=%u,PurgedFiles=%u WHERE JobId=%s",
-      (char)(jr->JobStatus), (char)(jr->JobLevel), dt, jr->ClientId,
-      edit_uint64(jr->JobBytes, ed1), edit_uint64(jr->ReadBytes, ed4),
-      jr->JobFiles, jr->JobErrors, jr->VolSessionId, jr->VolSessionTime,
-      jr->PoolId, jr->FileSetId, edit_uint64(JobTDate, ed2), rdt, PriorJobId,
-      jr->HasBase, jr->PurgedFiles, edit_int64(jr->JobId, ed3));
+  SqlParameters params;
+  params.Add((char)(jr->JobStatus))
+      .Add((char)(jr->JobLevel))
+      .Add(dt)
+      .Add(jr->ClientId)
+      .Add(jr->JobBytes)
+      .Add(jr->ReadBytes)
+      .Add(jr->JobFiles)
+      .Add(jr->JobErrors)
+      .Add(jr->VolSessionId)
+      .Add(jr->VolSessionTime)
+      .Add(jr->PoolId)
+      .Add(jr->FileSetId)
+      .Add(JobTDate)
+      .Add(rdt)
+      .Add(jr->PriorJobId)
+      .Add(jr->HasBase)
+      .Add(jr->PurgedFiles)
+      .Add(jr->JobId);
 
-  return UpdateDb(jcr, cmd) > 0;
+  DbLocker _{this};
+  return UpdateDb(jcr, update_job_end, params) > 0;
 }
 
 /**
@@ -285,18 +297,24 @@ bool BareosDb::UpdateStorageRecord(JobControlRecord* jcr, StorageDbRecord* sr)
  */
 bool BareosDb::UpdateMediaRecord(JobControlRecord* jcr, MediaDbRecord* mr)
 {
+  static constexpr prepared_statement update_media{
+      "update_media",
+      "UPDATE Media SET VolJobs=$1,"
+      "VolFiles=$2,VolBlocks=$3,VolBytes=$4,VolMounts=$5,VolErrors=$6,"
+      "VolWrites=$7,MaxVolBytes=$8,VolStatus=$9,"
+      "Slot=$10,InChanger=$11,VolReadTime=$12,VolWriteTime=$13,"
+      "LabelType=$14,StorageId=$15,PoolId=$16,VolRetention=$17,"
+      "VolUseDuration=$18,MaxVolJobs=$19,MaxVolFiles=$20,Enabled=$21,"
+      "LocationId=$22,ScratchPoolId=$23,RecyclePoolId=$24,RecycleCount=$25,"
+      "Recycle=$26,ActionOnPurge=$27,MinBlocksize=$28,MaxBlocksize=$29 "
+      "WHERE VolumeName=$30"};
   char dt[MAX_TIME_LENGTH];
   time_t ttime;
-  char ed1[50], ed2[50], ed3[50], ed4[50];
-  char ed5[50], ed6[50], ed7[50], ed8[50];
-  char ed9[50], ed10[50], ed11[50];
   char esc_medianame[MAX_ESCAPE_NAME_LENGTH];
-  char esc_status[MAX_ESCAPE_NAME_LENGTH];
 
   Dmsg1(100, "update_media: FirstWritten=%d\n", mr->FirstWritten);
   DbLocker _{this};
   EscapeString(jcr, esc_medianame, mr->VolumeName, strlen(mr->VolumeName));
-  EscapeString(jcr, esc_status, mr->VolStatus, strlen(mr->VolStatus));
 
   if (mr->set_first_written) {
     Dmsg1(400, "Set FirstWritten Vol=%s\n", mr->VolumeName);
@@ -332,32 +350,41 @@ bool BareosDb::UpdateMediaRecord(JobControlRecord* jcr, MediaDbRecord* mr)
     UpdateDb(jcr, cmd);
   }
 
-  Mmsg(cmd,
-       "UPDATE Media SET VolJobs=%u,"
-       "VolFiles=%u,VolBlocks=%u,VolBytes=%s,VolMounts=%u,VolErrors=%u,"
-       "VolWrites=%u,MaxVolBytes=%s,VolStatus='%s',"
-       "Slot=%d,InChanger=%d,VolReadTime=%s,VolWriteTime=%s,"
-       "LabelType=%d,StorageId=%s,PoolId=%s,VolRetention=%s,VolUseDuration=%s,"
-       "MaxVolJobs=%d,MaxVolFiles=%d,Enabled=%d,LocationId=%s,"
-       "ScratchPoolId=%s,RecyclePoolId=%s,RecycleCount=%d,Recycle=%d,"
-       "ActionOnPurge=%d,"
-       "MinBlocksize=%u,MaxBlocksize=%u "
-       "WHERE VolumeName='%s'",
-       mr->VolJobs, mr->VolFiles, mr->VolBlocks, edit_uint64(mr->VolBytes, ed1),
-       mr->VolMounts, mr->VolErrors, mr->VolWrites,
-       edit_uint64(mr->MaxVolBytes, ed2), esc_status, mr->Slot, mr->InChanger,
-       edit_int64(mr->VolReadTime, ed3), edit_int64(mr->VolWriteTime, ed4),
-       mr->LabelType, edit_int64(mr->StorageId, ed5),
-       edit_int64(mr->PoolId, ed6), edit_uint64(mr->VolRetention, ed7),
-       edit_uint64(mr->VolUseDuration, ed8), mr->MaxVolJobs, mr->MaxVolFiles,
-       mr->Enabled, edit_uint64(mr->LocationId, ed9),
-       edit_uint64(mr->ScratchPoolId, ed10),
-       edit_uint64(mr->RecyclePoolId, ed11), mr->RecycleCount, mr->Recycle,
-       mr->ActionOnPurge, mr->MinBlocksize, mr->MaxBlocksize, esc_medianame);
-
-  Dmsg1(400, "%s\n", cmd);
-
-  bool retval = UpdateDb(jcr, cmd) > 0;
+  SqlParameters params;
+  params.Add(mr->VolJobs)
+      .Add(mr->VolFiles)
+      .Add(mr->VolBlocks)
+      .Add(mr->VolBytes)
+      .Add(mr->VolMounts)
+      .Add(mr->VolErrors)
+      .Add(mr->VolWrites)
+      .Add(mr->MaxVolBytes)
+      .Add(mr->VolStatus)
+      .Add(mr->Slot)
+      .Add(mr->InChanger)
+      .Add(mr->VolReadTime)
+      .Add(mr->VolWriteTime)
+      .Add(mr->LabelType)
+      .Add(mr->StorageId)
+      .Add(mr->PoolId)
+      .Add(mr->VolRetention)
+      .Add(mr->VolUseDuration)
+      .Add(mr->MaxVolJobs)
+      .Add(mr->MaxVolFiles)
+      .Add(mr->Enabled)
+      .Add(mr->LocationId)
+      .Add(mr->ScratchPoolId)
+      .Add(mr->RecyclePoolId)
+      .Add(mr->RecycleCount)
+      .Add(mr->Recycle)
+      .Add(mr->ActionOnPurge)
+      .Add(mr->MinBlocksize)
+      .Add(mr->MaxBlocksize)
+      .Add(mr->VolumeName);
+
+  Dmsg1(400, "%s\n", update_media.query);
+
+  bool retval = UpdateDb(jcr, update_media, params) > 0;
 
   // Make sure InChanger is 0 for any record having the same Slot
   MakeInchangerUnique(jcr, mr);
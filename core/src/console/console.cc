@@ -38,6 +38,7 @@
 #include "lib/bnet.h"
 #include "lib/bnet_network_dump.h"
 #include "lib/bsock_tcp.h"
+#include "lib/bsock_compression.h"
 #include "lib/bstringlist.h"
 #include "lib/cli.h"
 #include "lib/qualified_resource_name_type_converter.h"
@@ -440,6 +441,31 @@ static void GetItems(const char* what)
   }
 }
 
+/* ask the director to compress the messages of this connection, which
+ * directors without the .compress command decline */
+static void RequestMessageCompression()
+{
+  const char* algorithm = MessageCompression::Algorithm();
+  if (!algorithm) {
+    ConsoleOutput(T_("Built without message compression.\n"));
+    return;
+  }
+
+  std::string accepted = std::string{"compress="} + algorithm;
+  bool enabled = false;
+  g_UA_sock->fsend(".compress");
+  while (g_UA_sock->recv() > 0) {
+    StripTrailingJunk(g_UA_sock->msg);
+    // anything after the reply may already be compressed
+    if (!enabled && accepted == g_UA_sock->msg) {
+      enabled = g_UA_sock->EnableMessageCompression();
+    }
+  }
+  if (!enabled) {
+    ConsoleOutput(T_("The Director does not compress messages.\n"));
+  }
+}
+
 typedef enum
 {
   ITEM_ARG, /* item with simple list like .jobs */
@@ -916,6 +942,10 @@ int main(int argc, char* argv[])
   console_app.add_flag("-s,--no-signals", no_signals,
                        "No signals (for debugging)");
 
+  bool compress_messages = false;
+  console_app.add_flag("-z,--compress", compress_messages,
+                       "Compress the messages to and from the Director");
+
   console_app.add_flag("-t,--test-config", test_config,
                        "Test - read configuration and exit");
 
@@ -1072,6 +1102,8 @@ int main(int argc, char* argv[])
 
   Dmsg0(40, "Opened connection with Director daemon\n");
 
+  if (compress_messages) { RequestMessageCompression(); }
+
   ConsoleOutput(T_("\nEnter a period (.) to cancel a command.\n"));
 
 #if defined(HAVE_WIN32)
@@ -0,0 +1,191 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * the accurate file list of a client and fileset, kept between backups
+ *
+ * A snapshot file consists of two text lines, the format version and the
+ * jobids with the checksum flag, followed by the records as they were sent to
+ * the fd, each one preceded by its length as 32 bit integer in host byte
+ * order.  A length of zero marks the end, a file without it is incomplete.
+ */
+
+#include "include/bareos.h"
+#include "dird.h"
+#include "dird/accurate_snapshot.h"
+#include "dird/director_jcr_impl.h"
+#include "cats/sql.h"
+#include "lib/berrno.h"
+#include "lib/bstringlist.h"
+
+#include <unistd.h>
+#include <algorithm>
+
+namespace directordaemon {
+
+static constexpr const char* snapshot_version = "Bareos accurate snapshot 1";
+
+// reads a line without its newline, false at the end of the file
+static bool ReadLine(FILE* fp, std::string& line)
+{
+  line.clear();
+  int c;
+  while ((c = getc(fp)) != EOF && c != '\n') { line.push_back(c); }
+  return c == '\n';
+}
+
+AccurateSnapshot::AccurateSnapshot(JobControlRecord* jcr, bool with_checksum)
+    : jcr_{jcr}, with_checksum_{with_checksum}
+{
+  PoolMem path(PM_FNAME);
+  Mmsg(path, "%s/%s.accurate.%u.%u", working_directory, my_name,
+       jcr->dir_impl->jr.ClientId, jcr->dir_impl->jr.FileSetId);
+  path_ = path.c_str();
+  Mmsg(path, "%s.%u.tmp", path_.c_str(), jcr->JobId);
+  new_path_ = path.c_str();
+}
+
+AccurateSnapshot::~AccurateSnapshot()
+{
+  if (stored_) { fclose(stored_); }
+  if (created_) {
+    fclose(created_);
+    unlink(new_path_.c_str());
+  }
+}
+
+std::size_t AccurateSnapshot::Open(const std::vector<std::string>& jobids)
+{
+  stored_ = fopen(path_.c_str(), "rb");
+  if (!stored_) { return 0; }
+
+  std::string line;
+  if (!ReadLine(stored_, line) || line != snapshot_version
+      || !ReadLine(stored_, line)) {
+    Dmsg1(50, "Accurate snapshot %s is invalid\n", path_.c_str());
+    fclose(stored_);
+    stored_ = nullptr;
+    return 0;
+  }
+
+  const std::string prefix = with_checksum_ ? "checksum=1 jobids="
+                                            : "checksum=0 jobids=";
+  BStringList covered;
+  if (line.compare(0, prefix.size(), prefix) == 0) {
+    covered = BStringList(line.substr(prefix.size()), ',');
+  }
+  if (covered.empty() || covered.size() > jobids.size()
+      || !std::equal(covered.begin(), covered.end(), jobids.begin())) {
+    Dmsg2(50, "Accurate snapshot %s does not match: %s\n", path_.c_str(),
+          line.c_str());
+    fclose(stored_);
+    stored_ = nullptr;
+    return 0;
+  }
+
+  /* Jobs whose files were purged or which were deleted since the snapshot was
+   * built do not contribute to the list of the catalog any more. */
+  PoolMem query(PM_MESSAGE);
+  db_list_ctx nb;
+  Mmsg(query, "SELECT count(1) FROM Job WHERE JobId IN (%s) AND PurgedFiles=0",
+       covered.Join(',').c_str());
+  if (!jcr_->db->SqlQuery(query.c_str(), DbListHandler, &nb) || nb.empty()
+      || nb.GetFrontAsInteger() != covered.size()) {
+    Dmsg1(50, "Accurate snapshot %s contains purged jobs\n", path_.c_str());
+    fclose(stored_);
+    stored_ = nullptr;
+    return 0;
+  }
+
+  return covered.size();
+}
+
+bool AccurateSnapshot::Next(std::string_view& record)
+{
+  if (!stored_) { return false; }
+
+  uint32_t size;
+  if (fread(&size, sizeof(size), 1, stored_) != 1) {
+    read_error_ = true;
+    return false;
+  }
+  if (size == 0) { return false; }
+
+  record_.resize(size);
+  if (fread(record_.data(), 1, size, stored_) != size) {
+    read_error_ = true;
+    return false;
+  }
+  record = record_;
+  return true;
+}
+
+bool AccurateSnapshot::Create(const std::string& jobids)
+{
+  created_ = fopen(new_path_.c_str(), "wb");
+  if (!created_) {
+    BErrNo be;
+    Jmsg(jcr_, M_WARNING, 0,
+         T_("Could not create accurate snapshot %s: ERR=%s\n"),
+         new_path_.c_str(), be.bstrerror());
+    return false;
+  }
+
+  if (fprintf(created_, "%s\nchecksum=%d jobids=%s\n", snapshot_version,
+              with_checksum_ ? 1 : 0, jobids.c_str())
+      < 0) {
+    write_error_ = true;
+  }
+  return true;
+}
+
+void AccurateSnapshot::Add(const char* record, uint32_t size)
+{
+  if (!created_ || write_error_ || size == 0) { return; }
+
+  if (fwrite(&size, sizeof(size), 1, created_) != 1
+      || fwrite(record, 1, size, created_) != size) {
+    write_error_ = true;
+  }
+}
+
+bool AccurateSnapshot::Commit()
+{
+  if (!created_) { return false; }
+
+  uint32_t end = 0;
+  if (fwrite(&end, sizeof(end), 1, created_) != 1 || fflush(created_) != 0
+      || fsync(fileno(created_)) != 0) {
+    write_error_ = true;
+  }
+  bool ok = fclose(created_) == 0 && !write_error_;
+  created_ = nullptr;
+
+  if (ok && rename(new_path_.c_str(), path_.c_str()) == 0) { return true; }
+
+  BErrNo be;
+  Jmsg(jcr_, M_WARNING, 0, T_("Could not write accurate snapshot %s: ERR=%s\n"),
+       path_.c_str(), be.bstrerror());
+  unlink(new_path_.c_str());
+  return false;
+}
+
+} /* namespace directordaemon */
@@ -0,0 +1,79 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * the accurate file list of a client and fileset, kept between backups
+ */
+#ifndef BAREOS_DIRD_ACCURATE_SNAPSHOT_H_
+#define BAREOS_DIRD_ACCURATE_SNAPSHOT_H_
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class JobControlRecord;
+
+namespace directordaemon {
+
+/* The records an accurate backup sent to the fd, kept in the working
+ * directory together with the jobids they were built from.  When the next
+ * backup of the client and fileset is based on the same jobs and some newer
+ * ones, only the files of the newer jobs have to be read from the catalog, the
+ * rest comes from the snapshot.  While the records are sent they are written
+ * to a new snapshot, which replaces the old one once it is complete. */
+class AccurateSnapshot {
+ public:
+  AccurateSnapshot(JobControlRecord* jcr, bool with_checksum);
+  ~AccurateSnapshot();
+
+  AccurateSnapshot(const AccurateSnapshot&) = delete;
+  AccurateSnapshot& operator=(const AccurateSnapshot&) = delete;
+
+  /* Opens the stored snapshot if it was built from the first jobs of jobids
+   * and none of them lost its files since.  Returns the number of jobids it
+   * covers, 0 if it cannot be used. */
+  std::size_t Open(const std::vector<std::string>& jobids);
+
+  // the next stored record, false at its end or when it cannot be read
+  bool Next(std::string_view& record);
+  bool ReadError() const { return read_error_; }
+
+  // starts the new snapshot of the given jobids
+  bool Create(const std::string& jobids);
+  void Add(const char* record, uint32_t size);
+  // replaces the stored snapshot with the new one
+  bool Commit();
+
+ private:
+  JobControlRecord* jcr_;
+  bool with_checksum_;
+  std::string path_;
+  std::string new_path_;
+  FILE* stored_{nullptr};
+  FILE* created_{nullptr};
+  bool read_error_{false};
+  bool write_error_{false};
+  std::string record_;
+};
+
+} /* namespace directordaemon */
+#endif  // BAREOS_DIRD_ACCURATE_SNAPSHOT_H_
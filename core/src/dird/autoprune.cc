@@ -28,6 +28,7 @@
 
 #include "include/bareos.h"
 #include "dird.h"
+#include "dird/background_prune.h"
 #include "dird/director_jcr_impl.h"
 #include "dird/next_vol.h"
 #include "dird/ua_server.h"
@@ -35,6 +36,11 @@
 #include "dird/ua_purge.h"
 #include "lib/edit.h"
 
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+
 namespace directordaemon {
 
 /**
@@ -47,33 +53,43 @@ void DoAutoprune(JobControlRecord* jcr)
   JobResource* job;
   ClientResource* client;
   PoolResource* pool;
-  bool pruned;
 
   if (!jcr->dir_impl->res.client) { /* temp -- remove me */
     return;
   }
 
-  ua = new_ua_context(jcr);
   job = jcr->dir_impl->res.job;
   client = jcr->dir_impl->res.client;
   pool = jcr->dir_impl->res.pool;
 
-  if (job->PruneJobs || client->AutoPrune) {
-    PruneJobs(ua, client, pool);
-    pruned = true;
-  } else {
-    pruned = false;
-  }
+  bool prune_jobs = job->PruneJobs || client->AutoPrune;
+  bool prune_files = job->PruneFiles || client->AutoPrune;
+  if (!prune_jobs && !prune_files) { return; }
 
-  if (job->PruneFiles || client->AutoPrune) {
-    PruneFiles(ua, client, pool);
-    pruned = true;
+  // With Background Autoprune set this only queues the pruning
+  if (QueueBackgroundPrune(jcr, prune_jobs, prune_files)) {
+    Jmsg(jcr, M_INFO, 0, T_("Auto prune queued.\n\n"));
+    return;
   }
-  if (pruned) { Jmsg(jcr, M_INFO, 0, T_("End auto prune.\n\n")); }
+
+  ua = new_ua_context(jcr);
+  if (prune_jobs) { PruneJobs(ua, client, pool); }
+  if (prune_files) { PruneFiles(ua, client, pool); }
+  Jmsg(jcr, M_INFO, 0, T_("End auto prune.\n\n"));
   FreeUaContext(ua);
   return;
 }
 
+/* When many jobs run out of volumes at the same time, each of them walks all
+ * volumes of the pool under the db lock.  If such a walk did not find a
+ * volume, the ones within kPruneVolumesInterval seconds will not find one
+ * either, as long as no retention expired in between, so they are skipped.
+ * The key is PoolId, MediaType, InChanger and StorageId. */
+static constexpr utime_t kPruneVolumesInterval = 60;
+static std::mutex fruitless_prunes_mutex;
+static std::map<std::tuple<DBId_t, std::string, bool, DBId_t>, utime_t>
+    fruitless_prunes;
+
 /**
  * Prune at least one Volume in current Pool. This is called from catreq.c =>
  * next_vol.c when the Storage daemon is asking for another volume and no
@@ -99,6 +115,21 @@ void PruneVolumes(JobControlRecord* jcr,
     return;
   }
 
+  auto key = std::make_tuple(mr->PoolId, std::string{mr->MediaType}, InChanger,
+                             InChanger ? mr->StorageId : 0);
+  utime_t started = (utime_t)time(NULL);
+  {
+    std::lock_guard lock(fruitless_prunes_mutex);
+    auto last = fruitless_prunes.find(key);
+    if (last != fruitless_prunes.end()
+        && started - last->second < kPruneVolumesInterval) {
+      Dmsg1(100, "Pruning PoolId=%d found no volume just now, skipping.\n",
+            (int)mr->PoolId);
+      return;
+    }
+  }
+  bool found = false;
+
   ua = new_ua_context(jcr);
   DbLocker _{jcr->db};
 
@@ -209,11 +240,21 @@ void PruneVolumes(JobControlRecord* jcr,
               (int)lmr.MediaId);
         memcpy(mr, &lmr, sizeof(MediaDbRecord));
         SetStorageidInMr(store, mr);
+        found = true;
         break; /* got a volume */
       }
     }
   }
 
+  {
+    std::lock_guard lock(fruitless_prunes_mutex);
+    if (found) {
+      fruitless_prunes.erase(key);
+    } else {
+      fruitless_prunes[key] = started;
+    }
+  }
+
 bail_out:
   Dmsg0(100, "Leave prune volumes\n");
   FreeUaContext(ua);
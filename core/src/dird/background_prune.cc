@@ -0,0 +1,257 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * prune after terminated jobs in the background
+ *
+ * DoAutoprune() runs the job and file pruning at the end of every job, in the
+ * thread of the job, which can take longer than the job itself.  With
+ * Director: Background Autoprune the pruning is queued instead.  Requests for
+ * the same catalog, client and pool are merged, and a single worker thread
+ * runs them once no job is running, or once they waited for kMaxPruneLag
+ * seconds.  After every prune the worker pauses as long as the prune took,
+ * so that it never keeps the catalog busy for more than half of the time.
+ */
+
+#include "include/bareos.h"
+#include "dird.h"
+#include "dird/background_prune.h"
+#include "dird/dird_globals.h"
+#include "dird/director_jcr_impl.h"
+#include "dird/get_database_connection.h"
+#include "dird/ua_prune.h"
+#include "dird/ua_server.h"
+#include "dird/ua.h"
+#include "cats/sql_pooling.h"
+#include "lib/edit.h"
+#include "lib/metrics.h"
+#include "lib/parse_conf.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+
+namespace directordaemon {
+
+namespace {
+// pending prunes are run at the latest after waiting this long for a quiet
+// period
+constexpr time_t kMaxPruneLag = 10 * 60;
+constexpr auto kQuietCheckInterval = std::chrono::seconds(5);
+
+struct pending_prune {
+  bool jobs{false};
+  bool files{false};
+  time_t queued{0};
+  std::string job; /* the job that queued it first, for messages */
+};
+
+// catalog, client and pool
+using prune_key = std::tuple<std::string, std::string, std::string>;
+
+std::mutex mutex;
+std::condition_variable work_available;
+std::map<prune_key, pending_prune> pending;
+std::thread worker;
+bool quit = false;
+bool running_prune = false;
+uint64_t finished_prunes = 0;
+uint64_t merged_prunes = 0;
+
+// Needs mutex to be held.
+time_t OldestQueued()
+{
+  time_t oldest = 0;
+  for (auto& [key, prune] : pending) {
+    if (!oldest || prune.queued < oldest) { oldest = prune.queued; }
+  }
+  return oldest;
+}
+
+metrics::callback_gauge prune_lag{
+    "bareos_dir_prune_lag_seconds",
+    "Time the oldest queued background prune has been waiting", [] {
+      std::unique_lock lock(mutex);
+      time_t oldest = OldestQueued();
+      return oldest ? static_cast<double>(time(nullptr) - oldest) : 0.0;
+    }};
+metrics::callback_gauge queued_prunes{
+    "bareos_dir_queued_prunes", "Background prunes waiting to be run", [] {
+      std::unique_lock lock(mutex);
+      return static_cast<double>(pending.size());
+    }};
+
+void RunPrune(const prune_key& key, const pending_prune& prune)
+{
+  auto& [catalog_name, client_name, pool_name] = key;
+  JobControlRecord* jcr = new_control_jcr("*Autoprune*", JT_CONSOLE);
+  ClientResource* client = nullptr;
+  PoolResource* pool = nullptr;
+  {
+    ResLocker _{my_config};
+    jcr->dir_impl->res.catalog = static_cast<CatalogResource*>(
+        my_config->GetResWithName(R_CATALOG, catalog_name.c_str()));
+    client = static_cast<ClientResource*>(
+        my_config->GetResWithName(R_CLIENT, client_name.c_str()));
+    if (!pool_name.empty()) {
+      pool = static_cast<PoolResource*>(
+          my_config->GetResWithName(R_POOL, pool_name.c_str()));
+    }
+    if (jcr->dir_impl->res.catalog) { jcr->db = GetDatabaseConnection(jcr); }
+  }
+
+  if (!jcr->db || !client) {
+    Qmsg2(nullptr, M_ERROR, 0,
+          T_("Background prune after job %s: client \"%s\" or its catalog is "
+             "gone.\n"),
+          prune.job.c_str(), client_name.c_str());
+  } else {
+    Dmsg3(100, "Background prune of client %s pool %s queued by %s\n",
+          client_name.c_str(), pool_name.c_str(), prune.job.c_str());
+    UaContext* ua = new_ua_context(jcr);
+    if (prune.jobs) { PruneJobs(ua, client, pool); }
+    if (prune.files) { PruneFiles(ua, client, pool); }
+    FreeUaContext(ua);
+  }
+
+  if (jcr->db) {
+    DbSqlClosePooledConnection(jcr, jcr->db);
+    jcr->db = nullptr;
+  }
+  FreeJcr(jcr);
+}
+
+void BackgroundPruneWorker()
+{
+  std::unique_lock lock(mutex);
+  for (;;) {
+    work_available.wait(lock, [] { return quit || !pending.empty(); });
+    if (quit) { break; }
+
+    // wait for a quiet period, but not forever
+    while (!quit && JobCount() > 0
+           && time(nullptr) - OldestQueued() < kMaxPruneLag) {
+      work_available.wait_for(lock, kQuietCheckInterval);
+    }
+    if (quit) { break; }
+
+    auto oldest = pending.begin();
+    for (auto it = pending.begin(); it != pending.end(); ++it) {
+      if (it->second.queued < oldest->second.queued) { oldest = it; }
+    }
+    prune_key key = oldest->first;
+    pending_prune prune = std::move(oldest->second);
+    pending.erase(oldest);
+    running_prune = true;
+    lock.unlock();
+
+    auto start = std::chrono::steady_clock::now();
+    RunPrune(key, prune);
+    auto took = std::chrono::steady_clock::now() - start;
+
+    lock.lock();
+    running_prune = false;
+    finished_prunes += 1;
+    work_available.wait_for(lock, took, [] { return quit; });
+  }
+}
+}  // namespace
+
+bool StartBackgroundPruneThread()
+{
+  if (!me->background_autoprune) { return false; }
+
+  std::unique_lock lock(mutex);
+  if (worker.joinable()) { return true; }
+
+  quit = false;
+  worker = std::thread(BackgroundPruneWorker);
+  Dmsg0(100, "Started background prune thread\n");
+
+  return true;
+}
+
+void StopBackgroundPruneThread()
+{
+  std::thread stopping;
+  {
+    std::unique_lock lock(mutex);
+    quit = true;
+    stopping.swap(worker);
+    pending.clear();
+  }
+  work_available.notify_all();
+
+  if (stopping.joinable()) { stopping.join(); }
+}
+
+// Returns false if the job has to prune itself.
+bool QueueBackgroundPrune(JobControlRecord* jcr, bool jobs, bool files)
+{
+  if (!jcr->dir_impl->res.catalog || !jcr->dir_impl->res.client) {
+    return false;
+  }
+  PoolResource* pool = jcr->dir_impl->res.pool;
+  prune_key key{jcr->dir_impl->res.catalog->resource_name_,
+                jcr->dir_impl->res.client->resource_name_,
+                pool ? pool->resource_name_ : ""};
+
+  {
+    std::unique_lock lock(mutex);
+    if (!worker.joinable() || quit) { return false; }
+
+    auto [it, inserted] = pending.try_emplace(key);
+    pending_prune& prune = it->second;
+    if (inserted) {
+      prune.queued = time(nullptr);
+      prune.job = jcr->Job;
+    } else {
+      merged_prunes += 1;
+    }
+    prune.jobs = prune.jobs || jobs;
+    prune.files = prune.files || files;
+  }
+  work_available.notify_one();
+  return true;
+}
+
+void ListBackgroundPruneStatus(UaContext* ua)
+{
+  std::unique_lock lock(mutex);
+  if (!worker.joinable()) { return; }
+
+  char ed1[50], ed2[50];
+  time_t oldest = OldestQueued();
+  ua->SendMsg(T_("\nBackground Autoprune:\n"));
+  ua->SendMsg(
+      T_("Queued: %d, running: %d, lag: %d sec, done: %s, merged: %s\n"),
+      (int)pending.size(), running_prune ? 1 : 0,
+      oldest ? (int)(time(nullptr) - oldest) : 0,
+      edit_uint64_with_commas(finished_prunes, ed1),
+      edit_uint64_with_commas(merged_prunes, ed2));
+  ua->SendMsg("====\n");
+}
+
+} /* namespace directordaemon */
@@ -35,12 +35,14 @@
 #include "include/bareos.h"
 #include "dird.h"
 #include "dird/dird_globals.h"
+#include "dird/accurate_snapshot.h"
 #include "dird/backup.h"
 #include "dird/fd_cmds.h"
 #include "dird/getmsg.h"
 #include "dird/inc_conf.h"
 #include "dird/director_jcr_impl.h"
 #include "dird/job.h"
+#include "dird/mirror.h"
 #include "dird/msgchan.h"
 #include "dird/quota.h"
 #include "dird/sd_cmds.h"
@@ -56,11 +58,21 @@
 #include "lib/util.h"
 #include "lib/version.h"
 #include "lib/bpipe.h"
+#include "lib/accurate_stream.h"
+#include "lib/message_builder.h"
+
+#include <charconv>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 
 namespace directordaemon {
 
 /* Commands sent to File daemon */
 static char backupcmd[] = "backup FileIndex=%ld\n";
+static char backupcmd_binary[]
+    = "backup FileIndex=%ld binaryattributes=1\n";
 static char storaddrcmd[] = "storage address=%s port=%d ssl=%d\n";
 static char passiveclientcmd[] = "passive client address=%s port=%d ssl=%d\n";
 
@@ -169,11 +181,76 @@ bool DoNativeBackupInit(JobControlRecord* jcr)
 
   if (!ValidateClient(jcr) || !ValidateStorage(jcr)) { return false; }
 
+  if (const ResumePoint& resume = jcr->dir_impl->resume; resume.JobId) {
+    if (jcr->getJobLevel() != resume.JobLevel) {
+      Jmsg(jcr, M_FATAL, 0, T_("JobId %u can only be resumed as %s backup.\n"),
+           resume.JobId, JobLevelToString(resume.JobLevel));
+      return false;
+    }
+    return true; /* its clones ran already */
+  }
+
+  // the mirror of a backup is no backup to run on its own
+  if (jcr->dir_impl->is_mirror) { return true; }
+
+  if (!SetupBackupMirror(jcr)) { return false; }
+
   CreateClones(jcr); /* run any clone jobs */
 
   return true;
 }
 
+static const char* sql_unsaved_files
+    = "DELETE FROM File WHERE JobId=%s AND FileIndex>%d";
+
+static const char* sql_unsaved_jobmedia
+    = "DELETE FROM JobMedia WHERE JobId=%s AND FirstIndex>%d";
+
+static const char* sql_trim_jobmedia
+    = "UPDATE JobMedia SET LastIndex=%d WHERE JobId=%s AND LastIndex>%d";
+
+/**
+ * Take over the Job record of the incomplete backup a job resumes.  Its
+ * JobMedia records get cut back to the files in the catalog, so what was
+ * written of the next ones is never read in a restore.
+ */
+bool ResumeBackupJobRecord(JobControlRecord* jcr)
+{
+  const ResumePoint& resume = jcr->dir_impl->resume;
+  JobDbRecord jr;
+  char ed1[50];
+
+  jr.JobId = resume.JobId;
+  DbLocker _{jcr->db};
+  if (!jcr->db->GetJobRecord(jcr, &jr)) {
+    Jmsg(jcr, M_FATAL, 0, "%s", jcr->db->strerror());
+    return false;
+  }
+
+  PoolMem query(PM_MESSAGE);
+  edit_int64(jr.JobId, ed1);
+  for (const char* sql : {sql_unsaved_files, sql_unsaved_jobmedia}) {
+    Mmsg(query, sql, ed1, resume.FileIndex);
+    if (!jcr->db->SqlQuery(query.c_str())) {
+      Jmsg(jcr, M_FATAL, 0, "%s", jcr->db->strerror());
+      return false;
+    }
+  }
+  Mmsg(query, sql_trim_jobmedia, resume.FileIndex, ed1, resume.FileIndex);
+  if (!jcr->db->SqlQuery(query.c_str())) {
+    Jmsg(jcr, M_FATAL, 0, "%s", jcr->db->strerror());
+    return false;
+  }
+
+  // the storage daemon continues the session of the incomplete backup
+  jcr->dir_impl->jr.JobId = jr.JobId;
+  jcr->VolSessionId = jr.VolSessionId;
+  jcr->VolSessionTime = jr.VolSessionTime;
+  jcr->rerunning = true;
+
+  return true;
+}
+
 // Take all base jobs from job resource and find the last L_BASE jobid.
 static bool GetBaseJobids(JobControlRecord* jcr, db_list_ctx* jobids)
 {
@@ -200,8 +277,52 @@ struct accurate_list_handler_args {
   JobControlRecord* jcr{nullptr};
   std::size_t sent{0};
   std::size_t discarded{0};
+  AccurateSnapshot* snapshot{nullptr};
+  /* When set, the records are collected here by path instead of being sent,
+   * files that were deleted get an empty record. */
+  std::unordered_map<std::string, std::string>* changes{nullptr};
+  PoolMem record{PM_MESSAGE};
+  // set if the fd gets the list in binary form
+  std::optional<AccurateStreamWriter> stream;
 };
 
+static bool FlushAccurateRecords(accurate_list_handler_args* args)
+{
+  if (!args->stream || args->stream->empty()) { return true; }
+
+  bool ok = args->jcr->file_bsock->send(args->stream->data(),
+                                        args->stream->size());
+  args->stream->Clear();
+  return ok;
+}
+
+// record is "/path/fname\0LStat\0MD5\0Delta"
+static bool SendAccurateRecord(accurate_list_handler_args* args,
+                               std::string_view record)
+{
+  if (args->snapshot) { args->snapshot->Add(record.data(), record.size()); }
+  args->sent += 1;
+  if (!args->stream) {
+    return args->jcr->file_bsock->send(record.data(), record.size());
+  }
+
+  std::string_view fields[4];
+  for (std::size_t i = 0; i < 3; ++i) {
+    std::size_t end = std::min(record.find('\0'), record.size());
+    fields[i] = record.substr(0, end);
+    record.remove_prefix(std::min(end + 1, record.size()));
+  }
+  fields[3] = record;
+  uint32_t delta_seq = 0;
+  std::from_chars(fields[3].data(), fields[3].data() + fields[3].size(),
+                  delta_seq);
+
+  if (args->stream->Add(fields[0], fields[1], fields[2], delta_seq)) {
+    return FlushAccurateRecords(args);
+  }
+  return true;
+}
+
 /*
  * Foreach files in currrent list, send "/path/fname\0LStat\0MD5\0Delta" to FD
  *      row[0]=Path, row[1]=Filename, row[2]=FileIndex
@@ -216,23 +337,55 @@ static int AccurateListHandler(void* ctx, int num_fields, char** row)
 
   if (row[2][0] == '0') { /* discard when file_index == 0 */
     args->discarded += 1;
+    if (args->changes) {
+      (*args->changes)[std::string{row[0]} + row[1]].clear();
+    }
     return 0;
   }
 
+  MessageBuilder record(args->record.addr());
+  record << row[0] << row[1] << '\0' << row[4] << '\0';
   /* sending with checksum */
   if (jcr->dir_impl->use_accurate_chksum && num_fields == 9 && row[6][0]
       && /* skip checksum = '0' */
       row[6][1]) {
-    jcr->file_bsock->fsend("%s%s%c%s%c%s%c%s", row[0], row[1], 0, row[4], 0,
-                           row[6], 0, row[5]);
-  } else {
-    jcr->file_bsock->fsend("%s%s%c%s%c%c%s", row[0], row[1], 0, row[4], 0, 0,
-                           row[5]);
+    record << row[6];
   }
-  args->sent += 1;
+  record << '\0' << row[5];
+
+  std::string_view message{args->record.c_str(),
+                           static_cast<std::size_t>(record.size())};
+  if (args->changes) {
+    (*args->changes)[std::string{row[0]} + row[1]] = message;
+    return 0;
+  }
+
+  SendAccurateRecord(args, message);
   return 0;
 }
 
+/* Sends the files of the snapshot that the newer jobs did not change or
+ * delete, followed by the changed ones. */
+static bool SendAccurateSnapshot(
+    accurate_list_handler_args* args,
+    AccurateSnapshot& stored,
+    const std::unordered_map<std::string, std::string>& changes)
+{
+  std::string_view record;
+  while (!args->jcr->IsJobCanceled() && stored.Next(record)) {
+    std::string_view path = record.substr(0, record.find('\0'));
+    if (changes.find(std::string{path}) != changes.end()) { continue; }
+    SendAccurateRecord(args, record);
+  }
+
+  if (stored.ReadError()) { return false; }
+
+  for (const auto& [path, change] : changes) {
+    if (!change.empty()) { SendAccurateRecord(args, change); }
+  }
+  return true;
+}
+
 /* In this procedure, we check if the current fileset is using checksum
  * FileSet-> Include-> Options-> Accurate/Verify/BaseJob=checksum
  * This procedure uses jcr->HasBase, so it must be call after the initialization
@@ -346,11 +499,15 @@ bool SendAccurateCurrentFiles(JobControlRecord* jcr)
     Jmsg(jcr, M_INFO, 0, "Sending Accurate information (estimated %s files).\n",
          count_as_str.c_str());
   }
-  jcr->file_bsock->fsend("accurate files=%s\n", count_as_str.c_str());
-
-
   accurate_list_handler_args args;
   args.jcr = jcr;
+  if (jcr->dir_impl->FDVersion >= FD_VERSION_55) {
+    args.stream.emplace();
+    jcr->file_bsock->fsend("accurate files=%s binary=1\n",
+                           count_as_str.c_str());
+  } else {
+    jcr->file_bsock->fsend("accurate files=%s\n", count_as_str.c_str());
+  }
 
   if (jcr->HasBase) {
     jcr->nb_base_files = nb.GetFrontAsInteger();
@@ -372,15 +529,56 @@ bool SendAccurateCurrentFiles(JobControlRecord* jcr)
       return false; /* Fail */
     }
 
-    if (DbLocker _{jcr->db_batch}; !jcr->db_batch->GetFileList(
-            jcr, jobids.GetAsString().c_str(),
-            jcr->dir_impl->use_accurate_chksum, false /* no delta */,
-            AccurateListHandler, (void*)&args)) {
+    std::optional<AccurateSnapshot> snapshot;
+    std::size_t covered = 0;
+    if (jcr->JobId && jcr->dir_impl->res.job->accurate_snapshot) {
+      snapshot.emplace(jcr, jcr->dir_impl->use_accurate_chksum);
+      covered = snapshot->Open(jobids);
+      if (snapshot->Create(jobids.GetAsString())) {
+        args.snapshot = &*snapshot;
+      }
+    }
+
+    if (covered) {
+      // only the jobs that came after the snapshot are read from the catalog
+      db_list_ctx newer;
+      newer.Append({jobids.begin() + covered, jobids.end()});
+      Jmsg(jcr, M_INFO, 0,
+           T_("Taking the files of %s of %s jobs from the accurate "
+              "snapshot.\n"),
+           std::to_string(covered).c_str(),
+           std::to_string(jobids.size()).c_str());
+
+      std::unordered_map<std::string, std::string> changes;
+      if (!newer.empty()) {
+        args.changes = &changes;
+        if (DbLocker _{jcr->db_batch}; !jcr->db_batch->GetFileList(
+                jcr, newer.GetAsString().c_str(),
+                jcr->dir_impl->use_accurate_chksum, false /* no delta */,
+                AccurateListHandler, (void*)&args, true /* with deleted */)) {
+          Jmsg(jcr, M_FATAL, 0, "error in jcr->db_batch->GetFileList:%s\n",
+               jcr->db_batch->strerror());
+          return false;
+        }
+        args.changes = nullptr;
+      }
+
+      if (!SendAccurateSnapshot(&args, *snapshot, changes)) {
+        Jmsg(jcr, M_FATAL, 0, T_("Could not read the accurate snapshot.\n"));
+        return false;
+      }
+    } else if (DbLocker _{jcr->db_batch}; !jcr->db_batch->GetFileList(
+                   jcr, jobids.GetAsString().c_str(),
+                   jcr->dir_impl->use_accurate_chksum, false /* no delta */,
+                   AccurateListHandler, (void*)&args)) {
       Jmsg(jcr, M_FATAL, 0, "error in jcr->db_batch->GetBaseFileList:%s\n",
            jcr->db_batch->strerror());
       return false;
     }
+
+    if (args.snapshot && !jcr->IsJobCanceled()) { snapshot->Commit(); }
   }
+  FlushAccurateRecords(&args);
   accurate_timer.stop();
 
   if (jcr->JobId) { /* display the message only for real jobs */
@@ -559,6 +757,11 @@ bool DoNativeBackup(JobControlRecord* jcr)
     return false;
   }
 
+  if (jcr->dir_impl->resume.JobId && !SendResumePoint(jcr)) {
+    TerminateBackupWithError(jcr);
+    return false;
+  }
+
   if (!SendIncludeExcludeLists(jcr)) {
     TerminateBackupWithError(jcr);
     return false;
@@ -606,6 +809,11 @@ bool DoNativeBackup(JobControlRecord* jcr)
    * is after the start of this run. */
   jcr->start_time = time(nullptr);
   jcr->dir_impl->jr.StartTime = jcr->start_time;
+  /* A resumed backup keeps its start time, the next one has to look at what
+   * changed during the first part. */
+  if (jcr->dir_impl->resume.JobId) {
+    jcr->dir_impl->jr.StartTime = jcr->dir_impl->resume.StartTime;
+  }
   if (DbLocker _{jcr->db};
       !jcr->db->UpdateJobStartRecord(jcr, &jcr->dir_impl->jr)) {
     Jmsg(jcr, M_FATAL, 0, "%s", jcr->db->strerror());
@@ -622,9 +830,20 @@ bool DoNativeBackup(JobControlRecord* jcr)
     return false;
   }
 
+  if (!StartBackupMirror(jcr)) { return false; }
+
   if (!ConfigureMessageThread(jcr)) { return false; }
 
-  jcr->file_bsock->fsend(backupcmd, jcr->JobFiles);
+  /* The files saved after resuming are numbered after the ones saved before,
+   * within the same session on the storage daemon. */
+  if (jcr->dir_impl->resume.JobId) {
+    jcr->JobFiles = jcr->dir_impl->resume.FileIndex;
+  }
+
+  // Older FDs ignore the request and send text attributes
+  jcr->file_bsock->fsend(
+      jcr->dir_impl->res.job->binary_attributes ? backupcmd_binary : backupcmd,
+      jcr->JobFiles);
   Dmsg1(100, ">filed: %s", jcr->file_bsock->msg);
   if (!response(jcr, jcr->file_bsock, OKbackup, "Backup", DISPLAY_ERROR)) {
     TerminateBackupWithError(jcr);
@@ -633,9 +852,15 @@ bool DoNativeBackup(JobControlRecord* jcr)
 
   int status = WaitForJobTermination(jcr);
   if (jcr->batch_started) {
+    auto timer = jcr->dir_impl->stage_times.Time(catalog_stage::kBatchCommit);
     jcr->db_batch->WriteBatchFileRecords(
         jcr);  // used by bulk batch file insert
   }
+  if (std::string stages
+      = jcr->dir_impl->stage_times.Format(catalog_stage_names);
+      !stages.empty()) {
+    Jmsg(jcr, M_INFO, 0, T_("Catalog stages: %s\n"), stages.c_str());
+  }
   if (jcr->HasBase) {
     if (DbLocker _{jcr->db}; !jcr->db->CommitBaseFileAttributesRecord(jcr)) {
       Jmsg(jcr, M_FATAL, 0, "%s", jcr->db->strerror());
@@ -728,10 +953,11 @@ int WaitForJobTermination(JobControlRecord* jcr, int timeout)
 
   // Return values from FD
   if (fd_ok) {
+    // for a resumed backup this includes the files saved before
     jcr->JobFiles = JobFiles;
     jcr->JobErrors += JobErrors; /* Keep total errors */
     jcr->ReadBytes = ReadBytes;
-    jcr->JobBytes = JobBytes;
+    jcr->JobBytes = JobBytes + jcr->dir_impl->resume.JobBytes;
     jcr->JobWarnings = JobWarnings;
     jcr->dir_impl->VSS = VSS;
     jcr->dir_impl->Encrypt = Encrypt;
@@ -770,6 +996,7 @@ void NativeBackupCleanup(JobControlRecord* jcr, int TermCode)
   }
 
   UpdateJobEnd(jcr, TermCode);
+  FinishBackupMirror(jcr, TermCode);
 
   if (DbLocker _{jcr->db}; !jcr->db->GetJobRecord(jcr, &jcr->dir_impl->jr)) {
     Jmsg(jcr, M_WARNING, 0,
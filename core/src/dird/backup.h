@@ -26,6 +26,7 @@ namespace directordaemon {
 
 int WaitForJobTermination(JobControlRecord* jcr, int timeout = 0);
 bool DoNativeBackupInit(JobControlRecord* jcr);
+bool ResumeBackupJobRecord(JobControlRecord* jcr);
 bool DoNativeBackup(JobControlRecord* jcr);
 void NativeBackupCleanup(JobControlRecord* jcr, int TermCode);
 void UpdateBootstrapFile(JobControlRecord* jcr);
@@ -39,7 +39,11 @@
 #include "lib/parse_conf.h"
 
 #include <algorithm>
+#include <map>
 #include <optional>
+#include <set>
+#include <string>
+#include <vector>
 
 namespace directordaemon {
 
@@ -65,47 +69,71 @@ RestoreBootstrapRecord::~RestoreBootstrapRecord()
 void RestoreBootstrapRecordFileIndex::Add(int32_t findex)
 {
   if (findex == 0) { return; /* probably a dummy directory */ }
-  fileIds_.push_back(findex);
-  sorted_ = false;
+  if (!ranges_.empty()) {
+    range& last = ranges_.back();
+    if (findex >= last.first && findex <= last.second) { return; }
+    if (findex == last.second + 1) {
+      last.second = findex; /* the common case, keeps ranges_ merged */
+      return;
+    }
+    if (findex == last.first - 1) {
+      last.first = findex;
+    } else {
+      ranges_.emplace_back(findex, findex);
+    }
+    std::size_t n = ranges_.size();
+    if (n > 1 && ranges_[n - 1].first <= ranges_[n - 2].second + 1) {
+      merged_ = false;
+      if (ranges_[n - 1].first < ranges_[n - 2].first) { sorted_ = false; }
+    }
+  } else {
+    ranges_.emplace_back(findex, findex);
+  }
+
+  // do not let unmerged ranges pile up if the indexes come in random order
+  if (!merged_ && ranges_.size() >= 2 * merged_size_ + 1024) { Merge(); }
 }
 
 void RestoreBootstrapRecordFileIndex::AddAll() { allFiles_ = true; }
-void RestoreBootstrapRecordFileIndex::Sort()
-{
-  if (sorted_) return;
 
-  if (!std::is_sorted(fileIds_.begin(), fileIds_.end())) {
-    std::sort(fileIds_.begin(), fileIds_.end());
+void RestoreBootstrapRecordFileIndex::Merge()
+{
+  if (!sorted_) {
+    std::sort(ranges_.begin(), ranges_.end());
+    sorted_ = true;
   }
-  sorted_ = true;
+  std::size_t n = 0;
+  for (std::size_t i = 1; i < ranges_.size(); ++i) {
+    if (ranges_[i].first <= ranges_[n].second + 1) {
+      ranges_[n].second = std::max(ranges_[n].second, ranges_[i].second);
+    } else {
+      ranges_[++n] = ranges_[i];
+    }
+  }
+  if (!ranges_.empty()) { ranges_.resize(n + 1); }
+  merged_size_ = ranges_.size();
+  merged_ = true;
 }
 
-std::vector<std::pair<int32_t, int32_t>>
+const std::vector<RestoreBootstrapRecordFileIndex::range>&
 RestoreBootstrapRecordFileIndex::GetRanges()
 {
-  if (allFiles_) {
-    return std::vector<std::pair<int32_t, int32_t>>{
-        std::make_pair(1, INT32_MAX)};
-  } else {
-    Sort();
-
-    auto ranges = std::vector<std::pair<int32_t, int32_t>>{};
-    auto begin = int32_t{0};
-    auto end = int32_t{0};
-
-    for (auto fileId : fileIds_) {
-      if (begin == 0) {
-        begin = end = fileId;
-      } else if (fileId > end + 1) {
-        ranges.push_back(std::make_pair(begin, end));
-        begin = end = fileId;
-      } else {
-        end = fileId;
-      }
-    }
-    ranges.push_back(std::make_pair(begin, end));
-    return ranges;
-  }
+  static const std::vector<range> all_files{range{1, INT32_MAX}};
+  if (allFiles_) { return all_files; }
+  if (!merged_) { Merge(); }
+  return ranges_;
+}
+
+// first of the sorted ranges that ends at or after findex
+static auto FirstRangeFrom(
+    const std::vector<RestoreBootstrapRecordFileIndex::range>& ranges,
+    uint32_t findex)
+{
+  return std::lower_bound(
+      ranges.begin(), ranges.end(), findex,
+      [](const RestoreBootstrapRecordFileIndex::range& r, uint32_t value) {
+        return static_cast<uint32_t>(r.second) < value;
+      });
 }
 
 // Get storage device name from Storage resource
@@ -166,7 +194,13 @@ uint32_t write_findex(RestoreBootstrapRecordFileIndex* fi,
   };
   std::optional<minmax> min_max_index;
 
-  for (auto& range : fi->GetRanges()) {
+  /* There is one call per JobMedia record, so only look at the ranges that
+   * can overlap with it. */
+  const auto& ranges = fi->GetRanges();
+  for (auto it = FirstRangeFrom(ranges, FirstIndex);
+       it != ranges.end() && static_cast<uint32_t>(it->first) <= LastIndex;
+       ++it) {
+    auto& range = *it;
     ASSERT(range.first >= 0);
     ASSERT(range.second >= 0);
     auto first = std::max(static_cast<uint32_t>(range.first), FirstIndex);
@@ -210,10 +244,10 @@ static inline bool is_volume_selected(RestoreBootstrapRecordFileIndex* fi,
                                       int32_t FirstIndex,
                                       int32_t LastIndex)
 {
-  for (auto range : fi->GetRanges()) {
-    if (range.first <= LastIndex && range.second >= FirstIndex) { return true; }
-  }
-  return false;
+  if (LastIndex < FirstIndex || LastIndex < 0) { return false; }
+  const auto& ranges = fi->GetRanges();
+  auto it = FirstRangeFrom(ranges, std::max(FirstIndex, 0));
+  return it != ranges.end() && it->first <= LastIndex;
 }
 
 
@@ -386,129 +420,204 @@ void DisplayBsrInfo(UaContext* ua, RestoreContext& rx)
   return;
 }
 
-// Write bsr data for a single bsr record
-static uint32_t write_bsr_item(RestoreBootstrapRecord* bsr,
+// Write bsr data for one JobMedia record of a job
+static uint32_t write_bsr_item(const RestoreVolumeSegment& segment,
                                UaContext* ua,
                                RestoreContext& rx,
                                std::string& buffer,
-                               bool& first,
-                               uint32_t& LastIndex)
+                               std::optional<uint32_t>& LastIndex)
 {
-  int i;
+  RestoreBootstrapRecord* bsr = segment.bsr;
+  VolumeParameters& vol = bsr->VolParams[segment.vol];
   char ed1[50], ed2[50];
-  uint32_t count = 0;
-  uint32_t total_count = 0;
   char device[MAX_NAME_LENGTH];
 
-  /* For a given volume, loop over all the JobMedia records.
-   * VolCount is the number of JobMedia records. */
-  for (i = 0; i < bsr->VolCount; i++) {
-    if (!is_volume_selected(bsr->fi.get(), bsr->VolParams[i].FirstIndex,
-                            bsr->VolParams[i].LastIndex)) {
-      bsr->VolParams[i].VolumeName[0] = 0; /* zap VolumeName */
-      continue;
-    }
-
-    if (!rx.store) {
-      FindStorageResource(ua, rx, bsr->VolParams[i].Storage,
-                          bsr->VolParams[i].MediaType);
-    }
-
-    PrintBsrItem(buffer, "Storage=\"%s\"\n", bsr->VolParams[i].Storage);
-    PrintBsrItem(buffer, "Volume=\"%s\"\n", bsr->VolParams[i].VolumeName);
-    PrintBsrItem(buffer, "MediaType=\"%s\"\n", bsr->VolParams[i].MediaType);
+  if (!rx.store) { FindStorageResource(ua, rx, vol.Storage, vol.MediaType); }
 
-    if (bsr->fileregex) {
-      PrintBsrItem(buffer, "FileRegex=%s\n", bsr->fileregex);
-    }
+  PrintBsrItem(buffer, "Storage=\"%s\"\n", vol.Storage);
+  PrintBsrItem(buffer, "Volume=\"%s\"\n", vol.VolumeName);
+  PrintBsrItem(buffer, "MediaType=\"%s\"\n", vol.MediaType);
 
-    if (GetStorageDevice(device, bsr->VolParams[i].Storage)) {
-      PrintBsrItem(buffer, "Device=\"%s\"\n", device);
-    }
+  if (bsr->fileregex) {
+    PrintBsrItem(buffer, "FileRegex=%s\n", bsr->fileregex);
+  }
 
-    if (bsr->VolParams[i].Slot > 0) {
-      PrintBsrItem(buffer, "Slot=%d\n", bsr->VolParams[i].Slot);
-    }
+  if (GetStorageDevice(device, vol.Storage)) {
+    PrintBsrItem(buffer, "Device=\"%s\"\n", device);
+  }
 
-    PrintBsrItem(buffer, "VolSessionId=%u\n", bsr->VolSessionId);
-    PrintBsrItem(buffer, "VolSessionTime=%u\n", bsr->VolSessionTime);
-    PrintBsrItem(buffer, "VolAddr=%s-%s\n",
-                 edit_uint64(bsr->VolParams[i].StartAddr, ed1),
-                 edit_uint64(bsr->VolParams[i].EndAddr, ed2));
+  if (vol.Slot > 0) { PrintBsrItem(buffer, "Slot=%d\n", vol.Slot); }
 
-    uint32_t start = bsr->VolParams[i].FirstIndex;
-    uint32_t end = bsr->VolParams[i].LastIndex;
-    count = write_findex(bsr->fi.get(), start, end, buffer);
-    if (count) { PrintBsrItem(buffer, "Count=%u\n", count); }
+  PrintBsrItem(buffer, "VolSessionId=%u\n", bsr->VolSessionId);
+  PrintBsrItem(buffer, "VolSessionTime=%u\n", bsr->VolSessionTime);
+  PrintBsrItem(buffer, "VolAddr=%s-%s\n", edit_uint64(vol.StartAddr, ed1),
+               edit_uint64(vol.EndAddr, ed2));
 
-    total_count += count;
+  uint32_t start = vol.FirstIndex;
+  uint32_t end = vol.LastIndex;
+  uint32_t count = write_findex(bsr->fi.get(), start, end, buffer);
+  if (count) { PrintBsrItem(buffer, "Count=%u\n", count); }
 
-    /* If the same file is present on two tapes or in two files
-     * on a tape, it is a continuation, and should not be treated
-     * twice in the totals. */
-    if (!first && count > 0 && LastIndex == start) { total_count--; }
-    first = false;
-    LastIndex = end;
-  }
+  /* If the same file is present on two tapes or in two files
+   * on a tape, it is a continuation, and should not be treated
+   * twice in the totals. */
+  uint32_t total_count = count;
+  if (LastIndex && count > 0 && *LastIndex == start) { total_count--; }
+  LastIndex = end;
 
   return total_count;
 }
 
-/**
- * Here we actually write out the details of the bsr file.
- * Note, there is one bsr for each JobId, but the bsr may
- * have multiple volumes, which have been entered in the
- * order they were written.
- *
- * The bsrs must be written out in the order the JobIds
- * are found in the jobid list.
- */
-uint32_t WriteBsr(UaContext* ua, RestoreContext& rx, std::string& buffer)
+/* The JobMedia records with selected files, job by job in the order the
+ * JobIds are found in the jobid list, and for each job in the order they
+ * were written. */
+static std::vector<RestoreVolumeSegment> SelectedSegments(RestoreContext& rx)
 {
-  bool first = true;
-  uint32_t LastIndex = 0;
-  uint32_t total_count = 0;
-  const char* p;
-  JobId_t JobId;
-  RestoreBootstrapRecord* bsr;
-
-  std::optional<std::pair<std::size_t, std::size_t>> last_job;
-
+  std::vector<RestoreBootstrapRecord*> jobs;
   if (*rx.JobIds == 0) {
-    for (bsr = rx.bsr.get(); bsr; bsr = bsr->next.get()) {
-      std::pair<std::size_t, std::size_t> this_job{bsr->VolSessionId,
-                                                   bsr->VolSessionTime};
-
-      if (last_job != this_job) {
-        // cannot compare indices between jobs
-        LastIndex = 0;
+    for (RestoreBootstrapRecord* bsr = rx.bsr.get(); bsr;
+         bsr = bsr->next.get()) {
+      jobs.push_back(bsr);
+    }
+  } else {
+    std::set<RestoreBootstrapRecord*> seen;
+    JobId_t JobId;
+    for (const char* p = rx.JobIds; GetNextJobidFromList(&p, &JobId) > 0;) {
+      for (RestoreBootstrapRecord* bsr = rx.bsr.get(); bsr;
+           bsr = bsr->next.get()) {
+        if (JobId == bsr->JobId && seen.insert(bsr).second) {
+          jobs.push_back(bsr);
+        }
       }
+    }
+  }
 
-      total_count += write_bsr_item(bsr, ua, rx, buffer, first, LastIndex);
-
-      last_job = this_job;
+  std::vector<RestoreVolumeSegment> segments;
+  for (RestoreBootstrapRecord* bsr : jobs) {
+    for (int i = 0; i < bsr->VolCount; i++) {
+      if (!is_volume_selected(bsr->fi.get(), bsr->VolParams[i].FirstIndex,
+                              bsr->VolParams[i].LastIndex)) {
+        bsr->VolParams[i].VolumeName[0] = 0; /* zap VolumeName */
+        continue;
+      }
+      segments.push_back(RestoreVolumeSegment{bsr, i});
     }
-    return total_count;
   }
+  return segments;
+}
 
-  for (p = rx.JobIds; GetNextJobidFromList(&p, &JobId) > 0;) {
-    for (bsr = rx.bsr.get(); bsr; bsr = bsr->next.get()) {
-      if (JobId == bsr->JobId) {
-        std::pair<std::size_t, std::size_t> this_job{bsr->VolSessionId,
-                                                     bsr->VolSessionTime};
+std::vector<RestoreVolumeSegment> PlanRestoreReads(
+    const std::vector<RestoreVolumeSegment>& segments)
+{
+  struct volume {
+    std::string name{};
+    std::string storage{};
+    std::vector<std::size_t> segments{};
+    std::set<std::size_t> before{}; /**< Volumes only read after this one */
+    std::size_t after = 0;          /**< Volumes to read before this one */
+  };
 
-        if (last_job != this_job) {
-          // cannot compare indices between jobs
-          LastIndex = 0;
-        }
+  // the volumes in the order they are first needed
+  std::vector<volume> volumes;
+  std::map<std::string, std::size_t> volume_index;
+  std::map<RestoreBootstrapRecord*, std::size_t> volume_of_job;
+  std::set<std::pair<RestoreBootstrapRecord*, std::size_t>> left_by_job;
+  for (std::size_t s = 0; s < segments.size(); ++s) {
+    RestoreBootstrapRecord* bsr = segments[s].bsr;
+    const VolumeParameters& vol = bsr->VolParams[segments[s].vol];
+    auto [found, inserted]
+        = volume_index.try_emplace(vol.VolumeName, volumes.size());
+    if (inserted) { volumes.push_back(volume{vol.VolumeName, vol.Storage}); }
+    std::size_t v = found->second;
+    volumes[v].segments.push_back(s);
+
+    if (auto last = volume_of_job.find(bsr);
+        last != volume_of_job.end() && last->second != v) {
+      if (left_by_job.count({bsr, v})) {
+        Dmsg2(100, "JobId=%u goes back to volume %s, not planning\n",
+              bsr->JobId, vol.VolumeName);
+        return segments;
+      }
+      left_by_job.insert({bsr, last->second});
+      if (volumes[last->second].before.insert(v).second) { volumes[v].after++; }
+    }
+    volume_of_job[bsr] = v;
+  }
 
-        total_count += write_bsr_item(bsr, ua, rx, buffer, first, LastIndex);
+  /* Of the volumes that no job needs later than another one, take the next
+   * on the storage of the previous one, else the one needed first. */
+  std::vector<std::size_t> order;
+  std::vector<bool> taken(volumes.size(), false);
+  const std::string* storage = nullptr;
+  while (order.size() < volumes.size()) {
+    std::optional<std::size_t> next;
+    for (std::size_t v = 0; v < volumes.size(); ++v) {
+      if (taken[v] || volumes[v].after > 0) { continue; }
+      if (!next) { next = v; }
+      if (storage && volumes[v].storage == *storage) {
+        next = v;
+        break;
+      }
+    }
+    if (!next) {
+      Dmsg0(100, "Jobs need the volumes in different orders, not planning\n");
+      return segments;
+    }
+    taken[*next] = true;
+    order.push_back(*next);
+    storage = &volumes[*next].storage;
+    for (std::size_t v : volumes[*next].before) { volumes[v].after--; }
+  }
 
-        last_job = this_job;
+  std::vector<RestoreVolumeSegment> planned;
+  planned.reserve(segments.size());
+  for (std::size_t v : order) {
+    // by address, unless that changes the order of the segments of a job
+    std::vector<std::size_t> on_volume = volumes[v].segments;
+    std::stable_sort(on_volume.begin(), on_volume.end(),
+                     [&segments](std::size_t a, std::size_t b) {
+                       return segments[a].bsr->VolParams[segments[a].vol]
+                                  .StartAddr
+                              < segments[b].bsr->VolParams[segments[b].vol]
+                                    .StartAddr;
+                     });
+    std::map<RestoreBootstrapRecord*, std::size_t> last_of_job;
+    for (std::size_t s : on_volume) {
+      auto [last, inserted] = last_of_job.try_emplace(segments[s].bsr, s);
+      if (!inserted && last->second > s) {
+        on_volume = volumes[v].segments;
+        break;
       }
+      last->second = s;
     }
+    for (std::size_t s : on_volume) { planned.push_back(segments[s]); }
   }
+  return planned;
+}
+
+/**
+ * Here we actually write out the details of the bsr file.
+ * Note, there is one bsr for each JobId, but the bsr may
+ * have multiple volumes, which have been entered in the
+ * order they were written.
+ *
+ * Unless some files are restored in more than one version, where the newest
+ * must come last, the JobMedia records of all jobs are written in the order
+ * of PlanRestoreReads().  Else the bsrs are written out in the order the
+ * JobIds are found in the jobid list.
+ */
+uint32_t WriteBsr(UaContext* ua, RestoreContext& rx, std::string& buffer)
+{
+  std::vector<RestoreVolumeSegment> segments = SelectedSegments(rx);
+  if (!rx.restores_versions) { segments = PlanRestoreReads(segments); }
 
+  uint32_t total_count = 0;
+  // cannot compare indices between jobs
+  std::map<RestoreBootstrapRecord*, std::optional<uint32_t>> last_index;
+  for (const RestoreVolumeSegment& segment : segments) {
+    total_count += write_bsr_item(segment, ua, rx, buffer,
+                                  last_index[segment.bsr]);
+  }
   return total_count;
 }
 
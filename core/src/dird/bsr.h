@@ -37,18 +37,29 @@ struct VolumeParameters;
 
 namespace directordaemon {
 
+/* The file indexes are kept as ranges of consecutive indexes.  Indexes that
+ * come in order (as they do from the catalog) only extend the last range;
+ * everything else is appended as a range of its own and merged lazily, so
+ * large selections need memory in the order of the number of gaps instead
+ * of the number of files. */
 class RestoreBootstrapRecordFileIndex {
+ public:
+  using range = std::pair<int32_t, int32_t>;
+
  private:
-  std::vector<int32_t> fileIds_;
+  std::vector<range> ranges_;
+  std::size_t merged_size_ = 0; /* size after the last Merge() */
   bool allFiles_ = false;
-  bool sorted_ = false;
-  void Sort();
+  bool merged_ = true;
+  bool sorted_ = true;
+  void Merge();
 
  public:
   void Add(int32_t findex);
   void AddAll();
-  std::vector<std::pair<int32_t, int32_t>> GetRanges();
-  bool Empty() const { return !allFiles_ && fileIds_.empty(); }
+  // sorted, non overlapping and non adjacent
+  const std::vector<range>& GetRanges();
+  bool Empty() const { return !allFiles_ && ranges_.empty(); }
 };
 
 /**
@@ -79,6 +90,21 @@ struct RestoreBootstrapRecord {
   RestoreBootstrapRecord& operator=(RestoreBootstrapRecord&&) = delete;
 };
 
+// One JobMedia record of a job that a restore reads
+struct RestoreVolumeSegment {
+  RestoreBootstrapRecord* bsr = nullptr;
+  int vol = 0; /**< Index into bsr->VolParams */
+};
+
+/* Orders the segments a restore reads by where they are.  Every volume is
+ * read in one go, from its beginning to its end, and the volumes on the same
+ * storage follow each other when the order of the volumes of each job
+ * allows it.  The segments of a job stay in their order, so files continued
+ * on another volume are still read in order.  If a job goes back to a volume
+ * it left, the order is kept as it is. */
+std::vector<RestoreVolumeSegment> PlanRestoreReads(
+    const std::vector<RestoreVolumeSegment>& segments);
+
 class UaContext;
 
 struct bootstrap_info {
@@ -0,0 +1,247 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * update the bvfs cache of terminated jobs in the background
+ *
+ * Without this, PathHierarchy and PathVisibility of a job are computed the
+ * first time somebody browses it, which can take minutes for big jobs.
+ * Terminated backup jobs are put into a queue instead, which a bounded number
+ * of worker threads (Director: Bvfs Cache Workers) works off while nobody is
+ * waiting for it.
+ */
+
+#include "include/bareos.h"
+#include "dird.h"
+#include "dird/bvfs_cache.h"
+#include "dird/dird_globals.h"
+#include "dird/director_jcr_impl.h"
+#include "dird/get_database_connection.h"
+#include "dird/ua_server.h"
+#include "dird/ua.h"
+#include "cats/sql_pooling.h"
+#include "lib/edit.h"
+#include "lib/parse_conf.h"
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace directordaemon {
+
+namespace {
+// a worker takes at most this many jobs of the same catalog at once
+constexpr std::size_t max_jobs_per_update = 16;
+
+struct pending_update {
+  std::string catalog;
+  JobId_t JobId;
+};
+
+struct catalog_coverage {
+  uint64_t cached_jobs{0};
+  uint64_t total_jobs{0};
+};
+
+std::mutex mutex;
+std::condition_variable work_available;
+std::deque<pending_update> queue;
+std::vector<std::thread> workers;
+bool quit = false;
+std::size_t running_updates = 0;
+uint64_t finished_updates = 0;
+uint64_t failed_updates = 0;
+std::map<std::string, catalog_coverage> coverage;
+
+bool OpenCatalog(JobControlRecord* jcr, const std::string& name)
+{
+  {
+    ResLocker _{my_config};
+    jcr->dir_impl->res.catalog = static_cast<CatalogResource*>(
+        my_config->GetResWithName(R_CATALOG, name.c_str()));
+    if (jcr->dir_impl->res.catalog) { jcr->db = GetDatabaseConnection(jcr); }
+  }
+  // the resource might be gone after the next reload
+  jcr->dir_impl->res.catalog = nullptr;
+
+  if (!jcr->db) {
+    Qmsg1(nullptr, M_ERROR, 0,
+          T_("Bvfs cache update: could not open catalog \"%s\".\n"),
+          name.c_str());
+    return false;
+  }
+  return true;
+}
+
+void CloseCatalog(JobControlRecord* jcr)
+{
+  if (jcr->db) {
+    DbSqlClosePooledConnection(jcr, jcr->db);
+    jcr->db = nullptr;
+  }
+}
+
+void BvfsCacheWorker()
+{
+  JobControlRecord* jcr = new_control_jcr("*BvfsCacheUpdater*", JT_SYSTEM);
+  std::string current_catalog;
+
+  for (;;) {
+    std::vector<JobId_t> jobids;
+    std::string catalog;
+    {
+      std::unique_lock lock(mutex);
+      work_available.wait(lock, [] { return quit || !queue.empty(); });
+      if (quit) { break; }
+
+      catalog = queue.front().catalog;
+      for (auto it = queue.begin();
+           it != queue.end() && jobids.size() < max_jobs_per_update;) {
+        if (it->catalog == catalog) {
+          jobids.push_back(it->JobId);
+          it = queue.erase(it);
+        } else {
+          ++it;
+        }
+      }
+      running_updates += jobids.size();
+    }
+
+    if (catalog != current_catalog) {
+      CloseCatalog(jcr);
+      current_catalog.clear();
+      if (OpenCatalog(jcr, catalog)) { current_catalog = catalog; }
+    }
+
+    bool ok = false;
+    catalog_coverage cov;
+    bool have_coverage = false;
+    if (jcr->db) {
+      std::string list;
+      char ed1[50];
+      for (JobId_t jobid : jobids) {
+        if (!list.empty()) { list += ','; }
+        list += edit_uint64(jobid, ed1);
+      }
+
+      Dmsg1(100, "Updating bvfs cache of jobs %s\n", list.c_str());
+      ok = jcr->db->BvfsUpdatePathHierarchyCache(jcr, list.c_str());
+      have_coverage = jcr->db->BvfsGetCacheCoverage(jcr, cov.cached_jobs,
+                                                    cov.total_jobs);
+    }
+
+    std::unique_lock lock(mutex);
+    running_updates -= jobids.size();
+    if (ok) {
+      finished_updates += jobids.size();
+    } else {
+      failed_updates += jobids.size();
+    }
+    if (have_coverage) { coverage[catalog] = cov; }
+  }
+
+  CloseCatalog(jcr);
+  FreeJcr(jcr);
+}
+}  // namespace
+
+bool StartBvfsCacheThreads()
+{
+  if (!me->bvfs_cache_workers) { return false; }
+
+  std::unique_lock lock(mutex);
+  if (!workers.empty()) { return true; }
+
+  quit = false;
+  for (uint32_t i = 0; i < me->bvfs_cache_workers; ++i) {
+    workers.emplace_back(BvfsCacheWorker);
+  }
+  Dmsg1(100, "Started %d bvfs cache workers\n", (int)workers.size());
+
+  return true;
+}
+
+void StopBvfsCacheThreads()
+{
+  std::vector<std::thread> stopping;
+  {
+    std::unique_lock lock(mutex);
+    quit = true;
+    stopping.swap(workers);
+    queue.clear();
+  }
+  work_available.notify_all();
+
+  for (auto& worker : stopping) { worker.join(); }
+}
+
+// Remember a terminated job, so that its cache is built before it is browsed
+void QueueBvfsCacheUpdate(JobControlRecord* jcr)
+{
+  switch (jcr->getJobType()) {
+    case JT_BACKUP:
+    case JT_ARCHIVE:
+      break;
+    default:
+      return;
+  }
+  if (!jcr->is_JobStatus(JS_Terminated) && !jcr->is_JobStatus(JS_Warnings)) {
+    return;
+  }
+  if (!jcr->dir_impl->res.catalog || jcr->JobFiles == 0) { return; }
+
+  {
+    std::unique_lock lock(mutex);
+    if (workers.empty() || quit) { return; }
+    queue.push_back(
+        pending_update{jcr->dir_impl->res.catalog->resource_name_, jcr->JobId});
+  }
+  work_available.notify_one();
+}
+
+void ListBvfsCacheStatus(UaContext* ua)
+{
+  std::unique_lock lock(mutex);
+  if (workers.empty()) { return; }
+
+  char ed1[50], ed2[50];
+  ua->SendMsg(T_("\nBvfs Cache:\n"));
+  ua->SendMsg(
+      T_("Workers: %d, queued jobs: %d, running: %d, updated: %s, failed: "
+         "%s\n"),
+      (int)workers.size(), (int)queue.size(), (int)running_updates,
+      edit_uint64_with_commas(finished_updates, ed1),
+      edit_uint64_with_commas(failed_updates, ed2));
+  for (auto& [catalog, cov] : coverage) {
+    int percent = cov.total_jobs ? (cov.cached_jobs * 100 / cov.total_jobs)
+                                 : 100;
+    ua->SendMsg(T_("Catalog \"%s\": %s of %s jobs cached (%d%%)\n"),
+                catalog.c_str(), edit_uint64_with_commas(cov.cached_jobs, ed1),
+                edit_uint64_with_commas(cov.total_jobs, ed2), percent);
+  }
+  ua->SendMsg("====\n");
+}
+
+} /* namespace directordaemon */
@@ -41,13 +41,22 @@
 #include "dird/director_jcr_impl.h"
 #include "dird/sd_cmds.h"
 #include "findlib/find.h"
+#include "lib/attribs.h"
 #include "lib/berrno.h"
 #include "lib/edit.h"
 #include "lib/util.h"
 #include "lib/serial.h"
 
+#include <optional>
+#include <vector>
+
 namespace directordaemon {
 
+const char* const catalog_stage_names[]
+    = {"attributes", "jobmedia", "batch-commit"};
+static_assert(std::size(catalog_stage_names)
+              == static_cast<std::size_t>(catalog_stage::kCount));
+
 /*
  * Handle catalog request
  *  For now, we simply return next Volume to be used
@@ -69,6 +78,11 @@ static char Create_job_media[]
     = "CatReq Job=%127s CreateJobMedia "
       " FirstIndex=%u LastIndex=%u StartFile=%u EndFile=%u "
       " StartBlock=%u EndBlock=%u Copy=%d Strip=%d MediaId=%lld\n";
+/* Followed by one line of "FirstIndex LastIndex StartFile EndFile StartBlock
+ * EndBlock Copy Strip MediaId" per JobMedia record. */
+static char Create_job_media_batch[]
+    = "CatReq Job=%127s CreateJobMediaBatch Count=%u\n";
+static char Job_media_batch_record[] = "%u %u %u %u %u %u %d %d %lld\n";
 
 static char Update_filelist[] = "Catreq Job=%127s UpdateFileList\n";
 
@@ -121,7 +135,7 @@ void CatalogRequest(JobControlRecord* jcr, BareosSocket* bs)
   PoolMem unwanted_volumes(PM_MESSAGE);
   int index, ok, label, writing;
   POOLMEM* omsg;
-  uint32_t Stripe, Copy;
+  uint32_t Stripe, Copy, count;
   uint64_t MediaId;
   utime_t VolFirstWritten;
   utime_t VolLastWritten;
@@ -351,6 +365,7 @@ void CatalogRequest(JobControlRecord* jcr, BareosSocket* bs)
     Dmsg6(400, "create_jobmedia JobId=%d MediaId=%d SF=%d EF=%d FI=%d LI=%d\n",
           jm.JobId, jm.MediaId, jm.StartFile, jm.EndFile, jm.FirstIndex,
           jm.LastIndex);
+    auto timer = jcr->dir_impl->stage_times.Time(catalog_stage::kJobMedia);
     DbLocker _{jcr->db};
     if (!jcr->db->CreateJobmediaRecord(jcr, &jm)) {
       Jmsg(jcr, M_FATAL, 0, T_("Catalog error creating JobMedia record. %s\n"),
@@ -360,10 +375,51 @@ void CatalogRequest(JobControlRecord* jcr, BareosSocket* bs)
       Dmsg0(400, "JobMedia record created\n");
       bs->fsend(OK_create);
     }
+  } else if (sscanf(bs->msg, Create_job_media_batch, &Job, &count) == 2) {
+    // Request to create the JobMedia records queued since the last request
+    JobId_t JobId = jcr->dir_impl->mig_jcr ? jcr->dir_impl->mig_jcr->JobId
+                                           : jcr->JobId;
+    std::vector<JobMediaDbRecord> jms;
+    const char* line = strchr(bs->msg, '\n');
+    while (line && *++line && jms.size() < count) {
+      JobMediaDbRecord& record = jms.emplace_back();
+      if (sscanf(line, Job_media_batch_record, &record.FirstIndex,
+                 &record.LastIndex, &record.StartFile, &record.EndFile,
+                 &record.StartBlock, &record.EndBlock, &Copy, &Stripe,
+                 &MediaId)
+          != 9) {
+        jms.pop_back();
+        break;
+      }
+      record.JobId = JobId;
+      record.MediaId = MediaId;
+      line = strchr(line, '\n');
+    }
+    Dmsg2(400, "create_jobmedia JobId=%d %d records\n", JobId,
+          static_cast<int>(jms.size()));
+    if (jms.size() != count) {
+      Jmsg(jcr, M_FATAL, 0, T_("Invalid JobMedia batch from SD: %s\n"),
+           bs->msg);
+      bs->fsend(T_("1992 Create JobMedia error\n"));
+    } else {
+      auto timer = jcr->dir_impl->stage_times.Time(catalog_stage::kJobMedia);
+      DbLocker _{jcr->db};
+      if (!jcr->db->CreateJobmediaRecords(jcr, jms.data(), jms.size())) {
+        Jmsg(jcr, M_FATAL, 0,
+             T_("Catalog error creating JobMedia record. %s\n"),
+             jcr->db->strerror());
+        bs->fsend(T_("1992 Create JobMedia error\n"));
+      } else {
+        Dmsg0(400, "JobMedia records created\n");
+        bs->fsend(OK_create);
+      }
+    }
   } else if (sscanf(bs->msg, Update_filelist, &Job) == 1) {
     Dmsg0(0, "Updating filelist\n");
 
     if (jcr->db_batch) {
+      auto timer
+          = jcr->dir_impl->stage_times.Time(catalog_stage::kBatchCommit);
       if (DbLocker _{jcr->db_batch};
           !jcr->db_batch->WriteBatchFileRecords(jcr)) {
         Jmsg(jcr, M_FATAL, 0, T_("Catalog error updating File table. %s\n"),
@@ -414,6 +470,9 @@ void CatalogRequest(JobControlRecord* jcr, BareosSocket* bs)
  * Note, we receive the whole attribute record, but we select out only the
  * stat packet, VolSessionId, VolSessionTime, FileIndex, file type, and file
  * name to store in the catalog.
+ *
+ * msg points to the serialized record (VolSessionId onwards) and
+ * message_length is its length including the raw record data.
  */
 static void UpdateAttribute(JobControlRecord* jcr,
                             char* msg,
@@ -437,12 +496,6 @@ static void UpdateAttribute(JobControlRecord* jcr,
    * there may be a cached attr so we cannot yet write into
    * jcr->attr or jcr->ar */
   p = msg;
-  SkipNonspaces(&p); /* UpdCat */
-  SkipSpaces(&p);
-  SkipNonspaces(&p); /* Job=nnn */
-  SkipSpaces(&p);
-  SkipNonspaces(&p); /* "FileAttributes" */
-  p += 1;
 
   UnserBegin(p, 0);
   unser_uint32(VolSessionId);   /* VolSessionId */
@@ -478,7 +531,6 @@ static void UpdateAttribute(JobControlRecord* jcr,
    *   Object_name
    *   Binary Object data */
 
-  Dmsg1(400, "UpdCat msg=%s\n", msg);
   Dmsg5(400, "UpdCat VolSessId=%d VolSessT=%d FI=%d Strm=%d reclen=%d\n",
         VolSessionId, VolSessionTime, FileIndex, Stream, reclen);
 
@@ -520,6 +572,16 @@ static void UpdateAttribute(JobControlRecord* jcr,
         }
       }
 
+      // The catalog keeps the text form
+      if (IsBinaryStat(attr)) {
+        if (!StatToText(attr, jcr->dir_impl->lstat)) {
+          Jmsg1(jcr, M_ERROR, 0, T_("Malformed attributes of %s from SD\n"),
+                fname);
+          break;
+        }
+        attr = jcr->dir_impl->lstat.c_str();
+      }
+
       Dmsg2(400, "dird<stored: stream=%d %s\n", Stream, fname);
       Dmsg1(400, "dird<stored: attr=%s\n", attr);
 
@@ -636,6 +698,10 @@ static void UpdateAttribute(JobControlRecord* jcr,
               digest_len = CRYPTO_DIGEST_XXH128_SIZE;
               type = CRYPTO_DIGEST_XXH128;
               break;
+            case STREAM_XXH3_TREE_DIGEST:
+              digest_len = CRYPTO_DIGEST_XXH3_TREE_SIZE;
+              type = CRYPTO_DIGEST_XXH3_TREE;
+              break;
             default:
               Jmsg(jcr, M_ERROR, 0,
                    T_("Catalog error updating file digest. Unsupported digest "
@@ -676,6 +742,65 @@ static void UpdateAttribute(JobControlRecord* jcr,
   }
 }
 
+/**
+ * Handle an "UpdCat Job=nnn FileAttributes" message, which carries a single
+ * record, or an "UpdCat Job=nnn FileAttributesBatch" message, which carries
+ * any number of serialized records one after the other.
+ */
+static void UpdateAttributes(JobControlRecord* jcr,
+                             char* msg,
+                             int32_t message_length)
+{
+  static constexpr char batch_keyword[] = "FileAttributesBatch";
+  // VolSessionId, VolSessionTime, FileIndex, Stream and record length
+  static constexpr int32_t record_header_size = 5 * sizeof(uint32_t);
+
+  Dmsg1(400, "UpdCat msg=%s\n", msg);
+
+  char* p = msg;
+  SkipNonspaces(&p); /* UpdCat */
+  SkipSpaces(&p);
+  SkipNonspaces(&p); /* Job=nnn */
+  SkipSpaces(&p);
+  char* keyword = p;
+  SkipNonspaces(&p); /* "FileAttributes" or "FileAttributesBatch" */
+  bool batch = (p - keyword) == (int)(sizeof(batch_keyword) - 1)
+               && bstrncmp(keyword, batch_keyword, sizeof(batch_keyword) - 1);
+  p += 1;
+
+  auto& stage_times = jcr->dir_impl->stage_times;
+  if (!batch) {
+    auto timer = stage_times.Time(catalog_stage::kAttributes);
+    UpdateAttribute(jcr, p, message_length - (p - msg));
+    return;
+  }
+
+  // keep the catalog locked for the whole batch instead of every record
+  std::optional<DbLocker> lock;
+  {
+    auto wait = stage_times.TimeWait(catalog_stage::kAttributes);
+    lock.emplace(jcr->db);
+  }
+  auto timer = stage_times.Time(catalog_stage::kAttributes);
+  char* end = msg + message_length;
+  while (end - p >= record_header_size) {
+    unser_declare;
+    uint32_t reclen;
+
+    UnserBegin(p + 4 * sizeof(uint32_t), 0);
+    unser_uint32(reclen);
+    if (reclen > (uint32_t)(end - p - record_header_size)) {
+      Jmsg1(jcr, M_ERROR, 0, T_("Malformed attribute batch from SD: %s\n"),
+            msg);
+      return;
+    }
+
+    UpdateAttribute(jcr, p, record_header_size + reclen);
+    if (jcr->IsJobCanceled()) { return; }
+    p += record_header_size + reclen;
+  }
+}
+
 // Update File Attributes in the catalog with data sent by the Storage daemon.
 void CatalogUpdate(JobControlRecord* jcr, BareosSocket* bs)
 {
@@ -694,7 +819,7 @@ void CatalogUpdate(JobControlRecord* jcr, BareosSocket* bs)
     goto bail_out;
   }
 
-  UpdateAttribute(jcr, bs->msg, bs->message_length);
+  UpdateAttributes(jcr, bs->msg, bs->message_length);
 
 bail_out:
   if (jcr->IsJobCanceled()) { CancelStorageDaemonJob(jcr); }
@@ -753,7 +878,7 @@ bool DespoolAttributesFromFile(JobControlRecord* jcr, const char* file)
     }
 
     if (!jcr->IsJobCanceled()) {
-      UpdateAttribute(jcr, msg, message_length);
+      UpdateAttributes(jcr, msg, message_length);
       if (jcr->IsJobCanceled()) { goto bail_out; }
     }
   }
@@ -30,179 +30,274 @@
 #include "dird/ua_db.h"
 #include "lib/parse_conf.h"
 
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
 namespace directordaemon {
 
-/**
- * In this routine,
- *  - we can check the connection (mode=CHECK_CONNECTION)
- *  - we can synchronize the catalog with the configuration
- * (mode=UPDATE_CATALOG)
- *  - we can synchronize, and fix old job records (mode=UPDATE_AND_FIX)
- */
-bool CheckCatalog(cat_op mode)
+namespace {
+// more connections update the pool records of a catalog in parallel
+constexpr std::size_t max_pool_connections = 4;
+constexpr std::size_t pools_per_connection = 64;
+
+using clock_type = std::chrono::steady_clock;
+
+double SecondsSince(clock_type::time_point start)
 {
-  bool OK = true;
+  return std::chrono::duration<double>(clock_type::now() - start).count();
+}
 
-  /* Loop over databases */
-  CatalogResource* catalog;
-  foreach_res (catalog, R_CATALOG) {
-    BareosDb* db;
+struct catalog_check {
+  CatalogResource* catalog{};
+  bool ok{true};
+  std::map<StorageResource*, DBId_t> storage_ids{};
+  std::string db_type{};
+};
 
-    /* Make sure we can open catalog, otherwise print a warning
-     * message because the server is probably not running. */
-    db = db_init_database(NULL, catalog->db_driver, catalog->db_name,
+BareosDb* ConnectToCatalog(CatalogResource* catalog)
+{
+  return db_init_database(NULL, catalog->db_driver, catalog->db_name,
                           catalog->db_user, catalog->db_password.value,
                           catalog->db_address, catalog->db_port,
                           catalog->db_socket, catalog->mult_db_connections,
                           catalog->disable_batch_insert, catalog->try_reconnect,
                           catalog->exit_on_fatal, true);
+}
 
-    if (!db) {
-      Pmsg2(000, T_("Could not open Catalog \"%s\", database \"%s\".\n"),
-            catalog->resource_name_, catalog->db_name);
-      Jmsg(NULL, M_FATAL, 0,
-           T_("Could not open Catalog \"%s\", database \"%s\".\n"),
-           catalog->resource_name_, catalog->db_name);
-      OK = false;
-      goto bail_out;
-    }
+// runs fn(db, pool) for all pools, on db and the other connections
+template <typename F>
+void ForEachPool(const std::vector<PoolResource*>& pools,
+                 const std::vector<BareosDb*>& dbs,
+                 F fn)
+{
+  std::atomic<std::size_t> next{0};
+  auto work = [&pools, &next, &fn](BareosDb* db) {
+    std::size_t i;
+    while ((i = next++) < pools.size()) { fn(db, pools[i]); }
+  };
 
+  std::vector<std::thread> workers;
+  for (std::size_t i = 1; i < dbs.size(); ++i) {
+    workers.emplace_back(work, dbs[i]);
+  }
+  work(dbs[0]);
+  for (auto& worker : workers) { worker.join(); }
+}
 
-    if (!db->OpenDatabase(NULL)) {
-      Pmsg2(000, T_("Could not open Catalog \"%s\", database \"%s\": %s\n"),
-            catalog->resource_name_, catalog->db_name, db->strerror());
-      Jmsg(NULL, M_FATAL, 0,
-           T_("Could not open Catalog \"%s\", database \"%s\": %s\n"),
-           catalog->resource_name_, catalog->db_name, db->strerror());
-      db->CloseDatabase(NULL);
-      OK = false;
-      goto bail_out;
-    }
+/* Pools are only independent of each other until their references
+ * (RecyclePool, ScratchPool) are set, which needs all of them to exist. */
+void SynchronizePools(CatalogResource* catalog, BareosDb* db)
+{
+  std::vector<PoolResource*> pools;
+  PoolResource* pool;
+  foreach_res (pool, R_POOL) {
+    // If the Pool has a catalog resource create the pool only in that catalog
+    if (!pool->catalog || pool->catalog == catalog) { pools.push_back(pool); }
+  }
 
-    /* Display a message if the db max_connections is too low */
-    if (!db->CheckMaxConnections(NULL, me->MaxConcurrentJobs)) {
-      Pmsg1(000, "Warning, settings problem for Catalog=%s\n",
-            catalog->resource_name_);
-      Pmsg1(000, "%s", db->strerror());
+  std::vector<BareosDb*> dbs{db};
+  std::size_t wanted = std::min(max_pool_connections,
+                                1 + pools.size() / pools_per_connection);
+  while (dbs.size() < wanted) {
+    BareosDb* extra = ConnectToCatalog(catalog);
+    if (!extra) { break; }
+    if (!extra->OpenDatabase(NULL)) {
+      Dmsg1(100, "No extra connection to catalog %s: %s", catalog->db_name,
+            extra->strerror());
+      extra->CloseDatabase(NULL);
+      break;
     }
+    dbs.push_back(extra);
+  }
 
-    /* we are in testing mode, so don't touch anything in the catalog */
-    if (mode == CHECK_CONNECTION) {
-      db->CloseDatabase(NULL);
-      continue;
-    }
+  ForEachPool(pools, dbs, [](BareosDb* pool_db, PoolResource* p) {
+    CreatePool(NULL, pool_db, p, POOL_OP_UPDATE); /* update request */
+  });
+  ForEachPool(pools, dbs, [](BareosDb* pool_db, PoolResource* p) {
+    UpdatePoolReferences(NULL, pool_db, p);
+  });
 
-    /* Loop over all pools, defining/updating them in each database */
-    PoolResource* pool;
-    foreach_res (pool, R_POOL) {
-      /* If the Pool has a catalog resource create the pool only
-       *   in that catalog. */
-      if (!pool->catalog || pool->catalog == catalog) {
-        CreatePool(NULL, db, pool, POOL_OP_UPDATE); /* update request */
-      }
-    }
+  for (std::size_t i = 1; i < dbs.size(); ++i) { dbs[i]->CloseDatabase(NULL); }
+}
 
-    /* Once they are created, we can loop over them again, updating
-     * references (RecyclePool)
-     */
-    foreach_res (pool, R_POOL) {
-      /* If the Pool has a catalog resource update the pool only
-       *   in that catalog. */
-      if (!pool->catalog || pool->catalog == catalog) {
-        UpdatePoolReferences(NULL, db, pool);
-      }
-    }
+bool SynchronizeStorages(BareosDb* db, catalog_check& check)
+{
+  std::vector<StorageResource*> stores;
+  std::vector<StorageDbRecord> records;
+  std::vector<std::string> media_types;
+  StorageResource* store;
+  foreach_res (store, R_STORAGE) {
+    stores.push_back(store);
+    StorageDbRecord& sr = records.emplace_back();
+    bstrncpy(sr.Name, store->resource_name_, sizeof(sr.Name));
+    sr.AutoChanger = store->autochanger;
+    if (store->media_type) { media_types.push_back(store->media_type); }
+  }
 
-    /* Ensure basic client record is in DB */
-    ClientResource* client;
-    foreach_res (client, R_CLIENT) {
-      ClientDbRecord cr;
-      /* Create clients only if they use the current catalog */
-      if (client->catalog != catalog) {
-        Dmsg3(500, "Skip client=%s with cat=%s not catalog=%s\n",
-              client->resource_name_, client->catalog->resource_name_,
-              catalog->resource_name_);
-        continue;
-      }
-      Dmsg2(500, "create cat=%s for client=%s\n",
-            client->catalog->resource_name_, client->resource_name_);
-      bstrncpy(cr.Name, client->resource_name_, sizeof(cr.Name));
-      db->CreateClientRecord(NULL, &cr);
+  if (!db->CreateMediatypeRecords(NULL, media_types)) {
+    Jmsg(NULL, M_ERROR, 0, "%s", db->strerror());
+  }
+  if (!db->CreateStorageRecords(NULL, records)) {
+    Jmsg(NULL, M_FATAL, 0, T_("Could not create storage records: %s"),
+         db->strerror());
+    return false;
+  }
+  for (std::size_t i = 0; i < stores.size(); ++i) {
+    check.storage_ids[stores[i]] = records[i].StorageId;
+  }
+  return true;
+}
+
+void CheckOneCatalog(cat_op mode, catalog_check& check)
+{
+  CatalogResource* catalog = check.catalog;
+  const auto start = clock_type::now();
+
+  /* Make sure we can open catalog, otherwise print a warning
+   * message because the server is probably not running. */
+  BareosDb* db = ConnectToCatalog(catalog);
+  if (!db) {
+    Pmsg2(000, T_("Could not open Catalog \"%s\", database \"%s\".\n"),
+          catalog->resource_name_, catalog->db_name);
+    Jmsg(NULL, M_FATAL, 0,
+         T_("Could not open Catalog \"%s\", database \"%s\".\n"),
+         catalog->resource_name_, catalog->db_name);
+    check.ok = false;
+    return;
+  }
+
+  if (!db->OpenDatabase(NULL)) {
+    Pmsg2(000, T_("Could not open Catalog \"%s\", database \"%s\": %s\n"),
+          catalog->resource_name_, catalog->db_name, db->strerror());
+    Jmsg(NULL, M_FATAL, 0,
+         T_("Could not open Catalog \"%s\", database \"%s\": %s\n"),
+         catalog->resource_name_, catalog->db_name, db->strerror());
+    db->CloseDatabase(NULL);
+    check.ok = false;
+    return;
+  }
+
+  /* Display a message if the db max_connections is too low */
+  if (!db->CheckMaxConnections(NULL, me->MaxConcurrentJobs)) {
+    Pmsg1(000, "Warning, settings problem for Catalog=%s\n",
+          catalog->resource_name_);
+    Pmsg1(000, "%s", db->strerror());
+  }
+  check.db_type = db->GetType();
+
+  /* we are in testing mode, so don't touch anything in the catalog */
+  if (mode == CHECK_CONNECTION) {
+    db->CloseDatabase(NULL);
+    return;
+  }
+
+  const auto pools_start = clock_type::now();
+  SynchronizePools(catalog, db);
+  const double pools_seconds = SecondsSince(pools_start);
+
+  /* Ensure basic client record is in DB */
+  const auto clients_start = clock_type::now();
+  std::vector<std::string> client_names;
+  ClientResource* client;
+  foreach_res (client, R_CLIENT) {
+    /* Create clients only if they use the current catalog */
+    if (client->catalog == catalog) {
+      client_names.push_back(client->resource_name_);
     }
+  }
+  if (!db->CreateClientRecords(NULL, client_names)) {
+    Jmsg(NULL, M_ERROR, 0, "%s", db->strerror());
+  }
+  const double clients_seconds = SecondsSince(clients_start);
 
-    /* Ensure basic storage record is in DB */
-    StorageResource* store;
-    foreach_res (store, R_STORAGE) {
-      StorageDbRecord sr;
-      MediaTypeDbRecord mtr;
-      if (store->media_type) {
-        bstrncpy(mtr.MediaType, store->media_type, sizeof(mtr.MediaType));
-        mtr.ReadOnly = 0;
-        db->CreateMediatypeRecord(NULL, &mtr);
+  /* Ensure basic storage record is in DB */
+  const auto storages_start = clock_type::now();
+  if (!SynchronizeStorages(db, check)) {
+    check.ok = false;
+    db->CloseDatabase(NULL);
+    return;
+  }
+  const double storages_seconds = SecondsSince(storages_start);
+
+  /* Loop over all counters of this catalog, defining them in it */
+  CounterResource* counter;
+  foreach_res (counter, R_COUNTER) {
+    if (!counter->created && counter->Catalog == catalog) {
+      CounterDbRecord cr;
+      bstrncpy(cr.Counter, counter->resource_name_, sizeof(cr.Counter));
+      cr.MinValue = counter->MinValue;
+      cr.MaxValue = counter->MaxValue;
+      cr.CurrentValue = counter->MinValue;
+      if (counter->WrapCounter) {
+        bstrncpy(cr.WrapCounter, counter->WrapCounter->resource_name_,
+                 sizeof(cr.WrapCounter));
       } else {
-        mtr.MediaTypeId = 0;
-      }
-      bstrncpy(sr.Name, store->resource_name_, sizeof(sr.Name));
-      sr.AutoChanger = store->autochanger;
-      if (!db->CreateStorageRecord(NULL, &sr)) {
-        Jmsg(NULL, M_FATAL, 0, T_("Could not create storage record for %s\n"),
-             store->resource_name_);
-        OK = false;
-        goto bail_out;
+        cr.WrapCounter[0] = 0; /* empty string */
       }
-      store->StorageId = sr.StorageId; /* set storage Id */
-      if (!sr.created) {               /* if not created, update it */
-        sr.AutoChanger = store->autochanger;
-        if (!db->UpdateStorageRecord(NULL, &sr)) {
-          Jmsg(NULL, M_FATAL, 0, T_("Could not update storage record for %s\n"),
-               store->resource_name_);
-          OK = false;
-          goto bail_out;
-        }
+      if (db->CreateCounterRecord(NULL, &cr)) {
+        counter->CurrentValue = cr.CurrentValue;
+        counter->created = true;
+        Dmsg2(100, "Create counter %s val=%d\n", counter->resource_name_,
+              counter->CurrentValue);
       }
     }
+  }
+  /* cleanup old job records */
+  if (mode == UPDATE_AND_FIX) {
+    db->SqlQuery(BareosDb::SQL_QUERY::cleanup_created_job);
+    db->SqlQuery(BareosDb::SQL_QUERY::cleanup_running_job);
+  }
 
-    /* Loop over all counters, defining them in each database */
-    /* Set default value in all counters */
-    CounterResource* counter;
-    foreach_res (counter, R_COUNTER) {
-      /* Write to catalog? */
-      if (!counter->created && counter->Catalog == catalog) {
-        CounterDbRecord cr;
-        bstrncpy(cr.Counter, counter->resource_name_, sizeof(cr.Counter));
-        cr.MinValue = counter->MinValue;
-        cr.MaxValue = counter->MaxValue;
-        cr.CurrentValue = counter->MinValue;
-        if (counter->WrapCounter) {
-          bstrncpy(cr.WrapCounter, counter->WrapCounter->resource_name_,
-                   sizeof(cr.WrapCounter));
-        } else {
-          cr.WrapCounter[0] = 0; /* empty string */
-        }
-        if (db->CreateCounterRecord(NULL, &cr)) {
-          counter->CurrentValue = cr.CurrentValue;
-          counter->created = true;
-          Dmsg2(100, "Create counter %s val=%d\n", counter->resource_name_,
-                counter->CurrentValue);
-        }
-      }
-      if (!counter->created) {
-        counter->CurrentValue = counter->MinValue; /* default value */
-      }
-    }
-    /* cleanup old job records */
-    if (mode == UPDATE_AND_FIX) {
-      db->SqlQuery(BareosDb::SQL_QUERY::cleanup_created_job);
-      db->SqlQuery(BareosDb::SQL_QUERY::cleanup_running_job);
-    }
+  db->CloseDatabase(NULL);
+  Dmsg5(50,
+        "Catalog %s synchronized in %.2fs: pools %.2fs, clients %.2fs, "
+        "storages %.2fs\n",
+        catalog->resource_name_, SecondsSince(start), pools_seconds,
+        clients_seconds, storages_seconds);
+}
+}  // namespace
 
-    /* Set type in global for debugging */
-    SetDbType(db->GetType());
+/**
+ * In this routine,
+ *  - we can check the connection (mode=CHECK_CONNECTION)
+ *  - we can synchronize the catalog with the configuration
+ * (mode=UPDATE_CATALOG)
+ *  - we can synchronize, and fix old job records (mode=UPDATE_AND_FIX)
+ *
+ * The catalogs are independent of each other and checked in parallel.
+ */
+bool CheckCatalog(cat_op mode)
+{
+  std::vector<catalog_check> checks;
+  CatalogResource* catalog;
+  foreach_res (catalog, R_CATALOG) { checks.emplace_back().catalog = catalog; }
 
-    db->CloseDatabase(NULL);
+  std::vector<std::thread> threads;
+  for (std::size_t i = 1; i < checks.size(); ++i) {
+    threads.emplace_back(CheckOneCatalog, mode, std::ref(checks[i]));
+  }
+  if (!checks.empty()) { CheckOneCatalog(mode, checks[0]); }
+  for (auto& thread : threads) { thread.join(); }
+
+  bool OK = true;
+  for (const catalog_check& check : checks) {
+    if (!check.ok) { OK = false; }
+    // as before, the storage ids are the ones of the last catalog
+    for (auto [store, id] : check.storage_ids) { store->StorageId = id; }
+    /* Set type in global for debugging */
+    if (!check.db_type.empty()) { SetDbType(check.db_type.c_str()); }
   }
 
-bail_out:
+  CounterResource* counter;
+  foreach_res (counter, R_COUNTER) {
+    if (!counter->created) {
+      counter->CurrentValue = counter->MinValue; /* default value */
+    }
+  }
   return OK;
 }
 
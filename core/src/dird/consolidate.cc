@@ -146,7 +146,12 @@ static bool ConsolidateJobs(JobControlRecord* jcr)
       }
 
       db_list_ctx jobids_ctx;
-      jcr->db->AccurateGetJobids(jcr, &jcr->dir_impl->jr, &jobids_ctx);
+      if (job->AlwaysIncrementalJobRetention) {
+        jcr->db->AccurateGetJobids(jcr, &jcr->dir_impl->jr, &jobids_ctx);
+      } else {
+        // without a retention all jobs are candidates
+        jobids_ctx = all_jobids_ctx;
+      }
       Dmsg1(10, "consolidate candidates:  %s.\n",
             jobids_ctx.GetAsString().c_str());
 
@@ -190,8 +195,12 @@ static bool ConsolidateJobs(JobControlRecord* jcr)
       Dmsg3(10, "total: %d, to_consolidate: %d, limit: %d.\n",
             incrementals_total, max_incrementals_to_consolidate,
             jcr->dir_impl->jr.limit);
-      jobids_ctx.clear();
-      jcr->db->AccurateGetJobids(jcr, &jcr->dir_impl->jr, &jobids_ctx);
+      /* The candidates are ordered like AccurateGetJobids() returns them and
+       * the empty jobs purged above are already removed from them, so the
+       * limited list is just their beginning. */
+      if (jobids_ctx.size() > static_cast<size_t>(jcr->dir_impl->jr.limit)) {
+        jobids_ctx.resize(jcr->dir_impl->jr.limit);
+      }
       const int32_t incrementals_to_consolidate = jobids_ctx.size() - 1;
       Dmsg2(10, "%d consolidate ids after limit: %s.\n", jobids_ctx.size(),
             jobids_ctx.GetAsString().c_str());
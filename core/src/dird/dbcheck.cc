@@ -36,6 +36,14 @@
 
 #include "dbcheck_utils.h"
 
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
 using namespace directordaemon;
 
 extern bool ParseDirConfig(const char* t_configfile, int exit_code);
@@ -43,12 +51,21 @@ extern bool ParseDirConfig(const char* t_configfile, int exit_code);
 // Global variables
 static bool fix = false;
 static bool batch = false;
-static BareosDb* db;
-static ID_LIST id_list;
-static NameList name_list;
-static char buf[20000];
+static int jobs = 1;
+static bool resume = false;
+static std::string checkpoint_file;
 static bool quit = false;
-static const char* idx_tmp_name;
+
+/* Every thread running checks has a database connection of its own; the
+ * checks of one stage run at the same time with -j. */
+static thread_local BareosDb* db;
+static thread_local ID_LIST id_list;
+static thread_local NameList name_list;
+static thread_local char buf[20000];
+static thread_local const char* idx_tmp_name;
+
+// Ids deleted with one statement
+static constexpr int delete_batch_size = 1000;
 
 // Forward referenced functions
 static void set_quit();
@@ -72,31 +89,38 @@ struct dbcheck_cmdstruct {
   void (*func)();           /**< Handler */
   const char* description;  /**< Main purpose */
   const bool baserepaircmd; /**< command that modifies the database */
+  const int stage;          /**< checks of a stage are independent */
 };
 
 static struct dbcheck_cmdstruct commands[] = {
-    {set_quit, "Quit", false},
-    {toggle_modify, "Toggle modify database flag", false},
-    {toggle_verbose, "Toggle verbose flag", false},
-    {repair_bad_filenames, "Check for bad Filename records", true},
-    {repair_bad_paths, "Check for bad Path records", true},
-    {eliminate_duplicate_paths, "Check for duplicate Path records", true},
+    {set_quit, "Quit", false, 0},
+    {toggle_modify, "Toggle modify database flag", false, 0},
+    {toggle_verbose, "Toggle verbose flag", false, 0},
+    {repair_bad_filenames, "Check for bad Filename records", true, 1},
+    {repair_bad_paths, "Check for bad Path records", true, 1},
+    {eliminate_duplicate_paths, "Check for duplicate Path records", true, 3},
     {eliminate_orphaned_jobmedia_records, "Check for orphaned Jobmedia records",
-     true},
-    {eliminate_orphaned_file_records, "Check for orphaned File records", true},
-    {eliminate_orphaned_path_records, "Check for orphaned Path records", true},
+     true, 2},
+    {eliminate_orphaned_file_records, "Check for orphaned File records", true,
+     2},
+    {eliminate_orphaned_path_records, "Check for orphaned Path records", true,
+     4},
     {eliminate_orphaned_fileset_records, "Check for orphaned FileSet records",
-     true},
+     true, 2},
     {eliminate_orphaned_client_records, "Check for orphaned Client records",
-     true},
-    {eliminate_orphaned_job_records, "Check for orphaned Job records", true},
+     true, 2},
+    {eliminate_orphaned_job_records, "Check for orphaned Job records", true, 1},
     {eliminate_orphaned_storage_records, "Check for orphaned storage records",
-     true},
-    {eliminate_admin_records, "Check for all Admin records", true},
-    {eliminate_restore_records, "Check for all Restore records", true},
-    {run_all_commands, "Run ALL checks", false},
+     true, 1},
+    {eliminate_admin_records, "Check for all Admin records", true, 2},
+    {eliminate_restore_records, "Check for all Restore records", true, 2},
+    {run_all_commands, "Run ALL checks", false, 0},
 };
 
+/* The stages run one after the other, so the later ones also clean up what
+ * the earlier ones left behind, e.g. the File records of deleted Jobs. */
+static constexpr int number_stages = 4;
+
 const int number_commands
     = (sizeof(commands) / sizeof(struct dbcheck_cmdstruct));
 
@@ -206,15 +230,25 @@ static bool DropTmpIdx(const char* idx_name, const char* table_name)
   return true;
 }
 
-// Delete all entries in the list
-static int DeleteIdList(const char* query, ID_LIST* t_id_list)
+// Delete all entries in the list, delete_batch_size of them at a time
+static int DeleteIdList(const char* table,
+                        const char* column,
+                        ID_LIST* t_id_list)
 {
   char ed1[50];
-
-  for (int i = 0; i < t_id_list->num_ids; i++) {
-    Bsnprintf(buf, sizeof(buf), query, edit_int64(t_id_list->Id[i], ed1));
-    if (g_verbose) { printf(T_("Deleting: %s\n"), buf); }
-    db->SqlQuery(buf, nullptr, nullptr);
+  std::string query;
+
+  for (int i = 0; i < t_id_list->num_ids; i += delete_batch_size) {
+    int end = std::min(i + delete_batch_size, t_id_list->num_ids);
+    query.assign("DELETE FROM ").append(table).append(" WHERE ");
+    query.append(column).append(" IN (");
+    for (int j = i; j < end; j++) {
+      if (j > i) { query.append(","); }
+      query.append(edit_int64(t_id_list->Id[j], ed1));
+    }
+    query.append(")");
+    if (g_verbose) { printf(T_("Deleting: %s\n"), query.c_str()); }
+    db->SqlQuery(query.c_str(), nullptr, nullptr);
   }
   return 1;
 }
@@ -300,7 +334,7 @@ static void eliminate_orphaned_jobmedia_records()
 
     if (fix && id_list.num_ids > 0) {
       printf(T_("Deleting %d orphaned JobMedia records.\n"), id_list.num_ids);
-      DeleteIdList("DELETE FROM JobMedia WHERE JobMediaId=%s", &id_list);
+      DeleteIdList("JobMedia", "JobMediaId", &id_list);
     } else {
       break; /* get out if not updating db */
     }
@@ -338,7 +372,7 @@ static void eliminate_orphaned_file_records()
     if (quit) { return; }
     if (fix && id_list.num_ids > 0) {
       printf(T_("Deleting %d orphaned File records.\n"), id_list.num_ids);
-      DeleteIdList("DELETE FROM File WHERE FileId=%s", &id_list);
+      DeleteIdList("File", "FileId", &id_list);
     } else {
       break; /* get out if not updating db */
     }
@@ -377,7 +411,7 @@ static void eliminate_orphaned_path_records()
     if (fix && id_list.num_ids > 0) {
       printf(T_("Deleting %d orphaned Path records.\n"), id_list.num_ids);
       fflush(stdout);
-      DeleteIdList("DELETE FROM Path WHERE PathId=%s", &id_list);
+      DeleteIdList("Path", "PathId", &id_list);
     } else {
       break; /* get out if not updating db */
     }
@@ -415,7 +449,7 @@ static void eliminate_orphaned_fileset_records()
   if (fix && id_list.num_ids > 0) {
     printf(T_("Deleting %d orphaned FileSet records.\n"), id_list.num_ids);
     fflush(stdout);
-    DeleteIdList("DELETE FROM FileSet WHERE FileSetId=%s", &id_list);
+    DeleteIdList("FileSet", "FileSetId", &id_list);
   }
 }
 
@@ -454,7 +488,7 @@ static void eliminate_orphaned_client_records()
   if (fix && id_list.num_ids > 0) {
     printf(T_("Deleting %d orphaned Client records.\n"), id_list.num_ids);
     fflush(stdout);
-    DeleteIdList("DELETE FROM Client WHERE ClientId=%s", &id_list);
+    DeleteIdList("Client", "ClientId", &id_list);
   }
 }
 
@@ -494,13 +528,13 @@ static void eliminate_orphaned_job_records()
   if (fix && id_list.num_ids > 0) {
     printf(T_("Deleting %d orphaned Job records.\n"), id_list.num_ids);
     fflush(stdout);
-    DeleteIdList("DELETE FROM Job WHERE JobId=%s", &id_list);
+    DeleteIdList("Job", "JobId", &id_list);
     printf(T_("Deleting JobMedia records of orphaned Job records.\n"));
     fflush(stdout);
-    DeleteIdList("DELETE FROM JobMedia WHERE JobId=%s", &id_list);
+    DeleteIdList("JobMedia", "JobId", &id_list);
     printf(T_("Deleting Log records of orphaned Job records.\n"));
     fflush(stdout);
-    DeleteIdList("DELETE FROM Log WHERE JobId=%s", &id_list);
+    DeleteIdList("Log", "JobId", &id_list);
   }
 }
 
@@ -570,7 +604,7 @@ static void eliminate_admin_records()
   if (fix && id_list.num_ids > 0) {
     printf(T_("Deleting %d Admin Job records.\n"), id_list.num_ids);
     fflush(stdout);
-    DeleteIdList("DELETE FROM Job WHERE JobId=%s", &id_list);
+    DeleteIdList("Job", "JobId", &id_list);
   }
 }
 
@@ -602,7 +636,7 @@ static void eliminate_restore_records()
   if (fix && id_list.num_ids > 0) {
     printf(T_("Deleting %d Restore Job records.\n"), id_list.num_ids);
     fflush(stdout);
-    DeleteIdList("DELETE FROM Job WHERE JobId=%s", &id_list);
+    DeleteIdList("Job", "JobId", &id_list);
   }
 }
 
@@ -715,25 +749,125 @@ static void repair_bad_paths()
   }
 }
 
+/* The checks a run of all checks has finished are written to the checkpoint
+ * file, so an interrupted run can be resumed with -r.  The file is removed
+ * once all checks are done. */
+static std::mutex checkpoint_mutex;
+static std::set<std::string> finished_checks;
+
+static void StartCheckpoint()
+{
+  finished_checks.clear();
+  if (checkpoint_file.empty()) { return; }
+
+  std::string modify = fix ? "modify=1" : "modify=0";
+  if (resume) {
+    std::ifstream in(checkpoint_file);
+    std::string line;
+    if (std::getline(in, line) && line == modify) {
+      while (std::getline(in, line)) { finished_checks.insert(line); }
+    } else if (in.is_open()) {
+      printf(T_("Checkpoint %s was written with another modify flag, "
+                "running all checks.\n"),
+             checkpoint_file.c_str());
+    }
+  }
+
+  std::ofstream out(checkpoint_file, std::ios::trunc);
+  out << modify << '\n';
+  for (const std::string& check : finished_checks) { out << check << '\n'; }
+}
+
+static void FinishCheck(const char* description)
+{
+  if (checkpoint_file.empty() || quit) { return; }
+  std::lock_guard lock(checkpoint_mutex);
+  std::ofstream out(checkpoint_file, std::ios::app);
+  out << description << '\n';
+}
+
+static void RunCheck(int i)
+{
+  if (finished_checks.count(commands[i].description)) {
+    printf(T_("= %s: done by the interrupted run, skipping.\n"),
+           commands[i].description);
+    return;
+  }
+
+  printf("===========================================================\n");
+  printf("=\n");
+  printf("= %s, modify=%d\n", commands[i].description, fix);
+  printf("=\n");
+
+  /* execute the real function */
+  (commands[i].func)();
+  FinishCheck(commands[i].description);
+
+  printf("=\n");
+  printf("=\n");
+  printf(
+      "==========================================================="
+      "\n\n\n\n");
+}
+
+// Runs the checks of each stage on up to jobs connections at the same time
+static bool RunChecksInParallel()
+{
+  BareosDb* main_db = db;
+
+  for (int stage = 1; stage <= number_stages; stage++) {
+    std::vector<int> checks;
+    for (int i = 0; i < number_commands; i++) {
+      if (commands[i].baserepaircmd && commands[i].stage == stage) {
+        checks.push_back(i);
+      }
+    }
+
+    std::atomic<std::size_t> next{0};
+    std::vector<std::thread> workers;
+    std::size_t num_workers
+        = std::min(checks.size(), static_cast<std::size_t>(jobs));
+    for (std::size_t w = 0; w < num_workers; w++) {
+      workers.emplace_back([main_db, &checks, &next] {
+        db = main_db->CloneDatabaseConnection(nullptr, true, false);
+        if (!db) {
+          printf(T_("Could not open another database connection.\n"));
+          return;
+        }
+        for (std::size_t i; (i = next++) < checks.size();) {
+          RunCheck(checks[i]);
+        }
+        FreeIdList(&id_list);
+        db->CloseDatabase(nullptr);
+      });
+    }
+    for (std::thread& worker : workers) { worker.join(); }
+
+    if (next < checks.size()) {
+      printf(T_("Not all checks could be run, stopping.\n"));
+      return false;
+    }
+  }
+  return true;
+}
+
 static void run_all_commands()
 {
-  for (int i = 0; i < number_commands; i++) {
-    if (commands[i].baserepaircmd) {
-      printf("===========================================================\n");
-      printf("=\n");
-      printf("= %s, modify=%d\n", commands[i].description, fix);
-      printf("=\n");
-
-      /* execute the real function */
-      (commands[i].func)();
-
-      printf("=\n");
-      printf("=\n");
-      printf(
-          "==========================================================="
-          "\n\n\n\n");
+  bool finished = true;
+
+  StartCheckpoint();
+
+  if (batch && jobs > 1) {
+    finished = RunChecksInParallel();
+  } else {
+    for (int i = 0; i < number_commands && !quit; i++) {
+      if (commands[i].baserepaircmd) { RunCheck(i); }
     }
   }
+
+  if (finished && !quit && !checkpoint_file.empty()) {
+    unlink(checkpoint_file.c_str());
+  }
 }
 
 static void print_commands()
@@ -820,6 +954,17 @@ int main(int argc, char* argv[])
 
   dbcheck_app.add_flag("-f,--fix", fix, "Fix inconsistencies.");
 
+  dbcheck_app
+      .add_option("-j,--jobs", jobs,
+                  "Run independent checks of batch mode on up to <n> "
+                  "database connections at the same time.")
+      ->check(CLI::PositiveNumber)
+      ->type_name("<n>");
+
+  dbcheck_app.add_flag("-r,--resume", resume,
+                       "Skip the checks an interrupted run of all checks has "
+                       "already finished.");
+
   AddVerboseOption(dbcheck_app);
 
   auto manual_args
@@ -925,6 +1070,11 @@ int main(int argc, char* argv[])
     return 1;
   }
 
+  if (working_directory && *working_directory) {
+    checkpoint_file = std::string(working_directory) + "/bareos-dbcheck."
+                      + db_name + ".checkpoint";
+  }
+
   // Drop temporary index idx_tmp_name if it already exists
   DropTmpIdx("idxPIchk", "File");
 
@@ -32,6 +32,8 @@
 #include "cats/sql_pooling.h"
 #include "dird.h"
 #include "dird_globals.h"
+#include "dird/bvfs_cache.h"
+#include "dird/background_prune.h"
 #include "dird/check_catalog.h"
 #include "dird/job.h"
 #include "dird/scheduler.h"
@@ -46,6 +48,8 @@
 #include "lib/parse_conf.h"
 #include "lib/thread_specific_data.h"
 #include "lib/util.h"
+#include "lib/lock_profile.h"
+#include "lib/metrics_server.h"
 #include "lib/watchdog.h"
 #include "lib/cli.h"
 
@@ -57,6 +61,10 @@
 #  include <regex.h>
 #endif
 #include <dirent.h>
+#include <chrono>
+#include <string>
+#include <utility>
+#include <vector>
 #define NAMELEN(dirent) (strlen((dirent)->d_name))
 #ifndef HAVE_READDIR_R
 int Readdir_r(DIR* dirp, struct dirent* entry, struct dirent** result);
@@ -91,6 +99,40 @@ void InitDeviceResources();
 
 static bool test_config = false;
 
+// how long the director took for each phase of its startup
+class StartupPhases {
+ public:
+  void Done(const char* phase)
+  {
+    auto now = std::chrono::steady_clock::now();
+    durations_.emplace_back(phase, now - last_);
+    last_ = now;
+  }
+
+  std::string Report() const
+  {
+    std::string report;
+    for (const auto& [phase, duration] : durations_) {
+      auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(duration);
+      if (!report.empty()) { report += ", "; }
+      report += std::string{phase} + " " + std::to_string(ms.count()) + "ms";
+    }
+    return report;
+  }
+
+  double Seconds() const
+  {
+    return std::chrono::duration<double>(last_ - start_).count();
+  }
+
+ private:
+  std::chrono::steady_clock::time_point start_{
+      std::chrono::steady_clock::now()};
+  std::chrono::steady_clock::time_point last_{start_};
+  std::vector<std::pair<const char*, std::chrono::steady_clock::duration>>
+      durations_{};
+};
+
 static std::string pidfile_path;
 
 /* Globals Imported */
@@ -113,6 +155,8 @@ static bool DirDbLogInsert(JobControlRecord* jcr,
   PoolMem query(PM_MESSAGE), esc_msg(PM_MESSAGE);
 
   if (!jcr || !jcr->db || !jcr->db->IsConnected()) { return false; }
+  // might be called by the message delivery thread
+  DbLocker _{jcr->db};
   length = strlen(msg);
   esc_msg.check_size(length * 2 + 1);
   jcr->db->EscapeString(jcr, esc_msg.c_str(), msg, length);
@@ -124,6 +168,41 @@ static bool DirDbLogInsert(JobControlRecord* jcr,
   return jcr->db->SqlQuery(query.c_str());
 }
 
+// rows per INSERT of DirDbLogBatchInsert()
+static constexpr std::size_t max_log_rows_per_insert = 500;
+
+// As above for the queued messages of a job, with multi-row INSERTs.
+static bool DirDbLogBatchInsert(JobControlRecord* jcr,
+                                const std::vector<db_log_message>& messages)
+{
+  char ed1[50];
+  char dt[MAX_TIME_LENGTH];
+  PoolMem esc_msg(PM_MESSAGE);
+  std::string query;
+  bool ok = true;
+
+  if (!jcr || !jcr->db || !jcr->db->IsConnected()) { return false; }
+  edit_int64(jcr->JobId, ed1);
+  DbLocker _{jcr->db};
+  for (std::size_t i = 0; i < messages.size(); ++i) {
+    query += (i % max_log_rows_per_insert == 0)
+                 ? "INSERT INTO Log (JobId, Time, LogText) VALUES ("
+                 : ",(";
+    int length = strlen(messages[i].msg);
+    esc_msg.check_size(length * 2 + 1);
+    jcr->db->EscapeString(jcr, esc_msg.c_str(), messages[i].msg, length);
+    bstrutime(dt, sizeof(dt), messages[i].mtime);
+    query.append(ed1).append(",'").append(dt).append("','");
+    query.append(esc_msg.c_str()).append("')");
+
+    if ((i + 1) % max_log_rows_per_insert == 0 || i + 1 == messages.size()) {
+      if (!jcr->db->SqlQuery(query.c_str())) { ok = false; }
+      query.clear();
+    }
+  }
+  return ok;
+}
+
 /*********************************************************************
  *
  *         Main BAREOS Director Server program
@@ -140,6 +219,7 @@ int main(int argc, char* argv[])
   bindtextdomain("bareos", LOCALEDIR);
   textdomain("bareos");
 
+  StartupPhases startup;
   InitStackDump();
   MyNameIs(argc, argv, "bareos-dir");
   InitMsg(nullptr, nullptr); /* initialize message handler */
@@ -272,6 +352,8 @@ int main(int argc, char* argv[])
     return BEXIT_SUCCESS;
   }
 
+  startup.Done("configuration");
+
   if (!CheckResources()) {
     Jmsg((JobControlRecord*)NULL, M_ERROR_TERM, 0,
          T_("Please correct the configuration in %s\n"),
@@ -281,6 +363,8 @@ int main(int argc, char* argv[])
     return BEXIT_SUCCESS;
   }
 
+  startup.Done("resource check");
+
   if (my_config->HasWarnings()) {
     // messaging not initialized, so Jmsg with  M_WARNING doesn't work
     fprintf(stderr, T_("There are configuration warnings:\n"));
@@ -312,6 +396,8 @@ int main(int argc, char* argv[])
   LoadDirPlugins(me->plugin_directory, me->plugin_names);
 
 
+  startup.Done("daemon setup");
+
   // If we are in testing mode, we don't try to fix the catalog
   cat_op mode = (test_config) ? CHECK_CONNECTION : UPDATE_AND_FIX;
 
@@ -324,6 +410,8 @@ int main(int argc, char* argv[])
     return BEXIT_SUCCESS;
   }
 
+  startup.Done("catalog check");
+
   if (test_config) { TerminateDird(0); }
 
   if (!InitializeSqlPooling()) {
@@ -335,17 +423,23 @@ int main(int argc, char* argv[])
     return BEXIT_SUCCESS;
   }
 
+  startup.Done("sql pooling");
+
   MyNameIs(0, nullptr, me->resource_name_); /* set user defined name */
 
   CleanUpOldFiles();
 
   SetDbLogInsertCallback(DirDbLogInsert);
+  SetDbLogBatchInsertCallback(DirDbLogBatchInsert);
 
   InitSighandlerSighup();
 
   InitConsoleMsg(working_directory);
 
   StartWatchdog(); /* start network watchdog thread */
+  StartMessageDelivery();
+  StartMetricsServer(me->metrics_address, me->metrics_port);
+  lock_profile::SetSampling(me->lock_profile_sampling);
 
   LockJcrChain();
   InitJcrChain();
@@ -361,9 +455,14 @@ int main(int argc, char* argv[])
       DbDebugPrint); /* used to debug BareosDb connexion after fatal signal */
 
   StartStatisticsThread();
+  StartBvfsCacheThreads();
+  StartBackgroundPruneThread();
 
   Dmsg0(200, "Start UA server\n");
   if (!StartSocketServer(me->DIRaddrs)) { TerminateDird(0); }
+  startup.Done("services");
+  Jmsg(nullptr, M_INFO, 0, T_("Director started in %.1f s: %s.\n"),
+       startup.Seconds(), startup.Report().c_str());
 
   Dmsg0(200, "wait for next job\n");
 
@@ -397,6 +496,9 @@ static
   DestroyConfigureUsageString();
   StopSocketServer();
   StopStatisticsThread();
+  StopBvfsCacheThreads();
+  StopBackgroundPruneThread();
+  StopMetricsServer();
   StopWatchdog();
   DbSqlPoolDestroy();
   UnloadDirPlugins();
@@ -166,6 +166,13 @@ struct ndmp_deviceinfo_t {
 };
 #endif
 
+/* Token bucket that limits how many jobs start per minute, see
+ * "Maximum Job Start Rate" */
+struct job_start_bucket {
+  double tokens{0};
+  time_t updated{0}; /* 0 until the first job asked for a token */
+};
+
 struct RuntimeStorageStatus final {
   RuntimeStorageStatus() = default;
   ~RuntimeStorageStatus()
@@ -194,6 +201,7 @@ struct RuntimeStorageStatus final {
   slot_number_t slots{0};            /**< Number of slots in autochanger */
   std::mutex changer_lock;           /**< Any access to
                                       the autochanger is controlled by this lock */
+  job_start_bucket start_bucket{};   /**< Jobs allowed to start now */
   unsigned char smc_ident[32] = {0}; /**< smc ident info = changer name */
   changer_vol_list_t* vol_list{nullptr}; /**< Cached content of autochanger */
   std::mutex ndmp_deviceinfo_lock;       /**< Any access to the list devices is
@@ -225,6 +233,7 @@ struct RuntimeJobStatus {
 #define FD_VERSION_52 52
 #define FD_VERSION_53 53
 #define FD_VERSION_54 54
+#define FD_VERSION_55 55 /* binary accurate list */
 
 } /* namespace directordaemon */
 
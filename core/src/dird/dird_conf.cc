@@ -134,12 +134,18 @@ static ResourceItem dir_items[] = {
   { "Subscriptions", CFG_TYPE_PINT32, ITEM(res_dir, subscriptions), 0, CFG_ITEM_DEFAULT, "0", "12.4.4-", NULL },
   { "MaximumConcurrentJobs", CFG_TYPE_PINT32, ITEM(res_dir, MaxConcurrentJobs), 0, CFG_ITEM_DEFAULT, "1", NULL, NULL },
   { "MaximumConsoleConnections", CFG_TYPE_PINT32, ITEM(res_dir, MaxConsoleConnections), 0, CFG_ITEM_DEFAULT, "20", NULL, NULL },
+  { "MaximumJobStartRate", CFG_TYPE_PINT32, ITEM(res_dir, MaxJobStartRate), 0, CFG_ITEM_DEFAULT, "0", "24.0.0-",
+     "Number of jobs the director starts per minute at most, so that many jobs scheduled for the same time do not connect to the clients, storages and the catalog all at once. Up to a sixth of it may start right away after a quiet period. Jobs with a higher priority get to start first. 0 does not limit the start rate." },
+  { "MappedRestoreTreeThreshold", CFG_TYPE_PINT32, ITEM(res_dir, mapped_restore_tree_threshold), 0, CFG_ITEM_DEFAULT, "0", "24.0.0-",
+     "Restore trees of at least this many files are kept in a memory mapped file in the working directory, so that they can be bigger than the memory. 0 keeps all of them in memory." },
   { "Password", CFG_TYPE_AUTOPASSWORD, ITEM(res_dir, password_), 0, CFG_ITEM_REQUIRED, NULL, NULL, NULL },
   { "FdConnectTimeout", CFG_TYPE_TIME, ITEM(res_dir, FDConnectTimeout), 0, CFG_ITEM_DEFAULT, "180" /* 3 minutes */, NULL, NULL },
   { "SdConnectTimeout", CFG_TYPE_TIME, ITEM(res_dir, SDConnectTimeout), 0, CFG_ITEM_DEFAULT, "1800" /* 30 minutes */, NULL, NULL },
   { "HeartbeatInterval", CFG_TYPE_TIME, ITEM(res_dir, heartbeat_interval), 0, CFG_ITEM_DEFAULT, "0", NULL, NULL },
   { "StatisticsRetention", CFG_TYPE_TIME, ITEM(res_dir, stats_retention), 0, CFG_ITEM_DEPRECATED | CFG_ITEM_DEFAULT, "160704000" /* 5 years */, NULL, NULL },
   { "StatisticsCollectInterval", CFG_TYPE_PINT32, ITEM(res_dir, stats_collect_interval), 0, CFG_ITEM_DEPRECATED | CFG_ITEM_DEFAULT, "0", "14.2.0-", NULL },
+  { "BvfsCacheWorkers", CFG_TYPE_PINT32, ITEM(res_dir, bvfs_cache_workers), 0, CFG_ITEM_DEFAULT, "0", "24.0.0-", "Number of threads that update the bvfs cache of terminated backup jobs in the background, so that browsing them for a restore is fast. 0 disables the background update." },
+  { "BackgroundAutoprune", CFG_TYPE_BOOL, ITEM(res_dir, background_autoprune), 0, CFG_ITEM_DEFAULT, "false", "24.0.0-", "Do the job and file pruning after jobs in a background thread instead of at the end of each job. Prunes of the same client and pool get merged, and they run once no job is running or after they waited for ten minutes." },
   { "VerId", CFG_TYPE_STR, ITEM(res_dir, verid), 0, 0, NULL, NULL, NULL },
   { "KeyEncryptionKey", CFG_TYPE_AUTOPASSWORD, ITEM(res_dir, keyencrkey), 1, 0, NULL, NULL, NULL },
   { "NdmpSnooping", CFG_TYPE_BOOL, ITEM(res_dir, ndmp_snooping), 0, 0, NULL, "13.2.0-", NULL },
@@ -150,6 +156,13 @@ static ResourceItem dir_items[] = {
   { "AuditEvents", CFG_TYPE_AUDIT, ITEM(res_dir, audit_events), 0, 0, NULL, "14.2.0-", NULL },
   { "SecureEraseCommand", CFG_TYPE_STR, ITEM(res_dir, secure_erase_cmdline), 0, 0, NULL, "15.2.1-",
      "Specify command that will be called when bareos unlinks files." },
+  { "MetricsPort", CFG_TYPE_PINT32, ITEM(res_dir, metrics_port), 0, CFG_ITEM_DEFAULT, "0", "24.0.0-",
+     "Port on which metrics are served over HTTP in the OpenMetrics format (GET /metrics). 0 disables the endpoint." },
+  { "MetricsAddress", CFG_TYPE_STR, ITEM(res_dir, metrics_address), 0, CFG_ITEM_DEFAULT, "localhost", "24.0.0-",
+     "Address on which the metrics endpoint listens." },
+  { "LockProfileSampling", CFG_TYPE_PINT32, ITEM(res_dir, lock_profile_sampling), 0, CFG_ITEM_DEFAULT, "0", "24.0.0-",
+     "Sample one in this many lock acquisitions of every thread for the lock contention profile shown by status. 0 switches"
+     " the profile off." },
   { "LogTimestampFormat", CFG_TYPE_STR, ITEM(res_dir, log_timestamp_format), 0, CFG_ITEM_DEFAULT, "%d-%b %H:%M", "15.2.3-", NULL },
    TLS_COMMON_CONFIG(res_dir),
    TLS_CERT_CONFIG(res_dir),
@@ -278,10 +291,14 @@ static ResourceItem store_items[] = {
   { "Enabled", CFG_TYPE_BOOL, ITEM(res_store, enabled), 0, CFG_ITEM_DEFAULT, "true", NULL,
      "En- or disable this resource." },
   { "AllowCompression", CFG_TYPE_BOOL, ITEM(res_store, AllowCompress), 0, CFG_ITEM_DEFAULT, "true", NULL, NULL },
+  { "MessageCompression", CFG_TYPE_BOOL, ITEM(res_store, message_compression), 0, CFG_ITEM_DEFAULT, "false", "24.0.0-",
+     "Compress the attributes and job messages the Storage daemon sends to the Director, if both support it. Helps jobs with many small files over slow links." },
   { "HeartbeatInterval", CFG_TYPE_TIME, ITEM(res_store, heartbeat_interval), 0, CFG_ITEM_DEFAULT, "0", NULL, NULL },
   { "CacheStatusInterval", CFG_TYPE_TIME, ITEM(res_store, cache_status_interval), 0, CFG_ITEM_DEFAULT, "30", NULL, NULL },
   { "MaximumConcurrentJobs", CFG_TYPE_PINT32, ITEM(res_store, MaxConcurrentJobs), 0, CFG_ITEM_DEFAULT, "1", NULL, NULL },
   { "MaximumConcurrentReadJobs", CFG_TYPE_PINT32, ITEM(res_store, MaxConcurrentReadJobs), 0, CFG_ITEM_DEFAULT, "0", NULL, NULL },
+  { "MaximumJobStartRate", CFG_TYPE_PINT32, ITEM(res_store, MaxJobStartRate), 0, CFG_ITEM_DEFAULT, "0", "24.0.0-",
+     "Number of jobs using this storage that start per minute at most, which spreads the device reservations of many jobs scheduled for the same time. Up to a sixth of it may start right away after a quiet period. 0 does not limit the start rate." },
   { "PairedStorage", CFG_TYPE_RES, ITEM(res_store, paired_storage), R_STORAGE, 0, NULL, NULL, NULL },
   { "MaximumBandwidthPerJob", CFG_TYPE_SPEED, ITEM(res_store, max_bandwidth), 0, 0, NULL, NULL, NULL },
   { "CollectStatistics", CFG_TYPE_BOOL, ITEM(res_store, collectstats), 0, CFG_ITEM_DEPRECATED | CFG_ITEM_DEFAULT, "false", NULL, NULL },
@@ -308,20 +325,32 @@ static ResourceItem cat_items[] = {
    /* Turned off for the moment */
   { "MultipleConnections", CFG_TYPE_BIT, ITEM(res_cat, mult_db_connections), 0, 0, NULL, NULL, NULL },
   { "DisableBatchInsert", CFG_TYPE_BOOL, ITEM(res_cat, disable_batch_insert), 0, CFG_ITEM_DEFAULT, "false", NULL, NULL },
+  { "BatchConnections", CFG_TYPE_PINT32, ITEM(res_cat, batch_connections), 0, CFG_ITEM_DEFAULT, "1",
+     "24.0.0-", "Number of database connections the file attributes of a job are spread over (by path). At the end of the job (and at every checkpoint) they are merged into the catalog in parallel." },
+  { "PurgeChunkSize", CFG_TYPE_PINT32, ITEM(res_cat, purge_chunk_size), 0, CFG_ITEM_DEFAULT, "100000",
+     "24.0.0-", "Maximum number of File records deleted by one statement when files or jobs are pruned or purged. Each chunk is its own transaction, so locks are held shorter and the write ahead log grows less at once. 0 deletes them all at once." },
+  { "PurgeChunkPause", CFG_TYPE_PINT32, ITEM(res_cat, purge_chunk_pause), 0, CFG_ITEM_DEFAULT, "0",
+     "24.0.0-", "Milliseconds to wait between two chunks of File records being deleted, to leave the database some room for running jobs." },
+  { "ReplicaAddress", CFG_TYPE_STR, ITEM(res_cat, replica_address), 0, 0, NULL,
+     "24.0.0-", "Address of a read-only streaming replica of the catalog database. Read-only console queries (list, llist, the bvfs browsing commands) are sent to it instead of the primary database, as long as it does not lag behind more than ReplicaMaxLag." },
+  { "ReplicaPort", CFG_TYPE_PINT32, ITEM(res_cat, replica_port), 0, 0, NULL,
+     "24.0.0-", "Port of the replica, DbPort if not set." },
+  { "ReplicaMaxLag", CFG_TYPE_TIME, ITEM(res_cat, replica_max_lag), 0, CFG_ITEM_DEFAULT, "30",
+     "24.0.0-", "The replica is only used while it has replayed all changes of the primary database older than this. Otherwise the queries go to the primary database." },
   { "Reconnect", CFG_TYPE_BOOL, ITEM(res_cat, try_reconnect), 0, CFG_ITEM_DEFAULT, "true",
      "15.1.0-", "Try to reconnect a database connection when it is dropped" },
   { "ExitOnFatal", CFG_TYPE_BOOL, ITEM(res_cat, exit_on_fatal), 0, CFG_ITEM_DEFAULT, "false",
      "15.1.0-", "Make any fatal error in the connection to the database exit the program" },
   { "MinConnections", CFG_TYPE_PINT32, ITEM(res_cat, pooling_min_connections), 0, CFG_ITEM_DEFAULT, "1", NULL,
-     "This directive is used by the experimental database pooling functionality. Only use this for non production sites. This sets the minimum number of connections to a database to keep in this database pool." },
+     "Number of idle connections to keep in the database pool of this catalog, even when they idle longer than IdleTimeout." },
   { "MaxConnections", CFG_TYPE_PINT32, ITEM(res_cat, pooling_max_connections), 0, CFG_ITEM_DEFAULT, "5", NULL,
-     "This directive is used by the experimental database pooling functionality. Only use this for non production sites. This sets the maximum number of connections to a database to keep in this database pool." },
+     "Maximum number of connections in the database pool of this catalog. Jobs and consoles that would share one connection get one of their own from the pool instead, once all are in use they share one connection again. 1 disables the pool." },
   { "IncConnections", CFG_TYPE_PINT32, ITEM(res_cat, pooling_increment_connections), 0, CFG_ITEM_DEFAULT, "1", NULL,
-    "This directive is used by the experimental database pooling functionality. Only use this for non production sites. This sets the number of connections to add to a database pool when not enough connections are available on the pool anymore." },
+    "Number of connections to open at once when the database pool of this catalog has no idle connection left." },
   { "IdleTimeout", CFG_TYPE_PINT32, ITEM(res_cat, pooling_idle_timeout), 0, CFG_ITEM_DEFAULT, "30", NULL,
-     "This directive is used by the experimental database pooling functionality. Only use this for non production sites.  This sets the idle time after which a database pool should be shrinked." },
+     "Seconds after which idle connections of the database pool (above MinConnections) are closed." },
   { "ValidateTimeout", CFG_TYPE_PINT32, ITEM(res_cat, pooling_validate_timeout), 0, CFG_ITEM_DEFAULT, "120", NULL,
-     "This directive is used by the experimental database pooling functionality. Only use this for non production sites. This sets the validation timeout after which the database connection is polled to see if its still alive." },
+     "Seconds a connection may idle in the database pool before it is checked to still be alive when it is handed out again." },
   {nullptr, 0, 0, nullptr, 0, 0, nullptr, nullptr, nullptr}
 };
 
@@ -341,6 +370,8 @@ ResourceItem job_items[] = {
   { "IncrementalBackupPool", CFG_TYPE_RES, ITEM(res_job, inc_pool), R_POOL, 0, NULL, NULL, NULL },
   { "DifferentialBackupPool", CFG_TYPE_RES, ITEM(res_job, diff_pool), R_POOL, 0, NULL, NULL, NULL },
   { "NextPool", CFG_TYPE_RES, ITEM(res_job, next_pool), R_POOL, 0, NULL, NULL, NULL },
+  { "MirrorPool", CFG_TYPE_RES, ITEM(res_job, mirror_pool), R_POOL, 0, NULL, "24.0.0-",
+     "Backups also get written to this pool while they run: the storage daemon sends every record on to the storage of this pool as well, so a copy job exists once the backup terminated, without reading the data again. A failure of either storage fails the backup." },
   { "Client", CFG_TYPE_RES, ITEM(res_job, client), R_CLIENT, 0, NULL, NULL, NULL },
   { "FileSet", CFG_TYPE_RES, ITEM(res_job, fileset), R_FILESET, 0, NULL, NULL, NULL },
   { "Schedule", CFG_TYPE_RES, ITEM(res_job, schedule), R_SCHEDULE, 0, NULL, NULL, NULL },
@@ -399,6 +430,10 @@ ResourceItem job_items[] = {
   { "RunScript", CFG_TYPE_RUNSCRIPT, ITEM(res_job, RunScripts), 0, CFG_ITEM_NO_EQUALS, NULL, NULL, NULL },
   { "SelectionType", CFG_TYPE_MIGTYPE, ITEM(res_job, selection_type), 0, 0, NULL, NULL, NULL },
   { "Accurate", CFG_TYPE_BOOL, ITEM(res_job, accurate), 0, CFG_ITEM_DEFAULT, "false", NULL, NULL },
+  { "BinaryAttributes", CFG_TYPE_BOOL, ITEM(res_job, binary_attributes), 0, CFG_ITEM_DEFAULT, "false", "24.0.0-",
+     "Let the File Daemon send the file attributes in a compact binary form. They are stored in the catalog as text as before." },
+  { "AccurateSnapshot", CFG_TYPE_BOOL, ITEM(res_job, accurate_snapshot), 0, CFG_ITEM_DEFAULT, "false", "24.0.0-",
+     "Keep the file list sent to the File Daemon for accurate backups in the working directory, so the next backup only has to read the files of newer jobs from the catalog." },
   { "AllowDuplicateJobs", CFG_TYPE_BOOL, ITEM(res_job, AllowDuplicateJobs), 0, CFG_ITEM_DEFAULT, "true", NULL, NULL },
   { "AllowHigherDuplicates", CFG_TYPE_BOOL, ITEM(res_job, AllowHigherDuplicates), 0, CFG_ITEM_DEPRECATED | CFG_ITEM_DEFAULT, "true", NULL, NULL },
   { "CancelLowerLevelDuplicates", CFG_TYPE_BOOL, ITEM(res_job, CancelLowerLevelDuplicates), 0, CFG_ITEM_DEFAULT, "false", NULL, NULL },
@@ -410,6 +445,8 @@ ResourceItem job_items[] = {
   { "SdPluginOptions", CFG_TYPE_ALIST_STR, ITEM(res_job, SdPluginOptions), 0, 0, NULL, NULL, NULL },
   { "DirPluginOptions", CFG_TYPE_ALIST_STR, ITEM(res_job, DirPluginOptions), 0, 0, NULL, NULL, NULL },
   { "MaxConcurrentCopies", CFG_TYPE_PINT32, ITEM(res_job, MaxConcurrentCopies), 0, CFG_ITEM_DEFAULT, "100", NULL, NULL },
+  { "ShareVolumeReads", CFG_TYPE_BOOL, ITEM(res_job, ShareVolumeReads), 0, CFG_ITEM_DEFAULT, "false", "24.0.0-",
+     "Copy and migration jobs selected together whose data is on the same single volume read it only once: the first of them to get the volume reads it for all the others that reserved the same device, and every record goes to the job it belongs to." },
    /* Settings for always incremental */
   { "AlwaysIncremental", CFG_TYPE_BOOL, ITEM(res_job, AlwaysIncremental), 0, CFG_ITEM_DEFAULT, "false", "16.2.4-",
      "Enable/disable always incremental backup scheme." },
@@ -1921,6 +1958,10 @@ void FilesetResource::PrintConfigIncludeExcludeOptions(
             send.KeyQuotedString("Signature", "XXH128");
             p++;
             break;
+          case '5':
+            send.KeyQuotedString("Signature", "XXH3TREE");
+            p++;
+            break;
           default:
             send.KeyQuotedString("Signature", "SHA1");
             break;
@@ -1994,6 +2035,14 @@ void FilesetResource::PrintConfigIncludeExcludeOptions(
                 break;
             }
             break;
+          case 's': {
+            p++; /* skip s, the level has two digits */
+            int level = (p[0] - '0') * 10 + (p[1] - '0');
+            send.KeyQuotedString("Compression",
+                                 "ZSTD" + std::to_string(level));
+            p++;
+            break;
+          }
           default:
             Emsg1(M_ERROR, 0,
                   T_("Unknown compression include/exclude option: %c\n"), *p);
@@ -2503,39 +2552,17 @@ static void StoreDevice(LEX* lc,
                         ResourceItem* item,
                         int index,
                         int pass,
-                        BareosResource** configuration_resources)
+                        BareosResource**)
 {
   int rindex = R_DEVICE;
 
   if (pass == 1) {
     LexGetToken(lc, BCT_NAME);
-    if (!configuration_resources[rindex]) {
+    if (!my_config->GetResWithName(rindex, lc->str, false)) {
       DeviceResource* device_resource = new DeviceResource;
       device_resource->rcode_ = R_DEVICE;
       device_resource->resource_name_ = strdup(lc->str);
-      configuration_resources[rindex] = device_resource; /* store first entry */
-      Dmsg3(900, "Inserting first %s res: %s index=%d\n",
-            my_config->ResToStr(R_DEVICE), device_resource->resource_name_,
-            rindex);
-    } else {
-      bool found = false;
-      BareosResource* next;
-      for (next = configuration_resources[rindex]; next->next_;
-           next = next->next_) {
-        if (bstrcmp(next->resource_name_, lc->str)) {
-          found = true;  // already defined
-          break;
-        }
-      }
-      if (!found) {
-        DeviceResource* device_resource = new DeviceResource;
-        device_resource->rcode_ = R_DEVICE;
-        device_resource->resource_name_ = strdup(lc->str);
-        next->next_ = device_resource;
-        Dmsg4(900, "Inserting %s res: %s index=%d pass=%d\n",
-              my_config->ResToStr(R_DEVICE), device_resource->resource_name_,
-              rindex, pass);
-      }
+      my_config->AppendToResourcesChain(device_resource, rindex);
     }
 
     ScanToEol(lc);
@@ -3814,6 +3841,7 @@ static void FreeResource(BareosResource* res, int type)
       if (p->audit_events) { delete p->audit_events; }
       if (p->secure_erase_cmdline) { free(p->secure_erase_cmdline); }
       if (p->log_timestamp_format) { free(p->log_timestamp_format); }
+      if (p->metrics_address) { free(p->metrics_address); }
       delete p;
       break;
     }
@@ -3897,6 +3925,7 @@ static void FreeResource(BareosResource* res, int type)
       CatalogResource* p = dynamic_cast<CatalogResource*>(res);
       assert(p);
       if (p->db_address) { free(p->db_address); }
+      if (p->replica_address) { free(p->replica_address); }
       if (p->db_socket) { free(p->db_socket); }
       if (p->db_user) { free(p->db_user); }
       if (p->db_name) { free(p->db_name); }
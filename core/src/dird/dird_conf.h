@@ -122,6 +122,8 @@ class DirectorResource
   MessagesResource* messages = nullptr;       /* Daemon message handler */
   uint32_t MaxConcurrentJobs = 0; /* Max concurrent jobs for whole director */
   uint32_t MaxConsoleConnections = 0; /* Max concurrent console connections */
+  uint32_t MaxJobStartRate = 0;       /* Jobs started per minute, 0 = any */
+  uint32_t mapped_restore_tree_threshold = 0; /* Files of a mapped tree */
   utime_t FDConnectTimeout = {0};     /* Timeout for connect in seconds */
   utime_t SDConnectTimeout = {0};     /* Timeout for connect in seconds */
   utime_t heartbeat_interval = {0};   /* Interval to send heartbeats */
@@ -139,11 +141,16 @@ class DirectorResource
                                  terminated  regardless of its progress */
   uint32_t stats_collect_interval
       = 0;               /* Statistics collect interval in seconds */
+  uint32_t bvfs_cache_workers = 0; /* Threads updating the bvfs cache */
+  bool background_autoprune = false; /* Prune after jobs in the background */
   char* verid = nullptr; /* Custom Id to print in version command */
   char* secure_erase_cmdline = nullptr; /* Cmdline to execute to perform secure
                                  erase of file */
   char* log_timestamp_format = nullptr; /* Timestamp format to use in generic
                                  logging messages */
+  char* metrics_address = nullptr;      /* Address of the metrics endpoint */
+  uint32_t metrics_port = 0;            /* Port of the metrics endpoint */
+  uint32_t lock_profile_sampling = 0;   /* 0 or one in how many locks */
   s_password keyencrkey;                /* Key Encryption Key */
 };
 
@@ -253,6 +260,12 @@ class CatalogResource : public BareosResource {
   uint32_t mult_db_connections = 0; /**< Set if multiple connections wanted */
   bool disable_batch_insert
       = false;                /**< Set if batch inserts should be disabled */
+  uint32_t batch_connections = 1; /**< Connections to fill the batch table */
+  uint32_t purge_chunk_size = 100000; /**< File records deleted at once */
+  uint32_t purge_chunk_pause = 0;  /**< Milliseconds between two chunks */
+  char* replica_address = nullptr; /**< Read-only replica of the database */
+  uint32_t replica_port = 0;       /**< Port of the replica */
+  utime_t replica_max_lag = 0;     /**< Seconds the replica may lag behind */
   bool try_reconnect = true;  /**< Try to reconnect a database connection when
                           it is dropped */
   bool exit_on_fatal = false; /**< Make any fatal error in the connection to the
@@ -349,12 +362,14 @@ class StorageResource
       = nullptr;                     /**< Alternate devices for this Storage */
   int32_t MaxConcurrentJobs = 0;     /**< Maximum concurrent jobs */
   int32_t MaxConcurrentReadJobs = 0; /**< Maximum concurrent jobs reading */
+  uint32_t MaxJobStartRate = 0;      /**< Jobs started per minute, 0 = any */
   bool enabled = false;              /**< Set if device is enabled */
   bool autochanger = false;          /**< Set if autochanger */
   bool collectstats
       = false; /**< Set if statistics should be collected of this SD */
   bool AllowCompress = false; /**< Set if this Storage should allow jobs to
                          enable compression */
+  bool message_compression = false; /**< Compress messages from the SD */
   int64_t StorageId = 0;      /**< Set from Storage DB record */
   int64_t max_bandwidth
       = 0; /**< Limit speed on this storage daemon for replication */
@@ -464,6 +479,7 @@ class JobResource : public BareosResource {
   PoolResource* inc_pool = nullptr;   /**< Pool for Incremental backups */
   PoolResource* diff_pool = nullptr;  /**< Pool for Differental backups */
   PoolResource* next_pool = nullptr; /**< Next Pool for Copy/Migration Jobs and Virtual backups */
+  PoolResource* mirror_pool = nullptr; /**< Pool backups are written to as well */
   char* selection_pattern = nullptr;
   JobResource* verify_job = nullptr; /**< Job name to verify */
   JobResource* jobdefs = nullptr;    /**< Job defaults */
@@ -488,12 +504,15 @@ class JobResource : public BareosResource {
   bool PreferMountedVolumes = false; /**< Prefer vols mounted rather than new one */
   bool enabled = false;              /**< Set if job enabled */
   bool accurate = false;             /**< Set if it is an accurate backup job */
+  bool binary_attributes = false;    /**< Ask the FD for binary attributes */
+  bool accurate_snapshot = false;    /**< Keep the accurate list in a file */
   bool AllowDuplicateJobs = false;   /**< Allow duplicate jobs */
   bool AllowHigherDuplicates = false; /**< Permit Higher Level */
   bool CancelLowerLevelDuplicates = false; /**< Cancel lower level backup jobs */
   bool CancelQueuedDuplicates = false;  /**< Cancel queued jobs */
   bool CancelRunningDuplicates = false; /**< Cancel Running jobs */
   bool PurgeMigrateJob = false;         /**< Purges source job on completion */
+  bool ShareVolumeReads = false;        /**< Copies read a volume once */
   bool IgnoreDuplicateJobChecking = false; /**< Ignore Duplicate Job Checking */
   bool SaveFileHist = false; /**< Ability to disable File history saving for certain protocols */
   bool AlwaysIncremental = false; /**< Always incremental with regular consolidation */
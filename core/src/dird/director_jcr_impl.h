@@ -25,9 +25,11 @@
 #define BAREOS_DIRD_DIRECTOR_JCR_IMPL_H_
 
 #include <optional>
+#include <string>
 
 #include "cats/cats.h"
 #include "lib/mem_pool.h"
+#include "lib/stage_timer.h"
 #include "dird/client_connection_handshake_mode.h"
 #include "dird/job_trigger.h"
 
@@ -45,6 +47,18 @@ class PoolResource;
 class FilesetResource;
 class CatalogResource;
 struct RuntimeJobStatus;
+
+// the catalog work done for the records a job sends
+enum class catalog_stage
+{
+  kAttributes,  /**< inserting file attributes and digests */
+  kJobMedia,    /**< inserting JobMedia records */
+  kBatchCommit, /**< moving the batch table into the File table */
+  kCount
+};
+
+extern const char* const catalog_stage_names[
+    static_cast<std::size_t>(catalog_stage::kCount)];
 }  // namespace directordaemon
 
 namespace storagedaemon {
@@ -103,6 +117,16 @@ struct Resources {
   bool run_next_pool_override{};  /**< Next pool override was given on run cmdline */
 };
 
+// of an incomplete backup that gets resumed, see the resume command
+struct ResumePoint {
+  JobId_t JobId{};                /**< Of the incomplete backup */
+  int JobLevel{};                 /**< It was run at */
+  int32_t FileIndex{};            /**< Of the last file it saved */
+  std::string fname{};            /**< Name of that file */
+  uint64_t JobBytes{};            /**< Saved up to there */
+  utime_t StartTime{};            /**< Of the incomplete backup */
+};
+
 struct DirectorJcrImpl {
   DirectorJcrImpl( std::shared_ptr<ConfigResourcesContainer> configuration_resources_container) : job_config_resources_container_(configuration_resources_container) {
     RestoreJobId = 0; MigrateJobId = 0; VerifyJobId = 0;
@@ -130,6 +154,10 @@ struct DirectorJcrImpl {
   JobDbRecord jr;                 /**< Job DB record for current job */
   std::optional<JobDbRecord> previous_jr;        /**< Previous job database record */
   JobControlRecord* mig_jcr{};    /**< JobControlRecord for migration/copy job */
+  JobControlRecord* mirror_jcr{}; /**< Copy written while the backup runs */
+  std::string read_group{};       /**< Copies sharing the read of a volume */
+  uint32_t read_group_size{};     /**< Number of them */
+  ResumePoint resume{};           /**< Set when resuming an incomplete backup */
   char FSCreateTime[MAX_TIME_LENGTH]{}; /**< FileSet CreateTime as returned from DB */
   char since[MAX_TIME_LENGTH]{};        /**< Since time */
   char PrevJob[MAX_NAME_LENGTH]{};      /**< Previous job name assiciated with since time */
@@ -139,6 +167,7 @@ struct DirectorJcrImpl {
     JobId_t VerifyJobId;                /**< Verify JobId specified by UA */
   };
   PoolMem fname{PM_FNAME};              /**< Name to put into catalog */
+  PoolMem lstat{PM_NAME};               /**< Text form of binary attributes */
   POOLMEM* client_uname{};              /**< Client uname */
   POOLMEM* FDSecureEraseCmd{};          /**< Report: Secure Erase Command  */
   POOLMEM* SDSecureEraseCmd{};          /**< Report: Secure Erase Command  */
@@ -154,8 +183,11 @@ struct DirectorJcrImpl {
   bool IgnoreClientConcurrency{};       /**< Set in migration jobs */
   bool IgnoreStorageConcurrency{};      /**< Set in migration jobs */
   int32_t max_concurrent_jobs{};        /**< Maximum concurrent jobs */
+  uint32_t restore_sessions{};          /**< Jobs a split restore runs as */
   bool spool_data{};                    /**< Spool data in SD */
   bool acquired_resource_locks{};       /**< Set if resource locks acquired */
+  const void* blocked_on{};             /**< Resource the job waits for */
+  uint64_t blocked_release{};           /**< Releases of it when it was full */
   bool nextrun_ready_inited{};          /**< Set when cond var inited */
   bool fn_printed{};                    /**< Printed filename */
   bool needs_sd{};                      /**< Set if SD needed by Job */
@@ -168,11 +200,13 @@ struct DirectorJcrImpl {
   bool use_accurate_chksum{};           /**< Use or not checksum option in accurate code */
   bool sd_canceled{};                   /**< Set if SD canceled */
   bool remote_replicate{};              /**< Replicate data to remote SD */
+  bool is_mirror{};                     /**< Set in the mirror_jcr of a backup */
   bool HasQuota{};                      /**< Client has quota limits */
   bool HasSelectedJobs{};               /**< Migration/Copy Job did actually select some JobIds */
   directordaemon::ClientConnectionHandshakeMode connection_handshake_try_{
     directordaemon::ClientConnectionHandshakeMode::kUndefined};
   JobTrigger job_trigger{JobTrigger::kUndefined};
+  stage_timers<directordaemon::catalog_stage> stage_times; /**< Catalog inserts */
 };
 /* clang-format on */
 
@@ -36,6 +36,11 @@
 #include "lib/output_formatter.h"
 #include "lib/var.h"
 
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
 namespace directordaemon {
 
 static int date_item(JobControlRecord*,
@@ -437,6 +442,79 @@ static var_rc_t operate_var(var_t*,
   return status;
 }
 
+namespace {
+struct template_deleter {
+  void operator()(var_template_t* tpl) const { var_template_free(tpl); }
+};
+
+/* The compiled templates by their source.  They are only read after
+ * compiling, so one template is shared by all jobs expanding it. */
+constexpr std::size_t kMaxTemplates = 256;
+std::mutex template_mutex;
+std::unordered_map<std::string, std::shared_ptr<const var_template_t>>
+    templates;
+}  // namespace
+
+/**
+ * Compile a template, or return it from the cache if it was compiled
+ * before.  The first unescaping only depends on the template itself, so it
+ * is done here once as well.
+ */
+static std::shared_ptr<const var_template_t> GetTemplate(var_t* var_ctx,
+                                                         const char* inp,
+                                                         var_rc_t& status)
+{
+  {
+    std::unique_lock lock(template_mutex);
+    if (auto found = templates.find(inp); found != templates.end()) {
+      return found->second;
+    }
+  }
+
+  int in_len = strlen(inp);
+  PoolMem buf(PM_FNAME);
+  buf.check_size(in_len + 1);
+  if ((status = var_unescape(var_ctx, inp, in_len, buf.c_str(), in_len + 1, 0))
+      != VAR_OK) {
+    return nullptr;
+  }
+
+  var_template_t* tpl = nullptr;
+  if ((status = var_compile(var_ctx, buf.c_str(), strlen(buf.c_str()), &tpl))
+      != VAR_OK) {
+    return nullptr;
+  }
+  std::shared_ptr<const var_template_t> compiled(tpl, template_deleter{});
+
+  std::unique_lock lock(template_mutex);
+  // templates of old configurations are dropped from time to time
+  if (templates.size() >= kMaxTemplates) { templates.clear(); }
+  templates.emplace(inp, compiled);
+  return compiled;
+}
+
+/**
+ * Check the syntax of a template, e.g. the LabelFormat of a pool while
+ * loading the configuration, and keep it compiled for VariableExpansion().
+ *
+ * Returns: false and a description in error if it cannot be expanded
+ */
+bool PrecompileVariableExpansion(const char* inp, std::string& error)
+{
+  var_t* var_ctx;
+  var_rc_t status;
+
+  if ((status = var_create(&var_ctx)) != VAR_OK) {
+    error = var_strerror(var_ctx, status);
+    return false;
+  }
+  bool ok = GetTemplate(var_ctx, inp, status) != nullptr;
+  if (!ok) { error = var_strerror(var_ctx, status); }
+  var_destroy(var_ctx);
+
+  return ok;
+}
+
 /**
  * Expand an input line and return it.
  *
@@ -448,10 +526,10 @@ int VariableExpansion(JobControlRecord* jcr, char* inp, POOLMEM*& exp)
   var_t* var_ctx;
   var_rc_t status;
   char* outp;
-  int in_len, out_len;
+  int out_len;
   int rtn_stat = 0;
+  std::shared_ptr<const var_template_t> tpl;
 
-  in_len = strlen(inp);
   outp = NULL;
   out_len = 0;
 
@@ -480,18 +558,15 @@ int VariableExpansion(JobControlRecord* jcr, char* inp, POOLMEM*& exp)
     goto bail_out;
   }
 
-  // Unescape in place
-  if ((status = var_unescape(var_ctx, inp, in_len, inp, in_len + 1, 0))
-      != VAR_OK) {
-    Jmsg(jcr, M_ERROR, 0, T_("Cannot unescape string: ERR=%s\n"),
+  // Unescape and compile, unless done before
+  if (!(tpl = GetTemplate(var_ctx, inp, status))) {
+    Jmsg(jcr, M_ERROR, 0, T_("Cannot expand expression \"%s\": ERR=%s\n"), inp,
          var_strerror(var_ctx, status));
     goto bail_out;
   }
 
-  in_len = strlen(inp);
-
   // Expand variables
-  if ((status = var_expand(var_ctx, inp, in_len, &outp, &out_len, 0))
+  if ((status = var_execute(var_ctx, tpl.get(), &outp, &out_len, 0))
       != VAR_OK) {
     Jmsg(jcr, M_ERROR, 0, T_("Cannot expand expression \"%s\": ERR=%s\n"), inp,
          var_strerror(var_ctx, status));
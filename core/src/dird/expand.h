@@ -22,9 +22,12 @@
 #ifndef BAREOS_DIRD_EXPAND_H_
 #define BAREOS_DIRD_EXPAND_H_
 
+#include <string>
+
 namespace directordaemon {
 
 int VariableExpansion(JobControlRecord* jcr, char* inp, POOLMEM*& exp);
+bool PrecompileVariableExpansion(const char* inp, std::string& error);
 
 } /* namespace directordaemon */
 
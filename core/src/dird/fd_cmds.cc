@@ -70,6 +70,7 @@ static char jobcmdssl[]
     = "JobId=%s Job=%s SDid=%u SDtime=%u Authorization=%s ssl=%d\n";
 /* Note, mtime_only is not used here -- implemented as file option */
 static char levelcmd[] = "level = %s%s%s mtime_only=%d %s%s\n";
+static char resumecmd[] = "resume FileIndex=%d File=%s\n";
 static char runscriptcmd[]
     = "Run OnSuccess=%u OnFailure=%u AbortOnError=%u When=%u Command=%s\n";
 static char runbeforenowcmd[] = "RunBeforeNow\n";
@@ -82,6 +83,7 @@ static char getSecureEraseCmd[] = "getSecureEraseCmd\n";
 static char OKinc[] = "2000 OK include\n";
 static char OKjob[] = "2000 OK Job";
 static char OKlevel[] = "2000 OK level\n";
+static char OKresume[] = "2000 OK resume\n";
 static char OKRunScript[] = "2000 OK RunScript\n";
 static char OKRunBeforeNow[] = "2000 OK RunBeforeNow\n";
 static char OKRestoreObject[] = "2000 OK ObjectRestored\n";
@@ -545,6 +547,18 @@ bool SendLevelCommand(JobControlRecord* jcr)
   return true;
 }
 
+// Tell the File daemon the last file saved by the backup the job resumes
+bool SendResumePoint(JobControlRecord* jcr)
+{
+  BareosSocket* fd = jcr->file_bsock;
+  const ResumePoint& resume = jcr->dir_impl->resume;
+  PoolMem fname(resume.fname);
+
+  BashSpaces(fname);
+  fd->fsend(resumecmd, resume.FileIndex, fname.c_str());
+  return response(jcr, fd, OKresume, "Resume", DISPLAY_ERROR);
+}
+
 // Send either an Included or an Excluded list to FD
 static bool SendFileset(JobControlRecord* jcr, FilesetResource* fileset)
 {
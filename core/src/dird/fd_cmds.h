@@ -37,6 +37,7 @@ void SetConnectionHandshakeMode(JobControlRecord* jcr, UaContext* ua);
 int SendJobInfoToFileDaemon(JobControlRecord* jcr);
 bool SendIncludeExcludeLists(JobControlRecord* jcr);
 bool SendLevelCommand(JobControlRecord* jcr);
+bool SendResumePoint(JobControlRecord* jcr);
 bool SendBwlimitToFd(JobControlRecord* jcr, const char* Job);
 bool SendSecureEraseReqToFd(JobControlRecord* jcr);
 bool SendPreviousRestoreObjects(JobControlRecord* jcr);
@@ -32,7 +32,7 @@ namespace directordaemon {
 
 BareosDb* GetDatabaseConnection(JobControlRecord* jcr)
 {
-  return DbSqlGetPooledConnection(
+  BareosDb* db = DbSqlGetPooledConnection(
       jcr, jcr->dir_impl->res.catalog->db_driver,
       jcr->dir_impl->res.catalog->db_name, jcr->dir_impl->res.catalog->db_user,
       jcr->dir_impl->res.catalog->db_password.value,
@@ -43,6 +43,12 @@ BareosDb* GetDatabaseConnection(JobControlRecord* jcr)
       jcr->dir_impl->res.catalog->disable_batch_insert,
       jcr->dir_impl->res.catalog->try_reconnect,
       jcr->dir_impl->res.catalog->exit_on_fatal);
+  if (db) {
+    db->SetBatchPartitions(jcr->dir_impl->res.catalog->batch_connections);
+    db->SetPurgeChunks(jcr->dir_impl->res.catalog->purge_chunk_size,
+                       jcr->dir_impl->res.catalog->purge_chunk_pause);
+  }
+  return db;
 }
 
 }  // namespace directordaemon
@@ -148,6 +148,7 @@ static struct s_fs_opt FS_options[]
        {"sha256", INC_KW_DIGEST, "S2"},
        {"sha512", INC_KW_DIGEST, "S3"},
        {"xxh128", INC_KW_DIGEST, "S4"},
+       {"xxh3tree", INC_KW_DIGEST, "S5"},
        {"gzip", INC_KW_COMPRESSION, "Z6"},
        {"gzip1", INC_KW_COMPRESSION, "Z1"},
        {"gzip2", INC_KW_COMPRESSION, "Z2"},
@@ -162,6 +163,26 @@ static struct s_fs_opt FS_options[]
        {"lzfast", INC_KW_COMPRESSION, "Zff"},
        {"lz4", INC_KW_COMPRESSION, "Zf4"},
        {"lz4hc", INC_KW_COMPRESSION, "Zfh"},
+       {"zstd", INC_KW_COMPRESSION, "Zs03"},
+       {"zstd1", INC_KW_COMPRESSION, "Zs01"},
+       {"zstd2", INC_KW_COMPRESSION, "Zs02"},
+       {"zstd3", INC_KW_COMPRESSION, "Zs03"},
+       {"zstd4", INC_KW_COMPRESSION, "Zs04"},
+       {"zstd5", INC_KW_COMPRESSION, "Zs05"},
+       {"zstd6", INC_KW_COMPRESSION, "Zs06"},
+       {"zstd7", INC_KW_COMPRESSION, "Zs07"},
+       {"zstd8", INC_KW_COMPRESSION, "Zs08"},
+       {"zstd9", INC_KW_COMPRESSION, "Zs09"},
+       {"zstd10", INC_KW_COMPRESSION, "Zs10"},
+       {"zstd11", INC_KW_COMPRESSION, "Zs11"},
+       {"zstd12", INC_KW_COMPRESSION, "Zs12"},
+       {"zstd13", INC_KW_COMPRESSION, "Zs13"},
+       {"zstd14", INC_KW_COMPRESSION, "Zs14"},
+       {"zstd15", INC_KW_COMPRESSION, "Zs15"},
+       {"zstd16", INC_KW_COMPRESSION, "Zs16"},
+       {"zstd17", INC_KW_COMPRESSION, "Zs17"},
+       {"zstd18", INC_KW_COMPRESSION, "Zs18"},
+       {"zstd19", INC_KW_COMPRESSION, "Zs19"},
        {"blowfish", INC_KW_ENCRYPTION, "Eb"},
        {"3des", INC_KW_ENCRYPTION, "E3"},
        {"aes128", INC_KW_ENCRYPTION, "Ea1"},
@@ -172,6 +193,7 @@ static struct s_fs_opt FS_options[]
        {"camellia256", INC_KW_ENCRYPTION, "Ec3"},
        {"aes128hmacsha1", INC_KW_ENCRYPTION, "Eh1"},
        {"aes256hmacsha1", INC_KW_ENCRYPTION, "Eh2"},
+       {"aes256gcm", INC_KW_ENCRYPTION, "Eg3"},
        {"yes", INC_KW_ONEFS, "0"},
        {"no", INC_KW_ONEFS, "f"},
        {"yes", INC_KW_RECURSE, "0"},
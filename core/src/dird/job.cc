@@ -33,6 +33,7 @@
 #include "dird/archive.h"
 #include "dird/autoprune.h"
 #include "dird/backup.h"
+#include "dird/bvfs_cache.h"
 #include "dird/consolidate.h"
 #include "dird/fd_cmds.h"
 #include "dird/get_database_connection.h"
@@ -40,6 +41,7 @@
 #include "dird/director_jcr_impl.h"
 #include "dird/migration.h"
 #include "dird/pthread_detach_if_not_detached.h"
+#include "dird/quota.h"
 #include "dird/restore.h"
 #include "dird/sd_cmds.h"
 #include "dird/stats.h"
@@ -62,6 +64,7 @@
 #include "cats/sql_pooling.h"
 #include "lib/berrno.h"
 #include "lib/edit.h"
+#include "lib/metrics.h"
 #include "lib/output_formatter_resource.h"
 #include "lib/parse_bsr.h"
 #include "lib/parse_conf.h"
@@ -89,6 +92,16 @@ static bool JobCheckMaxrunschedtime(JobControlRecord* jcr);
 
 jobq_t job_queue;
 
+static metrics::callback_gauge waiting_jobs{
+    "bareos_dir_waiting_jobs", "Jobs in the job queue waiting to be started",
+    [] { return JobqGetStatistics(&job_queue).waiting; }};
+static metrics::callback_gauge ready_jobs{
+    "bareos_dir_ready_jobs", "Jobs in the job queue ready to be started",
+    [] { return JobqGetStatistics(&job_queue).ready; }};
+static metrics::callback_gauge running_jobs{
+    "bareos_dir_running_jobs", "Jobs of the job queue that are running",
+    [] { return JobqGetStatistics(&job_queue).running; }};
+
 void InitJobServer(int max_workers)
 {
   int status;
@@ -110,6 +123,11 @@ void InitJobServer(int max_workers)
 
 void TermJobServer() { JobqDestroy(&job_queue); /* ignore any errors */ }
 
+jobq_statistics GetJobQueueStatistics()
+{
+  return JobqGetStatistics(&job_queue);
+}
+
 /**
  * Run a job -- typically called by the scheduler, but may also
  *              be called by the UA (Console program).
@@ -199,7 +217,10 @@ bool SetupJob(JobControlRecord* jcr, bool suppress_output)
     if (!GetOrCreateClientRecord(jcr)) { goto bail_out; }
   }
 
-  if (DbLocker _{jcr->db}; !jcr->db->CreateJobRecord(jcr, &jcr->dir_impl->jr)) {
+  if (jcr->dir_impl->resume.JobId) {
+    if (!ResumeBackupJobRecord(jcr)) { goto bail_out; }
+  } else if (DbLocker _{jcr->db};
+             !jcr->db->CreateJobRecord(jcr, &jcr->dir_impl->jr)) {
     Jmsg(jcr, M_FATAL, 0, "%s", jcr->db->strerror());
     goto bail_out;
   }
@@ -633,6 +654,9 @@ static void* job_thread(void* arg)
       break;
   }
 
+  QueueBvfsCacheUpdate(jcr);
+  AddQuotaUsage(jcr);
+
   RunScripts(jcr, jcr->dir_impl->res.job->RunScripts, "AfterJob");
 
   // Send off any queued messages
@@ -708,6 +732,14 @@ bool CancelJob(UaContext* ua, JobControlRecord* jcr)
         }
       }
 
+      // Cancel the Storage daemon a backup is mirrored to.
+      if (jcr->dir_impl->mirror_jcr
+          && jcr->dir_impl->mirror_jcr->store_bsock) {
+        if (!CancelStorageDaemonJob(ua, jcr->dir_impl->mirror_jcr)) {
+          return false;
+        }
+      }
+
       break;
   }
 
@@ -1558,6 +1590,11 @@ void DirdFreeJcr(JobControlRecord* jcr)
     jcr->dir_impl->mig_jcr = NULL;
   }
 
+  if (jcr->dir_impl->mirror_jcr) {
+    FreeJcr(jcr->dir_impl->mirror_jcr);
+    jcr->dir_impl->mirror_jcr = NULL;
+  }
+
   DirdFreeJcrPointers(jcr);
 
   if (jcr->dir_impl->nextrun_ready_inited) {
@@ -1566,6 +1603,7 @@ void DirdFreeJcr(JobControlRecord* jcr)
   }
 
   if (jcr->db_batch) {
+    jcr->db_batch->CloseBatchPartitions(jcr);
     DbSqlClosePooledConnection(jcr, jcr->db_batch);
     jcr->db_batch = NULL;
     jcr->batch_started = false;
@@ -33,6 +33,7 @@ class UaContext;
 class JobResource;
 class UnifiedStorageResource;
 class RunResource;
+struct jobq_statistics;
 
 bool AllowDuplicateJob(JobControlRecord* jcr);
 void SetJcrDefaults(JobControlRecord* jcr, JobResource* job);
@@ -64,6 +65,7 @@ void SdMsgThreadSendSignal(JobControlRecord* jcr,
                            const std::unique_lock<std::mutex>& jcr_lock);
 void InitJobServer(int max_workers);
 void TermJobServer();
+jobq_statistics GetJobQueueStatistics();
 
 } /* namespace directordaemon */
 #endif  // BAREOS_DIRD_JOB_H_
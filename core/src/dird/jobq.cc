@@ -29,11 +29,18 @@
  * allocated and they can immediately be run, and the
  * running queue where jobs are placed when they are
  * running.
+ *
+ * The waiting jobs are kept in one list per priority.  A job that could
+ * not get a client, storage or job slot remembers which one it was and is
+ * only looked at again once a slot of that resource was given back (or
+ * when all waiting jobs are re-evaluated every full_rescan_interval
+ * seconds, which catches changed limits after a reload).
  */
 
 #include "include/bareos.h"
 #include "dird.h"
 #include "dird/director_jcr_impl.h"
+#include "dird/dird_globals.h"
 #include "dird/job.h"
 #include "dird/jobq.h"
 #include "dird/storage.h"
@@ -41,10 +48,24 @@
 #include "lib/thread_specific_data.h"
 #include "dird/jcr_util.h"
 
+#include <algorithm>
+#include <unordered_map>
+
 namespace directordaemon {
 
 static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 
+// how often slots are given back, per resource; protected by mutex
+static std::unordered_map<const void*, uint64_t> resource_releases;
+// broadcast whenever resource_releases changes
+static pthread_cond_t resource_released = PTHREAD_COND_INITIALIZER;
+
+// start rate of the whole director; protected by mutex
+static job_start_bucket director_start_bucket;
+
+static constexpr time_t full_rescan_interval = 30;
+static constexpr int wait_for_resources = 2; /* seconds */
+
 /* Forward referenced functions */
 extern "C" void* jobq_server(void* arg);
 extern "C" void* sched_wait(void* arg);
@@ -52,6 +73,8 @@ extern "C" void* sched_wait(void* arg);
 static int StartServer(jobq_t* jq);
 static bool AcquireResources(JobControlRecord* jcr);
 static bool RescheduleJob(JobControlRecord* jcr, jobq_t* jq, jobq_item_t* je);
+static bool ResourceReleasedSinceBlocked(JobControlRecord* jcr);
+static int StartRateAllows(JobControlRecord* jcr, bool take);
 static bool IncClientConcurrency(JobControlRecord* jcr);
 static void DecClientConcurrency(JobControlRecord* jcr);
 static bool IncJobConcurrency(JobControlRecord* jcr);
@@ -99,10 +122,16 @@ int JobqInit(jobq_t* jq, int max_workers, void* (*engine)(void* arg))
   jq->max_workers = max_workers; /* max threads to create */
   jq->num_workers = 0;           /* no threads yet */
   jq->engine = engine;           /* routine to run */
+  jq->num_waiting = 0;
+  jq->next_full_rescan = 0;
+  jq->num_started = 0;
+  jq->total_wait_time = 0;
+  jq->max_wait_time = 0;
+  jq->num_rate_limited = 0;
   jq->valid = JOBQ_VALID;
 
   // Initialize the job queues
-  jq->waiting_jobs = new dlist<jobq_item_t>();
+  jq->waiting_jobs = new std::map<int, dlist<jobq_item_t>>();
   jq->running_jobs = new dlist<jobq_item_t>();
   jq->ready_jobs = new dlist<jobq_item_t>();
 
@@ -126,6 +155,7 @@ int JobqDestroy(jobq_t* jq)
   // If any threads are active, wake them
   if (jq->num_workers > 0) {
     jq->quit = true;
+    pthread_cond_broadcast(&jq->work);
     while (jq->num_workers > 0) {
       if ((status = pthread_cond_wait(&jq->work, &jq->mutex)) != 0) {
         BErrNo be;
@@ -200,8 +230,7 @@ extern "C" void* sched_wait(void* arg)
 int JobqAdd(jobq_t* jq, JobControlRecord* jcr)
 {
   int status;
-  jobq_item_t *item, *li;
-  bool inserted = false;
+  jobq_item_t* item;
   time_t wtime = jcr->sched_time - time(NULL);
   pthread_t id;
   wait_pkt* sched_pkt;
@@ -236,6 +265,8 @@ int JobqAdd(jobq_t* jq, JobControlRecord* jcr)
     return ENOMEM;
   }
   item->jcr = jcr;
+  item->priority = jcr->JobPriority;
+  item->queued = time(NULL);
 
   // While waiting in a queue this job is not attached to a thread
   SetJcrInThreadSpecificData(nullptr);
@@ -244,28 +275,17 @@ int JobqAdd(jobq_t* jq, JobControlRecord* jcr)
     jq->ready_jobs->prepend(item);
     Dmsg1(2300, "Prepended job=%d to ready queue\n", jcr->JobId);
   } else {
-    // Add this job to the wait queue in priority sorted order
-    foreach_dlist (li, jq->waiting_jobs) {
-      Dmsg2(2300, "waiting item jobid=%d priority=%d\n", li->jcr->JobId,
-            li->jcr->JobPriority);
-      if (li->jcr->JobPriority > jcr->JobPriority) {
-        jq->waiting_jobs->InsertBefore(item, li);
-        Dmsg2(2300, "InsertBefore jobid=%d before waiting job=%d\n",
-              li->jcr->JobId, jcr->JobId);
-        inserted = true;
-        break;
-      }
-    }
-
-    // If not jobs in wait queue, append it
-    if (!inserted) {
-      jq->waiting_jobs->append(item);
-      Dmsg1(2300, "Appended item jobid=%d to waiting queue\n", jcr->JobId);
-    }
+    // Add this job to the wait queue of its priority
+    jcr->dir_impl->blocked_on = nullptr;
+    (*jq->waiting_jobs)[item->priority].append(item);
+    jq->num_waiting++;
+    Dmsg2(2300, "Appended item jobid=%d to waiting queue of priority %d\n",
+          jcr->JobId, item->priority);
   }
 
   // Ensure that at least one server looks at the queue.
   status = StartServer(jq);
+  pthread_cond_broadcast(&jq->work);
 
   unlock_mutex(jq->mutex);
   Dmsg0(2300, "Return JobqAdd\n");
@@ -289,11 +309,15 @@ int JobqRemove(jobq_t* jq, JobControlRecord* jcr)
   if (jq->valid != JOBQ_VALID) { return EINVAL; }
 
   lock_mutex(jq->mutex);
-  foreach_dlist (item, jq->waiting_jobs) {
-    if (jcr == item->jcr) {
-      found = true;
-      break;
+  auto bucket = jq->waiting_jobs->begin();
+  for (; bucket != jq->waiting_jobs->end(); ++bucket) {
+    foreach_dlist (item, &bucket->second) {
+      if (jcr == item->jcr) {
+        found = true;
+        break;
+      }
     }
+    if (found) { break; }
   }
   if (!found) {
     unlock_mutex(jq->mutex);
@@ -303,12 +327,15 @@ int JobqRemove(jobq_t* jq, JobControlRecord* jcr)
   }
 
   // Move item to be the first on the list
-  jq->waiting_jobs->remove(item);
+  bucket->second.remove(item);
+  if (bucket->second.empty()) { jq->waiting_jobs->erase(bucket); }
+  jq->num_waiting--;
   jq->ready_jobs->prepend(item);
   Dmsg2(2300, "JobqRemove jobid=%d jcr=0x%x moved to ready queue\n", jcr->JobId,
         jcr);
 
   status = StartServer(jq);
+  pthread_cond_broadcast(&jq->work);
 
   unlock_mutex(jq->mutex);
   Dmsg0(2300, "Return JobqRemove\n");
@@ -452,7 +479,7 @@ extern "C" void* jobq_server(void* arg)
     if (!jq->waiting_jobs->empty() && !jq->quit) {
       int Priority;
       bool running_allow_mix = false;
-      je = (jobq_item_t*)jq->waiting_jobs->first();
+      je = jq->waiting_jobs->begin()->second.first();
       jobq_item_t* re = (jobq_item_t*)jq->running_jobs->first();
       if (re) {
         Priority = re->jcr->JobPriority;
@@ -476,43 +503,88 @@ extern "C" void* jobq_server(void* arg)
         Dmsg1(2300, "No job running. Look for Job pri=%d\n", Priority);
       }
 
-      /* Walk down the list of waiting jobs and attempt to acquire the resources
-       * it needs. */
-      for (; je;) {
-        // je is current job item on the queue, jn is the next one
-        JobControlRecord* jcr = je->jcr;
-        jobq_item_t* jn = (jobq_item_t*)jq->waiting_jobs->next(je);
-
-        Dmsg4(2300, "Examining Job=%d JobPri=%d want Pri=%d (%s)\n", jcr->JobId,
-              jcr->JobPriority, Priority,
-              jcr->allow_mixed_priority ? "mix" : "no mix");
-
-        // Take only jobs of correct Priority
-        if (!(jcr->JobPriority == Priority
-              || (jcr->JobPriority < Priority && jcr->allow_mixed_priority
-                  && running_allow_mix))) {
-          jcr->setJobStatusWithPriorityCheck(JS_WaitPriority);
-          break;
-        }
+      time_t now = time(NULL);
+      bool full_rescan = now >= jq->next_full_rescan;
+      if (full_rescan) { jq->next_full_rescan = now + full_rescan_interval; }
+
+      /* Walk down the lists of waiting jobs and attempt to acquire the
+       * resources they need.  As the lists are sorted by priority, the jobs
+       * with the highest one get the start rate tokens first. */
+      bool wrong_priority = false;
+      int rate_limited = 0;
+      for (auto bucket = jq->waiting_jobs->begin();
+           bucket != jq->waiting_jobs->end() && !wrong_priority;) {
+        dlist<jobq_item_t>& waiting = bucket->second;
+        for (je = waiting.first(); je;) {
+          // je is current job item on the queue, jn is the next one
+          JobControlRecord* jcr = je->jcr;
+          jobq_item_t* jn = waiting.next(je);
+
+          Dmsg4(2300, "Examining Job=%d JobPri=%d want Pri=%d (%s)\n",
+                jcr->JobId, jcr->JobPriority, Priority,
+                jcr->allow_mixed_priority ? "mix" : "no mix");
+
+          // Take only jobs of correct Priority
+          if (!(jcr->JobPriority == Priority
+                || (jcr->JobPriority < Priority && jcr->allow_mixed_priority
+                    && running_allow_mix))) {
+            jcr->setJobStatusWithPriorityCheck(JS_WaitPriority);
+            wrong_priority = true;
+            break;
+          }
 
-        if (!AcquireResources(jcr)) {
-          // If resource conflict, job is canceled
-          if (!jcr->IsJobCanceled()) {
-            je = jn; /* point to next waiting job */
+          // Nothing changed for the resource this job is waiting for
+          if (!full_rescan && !jcr->IsJobCanceled()
+              && !ResourceReleasedSinceBlocked(jcr)) {
+            je = jn;
             continue;
           }
-        }
 
-        /* Got all locks, now remove it from wait queue and append it
-         * to the ready queue.  Note, we may also get here if the
-         * job was canceled.  Once it is "run", it will quickly Terminate. */
-        jq->waiting_jobs->remove(je);
-        jq->ready_jobs->append(je);
-        Dmsg1(2300, "moved JobId=%d from wait to ready queue\n",
-              je->jcr->JobId);
-        je = jn; /* Point to next waiting job */
-      }          /* end for loop */
-    }            /* end if */
+          if (!jcr->IsJobCanceled()) {
+            if (int wait = StartRateAllows(jcr, false); wait != 0) {
+              jcr->setJobStatusWithPriorityCheck(wait);
+              jcr->dir_impl->blocked_on = nullptr; /* retry next time */
+              rate_limited++;
+              je = jn;
+              continue;
+            }
+          }
+
+          if (!AcquireResources(jcr)) {
+            // If resource conflict, job is canceled
+            if (!jcr->IsJobCanceled()) {
+              je = jn; /* point to next waiting job */
+              continue;
+            }
+          } else if (!jcr->IsJobCanceled()) {
+            StartRateAllows(jcr, true);
+          }
+
+          /* Got all locks, now remove it from wait queue and append it
+           * to the ready queue.  Note, we may also get here if the
+           * job was canceled.  Once it is "run", it will quickly Terminate. */
+          waiting.remove(je);
+          jq->num_waiting--;
+          jq->ready_jobs->append(je);
+          if (!jcr->IsJobCanceled()) {
+            utime_t waited = now > je->queued ? now - je->queued : 0;
+            jq->num_started++;
+            jq->total_wait_time += waited;
+            if (waited > jq->max_wait_time) { jq->max_wait_time = waited; }
+          }
+          Dmsg1(2300, "moved JobId=%d from wait to ready queue\n",
+                je->jcr->JobId);
+          je = jn; /* Point to next waiting job */
+        }          /* end for loop */
+
+        if (waiting.empty()) {
+          bucket = jq->waiting_jobs->erase(bucket);
+        } else {
+          ++bucket;
+        }
+      }
+      jq->num_rate_limited = rate_limited;
+    } /* end if */
 
     Dmsg0(2300, "Done checking wait queue.\n");
 
@@ -541,16 +613,18 @@ extern "C" void* jobq_server(void* arg)
     }
 
     work = !jq->ready_jobs->empty() || !jq->waiting_jobs->empty();
-    if (work) {
+    if (work && jq->ready_jobs->empty()) {
       /* If a job is waiting on a Resource, don't consume all
        * the CPU time looping looking for work, and even more
        * important, release the lock so that a job that has
-       * terminated can give us the resource. */
-      unlock_mutex(jq->mutex);
-      Bmicrosleep(2, 0); /* pause for 2 seconds */
-      lock_mutex(jq->mutex);
+       * terminated can give us the resource.  New jobs and
+       * finished ones wake us up earlier. */
+      gettimeofday(&tv, NULL);
+      timeout.tv_nsec = tv.tv_usec * 1000;
+      timeout.tv_sec = tv.tv_sec + wait_for_resources;
+      pthread_cond_timedwait(&jq->work, &jq->mutex, &timeout);
 
-      // Recompute work as something may have changed in last 2 secs
+      // Recompute work as something may have changed in the meantime
       work = !jq->ready_jobs->empty() || !jq->waiting_jobs->empty();
     }
     Dmsg1(2300, "Loop again. work=%d\n", work);
@@ -688,6 +762,7 @@ static bool AcquireResources(JobControlRecord* jcr)
 {
   // Set that we didn't acquire any resourse locks yet.
   jcr->dir_impl->acquired_resource_locks = false;
+  jcr->dir_impl->blocked_on = nullptr;
 
   /* Some Job Types are excluded from the client and storage concurrency
    * as they have no interaction with the client or storage at all. */
@@ -755,6 +830,96 @@ static bool AcquireResources(JobControlRecord* jcr)
   return true;
 }
 
+// Remember the resource without a free slot; called with mutex held
+static void NoteBlocked(JobControlRecord* jcr, const void* resource)
+{
+  jcr->dir_impl->blocked_on = resource;
+  jcr->dir_impl->blocked_release = resource_releases[resource];
+}
+
+// A slot of resource was given back; called with mutex held
+static void NoteRelease(const void* resource)
+{
+  resource_releases[resource]++;
+  pthread_cond_broadcast(&resource_released);
+}
+
+// Returns true if it makes sense to try to acquire the resources again
+static bool ResourceReleasedSinceBlocked(JobControlRecord* jcr)
+{
+  if (!jcr->dir_impl->blocked_on) { return true; }
+
+  lock_mutex(mutex);
+  auto found = resource_releases.find(jcr->dir_impl->blocked_on);
+  bool released = found == resource_releases.end()
+                  || found->second != jcr->dir_impl->blocked_release;
+  unlock_mutex(mutex);
+
+  return released;
+}
+
+/* Refills bucket for rate jobs per minute, at most a sixth of it piles up
+ * while no job starts.  Called with mutex held. */
+static bool StartTokenAvailable(job_start_bucket& bucket,
+                                uint32_t rate,
+                                time_t now)
+{
+  if (rate == 0) { return true; }
+
+  const double burst = std::max(1.0, rate / 6.0);
+  if (bucket.updated == 0) {
+    bucket.tokens = burst;
+  } else if (now > bucket.updated) {
+    bucket.tokens
+        = std::min(burst, bucket.tokens + (now - bucket.updated) * rate / 60.0);
+  }
+  bucket.updated = now;
+
+  return bucket.tokens >= 1.0;
+}
+
+/* Returns 0 if the start rates of the director and of the storages of the job
+ * let it start now, otherwise the status to wait with.  With take set, the
+ * job uses up its tokens. */
+static int StartRateAllows(JobControlRecord* jcr, bool take)
+{
+  StorageResource* stores[2] = {};
+  if (!jcr->dir_impl->IgnoreStorageConcurrency) {
+    stores[0] = jcr->dir_impl->res.read_storage;
+    stores[1] = jcr->dir_impl->res.write_storage;
+    if (stores[0] == stores[1]) { stores[1] = nullptr; }
+  }
+  time_t now = time(NULL);
+  int status = 0;
+
+  lock_mutex(mutex);
+  if (!StartTokenAvailable(director_start_bucket, me->MaxJobStartRate, now)) {
+    status = JS_WaitStartTime;
+  }
+  for (StorageResource* store : stores) {
+    if (status == 0 && store
+        && !StartTokenAvailable(store->runtime_storage_status->start_bucket,
+                                store->MaxJobStartRate, now)) {
+      status = JS_WaitStoreRes;
+    }
+  }
+  if (status == 0 && take) {
+    if (me->MaxJobStartRate) { director_start_bucket.tokens -= 1.0; }
+    for (StorageResource* store : stores) {
+      if (store && store->MaxJobStartRate) {
+        store->runtime_storage_status->start_bucket.tokens -= 1.0;
+      }
+    }
+  }
+  unlock_mutex(mutex);
+
+  if (status != 0) {
+    Dmsg1(200, "Start rate holds back JobId=%d\n", jcr->JobId);
+  }
+
+  return status;
+}
+
 static bool IncClientConcurrency(JobControlRecord* jcr)
 {
   if (!jcr->dir_impl->res.client || jcr->dir_impl->IgnoreClientConcurrency) {
@@ -773,6 +938,7 @@ static bool IncClientConcurrency(JobControlRecord* jcr)
     return true;
   }
 
+  NoteBlocked(jcr, jcr->dir_impl->res.client->rcs.get());
   unlock_mutex(mutex);
 
   return false;
@@ -785,6 +951,7 @@ static void DecClientConcurrency(JobControlRecord* jcr)
   lock_mutex(mutex);
   if (jcr->dir_impl->res.client) {
     jcr->dir_impl->res.client->rcs->NumConcurrentJobs--;
+    NoteRelease(jcr->dir_impl->res.client->rcs.get());
     Dmsg2(50, "Dec Client=%s rncj=%d\n",
           jcr->dir_impl->res.client->resource_name_,
           jcr->dir_impl->res.client->rcs->NumConcurrentJobs);
@@ -805,6 +972,7 @@ static bool IncJobConcurrency(JobControlRecord* jcr)
     return true;
   }
 
+  NoteBlocked(jcr, jcr->dir_impl->res.rjs.get());
   unlock_mutex(mutex);
 
   return false;
@@ -814,11 +982,37 @@ static void DecJobConcurrency(JobControlRecord* jcr)
 {
   lock_mutex(mutex);
   jcr->dir_impl->res.rjs->NumConcurrentJobs--;
+  NoteRelease(jcr->dir_impl->res.rjs.get());
   Dmsg2(50, "Dec Job=%s rncj=%d\n", jcr->dir_impl->res.job->resource_name_,
         jcr->dir_impl->res.rjs->NumConcurrentJobs);
   unlock_mutex(mutex);
 }
 
+/**
+ * Wait up to max_wait seconds for the resource the job could not get the
+ * last time (see NoteBlocked()) to give back a slot.
+ */
+void WaitForResourceRelease(JobControlRecord* jcr, int max_wait)
+{
+  struct timeval tv;
+  struct timespec timeout;
+
+  gettimeofday(&tv, NULL);
+  timeout.tv_nsec = tv.tv_usec * 1000;
+  timeout.tv_sec = tv.tv_sec + max_wait;
+
+  lock_mutex(mutex);
+  while (jcr->dir_impl->blocked_on
+         && resource_releases[jcr->dir_impl->blocked_on]
+                == jcr->dir_impl->blocked_release) {
+    if (pthread_cond_timedwait(&resource_released, &mutex, &timeout)
+        == ETIMEDOUT) {
+      break;
+    }
+  }
+  unlock_mutex(mutex);
+}
+
 /**
  * Note: IncReadStore() and DecReadStore() are
  * called from SelectNextRstore() in src/dird/job.c
@@ -842,6 +1036,8 @@ bool IncReadStore(JobControlRecord* jcr)
 
     return true;
   }
+  NoteBlocked(jcr,
+              jcr->dir_impl->res.read_storage->runtime_storage_status.get());
   unlock_mutex(mutex);
 
   Dmsg2(50, "Fail to acquire Rstore=%s rncj=%d\n",
@@ -861,6 +1057,7 @@ void DecReadStore(JobControlRecord* jcr)
         ->NumConcurrentReadJobs--;
     jcr->dir_impl->res.read_storage->runtime_storage_status
         ->NumConcurrentJobs--;
+    NoteRelease(jcr->dir_impl->res.read_storage->runtime_storage_status.get());
     Dmsg2(50, "Dec Rstore=%s rncj=%d\n",
           jcr->dir_impl->res.read_storage->resource_name_,
           jcr->dir_impl->res.read_storage->runtime_storage_status
@@ -905,6 +1102,8 @@ static bool IncWriteStore(JobControlRecord* jcr)
 
     return true;
   }
+  NoteBlocked(jcr,
+              jcr->dir_impl->res.write_storage->runtime_storage_status.get());
   unlock_mutex(mutex);
 
   Dmsg2(50, "Fail to acquire Wstore=%s wncj=%d\n",
@@ -922,6 +1121,7 @@ static void DecWriteStore(JobControlRecord* jcr)
     lock_mutex(mutex);
     jcr->dir_impl->res.write_storage->runtime_storage_status
         ->NumConcurrentJobs--;
+    NoteRelease(jcr->dir_impl->res.write_storage->runtime_storage_status.get());
     Dmsg2(50, "Dec Wstore=%s wncj=%d\n",
           jcr->dir_impl->res.write_storage->resource_name_,
           jcr->dir_impl->res.write_storage->runtime_storage_status
@@ -938,4 +1138,23 @@ static void DecWriteStore(JobControlRecord* jcr)
     unlock_mutex(mutex);
   }
 }
+
+jobq_statistics JobqGetStatistics(jobq_t* jq)
+{
+  jobq_statistics stats{};
+
+  if (jq->valid != JOBQ_VALID) { return stats; }
+
+  lock_mutex(jq->mutex);
+  stats.waiting = jq->num_waiting;
+  stats.ready = jq->ready_jobs->size();
+  stats.running = jq->running_jobs->size();
+  stats.started = jq->num_started;
+  stats.total_wait_time = jq->total_wait_time;
+  stats.max_wait_time = jq->max_wait_time;
+  stats.rate_limited = jq->num_rate_limited;
+  unlock_mutex(jq->mutex);
+
+  return stats;
+}
 } /* namespace directordaemon */
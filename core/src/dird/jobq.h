@@ -2,7 +2,7 @@
    BAREOS® - Backup Archiving REcovery Open Sourced
 
    Copyright (C) 2000-2006 Free Software Foundation Europe e.V.
-   Copyright (C) 2016-2021 Bareos GmbH & Co. KG
+   Copyright (C) 2016-2024 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -34,9 +34,10 @@
 #define BAREOS_DIRD_JOBQ_H_
 
 #include "lib/dlink.h"
+#include "lib/dlist.h"
 #include "include/jcr.h"
 
-template <typename T> class dlist;
+#include <map>
 
 namespace directordaemon {
 
@@ -44,6 +45,8 @@ namespace directordaemon {
 struct jobq_item_t {
   dlink<jobq_item_t> link;
   JobControlRecord* jcr;
+  int priority;  /* priority the job was queued with */
+  time_t queued; /* time the job was put into the wait queue */
 };
 
 // Structure describing a work queue
@@ -51,16 +54,32 @@ struct jobq_t {
   pthread_mutex_t mutex;            /* queue access control */
   pthread_cond_t work;              /* wait for work */
   pthread_attr_t attr;              /* create detached threads */
-  dlist<jobq_item_t>* waiting_jobs; /* list of jobs waiting */
+  std::map<int, dlist<jobq_item_t>>* waiting_jobs; /* waiting, per priority */
   dlist<jobq_item_t>* running_jobs; /* jobs running */
   dlist<jobq_item_t>* ready_jobs;   /* jobs ready to run */
   int valid;                        /* queue initialized */
   bool quit;                        /* jobq should quit */
   int max_workers;                  /* max threads */
   int num_workers;                  /* current threads */
+  int num_waiting;                  /* jobs in waiting_jobs */
+  time_t next_full_rescan;          /* re-evaluate all waiting jobs then */
+  uint64_t num_started;             /* jobs moved from waiting to ready */
+  utime_t total_wait_time;          /* time those jobs spent waiting */
+  utime_t max_wait_time;            /* longest time one of them waited */
+  int num_rate_limited;             /* held back by a start rate last time */
   void* (*engine)(void* arg);       /* user engine */
 };
 
+struct jobq_statistics {
+  int waiting;
+  int ready;
+  int running;
+  uint64_t started;
+  utime_t total_wait_time;
+  utime_t max_wait_time;
+  int rate_limited;
+};
+
 #define JOBQ_VALID 0xdec1993
 
 extern int JobqInit(jobq_t* wq,
@@ -70,9 +89,11 @@ extern int JobqInit(jobq_t* wq,
 extern int JobqDestroy(jobq_t* wq);
 extern int JobqAdd(jobq_t* wq, JobControlRecord* jcr);
 extern int JobqRemove(jobq_t* wq, JobControlRecord* jcr);
+extern jobq_statistics JobqGetStatistics(jobq_t* wq);
 
 bool IncReadStore(JobControlRecord* jcr);
 void DecReadStore(JobControlRecord* jcr);
+void WaitForResourceRelease(JobControlRecord* jcr, int max_wait);
 
 } /* namespace directordaemon */
 #endif  // BAREOS_DIRD_JOBQ_H_
@@ -62,6 +62,12 @@
 
 #include "cats/sql.h"
 
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
 #ifndef HAVE_REGEX_H
 #  include "lib/bregex.h"
 #else
@@ -74,43 +80,32 @@ namespace directordaemon {
 static char replicatecmd[]
     = "replicate JobId=%d Job=%s address=%s port=%d ssl=%d Authorization=%s\n";
 
-// Get Job names in Pool
-static const char* sql_job
-    = "SELECT DISTINCT Job.Name from Job,Pool"
-      " WHERE Pool.Name='%s' AND Job.PoolId=Pool.PoolId";
+/* The selection patterns are matched by the catalog (with ~ of PostgreSQL),
+ * so every regex selection needs just a single query. */
 
-// Get JobIds from regex'ed Job names
+// Get JobIds from Jobs in Pool with matching Job names
 static const char* sql_jobids_from_job
     = "SELECT DISTINCT Job.JobId,Job.StartTime FROM Job,Pool"
-      " WHERE Job.Name='%s' AND Pool.Name='%s' AND Job.PoolId=Pool.PoolId"
+      " WHERE Pool.Name='%s' AND Job.PoolId=Pool.PoolId"
+      " AND Job.Name ~ '%s'"
       " ORDER by Job.StartTime";
 
-// Get Client names in Pool
-static const char* sql_client
-    = "SELECT DISTINCT Client.Name from Client,Pool,Job"
-      " WHERE Pool.Name='%s' AND Job.ClientId=Client.ClientId AND"
-      " Job.PoolId=Pool.PoolId";
-
-// Get JobIds from regex'ed Client names
+// Get JobIds from Jobs in Pool with matching Client names
 static const char* sql_jobids_from_client
     = "SELECT DISTINCT Job.JobId,Job.StartTime FROM Job,Pool,Client"
-      " WHERE Client.Name='%s' AND Pool.Name='%s' AND Job.PoolId=Pool.PoolId"
-      " AND Job.ClientId=Client.ClientId AND Job.Type IN ('B','C')"
-      " AND Job.JobStatus IN ('T','W')"
+      " WHERE Pool.Name='%s' AND Job.PoolId=Pool.PoolId"
+      " AND Job.ClientId=Client.ClientId AND Client.Name ~ '%s'"
+      " AND Job.Type IN ('B','C') AND Job.JobStatus IN ('T','W')"
       " ORDER by Job.StartTime";
 
-// Get Volume names in Pool
-static const char* sql_vol
-    = "SELECT DISTINCT VolumeName FROM Media,Pool WHERE"
-      " VolStatus in ('Full','Used','Error') AND Media.Enabled=1 AND"
-      " Media.PoolId=Pool.PoolId AND Pool.Name='%s'";
-
-// Get JobIds from regex'ed Volume names
+// Get JobIds from Volumes in Pool with matching Volume names
 static const char* sql_jobids_from_vol
-    = "SELECT DISTINCT Job.JobId,Job.StartTime FROM Media,JobMedia,Job"
-      " WHERE Media.VolumeName='%s' AND Media.MediaId=JobMedia.MediaId"
+    = "SELECT DISTINCT Job.JobId,Job.StartTime FROM Media,Pool,JobMedia,Job"
+      " WHERE Pool.Name='%s' AND Media.PoolId=Pool.PoolId"
+      " AND Media.VolStatus in ('Full','Used','Error') AND Media.Enabled=1"
+      " AND Media.VolumeName ~ '%s' AND Media.MediaId=JobMedia.MediaId"
       " AND JobMedia.JobId=Job.JobId AND Job.Type IN ('B','C')"
-      " AND Job.JobStatus IN ('T','W') AND Media.Enabled=1"
+      " AND Job.JobStatus IN ('T','W')"
       " ORDER by Job.StartTime";
 
 // Get JobIds from the smallest volume
@@ -200,6 +195,11 @@ static const char* sql_copy_ndmp_metadata
       "FROM File "
       "WHERE JobId=%s)";
 
+// Get the first and the number of volumes of each Job
+static const char* sql_job_volumes
+    = "SELECT JobId,MIN(MediaId),COUNT(DISTINCT MediaId) FROM JobMedia"
+      " WHERE JobId IN (%s) GROUP BY JobId";
+
 static const int dbglevel = 10;
 
 struct idpkt {
@@ -207,6 +207,17 @@ struct idpkt {
   uint32_t count;
 };
 
+struct read_group_hint {
+  std::string name{};
+  uint32_t size{};
+};
+
+/* Read groups of the copies being started, by the JobId they copy.  The
+ * control job fills them in just before it starts a copy and
+ * DoMigrationInit() of the copy takes them. */
+static std::mutex read_group_mutex;
+static std::map<JobId_t, read_group_hint> read_group_hints;
+
 bool SetMigrationWstorage(JobControlRecord* jcr,
                           PoolResource* pool,
                           PoolResource* next_pool,
@@ -463,38 +474,104 @@ static int UniqueDbidHandler(void* ctx, int, char** row)
   return 0;
 }
 
-struct uitem {
-  dlink<uitem> link;
-  char* item;
+struct job_volumes {
+  DBId_t MediaId{};
+  int64_t count{};
 };
 
-static int ItemCompare(uitem* item1, uitem* item2)
+static int JobVolumesHandler(void* ctx, int num_fields, char** row)
 {
-  uitem* i1 = item1;
-  uitem* i2 = item2;
+  auto* volumes = static_cast<std::map<JobId_t, job_volumes>*>(ctx);
 
-  return strcmp(i1->item, i2->item);
+  if (num_fields < 3 || !row[0] || !row[1] || !row[2]) { return 0; }
+  (*volumes)[str_to_int64(row[0])]
+      = job_volumes{static_cast<DBId_t>(str_to_int64(row[1])),
+                    str_to_int64(row[2])};
+  return 0;
 }
 
-static int UniqueNameHandler(void* ctx, int, char** row)
+/**
+ * Orders the selected JobIds so that the jobs whose data is all on the same
+ * single volume get started one after the other, and works out which of the
+ * ones that get started (at most limit when it is not negative) can read that
+ * volume together.
+ */
+static std::map<JobId_t, read_group_hint> GroupJobsByVolume(
+    JobControlRecord* jcr,
+    idpkt* ids,
+    int limit)
 {
-  dlist<uitem>* list = (dlist<uitem>*)ctx;
+  std::map<JobId_t, read_group_hint> hints;
+  std::vector<JobId_t> jobids;
+  const char* p = ids->list;
+  JobId_t JobId;
+  while (GetNextJobidFromList(&p, &JobId) > 0) { jobids.push_back(JobId); }
+
+  std::map<JobId_t, job_volumes> volumes;
+  PoolMem query(PM_MESSAGE);
+  Mmsg(query, sql_job_volumes, ids->list);
+  if (DbLocker _{jcr->db};
+      !jcr->db->SqlQuery(query.c_str(), JobVolumesHandler, &volumes)) {
+    Jmsg(jcr, M_WARNING, 0, T_("Cannot get the volumes of the jobs. ERR=%s\n"),
+         jcr->db->strerror());
+    return hints;
+  }
+
+  std::map<DBId_t, std::vector<JobId_t>> by_volume;
+  for (JobId_t id : jobids) {
+    if (auto found = volumes.find(id);
+        found != volumes.end() && found->second.count == 1) {
+      by_volume[found->second.MediaId].push_back(id);
+    }
+  }
 
-  uitem* new_item = (uitem*)malloc(sizeof(uitem));
-  new (new_item) uitem();
+  // the first job of a volume brings along the others on it
+  std::vector<JobId_t> ordered;
+  for (JobId_t id : jobids) {
+    auto found = volumes.find(id);
+    if (found == volumes.end() || found->second.count != 1) {
+      ordered.push_back(id);
+      continue;
+    }
+    std::vector<JobId_t>& same_volume = by_volume[found->second.MediaId];
+    ordered.insert(ordered.end(), same_volume.begin(), same_volume.end());
+    same_volume.clear();
+  }
 
-  uitem* item;
-  new_item->item = strdup(row[0]);
-  Dmsg1(dbglevel, "Unique_name_hdlr Item=%s\n", row[0]);
+  if (limit >= 0 && ordered.size() > static_cast<std::size_t>(limit)) {
+    ordered.resize(limit);
+  }
+  std::map<DBId_t, std::vector<JobId_t>> started;
+  for (JobId_t id : ordered) {
+    if (auto found = volumes.find(id);
+        found != volumes.end() && found->second.count == 1) {
+      started[found->second.MediaId].push_back(id);
+    }
+  }
+  for (auto& [MediaId, group] : started) {
+    if (group.size() < 2) { continue; }
+    std::string name
+        = std::to_string(jcr->JobId) + "-" + std::to_string(MediaId);
+    for (JobId_t id : group) {
+      hints[id] = read_group_hint{name, static_cast<uint32_t>(group.size())};
+    }
+    Jmsg(jcr, M_INFO, 0, T_("%d jobs will read MediaId %u only once.\n"),
+         static_cast<int>(group.size()), MediaId);
+  }
 
-  item = list->binary_insert(new_item, ItemCompare);
-  if (item != new_item) { /* already in list */
-    free(new_item->item);
-    free((char*)new_item);
-    return 0;
+  // the jobs after the limit keep their place at the end of the list
+  std::set<JobId_t> in_order(ordered.begin(), ordered.end());
+  for (JobId_t id : jobids) {
+    if (in_order.insert(id).second) { ordered.push_back(id); }
+  }
+  char ed1[50];
+  ids->list[0] = 0;
+  for (std::size_t i = 0; i < ordered.size(); ++i) {
+    if (i > 0) { PmStrcat(ids->list, ","); }
+    PmStrcat(ids->list, edit_uint64(ordered[i], ed1));
   }
 
-  return 0;
+  return hints;
 }
 
 /**
@@ -591,99 +668,48 @@ static inline bool FindJobidsOfPoolUncopiedJobs(JobControlRecord* jcr,
 
 static bool regex_find_jobids(JobControlRecord* jcr,
                               idpkt* ids,
-                              const char* query1,
-                              const char* query2,
+                              const char* query_template,
                               const char* type)
 {
-  dlist<uitem>* item_chain;
-  uitem* item = NULL;
-  uitem* last_item = NULL;
+  const char* pattern = jcr->dir_impl->res.job->selection_pattern;
   regex_t preg{};
   char prbuf[500];
   int rc;
-  bool ok = false;
   PoolMem query(PM_MESSAGE);
 
-  item_chain = new dlist<uitem>();
-  if (!jcr->dir_impl->res.job->selection_pattern) {
+  if (!pattern) {
     Jmsg(jcr, M_FATAL, 0, T_("No %s %s selection pattern specified.\n"),
          jcr->get_OperationName(), type);
-    goto bail_out;
-  }
-  Dmsg1(dbglevel, "regex-sel-pattern=%s\n",
-        jcr->dir_impl->res.job->selection_pattern);
-
-  // Basic query for names
-  Mmsg(query, query1, jcr->dir_impl->res.rpool->resource_name_);
-  Dmsg1(dbglevel, "get name query1=%s\n", query.c_str());
-  if (DbLocker _{jcr->db};
-      !jcr->db->SqlQuery(query.c_str(), UniqueNameHandler, (void*)item_chain)) {
-    Jmsg(jcr, M_FATAL, 0, T_("SQL to get %s failed. ERR=%s\n"), type,
-         jcr->db->strerror());
-    goto bail_out;
-  }
-  Dmsg1(dbglevel, "query1 returned %d names\n", item_chain->size());
-  if (item_chain->size() == 0) {
-    Jmsg(jcr, M_INFO, 0, T_("Query of Pool \"%s\" returned no Jobs to %s.\n"),
-         jcr->dir_impl->res.rpool->resource_name_, jcr->get_ActionName());
-    ok = true;
-    goto bail_out; /* skip regex match */
-  } else {
-    // Compile regex expression
-    rc = regcomp(&preg, jcr->dir_impl->res.job->selection_pattern,
-                 REG_EXTENDED);
-    if (rc != 0) {
-      regerror(rc, &preg, prbuf, sizeof(prbuf));
-      Jmsg(jcr, M_FATAL, 0,
-           T_("Could not compile regex pattern \"%s\" ERR=%s\n"),
-           jcr->dir_impl->res.job->selection_pattern, prbuf);
-      goto bail_out;
-    }
-
-    // Now apply the regex to the names and remove any item not matched
-    foreach_dlist (item, item_chain) {
-      if (last_item) {
-        Dmsg1(dbglevel, "Remove item %s\n", last_item->item);
-        free(last_item->item);
-        item_chain->remove(last_item);
-      }
-      Dmsg1(dbglevel, "get name Item=%s\n", item->item);
-      rc = regexec(&preg, item->item, 0, NULL, 0);
-      if (rc == 0) {
-        last_item = NULL; /* keep this one */
-      } else {
-        last_item = item;
-      }
-    }
-
-    if (last_item) {
-      free(last_item->item);
-      Dmsg1(dbglevel, "Remove item %s\n", last_item->item);
-      item_chain->remove(last_item);
-    }
-
-    regfree(&preg);
+    return false;
   }
+  Dmsg1(dbglevel, "regex-sel-pattern=%s\n", pattern);
 
-  if (item_chain->size() == 0) {
-    Jmsg(jcr, M_INFO, 0, T_("Regex pattern matched no Jobs to %s.\n"),
-         jcr->get_ActionName());
-    ok = true;
-    goto bail_out; /* skip regex match */
+  /* The catalog does the matching, compiling the pattern here only reports
+   * invalid ones the way it always did. */
+  rc = regcomp(&preg, pattern, REG_EXTENDED | REG_NOSUB);
+  if (rc != 0) {
+    regerror(rc, &preg, prbuf, sizeof(prbuf));
+    Jmsg(jcr, M_FATAL, 0,
+         T_("Could not compile regex pattern \"%s\" ERR=%s\n"), pattern,
+         prbuf);
+    return false;
   }
+  regfree(&preg);
 
-  /* At this point, we have a list of items in item_chain
-   * that have been matched by the regex, so now we need
-   * to look up their jobids. */
+  std::size_t len = strlen(pattern);
+  PoolMem esc_pattern(PM_NAME);
+  esc_pattern.check_size(len * 2 + 1);
   ids->count = 0;
-  foreach_dlist (item, item_chain) {
-    Dmsg2(dbglevel, "Got %s: %s\n", type, item->item);
-    Mmsg(query, query2, item->item, jcr->dir_impl->res.rpool->resource_name_);
-    Dmsg1(dbglevel, "get id from name query2=%s\n", query.c_str());
-    if (DbLocker _{jcr->db};
-        !jcr->db->SqlQuery(query.c_str(), UniqueDbidHandler, (void*)ids)) {
-      Jmsg(jcr, M_FATAL, 0, T_("SQL failed. ERR=%s\n"), jcr->db->strerror());
-      goto bail_out;
+  {
+    DbLocker _{jcr->db};
+    jcr->db->EscapeString(jcr, esc_pattern.c_str(), pattern, len);
+    Mmsg(query, query_template, jcr->dir_impl->res.rpool->resource_name_,
+         esc_pattern.c_str());
+    Dmsg1(dbglevel, "get ids by %s query=%s\n", type, query.c_str());
+    if (!jcr->db->SqlQuery(query.c_str(), UniqueDbidHandler, (void*)ids)) {
+      Jmsg(jcr, M_FATAL, 0, T_("SQL to get %s failed. ERR=%s\n"), type,
+           jcr->db->strerror());
+      return false;
     }
   }
 
@@ -692,13 +718,8 @@ static bool regex_find_jobids(JobControlRecord* jcr,
          jcr->get_ActionName());
   }
 
-  ok = true;
-
-bail_out:
   Dmsg2(dbglevel, "Count=%d Jobids=%s\n", ids->count, ids->list);
-  foreach_dlist (item, item_chain) { free(item->item); }
-  delete item_chain;
-  return ok;
+  return true;
 }
 
 /**
@@ -725,6 +746,7 @@ static inline bool getJobs_to_migrate(JobControlRecord* jcr)
   idpkt ids, mid, jids;
   char ed1[30], ed2[30];
   PoolMem query(PM_MESSAGE);
+  std::map<JobId_t, read_group_hint> hints;
 
   ids.list = GetPoolMemory(PM_MESSAGE);
   ids.list[0] = 0;
@@ -734,19 +756,17 @@ static inline bool getJobs_to_migrate(JobControlRecord* jcr)
 
   switch (jcr->dir_impl->res.job->selection_type) {
     case MT_JOB:
-      if (!regex_find_jobids(jcr, &ids, sql_job, sql_jobids_from_job, "Job")) {
+      if (!regex_find_jobids(jcr, &ids, sql_jobids_from_job, "Job")) {
         goto bail_out;
       }
       break;
     case MT_CLIENT:
-      if (!regex_find_jobids(jcr, &ids, sql_client, sql_jobids_from_client,
-                             "Client")) {
+      if (!regex_find_jobids(jcr, &ids, sql_jobids_from_client, "Client")) {
         goto bail_out;
       }
       break;
     case MT_VOLUME:
-      if (!regex_find_jobids(jcr, &ids, sql_vol, sql_jobids_from_vol,
-                             "Volume")) {
+      if (!regex_find_jobids(jcr, &ids, sql_jobids_from_vol, "Volume")) {
         goto bail_out;
       }
       break;
@@ -930,18 +950,22 @@ static inline bool getJobs_to_migrate(JobControlRecord* jcr)
     goto bail_out;
   }
 
-  Jmsg(jcr, M_INFO, 0, T_("The following %u JobId%s chosen to be %s: %s\n"),
-       ids.count, (ids.count < 2) ? T_(" was") : T_("s were"),
-       jcr->get_ActionName(true), ids.list);
-
-  Dmsg2(dbglevel, "Before loop count=%d ids=%s\n", ids.count, ids.list);
-
   // Note: to not over load the system, limit the number of new jobs started.
   if (jcr->dir_impl->res.job->MaxConcurrentCopies) {
     limit = jcr->dir_impl->res.job->MaxConcurrentCopies;
     apply_limit = true;
   }
 
+  if (jcr->dir_impl->res.job->ShareVolumeReads) {
+    hints = GroupJobsByVolume(jcr, &ids, limit);
+  }
+
+  Jmsg(jcr, M_INFO, 0, T_("The following %u JobId%s chosen to be %s: %s\n"),
+       ids.count, (ids.count < 2) ? T_(" was") : T_("s were"),
+       jcr->get_ActionName(true), ids.list);
+
+  Dmsg2(dbglevel, "Before loop count=%d ids=%s\n", ids.count, ids.list);
+
   p = ids.list;
   for (int i = 0; i < (int)ids.count; i++) {
     JobId = 0;
@@ -964,8 +988,16 @@ static inline bool getJobs_to_migrate(JobControlRecord* jcr)
       if (limit < 0) { continue; }
     }
 
+    if (auto hint = hints.find(JobId); hint != hints.end()) {
+      std::lock_guard lock(read_group_mutex);
+      read_group_hints[JobId] = hint->second;
+    }
     StartNewMigrationJob(jcr);
     Dmsg0(dbglevel, "Back from StartNewMigrationJob\n");
+    {
+      std::lock_guard lock(read_group_mutex);
+      read_group_hints.erase(JobId);
+    }
   }
 
   jcr->dir_impl->HasSelectedJobs = true;
@@ -1045,6 +1077,15 @@ bool DoMigrationInit(JobControlRecord* jcr)
 
     auto& prev_jr = jcr->dir_impl->previous_jr.value();
 
+    {
+      std::lock_guard lock(read_group_mutex);
+      if (auto hint = read_group_hints.find(prev_jr.JobId);
+          hint != read_group_hints.end()) {
+        jcr->dir_impl->read_group = hint->second.name;
+        jcr->dir_impl->read_group_size = hint->second.size;
+      }
+    }
+
     Jmsg(jcr, M_INFO, 0, T_("%s using JobId=%s Job=%s\n"),
          jcr->get_OperationName(), edit_int64(prev_jr.JobId, ed1), prev_jr.Job);
     Dmsg4(dbglevel, "%s JobId=%d  using JobId=%s Job=%s\n",
@@ -0,0 +1,216 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+/**
+ * @file
+ * backups written to a second pool while they run
+ *
+ * A backup job with a Mirror Pool gets a second job, the mirror_jcr, that is
+ * set up like the remote storage daemon of a copy job.  The storage daemon
+ * of the backup is told to replicate to the storage of the mirror pool, and
+ * sends every record it writes on to it (see DoAppendData()).  So both
+ * storage daemons write the data in one pass and the mirror ends up in the
+ * catalog as a copy of the backup.
+ */
+
+#include "include/bareos.h"
+#include "dird.h"
+#include "dird/dird_globals.h"
+#include "dird/backup.h"
+#include "dird/director_jcr_impl.h"
+#include "dird/jcr_util.h"
+#include "dird/job.h"
+#include "dird/mirror.h"
+#include "dird/msgchan.h"
+#include "dird/sd_cmds.h"
+#include "dird/storage.h"
+#include "include/auth_protocol_types.h"
+#include "cats/sql.h"
+#include "lib/edit.h"
+
+namespace directordaemon {
+
+/* Commands sent to the storage daemon of the backup */
+static char replicatecmd[]
+    = "replicate JobId=%d Job=%s address=%s port=%d ssl=%d Authorization=%s\n";
+
+static bool IsTerminatedOk(int TermCode)
+{
+  return TermCode == JS_Terminated || TermCode == JS_Warnings;
+}
+
+// Creates the mirror job while the backup job is set up.
+bool SetupBackupMirror(JobControlRecord* jcr)
+{
+  JobResource* job = jcr->dir_impl->res.job;
+  PoolResource* pool = job->mirror_pool;
+  if (!pool || jcr->dir_impl->is_mirror) { return true; }
+
+  JobControlRecord* mirror_jcr = NewDirectorJcr(DirdFreeJcr);
+  jcr->dir_impl->mirror_jcr = mirror_jcr;
+
+  /* Like the writing side of a copy job, its messages go to the backup
+   * job. */
+  SetJcrDefaults(mirror_jcr, job);
+  mirror_jcr->dir_impl->is_mirror = true;
+  mirror_jcr->dir_impl->no_maxtime = true;
+  mirror_jcr->dir_impl->IgnoreDuplicateJobChecking = true;
+  mirror_jcr->dir_impl->spool_data = jcr->dir_impl->spool_data;
+  mirror_jcr->dir_impl->spool_size = jcr->dir_impl->spool_size;
+
+  if (!SetupJob(mirror_jcr, true)) {
+    Jmsg(jcr, M_FATAL, 0, T_("Setup of the mirror job failed.\n"));
+    return false;
+  }
+  mirror_jcr->cjcr = jcr;
+
+  // It has the data of the backup, whatever level its own setup chose.
+  mirror_jcr->setJobLevel(jcr->getJobLevel());
+  mirror_jcr->dir_impl->jr.JobLevel = jcr->getJobLevel();
+  mirror_jcr->dir_impl->res.pool = pool;
+  mirror_jcr->dir_impl->jr.PoolId
+      = GetOrCreatePoolRecord(mirror_jcr, pool->resource_name_);
+  if (mirror_jcr->dir_impl->jr.PoolId == 0) { return false; }
+
+  FreeWstorage(mirror_jcr);
+  CopyWstorage(mirror_jcr, pool->storage, T_("Mirror Pool resource"));
+  if (!mirror_jcr->dir_impl->res.write_storage_list) {
+    Jmsg(jcr, M_FATAL, 0, T_("No Storage specification found in Pool %s.\n"),
+         pool->resource_name_);
+    return false;
+  }
+
+  Dmsg3(100, "mirror_jcr: JobId=%d Pool=%s Storage=%s\n",
+        mirror_jcr->JobId, pool->resource_name_,
+        mirror_jcr->dir_impl->res.write_storage->resource_name_);
+  return true;
+}
+
+/* Reserves a device on the storage of the mirror pool and lets the storage
+ * daemon of the backup connect to it.  Called once the backup has its own
+ * device but before it runs. */
+bool StartBackupMirror(JobControlRecord* jcr)
+{
+  JobControlRecord* mirror_jcr = jcr->dir_impl->mirror_jcr;
+  if (!mirror_jcr) { return true; }
+
+  StorageResource* write_storage = mirror_jcr->dir_impl->res.write_storage;
+  mirror_jcr->setJobStatusWithPriorityCheck(JS_WaitSD);
+  if (!ConnectToStorageDaemon(mirror_jcr, 10, me->SDConnectTimeout, true)
+      || !StartStorageDaemonJob(mirror_jcr, false)
+      || !ReserveWriteDevice(mirror_jcr,
+                             mirror_jcr->dir_impl->res.write_storage_list)) {
+    Jmsg(jcr, M_FATAL, 0, T_("Cannot start the mirror job on Storage %s.\n"),
+         write_storage->resource_name_);
+    return false;
+  }
+
+  mirror_jcr->start_time = jcr->start_time;
+  mirror_jcr->dir_impl->jr.StartTime = jcr->dir_impl->jr.StartTime;
+  mirror_jcr->dir_impl->jr.JobTDate = jcr->start_time;
+  mirror_jcr->setJobStatusWithPriorityCheck(JS_Running);
+  if (DbLocker _{mirror_jcr->db}; !mirror_jcr->db->UpdateJobStartRecord(
+          mirror_jcr, &mirror_jcr->dir_impl->jr)) {
+    Jmsg(jcr, M_FATAL, 0, "%s", mirror_jcr->db->strerror());
+    return false;
+  }
+
+  /* Start the job prior to starting the message thread below
+   * to avoid two threads from using the BareosSocket structure at
+   * the same time. */
+  if (!mirror_jcr->store_bsock->fsend("listen")
+      || !StartStorageDaemonMessageThread(mirror_jcr)) {
+    return false;
+  }
+
+  uint32_t tls_need = write_storage->IsTlsConfigured()
+                          ? TlsPolicy::kBnetTlsAuto
+                          : TlsPolicy::kBnetTlsNone;
+  char* connection_target_address = StorageAddressToContact(
+      jcr->dir_impl->res.write_storage, write_storage);
+
+  PoolMem command(PM_MESSAGE);
+  Mmsg(command, replicatecmd, mirror_jcr->JobId, mirror_jcr->Job,
+       connection_target_address, write_storage->SDport, tls_need,
+       mirror_jcr->sd_auth_key);
+  if (!jcr->store_bsock->fsend(command.c_str())
+      || jcr->store_bsock->recv() <= 0
+      || !bstrcmp(jcr->store_bsock->msg, "3000 OK replicate\n")) {
+    Jmsg(jcr, M_FATAL, 0,
+         T_("Storage daemon could not connect to the mirror Storage %s.\n"),
+         write_storage->resource_name_);
+    return false;
+  }
+
+  Jmsg(jcr, M_INFO, 0, T_("Mirroring to Pool %s, JobId %u.\n"),
+       mirror_jcr->dir_impl->res.pool->resource_name_, mirror_jcr->JobId);
+  return true;
+}
+
+/* Waits for the storage daemon of the mirror and turns the mirror into a
+ * copy of the backup, a failed one too, so that it is never taken as the
+ * base of the next backup. */
+void FinishBackupMirror(JobControlRecord* jcr, int TermCode)
+{
+  JobControlRecord* mirror_jcr = jcr->dir_impl->mirror_jcr;
+  if (!mirror_jcr) { return; }
+
+  if (mirror_jcr->store_bsock) {
+    if (!IsTerminatedOk(TermCode)) {
+      mirror_jcr->setJobStatusWithPriorityCheck(JS_Canceled);
+      CancelStorageDaemonJob(mirror_jcr);
+    }
+    if (mirror_jcr->dir_impl->SD_msg_chan_started) {
+      WaitForStorageDaemonTermination(mirror_jcr);
+    }
+    if (mirror_jcr->batch_started) {
+      mirror_jcr->db_batch->WriteBatchFileRecords(mirror_jcr);
+    }
+  }
+
+  int mirror_code = TermCode;
+  if (IsTerminatedOk(TermCode)
+      && mirror_jcr->dir_impl->SDJobStatus != JS_Terminated) {
+    mirror_code = JS_ErrorTerminated;
+  }
+  mirror_jcr->JobFiles = mirror_jcr->dir_impl->SDJobFiles;
+  mirror_jcr->JobBytes = mirror_jcr->dir_impl->SDJobBytes;
+  mirror_jcr->dir_impl->jr.RealEndTime = 0;
+  mirror_jcr->dir_impl->jr.PriorJobId = jcr->JobId;
+  UpdateJobEnd(mirror_jcr, mirror_code);
+
+  char ec1[50], ec2[50];
+  PoolMem query(PM_MESSAGE);
+  Mmsg(query, "UPDATE Job SET Type='%c' WHERE JobId=%s", (char)JT_JOB_COPY,
+       edit_uint64(mirror_jcr->JobId, ec1));
+  jcr->db->SqlQuery(query.c_str());
+
+  if (IsTerminatedOk(mirror_code)) {
+    Jmsg(jcr, M_INFO, 0,
+         T_("Mirror JobId %u terminated: %s files, %s bytes.\n"),
+         mirror_jcr->JobId, edit_uint64_with_commas(mirror_jcr->JobFiles, ec1),
+         edit_uint64_with_commas(mirror_jcr->JobBytes, ec2));
+  } else if (IsTerminatedOk(TermCode)) {
+    Jmsg(jcr, M_ERROR, 0, T_("Mirror JobId %u failed.\n"), mirror_jcr->JobId);
+  }
+}
+
+} /* namespace directordaemon */
@@ -0,0 +1,38 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+/**
+ * @file
+ * backups written to a second pool while they run
+ */
+#ifndef BAREOS_DIRD_MIRROR_H_
+#define BAREOS_DIRD_MIRROR_H_
+
+class JobControlRecord;
+
+namespace directordaemon {
+
+bool SetupBackupMirror(JobControlRecord* jcr);
+bool StartBackupMirror(JobControlRecord* jcr);
+void FinishBackupMirror(JobControlRecord* jcr, int TermCode);
+
+} /* namespace directordaemon */
+#endif  // BAREOS_DIRD_MIRROR_H_
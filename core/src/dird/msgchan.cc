@@ -43,6 +43,7 @@
 #include "dird/sd_cmds.h"
 #include "lib/berrno.h"
 #include "lib/bnet.h"
+#include "lib/bsock_compression.h"
 #include "lib/edit.h"
 #include "lib/util.h"
 #include "lib/thread_specific_data.h"
@@ -56,7 +57,8 @@ static char jobcmd[]
       "type=%d level=%d FileSet=%s NoAttr=%d SpoolAttr=%d FileSetMD5=%s "
       "SpoolData=%d PreferMountedVols=%d SpoolSize=%s "
       "rerunning=%d VolSessionId=%d VolSessionTime=%d Quota=%llu "
-      "Protocol=%d BackupFormat=%s\n";
+      "Protocol=%d BackupFormat=%s AttrBatch=%d Priority=%d ReadGroup=%s "
+      "ReadGroupSize=%u\n";
 static char use_storage[]
     = "use storage=%s media_type=%s pool_name=%s "
       "pool_type=%s append=%d copy=%d stripe=%d\n";
@@ -68,6 +70,7 @@ static char use_device[] = "use device=%s\n";
 static char OKbootstrap[] = "3000 OK bootstrap\n";
 static char OK_job[] = "3000 OK Job SDid=%d SDtime=%d Authorization=%100s\n";
 static char OK_nextrun[] = "3000 OK Job Authorization=%100s\n";
+static char OKcompress[] = "3000 OK compress\n";
 static char OK_device[] = "3000 OK use device device=%s\n";
 
 /* Storage Daemon requests */
@@ -283,6 +286,35 @@ bool ReserveReadAndWriteDevices(JobControlRecord* jcr,
   return true;
 }
 
+/**
+ * Take up the message compression the Storage daemon offered in its reply to
+ * the Job command, still in sd_socket->msg, if the storage resource asks for
+ * it.  It compresses the attributes and job messages coming back.
+ */
+static bool EnableStorageMessageCompression(JobControlRecord* jcr,
+                                            BareosSocket* sd_socket)
+{
+  StorageResource* store = jcr->dir_impl->res.write_storage
+                               ? jcr->dir_impl->res.write_storage
+                               : jcr->dir_impl->res.read_storage;
+  const char* algorithm = MessageCompression::Algorithm();
+  if (!store || !store->message_compression || !algorithm) { return true; }
+
+  std::string offer = std::string{" compress="} + algorithm;
+  const char* found = strstr(sd_socket->msg, offer.c_str());
+  if (!found
+      || (found[offer.size()] != '\n' && found[offer.size()] != ' ')) {
+    Dmsg1(100, "Storage daemon does not offer %s compression\n", algorithm);
+    return true;
+  }
+
+  sd_socket->fsend("compress=%s\n", algorithm);
+  if (!response(jcr, sd_socket, OKcompress, "compress", DISPLAY_ERROR)) {
+    return false;
+  }
+  return sd_socket->EnableMessageCompression();
+}
+
 /** Start a job with the Storage daemon
  */
 bool StartStorageDaemonJob(JobControlRecord* jcr, bool send_bsr)
@@ -360,7 +392,11 @@ bool StartStorageDaemonJob(JobControlRecord* jcr, bool send_bsr)
       jcr->dir_impl->spool_data, jcr->dir_impl->res.job->PreferMountedVolumes,
       edit_int64(jcr->dir_impl->spool_size, ed2), jcr->rerunning,
       jcr->VolSessionId, jcr->VolSessionTime, remainingquota,
-      jcr->getJobProtocol(), backup_format.c_str());
+      jcr->getJobProtocol(), backup_format.c_str(),
+      1 /* we understand FileAttributesBatch */, jcr->JobPriority,
+      jcr->dir_impl->read_group.empty() ? "none"
+                                        : jcr->dir_impl->read_group.c_str(),
+      jcr->dir_impl->read_group_size);
 
   Dmsg1(100, ">stored: %s", sd_socket->msg);
   if (BgetDirmsg(sd_socket) > 0) {
@@ -384,6 +420,8 @@ bool StartStorageDaemonJob(JobControlRecord* jcr, bool send_bsr)
     return false;
   }
 
+  if (!EnableStorageMessageCompression(jcr, sd_socket)) { return false; }
+
   if (send_bsr
       && (!SendBootstrapFileToSd(jcr, sd_socket)
           || !response(jcr, sd_socket, OKbootstrap, "Bootstrap",
@@ -470,6 +508,8 @@ extern "C" void* msg_thread(void* arg)
   jcr->dir_impl->SD_msg_chan_started = true;
   pthread_cleanup_push(MsgThreadCleanup, arg);
   sd = jcr->store_bsock;
+  // from now on this thread alone reads from it
+  sd->EnableReceiveBuffer();
 
   // Read the Storage daemon's output.
   Dmsg0(100, "Start msg_thread loop\n");
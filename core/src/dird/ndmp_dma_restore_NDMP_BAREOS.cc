@@ -69,14 +69,16 @@ static inline char* lookup_fileindex(JobControlRecord* jcr, int32_t FileIndex)
   tree_node *node, *parent;
   PoolMem restore_pathname, tmp;
 
-  node = FirstTreeNode(jcr->dir_impl->restore_tree_root);
+  TREE_ROOT* root = jcr->dir_impl->restore_tree_root;
+  node = FirstTreeNode(root);
   while (node) {
     // See if this is the wanted FileIndex.
     if (node->FileIndex == FileIndex) {
       PmStrcpy(restore_pathname, node->fname);
 
       // Walk up the parent until we hit the head of the list.
-      for (parent = node->parent; parent; parent = parent->parent) {
+      for (parent = TreeParent(root, node); parent;
+           parent = TreeParent(root, parent)) {
         PmStrcpy(tmp, restore_pathname.c_str());
         Mmsg(restore_pathname, "%s/%s", parent->fname, tmp.c_str());
       }
@@ -86,7 +88,7 @@ static inline char* lookup_fileindex(JobControlRecord* jcr, int32_t FileIndex)
       }
     }
 
-    node = NextTreeNode(node);
+    node = NextTreeNode(root, node);
   }
 
   return NULL;
@@ -104,14 +106,16 @@ static inline int set_files_to_restore(JobControlRecord* jcr,
   tree_node *node, *parent;
   PoolMem restore_pathname, tmp;
 
-  node = FirstTreeNode(jcr->dir_impl->restore_tree_root);
+  TREE_ROOT* root = jcr->dir_impl->restore_tree_root;
+  node = FirstTreeNode(root);
   while (node) {
     // See if this is the wanted FileIndex and the user asked to extract it.
     if (node->FileIndex == FileIndex && node->extract) {
       PmStrcpy(restore_pathname, node->fname);
 
       // Walk up the parent until we hit the head of the list.
-      for (parent = node->parent; parent; parent = parent->parent) {
+      for (parent = TreeParent(root, node); parent;
+           parent = TreeParent(root, parent)) {
         PmStrcpy(tmp, restore_pathname.c_str());
         Mmsg(restore_pathname, "%s/%s", parent->fname, tmp.c_str());
       }
@@ -136,7 +140,7 @@ static inline int set_files_to_restore(JobControlRecord* jcr,
       }
     }
 
-    node = NextTreeNode(node);
+    node = NextTreeNode(root, node);
   }
 
   return cnt;
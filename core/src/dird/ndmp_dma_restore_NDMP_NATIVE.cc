@@ -138,9 +138,11 @@ static inline bool fill_restore_environment_ndmp_native(
   pv.value = ndmp_filesystem;
   ndma_store_env_list(&job->env_tab, &pv);
 
+  bool direct_access = false;
   if (ndmp_filesystem
       && SetFilesToRestoreNdmpNative(jcr, job, current_fi,
-                                     destination_path.c_str(), ndmp_filesystem)
+                                     destination_path.c_str(), ndmp_filesystem,
+                                     &direct_access)
              == 0) {
     Jmsg(jcr, M_INFO, 0,
          T_("No files selected for restore, preparing namelist for full image "
@@ -152,6 +154,24 @@ static inline bool fill_restore_environment_ndmp_native(
     AddToNamelist(job, (char*)"", destination_path.c_str(), (char*)"",
                   (char*)"", NDMP_INVALID_U_QUAD, NDMP_INVALID_U_QUAD,
                   me->ndmp_fhinfo_set_zero_for_invalid_u_quad);
+  } else if (direct_access && nbf_options && nbf_options->uses_file_history) {
+    /* Every file selected has its position in the backup image, so let the
+     * data agent seek to them instead of reading the whole image. A DIRECT
+     * given in the environment of the backup takes precedence. */
+    bool direct_set = false;
+    for (struct ndm_env_entry* entry = job->env_tab.head; entry;
+         entry = entry->next) {
+      if (bstrcmp(entry->pval.name, ndmp_env_keywords[NDMP_ENV_KW_DIRECT])) {
+        direct_set = true;
+        break;
+      }
+    }
+    if (!direct_set) {
+      Jmsg(jcr, M_INFO, 0, T_("Using Direct Access Recovery.\n"));
+      pv.name = ndmp_env_keywords[NDMP_ENV_KW_DIRECT];
+      pv.value = ndmp_env_values[NDMP_ENV_VALUE_YES];
+      ndma_store_env_list(&job->env_tab, &pv);
+    }
   }
   return true;
 }
@@ -161,14 +181,17 @@ int SetFilesToRestoreNdmpNative(JobControlRecord* jcr,
                                 struct ndm_job_param* job,
                                 int32_t,
                                 const char* restore_prefix,
-                                const char* ndmp_filesystem)
+                                const char* ndmp_filesystem,
+                                bool* direct_access)
 {
   int len;
   int cnt = 0;
+  bool all_positioned = true;
   tree_node *node, *parent;
   PoolMem restore_pathname, tmp;
 
-  node = FirstTreeNode(jcr->dir_impl->restore_tree_root);
+  TREE_ROOT* root = jcr->dir_impl->restore_tree_root;
+  node = FirstTreeNode(root);
   while (node) {
     /* node->extract_dir  means that only the directory should be selected for
      * extraction itself, the subdirs and subfiles are not automaticaly marked
@@ -185,7 +208,8 @@ int SetFilesToRestoreNdmpNative(JobControlRecord* jcr,
     if (node->extract) {
       PmStrcpy(restore_pathname, node->fname);
       // Walk up the parent until we hit the head of the list.
-      for (parent = node->parent; parent; parent = parent->parent) {
+      for (parent = TreeParent(root, node); parent;
+           parent = TreeParent(root, parent)) {
         PmStrcpy(tmp, restore_pathname.c_str());
         Mmsg(restore_pathname, "%s/%s", parent->fname, tmp.c_str());
       }
@@ -207,6 +231,8 @@ int SetFilesToRestoreNdmpNative(JobControlRecord* jcr,
         AddToNamelist(job, restore_pathname.c_str() + len, restore_prefix,
                       (char*)"", (char*)"", node->fhnode, node->fhinfo);
 
+        // a zero fhinfo is what the catalog holds when there was none
+        if (node->fhinfo == 0) { all_positioned = false; }
         cnt++;
 
       } else {
@@ -216,8 +242,9 @@ int SetFilesToRestoreNdmpNative(JobControlRecord* jcr,
              restore_pathname.c_str(), node->fhnode, node->fhinfo);
       }
     }
-    node = NextTreeNode(node);
+    node = NextTreeNode(root, node);
   }
+  if (direct_access) { *direct_access = cnt > 0 && all_positioned; }
   return cnt;
 }
 
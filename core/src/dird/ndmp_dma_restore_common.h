@@ -40,7 +40,8 @@ int SetFilesToRestoreNdmpNative(JobControlRecord* jcr,
                                 struct ndm_job_param* job,
                                 int32_t FileIndex,
                                 const char* restore_prefix,
-                                const char* ndmp_filesystem);
+                                const char* ndmp_filesystem,
+                                bool* direct_access = nullptr);
 int NdmpEnvHandler(void* ctx, int num_fields, char** row);
 bool ExtractPostRestoreStats(JobControlRecord* jcr, struct ndm_session* sess);
 void NdmpRestoreCleanup(JobControlRecord* jcr, int TermCode);
@@ -35,6 +35,16 @@
 #  include "ndmp_dma_priv.h"
 #  include "lmdb/lmdb.h"
 
+#  include <algorithm>
+#  include <condition_variable>
+#  include <deque>
+#  include <memory>
+#  include <mutex>
+#  include <string>
+#  include <thread>
+#  include <unordered_map>
+#  include <vector>
+
 namespace directordaemon {
 
 // What is actually stored in the LMDB
@@ -566,109 +576,284 @@ void NdmpFhdbLmdbUnregister(struct ndmlog* ixlog)
   }
 }
 
-static inline void CalculatePath(uint64_t node, fhdb_state* fhdb_state)
+/* Paths of the directories looked up last, so the files of one directory
+ * and their siblings only walk up to the root once. */
+constexpr std::size_t path_cache_entries = 64 * 1024;
+constexpr std::size_t entries_per_batch = 1024;
+
+struct fhdb_file {
+  std::string full_path;
+  PoolMem attribs{PM_FNAME};
+  int8_t FileType{0};
+  uint64_t fh_info{0};
+};
+
+struct fhdb_batch {
+  std::vector<const fhdb_payload*> entries;
+  std::vector<fhdb_file> files;
+  bool done{false};
+};
+
+// Each thread reconstructing paths has its own read transaction and cache.
+struct fhdb_path_builder {
+  MDB_txn* txn{nullptr};
+  std::unordered_map<uint64_t, std::string> paths;
+  std::vector<std::pair<uint64_t, const char*>> chain;
+};
+
+static void CalculatePath(uint64_t node,
+                          fhdb_state* fhdb_state,
+                          fhdb_path_builder& builder,
+                          std::string& path)
 {
-  PoolMem temp;
   int result = 0;
   MDB_val rkey, rdata;
   struct fhdb_payload* payload;
-  bool root_node_reached = false;
 
   Dmsg1(100, "CalculatePath for node %llu\n", node);
 
-  PmStrcpy(fhdb_state->path, "");
-  while (!result && !root_node_reached) {
+  // Walk up until the root or a directory with a known path.
+  path.clear();
+  builder.chain.clear();
+  while (node != fhdb_state->root_node) {
+    if (auto known = builder.paths.find(node); known != builder.paths.end()) {
+      path = known->second;
+      break;
+    }
+
     rkey.mv_data = &node;
     rkey.mv_size = sizeof(node);
-
-    result = mdb_get(fhdb_state->db_ro_txn, fhdb_state->db_dbi, &rkey, &rdata);
-    switch (result) {
-      case 0:
-        payload = (struct fhdb_payload*)rdata.mv_data;
-        if (node != fhdb_state->root_node) {
-          PmStrcpy(temp, "/");
-          PmStrcat(temp, payload->namebuffer);
-          PmStrcat(temp, fhdb_state->path);
-          PmStrcpy(fhdb_state->path, temp.c_str());
-          node = payload->dir_node;
-        } else {
-          // Root reached
-          root_node_reached = true;
-        }
-        break;
-      case MDB_NOTFOUND:
-        break;
-      case EINVAL:
-        Dmsg1(debuglevel, "%s\n", mdb_strerror(result));
-        break;
-      default:
+    result = mdb_get(builder.txn, fhdb_state->db_dbi, &rkey, &rdata);
+    if (result) {
+      if (result != MDB_NOTFOUND) {
         Dmsg1(debuglevel, "%s\n", mdb_strerror(result));
-        break;
+      }
+      break;
+    }
+    payload = (struct fhdb_payload*)rdata.mv_data;
+    builder.chain.emplace_back(node, payload->namebuffer);
+    node = payload->dir_node;
+  }
+
+  // Names stay valid as long as the read transaction.
+  if (builder.paths.size() + builder.chain.size() > path_cache_entries) {
+    builder.paths.clear();
+  }
+  for (auto dir = builder.chain.rbegin(); dir != builder.chain.rend(); ++dir) {
+    path += "/";
+    path += dir->second;
+    builder.paths.emplace(dir->first, path);
+  }
+}
+
+static void BuildFiles(NIS* nis,
+                       fhdb_state* fhdb_state,
+                       fhdb_path_builder& builder,
+                       fhdb_batch& batch)
+{
+  std::string path;
+
+  batch.files.resize(batch.entries.size());
+  for (std::size_t i = 0; i < batch.entries.size(); i++) {
+    const fhdb_payload* payload = batch.entries[i];
+    fhdb_file& file = batch.files[i];
+    ndmp9_file_stat ndmp_fstat = payload->ndmp_fstat;
+
+    CalculatePath(payload->dir_node, fhdb_state, builder, path);
+    NdmpConvertFstat(&ndmp_fstat, nis->FileIndex, &file.FileType,
+                     file.attribs);
+
+    file.full_path = nis->filesystem;
+    file.full_path += path;
+    file.full_path += "/";
+    file.full_path += payload->namebuffer;
+
+    if (file.FileType == FT_DIREND) {
+      /* SplitPathAndFilename() expects directories to end with a '/'
+       * so append '/' if full_path does not already end with '/' */
+      if (file.full_path.back() != '/') {
+        Dmsg1(100, ("appending / to %s \n"), file.full_path.c_str());
+        file.full_path += "/";
+      }
     }
+    file.fh_info = (ndmp_fstat.fh_info.valid == NDMP9_VALIDITY_VALID)
+                       ? ndmp_fstat.fh_info.value
+                       : 0;
+  }
+}
+
+static void StoreFiles(NIS* nis, fhdb_batch& batch)
+{
+  for (fhdb_file& file : batch.files) {
+    NdmpStoreAttributeRecord(nis->jcr, file.full_path.data(),
+                             nis->virtual_filename, file.attribs.c_str(),
+                             file.FileType, 0, file.fh_info);
   }
 }
 
+/* Reconstructs the paths of the batches on other threads while this one
+ * inserts the finished batches into the catalog, in the order of the LMDB.
+ * At most two batches per worker are in flight. */
+class FhdbPathWorkers {
+ public:
+  FhdbPathWorkers(NIS* nis, fhdb_state* fhdb_state, std::size_t num_workers)
+      : nis_{nis}, fhdb_state_{fhdb_state}, max_in_flight_{2 * num_workers}
+  {
+    for (std::size_t i = 0; i < num_workers; i++) {
+      MDB_txn* txn;
+      int result
+          = mdb_txn_begin(fhdb_state_->db_env, NULL, MDB_RDONLY, &txn);
+      if (result != MDB_SUCCESS) {
+        Dmsg1(debuglevel, "Unable to create read transaction: %s\n",
+              mdb_strerror(result));
+        break;
+      }
+      workers_.emplace_back([this, txn] { Build(txn); });
+    }
+  }
+
+  ~FhdbPathWorkers() { Finish(); }
+
+  // false if no worker could be started
+  bool Running() const { return !workers_.empty(); }
+
+  void Add(std::unique_ptr<fhdb_batch> batch)
+  {
+    std::unique_lock lock(mutex_);
+    batches_.push_back(std::move(batch));
+    todo_.push_back(batches_.back().get());
+    work_.notify_one();
+    StoreDone(lock, max_in_flight_);
+  }
+
+  void Finish()
+  {
+    std::unique_lock lock(mutex_);
+    StoreDone(lock, 0);
+    stopping_ = true;
+    work_.notify_all();
+    lock.unlock();
+    for (auto& worker : workers_) {
+      if (worker.joinable()) { worker.join(); }
+    }
+  }
+
+ private:
+  /* Stores the finished batches at the front, waiting until at most
+   * max_pending batches are left. */
+  void StoreDone(std::unique_lock<std::mutex>& lock, std::size_t max_pending)
+  {
+    for (;;) {
+      done_.wait(lock, [this, max_pending] {
+        return batches_.size() <= max_pending
+               || (!batches_.empty() && batches_.front()->done);
+      });
+      if (batches_.empty() || !batches_.front()->done) { return; }
+
+      std::unique_ptr<fhdb_batch> batch = std::move(batches_.front());
+      batches_.pop_front();
+      lock.unlock();
+      StoreFiles(nis_, *batch);
+      lock.lock();
+    }
+  }
+
+  void Build(MDB_txn* txn)
+  {
+    fhdb_path_builder builder;
+    builder.txn = txn;
+
+    std::unique_lock lock(mutex_);
+    for (;;) {
+      work_.wait(lock, [this] { return !todo_.empty() || stopping_; });
+      if (todo_.empty()) { break; }
+      fhdb_batch* batch = todo_.front();
+      todo_.pop_front();
+      lock.unlock();
+
+      BuildFiles(nis_, fhdb_state_, builder, *batch);
+
+      lock.lock();
+      batch->done = true;
+      done_.notify_all();
+    }
+    lock.unlock();
+    mdb_txn_abort(txn);
+  }
+
+  NIS* nis_;
+  fhdb_state* fhdb_state_;
+  std::size_t max_in_flight_;
+  std::mutex mutex_;
+  std::condition_variable work_;
+  std::condition_variable done_;
+  std::deque<std::unique_ptr<fhdb_batch>> batches_;
+  std::deque<fhdb_batch*> todo_;
+  std::vector<std::thread> workers_;
+  bool stopping_{false};
+};
+
 static inline void ProcessLmdb(NIS* nis, struct fhdb_state* fhdb_state)
 {
   int result;
   uint64_t node;
   MDB_cursor* cursor;
-  int8_t FileType = 0;
   MDB_val rkey, rdata;
-  PoolMem attribs(PM_FNAME);
-  ndmp9_file_stat ndmp_fstat;
-  PoolMem full_path(PM_FNAME);
   struct fhdb_payload* payload;
 
   result = mdb_cursor_open(fhdb_state->db_ro_txn, fhdb_state->db_dbi, &cursor);
   if (result) { Dmsg1(debuglevel, "%s\n", mdb_strerror(result)); }
 
+  /* The payloads stay valid as long as our read transaction, so the batches
+   * only reference them. */
+  std::unique_ptr<FhdbPathWorkers> workers;
+  std::size_t num_workers
+      = std::min(std::thread::hardware_concurrency() / 2, 4u);
+  if (num_workers > 0) {
+    workers = std::make_unique<FhdbPathWorkers>(nis, fhdb_state, num_workers);
+    if (!workers->Running()) { workers.reset(); }
+  }
+  fhdb_path_builder builder;
+  builder.txn = fhdb_state->db_ro_txn;
+
   rkey.mv_data = &node;
   rkey.mv_size = sizeof(node);
   result = mdb_cursor_get(cursor, &rkey, &rdata, MDB_FIRST);
   if (result) { Dmsg1(debuglevel, "%s\n", mdb_strerror(result)); }
 
+  auto batch = std::make_unique<fhdb_batch>();
   while (!result) {
-    switch (result) {
-      case 0:
-        payload = (struct fhdb_payload*)rdata.mv_data;
-        ndmp_fstat = payload->ndmp_fstat;
-        node = *(uint64_t*)rkey.mv_data;
-
-        if (ndmp_fstat.node.valid == NDMP9_VALIDITY_VALID) {
-          CalculatePath(payload->dir_node, fhdb_state);
-          NdmpConvertFstat(&ndmp_fstat, nis->FileIndex, &FileType, attribs);
-
-          PmStrcpy(full_path, nis->filesystem);
-          PmStrcat(full_path, fhdb_state->path);
-          PmStrcat(full_path, "/");
-          PmStrcat(full_path, payload->namebuffer);
-
-          if (FileType == FT_DIREND) {
-            /* SplitPathAndFilename() expects directories to end with a '/'
-             * so append '/' if full_path does not already end with '/' */
-            if (full_path.c_str()[strlen(full_path.c_str()) - 1] != '/') {
-              Dmsg1(100, ("appending / to %s \n"), full_path.c_str());
-              PmStrcat(full_path, "/");
-            }
-          }
-          NdmpStoreAttributeRecord(
-              nis->jcr, full_path.c_str(), nis->virtual_filename,
-              attribs.c_str(), FileType, 0,
-              (ndmp_fstat.fh_info.valid == NDMP9_VALIDITY_VALID)
-                  ? ndmp_fstat.fh_info.value
-                  : 0);
-        } else {
-          Dmsg1(100, "skipping node %lu because it has no valid node data\n",
-                node);
-        }
-        result = mdb_cursor_get(cursor, &rkey, &rdata, MDB_NEXT);
-        break;
-      default:
-        Dmsg1(debuglevel, "%s\n", mdb_strerror(result));
-        break;
+    payload = (struct fhdb_payload*)rdata.mv_data;
+    node = *(uint64_t*)rkey.mv_data;
+
+    if (payload->ndmp_fstat.node.valid == NDMP9_VALIDITY_VALID) {
+      batch->entries.push_back(payload);
+    } else {
+      Dmsg1(100, "skipping node %lu because it has no valid node data\n",
+            node);
+    }
+
+    result = mdb_cursor_get(cursor, &rkey, &rdata, MDB_NEXT);
+    if (result && result != MDB_NOTFOUND) {
+      Dmsg1(debuglevel, "%s\n", mdb_strerror(result));
+    }
+
+    if (batch->entries.size() >= entries_per_batch
+        || (result && !batch->entries.empty())) {
+      if (workers) {
+        workers->Add(std::move(batch));
+        batch = std::make_unique<fhdb_batch>();
+      } else {
+        BuildFiles(nis, fhdb_state, builder, *batch);
+        StoreFiles(nis, *batch);
+        batch->entries.clear();
+        batch->files.clear();
+      }
     }
   }
+
+  if (workers) { workers->Finish(); }
+  mdb_cursor_close(cursor);
 }
 
 void NdmpFhdbLmdbProcessDb(struct ndmlog* ixlog)
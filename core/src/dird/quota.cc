@@ -29,10 +29,107 @@
 #include "include/bareos.h"
 #include "dird.h"
 #include "dird/director_jcr_impl.h"
+#include "dird/quota.h"
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
 
 namespace directordaemon {
 
 #define debuglevel 100
+
+/* The JobBytes sums of the clients, so that not every job with a quota sums
+ * up all retained jobs of its client again.  Terminated jobs add their
+ * JobBytes to the sums of their client, purges and prunes drop all sums.  As
+ * jobs also drop out of the sum when they get older than the JobRetention, a
+ * sum is computed anew after kQuotaReconcileInterval seconds; until then it
+ * may still contain jobs that just left the retention. */
+static constexpr time_t kQuotaReconcileInterval = 10 * 60;
+
+namespace {
+struct quota_usage {
+  uint64_t bytes{0};
+  time_t computed{0};
+};
+
+// catalog, ClientId, JobRetention and whether failed jobs count
+using quota_key = std::tuple<std::string, DBId_t, utime_t, bool>;
+
+std::mutex quota_mutex;
+std::map<quota_key, quota_usage> quota_usages;
+}  // namespace
+
+static quota_key QuotaKey(JobControlRecord* jcr, bool include_failed)
+{
+  return quota_key{jcr->dir_impl->res.catalog
+                       ? jcr->dir_impl->res.catalog->resource_name_
+                       : "",
+                   jcr->dir_impl->jr.ClientId,
+                   jcr->dir_impl->res.client->JobRetention, include_failed};
+}
+
+// Sets jr.JobSumTotalBytes, from the cache if possible.
+static bool GetQuotaJobbytes(JobControlRecord* jcr)
+{
+  bool include_failed = jcr->dir_impl->res.client->QuotaIncludeFailedJobs;
+  quota_key key = QuotaKey(jcr, include_failed);
+  time_t now = time(NULL);
+  {
+    std::lock_guard lock(quota_mutex);
+    auto cached = quota_usages.find(key);
+    if (cached != quota_usages.end()
+        && now - cached->second.computed < kQuotaReconcileInterval) {
+      jcr->dir_impl->jr.JobSumTotalBytes = cached->second.bytes;
+      Dmsg1(debuglevel, "Using cached quota for JobId %d\n", jcr->JobId);
+      return true;
+    }
+  }
+
+  DbLocker _{jcr->db};
+  bool ok = include_failed
+                ? jcr->db->get_quota_jobbytes(
+                    jcr, &jcr->dir_impl->jr,
+                    jcr->dir_impl->res.client->JobRetention)
+                : jcr->db->get_quota_jobbytes_nofailed(
+                    jcr, &jcr->dir_impl->jr,
+                    jcr->dir_impl->res.client->JobRetention);
+  if (!ok) {
+    Jmsg(jcr, M_WARNING, 0, T_("Error getting Quota value: ERR=%s\n"),
+         jcr->db->strerror());
+    return false;
+  }
+
+  std::lock_guard lock(quota_mutex);
+  quota_usages[key] = quota_usage{jcr->dir_impl->jr.JobSumTotalBytes, now};
+  return true;
+}
+
+// Adds the JobBytes of a terminated job to the sums of its client.
+void AddQuotaUsage(JobControlRecord* jcr)
+{
+  if (!jcr->dir_impl->res.client || !jcr->dir_impl->jr.ClientId) { return; }
+
+  bool failed = jcr->is_JobStatus(JS_ErrorTerminated)
+                || jcr->is_JobStatus(JS_FatalError)
+                || jcr->is_JobStatus(JS_Canceled);
+  std::lock_guard lock(quota_mutex);
+  for (bool include_failed : {true, false}) {
+    if (failed && !include_failed) { continue; }
+    auto cached = quota_usages.find(QuotaKey(jcr, include_failed));
+    if (cached != quota_usages.end()) {
+      cached->second.bytes += jcr->dir_impl->jr.JobBytes;
+    }
+  }
+}
+
+// Jobs got removed from the catalog, the sums are computed anew.
+void ForgetQuotaUsages()
+{
+  std::lock_guard lock(quota_mutex);
+  quota_usages.clear();
+}
 /**
  * This function returns the total number of bytes difference remaining before
  * going over quota. Returns: unsigned long long containing remaining bytes
@@ -112,23 +209,7 @@ bool CheckHardquotas(JobControlRecord* jcr)
 
   Dmsg1(debuglevel, "Checking hard quotas for JobId %d\n", jcr->JobId);
   if (!jcr->dir_impl->HasQuota) {
-    if (jcr->dir_impl->res.client->QuotaIncludeFailedJobs) {
-      if (DbLocker _{jcr->db}; !jcr->db->get_quota_jobbytes(
-              jcr, &jcr->dir_impl->jr,
-              jcr->dir_impl->res.client->JobRetention)) {
-        Jmsg(jcr, M_WARNING, 0, T_("Error getting Quota value: ERR=%s\n"),
-             jcr->db->strerror());
-        goto bail_out;
-      }
-    } else {
-      if (DbLocker _{jcr->db}; !jcr->db->get_quota_jobbytes_nofailed(
-              jcr, &jcr->dir_impl->jr,
-              jcr->dir_impl->res.client->JobRetention)) {
-        Jmsg(jcr, M_WARNING, 0, T_("Error getting Quota value: ERR=%s\n"),
-             jcr->db->strerror());
-        goto bail_out;
-      }
-    }
+    if (!GetQuotaJobbytes(jcr)) { goto bail_out; }
     jcr->dir_impl->HasQuota = true;
   }
 
@@ -171,23 +252,10 @@ bool CheckSoftquotas(JobControlRecord* jcr)
 
   Dmsg1(debuglevel, "Checking soft quotas for JobId %d\n", jcr->JobId);
   if (!jcr->dir_impl->HasQuota) {
+    if (!GetQuotaJobbytes(jcr)) { goto bail_out; }
     if (jcr->dir_impl->res.client->QuotaIncludeFailedJobs) {
-      if (DbLocker _{jcr->db}; !jcr->db->get_quota_jobbytes(
-              jcr, &jcr->dir_impl->jr,
-              jcr->dir_impl->res.client->JobRetention)) {
-        Jmsg(jcr, M_WARNING, 0, T_("Error getting Quota value: ERR=%s\n"),
-             jcr->db->strerror());
-        goto bail_out;
-      }
       Dmsg0(debuglevel, "Quota Includes Failed Jobs\n");
     } else {
-      if (DbLocker _{jcr->db}; !jcr->db->get_quota_jobbytes_nofailed(
-              jcr, &jcr->dir_impl->jr,
-              jcr->dir_impl->res.client->JobRetention)) {
-        Jmsg(jcr, M_WARNING, 0, T_("Error getting Quota value: ERR=%s\n"),
-             jcr->db->strerror());
-        goto bail_out;
-      }
       Jmsg(jcr, M_INFO, 0, T_("Quota does NOT include Failed Jobs\n"));
     }
     jcr->dir_impl->HasQuota = true;
@@ -27,6 +27,8 @@ namespace directordaemon {
 uint64_t FetchRemainingQuotas(JobControlRecord* jcr);
 bool CheckHardquotas(JobControlRecord* jcr);
 bool CheckSoftquotas(JobControlRecord* jcr);
+void AddQuotaUsage(JobControlRecord* jcr);
+void ForgetQuotaUsages();
 
 } /* namespace directordaemon */
 #endif  // BAREOS_DIRD_QUOTA_H_
@@ -20,6 +20,8 @@
 */
 
 #include "dird/reload.h"
+#include "dird/expand.h"
+#include "dird/ua_label.h"
 
 #include <cassert>
 #include <atomic>
@@ -110,6 +112,25 @@ bool CheckResources()
     }
   }
 
+  /* Label formats with variables are compiled now, so syntax errors show up
+   * here instead of when the first volume gets labeled. */
+  PoolResource* pool;
+  foreach_res (pool, R_POOL) {
+    const char* format = pool->label_format;
+    if (!format || format[0] == '*' || IsVolumeNameLegal(nullptr, format)) {
+      continue;
+    }
+    std::string error;
+    if (!PrecompileVariableExpansion(format, error)) {
+      Jmsg(nullptr, M_FATAL, 0,
+           T_("Cannot expand LabelFormat \"%s\" of pool %s in file %s: "
+              "ERR=%s\n"),
+           format, pool->resource_name_, configfile_name.c_str(),
+           error.c_str());
+      return false;
+    }
+  }
+
   ConsoleResource* cons;
   foreach_res (cons, R_CONSOLE) {
     if (cons->IsTlsConfigured()) {
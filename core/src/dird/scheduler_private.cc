@@ -38,6 +38,7 @@
 #include "dird/jcr_util.h"
 
 #include <chrono>
+#include <unordered_map>
 #include <utility>
 
 namespace directordaemon {
@@ -200,6 +201,16 @@ void SchedulerPrivate::AddJobsForThisAndNextHourToQueue()
   RunHourValidator next_hour(this_hour.Time() + seconds_per_hour.count());
   next_hour.PrintDebugMessage(local_debuglevel);
 
+  /* Usually many jobs share a few schedules, so every run of a schedule is
+   * only evaluated (and its runtime calculated by mktime()) for the first job
+   * using it. */
+  struct evaluated_run {
+    bool run_this_hour;
+    bool run_next_hour;
+    time_t runtime;
+  };
+  std::unordered_map<const RunResource*, evaluated_run> evaluated_runs;
+
   JobResource* job = nullptr;
 
   foreach_res (job, R_JOB) {
@@ -209,14 +220,23 @@ void SchedulerPrivate::AddJobsForThisAndNextHourToQueue()
 
     for (RunResource* run = job->schedule->run; run != nullptr;
          run = run->next) {
-      bool run_this_hour = this_hour.TriggersOn(run->date_time_bitfield);
-      bool run_next_hour = next_hour.TriggersOn(run->date_time_bitfield);
+      auto [evaluated, first_use] = evaluated_runs.try_emplace(run);
+      if (first_use) {
+        evaluated_run& result = evaluated->second;
+        result.run_this_hour = this_hour.TriggersOn(run->date_time_bitfield);
+        result.run_next_hour = next_hour.TriggersOn(run->date_time_bitfield);
+        if (result.run_this_hour || result.run_next_hour) {
+          result.runtime = CalculateRuntime(this_hour.Time(), run->minute);
+        }
+      }
+      bool run_this_hour = evaluated->second.run_this_hour;
+      bool run_next_hour = evaluated->second.run_next_hour;
 
       Dmsg3(local_debuglevel, "run@%p: run_now=%d run_next_hour=%d\n", run,
             run_this_hour, run_next_hour);
 
       if (run_this_hour || run_next_hour) {
-        time_t runtime = CalculateRuntime(this_hour.Time(), run->minute);
+        time_t runtime = evaluated->second.runtime;
         if (run_this_hour) {
           AddJobToQueue(job, run, this_hour.Time(), runtime,
                         JobTrigger::kScheduler);
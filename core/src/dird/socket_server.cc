@@ -32,9 +32,11 @@
 #include "dird.h"
 #include "dird/dird_globals.h"
 #include "dird/fd_cmds.h"
+#include "dird/socket_server.h"
 #include "dird/ua_server.h"
 #include "lib/berrno.h"
 #include "lib/bnet_server_tcp.h"
+#include "lib/idle_socket_reactor.h"
 #include "lib/thread_list.h"
 #include "lib/thread_specific_data.h"
 #include "lib/try_tls_handshake_as_a_server.h"
@@ -53,6 +55,7 @@ static ThreadList thread_list;
 static std::atomic<bool> server_running;
 static pthread_t tcp_server_tid;
 static std::unique_ptr<connection_pool> client_connections{nullptr};
+static IdleSocketReactor idle_connections;
 
 static std::atomic<BnetServerState> server_state(BnetServerState::kUndefined);
 
@@ -125,6 +128,24 @@ static void* UserAgentShutdownCallback(void* bsock)
   return nullptr;
 }
 
+bool ResumeWhenReadable(BareosSocket* bs,
+                        std::function<void()> serve,
+                        std::function<void()> abandon)
+{
+  return idle_connections.Park(
+      bs->fd_, [bs, serve = std::move(serve),
+                abandon = std::move(abandon)](bool stop) {
+        auto handler = [serve](ConfigurationParser*, void*) -> void* {
+          serve();
+          return nullptr;
+        };
+        if (stop
+            || !thread_list.CreateAndAddNewThread(my_config, bs, handler)) {
+          abandon();
+        }
+      });
+}
+
 static void CleanupConnectionPool()
 {
   if (client_connections) { client_connections->cleanup(); }
@@ -186,6 +207,9 @@ bool StartSocketServer(std::vector<s_sockfd>&& bound_sockets)
     if (client_connections) { client_connections.reset(nullptr); }
     return false;
   }
+  if (!idle_connections.Start()) {
+    Dmsg0(100, "Idle console connections keep their threads\n");
+  }
   return true;
 }
 
@@ -198,6 +222,7 @@ bool StartSocketServer(dlist<IPADDR>* addrs)
 
 void StopSocketServer()
 {
+  idle_connections.Stop(); /* closes the parked connections */
   if (server_running) {
     BnetStopAndWaitForThreadServerTcp(tcp_server_tid);
     server_running = false;
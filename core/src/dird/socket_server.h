@@ -22,11 +22,13 @@
 #ifndef BAREOS_DIRD_SOCKET_SERVER_H_
 #define BAREOS_DIRD_SOCKET_SERVER_H_
 
+#include <functional>
 #include <vector>
 #include "lib/bnet_server_tcp.h"
 
 template <typename T> class dlist;
 class IPADDR;
+class BareosSocket;
 
 namespace directordaemon {
 
@@ -34,5 +36,13 @@ bool StartSocketServer(dlist<IPADDR>* addrs);
 bool StartSocketServer(std::vector<s_sockfd>&& bound_sockets);
 void StopSocketServer();
 
+/* Watches the idle connection bs without a thread.  Once it is readable,
+ * serve runs in a new thread of the socket server; abandon runs instead if
+ * the server stops first.  Returns false if the connection cannot be
+ * parked, then neither is called. */
+bool ResumeWhenReadable(BareosSocket* bs,
+                        std::function<void()> serve,
+                        std::function<void()> abandon);
+
 } /* namespace directordaemon */
 #endif  // BAREOS_DIRD_SOCKET_SERVER_H_
@@ -38,6 +38,14 @@
 #include "lib/parse_conf.h"
 #include "lib/util.h"
 #include "lib/berrno.h"
+#include "lib/thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace directordaemon {
 
@@ -59,46 +67,54 @@ static pthread_t statistics_tid;
 static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t wait_for_next_run_cond = PTHREAD_COND_INITIALIZER;
 
-// Cache the last lookup of a DeviceId.
-static struct cached_device {
-  char device_name[MAX_NAME_LENGTH];
-  DBId_t StorageId;
-  DBId_t DeviceId;
-} cached_device;
+// The storage daemons are asked for their statistics by this many threads.
+static constexpr std::size_t max_polling_threads = 8;
+
+/* Once per hour the samples older than an hour are thinned out to one per
+ * minute, the ones older than a week to one per hour and the ones older than
+ * the StatisticsRetention are deleted. */
+static constexpr time_t maintenance_interval = 60 * 60;
+static constexpr time_t minute_samples_after = 60 * 60;
+static constexpr time_t hour_samples_after = 7 * 24 * 60 * 60;
+
+// The samples of one storage daemon, by device name.
+struct storage_statistics {
+  std::string storage;
+  DBId_t StorageId{};
+  std::vector<std::pair<std::string, DeviceStatisticsDbRecord>> devices;
+  std::vector<std::pair<std::string, TapealertStatsDbRecord>> tape_alerts;
+  std::vector<std::pair<std::string, JobStatisticsDbRecord>> jobs;
+};
+
+// Cache the DeviceIds by StorageId and device name.
+static std::map<std::pair<DBId_t, std::string>, DBId_t> device_ids;
 
 static inline bool LookupDevice(JobControlRecord* jcr,
-                                const char* device_name,
+                                const std::string& device_name,
                                 DBId_t StorageId,
                                 DBId_t* DeviceId)
 {
   DeviceDbRecord dr;
 
-  if (cached_device.StorageId == StorageId
-      && bstrcmp(cached_device.device_name, device_name)) {
-    *DeviceId = cached_device.DeviceId;
+  auto cached = device_ids.find({StorageId, device_name});
+  if (cached != device_ids.end()) {
+    *DeviceId = cached->second;
     return true;
   }
 
   dr.StorageId = StorageId;
-  bstrncpy(dr.Name, device_name, sizeof(dr.Name));
+  bstrncpy(dr.Name, device_name.c_str(), sizeof(dr.Name));
   if (!jcr->db->CreateDeviceRecord(jcr, &dr)) {
     Dmsg0(100, "Failed to create new Device record\n");
-    goto bail_out;
+    return false;
   }
 
   Dmsg3(200, "Deviceid of \"%s\" on StorageId %d is %d\n", dr.Name,
         dr.StorageId, dr.DeviceId);
 
-  bstrncpy(cached_device.device_name, device_name,
-           sizeof(cached_device.device_name));
-  cached_device.StorageId = StorageId;
-  cached_device.DeviceId = dr.DeviceId;
-
+  device_ids[{StorageId, device_name}] = dr.DeviceId;
   *DeviceId = dr.DeviceId;
   return true;
-
-bail_out:
-  return false;
 }
 
 static inline void wait_for_next_run()
@@ -115,16 +131,216 @@ static inline void wait_for_next_run()
   unlock_mutex(mutex);
 }
 
+// Parse one statistics message of a storage daemon.
+static void ParseStatistics(JobControlRecord* jcr,
+                            const char* msg,
+                            storage_statistics& stats)
+{
+  if (bstrncmp(msg, "Devicestats", 10)) {
+    PoolMem DevName(PM_NAME);
+    DeviceStatisticsDbRecord dsr;
+
+    if (sscanf(msg, DevStats, &dsr.SampleTime, DevName.c_str(),
+               &dsr.ReadBytes, &dsr.WriteBytes, &dsr.SpoolSize,
+               &dsr.NumWaiting, &dsr.NumWriters, &dsr.ReadTime,
+               &dsr.WriteTime, &dsr.MediaId, &dsr.VolCatBytes,
+               &dsr.VolCatFiles, &dsr.VolCatBlocks)
+        == 13) {
+      Dmsg5(200,
+            "New Devstats [%lld]: Device=%s Read=%llu, Write=%llu, "
+            "SpoolSize=%llu,\n",
+            dsr.SampleTime, DevName.c_str(), dsr.ReadBytes, dsr.WriteBytes,
+            dsr.SpoolSize);
+      Dmsg4(200,
+            "NumWaiting=%lu, NumWriters=%lu, ReadTime=%lld, "
+            "WriteTime=%lld,\n",
+            dsr.NumWaiting, dsr.NumWriters, dsr.ReadTime, dsr.WriteTime);
+      Dmsg4(200, "MediaId=%ld, VolBytes=%llu, VolFiles=%llu, VolBlocks=%llu\n",
+            dsr.MediaId, dsr.VolCatBytes, dsr.VolCatFiles, dsr.VolCatBlocks);
+
+      stats.devices.emplace_back(DevName.c_str(), dsr);
+    } else {
+      Jmsg1(jcr, M_ERROR, 0, T_("Malformed message: %s\n"), msg);
+    }
+  } else if (bstrncmp(msg, "Tapealerts", 10)) {
+    PoolMem DevName(PM_NAME);
+    TapealertStatsDbRecord tsr;
+
+    if (sscanf(msg, TapeAlerts, &tsr.SampleTime, DevName.c_str(),
+               &tsr.AlertFlags)
+        == 3) {
+      UnbashSpaces(DevName);
+
+      Dmsg3(200, "New stats [%lld]: Device %s TapeAlert %llu\n",
+            tsr.SampleTime, DevName.c_str(), tsr.AlertFlags);
+
+      stats.tape_alerts.emplace_back(DevName.c_str(), tsr);
+    } else {
+      Jmsg1(jcr, M_ERROR, 0, T_("Malformed message: %s\n"), msg);
+    }
+  } else if (bstrncmp(msg, "Jobstats", 8)) {
+    PoolMem DevName(PM_NAME);
+    JobStatisticsDbRecord jsr;
+
+    if (sscanf(msg, JobStats, &jsr.SampleTime, &jsr.JobId, &jsr.JobFiles,
+               &jsr.JobBytes, DevName.c_str())
+        == 5) {
+      UnbashSpaces(DevName);
+
+      Dmsg5(200,
+            "New Jobstats [%lld]: JobId %ld, JobFiles %lu, JobBytes "
+            "%llu, DevName %s\n",
+            jsr.SampleTime, jsr.JobId, jsr.JobFiles, jsr.JobBytes,
+            DevName.c_str());
+
+      stats.jobs.emplace_back(DevName.c_str(), jsr);
+    } else {
+      Jmsg1(jcr, M_ERROR, 0, T_("Malformed message: %s\n"), msg);
+    }
+  }
+}
+
+// Retrieve the statistics from the remote SD.
+static void PollStorage(storage_statistics& stats)
+{
+  JobControlRecord* jcr = new_control_jcr("*StatisticsCollector*", JT_SYSTEM);
+  BareosSocket* sd = nullptr;
+
+  {
+    ResLocker _{my_config};
+    StorageResource* store = (StorageResource*)my_config->GetResWithName(
+        R_STORAGE, stats.storage.c_str());
+    if (store) {
+      jcr->dir_impl->res.read_storage = store;
+      if (ConnectToStorageDaemon(jcr, 2, 1, false)) {
+        stats.StorageId = store->StorageId;
+        sd = jcr->store_bsock;
+      }
+    }
+  }
+
+  if (sd) {
+    if (sd->fsend("stats")) {
+      while (BnetRecv(sd) >= 0) {
+        Dmsg1(200, "<stored: %s", sd->msg);
+        ParseStatistics(jcr, sd->msg, stats);
+      }
+    }
+
+    jcr->store_bsock->close();
+    delete jcr->store_bsock;
+    jcr->store_bsock = NULL;
+  }
+
+  FreeJcr(jcr);
+}
+
+// Ask all storage daemons for their statistics at the same time.
+static std::vector<storage_statistics> PollStorages()
+{
+  std::vector<storage_statistics> storages;
+  {
+    ResLocker _{my_config};
+    StorageResource* store;
+    foreach_res (store, R_STORAGE) {
+      if (!store->collectstats || store->Protocol != APT_NATIVE) { continue; }
+      storages.emplace_back().storage = store->resource_name_;
+    }
+  }
+
+  std::size_t num_threads = std::min(max_polling_threads, storages.size());
+  if (num_threads <= 1) {
+    for (storage_statistics& stats : storages) { PollStorage(stats); }
+  } else {
+    std::atomic<std::size_t> next{0};
+    thread_pool threads;
+    for (std::size_t i = 0; i < num_threads; ++i) {
+      threads.borrow_thread([&storages, &next] {
+        for (std::size_t j; (j = next++) < storages.size();) {
+          PollStorage(storages[j]);
+        }
+      });
+    }
+  }
+
+  return storages;
+}
+
+// Resolve the DeviceIds of the samples of one storage daemon.
+template <typename Record>
+static std::vector<Record> ResolveDevices(
+    JobControlRecord* jcr,
+    std::vector<std::pair<std::string, Record>>& samples,
+    DBId_t StorageId)
+{
+  std::vector<Record> records;
+  records.reserve(samples.size());
+  for (auto& [device_name, record] : samples) {
+    if (!LookupDevice(jcr, device_name, StorageId, &record.DeviceId)) {
+      continue;
+    }
+    records.push_back(record);
+  }
+  return records;
+}
+
+// Insert the samples of one storage daemon with one statement per table.
+static void StoreStatistics(JobControlRecord* jcr, storage_statistics& stats)
+{
+  if (!stats.StorageId) { return; }
+
+  std::vector devices = ResolveDevices(jcr, stats.devices, stats.StorageId);
+  if (!devices.empty()) {
+    jcr->db->CreateDeviceStatistics(jcr, devices.data(), devices.size());
+  }
+
+  std::vector alerts = ResolveDevices(jcr, stats.tape_alerts, stats.StorageId);
+  if (!alerts.empty()) {
+    jcr->db->CreateTapealertStatistics(jcr, alerts.data(), alerts.size());
+  }
+
+  std::vector jobs = ResolveDevices(jcr, stats.jobs, stats.StorageId);
+  if (!jobs.empty()) {
+    jcr->db->CreateJobStatistics(jcr, jobs.data(), jobs.size());
+  }
+}
+
+/* Thin out and prune the samples.  Only the samples that got old enough
+ * since the last run are looked at, the first run looks at all of them.  The
+ * ranges start at full hours so that no minute or hour is split. */
+static void MaintainStatistics(JobControlRecord* jcr,
+                               time_t now,
+                               time_t last_run)
+{
+  time_t hour = now - now % 3600;
+  time_t last_hour = last_run - last_run % 3600;
+
+  int thinned_minutes = jcr->db->DownsampleStatistics(
+      jcr, "minute", last_run ? last_hour - minute_samples_after : 0,
+      hour - minute_samples_after);
+  int thinned_hours = jcr->db->DownsampleStatistics(
+      jcr, "hour", last_run ? last_hour - hour_samples_after : 0,
+      hour - hour_samples_after);
+  int pruned = 0;
+  if (me->stats_retention) {
+    pruned = jcr->db->PruneStatistics(jcr, now - me->stats_retention);
+  }
+
+  Dmsg3(200,
+        "statistics_thread: thinned out %d minute and %d hour samples, "
+        "pruned %d samples\n",
+        thinned_minutes, thinned_hours, pruned);
+}
+
 extern "C" void* statistics_thread(void*)
 {
   JobControlRecord* jcr;
   utime_t now;
-  PoolMem current_store(PM_NAME);
+  time_t last_maintenance = 0;
 
   Dmsg0(200, "Starting statistics thread\n");
 
-  memset(&cached_device, 0, sizeof(struct cached_device));
-  PmStrcpy(current_store, "");
+  device_ids.clear();
 
   jcr = new_control_jcr("*StatisticsCollector*", JT_SYSTEM);
 
@@ -142,6 +358,11 @@ extern "C" void* statistics_thread(void*)
 
     Dmsg1(200, "statistics_thread: Doing work at %ld\n", now);
 
+    if (now >= last_maintenance + maintenance_interval) {
+      MaintainStatistics(jcr, now, last_maintenance);
+      last_maintenance = now;
+    }
+
     if (JobCount() == 0) {
       if (!need_flush) {
         Dmsg0(200, "statistics_thread: do nothing as no jobs are running\n");
@@ -155,144 +376,16 @@ extern "C" void* statistics_thread(void*)
       need_flush = true;
     }
 
-    while (1) {
-      BareosSocket* sd;
-      StorageResource* store;
-      int64_t StorageId;
-
-      {
-        ResLocker _{my_config};
-        if ((current_store.c_str())[0]) {
-          store = (StorageResource*)my_config->GetResWithName(
-              R_STORAGE, current_store.c_str());
-        } else {
-          store = NULL;
-        }
-
-        store = (StorageResource*)my_config->GetNextRes(R_STORAGE,
-                                                        (BareosResource*)store);
-        if (!store) {
-          PmStrcpy(current_store, "");
-          break;
-        }
-
-        PmStrcpy(current_store, store->resource_name_);
-        if (!store->collectstats) { continue; }
-
-        switch (store->Protocol) {
-          case APT_NATIVE:
-            break;
-          default:
-            continue;
-        }
-
-        jcr->dir_impl->res.read_storage = store;
-        if (!ConnectToStorageDaemon(jcr, 2, 1, false)) { continue; }
-
-        StorageId = store->StorageId;
-        sd = jcr->store_bsock;
-      }
-
-      // Do our work retrieving the statistics from the remote SD.
-      if (sd->fsend("stats")) {
-        while (BnetRecv(sd) >= 0) {
-          Dmsg1(200, "<stored: %s", sd->msg);
-          if (bstrncmp(sd->msg, "Devicestats", 10)) {
-            PoolMem DevName(PM_NAME);
-            DeviceStatisticsDbRecord dsr;
-
-            if (sscanf(sd->msg, DevStats, &dsr.SampleTime, DevName.c_str(),
-                       &dsr.ReadBytes, &dsr.WriteBytes, &dsr.SpoolSize,
-                       &dsr.NumWaiting, &dsr.NumWriters, &dsr.ReadTime,
-                       &dsr.WriteTime, &dsr.MediaId, &dsr.VolCatBytes,
-                       &dsr.VolCatFiles, &dsr.VolCatBlocks)
-                == 13) {
-              Dmsg5(200,
-                    "New Devstats [%lld]: Device=%s Read=%llu, Write=%llu, "
-                    "SpoolSize=%llu,\n",
-                    dsr.SampleTime, DevName.c_str(), dsr.ReadBytes,
-                    dsr.WriteBytes, dsr.SpoolSize);
-              Dmsg4(200,
-                    "NumWaiting=%lu, NumWriters=%lu, ReadTime=%lld, "
-                    "WriteTime=%lld,\n",
-                    dsr.NumWaiting, dsr.NumWriters, dsr.ReadTime,
-                    dsr.WriteTime);
-              Dmsg4(
-                  200,
-                  "MediaId=%ld, VolBytes=%llu, VolFiles=%llu, VolBlocks=%llu\n",
-                  dsr.MediaId, dsr.VolCatBytes, dsr.VolCatFiles,
-                  dsr.VolCatBlocks);
-
-              if (!LookupDevice(jcr, DevName.c_str(), StorageId,
-                                &dsr.DeviceId)) {
-                continue;
-              }
-
-              if (!jcr->db->CreateDeviceStatistics(jcr, &dsr)) { continue; }
-            } else {
-              Jmsg1(jcr, M_ERROR, 0, T_("Malformed message: %s\n"), sd->msg);
-            }
-          } else if (bstrncmp(sd->msg, "Tapealerts", 10)) {
-            PoolMem DevName(PM_NAME);
-            TapealertStatsDbRecord tsr;
-
-            if (sscanf(sd->msg, TapeAlerts, &tsr.SampleTime, DevName.c_str(),
-                       &tsr.AlertFlags)
-                == 3) {
-              UnbashSpaces(DevName);
-
-              Dmsg3(200, "New stats [%lld]: Device %s TapeAlert %llu\n",
-                    tsr.SampleTime, DevName.c_str(), tsr.AlertFlags);
-
-              if (!LookupDevice(jcr, DevName.c_str(), StorageId,
-                                &tsr.DeviceId)) {
-                continue;
-              }
-
-              if (!jcr->db->CreateTapealertStatistics(jcr, &tsr)) { continue; }
-            } else {
-              Jmsg1(jcr, M_ERROR, 0, T_("Malformed message: %s\n"), sd->msg);
-            }
-          } else if (bstrncmp(sd->msg, "Jobstats", 8)) {
-            PoolMem DevName(PM_NAME);
-            JobStatisticsDbRecord jsr;
-
-            if (sscanf(sd->msg, JobStats, &jsr.SampleTime, &jsr.JobId,
-                       &jsr.JobFiles, &jsr.JobBytes, DevName.c_str())
-                == 5) {
-              UnbashSpaces(DevName);
-
-              Dmsg5(200,
-                    "New Jobstats [%lld]: JobId %ld, JobFiles %lu, JobBytes "
-                    "%llu, DevName %s\n",
-                    jsr.SampleTime, jsr.JobId, jsr.JobFiles, jsr.JobBytes,
-                    DevName.c_str());
-
-              if (!LookupDevice(jcr, DevName.c_str(), StorageId,
-                                &jsr.DeviceId)) {
-                continue;
-              }
-
-              if (!jcr->db->CreateJobStatistics(jcr, &jsr)) { continue; }
-            } else {
-              Jmsg1(jcr, M_ERROR, 0, T_("Malformed message: %s\n"), sd->msg);
-            }
-          }
-        }
-      }
-
-      jcr->store_bsock->close();
-      delete jcr->store_bsock;
-      jcr->store_bsock = NULL;
-
-    }  // while (1)
+    for (storage_statistics& stats : PollStorages()) {
+      StoreStatistics(jcr, stats);
+    }
 
     wait_for_next_run();
 
   }  // while(!quit)
 
 bail_out:
-  jcr->db->CloseDatabase(jcr);
+  DbSqlClosePooledConnection(jcr, jcr->db);
   jcr->db = nullptr;
   FreeJcr(jcr);
 
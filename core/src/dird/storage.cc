@@ -444,7 +444,7 @@ bool HasPairedStorage(JobControlRecord* jcr)
   return true;
 }
 
-#define MAX_TRIES 6 * 360 /* 6 hours (10 sec intervals) */
+static constexpr time_t max_read_storage_wait = 6 * 60 * 60; /* 6 hours */
 
 // Change the read storage resource for the current job.
 bool SelectNextRstore(JobControlRecord* jcr, bootstrap_info& info)
@@ -477,14 +477,16 @@ bool SelectNextRstore(JobControlRecord* jcr, bootstrap_info& info)
   SetRstorage(jcr, &ustore);
   jcr->setJobStatusWithPriorityCheck(JS_WaitSD);
 
-  // Wait for up to 6 hours to increment read stoage counter
-  for (int i = 0; i < MAX_TRIES; i++) {
+  /* Wait for up to 6 hours to increment read storage counter, a job that
+   * gives back a slot ends the wait at once. */
+  const time_t deadline = time(nullptr) + max_read_storage_wait;
+  while (time(nullptr) < deadline) {
     // Try to get read storage counter incremented
     if (IncReadStore(jcr)) {
       jcr->setJobStatusWithPriorityCheck(JS_Running);
       return true;
     }
-    Bmicrosleep(10, 0); /* Sleep 10 secs */
+    WaitForResourceRelease(jcr, 10);
     if (jcr->IsJobCanceled()) {
       FreeRstorage(jcr);
       return false;
@@ -34,6 +34,7 @@ UaContext::UaContext(bool console_connected)
     , db(nullptr)
     , shared_db(nullptr)
     , private_db(nullptr)
+    , replica_db(nullptr)
     , catalog(nullptr)
     , user_acl(nullptr)
     , cmd(nullptr)
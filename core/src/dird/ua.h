@@ -31,6 +31,7 @@
 
 #include "include/bareos.h"
 #include "lib/bsock.h"
+#include "lib/tree_find.h"
 
 class JobControlRecord;
 class BareosDb;
@@ -62,6 +63,7 @@ class UaContext {
   BareosDb* db;
   BareosDb* shared_db;  /**< Shared database connection used by multiple ua's */
   BareosDb* private_db; /**< Private database connection only used by this ua */
+  BareosDb* replica_db; /**< Connection to the replica for read-only queries */
   CatalogResource* catalog;
   UserAcl* user_acl;              /**< acl from console or user resource */
   POOLMEM* cmd;                   /**< Return command/name buffer */
@@ -82,6 +84,7 @@ class UaContext {
   bool verbose;                   /**< Set for normal UA verbosity */
   bool batch;                     /**< Set for non-interactive mode */
   bool gui;                       /**< Set if talking to GUI program */
+  bool compress_messages{false};  /**< Compress after the current command */
   bool runscript;                 /**< Set if we are in runscript */
   uint32_t pint32_val;            /**< Positive integer */
   int32_t int32_val;              /**< Positive/negative */
@@ -174,6 +177,7 @@ struct TreeContext {
   uint32_t FileCount = 0;    /**< Current count of files */
   uint32_t LastCount = 0;    /**< Last count of files */
   uint32_t DeltaCount = 0;   /**< Trigger for printing */
+  TreeNameIndex names{};     /**< For find, built by its first use */
 
   TreeContext() = default;
   ~TreeContext() = default;
@@ -219,6 +223,9 @@ struct RestoreContext {
   char* replace = nullptr;
   char* plugin_options = nullptr;
   std::unique_ptr<RestoreBootstrapRecord> bsr;
+  uint32_t sessions = 1; /**< Restore jobs the selection is split over */
+  std::vector<std::unique_ptr<RestoreBootstrapRecord>> session_bsrs{};
+  std::vector<std::string> restore_clients{}; /**< Taking turns by session */
   POOLMEM* fname = nullptr; /**< Filename only */
   POOLMEM* path = nullptr;  /**< Path only */
   POOLMEM* query = nullptr;
@@ -226,6 +233,7 @@ struct RestoreContext {
   int pnl = 0; /**< Path length */
   bool found = false;
   bool all = false; /**< Mark all as default */
+  bool restores_versions = false; /**< Of a file from more than one job */
   NameList name_list;
 
   RestoreContext() = default;
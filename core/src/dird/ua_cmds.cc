@@ -92,6 +92,7 @@ extern bool DotJobsCmd(UaContext* ua, const char* cmd);
 extern bool DotJobstatusCmd(UaContext* ua, const char* cmd);
 extern bool DotFilesetsCmd(UaContext* ua, const char* cmd);
 extern bool DotClientsCmd(UaContext* ua, const char* cmd);
+extern bool DotCompressCmd(UaContext* ua, const char* cmd);
 extern bool DotConsolesCmd(UaContext* ua, const char* cmd);
 extern bool DotUsersCmd(UaContext* ua, const char* cmd);
 extern bool DotMsgsCmd(UaContext* ua, const char* cmd);
@@ -110,6 +111,7 @@ extern bool DotProfilesCmd(UaContext* ua, const char* cmd);
 extern bool DotAopCmd(UaContext* ua, const char* cmd);
 extern bool DotBvfsLsdirsCmd(UaContext* ua, const char* cmd);
 extern bool DotBvfsLsfilesCmd(UaContext* ua, const char* cmd);
+extern bool DotBvfsFindCmd(UaContext* ua, const char* cmd);
 extern bool DotBvfsUpdateCmd(UaContext* ua, const char* cmd);
 extern bool DotBvfsGetJobidsCmd(UaContext* ua, const char* cmd);
 extern bool DotBvfsVersionsCmd(UaContext* ua, const char* cmd);
@@ -230,6 +232,8 @@ static struct ua_cmdstruct commands[] = {
      false, false},
     {NT_(".clients"), DotClientsCmd, T_("List all client resources"),
      NT_("[enabled | disabled]"), true, false},
+    {NT_(".compress"), DotCompressCmd,
+     T_("Compress the messages of this connection"), NULL, false, false},
     {NT_(".consoles"), DotConsolesCmd, T_("List all console resources"), NULL,
      true, false},
     {NT_(".users"), DotUsersCmd, T_("List all user resources"), NULL, true,
@@ -281,11 +285,15 @@ static struct ua_cmdstruct commands[] = {
      true, false},
     {NT_(".bvfs_lsdirs"), DotBvfsLsdirsCmd, T_("List directories using BVFS"),
      NT_("jobid=<jobid> path=<path> | pathid=<pathid> [limit=<limit>] "
-         "[offset=<offset>]"),
+         "[offset=<offset> | after=<fullpath>]"),
      true, true},
     {NT_(".bvfs_lsfiles"), DotBvfsLsfilesCmd, T_("List files using BVFS"),
      NT_("jobid=<jobid> path=<path> | pathid=<pathid> [limit=<limit>] "
-         "[offset=<offset>]"),
+         "[offset=<offset> | after=<name>]"),
+     true, true},
+    {NT_(".bvfs_find"), DotBvfsFindCmd,
+     T_("Find files of all directories using BVFS"),
+     NT_("jobid=<jobid> pattern=<pattern> [limit=<limit>] [offset=<offset>]"),
      true, true},
     {NT_(".bvfs_update"), DotBvfsUpdateCmd, T_("Update BVFS cache"),
      NT_("[jobid=<jobid>]"), true, true},
@@ -334,7 +342,7 @@ static struct ua_cmdstruct commands[] = {
     {NT_("estimate"), EstimateCmd,
      T_("Performs FileSet estimate, listing gives full listing"),
      NT_("fileset=<fileset-name> client=<client-name> level=<level> "
-         "accurate=<yes/no> job=<job-name> listing"),
+         "accurate=<yes/no> job=<job-name> listing cached"),
      true, true},
     {NT_("exit"), quit_cmd, T_("Terminate Bconsole session"), NT_(""), false,
      false},
@@ -407,7 +415,8 @@ static struct ua_cmdstruct commands[] = {
          "replace=<always|never|ifolder|ifnewer> "
          "pluginoptions=<plugin-options-string> "
          "regexwhere=<regex> fileregex=<regex> "
-         "restoreclient=<client-name> backupformat=<format> "
+         "restoreclient=<client-name>[,<client-name>...] "
+         "sessions=<number> backupformat=<format> "
          "pool=<pool-name> file=<filename> directory=<directory> "
          "before=<date> "
          "strip_prefix=<prefix> add_prefix=<prefix> add_suffix=<suffix> "
@@ -428,6 +437,8 @@ static struct ua_cmdstruct commands[] = {
     {NT_("resolve"), ResolveCmd, T_("Resolve a hostname"),
      NT_("client=<client-name> | storage=<storage-name> <host-name>"), false,
      true},
+    {NT_("resume"), ResumeCmd, T_("Resume an incomplete backup"),
+     NT_("jobid=<jobid> [ yes ]"), false, true},
     {NT_("run"), RunCmd, T_("Run a job"),
      NT_("job=<job-name> client=<client-name> fileset=<fileset-name> "
          "level=<level> "
@@ -583,6 +594,7 @@ bool Do_a_command(UaContext* ua)
       if (ua->api) { user->signal(BNET_CMD_BEGIN); }
       ua->send->SetMode(ua->api);
       ok = ua->execute(&commands[i]);
+      LeaveReplicaDb(ua);
       if (ua->api) { user->signal(ok ? BNET_CMD_OK : BNET_CMD_FAILED); }
 
       found = true;
@@ -1092,6 +1104,7 @@ static void DoEnDisableCmd(UaContext* ua, bool setting)
     ua->send->ArrayEnd("jobs");
   }
   ua->send->ObjectEnd(action.c_str());
+  InvalidateScheduledJobs();
 
   ua->WarningMsg(
       T_("%sabling is a temporary operation until the director reloads.\n"
@@ -1716,12 +1729,37 @@ static bool var_cmd(UaContext* ua, const char*)
   return true;
 }
 
+/* Answers an estimate with the files and bytes of the last successful backup
+ * of the job instead of asking the client to scan the FileSet. */
+static bool EstimateFromLastBackup(UaContext* ua, JobResource* job)
+{
+  JobDbRecord jr;
+  char ed1[50], ed2[50], ed3[50];
+
+  jr.JobType = JT_BACKUP;
+  if (!ua->db->FindLastJobid(ua->jcr, job->resource_name_, &jr)
+      || !ua->db->GetJobRecord(ua->jcr, &jr)) {
+    ua->ErrorMsg(T_("No successful backup of Job \"%s\" found.\n"),
+                 job->resource_name_);
+    return false;
+  }
+
+  ua->SendMsg(T_("Using the %s backup JobId=%s of %s.\n"),
+              job_level_to_str(jr.JobLevel), edit_int64(jr.JobId, ed1),
+              jr.cStartTime);
+  ua->SendMsg("2000 OK estimate files=%s bytes=%s\n",
+              edit_uint64_with_commas(jr.JobFiles, ed2),
+              edit_uint64_with_commas(jr.JobBytes, ed3));
+  return true;
+}
+
 static bool EstimateCmd(UaContext* ua, const char*)
 {
   JobResource* job = NULL;
   ClientResource* client = NULL;
   FilesetResource* fileset = NULL;
   int listing = 0;
+  bool cached = false;
   JobControlRecord* jcr = ua->jcr;
   bool accurate_set = false;
   bool accurate = false;
@@ -1776,6 +1814,11 @@ static bool EstimateCmd(UaContext* ua, const char*)
       continue;
     }
 
+    if (Bstrcasecmp(ua->argk[i], NT_("cached"))) {
+      cached = true;
+      continue;
+    }
+
     if (Bstrcasecmp(ua->argk[i], NT_("level"))) {
       if (ua->argv[i]) {
         if (!GetLevelFromName(jcr, ua->argv[i])) {
@@ -1859,6 +1902,14 @@ static bool EstimateCmd(UaContext* ua, const char*)
 
   if (!OpenDb(ua)) { return false; }
 
+  if (cached) {
+    if (listing) {
+      ua->ErrorMsg(T_("A cached estimate cannot list the files.\n"));
+      return false;
+    }
+    return EstimateFromLastBackup(ua, job);
+  }
+
   jcr->dir_impl->res.job = job;
   jcr->setJobType(JT_BACKUP);
   jcr->start_time = time(NULL);
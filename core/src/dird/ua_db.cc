@@ -33,6 +33,9 @@
 #include "cats/sql_pooling.h"
 #include "dird/ua_select.h"
 
+#include <map>
+#include <mutex>
+
 namespace directordaemon {
 
 /* Imported subroutines */
@@ -45,7 +48,7 @@ namespace directordaemon {
  * have a catalog, look for a Job keyword and get the
  * catalog from its client record.
  */
-bool OpenClientDb(UaContext* ua, bool use_private)
+bool OpenClientDb(UaContext* ua, bool use_private, bool read_only)
 {
   int i;
   CatalogResource* catalog;
@@ -59,7 +62,7 @@ bool OpenClientDb(UaContext* ua, bool use_private)
     if (catalog) {
       if (ua->catalog && ua->catalog != catalog) { CloseDb(ua); }
       ua->catalog = catalog;
-      return OpenDb(ua, use_private);
+      return OpenDb(ua, use_private, read_only);
     }
   }
 
@@ -76,7 +79,7 @@ bool OpenClientDb(UaContext* ua, bool use_private)
         return false;
       }
       ua->catalog = catalog;
-      return OpenDb(ua, use_private);
+      return OpenDb(ua, use_private, read_only);
     }
   }
 
@@ -93,15 +96,15 @@ bool OpenClientDb(UaContext* ua, bool use_private)
         return false;
       }
       ua->catalog = catalog;
-      return OpenDb(ua, use_private);
+      return OpenDb(ua, use_private, read_only);
     }
   }
 
-  return OpenDb(ua, use_private);
+  return OpenDb(ua, use_private, read_only);
 }
 
 // Open the catalog database.
-bool OpenDb(UaContext* ua, bool use_private)
+static bool OpenPrimaryDb(UaContext* ua, bool use_private)
 {
   bool mult_db_conn;
 
@@ -144,6 +147,8 @@ bool OpenDb(UaContext* ua, bool use_private)
                  ua->catalog->db_name);
     return false;
   }
+  ua->db->SetPurgeChunks(ua->catalog->purge_chunk_size,
+                         ua->catalog->purge_chunk_pause);
   ua->jcr->db = ua->db;
 
   /* Save the new database connection under the right label e.g. shared or
@@ -162,6 +167,78 @@ bool OpenDb(UaContext* ua, bool use_private)
   return true;
 }
 
+/* A replica that could not be connected to is not tried again for a while,
+ * so the queries do not all wait for the connect to fail first. */
+static constexpr time_t replica_retry_interval = 60;
+static std::mutex replica_retry_mutex;
+static std::map<std::string, time_t> replica_retry_after;
+
+// Point ua->db to the replica of the catalog, if it is recent enough.
+static bool OpenReplicaDb(UaContext* ua)
+{
+  CatalogResource* catalog = ua->catalog;
+  if (!catalog->replica_address) { return false; }
+
+  if (!ua->replica_db) {
+    time_t now = time(nullptr);
+    {
+      std::lock_guard lock(replica_retry_mutex);
+      auto retry = replica_retry_after.find(catalog->resource_name_);
+      if (retry != replica_retry_after.end() && now < retry->second) {
+        return false;
+      }
+    }
+
+    /* A failing replica must never end the director, whatever the catalog
+     * says about fatal errors. */
+    ua->replica_db = DbSqlGetPooledConnection(
+        ua->jcr, catalog->db_driver, catalog->db_name, catalog->db_user,
+        catalog->db_password.value, catalog->replica_address,
+        catalog->replica_port ? catalog->replica_port : catalog->db_port,
+        nullptr, catalog->mult_db_connections, true, catalog->try_reconnect,
+        false, false);
+    if (!ua->replica_db) {
+      Dmsg2(100, "Could not open the replica %s of catalog %s\n",
+            catalog->replica_address, catalog->resource_name_);
+      std::lock_guard lock(replica_retry_mutex);
+      replica_retry_after[catalog->resource_name_]
+          = now + replica_retry_interval;
+      return false;
+    }
+  }
+
+  int64_t lag = 0;
+  if (!ua->replica_db->GetReplicationLag(ua->jcr, lag) || lag < 0
+      || lag > catalog->replica_max_lag) {
+    Dmsg2(100, "Not using the replica of catalog %s, it lags %lld seconds\n",
+          catalog->resource_name_, lag);
+    return false;
+  }
+
+  ua->db = ua->replica_db;
+  return true;
+}
+
+/**
+ * Open the catalog database.  With read_only the queries go to the replica
+ * of the catalog if it has one that is recent enough, until the command
+ * is done.
+ */
+bool OpenDb(UaContext* ua, bool use_private, bool read_only)
+{
+  if (!OpenPrimaryDb(ua, use_private)) { return false; }
+  if (read_only) { OpenReplicaDb(ua); }
+  return true;
+}
+
+// Point ua->db back to the primary database once a command is done.
+void LeaveReplicaDb(UaContext* ua)
+{
+  if (ua->db && ua->db == ua->replica_db) {
+    ua->db = ua->jcr ? ua->jcr->db : nullptr;
+  }
+}
+
 void CloseDb(UaContext* ua)
 {
   if (ua->jcr) { ua->jcr->db = NULL; }
@@ -175,6 +252,11 @@ void CloseDb(UaContext* ua)
     DbSqlClosePooledConnection(ua->jcr, ua->private_db);
     ua->private_db = NULL;
   }
+
+  if (ua->replica_db) {
+    DbSqlClosePooledConnection(ua->jcr, ua->replica_db);
+    ua->replica_db = NULL;
+  }
 }
 
 /**
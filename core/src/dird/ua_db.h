@@ -24,8 +24,11 @@
 
 namespace directordaemon {
 
-bool OpenClientDb(UaContext* ua, bool use_private = false);
-bool OpenDb(UaContext* ua, bool use_private = false);
+bool OpenClientDb(UaContext* ua,
+                  bool use_private = false,
+                  bool read_only = false);
+bool OpenDb(UaContext* ua, bool use_private = false, bool read_only = false);
+void LeaveReplicaDb(UaContext* ua);
 void CloseDb(UaContext* ua);
 int CreatePool(JobControlRecord* jcr,
                BareosDb* db,
@@ -45,6 +45,7 @@
 #include "dird/storage.h"
 #include "include/auth_protocol_types.h"
 #include "lib/attribs.h"
+#include "lib/bsock_compression.h"
 #include "lib/edit.h"
 #include "lib/parse_conf.h"
 #include "lib/util.h"
@@ -269,7 +270,8 @@ static bool BvfsParseArg(UaContext* ua,
                          char** path,
                          char** jobid,
                          int* limit,
-                         int* offset)
+                         int* offset,
+                         bool read_only = true)
 {
   *pathid = 0;
   *limit = 2000;
@@ -307,7 +309,7 @@ static bool BvfsParseArg(UaContext* ua,
 
   if (!((*pathid || *path) && *jobid)) { return false; }
 
-  if (!OpenClientDb(ua, true)) { return false; }
+  if (!OpenClientDb(ua, true, read_only)) { return false; }
 
   return true;
 }
@@ -416,7 +418,7 @@ bool DotBvfsRestoreCmd(UaContext* ua, const char*)
   PoolMem filtered_jobids(PM_FNAME);
 
   fileid = dirid = hardlink = empty;
-  if (!BvfsParseArg(ua, &pathid, &path, &jobid, &limit, &offset)) {
+  if (!BvfsParseArg(ua, &pathid, &path, &jobid, &limit, &offset, false)) {
     ua->ErrorMsg("Can't find jobid, pathid or path argument\n");
     return false; /* not enough param */
   }
@@ -445,6 +447,7 @@ bool DotBvfsRestoreCmd(UaContext* ua, const char*)
 /**
  * .bvfs_lsfiles jobid=1,2,3,4 path=/
  * .bvfs_lsfiles jobid=1,2,3,4 pathid=10
+ * .bvfs_lsfiles jobid=1,2,3,4 pathid=10 limit=1000 after=<name>
  */
 bool DotBvfsLsfilesCmd(UaContext* ua, const char*)
 {
@@ -481,7 +484,9 @@ bool DotBvfsLsfilesCmd(UaContext* ua, const char*)
   }
 
   fs.SetOffset(offset);
+  if ((i = FindArgWithValue(ua, "after")) >= 0) { fs.SetAfter(ua->argv[i]); }
 
+  ua->send->SetStreaming(true);
   ua->send->ArrayStart("files");
   fs.ls_files();
   ua->send->ArrayEnd("files");
@@ -489,10 +494,62 @@ bool DotBvfsLsfilesCmd(UaContext* ua, const char*)
   return true;
 }
 
+/**
+ * .bvfs_find jobid=1,2,3,4 pattern=*.conf
+ * .bvfs_find jobid=1,2,3,4 pattern=/etc/ssh/ssh*_config limit=1000 offset=10
+ *
+ * Files of all directories, the name is their full path.
+ */
+bool DotBvfsFindCmd(UaContext* ua, const char*)
+{
+  int i;
+  int limit = 2000, offset = 0;
+  char *jobid = NULL, *pattern = NULL;
+  PoolMem filtered_jobids(PM_FNAME);
+
+  if ((i = FindArgWithValue(ua, "jobid")) >= 0
+      && Is_a_number_list(ua->argv[i])) {
+    jobid = ua->argv[i];
+  }
+  if ((i = FindArgWithValue(ua, "pattern")) >= 0) { pattern = ua->argv[i]; }
+  if ((i = FindArgWithValue(ua, "limit")) >= 0 && Is_a_number(ua->argv[i])) {
+    limit = str_to_int64(ua->argv[i]);
+  }
+  if ((i = FindArgWithValue(ua, "offset")) >= 0 && Is_a_number(ua->argv[i])) {
+    offset = str_to_int64(ua->argv[i]);
+  }
+
+  if (!jobid || !pattern || !OpenClientDb(ua, true)) {
+    ua->ErrorMsg("Can't find jobid or pattern argument\n");
+    return false; /* not enough param */
+  }
+
+  if (!BvfsValidateJobids(ua, jobid, filtered_jobids, true)) {
+    ua->ErrorMsg(T_("Unauthorized command from this console.\n"));
+    return false;
+  }
+
+  if (!ua->guid) { ua->guid = new_guid_list(); }
+
+  Bvfs fs(ua->jcr, ua->db);
+  fs.SetJobids(filtered_jobids.c_str());
+  fs.SetHandler(BvfsResultHandler, ua);
+  fs.SetLimit(limit);
+  fs.SetOffset(offset);
+
+  ua->send->SetStreaming(true);
+  ua->send->ArrayStart("files");
+  fs.find_files(pattern);
+  ua->send->ArrayEnd("files");
+
+  return true;
+}
+
 /**
  * .bvfs_lsdirs jobid=1,2,3,4 path=
  * .bvfs_lsdirs jobid=1,2,3,4 path=/
  * .bvfs_lsdirs jobid=1,2,3,4 pathid=10
+ * .bvfs_lsdirs jobid=1,2,3,4 pathid=10 limit=1000 after=<fullpath>
  */
 bool DotBvfsLsdirsCmd(UaContext* ua, const char*)
 {
@@ -528,7 +585,11 @@ bool DotBvfsLsdirsCmd(UaContext* ua, const char*)
   fs.SetHandler(BvfsResultHandler, ua);
   fs.SetOffset(offset);
   fs.SetLimit(limit);
+  if (int i = FindArgWithValue(ua, "after"); i >= 0) {
+    fs.SetAfter(ua->argv[i]);
+  }
 
+  ua->send->SetStreaming(true);
   ua->send->ArrayStart("directories");
   fs.ls_dirs();
   ua->send->ArrayEnd("directories");
@@ -573,6 +634,7 @@ bool DotBvfsVersionsCmd(UaContext* ua, const char*)
   fs.SetHandler(BvfsResultHandler, ua);
   fs.SetLimit(limit);
   fs.SetOffset(offset);
+  ua->send->SetStreaming(true);
   ua->send->ArrayStart("versions");
   if (pathid) {
     fs.GetAllFileVersions(pathid, fname, client);
@@ -602,7 +664,7 @@ bool DotBvfsGetJobidsCmd(UaContext* ua, const char*)
   db_list_ctx jobids, tempids;
   PoolMem filtered_jobids(PM_FNAME);
 
-  if (!OpenClientDb(ua, true)) { return true; }
+  if (!OpenClientDb(ua, true, true)) { return true; }
 
   if ((pos = FindArgWithValue(ua, "ujobid")) >= 0) {
     bstrncpy(jr.Job, ua->argv[pos], sizeof(jr.Job));
@@ -682,6 +744,25 @@ bool DotBvfsGetJobidsCmd(UaContext* ua, const char*)
   return true;
 }
 
+/**
+ * .compress
+ *
+ * Compresses the larger messages in both directions once the reply
+ * "compress=<algorithm>" was sent.  Older directors do not know the
+ * command, so consoles only enable compression on this reply.
+ */
+bool DotCompressCmd(UaContext* ua, const char*)
+{
+  const char* algorithm = MessageCompression::Algorithm();
+  if (!algorithm || !ua->UA_sock) {
+    ua->ErrorMsg(T_("Message compression is not available.\n"));
+    return false;
+  }
+  ua->send->ObjectKeyValue("compress", "%s=", algorithm, "%s\n");
+  ua->compress_messages = true;
+  return true;
+}
+
 bool DotGetmsgsCmd(UaContext* ua, const char* cmd)
 {
   if (console_msg_pending) { DoMessages(ua, cmd); }
@@ -729,7 +729,10 @@ static bool ListJobs(UaContext* ua,
 
 static bool DoListCmd(UaContext* ua, const char* cmd, e_list_type llist)
 {
-  if (!OpenClientDb(ua, true)) { return true; }
+  // all listings but the next volume only read the catalog
+  bool read_only = ua->argc > 1 && !Bstrcasecmp(ua->argk[1], NT_("nextvol"))
+                   && !Bstrcasecmp(ua->argk[1], NT_("nextvolume"));
+  if (!OpenClientDb(ua, true, read_only)) { return true; }
 
   Dmsg1(20, "list: %s\n", cmd);
 
@@ -741,6 +744,9 @@ static bool DoListCmd(UaContext* ua, const char* cmd, e_list_type llist)
   ListCmdOptions optionslist{};
   if (!optionslist.parse(ua)) { return false; }
 
+  // listings can get long, send them while the rows come in
+  ua->send->SetStreaming(true);
+
   // Select what to do based on the first argument.
   if (Bstrcasecmp(ua->argk[1], NT_("jobs"))
       || Bstrcasecmp(ua->argk[1], NT_("job"))
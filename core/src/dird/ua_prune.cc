@@ -397,6 +397,7 @@ static bool PruneDirectory(UaContext* ua, ClientResource* client)
     {
       DbLocker _{ua->db};
       ua->db->SqlQuery(query.c_str());
+      ua->db->ForgetPathIds();
     }
   }
 
@@ -42,6 +42,7 @@
 #include "dird/ua_select.h"
 #include "dird/ua_prune.h"
 #include "dird/ua_purge.h"
+#include "dird/quota.h"
 #include "include/auth_protocol_types.h"
 #include "lib/bstringlist.h"
 #include "lib/edit.h"
@@ -471,6 +472,7 @@ static bool PurgeQuotaFromClient(UaContext* ua, ClientResource* client)
 void PurgeJobsFromCatalog(UaContext* ua, const char* jobs)
 {
   ua->db->PurgeJobs(jobs);
+  ForgetQuotaUsages();
 }
 
 /**
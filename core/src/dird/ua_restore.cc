@@ -51,10 +51,24 @@
 #include "lib/tree.h"
 #include "include/protocol_types.h"
 
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 namespace directordaemon {
 
+/* Restores of fewer files build their tree without helper threads */
+static constexpr uint32_t parallel_tree_min_files = 100'000;
+
+/* Most restore jobs the files selected can be split over */
+static constexpr uint32_t max_restore_sessions = 64;
+
+/* When splitting a restore, every file weighs as much as this many bytes on
+ * top of its size, for the time it takes to create it. */
+static constexpr uint64_t restore_file_weight = 64 * 1024;
+
 /* Imported functions */
 extern void PrintBsr(UaContext* ua, RestoreBootstrapRecord* bsr);
 
@@ -87,6 +101,11 @@ static void InsertOneFileOrDir(UaContext* ua,
                                char* p,
                                char* date,
                                bool dir);
+static bool InsertListIntoFindexList(UaContext* ua,
+                                     RestoreContext* rx,
+                                     std::vector<std::string>& lines,
+                                     char* date,
+                                     bool dir);
 static bool GetClientName(UaContext* ua, RestoreContext* rx);
 static bool GetRestoreClientName(UaContext* ua, RestoreContext& rx);
 static bool get_date(UaContext* ua, char* date, int date_len);
@@ -99,17 +118,22 @@ static bool CheckAndSetFileregex(UaContext* ua,
                                  RestoreContext* rx,
                                  const char* regex);
 static bool AddAllFindex(RestoreContext* rx);
+static std::string RestoreRunCommand(UaContext* ua,
+                                     RestoreContext& rx,
+                                     JobResource* job,
+                                     const char* restore_client,
+                                     const char* comment);
+static bool RunRestoreSessions(UaContext* ua,
+                               RestoreContext& rx,
+                               JobResource* job);
 
 // Restore files
 bool RestoreCmd(UaContext* ua, const char*)
 {
   RestoreContext rx; /* restore context */
-  PoolMem buf;
   JobResource* job;
   int i;
   JobControlRecord* jcr = ua->jcr;
-  char* escaped_bsr_name = NULL;
-  char* escaped_where_name = NULL;
   char *strip_prefix, *add_prefix, *add_suffix, *regexp;
   strip_prefix = add_prefix = add_suffix = regexp = NULL;
 
@@ -151,6 +175,20 @@ bool RestoreCmd(UaContext* ua, const char*)
   i = FindArgWithValue(ua, "regexwhere");
   if (i >= 0) { rx.RegexWhere = ua->argv[i]; }
 
+  i = FindArgWithValue(ua, "sessions");
+  if (i >= 0) {
+    rx.sessions = str_to_uint32(ua->argv[i]);
+    if (rx.sessions < 1 || rx.sessions > max_restore_sessions) {
+      ua->ErrorMsg(T_("Invalid \"sessions\" value, it must be from 1 to %u.\n"),
+                   max_restore_sessions);
+      goto bail_out;
+    }
+    if (rx.sessions > 1 && FindArgWithValue(ua, "bootstrap") >= 0) {
+      ua->ErrorMsg(T_("\"sessions\" cannot be used with \"bootstrap\".\n"));
+      goto bail_out;
+    }
+  }
+
   i = FindArgWithValue(ua, "fileregex");
   if (i >= 0) {
     if (!CheckAndSetFileregex(ua, &rx, ua->argv[i])) {
@@ -241,6 +279,11 @@ bool RestoreCmd(UaContext* ua, const char*)
   }
   if (!job) { goto bail_out; }
 
+  if (!rx.session_bsrs.empty() && job->Protocol != PT_NATIVE) {
+    ua->ErrorMsg(T_("Only native restores can be split into sessions.\n"));
+    goto bail_out;
+  }
+
   /* When doing NDMP_NATIVE restores, we don't create any bootstrap file
    * as we only send a namelist for restore. The storage handling is
    * done by the NDMP state machine via robot and tape interface. */
@@ -249,6 +292,15 @@ bool RestoreCmd(UaContext* ua, const char*)
         T_("Skipping BootStrapRecord creation as we are doing NDMP_NATIVE "
            "restore.\n"));
 
+  } else if (!rx.session_bsrs.empty()) {
+    // the bootstrap files are written once the clients are known
+    for (auto& bsr : rx.session_bsrs) {
+      if (!AddVolumeInformationToBsr(ua, bsr.get())) {
+        ua->ErrorMsg(T_(
+            "Unable to construct a valid BootStrapRecord. Cannot continue.\n"));
+        goto bail_out;
+      }
+    }
   } else {
     if (rx.bsr->JobId) {
       char ed1[50];
@@ -282,12 +334,63 @@ bool RestoreCmd(UaContext* ua, const char*)
   }
   if (!GetRestoreClientName(ua, rx)) { goto bail_out; }
 
-  escaped_bsr_name = escape_filename(jcr->RestoreBootstrap);
+  if (!rx.session_bsrs.empty()) {
+    if (!RunRestoreSessions(ua, rx, job)) { goto bail_out; }
+    if (regexp) { free(regexp); }
+    free_rx(&rx);
+    return true;
+  }
+
+  PmStrcpy(ua->cmd,
+           RestoreRunCommand(ua, rx, job, rx.RestoreClientName, rx.comment)
+               .c_str());
+
+  if (regexp) { free(regexp); }
+
+  Dmsg1(200, "Submitting: %s\n", ua->cmd);
 
-  Mmsg(ua->cmd,
+  // Transfer jobids to jcr to for picking up restore objects
+  jcr->JobIds = rx.JobIds;
+  rx.JobIds = NULL;
+
+  ParseUaArgs(ua);
+  RunCmd(ua, ua->cmd);
+  free_rx(&rx);
+  return true;
+
+bail_out:
+  if (regexp) { free(regexp); }
+
+  /* restore_tree_root only gets freed if either the backup starts
+   * or the ua session ends.  Since the first definitely does not happen
+   * after this point, and we cannot control the second one, we need
+   * to ensure that we free the tree here before returning false; otherwise
+   * this memory will leak, if another restore is attempted. */
+  if (jcr->dir_impl->restore_tree_root) {
+    FreeTree(jcr->dir_impl->restore_tree_root);
+    jcr->dir_impl->restore_tree_root = nullptr;
+  }
+
+  free_rx(&rx);
+  return false;
+}
+
+// Builds the command that runs the restore job
+static std::string RestoreRunCommand(UaContext* ua,
+                                     RestoreContext& rx,
+                                     JobResource* job,
+                                     const char* restore_client,
+                                     const char* comment)
+{
+  JobControlRecord* jcr = ua->jcr;
+  PoolMem cmd, buf;
+  char* escaped_bsr_name = escape_filename(jcr->RestoreBootstrap);
+  char* escaped_where_name = NULL;
+
+  Mmsg(cmd,
        "run job=\"%s\" client=\"%s\" restoreclient=\"%s\" storage=\"%s\""
        " bootstrap=\"%s\" files=%u catalog=\"%s\"",
-       job->resource_name_, rx.ClientName, rx.RestoreClientName,
+       job->resource_name_, rx.ClientName, restore_client,
        rx.store ? rx.store->resource_name_ : "",
        escaped_bsr_name ? escaped_bsr_name : jcr->RestoreBootstrap,
        rx.selected_files, ua->catalog->resource_name_);
@@ -295,7 +398,7 @@ bool RestoreCmd(UaContext* ua, const char*)
   // Build run command
   if (rx.backup_format) {
     Mmsg(buf, " backupformat=%s", rx.backup_format);
-    PmStrcat(ua->cmd, buf);
+    PmStrcat(cmd, buf.c_str());
   }
 
   PmStrcpy(buf, "");
@@ -309,63 +412,114 @@ bool RestoreCmd(UaContext* ua, const char*)
     Mmsg(buf, " where=\"%s\"",
          escaped_where_name ? escaped_where_name : rx.where);
   }
-  PmStrcat(ua->cmd, buf);
+  PmStrcat(cmd, buf.c_str());
 
   if (rx.replace) {
     Mmsg(buf, " replace=%s", rx.replace);
-    PmStrcat(ua->cmd, buf);
+    PmStrcat(cmd, buf.c_str());
   }
 
   if (rx.plugin_options) {
     Mmsg(buf, " pluginoptions=%s", rx.plugin_options);
-    PmStrcat(ua->cmd, buf);
+    PmStrcat(cmd, buf.c_str());
   }
 
-  if (rx.comment) {
-    Mmsg(buf, " comment=\"%s\"", rx.comment);
-    PmStrcat(ua->cmd, buf);
+  if (comment) {
+    Mmsg(buf, " comment=\"%s\"", comment);
+    PmStrcat(cmd, buf.c_str());
   }
 
   if (escaped_bsr_name != NULL) { free(escaped_bsr_name); }
 
   if (escaped_where_name != NULL) { free(escaped_where_name); }
 
-  if (regexp) { free(regexp); }
-
   if (FindArg(ua, NT_("yes")) > 0) {
-    PmStrcat(ua->cmd, " yes"); /* pass it on to the run command */
+    PmStrcat(cmd, " yes"); /* pass it on to the run command */
   }
 
-  Dmsg1(200, "Submitting: %s\n", ua->cmd);
+  return cmd.c_str();
+}
 
-  // Transfer jobids to jcr to for picking up restore objects
-  jcr->JobIds = rx.JobIds;
-  rx.JobIds = NULL;
+/* Writes a bootstrap file for every session of a split restore and runs
+ * them as restore jobs of their own.  All the command line arguments are
+ * used up before the first one runs, as running it replaces them. */
+static bool RunRestoreSessions(UaContext* ua,
+                               RestoreContext& rx,
+                               JobResource* job)
+{
+  JobControlRecord* jcr = ua->jcr;
+  const uint32_t count = rx.session_bsrs.size();
+  std::vector<std::string> session_commands;
+  std::vector<std::string> bsr_files;
+  uint32_t selected_files = 0;
+
+  auto remove_bsr_files = [&bsr_files] {
+    for (const std::string& file : bsr_files) {
+      SecureErase(nullptr, file.c_str());
+    }
+  };
 
-  ParseUaArgs(ua);
-  RunCmd(ua, ua->cmd);
-  free_rx(&rx);
-  return true;
+  for (uint32_t session = 0; session < count; ++session) {
+    rx.bsr = std::move(rx.session_bsrs[session]);
+    if (!(rx.selected_files = WriteBsrFile(ua, rx))) {
+      remove_bsr_files();
+      return false;
+    }
+    bsr_files.push_back(jcr->RestoreBootstrap);
+    selected_files += rx.selected_files;
+    DisplayBsrInfo(ua, rx);
 
-bail_out:
-  if (escaped_bsr_name != NULL) { free(escaped_bsr_name); }
+    std::string comment = rx.comment ? std::string{rx.comment} + ", " : "";
+    comment += "restore session " + std::to_string(session + 1) + " of "
+               + std::to_string(count);
+    const char* client
+        = rx.restore_clients.empty()
+              ? rx.RestoreClientName
+              : rx.restore_clients[session % rx.restore_clients.size()].c_str();
+    session_commands.push_back(
+        RestoreRunCommand(ua, rx, job, client, comment.c_str()));
+  }
 
-  if (escaped_where_name != NULL) { free(escaped_where_name); }
+  char ed1[50];
+  ua->InfoMsg(T_("\n%s files selected to be restored in %u sessions.\n\n"),
+              edit_uint64_with_commas(selected_files, ed1), count);
+
+  if (!ua->batch && FindArg(ua, NT_("yes")) < 0) {
+    if (!GetYesno(ua, T_("Run the restore sessions (yes/no): "))
+        || !ua->pint32_val) {
+      remove_bsr_files();
+      ua->SendMsg(T_("Restore not done.\n"));
+      return false;
+    }
+    for (std::string& command : session_commands) { command += " yes"; }
+  }
 
-  if (regexp) { free(regexp); }
+  std::string jobids;
+  jcr->dir_impl->restore_sessions = count;
+  for (const std::string& command : session_commands) {
+    PmStrcpy(ua->cmd, command.c_str());
+    Dmsg1(200, "Submitting: %s\n", ua->cmd);
 
-  /* restore_tree_root only gets freed if either the backup starts
-   * or the ua session ends.  Since the first definitely does not happen
-   * after this point, and we cannot control the second one, we need
-   * to ensure that we free the tree here before returning false; otherwise
-   * this memory will leak, if another restore is attempted. */
-  if (jcr->dir_impl->restore_tree_root) {
-    FreeTree(jcr->dir_impl->restore_tree_root);
-    jcr->dir_impl->restore_tree_root = nullptr;
+    // every session picks up the restore objects
+    if (jcr->JobIds) { FreePoolMemory(jcr->JobIds); }
+    jcr->JobIds = GetPoolMemory(PM_FNAME);
+    PmStrcpy(jcr->JobIds, rx.JobIds);
+    jcr->dir_impl->unlink_bsr = true;
+
+    ParseUaArgs(ua);
+    if (JobId_t JobId = DoRunCmd(ua, ua->cmd)) {
+      if (!jobids.empty()) { jobids += ","; }
+      jobids += std::to_string(JobId);
+    }
   }
+  jcr->dir_impl->restore_sessions = 0;
+  jcr->dir_impl->unlink_bsr = false;
+  FreeAndNullPoolMemory(jcr->JobIds);
 
-  free_rx(&rx);
-  return false;
+  if (!jobids.empty()) {
+    ua->InfoMsg(T_("Restore sessions queued as JobIds %s.\n"), jobids.c_str());
+  }
+  return !jobids.empty();
 }
 
 // Fill the rx->BaseJobIds and display the list
@@ -458,15 +612,34 @@ static bool GetRestoreClientName(UaContext* ua, RestoreContext& rx)
   // Try command line argument
   i = FindArgWithValue(ua, NT_("restoreclient"));
   if (i >= 0) {
-    if (!IsNameValid(ua->argv[i], ua->errmsg)) {
-      ua->ErrorMsg("%s argument: %s", ua->argk[i], ua->errmsg.c_str());
-      return false;
+    // the sessions of a split restore can go to a list of clients
+    std::vector<std::string> names;
+    if (rx.session_bsrs.empty()) {
+      names.push_back(ua->argv[i]);
+    } else {
+      for (const char* p = ua->argv[i]; *p;) {
+        const char* comma = strchr(p, ',');
+        std::size_t len = comma ? comma - p : strlen(p);
+        names.emplace_back(p, len);
+        p += len + (comma ? 1 : 0);
+      }
+    }
+    for (const std::string& name : names) {
+      if (!IsNameValid(name.c_str(), ua->errmsg)) {
+        ua->ErrorMsg("%s argument: %s", ua->argk[i], ua->errmsg.c_str());
+        return false;
+      }
+      if (!ua->GetClientResWithName(name.c_str())) {
+        ua->ErrorMsg("invalid %s argument: %s\n", ua->argk[i], name.c_str());
+        return false;
+      }
     }
-    if (!ua->GetClientResWithName(ua->argv[i])) {
-      ua->ErrorMsg("invalid %s argument: %s\n", ua->argk[i], ua->argv[i]);
+    if (names.empty()) {
+      ua->ErrorMsg(T_("Missing value for keyword: %s\n"), ua->argk[i]);
       return false;
     }
-    rx.RestoreClientName = strdup(ua->argv[i]);
+    rx.RestoreClientName = strdup(names.front().c_str());
+    if (names.size() > 1) { rx.restore_clients = std::move(names); }
     return true;
   }
 
@@ -966,15 +1139,21 @@ static void InsertOneFileOrDir(UaContext* ua,
   int line = 0;
 
   switch (*p) {
-    case '<':
+    case '<': {
       p++;
       if ((ffd = fopen(p, "rb")) == NULL) {
         BErrNo be;
         ua->ErrorMsg(T_("Cannot open file %s: ERR=%s\n"), p, be.bstrerror());
         break;
       }
-      while (fgets(file, sizeof(file), ffd)) {
+      std::vector<std::string> lines;
+      while (fgets(file, sizeof(file), ffd)) { lines.emplace_back(file); }
+      fclose(ffd);
+      if (InsertListIntoFindexList(ua, rx, lines, date, dir)) { break; }
+
+      for (auto& entry : lines) {
         line++;
+        bstrncpy(file, entry.c_str(), sizeof(file));
         if (dir) {
           if (!InsertDirIntoFindexList(ua, rx, file, date)) {
             ua->ErrorMsg(T_("Error occurred on line %d of file \"%s\"\n"), line,
@@ -987,8 +1166,8 @@ static void InsertOneFileOrDir(UaContext* ua,
           }
         }
       }
-      fclose(ffd);
       break;
+    }
     case '?':
       p++;
       InsertTableIntoFindexList(ua, rx, p);
@@ -1003,6 +1182,114 @@ static void InsertOneFileOrDir(UaContext* ua,
   }
 }
 
+struct selection_context {
+  RestoreContext* rx;
+  std::vector<bool> found; /* per line of the list */
+};
+
+static int SelectionFindexHandler(void* ctx, int num_fields, char** row)
+{
+  auto* sel = static_cast<selection_context*>(ctx);
+  std::size_t line = str_to_uint64(row[2]);
+  if (line < sel->found.size()) { sel->found[line] = true; }
+  return JobidFileindexHandler(sel->rx, num_fields, row);
+}
+
+// Splits name into its path and its filename, both unescaped.
+static void SplitRawPathAndFilename(const char* name,
+                                    std::string& path,
+                                    std::string& fname)
+{
+  const char* f = name;
+  const char* p;
+  for (p = name; *p; p++) {
+    if (IsPathSeparator(*p)) { f = p; }
+  }
+  if (IsPathSeparator(*f)) {
+    f++;
+  } else {
+    f = p;
+  }
+  path.assign(name, f - name);
+  fname.assign(f, p - f);
+}
+
+/**
+ * Does what InsertFileIntoFindexList() or InsertDirIntoFindexList() does
+ * for every line of a list, but with one query for all of them: the lines
+ * are copied into a temporary table that is joined with the catalog.
+ * Returns false (without having inserted anything) if that is not possible,
+ * the caller then has to insert the lines one at a time.
+ */
+static bool InsertListIntoFindexList(UaContext* ua,
+                                     RestoreContext* rx,
+                                     std::vector<std::string>& lines,
+                                     char* date,
+                                     bool dir)
+{
+  if (dir && *rx->JobIds == 0) { return false; }
+
+  std::vector<std::vector<std::string>> rows;
+  rows.reserve(lines.size());
+  for (std::size_t i = 0; i < lines.size(); ++i) {
+    std::vector<char> buf(lines[i].begin(), lines[i].end());
+    buf.push_back(0);
+    std::string path, fname;
+    if (dir) {
+      StripTrailingJunk(buf.data());
+      path = buf.data();
+    } else {
+      StripTrailingNewline(buf.data());
+      SplitRawPathAndFilename(buf.data(), path, fname);
+    }
+    lines[i] = buf.data();
+    rows.push_back({std::to_string(i), std::move(path), std::move(fname)});
+  }
+
+  /* The temporary table belongs to the connection, which might be shared
+   * with other consoles. */
+  DbLocker _{ua->db};
+  ua->db->SqlQuery(BareosDb::SQL_QUERY::uar_del_restore_selection_0);
+  if (!ua->db->SqlQuery(BareosDb::SQL_QUERY::uar_create_restore_selection_0)
+      || !ua->db->SqlCopyIn("restore_selection", rows)) {
+    Dmsg1(100, "Cannot select the files of the list at once: %s\n",
+          ua->db->strerror());
+    ua->db->SqlQuery(BareosDb::SQL_QUERY::uar_del_restore_selection_0);
+    return false;
+  }
+
+  if (dir) {
+    ua->db->FillQuery(
+        rx->query,
+        BareosDb::SQL_QUERY::uar_jobid_fileindex_from_dir_selection_2,
+        rx->JobIds, rx->ClientName);
+  } else if (*rx->JobIds == 0) {
+    ua->db->FillQuery(rx->query,
+                      BareosDb::SQL_QUERY::uar_jobid_fileindex_from_selection_3,
+                      date, rx->ClientName,
+                      RestoreContext::FilterIdentifier(rx->job_filter));
+  } else {
+    ua->db->FillQuery(
+        rx->query, BareosDb::SQL_QUERY::uar_jobids_fileindex_from_selection_3,
+        rx->JobIds, date, rx->ClientName);
+  }
+
+  selection_context sel{rx, std::vector<bool>(lines.size(), false)};
+  if (!ua->db->SqlQuery(rx->query, SelectionFindexHandler, &sel)) {
+    ua->ErrorMsg(T_("Query failed: %s. ERR=%s\n"), rx->query,
+                 ua->db->strerror());
+  }
+  ua->db->SqlQuery(BareosDb::SQL_QUERY::uar_del_restore_selection_0);
+
+  for (std::size_t i = 0; i < lines.size(); ++i) {
+    if (!sel.found[i]) {
+      ua->ErrorMsg(T_("No database record found for: %s\n"),
+                   lines[i].c_str());
+    }
+  }
+  return true;
+}
+
 /**
  * For a given file (path+filename), split into path and file, then
  * lookup the most recent backup in the catalog to get the JobId
@@ -1193,11 +1480,116 @@ static bool AskForFileregex(UaContext* ua, RestoreContext* rx)
  * should insert as
  * 0, 1, 2, 3, 4, 5, 6
  */
-static void AddDeltaListFindex(RestoreContext* rx, struct delta_list* lst)
+static void AddDeltaListFindex(RestoreContext* rx,
+                               RestoreBootstrapRecord* bsr,
+                               struct delta_list* lst)
 {
   if (lst == NULL) { return; }
-  if (lst->next) { AddDeltaListFindex(rx, lst->next); }
-  AddFindex(rx->bsr.get(), lst->JobId, lst->FileIndex);
+  rx->restores_versions = true;
+  if (lst->next) { AddDeltaListFindex(rx, bsr, lst->next); }
+  AddFindex(bsr, lst->JobId, lst->FileIndex);
+}
+
+// Adds a node marked to be extracted to the bsr
+static void AddNodeFindex(RestoreContext* rx,
+                          RestoreBootstrapRecord* bsr,
+                          tree_node* node)
+{
+  Dmsg3(400, "JobId=%lld type=%d FI=%d\n", (uint64_t)node->JobId, node->type,
+        node->FileIndex);
+  /* TODO: optimize bsr insertion when jobid are non sorted */
+  AddDeltaListFindex(rx, bsr, node->delta_list);
+  AddFindex(bsr, node->JobId, node->FileIndex);
+  if (node->type != tree_node_type::NewDir) {
+    rx->selected_files++; /* count only saved files */
+  }
+}
+
+// The child of split that node is in, 0 if it is not below split
+static tree_index SubtreeOf(TREE_ROOT* root, tree_node* node, tree_index split)
+{
+  while (node->index != 0 && node->parent_index != split) {
+    node = TreeParent(root, node);
+  }
+  return node->index;
+}
+
+/* Splits the marked files over rx->sessions bsrs by the subdirectories of the
+ * deepest directory that holds all of them.  Biggest first, every
+ * subdirectory goes to the session with the least data so far.  The
+ * directories above go to the first session.  Returns false if there is
+ * nothing to split. */
+static bool SplitRestoreTree(UaContext* ua, TREE_ROOT* root, RestoreContext* rx)
+{
+  // which subtrees hold something to extract, parents come before children
+  std::vector<bool> selected(root->num_nodes);
+  for (tree_index i = root->num_nodes - 1; i > 0; --i) {
+    tree_node* node = TreeNodeAt(root, i);
+    if (node->extract || selected[i]) { selected[node->parent_index] = true; }
+  }
+
+  auto is_selected = [&selected](tree_node* node) {
+    return node->extract || selected[node->index];
+  };
+
+  tree_node* split = root;
+  std::unordered_map<tree_index, uint64_t> weights;
+  while (true) {
+    weights.clear();
+    tree_node* last = nullptr;
+    for (tree_node* child : TreeChildren(root, split)) {
+      if (is_selected(child)) {
+        weights[child->index] = 0;
+        last = child;
+      }
+    }
+    if (weights.size() != 1 || !TreeNodeHasChild(last)) { break; }
+    split = last;
+  }
+  if (weights.size() < 2) { return false; }
+
+  for (tree_node* node = FirstTreeNode(root); node;
+       node = NextTreeNode(root, node)) {
+    if (!node->extract) { continue; }
+    if (tree_index subtree = SubtreeOf(root, node, split->index)) {
+      weights[subtree] += TreeNodeSize(node) + restore_file_weight;
+    }
+  }
+
+  std::vector<std::pair<tree_index, uint64_t>> subtrees(weights.begin(),
+                                                        weights.end());
+  std::sort(subtrees.begin(), subtrees.end(), [](auto& a, auto& b) {
+    return a.second != b.second ? a.second > b.second : a.first < b.first;
+  });
+  std::vector<uint64_t> load(std::min<std::size_t>(rx->sessions,
+                                                   subtrees.size()));
+  std::unordered_map<tree_index, std::size_t> session_of;
+  for (const auto& [index, weight] : subtrees) {
+    auto least = std::min_element(load.begin(), load.end());
+    session_of[index] = least - load.begin();
+    *least += weight;
+  }
+
+  for (std::size_t i = 0; i < load.size(); ++i) {
+    auto& bsr = rx->session_bsrs.emplace_back(
+        std::make_unique<RestoreBootstrapRecord>());
+    if (rx->bsr->fileregex) { bsr->fileregex = strdup(rx->bsr->fileregex); }
+  }
+  for (tree_node* node = FirstTreeNode(root); node;
+       node = NextTreeNode(root, node)) {
+    if (!node->extract) { continue; }
+    tree_index subtree = SubtreeOf(root, node, split->index);
+    std::size_t session = subtree ? session_of[subtree] : 0;
+    AddNodeFindex(rx, rx->session_bsrs[session].get(), node);
+  }
+
+  POOLMEM* path = tree_getpath(root, split);
+  ua->InfoMsg(T_("Splitting the restore into %d sessions by the %d "
+                 "subdirectories of %s\n"),
+              static_cast<int>(load.size()), static_cast<int>(subtrees.size()),
+              *path ? path : "/");
+  FreePoolMemory(path);
+  return true;
 }
 
 static bool AddAllFindex(RestoreContext* rx)
@@ -1207,6 +1599,7 @@ static bool AddAllFindex(RestoreContext* rx)
   for (const char* p = rx->JobIds; GetNextJobidFromList(&p, &JobId) > 0;) {
     if (JobId == last_JobId) { continue; /* eliminate duplicate JobIds */ }
     AddFindexAll(rx->bsr.get(), JobId);
+    if (has_jobid) { rx->restores_versions = true; }
     has_jobid = true;
   }
   return has_jobid;
@@ -1220,8 +1613,13 @@ static bool BuildDirectoryTree(UaContext* ua, RestoreContext* rx)
   bool OK = true;
   char ed1[50];
 
-  // Build the directory tree containing JobIds user selected
-  tree.root = new_tree(rx->TotalFiles);
+  /* Build the directory tree containing JobIds user selected, huge trees are
+   * kept in a file so only the parts in use take memory. */
+  uint32_t map_threshold = me->mapped_restore_tree_threshold;
+  tree.root = new_tree(
+      rx->TotalFiles,
+      map_threshold && rx->TotalFiles >= map_threshold ? me->working_directory
+                                                       : nullptr);
   tree.ua = ua;
   tree.all = rx->all;
 
@@ -1250,11 +1648,22 @@ static bool BuildDirectoryTree(UaContext* ua, RestoreContext* rx)
   ua->LogAuditEventInfoMsg(T_("Building directory tree for JobId(s) %s"),
                            rx->JobIds);
 
-  if (!ua->db->GetFileList(ua->jcr, rx->JobIds, false /* do not use md5 */,
-                           true /* get delta */, InsertTreeHandler,
-                           (void*)&tree)) {
-    ua->ErrorMsg("%s", ua->db->strerror());
+  auto fetch = [ua, rx](DB_RESULT_HANDLER* handler, void* ctx) {
+    return ua->db->GetFileList(ua->jcr, rx->JobIds, false /* do not use md5 */,
+                               true /* get delta */, handler, ctx);
+  };
+
+  /* For big trees the catalog rows are fetched and decoded by other threads
+   * while this one builds the tree. */
+  std::size_t num_workers
+      = std::min(std::thread::hardware_concurrency() / 2, 4u);
+  bool fetched;
+  if (num_workers > 0 && rx->TotalFiles >= parallel_tree_min_files) {
+    fetched = BuildTreeInParallel(&tree, num_workers, fetch);
+  } else {
+    fetched = fetch(InsertTreeHandler, (void*)&tree);
   }
+  if (!fetched) { ua->ErrorMsg("%s", ua->db->strerror()); }
 
   if (*rx->BaseJobIds) {
     PmStrcat(rx->JobIds, ",");
@@ -1298,20 +1707,14 @@ static bool BuildDirectoryTree(UaContext* ua, RestoreContext* rx)
 
     /* Walk down through the tree finding all files marked to be
      *  extracted making a bootstrap file. */
-    if (OK) {
+    if (OK && rx->sessions > 1 && !SplitRestoreTree(ua, tree.root, rx)) {
+      ua->InfoMsg(T_("Nothing to split, restoring in a single session.\n"));
+    }
+    if (OK && rx->session_bsrs.empty()) {
       for (tree_node* node = FirstTreeNode(tree.root); node;
-           node = NextTreeNode(node)) {
+           node = NextTreeNode(tree.root, node)) {
         Dmsg2(400, "FI=%d node=0x%x\n", node->FileIndex, node);
-        if (node->extract) {
-          Dmsg3(400, "JobId=%lld type=%d FI=%d\n", (uint64_t)node->JobId,
-                node->type, node->FileIndex);
-          /* TODO: optimize bsr insertion when jobid are non sorted */
-          AddDeltaListFindex(rx, node->delta_list);
-          AddFindex(rx->bsr.get(), node->JobId, node->FileIndex);
-          if (node->extract && node->type != tree_node_type::NewDir) {
-            rx->selected_files++; /* count only saved files */
-          }
-        }
+        if (node->extract) { AddNodeFindex(rx, rx->bsr.get(), node); }
       }
     }
   }
@@ -26,6 +26,7 @@
  */
 #include "include/bareos.h"
 #include "dird.h"
+#include "include/protocol_types.h"
 #include "dird/director_jcr_impl.h"
 #include "dird/job.h"
 #include "dird/migration.h"
@@ -356,6 +357,137 @@ bool reRunCmd(UaContext* ua, const char*)
   return true;
 }
 
+static const char* sql_newer_backups
+    = "SELECT JobId FROM Job WHERE Name='%s' AND ClientId=%s"
+      " AND FileSetId=%s AND Type='B' AND JobStatus IN ('T','W')"
+      " AND JobId>%s";
+
+static const char* sql_last_saved_file
+    = "SELECT File.FileIndex,Path.Path,File.Name FROM File,Path"
+      " WHERE File.JobId=%s AND File.PathId=Path.PathId AND File.FileIndex>0"
+      " ORDER BY File.FileIndex DESC LIMIT 1";
+
+static int LastSavedFileHandler(void* ctx, int, char** row)
+{
+  ResumePoint* point = static_cast<ResumePoint*>(ctx);
+  point->FileIndex = str_to_int64(row[0]);
+  point->fname = std::string{row[1]} + row[2];
+  return 0;
+}
+
+/**
+ * Find where an incomplete backup can be resumed: after the last file its
+ * checkpoints put into the catalog.  The storage daemon only sends the
+ * attributes of files that are completely written.
+ */
+static bool GetResumePoint(UaContext* ua, JobId_t JobId, ResumePoint& point)
+{
+  JobDbRecord jr;
+  char ed1[50], ed2[50], ed3[50];
+
+  jr.JobId = JobId;
+  if (DbLocker _{ua->db}; !ua->db->GetJobRecord(ua->jcr, &jr)) {
+    ua->ErrorMsg(T_("Error getting Job record for Job resume: ERR=%s\n"),
+                 ua->db->strerror());
+    return false;
+  }
+
+  switch (jr.JobStatus) {
+    case JS_Incomplete:
+    case JS_ErrorTerminated:
+    case JS_FatalError:
+    case JS_Canceled:
+      break;
+    default:
+      ua->ErrorMsg(T_("JobId %u did not fail, there is nothing to resume.\n"),
+                   JobId);
+      return false;
+  }
+
+  JobResource* job = ua->GetJobResWithName(jr.Name, false);
+  if (jr.JobType != JT_BACKUP || !job || job->Protocol != PT_NATIVE
+      || (jr.JobLevel != L_FULL && jr.JobLevel != L_DIFFERENTIAL
+          && jr.JobLevel != L_INCREMENTAL)) {
+    ua->ErrorMsg(
+        T_("JobId %u is not a native full, differential or incremental "
+           "backup of a configured job, it cannot be resumed.\n"),
+        JobId);
+    return false;
+  }
+
+  if (GetJcrById(JobId)) {
+    ua->ErrorMsg(T_("JobId %u is still running.\n"), JobId);
+    return false;
+  }
+
+  // a later backup would be based on what the incomplete one missed
+  char esc[MAX_ESCAPE_NAME_LENGTH];
+  PoolMem query(PM_MESSAGE);
+  dbid_list ids;
+  ua->db->EscapeString(ua->jcr, esc, jr.Name, strlen(jr.Name));
+  Mmsg(query, sql_newer_backups, esc, edit_int64(jr.ClientId, ed1),
+       edit_int64(jr.FileSetId, ed2), edit_int64(JobId, ed3));
+  if (DbLocker _{ua->db}; !ua->db->GetQueryDbids(ua->jcr, query, ids)) {
+    ua->ErrorMsg("%s", ua->db->strerror());
+    return false;
+  }
+  if (ids.size() > 0) {
+    ua->ErrorMsg(T_("JobId %u was followed by the successful backup JobId %u, "
+                    "it cannot be resumed any more.\n"),
+                 JobId, ids.get(0));
+    return false;
+  }
+
+  Mmsg(query, sql_last_saved_file, edit_int64(JobId, ed1));
+  if (DbLocker _{ua->db};
+      !ua->db->SqlQuery(query.c_str(), LastSavedFileHandler, &point)) {
+    ua->ErrorMsg("%s", ua->db->strerror());
+    return false;
+  }
+  if (point.FileIndex <= 0) {
+    ua->ErrorMsg(T_("JobId %u did not save any file, rerun it instead.\n"),
+                 JobId);
+    return false;
+  }
+
+  point.JobId = JobId;
+  point.JobLevel = jr.JobLevel;
+  point.JobBytes = jr.JobBytes;
+  point.StartTime = jr.JobTDate;
+  return true;
+}
+
+/**
+ * Resume an incomplete backup under its JobId.  The client skips the files
+ * up to the last one that was saved, the storage daemon writes the rest in
+ * a continuation of the session.
+ *
+ * Returns: false on error
+ *          true if OK
+ */
+bool ResumeCmd(UaContext* ua, const char*)
+{
+  if (!OpenClientDb(ua)) { return true; }
+
+  int i = FindArgWithValue(ua, NT_("jobid"));
+  if (i < 0 || !Is_a_number(ua->argv[i])) {
+    ua->SendMsg(T_("Please specify the jobid of the backup to resume.\n"));
+    return false;
+  }
+  JobId_t JobId = str_to_int64(ua->argv[i]);
+  bool yes = FindArg(ua, NT_("yes")) > 0;
+
+  ResumePoint point;
+  if (!GetResumePoint(ua, JobId, point)) { return false; }
+  ua->SendMsg(T_("Resuming JobId %u after file %d: %s\n"), JobId,
+              point.FileIndex, point.fname.c_str());
+
+  ua->jcr->dir_impl->resume = std::move(point);
+  bool ok = reRunJob(ua, JobId, yes, (utime_t)time(NULL));
+  ua->jcr->dir_impl->resume = ResumePoint{};
+  return ok;
+}
+
 /**
  * For Backup and Verify Jobs
  *     run [job=]<job-name> level=<level-name>
@@ -387,6 +519,15 @@ int DoRunCmd(UaContext* ua, const char*)
     jcr->dir_impl->unlink_bsr
         = ua->jcr->dir_impl->unlink_bsr; /* copy unlink flag from caller */
     ua->jcr->dir_impl->unlink_bsr = false;
+
+    /* The sessions of a split restore run side by side, also when they
+     * restore to the same client. */
+    if (uint32_t sessions = ua->jcr->dir_impl->restore_sessions;
+        sessions > 1) {
+      jcr->dir_impl->max_concurrent_jobs = std::max(
+          jcr->dir_impl->max_concurrent_jobs, static_cast<int32_t>(sessions));
+      jcr->dir_impl->IgnoreClientConcurrency = true;
+    }
   }
 
   // Transfer JobIds to new restore Job
@@ -395,6 +536,12 @@ int DoRunCmd(UaContext* ua, const char*)
     ua->jcr->JobIds = NULL;
   }
 
+  // Transfer the point to resume an incomplete backup at
+  if (ua->jcr->dir_impl->resume.JobId) {
+    jcr->dir_impl->resume = std::move(ua->jcr->dir_impl->resume);
+    ua->jcr->dir_impl->resume = ResumePoint{};
+  }
+
   // Transfer selected restore tree to new restore Job
   if (ua->jcr->dir_impl->restore_tree_root) {
     jcr->dir_impl->restore_tree_root = ua->jcr->dir_impl->restore_tree_root;
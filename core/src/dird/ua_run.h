@@ -38,6 +38,7 @@ struct RerunArguments {
 
 RerunArguments GetRerunCmdlineArguments(UaContext* ua);
 bool reRunCmd(UaContext* ua, const char* cmd);
+bool ResumeCmd(UaContext* ua, const char* cmd);
 bool RunCmd(UaContext* ua, const char* cmd);
 int DoRunCmd(UaContext* ua, const char* cmd);
 
@@ -43,8 +43,11 @@
 #include "lib/parse_conf.h"
 #include "lib/thread_specific_data.h"
 #include "dird/jcr_util.h"
+#include "dird/socket_server.h"
 #include "console_connection_lease.h"
 
+#include <optional>
+
 namespace directordaemon {
 
 /**
@@ -80,30 +83,85 @@ JobControlRecord* new_control_jcr(const char* base_name, int job_type)
   return jcr;
 }
 
-// Handle Director User Agent commands
-void* HandleUserAgentClientRequest(BareosSocket* user_agent_socket)
-{
-  DetachIfNotDetached(pthread_self());
+struct console_session {
+  ConsoleConnectionLease lease; /* counts the connection while it exists */
+  JobControlRecord* jcr{};
+  UaContext* ua{};
+};
 
-  JobControlRecord* jcr = new_control_jcr("-Console-", JT_CONSOLE);
+static void ServeConsole(console_session* session, bool readable);
 
-  UaContext* ua = new_ua_context(jcr);
-  ua->UA_sock = user_agent_socket;
-  SetJcrInThreadSpecificData(nullptr);
+/* Clients that send commands before the response to the previous one arrived
+ * can prefix them with a request tag "@<id> ".  The tag is removed from the
+ * command and sent back as the first message of its response, which is the
+ * JSON-RPC id of the response in API mode 2. */
+static std::optional<uint64_t> TakeRequestTag(UaContext* ua)
+{
+  const char* cmd = ua->cmd;
+  if (cmd[0] != '@' || !B_ISDIGIT(cmd[1])) { return std::nullopt; }
+
+  char* end;
+  errno = 0;
+  uint64_t id = strtoull(cmd + 1, &end, 10);
+  if (errno != 0 || (*end != ' ' && *end != 0)) { return std::nullopt; }
+  while (*end == ' ') { end++; }
+
+  ua->UA_sock->fsend("@%llu", static_cast<unsigned long long>(id));
+  PoolMem command(end);
+  PmStrcpy(ua->cmd, command);
+  return id;
+}
 
-  ConsoleConnectionLease lease;  // obtain lease to count connections
-  bool success = AuthenticateConsole(ua);
+static void EndConsole(console_session* session)
+{
+  BareosSocket* user_agent_socket = session->ua->UA_sock;
+  CloseDb(session->ua);
+  FreeUaContext(session->ua);
+  FreeJcr(session->jcr);
+  delete user_agent_socket;
+  delete session;
+}
+
+/* Gives the thread back while the console sends nothing, a thread of the
+ * socket server continues once it does. */
+static bool ParkConsole(console_session* session)
+{
+  BareosSocket* user_agent_socket = session->ua->UA_sock;
+  if (user_agent_socket->HasPendingData()) { return false; }
+
+  return ResumeWhenReadable(
+      user_agent_socket,
+      [session] {
+        SetJcrInThreadSpecificData(nullptr);
+        ServeConsole(session, true);
+      },
+      [session] { EndConsole(session); });
+}
 
-  if (!success) { ua->quit = true; }
+static void ServeConsole(console_session* session, bool readable)
+{
+  UaContext* ua = session->ua;
+  BareosSocket* user_agent_socket = ua->UA_sock;
 
   while (!ua->quit) {
-    if (ua->api) { user_agent_socket->signal(BNET_MAIN_PROMPT); }
+    if (!readable) {
+      if (ua->api) { user_agent_socket->signal(BNET_MAIN_PROMPT); }
+      if (ParkConsole(session)) { return; }
+    }
+    readable = false;
 
     int status = user_agent_socket->recv();
     if (status >= 0) {
       PmStrcpy(ua->cmd, ua->UA_sock->msg);
+      ua->send->SetRequestId(TakeRequestTag(ua));
       ParseUaArgs(ua);
       Do_a_command(ua);
+      ua->send->SetRequestId(std::nullopt);
+      if (ua->compress_messages) {
+        // the reply to .compress went out uncompressed, the rest is not
+        ua->compress_messages = false;
+        user_agent_socket->EnableMessageCompression();
+      }
 
       DequeueMessages(ua->jcr);
 
@@ -134,10 +192,23 @@ void* HandleUserAgentClientRequest(BareosSocket* user_agent_socket)
     }
   } /* while (!ua->quit) */
 
-  CloseDb(ua);
-  FreeUaContext(ua);
-  FreeJcr(jcr);
-  delete user_agent_socket;
+  EndConsole(session);
+}
+
+// Handle Director User Agent commands
+void* HandleUserAgentClientRequest(BareosSocket* user_agent_socket)
+{
+  DetachIfNotDetached(pthread_self());
+
+  console_session* session = new console_session;
+  session->jcr = new_control_jcr("-Console-", JT_CONSOLE);
+  session->ua = new_ua_context(session->jcr);
+  session->ua->UA_sock = user_agent_socket;
+  SetJcrInThreadSpecificData(nullptr);
+
+  if (!AuthenticateConsole(session->ua)) { session->ua->quit = true; }
+
+  ServeConsole(session, false);
 
   return NULL;
 }
@@ -28,6 +28,8 @@
 
 #include "include/bareos.h"
 #include "dird.h"
+#include "dird/bvfs_cache.h"
+#include "dird/background_prune.h"
 #include "dird/director_jcr_impl.h"
 #include "dird/run_hour_validator.h"
 #include "dird/dird_globals.h"
@@ -46,12 +48,16 @@
 #include "dird/ua_status.h"
 #include "include/auth_protocol_types.h"
 #include "lib/edit.h"
+#include "lib/lock_profile.h"
 #include "lib/recent_job_results_list.h"
 #include "lib/parse_conf.h"
+#include "lib/thread_util.h"
 #include "lib/util.h"
 #include "lib/version.h"
 
 #include <memory>
+#include <string>
+#include <vector>
 
 #define DEFAULT_STATUS_SCHED_DAYS 7
 
@@ -59,6 +65,8 @@ namespace directordaemon {
 
 static void ListScheduledJobs(UaContext* ua);
 static void ListRunningJobs(UaContext* ua);
+static void ListMessageDeliveryStatus(UaContext* ua);
+static void ListJobQueueStatus(UaContext* ua);
 static void ListTerminatedJobs(UaContext* ua);
 static void ListConnectedClients(UaContext* ua);
 static void DoDirectorStatus(UaContext* ua);
@@ -781,8 +789,15 @@ static void DoDirectorStatus(UaContext* ua)
   ListDirStatusHeader(ua);
   ListScheduledJobs(ua);
   ListRunningJobs(ua);
+  ListJobQueueStatus(ua);
+  ListMessageDeliveryStatus(ua);
   ListTerminatedJobs(ua);
+  ListBvfsCacheStatus(ua);
+  ListBackgroundPruneStatus(ua);
   ListConnectedClients(ua);
+  if (std::string profile = lock_profile::Report(); !profile.empty()) {
+    ua->SendMsg("%s", profile.c_str());
+  }
   ua->SendMsg("====\n");
 }
 
@@ -810,10 +825,33 @@ struct sched_pkt {
   StorageResource* store;
 };
 
-static void PrtRuntime(UaContext* ua, sched_pkt* sp)
+// what the status shows of a scheduled run
+struct scheduled_run {
+  std::string job;
+  std::string volume;
+  std::string level;
+  int type;
+  int priority;
+  utime_t runtime;
+};
+
+/* Looking up the next volume of every scheduled backup needs the catalog, so
+ * the scheduled runs are only computed once a minute (the scheduler does not
+ * look at them more often), after a reload or after something got enabled or
+ * disabled.  The Job ACL of the console is applied when they are listed. */
+struct scheduled_runs_cache {
+  std::weak_ptr<ConfigResourcesContainer> config;
+  int days{0};
+  time_t valid_until{0};
+  std::shared_ptr<const std::vector<scheduled_run>> runs;
+};
+
+static synchronized<scheduled_runs_cache> scheduled_runs;
+
+void InvalidateScheduledJobs() { scheduled_runs.lock()->valid_until = 0; }
+
+static scheduled_run LookupRuntime(UaContext* ua, sched_pkt* sp)
 {
-  char dt[MAX_TIME_LENGTH];
-  const char* level_ptr;
   bool ok = false;
   bool CloseDb = false;
   JobControlRecord* jcr = ua->jcr;
@@ -837,29 +875,43 @@ static void PrtRuntime(UaContext* ua, sched_pkt* sp)
     }
     if (!ok) { bstrncpy(mr.VolumeName, "*unknown*", sizeof(mr.VolumeName)); }
   }
-  bstrftime_nc(dt, sizeof(dt), sp->runtime);
+  if (CloseDb) { DbSqlClosePooledConnection(jcr, jcr->db); }
+  jcr->db = ua->db; /* restore ua db to jcr */
+  jcr->setJobType(orig_jobtype);
+
+  scheduled_run run;
+  run.job = sp->job->resource_name_;
+  run.volume = mr.VolumeName;
   switch (sp->job->JobType) {
     case JT_ADMIN:
     case JT_ARCHIVE:
     case JT_RESTORE:
-      level_ptr = " ";
+      run.level = " ";
       break;
     default:
-      level_ptr = JobLevelToString(sp->level);
+      run.level = JobLevelToString(sp->level);
       break;
   }
+  run.type = sp->job->JobType;
+  run.priority = sp->priority;
+  run.runtime = sp->runtime;
+  return run;
+}
+
+static void PrtRuntime(UaContext* ua, const scheduled_run& run)
+{
+  char dt[MAX_TIME_LENGTH];
+
+  bstrftime_nc(dt, sizeof(dt), run.runtime);
   if (ua->api) {
-    ua->SendMsg(T_("%-14s\t%-8s\t%3d\t%-18s\t%-18s\t%s\n"), level_ptr,
-                job_type_to_str(sp->job->JobType), sp->priority, dt,
-                sp->job->resource_name_, mr.VolumeName);
+    ua->SendMsg(T_("%-14s\t%-8s\t%3d\t%-18s\t%-18s\t%s\n"),
+                run.level.c_str(), job_type_to_str(run.type), run.priority, dt,
+                run.job.c_str(), run.volume.c_str());
   } else {
-    ua->SendMsg(T_("%-14s %-8s %3d  %-18s %-18s %s\n"), level_ptr,
-                job_type_to_str(sp->job->JobType), sp->priority, dt,
-                sp->job->resource_name_, mr.VolumeName);
+    ua->SendMsg(T_("%-14s %-8s %3d  %-18s %-18s %s\n"), run.level.c_str(),
+                job_type_to_str(run.type), run.priority, dt, run.job.c_str(),
+                run.volume.c_str());
   }
-  if (CloseDb) { DbSqlClosePooledConnection(jcr, jcr->db); }
-  jcr->db = ua->db; /* restore ua db to jcr */
-  jcr->setJobType(orig_jobtype);
 }
 
 // Sort items by runtime, priority
@@ -880,47 +932,26 @@ static int CompareByRuntimePriority(sched_pkt* p1, sched_pkt* p2)
   return 0;
 }
 
-// Find all jobs to be run in roughly the next 24 hours.
-static void ListScheduledJobs(UaContext* ua)
+// Find all jobs to be run in the next days.
+static std::vector<scheduled_run> FindScheduledRuns(UaContext* ua, int days)
 {
   utime_t runtime;
   RunResource* run;
   JobResource* job;
-  int level, num_jobs = 0;
+  int level;
   int priority;
-  bool hdr_printed = false;
   auto sched = std::make_unique<dlist<sched_pkt>>();
   sched_pkt* sp;
-  int days, i;
-
-  Dmsg0(200, "enter list_sched_jobs()\n");
-
-  days = 1;
-  i = FindArgWithValue(ua, NT_("days"));
-  if (i >= 0) {
-    days = atoi(ua->argv[i]);
-    if (((days < 0) || (days > 500)) && !ua->api) {
-      ua->SendMsg(T_("Ignoring invalid value for days. Max is 500.\n"));
-      days = 1;
-    }
-  }
 
   // Loop through all jobs
   foreach_res (job, R_JOB) {
-    if (!ua->AclAccessOk(Job_ACL, job->resource_name_) || !job->enabled
-        || (job->client && !job->client->enabled)) {
-      continue;
-    }
+    if (!job->enabled || (job->client && !job->client->enabled)) { continue; }
     for (run = NULL; (run = find_next_run(run, job, runtime, days));) {
       UnifiedStorageResource store;
       level = job->JobLevel;
       if (run->level) { level = run->level; }
       priority = job->Priority;
       if (run->Priority) { priority = run->Priority; }
-      if (!hdr_printed) {
-        PrtRunhdr(ua);
-        hdr_printed = true;
-      }
       sp = (sched_pkt*)malloc(sizeof(sched_pkt));
       sp->job = job;
       sp->level = level;
@@ -936,62 +967,102 @@ static void ListScheduledJobs(UaContext* ua)
         Dmsg1(250, "job=%s could not get job storage\n", job->resource_name_);
       }
       sched->BinaryInsertMultiple(sp, CompareByRuntimePriority);
-      num_jobs++;
     }
   } /* end for loop over resources */
 
-  foreach_dlist (sp, sched) { PrtRuntime(ua, sp); }
+  std::vector<scheduled_run> runs;
+  runs.reserve(sched->size());
+  foreach_dlist (sp, sched) { runs.push_back(LookupRuntime(ua, sp)); }
+  return runs;
+}
+
+static void ListScheduledJobs(UaContext* ua)
+{
+  int num_jobs = 0;
+  bool hdr_printed = false;
+  int days, i;
+
+  Dmsg0(200, "enter list_sched_jobs()\n");
+
+  days = 1;
+  i = FindArgWithValue(ua, NT_("days"));
+  if (i >= 0) {
+    days = atoi(ua->argv[i]);
+    if (((days < 0) || (days > 500)) && !ua->api) {
+      ua->SendMsg(T_("Ignoring invalid value for days. Max is 500.\n"));
+      days = 1;
+    }
+  }
+
+  std::shared_ptr<const std::vector<scheduled_run>> runs;
+  {
+    auto cache = scheduled_runs.lock();
+    time_t now = time(NULL);
+    auto config = my_config->GetResourcesContainer();
+    if (now >= cache->valid_until || days != cache->days
+        || cache->config.lock() != config) {
+      cache->runs = std::make_shared<const std::vector<scheduled_run>>(
+          FindScheduledRuns(ua, days));
+      cache->config = config;
+      cache->days = days;
+      cache->valid_until = now - now % 60 + 60;
+    } else {
+      Dmsg0(200, "list_sched_jobs() uses the cached runs\n");
+    }
+    runs = cache->runs;
+  }
+
+  // printed without the lock, a slow console does not hold up the others
+  for (const scheduled_run& run : *runs) {
+    if (!ua->AclAccessOk(Job_ACL, run.job.c_str())) { continue; }
+    if (!hdr_printed) {
+      PrtRunhdr(ua);
+      hdr_printed = true;
+    }
+    PrtRuntime(ua, run);
+    num_jobs++;
+  }
   if (num_jobs == 0 && !ua->api) { ua->SendMsg(T_("No Scheduled Jobs.\n")); }
   if (!ua->api) ua->SendMsg("====\n");
   Dmsg0(200, "Leave list_sched_jobs_runs()\n");
 }
 
+// what the status shows of a running job
+struct running_job {
+  JobId_t JobId;
+  char level[10];
+  std::string Job;
+  std::string msg;
+  std::string comment;
+  std::string stages;
+};
+
 static void ListRunningJobs(UaContext* ua)
 {
   JobControlRecord* jcr;
   int njobs = 0;
   const char* msg;
   char* emsg; /* edited message */
-  char level[10];
   bool pool_mem = false;
+  std::vector<utime_t> consoles;
+  std::vector<running_job> jobs;
 
   Dmsg0(200, "enter list_run_jobs()\n");
-  if (!ua->api) ua->SendMsg(T_("\nRunning Jobs:\n"));
+
+  /* Everything is copied out of the jcrs first, so no jcr is held while
+   * sending to the console. */
   foreach_jcr (jcr) {
     if (jcr->JobId == 0) { /* this is us */
       /* this is a console or other control job. We only show console
        * jobs in the status output.
        */
-      char dt[MAX_TIME_LENGTH];
-      if (jcr->is_JobType(JT_CONSOLE) && !ua->api) {
-        bstrftime_nc(dt, sizeof(dt), jcr->start_time);
-        ua->SendMsg(T_("Console connected at %s\n"), dt);
-      }
+      if (jcr->is_JobType(JT_CONSOLE)) { consoles.push_back(jcr->start_time); }
       continue;
     }
     njobs++;
-  }
-  endeach_jcr(jcr);
-
-  if (njobs == 0) {
-    // Note the following message is used by external programs -- don't change
-    if (!ua->api) ua->SendMsg(T_("No Jobs running.\n====\n"));
-    Dmsg0(200, "leave list_run_jobs()\n");
-    return;
-  }
-  njobs = 0;
-  if (!ua->api) {
-    ua->SendMsg(T_(" JobId Level   Name                       Status\n"));
-    ua->SendMsg(T_(
-        "===================================================================="
-        "==\n"));
-  }
-  foreach_jcr (jcr) {
-    if (jcr->JobId == 0
-        || !ua->AclAccessOk(Job_ACL, jcr->dir_impl->res.job->resource_name_)) {
+    if (!ua->AclAccessOk(Job_ACL, jcr->dir_impl->res.job->resource_name_)) {
       continue;
     }
-    njobs++;
     switch (jcr->getJobStatus()) {
       case JS_Created:
         msg = T_("is waiting execution");
@@ -1143,29 +1214,25 @@ static void ListRunningJobs(UaContext* ua)
         msg = T_("Dir inserting Attributes");
         break;
     }
+    running_job& job = jobs.emplace_back();
+    job.JobId = jcr->JobId;
     switch (jcr->getJobType()) {
       case JT_ADMIN:
       case JT_ARCHIVE:
       case JT_RESTORE:
-        bstrncpy(level, "      ", sizeof(level));
+        bstrncpy(job.level, "      ", sizeof(job.level));
         break;
       default:
-        bstrncpy(level, JobLevelToString(jcr->getJobLevel()), sizeof(level));
-        level[7] = 0;
+        bstrncpy(job.level, JobLevelToString(jcr->getJobLevel()),
+                 sizeof(job.level));
+        job.level[7] = 0;
         break;
     }
-
-    if (ua->api) {
-      BashSpaces(jcr->comment);
-      ua->SendMsg(T_("%6d\t%-6s\t%-20s\t%s\t%s\n"), jcr->JobId, level, jcr->Job,
-                  msg, jcr->comment);
-      UnbashSpaces(jcr->comment);
-    } else {
-      ua->SendMsg(T_("%6d %-6s  %-20s %s\n"), jcr->JobId, level, jcr->Job, msg);
-      /* Display comments if any */
-      if (*jcr->comment) {
-        ua->SendMsg(T_("               %-30s\n"), jcr->comment);
-      }
+    job.Job = jcr->Job;
+    job.msg = msg;
+    job.comment = jcr->comment;
+    if (!ua->api) {
+      job.stages = jcr->dir_impl->stage_times.Format(catalog_stage_names);
     }
 
     if (pool_mem) {
@@ -1174,10 +1241,88 @@ static void ListRunningJobs(UaContext* ua)
     }
   }
   endeach_jcr(jcr);
+
+  if (!ua->api) {
+    ua->SendMsg(T_("\nRunning Jobs:\n"));
+    for (utime_t start_time : consoles) {
+      char dt[MAX_TIME_LENGTH];
+      bstrftime_nc(dt, sizeof(dt), start_time);
+      ua->SendMsg(T_("Console connected at %s\n"), dt);
+    }
+  }
+
+  if (njobs == 0) {
+    // Note the following message is used by external programs -- don't change
+    if (!ua->api) ua->SendMsg(T_("No Jobs running.\n====\n"));
+    Dmsg0(200, "leave list_run_jobs()\n");
+    return;
+  }
+  if (!ua->api) {
+    ua->SendMsg(T_(" JobId Level   Name                       Status\n"));
+    ua->SendMsg(T_(
+        "===================================================================="
+        "==\n"));
+  }
+  for (running_job& job : jobs) {
+    if (ua->api) {
+      BashSpaces(job.comment);
+      ua->SendMsg(T_("%6d\t%-6s\t%-20s\t%s\t%s\n"), job.JobId, job.level,
+                  job.Job.c_str(), job.msg.c_str(), job.comment.c_str());
+    } else {
+      ua->SendMsg(T_("%6d %-6s  %-20s %s\n"), job.JobId, job.level,
+                  job.Job.c_str(), job.msg.c_str());
+      /* Display comments if any */
+      if (!job.comment.empty()) {
+        ua->SendMsg(T_("               %-30s\n"), job.comment.c_str());
+      }
+      if (!job.stages.empty()) {
+        ua->SendMsg(T_("               Catalog: %s\n"), job.stages.c_str());
+      }
+    }
+  }
   if (!ua->api) ua->SendMsg("====\n");
   Dmsg0(200, "leave list_run_jobs()\n");
 }
 
+static void ListJobQueueStatus(UaContext* ua)
+{
+  jobq_statistics stats = GetJobQueueStatistics();
+  if (ua->api || (stats.started == 0 && stats.waiting == 0)) { return; }
+
+  char ed1[50], ed2[50], ed3[50];
+  utime_t average = stats.started ? stats.total_wait_time / stats.started : 0;
+  ua->SendMsg(T_("\nJob Queue:\n"));
+  ua->SendMsg(T_("Waiting: %d, ready: %d, running: %d\n"), stats.waiting,
+              stats.ready, stats.running);
+  ua->SendMsg(T_("Started: %s, average wait: %s, longest wait: %s\n"),
+              edit_uint64_with_commas(stats.started, ed1),
+              edit_utime(average, ed2, sizeof(ed2)),
+              edit_utime(stats.max_wait_time, ed3, sizeof(ed3)));
+  if (stats.rate_limited > 0) {
+    ua->SendMsg(T_("Held back by the start rate: %d\n"), stats.rate_limited);
+  }
+  ua->SendMsg("====\n");
+}
+
+static void ListMessageDeliveryStatus(UaContext* ua)
+{
+  std::vector<message_delivery_stats> stats = GetMessageDeliveryStats();
+  if (ua->api || stats.empty()) { return; }
+
+  char ed1[50], ed2[50], ed3[50];
+  ua->SendMsg(T_("\nMessage Delivery:\n"));
+  for (auto& delivery : stats) {
+    ua->SendMsg(T_("%s: queued: %s, waits: %s, inline: %s, max depth: %d, "
+                   "max batch: %d\n"),
+                delivery.destination,
+                edit_uint64_with_commas(delivery.queued, ed1),
+                edit_uint64_with_commas(delivery.waits, ed2),
+                edit_uint64_with_commas(delivery.inline_delivered, ed3),
+                (int)delivery.max_depth, (int)delivery.max_batch);
+  }
+  ua->SendMsg("====\n");
+}
+
 static void ListTerminatedJobs(UaContext* ua)
 {
   char dt[MAX_TIME_LENGTH], b1[30], b2[30];
@@ -26,5 +26,8 @@ namespace directordaemon {
 
 void ListDirStatusHeader(UaContext* ua);
 
+// makes the next status recompute the scheduled jobs
+void InvalidateScheduledJobs();
+
 } /* namespace directordaemon */
 #endif  // BAREOS_DIRD_UA_STATUS_H_
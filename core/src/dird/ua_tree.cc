@@ -38,9 +38,15 @@
 #include "dird/ua_server.h"
 #include "lib/attribs.h"
 #include "lib/edit.h"
+#include "lib/thread_pool.h"
 #include "lib/tree.h"
 #include "lib/util.h"
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+
 namespace directordaemon {
 
 /* Forward referenced commands */
@@ -143,7 +149,7 @@ bool UserSelectFilesFromTree(TreeContext* tree)
 
   // Enter interactive command handler allowing selection of individual files.
   tree->node = tree->root;
-  cwd = tree_getpath(tree->node);
+  cwd = tree_getpath(tree->root, tree->node);
   if (cwd) {
     ua->SendMsg(T_("cwd is: %s\n"), cwd);
     FreePoolMemory(cwd);
@@ -205,53 +211,90 @@ bool UserSelectFilesFromTree(TreeContext* tree)
   return status;
 }
 
-/**
- * This callback routine is responsible for inserting the
- * items it gets into the directory tree. For each JobId selected
- * this routine is called once for each file. We do not allow
- * duplicate filenames, but instead keep the info from the most
- * recent file entered (i.e. the JobIds are assumed to be sorted)
- *
- * See uar_sel_files in sql_cmds.c for query that calls us.
- * row[0]=Path, row[1]=Filename, row[2]=FileIndex
- * row[3]=JobId row[4]=LStat row[5]=DeltaSeq row[6]=Fhinfo row[7]=Fhnode
- */
-int InsertTreeHandler(void* ctx, int, char** row)
-{
-  struct stat statp;
-  TreeContext* tree = (TreeContext*)ctx;
-  tree_node* node;
+namespace {
+// One file list row decoded, see InsertTreeHandler()
+struct tree_row {
+  char* path;
+  char* fname;
   tree_node_type type;
-  bool hard_link, ok;
-  int FileIndex;
-  int32_t delta_seq;
+  int32_t FileIndex;
   JobId_t JobId;
-  HL_ENTRY* entry = NULL;
+  int32_t delta_seq;
   int32_t LinkFI;
+  uint64_t fhinfo;
+  uint64_t fhnode;
+  uint64_t size;  /* st_size of regular files */
+  bool soft_link; /* S_ISLNK(st_mode) */
+  bool linked;    /* st_nlink > 1 */
+};
+}  // namespace
+
+static void DecodeTreeRow(char** row, tree_row& parsed)
+{
+  struct stat statp;
 
-  Dmsg4(150, "Path=%s%s FI=%s JobId=%s\n", row[0], row[1], row[2], row[3]);
+  parsed.path = row[0];
+  parsed.fname = row[1];
   if (*row[1] == 0) {                /* no filename => directory */
     if (!IsPathSeparator(*row[0])) { /* Must be Win32 directory */
-      type = tree_node_type::DirWin;
+      parsed.type = tree_node_type::DirWin;
     } else {
-      type = tree_node_type::Dir;
+      parsed.type = tree_node_type::Dir;
     }
   } else {
-    type = tree_node_type::File;
+    parsed.type = tree_node_type::File;
   }
-  DecodeStat(row[4], &statp, sizeof(statp), &LinkFI);
+  DecodeStat(row[4], &statp, sizeof(statp), &parsed.LinkFI);
+  parsed.soft_link = S_ISLNK(statp.st_mode) != 0;
+  parsed.size = (S_ISREG(statp.st_mode) && statp.st_size > 0)
+                    ? static_cast<uint64_t>(statp.st_size)
+                    : 0;
+  parsed.linked = statp.st_nlink > 1;
+  parsed.JobId = str_to_int64(row[3]);
+  parsed.FileIndex = str_to_int64(row[2]);
+  parsed.delta_seq = str_to_int64(row[5]);
+  parsed.fhinfo = str_to_int64(row[6]);
+  parsed.fhnode = str_to_int64(row[7]);
+}
+
+// Keeps the counters of the tree root in line with node->extract
+static void CountMarked(TREE_ROOT* root, tree_node* node, bool marked)
+{
+  if (node->type == tree_node_type::NewDir
+      || node->type == tree_node_type::Root) {
+    return;
+  }
+  if (marked) {
+    root->num_marked++;
+    root->marked_bytes += TreeNodeSize(node);
+  } else {
+    root->num_marked--;
+    root->marked_bytes -= TreeNodeSize(node);
+  }
+}
+
+static void InsertTreeRow(TreeContext* tree, const tree_row& row)
+{
+  tree_node* node;
+  tree_node_type type = row.type;
+  bool hard_link, ok;
+  int FileIndex = row.FileIndex;
+  int32_t delta_seq = row.delta_seq;
+  JobId_t JobId = row.JobId;
+  HL_ENTRY* entry = NULL;
+  int32_t LinkFI = row.LinkFI;
+
+  Dmsg4(150, "Path=%s%s FI=%d JobId=%d\n", row.path, row.fname, FileIndex,
+        JobId);
   hard_link = (LinkFI != 0);
-  node = insert_tree_node(row[0], row[1], type, tree->root, NULL);
-  JobId = str_to_int64(row[3]);
-  FileIndex = str_to_int64(row[2]);
-  delta_seq = str_to_int64(row[5]);
-  node->fhinfo = str_to_int64(row[6]);
-  node->fhnode = str_to_int64(row[7]);
+  node = insert_tree_node(row.path, row.fname, type, tree->root, NULL);
+  node->fhinfo = row.fhinfo;
+  node->fhnode = row.fhnode;
   Dmsg8(150,
-        "node=0x%p JobId=%s FileIndex=%s Delta=%s node.delta=%d LinkFI=%d, "
+        "node=0x%p JobId=%d FileIndex=%d Delta=%d node.delta=%d LinkFI=%d, "
         "fhinfo=%d, fhnode=%d\n",
-        node, row[3], row[2], row[5], node->delta_seq, LinkFI, node->fhinfo,
-        node->fhnode);
+        node, JobId, FileIndex, delta_seq, node->delta_seq, LinkFI,
+        node->fhinfo, node->fhnode);
 
   // TODO: check with hardlinks
   if (delta_seq > 0) {
@@ -267,14 +310,14 @@ int InsertTreeHandler(void* ctx, int, char** row)
         tree->ua->WarningMsg(
             T_("Something is wrong with the Delta sequence of %s, "
                "skipping new parts. Current sequence is %d\n"),
-            row[1], node->delta_seq);
+            row.fname, node->delta_seq);
 
         Dmsg3(0,
               "Something is wrong with Delta, skip it "
               "fname=%s d1=%d d2=%d\n",
-              row[1], node->delta_seq, delta_seq);
+              row.fname, node->delta_seq, delta_seq);
       }
-      return 0;
+      return;
     }
   }
 
@@ -294,17 +337,23 @@ int InsertTreeHandler(void* ctx, int, char** row)
     }
   }
   if (ok) {
+    if (node->extract) { CountMarked(tree->root, node, false); }
+    if (node->inserted || node->type == tree_node_type::NewDir) {
+      tree->root->num_entries++;
+    }
     node->hard_link = hard_link;
     node->FileIndex = FileIndex;
     node->JobId = JobId;
     node->type = type;
-    node->soft_link = S_ISLNK(statp.st_mode) != 0;
+    node->soft_link = row.soft_link;
     node->delta_seq = delta_seq;
+    TreeNodeSetSize(node, row.size);
 
     if (tree->all) { node->extract = true; /* extract by default */ }
+    if (node->extract) { CountMarked(tree->root, node, true); }
 
     // Insert file having hardlinks into hardlink hashtable.
-    if (statp.st_nlink > 1 && type != tree_node_type::Dir
+    if (row.linked && type != tree_node_type::Dir
         && type != tree_node_type::DirWin) {
       if (!LinkFI) {
         // First occurence - file hardlinked to
@@ -339,69 +388,312 @@ int InsertTreeHandler(void* ctx, int, char** row)
   }
 
   tree->cnt++;
+}
+
+/**
+ * This callback routine is responsible for inserting the
+ * items it gets into the directory tree. For each JobId selected
+ * this routine is called once for each file. We do not allow
+ * duplicate filenames, but instead keep the info from the most
+ * recent file entered (i.e. the JobIds are assumed to be sorted)
+ *
+ * See uar_sel_files in sql_cmds.c for query that calls us.
+ * row[0]=Path, row[1]=Filename, row[2]=FileIndex
+ * row[3]=JobId row[4]=LStat row[5]=DeltaSeq row[6]=Fhinfo row[7]=Fhnode
+ */
+int InsertTreeHandler(void* ctx, int, char** row)
+{
+  TreeContext* tree = (TreeContext*)ctx;
+  tree_row parsed;
+
+  DecodeTreeRow(row, parsed);
+  InsertTreeRow(tree, parsed);
   return 0;
 }
 
+namespace {
+constexpr int tree_row_fields = 8;
+constexpr std::size_t tree_batch_rows = 1000;
+
+/* Rows as they come from the catalog, and decoded by one of the workers.
+ * The path and fname of the decoded rows point into data. */
+struct tree_row_batch {
+  std::vector<char> data;          /* all fields of all rows */
+  std::vector<std::size_t> starts; /* offset of the first field of a row */
+  std::vector<tree_row> rows;
+};
+
+void DecodeTreeRows(tree_row_batch& batch)
+{
+  char* fields[tree_row_fields];
+
+  batch.rows.resize(batch.starts.size());
+  for (std::size_t i = 0; i < batch.starts.size(); ++i) {
+    char* field = batch.data.data() + batch.starts[i];
+    for (auto& f : fields) {
+      f = field;
+      field += strlen(field) + 1;
+    }
+    DecodeTreeRow(fields, batch.rows[i]);
+  }
+}
+
+struct tree_fetch_context {
+  work_group& decoders;
+  channel::input<std::future<tree_row_batch>>& out;
+  tree_row_batch batch{};
+
+  void SubmitBatch()
+  {
+    if (batch.starts.empty()) { return; }
+    out.emplace(decoders.submit([b = std::move(batch)]() mutable {
+      DecodeTreeRows(b);
+      return std::move(b);
+    }));
+    batch = tree_row_batch{};
+  }
+};
+
+int CollectTreeRow(void* ctx, int num_fields, char** row)
+{
+  auto* fetch = static_cast<tree_fetch_context*>(ctx);
+  auto& batch = fetch->batch;
+
+  if (num_fields < tree_row_fields) { return 0; }
+
+  batch.starts.push_back(batch.data.size());
+  for (int i = 0; i < tree_row_fields; ++i) {
+    const char* field = row[i] ? row[i] : "";
+    batch.data.insert(batch.data.end(), field, field + strlen(field) + 1);
+  }
+  if (batch.starts.size() >= tree_batch_rows) { fetch->SubmitBatch(); }
+  return 0;
+}
+}  // namespace
+
 /**
- * Set extract to value passed. We recursively walk down the tree setting all
- * children if the node is a directory.
+ * Same as calling fetch(InsertTreeHandler, tree), but the rows are fetched
+ * by another thread and decoded by num_workers threads, while this thread
+ * inserts them into the tree in the order they were fetched.
  */
-static int SetExtract(UaContext* ua,
-                      tree_node* node,
-                      TreeContext* tree,
-                      bool extract)
+bool BuildTreeInParallel(
+    TreeContext* tree,
+    std::size_t num_workers,
+    const std::function<bool(DB_RESULT_HANDLER*, void*)>& fetch)
 {
-  tree_node* n;
-  int count = 0;
+  thread_pool threads;
+  work_group decoders(num_workers * 2);
+
+  std::condition_variable decoders_fin;
+  synchronized<std::size_t> latch{num_workers};
+  threads.borrow_threads(num_workers, [&latch, &decoders, &decoders_fin] {
+    decoders.work_until_completion();
+
+    *latch.lock() -= 1;
+    decoders_fin.notify_one();
+  });
+
+  auto [in, out] = channel::CreateBufferedChannel<std::future<tree_row_batch>>(
+      num_workers * 2);
+
+  std::promise<bool> fetched;
+  std::future fetch_result = fetched.get_future();
+  threads.borrow_thread([&fetch, &decoders, in = std::move(in),
+                         fetched = std::move(fetched)]() mutable {
+    tree_fetch_context ctx{decoders, in};
+    bool ok = fetch(CollectTreeRow, &ctx);
+    ctx.SubmitBatch();
+    in.close();
+    fetched.set_value(ok);
+  });
+
+  while (std::optional batch_fut = out.get()) {
+    tree_row_batch batch = batch_fut->get();
+    for (const tree_row& row : batch.rows) { InsertTreeRow(tree, row); }
+  }
 
+  bool ok = fetch_result.get();
+  decoders.shutdown();
+  latch.lock().wait(decoders_fin, [](std::size_t num) { return num == 0; });
+  return ok;
+}
+
+namespace {
+// What marking a part of the tree changed
+struct mark_result {
+  int count{0};                       /* entries changed */
+  uint64_t bytes{0};                  /* size of the files changed */
+  std::vector<tree_node*> hardlinks{}; /* hard links to follow */
+};
+
+/* Marking is spread over threads only in trees of at least this many nodes,
+ * once the top of the subtree has been split into this many subtrees. */
+constexpr tree_index parallel_mark_nodes = 1 << 16;
+constexpr std::size_t parallel_mark_subtrees = 64;
+}  // namespace
+
+// For a non-file (i.e. directory), we see all the children
+static bool MarkChildren(const tree_node* node)
+{
+  return node->type != tree_node_type::File
+         || (node->soft_link && TreeNodeHasChild(node));
+}
+
+// Sets extract of the node alone, everything below it gets the same value
+static void MarkNode(tree_node* node, bool extract, mark_result& result)
+{
   if (node->extract != extract && node->type != tree_node_type::NewDir
       && node->type != tree_node_type::Root) {
-    count++;
+    result.count++;
+    result.bytes += TreeNodeSize(node);
   }
 
   node->extract = extract;
 
-  // For a non-file (i.e. directory), we see all the children
-  if (node->type != tree_node_type::File
-      || (node->soft_link && TreeNodeHasChild(node))) {
-    // Recursive set children within directory
-    foreach_child (n, node) { count += SetExtract(ua, n, tree, extract); }
+  if (MarkChildren(node)) {
+    if (TreeNodeHasChild(node)) { node->extract_descendant = extract; }
+  } else if (extract && node->hard_link) {
+    result.hardlinks.push_back(node);
+  }
+}
 
-  } else {
-    if (extract && node->hard_link) {
-      // Every hardlink is in hashtable, and it points to linked file.
-      uint64_t key = (((uint64_t)node->JobId) << 32) + node->FileIndex;
-
-      /* If we point to a hard linked file, find that file in hardlinks
-       * hashmap, and mark it to be restored as well. */
-      HL_ENTRY* entry = (HL_ENTRY*)tree->root->hardlinks.lookup(key);
-      if (entry && entry->node) {
-        n = entry->node;
-        count += SetExtract(ua, n, tree, extract);
+/* Marks the node and everything below it.  This only touches nodes of the
+ * subtree, so disjoint subtrees can be marked at the same time; the children
+ * are visited unsorted for the same reason. */
+static void MarkSubtree(TREE_ROOT* root,
+                        tree_node* node,
+                        bool extract,
+                        mark_result& result)
+{
+  std::vector<tree_node*> stack{node};
+  while (!stack.empty()) {
+    tree_node* current = stack.back();
+    stack.pop_back();
+    MarkNode(current, extract, result);
+    if (!MarkChildren(current)) { continue; }
+    for (uint32_t i = 0; i < current->num_children; ++i) {
+      stack.push_back(TreeNodeAt(root, current->children[i]));
+    }
+  }
+}
+
+/* In big trees the top of the subtree is marked level by level until there
+ * are enough subtrees below it, which are then marked by several threads. */
+static void MarkSubtreeInParallel(TREE_ROOT* root,
+                                  tree_node* node,
+                                  bool extract,
+                                  mark_result& result)
+{
+  std::vector<tree_node*> subtrees{node};
+  if (root->num_nodes >= parallel_mark_nodes) {
+    std::vector<tree_node*> below;
+    while (!subtrees.empty() && subtrees.size() < parallel_mark_subtrees) {
+      below.clear();
+      for (tree_node* top : subtrees) {
+        MarkNode(top, extract, result);
+        if (!MarkChildren(top)) { continue; }
+        for (uint32_t i = 0; i < top->num_children; ++i) {
+          below.push_back(TreeNodeAt(root, top->children[i]));
+        }
       }
+      subtrees.swap(below);
     }
   }
 
-  // Walk up tree marking any unextracted parent to be extracted.
+  std::size_t num_threads = std::min<std::size_t>(
+      subtrees.size(), std::thread::hardware_concurrency());
+  if (num_threads < 2) {
+    for (tree_node* subtree : subtrees) {
+      MarkSubtree(root, subtree, extract, result);
+    }
+    return;
+  }
+
+  std::vector<mark_result> results(num_threads);
+  std::atomic<std::size_t> next{0};
+  {
+    thread_pool threads;
+    for (mark_result& thread_result : results) {
+      threads.borrow_thread([&subtrees, &next, &thread_result, root,
+                             extract] {
+        for (std::size_t i; (i = next++) < subtrees.size();) {
+          MarkSubtree(root, subtrees[i], extract, thread_result);
+        }
+      });
+    }
+  }
+
+  for (mark_result& thread_result : results) {
+    result.count += thread_result.count;
+    result.bytes += thread_result.bytes;
+    result.hardlinks.insert(result.hardlinks.end(),
+                            thread_result.hardlinks.begin(),
+                            thread_result.hardlinks.end());
+  }
+}
+
+// Walk up tree marking any unextracted parent to be extracted.
+static void MarkParents(TREE_ROOT* root, tree_node* node, bool extract)
+{
+  tree_node* parent;
   if (extract) {
-    while (node->parent && !node->parent->extract_descendant) {
-      node = node->parent;
+    while ((parent = TreeParent(root, node)) && !parent->extract_descendant) {
+      node = parent;
       node->extract_descendant = true;
     }
   } else {
-    while (node->parent && node->parent->extract_descendant) {
-      node = node->parent;
+    while ((parent = TreeParent(root, node)) && parent->extract_descendant) {
+      node = parent;
       node->extract_descendant = false;
-      tree_node* child;
-      foreach_child (child, node) {
+      for (tree_node* child : TreeChildren(root, node)) {
         if (child->extract || child->extract_descendant) {
           node->extract_descendant = true;
+          break;
         }
       }
     }
   }
+}
 
-  return count;
+/**
+ * Set extract to value passed. We walk down the tree setting all
+ * children if the node is a directory.
+ */
+static int SetExtract(UaContext*,
+                      tree_node* node,
+                      TreeContext* tree,
+                      bool extract)
+{
+  TREE_ROOT* root = tree->root;
+  mark_result result;
+
+  MarkSubtreeInParallel(root, node, extract, result);
+  MarkParents(root, node, extract);
+
+  /* If we point to a hard linked file, find that file in hardlinks
+   * hashmap, and mark it to be restored as well. */
+  while (!result.hardlinks.empty()) {
+    tree_node* link = result.hardlinks.back();
+    result.hardlinks.pop_back();
+
+    // Every hardlink is in hashtable, and it points to linked file.
+    uint64_t key = (((uint64_t)link->JobId) << 32) + link->FileIndex;
+    HL_ENTRY* entry = (HL_ENTRY*)root->hardlinks.lookup(key);
+    if (entry && entry->node && !entry->node->extract) {
+      MarkSubtree(root, entry->node, true, result);
+      MarkParents(root, entry->node, true);
+    }
+  }
+
+  if (extract) {
+    root->num_marked += result.count;
+    root->marked_bytes += result.bytes;
+  } else {
+    root->num_marked -= result.count;
+    root->marked_bytes -= result.bytes;
+  }
+
+  return result.count;
 }
 
 static void StripTrailingSlash(char* arg)
@@ -467,10 +759,8 @@ static int MarkElements(UaContext* ua, TreeContext* tree, bool extract = true)
     } else if (parts[0].size() == 2 && parts[0][1] == ':') {
       // maybe we are trying to mark from a windows root
 
-      tree_node* root_child;
-
       bool found_root = false;
-      foreach_child (root_child, tree->root) {
+      for (tree_node* root_child : TreeChildren(tree->root, tree->root)) {
         if (root_child->type == tree_node_type::DirWin
             && fnmatch(parts[0].c_str(), root_child->fname, 0) == 0) {
           stack.push_back({root_child, 1});
@@ -502,8 +792,7 @@ static int MarkElements(UaContext* ua, TreeContext* tree, bool extract = true)
         // ** inside a path means: match 0 or more subdirectories, so we take
         // care of the "matcth 0 subdir" case
         stack.push_back({node, current.part_index + 1});
-        tree_node* child;
-        foreach_child (child, node) {
+        for (tree_node* child : TreeChildren(tree->root, node)) {
           // we already know that each (non-file) child matches **,
           // so no need to check
 
@@ -513,8 +802,7 @@ static int MarkElements(UaContext* ua, TreeContext* tree, bool extract = true)
           }
         }
       } else {
-        tree_node* child;
-        foreach_child (child, node) {
+        for (tree_node* child : TreeChildren(tree->root, node)) {
           if (fnmatch(part.c_str(), child->fname, 0) == 0) {
             if (current.part_index + 1 == parts.size()) {
               count += SetExtract(ua, child, tree, extract);
@@ -558,7 +846,6 @@ static int markcmd(UaContext* ua, TreeContext* tree)
 
 static int Markdircmd(UaContext* ua, TreeContext* tree)
 {
-  tree_node* node;
   int count = 0;
   char ec1[50];
 
@@ -568,10 +855,13 @@ static int Markdircmd(UaContext* ua, TreeContext* tree)
   }
   for (int i = 1; i < ua->argc; i++) {
     StripTrailingSlash(ua->argk[i]);
-    foreach_child (node, tree->node) {
+    for (tree_node* node : TreeChildren(tree->root, tree->node)) {
       if (fnmatch(ua->argk[i], node->fname, 0) == 0) {
         if (node->type == tree_node_type::Dir
             || node->type == tree_node_type::DirWin) {
+          if (node->extract != true) {
+            CountMarked(tree->root, node, true);
+          }
           node->extract = true;
           count++;
         }
@@ -591,20 +881,11 @@ static int Markdircmd(UaContext* ua, TreeContext* tree)
 
 static int countcmd(UaContext* ua, TreeContext* tree)
 {
-  tree_node* node;
-  int total, num_extract;
   char ec1[50], ec2[50];
 
-  total = num_extract = 0;
-  for (node = FirstTreeNode(tree->root); node; node = NextTreeNode(node)) {
-    if (node->type != tree_node_type::NewDir) {
-      total++;
-      if (node->extract) { num_extract++; }
-    }
-  }
   ua->SendMsg(T_("%s total files/dirs. %s marked to be restored.\n"),
-              edit_uint64_with_commas(total, ec1),
-              edit_uint64_with_commas(num_extract, ec2));
+              edit_uint64_with_commas(tree->root->num_entries, ec1),
+              edit_uint64_with_commas(tree->root->num_marked, ec2));
   return 1;
 }
 
@@ -619,21 +900,20 @@ static int findcmd(UaContext* ua, TreeContext* tree)
   }
 
   for (int i = 1; i < ua->argc; i++) {
-    for (node = FirstTreeNode(tree->root); node; node = NextTreeNode(node)) {
-      if (fnmatch(ua->argk[i], node->fname, 0) == 0) {
-        const char* tag;
-
-        cwd = tree_getpath(node);
-        if (node->extract) {
-          tag = "*";
-        } else if (node->extract_descendant) {
-          tag = "+";
-        } else {
-          tag = "";
-        }
-        ua->SendMsg("%s%s\n", tag, cwd);
-        FreePoolMemory(cwd);
+    for (tree_index index : tree->names.Find(tree->root, ua->argk[i])) {
+      const char* tag;
+
+      node = TreeNodeAt(tree->root, index);
+      cwd = tree_getpath(tree->root, node);
+      if (node->extract) {
+        tag = "*";
+      } else if (node->extract_descendant) {
+        tag = "+";
+      } else {
+        tag = "";
       }
+      ua->SendMsg("%s%s\n", tag, cwd);
+      FreePoolMemory(cwd);
     }
   }
   return 1;
@@ -641,11 +921,9 @@ static int findcmd(UaContext* ua, TreeContext* tree)
 
 static int DotLsdircmd(UaContext* ua, TreeContext* tree)
 {
-  tree_node* node;
-
   if (!TreeNodeHasChild(tree->node)) { return 1; }
 
-  foreach_child (node, tree->node) {
+  for (tree_node* node : TreeChildren(tree->root, tree->node)) {
     if (ua->argc == 1 || fnmatch(ua->argk[1], node->fname, 0) == 0) {
       if (TreeNodeHasChild(node)) { ua->SendMsg("%s/\n", node->fname); }
     }
@@ -665,11 +943,9 @@ static int DotHelpcmd(UaContext* ua, TreeContext*)
 
 static int DotLscmd(UaContext* ua, TreeContext* tree)
 {
-  tree_node* node;
-
   if (!TreeNodeHasChild(tree->node)) { return 1; }
 
-  foreach_child (node, tree->node) {
+  for (tree_node* node : TreeChildren(tree->root, tree->node)) {
     if (ua->argc == 1 || fnmatch(ua->argk[1], node->fname, 0) == 0) {
       ua->SendMsg("%s%s\n", node->fname, TreeNodeHasChild(node) ? "/" : "");
     }
@@ -680,10 +956,8 @@ static int DotLscmd(UaContext* ua, TreeContext* tree)
 
 static int lscmd(UaContext* ua, TreeContext* tree)
 {
-  tree_node* node;
-
   if (!TreeNodeHasChild(tree->node)) { return 1; }
-  foreach_child (node, tree->node) {
+  for (tree_node* node : TreeChildren(tree->root, tree->node)) {
     if (ua->argc == 1 || fnmatch(ua->argk[1], node->fname, 0) == 0) {
       const char* tag;
       if (node->extract) {
@@ -703,9 +977,8 @@ static int lscmd(UaContext* ua, TreeContext* tree)
 // Ls command that lists only the marked files
 static int DotLsmarkcmd(UaContext* ua, TreeContext* tree)
 {
-  tree_node* node;
   if (!TreeNodeHasChild(tree->node)) { return 1; }
-  foreach_child (node, tree->node) {
+  for (tree_node* node : TreeChildren(tree->root, tree->node)) {
     if ((ua->argc == 1 || fnmatch(ua->argk[1], node->fname, 0) == 0)
         && (node->extract)) {
       ua->SendMsg("%s%s\n", node->fname, TreeNodeHasChild(node) ? "/" : "");
@@ -715,9 +988,11 @@ static int DotLsmarkcmd(UaContext* ua, TreeContext* tree)
 }
 
 // This recursive ls command that lists only the marked files
-static void rlsmark(UaContext* ua, tree_node* tnode, int level)
+static void rlsmark(UaContext* ua,
+                    TREE_ROOT* root,
+                    tree_node* tnode,
+                    int level)
 {
-  tree_node* node;
   const int max_level = 100;
   char indent[max_level * 2 + 1];
   int i, j;
@@ -732,7 +1007,7 @@ static void rlsmark(UaContext* ua, tree_node* tnode, int level)
   }
   indent[j] = 0;
 
-  foreach_child (node, tnode) {
+  for (tree_node* node : TreeChildren(root, tnode)) {
     if ((ua->argc == 1 || fnmatch(ua->argk[1], node->fname, 0) == 0)
         && (node->extract || node->extract_descendant)) {
       const char* tag;
@@ -745,14 +1020,14 @@ static void rlsmark(UaContext* ua, tree_node* tnode, int level)
       }
       ua->SendMsg("%s%s%s%s\n", indent, tag, node->fname,
                   TreeNodeHasChild(node) ? "/" : "");
-      if (TreeNodeHasChild(node)) { rlsmark(ua, node, level + 1); }
+      if (TreeNodeHasChild(node)) { rlsmark(ua, root, node, level + 1); }
     }
   }
 }
 
 static int Lsmarkcmd(UaContext* ua, TreeContext* tree)
 {
-  rlsmark(ua, tree->node, 0);
+  rlsmark(ua, tree->root, tree->node, 0);
   return 1;
 }
 
@@ -804,7 +1079,6 @@ static inline void ls_output(guid_list* guid,
 // Like ls command, but give more detail on each file
 static int DoDircmd(UaContext* ua, TreeContext* tree, bool dot_cmd)
 {
-  tree_node* node;
   POOLMEM *cwd, *buf;
   FileDbRecord fdbr;
   struct stat statp;
@@ -818,7 +1092,7 @@ static int DoDircmd(UaContext* ua, TreeContext* tree, bool dot_cmd)
   ua->guid = new_guid_list();
   buf = GetPoolMemory(PM_FNAME);
 
-  foreach_child (node, tree->node) {
+  for (tree_node* node : TreeChildren(tree->root, tree->node)) {
     const char* tag;
     if (ua->argc == 1 || fnmatch(ua->argk[1], node->fname, 0) == 0) {
       if (node->extract) {
@@ -829,7 +1103,7 @@ static int DoDircmd(UaContext* ua, TreeContext* tree, bool dot_cmd)
         tag = " ";
       }
 
-      cwd = tree_getpath(node);
+      cwd = tree_getpath(tree->root, node);
 
       fdbr.FileId = 0;
       fdbr.JobId = node->JobId;
@@ -882,44 +1156,12 @@ static int dircmd(UaContext* ua, TreeContext* tree)
 
 static int Estimatecmd(UaContext* ua, TreeContext* tree)
 {
-  tree_node* node;
-  POOLMEM* cwd;
-  int total, num_extract;
-  uint64_t total_bytes = 0;
-  FileDbRecord fdbr;
-  struct stat statp;
-  char ec1[50];
-
-  total = num_extract = 0;
-  for (node = FirstTreeNode(tree->root); node; node = NextTreeNode(node)) {
-    if (node->type != tree_node_type::NewDir) {
-      total++;
-      if (node->extract && node->type == tree_node_type::File) {
-        // If regular file, get size
-        num_extract++;
-        cwd = tree_getpath(node);
-
-        fdbr.FileId = 0;
-        fdbr.JobId = node->JobId;
-
-        if (ua->db->GetFileAttributesRecord(ua->jcr, cwd, NULL, &fdbr)) {
-          int32_t LinkFI;
-          DecodeStat(fdbr.LStat, &statp, sizeof(statp),
-                     &LinkFI); /* decode stat pkt */
-          if (S_ISREG(statp.st_mode) && statp.st_size > 0) {
-            total_bytes += statp.st_size;
-          }
-        }
+  char ec1[50], ec2[50], ec3[50];
 
-        FreePoolMemory(cwd);
-      } else if (node->extract || node->extract_descendant) {
-        // Directory, count only
-        num_extract++;
-      }
-    }
-  }
-  ua->SendMsg(T_("%d total files; %d marked to be restored; %s bytes.\n"),
-              total, num_extract, edit_uint64_with_commas(total_bytes, ec1));
+  ua->SendMsg(T_("%s total files; %s marked to be restored; %s bytes.\n"),
+              edit_uint64(tree->root->num_entries, ec1),
+              edit_uint64(tree->root->num_marked, ec2),
+              edit_uint64_with_commas(tree->root->marked_bytes, ec3));
   return 1;
 }
 
@@ -981,7 +1223,7 @@ static int pwdcmd(UaContext* ua, TreeContext* tree)
 {
   POOLMEM* cwd;
 
-  cwd = tree_getpath(tree->node);
+  cwd = tree_getpath(tree->root, tree->node);
   if (cwd) {
     if (ua->api) {
       ua->SendMsg("%s", cwd);
@@ -998,7 +1240,7 @@ static int DotPwdcmd(UaContext* ua, TreeContext* tree)
 {
   POOLMEM* cwd;
 
-  cwd = tree_getpath(tree->node);
+  cwd = tree_getpath(tree->root, tree->node);
   if (cwd) {
     ua->SendMsg("%s", cwd);
     FreePoolMemory(cwd);
@@ -1032,7 +1274,6 @@ static int Unmarkcmd(UaContext* ua, TreeContext* tree)
 
 static int UnMarkdircmd(UaContext* ua, TreeContext* tree)
 {
-  tree_node* node;
   int count = 0;
 
   if (ua->argc < 2 || !TreeNodeHasChild(tree->node)) {
@@ -1042,10 +1283,13 @@ static int UnMarkdircmd(UaContext* ua, TreeContext* tree)
 
   for (int i = 1; i < ua->argc; i++) {
     StripTrailingSlash(ua->argk[i]);
-    foreach_child (node, tree->node) {
+    for (tree_node* node : TreeChildren(tree->root, tree->node)) {
       if (fnmatch(ua->argk[i], node->fname, 0) == 0) {
         if (node->type == tree_node_type::Dir
             || node->type == tree_node_type::DirWin) {
+          if (node->extract != false) {
+            CountMarked(tree->root, node, false);
+          }
           node->extract = false;
           count++;
         }
@@ -22,10 +22,17 @@
 #ifndef BAREOS_DIRD_UA_TREE_H_
 #define BAREOS_DIRD_UA_TREE_H_
 
+#include <cstddef>
+#include <functional>
+
 namespace directordaemon {
 
 bool UserSelectFilesFromTree(TreeContext* tree);
 int InsertTreeHandler(void* ctx, int num_fields, char** row);
+bool BuildTreeInParallel(
+    TreeContext* tree,
+    std::size_t num_workers,
+    const std::function<bool(DB_RESULT_HANDLER*, void*)>& fetch);
 
 } /* namespace directordaemon */
 #endif  // BAREOS_DIRD_UA_TREE_H_
@@ -28,18 +28,103 @@
 #include "filed/filed_globals.h"
 #include "filed/filed_jcr_impl.h"
 #include "filed/verify.h"
+#include "lib/accurate_stream.h"
 #include "lib/attribs.h"
 #include "lib/bsock.h"
+#include "lib/channel.h"
 #include "lib/edit.h"
 
 namespace filedaemon {
 
 static int debuglevel = 100;
 
+/* While the director sends the accurate list, the entries are put into the
+ * file list by a second thread, which keeps going after the end of the list.
+ * The job only waits for it with the first access of the list, which usually
+ * happens only after the connection to the storage daemon is up and the scan
+ * started. */
+namespace {
+// entries are handed to the loader in batches of about this size
+constexpr std::size_t accurate_batch_size = 256 * 1024;
+constexpr std::size_t accurate_batches_in_flight = 16;
+
+struct accurate_entry_header {
+  int32_t fname_length;
+  int32_t lstat_length;
+  int32_t chksum_length; /* -1 if the director did not send a checksum */
+  int32_t delta_seq;
+};
+
+void AppendEntry(std::vector<char>& batch,
+                 const char* fname,
+                 int fname_length,
+                 const char* lstat,
+                 int lstat_length,
+                 const char* chksum,
+                 int chksum_length,
+                 int32_t delta_seq)
+{
+  accurate_entry_header header{fname_length, lstat_length,
+                               chksum ? chksum_length : -1, delta_seq};
+  const char* h = reinterpret_cast<const char*>(&header);
+  batch.insert(batch.end(), h, h + sizeof(header));
+  batch.insert(batch.end(), fname, fname + fname_length + 1);
+  batch.insert(batch.end(), lstat, lstat + lstat_length + 1);
+  if (chksum) { batch.insert(batch.end(), chksum, chksum + chksum_length + 1); }
+}
+
+void AddBatch(BareosAccurateFilelist* file_list, std::vector<char>& batch)
+{
+  char* p = batch.data();
+  char* end = p + batch.size();
+  while (p < end) {
+    accurate_entry_header header;
+    memcpy(&header, p, sizeof(header));
+    p += sizeof(header);
+    char* fname = p;
+    p += header.fname_length + 1;
+    char* lstat = p;
+    p += header.lstat_length + 1;
+    char* chksum = nullptr;
+    int chksum_length = 0;
+    if (header.chksum_length >= 0) {
+      chksum = p;
+      chksum_length = header.chksum_length;
+      p += chksum_length + 1;
+    }
+    file_list->AddFile(fname, header.fname_length, lstat, header.lstat_length,
+                       chksum, chksum_length, header.delta_seq);
+  }
+}
+
+void AccurateLoader(JobControlRecord* jcr,
+                    channel::output<std::vector<char>> batches)
+{
+  while (std::optional<std::vector<char>> batch = batches.get()) {
+    AddBatch(jcr->fd_impl->file_list, *batch);
+  }
+  jcr->fd_impl->accurate_load_ok = jcr->fd_impl->file_list->EndLoad();
+}
+
+void WaitForAccurateLoad(JobControlRecord* jcr)
+{
+  if (!jcr->fd_impl->accurate_loader.joinable()) { return; }
+
+  jcr->fd_impl->accurate_loader.join();
+  if (!jcr->fd_impl->accurate_load_ok) {
+    Jmsg(jcr, M_FATAL, 0, T_("Could not load the accurate file list.\n"));
+    delete jcr->fd_impl->file_list;
+    jcr->fd_impl->file_list = nullptr;
+  }
+}
+}  // namespace
+
 bool AccurateMarkFileAsSeen(JobControlRecord* jcr, char* fname)
 {
   accurate_payload* temp;
 
+  WaitForAccurateLoad(jcr);
+
   if (!jcr->accurate || !jcr->fd_impl->file_list) { return false; }
 
   temp = jcr->fd_impl->file_list->lookup_payload(fname);
@@ -57,6 +142,8 @@ bool accurate_unMarkFileAsSeen(JobControlRecord* jcr, char* fname)
 {
   accurate_payload* temp;
 
+  WaitForAccurateLoad(jcr);
+
   if (!jcr->accurate || !jcr->fd_impl->file_list) { return false; }
 
   temp = jcr->fd_impl->file_list->lookup_payload(fname);
@@ -72,6 +159,7 @@ bool accurate_unMarkFileAsSeen(JobControlRecord* jcr, char* fname)
 
 bool AccurateMarkAllFilesAsSeen(JobControlRecord* jcr)
 {
+  WaitForAccurateLoad(jcr);
   if (!jcr->accurate || !jcr->fd_impl->file_list) { return false; }
 
   jcr->fd_impl->file_list->MarkAllFilesAsSeen();
@@ -80,6 +168,7 @@ bool AccurateMarkAllFilesAsSeen(JobControlRecord* jcr)
 
 bool accurate_unMarkAllFilesAsSeen(JobControlRecord* jcr)
 {
+  WaitForAccurateLoad(jcr);
   if (!jcr->accurate || !jcr->fd_impl->file_list) { return false; }
 
   jcr->fd_impl->file_list->UnmarkAllFilesAsSeen();
@@ -103,6 +192,9 @@ static inline bool AccurateLookup(JobControlRecord* jcr,
 
 void AccurateFree(JobControlRecord* jcr)
 {
+  if (jcr->fd_impl->accurate_loader.joinable()) {
+    jcr->fd_impl->accurate_loader.join();
+  }
   if (jcr->fd_impl->file_list) {
     delete jcr->fd_impl->file_list;
     jcr->fd_impl->file_list = NULL;
@@ -114,6 +206,7 @@ bool AccurateFinish(JobControlRecord* jcr)
 {
   bool retval = true;
 
+  WaitForAccurateLoad(jcr);
   if (jcr->IsJobCanceled() || jcr->IsIncomplete()) {
     AccurateFree(jcr);
     return retval;
@@ -161,6 +254,7 @@ bool AccurateCheckFile(JobControlRecord* jcr, FindFilesPacket* ff_pkt)
 
   if (!jcr->accurate && !jcr->rerunning) { return true; }
 
+  WaitForAccurateLoad(jcr);
   if (!jcr->fd_impl->file_list) { return true; /** Not initialized properly */ }
 
   // Apply path stripping for lookup in accurate data.
@@ -287,7 +381,13 @@ bool AccurateCheckFile(JobControlRecord* jcr, FindFilesPacket* ff_pkt)
                     || BitIsSet(FO_SHA1, ff_pkt->flags)
                     || BitIsSet(FO_SHA256, ff_pkt->flags)
                     || BitIsSet(FO_SHA512, ff_pkt->flags)
-                    || BitIsSet(FO_XXH128, ff_pkt->flags)))) {
+                    || BitIsSet(FO_XXH128, ff_pkt->flags)
+                    || BitIsSet(FO_XXH3_TREE, ff_pkt->flags)))) {
+          if (jcr->fd_impl->estimating && !jcr->fd_impl->listing) {
+            /* Counting files and bytes does not read the data, a file with
+             * unchanged metadata counts as unchanged. */
+            break;
+          }
           if (!*payload->chksum && !jcr->rerunning) {
             Jmsg(jcr, M_WARNING, 0, T_("Cannot verify checksum for %s\n"),
                  ff_pkt->fname);
@@ -326,27 +426,39 @@ bail_out:
 bool AccurateCmd(JobControlRecord* jcr)
 {
   uint32_t accurate_max_file_count;
+  int binary = 0;
   int fname_length, lstat_length, chksum_length;
   char *fname, *lstat, *chksum;
   uint16_t delta_seq;
   BareosSocket* dir = jcr->dir_bsock;
+  bool load_in_background = true;
 
   if (jcr->IsJobCanceled()) { return true; }
 
-  if (sscanf(dir->msg, "accurate files=%u", &accurate_max_file_count) != 1) {
+  if (sscanf(dir->msg, "accurate files=%u binary=%d", &accurate_max_file_count,
+             &binary)
+      < 1) {
     dir->fsend(T_("2991 Bad accurate command\n"));
     return false;
   }
 
-  jcr->fd_impl->file_list = nullptr;
+  AccurateFree(jcr);
 #ifdef HAVE_LMDB
   if (me->always_use_lmdb
       || (me->IsMemberPresent("LmdbThreshold")
           && accurate_max_file_count >= me->lmdb_threshold)) {
     jcr->fd_impl->file_list
         = new BareosAccurateFilelistLmdb(jcr, accurate_max_file_count);
+    // the lmdb transactions must not change their thread
+    load_in_background = false;
   }
 #endif
+  if (!jcr->fd_impl->file_list
+      && me->IsMemberPresent("CompactAccurateThreshold")
+      && accurate_max_file_count >= me->compact_accurate_threshold) {
+    jcr->fd_impl->file_list
+        = new BareosAccurateFilelistCompact(jcr, accurate_max_file_count);
+  }
   if (!jcr->fd_impl->file_list) {
     jcr->fd_impl->file_list
         = new BareosAccurateFilelistHtable(jcr, accurate_max_file_count);
@@ -356,8 +468,52 @@ bool AccurateCmd(JobControlRecord* jcr)
 
   jcr->accurate = true;
 
+  std::optional<channel::input<std::vector<char>>> batches;
+  std::vector<char> batch;
+  if (load_in_background) {
+    auto [in, out] = channel::CreateSpscChannel<std::vector<char>>(
+        accurate_batches_in_flight);
+    batches.emplace(std::move(in));
+    jcr->fd_impl->accurate_load_ok = true;
+    jcr->fd_impl->accurate_loader
+        = std::thread(AccurateLoader, jcr, std::move(out));
+    batch.reserve(accurate_batch_size + 1024);
+  }
+
+  auto add_file = [&](char* name, int name_length, char* stat,
+                      int stat_length, char* sum, int sum_length,
+                      int32_t seq) {
+    if (!batches) {
+      jcr->fd_impl->file_list->AddFile(name, name_length, stat, stat_length,
+                                       sum, sum_length, seq);
+      return;
+    }
+
+    AppendEntry(batch, name, name_length, stat, stat_length, sum, sum_length,
+                seq);
+    if (batch.size() >= accurate_batch_size) {
+      batches->emplace(std::move(batch));
+      batch = std::vector<char>{};
+      batch.reserve(accurate_batch_size + 1024);
+    }
+  };
+
+  // many entries per message, see lib/accurate_stream.h
+  accurate_stream_entry entry;
+  while (binary && dir->recv() >= 0) {
+    AccurateStreamReader reader(dir->msg, dir->message_length);
+    while (reader.Next(entry)) {
+      add_file(entry.fname.data(), entry.fname.size(), entry.lstat,
+               entry.lstat_length, entry.chksum, entry.chksum_length,
+               entry.delta_seq);
+    }
+    if (reader.Error()) {
+      Dmsg0(debuglevel, "Discarding the rest of a corrupt accurate message\n");
+    }
+  }
+
   // dirmsg = fname + \0 + lstat + \0 + checksum + \0 + delta_seq + \0
-  while (dir->recv() >= 0) {
+  while (!binary && dir->recv() >= 0) {
     fname = dir->msg;
     fname_length = strlen(fname);
     lstat = dir->msg + fname_length + 1;
@@ -381,8 +537,15 @@ bool AccurateCmd(JobControlRecord* jcr)
       }
     }
 
-    jcr->fd_impl->file_list->AddFile(fname, fname_length, lstat, lstat_length,
-                                     chksum, chksum_length, delta_seq);
+    add_file(fname, fname_length, lstat, lstat_length, chksum, chksum_length,
+             delta_seq);
+  }
+
+  if (batches) {
+    // the loader calls EndLoad() once it has added everything
+    if (!batch.empty()) { batches->emplace(std::move(batch)); }
+    batches->close();
+    return true;
   }
 
   if (!jcr->fd_impl->file_list->EndLoad()) { return false; }
@@ -43,10 +43,13 @@
 
 #include <vector>
 #include <algorithm>
+#include <memory>
+#include <string>
+#include <string_view>
 #include "include/config.h"
 #include "include/baconfig.h"
 #include "lib/jcr.h"
-#include "lib/htable.h"
+#include "lib/flat_htable.h"
 
 namespace filedaemon {
 
@@ -118,17 +121,16 @@ class BareosAccurateFilelist {
 };
 
 /*
- * Hash table specific storage abstraction class using the internal htable
- * datastructure.
+ * Hash table specific storage abstraction class using the internal
+ * flat_htable datastructure.
  */
 struct CurFile {
-  hlink link;
   char* fname;
   accurate_payload payload;
 };
 
 class BareosAccurateFilelistHtable : public BareosAccurateFilelist {
-  using FileList = htable<char*, CurFile>;
+  using FileList = flat_htable<char*, CurFile>;
 
  protected:
   FileList* file_list_;
@@ -157,6 +159,81 @@ class BareosAccurateFilelistHtable : public BareosAccurateFilelist {
   bool SendDeletedList() override;
 };
 
+/*
+ * Compact storage abstraction class.  The files are kept sorted by name in
+ * blocks of a few entries each.  Inside of a block every name only stores the
+ * part that differs from the name before it and the lstat fields are stored
+ * as varints relative to the ones before them.  This usually needs less than a
+ * fifth of the memory of the hash table at the price of a binary search (and
+ * the decoding of one block) per lookup.
+ */
+class BareosAccurateFilelistCompact : public BareosAccurateFilelist {
+ public:
+  static constexpr std::size_t block_entries = 16;
+  static constexpr int max_lstat_fields = 24;
+
+ protected:
+  struct decoded_entry {
+    std::string name;
+    int64_t fields[max_lstat_fields];
+    int num_fields{0}; /* 0 if the lstat is stored verbatim */
+    const uint8_t* raw_lstat{nullptr};
+    std::size_t raw_lstat_length{0};
+    const uint8_t* chksum{nullptr};
+    std::size_t chksum_length{0};
+    int32_t delta_seq{0};
+  };
+
+  /* While loading the files are kept as they come in (name\0lstat\0chksum\0
+   * followed by the delta_seq), they only get sorted and encoded by EndLoad */
+  std::unique_ptr<MonotonicBuffer> load_buffer_;
+  std::vector<char*> loaded_;
+  bool sorted_{true};
+
+  std::vector<uint8_t> data_;
+  std::vector<std::size_t> blocks_; /* offset of each block in data_ */
+  std::size_t num_files_{0};
+  std::size_t duplicate_files_{0};
+
+  // the payload handed out by lookup_payload() lives until the next lookup
+  std::string lstat_buf_;
+  std::string chksum_buf_;
+  accurate_payload payload_{};
+  decoded_entry entry_;
+
+  void Encode();
+  std::string_view BlockFirstName(std::size_t block) const;
+  void DecodeEntry(const uint8_t*& p, decoded_entry& e) const;
+  static void FillPayload(const decoded_entry& e,
+                          std::size_t filenr,
+                          std::string& lstat,
+                          std::string& chksum,
+                          accurate_payload& payload);
+  template <typename F> void ForEachFile(F callback);
+
+ public:
+  /* methods */
+  BareosAccurateFilelistCompact() = delete;
+  BareosAccurateFilelistCompact(JobControlRecord* jcr,
+                                uint32_t number_of_files);
+  ~BareosAccurateFilelistCompact() = default;
+
+  bool init() override { return true; }
+
+  bool AddFile(char* fname,
+               int fname_length,
+               char* lstat,
+               int lstat_length,
+               char* chksum,
+               int checksum_length,
+               int32_t delta_seq) override;
+  bool EndLoad() override;
+  accurate_payload* lookup_payload(char* fname) override;
+  bool UpdatePayload(char* fname, accurate_payload* payload) override;
+  bool SendBaseFileList() override;
+  bool SendDeletedList() override;
+};
+
 #ifdef HAVE_LMDB
 
 #  include "lmdb/lmdb.h"
@@ -176,8 +253,11 @@ class BareosAccurateFilelistLmdb : public BareosAccurateFilelist {
   MDB_txn* db_ro_txn_;
   std::size_t excess_files_{0};
   std::size_t duplicate_files_{0};
+  std::size_t load_txn_bytes_{0}; /* still to be added by the transaction */
+  std::string last_key_;          /* greatest name added so far */
 
   void destroy();
+  bool NewLoadTransaction(std::size_t entry_bytes);
 
  public:
   /* methods */
@@ -0,0 +1,459 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * This file contains the compact (sorted and front coded) abstraction of the
+ * accurate payload storage.
+ *
+ * Every block starts with a complete name, so a lookup does a binary search
+ * over the first names of the blocks and then decodes at most block_entries
+ * entries.  An entry is encoded as
+ *
+ *   varint shared prefix length, varint suffix length, suffix,
+ *   lstat, varint chksum length, chksum, zigzag varint delta_seq
+ *
+ * The lstat is either the varint number of its fields followed by every
+ * field as zigzag varint relative to the same field of the entry before it,
+ * or a 0 followed by the varint length and the lstat itself for everything
+ * that does not survive decoding and encoding unchanged.
+ */
+
+#include "include/bareos.h"
+#include "include/filetypes.h"
+#include "include/streams.h"
+#include "filed/filed.h"
+#include "filed/change_sources.h"
+#include "accurate.h"
+#include "lib/attribs.h"
+#include "lib/base64.h"
+
+#include <limits>
+
+namespace filedaemon {
+
+static int debuglevel = 100;
+
+namespace {
+void PutVarint(std::vector<uint8_t>& out, uint64_t value)
+{
+  while (value >= 0x80) {
+    out.push_back(static_cast<uint8_t>(value) | 0x80);
+    value >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(value));
+}
+
+uint64_t GetVarint(const uint8_t*& p)
+{
+  uint64_t value = 0;
+  for (int shift = 0;; shift += 7) {
+    uint8_t byte = *p++;
+    value |= uint64_t{byte & 0x7fu} << shift;
+    if (!(byte & 0x80)) { return value; }
+  }
+}
+
+uint64_t ZigZag(int64_t value)
+{
+  return (static_cast<uint64_t>(value) << 1) ^ (value < 0 ? ~uint64_t{0} : 0);
+}
+
+int64_t UnZigZag(uint64_t value)
+{
+  return static_cast<int64_t>((value >> 1) ^ (~(value & 1) + 1));
+}
+
+// returns the number of fields or 0 if lstat is not encoded canonically
+int ParseLstat(const char* lstat, int64_t* fields, int max_fields)
+{
+  int num_fields = 0;
+  char encoded[32];
+  const char* p = lstat;
+
+  while (*p) {
+    if (num_fields == max_fields) { return 0; }
+    int64_t value;
+    int length = FromBase64(&value, const_cast<char*>(p));
+    if (value == std::numeric_limits<int64_t>::min()) { return 0; }
+    if (ToBase64(value, encoded) != length || memcmp(encoded, p, length)) {
+      return 0;
+    }
+    fields[num_fields++] = value;
+    p += length;
+    if (*p == ' ') {
+      if (*++p == '\0') { return 0; }
+    } else if (*p) {
+      return 0;
+    }
+  }
+  return num_fields;
+}
+
+void EncodeLstat(std::vector<uint8_t>& out,
+                 const char* lstat,
+                 int64_t* prev_fields,
+                 int& prev_num_fields)
+{
+  int64_t fields[BareosAccurateFilelistCompact::max_lstat_fields];
+  int num_fields = ParseLstat(
+      lstat, fields, BareosAccurateFilelistCompact::max_lstat_fields);
+
+  PutVarint(out, num_fields);
+  if (num_fields == 0) {
+    std::size_t length = strlen(lstat);
+    PutVarint(out, length);
+    out.insert(out.end(), lstat, lstat + length);
+  }
+  for (int i = 0; i < num_fields; ++i) {
+    uint64_t base = i < prev_num_fields ? prev_fields[i] : 0;
+    PutVarint(out, ZigZag(static_cast<int64_t>(fields[i] - base)));
+    prev_fields[i] = fields[i];
+  }
+  prev_num_fields = num_fields;
+}
+}  // namespace
+
+BareosAccurateFilelistCompact::BareosAccurateFilelistCompact(
+    JobControlRecord* jcr,
+    uint32_t number_of_files)
+    : BareosAccurateFilelist(jcr, number_of_files)
+    , load_buffer_{std::make_unique<MonotonicBuffer>(
+          MonotonicBuffer::Size::Large)}
+{
+  loaded_.reserve(number_of_files);
+}
+
+bool BareosAccurateFilelistCompact::AddFile(char* fname,
+                                            int fname_length,
+                                            char* lstat,
+                                            int lstat_length,
+                                            char* chksum,
+                                            int chksum_length,
+                                            int32_t delta_seq)
+{
+  if (!load_buffer_) {
+    Dmsg1(debuglevel, "fname=<%s> added after the end of the load.\n", fname);
+    return false;
+  }
+
+  int total_length
+      = fname_length + lstat_length + chksum_length + 3 + sizeof(delta_seq);
+  char* item = static_cast<char*>(load_buffer_->allocate(total_length));
+
+  char* p = item;
+  memcpy(p, fname, fname_length);
+  p[fname_length] = '\0';
+  p += fname_length + 1;
+  memcpy(p, lstat, lstat_length);
+  p[lstat_length] = '\0';
+  p += lstat_length + 1;
+  if (chksum_length) { memcpy(p, chksum, chksum_length); }
+  p[chksum_length] = '\0';
+  p += chksum_length + 1;
+  memcpy(p, &delta_seq, sizeof(delta_seq));
+
+  if (sorted_ && !loaded_.empty() && strcmp(loaded_.back(), item) > 0) {
+    sorted_ = false;
+  }
+  loaded_.push_back(item);
+
+  Dmsg2(debuglevel, "add fname=<%s> lstat=%s\n", fname, lstat);
+  return true;
+}
+
+void BareosAccurateFilelistCompact::Encode()
+{
+  /* The director sends the files in the order they were backed up, which
+   * only sometimes is the order we need.  stable_sort() keeps the first of
+   * several entries with the same name, just like the hash table does. */
+  if (!sorted_) {
+    std::stable_sort(loaded_.begin(), loaded_.end(),
+                     [](const char* a, const char* b) {
+                       return strcmp(a, b) < 0;
+                     });
+  }
+
+  std::size_t prev_name_length = 0;
+  int64_t prev_fields[max_lstat_fields];
+  int prev_num_fields = 0;
+  std::size_t in_block = block_entries;
+
+  for (std::size_t i = 0; i < loaded_.size(); ++i) {
+    const char* name = loaded_[i];
+    if (i > 0 && strcmp(loaded_[i - 1], name) == 0) {
+      duplicate_files_ += 1;
+      Dmsg1(debuglevel, "fname=<%s> is already registered.\n", name);
+      continue;
+    }
+
+    if (in_block == block_entries) {
+      blocks_.push_back(data_.size());
+      in_block = 0;
+      prev_name_length = 0;
+      prev_num_fields = 0;
+    }
+
+    // loaded_[i - 1] has the name of the entry before, even if a duplicate
+    std::size_t name_length = strlen(name);
+    std::size_t shared = 0;
+    if (in_block > 0) {
+      const char* prev_name = loaded_[i - 1];
+      std::size_t max_shared = std::min(prev_name_length, name_length);
+      while (shared < max_shared && prev_name[shared] == name[shared]) {
+        shared++;
+      }
+    }
+    PutVarint(data_, shared);
+    PutVarint(data_, name_length - shared);
+    data_.insert(data_.end(), name + shared, name + name_length);
+
+    const char* lstat = name + name_length + 1;
+    EncodeLstat(data_, lstat, prev_fields, prev_num_fields);
+
+    const char* chksum = lstat + strlen(lstat) + 1;
+    std::size_t chksum_length = strlen(chksum);
+    PutVarint(data_, chksum_length);
+    data_.insert(data_.end(), chksum, chksum + chksum_length);
+
+    int32_t delta_seq;
+    memcpy(&delta_seq, chksum + chksum_length + 1, sizeof(delta_seq));
+    PutVarint(data_, ZigZag(delta_seq));
+
+    prev_name_length = name_length;
+    in_block += 1;
+    num_files_ += 1;
+  }
+
+  data_.shrink_to_fit();
+  blocks_.shrink_to_fit();
+  seen_bitmap_.assign(num_files_, false);
+
+  std::vector<char*>().swap(loaded_);
+  load_buffer_.reset();
+}
+
+bool BareosAccurateFilelistCompact::EndLoad()
+{
+  Encode();
+  Dmsg3(debuglevel, "%llu files stored in %llu bytes (%llu blocks)\n",
+        static_cast<unsigned long long>(num_files_),
+        static_cast<unsigned long long>(data_.size()),
+        static_cast<unsigned long long>(blocks_.size()));
+
+  if (duplicate_files_ > 0) {
+    Jmsg1(jcr_, M_ERROR, 0,
+          T_("%llu duplicate files were sent by the director and removed. This "
+             "may indicate problems with the database.\n"),
+          duplicate_files_);
+  }
+  if (num_files_ > initial_capacity_) {
+    Jmsg1(
+        jcr_, M_ERROR, 0,
+        T_("The director send too many files. %llu were sent but only %llu "
+           "were anticipated. The accurate job may be in a corrupted state.\n"),
+        num_files_, initial_capacity_);
+  }
+  return true;
+}
+
+std::string_view BareosAccurateFilelistCompact::BlockFirstName(
+    std::size_t block) const
+{
+  const uint8_t* p = data_.data() + blocks_[block];
+  GetVarint(p); /* the shared prefix length, always 0 here */
+  std::size_t length = GetVarint(p);
+  return std::string_view(reinterpret_cast<const char*>(p), length);
+}
+
+void BareosAccurateFilelistCompact::DecodeEntry(const uint8_t*& p,
+                                                decoded_entry& e) const
+{
+  std::size_t shared = GetVarint(p);
+  std::size_t suffix_length = GetVarint(p);
+  e.name.resize(shared);
+  e.name.append(reinterpret_cast<const char*>(p), suffix_length);
+  p += suffix_length;
+
+  int num_fields = GetVarint(p);
+  if (num_fields == 0) {
+    e.raw_lstat_length = GetVarint(p);
+    e.raw_lstat = p;
+    p += e.raw_lstat_length;
+  }
+  for (int i = 0; i < num_fields; ++i) {
+    uint64_t base = i < e.num_fields ? e.fields[i] : 0;
+    e.fields[i] = static_cast<int64_t>(base + UnZigZag(GetVarint(p)));
+  }
+  e.num_fields = num_fields;
+
+  e.chksum_length = GetVarint(p);
+  e.chksum = p;
+  p += e.chksum_length;
+
+  e.delta_seq = static_cast<int32_t>(UnZigZag(GetVarint(p)));
+}
+
+void BareosAccurateFilelistCompact::FillPayload(const decoded_entry& e,
+                                                std::size_t filenr,
+                                                std::string& lstat,
+                                                std::string& chksum,
+                                                accurate_payload& payload)
+{
+  if (e.num_fields == 0) {
+    lstat.assign(reinterpret_cast<const char*>(e.raw_lstat),
+                 e.raw_lstat_length);
+  } else {
+    char encoded[32];
+    lstat.clear();
+    for (int i = 0; i < e.num_fields; ++i) {
+      if (i > 0) { lstat += ' '; }
+      lstat.append(encoded, ToBase64(e.fields[i], encoded));
+    }
+  }
+  chksum.assign(reinterpret_cast<const char*>(e.chksum), e.chksum_length);
+
+  payload.filenr = filenr;
+  payload.delta_seq = e.delta_seq;
+  payload.lstat = lstat.data();
+  payload.chksum = chksum.data();
+}
+
+accurate_payload* BareosAccurateFilelistCompact::lookup_payload(char* fname)
+{
+  if (blocks_.empty()) { return nullptr; }
+
+  // find the last block whose first name is not greater than fname
+  std::string_view key{fname};
+  std::size_t lo = 0, hi = blocks_.size();
+  while (lo < hi) {
+    std::size_t mid = lo + (hi - lo) / 2;
+    if (BlockFirstName(mid) <= key) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == 0) { return nullptr; }
+
+  std::size_t block = lo - 1;
+  std::size_t filenr = block * block_entries;
+  std::size_t end = std::min(filenr + block_entries, num_files_);
+  const uint8_t* p = data_.data() + blocks_[block];
+
+  entry_.num_fields = 0;
+  for (; filenr < end; ++filenr) {
+    DecodeEntry(p, entry_);
+    int cmp = entry_.name.compare(key);
+    if (cmp == 0) {
+      FillPayload(entry_, filenr, lstat_buf_, chksum_buf_, payload_);
+      return &payload_;
+    }
+    if (cmp > 0) { break; }
+  }
+  return nullptr;
+}
+
+bool BareosAccurateFilelistCompact::UpdatePayload(char*, accurate_payload*)
+{
+  return true;
+}
+
+/* The callback gets its own copy of the payload, so it may look up other
+ * files in the meantime. */
+template <typename F>
+void BareosAccurateFilelistCompact::ForEachFile(F callback)
+{
+  decoded_entry e;
+  std::string lstat, chksum;
+  accurate_payload payload;
+
+  for (std::size_t block = 0; block < blocks_.size(); ++block) {
+    std::size_t filenr = block * block_entries;
+    std::size_t end = std::min(filenr + block_entries, num_files_);
+    const uint8_t* p = data_.data() + blocks_[block];
+
+    e.num_fields = 0;
+    for (; filenr < end; ++filenr) {
+      DecodeEntry(p, e);
+      FillPayload(e, filenr, lstat, chksum, payload);
+      callback(e.name.data(), &payload);
+    }
+  }
+}
+
+bool BareosAccurateFilelistCompact::SendBaseFileList()
+{
+  FindFilesPacket* ff_pkt;
+  int32_t LinkFIc;
+  struct stat statp;
+  int stream = STREAM_UNIX_ATTRIBUTES;
+
+  if (!jcr_->accurate || jcr_->getJobLevel() != L_FULL) { return true; }
+
+  ff_pkt = init_find_files();
+  ff_pkt->type = FT_BASE;
+
+  ForEachFile([&](char* fname, accurate_payload* payload) {
+    if (seen_bitmap_.at(payload->filenr)) {
+      Dmsg1(debuglevel, "base file fname=%s\n", fname);
+      DecodeStat(payload->lstat, &statp, sizeof(statp),
+                 &LinkFIc); /* decode catalog stat */
+      ff_pkt->fname = fname;
+      ff_pkt->statp = statp;
+      EncodeAndSendAttributes(jcr_, ff_pkt, stream);
+    }
+  });
+
+  TermFindFiles(ff_pkt);
+  return true;
+}
+
+bool BareosAccurateFilelistCompact::SendDeletedList()
+{
+  FindFilesPacket* ff_pkt;
+  int32_t LinkFIc;
+  struct stat statp;
+  int stream = STREAM_UNIX_ATTRIBUTES;
+
+  if (!jcr_->accurate) { return true; }
+
+  ff_pkt = init_find_files();
+  ff_pkt->type = FT_DELETED;
+
+  ForEachFile([&](char* fname, accurate_payload* payload) {
+    if (seen_bitmap_.at(payload->filenr) || PluginCheckFile(jcr_, fname)
+        || InSkippedDirectory(jcr_, fname)) {
+      return;
+    }
+    Dmsg1(debuglevel, "deleted fname=%s\n", fname);
+    ff_pkt->fname = fname;
+    DecodeStat(payload->lstat, &statp, sizeof(statp),
+               &LinkFIc); /* decode catalog stat */
+    ff_pkt->statp.st_mtime = statp.st_mtime;
+    ff_pkt->statp.st_ctime = statp.st_ctime;
+    EncodeAndSendAttributes(jcr_, ff_pkt, stream);
+  });
+
+  TermFindFiles(ff_pkt);
+  return true;
+}
+
+} /* namespace filedaemon */
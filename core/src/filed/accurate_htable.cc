@@ -30,6 +30,7 @@
 #include "include/filetypes.h"
 #include "include/streams.h"
 #include "filed/filed.h"
+#include "filed/change_sources.h"
 #include "accurate.h"
 #include "lib/attribs.h"
 
@@ -172,7 +173,8 @@ bool BareosAccurateFilelistHtable::SendDeletedList()
 
   foreach_htable (elt, file_list_) {
     if (seen_bitmap_.at(elt->payload.filenr)
-        || PluginCheckFile(jcr_, elt->fname)) {
+        || PluginCheckFile(jcr_, elt->fname)
+        || InSkippedDirectory(jcr_, elt->fname)) {
       continue;
     }
     Dmsg1(debuglevel, "deleted fname=%s\n", elt->fname);
@@ -25,11 +25,15 @@
 #if !defined(HAVE_MSVC)
 #  include <unistd.h>
 #endif
+#include <algorithm>
 #include <cstring>
+#include <string>
+#include <string_view>
 #include "include/bareos.h"
 #include "include/filetypes.h"
 #include "include/streams.h"
 #include "filed/filed.h"
+#include "filed/change_sources.h"
 #include "filed/filed_globals.h"
 #include "lib/attribs.h"
 
@@ -45,6 +49,19 @@ static int debuglevel = 100;
 #  define AVG_NR_BYTES_PER_ENTRY 256
 #  define B_PAGE_SIZE 4096
 
+/* While loading, the entries are committed whenever a write transaction holds
+ * a third of the room left in the map, which is doubled as soon as that drops
+ * below min_load_txn_bytes.  So the map never fills up, whatever the number
+ * of files the director announced. */
+static constexpr std::size_t min_load_txn_bytes = 16 * 1024 * 1024;
+
+// lmdb compares keys bytewise and puts a shorter key first
+static bool KeyIsAfter(const MDB_val& key, const std::string& last)
+{
+  return std::string_view{static_cast<const char*>(key.mv_data), key.mv_size}
+         > last;
+}
+
 BareosAccurateFilelistLmdb::BareosAccurateFilelistLmdb(JobControlRecord* jcr,
                                                        uint32_t number_of_files)
     : BareosAccurateFilelist(jcr, number_of_files)
@@ -100,8 +117,14 @@ bool BareosAccurateFilelistLmdb::init()
 
     Mmsg(lmdb_name_, "%s/.accurate_lmdb.%d", me->working_directory,
          jcr_->JobId);
-    result = mdb_env_open(env, lmdb_name_,
-                          MDB_NOSUBDIR | MDB_NOLOCK | MDB_NOSYNC, 0600);
+    /* With a writable map the transactions change the pages in place instead
+     * of copies of them.  On windows the file would take the whole map size
+     * right away. */
+    unsigned int flags = MDB_NOSUBDIR | MDB_NOLOCK | MDB_NOSYNC;
+#  if !defined(HAVE_WIN32)
+    flags |= MDB_WRITEMAP;
+#  endif
+    result = mdb_env_open(env, lmdb_name_, flags, 0600);
     if (result) {
       Jmsg2(jcr_, M_FATAL, 0, T_("Unable create LDMD database %s: %s\n"),
             lmdb_name_, mdb_strerror(result));
@@ -136,7 +159,7 @@ bail_out:
 }
 
 bool BareosAccurateFilelistLmdb::AddFile(char* fname,
-                                         int /* fname_length */,
+                                         int fname_length,
                                          char* lstat,
                                          int lstat_length,
                                          char* chksum,
@@ -153,9 +176,16 @@ bool BareosAccurateFilelistLmdb::AddFile(char* fname,
   int total_length;
   MDB_val key, data;
   bool retval = false;
+  unsigned int flags = MDB_NOOVERWRITE;
 
   total_length = sizeof(accurate_payload) + lstat_length + chksulength_ + 2;
 
+  std::size_t entry_bytes = total_length + fname_length + 1 + 16;
+  if (entry_bytes > load_txn_bytes_ && !NewLoadTransaction(entry_bytes)) {
+    return false;
+  }
+  load_txn_bytes_ -= entry_bytes;
+
   // Make sure pay_load_ is large enough.
   pay_load_ = CheckPoolMemorySize(pay_load_, total_length);
 
@@ -176,15 +206,23 @@ bool BareosAccurateFilelistLmdb::AddFile(char* fname,
   payload->filenr = seen_bitmap_.size();
 
   key.mv_data = fname;
-  key.mv_size = strlen(fname) + 1;
+  key.mv_size = fname_length + 1;
 
   data.mv_data = payload;
   data.mv_size = total_length;
 
+  /* The names usually come in the order of the catalog, in which a directory
+   * is followed by its contents.  Names after all others so far are appended
+   * without a search through the tree. */
+  if (KeyIsAfter(key, last_key_)) { flags |= MDB_APPEND; }
+
 retry:
-  result = mdb_put(db_rw_txn_, db_dbi_, &key, &data, MDB_NOOVERWRITE);
+  result = mdb_put(db_rw_txn_, db_dbi_, &key, &data, flags);
   switch (result) {
     case 0:
+      if (flags & MDB_APPEND) {
+        last_key_.assign(static_cast<char*>(key.mv_data), key.mv_size);
+      }
       if (chksum) {
         Dmsg4(debuglevel, "add fname=<%s> lstat=%s delta_seq=%i chksum=%s\n",
               fname, lstat, delta_seq, chksum);
@@ -226,6 +264,51 @@ retry:
   return retval;
 }
 
+bool BareosAccurateFilelistLmdb::NewLoadTransaction(std::size_t entry_bytes)
+{
+  int result;
+
+  if (db_rw_txn_) {
+    result = mdb_txn_commit(db_rw_txn_);
+    db_rw_txn_ = NULL;
+    if (result != 0) {
+      Jmsg1(jcr_, M_FATAL, 0, T_("Unable to commit full transaction: %s\n"),
+            mdb_strerror(result));
+      return false;
+    }
+  }
+
+  MDB_envinfo info;
+  MDB_stat stat;
+  mdb_env_info(db_env_, &info);
+  mdb_env_stat(db_env_, &stat);
+  std::size_t used = (info.me_last_pgno + 1) * stat.ms_psize;
+  std::size_t needed = std::max(min_load_txn_bytes, entry_bytes);
+  std::size_t mapsize = info.me_mapsize;
+  while (mapsize < used || (mapsize - used) / 3 < needed) { mapsize *= 2; }
+
+  if (mapsize != info.me_mapsize) {
+    Dmsg2(debuglevel, "growing the LMDB map from %llu to %llu bytes\n",
+          static_cast<unsigned long long>(info.me_mapsize),
+          static_cast<unsigned long long>(mapsize));
+    result = mdb_env_set_mapsize(db_env_, mapsize);
+    if (result != 0) {
+      Jmsg1(jcr_, M_FATAL, 0, T_("Unable to set MDB mapsize: %s\n"),
+            mdb_strerror(result));
+      return false;
+    }
+  }
+  load_txn_bytes_ = (mapsize - used) / 3;
+
+  result = mdb_txn_begin(db_env_, NULL, 0, &db_rw_txn_);
+  if (result != 0) {
+    Jmsg1(jcr_, M_FATAL, 0, T_("Unable create new transaction: %s\n"),
+          mdb_strerror(result));
+    return false;
+  }
+  return true;
+}
+
 bool BareosAccurateFilelistLmdb::EndLoad()
 {
   int result;
@@ -415,7 +498,6 @@ bool BareosAccurateFilelistLmdb::SendBaseFileList()
   MDB_cursor* cursor;
   MDB_val key, data;
   bool retval = false;
-  accurate_payload* payload;
   int stream = STREAM_UNIX_ATTRIBUTES;
 
   if (!jcr_->accurate || jcr_->getJobLevel() != L_FULL) { return true; }
@@ -437,10 +519,13 @@ bool BareosAccurateFilelistLmdb::SendBaseFileList()
   result = mdb_cursor_open(db_ro_txn_, db_dbi_, &cursor);
   if (result == 0) {
     while ((result = mdb_cursor_get(cursor, &key, &data, MDB_NEXT)) == 0) {
-      payload = (accurate_payload*)data.mv_data;
-      if (seen_bitmap_.at(payload->filenr)) {
+      // the stored lstat pointer is the one of the time the file was added
+      accurate_payload payload;
+      std::memcpy(&payload, data.mv_data, sizeof(payload));
+      char* lstat = (char*)data.mv_data + sizeof(accurate_payload);
+      if (seen_bitmap_.at(payload.filenr)) {
         Dmsg1(debuglevel, "base file fname=%s\n", key.mv_data);
-        DecodeStat(payload->lstat, &ff_pkt->statp, sizeof(struct stat),
+        DecodeStat(lstat, &ff_pkt->statp, sizeof(struct stat),
                    &LinkFIc); /* decode catalog stat */
         ff_pkt->fname = (char*)key.mv_data;
         EncodeAndSendAttributes(jcr_, ff_pkt, stream);
@@ -504,13 +589,14 @@ bool BareosAccurateFilelistLmdb::SendDeletedList()
       std::memcpy(&payload, data.mv_data, sizeof(payload));
 
       if (seen_bitmap_.at(payload.filenr)
-          || PluginCheckFile(jcr_, (char*)key.mv_data)) {
+          || PluginCheckFile(jcr_, (char*)key.mv_data)
+          || InSkippedDirectory(jcr_, (char*)key.mv_data)) {
         continue;
       }
 
       Dmsg1(debuglevel, "deleted fname=%s\n", key.mv_data);
-      DecodeStat(payload.lstat, &statp, sizeof(struct stat),
-                 &LinkFIc); /* decode catalog stat */
+      DecodeStat((char*)data.mv_data + sizeof(accurate_payload), &statp,
+                 sizeof(struct stat), &LinkFIc); /* decode catalog stat */
       ff_pkt->fname = (char*)key.mv_data;
       ff_pkt->statp.st_mtime = statp.st_mtime;
       ff_pkt->statp.st_ctime = statp.st_ctime;
@@ -552,22 +638,9 @@ void BareosAccurateFilelistLmdb::destroy()
   }
 
   if (db_env_) {
-    // Drop the contents of the LMDB.
-    if (db_dbi_) {
-      int result;
-      MDB_txn* txn;
-
-      result = mdb_txn_begin(db_env_, NULL, 0, &txn);
-      if (result == 0) {
-        result = mdb_drop(txn, db_dbi_, 1);
-        if (result == 0) {
-          mdb_txn_commit(txn);
-        } else {
-          mdb_txn_abort(txn);
-        }
-      }
-      db_dbi_ = 0;
-    }
+    /* The file is erased below, dropping its contents first would only walk
+     * through all of its pages. */
+    db_dbi_ = 0;
 
     // Close the environment.
     mdb_env_close(db_env_);
@@ -52,8 +52,9 @@ const int debuglevel = 50;
  *  52 13Jul13 - Added plugin options
  *  53 02Apr15 - Added setdebug timestamp
  *  54 29Oct15 - Added getSecureEraseCmd
+ *  55 24Jun24 - Added the binary accurate list
  */
-static char OK_hello[] = "2000 OK Hello 54\n";
+static char OK_hello[] = "2000 OK Hello 55\n";
 
 static char Dir_sorry[] = "2999 Authentication failed.\n";
 
@@ -195,4 +196,19 @@ bool AuthenticateWithStoragedaemon(JobControlRecord* jcr)
 
   return result;
 }
+
+/* Authenticate an additional data connection with a remote storage daemon.
+ * As the job is already authenticated, a failure does not fail the job. */
+bool AuthenticateDataConnectionWithStoragedaemon(JobControlRecord* jcr,
+                                                 BareosSocket* sd,
+                                                 char* key)
+{
+  s_password password;
+
+  password.encoding = p_encoding_md5;
+  password.value = key;
+  return sd->AuthenticateOutboundConnection(
+      nullptr, my_config->CreateOwnQualifiedNameForNetworkDump(),
+      (char*)jcr->client_name, password, me);
+}
 } /* namespace filedaemon */
@@ -31,6 +31,9 @@ bool AuthenticateWithDirector(JobControlRecord* jcr,
                               DirectorResource* director);
 bool AuthenticateStoragedaemon(JobControlRecord* jcr);
 bool AuthenticateWithStoragedaemon(JobControlRecord* jcr);
+bool AuthenticateDataConnectionWithStoragedaemon(JobControlRecord* jcr,
+                                                 BareosSocket* sd,
+                                                 char* key);
 
 } /* namespace filedaemon */
 
@@ -42,6 +42,7 @@
 #include "findlib/attribs.h"
 #include "findlib/hardlink.h"
 #include "findlib/find_one.h"
+#include "findlib/stat_ahead.h"
 #include "lib/attribs.h"
 #include "lib/berrno.h"
 #include "lib/bsock.h"
@@ -51,11 +52,17 @@
 #include "lib/version.h"
 #include "lib/serial.h"
 #include "lib/compression.h"
+#include "lib/message_builder.h"
+#include "lib/metrics.h"
+#include "lib/trace_ring.h"
 
 #include "lib/channel.h"
 #include "lib/network_order.h"
+#include "lib/xxhash.h"
 
 #include <cstring>
+#include <deque>
+#include <vector>
 
 namespace filedaemon {
 
@@ -96,6 +103,111 @@ bool EncodeAndSendAttributes(JobControlRecord* jcr,
 static void CloseVssBackupSession(JobControlRecord* jcr);
 #endif
 
+static metrics::counter files_saved{"bareos_fd_saved_files",
+                                    "Files handed to SaveFile"};
+static metrics::counter sent_bytes{"bareos_fd_sent_bytes",
+                                   "File data sent to the SD"};
+static metrics::counter compression_input{
+    "bareos_fd_compression_input_bytes", "Bytes given to the compression"};
+static metrics::counter compression_output{
+    "bareos_fd_compression_output_bytes",
+    "Bytes left after compression (or stored plain because it did not help)"};
+
+/* Sends the header "<file-index> <stream> 0" of a stream.  This and
+ * SendAttributeRecord() run for every file, so they build the messages
+ * without Bsnprintf(). */
+static bool SendStreamHeader(BareosSocket* sd, uint32_t file_index, int stream)
+{
+  if (sd->errors || sd->IsTerminated()) { return false; }
+  MessageBuilder message(sd->msg);
+  message << file_index << ' ' << stream << " 0";
+  sd->message_length = message.size();
+  return sd->send();
+}
+
+/* Sends the attribute record
+ *   <file-index> <type> <fname>\0<attribs>\0<link>\0<attribsEx>\0<delta-seq>\0
+ */
+static bool SendAttributeRecord(BareosSocket* sd,
+                                uint32_t file_index,
+                                int type,
+                                const char* fname,
+                                const char* attribs,
+                                const char* link,
+                                const char* attribsEx,
+                                uint32_t delta_seq)
+{
+  if (sd->errors || sd->IsTerminated()) { return false; }
+  MessageBuilder message(sd->msg);
+  message << file_index << ' ' << type << ' ' << fname << '\0' << attribs
+          << '\0' << link << '\0' << attribsEx << '\0' << delta_seq << '\0';
+  sd->message_length = message.size();
+  return sd->send();
+}
+
+const char* const backup_stage_names[]
+    = {"read", "digest", "compress", "encrypt", "network"};
+static_assert(std::size(backup_stage_names)
+              == static_cast<std::size_t>(backup_stage::kCount));
+
+#if !defined(HAVE_WIN32)
+// Maximum number of small files that are held in memory ahead of time.
+static constexpr std::size_t kPrefetchMaxFiles = 32;
+// Number of directory entries whose lstat() may be in flight.
+static constexpr std::size_t kStatAheadEntries = 64;
+// Number of files whose ACLs and xattrs are held ahead of time.
+static constexpr std::size_t kMetadataPrefetchFiles = 64;
+
+static void PrefetchFile(JobControlRecord* jcr,
+                         FindFilesPacket* ff_pkt,
+                         const char* fname)
+{
+  // Plugins supply their own data.
+  if (ff_pkt->cmd_plugin || ff_pkt->opt_plugin) { return; }
+
+  time_t changed_since = ff_pkt->incremental ? ff_pkt->save_time : 0;
+
+  if (MetadataPrefetcher* metadata = jcr->fd_impl->metadata_prefetcher.get()) {
+    metadata->Prefetch(fname, have_acl && BitIsSet(FO_ACL, ff_pkt->flags),
+                       have_xattr && BitIsSet(FO_XATTR, ff_pkt->flags),
+                       changed_since);
+  }
+
+  FilePrefetcher* prefetcher = jcr->fd_impl->prefetcher.get();
+  if (!prefetcher) { return; }
+
+  /* Reading ahead would change the access time before we get the chance
+   * to remember it. */
+  if (BitIsSet(FO_KEEPATIME, ff_pkt->flags)) { return; }
+
+  prefetcher->Prefetch(fname, BitIsSet(FO_NOATIME, ff_pkt->flags),
+                       changed_since);
+}
+
+// Hand the ACL and xattrs collected ahead of time to the findlib code.
+static void TakePrefetchedMetadata(JobControlRecord* jcr,
+                                   FindFilesPacket* ff_pkt)
+{
+  std::optional<MetadataPrefetcher::metadata> metadata;
+  if (auto* prefetcher = jcr->fd_impl->metadata_prefetcher.get();
+      prefetcher && (ff_pkt->type == FT_REG || ff_pkt->type == FT_REGE)
+      && !ff_pkt->cmd_plugin && !jcr->IsPlugin()) {
+    metadata = prefetcher->Take(ff_pkt->fname, ff_pkt->statp);
+  }
+
+  if (have_acl && jcr->fd_impl->acl_data) {
+    jcr->fd_impl->acl_data->trivial_access_acl
+        = metadata && metadata->trivial_access_acl;
+  }
+  if (have_xattr && jcr->fd_impl->xattr_data) {
+    jcr->fd_impl->xattr_data->prefetched.reset();
+    if (metadata) {
+      jcr->fd_impl->xattr_data->prefetched = std::move(metadata->xattrs);
+    }
+  }
+}
+#endif
+
 /**
  * Find all the requested files and send them
  * to the Storage daemon.
@@ -139,6 +251,7 @@ bool BlastDataToStorageDaemon(JobControlRecord* jcr, crypto_cipher_t cipher)
   jcr->buf_size = sd->message_length;
 
   if (!AdjustCompressionBuffers(jcr)) { return false; }
+  SetupCompressionDictionary(jcr);
 
   if (!CryptoSessionStart(jcr, cipher)) { return false; }
 
@@ -151,6 +264,29 @@ bool BlastDataToStorageDaemon(JobControlRecord* jcr, crypto_cipher_t cipher)
                            AccurateCheckFile);
   }
 
+#if !defined(HAVE_WIN32)
+  /* Small files do not use the parallel SendPlainData() pipeline, so instead
+   * some of them get read ahead while the current one is sent. */
+  if (me->MaxWorkersPerJob > 0) {
+    jcr->fd_impl->prefetcher = std::make_unique<FilePrefetcher>(
+        jcr->fd_impl->threads, me->MaxWorkersPerJob, 2 * jcr->buf_size,
+        kPrefetchMaxFiles);
+    SetFindPrefetchFunction((FindFilesPacket*)jcr->fd_impl->ff, PrefetchFile);
+
+    /* The directory scan itself is latency bound on network filesystems,
+     * so let it lstat() the entries it read ahead concurrently. */
+    jcr->fd_impl->stat_ahead = std::make_unique<StatAhead>(
+        jcr->fd_impl->threads, me->MaxWorkersPerJob, kStatAheadEntries);
+    jcr->fd_impl->ff->stat_ahead = jcr->fd_impl->stat_ahead.get();
+
+    // Each file takes several calls to find out it has no ACL or xattrs.
+    if (have_acl || have_xattr) {
+      jcr->fd_impl->metadata_prefetcher = std::make_unique<MetadataPrefetcher>(
+          jcr->fd_impl->threads, me->MaxWorkersPerJob, kMetadataPrefetchFiles);
+    }
+  }
+#endif
+
   auto hb_send = MakeHeartbeatMonitor(jcr);
 
   if (have_acl) {
@@ -176,6 +312,20 @@ bool BlastDataToStorageDaemon(JobControlRecord* jcr, crypto_cipher_t cipher)
     jcr->setJobStatusWithPriorityCheck(JS_ErrorTerminated);
   }
 
+  if (ok && jcr->fd_impl->resume_after) {
+    Jmsg(jcr, M_FATAL, 0,
+         T_("Did not come across %s, the last file saved by the backup being "
+            "resumed.\n"),
+         jcr->fd_impl->resume_after->c_str());
+    ok = false;
+    jcr->setJobStatusWithPriorityCheck(JS_ErrorTerminated);
+  }
+
+  jcr->fd_impl->ff->stat_ahead = nullptr;
+  jcr->fd_impl->stat_ahead.reset();
+  jcr->fd_impl->prefetcher.reset();
+  jcr->fd_impl->metadata_prefetcher.reset();
+
   if (have_acl && jcr->fd_impl->acl_data->u.build->nr_errors > 0) {
     Jmsg(jcr, M_WARNING, 0,
          T_("Encountered %ld acl errors while doing backup\n"),
@@ -187,6 +337,8 @@ bool BlastDataToStorageDaemon(JobControlRecord* jcr, crypto_cipher_t cipher)
          jcr->fd_impl->xattr_data->u.build->nr_errors);
   }
 
+  SaveCompressionDictionary(jcr, ok && !jcr->IsJobCanceled());
+
 #if defined(WIN32_VSS)
   CloseVssBackupSession(jcr);
 #endif
@@ -215,6 +367,12 @@ bool BlastDataToStorageDaemon(JobControlRecord* jcr, crypto_cipher_t cipher)
   CleanupCompression(jcr);
   CryptoSessionEnd(jcr);
 
+  if (std::string stages
+      = jcr->fd_impl->stage_times.Format(backup_stage_names);
+      !stages.empty()) {
+    Jmsg(jcr, M_INFO, 0, T_("Backup stages: %s\n"), stages.c_str());
+  }
+
   Dmsg1(100, "end blast_data ok=%d\n", ok);
   return ok;
 }
@@ -264,7 +422,7 @@ static inline bool SaveRsrcAndFinder(b_save_ctx& bsctx)
   }
 
   Dmsg1(300, "Saving Finder Info for \"%s\"\n", bsctx.ff_pkt->fname);
-  sd->fsend("%ld %d 0", bsctx.jcr->JobFiles, STREAM_HFSPLUS_ATTRIBUTES);
+  SendStreamHeader(sd, bsctx.jcr->JobFiles, STREAM_HFSPLUS_ATTRIBUTES);
   Dmsg1(300, "filed>stored:header %s", sd->msg);
   PmMemcpy(sd->msg, bsctx.ff_pkt->hfsinfo.fndrinfo, 32);
   sd->message_length = 32;
@@ -320,6 +478,9 @@ static inline bool SetupEncryptionDigests(b_save_ctx& bsctx)
   } else if (BitIsSet(FO_XXH128, bsctx.ff_pkt->flags)) {
     bsctx.digest = crypto_digest_new(bsctx.jcr, CRYPTO_DIGEST_XXH128);
     bsctx.digest_stream = STREAM_XXH128_DIGEST;
+  } else if (BitIsSet(FO_XXH3_TREE, bsctx.ff_pkt->flags)) {
+    bsctx.digest = crypto_digest_new(bsctx.jcr, CRYPTO_DIGEST_XXH3_TREE);
+    bsctx.digest_stream = STREAM_XXH3_TREE_DIGEST;
   }
 
   // Did digest initialization fail?
@@ -390,7 +551,7 @@ static inline bool TerminateSigningDigest(b_save_ctx& bsctx)
   }
 
   // Send our header
-  sd->fsend("%ld %ld 0", bsctx.jcr->JobFiles, STREAM_SIGNED_DIGEST);
+  SendStreamHeader(sd, bsctx.jcr->JobFiles, STREAM_SIGNED_DIGEST);
   Dmsg1(300, "filed>stored:header %s", sd->msg);
 
   // Encode signature data
@@ -417,7 +578,7 @@ static inline bool TerminateDigest(b_save_ctx& bsctx)
   bool retval = false;
   BareosSocket* sd = bsctx.jcr->store_bsock;
 
-  sd->fsend("%ld %d 0", bsctx.jcr->JobFiles, bsctx.digest_stream);
+  SendStreamHeader(sd, bsctx.jcr->JobFiles, bsctx.digest_stream);
   Dmsg1(300, "filed>stored:header %s", sd->msg);
 
   size = CRYPTO_DIGEST_MAX_SIZE;
@@ -435,7 +596,9 @@ static inline bool TerminateDigest(b_save_ctx& bsctx)
 
   // Keep the checksum if this file is a hardlink
   if (bsctx.ff_pkt->linked) {
-    bsctx.ff_pkt->linked->set_digest(bsctx.digest_stream, sd->msg, size);
+    FindFilesPacket* ff_pkt = bsctx.ff_pkt;
+    ff_pkt->linkhash->SetDigest(*ff_pkt->linked, bsctx.digest_stream, sd->msg,
+                                size);
   }
 
   sd->message_length = size;
@@ -530,6 +693,18 @@ int SaveFile(JobControlRecord* jcr, FindFilesPacket* ff_pkt, bool)
 
   jcr->fd_impl->num_files_examined++; /* bump total file count */
 
+  /* When resuming a backup, what it saved is skipped up to and including the
+   * last file it saved.  Directories get saved after their contents. */
+  if (jcr->fd_impl->resume_after) {
+    const char* fname
+        = S_ISDIR(ff_pkt->statp.st_mode) ? ff_pkt->link : ff_pkt->fname;
+    if (ff_pkt->type != FT_DIRBEGIN && *jcr->fd_impl->resume_after == fname) {
+      Jmsg(jcr, M_INFO, 0, T_("Resuming the backup after %s\n"), fname);
+      jcr->fd_impl->resume_after.reset();
+    }
+    return 1;
+  }
+
   switch (ff_pkt->type) {
     case FT_LNKSAVED: /* Hard linked, file already saved */
       Dmsg2(130, "FT_LNKSAVED hard link: %s => %s\n", ff_pkt->fname,
@@ -743,6 +918,10 @@ int SaveFile(JobControlRecord* jcr, FindFilesPacket* ff_pkt, bool)
   }
 
   Dmsg2(150, "type=%d do_read=%d\n", ff_pkt->type, do_read);
+  files_saved.Add();
+  Dtrace(kBackup, "save file FI=%d type=%d size=%lld do_read=%d",
+         jcr->JobFiles, ff_pkt->type, (long long)ff_pkt->statp.st_size,
+         do_read);
   if (do_read) {
     btimer_t* tid;
     int noatime;
@@ -757,6 +936,7 @@ int SaveFile(JobControlRecord* jcr, FindFilesPacket* ff_pkt, bool)
     ff_pkt->bfd.reparse_point
         = (ff_pkt->type == FT_REPARSE || ff_pkt->type == FT_JUNCTION);
 
+    SetReadAhead(&ff_pkt->bfd, me->read_ahead_size);
     if (bopen(&ff_pkt->bfd, ff_pkt->fname, O_RDONLY | O_BINARY | noatime, 0,
               ff_pkt->statp.st_rdev)
         < 0) {
@@ -796,6 +976,10 @@ int SaveFile(JobControlRecord* jcr, FindFilesPacket* ff_pkt, bool)
     }
   }
 
+#if !defined(HAVE_WIN32)
+  TakePrefetchedMetadata(jcr, ff_pkt);
+#endif
+
   // Save ACLs when requested and available for anything not being a symlink.
   if (have_acl) {
     if (BitIsSet(FO_ACL, ff_pkt->flags) && ff_pkt->type != FT_LNK) {
@@ -823,12 +1007,9 @@ int SaveFile(JobControlRecord* jcr, FindFilesPacket* ff_pkt, bool)
   // Check if original file has a digest, and send it
   if (ff_pkt->type == FT_LNKSAVED && ff_pkt->digest) {
     Dmsg2(300, "Link %s digest %d\n", ff_pkt->fname, ff_pkt->digest_len);
-    sd->fsend("%ld %d 0", jcr->JobFiles, ff_pkt->digest_stream);
+    SendStreamHeader(sd, jcr->JobFiles, ff_pkt->digest_stream);
 
-    sd->msg = CheckPoolMemorySize(sd->msg, ff_pkt->digest_len);
-    memcpy(sd->msg, ff_pkt->digest, ff_pkt->digest_len);
-    sd->message_length = ff_pkt->digest_len;
-    sd->send();
+    sd->SendV({{ff_pkt->digest, ff_pkt->digest_len}});
 
     sd->signal(BNET_EOD); /* end of hardlink record */
   }
@@ -895,34 +1076,64 @@ static inline bool SendDataToSd(b_ctx* bctx)
   // Uncompressed cipher input length
   bctx->cipher_input_len = sd->message_length;
 
-  // Update checksum if requested
-  if (bctx->digest) {
-    CryptoDigestUpdate(bctx->digest, (uint8_t*)bctx->rbuf, sd->message_length);
-  }
+  auto& stage_times = bctx->jcr->fd_impl->stage_times;
+  if (bctx->digest || bctx->signing_digest) {
+    auto timer = stage_times.Time(backup_stage::kDigest);
 
-  // Update signing digest if requested
-  if (bctx->signing_digest) {
-    CryptoDigestUpdate(bctx->signing_digest, (uint8_t*)bctx->rbuf,
-                       sd->message_length);
+    // Update checksum if requested
+    if (bctx->digest) {
+      CryptoDigestUpdate(bctx->digest, (uint8_t*)bctx->rbuf,
+                         sd->message_length);
+    }
+
+    // Update signing digest if requested
+    if (bctx->signing_digest) {
+      CryptoDigestUpdate(bctx->signing_digest, (uint8_t*)bctx->rbuf,
+                         sd->message_length);
+    }
   }
 
   // Compress the data.
   if (BitIsSet(FO_COMPRESS, bctx->ff_pkt->flags)) {
-    if (!CompressData(bctx->jcr, bctx->ff_pkt->Compress_algo, bctx->rbuf,
-                      bctx->jcr->store_bsock->message_length, bctx->cbuf,
-                      bctx->max_compress_len, &bctx->compress_len)) {
-      return false;
+    uint32_t rsize = bctx->jcr->store_bsock->message_length;
+    bool fits_plain = rsize <= bctx->max_compress_len;
+    bool store_plain
+        = fits_plain && bctx->compression_bypass->Skip(bctx->rbuf, rsize);
+
+    if (!store_plain) {
+      SampleForCompressionDictionary(bctx->jcr, bctx->ff_pkt, bctx->rbuf,
+                                     rsize);
+      auto timer = stage_times.Time(backup_stage::kCompress);
+      if (!CompressData(bctx->jcr, bctx->ff_pkt->Compress_algo, bctx->rbuf,
+                        rsize, bctx->cbuf, bctx->max_compress_len,
+                        &bctx->compress_len)) {
+        return false;
+      }
+      bctx->compression_bypass->Learn(rsize, bctx->compress_len);
+      store_plain
+          = fits_plain && CompressionWasUseless(rsize, bctx->compress_len);
     }
 
+    uint32_t magic = bctx->ch.magic;
+    uint16_t level = bctx->ch.level;
+    if (store_plain) {
+      memcpy(bctx->cbuf, bctx->rbuf, rsize);
+      bctx->compress_len = rsize;
+      magic = COMPRESS_NONE;
+      level = 0;
+    }
+    compression_input.Add(rsize);
+    compression_output.Add(bctx->compress_len);
+
     // See if we need to generate a compression header.
     if (bctx->chead) {
       ser_declare;
 
       // Complete header
       SerBegin(bctx->chead, sizeof(comp_stream_header));
-      ser_uint32(bctx->ch.magic);
+      ser_uint32(magic);
       ser_uint32(bctx->compress_len);
-      ser_uint16(bctx->ch.level);
+      ser_uint16(level);
       ser_uint16(bctx->ch.version);
       SerEnd(bctx->chead, sizeof(comp_stream_header));
 
@@ -936,10 +1147,12 @@ static inline bool SendDataToSd(b_ctx* bctx)
 
   // Encrypt the data.
   need_more_data = false;
-  if (BitIsSet(FO_ENCRYPT, bctx->ff_pkt->flags)
-      && !EncryptData(bctx, &need_more_data)) {
-    if (need_more_data) { return true; }
-    return false;
+  if (BitIsSet(FO_ENCRYPT, bctx->ff_pkt->flags)) {
+    auto timer = stage_times.Time(backup_stage::kEncrypt);
+    if (!EncryptData(bctx, &need_more_data)) {
+      if (need_more_data) { return true; }
+      return false;
+    }
   }
 
   // Send the buffer to the Storage daemon
@@ -949,7 +1162,12 @@ static inline bool SendDataToSd(b_ctx* bctx)
   }
   sd->msg = bctx->wbuf; /* set correct write buffer */
 
-  if (!sd->send()) {
+  bool sent;
+  {
+    auto timer = stage_times.Time(backup_stage::kNetwork);
+    sent = sd->send();
+  }
+  if (!sent) {
     if (!bctx->jcr->IsJobCanceled()) {
       Jmsg1(bctx->jcr, M_FATAL, 0, T_("Network send error to SD. ERR=%s\n"),
             sd->bstrerror());
@@ -960,6 +1178,7 @@ static inline bool SendDataToSd(b_ctx* bctx)
   Dmsg1(130, "Send data to SD len=%d\n", sd->message_length);
   bctx->jcr->JobBytes += sd->message_length; /* count bytes saved possibly
                                                 compressed/encrypted */
+  sent_bytes.Add(sd->message_length);
   sd->msg = bctx->msgsave;                   /* restore read buffer */
 
   return true;
@@ -1026,15 +1245,63 @@ bail_out:
 }
 #endif
 
+// Send the content of a file that was already read by the FilePrefetcher.
+static inline bool SendPrefetchedData(b_ctx& bctx,
+                                      const std::vector<char>& content)
+{
+  BareosSocket* sd = bctx.jcr->store_bsock;
+
+  std::size_t offset = 0;
+  while (offset < content.size()) {
+    std::size_t size
+        = std::min(content.size() - offset, static_cast<std::size_t>(bctx.rsize));
+    std::memcpy(bctx.rbuf, content.data() + offset, size);
+    offset += size;
+
+    sd->message_length = size;
+    if (!SendDataToSd(&bctx)) { return false; }
+  }
+  sd->message_length = 0;
+
+  return true;
+}
+
+/* Holes of sparse files are found with the help of the filesystem instead
+ * of reading and checking their zeroes.  The last block is always read, it
+ * is sent even if it is zero to restore the size of the file. */
+static bool SkipsHoles(FindFilesPacket* ff_pkt, std::size_t block_size)
+{
+  return BitIsSet(FO_SPARSE, ff_pkt->flags) && ff_pkt->type == FT_REG
+         && static_cast<uint64_t>(ff_pkt->statp.st_size) > block_size;
+}
+
 static inline bool SendPlainDataSerially(b_ctx& bctx)
 {
   bool retval = false;
   BareosSocket* sd = bctx.jcr->store_bsock;
 
+  if (auto* prefetcher = bctx.jcr->fd_impl->prefetcher.get();
+      prefetcher && bctx.may_be_prefetched) {
+    if (std::optional content
+        = prefetcher->Take(bctx.ff_pkt->fname, bctx.ff_pkt->statp)) {
+      return SendPrefetchedData(bctx, content.value());
+    }
+  }
+
+  bool skip_holes = SkipsHoles(bctx.ff_pkt, bctx.rsize);
+
   // Read the file data
-  while ((sd->message_length
-          = (uint32_t)bread(&bctx.ff_pkt->bfd, bctx.rbuf, bctx.rsize))
-         > 0) {
+  for (;;) {
+    {
+      auto timer = bctx.jcr->fd_impl->stage_times.Time(backup_stage::kRead);
+      if (skip_holes) {
+        bctx.fileAddr = SkipHole(&bctx.ff_pkt->bfd, bctx.fileAddr,
+                                 bctx.ff_pkt->statp.st_size - bctx.rsize);
+      }
+      sd->message_length
+          = (uint32_t)bread(&bctx.ff_pkt->bfd, bctx.rbuf, bctx.rsize);
+    }
+    if (sd->message_length <= 0) { break; }
     if (!SendDataToSd(&bctx)) { goto bail_out; }
   }
   retval = true;
@@ -1148,21 +1415,89 @@ class data_message {
 
 using shared_message = std::shared_ptr<data_message>;
 
+/* See EncryptData() for why the length of every block is encrypted in front
+ * of it. */
+static result<shared_message> DoEncryptMessage(CIPHER_CONTEXT* cipher_ctx,
+                                               const data_message& input)
+{
+  ASSERT(input.data_size() <= std::numeric_limits<std::uint32_t>::max());
+  std::uint32_t input_len = input.data_size();
+
+  uint8_t packet_len[sizeof(uint32_t)];
+  {
+    ser_declare;
+    SerBegin(packet_len, sizeof(uint32_t));
+    ser_uint32(input_len);
+    SerEnd(packet_len, sizeof(uint32_t));
+  }
+
+  /* CryptoCipherUpdate() will buffer up to (cipher_block_size - 1) bytes,
+   * so the output can be at most one block larger than the input. */
+  data_message msg(sizeof(packet_len) + input_len
+                   + 2 * CRYPTO_CIPHER_MAX_BLOCK_SIZE);
+  auto* out = reinterpret_cast<uint8_t*>(msg.data_ptr());
+
+  std::uint32_t initial_len = 0, encrypted_len = 0;
+  if (!CryptoCipherUpdate(cipher_ctx, packet_len, sizeof(packet_len), out,
+                          &initial_len)
+      || !CryptoCipherUpdate(
+          cipher_ctx, reinterpret_cast<const uint8_t*>(input.data_ptr()),
+          input_len, out + initial_len, &encrypted_len)) {
+    return PoolMem{"Encryption error"};
+  }
+
+  Dmsg2(400, "encrypted len=%d unencrypted len=%d\n", encrypted_len,
+        input_len);
+
+  auto total_size = initial_len + encrypted_len;
+  ASSERT(total_size <= msg.data_size());
+  msg.resize(total_size);
+
+  return shared_message{new data_message{std::move(msg)}};
+}
+
+/* Sealed blocks do not depend on each other, so this is done by the workers
+ * right after compressing the block. */
+static result<shared_message> DoSealMessage(CIPHER_CONTEXT* cipher_ctx,
+                                            const data_message& input)
+{
+  ASSERT(input.data_size() <= std::numeric_limits<std::uint32_t>::max());
+  std::uint32_t input_len = input.data_size();
+
+  data_message msg(input_len + CRYPTO_SEALED_OVERHEAD);
+  std::uint32_t sealed_len = 0;
+  if (!CryptoCipherSealBlock(
+          cipher_ctx, reinterpret_cast<const uint8_t*>(input.data_ptr()),
+          input_len, reinterpret_cast<uint8_t*>(msg.data_ptr()),
+          &sealed_len)) {
+    return PoolMem{"Encryption error"};
+  }
+  ASSERT(sealed_len == msg.data_size());
+
+  return shared_message{new data_message{std::move(msg)}};
+}
+
 static std::future<result<std::size_t>> MakeSendThread(
     thread_pool& pool,
     BareosSocket* sd,
+    stage_timers<backup_stage>& times,
     channel::output<std::future<result<shared_message>>> out)
 {
   std::promise<result<std::size_t>> promise;
   std::future fut = promise.get_future();
 
   pool.borrow_thread(
-      [prom = std::move(promise), out = std::move(out), sd]() mutable {
+      [prom = std::move(promise), out = std::move(out), sd, &times]() mutable {
         std::size_t accumulated = 0;
         for (;;) {
-          std::optional out_fut = out.get();
-          if (!out_fut) { break; }
-          result p = out_fut->get();
+          std::optional<result<shared_message>> next;
+          {
+            auto wait = times.TimeWait(backup_stage::kNetwork);
+            std::optional out_fut = out.get();
+            if (out_fut) { next.emplace(out_fut->get()); }
+          }
+          if (!next) { break; }
+          result p = std::move(*next);
           if (p.holds_error()) {
             prom.set_value(std::move(p.error_unchecked()));
             return;
@@ -1175,6 +1510,7 @@ static std::future<result<std::size_t>> MakeSendThread(
           // technically we are overwriting part of message here
           // but its only the "size" field of the message, which is not
           // read/written to otherwise after making it a shared_message.
+          auto timer = times.Time(backup_stage::kNetwork);
           result ret = SendData(sd, msg, size);
           if (ret.holds_error()) {
             prom.set_value(std::move(ret.error_unchecked()));
@@ -1188,30 +1524,93 @@ static std::future<result<std::size_t>> MakeSendThread(
   return fut;
 }
 
+/* Encryption has to be done in stream order since the cipher context is
+ * chained across all blocks of a file.  This thread takes the (possibly
+ * compressed) messages in order, encrypts them and hands them to the send
+ * thread, so that encryption overlaps both compression and network io.
+ * Ciphers sealing every block on its own do not need it. */
+static void MakeEncryptThread(
+    thread_pool& pool,
+    CIPHER_CONTEXT* cipher_ctx,
+    stage_timers<backup_stage>& times,
+    channel::output<std::future<result<shared_message>>> out,
+    channel::input<std::future<result<shared_message>>> in)
+{
+  pool.borrow_thread([cipher_ctx, &times, out = std::move(out),
+                      in = std::move(in)]() mutable {
+    for (;;) {
+      std::optional<result<shared_message>> next;
+      {
+        auto wait = times.TimeWait(backup_stage::kEncrypt);
+        std::optional out_fut = out.get();
+        if (out_fut) { next.emplace(out_fut->get()); }
+      }
+      if (!next) { break; }
+      result p = std::move(*next);
+
+      if (!p.holds_error()) {
+        auto timer = times.Time(backup_stage::kEncrypt);
+        p = DoEncryptMessage(cipher_ctx, *p.value_unchecked());
+        // the cipher did not produce a full block yet
+        if (!p.holds_error() && p.value_unchecked()->data_size() == 0) {
+          continue;
+        }
+      }
+
+      bool is_error = p.holds_error();
+      std::promise<result<shared_message>> prom;
+      prom.set_value(std::move(p));
+      if (!in.emplace(prom.get_future()) || is_error) { break; }
+    }
+    // the cipher context must not be used anymore after this point
+    in.close();
+    out.close();
+  });
+}
+
 struct compression_context {
   comp_stream_header ch;
   uint32_t algorithm;
   int level;
+  CompressionBypass* bypass;
+  const CompressionDictionary* dictionary;
 };
 
 static result<shared_message> DoCompressMessage(compression_context& compctx,
                                                 const data_message& input)
 {
+  bool store_plain = compctx.bypass->Skip(input.data_ptr(), input.data_size());
   auto data_size = RequiredCompressionOutputBufferSize(compctx.algorithm,
                                                        input.data_size());
 
   auto msg = input.derived();
   msg.resize(data_size);
-  result comp_size = ThreadlocalCompress(
-      compctx.algorithm, compctx.level, input.data_ptr(), input.data_size(),
-      msg.data_ptr() + sizeof(comp_stream_header),
-      msg.data_size() - sizeof(comp_stream_header));
+  std::size_t csize = 0;
+  if (!store_plain) {
+    result comp_size = ThreadlocalCompress(
+        compctx.algorithm, compctx.level, input.data_ptr(), input.data_size(),
+        msg.data_ptr() + sizeof(comp_stream_header),
+        msg.data_size() - sizeof(comp_stream_header), compctx.dictionary);
+
+    if (comp_size.holds_error()) {
+      return std::move(comp_size.error_unchecked());
+    }
 
-  if (comp_size.holds_error()) {
-    return std::move(comp_size.error_unchecked());
+    csize = comp_size.value_unchecked();
+    compctx.bypass->Learn(input.data_size(), csize);
+    store_plain = CompressionWasUseless(input.data_size(), csize);
   }
 
-  auto csize = comp_size.value_unchecked();
+  uint32_t magic = compctx.ch.magic;
+  uint16_t level = compctx.ch.level;
+  if (store_plain) {
+    ASSERT(input.data_size() + sizeof(comp_stream_header) <= msg.data_size());
+    std::memcpy(msg.data_ptr() + sizeof(comp_stream_header), input.data_ptr(),
+                input.data_size());
+    csize = input.data_size();
+    magic = COMPRESS_NONE;
+    level = 0;
+  }
 
   if (csize > std::numeric_limits<std::uint32_t>::max()) {
     PoolMem error;
@@ -1224,9 +1623,9 @@ static result<shared_message> DoCompressMessage(compression_context& compctx,
     // Write compression header
     ser_declare;
     SerBegin(msg.data_ptr(), sizeof(comp_stream_header));
-    ser_uint32(compctx.ch.magic);
+    ser_uint32(magic);
     ser_uint32(csize);
-    ser_uint16(compctx.ch.level);
+    ser_uint16(level);
     ser_uint16(compctx.ch.version);
     SerEnd(msg.data_ptr(), sizeof(comp_stream_header));
   }
@@ -1248,10 +1647,6 @@ static inline bool SendPlainData(b_ctx& bctx)
   auto* flags = bctx.ff_pkt->flags;
 
   const std::size_t num_workers = me->MaxWorkersPerJob;
-  // Currently we do not support encryption while doing
-  // parallel sending/checksumming/compression/etc.
-  // This is mostly because EncryptData() is weird!
-  if (BitIsSet(FO_ENCRYPT, flags)) { return SendPlainDataSerially(bctx); }
 
   // Setting up the parallel pipeline is not worth it for small files.
   if (static_cast<std::size_t>(file_size) < 2 * max_buf_size) {
@@ -1271,15 +1666,19 @@ static inline bool SendPlainData(b_ctx& bctx)
   bool support_offsets = BitIsSet(FO_OFFSETS, flags);
 
   std::optional<compression_context> compctx;
+  CompressionBypass bypass;
   if (BitIsSet(FO_COMPRESS, flags)) {
     compctx = compression_context{
         .ch = bctx.ch,
         .algorithm = bctx.ff_pkt->Compress_algo,
         .level = bctx.ff_pkt->Compress_level,
+        .bypass = &bypass,
+        .dictionary = bctx.jcr->compress.dictionary.get(),
     };
   }
 
   auto& threadpool = bctx.jcr->fd_impl->threads;
+  auto& stage_times = bctx.jcr->fd_impl->stage_times;
 
   work_group compute_group(num_workers * 3);
 
@@ -1295,16 +1694,56 @@ static inline bool SendPlainData(b_ctx& bctx)
                             });
 
   auto [in, out]
-      = channel::CreateBufferedChannel<std::future<result<shared_message>>>(
+      = channel::CreateSpscChannel<std::future<result<shared_message>>>(
           num_workers);
 
-  std::future bytes_send_fut = MakeSendThread(threadpool, sd, std::move(out));
+  CIPHER_CONTEXT* sealing = nullptr;
+  if (BitIsSet(FO_ENCRYPT, flags) && CryptoCipherSealsBlocks(bctx.cipher_ctx)) {
+    sealing = bctx.cipher_ctx;
+  }
+
+  std::future<result<std::size_t>> bytes_send_fut;
+  if (BitIsSet(FO_ENCRYPT, flags) && !sealing) {
+    // SetupEncryptionContext() makes sure that there is no header to encrypt
+    ASSERT(!support_sparse && !support_offsets);
+    auto [enc_in, enc_out]
+        = channel::CreateSpscChannel<std::future<result<shared_message>>>(
+            num_workers);
+
+    MakeEncryptThread(threadpool, bctx.cipher_ctx, stage_times,
+                      std::move(out), std::move(enc_in));
+    bytes_send_fut
+        = MakeSendThread(threadpool, sd, stage_times, std::move(enc_out));
+  } else {
+    bytes_send_fut
+        = MakeSendThread(threadpool, sd, stage_times, std::move(out));
+  }
 
   DIGEST* checksum = bctx.digest;
   DIGEST* signing = bctx.signing_digest;
 
   std::optional<std::future<void>> update_digest;
 
+  /* The chunks of a tree digest are hashed by the workers, only adding
+   * their hashes is done in order.  This needs every block but the last one
+   * to consist of whole chunks, so once bread() returns a short block the
+   * rest of the file is hashed serially with CryptoDigestUpdate(). */
+  DIGEST* tree_checksum = nullptr;
+  bool tree_serial = false;
+  std::deque<std::future<std::vector<Xxh128Hash>>> chunk_hashes;
+  if (checksum && checksum->type == CRYPTO_DIGEST_XXH3_TREE
+      && max_buf_size % xxh3_tree_chunk_size == 0) {
+    tree_checksum = checksum;
+    checksum = nullptr;
+  }
+  bool digest_error = false;
+  auto add_chunk_hashes = [&chunk_hashes, &digest_error, tree_checksum]() {
+    if (!Xxh3TreeAddChunkHashes(tree_checksum, chunk_hashes.front().get())) {
+      digest_error = true;
+    }
+    chunk_hashes.pop_front();
+  };
+
   std::uint64_t bytes_read{0};
   std::uint64_t offset{0};
 
@@ -1314,13 +1753,21 @@ static inline bool SendPlainData(b_ctx& bctx)
   bool include_header = support_sparse || support_offsets;
 
   bool read_error = false;
+  bool skip_holes = support_sparse && SkipsHoles(bctx.ff_pkt, max_buf_size);
 
   // Read the file data
   for (;;) {
     data_message msg(max_buf_size);
     for (bool skip_block = true; skip_block;) {
       skip_block = false;
-      ssize_t read_bytes = bread(&bfd, msg.data_ptr(), msg.data_size());
+      ssize_t read_bytes;
+      {
+        auto timer = stage_times.Time(backup_stage::kRead);
+        if (skip_holes) {
+          bytes_read = SkipHole(&bfd, bytes_read, file_size - max_buf_size);
+        }
+        read_bytes = bread(&bfd, msg.data_ptr(), msg.data_size());
+      }
       // update offset _before_ sending the header
       offset = bfd.offset;
 
@@ -1348,7 +1795,7 @@ static inline bool SendPlainData(b_ctx& bctx)
        */
       if (support_sparse
           && ((msg.data_size() == max_buf_size
-               && (msg.data_size() + max_buf_size < (uint64_t)file_size))
+               && (bytes_read + msg.data_size() < (uint64_t)file_size))
               || unsized_file)
           // IsBufZero actually requires 8 bytes of alignment
           && IsBufZero(msg.data_ptr(), msg.data_size())) {
@@ -1368,12 +1815,15 @@ static inline bool SendPlainData(b_ctx& bctx)
       // updating the digest has to be done serially
       // so we have to wait until the last task is finished
       // before issuing a new one.
+      auto wait = stage_times.TimeWait(backup_stage::kRead);
       update_digest->get();
     }
 
     if (checksum || signing) {
       update_digest.emplace(compute_group.submit([checksum, signing,
+                                                  &stage_times,
                                                   shared_msg]() mutable {
+        auto timer = stage_times.Time(backup_stage::kDigest);
         auto* data = reinterpret_cast<const uint8_t*>(shared_msg->data_ptr());
         auto size = shared_msg->data_size();
         // Update checksum if requested
@@ -1384,11 +1834,48 @@ static inline bool SendPlainData(b_ctx& bctx)
       }));
     }
 
+    if (tree_checksum && !tree_serial
+        && shared_msg->data_size() % xxh3_tree_chunk_size != 0) {
+      tree_serial = true;
+      auto wait = stage_times.TimeWait(backup_stage::kRead);
+      while (!chunk_hashes.empty()) { add_chunk_hashes(); }
+    }
+
+    if (tree_checksum && tree_serial) {
+      auto timer = stage_times.Time(backup_stage::kDigest);
+      if (!CryptoDigestUpdate(
+              tree_checksum,
+              reinterpret_cast<const uint8_t*>(shared_msg->data_ptr()),
+              shared_msg->data_size())) {
+        digest_error = true;
+      }
+    } else if (tree_checksum) {
+      chunk_hashes.push_back(
+          compute_group.submit([&stage_times, shared_msg]() mutable {
+            auto timer = stage_times.Time(backup_stage::kDigest);
+            return Xxh3TreeChunkHashes(shared_msg->data_ptr(),
+                                       shared_msg->data_size());
+          }));
+      while (chunk_hashes.size() > num_workers) {
+        auto wait = stage_times.TimeWait(backup_stage::kRead);
+        add_chunk_hashes();
+      }
+    }
+
     std::future<result<shared_message>> copy_fut;
-    if (compctx) {
+    if (compctx || sealing) {
       copy_fut = compute_group.submit(
-          [cctx = compctx.value(), shared_msg]() mutable {
-            return DoCompressMessage(cctx, *shared_msg.get());
+          [cctx = compctx, sealing, &stage_times, shared_msg]() mutable {
+            result<shared_message> p = shared_msg;
+            if (cctx) {
+              auto timer = stage_times.Time(backup_stage::kCompress);
+              p = DoCompressMessage(*cctx, *shared_msg.get());
+            }
+            if (sealing && !p.holds_error()) {
+              auto timer = stage_times.Time(backup_stage::kEncrypt);
+              p = DoSealMessage(sealing, *p.value_unchecked());
+            }
+            return p;
           });
     } else {
       std::promise<result<shared_message>> prom;
@@ -1397,7 +1884,13 @@ static inline bool SendPlainData(b_ctx& bctx)
     }
 
     // Send the buffer to the Storage daemon
-    if (!in.emplace(std::move(copy_fut))) { goto bail_out; }
+    bool queued;
+    {
+      // the send side is the bottleneck if this has to wait
+      auto wait = stage_times.TimeWait(backup_stage::kRead);
+      queued = in.emplace(std::move(copy_fut));
+    }
+    if (!queued) { goto bail_out; }
   }
 end_read_loop:
   retval = true;
@@ -1407,6 +1900,11 @@ bail_out:
   latch.lock().wait(compute_fin, [](int num) { return num == 0; });
   in.close();
   if (update_digest) { update_digest->get(); }
+  while (!chunk_hashes.empty()) { add_chunk_hashes(); }
+  if (digest_error) {
+    Jmsg1(bctx.jcr, M_ERROR, 0, T_("Could not update the digest of %s\n"),
+          bctx.ff_pkt->fname);
+  }
   result sendres = bytes_send_fut.get();
   if (auto* error = sendres.error()) {
     if (!bctx.jcr->IsJobCanceled()) {
@@ -1417,6 +1915,7 @@ bail_out:
     bctx.jcr->JobBytes
         += sendres.value_unchecked();  /* count bytes saved possibly
                                           compressed/encrypted */
+    sent_bytes.Add(sendres.value_unchecked());
     bctx.jcr->ReadBytes += bytes_read; /* count bytes read */
   }
   sd->msg = bctx.msgsave; /* restore read buffer */
@@ -1447,6 +1946,7 @@ static int send_data(JobControlRecord* jcr,
                      DIGEST* signing_digest)
 {
   b_ctx bctx;
+  CompressionBypass compression_bypass;
   BareosSocket* sd = jcr->store_bsock;
 #ifdef FD_NO_SEND_TEST
   return 1;
@@ -1463,6 +1963,11 @@ static int send_data(JobControlRecord* jcr,
   bctx.cipher_input = (uint8_t*)bctx.rbuf; /* encrypt uncompressed data */
   bctx.digest = digest;                    /* encryption digest */
   bctx.signing_digest = signing_digest;    /* signing digest */
+  bctx.compression_bypass = &compression_bypass;
+  bctx.may_be_prefetched = ff_pkt->type == FT_REG && !ff_pkt->bfd.cmd_plugin
+                           && !jcr->opt_plugin
+                           && stream != STREAM_MACOS_FORK_DATA
+                           && stream != STREAM_ENCRYPTED_MACOS_FORK_DATA;
 
   Dmsg1(300, "Saving data, type=%d\n", ff_pkt->type);
 
@@ -1472,7 +1977,7 @@ static int send_data(JobControlRecord* jcr,
 
   /* Send Data header to Storage daemon
    *    <file-index> <stream> <info> */
-  if (!sd->fsend("%ld %d 0", jcr->JobFiles, stream)) {
+  if (!SendStreamHeader(sd, jcr->JobFiles, stream)) {
     if (!jcr->IsJobCanceled()) {
       Jmsg1(jcr, M_FATAL, 0, T_("Network send error to SD. ERR=%s\n"),
             sd->bstrerror());
@@ -1538,6 +2043,7 @@ static int send_data(JobControlRecord* jcr,
       Dmsg1(130, "Send data to SD len=%d\n", sd->message_length);
       jcr->JobBytes += sd->message_length; /* count bytes saved possibly
                                               compressed/encrypted */
+      sent_bytes.Add(sd->message_length);
       sd->msg = bctx.msgsave;              /* restore bnet buffer */
     }
   }
@@ -1599,8 +2105,13 @@ bool EncodeAndSendAttributes(JobControlRecord* jcr,
           T_("Invalid file flags, no supported data stream type.\n"));
     return false;
   }
-  EncodeStat(attribs.c_str(), &ff_pkt->statp, sizeof(ff_pkt->statp),
-             ff_pkt->LinkFI, data_stream);
+  if (jcr->fd_impl->binary_attributes && !IS_FT_OBJECT(ff_pkt->type)) {
+    EncodeStatBinary(attribs.c_str(), &ff_pkt->statp, sizeof(ff_pkt->statp),
+                     ff_pkt->LinkFI, data_stream);
+  } else {
+    EncodeStat(attribs.c_str(), &ff_pkt->statp, sizeof(ff_pkt->statp),
+               ff_pkt->LinkFI, data_stream);
+  }
 
   /** Now possibly extend the attributes */
   if (IS_FT_OBJECT(ff_pkt->type)) {
@@ -1634,7 +2145,7 @@ bool EncodeAndSendAttributes(JobControlRecord* jcr,
 
   /* Send Attributes header to Storage daemon
    *    <file-index> <stream> <info> */
-  if (!sd->fsend("%ld %d 0", jcr->JobFiles, attr_stream)) {
+  if (!SendStreamHeader(sd, jcr->JobFiles, attr_stream)) {
     if (!jcr->IsJobCanceled() && !jcr->IsIncomplete()) {
       Jmsg1(jcr, M_FATAL, 0, T_("Network send error to SD. ERR=%s\n"),
             sd->bstrerror());
@@ -1675,16 +2186,16 @@ bool EncodeAndSendAttributes(JobControlRecord* jcr,
     case FT_LNKSAVED:
       Dmsg3(300, "Link %d %s to %s\n", jcr->JobFiles, ff_pkt->fname,
             ff_pkt->link);
-      status = sd->fsend("%ld %d %s%c%s%c%s%c%s%c%u%c", jcr->JobFiles,
-                         ff_pkt->type, ff_pkt->fname, 0, attribs.c_str(), 0,
-                         ff_pkt->link, 0, attribsEx, 0, ff_pkt->delta_seq, 0);
+      status = SendAttributeRecord(sd, jcr->JobFiles, ff_pkt->type,
+                                   ff_pkt->fname, attribs.c_str(), ff_pkt->link,
+                                   attribsEx, ff_pkt->delta_seq);
       break;
     case FT_DIREND:
     case FT_REPARSE:
       /* Here link is the canonical filename (i.e. with trailing slash) */
-      status = sd->fsend("%ld %d %s%c%s%c%c%s%c%u%c", jcr->JobFiles,
-                         ff_pkt->type, ff_pkt->link, 0, attribs.c_str(), 0, 0,
-                         attribsEx, 0, ff_pkt->delta_seq, 0);
+      status = SendAttributeRecord(sd, jcr->JobFiles, ff_pkt->type,
+                                   ff_pkt->link, attribs.c_str(), "", attribsEx,
+                                   ff_pkt->delta_seq);
       break;
     case FT_PLUGIN_CONFIG:
     case FT_RESTORE_FIRST:
@@ -1712,25 +2223,22 @@ bool EncodeAndSendAttributes(JobControlRecord* jcr,
           sd->msg, "%d %d %d %d %d %d %s%c%s%c", jcr->JobFiles, ff_pkt->type,
           ff_pkt->object_index, comp_len, ff_pkt->object_len,
           ff_pkt->object_compression, ff_pkt->fname, 0, ff_pkt->object_name, 0);
-      sd->msg = CheckPoolMemorySize(sd->msg, sd->message_length + comp_len + 2);
-      memcpy(sd->msg + sd->message_length, ff_pkt->object, comp_len);
-
       // Note we send one extra byte so Dir can store zero after object
-      sd->message_length += comp_len + 1;
-      // initalize the extra byte
-      sd->msg[sd->message_length - 1] = '\0';
-      status = sd->send();
+      status = sd->SendV(
+          {{sd->msg, static_cast<std::size_t>(sd->message_length)},
+           {ff_pkt->object, static_cast<std::size_t>(comp_len)},
+           {"", 1}});
       if (ff_pkt->object_compression) { FreeAndNullPoolMemory(ff_pkt->object); }
       break;
     case FT_REG:
-      status = sd->fsend("%ld %d %s%c%s%c%c%s%c%d%c", jcr->JobFiles,
-                         ff_pkt->type, ff_pkt->fname, 0, attribs.c_str(), 0, 0,
-                         attribsEx, 0, ff_pkt->delta_seq, 0);
+      status = SendAttributeRecord(sd, jcr->JobFiles, ff_pkt->type,
+                                   ff_pkt->fname, attribs.c_str(), "",
+                                   attribsEx, ff_pkt->delta_seq);
       break;
     default:
-      status = sd->fsend("%ld %d %s%c%s%c%c%s%c%u%c", jcr->JobFiles,
-                         ff_pkt->type, ff_pkt->fname, 0, attribs.c_str(), 0, 0,
-                         attribsEx, 0, ff_pkt->delta_seq, 0);
+      status = SendAttributeRecord(sd, jcr->JobFiles, ff_pkt->type,
+                                   ff_pkt->fname, attribs.c_str(), "",
+                                   attribsEx, ff_pkt->delta_seq);
       break;
   }
 
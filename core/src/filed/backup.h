@@ -26,6 +26,8 @@
 
 #include "lib/crypto.h"
 
+class CompressionBypass;
+
 namespace filedaemon {
 
 struct b_save_ctx {
@@ -44,6 +46,7 @@ struct b_ctx {
   char* wbuf;              /* Write buffer */
   int32_t rsize;           /* Read size */
   uint64_t fileAddr;       /* File address */
+  bool may_be_prefetched;  /* Data might be available from the prefetcher */
 
   // Compression data.
   const unsigned char* chead; /* Compression header */
@@ -54,6 +57,7 @@ struct b_ctx {
       max_compress_len; /* Maximum size that will fit into compression buffer */
   comp_stream_header
       ch; /* Compression Stream Header with info about compression used */
+  CompressionBypass* compression_bypass; /* Skips incompressible blocks */
 
   // Encryption data.
   uint32_t cipher_input_len;   /* Actual length of the data to encrypt */
@@ -0,0 +1,425 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * directories with changes, taken from the generations of a btrfs subvolume
+ *
+ * btrfs records in every item of a subvolume the transaction (generation)
+ * that last changed it.  Every backup saves the generation of each
+ * subvolume it looks at, an incremental then searches the subvolume for
+ * the inodes and directory entries of later transactions, like
+ * "btrfs subvolume find-new" does.  A deleted file shows up as a change of
+ * its directory.  The search needs CAP_SYS_ADMIN.
+ */
+
+#include "include/bareos.h"
+#include "include/jcr.h"
+#include "filed/change_sources.h"
+#include "lib/berrno.h"
+
+#if defined(HAVE_LINUX_BTRFS_H)
+#  include <endian.h>
+#  include <fcntl.h>
+#  include <sys/ioctl.h>
+#  include <unistd.h>
+#  include <linux/btrfs.h>
+#  include <linux/btrfs_tree.h>
+
+#  include <unordered_map>
+#  include <unordered_set>
+#endif
+
+namespace filedaemon {
+
+#if defined(HAVE_LINUX_BTRFS_H)
+
+namespace {
+
+struct subvolume {
+  std::string root{}; /**< With a trailing slash */
+  dev_t dev{};
+  uint64_t tree_id{};
+  uint64_t generation{}; /**< At the start of this backup */
+  std::string uuid{};
+  bool changes_read{false};
+  ChangedDirectories changed_dirs{};
+};
+
+class FileDescriptor {
+ public:
+  explicit FileDescriptor(int fd) : fd_{fd} {}
+  FileDescriptor(const FileDescriptor&) = delete;
+  FileDescriptor& operator=(const FileDescriptor&) = delete;
+  ~FileDescriptor()
+  {
+    if (fd_ >= 0) { close(fd_); }
+  }
+  int get() const { return fd_; }
+
+ private:
+  int fd_;
+};
+
+// the top directory of the subvolume the path is on
+std::string SubvolumeRoot(const std::string& path, dev_t dev)
+{
+  std::string root = path;
+  while (root.size() > 1) {
+    if (root.back() == '/') { root.pop_back(); }
+    std::string parent{ParentDirectory(root)};
+    struct stat statp;
+    if (parent.empty() || lstat(parent.c_str(), &statp) != 0
+        || statp.st_dev != dev) {
+      break;
+    }
+    root = parent;
+  }
+  if (root.back() != '/') { root += '/'; }
+  return root;
+}
+
+template <typename T> T Item(const char* data)
+{
+  T item;
+  memcpy(&item, data, sizeof(item));
+  return item;
+}
+
+// the changes of the subvolume since the generation, in inode numbers
+class TreeSearch {
+ public:
+  TreeSearch(int fd, uint64_t tree_id) : fd_{fd}, tree_id_{tree_id} {}
+
+  bool Run(uint64_t since);
+  bool FindParents(uint64_t ino);
+  bool Path(uint64_t ino, std::string& path);
+
+  std::unordered_set<uint64_t> dirs{};     /**< Changed directories */
+  std::unordered_set<uint64_t> subtrees{}; /**< New entries of directories */
+  std::unordered_set<uint64_t> files{};    /**< Other changed inodes */
+  std::unordered_multimap<uint64_t, uint64_t> parents{};
+
+ private:
+  template <typename F>
+  bool Search(btrfs_ioctl_search_key key, F item);
+
+  int fd_;
+  uint64_t tree_id_;
+};
+
+template <typename F>
+bool TreeSearch::Search(btrfs_ioctl_search_key key, F item)
+{
+  constexpr std::size_t buf_size = 256 * 1024;
+  std::vector<uint64_t> storage(
+      (sizeof(btrfs_ioctl_search_args_v2) + buf_size) / sizeof(uint64_t) + 1);
+  auto* args = reinterpret_cast<btrfs_ioctl_search_args_v2*>(storage.data());
+
+  key.tree_id = tree_id_;
+  while (true) {
+    args->key = key;
+    args->key.nr_items = UINT32_MAX;
+    args->buf_size = buf_size;
+    if (ioctl(fd_, BTRFS_IOC_TREE_SEARCH_V2, args) != 0) { return false; }
+    if (args->key.nr_items == 0) { return true; }
+
+    const char* data = reinterpret_cast<const char*>(args->buf);
+    btrfs_ioctl_search_header header{};
+    for (uint32_t i = 0; i < args->key.nr_items; ++i) {
+      header = Item<btrfs_ioctl_search_header>(data);
+      data += sizeof(header);
+      item(header, data);
+      data += header.len;
+    }
+
+    // continue after the last item returned
+    key.min_objectid = header.objectid;
+    key.min_type = header.type;
+    key.min_offset = header.offset;
+    if (key.min_offset < UINT64_MAX) {
+      key.min_offset++;
+    } else if (key.min_type < UINT8_MAX) {
+      key.min_offset = 0;
+      key.min_type++;
+    } else if (key.min_objectid < UINT64_MAX) {
+      key.min_offset = 0;
+      key.min_type = 0;
+      key.min_objectid++;
+    } else {
+      return true;
+    }
+    if (key.min_objectid > key.max_objectid) { return true; }
+  }
+}
+
+bool TreeSearch::Run(uint64_t since)
+{
+  btrfs_ioctl_search_key key{};
+  key.max_objectid = UINT64_MAX;
+  key.max_offset = UINT64_MAX;
+  key.max_type = UINT8_MAX;
+  // leaves written by later transactions, the items in there are checked
+  key.min_transid = since + 1;
+  key.max_transid = UINT64_MAX;
+
+  return Search(key, [this, since](const btrfs_ioctl_search_header& h,
+                                  const char* data) {
+    switch (h.type) {
+      case BTRFS_INODE_ITEM_KEY: {
+        if (h.len < sizeof(btrfs_inode_item)) { break; }
+        auto inode = Item<btrfs_inode_item>(data);
+        if (le64toh(inode.transid) <= since) { break; }
+        if (S_ISDIR(le32toh(inode.mode))) {
+          dirs.insert(h.objectid);
+        } else {
+          files.insert(h.objectid);
+        }
+        break;
+      }
+      case BTRFS_INODE_REF_KEY:
+        parents.emplace(h.objectid, h.offset);
+        break;
+      case BTRFS_DIR_INDEX_KEY: {
+        if (h.len < sizeof(btrfs_dir_item)) { break; }
+        auto entry = Item<btrfs_dir_item>(data);
+        if (le64toh(entry.transid) <= since) { break; }
+        dirs.insert(h.objectid);
+        // a directory that got created or moved here
+        if (entry.type == BTRFS_FT_DIR
+            && entry.location.type == BTRFS_INODE_ITEM_KEY) {
+          subtrees.insert(le64toh(entry.location.objectid));
+        }
+        break;
+      }
+      case BTRFS_EXTENT_DATA_KEY: {
+        if (h.len < sizeof(uint64_t)) { break; }
+        if (le64toh(Item<uint64_t>(data)) > since) { files.insert(h.objectid); }
+        break;
+      }
+      default:
+        break;
+    }
+  });
+}
+
+// the directories of a file whose references were not in changed leaves
+bool TreeSearch::FindParents(uint64_t ino)
+{
+  btrfs_ioctl_search_key key{};
+  key.min_objectid = key.max_objectid = ino;
+  key.min_type = key.max_type = BTRFS_INODE_REF_KEY;
+  key.max_offset = UINT64_MAX;
+  key.max_transid = UINT64_MAX;
+  return Search(key, [this, ino](const btrfs_ioctl_search_header& h,
+                                 const char*) {
+    if (h.objectid == ino && h.type == BTRFS_INODE_REF_KEY) {
+      parents.emplace(h.objectid, h.offset);
+    }
+  });
+}
+
+// the path of a directory relative to the subvolume, with a trailing slash
+bool TreeSearch::Path(uint64_t ino, std::string& path)
+{
+  btrfs_ioctl_ino_lookup_args args{};
+  args.treeid = tree_id_;
+  args.objectid = ino;
+  if (ioctl(fd_, BTRFS_IOC_INO_LOOKUP, &args) != 0) { return false; }
+  path = args.name;
+  return true;
+}
+
+std::string UuidString(const uint8_t* uuid)
+{
+  std::string hex;
+  char buf[3];
+  for (int i = 0; i < BTRFS_UUID_SIZE; ++i) {
+    snprintf(buf, sizeof(buf), "%02x", uuid[i]);
+    hex += buf;
+  }
+  return hex;
+}
+
+class BtrfsChangeSource : public ChangeSource {
+ public:
+  void Open(JobControlRecord* jcr,
+            const std::vector<std::string>& paths,
+            const char* prev_job);
+  bool empty() const { return subvolumes_.empty(); }
+
+  bool Covers(const char*, const struct stat& statp) const override
+  {
+    const subvolume* vol = Find(statp.st_dev);
+    return vol && vol->changes_read;
+  }
+
+  bool MayHaveChanged(const char* dirname,
+                      const struct stat& statp) const override
+  {
+    const subvolume* vol = Find(statp.st_dev);
+    return !vol || !vol->changes_read || vol->changed_dirs.Contains(dirname);
+  }
+
+  void SaveState(JobControlRecord* jcr) override;
+
+ private:
+  const subvolume* Find(dev_t dev) const
+  {
+    for (const subvolume& vol : subvolumes_) {
+      if (vol.dev == dev) { return &vol; }
+    }
+    return nullptr;
+  }
+  bool ReadChanges(JobControlRecord* jcr,
+                   int fd,
+                   subvolume& vol,
+                   uint64_t since);
+
+  std::vector<subvolume> subvolumes_{};
+};
+
+void BtrfsChangeSource::Open(JobControlRecord* jcr,
+                             const std::vector<std::string>& paths,
+                             const char* prev_job)
+{
+  for (const std::string& path : paths) {
+    struct stat statp;
+    mount_entry mount;
+    if (lstat(path.c_str(), &statp) != 0 || Find(statp.st_dev)
+        || !FindMount(statp.st_dev, mount) || mount.fstype != "btrfs") {
+      continue;
+    }
+
+    subvolume vol;
+    vol.dev = statp.st_dev;
+    vol.root = SubvolumeRoot(path, statp.st_dev);
+    FileDescriptor fd{open(vol.root.c_str(), O_RDONLY | O_DIRECTORY)};
+    btrfs_ioctl_get_subvol_info_args info{};
+    if (fd.get() < 0
+        || ioctl(fd.get(), BTRFS_IOC_GET_SUBVOL_INFO, &info) != 0) {
+      BErrNo be;
+      Jmsg(jcr, M_WARNING, 0, T_("Cannot get the subvolume of %s: ERR=%s\n"),
+           vol.root.c_str(), be.bstrerror());
+      continue;
+    }
+    vol.tree_id = info.treeid;
+    vol.generation = info.generation;
+    vol.uuid = UuidString(info.uuid);
+
+    change_state state;
+    unsigned long long since = 0;
+    char uuid[2 * BTRFS_UUID_SIZE + 1]{};
+    if (!*prev_job) {
+      // nothing to read
+    } else if (!ReadChangeState(ChangeStateFile(jcr, "btrfs", vol.uuid), state)
+               || state.job != prev_job
+               || sscanf(state.position.c_str(), "%32s %llu", uuid, &since) != 2
+               || vol.uuid != uuid || since > vol.generation) {
+      Jmsg(jcr, M_INFO, 0,
+           T_("No generation of %s saved by job %s, looking at all files.\n"),
+           vol.root.c_str(), prev_job);
+    } else if (ReadChanges(jcr, fd.get(), vol, since)) {
+      vol.changes_read = true;
+      Jmsg(jcr, M_INFO, 0,
+           T_("Subvolume %s lists changes in %llu directories.\n"),
+           vol.root.c_str(),
+           static_cast<unsigned long long>(vol.changed_dirs.size()));
+    } else {
+      vol.changed_dirs = ChangedDirectories{};
+    }
+    subvolumes_.push_back(std::move(vol));
+  }
+}
+
+bool BtrfsChangeSource::ReadChanges(JobControlRecord* jcr,
+                                    int fd,
+                                    subvolume& vol,
+                                    uint64_t since)
+{
+  TreeSearch search{fd, vol.tree_id};
+  if (!search.Run(since)) {
+    BErrNo be;
+    Jmsg(jcr, M_WARNING, 0, T_("Cannot search subvolume %s: ERR=%s\n"),
+         vol.root.c_str(), be.bstrerror());
+    return false;
+  }
+
+  for (uint64_t ino : search.files) {
+    if (jcr->IsJobCanceled()) { return false; }
+    if (search.parents.count(ino) == 0 && !search.FindParents(ino)) {
+      return false;
+    }
+    auto [first, last] = search.parents.equal_range(ino);
+    for (auto it = first; it != last; ++it) { search.dirs.insert(it->second); }
+  }
+
+  std::string path;
+  for (uint64_t ino : search.dirs) {
+    // directories that got deleted since are not there anymore
+    if (!search.Path(ino, path)) { continue; }
+    vol.changed_dirs.Add(vol.root + path);
+  }
+  for (uint64_t ino : search.subtrees) {
+    if (!search.Path(ino, path)) { continue; }
+    vol.changed_dirs.AddSubtree(vol.root + path);
+  }
+  return true;
+}
+
+void BtrfsChangeSource::SaveState(JobControlRecord* jcr)
+{
+  for (const subvolume& vol : subvolumes_) {
+    WriteChangeState(jcr, ChangeStateFile(jcr, "btrfs", vol.uuid),
+                     vol.uuid + " " + std::to_string(vol.generation));
+  }
+}
+
+}  // namespace
+
+std::unique_ptr<ChangeSource> NewBtrfsChangeSource(
+    JobControlRecord* jcr,
+    const std::vector<std::string>& paths,
+    const char* prev_job)
+{
+  auto source = std::make_unique<BtrfsChangeSource>();
+  source->Open(jcr, paths, prev_job);
+  if (source->empty()) {
+    Jmsg(jcr, M_INFO, 0, T_("No btrfs subvolume in the fileset.\n"));
+    return nullptr;
+  }
+  return source;
+}
+
+#else
+
+std::unique_ptr<ChangeSource> NewBtrfsChangeSource(
+    JobControlRecord* jcr,
+    const std::vector<std::string>&,
+    const char*)
+{
+  Jmsg(jcr, M_WARNING, 0,
+       T_("Change source btrfs is not available on this client.\n"));
+  return nullptr;
+}
+
+#endif
+
+}  // namespace filedaemon
@@ -0,0 +1,487 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * directories with changes, recorded with fanotify while the daemon runs
+ *
+ * The first backup that uses the source starts to watch the filesystems
+ * of its fileset.  From then on a thread records for every directory in
+ * which something happens a sequence number.  The sequence number at the
+ * start of a backup is its position, an incremental can skip the
+ * directories that did not get a higher number since the position of the
+ * job it is based on.  A filesystem is only covered if it was watched
+ * before that position was taken, so a restart of the daemon or an
+ * overflow of the event queue start over.  Needs CAP_SYS_ADMIN and
+ * CAP_DAC_READ_SEARCH.
+ */
+
+#include "include/bareos.h"
+#include "include/jcr.h"
+#include "filed/change_sources.h"
+#include "lib/berrno.h"
+
+#if defined(HAVE_SYS_FANOTIFY_H)
+#  include <fcntl.h>
+#  include <poll.h>
+#  include <sys/fanotify.h>
+#  include <sys/statfs.h>
+#  include <unistd.h>
+
+#  include <algorithm>
+#  include <climits>
+#  include <cstring>
+#  include <mutex>
+#  include <thread>
+#  include <unordered_map>
+#endif
+
+namespace filedaemon {
+
+#if defined(HAVE_SYS_FANOTIFY_H)
+
+namespace {
+
+constexpr uint64_t fanotify_mask = FAN_MODIFY | FAN_ATTRIB | FAN_CREATE
+                                   | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO
+                                   | FAN_ONDIR;
+
+// above this many directories the log starts over
+constexpr std::size_t max_directories = 1000000;
+
+struct log_position {
+  std::string instance{};
+  uint64_t seq{};
+};
+
+class FanotifyChangeLog {
+ public:
+  ~FanotifyChangeLog() { Stop(); }
+
+  bool Start(JobControlRecord* jcr);
+  void Stop();
+
+  // starts to watch the filesystem the path is on
+  bool Watch(JobControlRecord* jcr, const std::string& path, dev_t dev);
+
+  log_position Position();
+  bool Covers(dev_t dev, const log_position& since);
+  void ChangesSince(const log_position& since, ChangedDirectories& changed);
+
+ private:
+  struct filesystem {
+    dev_t dev{};
+    int mount_fd{-1};
+    __kernel_fsid_t fsid{};
+    uint64_t since{}; /**< Sequence number when the watch started */
+  };
+
+  void Run();
+  void Read();
+  void Event(const fanotify_event_metadata& event, const char* end);
+  bool ResolveHandle(const __kernel_fsid_t& fsid,
+                     file_handle* handle,
+                     std::string& path);
+  void Reset();
+  void Record(std::unordered_map<std::string, uint64_t>& dirs,
+              std::string dirname);
+
+  std::mutex mutex_{};
+  int fd_{-1};
+  int stop_pipe_[2]{-1, -1};
+  std::thread thread_{};
+
+  std::string instance_{};
+  uint64_t seq_{};
+  std::vector<filesystem> filesystems_{};
+  std::unordered_map<std::string, uint64_t> changed_{};
+  std::unordered_map<std::string, uint64_t> subtrees_{};
+  std::unordered_map<std::string, std::string> handle_cache_{};
+};
+
+std::mutex change_log_mutex;
+std::unique_ptr<FanotifyChangeLog> change_log;
+
+bool FanotifyChangeLog::Start(JobControlRecord* jcr)
+{
+  fd_ = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_NONBLOCK
+                          | FAN_CLOEXEC,
+                      O_RDONLY | O_LARGEFILE);
+  if (fd_ < 0) {
+    BErrNo be;
+    Jmsg(jcr, M_WARNING, 0, T_("Cannot start fanotify: ERR=%s\n"),
+         be.bstrerror());
+    return false;
+  }
+  if (pipe(stop_pipe_) != 0) {
+    BErrNo be;
+    Jmsg(jcr, M_WARNING, 0, T_("Cannot create pipe: ERR=%s\n"),
+         be.bstrerror());
+    close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  Reset();
+  thread_ = std::thread([this]() { Run(); });
+  return true;
+}
+
+void FanotifyChangeLog::Stop()
+{
+  if (thread_.joinable()) {
+    char c = 0;
+    if (write(stop_pipe_[1], &c, 1) != 1) {
+      Dmsg0(100, "Cannot stop the fanotify thread\n");
+    }
+    thread_.join();
+  }
+  for (filesystem& fs : filesystems_) { close(fs.mount_fd); }
+  filesystems_.clear();
+  for (int* fd : {&fd_, &stop_pipe_[0], &stop_pipe_[1]}) {
+    if (*fd >= 0) { close(*fd); }
+    *fd = -1;
+  }
+}
+
+bool FanotifyChangeLog::Watch(JobControlRecord* jcr,
+                              const std::string& path,
+                              dev_t dev)
+{
+  std::lock_guard lock{mutex_};
+  for (const filesystem& fs : filesystems_) {
+    if (fs.dev == dev) { return true; }
+  }
+
+  mount_entry mount;
+  if (!FindMount(dev, mount)) { mount.mount_point = path; }
+  filesystem fs;
+  fs.dev = dev;
+  fs.mount_fd = open(mount.mount_point.c_str(), O_RDONLY | O_DIRECTORY);
+  struct statfs stats;
+  if (fs.mount_fd < 0 || fstatfs(fs.mount_fd, &stats) != 0
+      || fanotify_mark(fd_, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, fanotify_mask,
+                       fs.mount_fd, nullptr)
+             != 0) {
+    BErrNo be;
+    Jmsg(jcr, M_WARNING, 0, T_("Cannot watch %s with fanotify: ERR=%s\n"),
+         mount.mount_point.c_str(), be.bstrerror());
+    if (fs.mount_fd >= 0) { close(fs.mount_fd); }
+    return false;
+  }
+  memcpy(&fs.fsid, &stats.f_fsid, sizeof(fs.fsid));
+  fs.since = seq_;
+  filesystems_.push_back(fs);
+  Jmsg(jcr, M_INFO, 0, T_("Watching %s for changes.\n"),
+       mount.mount_point.c_str());
+  return true;
+}
+
+log_position FanotifyChangeLog::Position()
+{
+  std::lock_guard lock{mutex_};
+  // the events that are queued already happened before
+  Read();
+  return log_position{instance_, seq_};
+}
+
+bool FanotifyChangeLog::Covers(dev_t dev, const log_position& since)
+{
+  std::lock_guard lock{mutex_};
+  if (since.instance != instance_ || since.seq > seq_) { return false; }
+  for (const filesystem& fs : filesystems_) {
+    if (fs.dev == dev) { return fs.since <= since.seq; }
+  }
+  return false;
+}
+
+void FanotifyChangeLog::ChangesSince(const log_position& since,
+                                     ChangedDirectories& changed)
+{
+  std::lock_guard lock{mutex_};
+  for (const auto& [dirname, seq] : changed_) {
+    if (seq > since.seq) { changed.Add(dirname); }
+  }
+  for (const auto& [dirname, seq] : subtrees_) {
+    if (seq > since.seq) { changed.AddSubtree(dirname); }
+  }
+}
+
+void FanotifyChangeLog::Run()
+{
+  pollfd fds[2] = {{fd_, POLLIN, 0}, {stop_pipe_[0], POLLIN, 0}};
+  while (true) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) { continue; }
+      break;
+    }
+    if (fds[1].revents) { break; }
+    if (fds[0].revents & POLLIN) {
+      std::lock_guard lock{mutex_};
+      Read();
+    }
+  }
+}
+
+// handles the queued events, with the mutex taken
+void FanotifyChangeLog::Read()
+{
+  alignas(fanotify_event_metadata) char buf[64 * 1024];
+  while (true) {
+    ssize_t length = read(fd_, buf, sizeof(buf));
+    if (length <= 0) { return; }
+
+    auto* event = reinterpret_cast<fanotify_event_metadata*>(buf);
+    for (; FAN_EVENT_OK(event, length); event = FAN_EVENT_NEXT(event, length)) {
+      if (event->vers != FANOTIFY_METADATA_VERSION) { continue; }
+      if (event->mask & FAN_Q_OVERFLOW) {
+        Dmsg0(100, "fanotify queue overflow, starting over\n");
+        Reset();
+        continue;
+      }
+      Event(*event, reinterpret_cast<const char*>(event) + event->event_len);
+    }
+  }
+}
+
+void FanotifyChangeLog::Event(const fanotify_event_metadata& event,
+                              const char* end)
+{
+  const char* info = reinterpret_cast<const char*>(&event) + event.metadata_len;
+  while (info + sizeof(fanotify_event_info_header) <= end) {
+    auto* fid = reinterpret_cast<const fanotify_event_info_fid*>(info);
+    if (fid->hdr.len == 0) { return; }
+    info += fid->hdr.len;
+    if (fid->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME
+        && fid->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID) {
+      continue;
+    }
+
+    auto* handle = reinterpret_cast<file_handle*>(
+        const_cast<unsigned char*>(fid->handle));
+    std::string dirname;
+    if (!ResolveHandle(fid->fsid, handle, dirname)) { continue; }
+    Record(changed_, dirname);
+
+    if (fid->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME
+        || !(event.mask & FAN_ONDIR)) {
+      continue;
+    }
+    const char* name = reinterpret_cast<const char*>(handle->f_handle)
+                       + handle->handle_bytes;
+    if (!*name || strcmp(name, ".") == 0) { continue; }
+
+    // cached names below a directory that moved are wrong now
+    if (event.mask & (FAN_MOVED_FROM | FAN_MOVED_TO)) { handle_cache_.clear(); }
+    std::string subdir = dirname + name + '/';
+    if (event.mask & (FAN_CREATE | FAN_MOVED_TO)) {
+      Record(subtrees_, subdir);
+    } else if (!(event.mask & (FAN_DELETE | FAN_MOVED_FROM))) {
+      Record(changed_, subdir);
+    }
+  }
+}
+
+bool FanotifyChangeLog::ResolveHandle(const __kernel_fsid_t& fsid,
+                                      file_handle* handle,
+                                      std::string& path)
+{
+  std::string key(reinterpret_cast<const char*>(handle),
+                  sizeof(file_handle) + handle->handle_bytes);
+  key.append(reinterpret_cast<const char*>(&fsid), sizeof(fsid));
+  if (auto cached = handle_cache_.find(key); cached != handle_cache_.end()) {
+    path = cached->second;
+    return true;
+  }
+
+  auto fs = std::find_if(
+      filesystems_.begin(), filesystems_.end(), [&fsid](const filesystem& f) {
+        return memcmp(&f.fsid, &fsid, sizeof(fsid)) == 0;
+      });
+  if (fs == filesystems_.end()) { return false; }
+
+  // directories that got deleted since cannot be opened anymore
+  int fd = open_by_handle_at(fs->mount_fd, handle, O_PATH);
+  if (fd < 0) { return false; }
+  char link[64];
+  snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+  char target[PATH_MAX + 1];
+  ssize_t length = readlink(link, target, sizeof(target) - 1);
+  close(fd);
+  if (length <= 0) { return false; }
+
+  path.assign(target, length);
+  if (path.back() != '/') { path += '/'; }
+  if (handle_cache_.size() > 10000) { handle_cache_.clear(); }
+  handle_cache_.emplace(std::move(key), path);
+  return true;
+}
+
+void FanotifyChangeLog::Record(std::unordered_map<std::string, uint64_t>& dirs,
+                               std::string dirname)
+{
+  dirs[std::move(dirname)] = ++seq_;
+  if (changed_.size() + subtrees_.size() > max_directories) {
+    Dmsg0(100, "fanotify log too large, starting over\n");
+    Reset();
+  }
+}
+
+// forgets all changes, positions taken before do not cover anything anymore
+void FanotifyChangeLog::Reset()
+{
+  char instance[64];
+  snprintf(instance, sizeof(instance), "%d-%lld-%llu", (int)getpid(),
+           (long long)time(nullptr), (unsigned long long)seq_);
+  instance_ = instance;
+  changed_.clear();
+  subtrees_.clear();
+  handle_cache_.clear();
+  for (filesystem& fs : filesystems_) { fs.since = seq_; }
+}
+
+class FanotifyChangeSource : public ChangeSource {
+ public:
+  explicit FanotifyChangeSource(FanotifyChangeLog* log)
+      : log_{log}, position_{log->Position()}
+  {
+  }
+
+  void ReadChanges(JobControlRecord* jcr,
+                   const std::vector<dev_t>& devs,
+                   const char* prev_job);
+
+  bool Covers(const char*, const struct stat& statp) const override
+  {
+    return std::find(covered_.begin(), covered_.end(), statp.st_dev)
+           != covered_.end();
+  }
+
+  bool MayHaveChanged(const char* dirname,
+                      const struct stat& statp) const override
+  {
+    return !Covers(dirname, statp) || changed_dirs_.Contains(dirname);
+  }
+
+  void SaveState(JobControlRecord* jcr) override
+  {
+    WriteChangeState(jcr, ChangeStateFile(jcr, "fanotify", "log"),
+                     position_.instance + " " + std::to_string(position_.seq));
+  }
+
+ private:
+  FanotifyChangeLog* log_;
+  log_position position_; /**< Of this backup */
+  log_position since_;    /**< Of the job it is based on */
+  std::vector<dev_t> covered_{};
+  ChangedDirectories changed_dirs_{};
+};
+
+void FanotifyChangeSource::ReadChanges(JobControlRecord* jcr,
+                                       const std::vector<dev_t>& devs,
+                                       const char* prev_job)
+{
+  if (!*prev_job) { return; }
+
+  change_state state;
+  char instance[64]{};
+  unsigned long long seq = 0;
+  if (!ReadChangeState(ChangeStateFile(jcr, "fanotify", "log"), state)
+      || state.job != prev_job
+      || sscanf(state.position.c_str(), "%63s %llu", instance, &seq) != 2) {
+    Jmsg(jcr, M_INFO, 0,
+         T_("No fanotify position saved by job %s, looking at all files.\n"),
+         prev_job);
+    return;
+  }
+  since_ = log_position{instance, seq};
+
+  for (dev_t dev : devs) {
+    if (log_->Covers(dev, since_)) { covered_.push_back(dev); }
+  }
+  if (covered_.size() < devs.size()) {
+    Jmsg(jcr, M_INFO, 0,
+         T_("fanotify did not watch all filesystems since job %s, looking at "
+            "their files.\n"),
+         prev_job);
+  }
+  if (covered_.empty()) { return; }
+
+  log_->ChangesSince(since_, changed_dirs_);
+  Jmsg(jcr, M_INFO, 0, T_("fanotify lists changes in %llu directories.\n"),
+       static_cast<unsigned long long>(changed_dirs_.size()));
+}
+
+}  // namespace
+
+std::unique_ptr<ChangeSource> NewFanotifyChangeSource(
+    JobControlRecord* jcr,
+    const std::vector<std::string>& paths,
+    const char* prev_job)
+{
+  FanotifyChangeLog* log;
+  {
+    std::lock_guard lock{change_log_mutex};
+    if (!change_log) {
+      auto new_log = std::make_unique<FanotifyChangeLog>();
+      if (!new_log->Start(jcr)) { return nullptr; }
+      change_log = std::move(new_log);
+    }
+    log = change_log.get();
+  }
+
+  std::vector<dev_t> devs;
+  for (const std::string& path : paths) {
+    struct stat statp;
+    if (lstat(path.c_str(), &statp) != 0
+        || std::find(devs.begin(), devs.end(), statp.st_dev) != devs.end()) {
+      continue;
+    }
+    if (log->Watch(jcr, path, statp.st_dev)) { devs.push_back(statp.st_dev); }
+  }
+  if (devs.empty()) { return nullptr; }
+
+  auto source = std::make_unique<FanotifyChangeSource>(log);
+  source->ReadChanges(jcr, devs, prev_job);
+  return source;
+}
+
+void StopFanotifyChangeLog()
+{
+  std::lock_guard lock{change_log_mutex};
+  change_log.reset();
+}
+
+#else
+
+std::unique_ptr<ChangeSource> NewFanotifyChangeSource(
+    JobControlRecord* jcr,
+    const std::vector<std::string>&,
+    const char*)
+{
+  Jmsg(jcr, M_WARNING, 0,
+       T_("Change source fanotify is not available on this client.\n"));
+  return nullptr;
+}
+
+void StopFanotifyChangeLog() {}
+
+#endif
+
+}  // namespace filedaemon
@@ -0,0 +1,256 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * directories with changes, taken from the difference of two zfs snapshots
+ *
+ * Every backup takes a snapshot named after the job of each dataset it
+ * looks at.  An incremental lets "zfs diff" list what changed between the
+ * snapshot of the job it is based on and its own one.  Once a backup
+ * terminated its snapshot is kept for the next one and the previous one
+ * gets destroyed, so there is a single snapshot per dataset and job.
+ */
+
+#include "include/bareos.h"
+#include "include/jcr.h"
+#include "filed/change_sources.h"
+#include "lib/berrno.h"
+#include "lib/bpipe.h"
+
+#include <cctype>
+
+namespace filedaemon {
+
+namespace {
+
+constexpr const char* snapshot_prefix = "@bareos-";
+
+struct dataset {
+  std::string name{};
+  dev_t dev{};
+  std::string snapshot{};      /**< Taken by this backup */
+  std::string prev_snapshot{}; /**< Taken by the job it is based on */
+  bool changes_read{false};
+  ChangedDirectories changed_dirs{};
+};
+
+// runs a zfs command, calling line() for every line of its output
+template <typename F>
+bool RunZfs(JobControlRecord* jcr, const std::string& args, F line)
+{
+  std::string cmd = "zfs " + args;
+  Bpipe* bpipe = OpenBpipe(cmd.c_str(), 0, "r", false);
+  if (!bpipe) {
+    BErrNo be;
+    Jmsg(jcr, M_WARNING, 0, T_("Cannot run %s: ERR=%s\n"), cmd.c_str(),
+         be.bstrerror());
+    return false;
+  }
+  char* buf = nullptr;
+  size_t size = 0;
+  ssize_t length;
+  while ((length = getline(&buf, &size, bpipe->rfd)) > 0) {
+    if (buf[length - 1] == '\n') { buf[length - 1] = '\0'; }
+    line(buf);
+  }
+  free(buf);
+  if (int status = CloseBpipe(bpipe); status != 0) {
+    BErrNo be;
+    Jmsg(jcr, M_WARNING, 0, T_("%s failed: ERR=%s\n"), cmd.c_str(),
+         be.bstrerror(status));
+    return false;
+  }
+  return true;
+}
+
+// zfs diff writes unusual characters as \0ooo
+std::string Unescape(std::string_view path)
+{
+  std::string out;
+  for (std::size_t i = 0; i < path.size(); ++i) {
+    if (path[i] == '\\' && i + 4 < path.size() && path[i + 1] >= '0'
+        && path[i + 1] <= '3' && isdigit(path[i + 2]) && isdigit(path[i + 3])
+        && isdigit(path[i + 4])) {
+      out += static_cast<char>((path[i + 2] - '0') * 64
+                               + (path[i + 3] - '0') * 8 + path[i + 4] - '0');
+      i += 4;
+    } else {
+      out += path[i];
+    }
+  }
+  return out;
+}
+
+/* A line looks like "M\t/\t/tank/dir", or for renamed files
+ * "R\tF\t/tank/old\t/tank/new".  The type is / for directories. */
+void AddChange(ChangedDirectories& changed, std::string_view line)
+{
+  std::vector<std::string_view> fields;
+  while (true) {
+    std::size_t tab = line.find('\t');
+    fields.push_back(line.substr(0, tab));
+    if (tab == std::string_view::npos) { break; }
+    line.remove_prefix(tab + 1);
+  }
+  if (fields.size() < 3 || fields[0].size() != 1) { return; }
+
+  char change = fields[0][0];
+  bool is_dir = fields[1] == "/";
+  std::string path = Unescape(fields[2]);
+  changed.Add(ParentDirectory(path));
+  if (is_dir && (change == '+' || change == 'M')) { changed.Add(path + '/'); }
+  if (change == 'R' && fields.size() > 3) {
+    std::string new_path = Unescape(fields[3]);
+    changed.Add(ParentDirectory(new_path));
+    if (is_dir) { changed.AddSubtree(new_path + '/'); }
+  }
+}
+
+class ZfsChangeSource : public ChangeSource {
+ public:
+  explicit ZfsChangeSource(JobControlRecord* jcr) : jcr_{jcr} {}
+  ~ZfsChangeSource() override
+  {
+    // a backup that failed leaves the snapshot of the previous one in place
+    if (saved_) { return; }
+    for (const dataset& ds : datasets_) {
+      RunZfs(nullptr, "destroy \"" + ds.snapshot + "\"", [](const char*) {});
+    }
+  }
+
+  void Open(const std::vector<std::string>& paths, const char* prev_job);
+  bool empty() const { return datasets_.empty(); }
+
+  bool Covers(const char*, const struct stat& statp) const override
+  {
+    const dataset* ds = Find(statp.st_dev);
+    return ds && ds->changes_read;
+  }
+
+  bool MayHaveChanged(const char* dirname,
+                      const struct stat& statp) const override
+  {
+    const dataset* ds = Find(statp.st_dev);
+    return !ds || !ds->changes_read || ds->changed_dirs.Contains(dirname);
+  }
+
+  void SaveState(JobControlRecord* jcr) override;
+
+ private:
+  const dataset* Find(dev_t dev) const
+  {
+    for (const dataset& ds : datasets_) {
+      if (ds.dev == dev) { return &ds; }
+    }
+    return nullptr;
+  }
+
+  JobControlRecord* jcr_;
+  std::vector<dataset> datasets_{};
+  bool saved_{false};
+};
+
+void ZfsChangeSource::Open(const std::vector<std::string>& paths,
+                           const char* prev_job)
+{
+  std::string snapshot_name = snapshot_prefix;
+  for (const char* p = jcr_->Job; *p; ++p) {
+    snapshot_name += (isalnum(static_cast<unsigned char>(*p)) || *p == '-'
+                      || *p == '_' || *p == '.' || *p == ':')
+                         ? *p
+                         : '_';
+  }
+
+  for (const std::string& path : paths) {
+    struct stat statp;
+    mount_entry mount;
+    if (lstat(path.c_str(), &statp) != 0 || Find(statp.st_dev)
+        || !FindMount(statp.st_dev, mount) || mount.fstype != "zfs") {
+      continue;
+    }
+
+    dataset ds;
+    ds.name = mount.source;
+    ds.dev = statp.st_dev;
+    ds.snapshot = ds.name + snapshot_name;
+    if (!RunZfs(jcr_, "snapshot \"" + ds.snapshot + "\"", [](const char*) {})) {
+      continue;
+    }
+
+    change_state state;
+    if (*prev_job
+        && ReadChangeState(ChangeStateFile(jcr_, "zfs", ds.name), state)
+        && state.job == prev_job) {
+      ds.prev_snapshot = state.position;
+      ds.changes_read = RunZfs(
+          jcr_, "diff -FH \"" + ds.prev_snapshot + "\" \"" + ds.snapshot + "\"",
+          [&ds](const char* line) { AddChange(ds.changed_dirs, line); });
+      if (ds.changes_read) {
+        Jmsg(jcr_, M_INFO, 0,
+             T_("zfs diff of %s lists changes in %llu directories.\n"),
+             ds.name.c_str(),
+             static_cast<unsigned long long>(ds.changed_dirs.size()));
+      } else {
+        ds.changed_dirs = ChangedDirectories{};
+      }
+    } else if (*prev_job) {
+      Jmsg(jcr_, M_INFO, 0,
+           T_("No snapshot of %s taken by job %s, looking at all files.\n"),
+           ds.name.c_str(), prev_job);
+    }
+    datasets_.push_back(std::move(ds));
+  }
+}
+
+void ZfsChangeSource::SaveState(JobControlRecord* jcr)
+{
+  for (const dataset& ds : datasets_) {
+    std::string state_file = ChangeStateFile(jcr, "zfs", ds.name);
+    change_state state;
+    bool had_state = ReadChangeState(state_file, state);
+    WriteChangeState(jcr, state_file, ds.snapshot);
+
+    // only ever destroy snapshots this source took
+    if (had_state && state.position != ds.snapshot
+        && state.position.rfind(ds.name + snapshot_prefix, 0) == 0) {
+      RunZfs(jcr, "destroy \"" + state.position + "\"", [](const char*) {});
+    }
+  }
+  saved_ = true;
+}
+
+}  // namespace
+
+std::unique_ptr<ChangeSource> NewZfsChangeSource(
+    JobControlRecord* jcr,
+    const std::vector<std::string>& paths,
+    const char* prev_job)
+{
+  auto source = std::make_unique<ZfsChangeSource>(jcr);
+  source->Open(paths, prev_job);
+  if (source->empty()) {
+    Jmsg(jcr, M_INFO, 0, T_("No zfs dataset in the fileset.\n"));
+    return nullptr;
+  }
+  return source;
+}
+
+}  // namespace filedaemon
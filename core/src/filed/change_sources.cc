@@ -0,0 +1,259 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * the change sources (ChangeSource directive) of a backup
+ */
+
+#include "include/bareos.h"
+#include "include/jcr.h"
+#include "filed/filed.h"
+#include "filed/filed_globals.h"
+#include "filed/filed_jcr_impl.h"
+#include "filed/change_sources.h"
+#include "findlib/find.h"
+#include "lib/berrno.h"
+#include "lib/dlist_string.h"
+
+#if defined(HAVE_WIN32)
+#  include "win32/findlib/win32.h"
+#  include "win32/filed/change_journal.h"
+#endif
+
+#if defined(HAVE_LINUX_OS)
+#  include <sys/sysmacros.h>
+#endif
+
+#include <cctype>
+
+namespace filedaemon {
+
+// the top level names of the fileset
+static std::vector<std::string> IncludedPaths(findFILESET* fileset)
+{
+  std::vector<std::string> paths;
+  if (!fileset) { return paths; }
+  for (int i = 0; i < fileset->include_list.size(); i++) {
+    findIncludeExcludeItem* incexe
+        = (findIncludeExcludeItem*)fileset->include_list.get(i);
+    dlistString* node;
+    foreach_dlist (node, &incexe->name_list) {
+      paths.emplace_back(node->c_str());
+    }
+  }
+  return paths;
+}
+
+void SetupChangeSources(JobControlRecord* jcr)
+{
+  if (!me->change_sources) { return; }
+
+  FindFilesPacket* ff = jcr->fd_impl->ff;
+  const char* prev_job = jcr->fd_impl->incremental ? jcr->fd_impl->PrevJob : "";
+  std::vector<std::string> paths = IncludedPaths(ff->fileset);
+
+  auto sources = std::make_unique<ChangeSources>();
+  for (const char* name : me->change_sources) {
+    std::unique_ptr<ChangeSource> source;
+#if defined(HAVE_WIN32)
+    if (Bstrcasecmp(name, "usn")) {
+      source = NewUsnChangeSource(jcr, get_win32_volumes(ff->fileset),
+                                  prev_job);
+    }
+#else
+    if (Bstrcasecmp(name, "zfs")) {
+      source = NewZfsChangeSource(jcr, paths, prev_job);
+    } else if (Bstrcasecmp(name, "btrfs")) {
+      source = NewBtrfsChangeSource(jcr, paths, prev_job);
+    } else if (Bstrcasecmp(name, "fanotify")) {
+      source = NewFanotifyChangeSource(jcr, paths, prev_job);
+    }
+#endif
+    else {
+      Jmsg(jcr, M_WARNING, 0,
+           T_("Change source %s is not available on this client.\n"), name);
+    }
+    if (source) { sources->Add(std::move(source)); }
+  }
+
+  if (sources->empty()) { return; }
+  jcr->fd_impl->change_sources = std::move(sources);
+  ff->change_sources = jcr->fd_impl->change_sources.get();
+}
+
+void SaveChangeSources(JobControlRecord* jcr)
+{
+  if (jcr->fd_impl->change_sources) {
+    jcr->fd_impl->change_sources->SaveState(jcr);
+  }
+}
+
+bool InSkippedDirectory(JobControlRecord* jcr, const char* fname)
+{
+  return jcr->fd_impl->change_sources
+         && jcr->fd_impl->change_sources->InSkippedDirectory(fname);
+}
+
+std::string_view JobResourceName(const char* job)
+{
+  std::string_view name{job};
+  constexpr std::size_t suffix_length = sizeof(".2024-01-01_00.00.00_00") - 1;
+  if (name.size() > suffix_length
+      && name[name.size() - suffix_length] == '.') {
+    name.remove_suffix(suffix_length);
+  }
+  return name;
+}
+
+std::string ChangeStateFile(JobControlRecord* jcr,
+                            std::string_view source,
+                            std::string_view key)
+{
+  std::string name = me->working_directory;
+  name += '/';
+  name += me->resource_name_;
+  name += '.';
+  name += JobResourceName(jcr->Job);
+  name += '.';
+  name += source;
+  name += '.';
+  for (char c : key) {
+    name += (isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_')
+                ? c
+                : '_';
+  }
+  name += ".state";
+  return name;
+}
+
+static bool ReadLine(FILE* fp, std::string& line)
+{
+  char buf[1024];
+  if (!fgets(buf, sizeof(buf), fp)) { return false; }
+  line = buf;
+  while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) {
+    line.pop_back();
+  }
+  return true;
+}
+
+bool ReadChangeState(const std::string& fname, change_state& state)
+{
+  FILE* fp = fopen(fname.c_str(), "r");
+  if (!fp) { return false; }
+  bool ok = ReadLine(fp, state.job) && ReadLine(fp, state.position);
+  fclose(fp);
+  return ok;
+}
+
+void WriteChangeState(JobControlRecord* jcr,
+                      const std::string& fname,
+                      const std::string& position)
+{
+  FILE* fp = fopen(fname.c_str(), "w");
+  if (!fp) {
+    BErrNo be;
+    Jmsg(jcr, M_WARNING, 0, T_("Cannot create %s: ERR=%s\n"), fname.c_str(),
+         be.bstrerror());
+    return;
+  }
+  fprintf(fp, "%s\n%s\n", jcr->Job, position.c_str());
+  if (fclose(fp) != 0) {
+    BErrNo be;
+    Jmsg(jcr, M_WARNING, 0, T_("Cannot write %s: ERR=%s\n"), fname.c_str(),
+         be.bstrerror());
+  }
+}
+
+#if defined(HAVE_LINUX_OS)
+// mountinfo escapes blanks, tabs, newlines and backslashes as \ooo
+static std::string Unescape(std::string_view field)
+{
+  std::string out;
+  for (std::size_t i = 0; i < field.size(); ++i) {
+    if (field[i] == '\\' && i + 3 < field.size() + 0 && isdigit(field[i + 1])
+        && isdigit(field[i + 2]) && isdigit(field[i + 3])) {
+      out += static_cast<char>((field[i + 1] - '0') * 64
+                               + (field[i + 2] - '0') * 8 + field[i + 3] - '0');
+      i += 3;
+    } else {
+      out += field[i];
+    }
+  }
+  return out;
+}
+
+bool FindMount(dev_t dev, mount_entry& mount)
+{
+  FILE* fp = fopen("/proc/self/mountinfo", "r");
+  if (!fp) { return false; }
+
+  bool found = false;
+  char* line = nullptr;
+  size_t size = 0;
+  while (getline(&line, &size, fp) > 0) {
+    /* 36 35 98:0 /mnt1 /mnt/parent rw,noatime master:1 - ext3 /dev/root rw
+     * with any number of optional fields before the dash */
+    std::vector<std::string_view> fields;
+    std::string_view rest{line};
+    while (!rest.empty()) {
+      std::size_t end = rest.find_first_of(" \n");
+      if (end != 0) { fields.push_back(rest.substr(0, end)); }
+      if (end == std::string_view::npos) { break; }
+      rest.remove_prefix(end + 1);
+    }
+    if (fields.size() < 10) { continue; }
+
+    unsigned int major = 0, minor = 0;
+    if (sscanf(std::string{fields[2]}.c_str(), "%u:%u", &major, &minor) != 2
+        || makedev(major, minor) != dev) {
+      continue;
+    }
+    std::size_t dash = 6;
+    while (dash < fields.size() && fields[dash] != "-") { ++dash; }
+    if (dash + 2 >= fields.size()) { continue; }
+
+    // bind mounts share the device, the mount of the root is the one
+    if (found && fields[3] != "/") { continue; }
+    mount.dev = dev;
+    mount.mount_point = Unescape(fields[4]);
+    if (mount.mount_point.back() != '/') { mount.mount_point += '/'; }
+    mount.fstype = Unescape(fields[dash + 1]);
+    mount.source = Unescape(fields[dash + 2]);
+    found = true;
+  }
+  free(line);
+  fclose(fp);
+  return found;
+}
+#else
+bool FindMount(dev_t, mount_entry&) { return false; }
+#endif
+
+std::string_view ParentDirectory(std::string_view path)
+{
+  if (!path.empty() && path.back() == '/') { path.remove_suffix(1); }
+  std::size_t slash = path.rfind('/');
+  if (slash == std::string_view::npos) { return std::string_view{}; }
+  return path.substr(0, slash + 1);
+}
+
+}  // namespace filedaemon
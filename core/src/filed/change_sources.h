@@ -0,0 +1,100 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * the change sources (ChangeSource directive) of a backup
+ */
+
+#ifndef BAREOS_FILED_CHANGE_SOURCES_H_
+#define BAREOS_FILED_CHANGE_SOURCES_H_
+
+#include "findlib/change_source.h"
+
+#include <sys/types.h>
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class JobControlRecord;
+
+namespace filedaemon {
+
+/* Creates the change sources configured for the client before a backup
+ * starts to look at files.  They take their positions now and, for
+ * incrementals and differentials, read what changed since the positions
+ * saved by the job the backup is based on. */
+void SetupChangeSources(JobControlRecord* jcr);
+
+// keeps the positions for the next backup, once this one terminated ok
+void SaveChangeSources(JobControlRecord* jcr);
+
+// whether the scan of the running backup skipped the directory of the file
+bool InSkippedDirectory(JobControlRecord* jcr, const char* fname);
+
+void StopFanotifyChangeLog();
+
+// the name of the job resource, without the date and time of the run
+std::string_view JobResourceName(const char* job);
+
+/* The positions are kept in the working directory, one file per job
+ * resource, source and key. */
+struct change_state {
+  std::string job{};      /**< Job that saved the position */
+  std::string position{}; /**< Source specific */
+};
+std::string ChangeStateFile(JobControlRecord* jcr,
+                            std::string_view source,
+                            std::string_view key);
+bool ReadChangeState(const std::string& fname, change_state& state);
+void WriteChangeState(JobControlRecord* jcr,
+                      const std::string& fname,
+                      const std::string& position);
+
+// the mounted filesystem a file on device dev is on
+struct mount_entry {
+  dev_t dev{};
+  std::string source{};      /**< Device, or the dataset on zfs */
+  std::string mount_point{}; /**< With a trailing slash */
+  std::string fstype{};
+};
+bool FindMount(dev_t dev, mount_entry& mount);
+
+// the parent directory of a path (with a trailing slash)
+std::string_view ParentDirectory(std::string_view path);
+
+std::unique_ptr<ChangeSource> NewZfsChangeSource(
+    JobControlRecord* jcr,
+    const std::vector<std::string>& paths,
+    const char* prev_job);
+std::unique_ptr<ChangeSource> NewBtrfsChangeSource(
+    JobControlRecord* jcr,
+    const std::vector<std::string>& paths,
+    const char* prev_job);
+std::unique_ptr<ChangeSource> NewFanotifyChangeSource(
+    JobControlRecord* jcr,
+    const std::vector<std::string>& paths,
+    const char* prev_job);
+
+}  // namespace filedaemon
+
+#endif  // BAREOS_FILED_CHANGE_SOURCES_H_
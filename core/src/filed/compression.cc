@@ -30,15 +30,25 @@
  */
 
 #include "include/bareos.h"
+#include "include/filetypes.h"
 #include "filed/filed.h"
 #include "filed/filed_globals.h"
 #include "filed/filed_jcr_impl.h"
+#include "filed/backup.h"
+#include "filed/change_sources.h"
+#include "filed/compression.h"
+#include "lib/berrno.h"
 #include "lib/compression.h"
+#include "lib/edit.h"
 
 #if defined(HAVE_LIBZ)
 #  include <zlib.h>
 #endif
 
+#if defined(HAVE_ZSTD)
+#  include <zstd.h>
+#endif
+
 #include "fastlz/fastlzlib.h"
 
 namespace filedaemon {
@@ -183,6 +193,36 @@ bool SetupCompressionContext(b_ctx& bctx)
         bctx.ch.level = bctx.ff_pkt->Compress_level;
         break;
       }
+#if defined(HAVE_ZSTD)
+      case COMPRESS_ZSTD: {
+        // Set zstd compression level - must be done per file
+        if (size_t zstat = ZSTD_CCtx_setParameter(
+                (ZSTD_CCtx*)bctx.jcr->compress.workset.pZSTD,
+                ZSTD_c_compressionLevel, bctx.ff_pkt->Compress_level);
+            ZSTD_isError(zstat)) {
+          Jmsg(bctx.jcr, M_FATAL, 0,
+               T_("Compression ZSTD_CCtx_setParameter error: %s\n"),
+               ZSTD_getErrorName(zstat));
+          bctx.jcr->setJobStatusWithPriorityCheck(JS_ErrorTerminated);
+          goto bail_out;
+        }
+        const auto& dictionary = bctx.jcr->compress.dictionary;
+        if (size_t zstat = ZSTD_CCtx_refCDict(
+                (ZSTD_CCtx*)bctx.jcr->compress.workset.pZSTD,
+                dictionary
+                    ? dictionary->ForCompression(bctx.ff_pkt->Compress_level)
+                    : nullptr);
+            ZSTD_isError(zstat)) {
+          Jmsg(bctx.jcr, M_FATAL, 0,
+               T_("Compression ZSTD_CCtx_refCDict error: %s\n"),
+               ZSTD_getErrorName(zstat));
+          bctx.jcr->setJobStatusWithPriorityCheck(JS_ErrorTerminated);
+          goto bail_out;
+        }
+        bctx.ch.level = bctx.ff_pkt->Compress_level;
+        break;
+      }
+#endif
       default:
         break;
     }
@@ -194,4 +234,158 @@ bail_out:
   return retval;
 }
 
+// only blocks of files up to this size are samples for the dictionary
+static constexpr std::size_t kDictionarySampleFileSize = 64 * 1024;
+// fewer samples do not make a dictionary that is worth it
+static constexpr std::size_t kMinDictionarySamples = 100;
+
+static bool UsesZstd(JobControlRecord* jcr)
+{
+  findFILESET* fileset = jcr->fd_impl->ff->fileset;
+  if (!fileset) { return false; }
+  for (int i = 0; i < fileset->include_list.size(); i++) {
+    findIncludeExcludeItem* incexe
+        = (findIncludeExcludeItem*)fileset->include_list.get(i);
+    for (int j = 0; j < incexe->opts_list.size(); j++) {
+      findFOPTS* fo = (findFOPTS*)incexe->opts_list.get(j);
+      if (BitIsSet(FO_COMPRESS, fo->flags)
+          && fo->Compress_algo == COMPRESS_ZSTD) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// one file per job resource in the working directory
+static std::string CompressionDictionaryFile(JobControlRecord* jcr)
+{
+  std::string name = me->working_directory;
+  name += '/';
+  name += me->resource_name_;
+  name += '.';
+  name += JobResourceName(jcr->Job);
+  name += ".zstd.dict";
+  return name;
+}
+
+void SetupCompressionDictionary(JobControlRecord* jcr)
+{
+  if (me->compression_dictionary_size == 0 || !UsesZstd(jcr)) { return; }
+
+  jcr->fd_impl->dictionary_trainer
+      = std::make_unique<CompressionDictionaryTrainer>(
+          me->compression_dictionary_size);
+
+  std::string fname = CompressionDictionaryFile(jcr);
+  FILE* fp = fopen(fname.c_str(), "rb");
+  if (!fp) { return; }
+  std::string data;
+  char buf[64 * 1024];
+  std::size_t len;
+  while ((len = fread(buf, 1, sizeof(buf), fp)) > 0) { data.append(buf, len); }
+  bool read_error = ferror(fp);
+  fclose(fp);
+
+  auto dictionary = read_error ? nullptr
+                               : CompressionDictionary::Load(std::move(data));
+  if (!dictionary) {
+    Jmsg(jcr, M_WARNING, 0,
+         T_("Cannot use the compression dictionary %s, compressing without "
+            "it.\n"),
+         fname.c_str());
+    return;
+  }
+  char ed1[50];
+  Jmsg(jcr, M_INFO, 0, T_("Compressing with dictionary %u of %s bytes.\n"),
+       dictionary->id(), edit_uint64(dictionary->data().size(), ed1));
+  jcr->compress.dictionary = std::move(dictionary);
+}
+
+void SampleForCompressionDictionary(JobControlRecord* jcr,
+                                    FindFilesPacket* ff_pkt,
+                                    const char* data,
+                                    std::size_t size)
+{
+  auto& trainer = jcr->fd_impl->dictionary_trainer;
+  if (trainer && ff_pkt->Compress_algo == COMPRESS_ZSTD
+      && static_cast<uint64_t>(ff_pkt->statp.st_size)
+             <= kDictionarySampleFileSize) {
+    trainer->AddSample(data, size);
+  }
+}
+
+static void TrainCompressionDictionary(JobControlRecord* jcr)
+{
+  auto& trainer = *jcr->fd_impl->dictionary_trainer;
+  std::size_t samples = trainer.samples();
+  if (samples < kMinDictionarySamples) {
+    Dmsg1(100, "Only %llu samples, keeping the compression dictionary\n",
+          static_cast<unsigned long long>(samples));
+    return;
+  }
+
+  result trained = trainer.Train();
+  if (trained.holds_error()) {
+    Jmsg(jcr, M_INFO, 0, T_("Keeping the compression dictionary: %s\n"),
+         trained.error_unchecked().c_str());
+    return;
+  }
+  const std::string& data = trained.value_unchecked();
+
+  // the next backup must never find half a dictionary
+  std::string fname = CompressionDictionaryFile(jcr);
+  std::string tmp_fname = fname + ".tmp";
+  FILE* fp = fopen(tmp_fname.c_str(), "wb");
+  bool ok = fp && fwrite(data.data(), 1, data.size(), fp) == data.size();
+  if (fp && fclose(fp) != 0) { ok = false; }
+  if (!ok || rename(tmp_fname.c_str(), fname.c_str()) != 0) {
+    BErrNo be;
+    Jmsg(jcr, M_WARNING, 0, T_("Cannot write %s: ERR=%s\n"), fname.c_str(),
+         be.bstrerror());
+    unlink(tmp_fname.c_str());
+    return;
+  }
+
+  char ed1[50];
+  Jmsg(jcr, M_INFO, 0,
+       T_("Trained a compression dictionary of %s bytes from %llu samples "
+          "for the next backup.\n"),
+       edit_uint64(data.size(), ed1), static_cast<unsigned long long>(samples));
+}
+
+void SaveCompressionDictionary(JobControlRecord* jcr, bool backup_ok)
+{
+  if (!jcr->fd_impl->dictionary_trainer) { return; }
+
+  if (const auto& dictionary = jcr->compress.dictionary; dictionary) {
+    FindFilesPacket* ff_pkt = jcr->fd_impl->ff;
+    ff_pkt->fname = (char*)"*all*";
+    ff_pkt->type = FT_RESTORE_FIRST;
+    ff_pkt->LinkFI = 0;
+    ff_pkt->object_name = (char*)compression_dictionary_object;
+    ff_pkt->object = const_cast<char*>(dictionary->data().data());
+    ff_pkt->object_len = dictionary->data().size();
+    ff_pkt->object_index = (int)time(NULL);
+    SaveFile(jcr, ff_pkt, true);
+  }
+
+  if (backup_ok) { TrainCompressionDictionary(jcr); }
+  jcr->fd_impl->dictionary_trainer.reset();
+}
+
+void AddCompressionDictionary(JobControlRecord* jcr,
+                              const char* data,
+                              std::size_t size)
+{
+  auto dictionary = CompressionDictionary::Load(std::string{data, size});
+  if (!dictionary) {
+    Jmsg(jcr, M_WARNING, 0,
+         T_("Got an invalid compression dictionary from the director.\n"));
+    return;
+  }
+  Dmsg1(100, "Got compression dictionary %u\n", dictionary->id());
+  jcr->compress.dictionaries[dictionary->id()] = std::move(dictionary);
+}
+
 } /* namespace filedaemon */
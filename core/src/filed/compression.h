@@ -28,6 +28,23 @@ bool AdjustCompressionBuffers(JobControlRecord* jcr);
 bool AdjustDecompressionBuffers(JobControlRecord* jcr);
 bool SetupCompressionContext(b_ctx& bctx);
 
+/* With a CompressionDictionarySize a backup compresses with zstd using the
+ * dictionary trained by the previous backup of the job, and trains the one
+ * of the next backup from samples of its small files.  The dictionary in use
+ * is saved as a restore object, so that restores get it back. */
+inline constexpr const char* compression_dictionary_object
+    = "bareos-zstd-dictionary";
+void SetupCompressionDictionary(JobControlRecord* jcr);
+void SampleForCompressionDictionary(JobControlRecord* jcr,
+                                    FindFilesPacket* ff_pkt,
+                                    const char* data,
+                                    std::size_t size);
+void SaveCompressionDictionary(JobControlRecord* jcr, bool backup_ok);
+// makes a dictionary saved by a backup known to the restore
+void AddCompressionDictionary(JobControlRecord* jcr,
+                              const char* data,
+                              std::size_t size);
+
 } /* namespace filedaemon */
 
 #endif  // BAREOS_FILED_COMPRESSION_H_
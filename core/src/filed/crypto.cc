@@ -59,6 +59,54 @@ static void UnserCryptoPacketLen(RestoreCipherContext* ctx)
   }
 }
 
+/* Sealed blocks are buffered until one is complete, which is then opened
+ * in place.  Like for the other ciphers at most one block is returned per
+ * call, the caller moves the rest of the buffer to its start. */
+static bool OpenSealedBlock(JobControlRecord* jcr,
+                            char** data,
+                            uint32_t* length,
+                            RestoreCipherContext* cipher_ctx)
+{
+  cipher_ctx->buf = CheckPoolMemorySize(cipher_ctx->buf,
+                                        cipher_ctx->buf_len + *length);
+  if (*length > 0) {
+    memcpy(&cipher_ctx->buf[cipher_ctx->buf_len], *data, *length);
+    cipher_ctx->buf_len += *length;
+  }
+  *length = 0;
+
+  if (cipher_ctx->packet_len == 0 && cipher_ctx->buf_len >= CRYPTO_LEN_SIZE) {
+    uint32_t plain_len;
+    unser_declare;
+    UnserBegin(&cipher_ctx->buf[0], CRYPTO_LEN_SIZE);
+    unser_uint32(plain_len);
+    cipher_ctx->packet_len = plain_len + CRYPTO_SEALED_OVERHEAD;
+  }
+  if (cipher_ctx->packet_len == 0
+      || cipher_ctx->buf_len < cipher_ctx->packet_len) {
+    // No full sealed block is available.
+    return true;
+  }
+
+  uint32_t plain_len = 0;
+  if (!CryptoCipherOpenBlock(cipher_ctx->cipher, (uint8_t*)cipher_ctx->buf,
+                             cipher_ctx->packet_len, &plain_len)) {
+    Jmsg1(jcr, M_ERROR, 0,
+          T_("Decryption error, encrypted data of %s was modified\n"),
+          jcr->fd_impl->last_fname);
+    cipher_ctx->buf_len = 0;
+    cipher_ctx->packet_len = 0;
+    return false;
+  }
+
+  *data = &cipher_ctx->buf[CRYPTO_SEALED_HEADER_SIZE];
+  *length = plain_len;
+  cipher_ctx->buf_len -= cipher_ctx->packet_len;
+  Dmsg2(130, "Opened sealed block, %u bytes, remaining %u bytes in buffer\n",
+        *length, cipher_ctx->buf_len);
+  return true;
+}
+
 bool CryptoSessionStart(JobControlRecord* jcr, crypto_cipher_t cipher)
 {
   /* Create encryption session data and a cached, DER-encoded session data
@@ -278,8 +326,24 @@ bool FlushCipher(JobControlRecord* jcr,
   uint32_t wsize; /* write size */
   char ec1[50];   /* Buffer printing huge values */
   bool second_pass = false;
+  bool sealed = CryptoCipherSealsBlocks(cipher_ctx->cipher);
 
 again:
+  if (sealed) {
+    // Only whole sealed blocks are left in the buffer, if any
+    if (cipher_ctx->buf_len == 0) { return true; }
+    wsize = 0;
+    if (!OpenSealedBlock(jcr, &wbuf, &wsize, cipher_ctx)) { return false; }
+    if (wsize == 0) {
+      Jmsg1(jcr, M_ERROR, 0, T_("Encrypted data of %s is truncated\n"),
+            jcr->fd_impl->last_fname);
+      cipher_ctx->buf_len = 0;
+      cipher_ctx->packet_len = 0;
+      return false;
+    }
+    goto write_block;
+  }
+
   // Write out the remaining block and free the cipher context
   cipher_ctx->buf = CheckPoolMemorySize(
       cipher_ctx->buf, cipher_ctx->buf_len + cipher_ctx->block_size);
@@ -312,6 +376,7 @@ again:
       "Encryption writing full block, %u bytes, remaining %u bytes in buffer\n",
       wsize, cipher_ctx->buf_len);
 
+write_block:
   if (BitIsSet(FO_SPARSE, flags) || BitIsSet(FO_OFFSETS, flags)) {
     if (!SparseData(jcr, bfd, addr, &wbuf, &wsize)) { return false; }
   }
@@ -342,7 +407,7 @@ again:
    * packet length may be re-read by UnserCryptoPacketLen() */
   cipher_ctx->packet_len = 0;
 
-  if (cipher_ctx->buf_len > 0 && !second_pass) {
+  if (cipher_ctx->buf_len > 0 && (sealed || !second_pass)) {
     second_pass = true;
     goto again;
   }
@@ -409,7 +474,8 @@ bool SetupEncryptionContext(b_ctx& bctx)
                               (MAX(bctx.jcr->buf_size + (int)sizeof(uint32_t),
                                    (int32_t)bctx.max_compress_len)
                                + cipher_block_size - 1)
-                                  / cipher_block_size * cipher_block_size);
+                                      / cipher_block_size * cipher_block_size
+                                  + CRYPTO_SEALED_OVERHEAD);
 
     bctx.wbuf
         = bctx.jcr->fd_impl->crypto
@@ -467,6 +533,20 @@ bool EncryptData(b_ctx* bctx, bool* need_more_data)
     bctx->cipher_input_len += OFFSET_FADDR_SIZE;
   }
 
+  // A sealed block carries its length itself and is never buffered
+  if (CryptoCipherSealsBlocks(bctx->cipher_ctx)) {
+    uint32_t sealed_len = 0;
+    if (!CryptoCipherSealBlock(
+            bctx->cipher_ctx, bctx->cipher_input, bctx->cipher_input_len,
+            (uint8_t*)bctx->jcr->fd_impl->crypto.crypto_buf, &sealed_len)) {
+      Jmsg(bctx->jcr, M_FATAL, 0, T_("Encryption error\n"));
+      return false;
+    }
+    bctx->encrypted_len = sealed_len;
+    bctx->jcr->store_bsock->message_length = sealed_len;
+    return true;
+  }
+
   // Encrypt the length of the input block
   uint8_t packet_len[sizeof(uint32_t)];
 
@@ -519,6 +599,10 @@ bool DecryptData(JobControlRecord* jcr,
 
   ASSERT(cipher_ctx->cipher);
 
+  if (CryptoCipherSealsBlocks(cipher_ctx->cipher)) {
+    return OpenSealedBlock(jcr, data, length, cipher_ctx);
+  }
+
   /* NOTE: We must fd_implement block preserving semantics for the
    * non-streaming compression and sparse code.
    *
@@ -29,6 +29,7 @@
 #include "include/bareos.h"
 #include "filed/filed.h"
 #include "filed/filed_globals.h"
+#include "filed/accurate.h"
 #include "include/ch.h"
 #include "filed/authenticate.h"
 #include "filed/dir_cmd.h"
@@ -52,11 +53,15 @@
 #include "lib/tls_conf.h"
 #include "lib/parse_conf.h"
 #include "lib/bsock_tcp.h"
+#include "lib/bsock_striped.h"
 #include "lib/bnet_network_dump.h"
 #include "lib/watchdog.h"
 #include "lib/util.h"
 #include "filed/backup.h"
+#include "filed/change_sources.h"
+#include "filed/compression.h"
 #include "lib/compression.h"
+#include "lib/trace_ring.h"
 
 #if defined(WIN32_VSS)
 #  include "win32/findlib/win32.h"
@@ -115,6 +120,7 @@ static bool RestoreCmd(JobControlRecord* jcr);
 static bool SessionCmd(JobControlRecord* jcr);
 static bool SecureerasereqCmd(JobControlRecord* jcr);
 static bool SetauthorizationCmd(JobControlRecord* jcr);
+static bool ResumeCmd(JobControlRecord* jcr);
 static bool SetbandwidthCmd(JobControlRecord* jcr);
 static bool SetdebugCmd(JobControlRecord* jcr);
 static bool StorageCmd(JobControlRecord* jcr);
@@ -163,6 +169,7 @@ static struct s_fd_dir_cmds cmds[] = {
     {"restoreobject", RestoreObjectCmd, false},
     {"restore ", RestoreCmd, false},
     {"resolve ", ResolveCmd, false},
+    {"resume ", ResumeCmd, false},
     {"getSecureEraseCmd", SecureerasereqCmd, false},
     {"session", SessionCmd, false},
     {"setauthorization", SetauthorizationCmd, false},
@@ -203,6 +210,7 @@ static char Estimatecmd[] = "estimate listing=%d";
 static char runscriptcmd[]
     = "Run OnSuccess=%d OnFailure=%d AbortOnError=%d When=%d Command=%s";
 static char resolvecmd[] = "resolve %s";
+static char resumecmd[] = "resume FileIndex=%d File=%s";
 
 // Responses sent to Director
 static char errmsg[] = "2999 Invalid command\n";
@@ -217,6 +225,7 @@ static char OKbackup[] = "2000 OK backup\n";
 static char OKbootstrap[] = "2000 OK bootstrap\n";
 static char OKverify[] = "2000 OK verify\n";
 static char OKrestore[] = "2000 OK restore\n";
+static char OKresume[] = "2000 OK resume\n";
 static char OKsecureerase[] = "2000 OK FDSecureEraseCmd %s\n";
 static char OKsession[] = "2000 OK session\n";
 static char OKstore[] = "2000 OK storage\n";
@@ -242,12 +251,15 @@ static char BadPluginOptions[] = "2905 Bad PluginOptions command.\n";
 static char OK_end[] = "3000 OK end\n";
 static char OK_close[] = "3000 OK close Status = %d\n";
 static char OK_open[] = "3000 OK open ticket = %d\n";
+static char OK_open_data_connections[]
+    = "3000 OK open ticket = %d data connections\n";
 static char OK_data[] = "3000 OK data\n";
 static char OK_append[] = "3000 OK append data\n";
 
 // Commands sent to Storage Daemon
 static char append_open[] = "append open session\n";
 static char append_data[] = "append data %d\n";
+static char append_data_connections[] = "append data %d connections=%d\n";
 static char append_end[] = "append end session %d\n";
 static char append_close[] = "append close session %d\n";
 static char read_open[] = "read open session = %s %ld %ld %ld %ld %ld %ld\n";
@@ -305,6 +317,7 @@ void CleanupFileset(JobControlRecord* jcr)
           regfree((regex_t*)fo->regexfile.get(k));
         }
         if (fo->size_match) { free(fo->size_match); }
+        FreeCompiledWildcards(fo);
         fo->regex.destroy();
         fo->regexdir.destroy();
         fo->regexfile.destroy();
@@ -315,6 +328,7 @@ void CleanupFileset(JobControlRecord* jcr)
         fo->fstype.destroy();
         fo->Drivetype.destroy();
       }
+      FreeCompiledWildcards(incexe);
       incexe->opts_list.destroy();
       incexe->name_list.destroy();
       incexe->plugin_list.destroy();
@@ -328,6 +342,7 @@ void CleanupFileset(JobControlRecord* jcr)
       for (int j = 0; j < incexe->opts_list.size(); j++) {
         fo = (findFOPTS*)incexe->opts_list.get(j);
         if (fo->size_match) { free(fo->size_match); }
+        FreeCompiledWildcards(fo);
         fo->regex.destroy();
         fo->regexdir.destroy();
         fo->regexfile.destroy();
@@ -338,6 +353,7 @@ void CleanupFileset(JobControlRecord* jcr)
         fo->fstype.destroy();
         fo->Drivetype.destroy();
       }
+      FreeCompiledWildcards(incexe);
       incexe->opts_list.destroy();
       incexe->name_list.destroy();
       incexe->plugin_list.destroy();
@@ -847,6 +863,8 @@ static bool SetdebugCmd(JobControlRecord* jcr)
   if (level >= 0) { debug_level = level; }
 
   SetTrace(trace_flag);
+  // the trace rings are written out together with switching on the trace file
+  if (trace_flag) { DumpTraceRingsToTraceFile(); }
   SetHangup(hangup_flag);
   if (scan == 4) {
     SetTimestamp(timestamp_flag);
@@ -1135,7 +1153,12 @@ static bool RestoreObjectCmd(JobControlRecord* jcr)
     jcr->fd_impl->got_metadata = true;
   }
 
-  GeneratePluginEvent(jcr, bEventRestoreObject, (void*)&rop);
+  // Not meant for the plugins
+  if (bstrcmp(rop.object_name, compression_dictionary_object)) {
+    AddCompressionDictionary(jcr, rop.object, rop.object_len);
+  } else {
+    GeneratePluginEvent(jcr, bEventRestoreObject, (void*)&rop);
+  }
 
   if (rop.object_name) { free(rop.object_name); }
 
@@ -1257,6 +1280,31 @@ static bool BootstrapCmd(JobControlRecord* jcr)
   return dir->fsend(OKbootstrap);
 }
 
+/**
+ * Resume an incomplete backup: skip the files up to the last one it saved
+ * and number the following ones after it.
+ */
+static bool ResumeCmd(JobControlRecord* jcr)
+{
+  BareosSocket* dir = jcr->dir_bsock;
+  int32_t FileIndex = 0;
+  PoolMem fname(PM_FNAME);
+
+  fname.check_size(dir->message_length);
+  if (sscanf(dir->msg, resumecmd, &FileIndex, fname.c_str()) != 2
+      || FileIndex <= 0) {
+    PmStrcpy(jcr->errmsg, dir->msg);
+    Jmsg1(jcr, M_FATAL, 0, T_("Bad resume command: %s\n"), jcr->errmsg);
+    return false;
+  }
+  UnbashSpaces(fname);
+
+  jcr->JobFiles = FileIndex;
+  jcr->fd_impl->resume_after = fname.c_str();
+
+  return dir->fsend(OKresume);
+}
+
 // Get backup level from Director
 static bool LevelCmd(JobControlRecord* jcr)
 {
@@ -1512,6 +1560,14 @@ static bool StorageCmd(JobControlRecord* jcr)
   storage_daemon_socket->InitBnetDump(
       my_config->CreateOwnQualifiedNameForNetworkDump());
   storage_daemon_socket->fsend("Hello Start Job %s\n", jcr->Job);
+
+  // AuthenticateWithStoragedaemon() destroys the key
+  if (me->storage_data_connections > 1) {
+    jcr->fd_impl->sd_address = stored_addr;
+    jcr->fd_impl->sd_port = stored_port;
+    jcr->fd_impl->sd_data_key = jcr->sd_auth_key;
+  }
+
   if (!AuthenticateWithStoragedaemon(jcr)) {
     Jmsg(jcr, M_FATAL, 0, T_("Failed to authenticate Storage daemon.\n"));
     goto bail_out;
@@ -1528,6 +1584,92 @@ bail_out:
   return false;
 }
 
+static void ForgetStorageDataKey(JobControlRecord* jcr)
+{
+  std::string& key = jcr->fd_impl->sd_data_key;
+  if (!key.empty()) { memset(key.data(), 0, key.size()); }
+  key.clear();
+}
+
+/* Opens the additional data connections to the storage daemon the job was
+ * told about with the storage command (see StorageDataConnections).  If one
+ * of them cannot be opened, the backup uses the ones opened before it, i.e.
+ * maybe just the connection of the job. */
+static void OpenStorageDataConnections(JobControlRecord* jcr)
+{
+  FiledJcrImpl* impl = jcr->fd_impl;
+  const uint32_t count = me->storage_data_connections;
+  std::string qualified_resource_name;
+
+  if (jcr->sd_tls_policy == TlsPolicy::kBnetTlsAuto
+      && !my_config->GetQualifiedResourceNameTypeConverter()->ResourceToString(
+          jcr->Job, R_JOB, qualified_resource_name)) {
+    ForgetStorageDataKey(jcr);
+    return;
+  }
+
+  for (uint32_t i = 0; i < count; ++i) {
+    BareosSocket* sock = new BareosSocketTCP;
+    sock->SetSourceAddress(me->FDsrc_addr);
+    if (jcr->max_bandwidth) { sock->SetBwlimit(jcr->max_bandwidth / count); }
+    if (me->allow_bw_bursting) { sock->SetBwlimitBursting(); }
+
+    bool ok = sock->connect(nullptr, 1, 10, me->heartbeat_interval,
+                            T_("Storage daemon"), impl->sd_address.data(),
+                            nullptr, impl->sd_port, false);
+    if (ok && jcr->sd_tls_policy == TlsPolicy::kBnetTlsAuto) {
+      ok = sock->DoTlsHandshake(TlsPolicy::kBnetTlsAuto, me, false,
+                                qualified_resource_name.c_str(),
+                                impl->sd_data_key.c_str(), nullptr);
+    }
+    if (ok) {
+      sock->InitBnetDump(my_config->CreateOwnQualifiedNameForNetworkDump());
+      ok = sock->fsend("Hello Start Job %s data connection %d\n", jcr->Job, i)
+           && AuthenticateDataConnectionWithStoragedaemon(
+               jcr, sock, impl->sd_data_key.data());
+    }
+    if (!ok) {
+      Jmsg(jcr, M_WARNING, 0,
+           T_("Could not open data connection %d to Storage daemon %s:%d.\n"),
+           i + 1, impl->sd_address.c_str(), impl->sd_port);
+      sock->close();
+      delete sock;
+      break;
+    }
+
+    sock->SetJcr(jcr);
+    impl->sd_data_connections.push_back(sock);
+  }
+
+  ForgetStorageDataKey(jcr);
+}
+
+static void CloseStorageDataConnections(JobControlRecord* jcr)
+{
+  for (BareosSocket* sock : jcr->fd_impl->sd_data_connections) {
+    sock->close();
+    delete sock;
+  }
+  jcr->fd_impl->sd_data_connections.clear();
+}
+
+/* Stops sending over the data connections; returns false if the data did
+ * not make it to the storage daemon. */
+static bool StopStriping(JobControlRecord* jcr,
+                         std::unique_ptr<StripedSender>& striped)
+{
+  if (!striped) { return true; }
+  jcr->store_bsock->SetStripedSender(nullptr);
+  auto error = striped->Finish();
+  striped.reset();
+  if (error) {
+    Jmsg(jcr, M_FATAL, 0, T_("Network error on data connection to %s: %s\n"),
+         jcr->fd_impl->sd_address.c_str(), error->c_str());
+    return false;
+  }
+  return true;
+}
+
 #ifndef HAVE_WIN32
 static void LogFlagStatus(JobControlRecord* jcr,
                           int flag,
@@ -1621,6 +1763,10 @@ static inline void ClearCompressionFlagInFileset(JobControlRecord* jcr)
             case COMPRESS_FZ4L:
             case COMPRESS_FZ4H:
               break;
+#if defined(HAVE_ZSTD)
+            case COMPRESS_ZSTD:
+              break;
+#endif
             default:
               /* When we get here its because the wanted compression protocol is
                * not supported with the current compile options. */
@@ -1713,6 +1859,7 @@ static bool BackupCmd(JobControlRecord* jcr)
   BareosSocket* dir = jcr->dir_bsock;
   BareosSocket* sd = jcr->store_bsock;
   crypto_cipher_t cipher = CRYPTO_CIPHER_NONE;
+  std::unique_ptr<StripedSender> striped;
 
   /* See if we are in restore only mode then we don't allow a backup to be
    * initiated. */
@@ -1736,9 +1883,18 @@ static bool BackupCmd(JobControlRecord* jcr)
   if (jcr->fd_impl->enable_vss) { VSSInit(jcr); }
 #endif
 
-  if (sscanf(dir->msg, "backup FileIndex=%ld\n", &FileIndex) == 1) {
-    jcr->JobFiles = FileIndex;
-    Dmsg1(100, "JobFiles=%ld\n", jcr->JobFiles);
+  if (int binary_attributes = 0;
+      sscanf(dir->msg, "backup FileIndex=%ld binaryattributes=%d\n",
+             &FileIndex, &binary_attributes)
+      >= 1) {
+    // a resumed backup continues after the files it saved before
+    if (!jcr->fd_impl->resume_after
+        || static_cast<uint32_t>(FileIndex) > jcr->JobFiles) {
+      jcr->JobFiles = FileIndex;
+    }
+    jcr->fd_impl->binary_attributes = binary_attributes;
+    Dmsg2(100, "JobFiles=%ld binary attributes=%d\n", jcr->JobFiles,
+          binary_attributes);
   }
 
   /* Validate some options given to the backup make sense for the compiled in
@@ -1804,8 +1960,26 @@ static bool BackupCmd(JobControlRecord* jcr)
     goto cleanup;
   }
 
+  // Older storage daemons do not know about data connections
+  if (!jcr->fd_impl->sd_data_key.empty()) {
+    PoolMem expected(PM_MESSAGE);
+    Mmsg(expected, OK_open_data_connections, jcr->fd_impl->Ticket);
+    if (bstrcmp(sd->msg, expected.c_str())) {
+      OpenStorageDataConnections(jcr);
+    } else {
+      Jmsg(jcr, M_INFO, 0,
+           T_("Storage daemon does not accept data connections.\n"));
+      ForgetStorageDataKey(jcr);
+    }
+  }
+
   // Send Append data command to Storage daemon
-  sd->fsend(append_data, jcr->fd_impl->Ticket);
+  if (!jcr->fd_impl->sd_data_connections.empty()) {
+    sd->fsend(append_data_connections, jcr->fd_impl->Ticket,
+              static_cast<int>(jcr->fd_impl->sd_data_connections.size()));
+  } else {
+    sd->fsend(append_data, jcr->fd_impl->Ticket);
+  }
   Dmsg1(110, ">stored: %s", sd->msg);
 
   // Expect to get OK data
@@ -1815,11 +1989,36 @@ static bool BackupCmd(JobControlRecord* jcr)
   }
   Dmsg1(110, "<stored: %s", sd->msg);
 
+  if (!jcr->fd_impl->sd_data_connections.empty()) {
+    striped
+        = std::make_unique<StripedSender>(jcr->fd_impl->sd_data_connections);
+    sd->SetStripedSender(striped.get());
+    Jmsg(jcr, M_INFO, 0, T_("Sending data over %d connections.\n"),
+         static_cast<int>(striped->size()));
+  }
+
   GeneratePluginEvent(jcr, bEventStartBackupJob);
 
+  /* The positions of the change sources are taken before the snapshots,
+   * changes in between are then read once more by the next backup. */
+  SetupChangeSources(jcr);
+
 #if defined(WIN32_VSS)
   // START VSS ON WIN32
   if (jcr->fd_impl->pVSSClient) {
+    VSSClient* vss = jcr->fd_impl->pVSSClient;
+    vss->include_writers.clear();
+    vss->exclude_writers.clear();
+    if (me->vss_include_writers) {
+      for (const char* writer : me->vss_include_writers) {
+        vss->include_writers.emplace_back(writer);
+      }
+    }
+    if (me->vss_exclude_writers) {
+      for (const char* writer : me->vss_exclude_writers) {
+        vss->exclude_writers.emplace_back(writer);
+      }
+    }
     if (jcr->fd_impl->pVSSClient->InitializeForBackup(jcr)) {
       int volume_count;
       char szWinDriveLetters[27];
@@ -1913,7 +2112,7 @@ static bool BackupCmd(JobControlRecord* jcr)
 
   // Send Files to Storage daemon
   Dmsg1(110, "begin blast ff=%p\n", (FindFilesPacket*)jcr->fd_impl->ff);
-  if (!BlastDataToStorageDaemon(jcr, cipher)) {
+  if (!BlastDataToStorageDaemon(jcr, cipher) || !StopStriping(jcr, striped)) {
     jcr->setJobStatusWithPriorityCheck(JS_ErrorTerminated);
     BnetSuppressErrorMessages(sd, 1);
     Dmsg0(110, "Error in blast_data.\n");
@@ -1953,10 +2152,16 @@ static bool BackupCmd(JobControlRecord* jcr)
     if (!(SDJobStatus == JS_Terminated || SDJobStatus == JS_Warnings)) {
       Jmsg(jcr, M_FATAL, 0, T_("Bad status %d returned from Storage Daemon.\n"),
            SDJobStatus);
+    } else if (jcr->IsTerminatedOk()) {
+      SaveChangeSources(jcr);
     }
   }
 
 cleanup:
+  StopStriping(jcr, striped);
+  CloseStorageDataConnections(jcr);
+  ForgetStorageDataKey(jcr);
+
 #if defined(WIN32_VSS)
   if (jcr->fd_impl->pVSSClient) {
     jcr->fd_impl->pVSSClient->DestroyWriterInfo();
@@ -2385,6 +2590,9 @@ static void FiledFreeJcr(JobControlRecord* jcr)
   TermFindFiles(jcr->fd_impl->ff);
   jcr->fd_impl->ff = nullptr;
 
+  // also waits for the accurate list if it is still being loaded
+  AccurateFree(jcr);
+
   if (jcr->JobId != 0) {
     WriteStateFile(me->working_directory, "bareos-fd",
                    GetFirstPortHostOrder(me->FDaddrs));
@@ -29,13 +29,20 @@
 #include "include/bareos.h"
 #include "include/filetypes.h"
 #include "filed/filed.h"
+#include "filed/filed_globals.h"
 #include "filed/filed_jcr_impl.h"
 #include "filed/accurate.h"
+#include "findlib/stat_ahead.h"
 
 namespace filedaemon {
 
 static int TallyFile(JobControlRecord* jcr, FindFilesPacket* ff_pkt, bool);
 
+#if !defined(HAVE_WIN32)
+// Number of directory entries whose lstat() may be in flight.
+static constexpr std::size_t kStatAheadEntries = 64;
+#endif
+
 // Find all the requested files and count them.
 int MakeEstimate(JobControlRecord* jcr)
 {
@@ -51,8 +58,23 @@ int MakeEstimate(JobControlRecord* jcr)
                            AccurateCheckFile);
   }
 
+#if !defined(HAVE_WIN32)
+  /* An estimate only looks at the metadata, so the scan is all there is to
+   * it; lstat() the entries read ahead concurrently like the backup does. */
+  if (me->MaxWorkersPerJob > 0) {
+    jcr->fd_impl->stat_ahead = std::make_unique<StatAhead>(
+        jcr->fd_impl->threads, me->MaxWorkersPerJob, kStatAheadEntries);
+    jcr->fd_impl->ff->stat_ahead = jcr->fd_impl->stat_ahead.get();
+  }
+#endif
+
+  jcr->fd_impl->estimating = true;
   status = FindFiles(jcr, (FindFilesPacket*)jcr->fd_impl->ff, TallyFile,
                      PluginEstimate);
+  jcr->fd_impl->estimating = false;
+
+  jcr->fd_impl->ff->stat_ahead = nullptr;
+  jcr->fd_impl->stat_ahead.reset();
   AccurateFree(jcr);
   return status;
 }
@@ -36,6 +36,7 @@
 #include "filed/fileset.h"
 #include "filed/heartbeat.h"
 #include "filed/filed_jcr_impl.h"
+#include "filed/plugin_streams.h"
 #include "findlib/attribs.h"
 #include "findlib/find.h"
 #include "findlib/find_one.h"
@@ -45,6 +46,11 @@
 #include "lib/plugins.h"
 #include "lib/parse_conf.h"
 
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <vector>
+
 // Function pointers to be set here (findlib)
 BAREOS_IMPORT int (*plugin_bopen)(BareosFilePacket* bfd,
                                   const char* fname,
@@ -177,8 +183,13 @@ struct FiledPluginContext {
       nullptr};   /* pointer to include/exclude files */
   Plugin* plugin; /* pointer to plugin of which this is an instance off */
   bool check_changes{true}; /* call CheckChanges() on every file */
+  int backup_streams{1};    /* files the plugin may have open at once */
+  PluginStreamReader* stream_reader{nullptr}; /* of the file being saved */
 };
 
+static constexpr int max_backup_streams = 64;
+static constexpr std::size_t max_buffered_per_stream = 4 * 1024 * 1024;
+
 static inline bool IsEventEnabled(PluginContext* ctx, bEventType eventType)
 {
   FiledPluginContext* b_ctx;
@@ -633,6 +644,149 @@ bail_out:
   return retval;
 }
 
+/* Asks the plugin for the next file.  Returns bRC_OK if it gave us one,
+ * bRC_Skip to ask again, bRC_Stop if there are no more files and bRC_Error
+ * on fatal errors. */
+static bRC StartPluginBackupFile(JobControlRecord* jcr,
+                                 PluginContext* ctx,
+                                 char* cmd,
+                                 char* flags,
+                                 save_pkt& sp)
+{
+  sp.portable = true;
+  sp.no_read = false;
+  CopyBits(FO_MAX, flags, sp.flags);
+  sp.cmd = cmd;
+  Dmsg3(debuglevel, "startBackup st_size=%p st_blocks=%p sp=%p\n",
+        &sp.statp.st_size, &sp.statp.st_blocks, &sp);
+
+  // Get the file save parameters. I.e. the stat pkt ...
+  switch (PlugFunc(ctx->plugin)->startBackupFile(ctx, &sp)) {
+    case bRC_OK:
+      if (sp.type == 0) {
+        Jmsg1(jcr, M_FATAL, 0,
+              T_("Command plugin \"%s\": no type in startBackupFile "
+                 "packet.\n"),
+              cmd);
+        return bRC_Error;
+      }
+      return bRC_OK;
+    case bRC_Stop:
+      Dmsg0(debuglevel, "Plugin returned bRC_Stop, continue with next steps\n");
+      return bRC_Stop;
+    case bRC_Skip:
+      Dmsg0(debuglevel, "Plugin returned bRC_Skip, continue with next file\n");
+      return bRC_Skip;
+    case bRC_Error:
+      Jmsg1(jcr, M_FATAL, 0,
+            T_("Command plugin \"%s\": startBackupFile failed.\n"), cmd);
+      return bRC_Error;
+    case PYTHON_UNDEFINED_RETURN_VALUE:
+    case bRC_Cancel:
+    case bRC_Core:
+    case bRC_Max:
+    case bRC_More:
+    case bRC_Seen:
+    case bRC_Term:
+      break;
+  }
+
+  Jmsg1(jcr, M_ERROR, 0,
+        T_("Command plugin \"%s\": unhandled returncode from "
+           "startBackupFile.\n"),
+        cmd);
+  return bRC_Stop;
+}
+
+/* A file the plugin announced (and ended) while the files before it are
+ * still being saved.  The strings of sp point into this struct. */
+struct PendingPluginFile {
+  save_pkt sp;
+  std::vector<char> fname;
+  std::vector<char> link;
+  std::vector<char> object_name;
+  std::vector<char> object;
+  bRC end_retval{bRC_OK};
+  std::unique_ptr<PluginStreamReader> reader;
+};
+
+static char* KeepCopy(std::vector<char>& storage, const char* data, size_t len)
+{
+  if (!data) { return nullptr; }
+  storage.assign(data, data + len);
+  storage.push_back('\0');
+  return storage.data();
+}
+
+static char* KeepCopy(std::vector<char>& storage, const char* str)
+{
+  return KeepCopy(storage, str, str ? strlen(str) : 0);
+}
+
+/* Lets a plugin with backup_streams > 1 announce files until that many are
+ * pending.  The data of every file is read ahead with its own stream, so
+ * the plugin can produce it in parallel while the backup loop still sends
+ * one file after the other. */
+static bool FillBackupStreams(
+    JobControlRecord* jcr,
+    PluginContext* ctx,
+    char* cmd,
+    char* flags,
+    std::deque<std::unique_ptr<PendingPluginFile>>& pending_files,
+    bool& plugin_done)
+{
+  auto* b_ctx = static_cast<FiledPluginContext*>(ctx->core_private_context);
+
+  /* The plugin may lower backup_streams in between, e.g. to make sure all
+   * pending files got saved before it announces the next one. */
+  while (!plugin_done && !jcr->IsJobCanceled()
+         && pending_files.size()
+                < static_cast<std::size_t>(b_ctx->backup_streams)) {
+    auto file = std::make_unique<PendingPluginFile>();
+    save_pkt& sp = file->sp;
+    switch (StartPluginBackupFile(jcr, ctx, cmd, flags, sp)) {
+      case bRC_OK:
+        break;
+      case bRC_Skip:
+        continue;
+      case bRC_Error:
+        return false;
+      default:
+        plugin_done = true;
+        continue;
+    }
+
+    // the plugin may reuse its strings for the following files
+    sp.fname = KeepCopy(file->fname, sp.fname);
+    sp.link = KeepCopy(file->link, sp.link);
+    sp.object_name = KeepCopy(file->object_name, sp.object_name);
+    sp.object = KeepCopy(file->object, sp.object, sp.object_len);
+
+    if (!IS_FT_OBJECT(sp.type) && !sp.no_read && sp.fname) {
+      // the lowest stream not used by one of the other pending files
+      int32_t stream = 1;
+      while (std::any_of(pending_files.begin(), pending_files.end(),
+                         [stream](const auto& other) {
+                           return other->reader
+                                  && other->reader->stream() == stream;
+                         })) {
+        stream += 1;
+      }
+      int noatime = BitIsSet(FO_NOATIME, sp.flags) ? O_NOATIME : 0;
+      file->reader = std::make_unique<PluginStreamReader>(
+          ctx, PlugFunc(ctx->plugin)->pluginIO, stream,
+          max_buffered_per_stream);
+      file->reader->Open(sp.fname, O_RDONLY | O_BINARY | noatime, 0);
+    }
+
+    file->end_retval = PlugFunc(ctx->plugin)->endBackupFile(ctx);
+    if (file->end_retval != bRC_More) { plugin_done = true; }
+    pending_files.push_back(std::move(file));
+  }
+
+  return true;
+}
+
 /**
  * Sequence of calls for a backup:
  * 1. PluginSave() here is called with ff_pkt
@@ -712,54 +866,35 @@ int PluginSave(JobControlRecord* jcr, FindFilesPacket* ff_pkt, bool)
     }
 
     // Loop getting filenames to backup then saving them
+    std::deque<std::unique_ptr<PendingPluginFile>> pending_files;
+    bool plugin_done = false;
     while (!jcr->IsJobCanceled()) {
-      save_pkt sp;
-      sp.portable = true;
-      sp.no_read = false;
-      CopyBits(FO_MAX, ff_pkt->flags, sp.flags);
-      sp.cmd = cmd;
-      Dmsg3(debuglevel, "startBackup st_size=%p st_blocks=%p sp=%p\n",
-            &sp.statp.st_size, &sp.statp.st_blocks, &sp);
+      auto* b_ctx = static_cast<FiledPluginContext*>(ctx->core_private_context);
+      save_pkt next_sp;
+      std::unique_ptr<PendingPluginFile> pending;
 
-      // Get the file save parameters. I.e. the stat pkt ...
-      {
-        switch (PlugFunc(ctx->plugin)->startBackupFile(ctx, &sp)) {
+      if (b_ctx->backup_streams > 1 || !pending_files.empty()) {
+        if (!FillBackupStreams(jcr, ctx, cmd, ff_pkt->flags, pending_files,
+                               plugin_done)) {
+          goto bail_out;
+        }
+        if (pending_files.empty()) { goto fun_end; }
+        pending = std::move(pending_files.front());
+        pending_files.pop_front();
+        b_ctx->stream_reader = pending->reader.get();
+      } else {
+        switch (StartPluginBackupFile(jcr, ctx, cmd, ff_pkt->flags, next_sp)) {
           case bRC_OK:
-            if (sp.type == 0) {
-              Jmsg1(jcr, M_FATAL, 0,
-                    T_("Command plugin \"%s\": no type in startBackupFile "
-                       "packet.\n"),
-                    cmd);
-              goto bail_out;
-            }
             break;
-          case bRC_Stop:
-            Dmsg0(debuglevel,
-                  "Plugin returned bRC_Stop, continue with next steps\n");
-            goto fun_end;
           case bRC_Skip:
-            Dmsg0(debuglevel,
-                  "Plugin returned bRC_Skip, continue with next file\n");
             continue;
           case bRC_Error:
-            Jmsg1(jcr, M_FATAL, 0,
-                  T_("Command plugin \"%s\": startBackupFile failed.\n"), cmd);
             goto bail_out;
-          case PYTHON_UNDEFINED_RETURN_VALUE:
-          case bRC_Cancel:
-          case bRC_Core:
-          case bRC_Max:
-          case bRC_More:
-          case bRC_Seen:
-          case bRC_Term:
-            Jmsg1(jcr, M_ERROR, 0,
-                  T_("Command plugin \"%s\": unhandled returncode from "
-                     "startBackupFile.\n"),
-                  cmd);
-
+          default:
             goto fun_end;
         }
       }
+      save_pkt& sp = pending ? pending->sp : next_sp;
 
       jcr->fd_impl->plugin_sp = &sp;
       ff_pkt = jcr->fd_impl->ff;
@@ -817,6 +952,7 @@ int PluginSave(JobControlRecord* jcr, FindFilesPacket* ff_pkt, bool)
       ff_pkt->LinkFI = 0;
       ff_pkt->FileIndex = 0;
       ff_pkt->linked = nullptr;
+      CurLink* link_saved = nullptr;
       if (!BitIsSet(FO_NO_HARDLINK, ff_pkt->flags)
           && ff_pkt->statp.st_nlink > 1) {
         switch (ff_pkt->statp.st_mode & S_IFMT) {
@@ -828,31 +964,36 @@ int PluginSave(JobControlRecord* jcr, FindFilesPacket* ff_pkt, bool)
           case S_IFSOCK:
 #endif
 
-            if (!ff_pkt->linkhash) { ff_pkt->linkhash = new LinkHash(10000); }
+            if (!ff_pkt->linkhash) { ff_pkt->linkhash = new LinkHash; }
 
-            auto [iter, _] = ff_pkt->linkhash->try_emplace(
-                Hardlink{ff_pkt->statp.st_dev, ff_pkt->statp.st_ino}, sp.fname);
-            auto& hl = iter->second;
+            LinkHash& links = *ff_pkt->linkhash;
+            CurLink& hl = links.Lookup(
+                Hardlink{ff_pkt->statp.st_dev, ff_pkt->statp.st_ino},
+                ff_pkt->statp.st_nlink, sp.fname);
             if (hl.FileIndex == 0) {
+              if (!bstrcmp(links.name(hl), sp.fname)) {
+                links.SetName(hl, sp.fname);
+              }
               ff_pkt->linked = &hl;
               Dmsg2(400, "Added to hash FI=%d file=%s\n", ff_pkt->FileIndex,
-                    hl.name.c_str());
-            } else if (bstrcmp(hl.name.c_str(), sp.fname)) {
+                    links.name(hl));
+            } else if (bstrcmp(links.name(hl), sp.fname)) {
               Dmsg2(400, "== Name identical skip FI=%d file=%s\n", hl.FileIndex,
                     fname.c_str());
               ff_pkt->no_read = true;
             } else {
-              ff_pkt->link = hl.name.data();
+              ff_pkt->link = const_cast<char*>(links.name(hl));
               ff_pkt->type = FT_LNKSAVED; /* Handle link, file already saved */
               ff_pkt->LinkFI = hl.FileIndex;
-              ff_pkt->digest = hl.digest.data();
+              ff_pkt->digest = const_cast<char*>(links.digest(hl));
               ff_pkt->digest_stream = hl.digest_stream;
-              ff_pkt->digest_len = hl.digest.size();
+              ff_pkt->digest_len = hl.digest_len;
 
               Dmsg3(400, "FT_LNKSAVED FI=%d LinkFI=%d file=%s\n",
-                    ff_pkt->FileIndex, hl.FileIndex, hl.name.c_str());
+                    ff_pkt->FileIndex, hl.FileIndex, links.name(hl));
 
               ff_pkt->no_read = true;
+              link_saved = &hl;
             }
             break;
         }
@@ -860,18 +1001,22 @@ int PluginSave(JobControlRecord* jcr, FindFilesPacket* ff_pkt, bool)
 
       // Call Bareos core code to backup the plugin's file
       SaveFile(jcr, ff_pkt, true);
+      b_ctx->stream_reader = nullptr;
 
       if (ff_pkt->linked) { ff_pkt->linked->FileIndex = ff_pkt->FileIndex; }
+      // ff_pkt->link points into the hash until here
+      if (link_saved) { ff_pkt->linkhash->LinkSeen(*link_saved); }
 
       // Restore original flags.
       CopyBits(FO_MAX, flags, ff_pkt->flags);
 
-      bRC retval = PlugFunc(ctx->plugin)->endBackupFile(ctx);
+      bRC retval = pending ? pending->end_retval
+                           : PlugFunc(ctx->plugin)->endBackupFile(ctx);
       if (retval == bRC_More || retval == bRC_OK) {
         AccurateMarkFileAsSeen(jcr, fname.c_str());
       }
 
-      if (retval == bRC_More) { continue; }
+      if (retval == bRC_More || !pending_files.empty()) { continue; }
 
       goto fun_end;
     } /* end while loop */
@@ -1783,6 +1928,14 @@ void FreePlugins(JobControlRecord* jcr)
   jcr->plugin_ctx_list = NULL;
 }
 
+// Set while a file of a plugin with several backup streams is saved.
+static PluginStreamReader* CurrentStreamReader(JobControlRecord* jcr)
+{
+  auto* b_ctx
+      = static_cast<FiledPluginContext*>(jcr->plugin_ctx->core_private_context);
+  return b_ctx ? b_ctx->stream_reader : nullptr;
+}
+
 /** Entry point for opening the file this is a wrapper around
     the pluginIO entry point in the plugin.  */
 static int MyPluginBopen(BareosFilePacket* bfd,
@@ -1798,6 +1951,17 @@ static int MyPluginBopen(BareosFilePacket* bfd,
   if (!jcr->plugin_ctx) { return 0; }
   plugin = (Plugin*)jcr->plugin_ctx->plugin;
 
+  // already opened by FillBackupStreams()
+  if (PluginStreamReader* reader = CurrentStreamReader(jcr)) {
+    int io_errno;
+    int status = reader->OpenStatus(io_errno);
+    bfd->BErrNo = io_errno;
+    errno = io_errno;
+    bfd->do_io_in_core = false;
+    bfd->filedes = status < 0 ? kInvalidFiledescriptor : 0;
+    return status;
+  }
+
   io.filedes = kInvalidFiledescriptor;
 
   io.func = IO_OPEN;
@@ -1868,6 +2032,15 @@ static int MyPluginBclose(BareosFilePacket* bfd)
   if (!jcr->plugin_ctx) { return 0; }
   plugin = (Plugin*)jcr->plugin_ctx->plugin;
 
+  if (PluginStreamReader* reader = CurrentStreamReader(jcr)) {
+    int io_errno;
+    int status = reader->Close(io_errno);
+    bfd->BErrNo = io_errno;
+    errno = io_errno;
+    bfd->filedes = kInvalidFiledescriptor;
+    return status;
+  }
+
   io.filedes = bfd->filedes;
 
   io.func = IO_CLOSE;
@@ -1901,6 +2074,15 @@ static ssize_t MyPluginBread(BareosFilePacket* bfd, void* buf, size_t count)
   if (!jcr->plugin_ctx) { return 0; }
   plugin = (Plugin*)jcr->plugin_ctx->plugin;
 
+  if (PluginStreamReader* reader = CurrentStreamReader(jcr)) {
+    int io_errno;
+    ssize_t status = reader->Read(static_cast<char*>(buf), count, bfd->offset,
+                                  io_errno);
+    bfd->BErrNo = io_errno;
+    errno = io_errno;
+    return status;
+  }
+
   io.filedes = bfd->filedes;
 
   io.func = IO_READ;
@@ -2141,6 +2323,21 @@ static bRC bareosSetValue(PluginContext* ctx, bVariable var, const void* value)
     case bVarFileSeen:
       if (!AccurateMarkFileAsSeen(jcr, (char*)value)) { return bRC_Error; }
       break;
+    case bVarBackupStreams: {
+      const int streams = *static_cast<const int*>(value);
+      if (streams < 1 || streams > max_backup_streams) {
+        Jmsg2(jcr, M_ERROR, 0,
+              T_("Plugin asked for %d backup streams, but at most %d are "
+                 "supported.\n"),
+              streams, max_backup_streams);
+        return bRC_Error;
+      }
+      static_cast<FiledPluginContext*>(ctx->core_private_context)
+          ->backup_streams
+          = streams;
+      Dmsg1(100, "backup_streams set to %d\n", streams);
+      return bRC_OK;
+    }
     default:
       Jmsg1(jcr, M_ERROR, 0,
             "Warning: bareosSetValue not implemented for var %d.\n", var);
@@ -160,6 +160,7 @@ struct io_pkt {
   boffset_t offset{};               /* Lseek argument */
   bool win32{};                     /* Win32 GetLastError returned */
   int filedes{};                    /* file descriptor to read/write in core */
+  int32_t stream{};                 /* Backup stream, see bVarBackupStreams */
   int32_t pkt_end{sizeof(io_pkt)};  /* End packet sentinel */
 };
 
@@ -213,6 +214,7 @@ typedef enum
   bVarCheckChanges = 20,
   bVarUsedConfig = 21,
   bVarPluginPath = 22,
+  bVarBackupStreams = 23,
 } bVariable;
 
 // Events that are passed to plugin
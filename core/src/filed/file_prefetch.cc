@@ -0,0 +1,177 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "include/bareos.h"
+#include "include/fcntl_def.h"
+#include "filed/file_prefetch.h"
+
+#if !defined(HAVE_MSVC)
+#  include <unistd.h>
+#endif
+#include <cstring>
+#include <string_view>
+
+namespace filedaemon {
+
+static constexpr int debuglevel = 400;
+
+FilePrefetcher::FilePrefetcher(thread_pool& pool,
+                               std::size_t num_workers,
+                               std::size_t max_file_size,
+                               std::size_t max_files)
+    : max_file_size_{max_file_size}
+    , max_files_{max_files}
+    , num_workers_{num_workers}
+    , group_{max_files}
+{
+  ASSERT(num_workers_ > 0);
+  *running_workers_.lock() = num_workers_;
+  pool.borrow_threads(num_workers_, [this] {
+    group_.work_until_completion();
+
+    *running_workers_.lock() -= 1;
+    workers_done_.notify_one();
+  });
+}
+
+FilePrefetcher::~FilePrefetcher()
+{
+  group_.shutdown();
+  running_workers_.lock().wait(workers_done_,
+                               [](std::size_t num) { return num == 0; });
+  pending_.clear();
+}
+
+std::optional<FilePrefetcher::prefetched_file> FilePrefetcher::ReadFile(
+    const std::string& fname,
+    bool noatime,
+    time_t changed_since,
+    std::size_t max_size)
+{
+  int flags = O_RDONLY | O_BINARY;
+#if defined(O_NOATIME)
+  if (noatime) { flags |= O_NOATIME; }
+#else
+  (void)noatime;
+#endif
+  int fd = open(fname.c_str(), flags);
+#if defined(O_NOATIME)
+  // O_NOATIME is only allowed for the owner of the file (or root)
+  if (fd < 0 && noatime && errno == EPERM) {
+    fd = open(fname.c_str(), flags & ~O_NOATIME);
+  }
+#endif
+  if (fd < 0) { return std::nullopt; }
+
+  std::optional<prefetched_file> file{std::in_place};
+  if (fstat(fd, &file->statp) != 0 || !S_ISREG(file->statp.st_mode)
+      || static_cast<std::size_t>(file->statp.st_size) > max_size) {
+    close(fd);
+    return std::nullopt;
+  }
+
+  if (changed_since != 0 && file->statp.st_mtime < changed_since
+      && file->statp.st_ctime < changed_since) {
+    close(fd);
+    return std::nullopt;
+  }
+
+  std::size_t size = file->statp.st_size;
+  file->data.resize(size);
+  std::size_t done = 0;
+  while (done < size) {
+    ssize_t num = read(fd, file->data.data() + done, size - done);
+    if (num < 0 && errno == EINTR) { continue; }
+    if (num <= 0) { break; }
+    done += num;
+  }
+
+  // a short read means that the file changed while we were reading it
+  char probe;
+  bool at_eof = (done == size) && (read(fd, &probe, 1) == 0);
+  close(fd);
+
+  if (!at_eof) { return std::nullopt; }
+  return file;
+}
+
+void FilePrefetcher::Prefetch(const char* fname,
+                              bool noatime,
+                              time_t changed_since)
+{
+  while (pending_.size() >= max_files_) {
+    // the oldest entries are most likely the ones that got skipped
+    pending_.pop_front();
+  }
+
+  std::string name{fname};
+  const char* last_sep = strrchr(fname, '/');
+  std::size_t dir_len = last_sep ? last_sep - fname : 0;
+
+  auto fut = group_.submit(
+      [name, noatime, changed_since, max_size = max_file_size_]() {
+        return ReadFile(name, noatime, changed_since, max_size);
+      });
+
+  pending_.push_back(pending_file{std::move(name), dir_len, std::move(fut)});
+}
+
+std::optional<std::vector<char>> FilePrefetcher::Take(const char* fname,
+                                                      const struct stat& statp)
+{
+  auto it = pending_.begin();
+  for (; it != pending_.end(); ++it) {
+    if (it->name == fname) { break; }
+  }
+  if (it == pending_.end()) { return std::nullopt; }
+
+  /* Files are visited in the order they were prefetched, so older entries
+   * of the same directory were skipped and will never be asked for. */
+  std::string_view dir{fname, it->dir_len};
+  for (auto older = pending_.begin(); older != it;) {
+    if (older->dir_len == dir.size()
+        && std::string_view{older->name}.substr(0, older->dir_len) == dir) {
+      older = pending_.erase(older);
+    } else {
+      ++older;
+    }
+  }
+
+  std::optional<prefetched_file> file = it->content.get();
+  pending_.erase(it);
+
+  if (!file) { return std::nullopt; }
+
+  auto& prefetched = file->statp;
+  if (prefetched.st_dev != statp.st_dev || prefetched.st_ino != statp.st_ino
+      || prefetched.st_size != statp.st_size
+      || prefetched.st_mtime != statp.st_mtime
+      || prefetched.st_ctime != statp.st_ctime) {
+    Dmsg1(debuglevel, "Prefetched %s changed; reading it again\n", fname);
+    return std::nullopt;
+  }
+
+  Dmsg2(debuglevel, "Using prefetched %s (%llu bytes)\n", fname,
+        static_cast<unsigned long long>(file->data.size()));
+  return std::move(file->data);
+}
+
+}  // namespace filedaemon
@@ -0,0 +1,99 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * read small files ahead of the backup loop
+ */
+
+#ifndef BAREOS_FILED_FILE_PREFETCH_H_
+#define BAREOS_FILED_FILE_PREFETCH_H_
+
+#include <sys/stat.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <future>
+#include <list>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "lib/thread_pool.h"
+
+namespace filedaemon {
+
+/* The backup loop handles one file after the other, so for trees with lots
+ * of small files we mostly wait on open()/read() latency.  The prefetcher
+ * gets told by findlib which files are going to be visited next and reads
+ * them on a couple of worker threads.  The backup loop then picks up the
+ * content again -- in its own order -- and sends it as usual, so the stream
+ * order the SD expects does not change. */
+class FilePrefetcher {
+ public:
+  FilePrefetcher(thread_pool& pool,
+                 std::size_t num_workers,
+                 std::size_t max_file_size,
+                 std::size_t max_files);
+  FilePrefetcher(const FilePrefetcher&) = delete;
+  FilePrefetcher& operator=(const FilePrefetcher&) = delete;
+  ~FilePrefetcher();
+
+  /* Start reading fname in the background.  If changed_since is not zero,
+   * files that were not modified after that time are not read as they
+   * will most likely not be saved. */
+  void Prefetch(const char* fname, bool noatime, time_t changed_since);
+
+  /* Return the prefetched content of fname, but only if the file did not
+   * change (according to statp) since it was read ahead. */
+  std::optional<std::vector<char>> Take(const char* fname,
+                                        const struct stat& statp);
+
+  std::size_t MaxFileSize() const { return max_file_size_; }
+
+ private:
+  struct prefetched_file {
+    struct stat statp {};
+    std::vector<char> data{};
+  };
+
+  struct pending_file {
+    std::string name;
+    std::size_t dir_len;
+    std::future<std::optional<prefetched_file>> content;
+  };
+
+  static std::optional<prefetched_file> ReadFile(const std::string& fname,
+                                                 bool noatime,
+                                                 time_t changed_since,
+                                                 std::size_t max_size);
+
+  std::size_t max_file_size_;
+  std::size_t max_files_;
+  std::size_t num_workers_;
+  std::list<pending_file> pending_{};
+  work_group group_;
+  std::condition_variable workers_done_{};
+  synchronized<std::size_t> running_workers_{};
+};
+
+}  // namespace filedaemon
+
+#endif  // BAREOS_FILED_FILE_PREFETCH_H_
@@ -31,6 +31,7 @@
 #endif
 #include "include/bareos.h"
 #include "include/exit_codes.h"
+#include "filed/change_sources.h"
 #include "filed/dir_cmd.h"
 #include "filed/filed.h"
 #include "filed/filed_globals.h"
@@ -42,6 +43,8 @@
 #include "lib/bnet_network_dump.h"
 #include "lib/bsignal.h"
 #include "lib/parse_conf.h"
+#include "lib/lock_profile.h"
+#include "lib/metrics_server.h"
 #include "lib/watchdog.h"
 #include "lib/util.h"
 #include "lib/address_conf.h"
@@ -230,6 +233,9 @@ int main(int argc, char* argv[])
   UnlockJcrChain();
   if (!no_signals) {
     StartWatchdog(); /* start watchdog thread */
+    StartMessageDelivery();
+    StartMetricsServer(me->metrics_address, me->metrics_port);
+    lock_profile::SetSampling(me->lock_profile_sampling);
     if (me->jcr_watchdog_time) {
       InitJcrSubsystem(
           me->jcr_watchdog_time); /* start JobControlRecord watchdogs etc. */
@@ -258,10 +264,12 @@ void TerminateFiled(int sig)
   }
   already_here = true;
   debug_level = 0; /* turn off debug */
+  StopMetricsServer();
   StopWatchdog();
 
   StopConnectToDirectorThreads(true);
   StopSocketServer();
+  StopFanotifyChangeLog();
 
   UnloadFdPlugins();
   FlushMntentCache();
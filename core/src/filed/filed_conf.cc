@@ -94,6 +94,19 @@ static ResourceItem cli_items[] = {
   {"MaximumConcurrentJobs", CFG_TYPE_PINT32, ITEM(res_client, MaxConcurrentJobs), 0, CFG_ITEM_DEFAULT | CFG_ITEM_DEPRECATED, "1000", NULL, NULL},
   {"MaximumWorkersPerJob", CFG_TYPE_PINT32, ITEM(res_client, MaxWorkersPerJob), 0, CFG_ITEM_DEFAULT, "2", "23.0.0-",
    "The maximum number of worker threads that bareos will use during backup."},
+  {"ReadAheadSize", CFG_TYPE_SIZE32, ITEM(res_client, read_ahead_size), 0, CFG_ITEM_DEFAULT, "0", "24.0.0-",
+   "Amount of data that gets requested from the os ahead of the current read position when backing up a file. "
+   "Larger values keep more requests in flight, which helps on fast or high latency storage. 0 leaves read ahead to the os."},
+  {"RestoreReceiveAhead", CFG_TYPE_PINT32, ITEM(res_client, restore_receive_ahead), 0, CFG_ITEM_DEFAULT, "0", "24.0.0-",
+   "Number of records a restore receives from the storage daemon ahead of what was written, so that receiving the data"
+   " and writing it overlap.  0 receives every record only after the one before it was written."},
+  {"StorageDataConnections", CFG_TYPE_PINT32, ITEM(res_client, storage_data_connections), 0, CFG_ITEM_DEFAULT, "1", "24.0.0-",
+   "Number of connections the data of a backup is spread over when the File Daemon connects to the Storage Daemon."
+   " Several connections use more than one TCP flow (and core for TLS), which helps on long fat networks. 1 sends all"
+   " data over the connection of the job itself."},
+  {"CompressionDictionarySize", CFG_TYPE_SIZE32, ITEM(res_client, compression_dictionary_size), 0, CFG_ITEM_DEFAULT, "0", "24.0.0-",
+   "Maximum size of the dictionary that zstd compression of a job gets trained from the small files it backs up. The next"
+   " backup of the job compresses with it, which helps with many small files. 0 compresses every file on its own."},
   {"Messages", CFG_TYPE_RES, ITEM(res_client, messages), R_MSGS, 0, NULL, NULL, NULL},
   {"SdConnectTimeout", CFG_TYPE_TIME, ITEM(res_client, SDConnectTimeout), 0, CFG_ITEM_DEFAULT, "1800" /* 30 minutes */, NULL, NULL},
   {"HeartbeatInterval", CFG_TYPE_TIME, ITEM(res_client, heartbeat_interval), 0, CFG_ITEM_DEFAULT, "0", NULL, NULL},
@@ -113,14 +126,29 @@ static ResourceItem cli_items[] = {
   {"AllowBandwidthBursting", CFG_TYPE_BOOL, ITEM(res_client, allow_bw_bursting), 0, CFG_ITEM_DEFAULT, "false", NULL, NULL},
   {"AllowedScriptDir", CFG_TYPE_ALIST_DIR, ITEM(res_client, allowed_script_dirs), 0, 0, NULL, NULL, NULL},
   {"AllowedJobCommand", CFG_TYPE_ALIST_STR, ITEM(res_client, allowed_job_cmds), 0, 0, NULL, NULL, NULL},
+  {"VssIncludeWriters", CFG_TYPE_ALIST_STR, ITEM(res_client, vss_include_writers), 0, 0, NULL, "24.0.0-",
+   "Only let the VSS writers with these names (wildcards allowed) take part in the snapshots."},
+  {"VssExcludeWriters", CFG_TYPE_ALIST_STR, ITEM(res_client, vss_exclude_writers), 0, 0, NULL, "24.0.0-",
+   "Leave out the VSS writers with these names (wildcards allowed) from the snapshots."},
   {"AbsoluteJobTimeout", CFG_TYPE_PINT32, ITEM(res_client, jcr_watchdog_time), 0, 0, NULL, "14.2.0-", "Absolute time after which a Job gets terminated regardless of its progress" },
   {"AlwaysUseLmdb", CFG_TYPE_BOOL, ITEM(res_client, always_use_lmdb), 0, CFG_ITEM_DEFAULT | CFG_ITEM_DEPRECATED, "false", NULL,
    "Ensure that bareos always chooses the lmdb backend for accurate information regardless of the file list size.  Use LmdbThreshold = 0 instead."
   },
+  {"ChangeSource", CFG_TYPE_ALIST_STR, ITEM(res_client, change_sources), 0, 0, NULL, "24.0.0-",
+   "Let incremental and differential backups skip the directories in which these sources recorded no changes since the previous backup: usn (NTFS change journal, Windows), zfs, btrfs or fanotify (Linux)."},
   {"LmdbThreshold", CFG_TYPE_PINT32, ITEM(res_client, lmdb_threshold), 0, 0, NULL, NULL,
    "File count threshold after which bareos will use the lmdb backend to store accurate information."},
+  {"CompactAccurateThreshold", CFG_TYPE_PINT32, ITEM(res_client, compact_accurate_threshold), 0, 0, NULL, "24.0.0-",
+   "File count threshold after which bareos keeps the accurate information in a sorted and compressed list instead of a hash table. This needs much less memory but makes lookups slower. The lmdb backend takes precedence."},
   {"SecureEraseCommand", CFG_TYPE_STR, ITEM(res_client, secure_erase_cmdline), 0, 0, NULL, "15.2.1-",
       "Specify command that will be called when bareos unlinks files."},
+  {"MetricsPort", CFG_TYPE_PINT32, ITEM(res_client, metrics_port), 0, CFG_ITEM_DEFAULT, "0", "24.0.0-",
+   "Port on which metrics are served over HTTP in the OpenMetrics format (GET /metrics). 0 disables the endpoint."},
+  {"MetricsAddress", CFG_TYPE_STR, ITEM(res_client, metrics_address), 0, CFG_ITEM_DEFAULT, "localhost", "24.0.0-",
+   "Address on which the metrics endpoint listens."},
+  {"LockProfileSampling", CFG_TYPE_PINT32, ITEM(res_client, lock_profile_sampling), 0, CFG_ITEM_DEFAULT, "0", "24.0.0-",
+   "Sample one in this many lock acquisitions of every thread for the lock contention profile shown by status. 0 switches"
+   " the profile off."},
   {"LogTimestampFormat", CFG_TYPE_STR, ITEM(res_client, log_timestamp_format), 0, CFG_ITEM_DEFAULT, "%d-%b %H:%M", "15.2.3-", NULL},
     TLS_COMMON_CONFIG(res_client),
     TLS_CERT_CONFIG(res_client),
@@ -175,6 +203,7 @@ static struct s_kw CryptoCiphers[]
        {"camellia256", CRYPTO_CIPHER_CAMELLIA_256_CBC},
        {"aes128hmacsha1", CRYPTO_CIPHER_AES_128_CBC_HMAC_SHA1},
        {"aes256hmacsha1", CRYPTO_CIPHER_AES_256_CBC_HMAC_SHA1},
+       {"aes256gcm", CRYPTO_CIPHER_AES_256_GCM},
        {NULL, 0}};
 
 static void StoreCipher(LEX* lc, ResourceItem* item, int index, int)
@@ -393,8 +422,12 @@ static void FreeResource(BareosResource* res, int type)
       if (p->verid) { free(p->verid); }
       if (p->allowed_script_dirs) { delete p->allowed_script_dirs; }
       if (p->allowed_job_cmds) { delete p->allowed_job_cmds; }
+      if (p->vss_include_writers) { delete p->vss_include_writers; }
+      if (p->vss_exclude_writers) { delete p->vss_exclude_writers; }
+      if (p->change_sources) { delete p->change_sources; }
       if (p->secure_erase_cmdline) { free(p->secure_erase_cmdline); }
       if (p->log_timestamp_format) { free(p->log_timestamp_format); }
+      if (p->metrics_address) { free(p->metrics_address); }
       delete p;
       break;
     }
@@ -469,6 +502,9 @@ static bool SaveResource(int type, ResourceItem* items, int pass)
               res_client->tls_cert_.allowed_certificate_common_names_);
           p->allowed_script_dirs = res_client->allowed_script_dirs;
           p->allowed_job_cmds = res_client->allowed_job_cmds;
+          p->vss_include_writers = res_client->vss_include_writers;
+          p->vss_exclude_writers = res_client->vss_exclude_writers;
+          p->change_sources = res_client->change_sources;
         }
         break;
       }
@@ -98,6 +98,10 @@ class ClientResource
   MessagesResource* messages = nullptr; /* Daemon message handler */
   uint32_t MaxConcurrentJobs = 0;
   uint32_t MaxWorkersPerJob{0};
+  uint32_t read_ahead_size{0};         /* Bytes to read ahead per file */
+  uint32_t restore_receive_ahead{0};   /* Records received ahead on restore */
+  uint32_t storage_data_connections{1}; /* Connections for backup data */
+  uint32_t compression_dictionary_size{0}; /* Trained zstd dictionary */
   utime_t SDConnectTimeout = {0};       /* Timeout in seconds */
   utime_t heartbeat_interval = {0};     /* Interval to send heartbeats */
   uint32_t max_network_buffer_size = 0; /* Max network buf size */
@@ -115,6 +119,8 @@ class ClientResource
   bool always_use_lmdb = false; /* Use LMDB for accurate data */
   uint32_t lmdb_threshold = 0;  /* Switch to using LDMD when number of accurate
                                entries exceeds treshold. */
+  uint32_t compact_accurate_threshold = 0; /* Switch to the compact accurate
+                                              list above this many entries */
   X509_KEYPAIR* pki_keypair = nullptr; /* Shared PKI Public/Private Keypair */
 
   alist<X509_KEYPAIR*>* pki_signers = nullptr; /* Shared PKI Trusted Signers */
@@ -123,12 +129,21 @@ class ClientResource
       = nullptr; /* Only allow to run scripts in this directories */
   alist<const char*>* allowed_job_cmds = nullptr; /* Only allow the following
                                 Job commands to be executed */
+  alist<const char*>* vss_include_writers
+      = nullptr; /* Only use these VSS writers */
+  alist<const char*>* vss_exclude_writers
+      = nullptr; /* Leave out these VSS writers */
+  alist<const char*>* change_sources
+      = nullptr; /* Tell incrementals which directories changed */
   char* verid = nullptr; /* Custom Id to print in version command */
   char* secure_erase_cmdline = nullptr; /* Cmdline to execute to perform secure
                                   erase of file */
   char* log_timestamp_format = nullptr; /* Timestamp format to use in generic
                                  logging messages */
   uint64_t max_bandwidth_per_job = 0;   /* Bandwidth limitation (global) */
+  char* metrics_address = nullptr;      /* Address of the metrics endpoint */
+  uint32_t metrics_port = 0;            /* Port of the metrics endpoint */
+  uint32_t lock_profile_sampling = 0;   /* 0 or one in how many locks */
 };
 
 
@@ -25,17 +25,40 @@
 #define BAREOS_FILED_FILED_JCR_IMPL_H_
 
 #include "include/bareos.h"
+#include "lib/compression.h"
 #include "lib/crypto.h"
+#include "lib/stage_timer.h"
 #include "lib/thread_pool.h"
+#include "filed/file_prefetch.h"
+#include "filed/metadata_prefetch.h"
+#include "findlib/stat_ahead.h"
+#include "findlib/change_source.h"
 
 #include <atomic>
+#include <optional>
+#include <string>
+#include <thread>
 
 struct AclData;
 struct XattrData;
 
 namespace filedaemon {
 class BareosAccurateFilelist;
-}
+
+// the stages file data goes through during a backup
+enum class backup_stage
+{
+  kRead,     /**< reading the file */
+  kDigest,   /**< updating checksum and signing digest */
+  kCompress, /**< compressing */
+  kEncrypt,  /**< encrypting */
+  kNetwork,  /**< sending to the SD */
+  kCount
+};
+
+extern const char* const backup_stage_names[
+    static_cast<std::size_t>(backup_stage::kCount)];
+}  // namespace filedaemon
 
 /* clang-format off */
 struct CryptoContext {
@@ -61,6 +84,7 @@ struct FiledJcrImpl {
   bool incremental{};             /**< Set if incremental for SINCE */
   utime_t since_time{};           /**< Begin time for SINCE */
   int listing{};                  /**< Job listing in estimate */
+  bool estimating{};              /**< Set while an estimate runs */
   int32_t Ticket{};               /**< Ticket */
   char* big_buf{};                /**< I/O buffer */
   int32_t replace{};              /**< Replace options */
@@ -79,12 +103,26 @@ struct FiledJcrImpl {
   bool got_metadata{};            /**< Set when found job_metadata */
   bool multi_restore{};           /**< Dir can do multiple storage restore */
   filedaemon::BareosAccurateFilelist* file_list{}; /**< Previous file list (accurate mode) */
+  std::thread accurate_loader{};  /**< Fills file_list in the background */
+  bool accurate_load_ok{true};    /**< Set by accurate_loader when done */
+  bool binary_attributes{};       /**< Send the attributes in binary form */
   uint64_t base_size{};           /**< Compute space saved with base job */
   filedaemon::save_pkt* plugin_sp{}; /**< Plugin save packet */
 #ifdef HAVE_WIN32
   VSSClient* pVSSClient{};        /**< VSS Client Instance */
 #endif
+  std::unique_ptr<ChangeSources> change_sources{}; /**< ChangeSource directive */
   thread_pool threads;
+  std::unique_ptr<filedaemon::FilePrefetcher> prefetcher{}; /**< Reads small files ahead (uses threads) */
+  std::unique_ptr<StatAhead> stat_ahead{}; /**< Concurrent lstat() during the scan (uses threads) */
+  std::unique_ptr<filedaemon::MetadataPrefetcher> metadata_prefetcher{}; /**< Collects ACLs/xattrs ahead (uses threads) */
+  stage_timers<filedaemon::backup_stage> stage_times; /**< Backup pipeline */
+  std::unique_ptr<CompressionDictionaryTrainer> dictionary_trainer{}; /**< See CompressionDictionarySize */
+  std::string sd_address{};       /**< Storage daemon, for the data connections */
+  int sd_port{};                  /**< Port of the storage daemon */
+  std::string sd_data_key{};      /**< Auth key kept for the data connections */
+  std::vector<BareosSocket*> sd_data_connections{}; /**< See StorageDataConnections */
+  std::optional<std::string> resume_after{}; /**< Last file saved by the backup being resumed */
 };
 /* clang-format on */
 
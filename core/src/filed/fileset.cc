@@ -341,6 +341,12 @@ static int SetOptionsAndFlags(findFOPTS* fo, const char* opts)
             SetBit(FO_FORCE_ENCRYPT, fo->flags);
             p++;
             break;
+          case 'g':
+            if (*(p + 2) == '3') {
+              fo->Encryption_cipher = CRYPTO_CIPHER_AES_256_GCM;
+              p += 2;
+            }
+            break;
           case 'h':
             switch (*(p + 2)) {
               case '1':
@@ -425,6 +431,10 @@ static int SetOptionsAndFlags(findFOPTS* fo, const char* opts)
             SetBit(FO_XXH128, fo->flags);
             p++;
             break;
+          case '5':
+            SetBit(FO_XXH3_TREE, fo->flags);
+            p++;
+            break;
           default:
             /* If 2 or 3 is seen here, SHA2 is not configured, so eat the
              * option, and drop back to SHA-1. */
@@ -481,6 +491,11 @@ static int SetOptionsAndFlags(findFOPTS* fo, const char* opts)
             fo->Compress_algo = COMPRESS_FZ4H;
             fo->Compress_level = 1; /* not used with FZ4H */
           }
+        } else if (*p == 's' && B_ISDIGIT(p[1]) && B_ISDIGIT(p[2])) {
+          SetBit(FO_COMPRESS, fo->flags);
+          fo->Compress_algo = COMPRESS_ZSTD;
+          fo->Compress_level = (p[1] - '0') * 10 + (p[2] - '0');
+          p += 2; /* Skip level */
         }
         break;
       case 'z': /* Min, max or approx size or size range */
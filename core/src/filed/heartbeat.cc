@@ -37,94 +37,115 @@
 #include "lib/watchdog.h"
 #include "filed/heartbeat.h"
 
-#include <functional>
-
 namespace filedaemon {
 
 #define WAIT_INTERVAL 5
 
 extern bool no_signals;
 
-heartbeat_dir::heartbeat_dir(BareosSocket* sock, time_t interval)
-    : thread{std::mem_fn(&heartbeat_dir::send_heartbeat), this, sock, interval}
+static watchdog_t* StartHeartbeat(void (*callback)(watchdog_t*),
+                                  void* data,
+                                  time_t interval)
 {
+  watchdog_t* wd = NewWatchdog();
+  wd->one_shot = false;
+  wd->interval = interval;
+  wd->callback = callback;
+  wd->data = data;
+  RegisterWatchdog(wd);
+  return wd;
 }
 
-void heartbeat_dir::send_heartbeat(BareosSocket* sock, time_t interval)
+// Waits for a callback that is running right now.
+static void StopHeartbeat(watchdog_t* wd)
 {
-  sock->suppress_error_msgs_ = true;
-  time_t last_heartbeat = time(NULL);
+  UnregisterWatchdog(wd);
+  free(wd);
+}
 
-  while (!sock->IsStop() && !stop_requested) {
-    time_t now = time(NULL);
-    time_t since_last = now - last_heartbeat;
-    if (since_last >= interval) {
-      sock->signal(BNET_HEARTBEAT);
-      if (sock->IsStop() || stop_requested) { break; }
-      last_heartbeat = now;
-      Bmicrosleep(interval, 0);
-    } else {
-      Bmicrosleep(interval - since_last, 0);
-    }
-  }
-  sock->close();
+heartbeat_dir::heartbeat_dir(BareosSocket* sock, time_t interval) : dir{sock}
+{
+  dir->suppress_error_msgs_ = true;
+  wd = StartHeartbeat(&heartbeat_dir::Callback, this, interval);
+}
 
-  delete sock;
+void heartbeat_dir::Callback(watchdog_t* self)
+{
+  static_cast<heartbeat_dir*>(self->data)->Send();
 }
 
-heartbeat_dir::~heartbeat_dir()
+void heartbeat_dir::Send()
 {
-  stop_requested = true;
-  pthread_kill(static_cast<pthread_t>(thread.native_handle()), kTimeoutSignal);
-  thread.join();
+  if (stopped || dir->IsStop()) {
+    stopped = true;
+    return;
+  }
+  dir->signal(BNET_HEARTBEAT);
 }
 
-heartbeat_sd_dir::heartbeat_sd_dir(BareosSocket* sd,
-                                   BareosSocket* dir,
-                                   time_t interval)
-    : thread{std::mem_fn(&heartbeat_sd_dir::send_heartbeat), this, sd, dir,
-             interval}
+heartbeat_dir::~heartbeat_dir()
 {
+  StopHeartbeat(wd);
+  dir->close();
+
+  delete dir;
 }
 
-void heartbeat_sd_dir::send_heartbeat(BareosSocket* sd,
-                                      BareosSocket* dir,
-                                      time_t interval)
+heartbeat_sd_dir::heartbeat_sd_dir(BareosSocket* t_sd,
+                                   BareosSocket* t_dir,
+                                   time_t t_interval)
+    : sd{t_sd}, dir{t_dir}, interval{t_interval}, last_heartbeat{time(NULL)}
 {
   dir->suppress_error_msgs_ = true;
   sd->suppress_error_msgs_ = true;
+  wd = StartHeartbeat(&heartbeat_sd_dir::Callback, this, WAIT_INTERVAL);
+}
 
-  time_t last_heartbeat = time(NULL);
-
-  /* Hang reading the socket to the SD, and every time we get
-   * a heartbeat or we get a wait timeout (5 seconds), we
-   * check to see if we need to send a heartbeat to the
-   * Director.
-   */
-  while (!sd->IsStop() && !stop_requested) {
-    std::int32_t n = BnetWaitDataIntr(sd, WAIT_INTERVAL);
-    if (n < 0 || sd->IsStop() || stop_requested) { break; }
-    if (interval) {
-      time_t now = time(NULL);
-      if (now - last_heartbeat >= interval) {
-        dir->signal(BNET_HEARTBEAT);
-        if (dir->IsStop() || stop_requested) { break; }
-        last_heartbeat = now;
-      }
+void heartbeat_sd_dir::Callback(watchdog_t* self)
+{
+  static_cast<heartbeat_sd_dir*>(self->data)->Poll();
+}
+
+/* Every wait interval (5 seconds) read what the SD sent in the meantime --
+ * probably heartbeats -- and check to see if we need to send a heartbeat to
+ * the Director.  This never waits for the SD, as the watchdog thread is
+ * shared by all jobs. */
+void heartbeat_sd_dir::Poll()
+{
+  if (stopped || sd->IsStop()) {
+    stopped = true;
+    return;
+  }
+  if (interval) {
+    time_t now = time(NULL);
+    if (now - last_heartbeat >= interval) {
+      dir->signal(BNET_HEARTBEAT);
+      last_heartbeat = now;
+    }
+  }
+
+  std::int32_t n;
+  while ((n = BnetWaitData(sd, 0)) == 1) { /* input waiting */
+    std::int32_t received = sd->recv(); /* read it */
+    if (received < 0 && received != BNET_SIGNAL) {
+      n = -1;
+      break;
     }
-    if (n == 1) { /* input waiting */
-      sd->recv(); /* read it -- probably heartbeat from sd */
-      if (sd->IsStop() || stop_requested) { break; }
-      if (sd->message_length <= 0) {
-        Dmsg1(100, "Got BNET_SIG %d from SD\n", sd->message_length);
-      } else {
-        Dmsg2(100, "Got %d bytes from SD. MSG=%s\n", sd->message_length,
-              sd->msg);
-      }
+    if (sd->IsStop()) { break; }
+    if (sd->message_length <= 0) {
+      Dmsg1(100, "Got BNET_SIG %d from SD\n", sd->message_length);
+    } else {
+      Dmsg2(100, "Got %d bytes from SD. MSG=%s\n", sd->message_length,
+            sd->msg);
     }
-    Dmsg2(200, "wait_intr=%d stop=%d\n", n, IsBnetStop(sd));
   }
+  Dmsg2(200, "wait=%d stop=%d\n", n, IsBnetStop(sd));
+  if (n < 0 || sd->IsStop()) { stopped = true; }
+}
 
+heartbeat_sd_dir::~heartbeat_sd_dir()
+{
+  StopHeartbeat(wd);
   sd->close();
   dir->close();
 
@@ -132,13 +153,6 @@ void heartbeat_sd_dir::send_heartbeat(BareosSocket* sd,
   delete dir;
 }
 
-heartbeat_sd_dir::~heartbeat_sd_dir()
-{
-  stop_requested = true;
-  pthread_kill(static_cast<pthread_t>(thread.native_handle()), kTimeoutSignal);
-  thread.join();
-}
-
 std::optional<heartbeat_sd_dir> MakeHeartbeatMonitor(JobControlRecord* jcr)
 {
   if (no_signals) { return std::nullopt; }
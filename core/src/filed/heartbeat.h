@@ -24,18 +24,26 @@
 #ifndef BAREOS_FILED_HEARTBEAT_H_
 #define BAREOS_FILED_HEARTBEAT_H_
 
-#include <thread>
-#include <atomic>
 #include <optional>
 
+struct s_watchdog_t;
+class BareosSocket;
+
 namespace filedaemon {
 
+/* Both heartbeats are callbacks of the watchdog thread of the daemon instead
+ * of threads of their own. */
 class heartbeat_sd_dir {
-  std::atomic<bool> stop_requested{false};
-  std::thread thread;
+  BareosSocket* sd;
+  BareosSocket* dir;
+  time_t interval;
+  time_t last_heartbeat;
+  bool stopped{false};
+  s_watchdog_t* wd{nullptr};
 
  protected:
-  void send_heartbeat(BareosSocket* sd, BareosSocket* dir, time_t interval);
+  static void Callback(s_watchdog_t* self);
+  void Poll();
 
  public:
   heartbeat_sd_dir(BareosSocket* sd, BareosSocket* dir, time_t interval);
@@ -49,11 +57,13 @@ class heartbeat_sd_dir {
 };
 
 class heartbeat_dir {
-  std::atomic<bool> stop_requested{false};
-  std::thread thread;
+  BareosSocket* dir;
+  bool stopped{false};
+  s_watchdog_t* wd{nullptr};
 
  protected:
-  void send_heartbeat(BareosSocket* dir, time_t interval);
+  static void Callback(s_watchdog_t* self);
+  void Send();
 
  public:
   heartbeat_dir(BareosSocket* dir, time_t interval);
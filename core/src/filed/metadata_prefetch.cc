@@ -0,0 +1,145 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "include/bareos.h"
+#include "filed/metadata_prefetch.h"
+#include "findlib/fstype.h"
+
+#include <cstring>
+#include <string_view>
+
+namespace filedaemon {
+
+static constexpr int debuglevel = 400;
+
+MetadataPrefetcher::MetadataPrefetcher(thread_pool& pool,
+                                       std::size_t num_workers,
+                                       std::size_t max_files)
+    : max_files_{max_files}, num_workers_{num_workers}, group_{max_files}
+{
+  ASSERT(num_workers_ > 0);
+  *running_workers_.lock() = num_workers_;
+  pool.borrow_threads(num_workers_, [this] {
+    group_.work_until_completion();
+
+    *running_workers_.lock() -= 1;
+    workers_done_.notify_one();
+  });
+}
+
+MetadataPrefetcher::~MetadataPrefetcher()
+{
+  group_.shutdown();
+  running_workers_.lock().wait(workers_done_,
+                               [](std::size_t num) { return num == 0; });
+  pending_.clear();
+}
+
+std::optional<MetadataPrefetcher::collected> MetadataPrefetcher::Collect(
+    const std::string& fname,
+    bool acl,
+    bool xattr,
+    time_t changed_since)
+{
+  /* Stat first: any change of the ACL or the xattrs after this point
+   * changes the ctime, which Take() then notices. */
+  std::optional<collected> file{std::in_place};
+  if (lstat(fname.c_str(), &file->statp) != 0
+      || !S_ISREG(file->statp.st_mode)) {
+    return std::nullopt;
+  }
+
+  if (changed_since != 0 && file->statp.st_mtime < changed_since
+      && file->statp.st_ctime < changed_since) {
+    return std::nullopt;
+  }
+
+  uint32_t dev = file->statp.st_dev;
+  if (acl && !FstypeUnsupported(dev, FS_FEATURE_ACL)) {
+    file->data.trivial_access_acl = HasTrivialAccessAcl(fname.c_str());
+  }
+  if (xattr && !FstypeUnsupported(dev, FS_FEATURE_XATTR)) {
+    file->data.xattrs = CollectXattrs(fname.c_str());
+  }
+  return file;
+}
+
+void MetadataPrefetcher::Prefetch(const char* fname,
+                                  bool acl,
+                                  bool xattr,
+                                  time_t changed_since)
+{
+  if (!acl && !xattr) { return; }
+
+  while (pending_.size() >= max_files_) {
+    // the oldest entries are most likely the ones that got skipped
+    pending_.pop_front();
+  }
+
+  std::string name{fname};
+  const char* last_sep = strrchr(fname, '/');
+  std::size_t dir_len = last_sep ? last_sep - fname : 0;
+
+  auto fut = group_.submit([name, acl, xattr, changed_since]() {
+    return Collect(name, acl, xattr, changed_since);
+  });
+
+  pending_.push_back(pending_file{std::move(name), dir_len, std::move(fut)});
+}
+
+std::optional<MetadataPrefetcher::metadata> MetadataPrefetcher::Take(
+    const char* fname,
+    const struct stat& statp)
+{
+  auto it = pending_.begin();
+  for (; it != pending_.end(); ++it) {
+    if (it->name == fname) { break; }
+  }
+  if (it == pending_.end()) { return std::nullopt; }
+
+  /* Files are visited in the order they were prefetched, so older entries
+   * of the same directory were skipped and will never be asked for. */
+  std::string_view dir{fname, it->dir_len};
+  for (auto older = pending_.begin(); older != it;) {
+    if (older->dir_len == dir.size()
+        && std::string_view{older->name}.substr(0, older->dir_len) == dir) {
+      older = pending_.erase(older);
+    } else {
+      ++older;
+    }
+  }
+
+  std::optional<collected> file = it->content.get();
+  pending_.erase(it);
+
+  if (!file) { return std::nullopt; }
+
+  auto& prefetched = file->statp;
+  if (prefetched.st_dev != statp.st_dev || prefetched.st_ino != statp.st_ino
+      || prefetched.st_ctime != statp.st_ctime) {
+    Dmsg1(debuglevel, "Metadata of %s changed; collecting it again\n", fname);
+    return std::nullopt;
+  }
+
+  return std::move(file->data);
+}
+
+}  // namespace filedaemon
@@ -0,0 +1,103 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * collect the ACLs and xattrs of files ahead of the backup loop
+ */
+
+#ifndef BAREOS_FILED_METADATA_PREFETCH_H_
+#define BAREOS_FILED_METADATA_PREFETCH_H_
+
+#include <sys/stat.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <future>
+#include <list>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "findlib/find.h"
+#include "lib/thread_pool.h"
+
+namespace filedaemon {
+
+/* Looking up the ACL and the extended attributes of a file takes several
+ * calls even if it has none, which on network filesystems costs several
+ * round trips per file.  Like the FilePrefetcher this gets told which files
+ * are going to be visited next and collects that data on a couple of worker
+ * threads, the backup loop then builds the streams from it as usual.
+ * Filesystems known to lack xattr or ACL support are not asked at all. */
+class MetadataPrefetcher {
+ public:
+  struct metadata {
+    bool trivial_access_acl{false}; /**< see HasTrivialAccessAcl() */
+    std::optional<std::vector<prefetched_xattr_t>> xattrs{};
+  };
+
+  MetadataPrefetcher(thread_pool& pool,
+                     std::size_t num_workers,
+                     std::size_t max_files);
+  MetadataPrefetcher(const MetadataPrefetcher&) = delete;
+  MetadataPrefetcher& operator=(const MetadataPrefetcher&) = delete;
+  ~MetadataPrefetcher();
+
+  /* Start collecting the ACL and/or the xattrs of fname in the background.
+   * If changed_since is not zero, files that were not changed after that
+   * time are skipped as they will most likely not be saved. */
+  void Prefetch(const char* fname,
+                bool acl,
+                bool xattr,
+                time_t changed_since);
+
+  /* Return what was collected for fname, but only if the file did not
+   * change (according to statp) since then. */
+  std::optional<metadata> Take(const char* fname, const struct stat& statp);
+
+ private:
+  struct collected {
+    struct stat statp {};
+    metadata data{};
+  };
+
+  struct pending_file {
+    std::string name;
+    std::size_t dir_len;
+    std::future<std::optional<collected>> content;
+  };
+
+  static std::optional<collected> Collect(const std::string& fname,
+                                          bool acl,
+                                          bool xattr,
+                                          time_t changed_since);
+
+  std::size_t max_files_;
+  std::size_t num_workers_;
+  std::list<pending_file> pending_{};
+  work_group group_;
+  std::condition_variable workers_done_{};
+  synchronized<std::size_t> running_workers_{};
+};
+
+}  // namespace filedaemon
+
+#endif  // BAREOS_FILED_METADATA_PREFETCH_H_
@@ -0,0 +1,206 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "include/bareos.h"
+#include "filed/plugin_streams.h"
+
+#if !defined(HAVE_MSVC)
+#  include <unistd.h>
+#endif
+#include <algorithm>
+#include <cstring>
+
+namespace filedaemon {
+
+static constexpr int debuglevel = 150;
+static constexpr std::size_t chunk_size = 64 * 1024;
+
+PluginStreamReader::PluginStreamReader(PluginContext* ctx,
+                                       io_function plugin_io,
+                                       int32_t stream,
+                                       std::size_t max_buffered)
+    : ctx_{ctx}
+    , plugin_io_{plugin_io}
+    , stream_{stream}
+    , max_buffered_{std::max(max_buffered, chunk_size)}
+{
+}
+
+PluginStreamReader::~PluginStreamReader()
+{
+  int io_errno;
+  Close(io_errno);
+}
+
+void PluginStreamReader::Open(const char* fname, int flags, mode_t mode)
+{
+  io_pkt io;
+  io.func = IO_OPEN;
+  io.fname = fname;
+  io.flags = flags;
+  io.mode = mode;
+  io.filedes = kInvalidFiledescriptor;
+  io.stream = stream_;
+
+  bRC res = plugin_io_(ctx_, &io);
+  open_errno_ = io.io_errno;
+  if (res == bRC_Error || io.status < 0) {
+    open_status_ = -1;
+    closed_ = true;
+    return;
+  }
+
+  // see MyPluginBopen() for the two ways a plugin can answer IO_OPEN
+  filedes_ = io.filedes;
+  in_core_ = io.status == IoStatus::do_io_in_core;
+  if (in_core_ && filedes_ == kInvalidFiledescriptor) {
+    Dmsg1(debuglevel, "stream %d: plugin did not return a filedescriptor\n",
+          stream_);
+    open_status_ = -1;
+    open_errno_ = EBADF;
+    int io_errno;
+    Close(io_errno);
+    return;
+  }
+
+  open_status_ = 0;
+  Dmsg2(debuglevel, "stream %d: reading %s ahead\n", stream_, fname);
+  thread_ = std::thread([this] { Run(); });
+}
+
+int PluginStreamReader::OpenStatus(int& io_errno) const
+{
+  io_errno = open_errno_;
+  return open_status_;
+}
+
+PluginStreamReader::chunk PluginStreamReader::ReadChunk()
+{
+  chunk c;
+  c.data.resize(chunk_size);
+  c.io_errno = 0;
+
+  if (in_core_) {
+    ssize_t num;
+    do {
+      num = read(filedes_, c.data.data(), c.data.size());
+    } while (num < 0 && errno == EINTR);
+    c.status = num;
+    c.offset = 0;
+    if (num < 0) { c.io_errno = errno; }
+  } else {
+    io_pkt io;
+    io.func = IO_READ;
+    io.count = c.data.size();
+    io.buf = c.data.data();
+    io.filedes = filedes_;
+    io.stream = stream_;
+    plugin_io_(ctx_, &io);
+    c.status = io.status;
+    c.offset = io.offset;
+    c.io_errno = io.io_errno;
+  }
+
+  c.data.resize(c.status > 0 ? c.status : 0);
+  return c;
+}
+
+void PluginStreamReader::Run()
+{
+  for (;;) {
+    {
+      std::unique_lock lock(mutex_);
+      space_.wait(lock,
+                  [this] { return buffered_ < max_buffered_ || stopping_; });
+      if (stopping_) { break; }
+    }
+
+    chunk c = ReadChunk();
+    bool last = c.status <= 0;
+
+    std::unique_lock lock(mutex_);
+    buffered_ += c.data.size();
+    chunks_.push_back(std::move(c));
+    arrived_.notify_one();
+    if (last) { break; }
+  }
+
+  std::unique_lock lock(mutex_);
+  finished_ = true;
+  arrived_.notify_one();
+}
+
+ssize_t PluginStreamReader::Read(char* buf,
+                                 std::size_t count,
+                                 boffset_t& offset,
+                                 int& io_errno)
+{
+  io_errno = 0;
+  std::unique_lock lock(mutex_);
+  arrived_.wait(lock, [this] { return !chunks_.empty() || finished_; });
+  if (chunks_.empty()) { return 0; }
+
+  chunk& c = chunks_.front();
+  if (c.status <= 0) {
+    // leave the end marker (or the error) for the following calls
+    io_errno = c.io_errno;
+    return c.status;
+  }
+
+  std::size_t num = std::min(count, c.data.size() - consumed_);
+  memcpy(buf, c.data.data() + consumed_, num);
+  offset = c.offset + consumed_;
+  consumed_ += num;
+  if (consumed_ == c.data.size()) {
+    buffered_ -= c.data.size();
+    chunks_.pop_front();
+    consumed_ = 0;
+    space_.notify_one();
+  }
+  return num;
+}
+
+int PluginStreamReader::Close(int& io_errno)
+{
+  io_errno = 0;
+  if (closed_) { return 0; }
+  closed_ = true;
+
+  {
+    std::unique_lock lock(mutex_);
+    stopping_ = true;
+  }
+  space_.notify_one();
+  if (thread_.joinable()) { thread_.join(); }
+  chunks_.clear();
+  buffered_ = 0;
+
+  io_pkt io;
+  io.func = IO_CLOSE;
+  io.filedes = filedes_;
+  io.stream = stream_;
+  plugin_io_(ctx_, &io);
+  io_errno = io.io_errno;
+  filedes_ = kInvalidFiledescriptor;
+  return io.status;
+}
+
+}  // namespace filedaemon
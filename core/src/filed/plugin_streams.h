@@ -0,0 +1,105 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * read the data of plugin files ahead, one thread per stream
+ */
+
+#ifndef BAREOS_FILED_PLUGIN_STREAMS_H_
+#define BAREOS_FILED_PLUGIN_STREAMS_H_
+
+#include "filed/fd_plugins.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace filedaemon {
+
+/* A plugin that sets bVarBackupStreams to n > 1 gets up to n files opened
+ * at once, each with its own io_pkt.stream (1 .. n), and pluginIO() is
+ * called for them from different threads at the same time.  Every open
+ * file is read ahead by one thread into a bounded buffer, the backup loop
+ * then sends the data file after file as the SD expects it. */
+class PluginStreamReader {
+ public:
+  using io_function = bRC (*)(PluginContext* ctx, io_pkt* io);
+
+  PluginStreamReader(PluginContext* ctx,
+                     io_function plugin_io,
+                     int32_t stream,
+                     std::size_t max_buffered);
+  PluginStreamReader(const PluginStreamReader&) = delete;
+  PluginStreamReader& operator=(const PluginStreamReader&) = delete;
+  ~PluginStreamReader();
+
+  /* Sends IO_OPEN and starts reading in the background.  A failed open is
+   * only reported (with its errno) by OpenStatus(), i.e. when the backup
+   * loop gets to the file. */
+  void Open(const char* fname, int flags, mode_t mode);
+  int OpenStatus(int& io_errno) const;
+
+  // Like IO_READ: returns the number of bytes, 0 at the end or -1.
+  ssize_t Read(char* buf, std::size_t count, boffset_t& offset, int& io_errno);
+
+  // Stops reading and sends IO_CLOSE, returns its status.
+  int Close(int& io_errno);
+
+  int32_t stream() const { return stream_; }
+
+ private:
+  struct chunk {
+    std::vector<char> data;
+    boffset_t offset;
+    int32_t status; /* <= 0: end of file or error */
+    int32_t io_errno;
+  };
+
+  void Run();
+  chunk ReadChunk();
+
+  PluginContext* ctx_;
+  io_function plugin_io_;
+  int32_t stream_;
+  std::size_t max_buffered_;
+  int open_status_{-1};
+  int open_errno_{0};
+  bool in_core_{false}; /* plugin lets us read filedes_ ourselves */
+  int filedes_{kInvalidFiledescriptor};
+  bool closed_{false};
+
+  std::mutex mutex_;
+  std::condition_variable space_;
+  std::condition_variable arrived_;
+  std::deque<chunk> chunks_;
+  std::size_t buffered_{0};
+  std::size_t consumed_{0}; /* of chunks_.front() */
+  bool stopping_{false};
+  bool finished_{false};
+  std::thread thread_;
+};
+
+}  // namespace filedaemon
+
+#endif  // BAREOS_FILED_PLUGIN_STREAMS_H_
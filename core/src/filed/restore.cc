@@ -52,6 +52,12 @@
 #include "lib/serial.h"
 #include "lib/compression.h"
 #include "lib/version.h"
+#include "lib/channel.h"
+
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
 
 #ifdef HAVE_WIN32
 #  include "win32/findlib/win32.h"
@@ -96,6 +102,89 @@ const bool have_xattr = false;
 // Data received from Storage Daemon
 static char rec_header[] = "rechdr %ld %ld %ld %ld %ld";
 
+namespace {
+struct received_record {
+  PoolMem header{PM_MESSAGE};
+  PoolMem data{PM_MESSAGE};
+  int32_t data_len{0};
+};
+
+/* Receives the records of the Storage daemon on its own thread, so that
+ * decompressing and writing the data does not wait for the network and the
+ * network does not wait for the disk.  With a capacity of 0 every record is
+ * received on the calling thread when it is asked for. */
+class RecordReceiver {
+ public:
+  RecordReceiver(BareosSocket* t_sd, std::size_t capacity) : sd{t_sd}
+  {
+    if (capacity > 0) {
+      auto [in, out]
+          = channel::CreateBufferedChannel<received_record>(capacity);
+      input.emplace(std::move(in));
+      output.emplace(std::move(out));
+      receive_thread = std::thread{enlist, this};
+    }
+  }
+
+  // false once there are no more records
+  bool Next(received_record& rec)
+  {
+    if (!output) { return Receive(rec); }
+    std::optional<received_record> next = output->get();
+    if (!next) { return false; }
+    rec = std::move(*next);
+    return true;
+  }
+
+  /* Stops receiving (also if not all records were taken) and returns the
+   * error if the data of a record could not be received. */
+  std::optional<std::string> Finish()
+  {
+    if (output) { output->close(); }
+    if (receive_thread.joinable()) { receive_thread.join(); }
+    std::unique_lock lock(error_mutex);
+    return error;
+  }
+
+  ~RecordReceiver() { Finish(); }
+
+ private:
+  BareosSocket* sd;
+  std::optional<channel::input<received_record>> input;
+  std::optional<channel::output<received_record>> output;
+  std::mutex error_mutex;
+  std::optional<std::string> error;
+  std::thread receive_thread;
+
+  // the received messages trade their buffers with the socket
+  bool Receive(received_record& rec)
+  {
+    if (BgetMsg(sd) < 0) { return false; }
+    std::swap(rec.header.addr(), sd->msg);
+
+    if (BgetMsg(sd) < 0) {
+      std::unique_lock lock(error_mutex);
+      error.emplace(sd->bstrerror());
+      return false;
+    }
+    std::swap(rec.data.addr(), sd->msg);
+    rec.data_len = sd->message_length;
+    return true;
+  }
+
+  void do_work()
+  {
+    for (;;) {
+      received_record rec;
+      if (!Receive(rec) || !input->emplace(std::move(rec))) { break; }
+    }
+    input->close();
+  }
+
+  static void enlist(RecordReceiver* receiver) { receiver->do_work(); }
+};
+}  // namespace
+
 // Forward referenced functions
 #if defined(HAVE_LIBZ)
 const bool have_libz = true;
@@ -191,7 +280,8 @@ static inline void DropDelayedDataStreams(r_ctx& rctx, bool reuse)
 }
 
 // Push a data stream onto the delayed restore stack for later processing.
-static inline void PushDelayedDataStream(r_ctx& rctx, BareosSocket* sd)
+static inline void PushDelayedDataStream(r_ctx& rctx,
+                                         const received_record& rec)
 {
   DelayedDataStream* dds;
 
@@ -201,9 +291,9 @@ static inline void PushDelayedDataStream(r_ctx& rctx, BareosSocket* sd)
 
   dds = (DelayedDataStream*)malloc(sizeof(DelayedDataStream));
   dds->stream = rctx.stream;
-  dds->content = (char*)malloc(sd->message_length);
-  memcpy(dds->content, sd->msg, sd->message_length);
-  dds->content_length = sd->message_length;
+  dds->content = (char*)malloc(rec.data_len);
+  memcpy(dds->content, rec.data.c_str(), rec.data_len);
+  dds->content_length = rec.data_len;
 
   rctx.delayed_streams->append(dds);
 }
@@ -413,10 +503,14 @@ void DoRestore(JobControlRecord* jcr)
   int non_support_progname = 0;
   int non_support_crypto = 0;
   int non_support_xattr = 0;
+  std::optional<RecordReceiver> receiver;
+  received_record rec;
 
   rctx.jcr = jcr;
 
   sd = jcr->store_bsock;
+  // nothing but the restore reads from it, see EnableReceiveBuffer()
+  sd->EnableReceiveBuffer();
   jcr->setJobStatusWithPriorityCheck(JS_Running);
 
   ClientResource* client = nullptr;
@@ -486,15 +580,17 @@ void DoRestore(JobControlRecord* jcr)
     memset(jcr->fd_impl->xattr_data->u.parse, 0, sizeof(xattr_parse_data_t));
   }
 
-  while (BgetMsg(sd) >= 0 && !jcr->IsJobCanceled()) {
+  receiver.emplace(sd, me->restore_receive_ahead);
+  while (receiver->Next(rec) && !jcr->IsJobCanceled()) {
     // Remember previous stream type
     rctx.prev_stream = rctx.stream;
 
     // First we expect a Stream Record Header
-    if (sscanf(sd->msg, rec_header, &VolSessionId, &VolSessionTime, &file_index,
-               &rctx.full_stream, &rctx.size)
+    if (sscanf(rec.header.c_str(), rec_header, &VolSessionId, &VolSessionTime,
+               &file_index, &rctx.full_stream, &rctx.size)
         != 5) {
-      Jmsg1(jcr, M_FATAL, 0, T_("Record header scan error: %s\n"), sd->msg);
+      Jmsg1(jcr, M_FATAL, 0, T_("Record header scan error: %s\n"),
+            rec.header.c_str());
       goto bail_out;
     }
     /* Strip off new stream high bits */
@@ -503,21 +599,16 @@ void DoRestore(JobControlRecord* jcr)
           jcr->JobFiles, file_index, rctx.size, rctx.stream,
           stream_to_ascii(rctx.stream));
 
-    // Now we expect the Stream Data
-    if (BgetMsg(sd) < 0) {
-      Jmsg1(jcr, M_FATAL, 0, T_("Data record error. ERR=%s\n"),
-            sd->bstrerror());
-      goto bail_out;
-    }
-    if (rctx.size != (uint32_t)sd->message_length) {
+    // The Stream Data came with it
+    if (rctx.size != (uint32_t)rec.data_len) {
       Jmsg2(jcr, M_FATAL, 0, T_("Actual data size %d not same as header %d\n"),
-            sd->message_length, rctx.size);
+            rec.data_len, rctx.size);
       Dmsg2(50, "Actual data size %d not same as header %d\n",
-            sd->message_length, rctx.size);
+            rec.data_len, rctx.size);
       goto bail_out;
     }
     Dmsg3(130, "Got stream: %s len=%d extract=%d\n",
-          stream_to_ascii(rctx.stream), sd->message_length, rctx.extract);
+          stream_to_ascii(rctx.stream), rec.data_len, rctx.extract);
 
     // If we change streams, close and reset alternate data streams
     if (rctx.prev_stream != rctx.stream) {
@@ -558,15 +649,15 @@ void DoRestore(JobControlRecord* jcr)
         if (IS_FT_OBJECT(rctx.type)) { continue; }
 
         // Unpack attributes and do sanity check them
-        if (!UnpackAttributesRecord(jcr, rctx.stream, sd->msg,
-                                    sd->message_length, attr)) {
+        if (!UnpackAttributesRecord(jcr, rctx.stream, rec.data.c_str(),
+                                    rec.data_len, attr)) {
           goto bail_out;
         }
 
         Dmsg3(100, "File %s\nattrib=%s\nattribsEx=%s\n", attr->fname,
               attr->attr, attr->attrEx);
         Dmsg3(100, "=== message_length=%d attrExlen=%d msg=%s\n",
-              sd->message_length, strlen(attr->attrEx), sd->msg);
+              rec.data_len, strlen(attr->attrEx), rec.data.c_str());
 
         attr->data_stream = DecodeStat(attr->attr, &attr->statp,
                                        sizeof(attr->statp), &attr->LinkFI);
@@ -682,7 +773,7 @@ void DoRestore(JobControlRecord* jcr)
 
           // Decode and save session keys.
           cryptoerr = CryptoSessionDecode(
-              (uint8_t*)sd->msg, (uint32_t)sd->message_length,
+              (uint8_t*)rec.data.c_str(), (uint32_t)rec.data_len,
               jcr->fd_impl->crypto.pki_recipients, &rctx.cs);
           switch (cryptoerr) {
             case CRYPTO_ERROR_NONE:
@@ -809,7 +900,7 @@ void DoRestore(JobControlRecord* jcr)
               SetBit(FO_WIN32DECOMP, rctx.flags);
             }
 
-            if (ExtractData(jcr, &rctx.bfd, sd->msg, sd->message_length,
+            if (ExtractData(jcr, &rctx.bfd, rec.data.c_str(), rec.data_len,
                             &rctx.fileAddr, rctx.flags, rctx.stream,
                             &rctx.cipher_ctx)
                 < 0) {
@@ -858,7 +949,7 @@ void DoRestore(JobControlRecord* jcr)
 #endif
             }
 
-            if (ExtractData(jcr, &rctx.forkbfd, sd->msg, sd->message_length,
+            if (ExtractData(jcr, &rctx.forkbfd, rec.data.c_str(), rec.data_len,
                             &rctx.fork_addr, rctx.fork_flags, rctx.stream,
                             &rctx.fork_cipher_ctx)
                 < 0) {
@@ -874,7 +965,7 @@ void DoRestore(JobControlRecord* jcr)
 
       case STREAM_HFSPLUS_ATTRIBUTES:
         if (have_darwin_os) {
-          if (!RestoreFinderinfo(jcr, sd->msg, sd->message_length)) {
+          if (!RestoreFinderinfo(jcr, rec.data.c_str(), rec.data_len)) {
             continue;
           }
         } else {
@@ -917,9 +1008,10 @@ void DoRestore(JobControlRecord* jcr)
           /* For anything that is not a directory we delay
            * the restore of acls till a later stage. */
           if (jcr->fd_impl->last_type != FT_DIREND) {
-            PushDelayedDataStream(rctx, sd);
+            PushDelayedDataStream(rctx, rec);
           } else {
-            if (!do_reStoreAcl(jcr, rctx.stream, sd->msg, sd->message_length)) {
+            if (!do_reStoreAcl(jcr, rctx.stream, rec.data.c_str(),
+                               rec.data_len)) {
               goto bail_out;
             }
           }
@@ -951,10 +1043,10 @@ void DoRestore(JobControlRecord* jcr)
           /* For anything that is not a directory we delay
            * the restore of xattr till a later stage. */
           if (jcr->fd_impl->last_type != FT_DIREND) {
-            PushDelayedDataStream(rctx, sd);
+            PushDelayedDataStream(rctx, rec);
           } else {
-            if (!do_restore_xattr(jcr, rctx.stream, sd->msg,
-                                  sd->message_length)) {
+            if (!do_restore_xattr(jcr, rctx.stream, rec.data.c_str(),
+                                  rec.data_len)) {
               goto bail_out;
             }
           }
@@ -973,8 +1065,8 @@ void DoRestore(JobControlRecord* jcr)
           break;
         }
         if (have_xattr) {
-          if (!do_restore_xattr(jcr, rctx.stream, sd->msg,
-                                sd->message_length)) {
+          if (!do_restore_xattr(jcr, rctx.stream, rec.data.c_str(),
+                                rec.data_len)) {
             goto bail_out;
           }
         } else {
@@ -992,8 +1084,8 @@ void DoRestore(JobControlRecord* jcr)
         }
         // Save signature.
         if (rctx.extract
-            && (rctx.sig = crypto_sign_decode(jcr, (uint8_t*)sd->msg,
-                                              (uint32_t)sd->message_length))
+            && (rctx.sig = crypto_sign_decode(jcr, (uint8_t*)rec.data.c_str(),
+                                              (uint32_t)rec.data_len))
                    == NULL) {
           Jmsg1(jcr, M_ERROR, 0,
                 T_("Failed to decode message signature for %s\n"),
@@ -1006,6 +1098,7 @@ void DoRestore(JobControlRecord* jcr)
       case STREAM_SHA256_DIGEST:
       case STREAM_SHA512_DIGEST:
       case STREAM_XXH128_DIGEST:
+      case STREAM_XXH3_TREE_DIGEST:
         break;
 
       case STREAM_PROGRAM_NAMES:
@@ -1018,8 +1111,8 @@ void DoRestore(JobControlRecord* jcr)
 
       case STREAM_PLUGIN_NAME:
         if (!ClosePreviousStream(jcr, rctx)) { goto bail_out; }
-        Dmsg1(50, "restore stream_plugin_name=%s\n", sd->msg);
-        if (!PluginNameStream(jcr, sd->msg)) { goto bail_out; }
+        Dmsg1(50, "restore stream_plugin_name=%s\n", rec.data.c_str());
+        if (!PluginNameStream(jcr, rec.data.c_str())) { goto bail_out; }
         break;
 
       case STREAM_RESTORE_OBJECT:
@@ -1030,11 +1123,16 @@ void DoRestore(JobControlRecord* jcr)
         Jmsg(jcr, M_WARNING, 0,
              T_("Unknown stream=%d ignored. This shouldn't happen!\n"),
              rctx.stream);
-        Dmsg2(0, "Unknown stream=%d data=%s\n", rctx.stream, sd->msg);
+        Dmsg2(0, "Unknown stream=%d data=%s\n", rctx.stream, rec.data.c_str());
         break;
     } /* end switch(stream) */
   }   /* end while get_msg() */
 
+  if (std::optional error = receiver->Finish()) {
+    Jmsg1(jcr, M_FATAL, 0, T_("Data record error. ERR=%s\n"), error->c_str());
+    goto bail_out;
+  }
+
   /* If output file is still open, it was the last one in the
    * archive since we just hit an end of file, so close the file. */
   if (IsBopen(&rctx.forkbfd)) {
@@ -1049,6 +1147,9 @@ bail_out:
   jcr->setJobStatusWithPriorityCheck(JS_ErrorTerminated);
 
 ok_out:
+  // the storage daemon socket is not received from anymore after this
+  receiver.reset();
+
 #ifdef HAVE_WIN32
   // Cleanup the copy thread if we restored any EFS data.
   if (jcr->cp_thread) { win32_cleanup_copy_thread(jcr); }
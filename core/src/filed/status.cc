@@ -34,8 +34,10 @@
 #include "lib/status_packet.h"
 #include "lib/bsock.h"
 #include "lib/edit.h"
+#include "lib/lock_profile.h"
 #include "lib/parse_conf.h"
 #include "lib/recent_job_results_list.h"
+#include "lib/thread_pool.h"
 #include "findlib/enable_priv.h"
 #include "lib/util.h"
 
@@ -69,6 +71,10 @@ static void OutputStatus(StatusPacket* sp)
   ListStatusHeader(sp);
   ListRunningJobs(sp);
   ListTerminatedJobs(sp);
+  if (std::string profile = lock_profile::Report();
+      !sp->api && !profile.empty()) {
+    sp->send(profile);
+  }
 }
 
 static void ListStatusHeader(StatusPacket* sp)
@@ -76,7 +82,7 @@ static void ListStatusHeader(StatusPacket* sp)
   int len;
   char dt[MAX_TIME_LENGTH];
   PoolMem msg(PM_MESSAGE);
-  char b1[32];
+  char b1[32], b2[32], b3[32], b4[32];
 
   len = Mmsg(msg, T_("%s Version: %s (%s) %s %s\n"), my_name,
              kBareosVersionStrings.Full, kBareosVersionStrings.Date, VSS,
@@ -133,6 +139,37 @@ static void ListStatusHeader(StatusPacket* sp)
              edit_uint64_with_commas(me->max_bandwidth_per_job / 1024, b1));
   sp->send(msg, len);
 
+  thread_pool_stats threads = worker_threads::stats();
+  len = Mmsg(msg,
+             T_(" Worker threads: %d (%d idle), started: %s, reused: %s, "
+                "tasks: %s\n"),
+             (int)threads.threads, (int)threads.idle,
+             edit_uint64_with_commas(threads.started, b1),
+             edit_uint64_with_commas(threads.reused, b2),
+             edit_uint64_with_commas(threads.tasks_run, b3));
+  sp->send(msg, len);
+
+  pool_memory_stats pool_mem = GetPoolMemoryStats();
+  len = Mmsg(msg,
+             T_(" Pool memory: held=%s cached=%s huge=%s released=%s\n"),
+             edit_uint64_with_commas(pool_mem.held_bytes, b1),
+             edit_uint64_with_commas(pool_mem.cached_bytes, b2),
+             edit_uint64_with_commas(pool_mem.huge_bytes, b3),
+             edit_uint64_with_commas(pool_mem.released_bytes, b4));
+  sp->send(msg, len);
+
+  for (auto& delivery : GetMessageDeliveryStats()) {
+    len = Mmsg(msg,
+               T_(" Message delivery (%s): queued=%s waits=%s inline=%s "
+                  "max depth=%d max batch=%d\n"),
+               delivery.destination,
+               edit_uint64_with_commas(delivery.queued, b1),
+               edit_uint64_with_commas(delivery.waits, b2),
+               edit_uint64_with_commas(delivery.inline_delivered, b3),
+               (int)delivery.max_depth, (int)delivery.max_batch);
+    sp->send(msg, len);
+  }
+
   if (me->secure_erase_cmdline) {
     len = Mmsg(msg, T_(" secure erase command='%s'\n"),
                me->secure_erase_cmdline);
@@ -206,6 +243,12 @@ static void ListRunningJobsPlain(StatusPacket* sp)
     len = Mmsg(msg, T_("    Files Examined=%s\n"),
                edit_uint64_with_commas(njcr->fd_impl->num_files_examined, b1));
     sp->send(msg, len);
+    if (std::string stages
+        = njcr->fd_impl->stage_times.Format(backup_stage_names);
+        !stages.empty()) {
+      len = Mmsg(msg, T_("    Stages: %s\n"), stages.c_str());
+      sp->send(msg, len);
+    }
     if (njcr->JobFiles > 0) {
       {
         std::unique_lock l(njcr->mutex_guard());
@@ -256,7 +256,8 @@ static int VerifyFile(JobControlRecord* jcr, FindFilesPacket* ff_pkt, bool)
       && (BitIsSet(FO_MD5, ff_pkt->flags) || BitIsSet(FO_SHA1, ff_pkt->flags)
           || BitIsSet(FO_SHA256, ff_pkt->flags)
           || BitIsSet(FO_SHA512, ff_pkt->flags)
-          || BitIsSet(FO_XXH128, ff_pkt->flags))) {
+          || BitIsSet(FO_XXH128, ff_pkt->flags)
+          || BitIsSet(FO_XXH3_TREE, ff_pkt->flags))) {
     int digest_stream = STREAM_NONE;
     DIGEST* digest = NULL;
     char* digest_buf = NULL;
@@ -421,6 +422,9 @@ static bool calculate_file_chksum(JobControlRecord* jcr,
   } else if (BitIsSet(FO_XXH128, ff_pkt->flags)) {
     *digest = crypto_digest_new(jcr, CRYPTO_DIGEST_XXH128);
     *digest_stream = STREAM_XXH128_DIGEST;
+  } else if (BitIsSet(FO_XXH3_TREE, ff_pkt->flags)) {
+    *digest = crypto_digest_new(jcr, CRYPTO_DIGEST_XXH3_TREE);
+    *digest_stream = STREAM_XXH3_TREE_DIGEST;
   }
 
   // compute MD5 or SHA1 hash
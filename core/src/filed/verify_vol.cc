@@ -260,6 +260,16 @@ void DoVerifyVolume(JobControlRecord* jcr)
               dir->msg);
         break;
 
+      case STREAM_XXH3_TREE_DIGEST:
+        BinToBase64(digest, sizeof(digest), (char*)sd->msg,
+                    CRYPTO_DIGEST_XXH3_TREE_SIZE, true);
+        Dmsg2(400, "send inx=%d XXH3TREE=%s\n", jcr->JobFiles, digest);
+        dir->fsend("%d %d %s *XXH3TREE-%d*", jcr->JobFiles,
+                   STREAM_XXH3_TREE_DIGEST, digest, jcr->JobFiles);
+        Dmsg2(20, "filed>dir: XXH3TREE len=%d: msg=%s\n", dir->message_length,
+              dir->msg);
+        break;
+
       case STREAM_RESTORE_OBJECT: {
         std::unique_lock l(jcr->mutex_guard());
         jcr->JobFiles++;
@@ -68,6 +68,7 @@
 #include "lib/berrno.h"
 #include "lib/bsock.h"
 #include "find.h"
+#include "findlib/fstype.h"
 
 #if !defined(HAVE_ACL) && !defined(HAVE_AFS_ACL)
 /**
@@ -87,6 +88,8 @@ bacl_exit_code parse_acl_streams(JobControlRecord*,
 {
   return bacl_exit_fatal;
 }
+
+bool HasTrivialAccessAcl(const char*) { return false; }
 #else
 // Send an ACL stream to the SD.
 bacl_exit_code SendAclStream(JobControlRecord* jcr,
@@ -659,6 +662,16 @@ static bacl_exit_code generic_get_acl_from_os(JobControlRecord* jcr,
   char* acl_text;
   bacl_exit_code retval = bacl_exit_ok;
 
+#      if defined(HAVE_LINUX_OS)
+  // Nothing to save, see HasTrivialAccessAcl().
+  if (acltype == BACL_TYPE_ACCESS && acl_data->trivial_access_acl) {
+    acl_data->trivial_access_acl = false;
+    PmStrcpy(acl_data->u.build->content, "");
+    acl_data->u.build->content_length = 0;
+    return bacl_exit_ok;
+  }
+#      endif
+
   ostype = BacToOsAcltype(acltype);
   acl = acl_get_file(acl_data->last_fname, ostype);
   if (acl) {
@@ -719,8 +732,10 @@ static bacl_exit_code generic_get_acl_from_os(JobControlRecord* jcr,
         /* If the filesystem reports it doesn't support ACLs we clear the
          * BACL_FLAG_SAVE_NATIVE flag so we skip ACL saves on all other files
          * on the same filesystem. The BACL_FLAG_SAVE_NATIVE flag gets set again
-         * when we change from one filesystem to another. */
+         * when we change from one filesystem to another, unless the filesystem
+         * is remembered as not supporting ACLs. */
         acl_data->flags &= ~BACL_FLAG_SAVE_NATIVE;
+        FstypeMarkUnsupported(acl_data->current_dev, FS_FEATURE_ACL);
         goto bail_out;
 #      endif
       case ENOENT:
@@ -744,6 +759,23 @@ bail_out:
   return retval;
 }
 
+#      if defined(HAVE_LINUX_OS)
+/**
+ * See if fname is known to have no access ACL worth saving, which is what
+ * most files have.  Unlike acl_to_text() this is safe to call from any
+ * thread, so the lookup can be done ahead of time for upcoming files.
+ */
+bool HasTrivialAccessAcl(const char* fname)
+{
+  acl_t acl = acl_get_file(fname, ACL_TYPE_ACCESS);
+  if (!acl) { return false; }
+
+  bool trivial = AclCountEntries(acl) <= 0 || AclIsTrivial(acl);
+  acl_free(acl);
+  return trivial;
+}
+#      endif
+
 // Generic wrapper around acl_set_file call.
 static bacl_exit_code generic_set_acl_on_os(JobControlRecord* jcr,
                                             AclData* acl_data,
@@ -1737,6 +1769,13 @@ bacl_exit_code BuildAclStreams(JobControlRecord* jcr,
 
     // Save that we started scanning a new filesystem.
     acl_data->current_dev = ff_pkt->statp.st_dev;
+
+    // Skip filesystems that already told us they have no ACLs.
+    if (FstypeUnsupported(acl_data->current_dev, FS_FEATURE_ACL)) {
+      Dmsg1(100, "ACLs not supported on the filesystem of \"%s\"\n",
+            acl_data->last_fname);
+      acl_data->flags &= ~BACL_FLAG_SAVE_NATIVE;
+    }
   }
 
 #  if defined(HAVE_AFS_ACL)
@@ -1761,6 +1800,10 @@ bacl_exit_code BuildAclStreams(JobControlRecord* jcr,
   return bacl_exit_error;
 }
 
+#  if !defined(HAVE_ACL) || !defined(HAVE_LINUX_OS)
+bool HasTrivialAccessAcl(const char*) { return false; }
+#  endif
+
 bacl_exit_code parse_acl_streams(JobControlRecord* jcr,
                                  AclData* acl_data,
                                  int stream,
@@ -91,6 +91,9 @@ struct AclData {
   uint32_t flags{}; /* See BACL_FLAG_* */
   uint32_t current_dev{0};
   bool first_dev{true};
+  /* last_fname is known (ahead of time) to have no access ACL beyond its
+   * permission bits, used (and cleared) by the next BuildAclStreams() */
+  bool trivial_access_acl{false};
   union {
     struct acl_build_data_t* build;
     struct acl_parse_data_t* parse;
@@ -103,6 +106,7 @@ bacl_exit_code SendAclStream(JobControlRecord* jcr,
 bacl_exit_code BuildAclStreams(JobControlRecord* jcr,
                                AclData* acl_data,
                                FindFilesPacket* ff_pkt);
+bool HasTrivialAccessAcl(const char* fname);
 bacl_exit_code parse_acl_streams(JobControlRecord* jcr,
                                  AclData* acl_data,
                                  int stream,
@@ -39,6 +39,16 @@
 #include "find.h"
 #include "lib/berrno.h"
 
+#include <algorithm>
+
+#if defined(HAVE_WIN32)
+#  include <condition_variable>
+#  include <deque>
+#  include <mutex>
+#  include <thread>
+#  include <vector>
+#endif
+
 const int debuglevel = 200;
 
 int (*plugin_bopen)(BareosFilePacket* bfd,
@@ -130,6 +140,8 @@ const char* stream_to_ascii(int stream)
       return T_("SHA512 digest");
     case STREAM_XXH128_DIGEST:
       return T_("XXH128 digest");
+    case STREAM_XXH3_TREE_DIGEST:
+      return T_("XXH3 tree digest");
     case STREAM_SIGNED_DIGEST:
       return T_("Signed digest");
     case STREAM_ENCRYPTED_FILE_DATA:
@@ -449,6 +461,7 @@ bool IsRestoreStreamSupported(int stream)
     case STREAM_SHA512_DIGEST:
 #  endif
     case STREAM_XXH128_DIGEST:
+    case STREAM_XXH3_TREE_DIGEST:
 #  ifdef HAVE_CRYPTO
     case STREAM_SIGNED_DIGEST:
     case STREAM_ENCRYPTED_FILE_DATA:
@@ -750,6 +763,129 @@ static inline int BcloseEncrypted(BareosFilePacket* bfd)
   return 0;
 }
 
+/* Reads count bytes of the file or whatever is left of it.
+ * Returns: TRUE on success, FALSE with the error in GetLastError() */
+static BOOL ReadFromFile(BareosFilePacket* bfd,
+                         void* buf,
+                         DWORD count,
+                         DWORD* bytes_read)
+{
+  if (bfd->use_backup_api) {
+    return p_BackupRead(bfd->fh, (BYTE*)buf, count, bytes_read,
+                        0,                              /* no Abort */
+                        1,                              /* Process Security */
+                        &bfd->lplugin_private_context); /* Context */
+  } else {
+    return ReadFile(bfd->fh, buf, count, bytes_read, NULL);
+  }
+}
+
+/* BackupRead() cannot do overlapped i/o.  To have reads in flight while the
+ * data is processed anyway, a file with a read ahead window is read by a
+ * thread that stays up to the window in front of bread().  It reads in
+ * chunks of a quarter of the window, which are usually a lot larger than
+ * the network buffers bread() is called with. */
+struct win32_read_ahead {
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<std::vector<char>> chunks; /* read but not yet consumed */
+  std::size_t consumed{0};              /* bytes of chunks.front() */
+  std::size_t buffered{0};              /* bytes in chunks */
+  bool done{false};                     /* end of file or error */
+  bool stop{false};
+  DWORD error{0};
+  std::thread reader;
+};
+
+static constexpr std::size_t min_read_ahead_chunk = 64 * 1024;
+
+static void ReadAheadThread(BareosFilePacket* bfd, win32_read_ahead* ra)
+{
+  const std::size_t window = bfd->readahead_window;
+  const std::size_t chunk_size = std::max(window / 4, min_read_ahead_chunk);
+
+  for (;;) {
+    {
+      std::unique_lock lock(ra->mutex);
+      ra->changed.wait(lock, [ra, window, chunk_size] {
+        return ra->stop || ra->buffered + chunk_size <= window
+               || ra->chunks.empty();
+      });
+      if (ra->stop) { return; }
+    }
+
+    std::vector<char> chunk(chunk_size);
+    DWORD bytes_read = 0;
+    bool ok = ReadFromFile(bfd, chunk.data(), chunk_size, &bytes_read);
+    DWORD error = ok ? 0 : GetLastError();
+
+    std::unique_lock lock(ra->mutex);
+    if (!ok) {
+      ra->error = error;
+      ra->done = true;
+    } else if (bytes_read == 0) {
+      ra->done = true;
+    } else {
+      chunk.resize(bytes_read);
+      ra->buffered += bytes_read;
+      ra->chunks.push_back(std::move(chunk));
+    }
+    ra->changed.notify_all();
+    if (ra->done) { return; }
+  }
+}
+
+static void StopReadAhead(BareosFilePacket* bfd)
+{
+  win32_read_ahead* ra = bfd->readahead;
+  if (!ra) { return; }
+
+  {
+    std::unique_lock lock(ra->mutex);
+    ra->stop = true;
+  }
+  ra->changed.notify_all();
+  ra->reader.join();
+  delete ra;
+  bfd->readahead = nullptr;
+}
+
+// Takes count bytes from the read ahead, less only at the end of the file.
+static ssize_t ReadAhead(BareosFilePacket* bfd, void* buf, size_t count)
+{
+  win32_read_ahead* ra = bfd->readahead;
+  char* out = static_cast<char*>(buf);
+  std::size_t copied = 0;
+
+  std::unique_lock lock(ra->mutex);
+  while (copied < count) {
+    ra->changed.wait(lock, [ra] { return ra->done || !ra->chunks.empty(); });
+    if (ra->chunks.empty()) { break; }
+
+    std::vector<char>& chunk = ra->chunks.front();
+    std::size_t n = std::min(count - copied, chunk.size() - ra->consumed);
+    memcpy(out + copied, chunk.data() + ra->consumed, n);
+    copied += n;
+    ra->consumed += n;
+    ra->buffered -= n;
+    if (ra->consumed == chunk.size()) {
+      ra->chunks.pop_front();
+      ra->consumed = 0;
+      ra->changed.notify_all();
+    }
+  }
+
+  if (copied == 0 && ra->error) {
+    bfd->lerror = ra->error;
+    bfd->BErrNo = b_errno_win32;
+    errno = b_errno_win32;
+    return -1;
+  }
+
+  bfd->rw_bytes = copied;
+  return copied;
+}
+
 /**
  * Returns  0 on success
  *         -1 on error
@@ -763,6 +899,8 @@ static inline int BcloseNonencrypted(BareosFilePacket* bfd)
     return 0;
   }
 
+  StopReadAhead(bfd);
+
   if (bfd->cmd_plugin && plugin_bclose) {
     status = plugin_bclose(bfd);
     Dmsg0(50, "==== BFD closed!!!\n");
@@ -842,28 +980,36 @@ ssize_t bread(BareosFilePacket* bfd, void* buf, size_t count)
     }
     Dmsg1(400, "bread handled in core via bfd->fh=%d\n", bfd->fh);
   }
-  if (bfd->use_backup_api) {
-    if (!p_BackupRead(bfd->fh, (BYTE*)buf, count, &bfd->rw_bytes,
-                      0,                                /* no Abort */
-                      1,                                /* Process Security */
-                      &bfd->lplugin_private_context)) { /* Context */
-      bfd->lerror = GetLastError();
-      bfd->BErrNo = b_errno_win32;
-      errno = b_errno_win32;
-      return -1;
-    }
-  } else {
-    if (!ReadFile(bfd->fh, buf, count, &bfd->rw_bytes, NULL)) {
-      bfd->lerror = GetLastError();
-      bfd->BErrNo = b_errno_win32;
-      errno = b_errno_win32;
-      return -1;
+
+  if (bfd->readahead_window > count && bfd->mode == BF_READ) {
+    if (!bfd->readahead) {
+      bfd->readahead = new win32_read_ahead;
+      bfd->readahead->reader
+          = std::thread(ReadAheadThread, bfd, bfd->readahead);
     }
+    return ReadAhead(bfd, buf, count);
+  }
+
+  if (!ReadFromFile(bfd, buf, count, &bfd->rw_bytes)) {
+    bfd->lerror = GetLastError();
+    bfd->BErrNo = b_errno_win32;
+    errno = b_errno_win32;
+    return -1;
   }
 
   return (ssize_t)bfd->rw_bytes;
 }
 
+/* Windows does its own read ahead on sequentially opened files, but only
+ * one read is in flight with it.  A window makes bread() use a reader
+ * thread, see ReadAhead(). */
+void SetReadAhead(BareosFilePacket* bfd, size_t window)
+{
+  bfd->readahead_window = window;
+}
+
+boffset_t SkipHole(BareosFilePacket*, boffset_t pos, boffset_t) { return pos; }
+
 ssize_t bwrite(BareosFilePacket* bfd, void* buf, size_t count)
 {
   bfd->rw_bytes = 0;
@@ -998,6 +1144,7 @@ bool IsRestoreStreamSupported(int stream)
     case STREAM_SHA512_DIGEST:
 #  endif
     case STREAM_XXH128_DIGEST:
+    case STREAM_XXH3_TREE_DIGEST:
 #  ifdef HAVE_CRYPTO
     case STREAM_SIGNED_DIGEST:
     case STREAM_ENCRYPTED_FILE_DATA:
@@ -1065,6 +1212,9 @@ int bopen(BareosFilePacket* bfd,
   bfd->win32Decomplugin_private_context.bIsInData = false;
   bfd->win32Decomplugin_private_context.liNextHeader = 0;
 
+  bfd->readahead_pos = 0;
+  bfd->readahead_until = 0;
+
 #  if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_WILLNEED)
   /* If not RDWR or WRONLY must be Read Only */
   if (bfd->filedes != -1 && !(flags & (O_RDWR | O_WRONLY))) {
@@ -1129,6 +1279,31 @@ int bclose(BareosFilePacket* bfd)
   return status;
 }
 
+/* The kernel only reads ahead a couple hundred KiB by default, which leaves
+ * fast devices (and devices with high latency) mostly idle while we wait for
+ * the next read.  Instead we keep readahead_window bytes announced in front
+ * of the reader, so that enough requests are queued on the device.  The
+ * window gets extended once half of it got consumed. */
+static void ReadAhead([[maybe_unused]] BareosFilePacket* bfd,
+                      [[maybe_unused]] size_t count)
+{
+#  if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_WILLNEED)
+  if (bfd->readahead_window == 0) { return; }
+
+  boffset_t window = static_cast<boffset_t>(std::max(bfd->readahead_window, count));
+  boffset_t wanted_until = bfd->readahead_pos + window;
+  if (bfd->readahead_until - bfd->readahead_pos >= window / 2) { return; }
+
+  boffset_t start = std::max(bfd->readahead_pos, bfd->readahead_until);
+  int status = posix_fadvise(bfd->filedes, start, wanted_until - start,
+                             POSIX_FADV_WILLNEED);
+  Dmsg4(400, "Read ahead filedes=%d from %lld to %lld status=%d\n",
+        bfd->filedes, static_cast<long long>(start),
+        static_cast<long long>(wanted_until), status);
+  bfd->readahead_until = wanted_until;
+#  endif
+}
+
 ssize_t bread(BareosFilePacket* bfd, void* buf, size_t count)
 {
   if (bfd->cmd_plugin && plugin_bread)
@@ -1139,6 +1314,7 @@ ssize_t bread(BareosFilePacket* bfd, void* buf, size_t count)
 
   Dmsg1(400, "bread handled in core via bfd->filedes=%d\n", bfd->filedes);
   ASSERT(static_cast<ssize_t>(count) >= 0);
+  ReadAhead(bfd, count);
   ssize_t bytes_read = 0;
   while (bytes_read < static_cast<ssize_t>(count)) {
     ssize_t status = read(bfd->filedes, ptr + bytes_read, count - bytes_read);
@@ -1154,9 +1330,44 @@ ssize_t bread(BareosFilePacket* bfd, void* buf, size_t count)
     }
   }
   bfd->BErrNo = errno;
+  if (bytes_read > 0) { bfd->readahead_pos += bytes_read; }
   return bytes_read;
 }
 
+void SetReadAhead(BareosFilePacket* bfd, size_t window)
+{
+  bfd->readahead_window = window;
+}
+
+boffset_t SkipHole([[maybe_unused]] BareosFilePacket* bfd,
+                   boffset_t pos,
+                   [[maybe_unused]] boffset_t limit)
+{
+#  if defined(SEEK_DATA)
+  if (bfd->cmd_plugin && plugin_bread && !bfd->do_io_in_core) { return pos; }
+  if (pos >= limit) { return pos; }
+
+  boffset_t data = lseek(bfd->filedes, pos, SEEK_DATA);
+  if (data < 0) {
+    // ENXIO: there is only a hole left until the end of the file
+    if (errno != ENXIO) { return pos; }
+    data = limit;
+  }
+  if (data <= pos) { return pos; }
+  if (data > limit) { data = limit; }
+
+  if (blseek(bfd, data, SEEK_SET) != data) {
+    blseek(bfd, pos, SEEK_SET);
+    return pos;
+  }
+  Dmsg3(400, "Skipped hole filedes=%d from %lld to %lld\n", bfd->filedes,
+        static_cast<long long>(pos), static_cast<long long>(data));
+  return data;
+#  else
+  return pos;
+#  endif
+}
+
 ssize_t bwrite(BareosFilePacket* bfd, void* buf, size_t count)
 {
   if (bfd->cmd_plugin && plugin_bwrite)
@@ -1197,6 +1408,10 @@ boffset_t blseek(BareosFilePacket* bfd, boffset_t offset, int whence)
   }
   pos = (boffset_t)lseek(bfd->filedes, offset, whence);
   bfd->BErrNo = errno;
+  if (pos >= 0 && pos != bfd->readahead_pos) {
+    bfd->readahead_pos = pos;
+    bfd->readahead_until = pos;
+  }
   return pos;
 }
 #endif
@@ -69,6 +69,8 @@ enum
 
 /* In bfile.c */
 
+struct win32_read_ahead;
+
 /* Basic Win32 low level I/O file packet */
 /* clang-format off */
 struct BareosFilePacket {
@@ -91,6 +93,8 @@ struct BareosFilePacket {
   bool reparse_point = false; /**< set if reparse point */
   bool cmd_plugin = false;    /**< set if we have a command plugin */
   bool do_io_in_core{false};      /**< set if core should read/write from/to filedes */
+  size_t readahead_window{0};     /**< bytes to read ahead of bread() */
+  win32_read_ahead* readahead{nullptr}; /**< reader thread of the read ahead */
 };
 /* clang-format on */
 
@@ -120,6 +124,9 @@ struct BareosFilePacket {
   bool reparse_point{false};      /**< not used in Unix */
   bool cmd_plugin{false};         /**< set if we have a command plugin */
   bool do_io_in_core{false};      /**< set if core should read/write from/to filedes */
+  size_t readahead_window{0};     /**< bytes to keep announced ahead of reads */
+  boffset_t readahead_pos{0};     /**< current read position */
+  boffset_t readahead_until{0};   /**< end of the announced read ahead range */
 };
 /* clang-format on */
 
@@ -142,6 +149,14 @@ int bopen(BareosFilePacket* bfd,
 int BopenRsrc(BareosFilePacket* bfd, const char* fname, int flags, mode_t mode);
 int bclose(BareosFilePacket* bfd);
 ssize_t bread(BareosFilePacket* bfd, void* buf, size_t count);
+/* Keep window bytes announced to the kernel ahead of the current read
+ * position, so that several reads are in flight while we process the data.
+ * A window of 0 leaves read ahead to the os. */
+void SetReadAhead(BareosFilePacket* bfd, size_t window);
+/* Moves the file position from pos over a hole of a sparse file, but not
+ * beyond limit, and returns the new position.  Returns pos if there is no
+ * hole or holes cannot be found (plugins, no SEEK_DATA). */
+boffset_t SkipHole(BareosFilePacket* bfd, boffset_t pos, boffset_t limit);
 ssize_t bwrite(BareosFilePacket* bfd, void* buf, size_t count);
 boffset_t blseek(BareosFilePacket* bfd, boffset_t offset, int whence);
 const char* stream_to_ascii(int stream);
@@ -0,0 +1,106 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * sources that know in which directories something changed
+ */
+
+#include "include/bareos.h"
+#include "findlib/change_source.h"
+
+#include <algorithm>
+
+// the end of the parent of the directory name ending at end, or 0
+static std::size_t ParentEnd(std::string_view dirname, std::size_t end)
+{
+  if (end < 2) { return 0; }
+  std::size_t slash = dirname.rfind('/', end - 2);
+  return slash == std::string_view::npos ? 0 : slash + 1;
+}
+
+void ChangedDirectories::Add(std::string_view dirname)
+{
+  // once a directory is known all of its parents are known as well
+  for (std::size_t end = dirname.size(); end > 0;
+       end = ParentEnd(dirname, end)) {
+    if (!dirs_.emplace(dirname.substr(0, end)).second) { break; }
+  }
+}
+
+void ChangedDirectories::AddSubtree(std::string_view dirname)
+{
+  Add(dirname);
+  subtrees_.emplace(dirname);
+}
+
+bool ChangedDirectories::Contains(std::string_view dirname) const
+{
+  if (dirs_.find(std::string{dirname}) != dirs_.end()) { return true; }
+  if (subtrees_.empty()) { return false; }
+  for (std::size_t end = dirname.size(); end > 0;
+       end = ParentEnd(dirname, end)) {
+    if (subtrees_.find(std::string{dirname.substr(0, end)})
+        != subtrees_.end()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void ChangeSources::Add(std::unique_ptr<ChangeSource> source)
+{
+  sources_.push_back(std::move(source));
+}
+
+bool ChangeSources::MayHaveChanged(const char* dirname,
+                                   const struct stat& statp)
+{
+  auto covering = std::find_if(
+      sources_.begin(), sources_.end(),
+      [dirname, &statp](const std::unique_ptr<ChangeSource>& source) {
+        return source->Covers(dirname, statp);
+      });
+  if (covering == sources_.end()
+      || (*covering)->MayHaveChanged(dirname, statp)) {
+    return true;
+  }
+  skipped_dirs_.emplace(dirname);
+  return false;
+}
+
+bool ChangeSources::InSkippedDirectory(const char* fname) const
+{
+  if (skipped_dirs_.empty()) { return false; }
+  std::string_view name{fname};
+  for (std::size_t slash = name.rfind('/'); slash != std::string_view::npos;
+       slash = slash ? name.rfind('/', slash - 1) : std::string_view::npos) {
+    if (skipped_dirs_.find(std::string{name.substr(0, slash + 1)})
+        != skipped_dirs_.end()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void ChangeSources::SaveState(JobControlRecord* jcr)
+{
+  for (auto& source : sources_) { source->SaveState(jcr); }
+}
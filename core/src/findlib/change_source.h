@@ -0,0 +1,94 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * sources that know in which directories something changed
+ */
+
+#ifndef BAREOS_FINDLIB_CHANGE_SOURCE_H_
+#define BAREOS_FINDLIB_CHANGE_SOURCE_H_
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+class JobControlRecord;
+
+/* The directories in which something changed.  Adding a directory adds all
+ * of its parents as well, a subtree counts as changed with everything below
+ * it, e.g. after it was moved.  Names end with a slash. */
+class ChangedDirectories {
+ public:
+  void Add(std::string_view dirname);
+  void AddSubtree(std::string_view dirname);
+  bool Contains(std::string_view dirname) const;
+  std::size_t size() const { return dirs_.size(); }
+
+ private:
+  std::unordered_set<std::string> dirs_{};
+  std::unordered_set<std::string> subtrees_{};
+};
+
+/* Something that knows what changed on some filesystems since a backup,
+ * like a change log kept by the filesystem or a diff of two snapshots.
+ * The position of the current backup is taken when the source gets created
+ * and is kept for the next backup by SaveState() once this one terminated
+ * successfully. */
+class ChangeSource {
+ public:
+  virtual ~ChangeSource() = default;
+
+  // whether the source knows about the directory (a name like /dir/)
+  virtual bool Covers(const char* dirname, const struct stat& statp) const
+      = 0;
+
+  // false if nothing below the covered directory changed
+  virtual bool MayHaveChanged(const char* dirname,
+                              const struct stat& statp) const
+      = 0;
+
+  virtual void SaveState(JobControlRecord* jcr) = 0;
+};
+
+/* All change sources of a backup.  The scan asks them before it descends
+ * into a directory and remembers which directories it skipped, so that
+ * accurate mode does not take the files in there for deleted. */
+class ChangeSources {
+ public:
+  void Add(std::unique_ptr<ChangeSource> source);
+  bool empty() const { return sources_.empty(); }
+
+  bool MayHaveChanged(const char* dirname, const struct stat& statp);
+  bool InSkippedDirectory(const char* fname) const;
+  void SaveState(JobControlRecord* jcr);
+
+ private:
+  std::vector<std::unique_ptr<ChangeSource>> sources_{};
+  std::unordered_set<std::string> skipped_dirs_{};
+};
+
+#endif  // BAREOS_FINDLIB_CHANGE_SOURCE_H_
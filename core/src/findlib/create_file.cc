@@ -53,6 +53,9 @@
 static int SeparatePathAndFile(JobControlRecord* jcr, char* fname, char* ofile);
 static int PathAlreadySeen(JobControlRecord* jcr, char* path, int pnl);
 
+// bounds the memory used for PathAlreadySeen()
+static constexpr uint32_t max_made_paths = 100000;
+
 /**
  * Create the file, or the directory
  *
@@ -533,8 +536,9 @@ static int SeparatePathAndFile(JobControlRecord* jcr, char* fname, char* ofile)
 }
 
 /**
- * Primitive caching of path to prevent recreating a pathname
- *   each time as long as we remain in the same directory.
+ * Caching of paths to prevent recreating a pathname each time.  Besides the
+ * last path every path made is remembered, so coming back to a directory
+ * after restoring a subdirectory does not walk the whole path again.
  */
 static int PathAlreadySeen(JobControlRecord* jcr, char* path, int pnl)
 {
@@ -542,5 +546,13 @@ static int PathAlreadySeen(JobControlRecord* jcr, char* path, int pnl)
   if (jcr->cached_pnl == pnl && bstrcmp(path, jcr->cached_path)) { return 1; }
   PmStrcpy(jcr->cached_path, path);
   jcr->cached_pnl = pnl;
+
+  if (jcr->made_paths && jcr->made_paths->size() >= max_made_paths) {
+    FreePathList(jcr->made_paths);
+    jcr->made_paths = nullptr;
+  }
+  if (!jcr->made_paths) { jcr->made_paths = path_list_init(); }
+  if (jcr->made_paths->lookup(path)) { return 1; }
+  PathListAdd(jcr->made_paths, pnl, path);
   return 0;
 }
@@ -38,6 +38,7 @@
 #include "include/jcr.h"
 #include "find.h"
 #include "findlib/find_one.h"
+#include "findlib/wildcard_set.h"
 #include "lib/util.h"
 
 #if defined(HAVE_DARWIN_OS)
@@ -103,6 +104,17 @@ void SetFindChangedFunction(FindFilesPacket* ff,
   ff->CheckFct = CheckFct;
 }
 
+/* The prefetch function gets called with the names of regular files a
+ * directory scan will visit soon, before they are actually handled. */
+void SetFindPrefetchFunction(FindFilesPacket* ff,
+                             void PrefetchFct(JobControlRecord* jcr,
+                                              FindFilesPacket* ff,
+                                              const char* fname))
+{
+  Dmsg0(debuglevel, "Enter SetFindPrefetchFunction()\n");
+  ff->PrefetchFct = PrefetchFct;
+}
+
 /**
  * Call this subroutine with a callback subroutine as the first
  * argument and a packet as the second argument, this packet
@@ -233,6 +245,74 @@ bool IsInFileset(FindFilesPacket* ff)
   return false;
 }
 
+/* Compile the wild cards of fo for fnmatch() flags, again if the flags
+ * differ or plugins added more of them since. */
+static fopts_wildcards* CompiledWildcards(findFOPTS* fo, int flags)
+{
+  std::size_t num_patterns = fo->wild.size() + fo->wilddir.size()
+                             + fo->wildfile.size() + fo->wildbase.size();
+  fopts_wildcards* wildcards = fo->wildcards;
+  if (wildcards
+      && (wildcards->any.flags() != flags
+          || wildcards->any.size() + wildcards->dir.size()
+                     + wildcards->file.size() + wildcards->base.size()
+                 != num_patterns)) {
+    delete wildcards;
+    wildcards = nullptr;
+  }
+
+  if (!wildcards) {
+    wildcards = new fopts_wildcards(flags);
+    for (int k = 0; k < fo->wild.size(); k++) {
+      wildcards->any.Add(fo->wild.get(k));
+    }
+    for (int k = 0; k < fo->wilddir.size(); k++) {
+      wildcards->dir.Add(fo->wilddir.get(k));
+    }
+    for (int k = 0; k < fo->wildfile.size(); k++) {
+      wildcards->file.Add(fo->wildfile.get(k));
+    }
+    for (int k = 0; k < fo->wildbase.size(); k++) {
+      wildcards->base.Add(fo->wildbase.get(k));
+    }
+    fo->wildcards = wildcards;
+  }
+  return wildcards;
+}
+
+// Same for the names of an Exclude { } block.
+static WildcardSet* CompiledNames(findIncludeExcludeItem* incexe, int flags)
+{
+  WildcardSet* names = incexe->name_wildcards;
+  if (names
+      && (names->flags() != flags
+          || names->size() != std::size_t(incexe->name_list.size()))) {
+    delete names;
+    names = nullptr;
+  }
+
+  if (!names) {
+    dlistString* node;
+
+    names = new WildcardSet(flags);
+    foreach_dlist (node, &incexe->name_list) { names->Add(node->c_str()); }
+    incexe->name_wildcards = names;
+  }
+  return names;
+}
+
+void FreeCompiledWildcards(findFOPTS* fo)
+{
+  delete fo->wildcards;
+  fo->wildcards = nullptr;
+}
+
+void FreeCompiledWildcards(findIncludeExcludeItem* incexe)
+{
+  delete incexe->name_wildcards;
+  incexe->name_wildcards = nullptr;
+}
+
 bool AcceptFile(FindFilesPacket* ff)
 {
   int i, j, k;
@@ -240,17 +320,14 @@ bool AcceptFile(FindFilesPacket* ff)
   const char* basename;
   findFILESET* fileset = ff->fileset;
   findIncludeExcludeItem* incexe = fileset->incexe;
-  int (*match_func)(const char* pattern, const char* string, int flags);
 
   Dmsg1(debuglevel, "enter AcceptFile: fname=%s\n", ff->fname);
   if (BitIsSet(FO_ENHANCEDWILD, ff->flags)) {
-    match_func = fnmatch;
     if ((basename = last_path_separator(ff->fname)) != NULL)
       basename++;
     else
       basename = ff->fname;
   } else {
-    match_func = fnmatch;
     basename = ff->fname;
   }
 
@@ -267,55 +344,22 @@ bool AcceptFile(FindFilesPacket* ff)
     fnm_flags = BitIsSet(FO_IGNORECASE, ff->flags) ? FNM_CASEFOLD : 0;
     fnm_flags |= BitIsSet(FO_ENHANCEDWILD, ff->flags) ? FNM_PATHNAME : 0;
 
+    /* All wild cards of an options block lead to the same decision, so it
+     * does not matter which of them matches first. */
+    fopts_wildcards* wildcards = CompiledWildcards(fo, fnmode | fnm_flags);
+    bool matched;
     if (S_ISDIR(ff->statp.st_mode)) {
-      for (k = 0; k < fo->wilddir.size(); k++) {
-        if (match_func((char*)fo->wilddir.get(k), ff->fname, fnmode | fnm_flags)
-            == 0) {
-          if (BitIsSet(FO_EXCLUDE, ff->flags)) {
-            Dmsg2(debuglevel, "Exclude wilddir: %s file=%s\n",
-                  (char*)fo->wilddir.get(k), ff->fname);
-            return false; /* reject dir */
-          }
-          return true; /* accept dir */
-        }
-      }
+      matched = wildcards->dir.Matches(ff->fname);
     } else {
-      for (k = 0; k < fo->wildfile.size(); k++) {
-        if (match_func((char*)fo->wildfile.get(k), ff->fname,
-                       fnmode | fnm_flags)
-            == 0) {
-          if (BitIsSet(FO_EXCLUDE, ff->flags)) {
-            Dmsg2(debuglevel, "Exclude wildfile: %s file=%s\n",
-                  (char*)fo->wildfile.get(k), ff->fname);
-            return false; /* reject file */
-          }
-          return true; /* accept file */
-        }
-      }
-
-      for (k = 0; k < fo->wildbase.size(); k++) {
-        if (match_func((char*)fo->wildbase.get(k), basename, fnmode | fnm_flags)
-            == 0) {
-          if (BitIsSet(FO_EXCLUDE, ff->flags)) {
-            Dmsg2(debuglevel, "Exclude wildbase: %s file=%s\n",
-                  (char*)fo->wildbase.get(k), basename);
-            return false; /* reject file */
-          }
-          return true; /* accept file */
-        }
-      }
+      matched = wildcards->file.Matches(ff->fname)
+                || wildcards->base.Matches(basename);
     }
-
-    for (k = 0; k < fo->wild.size(); k++) {
-      if (match_func((char*)fo->wild.get(k), ff->fname, fnmode | fnm_flags)
-          == 0) {
-        if (BitIsSet(FO_EXCLUDE, ff->flags)) {
-          Dmsg2(debuglevel, "Exclude wild: %s file=%s\n",
-                (char*)fo->wild.get(k), ff->fname);
-          return false; /* reject file */
-        }
-        return true; /* accept file */
+    if (matched || wildcards->any.Matches(ff->fname)) {
+      if (BitIsSet(FO_EXCLUDE, ff->flags)) {
+        Dmsg1(debuglevel, "Exclude wild: file=%s\n", ff->fname);
+        return false; /* reject file */
       }
+      return true; /* accept file */
     }
 
     if (S_ISDIR(ff->statp.st_mode)) {
@@ -359,32 +403,24 @@ bool AcceptFile(FindFilesPacket* ff)
 
   // Now apply the Exclude { } directive
   for (i = 0; i < fileset->exclude_list.size(); i++) {
-    dlistString* node;
     findIncludeExcludeItem* exclude_item
         = (findIncludeExcludeItem*)fileset->exclude_list.get(i);
 
     for (j = 0; j < exclude_item->opts_list.size(); j++) {
       findFOPTS* fo = (findFOPTS*)exclude_item->opts_list.get(j);
       fnm_flags = BitIsSet(FO_IGNORECASE, fo->flags) ? FNM_CASEFOLD : 0;
-      for (k = 0; k < fo->wild.size(); k++) {
-        if (fnmatch((char*)fo->wild.get(k), ff->fname, fnmode | fnm_flags)
-            == 0) {
-          Dmsg1(debuglevel, "Reject wild1: %s\n", ff->fname);
-          return false; /* reject file */
-        }
+      if (CompiledWildcards(fo, fnmode | fnm_flags)->any.Matches(ff->fname)) {
+        Dmsg1(debuglevel, "Reject wild1: %s\n", ff->fname);
+        return false; /* reject file */
       }
     }
     fnm_flags = (exclude_item->current_opts != NULL
                  && BitIsSet(FO_IGNORECASE, exclude_item->current_opts->flags))
                     ? FNM_CASEFOLD
                     : 0;
-    foreach_dlist (node, &exclude_item->name_list) {
-      char* fname = node->c_str();
-
-      if (fnmatch(fname, ff->fname, fnmode | fnm_flags) == 0) {
-        Dmsg1(debuglevel, "Reject wild2: %s\n", ff->fname);
-        return false; /* reject file */
-      }
+    if (CompiledNames(exclude_item, fnmode | fnm_flags)->Matches(ff->fname)) {
+      Dmsg1(debuglevel, "Reject wild2: %s\n", ff->fname);
+      return false; /* reject file */
     }
   }
 
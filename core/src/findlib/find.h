@@ -69,6 +69,11 @@ int Readdir_r(DIR* dirp, struct dirent* entry, struct dirent** result);
 #  endif
 #endif
 
+class StatAhead;
+class ChangeSources;
+class WildcardSet;
+struct fopts_wildcards;
+
 // For options FO_xxx values see src/fileopts.h
 enum
 {
@@ -147,6 +152,7 @@ struct findFOPTS {
   alist<const char*> wildbase;   /**< Wild card strings for basenames */
   alist<const char*> fstype;     /**< File system type limitation */
   alist<const char*> Drivetype;  /**< Drive type limitation */
+  fopts_wildcards* wildcards{};  /**< The wild cards compiled by AcceptFile() */
 };
 
 // This is either an include item or an exclude item
@@ -156,6 +162,7 @@ struct findIncludeExcludeItem {
   dlist<dlistString> name_list;   /**< Filename list -- holds dlistString */
   dlist<dlistString> plugin_list; /**< Plugin list -- holds dlistString */
   alist<const char*> ignoredir;   /**< Ignore directories with this file(s) */
+  WildcardSet* name_wildcards{};  /**< name_list compiled by AcceptFile() */
 };
 
 // FileSet Resource
@@ -213,6 +220,8 @@ struct FindFilesPacket {
   struct s_included_file* included_files_list{nullptr};
   struct s_excluded_file* excluded_files_list{nullptr};
   struct s_excluded_file* excluded_paths_list{nullptr};
+  WildcardSet* excluded_files_wildcards{nullptr}; /**< of excluded_files_list */
+  WildcardSet* excluded_paths_wildcards{nullptr}; /**< of excluded_paths_list */
   findFILESET* fileset{nullptr};
   int (*FileSave)(JobControlRecord*,
                   FindFilesPacket*,
@@ -220,6 +229,14 @@ struct FindFilesPacket {
   bool (*CheckFct)(
       JobControlRecord*,
       FindFilesPacket*){};   /**< Optional user fct to check file changes */
+  void (*PrefetchFct)(
+      JobControlRecord*,
+      FindFilesPacket*,
+      const char*){};        /**< Optional user fct called for upcoming files */
+  StatAhead* stat_ahead{nullptr}; /**< Optional concurrent lstat() of upcoming
+                                       directory entries */
+  ChangeSources* change_sources{nullptr}; /**< Optional, tell which directories
+                                               an incremental can skip */
 
   // Values set by AcceptFile while processing Options
   char flags[FOPTS_BYTES]{}; /**< Backup options */
@@ -248,6 +265,10 @@ void SetFindOptions(FindFilesPacket* ff, bool incremental, time_t mtime);
 void SetFindChangedFunction(FindFilesPacket* ff,
                             bool CheckFct(JobControlRecord* jcr,
                                           FindFilesPacket* ff));
+void SetFindPrefetchFunction(FindFilesPacket* ff,
+                             void PrefetchFct(JobControlRecord* jcr,
+                                              FindFilesPacket* ff,
+                                              const char* fname));
 int FindFiles(JobControlRecord* jcr,
               FindFilesPacket* ff,
               int file_sub(JobControlRecord*, FindFilesPacket* ff_pkt, bool),
@@ -258,6 +279,8 @@ bool MatchFiles(JobControlRecord* jcr,
 void TermFindFiles(FindFilesPacket* ff);
 bool IsInFileset(FindFilesPacket* ff);
 bool AcceptFile(FindFilesPacket* ff);
+void FreeCompiledWildcards(findFOPTS* fo);
+void FreeCompiledWildcards(findIncludeExcludeItem* incexe);
 findIncludeExcludeItem* allocate_new_incexe(void);
 findIncludeExcludeItem* new_exclude(findFILESET* fileset);
 findIncludeExcludeItem* new_include(findFILESET* fileset);
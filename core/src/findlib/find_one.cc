@@ -33,6 +33,11 @@
 #  include <unistd.h>
 #endif
 #include <assert.h>
+#include <algorithm>
+#include <deque>
+#include <future>
+#include <optional>
+#include <string>
 #include "include/bareos.h"
 #include "include/filetypes.h"
 #include "include/jcr.h"
@@ -42,6 +47,8 @@
 #include "findlib/hardlink.h"
 #include "findlib/fstype.h"
 #include "findlib/drivetype.h"
+#include "findlib/stat_ahead.h"
+#include "findlib/change_source.h"
 #include "lib/berrno.h"
 #ifdef HAVE_DARWIN_OS
 #  include <sys/param.h>
@@ -71,6 +78,8 @@ static inline FindFilesPacket* new_dir_ff_pkt(FindFilesPacket* ff_pkt)
   dir_ff_pkt->included_files_list = NULL;
   dir_ff_pkt->excluded_files_list = NULL;
   dir_ff_pkt->excluded_paths_list = NULL;
+  dir_ff_pkt->excluded_files_wildcards = NULL;
+  dir_ff_pkt->excluded_paths_wildcards = NULL;
   dir_ff_pkt->linkhash = NULL;
   dir_ff_pkt->fname_save = NULL;
   dir_ff_pkt->link_save = NULL;
@@ -431,34 +440,41 @@ static inline int process_hardlink(JobControlRecord* jcr,
 {
   int rtn_stat = 0;
 
-  if (!ff_pkt->linkhash) { ff_pkt->linkhash = new LinkHash(10000); }
+  if (!ff_pkt->linkhash) { ff_pkt->linkhash = new LinkHash; }
 
-  auto [iter, inserted] = ff_pkt->linkhash->try_emplace(
-      Hardlink{ff_pkt->statp.st_dev, ff_pkt->statp.st_ino}, fname);
-  CurLink& hl = iter->second;
+  LinkHash& links = *ff_pkt->linkhash;
+  CurLink& hl
+      = links.Lookup(Hardlink{ff_pkt->statp.st_dev, ff_pkt->statp.st_ino},
+                     ff_pkt->statp.st_nlink, fname);
 
   if (hl.FileIndex == 0) {
     // no file backed up yet
+    if (!bstrcmp(links.name(hl), fname)) { links.SetName(hl, fname); }
     ff_pkt->linked = &hl;
     *done = false;
-  } else if (bstrcmp(hl.name.c_str(), fname)) {
+  } else if (bstrcmp(links.name(hl), fname)) {
     // If we have already backed up the hard linked file don't do it again
     Dmsg2(400, "== Name identical skip FI=%d file=%s\n", hl.FileIndex, fname);
     *done = true;
     rtn_stat = 1; /* ignore */
   } else {
     // some other file was already backed up!
-    ff_pkt->link = hl.name.data();
+    ff_pkt->link = const_cast<char*>(links.name(hl));
     ff_pkt->type = FT_LNKSAVED; /* Handle link, file already saved */
     ff_pkt->LinkFI = hl.FileIndex;
     ff_pkt->linked = NULL;
-    ff_pkt->digest = hl.digest.data();
+    ff_pkt->digest = const_cast<char*>(links.digest(hl));
     ff_pkt->digest_stream = hl.digest_stream;
-    ff_pkt->digest_len = hl.digest.size();
+    ff_pkt->digest_len = hl.digest_len;
 
     rtn_stat = HandleFile(jcr, ff_pkt, top_level);
     Dmsg3(400, "FT_LNKSAVED FI=%d LinkFI=%d file=%s\n", ff_pkt->FileIndex,
-          hl.FileIndex, hl.name.c_str());
+          hl.FileIndex, links.name(hl));
+    // ff_pkt->link points into links until here
+    links.LinkSeen(hl);
+    ff_pkt->link = ff_pkt->fname;
+    ff_pkt->digest = NULL;
+    ff_pkt->digest_len = 0;
     *done = true;
   }
 
@@ -534,6 +550,36 @@ static inline int process_symlink(JobControlRecord* jcr,
   return rtn_stat;
 }
 
+static int FindOneStatedFile(JobControlRecord* jcr,
+                             FindFilesPacket* ff_pkt,
+                             int HandleFile(JobControlRecord* jcr,
+                                            FindFilesPacket* ff,
+                                            bool top_level),
+                             char* fname,
+                             dev_t parent_device,
+                             bool top_level,
+                             int stat_errno);
+
+#ifndef USE_READDIR_R
+// Number of directory entries that get announced to the PrefetchFct early.
+static constexpr std::size_t kDirectoryLookahead = 16;
+
+struct upcoming_entry {
+  std::string name;
+  std::optional<std::future<StatAhead::stat_result>> stat{};
+};
+
+static inline bool MaybeRegularFile(const struct dirent* entry)
+{
+#  if defined(_DIRENT_HAVE_D_TYPE)
+  return entry->d_type == DT_REG || entry->d_type == DT_UNKNOWN;
+#  else
+  (void)entry;
+  return true;
+#  endif
+}
+#endif
+
 // Handling of a directory.
 static inline int process_directory(JobControlRecord* jcr,
                                     FindFilesPacket* ff_pkt,
@@ -642,6 +688,14 @@ static inline int process_directory(JobControlRecord* jcr,
     }
   }
 
+  /* An incremental does not need to read a directory in which nothing
+   * changed, if somebody can tell. */
+  if (recurse && !top_level && ff_pkt->incremental && ff_pkt->change_sources
+      && !ff_pkt->change_sources->MayHaveChanged(link, ff_pkt->statp)) {
+    Dmsg1(300, "Nothing changed below %s\n", link);
+    recurse = false;
+  }
+
   // If not recursing, just backup dir and return
   if (!recurse) {
     rtn_stat = HandleFile(jcr, ff_pkt, top_level);
@@ -725,42 +779,84 @@ static inline int process_directory(JobControlRecord* jcr,
 
 #else
 
+  /* If somebody is interested in upcoming files, read a few entries ahead of
+   * the one that gets handled and announce them via the PrefetchFct.
+   * Otherwise every entry gets handled right after it was read. */
+  std::size_t lookahead = ff_pkt->PrefetchFct ? kDirectoryLookahead : 1;
+  if (ff_pkt->stat_ahead) {
+    lookahead = std::max(lookahead, ff_pkt->stat_ahead->Lookahead());
+  }
+  std::deque<upcoming_entry> upcoming;
+  bool end_of_directory = false;
+
   while (!jcr->IsJobCanceled()) {
-    int name_length;
-    result = readdir(directory);
-    if (result == NULL) { break; }
+    while (!end_of_directory && upcoming.size() < lookahead) {
+      int name_length;
+      result = readdir(directory);
+      if (result == NULL) {
+        end_of_directory = true;
+        break;
+      }
 
-    name_length = (int)NAMELEN(result);
+      name_length = (int)NAMELEN(result);
 
-    /* Some filesystems violate against the rules and return filenames
-     * longer than _PC_NAME_MAX. Log the error and continue. */
-    if ((name_max + 1) <= ((int)sizeof(struct dirent) + name_length)) {
-      Jmsg2(jcr, M_ERROR, 0, T_("%s: File name too long [%d]\n"),
-            result->d_name, name_length);
-      continue;
-    }
+      /* Some filesystems violate against the rules and return filenames
+       * longer than _PC_NAME_MAX. Log the error and continue. */
+      if ((name_max + 1) <= ((int)sizeof(struct dirent) + name_length)) {
+        Jmsg2(jcr, M_ERROR, 0, T_("%s: File name too long [%d]\n"),
+              result->d_name, name_length);
+        continue;
+      }
 
-    // Skip `.', `..', and excluded file names.
-    if (result->d_name[0] == '\0'
-        || (result->d_name[0] == '.'
-            && (result->d_name[1] == '\0'
-                || (result->d_name[1] == '.' && result->d_name[2] == '\0')))) {
-      continue;
+      // Skip `.', `..', and excluded file names.
+      if (result->d_name[0] == '\0'
+          || (result->d_name[0] == '.'
+              && (result->d_name[1] == '\0'
+                  || (result->d_name[1] == '.' && result->d_name[2] == '\0')))) {
+        continue;
+      }
+
+      std::string entry_name;
+      entry_name.reserve(len + name_length);
+      entry_name.append(link, len);
+      entry_name.append(result->d_name, name_length);
+
+      if (FileIsExcluded(ff_pkt, entry_name.c_str())) { continue; }
+
+      if (ff_pkt->PrefetchFct && MaybeRegularFile(result)) {
+        ff_pkt->PrefetchFct(jcr, ff_pkt, entry_name.c_str());
+      }
+
+      upcoming_entry& entry = upcoming.emplace_back();
+      if (ff_pkt->stat_ahead) {
+        entry.stat = ff_pkt->stat_ahead->Submit(entry_name);
+      }
+      entry.name = std::move(entry_name);
     }
 
+    if (upcoming.empty()) { break; }
+
+    upcoming_entry next = std::move(upcoming.front());
+    upcoming.pop_front();
+
     // Make sure there is enough room to store the whole name.
-    if (name_length + len >= link_len) {
-      link_len = len + name_length + 1;
+    if ((int)next.name.size() >= link_len) {
+      link_len = next.name.size() + 1;
       link = (char*)realloc(link, link_len + 1);
     }
 
-    memcpy(link + len, result->d_name, name_length);
-    link[len + name_length] = '\0';
+    memcpy(link + len, next.name.data() + len, next.name.size() - len);
+    link[next.name.size()] = '\0';
 
-    if (!FileIsExcluded(ff_pkt, link)) {
+    if (next.stat) {
+      StatAhead::stat_result stat_result = next.stat->get();
+      ff_pkt->statp = stat_result.statp;
+      rtn_stat = FindOneStatedFile(jcr, ff_pkt, HandleFile, link, our_device,
+                                   false, stat_result.error);
+    } else {
       rtn_stat = FindOneFile(jcr, ff_pkt, HandleFile, link, our_device, false);
-      if (ff_pkt->linked) { ff_pkt->linked->FileIndex = ff_pkt->FileIndex; }
     }
+    if (ff_pkt->linked) { ff_pkt->linked->FileIndex = ff_pkt->FileIndex; }
   }
 
   closedir(directory);
@@ -895,16 +991,37 @@ int FindOneFile(JobControlRecord* jcr,
                 char* fname,
                 dev_t parent_device,
                 bool top_level)
+{
+  int stat_errno = 0;
+  if (lstat(fname, &ff_pkt->statp) != 0) { stat_errno = errno; }
+
+  return FindOneStatedFile(jcr, ff_pkt, HandleFile, fname, parent_device,
+                           top_level, stat_errno);
+}
+
+/**
+ * Same as FindOneFile() but ff_pkt->statp was already filled in by
+ * the caller; stat_errno is the errno of a failed lstat() or 0.
+ */
+static int FindOneStatedFile(JobControlRecord* jcr,
+                             FindFilesPacket* ff_pkt,
+                             int HandleFile(JobControlRecord* jcr,
+                                            FindFilesPacket* ff,
+                                            bool top_level),
+                             char* fname,
+                             dev_t parent_device,
+                             bool top_level,
+                             int stat_errno)
 {
   int rtn_stat;
   bool done = false;
 
   ff_pkt->link = ff_pkt->fname = fname;
   ff_pkt->type = FT_UNSET;
-  if (lstat(fname, &ff_pkt->statp) != 0) {
+  if (stat_errno != 0) {
     // Cannot stat file
     ff_pkt->type = FT_NOSTAT;
-    ff_pkt->ff_errno = errno;
+    ff_pkt->ff_errno = stat_errno;
     return HandleFile(jcr, ff_pkt, top_level);
   }
 
@@ -79,6 +79,22 @@ bool fstype(const char* fname, char* fs, int fslen)
   return false;
 }
 
+static inline uint32_t MntentFeatures(uint32_t features)
+{
+  return ((features & FS_FEATURE_XATTR) ? MNTENT_NO_XATTR : 0)
+         | ((features & FS_FEATURE_ACL) ? MNTENT_NO_ACL : 0);
+}
+
+void FstypeMarkUnsupported(uint32_t dev, uint32_t features)
+{
+  MarkMntentUnsupported(dev, MntentFeatures(features));
+}
+
+bool FstypeUnsupported(uint32_t dev, uint32_t features)
+{
+  return MntentUnsupported(dev, MntentFeatures(features));
+}
+
 #elif defined(HAVE_SUN_OS)
 
 #  include <sys/types.h>
@@ -142,6 +158,13 @@ bool fstype(const char* fname, char* fs, int fslen)
 }
 #endif
 
+#if !defined(HAVE_LINUX_OS)
+// Without a cached mount table every job finds out on its own.
+void FstypeMarkUnsupported(uint32_t, uint32_t) {}
+
+bool FstypeUnsupported(uint32_t, uint32_t) { return false; }
+#endif
+
 /**
  * Compare function build on top of fstype, OS independent.
  *
@@ -24,4 +24,11 @@
 bool fstype(const char* fname, char* fs, int fslen);
 bool FstypeEquals(const char* fname, const char* fstypename);
 
+// Features a filesystem (by st_dev) can lack, see FstypeMarkUnsupported().
+#define FS_FEATURE_XATTR 0x01
+#define FS_FEATURE_ACL 0x02
+
+void FstypeMarkUnsupported(uint32_t dev, uint32_t features);
+bool FstypeUnsupported(uint32_t dev, uint32_t features);
+
 #endif  // BAREOS_FINDLIB_FSTYPE_H_
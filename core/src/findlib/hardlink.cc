@@ -0,0 +1,151 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Tracking of the hard linked files of a backup
+ */
+
+#include "include/bareos.h"
+#include "findlib/hardlink.h"
+
+#include <cstring>
+
+namespace {
+constexpr std::size_t kInitialSlots = 1024;
+// names take up space until there is at least this much garbage
+constexpr std::size_t kMinCompact = 1024 * 1024;
+}  // namespace
+
+std::size_t LinkHash::Slot(const Hardlink& key) const
+{
+  // fibonacci hashing spreads consecutive inodes over the whole table
+  uint64_t hash = std::hash<Hardlink>{}(key);
+  return static_cast<std::size_t>(hash * UINT64_C(0x9e3779b97f4a7c15) >> 32)
+         & (slots_.size() - 1);
+}
+
+uint64_t LinkHash::AddString(const char* data, std::size_t len)
+{
+  uint64_t offset = strings_.size();
+  strings_.insert(strings_.end(), data, data + len);
+  return offset;
+}
+
+void LinkHash::Grow()
+{
+  std::vector<CurLink> old(slots_.empty() ? kInitialSlots : slots_.size() * 2,
+                           CurLink{{}, kEmpty});
+  old.swap(slots_);
+  for (CurLink& link : old) {
+    if (link.name == kEmpty) { continue; }
+    std::size_t i = Slot(link.key);
+    while (slots_[i].name != kEmpty) { i = (i + 1) & (slots_.size() - 1); }
+    slots_[i] = link;
+  }
+}
+
+void LinkHash::Compact()
+{
+  std::vector<char> strings;
+  strings.reserve(strings_.size() - garbage_);
+  for (CurLink& link : slots_) {
+    if (link.name == kEmpty) { continue; }
+    const char* name = strings_.data() + link.name;
+    std::size_t len = strlen(name) + 1;
+    link.name = strings.size();
+    strings.insert(strings.end(), name, name + len);
+    if (link.digest_len) {
+      const char* digest = strings_.data() + link.digest;
+      link.digest = strings.size();
+      strings.insert(strings.end(), digest, digest + link.digest_len);
+    }
+  }
+  strings_.swap(strings);
+  garbage_ = 0;
+}
+
+CurLink& LinkHash::Lookup(const Hardlink& key,
+                          uint32_t links,
+                          const char* fname)
+{
+  if ((used_ + 1) * 4 > slots_.size() * 3) { Grow(); }
+  if (garbage_ > kMinCompact && garbage_ > strings_.size() / 2) { Compact(); }
+
+  std::size_t i = Slot(key);
+  while (slots_[i].name != kEmpty) {
+    if (slots_[i].key == key) { return slots_[i]; }
+    i = (i + 1) & (slots_.size() - 1);
+  }
+
+  CurLink& link = slots_[i];
+  link = CurLink{key, AddString(fname, strlen(fname) + 1)};
+  link.links_remaining = links > 0 ? links - 1 : 0;
+  used_ += 1;
+  return link;
+}
+
+void LinkHash::LinkSeen(CurLink& link)
+{
+  if (link.links_remaining > 1) {
+    link.links_remaining -= 1;
+  } else {
+    Forget(link);
+  }
+}
+
+void LinkHash::SetName(CurLink& link, const char* fname)
+{
+  garbage_ += strlen(name(link)) + 1;
+  link.name = AddString(fname, strlen(fname) + 1);
+}
+
+void LinkHash::SetDigest(CurLink& link,
+                         int32_t digest_stream,
+                         const char* digest,
+                         uint32_t len)
+{
+  if (link.digest_len == 0 && len > 0) {
+    link.digest = AddString(digest, len);
+    link.digest_len = len;
+    link.digest_stream = digest_stream;
+  }
+}
+
+// removes the entry by moving the ones probed after it back
+void LinkHash::Forget(CurLink& link)
+{
+  const std::size_t mask = slots_.size() - 1;
+  std::size_t hole = &link - slots_.data();
+
+  garbage_ += strlen(name(link)) + 1 + link.digest_len;
+  used_ -= 1;
+
+  for (std::size_t i = (hole + 1) & mask; slots_[i].name != kEmpty;
+       i = (i + 1) & mask) {
+    std::size_t home = Slot(slots_[i].key);
+    // can the entry in i move into the hole without becoming unreachable?
+    if (((i - home) & mask) >= ((i - hole) & mask)) {
+      slots_[hole] = slots_[i];
+      hole = i;
+    }
+  }
+  slots_[hole] = CurLink{{}, kEmpty};
+}
@@ -1,7 +1,7 @@
 /*
    BAREOS® - Backup Archiving REcovery Open Sourced
 
-   Copyright (C) 2018-2023 Bareos GmbH & Co. KG
+   Copyright (C) 2018-2024 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -21,38 +21,13 @@
 #ifndef BAREOS_FINDLIB_HARDLINK_H_
 #define BAREOS_FINDLIB_HARDLINK_H_
 
-#include <unordered_map>
+#include <cstdint>
+#include <functional>
 #include <vector>
-#include <string>
 #include <type_traits>
 
 #include "lib/util.h"
 
-/**
- * Structure for keeping track of hard linked files, we
- * keep an entry for each hardlinked file that we save,
- * which is the first one found. For all the other files that
- * are linked to this one, we save only the directory
- * entry so we can link it.
- */
-struct CurLink {
-  uint32_t FileIndex{0};      /**< Bareos FileIndex of this file */
-  int32_t digest_stream{0};   /**< Digest type if needed */
-  std::vector<char> digest{}; /**< Checksum of the file if needed */
-  std::string name;           /**< The name */
-
-  CurLink(const char* fname) : name{fname} {}
-  void set_digest(int32_t new_digest_stream,
-                  const char* new_digest,
-                  uint32_t len)
-  {
-    if (digest.empty()) {
-      digest.assign(new_digest, new_digest + len);
-      digest_stream = new_digest_stream;
-    }
-  }
-};
-
 struct Hardlink {
   // work around for windows; mingw defines ino_t to be 16bit
   // but the compat layer needs 64bits instead, so
@@ -82,6 +57,79 @@ template <> struct std::hash<Hardlink> {
   }
 };
 
-using LinkHash = std::unordered_map<Hardlink, CurLink>;
+/**
+ * Structure for keeping track of hard linked files, we
+ * keep an entry for each hardlinked file that we save,
+ * which is the first one found. For all the other files that
+ * are linked to this one, we save only the directory
+ * entry so we can link it.
+ *
+ * The name and the digest live in the LinkHash the entry belongs to.
+ */
+struct CurLink {
+  Hardlink key{};
+  uint64_t name{0};             /**< Offset of the name in the LinkHash */
+  uint64_t digest{0};           /**< Offset of the checksum if needed */
+  uint32_t FileIndex{0};        /**< Bareos FileIndex of this file */
+  int32_t digest_stream{0};     /**< Digest type if needed */
+  uint32_t links_remaining{0};  /**< Links of the file not seen yet */
+  uint32_t digest_len{0};       /**< Length of the checksum */
+};
+
+/**
+ * Open addressing hash set of the hard linked files seen so far,
+ * keyed by device and inode.  All names are kept in one shared buffer
+ * instead of one allocation per file.
+ *
+ * A file is forgotten once as many different names of it were seen as it
+ * had links when it was first found; its remaining links (e.g. outside of
+ * the fileset) could not refer to it anymore anyway.
+ *
+ * Lookup() and Forget() may move every entry and every name, so
+ * references and pointers returned earlier must not be used afterwards.
+ */
+class LinkHash {
+ public:
+  LinkHash() = default;
+
+  /* Returns the entry of the file, a new one named fname if it was not
+   * seen before.  links is the link count of the file. */
+  CurLink& Lookup(const Hardlink& key, uint32_t links, const char* fname);
+
+  // counts one more name of the file, forgets the file after its last one
+  void LinkSeen(CurLink& link);
+
+  // renames a file that was not backed up yet
+  void SetName(CurLink& link, const char* fname);
+  void SetDigest(CurLink& link,
+                 int32_t digest_stream,
+                 const char* digest,
+                 uint32_t len);
+
+  const char* name(const CurLink& link) const
+  {
+    return strings_.data() + link.name;
+  }
+  const char* digest(const CurLink& link) const
+  {
+    return link.digest_len ? strings_.data() + link.digest : nullptr;
+  }
+
+  std::size_t size() const { return used_; }
+
+ private:
+  static constexpr uint64_t kEmpty = UINT64_MAX;
+
+  std::size_t Slot(const Hardlink& key) const;
+  uint64_t AddString(const char* data, std::size_t len);
+  void Grow();
+  void Forget(CurLink& link);
+  void Compact();
+
+  std::vector<CurLink> slots_;
+  std::vector<char> strings_;
+  std::size_t used_{0};
+  std::size_t garbage_{0}; /* bytes of strings_ no entry refers to */
+};
 
 #endif  // BAREOS_FINDLIB_HARDLINK_H_
@@ -43,6 +43,7 @@
 #include <sys/types.h>
 #include "findlib/match.h"
 #include "findlib/find_one.h"
+#include "findlib/wildcard_set.h"
 #include "lib/edit.h"
 #include "lib/crypto.h"
 
@@ -109,6 +110,11 @@ void TermIncludeExcludeFiles(FindFilesPacket* ff)
     exc = next_exc;
   }
   ff->excluded_paths_list = NULL;
+
+  delete ff->excluded_files_wildcards;
+  ff->excluded_files_wildcards = NULL;
+  delete ff->excluded_paths_wildcards;
+  ff->excluded_paths_wildcards = NULL;
 }
 
 // Add a filename to list of included files
@@ -211,6 +217,12 @@ void AddFnameToIncludeList(FindFilesPacket* ff, int prefixed, const char* fname)
               SetBit(FO_FORCE_ENCRYPT, inc->options);
               rp++;
               break;
+            case 'g':
+              if (*(rp + 2) == '3') {
+                inc->cipher = CRYPTO_CIPHER_AES_256_GCM;
+                rp += 2;
+              }
+              break;
             case 'h':
               switch (*(rp + 2)) {
                 case '1':
@@ -283,6 +295,10 @@ void AddFnameToIncludeList(FindFilesPacket* ff, int prefixed, const char* fname)
               SetBit(FO_XXH128, inc->options);
               rp++;
               break;
+            case '5':
+              SetBit(FO_XXH3_TREE, inc->options);
+              rp++;
+              break;
             default:
               /* If 2 or 3 is seen here, SHA2 is not configured, so
                *  eat the option, and drop back to SHA-1. */
@@ -341,6 +357,11 @@ void AddFnameToIncludeList(FindFilesPacket* ff, int prefixed, const char* fname)
               inc->algo = COMPRESS_FZ4H;
               inc->level = 1; /* Not used with libfzlib */
             }
+          } else if (*rp == 's' && B_ISDIGIT(rp[1]) && B_ISDIGIT(rp[2])) {
+            SetBit(FO_COMPRESS, inc->options);
+            inc->algo = COMPRESS_ZSTD;
+            inc->level = (rp[1] - '0') * 10 + (rp[2] - '0');
+            rp += 2; /* Skip level */
           }
           Dmsg2(200, "Compression alg=%d level=%d\n", inc->algo, inc->level);
           break;
@@ -417,13 +438,16 @@ void AddFnameToExcludeList(FindFilesPacket* ff, const char* fname)
 {
   int len;
   struct s_excluded_file *exc, **list;
+  WildcardSet** wildcards;
 
   Dmsg1(20, "Add name to exclude: %s\n", fname);
 
   if (first_path_separator(fname) != NULL) {
     list = &ff->excluded_paths_list;
+    wildcards = &ff->excluded_paths_wildcards;
   } else {
     list = &ff->excluded_files_list;
+    wildcards = &ff->excluded_files_wildcards;
   }
 
   len = strlen(fname);
@@ -441,6 +465,10 @@ void AddFnameToExcludeList(FindFilesPacket* ff, const char* fname)
   }
 #endif
   *list = exc;
+
+  // All patterns of a list get matched at once, see FileInExcludedList().
+  if (!*wildcards) { *wildcards = new WildcardSet(fnmode | FNM_PATHNAME); }
+  (*wildcards)->Add(exc->fname);
 }
 
 
@@ -498,16 +526,17 @@ bool FileIsIncluded(FindFilesPacket* ff, const char* file)
  * This is the workhorse of excluded_file().
  * Determine if the file is excluded or not.
  */
-static bool FileInExcludedList(struct s_excluded_file* exc, const char* file)
+static bool FileInExcludedList(const WildcardSet* wildcards, const char* file)
 {
-  if (exc == NULL) { Dmsg0(900, "exc is NULL\n"); }
-  for (; exc; exc = exc->next) {
-    if (fnmatch(exc->fname, file, fnmode | FNM_PATHNAME) == 0) {
-      Dmsg2(900, "Match exc pat=%s: file=%s:\n", exc->fname, file);
-      return true;
-    }
-    Dmsg2(900, "No match exc pat=%s: file=%s:\n", exc->fname, file);
+  if (wildcards == NULL) {
+    Dmsg0(900, "exc is NULL\n");
+    return false;
+  }
+  if (wildcards->Matches(file)) {
+    Dmsg1(900, "Match exc: file=%s:\n", file);
+    return true;
   }
+  Dmsg1(900, "No match exc: file=%s:\n", file);
   return false;
 }
 
@@ -526,13 +555,13 @@ bool FileIsExcluded(FindFilesPacket* ff, const char* file)
   if (file[1] == ':') { file += 2; }
 #endif
 
-  if (FileInExcludedList(ff->excluded_paths_list, file)) { return true; }
+  if (FileInExcludedList(ff->excluded_paths_wildcards, file)) { return true; }
 
   /* Try each component */
   for (p = file; *p; p++) {
     /* Match from the beginning of a component only */
     if ((p == file || (!IsPathSeparator(*p) && IsPathSeparator(p[-1])))
-        && FileInExcludedList(ff->excluded_files_list, p)) {
+        && FileInExcludedList(ff->excluded_files_wildcards, p)) {
       return true;
     }
   }
@@ -0,0 +1,54 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "include/bareos.h"
+#include "findlib/stat_ahead.h"
+
+StatAhead::StatAhead(thread_pool& pool,
+                     std::size_t num_workers,
+                     std::size_t queue_size)
+    : lookahead_{queue_size}, group_{queue_size}
+{
+  ASSERT(num_workers > 0);
+  *running_workers_.lock() = num_workers;
+  pool.borrow_threads(num_workers, [this] {
+    group_.work_until_completion();
+
+    *running_workers_.lock() -= 1;
+    workers_done_.notify_one();
+  });
+}
+
+StatAhead::~StatAhead()
+{
+  group_.shutdown();
+  running_workers_.lock().wait(workers_done_,
+                               [](std::size_t num) { return num == 0; });
+}
+
+std::future<StatAhead::stat_result> StatAhead::Submit(const std::string& fname)
+{
+  return group_.submit([fname]() {
+    stat_result result;
+    if (lstat(fname.c_str(), &result.statp) != 0) { result.error = errno; }
+    return result;
+  });
+}
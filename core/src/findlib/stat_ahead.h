@@ -0,0 +1,68 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * stat directory entries concurrently while a directory gets scanned
+ */
+
+#ifndef BAREOS_FINDLIB_STAT_AHEAD_H_
+#define BAREOS_FINDLIB_STAT_AHEAD_H_
+
+#include <sys/stat.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <future>
+#include <string>
+
+#include "lib/thread_pool.h"
+
+/* On network filesystems walking a tree is bound by the latency of the
+ * lstat() calls the scan issues one after the other.  If a StatAhead is
+ * attached to the FindFilesPacket, the directory scan submits the lstat()
+ * of the entries it has read ahead to a couple of worker threads and only
+ * collects the results when it actually gets to the entry, so the order
+ * in which files are handed to the save callback does not change. */
+class StatAhead {
+ public:
+  struct stat_result {
+    int error{0}; /**< errno of the failed lstat(), 0 on success */
+    struct stat statp {};
+  };
+
+  StatAhead(thread_pool& pool, std::size_t num_workers, std::size_t queue_size);
+  StatAhead(const StatAhead&) = delete;
+  StatAhead& operator=(const StatAhead&) = delete;
+  ~StatAhead();
+
+  std::future<stat_result> Submit(const std::string& fname);
+
+  // number of entries a directory scan should read ahead
+  std::size_t Lookahead() const { return lookahead_; }
+
+ private:
+  std::size_t lookahead_;
+  work_group group_;
+  std::condition_variable workers_done_{};
+  synchronized<std::size_t> running_workers_{};
+};
+
+#endif  // BAREOS_FINDLIB_STAT_AHEAD_H_
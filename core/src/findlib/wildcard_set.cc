@@ -0,0 +1,151 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "include/bareos.h"
+#include "findlib/wildcard_set.h"
+#include "lib/fnmatch.h"
+
+#include <algorithm>
+#include <cstring>
+
+void WildcardSet::trie::Insert(std::string_view literal)
+{
+  uint32_t current = 0;
+  for (char c : literal) {
+    auto& children = nodes_[current].children;
+    auto child
+        = std::find_if(children.begin(), children.end(),
+                       [c](const auto& entry) { return entry.first == c; });
+    if (child != children.end()) {
+      current = child->second;
+    } else {
+      uint32_t next = nodes_.size();
+      nodes_[current].children.emplace_back(c, next);
+      nodes_.emplace_back();
+      current = next;
+    }
+  }
+  nodes_[current].terminal = true;
+}
+
+const WildcardSet::trie::node* WildcardSet::trie::Child(const node& parent,
+                                                        char c) const
+{
+  for (const auto& [key, index] : parent.children) {
+    if (key == c) { return &nodes_[index]; }
+  }
+  return nullptr;
+}
+
+// the same folding fnmatch() does
+char WildcardSet::Fold(char c) const
+{
+  return (flags_ & FNM_CASEFOLD) && B_ISUPPER(c) ? tolower(c) : c;
+}
+
+void WildcardSet::Add(const char* pattern)
+{
+  size_ += 1;
+
+  std::string_view view{pattern};
+  if ((flags_ & ~(FNM_CASEFOLD | FNM_PATHNAME))
+      || view.find_first_of("?[\\") != view.npos) {
+    others_.emplace_back(pattern);
+    return;
+  }
+
+  // multiple stars get collapsed by fnmatch()
+  std::size_t first_star = view.find('*');
+  std::size_t last_star = view.rfind('*');
+  std::size_t leading = view.find_first_not_of('*');
+  std::size_t trailing = view.find_last_not_of('*');
+
+  std::string literal;
+  if (first_star == view.npos) {
+    literal = view;
+  } else if (leading == view.npos || first_star > trailing) {
+    // "prefix*" (or only stars)
+    literal = view.substr(0, first_star);
+  } else if (last_star < leading) {
+    // "*suffix"
+    literal = view.substr(leading);
+    std::reverse(literal.begin(), literal.end());
+  } else {
+    others_.emplace_back(pattern);
+    return;
+  }
+  for (char& c : literal) { c = Fold(c); }
+
+  if (first_star == view.npos) {
+    literals_.insert(std::move(literal));
+  } else if (leading == view.npos || first_star > trailing) {
+    prefixes_.Insert(literal);
+  } else {
+    suffixes_.Insert(literal);
+  }
+}
+
+bool WildcardSet::Matches(const char* name) const
+{
+  const std::size_t length = strlen(name);
+  const bool pathname = flags_ & FNM_PATHNAME;
+  const char* first_slash = strchr(name, '/');
+  const char* last_slash = strrchr(name, '/');
+
+  if (!literals_.empty()) {
+    std::string folded{name, length};
+    for (char& c : folded) { c = Fold(c); }
+    if (literals_.count(folded)) { return true; }
+  }
+
+  /* With FNM_PATHNAME the star does not match a slash, so whatever it
+   * covers has to be free of them. */
+  if (!prefixes_.no_entries()) {
+    const trie::node* node = &prefixes_.root();
+    for (std::size_t i = 0; node; ++i) {
+      if (node->terminal
+          && (!pathname || !last_slash || i > std::size_t(last_slash - name))) {
+        return true;
+      }
+      if (i == length) { break; }
+      node = prefixes_.Child(*node, Fold(name[i]));
+    }
+  }
+
+  if (!suffixes_.no_entries()) {
+    const trie::node* node = &suffixes_.root();
+    for (std::size_t depth = 0; node; ++depth) {
+      std::size_t start = length - depth;
+      if (node->terminal
+          && (!pathname || !first_slash
+              || start <= std::size_t(first_slash - name))) {
+        return true;
+      }
+      if (depth == length) { break; }
+      node = suffixes_.Child(*node, Fold(name[start - 1]));
+    }
+  }
+
+  for (const std::string& pattern : others_) {
+    if (fnmatch(pattern.c_str(), name, flags_) == 0) { return true; }
+  }
+  return false;
+}
@@ -0,0 +1,99 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * match a name against many wild cards at once
+ */
+
+#ifndef BAREOS_FINDLIB_WILDCARD_SET_H_
+#define BAREOS_FINDLIB_WILDCARD_SET_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+/* FileSets often exclude hundreds of names or suffixes, which made
+ * AcceptFile() call fnmatch() hundreds of times for every file.  A
+ * WildcardSet sorts the patterns by their shape: names without any wild card
+ * go into a hash set, "prefix*" and "*suffix" patterns into a trie each, so
+ * a name is checked against all of them in a single pass.  Only the
+ * remaining patterns are handed to fnmatch() one by one. */
+class WildcardSet {
+ public:
+  // flags as given to fnmatch(), only FNM_CASEFOLD and FNM_PATHNAME are sped up
+  explicit WildcardSet(int flags) : flags_{flags} {}
+
+  void Add(const char* pattern);
+
+  // true if fnmatch() would have matched name against any of the patterns
+  bool Matches(const char* name) const;
+
+  std::size_t size() const { return size_; }
+  int flags() const { return flags_; }
+
+ private:
+  // trie of literal strings, children are few so they are searched linearly
+  class trie {
+   public:
+    void Insert(std::string_view literal);
+    bool no_entries() const
+    {
+      return nodes_.size() == 1 && !nodes_[0].terminal;
+    }
+
+    struct node {
+      std::vector<std::pair<char, uint32_t>> children{};
+      bool terminal{false};
+    };
+    const node& root() const { return nodes_[0]; }
+    const node* Child(const node& parent, char c) const;
+
+   private:
+    std::vector<node> nodes_{1};
+  };
+
+  char Fold(char c) const;
+
+  int flags_;
+  std::size_t size_{0};
+  std::unordered_set<std::string> literals_{};
+  trie prefixes_{}; /* of "prefix*" */
+  trie suffixes_{}; /* of "*suffix", stored reversed */
+  std::vector<std::string> others_{};
+};
+
+// The wild cards of one findFOPTS, see AcceptFile().
+struct fopts_wildcards {
+  explicit fopts_wildcards(int flags)
+      : any{flags}, dir{flags}, file{flags}, base{flags}
+  {
+  }
+
+  WildcardSet any;  /**< wild */
+  WildcardSet dir;  /**< wilddir */
+  WildcardSet file; /**< wildfile */
+  WildcardSet base; /**< wildbase, matched against the basename */
+};
+
+#endif  // BAREOS_FINDLIB_WILDCARD_SET_H_
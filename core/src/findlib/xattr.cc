@@ -59,6 +59,7 @@
 #include "include/bareos.h"
 #include "include/streams.h"
 #include "find.h"
+#include "findlib/fstype.h"
 #include "lib/berrno.h"
 #include "lib/bsock.h"
 #include "include/jcr.h"
@@ -88,6 +89,11 @@ BxattrExitCode ParseXattrStreams(JobControlRecord*,
 {
   return BxattrExitCode::kErrorFatal;
 }
+
+std::optional<std::vector<prefetched_xattr_t>> CollectXattrs(const char*)
+{
+  return std::nullopt;
+}
 #else
 // Send a XATTR stream to the SD.
 BxattrExitCode SendXattrStream(JobControlRecord* jcr,
@@ -668,14 +674,135 @@ static const char* xattr_skiplist[]
 #      endif
 #    endif
 
+static bool InXattrSkiplist(const char* name, const char** skiplist)
+{
+  for (int cnt = 0; skiplist[cnt] != NULL; cnt++) {
+    if (bstrcmp(name, skiplist[cnt])) { return true; }
+  }
+  return false;
+}
+
+static bool SkipXattr(FindFilesPacket* ff_pkt, const char* name)
+{
+  /* On some OSes you also get the acls in the extented attribute list.
+   * So we check if we are already backing up acls and if we do we
+   * don't store the extended attribute with the same info. */
+  if (BitIsSet(FO_ACL, ff_pkt->flags)
+      && InXattrSkiplist(name, xattr_acl_skiplist)) {
+    return true;
+  }
+
+  /* On some OSes we want to skip certain xattrs which are in the
+   * xattr_skiplist array. */
+  return InXattrSkiplist(name, xattr_skiplist);
+}
+
+/**
+ * Read the names and values of all xattrs of fname, except the ones in the
+ * xattr_skiplist.  This can be called from any thread as it only reports
+ * success or failure; anything but success makes the backup fall back to
+ * generic_build_xattr_streams() which reports the problem properly.
+ */
+std::optional<std::vector<prefetched_xattr_t>> CollectXattrs(
+    const char* fname)
+{
+  std::vector<prefetched_xattr_t> xattrs;
+
+  ssize_t list_len = llistxattr(fname, NULL, 0);
+  if (list_len <= 0) {
+    if (list_len == 0) { return xattrs; }
+    return std::nullopt;
+  }
+
+  std::vector<char> list(list_len + 1);
+  list_len = llistxattr(fname, list.data(), list_len);
+  if (list_len < 0) { return std::nullopt; }
+  list[list_len] = '\0';
+
+  std::size_t total_len = 0;
+  for (const char* bp = list.data(); (bp - list.data()) + 1 < list_len;
+       bp = strchr(bp, '\0') + 1) {
+    if (*bp == '\0' || InXattrSkiplist(bp, xattr_skiplist)) { continue; }
+
+    ssize_t value_len = lgetxattr(fname, bp, NULL, 0);
+    if (value_len < 0) { return std::nullopt; }
+
+    prefetched_xattr_t& xattr = xattrs.emplace_back();
+    xattr.name = bp;
+    if (value_len > 0) {
+      xattr.value.resize(value_len);
+      value_len = lgetxattr(fname, bp, xattr.value.data(), value_len);
+      if (value_len < 0) { return std::nullopt; }
+      xattr.value.resize(value_len);
+    }
+
+    total_len += xattr.name.size() + xattr.value.size();
+    if (total_len >= MAX_XATTR_STREAM) { return std::nullopt; }
+  }
+
+  return xattrs;
+}
+
+// Send the xattrs collected ahead of time by CollectXattrs().
+static BxattrExitCode build_prefetched_xattr_streams(
+    JobControlRecord* jcr,
+    XattrData* xattr_data,
+    FindFilesPacket* ff_pkt,
+    std::vector<prefetched_xattr_t>& xattrs)
+{
+  uint32_t expected_serialize_len = 0;
+  alist<xattr_t*> xattr_value_list(10, not_owned_by_alist);
+
+  for (prefetched_xattr_t& xattr : xattrs) {
+    if (SkipXattr(ff_pkt, xattr.name.c_str())) {
+      Dmsg1(100, "Skipping xattr named %s\n", xattr.name.c_str());
+      continue;
+    }
+
+    /* The internal table only borrows name and value, so it does not get
+     * dropped with XattrDropInternalTable(). */
+    xattr_t* current_xattr = (xattr_t*)malloc(sizeof(xattr_t));
+    current_xattr->magic = XATTR_MAGIC;
+    current_xattr->name_length = xattr.name.size();
+    current_xattr->name = xattr.name.data();
+    current_xattr->value_length = xattr.value.size();
+    current_xattr->value = xattr.value.empty() ? NULL : xattr.value.data();
+    xattr_value_list.append(current_xattr);
+
+    expected_serialize_len += sizeof(current_xattr->magic)
+                              + sizeof(current_xattr->name_length)
+                              + current_xattr->name_length
+                              + sizeof(current_xattr->value_length)
+                              + current_xattr->value_length;
+  }
+
+  BxattrExitCode retval = BxattrExitCode::kSuccess;
+  if (!xattr_value_list.empty()) {
+    if (SerializeXattrStream(jcr, xattr_data, expected_serialize_len,
+                             &xattr_value_list)
+        < expected_serialize_len) {
+      Mmsg1(jcr->errmsg,
+            T_("Failed to Serialize extended attributes on file \"%s\"\n"),
+            xattr_data->last_fname);
+      Dmsg1(100, "Failed to Serialize extended attributes on file \"%s\"\n",
+            xattr_data->last_fname);
+      retval = BxattrExitCode::kError;
+    } else {
+      retval = SendXattrStream(jcr, xattr_data, os_default_xattr_streams[0]);
+    }
+  }
+
+  for (xattr_t* current_xattr : xattr_value_list) { free(current_xattr); }
+  return retval;
+}
+
 static BxattrExitCode generic_build_xattr_streams(JobControlRecord* jcr,
                                                   XattrData* xattr_data,
                                                   FindFilesPacket* ff_pkt)
 {
   char* bp;
-  bool skip_xattr;
   char* xattr_list = NULL;
-  int cnt, xattr_count = 0;
+  int xattr_count = 0;
   uint32_t name_length;
   int32_t xattr_list_len, xattr_value_len;
   uint32_t expected_serialize_len = 0;
@@ -683,6 +810,13 @@ static BxattrExitCode generic_build_xattr_streams(JobControlRecord* jcr,
   alist<xattr_t*>* xattr_value_list = NULL;
   BxattrExitCode retval = BxattrExitCode::kError;
 
+  if (xattr_data->prefetched) {
+    std::vector<prefetched_xattr_t> xattrs
+        = std::move(*xattr_data->prefetched);
+    xattr_data->prefetched.reset();
+    return build_prefetched_xattr_streams(jcr, xattr_data, ff_pkt, xattrs);
+  }
+
   // First get the length of the available list with extended attributes.
   xattr_list_len = llistxattr(xattr_data->last_fname, NULL, 0);
   switch (xattr_list_len) {
@@ -698,8 +832,10 @@ static BxattrExitCode generic_build_xattr_streams(JobControlRecord* jcr,
            * the BXATTR_FLAG_RESTORE_NATIVE flag so we skip XATTR restores
            * on all other files on the same filesystem. The
            * BXATTR_FLAG_RESTORE_NATIVE flags gets sets again when we
-           * change from one filesystem to another. */
+           * change from one filesystem to another, unless the filesystem
+           * is remembered as not supporting XATTRs. */
           xattr_data->flags &= ~BXATTR_FLAG_SAVE_NATIVE;
+          FstypeMarkUnsupported(ff_pkt->statp.st_dev, FS_FEATURE_XATTR);
           retval = BxattrExitCode::kWarning;
           Mmsg(jcr->errmsg, error_message_disabling_xattributes.c_str(),
                xattr_data->last_fname);
@@ -755,33 +891,8 @@ static BxattrExitCode generic_build_xattr_streams(JobControlRecord* jcr,
    * We already count the bytes needed for serializing the stream later on. */
   for (bp = xattr_list; (bp - xattr_list) + 1 < xattr_list_len;
        bp = strchr(bp, '\0') + 1) {
-    skip_xattr = false;
-
-    /* On some OSes you also get the acls in the extented attribute list.
-     * So we check if we are already backing up acls and if we do we
-     * don't store the extended attribute with the same info. */
-    if (BitIsSet(FO_ACL, ff_pkt->flags)) {
-      for (cnt = 0; xattr_acl_skiplist[cnt] != NULL; cnt++) {
-        if (bstrcmp(bp, xattr_acl_skiplist[cnt])) {
-          skip_xattr = true;
-          break;
-        }
-      }
-    }
-
-    /* On some OSes we want to skip certain xattrs which are in the
-     * xattr_skiplist array. */
-    if (!skip_xattr) {
-      for (cnt = 0; xattr_skiplist[cnt] != NULL; cnt++) {
-        if (bstrcmp(bp, xattr_skiplist[cnt])) {
-          skip_xattr = true;
-          break;
-        }
-      }
-    }
-
     name_length = strlen(bp);
-    if (skip_xattr || name_length == 0) {
+    if (name_length == 0 || SkipXattr(ff_pkt, bp)) {
       Dmsg1(100, "Skipping xattr named %s\n", bp);
       continue;
     }
@@ -2746,15 +2857,31 @@ BxattrExitCode BuildXattrStreams(JobControlRecord* jcr,
     xattr_data->flags = BXATTR_FLAG_SAVE_NATIVE;
     xattr_data->first_dev = false;
     xattr_data->current_dev = ff_pkt->statp.st_dev;
+
+    // Skip filesystems that already told us they have no XATTRs.
+    if (FstypeUnsupported(xattr_data->current_dev, FS_FEATURE_XATTR)) {
+      Dmsg1(100, "XATTRs not supported on the filesystem of \"%s\"\n",
+            xattr_data->last_fname);
+      xattr_data->flags &= ~BXATTR_FLAG_SAVE_NATIVE;
+    }
   }
 
   if ((xattr_data->flags & BXATTR_FLAG_SAVE_NATIVE) && os_build_xattr_streams) {
     return os_build_xattr_streams(jcr, xattr_data, ff_pkt);
   } else {
+    xattr_data->prefetched.reset();
     return BxattrExitCode::kSuccess;
   }
 }
 
+#  if !defined(HAVE_DARWIN_OS) && !defined(HAVE_LINUX_OS)
+// Only the generic implementation can use xattrs collected ahead of time.
+std::optional<std::vector<prefetched_xattr_t>> CollectXattrs(const char*)
+{
+  return std::nullopt;
+}
+#  endif
+
 BxattrExitCode ParseXattrStreams(JobControlRecord* jcr,
                                  XattrData* xattr_data,
                                  int stream,
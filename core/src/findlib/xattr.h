@@ -24,6 +24,10 @@
 #ifndef BAREOS_FINDLIB_XATTR_H_
 #define BAREOS_FINDLIB_XATTR_H_
 
+#include <optional>
+#include <string>
+#include <vector>
+
 // Return codes from xattr subroutines.
 enum class BxattrExitCode
 {
@@ -71,6 +75,12 @@ struct xattr_build_data_t {
   alist<xattr_link_cache_entry_t*>* link_cache;
 };
 
+// An extended attribute read ahead of time, see CollectXattrs().
+struct prefetched_xattr_t {
+  std::string name;
+  std::string value;
+};
+
 struct xattr_parse_data_t {
   uint32_t nr_errors;
 };
@@ -81,6 +91,9 @@ struct XattrData {
   uint32_t flags{0}; /* See BXATTR_FLAG_* */
   uint32_t current_dev{0};
   bool first_dev{true};
+  /* The xattrs of last_fname if they were collected ahead of time,
+   * used (and cleared) by the next BuildXattrStreams() */
+  std::optional<std::vector<prefetched_xattr_t>> prefetched{};
   union {
     struct xattr_build_data_t* build;
     struct xattr_parse_data_t* parse;
@@ -110,6 +123,8 @@ BxattrExitCode UnSerializeXattrStream(JobControlRecord* jcr,
 BxattrExitCode BuildXattrStreams(JobControlRecord* jcr,
                                  struct XattrData* xattr_data,
                                  FindFilesPacket* ff_pkt);
+std::optional<std::vector<prefetched_xattr_t>> CollectXattrs(
+    const char* fname);
 BxattrExitCode ParseXattrStreams(JobControlRecord* jcr,
                                  struct XattrData* xattr_data,
                                  int stream,
@@ -24,6 +24,12 @@
 #ifndef BAREOS_INCLUDE_COMPRESSION_CONTEXT_H_
 #define BAREOS_INCLUDE_COMPRESSION_CONTEXT_H_
 
+#include <cstdint>
+#include <map>
+#include <memory>
+
+class CompressionDictionary;
+
 /* clang-format off */
 struct CompressionContext {
   POOLMEM* deflate_buffer{nullptr}; /**< Buffer used for deflation (compression) */
@@ -38,7 +44,14 @@ struct CompressionContext {
     void* pLZO{nullptr}; /**< LZO compression session data */
 #endif
     void* pZFAST{nullptr}; /**< FASTLZ compression session data */
+#ifdef HAVE_ZSTD
+    void* pZSTD{nullptr}; /**< ZSTD compression context */
+    void* pZSTDD{nullptr}; /**< ZSTD decompression context */
+#endif
   } workset;
+  std::shared_ptr<const CompressionDictionary> dictionary{}; /**< Used to compress */
+  std::map<std::uint32_t, std::shared_ptr<const CompressionDictionary>>
+      dictionaries{}; /**< Known to decompress, by id */
 };
 /* clang-format on */
 
@@ -73,10 +73,11 @@ enum
   FO_NO_AUTOEXCL = 31, /**< Don't use autoexclude methods */
   FO_FORCE_ENCRYPT = 32, /**< Force encryption */
   FO_XXH128 = 33,        /**< Do xxHash128 checksum */
+  FO_XXH3_TREE = 34,     /**< Do xxHash128 tree checksum */
 };
 
 // Keep this set to the last entry in the enum.
-#define FO_MAX FO_XXH128
+#define FO_MAX FO_XXH3_TREE
 
 // Make sure you have enough bits to store all above bit fields.
 #define FOPTS_BYTES NbytesForBits(FO_MAX + 1)
@@ -207,6 +207,7 @@ class JobControlRecord {
   alist<BareosRegex*>* where_bregexp{};       /**< BareosRegex alist for path manipulation */
   int32_t cached_pnl{};         /**< Cached path length */
   POOLMEM* cached_path{};   /**< Cached path */
+  PathList* made_paths{};   /**< Paths known to exist (used by findlib) */
   bool passive_client{};    /**< Client is a passive client e.g. doesn't initiate any network connection */
   bool prefix_links{};      /**< Prefix links with Where path */
   bool gui{};               /**< Set if gui using console */
@@ -106,6 +106,7 @@
 #define STREAM_ENCRYPTED_WIN32_COMPRESSED_DATA 33       /**< Encrypted, compressed Win32 BackupRead data */
 
 #define STREAM_XXH128_DIGEST                   40       /**< xxHash128 digest for the file */
+#define STREAM_XXH3_TREE_DIGEST                41       /**< Tree of xxHash128 chunk digests for the file */
 
 #define STREAM_NDMP_SEPARATOR                 999       /**< NDMP separator between multiple data streams of one job */
 
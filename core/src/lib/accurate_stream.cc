@@ -0,0 +1,116 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+#include "lib/accurate_stream.h"
+
+#include <algorithm>
+
+namespace {
+void PutVarint(std::vector<char>& out, uint64_t value)
+{
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+}  // namespace
+
+bool AccurateStreamWriter::Add(std::string_view fname,
+                               std::string_view lstat,
+                               std::string_view chksum,
+                               uint32_t delta_seq)
+{
+  std::size_t shared = 0;
+  std::size_t max_shared = std::min(fname.size(), previous_.size());
+  while (shared < max_shared && fname[shared] == previous_[shared]) {
+    shared += 1;
+  }
+
+  PutVarint(buf_, shared);
+  PutVarint(buf_, fname.size() - shared);
+  buf_.insert(buf_.end(), fname.begin() + shared, fname.end());
+  PutVarint(buf_, lstat.size());
+  buf_.insert(buf_.end(), lstat.begin(), lstat.end());
+  buf_.push_back(0);
+  PutVarint(buf_, chksum.size());
+  buf_.insert(buf_.end(), chksum.begin(), chksum.end());
+  buf_.push_back(0);
+  PutVarint(buf_, delta_seq);
+
+  previous_.assign(fname);
+  return buf_.size() >= message_size;
+}
+
+void AccurateStreamWriter::Clear()
+{
+  buf_.clear();
+  previous_.clear();
+}
+
+bool AccurateStreamReader::GetVarint(uint64_t& value)
+{
+  value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (p_ == end_) { return false; }
+    uint8_t byte = static_cast<uint8_t>(*p_++);
+    value |= uint64_t{byte & 0x7fu} << shift;
+    if (!(byte & 0x80)) { return true; }
+  }
+  return false;
+}
+
+bool AccurateStreamReader::Next(accurate_stream_entry& entry)
+{
+  if (p_ == end_) { return false; }
+
+  uint64_t shared, suffix, lstat_length, chksum_length, delta_seq;
+  error_ = true;
+  if (!GetVarint(shared) || (first_ ? shared != 0 : shared > entry.fname.size())
+      || !GetVarint(suffix) || suffix > uint64_t(end_ - p_)) {
+    return false;
+  }
+  first_ = false;
+  entry.fname.resize(shared);
+  entry.fname.append(p_, suffix);
+  p_ += suffix;
+
+  if (!GetVarint(lstat_length) || lstat_length >= uint64_t(end_ - p_)
+      || p_[lstat_length] != 0) {
+    return false;
+  }
+  entry.lstat = p_;
+  entry.lstat_length = static_cast<int>(lstat_length);
+  p_ += lstat_length + 1;
+
+  if (!GetVarint(chksum_length) || chksum_length >= uint64_t(end_ - p_)
+      || p_[chksum_length] != 0) {
+    return false;
+  }
+  entry.chksum = p_;
+  entry.chksum_length = static_cast<int>(chksum_length);
+  p_ += chksum_length + 1;
+
+  if (!GetVarint(delta_seq)) { return false; }
+  entry.delta_seq = static_cast<int32_t>(delta_seq);
+
+  error_ = false;
+  return true;
+}
@@ -0,0 +1,92 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * binary form of the accurate file list the director sends to the fd
+ */
+#ifndef BAREOS_LIB_ACCURATE_STREAM_H_
+#define BAREOS_LIB_ACCURATE_STREAM_H_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/* Instead of one message per file, file daemons that understand it get
+ * messages with many entries each:
+ *
+ *   varint shared prefix length, varint suffix length, suffix,
+ *   varint lstat length, lstat, 0, varint chksum length, chksum, 0,
+ *   varint delta_seq
+ *
+ * The name of an entry shares its first characters with the name of the entry
+ * before it in the same message, the first entry of a message has the whole
+ * name.  The zeros after the lstat and the checksum let the fd use them
+ * in place. */
+class AccurateStreamWriter {
+ public:
+  static constexpr std::size_t message_size = 64 * 1024;
+
+  // returns true once the message is big enough to be sent
+  bool Add(std::string_view fname,
+           std::string_view lstat,
+           std::string_view chksum,
+           uint32_t delta_seq);
+  bool empty() const { return buf_.empty(); }
+  const char* data() const { return buf_.data(); }
+  uint32_t size() const { return static_cast<uint32_t>(buf_.size()); }
+  void Clear();
+
+ private:
+  std::vector<char> buf_;
+  std::string previous_;
+};
+
+struct accurate_stream_entry {
+  std::string fname;
+  char* lstat{nullptr};
+  int lstat_length{0};
+  char* chksum{nullptr};
+  int chksum_length{0};
+  int32_t delta_seq{0};
+};
+
+class AccurateStreamReader {
+ public:
+  AccurateStreamReader(char* msg, int32_t length)
+      : p_{msg}, end_{msg + (length > 0 ? length : 0)}
+  {
+  }
+
+  /* Gets the next entry, its lstat and chksum point into the message.  Returns
+   * false at the end of the message or if it is corrupt. */
+  bool Next(accurate_stream_entry& entry);
+  bool Error() const { return error_; }
+
+ private:
+  bool GetVarint(uint64_t& value);
+  char* p_;
+  char* end_;
+  bool first_{true};
+  bool error_{false};
+};
+
+#endif  // BAREOS_LIB_ACCURATE_STREAM_H_
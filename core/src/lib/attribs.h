@@ -1,7 +1,7 @@
 /*
    BAREOS® - Backup Archiving REcovery Open Sourced
 
-   Copyright (C) 2018-2023 Bareos GmbH & Co. KG
+   Copyright (C) 2018-2024 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -28,4 +28,17 @@ void EncodeStat(char* buf,
                 int data_stream);
 int DecodeStat(char* buf, struct stat* statp, int stat_size, int32_t* LinkFI);
 
+// First byte of the binary form, which the text form never starts with
+inline constexpr char kBinaryStatVersion = '\x01';
+
+void EncodeStatBinary(char* buf,
+                      struct stat* statp,
+                      int stat_size,
+                      int32_t LinkFI,
+                      int data_stream);
+bool IsBinaryStat(const char* buf);
+/* Puts the text form of buf into text if buf holds the binary form.
+ * Returns false if it does not or if the binary form is malformed. */
+bool StatToText(const char* buf, PoolMem& text);
+
 #endif  // BAREOS_LIB_ATTRIBS_H_
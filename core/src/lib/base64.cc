@@ -27,24 +27,28 @@
 
 #include "include/bareos.h"
 
-static uint8_t const base64_digits[64]
+static constexpr uint8_t base64_digits[64]
     = {'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M',
        'N', 'O', 'P', 'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z',
        'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm',
        'n', 'o', 'p', 'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z',
        '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', '+', '/'};
 
-static int base64_inited = 0;
-static uint8_t base64_map[256];
+struct base64_decode_table {
+  uint8_t map[256]{};
 
-/* Initialize the Base 64 conversion routines */
-void Base64Init(void)
-{
-  int i;
-  memset(base64_map, 0, sizeof(base64_map));
-  for (i = 0; i < 64; i++) base64_map[(uint8_t)base64_digits[i]] = i;
-  base64_inited = 1;
-}
+  constexpr base64_decode_table()
+  {
+    for (int i = 0; i < 64; i++) { map[base64_digits[i]] = i; }
+  }
+};
+
+// built at compile time, characters that are no base64 digits map to 0
+static constexpr base64_decode_table base64_table{};
+static constexpr const uint8_t* base64_map = base64_table.map;
+
+/* The conversion table is a constant, nothing to initialize anymore */
+void Base64Init(void) {}
 
 /* Convert a value to base64 characters.
  * The result is stored in where, which
@@ -55,31 +59,26 @@ void Base64Init(void)
  */
 int ToBase64(int64_t value, char* where)
 {
-  uint64_t val;
   int i = 0;
-  int n;
 
   /* Handle negative values */
-  if (value < 0) {
-    where[i++] = '-';
-    value = -value;
+  if (value < 0) { where[i++] = '-'; }
+  uint64_t val = value < 0 ? 0 - static_cast<uint64_t>(value) : value;
+
+  /* Six bits per character, at least one character for 0 */
+  int digits = 1;
+  if (val) {
+    int bits = 64 - __builtin_clzll(val);
+    digits = (bits + 5) / 6;
   }
 
-  /* Determine output size */
-  val = value;
-  do {
-    val >>= 6;
-    i++;
-  } while (val);
-  n = i;
-
   /* Output characters */
-  val = value;
-  where[i] = 0;
-  do {
-    where[--i] = base64_digits[val & (uint64_t)0x3F];
+  int n = i + digits;
+  where[n] = 0;
+  for (int pos = n - 1; pos >= i; pos--) {
+    where[pos] = base64_digits[val & 0x3F];
     val >>= 6;
-  } while (val);
+  }
   return n;
 }
 
@@ -95,7 +94,6 @@ int FromBase64(int64_t* value, char* where)
   uint64_t val = 0;
   int i, neg;
 
-  if (!base64_inited) Base64Init();
   /* Check if it is negative */
   i = neg = 0;
   if (where[i] == '-') {
@@ -132,7 +130,24 @@ int BinToBase64(char* buf, int buflen, char* bin, int binlen, bool compatible)
   reg = 0;
   rem = 0;
   buflen--; /* allow for storing EOS */
-  for (i = 0; i < binlen;) {
+  i = 0;
+
+  /* Three whole bytes make four characters.  The other alphabet sign extends
+   * the bytes into the bits left over from the previous byte, so it has to
+   * go the long way below. */
+  if (compatible) {
+    for (; i + 3 <= binlen && j + 4 <= buflen; i += 3, j += 4) {
+      uint32_t group = (uint32_t)(uint8_t)bin[i] << 16
+                       | (uint32_t)(uint8_t)bin[i + 1] << 8
+                       | (uint8_t)bin[i + 2];
+      buf[j] = base64_digits[group >> 18];
+      buf[j + 1] = base64_digits[(group >> 12) & 0x3F];
+      buf[j + 2] = base64_digits[(group >> 6) & 0x3F];
+      buf[j + 3] = base64_digits[group & 0x3F];
+    }
+  }
+
+  while (i < binlen) {
     if (rem < 6) {
       reg <<= 8;
       if (compatible) {
@@ -177,8 +192,6 @@ int Base64ToBin(char* dest, int dest_size, char* src, int srclen)
   uint8_t* bufplain = (uint8_t*)dest;
   const uint8_t* bufin;
 
-  if (!base64_inited) Base64Init();
-
   if (dest_size < (((srclen + 3) / 4) * 3)) {
     /* dest buffer too small */
     *dest = 0;
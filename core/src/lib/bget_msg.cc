@@ -36,22 +36,12 @@ static char TERM_msg[] = "2999 Terminate\n";
 
 #define messagelevel 500
 
-/**
- * This routine does a BnetRecv(), then if a signal was
- *   sent, it handles it.  The return codes are the same as
- *   bne_recv() except the BNET_SIGNAL messages that can
- *   be handled are done so without returning.
- *
- * Returns number of bytes read (may return zero)
- * Returns -1 on signal (BNET_SIGNAL)
- * Returns -2 on hard end of file (BNET_HARDEOF)
- * Returns -3 on error  (BNET_ERROR)
- */
-int BgetMsg(BareosSocket* sock)
+// Receive a message with recv() and handle the signals as described below.
+template <typename Receive> static int GetMsg(BareosSocket* sock, Receive recv)
 {
   int n;
   for (;;) {
-    n = sock->recv();
+    n = recv(sock);
     if (n >= 0) { /* normal return */
       return n;
     }
@@ -100,3 +90,28 @@ int BgetMsg(BareosSocket* sock)
     }
   }
 }
+
+/**
+ * This routine does a BnetRecv(), then if a signal was
+ *   sent, it handles it.  The return codes are the same as
+ *   bne_recv() except the BNET_SIGNAL messages that can
+ *   be handled are done so without returning.
+ *
+ * Returns number of bytes read (may return zero)
+ * Returns -1 on signal (BNET_SIGNAL)
+ * Returns -2 on hard end of file (BNET_HARDEOF)
+ * Returns -3 on error  (BNET_ERROR)
+ */
+int BgetMsg(BareosSocket* sock)
+{
+  return GetMsg(sock, [](BareosSocket* bs) { return bs->recv(); });
+}
+
+/**
+ * Same as BgetMsg() but only the length of a message is received, its
+ *   content has to be read by the caller with RecvContent().
+ */
+int BgetMsgLength(BareosSocket* sock)
+{
+  return GetMsg(sock, [](BareosSocket* bs) { return bs->RecvLength(); });
+}
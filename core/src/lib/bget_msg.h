@@ -22,5 +22,6 @@
 #define BAREOS_LIB_BGET_MSG_H_
 
 int BgetMsg(BareosSocket* sock);
+int BgetMsgLength(BareosSocket* sock);
 
 #endif  // BAREOS_LIB_BGET_MSG_H_
@@ -134,6 +134,7 @@ bool BnetTlsServer(BareosSocket* bsock,
             bsock->host());
       goto err;
     }
+    bsock->SetTlsPeerVerified();
   }
 
   bsock->LockMutex();
@@ -186,6 +187,7 @@ bool BnetTlsClient(BareosSocket* bsock,
         goto err;
       }
     }
+    bsock->SetTlsPeerVerified();
   }
 
   bsock->LockMutex();
@@ -57,6 +57,12 @@
 #include "include/bareos.h"
 #include "bregex.h"
 
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 #define set_error(x) bufp->errmsg = ((char*)(x))
 #define got_error bufp->errmsg != NULL
 
@@ -1349,6 +1355,468 @@ too_complex:
 #undef SETBIT
 #undef SET_FIELDS
 
+/* A second matcher for the compiled patterns that runs in linear time.
+ *
+ * ReMatch() backtracks, so patterns like "(a*)*b" take exponential time, and
+ * ReSearch() runs it once for every start position.  The matcher below
+ * decodes the compiled pattern into an automaton and runs it over the text
+ * in a single pass: without submatches (the usual case of fileset options
+ * and selections) as a DFA whose states are built on demand, with
+ * submatches as a Pike VM, which follows all threads of the automaton at
+ * once in the order the backtracker would try them.  Patterns with back
+ * references (Cmatch_memory) cannot be matched like that and keep using
+ * only the backtracker. */
+
+namespace {
+
+enum vm_kind : unsigned char
+{
+  kChar,   /* matches one character */
+  kMatch,  /* end of pattern */
+  kAssert, /* zero-width condition on the characters around the position */
+  kSave,   /* remembers the position in a register slot */
+  kJump,
+  kSplit /* tries next first, then alt */
+};
+
+struct vm_inst {
+  vm_kind kind;
+  unsigned char op;  /* the original opcode */
+  unsigned char arg; /* character, register slot or syntax code */
+  const unsigned char* set;
+  int next;
+  int alt;
+};
+
+// the class of the character before or at a position, kNone is off the text
+enum char_class : unsigned char
+{
+  kNone,
+  kNewline,
+  kWord,
+  kOther
+};
+
+inline char_class ClassOf(unsigned char ch)
+{
+  if (ch == '\n') { return kNewline; }
+  return (SYNTAX(ch) & Sword) ? kWord : kOther;
+}
+
+inline bool AssertionHolds(unsigned char op, char_class prev, char_class cur)
+{
+  switch (op) {
+    case Cbol:
+      return prev == kNone || prev == kNewline;
+    case Ceol:
+      return cur == kNone || cur == kNewline;
+    case Cbegbuf:
+      return prev == kNone;
+    case Cendbuf:
+      return cur == kNone;
+    case Cwordbeg:
+      return cur == kWord && prev != kWord;
+    case Cwordend:
+      return prev == kWord && cur != kWord;
+    case Cwordbound:
+      return prev == kNone || cur == kNone || (prev == kWord) != (cur == kWord);
+    case Cnotwordbound:
+      return prev != kNone && cur != kNone
+             && (prev == kWord) == (cur == kWord);
+    default:
+      return false;
+  }
+}
+
+class regex_vm {
+ public:
+  // nullptr if the pattern needs the backtracker
+  static regex_vm* Compile(const regex_t* bufp);
+
+  bool Matches(const unsigned char* text, int size);
+  bool Search(const unsigned char* text, int size, re_registers* regs) const;
+
+ private:
+  static constexpr int kUnknown = -1;
+  static constexpr int kMatched = -2;
+  static constexpr std::size_t kMaxStates = 4096;
+
+  struct dfa_state {
+    std::vector<int> kernel; /* sorted kChar/kMatch/... entry points */
+    char_class prev;
+    int accepts_at_end{kUnknown};
+    int next[256];
+  };
+
+  bool CharMatches(const vm_inst& inst, unsigned char ch) const;
+  bool Closure(const std::vector<int>& kernel,
+               char_class prev,
+               char_class cur,
+               std::vector<int>& chars);
+  int Intern(std::vector<int>&& kernel, char_class prev);
+  int Transition(int state, unsigned char ch);
+
+  struct thread_list {
+    std::vector<int> pcs;
+    std::vector<int> caps;
+    std::vector<unsigned> marks;
+    unsigned generation{1};
+
+    void Clear()
+    {
+      pcs.clear();
+      caps.clear();
+      if (++generation == 0) {
+        std::fill(marks.begin(), marks.end(), 0);
+        generation = 1;
+      }
+    }
+  };
+  void AddThread(thread_list& list,
+                 int pc,
+                 std::vector<int>& caps,
+                 int pos,
+                 char_class prev,
+                 char_class cur) const;
+
+  std::vector<vm_inst> prog_;
+  int start_{0};
+  int ncaps_{2};
+  bool uses_registers_{false};
+  const unsigned char* translate_{nullptr};
+  bool icase_{false}; /* like ReSearch(), which lowercases the text */
+
+  std::mutex mutex_; /* protects the dfa states */
+  std::vector<std::unique_ptr<dfa_state>> states_;
+  std::map<std::pair<char_class, std::vector<int>>, int> state_index_;
+  std::vector<unsigned> marks_;
+  std::vector<int> stack_;
+  unsigned generation_{0};
+};
+
+regex_vm* regex_vm::Compile(const regex_t* bufp)
+{
+  const unsigned char* code = bufp->buffer;
+  const int used = bufp->used;
+  if (!code || used <= 0) { return nullptr; }
+
+  std::vector<int> index_of(used + 1, -1);
+  std::vector<vm_inst> prog;
+  std::vector<int> targets; /* byte offsets, resolved below */
+  for (int pos = 0; pos < used;) {
+    index_of[pos] = prog.size();
+    vm_inst inst{kChar, code[pos], 0, nullptr, 0, 0};
+    int length = 1, next = -1, alt = -1;
+    auto displacement = [&] {
+      int a = code[pos + 1] | (code[pos + 2] << 8);
+      return pos + 3 + (int)SHORT(a);
+    };
+    switch (code[pos]) {
+      case Cend:
+        inst.kind = kMatch;
+        break;
+      case Cbol:
+      case Ceol:
+      case Cbegbuf:
+      case Cendbuf:
+      case Cwordbeg:
+      case Cwordend:
+      case Cwordbound:
+      case Cnotwordbound:
+        inst.kind = kAssert;
+        break;
+      case Canychar:
+        break;
+      case Cset:
+        length = 1 + 256 / 8;
+        inst.set = code + pos + 1;
+        break;
+      case Cexact:
+      case Csyntaxspec:
+      case Cnotsyntaxspec:
+        length = 2;
+        inst.arg = code[pos + 1];
+        break;
+      case Cstart_memory:
+      case Cend_memory:
+        length = 2;
+        inst.kind = kSave;
+        if (code[pos + 1] >= bufp->num_registers) { return nullptr; }
+        inst.arg = 2 * code[pos + 1] + (code[pos] == Cend_memory);
+        break;
+      case Cjump:
+      case Cstar_jump:
+      case Cdummy_failure_jump:
+        length = 3;
+        inst.kind = kJump;
+        next = displacement();
+        break;
+      case Cfailure_jump:
+        length = 3;
+        inst.kind = kSplit;
+        next = pos + 3;
+        alt = displacement();
+        break;
+      case Cupdate_failure_jump:
+      case Crepeat1:
+        /* the back edge of a loop, the topmost failure point it updates is
+         * the exit of the loop right behind it */
+        length = 3;
+        inst.kind = kSplit;
+        next = displacement();
+        alt = pos + 3;
+        break;
+      default: /* Cmatch_memory */
+        return nullptr;
+    }
+    if (pos + length > used) { return nullptr; }
+    if (next < 0 && inst.kind != kMatch) { next = pos + length; }
+    targets.push_back(next);
+    targets.push_back(alt);
+    prog.push_back(inst);
+    pos += length;
+  }
+
+  for (std::size_t i = 0; i < prog.size(); ++i) {
+    for (int j = 0; j < 2; ++j) {
+      int target = targets[2 * i + j];
+      if (target < 0) { continue; }
+      if (target > used || index_of[target] < 0) { return nullptr; }
+      (j ? prog[i].alt : prog[i].next) = index_of[target];
+    }
+  }
+
+  regex_vm* vm = new regex_vm;
+  vm->prog_ = std::move(prog);
+  vm->ncaps_ = 2 * std::max(bufp->num_registers, 1);
+  vm->uses_registers_ = bufp->uses_registers;
+  vm->translate_ = bufp->translate;
+  vm->icase_ = bufp->cflags & REG_ICASE;
+  vm->marks_.resize(vm->prog_.size());
+  return vm;
+}
+
+bool regex_vm::CharMatches(const vm_inst& inst, unsigned char ch) const
+{
+  if (icase_) { ch = tolower(ch); }
+  if (translate_) { ch = translate_[ch]; }
+  switch (inst.op) {
+    case Cset:
+      return inst.set[ch / 8] & (1 << (ch & 7));
+    case Cexact:
+      return ch == inst.arg;
+    case Canychar:
+      return ch != '\n';
+    case Csyntaxspec:
+      return SYNTAX(ch) & inst.arg;
+    case Cnotsyntaxspec:
+      return !(SYNTAX(ch) & inst.arg);
+    default:
+      return false;
+  }
+}
+
+/* Follows the jumps, splits and assertions from the kernel.  Returns true if
+ * the end of the pattern is reached, otherwise chars gets the kChar
+ * instructions that are reached. */
+bool regex_vm::Closure(const std::vector<int>& kernel,
+                       char_class prev,
+                       char_class cur,
+                       std::vector<int>& chars)
+{
+  if (++generation_ == 0) {
+    std::fill(marks_.begin(), marks_.end(), 0);
+    generation_ = 1;
+  }
+  chars.clear();
+  stack_.assign(kernel.rbegin(), kernel.rend());
+  while (!stack_.empty()) {
+    int pc = stack_.back();
+    stack_.pop_back();
+    if (marks_[pc] == generation_) { continue; }
+    marks_[pc] = generation_;
+    const vm_inst& inst = prog_[pc];
+    switch (inst.kind) {
+      case kMatch:
+        return true;
+      case kChar:
+        chars.push_back(pc);
+        break;
+      case kAssert:
+        if (AssertionHolds(inst.op, prev, cur)) { stack_.push_back(inst.next); }
+        break;
+      case kSave:
+      case kJump:
+        stack_.push_back(inst.next);
+        break;
+      case kSplit:
+        stack_.push_back(inst.alt);
+        stack_.push_back(inst.next);
+        break;
+    }
+  }
+  return false;
+}
+
+int regex_vm::Intern(std::vector<int>&& kernel, char_class prev)
+{
+  std::sort(kernel.begin(), kernel.end());
+  kernel.erase(std::unique(kernel.begin(), kernel.end()), kernel.end());
+  auto key = std::make_pair(prev, kernel);
+  auto found = state_index_.find(key);
+  if (found != state_index_.end()) { return found->second; }
+
+  auto state = std::make_unique<dfa_state>();
+  state->kernel = std::move(kernel);
+  state->prev = prev;
+  std::fill(std::begin(state->next), std::end(state->next), kUnknown);
+  int index = states_.size();
+  states_.push_back(std::move(state));
+  state_index_.emplace(std::move(key), index);
+  return index;
+}
+
+int regex_vm::Transition(int state, unsigned char ch)
+{
+  std::vector<int> chars;
+  char_class cur = ClassOf(ch);
+  if (Closure(states_[state]->kernel, states_[state]->prev, cur, chars)) {
+    states_[state]->next[ch] = kMatched;
+    return kMatched;
+  }
+
+  // the search may start at the next position as well
+  std::vector<int> kernel{start_};
+  for (int pc : chars) {
+    if (CharMatches(prog_[pc], ch)) { kernel.push_back(prog_[pc].next); }
+  }
+
+  // too many states, start over instead of growing without bounds
+  bool flushed = false;
+  if (states_.size() >= kMaxStates) {
+    states_.clear();
+    state_index_.clear();
+    flushed = true;
+  }
+  int next = Intern(std::move(kernel), cur);
+  if (!flushed) { states_[state]->next[ch] = next; }
+  return next;
+}
+
+bool regex_vm::Matches(const unsigned char* text, int size)
+{
+  std::lock_guard lock(mutex_);
+  int state = Intern(std::vector<int>{start_}, kNone);
+  for (int i = 0; i < size; ++i) {
+    int next = states_[state]->next[text[i]];
+    if (next == kUnknown) { next = Transition(state, text[i]); }
+    if (next == kMatched) { return true; }
+    state = next;
+  }
+
+  dfa_state& last = *states_[state];
+  if (last.accepts_at_end == kUnknown) {
+    std::vector<int> chars;
+    last.accepts_at_end = Closure(last.kernel, last.prev, kNone, chars);
+  }
+  return last.accepts_at_end;
+}
+
+void regex_vm::AddThread(thread_list& list,
+                         int pc,
+                         std::vector<int>& caps,
+                         int pos,
+                         char_class prev,
+                         char_class cur) const
+{
+  if (list.marks[pc] == list.generation) { return; }
+  list.marks[pc] = list.generation;
+  const vm_inst& inst = prog_[pc];
+  switch (inst.kind) {
+    case kChar:
+    case kMatch:
+      list.pcs.push_back(pc);
+      list.caps.insert(list.caps.end(), caps.begin(), caps.end());
+      break;
+    case kAssert:
+      if (AssertionHolds(inst.op, prev, cur)) {
+        AddThread(list, inst.next, caps, pos, prev, cur);
+      }
+      break;
+    case kSave: {
+      int saved = caps[inst.arg];
+      caps[inst.arg] = pos;
+      AddThread(list, inst.next, caps, pos, prev, cur);
+      caps[inst.arg] = saved;
+      break;
+    }
+    case kJump:
+      AddThread(list, inst.next, caps, pos, prev, cur);
+      break;
+    case kSplit:
+      AddThread(list, inst.next, caps, pos, prev, cur);
+      AddThread(list, inst.alt, caps, pos, prev, cur);
+      break;
+  }
+}
+
+// the leftmost match the backtracker would find, with its registers
+bool regex_vm::Search(const unsigned char* text,
+                      int size,
+                      re_registers* regs) const
+{
+  thread_list lists[2];
+  for (auto& list : lists) { list.marks.resize(prog_.size()); }
+  thread_list* current = &lists[0];
+  thread_list* next = &lists[1];
+  std::vector<int> caps(ncaps_, -1), matched;
+  int match_end = -1;
+
+  for (int pos = 0; pos <= size; ++pos) {
+    char_class prev = pos == 0 ? kNone : ClassOf(text[pos - 1]);
+    char_class cur = pos == size ? kNone : ClassOf(text[pos]);
+    if (match_end < 0) {
+      // the lowest priority, a match starting earlier always wins
+      std::fill(caps.begin(), caps.end(), -1);
+      caps[0] = pos;
+      AddThread(*current, start_, caps, pos, prev, cur);
+    }
+    if (current->pcs.empty() && match_end >= 0) { break; }
+
+    next->Clear();
+    char_class after = pos + 1 >= size ? kNone : ClassOf(text[pos + 1]);
+    for (std::size_t t = 0; t < current->pcs.size(); ++t) {
+      const vm_inst& inst = prog_[current->pcs[t]];
+      auto thread_caps = current->caps.begin() + t * ncaps_;
+      if (inst.kind == kMatch) {
+        matched.assign(thread_caps, thread_caps + ncaps_);
+        match_end = pos;
+        break; /* the threads after it have a lower priority */
+      }
+      if (pos < size && CharMatches(inst, text[pos])) {
+        caps.assign(thread_caps, thread_caps + ncaps_);
+        AddThread(*next, inst.next, caps, pos + 1, cur, after);
+      }
+    }
+    std::swap(current, next);
+  }
+
+  if (match_end < 0) { return false; }
+  if (regs) {
+    regs->start[0] = matched[0];
+    regs->end[0] = match_end;
+    for (int r = 1; r < RE_NREGS; ++r) {
+      bool set = uses_registers_ && 2 * r + 1 < ncaps_ && matched[2 * r] >= 0
+                 && matched[2 * r + 1] >= 0;
+      regs->start[r] = set ? matched[2 * r] : -1;
+      regs->end[r] = set ? matched[2 * r + 1] : -1;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
 #define PREFETCH \
   if (text == textend) goto fail
 
@@ -1359,17 +1827,19 @@ too_complex:
 
 int regcomp(regex_t* bufp, const char* regex, int cflags)
 {
+  const char* error;
   memset(bufp, 0, sizeof(regex_t));
   bufp->cflags = cflags;
   if (bufp->cflags & REG_ICASE) {
     char *p, *lcase = strdup(regex);
     for (p = lcase; *p; p++) { *p = tolower(*p); }
-    re_compile_pattern(bufp, (unsigned char*)lcase);
+    error = re_compile_pattern(bufp, (unsigned char*)lcase);
     free(lcase);
   } else {
-    re_compile_pattern(bufp, (unsigned char*)regex);
+    error = re_compile_pattern(bufp, (unsigned char*)regex);
   }
   if (got_error) { return -1; }
+  if (!error) { bufp->engine = regex_vm::Compile(bufp); }
   return 0;
 }
 
@@ -1395,7 +1865,30 @@ int regexec(regex_t* preg,
             const char* string,
             size_t nmatch,
             regmatch_t pmatch[],
-            int)
+            int eflags)
+{
+  regex_vm* vm = static_cast<regex_vm*>(preg->engine);
+  if (!vm) {
+    return RegexecBacktracking(preg, string, nmatch, pmatch, eflags);
+  }
+
+  const unsigned char* text = (const unsigned char*)string;
+  int len = strlen(string);
+  if (nmatch == 0 || pmatch == NULL) {
+    return vm->Matches(text, len) ? 0 : -1;
+  }
+  // most texts do not match, that is found out faster without submatches
+  re_registers regs{};
+  if (!vm->Matches(text, len) || !vm->Search(text, len, &regs)) { return -1; }
+  re_registers_to_regmatch(&regs, pmatch, nmatch);
+  return 0;
+}
+
+int RegexecBacktracking(regex_t* preg,
+                        const char* string,
+                        size_t nmatch,
+                        regmatch_t pmatch[],
+                        int)
 {
   int status;
   int len = strlen(string);
@@ -1417,6 +1910,8 @@ size_t regerror(int, regex_t* preg, char* errbuf, size_t errbuf_size)
 
 void regfree(regex_t* preg)
 {
+  delete static_cast<regex_vm*>(preg->engine);
+  preg->engine = NULL;
   if (preg->lcase) {
     FreePoolMemory(preg->lcase);
     preg->lcase = NULL;
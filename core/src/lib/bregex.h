@@ -72,6 +72,8 @@ extern "C" {
 #  define regexec b_regexec
 #  define regerror b_regerror
 #  define regfree b_regfree
+#  define RegexecBacktracking b_regexec_backtracking
+#  define re_registers b_re_registers
 
 
 #  define RE_NREGS 100 /* number of registers available */
@@ -107,6 +109,7 @@ struct regex_t {
   char* errmsg;
   int cflags;           /* compilation flags */
   POOLMEM* lcase; /* used by REG_ICASE */
+  void* engine;   /* linear time matcher, NULL for back references */
 };
 /* clang-format on */
 
@@ -202,6 +205,14 @@ int regexec(regex_t* preg,
 size_t regerror(int errcode, regex_t* preg, char* errbuf, size_t errbuf_size);
 void regfree(regex_t* preg);
 
+/* regexec() with the backtracking matcher only, regexec() uses it for
+ * patterns with back references */
+int RegexecBacktracking(regex_t* preg,
+                        const char* string,
+                        size_t nmatch,
+                        regmatch_t pmatch[],
+                        int eflags);
+
 #endif /* REGEXPR_H */
 
 
@@ -31,6 +31,7 @@
 #include "include/jcr.h"
 #include "lib/berrno.h"
 #include "lib/bnet.h"
+#include "lib/bsock_compression.h"
 #include "lib/cram_md5.h"
 #include "lib/tls.h"
 #include "lib/util.h"
@@ -40,6 +41,10 @@
 
 #include <algorithm>
 
+#if !defined(HAVE_WIN32)
+#  include <sys/mman.h>
+#endif
+
 static constexpr int debuglevel = 50;
 
 BareosSocket::BareosSocket()
@@ -129,6 +134,7 @@ BareosSocket::BareosSocket(const BareosSocket& other)
   nb_bytes_ = other.nb_bytes_;
   last_tick_ = other.last_tick_;
   tls_established_ = other.tls_established_;
+  tls_peer_verified_ = other.tls_peer_verified_;
 }
 
 BareosSocket::~BareosSocket()
@@ -137,6 +143,13 @@ BareosSocket::~BareosSocket()
   Dmsg0(100, "Destruct BareosSocket\n");
 }
 
+bool BareosSocket::EnableMessageCompression()
+{
+  if (!MessageCompression::Algorithm()) { return false; }
+  if (!compression_) { compression_ = std::make_unique<MessageCompression>(); }
+  return true;
+}
+
 void BareosSocket::CloseTlsConnectionAndFreeMemory()
 {
   if (!cloned_) {
@@ -205,6 +218,60 @@ bool BareosSocket::signal(int signal)
   return send();
 }
 
+#if !defined(HAVE_WIN32)
+/* Sends the spooled messages straight out of a mapping of the spool file,
+ * which saves the two reads per message and the copy into msg.  Returns
+ * false if the file could not be mapped, the caller then reads it. */
+static bool DespoolMapped(BareosSocket* bsock,
+                          void UpdateAttrSpoolSize(ssize_t size),
+                          ssize_t tsize,
+                          bool& ok)
+{
+  if (tsize <= 0) { return false; }
+  void* map = mmap(nullptr, tsize, PROT_READ, MAP_SHARED, bsock->spool_fd_, 0);
+  if (map == MAP_FAILED) { return false; }
+#  if defined(MADV_SEQUENTIAL)
+  madvise(map, tsize, MADV_SEQUENTIAL);
+#  endif
+
+  JobControlRecord* jcr = bsock->get_jcr();
+  const char* data = static_cast<const char*>(map);
+  ssize_t size = 0, last = 0;
+  int count = 0;
+  ok = true;
+  while (tsize - size >= static_cast<ssize_t>(sizeof(int32_t))) {
+    int32_t pktsiz;
+    memcpy(&pktsiz, data + size, sizeof(int32_t));
+    size += sizeof(int32_t);
+    int32_t length = ntohl(pktsiz);
+    if (length > 0) {
+      if (length > tsize - size) {
+        Dmsg2(400, "message_length=%d left=%lld\n", length,
+              static_cast<long long>(tsize - size));
+        Qmsg0(jcr, M_FATAL, 0, T_("read attr spool error. ERR=short file\n"));
+        ok = false;
+        break;
+      }
+      bsock->SendV({{data + size, static_cast<std::size_t>(length)}});
+      size += length;
+      if ((++count & 0x3F) == 0) {
+        UpdateAttrSpoolSize(size - last);
+        last = size;
+      }
+    } else {
+      bsock->signal(length);
+    }
+    if (jcr && jcr->IsJobCanceled()) {
+      ok = false;
+      break;
+    }
+  }
+  UpdateAttrSpoolSize(tsize - last);
+  munmap(map, tsize);
+  return true;
+}
+#endif
+
 // Despool spooled attributes
 bool BareosSocket::despool(void UpdateAttrSpoolSize(ssize_t size),
                            ssize_t tsize)
@@ -215,6 +282,11 @@ bool BareosSocket::despool(void UpdateAttrSpoolSize(ssize_t size),
   int count = 0;
   JobControlRecord* jcr = get_jcr();
 
+#if !defined(HAVE_WIN32)
+  bool ok;
+  if (DespoolMapped(this, UpdateAttrSpoolSize, tsize, ok)) { return ok; }
+#endif
+
   if (lseek(spool_fd_, 0, SEEK_SET) == -1) {
     Qmsg(jcr, M_FATAL, 0, T_("attr spool I/O error.\n"));
     return false;
@@ -326,6 +398,81 @@ bool BareosSocket::send(const char* msg_in, uint32_t nbytes)
   return send();
 }
 
+// Generic implementation: there is nothing but msg to point into.
+int32_t BareosSocket::RecvView(std::string_view& view)
+{
+  int32_t nbytes = recv();
+  view = nbytes > 0 ? std::string_view(msg, nbytes) : std::string_view();
+  return nbytes;
+}
+
+/* Generic implementation: gather everything into an own buffer and send that
+ * as msg.  The buffer is swapped back afterwards, so msg stays untouched
+ * (which allows parts that point into msg). */
+bool BareosSocket::SendV(const message_part* parts, std::size_t count)
+{
+  if (errors || IsTerminated()) { return false; }
+
+  std::size_t total = 0;
+  for (std::size_t i = 0; i < count; ++i) { total += parts[i].size; }
+
+  POOLMEM* gathered = GetPoolMemory(PM_BSOCK);
+  gathered = CheckPoolMemorySize(gathered, total + 1);
+  std::size_t offset = 0;
+  for (std::size_t i = 0; i < count; ++i) {
+    if (parts[i].size == 0) { continue; }
+    memcpy(gathered + offset, parts[i].data, parts[i].size);
+    offset += parts[i].size;
+  }
+
+  int32_t saved_length = message_length;
+  std::swap(msg, gathered);
+  message_length = total;
+  bool ok = send();
+  std::swap(msg, gathered);
+  message_length = saved_length;
+  FreePoolMemory(gathered);
+
+  return ok;
+}
+
+// Generic implementation: read the range into an own buffer and send that.
+bool BareosSocket::SendFileRange(int file_fd, uint64_t offset, uint32_t size)
+{
+  if (errors || IsTerminated()) { return false; }
+
+  POOLMEM* data = GetPoolMemory(PM_BSOCK);
+  data = CheckPoolMemorySize(data, size + 1);
+  uint32_t done = 0;
+  while (done < size) {
+#if defined(HAVE_WIN32)
+    ssize_t n = -1;
+    if (_lseeki64(file_fd, offset + done, SEEK_SET) >= 0) {
+      n = ::read(file_fd, data + done, size - done);
+    }
+#else
+    ssize_t n = ::pread(file_fd, data + done, size - done, offset + done);
+#endif
+    if (n < 0 && errno == EINTR) { continue; }
+    if (n <= 0) {
+      b_errno = n < 0 ? errno : EIO;
+      FreePoolMemory(data);
+      return false;
+    }
+    done += n;
+  }
+
+  int32_t saved_length = message_length;
+  std::swap(msg, data);
+  message_length = size;
+  bool ok = send();
+  std::swap(msg, data);
+  message_length = saved_length;
+  FreePoolMemory(data);
+
+  return ok;
+}
+
 void BareosSocket::SetKillable(bool killable)
 {
   if (jcr_) { jcr_->SetKillable(killable); }
@@ -418,7 +565,13 @@ bool BareosSocket::TwoWayAuthenticate(JobControlRecord* jcr,
       return false;
     }
 
-    auth_success = cram_md5_handshake.DoHandshake(initiated_by_remote);
+    if (tls_resource->tls_cert_.skip_cram_md5_ && tls_conn
+        && TlsPeerVerified()) {
+      Dmsg0(debuglevel, "TLS verified the peer, skipping CRAM-MD5\n");
+      auth_success = true;
+    } else {
+      auth_success = cram_md5_handshake.DoHandshake(initiated_by_remote);
+    }
 
     if (!auth_success) {
       char ipaddr_str[MAXHOSTNAMELEN]{};
@@ -512,6 +665,7 @@ void BareosSocket::ParameterizeTlsCert(Tls* conn_init,
   conn_init->SetCipherSuites(tls_resource->ciphersuites_);
   conn_init->SetVerifyPeer(tls_resource->tls_cert_.verify_peer_);
   conn_init->SetEnableKtls(tls_resource->enable_ktls_);
+  conn_init->SetSessionLifetime(tls_resource->session_lifetime_);
 }
 
 bool BareosSocket::ParameterizeAndInitTlsConnectionAsAServer(
@@ -53,9 +53,14 @@
 #include <functional>
 #include <cassert>
 #include <atomic>
+#include <cstddef>
+#include <initializer_list>
+#include <string_view>
 
 struct btimer_t; /* forward reference */
 class BareosSocket;
+class MessageCompression;
+class StripedSender;
 class Tls;
 class BStringList;
 class QualifiedResourceNameTypeConverter;
@@ -87,6 +92,14 @@ class BareosSocket {
   struct sockaddr_in peer_addr; /* Peer's IP address */
   void SetTlsEstablished() { tls_established_ = true; }
   bool TlsEstablished() const { return tls_established_; }
+  // a recv() would not even have to wait for the socket to become readable
+  virtual bool HasPendingData() const
+  {
+    return tls_conn && tls_conn->TlsBsockHasPendingData();
+  }
+  // the certificate of the peer and its name were verified
+  void SetTlsPeerVerified() { tls_peer_verified_ = true; }
+  bool TlsPeerVerified() const { return tls_peer_verified_; }
   std::shared_ptr<Tls> tls_conn;      /* Associated tls connection */
   std::unique_ptr<Tls> tls_conn_init; /* during initialization */
   BareosVersionNumber connected_daemon_version_;
@@ -110,7 +123,10 @@ class BareosSocket {
   int64_t nb_bytes_;     /* Bytes sent/recv since the last tick */
   btime_t last_tick_;    /* Last tick used by bwlimit */
   bool tls_established_; /* is true when tls connection is established */
+  bool tls_peer_verified_{false};
   std::unique_ptr<BnetDump> bnet_dump_;
+  StripedSender* striped_sender_{nullptr}; /* Not owned, see SetStripedSender */
+  std::unique_ptr<MessageCompression> compression_; /* Not copied */
 
   virtual void FinInit(JobControlRecord* jcr,
                        int sockfd,
@@ -169,6 +185,20 @@ class BareosSocket {
                        bool verbose)
       = 0;
   virtual int32_t recv() = 0;
+  /* Receive a message in two steps: first its length, then its content
+   * (maybe in several parts) into a buffer of the callers choice. */
+  virtual int32_t RecvLength() = 0;
+  virtual int32_t RecvContent(char* buf, int32_t nbytes) = 0;
+  /* Like recv(), but the content is not copied into msg if it already is
+   * in memory as a whole (see EnableReceiveBuffer()).  view then points
+   * there, otherwise into msg; either way it is only valid until the next
+   * receive on this socket and not terminated by a zero. */
+  virtual int32_t RecvView(std::string_view& view);
+  /* Read the connection in chunks of up to size bytes and take the
+   * messages out of them, instead of reading header and content of each
+   * message separately.  Only for sockets whose connection is not read by
+   * a clone as well, the clone would miss what is buffered here. */
+  virtual void EnableReceiveBuffer(std::size_t /* size */ = 64 * 1024) {}
   virtual bool send() = 0;
   virtual int32_t read_nbytes(char* ptr, int32_t nbytes) = 0;
   virtual int32_t write_nbytes(char* ptr, int32_t nbytes) = 0;
@@ -189,6 +219,34 @@ class BareosSocket {
   bool fsend(const char*, ...);
   bool vfsend(const char* fmt, va_list ap);
   bool send(const char* msg_in, uint32_t nbytes);
+  /* A piece of a message for SendV().  The parts are sent as one single
+   * message, exactly as if they had been copied into msg one after the other
+   * and sent with send(); they may point anywhere, including into msg. */
+  struct message_part {
+    const char* data;
+    std::size_t size;
+  };
+  virtual bool SendV(const message_part* parts, std::size_t count);
+  bool SendV(std::initializer_list<message_part> parts)
+  {
+    return SendV(parts.begin(), parts.size());
+  }
+  /* Sends size bytes of the file file_fd, starting at offset, as one single
+   * message, exactly as if they had been read into msg and sent with send().
+   * Only if CanSendFileRange() is true the bytes are handed to the kernel
+   * directly (sendfile() or kTLS), otherwise they are read into a buffer. */
+  virtual bool CanSendFileRange() { return false; }
+  virtual bool SendFileRange(int file_fd, uint64_t offset, uint32_t size);
+  /* While a striped sender is set, all messages and signals sent on this
+   * socket go over its connections instead (see lib/bsock_striped.h).
+   * Receiving is not affected. */
+  void SetStripedSender(StripedSender* sender) { striped_sender_ = sender; }
+  bool IsStriped() const { return striped_sender_ != nullptr; }
+  /* Compress the larger messages sent from now on and accept compressed
+   * ones, see lib/bsock_compression.h.  Both ends have to agree on it
+   * before; fails if built without a compression library. */
+  bool EnableMessageCompression();
+  bool MessageCompressionEnabled() const { return compression_ != nullptr; }
   void SetKillable(bool killable);
   bool signal(int signal);
   const char* bstrerror(); /* last error on socket */
@@ -0,0 +1,109 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "include/bareos.h"
+#include "lib/bsock_compression.h"
+
+#if defined(HAVE_ZSTD)
+#  include <zstd.h>
+
+// the fastest level, command output and attributes compress well anyway
+static constexpr int compression_level = 1;
+
+struct MessageCompression::Contexts {
+  ZSTD_CCtx* cctx{ZSTD_createCCtx()};
+  ZSTD_DCtx* dctx{ZSTD_createDCtx()};
+  ~Contexts()
+  {
+    ZSTD_freeCCtx(cctx);
+    ZSTD_freeDCtx(dctx);
+  }
+};
+
+const char* MessageCompression::Algorithm() { return "zstd"; }
+
+MessageCompression::MessageCompression() : contexts_{new Contexts} {}
+
+MessageCompression::~MessageCompression() { delete contexts_; }
+
+int32_t MessageCompression::Compress(const char* data,
+                                     int32_t length,
+                                     int32_t header_length,
+                                     std::vector<char>& out)
+{
+  if (length < min_length || !contexts_->cctx) { return 0; }
+  out.resize(header_length + ZSTD_compressBound(length));
+  std::size_t size
+      = ZSTD_compressCCtx(contexts_->cctx, out.data() + header_length,
+                          out.size() - header_length, data, length,
+                          compression_level);
+  if (ZSTD_isError(size) || size >= static_cast<std::size_t>(length)) {
+    return 0;
+  }
+  return static_cast<int32_t>(size);
+}
+
+int32_t MessageCompression::Decompress(const char* data,
+                                       int32_t length,
+                                       int32_t max_length,
+                                       std::vector<char>& out)
+{
+  if (!contexts_->dctx) { return -1; }
+  unsigned long long size = ZSTD_getFrameContentSize(data, length);
+  if (size == ZSTD_CONTENTSIZE_UNKNOWN || size == ZSTD_CONTENTSIZE_ERROR
+      || size > static_cast<unsigned long long>(max_length)) {
+    return -1;
+  }
+  out.resize(size);
+  std::size_t result
+      = ZSTD_decompressDCtx(contexts_->dctx, out.data(), out.size(), data,
+                            length);
+  if (ZSTD_isError(result) || result != size) { return -1; }
+  return static_cast<int32_t>(size);
+}
+
+#else
+
+struct MessageCompression::Contexts {};
+
+const char* MessageCompression::Algorithm() { return nullptr; }
+
+MessageCompression::MessageCompression() : contexts_{nullptr} {}
+
+MessageCompression::~MessageCompression() = default;
+
+int32_t MessageCompression::Compress(const char*,
+                                     int32_t,
+                                     int32_t,
+                                     std::vector<char>&)
+{
+  return 0;
+}
+
+int32_t MessageCompression::Decompress(const char*,
+                                       int32_t,
+                                       int32_t,
+                                       std::vector<char>&)
+{
+  return -1;
+}
+
+#endif
@@ -0,0 +1,72 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * compression of the single messages of a socket
+ *
+ * Once both ends of a connection agreed on it (see
+ * BareosSocket::EnableMessageCompression()), a packet with at least
+ * min_length bytes is sent compressed if that makes it smaller.  Its header
+ * then holds the compressed length with compressed_flag set, which can not
+ * happen otherwise as packets are at most 1000000 bytes long.  Every packet
+ * is compressed on its own, so they still can be read one by one.
+ *
+ * Meant for the connections carrying command output and attributes; the
+ * data of a backup is compressed by the file daemon already, if at all.
+ */
+
+#ifndef BAREOS_LIB_BSOCK_COMPRESSION_H_
+#define BAREOS_LIB_BSOCK_COMPRESSION_H_
+
+#include <cstdint>
+#include <vector>
+
+class MessageCompression {
+ public:
+  static constexpr int32_t compressed_flag = 0x40000000;
+  static constexpr int32_t min_length = 256;
+
+  // the name used in the negotiation, nullptr if not built with one
+  static const char* Algorithm();
+
+  MessageCompression();
+  ~MessageCompression();
+  MessageCompression(const MessageCompression&) = delete;
+  MessageCompression& operator=(const MessageCompression&) = delete;
+
+  /* Compresses into out, after space for the packet header of header_length
+   * bytes.  Returns the compressed length, 0 if it would not get smaller. */
+  int32_t Compress(const char* data,
+                   int32_t length,
+                   int32_t header_length,
+                   std::vector<char>& out);
+  // Returns the length of the message, a negative value on error
+  int32_t Decompress(const char* data,
+                     int32_t length,
+                     int32_t max_length,
+                     std::vector<char>& out);
+
+ private:
+  struct Contexts;
+  Contexts* contexts_;
+};
+
+#endif  // BAREOS_LIB_BSOCK_COMPRESSION_H_
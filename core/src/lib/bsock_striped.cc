@@ -0,0 +1,300 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "include/bareos.h"
+#include "lib/bsock_striped.h"
+#include "lib/bsock.h"
+#include "lib/bnet.h"
+
+#include <algorithm>
+
+#ifndef SHUT_RDWR
+#  define SHUT_RDWR 2
+#endif
+
+static void EncodeFrameHeader(char* p, uint64_t seq, int32_t signal)
+{
+  uint32_t hi = htonl(static_cast<uint32_t>(seq >> 32));
+  uint32_t lo = htonl(static_cast<uint32_t>(seq));
+  uint32_t sig = htonl(static_cast<uint32_t>(signal));
+  memcpy(p, &hi, sizeof(hi));
+  memcpy(p + 4, &lo, sizeof(lo));
+  memcpy(p + 8, &sig, sizeof(sig));
+}
+
+static void DecodeFrameHeader(const char* p, uint64_t& seq, int32_t& signal)
+{
+  uint32_t hi, lo, sig;
+  memcpy(&hi, p, sizeof(hi));
+  memcpy(&lo, p + 4, sizeof(lo));
+  memcpy(&sig, p + 8, sizeof(sig));
+  seq = (uint64_t{ntohl(hi)} << 32) | ntohl(lo);
+  signal = static_cast<int32_t>(ntohl(sig));
+}
+
+StripedSender::StripedSender(std::vector<BareosSocket*> connections,
+                             std::size_t queue_depth)
+    : queue_depth_{std::max<std::size_t>(queue_depth, 1)}
+{
+  for (BareosSocket* sock : connections) {
+    auto conn = std::make_unique<connection>();
+    conn->sock = sock;
+    connections_.push_back(std::move(conn));
+  }
+  for (auto& conn : connections_) {
+    conn->thread = std::thread([this, c = conn.get()] { Write(*c); });
+  }
+}
+
+StripedSender::~StripedSender()
+{
+  Finish();
+  for (POOLMEM* buf : free_buffers_) { FreePoolMemory(buf); }
+}
+
+// Needs mutex_ to be held.
+POOLMEM* StripedSender::TakeBuffer()
+{
+  if (free_buffers_.empty()) { return GetPoolMemory(PM_BSOCK); }
+  POOLMEM* buf = free_buffers_.back();
+  free_buffers_.pop_back();
+  return buf;
+}
+
+bool StripedSender::Send(const char* data, int32_t length)
+{
+  using namespace striped_detail;
+
+  const int32_t signal = length <= 0 ? length : 0;
+  int32_t remaining = std::max(length, 0);
+  do {
+    const int32_t chunk = std::min(remaining, max_frame_data);
+
+    std::unique_lock lock(mutex_);
+    POOLMEM* buf = TakeBuffer();
+    lock.unlock();
+    buf = CheckPoolMemorySize(buf, frame_header_length + chunk + 1);
+    if (chunk > 0) { memcpy(buf + frame_header_length, data, chunk); }
+    lock.lock();
+
+    /* The first connection with room after the one used last; slow
+     * connections fill up and get skipped until they caught up. */
+    std::size_t index = 0;
+    space_.wait(lock, [this, &index] {
+      if (error_ || finishing_) { return true; }
+      for (std::size_t i = 0; i < connections_.size(); ++i) {
+        index = (next_connection_ + i) % connections_.size();
+        if (connections_[index]->queue.size() < queue_depth_) { return true; }
+      }
+      return false;
+    });
+    if (error_ || finishing_) {
+      free_buffers_.push_back(buf);
+      return false;
+    }
+
+    EncodeFrameHeader(buf, next_seq_++, signal);
+    connection& conn = *connections_[index];
+    conn.queue.push_back(frame{buf, frame_header_length + chunk});
+    conn.work.notify_one();
+    next_connection_ = (index + 1) % connections_.size();
+
+    data += chunk;
+    remaining -= chunk;
+  } while (remaining > 0);
+
+  return true;
+}
+
+void StripedSender::Write(connection& conn)
+{
+  BareosSocket* sock = conn.sock;
+  std::unique_lock lock(mutex_);
+  for (;;) {
+    conn.work.wait(lock, [this, &conn] {
+      return !conn.queue.empty() || finishing_ || error_;
+    });
+    if (conn.queue.empty() || error_) { break; }
+
+    frame f = conn.queue.front();
+    conn.queue.pop_front();
+    space_.notify_all();
+    lock.unlock();
+
+    // send the frame as msg without copying it
+    POOLMEM* saved_msg = sock->msg;
+    int32_t saved_length = sock->message_length;
+    sock->msg = f.buf;
+    sock->message_length = f.length;
+    bool ok = sock->send();
+    f.buf = sock->msg;
+    sock->msg = saved_msg;
+    sock->message_length = saved_length;
+
+    lock.lock();
+    free_buffers_.push_back(f.buf);
+    if (!ok && !error_) {
+      error_.emplace(sock->bstrerror());
+      for (auto& other : connections_) { other->work.notify_one(); }
+      space_.notify_all();
+    }
+  }
+
+  for (frame& f : conn.queue) { free_buffers_.push_back(f.buf); }
+  conn.queue.clear();
+}
+
+std::optional<std::string> StripedSender::Finish()
+{
+  {
+    std::unique_lock lock(mutex_);
+    if (finished_) { return error_; }
+    finishing_ = true;
+    finished_ = true;
+  }
+  for (auto& conn : connections_) { conn->work.notify_one(); }
+  space_.notify_all();
+  for (auto& conn : connections_) {
+    if (conn->thread.joinable()) { conn->thread.join(); }
+  }
+
+  for (auto& conn : connections_) {
+    conn->sock->suppress_error_msgs_ = true;
+    conn->sock->signal(BNET_TERMINATE);
+  }
+
+  std::unique_lock lock(mutex_);
+  return error_;
+}
+
+StripedReceiver::StripedReceiver(std::vector<BareosSocket*> connections,
+                                 std::size_t window)
+    : connections_{std::move(connections)}
+    , window_{std::max<std::size_t>(window, connections_.size())}
+    , running_{connections_.size()}
+{
+  for (BareosSocket* sock : connections_) {
+    readers_.emplace_back([this, sock] { Read(sock); });
+  }
+}
+
+StripedReceiver::~StripedReceiver() { Stop(); }
+
+void StripedReceiver::Read(BareosSocket* sock)
+{
+  using namespace striped_detail;
+
+  for (;;) {
+    int32_t n = sock->recv();
+    if (n == BNET_SIGNAL) {
+      if (sock->message_length == BNET_TERMINATE) { break; }
+      continue; /* e.g. heartbeats */
+    }
+
+    std::unique_lock lock(mutex_);
+    if (stopping_) { break; }
+    if (n < frame_header_length) {
+      if (!error_) {
+        error_.emplace(n < 0 ? sock->bstrerror()
+                             : "short frame on data connection");
+      }
+      break;
+    }
+
+    uint64_t seq;
+    int32_t signal;
+    DecodeFrameHeader(sock->msg, seq, signal);
+    if (seq < next_seq_ || frames_.count(seq)) {
+      if (!error_) { error_.emplace("duplicate frame on data connection"); }
+      break;
+    }
+
+    // frames are sent in order, so the next one cannot be on this connection
+    space_.wait(lock,
+                [this, seq] { return seq < next_seq_ + window_ || stopping_; });
+    if (stopping_) { break; }
+
+    const int32_t length = n - frame_header_length;
+    PoolMem data(PM_MESSAGE);
+    data.check_size(length + 1);
+    memcpy(data.c_str(), sock->msg + frame_header_length, length);
+    data.c_str()[length] = 0;
+    frames_.emplace(seq, frame{signal, length, std::move(data)});
+    if (seq == next_seq_) { arrived_.notify_all(); }
+  }
+
+  std::unique_lock lock(mutex_);
+  running_ -= 1;
+  arrived_.notify_all();
+}
+
+std::optional<int32_t> StripedReceiver::Receive(
+    PoolMem& msg,
+    int32_t& signal,
+    std::chrono::milliseconds timeout)
+{
+  std::unique_lock lock(mutex_);
+  auto found = frames_.end();
+  bool ready = arrived_.wait_for(lock, timeout, [this, &found] {
+    found = frames_.find(next_seq_);
+    return found != frames_.end() || running_ == 0 || error_ || stopping_;
+  });
+  if (!ready) { return std::nullopt; }
+  if (found == frames_.end()) { return error_ ? BNET_ERROR : BNET_HARDEOF; }
+
+  frame f = std::move(found->second);
+  frames_.erase(found);
+  next_seq_ += 1;
+  space_.notify_all();
+  lock.unlock();
+
+  if (f.signal != 0) {
+    signal = f.signal;
+    return BNET_SIGNAL;
+  }
+  msg = std::move(f.data);
+  return f.length;
+}
+
+void StripedReceiver::Stop()
+{
+  {
+    std::unique_lock lock(mutex_);
+    if (stopping_) { return; }
+    stopping_ = true;
+  }
+  space_.notify_all();
+  arrived_.notify_all();
+
+  // wakes up the readers still waiting for data
+  for (BareosSocket* sock : connections_) {
+    if (sock->fd_ != kInvalidFiledescriptor) { shutdown(sock->fd_, SHUT_RDWR); }
+  }
+  for (auto& reader : readers_) {
+    if (reader.joinable()) { reader.join(); }
+  }
+}
+
+std::optional<std::string> StripedReceiver::error()
+{
+  std::unique_lock lock(mutex_);
+  return error_;
+}
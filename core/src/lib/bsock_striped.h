@@ -0,0 +1,152 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * spreads the messages of one socket over several connections
+ *
+ * A single TCP connection rarely fills a long fat network and its TLS runs on
+ * one single core.  A StripedSender sends the messages of a socket (see
+ * BareosSocket::SetStripedSender()) as frames over several connections, each
+ * one written by an own thread.  A frame is a normal message that starts with
+ * the sequence number of the message and its signal (0 for data), both in
+ * network byte order.  The StripedReceiver reads all connections with one
+ * thread each and hands the messages out in the order they were sent.  Every
+ * connection ends with a BNET_TERMINATE outside of any frame.
+ */
+
+#ifndef BAREOS_LIB_BSOCK_STRIPED_H_
+#define BAREOS_LIB_BSOCK_STRIPED_H_
+
+#include "lib/mem_pool.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+class BareosSocket;
+
+namespace striped_detail {
+constexpr int32_t frame_header_length = sizeof(uint64_t) + sizeof(int32_t);
+// frames have to fit into a single packet, see BareosSocketTCP::send()
+constexpr int32_t max_frame_data = 1000000 - 4 - frame_header_length;
+}  // namespace striped_detail
+
+class StripedSender {
+ public:
+  /* The connections stay owned by the caller, they have to live until
+   * Finish() returned.  At most queue_depth frames wait per connection. */
+  explicit StripedSender(std::vector<BareosSocket*> connections,
+                         std::size_t queue_depth = 8);
+  ~StripedSender();
+
+  /* Queues a copy of the message for one of the connections, a length <= 0
+   * is sent as that signal.  Messages too large for one frame are split the
+   * same way BareosSocketTCP::send() splits them into packets.  Can be called
+   * from several threads; fails once one of the connections failed. */
+  bool Send(const char* data, int32_t length);
+
+  /* Waits until everything queued was sent, then terminates every
+   * connection.  Returns the first error of any connection. */
+  std::optional<std::string> Finish();
+
+  std::size_t size() const { return connections_.size(); }
+
+ private:
+  struct frame {
+    POOLMEM* buf;
+    int32_t length;
+  };
+  struct connection {
+    BareosSocket* sock;
+    std::deque<frame> queue;
+    std::condition_variable work;
+    std::thread thread;
+  };
+
+  void Write(connection& conn);
+  POOLMEM* TakeBuffer();
+
+  std::mutex mutex_;
+  std::condition_variable space_;
+  std::vector<std::unique_ptr<connection>> connections_;
+  std::vector<POOLMEM*> free_buffers_;
+  std::size_t queue_depth_;
+  std::size_t next_connection_{0};
+  uint64_t next_seq_{0};
+  std::optional<std::string> error_;
+  bool finishing_{false};
+  bool finished_{false};
+};
+
+class StripedReceiver {
+ public:
+  /* The connections stay owned by the caller, they have to live until Stop()
+   * returned.  Readers wait while their next frame is window frames ahead of
+   * the one handed out next. */
+  StripedReceiver(std::vector<BareosSocket*> connections, std::size_t window);
+  ~StripedReceiver();
+
+  /* Waits up to timeout for the next message.  Like BareosSocket::recv()
+   * returns its length (msg is null terminated) or BNET_SIGNAL with the signal
+   * in signal.  BNET_HARDEOF means that all connections ended before the next
+   * message arrived, BNET_ERROR that one of them failed before.  Returns
+   * nothing if the next message did not arrive in time. */
+  std::optional<int32_t> Receive(PoolMem& msg,
+                                 int32_t& signal,
+                                 std::chrono::milliseconds timeout);
+
+  // shuts the connections down and waits for the readers
+  void Stop();
+
+  std::optional<std::string> error();
+  std::size_t size() const { return connections_.size(); }
+
+ private:
+  struct frame {
+    int32_t signal;
+    int32_t length;
+    PoolMem data;
+  };
+
+  void Read(BareosSocket* sock);
+
+  std::mutex mutex_;
+  std::condition_variable arrived_;
+  std::condition_variable space_;
+  std::vector<BareosSocket*> connections_;
+  std::vector<std::thread> readers_;
+  std::map<uint64_t, frame> frames_;
+  std::size_t window_;
+  std::size_t running_{0};
+  uint64_t next_seq_{0};
+  std::optional<std::string> error_;
+  bool stopping_{false};
+};
+
+#endif  // BAREOS_LIB_BSOCK_STRIPED_H_
@@ -32,11 +32,22 @@
 #include "include/jcr.h"
 #include <netdb.h>
 #include <netinet/tcp.h>
+#if !defined(HAVE_WIN32)
+#  include <sys/uio.h>
+#endif
+#if defined(HAVE_LINUX_OS)
+#  include <sys/sendfile.h>
+#endif
+#include <algorithm>
+#include <climits>
+#include <vector>
 #include "lib/bnet.h"
 #include "lib/bpoll.h"
 #include "lib/btimers.h"
 #include "lib/tls_openssl.h"
 #include "lib/bsock_tcp.h"
+#include "lib/bsock_compression.h"
+#include "lib/bsock_striped.h"
 #include "lib/berrno.h"
 
 #ifdef HAVE_MSVC
@@ -127,6 +138,11 @@ BareosSocket* BareosSocketTCP::clone()
 
   if (spool_fd_ >= 0) { clone->spool_fd_ = dup(spool_fd_); }
 
+  /* what was read ahead belongs to this socket, the clone reads (if at
+   * all) unbuffered from where this one stopped */
+  clone->receive_buffer_ = {};
+  clone->receive_begin_ = clone->receive_end_ = 0;
+
   clone->cloned_ = true;
 
   return clone;
@@ -502,6 +518,8 @@ bool BareosSocketTCP::send()
    * just before msg, So we can store there */
   int32_t* hdr = (int32_t*)(msg - (int)header_length);
 
+  if (striped_sender_) { return striped_sender_->Send(msg, o_msglen); }
+
   if (errors) {
     if (!suppress_error_msgs_) {
       Qmsg4(jcr_, M_ERROR, 0, T_("Socket has errors=%d on call to %s:%s:%d\n"),
@@ -541,8 +559,19 @@ bool BareosSocketTCP::send()
         packet_msglen = (o_msglen - written);
       }
 
-      *hdr = htonl(packet_msglen); /* store length */
-      ok = SendPacket(hdr, pktsiz);
+      int32_t compressed
+          = compression_ ? compression_->Compress(msg + written, packet_msglen,
+                                                  header_length, compressed_)
+                         : 0;
+      if (compressed > 0) {
+        int32_t* compressed_hdr = (int32_t*)compressed_.data();
+        *compressed_hdr
+            = htonl(compressed | MessageCompression::compressed_flag);
+        ok = SendPacket(compressed_hdr, header_length + compressed);
+      } else {
+        *hdr = htonl(packet_msglen); /* store length */
+        ok = SendPacket(hdr, pktsiz);
+      }
       written += packet_msglen;
       hdr = (int32_t*)(msg + written - (int)header_length);
     }
@@ -553,6 +582,191 @@ bool BareosSocketTCP::send()
   return ok;
 }
 
+/*
+ * Send the concatenation of parts as a single message.  On plain sockets the
+ * header and all parts go out with writev(), so nothing needs to be copied
+ * into msg first.  Whenever the bytes have to pass through something else
+ * (spooling, network dump, TLS) or the message has to be split into several
+ * packets we fall back to gathering it into one buffer, which still results
+ * in one single write per packet.
+ *
+ * Returns: false on failure
+ *          true  on success
+ */
+bool BareosSocketTCP::SendV(const message_part* parts, std::size_t count)
+{
+#if defined(HAVE_WIN32)
+  return BareosSocket::SendV(parts, count);
+#else
+  std::size_t total = 0;
+  for (std::size_t i = 0; i < count; ++i) { total += parts[i].size; }
+
+  bool direct = !IsSpooling() && !IsBnetDumpEnabled() && !tls_conn
+                && !striped_sender_ && !compression_
+                && total <= static_cast<std::size_t>(max_message_len)
+                && count < IOV_MAX;
+  if (!direct) { return BareosSocket::SendV(parts, count); }
+
+  if (errors) {
+    if (!suppress_error_msgs_) {
+      Qmsg4(jcr_, M_ERROR, 0, T_("Socket has errors=%d on call to %s:%s:%d\n"),
+            errors.load(), who_, host_, port_);
+    }
+    return false;
+  }
+
+  if (IsTerminated()) {
+    if (!suppress_error_msgs_) {
+      Qmsg4(jcr_, M_ERROR, 0,
+            T_("Socket is terminated=%d on call to %s:%s:%d\n"), IsTerminated(),
+            who_, host_, port_);
+    }
+    return false;
+  }
+
+  const int32_t msglen = static_cast<int32_t>(total);
+  const int32_t pktsiz = header_length + msglen;
+  int32_t hdr = htonl(msglen);
+
+  std::vector<struct iovec> iov;
+  iov.reserve(count + 1);
+  iov.push_back({&hdr, sizeof(hdr)});
+  for (std::size_t i = 0; i < count; ++i) {
+    if (parts[i].size == 0) { continue; }
+    iov.push_back({const_cast<char*>(parts[i].data), parts[i].size});
+  }
+
+  bool ok = true;
+
+  LockMutex();
+
+  out_msg_no++; /* increment message number */
+  timer_start = watchdog_time; /* start timer */
+  ClearTimedOut();
+
+  int32_t rc = WriteVector(iov.data(), iov.size(), pktsiz);
+  timer_start = 0; /* clear timer */
+  if (rc != pktsiz) {
+    ++errors;
+    if (errno == 0) {
+      b_errno = EIO;
+    } else {
+      b_errno = errno;
+    }
+    if (rc < 0) {
+      if (!suppress_error_msgs_) {
+        Qmsg5(
+            jcr_, M_ERROR, 0,
+            T_("Write error sending %d (mlen: %d) bytes to %s:%s:%d: ERR=%s\n"),
+            pktsiz, msglen, who_, host_, port_, this->bstrerror());
+      }
+    } else {
+      Qmsg5(
+          jcr_, M_ERROR, 0,
+          T_("Wrote %d (mlen: %d) bytes to %s:%s:%d, but only %d accepted.\n"),
+          pktsiz, msglen, who_, host_, port_, rc);
+    }
+    ok = false;
+  }
+
+  UnlockMutex();
+
+  return ok;
+#endif
+}
+
+// true if SendFileRange() lets the kernel send the bytes by itself
+bool BareosSocketTCP::CanSendFileRange()
+{
+#if defined(HAVE_LINUX_OS)
+  if (IsSpooling() || IsBnetDumpEnabled() || striped_sender_ || compression_) {
+    return false;
+  }
+  return !tls_conn || tls_conn->KtlsSendStatus();
+#else
+  return false;
+#endif
+}
+
+/*
+ * Send a range of a file as one message, like BareosSocket::SendFileRange().
+ * The packet headers are written as usual, the data itself goes out with
+ * sendfile() on plain sockets and with SSL_sendfile() on kTLS connections, so
+ * it is neither copied into userspace nor encrypted there.
+ *
+ * Returns: false on failure
+ *          true  on success
+ */
+bool BareosSocketTCP::SendFileRange(int file_fd,
+                                    uint64_t offset,
+                                    uint32_t size)
+{
+  if (!CanSendFileRange()) {
+    return BareosSocket::SendFileRange(file_fd, offset, size);
+  }
+
+  if (errors) {
+    if (!suppress_error_msgs_) {
+      Qmsg4(jcr_, M_ERROR, 0, T_("Socket has errors=%d on call to %s:%s:%d\n"),
+            errors.load(), who_, host_, port_);
+    }
+    return false;
+  }
+
+  if (IsTerminated()) {
+    if (!suppress_error_msgs_) {
+      Qmsg4(jcr_, M_ERROR, 0,
+            T_("Socket is terminated=%d on call to %s:%s:%d\n"), IsTerminated(),
+            who_, host_, port_);
+    }
+    return false;
+  }
+
+  bool ok = true;
+  uint32_t written = 0;
+
+  LockMutex();
+
+  // an empty range still is a message (of length zero), just as with send()
+  do {
+    int32_t packet_msglen = static_cast<int32_t>(
+        std::min<uint32_t>(size - written, max_message_len));
+    int32_t hdr = htonl(packet_msglen);
+
+    out_msg_no++; /* increment message number */
+    timer_start = watchdog_time; /* start timer */
+    ClearTimedOut();
+
+    ok = write_nbytes(reinterpret_cast<char*>(&hdr), header_length)
+             == header_length
+         && (packet_msglen == 0
+             || WriteFileData(file_fd, offset + written, packet_msglen)
+                    == packet_msglen);
+    timer_start = 0; /* clear timer */
+    if (!ok) {
+      ++errors;
+      if (errno == 0) {
+        b_errno = EIO;
+      } else {
+        b_errno = errno;
+      }
+      if (!suppress_error_msgs_) {
+        Qmsg5(
+            jcr_, M_ERROR, 0,
+            T_("Write error sending %d (mlen: %d) bytes to %s:%s:%d: ERR=%s\n"),
+            header_length + packet_msglen, size, who_, host_, port_,
+            this->bstrerror());
+      }
+      break;
+    }
+    written += packet_msglen;
+  } while (written < size);
+
+  UnlockMutex();
+
+  return ok;
+}
+
 /*
  * Receive a message from the other end. Each message consists of
  * two packets. The first is a header that contains the size
@@ -573,7 +787,6 @@ bool BareosSocketTCP::send()
 int32_t BareosSocketTCP::recv()
 {
   int32_t nbytes;
-  int32_t pktsiz;
 
   msg[0] = 0;
   message_length = 0;
@@ -581,12 +794,151 @@ int32_t BareosSocketTCP::recv()
 
   LockMutex();
 
+  nbytes = ReceiveHeader();
+  if (nbytes > 0) { nbytes = ReceiveIntoMsg(nbytes); }
+
+  UnlockMutex();
+
+  return nbytes; /* return actual length of message */
+}
+
+// Like recv(), but points into the buffers where possible, see bsock.h.
+int32_t BareosSocketTCP::RecvView(std::string_view& view)
+{
+  int32_t nbytes;
+
+  view = {};
+  msg[0] = 0;
+  message_length = 0;
+  if (errors || IsTerminated()) { return BNET_HARDEOF; }
+
+  LockMutex();
+
+  nbytes = ReceiveHeader();
+  if (nbytes > 0) {
+    if (const char* content = TakeReceived(nbytes)) {
+      in_msg_no++;
+      message_length = nbytes;
+      view = std::string_view(content, nbytes);
+    } else if ((nbytes = ReceiveIntoMsg(nbytes)) > 0) {
+      view = std::string_view(msg, nbytes);
+    }
+  }
+
+  UnlockMutex();
+
+  return nbytes;
+}
+
+// Read the content of a message into msg, the caller has to hold the mutex.
+int32_t BareosSocketTCP::ReceiveIntoMsg(int32_t nbytes)
+{
+  // Make sure the buffer is big enough + one byte for EOS
+  if (nbytes >= (int32_t)SizeofPoolMemory(msg)) {
+    msg = ReallocPoolMemory(msg, nbytes + 100);
+  }
+
+  // Now read the actual data
+  nbytes = ReceiveContent(msg, nbytes);
+  if (nbytes > 0) {
+    in_msg_no++;
+    message_length = nbytes;
+
+    /* Always add a zero by to properly Terminate any string that was send
+     * to us. Note, we ensured above that the buffer is at least one byte
+     * longer than the message length. */
+    msg[nbytes] = 0; /* Terminate in case it is a string */
+  }
+  return nbytes;
+}
+
+/*
+ * Hand out the next nbytes of content without copying them if they were
+ * already decompressed or read ahead as a whole, otherwise return nullptr
+ * and leave them for ReceiveContent().
+ */
+const char* BareosSocketTCP::TakeReceived(int32_t nbytes)
+{
+  const char* content = nullptr;
+  std::size_t size = nbytes;
+
+  if (inflated_pos_ < inflated_.size()) {
+    if (size <= inflated_.size() - inflated_pos_) {
+      content = inflated_.data() + inflated_pos_;
+      inflated_pos_ += size;
+    }
+  } else if (size <= receive_end_ - receive_begin_) {
+    content = receive_buffer_.data() + receive_begin_;
+    receive_begin_ += size;
+  }
+  return content;
+}
+
+void BareosSocketTCP::EnableReceiveBuffer(std::size_t size)
+{
+  LockMutex();
+  // whatever was read ahead already stays in front
+  std::vector<char> buffer(std::max(size, receive_end_ - receive_begin_));
+  std::copy(receive_buffer_.begin() + receive_begin_,
+            receive_buffer_.begin() + receive_end_, buffer.begin());
+  receive_end_ -= receive_begin_;
+  receive_begin_ = 0;
+  receive_buffer_ = std::move(buffer);
+  UnlockMutex();
+}
+
+/*
+ * Like recv() but only receive the header of the message. The content
+ * (if the return value is positive) has to be read with RecvContent()
+ * before the next message can be received.
+ */
+int32_t BareosSocketTCP::RecvLength()
+{
+  int32_t nbytes;
+
+  message_length = 0;
+  if (errors || IsTerminated()) { return BNET_HARDEOF; }
+
+  LockMutex();
+  nbytes = ReceiveHeader();
+  if (nbytes > 0) {
+    in_msg_no++;
+    message_length = nbytes;
+  }
+  UnlockMutex();
+
+  return nbytes;
+}
+
+/*
+ * Receive the next nbytes of the content of the message whose header was
+ * read by RecvLength(); the content may be read in several parts.
+ */
+int32_t BareosSocketTCP::RecvContent(char* buf, int32_t nbytes)
+{
+  LockMutex();
+  nbytes = ReceiveContent(buf, nbytes);
+  UnlockMutex();
+
+  return nbytes;
+}
+
+/*
+ * Read the header of a message, the caller has to hold the mutex.
+ * Returns the size of the data that follows, 0 for an empty message or the
+ * same negative values as recv().
+ */
+int32_t BareosSocketTCP::ReceiveHeader()
+{
+  int32_t nbytes;
+  int32_t pktsiz;
+
   read_seqno++;                /* bump sequence number */
   timer_start = watchdog_time; /* set start wait time */
   ClearTimedOut();
 
   // Get data size -- in int32_t
-  if ((nbytes = read_nbytes((char*)&pktsiz, header_length)) <= 0) {
+  if ((nbytes = ReceiveBytes((char*)&pktsiz, header_length)) <= 0) {
     timer_start = 0; /* clear timer */
     // Probably pipe broken because client died
     if (errno == 0) {
@@ -595,8 +947,7 @@ int32_t BareosSocketTCP::recv()
       b_errno = errno;
     }
     ++errors;
-    nbytes = BNET_HARDEOF; /* assume hard EOF received */
-    goto get_out;
+    return BNET_HARDEOF; /* assume hard EOF received */
   }
   timer_start = 0; /* clear timer */
   if (nbytes != header_length) {
@@ -604,18 +955,20 @@ int32_t BareosSocketTCP::recv()
     b_errno = EIO;
     Qmsg5(jcr_, M_ERROR, 0, T_("Read expected %d got %d from %s:%s:%d\n"),
           header_length, nbytes, who_, host_, port_);
-    nbytes = BNET_ERROR;
-    goto get_out;
+    return BNET_ERROR;
   }
 
   pktsiz = ntohl(pktsiz); /* decode no. of bytes that follow */
 
   if (pktsiz == 0) { /* No data transferred */
-    timer_start = 0; /* clear timer */
     in_msg_no++;
     message_length = 0;
-    nbytes = 0; /* zero bytes read */
-    goto get_out;
+    return 0; /* zero bytes read */
+  }
+
+  if (compression_ && pktsiz > 0
+      && (pktsiz & MessageCompression::compressed_flag)) {
+    return ReceiveCompressed(pktsiz & ~MessageCompression::compressed_flag);
   }
 
   // If signal or packet size too big
@@ -628,23 +981,69 @@ int32_t BareosSocketTCP::recv()
       pktsiz = BNET_TERMINATE; /* hang up */
     }
     if (pktsiz == BNET_TERMINATE) { SetTerminated(); }
-    timer_start = 0; /* clear timer */
     b_errno = ENODATA;
     message_length = pktsiz; /* signal code */
-    nbytes = BNET_SIGNAL;    /* signal */
-    goto get_out;
+    return BNET_SIGNAL;      /* signal */
   }
 
-  // Make sure the buffer is big enough + one byte for EOS
-  if (pktsiz >= (int32_t)SizeofPoolMemory(msg)) {
-    msg = ReallocPoolMemory(msg, pktsiz + 100);
+  return pktsiz;
+}
+
+/*
+ * Read and decompress a compressed packet.  Returns the length of its
+ * content, which ReceiveContent() then hands out, or BNET_ERROR.
+ */
+int32_t BareosSocketTCP::ReceiveCompressed(int32_t length)
+{
+  inflated_.clear();
+  inflated_pos_ = 0;
+  if (length > max_packet_size) {
+    Qmsg3(jcr_, M_FATAL, 0,
+          T_("Packet size too big from \"%s:%s:%d. Terminating connection.\n"),
+          who_, host_, port_);
+    SetTerminated();
+    b_errno = ENODATA;
+    message_length = BNET_TERMINATE;
+    return BNET_SIGNAL;
+  }
+
+  compressed_.resize(length);
+  if (ReceiveContent(compressed_.data(), length) != length) {
+    return BNET_ERROR;
+  }
+  int32_t size = compression_->Decompress(compressed_.data(), length,
+                                          max_message_len, inflated_);
+  if (size <= 0) {
+    inflated_.clear();
+    b_errno = EIO;
+    ++errors;
+    Qmsg3(jcr_, M_ERROR, 0, T_("Bad compressed message from %s:%s:%d\n"),
+          who_, host_, port_);
+    return BNET_ERROR;
+  }
+  return size;
+}
+
+// Read nbytes of message content, the caller has to hold the mutex.
+int32_t BareosSocketTCP::ReceiveContent(char* buf, int32_t nbytes)
+{
+  int32_t pktsiz = nbytes;
+
+  if (inflated_pos_ < inflated_.size()) {
+    if (static_cast<std::size_t>(nbytes) > inflated_.size() - inflated_pos_) {
+      b_errno = EIO;
+      ++errors;
+      return BNET_ERROR;
+    }
+    memcpy(buf, inflated_.data() + inflated_pos_, nbytes);
+    inflated_pos_ += nbytes;
+    return nbytes;
   }
 
   timer_start = watchdog_time; /* set start wait time */
   ClearTimedOut();
 
-  // Now read the actual data
-  if ((nbytes = read_nbytes(msg, pktsiz)) <= 0) {
+  if ((nbytes = ReceiveBytes(buf, pktsiz)) <= 0) {
     timer_start = 0; /* clear timer */
     if (errno == 0) {
       b_errno = ENODATA;
@@ -654,33 +1053,54 @@ int32_t BareosSocketTCP::recv()
     ++errors;
     Qmsg4(jcr_, M_ERROR, 0, T_("Read error from %s:%s:%d: ERR=%s\n"), who_,
           host_, port_, this->bstrerror());
-    nbytes = BNET_ERROR;
-    goto get_out;
+    return BNET_ERROR;
   }
   timer_start = 0; /* clear timer */
-  in_msg_no++;
-  message_length = nbytes;
   if (nbytes != pktsiz) {
     b_errno = EIO;
     ++errors;
     Qmsg5(jcr_, M_ERROR, 0, T_("Read expected %d got %d from %s:%s:%d\n"),
           pktsiz, nbytes, who_, host_, port_);
-    nbytes = BNET_ERROR;
-    goto get_out;
+    return BNET_ERROR;
   }
 
-  /* Always add a zero by to properly Terminate any string that was send to us.
-   * Note, we ensured above that the buffer is at least one byte longer than
-   * the message length. */
-  msg[nbytes] = 0; /* Terminate in case it is a string */
+  return nbytes;
+}
+
+/*
+ * Read nbytes, out of the receive buffer if there is one.  It is only
+ * refilled once it is empty; contents that would not fit into it anyway
+ * are read directly.  Returns the same as read_nbytes().
+ */
+int32_t BareosSocketTCP::ReceiveBytes(char* ptr, int32_t nbytes)
+{
+  if (receive_buffer_.empty()) { return read_nbytes(ptr, nbytes); }
+
+  int32_t done = 0;
+  while (done < nbytes) {
+    std::size_t wanted = nbytes - done;
+    if (receive_begin_ < receive_end_) {
+      std::size_t size = std::min(wanted, receive_end_ - receive_begin_);
+      memcpy(ptr + done, receive_buffer_.data() + receive_begin_, size);
+      receive_begin_ += size;
+      done += size;
+      continue;
+    }
 
-  /* The following uses *lots* of resources so turn it on only for serious
-   * debugging. */
+    int32_t nread;
+    if (wanted >= receive_buffer_.size()) {
+      nread = read_nbytes(ptr + done, wanted);
+      if (nread > 0) { done += nread; }
+      break;
+    }
 
-get_out:
-  UnlockMutex();
+    receive_begin_ = receive_end_ = 0;
+    nread = ReadSocket(receive_buffer_.data(), receive_buffer_.size(), true);
+    if (nread <= 0) { break; }
+    receive_end_ = nread;
+  }
 
-  return nbytes; /* return actual length of message */
+  return done > 0 ? done : -1;
 }
 
 #if defined(HAVE_WIN32)
@@ -724,11 +1144,10 @@ bool BareosSocketTCP::SetBufferSize(uint32_t size, int rw)
     dbuf_size = DEFAULT_NETWORK_BUFFER_SIZE;
   }
   start_size = dbuf_size;
-  if ((msg = ReallocPoolMemory(msg, dbuf_size + 100)) == NULL) {
-    Qmsg0(get_jcr(), M_FATAL, 0,
-          T_("Could not malloc BareosSocket data buffer\n"));
-    return false;
-  }
+  // the content does not survive this, so the buffer can be a new one
+  POOLMEM* buf = GetBufferMemory(dbuf_size + 100);
+  FreePoolMemory(msg);
+  msg = buf;
 
   /* If user has not set the size, use the OS default -- i.e. do not
    * try to set it.  This allows sys admins to set the size they
@@ -886,6 +1305,11 @@ int BareosSocketTCP::WaitData(int sec, int usec)
 {
   int msec;
 
+  if (receive_begin_ < receive_end_) {
+    b_errno = 0;
+    return 1;
+  }
+
   msec = (sec * 1000) + (usec / 1000);
   switch (WaitForReadableFd(fd_, msec, true)) {
     case 0:
@@ -905,6 +1329,11 @@ int BareosSocketTCP::WaitDataIntr(int sec, int usec)
 {
   int msec;
 
+  if (receive_begin_ < receive_end_) {
+    b_errno = 0;
+    return 1;
+  }
+
   msec = (sec * 1000) + (usec / 1000);
   switch (WaitForReadableFd(fd_, msec, false)) {
     case 0:
@@ -980,11 +1409,23 @@ void BareosSocketTCP::destroy()
  * read requests
  */
 int32_t BareosSocketTCP::read_nbytes(char* ptr, int32_t nbytes)
+{
+  return ReadSocket(ptr, nbytes, false);
+}
+
+/*
+ * As read_nbytes(), but if partial is set it returns as soon as anything
+ * was read.
+ */
+int32_t BareosSocketTCP::ReadSocket(char* ptr, int32_t nbytes, bool partial)
 {
   int32_t nleft, nread;
 
 #ifdef HAVE_TLS
-  if (tls_conn) { return (tls_conn->TlsBsockReadn(this, ptr, nbytes)); }
+  if (tls_conn) {
+    return partial ? tls_conn->TlsBsockRead(this, ptr, nbytes)
+                   : tls_conn->TlsBsockReadn(this, ptr, nbytes);
+  }
 #endif /* HAVE_TLS */
 
   nleft = nbytes;
@@ -1022,6 +1463,7 @@ int32_t BareosSocketTCP::read_nbytes(char* ptr, int32_t nbytes)
     nleft -= nread;
     ptr += nread;
     if (UseBwlimit()) { ControlBwlimit(nread); }
+    if (partial) { break; }
   }
 
   return nbytes - nleft; /* return >= 0 */
@@ -1100,11 +1542,118 @@ int32_t BareosSocketTCP::write_nbytes(char* ptr, int32_t nbytes)
   return nbytes - nleft;
 }
 
+/*
+ * Write the nbytes described by iov to the network, same as write_nbytes()
+ * but for scattered data.  The iov array gets modified on partial writes.
+ */
+int32_t BareosSocketTCP::WriteVector(struct iovec* iov,
+                                     int iovcnt,
+                                     int32_t nbytes)
+{
+#if defined(HAVE_WIN32)
+  (void)iov;
+  (void)iovcnt;
+  (void)nbytes;
+  errno = ENOSYS;
+  return -1;
+#else
+  int32_t nleft = nbytes;
+  while (nleft > 0 && iovcnt > 0) {
+    ssize_t nwritten;
+    do {
+      errno = 0;
+      nwritten = ::writev(fd_, iov, iovcnt);
+      if (IsTimedOut() || IsTerminated()) { return -1; }
+    } while (nwritten == -1 && errno == EINTR);
+
+    if (nwritten == -1 && errno == EAGAIN) {
+      WaitForWritableFd(fd_, 1, false);
+      continue;
+    }
+
+    if (nwritten <= 0) { return -1; /* error */ }
+
+    nleft -= nwritten;
+    if (UseBwlimit()) { ControlBwlimit(nwritten); }
+
+    // skip everything that was written completely
+    std::size_t done = nwritten;
+    while (iovcnt > 0 && done >= iov->iov_len) {
+      done -= iov->iov_len;
+      ++iov;
+      --iovcnt;
+    }
+    if (iovcnt > 0) {
+      iov->iov_base = static_cast<char*>(iov->iov_base) + done;
+      iov->iov_len -= done;
+    }
+  }
+
+  return nbytes - nleft;
+#endif
+}
+
+/*
+ * Write nbytes of file_fd, starting at offset, to the network, same as
+ * write_nbytes() but the kernel takes the bytes directly from the file.
+ */
+int32_t BareosSocketTCP::WriteFileData(int file_fd,
+                                       uint64_t offset,
+                                       int32_t nbytes)
+{
+#if defined(HAVE_LINUX_OS)
+  if (tls_conn) {
+    return tls_conn->TlsBsockSendfile(this, file_fd, offset, nbytes);
+  }
+
+  off_t pos = offset;
+  int32_t nleft = nbytes;
+  while (nleft > 0) {
+    ssize_t nwritten;
+    do {
+      errno = 0;
+      nwritten = ::sendfile(fd_, file_fd, &pos, nleft);
+      if (IsTimedOut() || IsTerminated()) { return -1; }
+    } while (nwritten == -1 && errno == EINTR);
+
+    if (nwritten == -1 && errno == EAGAIN) {
+      WaitForWritableFd(fd_, 1, false);
+      continue;
+    }
+
+    // zero means the file ended before the range did
+    if (nwritten <= 0) { return -1; /* error */ }
+
+    nleft -= nwritten;
+    if (UseBwlimit()) { ControlBwlimit(nwritten); }
+  }
+
+  return nbytes - nleft;
+#else
+  (void)file_fd;
+  (void)offset;
+  (void)nbytes;
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
 bool BareosSocketTCP::ConnectionReceivedTerminateSignal()
 {
   int32_t signal;
-  SetNonblocking();
   bool terminated = false;
+  if (receive_begin_ < receive_end_) {
+    // the next message was read ahead already (or at least a part of it)
+    if (receive_end_ - receive_begin_ >= sizeof(signal)) {
+      memcpy(&signal, receive_buffer_.data() + receive_begin_, sizeof(signal));
+      if (static_cast<int32_t>(ntohl(signal)) == BNET_TERMINATE) {
+        SetTerminated();
+        terminated = true;
+      }
+    }
+    return terminated;
+  }
+  SetNonblocking();
   if (::recv(fd_, (char*)&signal, 4, MSG_PEEK) == 4) {
     signal = ntohl(signal);
     if (signal == BNET_TERMINATE) {
@@ -24,6 +24,8 @@
 
 #include "lib/bsock.h"
 
+#include <vector>
+
 class BareosSocketTCP : public BareosSocket {
  public:
   /*
@@ -63,8 +65,24 @@ class BareosSocketTCP : public BareosSocket {
                     int keepalive_start,
                     int keepalive_interval);
   bool SendPacket(int32_t* hdr, int32_t pktsiz);
+  int32_t WriteVector(struct iovec* iov, int iovcnt, int32_t nbytes);
+  int32_t WriteFileData(int file_fd, uint64_t offset, int32_t nbytes);
+  int32_t ReceiveHeader();
+  int32_t ReceiveContent(char* buf, int32_t nbytes);
+  int32_t ReceiveCompressed(int32_t length);
+  int32_t ReceiveIntoMsg(int32_t nbytes);
+  const char* TakeReceived(int32_t nbytes);
+  int32_t ReceiveBytes(char* ptr, int32_t nbytes);
+  int32_t ReadSocket(char* ptr, int32_t nbytes, bool partial);
   void DumpNetworkMessageToFile(const char* ptr, int nbytes);
 
+  std::vector<char> compressed_{}; /* packet sent or received compressed */
+  std::vector<char> inflated_{};   /* content of a received compressed one */
+  std::size_t inflated_pos_{0};    /* read by ReceiveContent() up to here */
+  std::vector<char> receive_buffer_{}; /* see EnableReceiveBuffer() */
+  std::size_t receive_begin_{0};       /* handed out up to here */
+  std::size_t receive_end_{0};         /* filled up to here */
+
  public:
   BareosSocketTCP();
   ~BareosSocketTCP();
@@ -81,7 +99,19 @@ class BareosSocketTCP : public BareosSocket {
                int port,
                bool verbose) override;
   int32_t recv() override;
+  int32_t RecvLength() override;
+  int32_t RecvContent(char* buf, int32_t nbytes) override;
+  int32_t RecvView(std::string_view& view) override;
+  void EnableReceiveBuffer(std::size_t size = 64 * 1024) override;
+  bool HasPendingData() const override
+  {
+    return receive_begin_ < receive_end_ || BareosSocket::HasPendingData();
+  }
   bool send() override;
+  using BareosSocket::SendV;
+  bool SendV(const message_part* parts, std::size_t count) override;
+  bool CanSendFileRange() override;
+  bool SendFileRange(int file_fd, uint64_t offset, uint32_t size) override;
   bool fsend(const char*, ...);
   int32_t read_nbytes(char* ptr, int32_t nbytes) override;
   int32_t write_nbytes(char* ptr, int32_t nbytes) override;
@@ -22,7 +22,12 @@
 #ifndef BAREOS_LIB_CHANNEL_H_
 #define BAREOS_LIB_CHANNEL_H_
 
+#include <atomic>
 #include <condition_variable>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <vector>
 #include <utility>
@@ -32,17 +37,62 @@
 #include "include/baconfig.h"
 
 namespace channel {
-// a simple single consumer/ single producer queue
-// Its composed of three parts: the input, the output and the
+// A channel is composed of three parts: the input, the output and the
 // actual queue data.
 // Instead of directly interacting with the queue itself you instead
 // interact with either the input or the output.
 // This ensures that there is only one producer (who writes to the input)
-// and one consumer (who reads from the output).
+// and one consumer (who reads from the output); only the mpmc channel
+// allows more of them (see input::clone() and output::clone()).
 
 struct channel_closed {};
 
-template <typename T> class queue {
+enum class queue_status
+{
+  Ok,
+  WouldBlock,
+  Closed,
+};
+
+// what input and output need from the queue behind them
+template <typename T> class queue_interface {
+ public:
+  virtual ~queue_interface() = default;
+
+  // value is only moved from if Ok is returned
+  virtual queue_status put(T& value, bool wait) = 0;
+  /* moves values, starting at done, until all are put, the channel is closed
+   * or the queue is full and we should not wait */
+  virtual queue_status put_many(std::vector<T>& values,
+                                std::size_t& done,
+                                bool wait)
+  {
+    for (; done < values.size(); ++done) {
+      if (auto status = put(values[done], wait); status != queue_status::Ok) {
+        return status;
+      }
+    }
+    return queue_status::Ok;
+  }
+  // replaces the content of out with at most max values
+  virtual queue_status get(std::vector<T>& out, std::size_t max, bool wait)
+      = 0;
+  // the number of values output::get() takes out of the queue at once
+  virtual std::size_t batch_size() const
+  {
+    return std::numeric_limits<std::size_t>::max();
+  }
+  // must not block
+  virtual bool output_closed() = 0;
+  virtual void close_in() = 0;
+  virtual void close_out() = 0;
+
+  virtual void add_input() { ASSERT(false); }
+  virtual void add_output() { ASSERT(false); }
+};
+
+// a simple single consumer/ single producer queue protected by a mutex
+template <typename T> class queue : public queue_interface<T> {
   struct internal {
     std::vector<T> data;
     bool in_dead;
@@ -82,6 +132,7 @@ template <typename T> class queue {
     {
       locked = std::move(that.locked);
       update = std::exchange(that.update, nullptr);
+      return *this;
     }
 
     std::vector<T>& data() { return locked->data; }
@@ -164,27 +215,411 @@ template <typename T> class queue {
                        &in_update);
   }
 
-  void close_in()
+  queue_status put(T& value, bool wait) override
+  {
+    return with_handle(wait ? std::make_optional(input_lock())
+                            : try_input_lock(),
+                       [&value](std::vector<T>& data) {
+                         data.push_back(std::move(value));
+                       });
+  }
+
+  queue_status put_many(std::vector<T>& values,
+                        std::size_t& done,
+                        bool wait) override
+  {
+    while (done < values.size()) {
+      auto status = with_handle(
+          wait ? std::make_optional(input_lock()) : try_input_lock(),
+          [this, &values, &done](std::vector<T>& data) {
+            while (done < values.size() && data.size() < max_size) {
+              data.push_back(std::move(values[done++]));
+            }
+          });
+      if (status != queue_status::Ok) { return status; }
+    }
+    return queue_status::Ok;
+  }
+
+  queue_status get(std::vector<T>& out, std::size_t max, bool wait) override
+  {
+    return with_handle(
+        wait ? std::make_optional(output_lock()) : try_output_lock(),
+        [&out, max](std::vector<T>& data) {
+          out.clear();
+          if (data.size() <= max) {
+            std::swap(out, data);
+          } else {
+            auto last = data.begin() + max;
+            out.assign(std::make_move_iterator(data.begin()),
+                       std::make_move_iterator(last));
+            data.erase(data.begin(), last);
+          }
+        });
+  }
+
+  bool output_closed() override
+  {
+    auto locked = shared.try_lock();
+    return locked && locked.value()->out_dead;
+  }
+
+  void close_in() override
   {
     shared.lock()->in_dead = true;
     in_update.notify_one();
   }
 
-  void close_out()
+  void close_out() override
   {
     shared.lock()->out_dead = true;
     out_update.notify_one();
   }
+
+ private:
+  template <typename F>
+  queue_status with_handle(std::optional<result_type> result, F f)
+  {
+    if (!result) { return queue_status::WouldBlock; }
+    if (auto* h = std::get_if<handle>(&result.value())) {
+      f(h->data());
+      return queue_status::Ok;
+    }
+    return queue_status::Closed;
+  }
+};
+
+/* Lets one side of a lock-free queue sleep until the other side made
+ * progress.  As long as nobody sleeps, waking is just a fence and a load:
+ * no lock and no system call per message. */
+class waiter {
+ public:
+  template <typename Pred> void wait(Pred ready)
+  {
+    std::unique_lock lock(mutex);
+    sleeping.fetch_add(1, std::memory_order_relaxed);
+    // pairs with the fence in wake(): either we see the progress or it sees us
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    while (!ready()) { cond.wait(lock); }
+    sleeping.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  void wake(bool all = false)
+  {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_relaxed) > 0) {
+      // the sleeper is either in cond.wait() or did not check ready() yet
+      { std::lock_guard lock(mutex); }
+      if (all) {
+        cond.notify_all();
+      } else {
+        cond.notify_one();
+      }
+    }
+  }
+
+ private:
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::atomic<int> sleeping{0};
+};
+
+inline constexpr std::size_t cache_line_size = 64;
+
+// lock-free ring buffer for exactly one producer and one consumer
+template <typename T> class spsc_queue : public queue_interface<T> {
+ public:
+  explicit spsc_queue(std::size_t capacity)
+      : slots(std::max<std::size_t>(capacity, 1))
+  {
+  }
+  spsc_queue(const spsc_queue&) = delete;
+  spsc_queue& operator=(const spsc_queue&) = delete;
+
+  queue_status put(T& value, bool wait) override
+  {
+    std::size_t pos = tail.load(std::memory_order_relaxed);
+    if (auto status = wait_for_space(pos, wait); status != queue_status::Ok) {
+      return status;
+    }
+    slots[pos % slots.size()].emplace(std::move(value));
+    tail.store(pos + 1, std::memory_order_release);
+    consumer.wake();
+    return queue_status::Ok;
+  }
+
+  queue_status put_many(std::vector<T>& values,
+                        std::size_t& done,
+                        bool wait) override
+  {
+    while (done < values.size()) {
+      std::size_t pos = tail.load(std::memory_order_relaxed);
+      if (auto status = wait_for_space(pos, wait);
+          status != queue_status::Ok) {
+        return status;
+      }
+      std::size_t end = head.load(std::memory_order_acquire) + slots.size();
+      for (; pos < end && done < values.size(); ++pos) {
+        slots[pos % slots.size()].emplace(std::move(values[done++]));
+      }
+      tail.store(pos, std::memory_order_release);
+      consumer.wake();
+    }
+    return queue_status::Ok;
+  }
+
+  queue_status get(std::vector<T>& out, std::size_t max, bool wait) override
+  {
+    std::size_t pos = head.load(std::memory_order_relaxed);
+    std::size_t end;
+    for (;;) {
+      end = tail.load(std::memory_order_acquire);
+      if (end != pos) { break; }
+      if (in_dead.load(std::memory_order_acquire)) {
+        // everything put before closing is visible now
+        if (tail.load(std::memory_order_acquire) == pos) {
+          return queue_status::Closed;
+        }
+        continue;
+      }
+      if (!wait) { return queue_status::WouldBlock; }
+      consumer.wait([this, pos] {
+        return tail.load(std::memory_order_acquire) != pos
+               || in_dead.load(std::memory_order_acquire);
+      });
+    }
+
+    if (end - pos > max) { end = pos + max; }
+    out.clear();
+    for (; pos < end; ++pos) {
+      auto& slot = slots[pos % slots.size()];
+      out.push_back(std::move(slot.value()));
+      slot.reset();
+    }
+    head.store(pos, std::memory_order_release);
+    producer.wake();
+    return queue_status::Ok;
+  }
+
+  bool output_closed() override
+  {
+    return out_dead.load(std::memory_order_acquire);
+  }
+
+  void close_in() override
+  {
+    in_dead.store(true, std::memory_order_release);
+    consumer.wake(true);
+  }
+
+  void close_out() override
+  {
+    out_dead.store(true, std::memory_order_release);
+    producer.wake(true);
+  }
+
+ private:
+  queue_status wait_for_space(std::size_t pos, bool wait)
+  {
+    auto full = [this, pos] {
+      return pos - head.load(std::memory_order_acquire) >= slots.size();
+    };
+    if (out_dead.load(std::memory_order_acquire)) {
+      return queue_status::Closed;
+    }
+    if (full()) {
+      if (!wait) { return queue_status::WouldBlock; }
+      producer.wait([this, &full] {
+        return !full() || out_dead.load(std::memory_order_acquire);
+      });
+      if (out_dead.load(std::memory_order_acquire)) {
+        return queue_status::Closed;
+      }
+    }
+    return queue_status::Ok;
+  }
+
+  std::vector<std::optional<T>> slots;
+  // positions only ever increase; the slot is position % size
+  alignas(cache_line_size) std::atomic<std::size_t> head{0};
+  alignas(cache_line_size) std::atomic<std::size_t> tail{0};
+  alignas(cache_line_size) std::atomic<bool> in_dead{false};
+  std::atomic<bool> out_dead{false};
+  waiter producer;
+  waiter consumer;
+};
+
+/* bounded lock-free queue for any number of producers and consumers
+ * (D. Vyukov's bounded MPMC queue); the capacity is rounded up to a
+ * power of two */
+template <typename T> class mpmc_queue : public queue_interface<T> {
+  struct cell {
+    std::atomic<std::size_t> sequence;
+    std::optional<T> value;
+  };
+
+ public:
+  explicit mpmc_queue(std::size_t capacity)
+  {
+    std::size_t size = 2;
+    while (size < capacity) { size *= 2; }
+    cells = std::make_unique<cell[]>(size);
+    mask = size - 1;
+    for (std::size_t i = 0; i < size; ++i) {
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+  mpmc_queue(const mpmc_queue&) = delete;
+  mpmc_queue& operator=(const mpmc_queue&) = delete;
+
+  queue_status put(T& value, bool wait) override
+  {
+    for (;;) {
+      if (outputs.load(std::memory_order_acquire) == 0) {
+        return queue_status::Closed;
+      }
+      if (try_push(value)) {
+        consumers.wake();
+        return queue_status::Ok;
+      }
+      if (!wait) { return queue_status::WouldBlock; }
+      producers.wait([this] {
+        return !full() || outputs.load(std::memory_order_acquire) == 0;
+      });
+    }
+  }
+
+  queue_status get(std::vector<T>& out, std::size_t max, bool wait) override
+  {
+    out.clear();
+    for (;;) {
+      // everything put by inputs that are closed already is visible now
+      bool no_inputs = inputs.load(std::memory_order_acquire) == 0;
+      while (out.size() < max && try_pop(out)) {}
+      if (!out.empty()) {
+        producers.wake(out.size() > 1);
+        return queue_status::Ok;
+      }
+      if (no_inputs) { return queue_status::Closed; }
+      if (!wait) { return queue_status::WouldBlock; }
+      consumers.wait([this] {
+        return !empty() || inputs.load(std::memory_order_acquire) == 0;
+      });
+    }
+  }
+
+  // consumers take one value at a time, so that all of them get work
+  std::size_t batch_size() const override { return 1; }
+
+  bool output_closed() override
+  {
+    return outputs.load(std::memory_order_acquire) == 0;
+  }
+
+  void close_in() override
+  {
+    if (inputs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      consumers.wake(true);
+    }
+  }
+
+  void close_out() override
+  {
+    if (outputs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      producers.wake(true);
+    }
+  }
+
+  void add_input() override
+  {
+    inputs.fetch_add(1, std::memory_order_relaxed);
+  }
+  void add_output() override
+  {
+    outputs.fetch_add(1, std::memory_order_relaxed);
+  }
+
+ private:
+  bool try_push(T& value)
+  {
+    std::size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+    cell* c;
+    for (;;) {
+      c = &cells[pos & mask];
+      std::size_t seq = c->sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<std::intptr_t>(seq)
+                  - static_cast<std::intptr_t>(pos);
+      if (diff == 0) {
+        if (enqueue_pos.compare_exchange_weak(pos, pos + 1,
+                                              std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false; /* full */
+      } else {
+        pos = enqueue_pos.load(std::memory_order_relaxed);
+      }
+    }
+    c->value.emplace(std::move(value));
+    c->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool try_pop(std::vector<T>& out)
+  {
+    std::size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+    cell* c;
+    for (;;) {
+      c = &cells[pos & mask];
+      std::size_t seq = c->sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<std::intptr_t>(seq)
+                  - static_cast<std::intptr_t>(pos + 1);
+      if (diff == 0) {
+        if (dequeue_pos.compare_exchange_weak(pos, pos + 1,
+                                              std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false; /* empty */
+      } else {
+        pos = dequeue_pos.load(std::memory_order_relaxed);
+      }
+    }
+    out.push_back(std::move(c->value.value()));
+    c->value.reset();
+    c->sequence.store(pos + mask + 1, std::memory_order_release);
+    return true;
+  }
+
+  // only used to decide whether to sleep, so they can be a bit off
+  bool full() const
+  {
+    return enqueue_pos.load(std::memory_order_acquire)
+               - dequeue_pos.load(std::memory_order_acquire)
+           > mask;
+  }
+  bool empty() const
+  {
+    return enqueue_pos.load(std::memory_order_acquire)
+           == dequeue_pos.load(std::memory_order_acquire);
+  }
+
+  std::unique_ptr<cell[]> cells;
+  std::size_t mask;
+  alignas(cache_line_size) std::atomic<std::size_t> enqueue_pos{0};
+  alignas(cache_line_size) std::atomic<std::size_t> dequeue_pos{0};
+  alignas(cache_line_size) std::atomic<std::size_t> inputs{1};
+  std::atomic<std::size_t> outputs{1};
+  waiter producers;
+  waiter consumers;
 };
 
 template <typename T> class input {
-  std::shared_ptr<queue<T>> shared;
+  std::shared_ptr<queue_interface<T>> shared;
   bool did_close{false};
-  using handle_type = typename queue<T>::handle;
-  using result_type = typename queue<T>::result_type;
 
  public:
-  explicit input(std::shared_ptr<queue<T>> t_shared)
+  explicit input(std::shared_ptr<queue_interface<T>> t_shared)
       : shared{std::move(t_shared)}
   {
   }
@@ -197,31 +632,46 @@ template <typename T> class input {
   template <typename... Args> bool emplace(Args... args)
   {
     if (did_close) { return false; }
-    auto result = shared->input_lock();
-    return do_emplace(result, std::forward<Args>(args)...);
+    T value(std::forward<Args>(args)...);
+    return do_put(value, true);
   }
 
   template <typename... Args> bool try_emplace(Args... args)
   {
     if (did_close) { return false; }
+    T value(std::forward<Args>(args)...);
+    return do_put(value, false);
+  }
 
-    if (auto result = shared->try_input_lock()) {
-      return do_emplace(result.value(), std::forward<Args>(args)...);
+  /* puts all values (waiting for space as needed) and clears the vector;
+   * returns false if the channel was closed, then values only contains
+   * what was not put. */
+  bool put_many(std::vector<T>& values)
+  {
+    if (did_close) { return false; }
+    std::size_t done = 0;
+    auto status = shared->put_many(values, done, true);
+    values.erase(values.begin(), values.begin() + done);
+    if (status == queue_status::Closed) {
+      close();
+      return false;
     }
-
-    return false;
+    return true;
   }
 
   void try_update_status()
   {
     if (did_close) { return; }
 
-    bool should_close = false;
-    if (auto result = shared->try_input_lock()) {
-      if (std::get_if<channel_closed>(&result.value())) { should_close = true; }
-    }
+    if (shared->output_closed()) { close(); }
+  }
 
-    if (should_close) { close(); }
+  // another input of the same channel (only for mpmc channels)
+  input clone()
+  {
+    ASSERT(!did_close);
+    shared->add_input();
+    return input{shared};
   }
 
   void close()
@@ -240,42 +690,28 @@ template <typename T> class input {
   }
 
  private:
-  template <typename... Args>
-  inline bool do_emplace(result_type& result, Args... args)
-  {
-    return std::visit(
-        [this, &args...](auto&& val) {
-          using val_type = std::decay_t<decltype(val)>;
-          if constexpr (std::is_same_v<val_type, channel_closed>) {
-            close();
-            return false;
-          } else if constexpr (std::is_same_v<val_type, handle_type>) {
-            val.data().emplace_back(std::forward<Args>(args)...);
-            return true;
-          } else {
-            static_assert("Type not handled");
-          }
-        },
-        result);
+  bool do_put(T& value, bool wait)
+  {
+    switch (shared->put(value, wait)) {
+      case queue_status::Ok:
+        return true;
+      case queue_status::Closed:
+        close();
+        return false;
+      default:
+        return false;
+    }
   }
 };
 
 template <typename T> class output {
-  std::shared_ptr<queue<T>> shared;
+  std::shared_ptr<queue_interface<T>> shared;
   std::vector<T> cache{};
   typename decltype(cache)::iterator cache_iter = cache.begin();
   bool did_close{false};
-  using handle_type = typename queue<T>::handle;
-  using result_type = typename queue<T>::result_type;
-
-  enum class with_lock
-  {
-    No,
-    Yes,
-  };
 
  public:
-  explicit output(std::shared_ptr<queue<T>> t_shared)
+  explicit output(std::shared_ptr<queue_interface<T>> t_shared)
       : shared{std::move(t_shared)}
   {
   }
@@ -285,9 +721,39 @@ template <typename T> class output {
   output(const output&) = delete;
   output& operator=(const output&) = delete;
 
-  std::optional<T> get() { return get_internal(with_lock::Yes); }
+  std::optional<T> get() { return get_internal(true); }
 
-  std::optional<T> try_get() { return get_internal(with_lock::No); }
+  std::optional<T> try_get() { return get_internal(false); }
+
+  /* replaces the content of values with everything that is available,
+   * waiting until there is something; returns false once the channel is
+   * closed and empty. */
+  bool get_all(std::vector<T>& values)
+  {
+    values.clear();
+    if (did_close) { return false; }
+    if (cache_iter != cache.end()) {
+      values.assign(std::make_move_iterator(cache_iter),
+                    std::make_move_iterator(cache.end()));
+      cache.clear();
+      cache_iter = cache.begin();
+      return true;
+    }
+    if (shared->get(values, std::numeric_limits<std::size_t>::max(), true)
+        == queue_status::Closed) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  // another output of the same channel (only for mpmc channels)
+  output clone()
+  {
+    ASSERT(!did_close);
+    shared->add_output();
+    return output{shared};
+  }
 
   void close()
   {
@@ -307,10 +773,10 @@ template <typename T> class output {
   }
 
  private:
-  std::optional<T> get_internal(with_lock lock)
+  std::optional<T> get_internal(bool wait)
   {
     if (did_close) { return std::nullopt; }
-    update_cache(lock);
+    update_cache(wait);
 
     if (cache_iter != cache.end()) {
       std::optional result = std::make_optional<T>(std::move(*cache_iter++));
@@ -320,35 +786,20 @@ template <typename T> class output {
     }
   }
 
-  inline void do_update_cache(result_type& result)
-  {
-    std::visit(
-        [this](auto&& val) {
-          using val_type = std::decay_t<decltype(val)>;
-          if constexpr (std::is_same_v<val_type, channel_closed>) {
-            close();
-          } else if constexpr (std::is_same_v<val_type, handle_type>) {
-            cache.clear();
-            std::swap(cache, val.data());
-            cache_iter = cache.begin();
-          } else {
-            static_assert("Type not handled");
-          }
-        },
-        result);
-  }
-
-  void update_cache(with_lock lock)
+  void update_cache(bool wait)
   {
     if (cache_iter == cache.end()) {
-      std::optional<handle_type> handle;
-      if (lock == with_lock::No) {
-        if (auto result = shared->try_output_lock()) {
-          do_update_cache(result.value());
-        }
-      } else {
-        auto result = shared->output_lock();
-        do_update_cache(result);
+      switch (shared->get(cache, shared->batch_size(), wait)) {
+        case queue_status::Ok:
+          cache_iter = cache.begin();
+          break;
+        case queue_status::Closed:
+          close();
+          break;
+        default:
+          cache.clear();
+          cache_iter = cache.begin();
+          break;
       }
     }
   }
@@ -357,13 +808,31 @@ template <typename T> class output {
 template <typename T> using channel_pair = std::pair<input<T>, output<T>>;
 
 template <typename T>
-channel_pair<T> CreateBufferedChannel(std::size_t capacity)
+channel_pair<T> MakeChannel(std::shared_ptr<queue_interface<T>> shared)
 {
-  auto shared = std::make_shared<queue<T>>(capacity);
-  auto in = input(shared);
-  auto out = output(shared);
+  auto in = input<T>(shared);
+  auto out = output<T>(std::move(shared));
   return {std::move(in), std::move(out)};
 }
+
+template <typename T>
+channel_pair<T> CreateBufferedChannel(std::size_t capacity)
+{
+  return MakeChannel<T>(std::make_shared<queue<T>>(capacity));
+}
+
+/* Same as CreateBufferedChannel(), but lock-free; neither side takes a lock
+ * or makes a system call unless it has to wait for the other. */
+template <typename T> channel_pair<T> CreateSpscChannel(std::size_t capacity)
+{
+  return MakeChannel<T>(std::make_shared<spsc_queue<T>>(capacity));
+}
+
+// A lock-free channel whose input and output can be cloned.
+template <typename T> channel_pair<T> CreateMpmcChannel(std::size_t capacity)
+{
+  return MakeChannel<T>(std::make_shared<mpmc_queue<T>>(capacity));
+}
 }  // namespace channel
 
 #endif  // BAREOS_LIB_CHANNEL_H_
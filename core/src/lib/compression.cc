@@ -46,8 +46,16 @@
 #  include <lzo/lzo1x.h>
 #endif
 
+#ifdef HAVE_ZSTD
+#  include <zstd.h>
+#  include <zstd_errors.h>
+#  include <zdict.h>
+#endif
+
 #include "fastlz/fastlzlib.h"
 
+#include <cmath>
+
 #ifndef HAVE_COMPRESS_BOUND
 #  define compressBound(sourceLen) \
     (sourceLen + (sourceLen >> 12) + (sourceLen >> 14) + (sourceLen >> 25) + 13)
@@ -66,6 +74,10 @@ const char* cmprs_algo_to_text(uint32_t compression_algorithm)
       return "LZ4";
     case COMPRESS_FZ4H:
       return "LZ4HC";
+    case COMPRESS_ZSTD:
+      return "ZSTD";
+    case COMPRESS_NONE:
+      return "NONE";
     default:
       return "Unknown";
   }
@@ -102,6 +114,55 @@ static inline void UnknownCompressionAlgorithm(JobControlRecord* jcr,
        cmprs_algo_to_text(compression_algorithm));
 }
 
+bool LooksIncompressible(const char* data, std::size_t size)
+{
+  constexpr std::size_t kSamples = 4;
+  constexpr std::size_t kSampleSize = 1024;
+  /* Compressed or encrypted data has close to 8 bits of entropy per byte, as
+   * we only look at 4 KiB the estimate is usually a bit lower than that.
+   * Even base64 encoded data stays clearly below this threshold. */
+  constexpr double kThreshold = 7.85;
+
+  if (size < kSamples * kSampleSize) { return false; }
+
+  std::uint32_t histogram[256] = {};
+  std::size_t stride = (size - kSampleSize) / (kSamples - 1);
+  for (std::size_t i = 0; i < kSamples; ++i) {
+    auto* sample = reinterpret_cast<const unsigned char*>(data) + i * stride;
+    for (std::size_t j = 0; j < kSampleSize; ++j) { histogram[sample[j]]++; }
+  }
+
+  constexpr double total = kSamples * kSampleSize;
+  double entropy = 0;
+  for (std::uint32_t count : histogram) {
+    if (count == 0) { continue; }
+    double p = count / total;
+    entropy -= p * std::log2(p);
+  }
+
+  return entropy > kThreshold;
+}
+
+bool CompressionBypass::Skip(const char* data, std::size_t size)
+{
+  if (useless_in_a_row_.load(std::memory_order_relaxed) >= kUselessThreshold) {
+    // compress a block every now and then to notice a change of content
+    return skipped_.fetch_add(1, std::memory_order_relaxed) % kProbeInterval
+           != kProbeInterval - 1;
+  }
+  return LooksIncompressible(data, size);
+}
+
+void CompressionBypass::Learn(std::size_t uncompressed_size,
+                              std::size_t compressed_size)
+{
+  if (CompressionWasUseless(uncompressed_size, compressed_size)) {
+    useless_in_a_row_.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    useless_in_a_row_.store(0, std::memory_order_relaxed);
+  }
+}
+
 std::size_t RequiredCompressionOutputBufferSize(uint32_t algo,
                                                 std::size_t max_input_size)
 {
@@ -123,6 +184,10 @@ std::size_t RequiredCompressionOutputBufferSize(uint32_t algo,
       return max_input_size + (max_input_size / 10 + 16 * 2)
              + sizeof(comp_stream_header);
       break;
+#ifdef HAVE_ZSTD
+    case COMPRESS_ZSTD:
+      return ZSTD_compressBound(max_input_size) + sizeof(comp_stream_header);
+#endif
   }
 
   return max_input_size + sizeof(comp_stream_header);
@@ -307,6 +372,67 @@ class lzo_compressor {
 };
 #endif
 
+#ifdef HAVE_ZSTD
+class zstd_compressor {
+  ZSTD_CCtx* cctx{nullptr};
+  std::optional<PoolMem> error{};
+
+ public:
+  zstd_compressor()
+  {
+    cctx = ZSTD_createCCtx();
+    if (!cctx) { error.emplace("Failed to create zstd context."); }
+  }
+
+  bool set_level(int level)
+  {
+    if (error) return false;
+
+    if (auto zstat
+        = ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+        ZSTD_isError(zstat)) {
+      Mmsg(error.emplace(), "Failed to set zstd level %d: %s\n", level,
+           ZSTD_getErrorName(zstat));
+    }
+
+    return !error;
+  }
+
+  result<std::size_t> compress(char const* input,
+                               std::size_t size,
+                               char* output,
+                               std::size_t capacity,
+                               ZSTD_CDict* cdict)
+  {
+    if (error) return PoolMem{error->c_str()};
+
+    // referencing no dictionary drops the one of the previous call
+    if (auto zstat = ZSTD_CCtx_refCDict(cctx, cdict); ZSTD_isError(zstat)) {
+      PoolMem errmsg;
+      Mmsg(errmsg, "Failed to set zstd dictionary: %s\n",
+           ZSTD_getErrorName(zstat));
+      return errmsg;
+    }
+
+    std::size_t compress_len
+        = ZSTD_compress2(cctx, output, capacity, input, size);
+    if (ZSTD_isError(compress_len)) {
+      PoolMem errmsg;
+      Mmsg(errmsg, "Compression zstd error: %s\n",
+           ZSTD_getErrorName(compress_len));
+      return errmsg;
+    }
+
+    Dmsg2(400, "ZSTD compressed len=%d uncompressed len=%d\n", compress_len,
+          size);
+
+    return compress_len;
+  }
+
+  ~zstd_compressor() { ZSTD_freeCCtx(cctx); }
+};
+#endif
+
 struct compressors {
 #ifdef HAVE_LIBZ
   std::unique_ptr<gzip_compressor> gzip{nullptr};
@@ -317,6 +443,9 @@ struct compressors {
   std::unique_ptr<z4_compressor> lz_fast{nullptr};
   std::unique_ptr<z4_compressor> lz_default{nullptr};
   std::unique_ptr<z4_compressor> lz_best{nullptr};
+#ifdef HAVE_ZSTD
+  std::unique_ptr<zstd_compressor> zstd{nullptr};
+#endif
 };
 
 template <typename T> struct tls_manager {
@@ -348,7 +477,8 @@ result<std::size_t> ThreadlocalCompress(uint32_t algo,
                                         char const* input,
                                         std::size_t size,
                                         char* output,
-                                        std::size_t capacity)
+                                        std::size_t capacity,
+                                        const CompressionDictionary* dictionary)
 {
   /* NOTE: this is done because thread_local is broken on the crosscompiler.
    * it may free the underlying thread local storage before destroying the
@@ -388,6 +518,15 @@ result<std::size_t> ThreadlocalCompress(uint32_t algo,
             new z4_compressor{Z_BEST_COMPRESSION, COMPRESSOR_LZ4});
       return comps->lz_best->compress(input, size, output, capacity);
     } break;
+#ifdef HAVE_ZSTD
+    case COMPRESS_ZSTD: {
+      if (!comps->zstd) comps->zstd.reset(new zstd_compressor);
+      comps->zstd->set_level(level);
+      return comps->zstd->compress(
+          input, size, output, capacity,
+          dictionary ? dictionary->ForCompression(level) : nullptr);
+    } break;
+#endif
   }
 
   PoolMem errmsg;
@@ -395,6 +534,87 @@ result<std::size_t> ThreadlocalCompress(uint32_t algo,
   return errmsg;
 }
 
+std::shared_ptr<const CompressionDictionary> CompressionDictionary::Load(
+    std::string data)
+{
+#ifdef HAVE_ZSTD
+  std::uint32_t id = ZSTD_getDictID_fromDict(data.data(), data.size());
+  // raw content without the header of a trained dictionary has no id
+  if (id == 0) { return nullptr; }
+
+  std::shared_ptr<CompressionDictionary> dictionary{
+      new CompressionDictionary{std::move(data), id}};
+  dictionary->ddict_ = ZSTD_createDDict(dictionary->data_.data(),
+                                        dictionary->data_.size());
+  if (!dictionary->ddict_) { return nullptr; }
+  return dictionary;
+#else
+  (void)data;
+  return nullptr;
+#endif
+}
+
+CompressionDictionary::~CompressionDictionary()
+{
+#ifdef HAVE_ZSTD
+  for (auto& [level, cdict] : cdicts_) { ZSTD_freeCDict(cdict); }
+  ZSTD_freeDDict(ddict_);
+#endif
+}
+
+ZSTD_CDict* CompressionDictionary::ForCompression(int level) const
+{
+#ifdef HAVE_ZSTD
+  std::unique_lock lock(mutex_);
+  auto& cdict = cdicts_[level];
+  if (!cdict) { cdict = ZSTD_createCDict(data_.data(), data_.size(), level); }
+  return cdict;
+#else
+  (void)level;
+  return nullptr;
+#endif
+}
+
+void CompressionDictionaryTrainer::AddSample(const char* data,
+                                             std::size_t size)
+{
+  size = std::min(size, kMaxSampleSize);
+  if (size == 0) { return; }
+
+  std::unique_lock lock(mutex_);
+  if (samples_.size() + size > 100 * dictionary_size_) { return; }
+  samples_.append(data, size);
+  sample_sizes_.push_back(size);
+}
+
+std::size_t CompressionDictionaryTrainer::samples() const
+{
+  std::unique_lock lock(mutex_);
+  return sample_sizes_.size();
+}
+
+result<std::string> CompressionDictionaryTrainer::Train() const
+{
+#ifdef HAVE_ZSTD
+  std::unique_lock lock(mutex_);
+  std::string dictionary(dictionary_size_, '\0');
+  std::size_t size = ZDICT_trainFromBuffer(
+      dictionary.data(), dictionary.size(), samples_.data(),
+      sample_sizes_.data(), static_cast<unsigned>(sample_sizes_.size()));
+  if (ZDICT_isError(size)) {
+    PoolMem errmsg;
+    Mmsg(errmsg, "Training the dictionary from %llu samples failed: %s",
+         static_cast<unsigned long long>(sample_sizes_.size()),
+         ZDICT_getErrorName(size));
+    return errmsg;
+  }
+  dictionary.resize(size);
+  return dictionary;
+#else
+  return PoolMem{"Compression dictionaries need zstd support"};
+#endif
+}
+
 bool SetupCompressionBuffers(JobControlRecord* jcr,
                              uint32_t compression_algorithm,
                              uint32_t* compress_buf_size)
@@ -524,6 +744,28 @@ bool SetupCompressionBuffers(JobControlRecord* jcr,
       }
       break;
     }
+#ifdef HAVE_ZSTD
+    case COMPRESS_ZSTD: {
+      /* ZSTD_compressBound() gives the worst case size of a single frame,
+       * the compression level is set per file. */
+      wanted_compress_buf_size
+          = ZSTD_compressBound(jcr->buf_size) + (int)sizeof(comp_stream_header);
+      if (wanted_compress_buf_size > *compress_buf_size) {
+        *compress_buf_size = wanted_compress_buf_size;
+      }
+
+      // See if this compression algorithm is already setup.
+      if (jcr->compress.workset.pZSTD) { return true; }
+
+      if (ZSTD_CCtx* cctx = ZSTD_createCCtx(); cctx) {
+        jcr->compress.workset.pZSTD = cctx;
+      } else {
+        Jmsg(jcr, M_FATAL, 0, T_("Failed to initialize ZSTD compression\n"));
+        return false;
+      }
+      break;
+    }
+#endif
     default:
       UnknownCompressionAlgorithm(jcr, compression_algorithm);
       return false;
@@ -668,6 +910,35 @@ static bool compress_with_fastlz(JobControlRecord* jcr,
   return true;
 }
 
+#ifdef HAVE_ZSTD
+static bool compress_with_zstd(JobControlRecord* jcr,
+                               char* rbuf,
+                               uint32_t rsize,
+                               unsigned char* cbuf,
+                               uint32_t max_compress_len,
+                               uint32_t* compress_len)
+{
+  Dmsg3(400, "cbuf=0x%x rbuf=0x%x len=%u\n", cbuf, rbuf, rsize);
+
+  std::size_t zstat
+      = ZSTD_compress2((ZSTD_CCtx*)jcr->compress.workset.pZSTD, cbuf,
+                       max_compress_len, rbuf, rsize);
+  if (ZSTD_isError(zstat)) {
+    Jmsg(jcr, M_FATAL, 0, T_("Compression zstd error: %s\n"),
+         ZSTD_getErrorName(zstat));
+    jcr->setJobStatusWithPriorityCheck(JS_ErrorTerminated);
+    return false;
+  }
+
+  *compress_len = zstat;
+
+  Dmsg2(400, "ZSTD compressed len=%d uncompressed len=%d\n", *compress_len,
+        rsize);
+
+  return true;
+}
+#endif
+
 bool CompressData(JobControlRecord* jcr,
                   uint32_t compression_algorithm,
                   char* rbuf,
@@ -708,6 +979,16 @@ bool CompressData(JobControlRecord* jcr,
         }
       }
       break;
+#ifdef HAVE_ZSTD
+    case COMPRESS_ZSTD:
+      if (jcr->compress.workset.pZSTD) {
+        if (!compress_with_zstd(jcr, rbuf, rsize, cbuf, max_compress_len,
+                                compress_len)) {
+          return false;
+        }
+      }
+      break;
+#endif
     default:
       break;
   }
@@ -957,6 +1238,134 @@ cleanup:
   return false;
 }
 
+#ifdef HAVE_ZSTD
+static bool decompress_with_zstd(JobControlRecord* jcr,
+                                 const char* last_fname,
+                                 char** data,
+                                 uint32_t* length,
+                                 bool sparse,
+                                 bool want_data_stream)
+{
+  char ec1[50]; /* Buffer printing huge values */
+  const char* cbuf = *data + sizeof(comp_stream_header);
+  std::size_t real_compress_len = *length - sizeof(comp_stream_header);
+  uint32_t offset = (sparse && want_data_stream) ? OFFSET_FADDR_SIZE : 0;
+
+  cbuf += offset;
+  real_compress_len -= offset;
+
+  /* Every block is compressed into a single frame which records its
+   * uncompressed size, so we can size the buffer up front. */
+  unsigned long long wanted
+      = ZSTD_getFrameContentSize(cbuf, real_compress_len);
+  if (wanted == ZSTD_CONTENTSIZE_ERROR) {
+    Qmsg(jcr, M_ERROR, 0,
+         T_("ZSTD uncompression error on file %s. ERR=invalid frame\n"),
+         last_fname);
+    return false;
+  }
+  if (wanted != ZSTD_CONTENTSIZE_UNKNOWN
+      && wanted + offset > jcr->compress.inflate_buffer_size) {
+    jcr->compress.inflate_buffer_size = wanted + offset;
+    jcr->compress.inflate_buffer = CheckPoolMemorySize(
+        jcr->compress.inflate_buffer, jcr->compress.inflate_buffer_size);
+  }
+
+  Dmsg2(400, "Comp_len=%d message_length=%d\n", real_compress_len, *length);
+
+  // Frames compressed with a dictionary record its id.
+  ZSTD_DDict* ddict = nullptr;
+  if (unsigned dict_id = ZSTD_getDictID_fromFrame(cbuf, real_compress_len);
+      dict_id != 0) {
+    auto found = jcr->compress.dictionaries.find(dict_id);
+    if (found == jcr->compress.dictionaries.end()) {
+      Qmsg(jcr, M_ERROR, 0,
+           T_("ZSTD uncompression error on file %s. ERR=compression "
+              "dictionary %u is not known\n"),
+           last_fname, dict_id);
+      return false;
+    }
+    ddict = found->second->ForDecompression();
+
+    if (!jcr->compress.workset.pZSTDD) {
+      jcr->compress.workset.pZSTDD = ZSTD_createDCtx();
+      if (!jcr->compress.workset.pZSTDD) {
+        Qmsg(jcr, M_ERROR, 0, T_("Failed to initialize ZSTD decompression\n"));
+        return false;
+      }
+    }
+  }
+
+  auto decompress = [&]() {
+    char* out = jcr->compress.inflate_buffer + offset;
+    std::size_t capacity = jcr->compress.inflate_buffer_size - offset;
+    if (!ddict) {
+      return ZSTD_decompress(out, capacity, cbuf, real_compress_len);
+    }
+    return ZSTD_decompress_usingDDict((ZSTD_DCtx*)jcr->compress.workset.pZSTDD,
+                                      out, capacity, cbuf, real_compress_len,
+                                      ddict);
+  };
+
+  std::size_t zstat;
+  while (ZSTD_isError(zstat = decompress())) {
+    if (ZSTD_getErrorCode(zstat) != ZSTD_error_dstSize_tooSmall) {
+      Qmsg(jcr, M_ERROR, 0, T_("ZSTD uncompression error on file %s. ERR=%s\n"),
+           last_fname, ZSTD_getErrorName(zstat));
+      return false;
+    }
+    // The buffer size is too small, try with a bigger one
+    jcr->compress.inflate_buffer_size
+        = jcr->compress.inflate_buffer_size
+          + (jcr->compress.inflate_buffer_size >> 1);
+    jcr->compress.inflate_buffer = CheckPoolMemorySize(
+        jcr->compress.inflate_buffer, jcr->compress.inflate_buffer_size);
+  }
+
+  /* We return a decompressed data stream with the fileoffset encoded when this
+   * was a sparse stream. */
+  if (sparse && want_data_stream) {
+    memcpy(jcr->compress.inflate_buffer, *data, OFFSET_FADDR_SIZE);
+  }
+
+  *data = jcr->compress.inflate_buffer;
+  *length = zstat;
+
+  Dmsg2(400, "Write uncompressed %d bytes, total before write=%s\n", *length,
+        edit_uint64(jcr->JobBytes, ec1));
+
+  return true;
+}
+#endif
+
+// Blocks that were not worth compressing are stored as is.
+static bool decompress_none(JobControlRecord* jcr,
+                            char** data,
+                            uint32_t* length,
+                            bool sparse,
+                            bool want_data_stream)
+{
+  uint32_t offset = (sparse && want_data_stream) ? OFFSET_FADDR_SIZE : 0;
+  const char* cbuf = *data + offset + sizeof(comp_stream_header);
+  uint32_t size = *length - offset - sizeof(comp_stream_header);
+
+  if (size + offset > jcr->compress.inflate_buffer_size) {
+    jcr->compress.inflate_buffer_size = size + offset;
+    jcr->compress.inflate_buffer = CheckPoolMemorySize(
+        jcr->compress.inflate_buffer, jcr->compress.inflate_buffer_size);
+  }
+
+  memcpy(jcr->compress.inflate_buffer + offset, cbuf, size);
+  if (offset) { memcpy(jcr->compress.inflate_buffer, *data, offset); }
+
+  *data = jcr->compress.inflate_buffer;
+  *length = size;
+
+  Dmsg1(400, "Write uncompressible %d bytes\n", *length);
+
+  return true;
+}
+
 bool DecompressData(JobControlRecord* jcr,
                     const char* last_fname,
                     int32_t stream,
@@ -1041,6 +1450,21 @@ bool DecompressData(JobControlRecord* jcr,
                                             comp_magic, false,
                                             want_data_stream);
           }
+        case COMPRESS_NONE:
+          return decompress_none(jcr, data, length,
+                                 stream == STREAM_SPARSE_COMPRESSED_DATA,
+                                 want_data_stream);
+#ifdef HAVE_ZSTD
+        case COMPRESS_ZSTD:
+          switch (stream) {
+            case STREAM_SPARSE_COMPRESSED_DATA:
+              return decompress_with_zstd(jcr, last_fname, data, length, true,
+                                          want_data_stream);
+            default:
+              return decompress_with_zstd(jcr, last_fname, data, length, false,
+                                          want_data_stream);
+          }
+#endif
         default:
           Qmsg(jcr, M_ERROR, 0,
                T_("Compression algorithm 0x%x found, but not supported!\n"),
@@ -1100,4 +1524,18 @@ void CleanupCompression(JobControlRecord* jcr)
     free(jcr->compress.workset.pZFAST);
     jcr->compress.workset.pZFAST = NULL;
   }
+
+#ifdef HAVE_ZSTD
+  if (jcr->compress.workset.pZSTD) {
+    ZSTD_freeCCtx((ZSTD_CCtx*)jcr->compress.workset.pZSTD);
+    jcr->compress.workset.pZSTD = NULL;
+  }
+  if (jcr->compress.workset.pZSTDD) {
+    ZSTD_freeDCtx((ZSTD_DCtx*)jcr->compress.workset.pZSTDD);
+    jcr->compress.workset.pZSTDD = NULL;
+  }
+#endif
+
+  jcr->compress.dictionary.reset();
+  jcr->compress.dictionaries.clear();
 }
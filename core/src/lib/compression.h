@@ -23,6 +23,16 @@
 
 #include "lib/util.h"
 
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct ZSTD_CDict_s;
+struct ZSTD_DDict_s;
+
 const char* cmprs_algo_to_text(uint32_t compression_algorithm);
 
 bool SetupCompressionBuffers(JobControlRecord* jcr,
@@ -31,19 +41,110 @@ bool SetupCompressionBuffers(JobControlRecord* jcr,
 bool SetupDecompressionBuffers(JobControlRecord* jcr,
                                uint32_t* decompress_buf_size);
 
+/* A zstd dictionary trained from samples of the data.  Small blocks compress
+ * much better with one, as the compressor does not start from an empty
+ * state.  Every frame compressed with it records the id of the dictionary and
+ * cannot be decompressed without it. */
+class CompressionDictionary {
+ public:
+  // nullptr if the data is no zstd dictionary
+  static std::shared_ptr<const CompressionDictionary> Load(std::string data);
+  ~CompressionDictionary();
+  CompressionDictionary(const CompressionDictionary&) = delete;
+  CompressionDictionary& operator=(const CompressionDictionary&) = delete;
+
+  std::uint32_t id() const { return id_; }
+  const std::string& data() const { return data_; }
+
+  // digested for the compression level, made on first use
+  ZSTD_CDict_s* ForCompression(int level) const;
+  ZSTD_DDict_s* ForDecompression() const { return ddict_; }
+
+ private:
+  CompressionDictionary(std::string data, std::uint32_t id)
+      : data_{std::move(data)}, id_{id}
+  {
+  }
+
+  std::string data_;
+  std::uint32_t id_;
+  ZSTD_DDict_s* ddict_{nullptr};
+  mutable std::mutex mutex_{};
+  mutable std::map<int, ZSTD_CDict_s*> cdicts_{};
+};
+
+/* Collects samples of the data, e.g. the content of small files, and trains
+ * a dictionary from them.  Once a hundred times the size of the dictionary
+ * was collected further samples are ignored.  Can be used by several threads
+ * at once. */
+class CompressionDictionaryTrainer {
+ public:
+  explicit CompressionDictionaryTrainer(std::size_t dictionary_size)
+      : dictionary_size_{dictionary_size}
+  {
+  }
+
+  void AddSample(const char* data, std::size_t size);
+  std::size_t samples() const;
+  result<std::string> Train() const;
+
+ private:
+  static constexpr std::size_t kMaxSampleSize = 128 * 1024;
+
+  std::size_t dictionary_size_;
+  mutable std::mutex mutex_{};
+  std::string samples_{};
+  std::vector<std::size_t> sample_sizes_{};
+};
+
 
 // return the number of bytes written to the output on success
-// or std::nullopt on error
+// or std::nullopt on error; only zstd makes use of the dictionary
 result<std::size_t> ThreadlocalCompress(uint32_t algo,
                                         uint32_t level,
                                         char const* input,
                                         std::size_t size,
                                         char* output,
-                                        std::size_t capacity);
+                                        std::size_t capacity,
+                                        const CompressionDictionary* dictionary
+                                        = nullptr);
 
 std::size_t RequiredCompressionOutputBufferSize(uint32_t algo,
                                                 std::size_t max_input_size);
 
+/* Cheap estimate (based on the byte entropy of a few samples) whether
+ * compressing data is a waste of time, e.g. because it is already compressed
+ * or encrypted. */
+bool LooksIncompressible(const char* data, std::size_t size);
+
+/* Decides per block of a file whether it should be stored without
+ * compression (as COMPRESS_NONE).  Besides sampling every block it learns
+ * from the real compression results: once a couple of blocks in a row did
+ * not get any smaller, only every kProbeInterval-th block of the file is
+ * compressed to find out whether the content changed.  Can be used by
+ * several threads at once. */
+class CompressionBypass {
+ public:
+  bool Skip(const char* data, std::size_t size);
+  void Learn(std::size_t uncompressed_size, std::size_t compressed_size);
+
+ private:
+  static constexpr std::uint32_t kUselessThreshold = 4;
+  static constexpr std::uint32_t kProbeInterval = 16;
+
+  std::atomic<std::uint32_t> useless_in_a_row_{0};
+  std::atomic<std::uint32_t> skipped_{0};
+};
+
+/* true if the compressed block is not worth storing instead of the
+ * original; saving less than 2 percent does not pay for the decompression
+ * on restore. */
+constexpr bool CompressionWasUseless(std::size_t uncompressed_size,
+                                     std::size_t compressed_size)
+{
+  return compressed_size >= uncompressed_size - uncompressed_size / 50;
+}
+
 bool CompressData(JobControlRecord* jcr,
                   uint32_t compression_algorithm,
                   char* rbuf,
@@ -142,6 +142,8 @@ const char* crypto_digest_name(crypto_digest_t type)
       return "SHA512";
     case CRYPTO_DIGEST_XXH128:
       return "XXH128";
+    case CRYPTO_DIGEST_XXH3_TREE:
+      return "XXH3TREE";
     case CRYPTO_DIGEST_NONE:
       return "None";
     default:
@@ -166,6 +168,8 @@ crypto_digest_t CryptoDigestStreamType(int stream)
       return CRYPTO_DIGEST_SHA512;
     case STREAM_XXH128_DIGEST:
       return CRYPTO_DIGEST_XXH128;
+    case STREAM_XXH3_TREE_DIGEST:
+      return CRYPTO_DIGEST_XXH3_TREE;
     default:
       return CRYPTO_DIGEST_NONE;
   }
@@ -209,6 +213,7 @@ DIGEST* crypto_digest_new(JobControlRecord* jcr, crypto_digest_t type)
     case CRYPTO_DIGEST_SHA512:
       return OpensslDigestNew(jcr, type);
     case CRYPTO_DIGEST_XXH128:
+    case CRYPTO_DIGEST_XXH3_TREE:
       return XxhashDigestNew(jcr, type);
     case CRYPTO_DIGEST_NONE:
       Jmsg1(jcr, M_ERROR, 0, T_("Unsupported digest type: %d\n"), type);
@@ -70,7 +70,8 @@ typedef enum
   CRYPTO_DIGEST_SHA1 = 2,
   CRYPTO_DIGEST_SHA256 = 3,
   CRYPTO_DIGEST_SHA512 = 4,
-  CRYPTO_DIGEST_XXH128 = 5
+  CRYPTO_DIGEST_XXH128 = 5,
+  CRYPTO_DIGEST_XXH3_TREE = 6
 } crypto_digest_t;
 
 /* Cipher Types */
@@ -87,7 +88,8 @@ typedef enum
   CRYPTO_CIPHER_CAMELLIA_192_CBC = 7,
   CRYPTO_CIPHER_CAMELLIA_256_CBC = 8,
   CRYPTO_CIPHER_AES_128_CBC_HMAC_SHA1 = 9,
-  CRYPTO_CIPHER_AES_256_CBC_HMAC_SHA1 = 10
+  CRYPTO_CIPHER_AES_256_CBC_HMAC_SHA1 = 10,
+  CRYPTO_CIPHER_AES_256_GCM = 11
 } crypto_cipher_t;
 
 /* Crypto API Errors */
@@ -109,6 +111,7 @@ typedef enum
 #define CRYPTO_DIGEST_SHA256_SIZE 32 /* 256 bits */
 #define CRYPTO_DIGEST_SHA512_SIZE 64 /* 512 bits */
 #define CRYPTO_DIGEST_XXH128_SIZE 16 /* 128 bits */
+#define CRYPTO_DIGEST_XXH3_TREE_SIZE 16 /* 128 bits */
 
 /* Maximum Message Digest Size */
 #ifdef HAVE_OPENSSL
@@ -136,6 +139,15 @@ typedef enum
 
 #endif /* HAVE_OPENSSL */
 
+/* AEAD ciphers seal every block on its own instead of chaining all blocks of
+ * a file.  A sealed block starts with the length of the plain data (4 bytes)
+ * and the number of the block within the session (8 bytes), both in network
+ * byte order, followed by the encrypted data and the authentication tag. */
+#define CRYPTO_SEALED_HEADER_SIZE 12
+#define CRYPTO_SEALED_TAG_SIZE 16
+#define CRYPTO_SEALED_OVERHEAD \
+  (CRYPTO_SEALED_HEADER_SIZE + CRYPTO_SEALED_TAG_SIZE)
+
 class DigestInitException : public std::exception {};
 
 struct Digest {
@@ -205,6 +217,16 @@ bool CryptoCipherFinalize(CIPHER_CONTEXT* cipher_ctx,
                           uint8_t* dest,
                           uint32_t* written);
 void CryptoCipherFree(CIPHER_CONTEXT* cipher_ctx);
+bool CryptoCipherSealsBlocks(CIPHER_CONTEXT* cipher_ctx);
+bool CryptoCipherSealBlock(CIPHER_CONTEXT* cipher_ctx,
+                           const uint8_t* data,
+                           uint32_t length,
+                           uint8_t* dest,
+                           uint32_t* written);
+bool CryptoCipherOpenBlock(CIPHER_CONTEXT* cipher_ctx,
+                           uint8_t* block,
+                           uint32_t length,
+                           uint32_t* written);
 X509_KEYPAIR* crypto_keypair_new(void);
 X509_KEYPAIR* crypto_keypair_dup(X509_KEYPAIR* keypair);
 int CryptoKeypairLoadCert(X509_KEYPAIR* keypair, const char* file);
@@ -32,24 +32,252 @@
 #include "include/bareos.h"
 #include "crypto_cache.h"
 #include "lib/berrno.h"
-#include "lib/dlist.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if defined(HAVE_POSIX_FALLOCATE) && !defined(HAVE_WIN32)
+#  include <sys/mman.h>
+#  define HAVE_MAPPED_CRYPTO_CACHE 1
+#endif
+
+namespace {
+
+// Version 1 of the file stored the list links of an entry with it.
+struct legacy_crypto_cache_entry_t {
+  void* next;
+  void* prev;
+  char VolumeName[MAX_NAME_LENGTH];
+  char EncryptionKey[MAX_NAME_LENGTH];
+  utime_t added;
+};
+
+struct crypto_cache {
+  crypto_cache_entry_t* slots{nullptr};
+  std::size_t nr_slots{0};
+  std::unordered_map<std::string, std::size_t> index{};
+  std::vector<std::size_t> free_slots{};
+
+  // The slots when the cache is not mapped.
+  std::vector<crypto_cache_entry_t> heap_slots{};
+
+  // The mapped cache file, if any.
+  std::string file{};
+  int fd{-1};
+  char* map{nullptr};
+  std::size_t map_size{0};
+};
+
+}  // namespace
 
 static pthread_mutex_t crypto_cache_lock = PTHREAD_MUTEX_INITIALIZER;
-static dlist<crypto_cache_entry_t>* cached_crypto_keys = NULL;
+static crypto_cache* cached_crypto_keys = NULL;
+
+static s_crypto_cache_hdr crypto_cache_hdr = {"BAREOS Crypto Cache\n", 2, 0};
+static constexpr int32_t legacy_crypto_cache_version = 1;
+
+static std::size_t CryptoCacheFileSize(std::size_t nr_slots)
+{
+  return sizeof(s_crypto_cache_hdr) + nr_slots * sizeof(crypto_cache_entry_t);
+}
+
+// Rebuild the index and the list of free slots from the slots.
+static void IndexCryptoCache(crypto_cache* cache)
+{
+  cache->index.clear();
+  cache->free_slots.clear();
+  for (std::size_t i = cache->nr_slots; i-- > 0;) {
+    crypto_cache_entry_t* cce = &cache->slots[i];
+    cce->VolumeName[sizeof(cce->VolumeName) - 1] = '\0';
+    cce->EncryptionKey[sizeof(cce->EncryptionKey) - 1] = '\0';
+    if (!*cce->VolumeName || !cache->index.emplace(cce->VolumeName, i).second) {
+      memset(cce, 0, sizeof(crypto_cache_entry_t));
+      cache->free_slots.push_back(i);
+    }
+  }
+}
+
+static void UnmapCryptoCache(crypto_cache* cache)
+{
+#if defined(HAVE_MAPPED_CRYPTO_CACHE)
+  if (cache->map) { munmap(cache->map, cache->map_size); }
+  if (cache->fd >= 0) { close(cache->fd); }
+#endif
+  cache->map = nullptr;
+  cache->map_size = 0;
+  cache->fd = -1;
+  cache->file.clear();
+}
+
+/* Map the cache file open on fd, its header says how many slots follow.
+ * The cache owns fd on success. */
+static bool MapCryptoCache(crypto_cache* cache, int fd, const char* cache_file)
+{
+#if defined(HAVE_MAPPED_CRYPTO_CACHE)
+  struct stat st;
+  s_crypto_cache_hdr hdr;
+  if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) || hdr.nr_entries < 0
+      || fstat(fd, &st) != 0
+      || static_cast<std::size_t>(st.st_size)
+             < CryptoCacheFileSize(hdr.nr_entries)) {
+    return false;
+  }
+
+  std::size_t size = CryptoCacheFileSize(hdr.nr_entries);
+  void* map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    BErrNo be;
+
+    Dmsg2(010, "Could not map crypto cache file %s ERR=%s\n", cache_file,
+          be.bstrerror());
+    return false;
+  }
+
+  UnmapCryptoCache(cache);
+  cache->heap_slots.clear();
+  cache->heap_slots.shrink_to_fit();
+  cache->file = cache_file;
+  cache->fd = fd;
+  cache->map = static_cast<char*>(map);
+  cache->map_size = size;
+  cache->slots = reinterpret_cast<crypto_cache_entry_t*>(
+      cache->map + sizeof(s_crypto_cache_hdr));
+  cache->nr_slots = hdr.nr_entries;
+  IndexCryptoCache(cache);
+  return true;
+#else
+  (void)cache;
+  (void)fd;
+  (void)cache_file;
+  return false;
+#endif
+}
+
+// Grow the table, returns false if a mapped cache file cannot grow.
+static bool GrowCryptoCache(crypto_cache* cache)
+{
+  std::size_t nr_slots = std::max<std::size_t>(16, 2 * cache->nr_slots);
+
+#if defined(HAVE_MAPPED_CRYPTO_CACHE)
+  if (cache->map) {
+    std::size_t size = CryptoCacheFileSize(nr_slots);
+    void* map = MAP_FAILED;
+    if (posix_fallocate(cache->fd, 0, size) == 0) {
+      map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, cache->fd,
+                 0);
+    }
+    if (map == MAP_FAILED) {
+      BErrNo be;
+
+      Emsg2(M_ERROR, 0, T_("Could not grow crypto cache file %s ERR=%s\n"),
+            cache->file.c_str(), be.bstrerror());
+      return false;
+    }
+    munmap(cache->map, cache->map_size);
+    cache->map = static_cast<char*>(map);
+    cache->map_size = size;
+    cache->slots = reinterpret_cast<crypto_cache_entry_t*>(
+        cache->map + sizeof(s_crypto_cache_hdr));
+    reinterpret_cast<s_crypto_cache_hdr*>(cache->map)->nr_entries = nr_slots;
+  } else
+#endif
+  {
+    cache->heap_slots.resize(nr_slots, crypto_cache_entry_t{});
+    cache->slots = cache->heap_slots.data();
+  }
+
+  for (std::size_t i = nr_slots; i-- > cache->nr_slots;) {
+    cache->free_slots.push_back(i);
+  }
+  cache->nr_slots = nr_slots;
+  return true;
+}
+
+// Remove an entry, overwriting its key.
+static void RemoveCryptoCacheEntry(crypto_cache* cache, std::size_t slot)
+{
+  crypto_cache_entry_t* cce = &cache->slots[slot];
+  cache->index.erase(cce->VolumeName);
+  memset(cce, 0, sizeof(crypto_cache_entry_t));
+  cache->free_slots.push_back(slot);
+}
+
+static void DestroyCryptoCache()
+{
+  if (!cached_crypto_keys) { return; }
+
+  UnmapCryptoCache(cached_crypto_keys);
+  delete cached_crypto_keys;
+  cached_crypto_keys = NULL;
+}
+
+// Read the content of a version 1 crypto cache file into memory.
+static bool ReadLegacyCryptoCache(int fd,
+                                  const s_crypto_cache_hdr& hdr,
+                                  const char* cache_file)
+{
+  int cnt = 0;
+  legacy_crypto_cache_entry_t legacy;
+  crypto_cache* cache = cached_crypto_keys;
+
+  while (read(fd, &legacy, sizeof(legacy)) == sizeof(legacy)) {
+    cnt++;
+    if (cache->free_slots.empty()) { GrowCryptoCache(cache); }
+    crypto_cache_entry_t* cce = &cache->slots[cache->free_slots.back()];
+    cache->free_slots.pop_back();
+    memcpy(cce->VolumeName, legacy.VolumeName, sizeof(cce->VolumeName));
+    memcpy(cce->EncryptionKey, legacy.EncryptionKey,
+           sizeof(cce->EncryptionKey));
+    cce->added = legacy.added;
+  }
+  IndexCryptoCache(cache);
 
-static s_crypto_cache_hdr crypto_cache_hdr = {"BAREOS Crypto Cache\n", 1, 0};
+  // Check if we read the number of entries the header said are in the file.
+  if (cnt != hdr.nr_entries) {
+    Dmsg3(
+        000,
+        "Crypto cache read %d entries while %d entries should be in file %s\n",
+        cnt, hdr.nr_entries, cache_file);
+    return false;
+  }
+  return true;
+}
 
-// Read the content of the crypto cache from the filesystem.
-void ReadCryptoCache(const char* cache_file)
+// Read the slots following the header into memory.
+static bool ReadCryptoCacheSlots(int fd, const s_crypto_cache_hdr& hdr)
 {
-  int fd, cnt;
+  crypto_cache* cache = cached_crypto_keys;
+
+  if (hdr.nr_entries < 0) { return false; }
+  cache->heap_slots.resize(hdr.nr_entries, crypto_cache_entry_t{});
+  std::size_t size = hdr.nr_entries * sizeof(crypto_cache_entry_t);
+  if (size > 0
+      && read(fd, cache->heap_slots.data(), size)
+             != static_cast<ssize_t>(size)) {
+    return false;
+  }
+  cache->slots = cache->heap_slots.data();
+  cache->nr_slots = hdr.nr_entries;
+  IndexCryptoCache(cache);
+  return true;
+}
+
+/* Read the content of the crypto cache from the filesystem.  Unless
+ * read_only is set the cache maps the file so updates go right into it,
+ * and a file that cannot be read gets removed. */
+void ReadCryptoCache(const char* cache_file, bool read_only)
+{
+  int fd;
   ssize_t status;
   bool ok = false;
   s_crypto_cache_hdr hdr;
   int hdr_size = sizeof(hdr);
-  crypto_cache_entry_t* cce = NULL;
 
-  if ((fd = open(cache_file, O_RDONLY | O_BINARY)) < 0) {
+  lock_mutex(crypto_cache_lock);
+
+  if ((fd = open(cache_file, (read_only ? O_RDONLY : O_RDWR) | O_BINARY))
+      < 0) {
     BErrNo be;
 
     Dmsg2(010, "Could not open crypto cache file. %s ERR=%s\n", cache_file,
@@ -66,7 +294,8 @@ void ReadCryptoCache(const char* cache_file)
     goto bail_out;
   }
 
-  if (hdr.version != crypto_cache_hdr.version) {
+  if (hdr.version != crypto_cache_hdr.version
+      && hdr.version != legacy_crypto_cache_version) {
     Dmsg2(010, "Crypto cache bad hdr version. Wanted %d got %d\n",
           crypto_cache_hdr.version, hdr.version);
     goto bail_out;
@@ -78,72 +307,78 @@ void ReadCryptoCache(const char* cache_file)
     goto bail_out;
   }
 
-  if (!cached_crypto_keys) {
-    cached_crypto_keys = new dlist<crypto_cache_entry_t>();
-  }
+  DestroyCryptoCache();
+  cached_crypto_keys = new crypto_cache;
 
-  // Read as many crypto cache entries as available.
-  cnt = 0;
-  cce = (crypto_cache_entry_t*)malloc(sizeof(crypto_cache_entry_t));
-  while (read(fd, cce, sizeof(crypto_cache_entry_t))
-         == sizeof(crypto_cache_entry_t)) {
-    cnt++;
-    cached_crypto_keys->append(cce);
-    cce = (crypto_cache_entry_t*)malloc(sizeof(crypto_cache_entry_t));
+  if (hdr.version == legacy_crypto_cache_version) {
+    // Gets converted with the next write of the cache.
+    ok = ReadLegacyCryptoCache(fd, hdr, cache_file);
+  } else if (!read_only
+             && MapCryptoCache(cached_crypto_keys, fd, cache_file)) {
+    fd = -1;
+    ok = true;
+  } else {
+    ok = ReadCryptoCacheSlots(fd, hdr);
   }
 
-  /* We always allocate a dangling crypto_cache_entry_t structure in
-   * the way that we malloc before the loop and in the loop. So drop
-   * the last unused entry. */
-  free(cce);
-
-  // Check if we read the number of entries the header said are in the file.
-  if (cnt == hdr.nr_entries) {
-    ok = true;
-    Dmsg2(010, "Crypto cache read %d entries in file %s\n", cnt, cache_file);
+  if (ok) {
+    Dmsg2(010, "Crypto cache read %d entries in file %s\n",
+          (int)cached_crypto_keys->index.size(), cache_file);
   } else {
-    Dmsg3(
-        000,
-        "Crypto cache read %d entries while %d entries should be in file %s\n",
-        cnt, hdr.nr_entries, cache_file);
+    Dmsg1(000, "Crypto cache file %s is truncated.\n", cache_file);
   }
 
 bail_out:
   if (fd >= 0) { close(fd); }
 
   if (!ok) {
-    SecureErase(NULL, cache_file);
-    if (cached_crypto_keys) {
-      cached_crypto_keys->destroy();
-      delete cached_crypto_keys;
-      cached_crypto_keys = NULL;
-    }
+    DestroyCryptoCache();
+    if (!read_only) { SecureErase(NULL, cache_file); }
   }
+
+  unlock_mutex(crypto_cache_lock);
 }
 
-void ReadCryptoCache(const char* dir, const char* progname, int port)
+void ReadCryptoCache(const char* dir,
+                     const char* progname,
+                     int port,
+                     bool read_only)
 {
   POOLMEM* fname = GetPoolMemory(PM_FNAME);
 
   Mmsg(fname, "%s/%s.%d.cryptoc", dir, progname, port);
-  ReadCryptoCache(fname);
+  ReadCryptoCache(fname, read_only);
   FreePoolMemory(fname);
 }
 
-// Write the content of the crypto cache to the filesystem.
+/*
+ * Write the content of the crypto cache to the filesystem. A cache mapped
+ * from this file already is in it, so only the writeback gets started.
+ * Otherwise the file is written and mapped for the following updates.
+ */
 void WriteCryptoCache(const char* cache_file)
 {
   int fd;
   bool ok = false;
-  crypto_cache_entry_t* cce;
+  crypto_cache* cache;
+  s_crypto_cache_hdr hdr = crypto_cache_hdr;
 
   if (!cached_crypto_keys) { return; }
 
   // Lock the cache.
   lock_mutex(crypto_cache_lock);
 
+  cache = cached_crypto_keys;
+#if defined(HAVE_MAPPED_CRYPTO_CACHE)
+  if (cache->map && cache->file == cache_file) {
+    msync(cache->map, cache->map_size, MS_ASYNC);
+    unlock_mutex(crypto_cache_lock);
+    return;
+  }
+#endif
+
   SecureErase(NULL, cache_file);
-  if ((fd = open(cache_file, O_CREAT | O_WRONLY | O_BINARY, 0640)) < 0) {
+  if ((fd = open(cache_file, O_CREAT | O_RDWR | O_BINARY, 0640)) < 0) {
     BErrNo be;
 
     Emsg2(M_ERROR, 0, T_("Could not create crypto cache file. %s ERR=%s\n"),
@@ -151,17 +386,16 @@ void WriteCryptoCache(const char* cache_file)
     goto bail_out;
   }
 
-  crypto_cache_hdr.nr_entries = cached_crypto_keys->size();
-  if (write(fd, &crypto_cache_hdr, sizeof(crypto_cache_hdr))
-      != sizeof(crypto_cache_hdr)) {
+  hdr.nr_entries = cache->nr_slots;
+  if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
     BErrNo be;
 
     Dmsg1(000, "Write hdr error: ERR=%s\n", be.bstrerror());
     goto bail_out;
   }
 
-  foreach_dlist (cce, cached_crypto_keys) {
-    if (write(fd, cce, sizeof(crypto_cache_entry_t))
+  for (std::size_t i = 0; i < cache->nr_slots; i++) {
+    if (write(fd, &cache->slots[i], sizeof(crypto_cache_entry_t))
         != sizeof(crypto_cache_entry_t)) {
       BErrNo be;
 
@@ -172,6 +406,9 @@ void WriteCryptoCache(const char* cache_file)
 
   ok = true;
 
+  // A failed mapping keeps the cache in memory.
+  if (MapCryptoCache(cache, fd, cache_file)) { fd = -1; }
+
 bail_out:
   if (fd >= 0) { close(fd); }
 
@@ -192,70 +429,60 @@ void WriteCryptoCache(const char* dir, const char* progname, int port)
 /*
  * Update the internal cache with new data. When the cache gets
  * modified by a new entry or by expiring old data the return
- * value gives an indication of that.
+ * value gives an indication of that. Finding the entry uses the index,
+ * but the expiry scans every slot on each update; only the slots that
+ * change are written.
  * Returns: true - cache was updated with new data.
  *          false - cache was not updated with new data.
  */
 bool UpdateCryptoCache(const char* VolumeName, const char* EncryptionKey)
 {
   time_t now;
-  bool found;
   bool retval = false;
-  crypto_cache_entry_t* cce = NULL;
-  crypto_cache_entry_t* next_cce;
+  crypto_cache* cache;
+  crypto_cache_entry_t* cce;
 
   // Lock the cache.
   lock_mutex(crypto_cache_lock);
 
   // See if there are any cached encryption keys.
-  if (!cached_crypto_keys) {
-    cached_crypto_keys = new dlist<crypto_cache_entry_t>();
+  if (!cached_crypto_keys) { cached_crypto_keys = new crypto_cache; }
+  cache = cached_crypto_keys;
 
-    cce = (crypto_cache_entry_t*)malloc(sizeof(crypto_cache_entry_t));
-    bstrncpy(cce->VolumeName, VolumeName, sizeof(cce->VolumeName));
-    bstrncpy(cce->EncryptionKey, EncryptionKey, sizeof(cce->EncryptionKey));
-    cce->added = time(NULL);
-    cached_crypto_keys->append(cce);
-    retval = true;
-  } else {
-    found = false;
-    now = time(NULL);
-    cce = (crypto_cache_entry_t*)cached_crypto_keys->first();
-    while (cce) {
-      next_cce = (crypto_cache_entry_t*)cached_crypto_keys->next(cce);
-      if (bstrcmp(cce->VolumeName, VolumeName)) {
-        found = true;
-
-        // If the key changed update the cached entry.
-        if (!bstrcmp(cce->EncryptionKey, EncryptionKey)) {
-          bstrncpy(cce->EncryptionKey, EncryptionKey,
-                   sizeof(cce->EncryptionKey));
-          retval = true;
-        }
-
-        cce->added = time(NULL);
-        cce = next_cce;
-        continue;
-      }
-
-      /* Validate the entry.
-       * Any entry older the CRYPTO_CACHE_MAX_AGE seconds is removed. */
-      if ((cce->added + CRYPTO_CACHE_MAX_AGE) < now) {
-        cached_crypto_keys->remove(cce);
-        retval = true;
-      }
-      cce = next_cce;
+  /* Validate the entries.
+   * Any entry older the CRYPTO_CACHE_MAX_AGE seconds is removed. */
+  now = time(NULL);
+  for (std::size_t i = 0; i < cache->nr_slots; i++) {
+    cce = &cache->slots[i];
+    if (*cce->VolumeName && !bstrcmp(cce->VolumeName, VolumeName)
+        && (cce->added + CRYPTO_CACHE_MAX_AGE) < now) {
+      RemoveCryptoCacheEntry(cache, i);
+      retval = true;
     }
+  }
 
-    // New entry.
-    if (!found) {
-      cce = (crypto_cache_entry_t*)malloc(sizeof(crypto_cache_entry_t));
-      bstrncpy(cce->VolumeName, VolumeName, sizeof(cce->VolumeName));
+  if (auto found = cache->index.find(VolumeName);
+      found != cache->index.end()) {
+    cce = &cache->slots[found->second];
+
+    // If the key changed update the cached entry.
+    if (!bstrcmp(cce->EncryptionKey, EncryptionKey)) {
+      memset(cce->EncryptionKey, 0, sizeof(cce->EncryptionKey));
       bstrncpy(cce->EncryptionKey, EncryptionKey, sizeof(cce->EncryptionKey));
-      cce->added = time(NULL);
-      cached_crypto_keys->append(cce);
       retval = true;
     }
+
+    cce->added = now;
+  } else if (!cache->free_slots.empty() || GrowCryptoCache(cache)) {
+    // New entry.
+    std::size_t slot = cache->free_slots.back();
+    cache->free_slots.pop_back();
+    cce = &cache->slots[slot];
+    bstrncpy(cce->VolumeName, VolumeName, sizeof(cce->VolumeName));
+    bstrncpy(cce->EncryptionKey, EncryptionKey, sizeof(cce->EncryptionKey));
+    cce->added = now;
+    cache->index.emplace(cce->VolumeName, slot);
+    retval = true;
   }
 
   unlock_mutex(crypto_cache_lock);
@@ -268,22 +495,20 @@ bool UpdateCryptoCache(const char* VolumeName, const char* EncryptionKey)
  */
 char* lookup_crypto_cache_entry(const char* VolumeName)
 {
-  crypto_cache_entry_t* cce;
+  char* key = NULL;
 
   if (!cached_crypto_keys) { return NULL; }
 
   // Lock the cache.
   lock_mutex(crypto_cache_lock);
 
-  foreach_dlist (cce, cached_crypto_keys) {
-    if (bstrcmp(cce->VolumeName, VolumeName)) {
-      unlock_mutex(crypto_cache_lock);
-      return strdup(cce->EncryptionKey);
-    }
+  if (auto found = cached_crypto_keys->index.find(VolumeName);
+      found != cached_crypto_keys->index.end()) {
+    key = strdup(cached_crypto_keys->slots[found->second].EncryptionKey);
   }
 
   unlock_mutex(crypto_cache_lock);
-  return NULL;
+  return key;
 }
 
 // Dump the content of the crypto cache to a filedescriptor.
@@ -300,10 +525,13 @@ void DumpCryptoCache(int fd)
   // Lock the cache.
   lock_mutex(crypto_cache_lock);
 
+  crypto_cache* cache = cached_crypto_keys;
+
   // See how long the biggest volumename and key are.
   max_vol_length = strlen(T_("Volumename"));
   max_key_length = strlen(T_("EncryptionKey"));
-  foreach_dlist (cce, cached_crypto_keys) {
+  for (std::size_t i = 0; i < cache->nr_slots; i++) {
+    cce = &cache->slots[i];
     if (strlen(cce->VolumeName) > max_vol_length) {
       max_vol_length = strlen(cce->VolumeName);
     }
@@ -320,7 +548,10 @@ void DumpCryptoCache(int fd)
     BErrNo be;
     Dmsg1(000, "write error: ERR=%s\n", be.bstrerror());
   }
-  foreach_dlist (cce, cached_crypto_keys) {
+  for (std::size_t i = 0; i < cache->nr_slots; i++) {
+    cce = &cache->slots[i];
+    if (!*cce->VolumeName) { continue; }
+
     bstrutime(dt1, sizeof(dt1), cce->added);
     bstrutime(dt2, sizeof(dt2), cce->added + CRYPTO_CACHE_MAX_AGE);
     len = Mmsg(msg, "%-*s %-*s %-20s %-20s\n", max_vol_length, cce->VolumeName,
@@ -339,7 +570,6 @@ void DumpCryptoCache(int fd)
 void ResetCryptoCache(void)
 {
   time_t now;
-  crypto_cache_entry_t* cce;
 
   if (!cached_crypto_keys) { return; }
 
@@ -348,7 +578,10 @@ void ResetCryptoCache(void)
   // Lock the cache.
   lock_mutex(crypto_cache_lock);
 
-  foreach_dlist (cce, cached_crypto_keys) { cce->added = now; }
+  for (std::size_t i = 0; i < cached_crypto_keys->nr_slots; i++) {
+    crypto_cache_entry_t* cce = &cached_crypto_keys->slots[i];
+    if (*cce->VolumeName) { cce->added = now; }
+  }
 
   unlock_mutex(crypto_cache_lock);
 }
@@ -361,9 +594,7 @@ void FlushCryptoCache(void)
   // Lock the cache.
   lock_mutex(crypto_cache_lock);
 
-  cached_crypto_keys->destroy();
-  delete cached_crypto_keys;
-  cached_crypto_keys = NULL;
+  DestroyCryptoCache();
 
   unlock_mutex(crypto_cache_lock);
 }
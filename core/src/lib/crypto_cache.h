@@ -2,7 +2,7 @@
    BAREOS® - Backup Archiving REcovery Open Sourced
 
    Copyright (C) 2011-2012 Planets Communications B.V.
-   Copyright (C) 2013-2021 Bareos GmbH & Co. KG
+   Copyright (C) 2013-2024 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -28,25 +28,30 @@
 #ifndef BAREOS_LIB_CRYPTO_CACHE_H_
 #define BAREOS_LIB_CRYPTO_CACHE_H_
 
-#include "lib/dlink.h"
-
 #define CRYPTO_CACHE_MAX_AGE 60 * 60 * 24 * 60 /* 60 Days */
 
 struct s_crypto_cache_hdr {
   char id[21];
   int32_t version;
-  int32_t nr_entries;
+  int32_t nr_entries; /* Number of slots in the table following the header */
 };
 
+/* The cache is a table of fixed size slots, free slots have an empty
+ * VolumeName. Once the cache was read from or written to a file the table
+ * is a shared mapping of that file, so updates of single entries go right
+ * into it instead of rewriting the whole file. A cache read with read_only
+ * set stays in memory and leaves the file alone. */
 struct crypto_cache_entry_t {
-  dlink<crypto_cache_entry_t> link;
   char VolumeName[MAX_NAME_LENGTH];
   char EncryptionKey[MAX_NAME_LENGTH];
   utime_t added;
 };
 
-void ReadCryptoCache(const char* dir, const char* progname, int port);
-void ReadCryptoCache(const char* cache_file);
+void ReadCryptoCache(const char* dir,
+                     const char* progname,
+                     int port,
+                     bool read_only = false);
+void ReadCryptoCache(const char* cache_file, bool read_only = false);
 void WriteCryptoCache(const char* dir, const char* progname, int port);
 void WriteCryptoCache(const char* cache_file);
 bool UpdateCryptoCache(const char* VolumeName, const char* EncryptionKey);
@@ -46,8 +46,11 @@
 #    include <openssl/asn1.h>
 #    include <openssl/asn1t.h>
 #    include <openssl/evp.h>
+#    include <atomic>
 #    include <iomanip>
+#    include <mutex>
 #    include <sstream>
+#    include <vector>
 
 
 /*
@@ -331,18 +334,36 @@ struct Signature {
 
 /* Encryption Session Data */
 struct Crypto_Session {
-  CryptoData* cryptoData;     /* ASN.1 Structure */
-  unsigned char* session_key; /* Private symmetric session key */
-  size_t session_key_len;     /* Symmetric session key length */
+  CryptoData* cryptoData{nullptr};     /* ASN.1 Structure */
+  unsigned char* session_key{nullptr}; /* Private symmetric session key */
+  size_t session_key_len{0};           /* Symmetric session key length */
+  std::atomic<uint64_t> sealed_blocks{0}; /* Numbers the sealed blocks */
 };
 
 /* Symmetric Cipher Context */
 struct Cipher_Context {
   EVP_CIPHER_CTX* ctx;
 
+  /* Only set for ciphers sealing every block on its own.  The nonce of a
+   * block is the session IV xored with its number, so numbers are taken from
+   * the session and never used twice with the same key. */
+  const EVP_CIPHER* sealing{nullptr};
+  std::vector<unsigned char> iv{};
+  std::atomic<uint64_t>* next_block{nullptr};
+
+  /* Blocks are sealed by several threads at once, each with a context from
+   * this pool that already has the key set up. */
+  std::vector<unsigned char> key{};
+  std::mutex pool_mutex{};
+  std::vector<EVP_CIPHER_CTX*> pool{};
+
   Cipher_Context() { ctx = EVP_CIPHER_CTX_new(); }
 
-  ~Cipher_Context() { EVP_CIPHER_CTX_free(ctx); }
+  ~Cipher_Context()
+  {
+    EVP_CIPHER_CTX_free(ctx);
+    for (EVP_CIPHER_CTX* pooled : pool) { EVP_CIPHER_CTX_free(pooled); }
+  }
 };
 
 /* PEM Password Dispatch Context */
@@ -1017,17 +1038,14 @@ CRYPTO_SESSION* crypto_session_new(crypto_cipher_t cipher,
   int iv_len;
 
   /* Allocate our session description structures */
-  cs = (CRYPTO_SESSION*)malloc(sizeof(CRYPTO_SESSION));
-
-  /* Initialize required fields */
-  cs->session_key = NULL;
+  cs = new CRYPTO_SESSION;
 
   /* Allocate a CryptoData structure */
   cs->cryptoData = CryptoData_new();
 
   if (!cs->cryptoData) {
     /* Allocation failed in OpenSSL */
-    free(cs);
+    delete cs;
     return NULL;
   }
 
@@ -1114,6 +1132,15 @@ CRYPTO_SESSION* crypto_session_new(crypto_cipher_t cipher,
       break;
 #      endif
 #    endif /* !OPENSSL_NO_SHA && !OPENSSL_NO_SHA1 */
+#    if !defined(OPENSSL_NO_AES) && !defined(HAVE_OPENSSL_EXPORT_LIBRARY)
+#      ifdef NID_aes_256_gcm
+    case CRYPTO_CIPHER_AES_256_GCM:
+      /* AES 256 bit GCM, sealing every block on its own */
+      cs->cryptoData->contentEncryptionAlgorithm = OBJ_nid2obj(NID_aes_256_gcm);
+      ec = EVP_aes_256_gcm();
+      break;
+#      endif
+#    endif
     default:
       Jmsg0(NULL, M_ERROR, 0, T_("Unsupported cipher type specified\n"));
       CryptoSessionFree(cs);
@@ -1257,10 +1284,7 @@ crypto_error_t CryptoSessionDecode(const uint8_t* data,
   /* bareos-fd.conf doesn't contains any key */
   if (!keypairs) { return CRYPTO_ERROR_NORECIPIENT; }
 
-  cs = (CRYPTO_SESSION*)malloc(sizeof(CRYPTO_SESSION));
-
-  /* Initialize required fields */
-  cs->session_key = NULL;
+  cs = new CRYPTO_SESSION;
 
   /* d2i_CryptoData modifies the supplied pointer */
   cs->cryptoData = d2i_CryptoData(NULL, &p, length);
@@ -1338,7 +1362,47 @@ void CryptoSessionFree(CRYPTO_SESSION* cs)
 {
   if (cs->cryptoData) { CryptoData_free(cs->cryptoData); }
   if (cs->session_key) { free(cs->session_key); }
-  free(cs);
+  delete cs;
+}
+
+// Sets up cipher_ctx for sealing/opening blocks, see CryptoCipherSealBlock()
+static CIPHER_CONTEXT* SealingCipherNew(CIPHER_CONTEXT* cipher_ctx,
+                                        CRYPTO_SESSION* cs,
+                                        const EVP_CIPHER* ec,
+                                        bool encrypt,
+                                        uint32_t* blocksize)
+{
+  if (static_cast<int>(cs->session_key_len) != EVP_CIPHER_key_length(ec)) {
+    Jmsg0(NULL, M_ERROR, 0,
+          T_("Encryption session provided an invalid symmetric key\n"));
+    delete cipher_ctx;
+    return NULL;
+  }
+  if (M_ASN1_STRING_length(cs->cryptoData->iv) != EVP_CIPHER_iv_length(ec)
+      || EVP_CIPHER_iv_length(ec) < 8) {
+    Jmsg0(NULL, M_ERROR, 0, T_("Encryption session provided an invalid IV\n"));
+    delete cipher_ctx;
+    return NULL;
+  }
+
+  cipher_ctx->sealing = ec;
+  cipher_ctx->key.assign(cs->session_key,
+                         cs->session_key + cs->session_key_len);
+  const unsigned char* iv = M_ASN1_STRING_data(cs->cryptoData->iv);
+  cipher_ctx->iv.assign(iv, iv + M_ASN1_STRING_length(cs->cryptoData->iv));
+  if (encrypt) {
+    cipher_ctx->next_block = &cs->sealed_blocks;
+  } else if (!EVP_DecryptInit_ex(cipher_ctx->ctx, ec, NULL,
+                                 cipher_ctx->key.data(), NULL)) {
+    OpensslPostErrors(M_ERROR,
+                      T_("OpenSSL cipher context initialization failed"));
+    delete cipher_ctx;
+    return NULL;
+  }
+
+  // sealed blocks are never padded
+  *blocksize = 1;
+  return cipher_ctx;
 }
 
 /*
@@ -1362,6 +1426,10 @@ CIPHER_CONTEXT* crypto_cipher_new(CRYPTO_SESSION* cs,
     return NULL;
   }
 
+  if (EVP_CIPHER_mode(ec) == EVP_CIPH_GCM_MODE) {
+    return SealingCipherNew(cipher_ctx, cs, ec, encrypt, blocksize);
+  }
+
   if (encrypt) {
     /* Initialize for encryption */
     if (!EVP_CipherInit_ex(cipher_ctx->ctx, ec, NULL, NULL, NULL, 1)) {
@@ -1439,6 +1507,12 @@ bool CryptoCipherFinalize(CIPHER_CONTEXT* cipher_ctx,
                           uint8_t* dest,
                           uint32_t* written)
 {
+  // every sealed block is complete on its own
+  if (cipher_ctx->sealing) {
+    *written = 0;
+    return true;
+  }
+
   if (!EVP_CipherFinal_ex(cipher_ctx->ctx, (unsigned char*)dest,
                           (int*)written)) {
     /* This really shouldn't fail */
@@ -1451,6 +1525,132 @@ bool CryptoCipherFinalize(CIPHER_CONTEXT* cipher_ctx,
 // Free memory associated with a cipher context.
 void CryptoCipherFree(CIPHER_CONTEXT* cipher_ctx) { delete cipher_ctx; }
 
+/*
+ * Check whether the cipher context seals every block on its own.  These are
+ * only passed to CryptoCipherSealBlock() and CryptoCipherOpenBlock().
+ */
+bool CryptoCipherSealsBlocks(CIPHER_CONTEXT* cipher_ctx)
+{
+  return cipher_ctx->sealing != nullptr;
+}
+
+static void SealedBlockNonce(const CIPHER_CONTEXT* cipher_ctx,
+                             uint64_t block,
+                             unsigned char* nonce)
+{
+  std::size_t iv_len = cipher_ctx->iv.size();
+  memcpy(nonce, cipher_ctx->iv.data(), iv_len);
+  for (std::size_t i = 0; i < sizeof(block); ++i) {
+    nonce[iv_len - 1 - i] ^= static_cast<unsigned char>(block >> (8 * i));
+  }
+}
+
+/*
+ * Encrypt length bytes of data into a sealed block written to dest, which
+ * needs room for length + CRYPTO_SEALED_OVERHEAD bytes.  Every block can be
+ * opened on its own, so this may be called by several threads at once.
+ * Returns: true on success, size of the sealed block in written
+ *          false on failure
+ */
+bool CryptoCipherSealBlock(CIPHER_CONTEXT* cipher_ctx,
+                           const uint8_t* data,
+                           uint32_t length,
+                           uint8_t* dest,
+                           uint32_t* written)
+{
+  if (!cipher_ctx->sealing || !cipher_ctx->next_block) { return false; }
+
+  uint64_t block = cipher_ctx->next_block->fetch_add(1);
+  for (std::size_t i = 0; i < 4; ++i) {
+    dest[i] = static_cast<uint8_t>(length >> (8 * (3 - i)));
+  }
+  for (std::size_t i = 0; i < 8; ++i) {
+    dest[4 + i] = static_cast<uint8_t>(block >> (8 * (7 - i)));
+  }
+  std::vector<unsigned char> nonce(cipher_ctx->iv.size());
+  SealedBlockNonce(cipher_ctx, block, nonce.data());
+
+  EVP_CIPHER_CTX* ctx = nullptr;
+  {
+    std::unique_lock lock(cipher_ctx->pool_mutex);
+    if (!cipher_ctx->pool.empty()) {
+      ctx = cipher_ctx->pool.back();
+      cipher_ctx->pool.pop_back();
+    }
+  }
+  if (!ctx) {
+    ctx = EVP_CIPHER_CTX_new();
+    if (!ctx
+        || !EVP_EncryptInit_ex(ctx, cipher_ctx->sealing, NULL,
+                               cipher_ctx->key.data(), NULL)) {
+      EVP_CIPHER_CTX_free(ctx);
+      return false;
+    }
+  }
+
+  int len = 0, final_len = 0;
+  bool ok = EVP_EncryptInit_ex(ctx, NULL, NULL, NULL, nonce.data())
+            && EVP_EncryptUpdate(ctx, NULL, &len, dest,
+                                 CRYPTO_SEALED_HEADER_SIZE)
+            && EVP_EncryptUpdate(ctx, dest + CRYPTO_SEALED_HEADER_SIZE, &len,
+                                 data, length)
+            && EVP_EncryptFinal_ex(ctx, dest + CRYPTO_SEALED_HEADER_SIZE + len,
+                                   &final_len)
+            && static_cast<uint32_t>(len + final_len) == length
+            && EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG,
+                                   CRYPTO_SEALED_TAG_SIZE,
+                                   dest + CRYPTO_SEALED_HEADER_SIZE + length);
+
+  {
+    std::unique_lock lock(cipher_ctx->pool_mutex);
+    cipher_ctx->pool.push_back(ctx);
+  }
+
+  if (!ok) { return false; }
+  *written = length + CRYPTO_SEALED_OVERHEAD;
+  return true;
+}
+
+/*
+ * Decrypt and authenticate the sealed block of length bytes in place.  The
+ * plain data starts CRYPTO_SEALED_HEADER_SIZE bytes into the block.
+ * Returns: true on success, size of the plain data in written
+ *          false if the block is malformed or was tampered with
+ */
+bool CryptoCipherOpenBlock(CIPHER_CONTEXT* cipher_ctx,
+                           uint8_t* block,
+                           uint32_t length,
+                           uint32_t* written)
+{
+  if (!cipher_ctx->sealing || length < CRYPTO_SEALED_OVERHEAD) {
+    return false;
+  }
+
+  uint32_t plain_len = 0;
+  for (std::size_t i = 0; i < 4; ++i) { plain_len = plain_len << 8 | block[i]; }
+  uint64_t number = 0;
+  for (std::size_t i = 0; i < 8; ++i) { number = number << 8 | block[4 + i]; }
+  if (plain_len != length - CRYPTO_SEALED_OVERHEAD) { return false; }
+
+  std::vector<unsigned char> nonce(cipher_ctx->iv.size());
+  SealedBlockNonce(cipher_ctx, number, nonce.data());
+
+  uint8_t* data = block + CRYPTO_SEALED_HEADER_SIZE;
+  int len = 0, final_len = 0;
+  if (!EVP_DecryptInit_ex(cipher_ctx->ctx, NULL, NULL, NULL, nonce.data())
+      || !EVP_DecryptUpdate(cipher_ctx->ctx, NULL, &len, block,
+                            CRYPTO_SEALED_HEADER_SIZE)
+      || !EVP_DecryptUpdate(cipher_ctx->ctx, data, &len, data, plain_len)
+      || !EVP_CIPHER_CTX_ctrl(cipher_ctx->ctx, EVP_CTRL_GCM_SET_TAG,
+                              CRYPTO_SEALED_TAG_SIZE, data + plain_len)
+      || !EVP_DecryptFinal_ex(cipher_ctx->ctx, data + len, &final_len)) {
+    return false;
+  }
+
+  *written = len + final_len;
+  return true;
+}
+
 const char* crypto_digest_name(DIGEST* digest)
 {
   return crypto_digest_name(digest->type);
@@ -0,0 +1,265 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Open addressing hash table with the interface of htable
+ *
+ * htable chains its items through the hlink inside of them, so every probe
+ * is a cache miss.  flat_htable instead keeps the hash, the key and a
+ * pointer to the item next to each other in one array and a byte of the
+ * hash per slot in a separate control array (like the "swiss tables" of
+ * abseil).  A lookup scans eight control bytes at once and usually touches
+ * only the one item it returns.  Items do not need an hlink member.
+ *
+ * Items cannot be removed, just like with htable.
+ */
+
+#ifndef BAREOS_LIB_FLAT_HTABLE_H_
+#define BAREOS_LIB_FLAT_HTABLE_H_
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#if defined(_MSC_VER)
+#  include <intrin.h>
+#endif
+
+#include "lib/htable.h"
+#include "lib/monotonic_buffer.h"
+
+namespace flat_htable_detail {
+inline uint64_t Mix(uint64_t h)
+{
+  // finalizer of murmur3, spreads all input bits over the result
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+inline uint64_t HashBytes(const uint8_t* p, std::size_t len)
+{
+  // eight bytes at a time, the mixing at the end makes up for the weak steps
+  uint64_t h = 0x9e3779b97f4a7c15ULL ^ len;
+  for (; len >= 8; p += 8, len -= 8) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    h = (h ^ word) * 0xff51afd7ed558ccdULL;
+    h ^= h >> 32;
+  }
+  uint64_t tail = 0;
+  for (std::size_t i = 0; i < len; ++i) { tail |= uint64_t{p[i]} << (8 * i); }
+  return Mix(h ^ tail);
+}
+
+inline uint64_t Hash(const char* key)
+{
+  return HashBytes(reinterpret_cast<const uint8_t*>(key), strlen(key));
+}
+inline uint64_t Hash(uint32_t key) { return Mix(key); }
+inline uint64_t Hash(uint64_t key) { return Mix(key); }
+inline uint64_t Hash(const htable_binary_key& key)
+{
+  return HashBytes(key.ptr, key.len);
+}
+
+inline bool Equal(const char* a, const char* b) { return strcmp(a, b) == 0; }
+inline bool Equal(uint32_t a, uint32_t b) { return a == b; }
+inline bool Equal(uint64_t a, uint64_t b) { return a == b; }
+inline bool Equal(const htable_binary_key& a, const htable_binary_key& b)
+{
+  return a.len == b.len && memcmp(a.ptr, b.ptr, a.len) == 0;
+}
+
+// eight control bytes are looked at together
+constexpr std::size_t group_size = 8;
+constexpr uint8_t empty = 0x80;
+constexpr uint64_t lsbs = 0x0101010101010101ULL;
+constexpr uint64_t msbs = 0x8080808080808080ULL;
+
+/* bit 7 of byte n is set if control byte n might be tag; false positives
+ * are possible but rare and get sorted out by comparing the hash */
+inline uint64_t MatchTag(uint64_t group, uint8_t tag)
+{
+  uint64_t x = group ^ (lsbs * tag);
+  return (x - lsbs) & ~x & msbs;
+}
+inline uint64_t MatchEmpty(uint64_t group) { return group & msbs; }
+
+inline int FirstMatch(uint64_t mask)
+{
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward64(&index, mask);
+  return index / 8;
+#else
+  return __builtin_ctzll(mask) / 8;
+#endif
+}
+inline uint64_t DropFirstMatch(uint64_t mask) { return mask & (mask - 1); }
+
+// control byte n ends up in byte n (counted from the lowest) on every cpu
+inline uint64_t LoadGroup(const uint8_t* p)
+{
+  uint64_t group = 0;
+  for (std::size_t i = 0; i < group_size; ++i) {
+    group |= uint64_t{p[i]} << (8 * i);
+  }
+  return group;
+}
+}  // namespace flat_htable_detail
+
+template <typename Key,
+          typename T,
+          enum MonotonicBuffer::Size BufferSize = MonotonicBuffer::Size::Large>
+class flat_htable {
+  struct slot {
+    uint64_t hash;
+    Key key;
+    T* item;
+  };
+
+  std::unique_ptr<uint8_t[]> ctrl;
+  std::unique_ptr<slot[]> slots;
+  std::size_t capacity{0}; /* number of slots, a power of two */
+  std::size_t num_items{0};
+  std::size_t max_items{0}; /* grow when this is reached */
+  std::size_t walk_index{0};
+  MonotonicBuffer monobuf{BufferSize};
+
+ public:
+  // tsize is the estimated number of entries in the hash table
+  flat_htable(int tsize = 31)
+  {
+    std::size_t wanted = tsize < 31 ? 31 : tsize;
+    std::size_t cap = flat_htable_detail::group_size;
+    while (cap - cap / 8 < wanted) { cap *= 2; }
+    allocate(cap);
+  }
+
+  T* lookup(Key key) { return Find(flat_htable_detail::Hash(key), key); }
+
+  // returns false (and does not insert) if the key is already known
+  bool insert(Key key, T* item)
+  {
+    uint64_t hash = flat_htable_detail::Hash(key);
+    if (Find(hash, key)) { return false; }
+    if (num_items >= max_items) { allocate(2 * capacity); }
+    Place(hash, key, item);
+    num_items += 1;
+    return true;
+  }
+
+  char* hash_malloc(int size)
+  {
+    return static_cast<char*>(monobuf.allocate(size));
+  }
+
+  // Get first item in table
+  T* first()
+  {
+    walk_index = 0;
+    return next();
+  }
+
+  // Get next item in table
+  T* next()
+  {
+    while (walk_index < capacity) {
+      std::size_t i = walk_index++;
+      if (ctrl[i] != flat_htable_detail::empty) { return slots[i].item; }
+    }
+    return nullptr;
+  }
+
+  uint32_t size() { return num_items; }
+
+ private:
+  static uint8_t Tag(uint64_t hash) { return hash >> 57; }
+  std::size_t NumGroups() const
+  {
+    return capacity / flat_htable_detail::group_size;
+  }
+  uint64_t LoadGroup(std::size_t group) const
+  {
+    return flat_htable_detail::LoadGroup(
+        &ctrl[group * flat_htable_detail::group_size]);
+  }
+
+  T* Find(uint64_t hash, const Key& key) const
+  {
+    uint8_t tag = Tag(hash);
+    std::size_t group = hash & (NumGroups() - 1);
+    for (std::size_t probe = 1;; ++probe) {
+      uint64_t ctrls = LoadGroup(group);
+      for (uint64_t m = flat_htable_detail::MatchTag(ctrls, tag); m;
+           m = flat_htable_detail::DropFirstMatch(m)) {
+        const slot& s = slots[group * flat_htable_detail::group_size
+                              + flat_htable_detail::FirstMatch(m)];
+        if (s.hash == hash && flat_htable_detail::Equal(s.key, key)) {
+          return s.item;
+        }
+      }
+      if (flat_htable_detail::MatchEmpty(ctrls)) { return nullptr; }
+      // triangular probing visits every group once
+      group = (group + probe) & (NumGroups() - 1);
+    }
+  }
+
+  void Place(uint64_t hash, const Key& key, T* item)
+  {
+    std::size_t group = hash & (NumGroups() - 1);
+    for (std::size_t probe = 1;; ++probe) {
+      if (uint64_t m = flat_htable_detail::MatchEmpty(LoadGroup(group))) {
+        std::size_t i = group * flat_htable_detail::group_size
+                        + flat_htable_detail::FirstMatch(m);
+        ctrl[i] = Tag(hash);
+        slots[i] = slot{hash, key, item};
+        return;
+      }
+      group = (group + probe) & (NumGroups() - 1);
+    }
+  }
+
+  // (re)allocates the table with cap slots and puts all items into it
+  void allocate(std::size_t cap)
+  {
+    std::unique_ptr<uint8_t[]> old_ctrl = std::move(ctrl);
+    std::unique_ptr<slot[]> old_slots = std::move(slots);
+    std::size_t old_capacity = capacity;
+
+    ctrl = std::make_unique<uint8_t[]>(cap);
+    memset(ctrl.get(), flat_htable_detail::empty, cap);
+    slots.reset(new slot[cap]);
+    capacity = cap;
+    max_items = cap - cap / 8; /* at most 7/8 full */
+
+    for (std::size_t i = 0; i < old_capacity; ++i) {
+      if (old_ctrl[i] != flat_htable_detail::empty) {
+        Place(old_slots[i].hash, old_slots[i].key, old_slots[i].item);
+      }
+    }
+  }
+};
+
+#endif  // BAREOS_LIB_FLAT_HTABLE_H_
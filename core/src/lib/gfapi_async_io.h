@@ -0,0 +1,233 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * asynchronous I/O for the users of the GlusterFS gfapi
+ *
+ * Only to be included by code that is linked against gfapi, i.e. the gfapi
+ * storage backend and the gfapi plugin of the file daemon.
+ */
+
+#ifndef BAREOS_LIB_GFAPI_ASYNC_IO_H_
+#define BAREOS_LIB_GFAPI_ASYNC_IO_H_
+
+#include <glusterfs/api/glfs.h>
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#if defined(GLFS_IO_CBK_HAS_STAT_ARGS)
+#  define GFAPI_IO_CBK_STAT_ARGS struct glfs_stat*, struct glfs_stat*,
+#else
+#  define GFAPI_IO_CBK_STAT_ARGS
+#endif
+
+/**
+ * Asynchronous I/O on a gfapi file handle, so the network round trip of
+ * one block overlaps with the next ones.  Up to queue_depth writes are
+ * copied and written behind, each at the offset it would have been written
+ * to.  Sequential reads of the same size are read ahead by up to
+ * queue_depth requests.  Finish() waits for everything in flight and puts
+ * the file position of the handle where a synchronous caller expects it;
+ * it has to be called before any other operation on the handle.  An error
+ * of a write behind is returned by the next Write() or by Finish().
+ */
+class gfapi_async_io {
+ public:
+  gfapi_async_io(glfs_fd_t* gfd, int queue_depth)
+      : gfd_{gfd}, queue_depth_{static_cast<std::size_t>(queue_depth)}
+  {
+  }
+  ~gfapi_async_io() { Finish(); }
+
+  ssize_t Write(const void* buffer, size_t count)
+  {
+    if (!reads_.empty() && !Finish()) { return -1; }
+
+    std::unique_lock lock(mutex_);
+    if (!SyncPosition()) { return -1; }
+    done_.wait(lock, [this] {
+      while (!writes_.empty() && writes_.front()->done) {
+        writes_.pop_front();
+      }
+      return writes_.size() < queue_depth_;
+    });
+    if (error_) {
+      errno = error_;
+      return -1;
+    }
+
+    auto req = std::make_unique<request>(this, true, position_, count);
+    memcpy(req->buffer.data(), buffer, count);
+    if (glfs_pwrite_async(gfd_, req->buffer.data(), count, position_, 0, Done,
+                          req.get())
+        < 0) {
+      return -1;
+    }
+    writes_.push_back(std::move(req));
+    position_ += count;
+    return count;
+  }
+
+  ssize_t Read(void* buffer, size_t count)
+  {
+    if (!writes_.empty() && !Finish()) { return -1; }
+
+    std::unique_lock lock(mutex_);
+    if (!SyncPosition()) { return -1; }
+    if (!reads_.empty()
+        && (reads_.front()->offset != position_
+            || reads_.front()->buffer.size() != count)) {
+      DropReads(lock);
+    }
+
+    // Keep queue_depth reads in flight, but none beyond the end of the file.
+    while (reads_.size() < queue_depth_
+           && (reads_.empty() || !AtEnd(*reads_.back()))) {
+      off_t offset = reads_.empty() ? position_
+                                        : reads_.back()->offset + count;
+      auto req = std::make_unique<request>(this, false, offset, count);
+      if (glfs_pread_async(gfd_, req->buffer.data(), count, offset, 0, Done,
+                           req.get())
+          < 0) {
+        if (reads_.empty()) { return -1; }
+        break;
+      }
+      reads_.push_back(std::move(req));
+    }
+
+    done_.wait(lock, [this] { return reads_.front()->done; });
+    std::unique_ptr<request> req = std::move(reads_.front());
+    reads_.pop_front();
+    if (req->result < 0) {
+      DropReads(lock);
+      errno = req->error;
+      return -1;
+    }
+    memcpy(buffer, req->buffer.data(), req->result);
+    position_ += req->result;
+    return req->result;
+  }
+
+  // false (with errno set) when a write behind failed
+  bool Finish()
+  {
+    std::unique_lock lock(mutex_);
+    done_.wait(lock, [this] {
+      while (!writes_.empty() && writes_.front()->done) {
+        writes_.pop_front();
+      }
+      return writes_.empty();
+    });
+    DropReads(lock);
+
+    bool ok = true;
+    if (position_ >= 0 && glfs_lseek(gfd_, position_, SEEK_SET) < 0) {
+      ok = false;
+    }
+    position_ = -1;
+    if (error_) {
+      errno = error_;
+      error_ = 0;
+      ok = false;
+    }
+    return ok;
+  }
+
+ private:
+  struct request {
+    request(gfapi_async_io* t_io,
+            bool t_is_write,
+            off_t t_offset,
+            size_t count)
+        : io{t_io}, is_write{t_is_write}, offset{t_offset}, buffer(count)
+    {
+    }
+    gfapi_async_io* io;
+    bool is_write;
+    off_t offset;
+    std::vector<char> buffer;
+    ssize_t result{0};
+    int error{0};
+    bool done{false};
+  };
+
+  // Called by a gfapi thread when a request is done.
+  static void Done(glfs_fd_t*, ssize_t ret, GFAPI_IO_CBK_STAT_ARGS void* data)
+  {
+    request* req = static_cast<request*>(data);
+    gfapi_async_io* io = req->io;
+    int error = errno;
+
+    std::unique_lock lock(io->mutex_);
+    req->result = ret;
+    req->error = error;
+    req->done = true;
+    if (ret < 0 && req->is_write && !io->error_) {
+      io->error_ = error ? error : EIO;
+    }
+    io->done_.notify_all();
+  }
+
+  static bool AtEnd(const request& req)
+  {
+    return req.done && req.result < static_cast<ssize_t>(req.buffer.size());
+  }
+
+  // Need mutex_ to be held.
+  bool SyncPosition()
+  {
+    if (position_ < 0) {
+      position_ = glfs_lseek(gfd_, 0, SEEK_CUR);
+      if (position_ < 0) { return false; }
+    }
+    return true;
+  }
+
+  void DropReads(std::unique_lock<std::mutex>& lock)
+  {
+    done_.wait(lock, [this] {
+      for (auto& req : reads_) {
+        if (!req->done) { return false; }
+      }
+      return true;
+    });
+    reads_.clear();
+  }
+
+  glfs_fd_t* gfd_;
+  std::size_t queue_depth_;
+  std::mutex mutex_;
+  std::condition_variable done_;
+  std::deque<std::unique_ptr<request>> writes_;
+  std::deque<std::unique_ptr<request>> reads_;
+  off_t position_{-1}; /* -1 when the position of gfd_ is right */
+  int error_{0};
+};
+
+#undef GFAPI_IO_CBK_STAT_ARGS
+
+#endif  // BAREOS_LIB_GFAPI_ASYNC_IO_H_
@@ -0,0 +1,155 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation, which is
+   listed in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "include/bareos.h"
+#include "lib/idle_socket_reactor.h"
+#include "lib/berrno.h"
+
+#ifndef HAVE_WIN32
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+#ifdef HAVE_POLL_H
+#  include <poll.h>
+#elif HAVE_SYS_POLL_H
+#  include <sys/poll.h>
+#endif
+
+#include <vector>
+
+bool IdleSocketReactor::Start()
+{
+#if defined(HAVE_WIN32) || !defined(HAVE_POLL)
+  return false;
+#else
+  std::unique_lock lock(mutex_);
+  if (running_) { return true; }
+  if (pipe(wake_fds_) != 0) {
+    BErrNo be;
+    Dmsg1(50, "Cannot create the wake up pipe of the reactor: %s\n",
+          be.bstrerror());
+    return false;
+  }
+  for (int fd : wake_fds_) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  }
+  running_ = true;
+  stopping_ = false;
+  thread_ = std::thread([this] { Run(); });
+  return true;
+#endif
+}
+
+bool IdleSocketReactor::Park(int fd, resume_function resume)
+{
+  {
+    std::unique_lock lock(mutex_);
+    if (!running_ || stopping_) { return false; }
+    parked_[fd] = std::move(resume);
+  }
+  Wake();
+  return true;
+}
+
+void IdleSocketReactor::Stop()
+{
+  {
+    std::unique_lock lock(mutex_);
+    if (!running_ || stopping_) { return; }
+    stopping_ = true;
+  }
+  Wake();
+  thread_.join();
+
+  std::unordered_map<int, resume_function> parked;
+  {
+    std::unique_lock lock(mutex_);
+    parked.swap(parked_);
+    running_ = false;
+  }
+  for (auto& [fd, resume] : parked) { resume(true); }
+
+#ifndef HAVE_WIN32
+  close(wake_fds_[0]);
+  close(wake_fds_[1]);
+#endif
+  wake_fds_[0] = wake_fds_[1] = -1;
+}
+
+std::size_t IdleSocketReactor::Parked()
+{
+  std::unique_lock lock(mutex_);
+  return parked_.size();
+}
+
+void IdleSocketReactor::Wake()
+{
+#if !defined(HAVE_WIN32) && defined(HAVE_POLL)
+  // a full pipe wakes the reactor up as well
+  char c = 0;
+  while (write(wake_fds_[1], &c, 1) < 0 && errno == EINTR) {}
+#endif
+}
+
+void IdleSocketReactor::Run()
+{
+#if !defined(HAVE_WIN32) && defined(HAVE_POLL)
+  std::vector<struct pollfd> pfds;
+  std::vector<resume_function> ready;
+
+  for (;;) {
+    pfds.clear();
+    pfds.push_back({wake_fds_[0], POLLIN, 0});
+    {
+      std::unique_lock lock(mutex_);
+      if (stopping_) { break; }
+      for (auto& entry : parked_) { pfds.push_back({entry.first, POLLIN, 0}); }
+    }
+
+    if (poll(pfds.data(), pfds.size(), -1) < 0) {
+      if (errno == EINTR) { continue; }
+      BErrNo be;
+      Emsg1(M_ERROR, 0, T_("Idle socket reactor poll failed: %s\n"),
+            be.bstrerror());
+      break;
+    }
+
+    if (pfds[0].revents) {
+      char buf[64];
+      while (read(wake_fds_[0], buf, sizeof(buf)) > 0) {}
+    }
+
+    {
+      std::unique_lock lock(mutex_);
+      for (std::size_t i = 1; i < pfds.size(); ++i) {
+        if (!pfds[i].revents) { continue; }
+        if (auto found = parked_.find(pfds[i].fd); found != parked_.end()) {
+          ready.push_back(std::move(found->second));
+          parked_.erase(found);
+        }
+      }
+    }
+    for (auto& resume : ready) { resume(false); }
+    ready.clear();
+  }
+#endif
+}
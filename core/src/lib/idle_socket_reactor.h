@@ -0,0 +1,74 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation, which is
+   listed in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * watches idle sockets without holding a thread for each one
+ *
+ * A connection that waits for its next request parks its socket here.  The
+ * thread of the reactor polls all parked sockets and calls the resume
+ * function of a socket once data (or the end of the connection) arrived; that
+ * function has to hand the work to a thread of its own.
+ */
+
+#ifndef BAREOS_LIB_IDLE_SOCKET_REACTOR_H_
+#define BAREOS_LIB_IDLE_SOCKET_REACTOR_H_
+
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+class IdleSocketReactor {
+ public:
+  // stop is set if the reactor stops before the socket got readable
+  using resume_function = std::function<void(bool stop)>;
+
+  IdleSocketReactor() = default;
+  ~IdleSocketReactor() { Stop(); }
+
+  IdleSocketReactor(const IdleSocketReactor&) = delete;
+  IdleSocketReactor& operator=(const IdleSocketReactor&) = delete;
+
+  // false if the platform has no way to wake up the reactor
+  bool Start();
+
+  /* Watches fd until it is readable.  Returns false (and does not keep
+   * resume) if the reactor does not run. */
+  bool Park(int fd, resume_function resume);
+
+  // calls the resume function of every parked socket with stop set
+  void Stop();
+
+  std::size_t Parked();
+
+ private:
+  void Run();
+  void Wake();
+
+  std::mutex mutex_;
+  std::unordered_map<int, resume_function> parked_;
+  std::thread thread_;
+  int wake_fds_[2]{-1, -1};
+  bool running_{false};
+  bool stopping_{false};
+};
+
+#endif  // BAREOS_LIB_IDLE_SOCKET_REACTOR_H_
@@ -48,6 +48,7 @@
 #include "lib/jcr.h"
 #include "lib/berrno.h"
 #include "lib/bsignal.h"
+#include "lib/lock_profile.h"
 #include "lib/breg.h"
 #include "lib/edit.h"
 #include "lib/thread_specific_data.h"
@@ -62,6 +63,8 @@
 #include <thread>
 #include <atomic>
 #include <chrono>
+#include <string>
+#include <unordered_map>
 
 const int debuglevel = 3400;
 
@@ -78,7 +81,23 @@ static std::vector<std::weak_ptr<JobControlRecord>> job_control_record_cache;
 static dlist<JobControlRecord>* job_control_record_chain = nullptr;
 static int watch_dog_timeout = 0;
 
-static std::mutex jcr_chain_mutex;
+/* Where the jcrs of the chain were found by their JobId, Job name and volume
+ * session.  These members get set at any time after a jcr was registered, so
+ * an entry is only a hint that is checked against the jcr; without a matching
+ * entry the chain is scanned, which indexes the jcr found.  Keys that many
+ * jcrs share (JobId 0, no session) are not indexed.  The entries of a jcr are
+ * removed together with it from the chain.  Needs jcr_chain_mutex. */
+struct jcr_index_keys {
+  uint32_t JobId;
+  std::string Job;
+  uint64_t session;
+};
+static std::unordered_map<uint32_t, JobControlRecord*> jcr_by_id;
+static std::unordered_map<std::string, JobControlRecord*> jcr_by_name;
+static std::unordered_map<uint64_t, JobControlRecord*> jcr_by_session;
+static std::unordered_map<JobControlRecord*, jcr_index_keys> jcr_index;
+
+static lock_profile::mutex jcr_chain_mutex{"jcr chain"};
 static pthread_mutex_t job_start_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 static char Job_status[] = "Status Job=%s JobStatus=%d\n";
@@ -250,6 +269,86 @@ void InitJcr(std::shared_ptr<JobControlRecord> jcr,
   UnlockJobs();
 }
 
+static uint64_t SessionKey(uint32_t SessionId, uint32_t SessionTime)
+{
+  return (uint64_t{SessionTime} << 32) | SessionId;
+}
+
+template <typename Key>
+static void EraseIndexEntry(
+    std::unordered_map<Key, JobControlRecord*>& entries,
+    const Key& key,
+    JobControlRecord* jcr)
+{
+  if (auto found = entries.find(key);
+      found != entries.end() && found->second == jcr) {
+    entries.erase(found);
+  }
+}
+
+// Needs jcr_chain_mutex.
+static void UnindexJcr(JobControlRecord* jcr)
+{
+  auto found = jcr_index.find(jcr);
+  if (found == jcr_index.end()) { return; }
+  const jcr_index_keys& keys = found->second;
+  EraseIndexEntry(jcr_by_id, keys.JobId, jcr);
+  EraseIndexEntry(jcr_by_name, keys.Job, jcr);
+  EraseIndexEntry(jcr_by_session, keys.session, jcr);
+  jcr_index.erase(found);
+}
+
+// Needs jcr_chain_mutex.
+static void IndexJcr(JobControlRecord* jcr)
+{
+  UnindexJcr(jcr);
+  jcr_index_keys& keys = jcr_index[jcr];
+  keys.JobId = jcr->JobId;
+  keys.session = SessionKey(jcr->VolSessionId, jcr->VolSessionTime);
+  if (jcr->JobId != 0) {
+    keys.Job = jcr->Job;
+    jcr_by_id.insert_or_assign(keys.JobId, jcr);
+    jcr_by_name.insert_or_assign(keys.Job, jcr);
+  }
+  if (jcr->VolSessionId != 0) {
+    jcr_by_session.insert_or_assign(keys.session, jcr);
+  }
+}
+
+/* Returns the jcr of the chain the index has under key if matches(jcr) or
+ * else the first one of the chain that matches, with its use count
+ * incremented. */
+template <typename Key, typename P>
+static JobControlRecord* FindJcr(
+    const std::unordered_map<Key, JobControlRecord*>* entries,
+    const Key& key,
+    P matches)
+{
+  std::unique_lock _{jcr_chain_mutex};
+  if (!job_control_record_chain) { return nullptr; }
+
+  JobControlRecord* jcr = nullptr;
+  if (entries) {
+    if (auto found = entries->find(key);
+        found != entries->end() && matches(found->second)) {
+      jcr = found->second;
+    }
+  }
+  if (!jcr) {
+    for (jcr = job_control_record_chain->first(); jcr;
+         jcr = job_control_record_chain->next(jcr)) {
+      if (matches(jcr)) { break; }
+    }
+    if (jcr && entries) { IndexJcr(jcr); }
+  }
+  if (jcr) {
+    jcr->IncUseCount();
+    Dmsg3(debuglevel, "Inc get_jcr jid=%u UseCount=%d Job=%s\n", jcr->JobId,
+          jcr->UseCount(), jcr->Job);
+  }
+  return jcr;
+}
+
 /*
  * Remove a JobControlRecord from the chain
  *
@@ -260,6 +359,7 @@ static void RemoveJcr(JobControlRecord* jcr)
   Dmsg0(debuglevel, "Enter RemoveJcr\n");
   if (!jcr) { Emsg0(M_ABORT, 0, T_("nullptr jcr.\n")); }
   job_control_record_chain->remove(jcr);
+  UnindexJcr(jcr);
   Dmsg0(debuglevel, "Leave RemoveJcr\n");
 }
 
@@ -331,6 +431,11 @@ static void FreeCommonJcr(JobControlRecord* jcr)
     jcr->cached_pnl = 0;
   }
 
+  if (jcr->made_paths) {
+    FreePathList(jcr->made_paths);
+    jcr->made_paths = nullptr;
+  }
+
   if (jcr->id_list) {
     FreeGuidList(jcr->id_list);
     jcr->id_list = nullptr;
@@ -452,19 +557,10 @@ void JobControlRecord::MyThreadSendSignal(int sig)
  */
 JobControlRecord* get_jcr_by_id(uint32_t JobId)
 {
-  JobControlRecord* jcr;
-
-  foreach_jcr (jcr) {
-    if (jcr->JobId == JobId) {
-      jcr->IncUseCount();
-      Dmsg3(debuglevel, "Inc get_jcr jid=%u UseCount=%d Job=%s\n", jcr->JobId,
-            jcr->UseCount(), jcr->Job);
-      break;
-    }
-  }
-  endeach_jcr(jcr);
-
-  return jcr;
+  return FindJcr(JobId ? &jcr_by_id : nullptr, JobId,
+                 [JobId](const JobControlRecord* jcr) {
+                   return jcr->JobId == JobId;
+                 });
 }
 
 static void CleanupExpired(std::vector<std::weak_ptr<JobControlRecord>>& v)
@@ -533,19 +629,12 @@ std::shared_ptr<JobControlRecord> GetJcrBySession(VolumeSessionInfo vsi)
  */
 JobControlRecord* get_jcr_by_session(uint32_t SessionId, uint32_t SessionTime)
 {
-  JobControlRecord* jcr;
-
-  foreach_jcr (jcr) {
-    if (jcr->VolSessionId == SessionId && jcr->VolSessionTime == SessionTime) {
-      jcr->IncUseCount();
-      Dmsg3(debuglevel, "Inc get_jcr jid=%u UseCount=%d Job=%s\n", jcr->JobId,
-            jcr->UseCount(), jcr->Job);
-      break;
-    }
-  }
-  endeach_jcr(jcr);
-
-  return jcr;
+  return FindJcr(SessionId ? &jcr_by_session : nullptr,
+                 SessionKey(SessionId, SessionTime),
+                 [SessionId, SessionTime](const JobControlRecord* jcr) {
+                   return jcr->VolSessionId == SessionId
+                          && jcr->VolSessionTime == SessionTime;
+                 });
 }
 
 /*
@@ -584,21 +673,12 @@ JobControlRecord* get_jcr_by_partial_name(char* Job)
  */
 JobControlRecord* get_jcr_by_full_name(char* Job)
 {
-  JobControlRecord* jcr;
-
   if (!Job) { return nullptr; }
 
-  foreach_jcr (jcr) {
-    if (bstrcmp(jcr->Job, Job)) {
-      jcr->IncUseCount();
-      Dmsg3(debuglevel, "Inc get_jcr jid=%u UseCount=%d Job=%s\n", jcr->JobId,
-            jcr->UseCount(), jcr->Job);
-      break;
-    }
-  }
-  endeach_jcr(jcr);
-
-  return jcr;
+  return FindJcr(&jcr_by_name, std::string{Job},
+                 [Job](const JobControlRecord* jcr) {
+                   return bstrcmp(jcr->Job, Job);
+                 });
 }
 
 const char* JcrGetAuthenticateKey(const char* unified_job_name)
@@ -901,6 +981,10 @@ void CleanupJcrChain()
   if (job_control_record_chain) {
     delete job_control_record_chain;
     job_control_record_chain = nullptr;
+    jcr_by_id.clear();
+    jcr_by_name.clear();
+    jcr_by_session.clear();
+    jcr_index.clear();
   }
 }
 
@@ -0,0 +1,302 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "include/bareos.h"
+#include "lib/lock_profile.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace lock_profile {
+
+std::atomic<uint32_t> sampling{0};
+
+namespace {
+
+constexpr const char* unknown_site = "an unknown call site";
+
+// upper bounds of the wait time buckets in microseconds, then the rest
+constexpr std::array<uint64_t, 8> wait_bounds{1,     10,     100,     1000,
+                                              10000, 100000, 1000000, 10000000};
+constexpr std::array<const char*, 9> wait_labels{
+    "<1us",   "<10us", "<100us", "<1ms", "<10ms",
+    "<100ms", "<1s",   "<10s",   ">=10s"};
+
+struct site {
+  const char* file{nullptr};
+  uint32_t line{0};
+
+  bool operator<(const site& other) const
+  {
+    return file != other.file ? file < other.file : line < other.line;
+  }
+};
+
+struct lock_stats {
+  std::string name{};
+  uint64_t sampled{0};
+  uint64_t contended{0};
+  uint64_t wait_ns{0};
+  uint64_t max_wait_ns{0};
+  std::array<uint64_t, wait_labels.size()> waits{};
+  std::map<site, uint64_t> holders{}; /**< Of the contended acquisitions */
+};
+
+struct profile_data {
+  std::mutex mutex{};
+  std::map<const void*, std::string> names{};
+  std::map<const void*, lock_stats> locks{};
+};
+
+// never destroyed, locks get named during static initialization
+profile_data& Profile()
+{
+  static profile_data* profile = new profile_data;
+  return *profile;
+}
+
+/* The last call site that locked a mutex, in a slot picked by its address.
+ * Mutexes sharing a slot overwrite each other, a waiter only trusts a slot
+ * that names its own mutex. */
+struct holder_slot {
+  std::atomic<const void*> lock{nullptr};
+  std::atomic<const char*> file{nullptr};
+  std::atomic<uint32_t> line{0};
+};
+
+constexpr std::size_t holder_slots = 4096;
+holder_slot holders[holder_slots];
+
+holder_slot& SlotOf(const void* lock)
+{
+  auto addr = reinterpret_cast<uintptr_t>(lock);
+  return holders[((addr >> 4) ^ (addr >> 16)) % holder_slots];
+}
+
+void SetHolder(const void* lock, const char* file, uint32_t line)
+{
+  holder_slot& slot = SlotOf(lock);
+  slot.file.store(file, std::memory_order_relaxed);
+  slot.line.store(line, std::memory_order_relaxed);
+  slot.lock.store(lock, std::memory_order_release);
+}
+
+site Holder(const void* lock)
+{
+  holder_slot& slot = SlotOf(lock);
+  if (slot.lock.load(std::memory_order_acquire) != lock) {
+    return {unknown_site, 0};
+  }
+  return {slot.file.load(std::memory_order_relaxed),
+          slot.line.load(std::memory_order_relaxed)};
+}
+
+thread_local uint32_t countdown = 0;
+
+std::string FormatSite(const site& s)
+{
+  if (s.line == 0) { return s.file; }
+  return std::string{s.file} + ":" + std::to_string(s.line);
+}
+
+std::string FormatWait(uint64_t ns)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.3f ms", ns / 1e6);
+  return buf;
+}
+
+}  // namespace
+
+void SetSampling(uint32_t one_in)
+{
+  sampling.store(one_in, std::memory_order_relaxed);
+}
+
+void NameLock(const void* lock, std::string name)
+{
+  profile_data& profile = Profile();
+  std::lock_guard l(profile.mutex);
+  profile.names[lock] = std::move(name);
+  auto found = profile.locks.find(lock);
+  if (found != profile.locks.end()) {
+    found->second.name = profile.names[lock];
+  }
+}
+
+void ForgetLock(const void* lock)
+{
+  profile_data& profile = Profile();
+  std::lock_guard l(profile.mutex);
+  profile.names.erase(lock);
+  profile.locks.erase(lock);
+}
+
+void Reset()
+{
+  profile_data& profile = Profile();
+  std::lock_guard l(profile.mutex);
+  profile.locks.clear();
+}
+
+bool Sample()
+{
+  uint32_t one_in = sampling.load(std::memory_order_relaxed);
+  if (one_in == 0) { return false; }
+  if (countdown > 0) {
+    countdown--;
+    return false;
+  }
+  countdown = one_in - 1;
+  return true;
+}
+
+uint64_t Now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void RecordAcquisition(const void* lock,
+                       const char* file,
+                       uint32_t line,
+                       uint64_t wait_ns,
+                       const char* holder_file,
+                       uint32_t holder_line)
+{
+  profile_data& profile = Profile();
+  std::lock_guard l(profile.mutex);
+  auto [found, inserted] = profile.locks.try_emplace(lock);
+  lock_stats& stats = found->second;
+  if (inserted) {
+    auto name = profile.names.find(lock);
+    if (name != profile.names.end()) {
+      stats.name = name->second;
+    } else if (file) {
+      stats.name = FormatSite({file, line});
+    } else {
+      char buf[32];
+      snprintf(buf, sizeof(buf), "lock %p", lock);
+      stats.name = buf;
+    }
+  }
+
+  stats.sampled++;
+  if (!holder_file) { return; }
+  stats.contended++;
+  stats.wait_ns += wait_ns;
+  stats.max_wait_ns = std::max(stats.max_wait_ns, wait_ns);
+  std::size_t bucket = 0;
+  while (bucket < wait_bounds.size() && wait_ns >= wait_bounds[bucket] * 1000) {
+    bucket++;
+  }
+  stats.waits[bucket]++;
+  stats.holders[{holder_file, holder_line}]++;
+}
+
+int LockMutex(pthread_mutex_t& m, const char* file, uint32_t line)
+{
+  int status;
+  if (!Sample()) {
+    status = pthread_mutex_lock(&m);
+  } else if ((status = pthread_mutex_trylock(&m)) == 0) {
+    RecordAcquisition(&m, file, line, 0);
+  } else if (status == EBUSY) {
+    site holder = Holder(&m);
+    uint64_t start = Now();
+    status = pthread_mutex_lock(&m);
+    if (status == 0) {
+      RecordAcquisition(&m, file, line, Now() - start, holder.file,
+                        holder.line);
+    }
+  }
+  if (status == 0) { SetHolder(&m, file, line); }
+  return status;
+}
+
+void mutex::lock()
+{
+  if (!Enabled() || !Sample()) {
+    mutex_.lock();
+  } else if (mutex_.try_lock()) {
+    RecordAcquisition(this, nullptr, 0, 0);
+  } else {
+    uint64_t start = Now();
+    mutex_.lock();
+    RecordAcquisition(this, nullptr, 0, Now() - start, unknown_site, 0);
+  }
+}
+
+std::string Report()
+{
+  uint32_t one_in = sampling.load(std::memory_order_relaxed);
+  profile_data& profile = Profile();
+  std::lock_guard l(profile.mutex);
+  if (one_in == 0 && profile.locks.empty()) { return {}; }
+
+  std::vector<const lock_stats*> locks;
+  for (auto& [lock, stats] : profile.locks) { locks.push_back(&stats); }
+  std::sort(locks.begin(), locks.end(),
+            [](const lock_stats* a, const lock_stats* b) {
+              return a->wait_ns > b->wait_ns;
+            });
+
+  std::string out = "Lock contention profile";
+  if (one_in == 0) {
+    out += " (sampling switched off):\n";
+  } else {
+    out += " (1 in " + std::to_string(one_in) + " acquisitions sampled):\n";
+  }
+  for (const lock_stats* stats : locks) {
+    out += "  " + stats->name + ": sampled=" + std::to_string(stats->sampled)
+           + " waited=" + std::to_string(stats->contended);
+    if (stats->contended == 0) {
+      out += "\n";
+      continue;
+    }
+    out += " wait=" + FormatWait(stats->wait_ns)
+           + " max=" + FormatWait(stats->max_wait_ns) + "\n   ";
+    for (std::size_t i = 0; i < stats->waits.size(); ++i) {
+      if (stats->waits[i] == 0) { continue; }
+      out += std::string{" "} + wait_labels[i] + ":"
+             + std::to_string(stats->waits[i]);
+    }
+    out += "\n";
+
+    std::vector<std::pair<site, uint64_t>> holders(stats->holders.begin(),
+                                                   stats->holders.end());
+    std::sort(holders.begin(), holders.end(),
+              [](const auto& a, const auto& b) { return a.second > b.second; });
+    if (holders.size() > 5) { holders.resize(5); }
+    for (auto& [holder, count] : holders) {
+      out += "    held by " + FormatSite(holder) + ": "
+             + std::to_string(count) + "\n";
+    }
+  }
+  return out;
+}
+
+}  // namespace lock_profile
@@ -0,0 +1,98 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Sampled profile of the contention on locks
+ *
+ * With a sampling of N, one in N acquisitions of every thread through
+ * lock_mutex() and the brwlock_t functions is timed.  For each lock the
+ * profile keeps a histogram of the sampled wait times and the call sites
+ * that held the lock whenever a sampled acquisition had to wait for it.
+ * Locks are shown with the name NameLock() gave them, others with the call
+ * site of their first sampled acquisition.  A sampling of 0, the default,
+ * switches it off and leaves a check of an atomic as the only cost.
+ */
+
+#ifndef BAREOS_LIB_LOCK_PROFILE_H_
+#define BAREOS_LIB_LOCK_PROFILE_H_
+
+#include "include/dll_import_export.h"
+
+#include <pthread.h>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+
+namespace lock_profile {
+
+// 0 or one in how many acquisitions of a thread are sampled
+BAREOS_IMPORT std::atomic<uint32_t> sampling;
+
+inline bool Enabled() { return sampling.load(std::memory_order_relaxed) != 0; }
+
+void SetSampling(uint32_t one_in);
+void NameLock(const void* lock, std::string name);
+// before the memory of a lock gets reused
+void ForgetLock(const void* lock);
+void Reset();
+
+// true for the acquisitions to time, only call while Enabled()
+bool Sample();
+uint64_t Now();
+
+/* a sampled acquisition at file:line that waited wait_ns for the holder at
+ * holder_file:holder_line, holder_file is nullptr when it did not wait and
+ * holder_line 0 when holder_file describes the holder */
+void RecordAcquisition(const void* lock,
+                       const char* file,
+                       uint32_t line,
+                       uint64_t wait_ns,
+                       const char* holder_file = nullptr,
+                       uint32_t holder_line = 0);
+
+// locks m like pthread_mutex_lock(), profiling it while Enabled()
+int LockMutex(pthread_mutex_t& m, const char* file, uint32_t line);
+
+/* A std::mutex that profiles its waits under the name it was given.  As it
+ * mostly gets locked by std::unique_lock, it does not know its call sites. */
+class mutex {
+ public:
+  explicit mutex(std::string name) { NameLock(this, std::move(name)); }
+  ~mutex() { ForgetLock(this); }
+  mutex(const mutex&) = delete;
+  mutex& operator=(const mutex&) = delete;
+
+  void lock();
+  bool try_lock() { return mutex_.try_lock(); }
+  void unlock() { mutex_.unlock(); }
+
+ private:
+  std::mutex mutex_;
+};
+
+// the profile of all locks by their total wait time, empty if switched off
+std::string Report();
+
+}  // namespace lock_profile
+
+#endif  // BAREOS_LIB_LOCK_PROFILE_H_
@@ -23,12 +23,15 @@
 
 #include "include/bareos.h"
 #include "lib/berrno.h"
+#include "lib/lock_profile.h"
 #include <cstddef>
 
 void lock_mutex_impl(pthread_mutex_t& m, const char* file, std::size_t line)
 {
-  int errstat;
-  if ((errstat = pthread_mutex_lock(&m))) {
+  int errstat = lock_profile::Enabled()
+                    ? lock_profile::LockMutex(m, file, line)
+                    : pthread_mutex_lock(&m);
+  if (errstat) {
     BErrNo be;
     e_msg(file, line, M_ABORT, 0, T_("Mutex lock failure. ERR=%s\n"),
           be.bstrerror(errstat));
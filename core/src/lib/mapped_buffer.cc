@@ -0,0 +1,99 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "include/bareos.h"
+#include "lib/mapped_buffer.h"
+
+#include <algorithm>
+#include <string>
+
+#if defined(HAVE_POSIX_FALLOCATE) && !defined(HAVE_WIN32)
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <unistd.h>
+#  define HAVE_MAPPED_BUFFER 1
+#endif
+
+// the file grows by at least this much at a time
+static constexpr std::size_t region_size = 64 * 1024 * 1024;
+
+static std::size_t AlignedSize(std::size_t size)
+{
+  constexpr std::size_t mod = alignof(max_align_t);
+  return (size + mod - 1) / mod * mod;
+}
+
+MappedBuffer::~MappedBuffer()
+{
+#if defined(HAVE_MAPPED_BUFFER)
+  for (Region& region : regions_) { munmap(region.base, region.size); }
+  if (fd_ >= 0) { close(fd_); }
+#endif
+}
+
+bool MappedBuffer::Open(const char* directory)
+{
+#if defined(HAVE_MAPPED_BUFFER)
+  std::string name = std::string{directory} + "/bareos-mapped.XXXXXX";
+  fd_ = mkstemp(name.data());
+  if (fd_ < 0) { return false; }
+  unlink(name.c_str());
+  return true;
+#else
+  (void)directory;
+  return false;
+#endif
+}
+
+void* MappedBuffer::allocate(std::size_t size)
+{
+  size = AlignedSize(size);
+  if (size > rem_) {
+#if defined(HAVE_MAPPED_BUFFER)
+    if (fd_ < 0 || full_) { return nullptr; }
+
+    std::size_t page_size = sysconf(_SC_PAGESIZE);
+    std::size_t grow = std::max(region_size,
+                                (size + page_size - 1) / page_size * page_size);
+    void* base = MAP_FAILED;
+    if (posix_fallocate(fd_, file_size_, grow) == 0) {
+      base = mmap(nullptr, grow, PROT_READ | PROT_WRITE, MAP_SHARED, fd_,
+                  file_size_);
+    }
+    if (base == MAP_FAILED) {
+      full_ = true;
+      return nullptr;
+    }
+
+    regions_.push_back({static_cast<char*>(base), grow});
+    file_size_ += grow;
+    mem_ = static_cast<char*>(base);
+    rem_ = grow;
+#else
+    return nullptr;
+#endif
+  }
+
+  void* buf = mem_;
+  mem_ += size;
+  rem_ -= size;
+  return buf;
+}
@@ -0,0 +1,61 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#ifndef BAREOS_LIB_MAPPED_BUFFER_H_
+#define BAREOS_LIB_MAPPED_BUFFER_H_
+
+#include <cstddef>
+#include <vector>
+
+/* Like a MonotonicBuffer, but the memory is a shared mapping of a temporary
+ * file.  Its pages are written back to the file instead of the swap space when
+ * memory gets short, so a structure that is bigger than the memory only keeps
+ * its recently used parts there.  The file is removed right after it was
+ * created; its space is reserved before a region is mapped, so a full disk
+ * makes allocate() fail instead of the process when the page is written. */
+class MappedBuffer {
+ public:
+  MappedBuffer() = default;
+  ~MappedBuffer();
+  MappedBuffer(const MappedBuffer&) = delete;
+  MappedBuffer& operator=(const MappedBuffer&) = delete;
+
+  // creates the file in directory, false if that is not possible
+  bool Open(const char* directory);
+  // nullptr once the file cannot grow
+  void* allocate(std::size_t size);
+  std::size_t file_size() const { return file_size_; }
+
+ private:
+  struct Region {
+    char* base;
+    std::size_t size;
+  };
+
+  int fd_{-1};
+  bool full_{false};
+  std::size_t file_size_{0};
+  std::vector<Region> regions_;
+  char* mem_{nullptr};
+  std::size_t rem_{0};
+};
+
+#endif  // BAREOS_LIB_MAPPED_BUFFER_H_
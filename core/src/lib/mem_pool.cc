@@ -22,7 +22,8 @@
 /*
  * Historically, the following was may have been true, but nowadays operating
  * systems are a lot better at handling memory than we are, so the pooling has
- * been removed.
+ * been removed.  (It is back as size classes, see below, because the heap
+ * of long running daemons still fragments.)
  *
  * Andreas Rogge
  */
@@ -49,18 +50,56 @@
 
 #include <stdarg.h>
 #include <string.h>
+#if defined(__GLIBC__)
+#  include <malloc.h>
+#endif
+#if !defined(HAVE_WIN32)
+#  include <sys/mman.h>
+#  include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <ctime>
+#include <mutex>
+#include <new>
+#include <vector>
 
 #include "lib/util.h"
 #include "include/baconfig.h"
 
+/*
+ * POOLMEM buffers are handed out in size classes, so that long running
+ * daemons reuse the same buffers instead of fragmenting the heap with ever
+ * changing sizes.  The small classes are carved out of slabs, the bigger ones
+ * are single allocations that are kept for reuse.  Every thread keeps a few
+ * free buffers of each class, so most requests do not take a lock.  Slabs and
+ * buffers that were not needed for a while are given back.
+ */
+struct slab;
+
+// owner of the buffers that got pages of their own, see GetBufferMemory()
+static slab* const mapped_owner = reinterpret_cast<slab*>(alignof(slab*));
+
 // Memory allocation control structures and storage.
 struct abufhead {
+  slab* owner;       /* Slab of the buffer, nullptr if it was malloc()ed,
+                      * mapped_owner if it was mmap()ed */
   int32_t ablen;     /* Buffer length in bytes */
   int32_t bnet_size; /* dummy for BnetSend() */
 };
 
 constexpr int32_t HEAD_SIZE{BALIGN(sizeof(struct abufhead))};
 
+// keep the sanitizers able to see every buffer on its own
+#if defined(__SANITIZE_ADDRESS__)
+#  define POOLMEM_USE_MALLOC
+#elif defined(__has_feature)
+#  if __has_feature(address_sanitizer)
+#    define POOLMEM_USE_MALLOC
+#  endif
+#endif
+
 /*
  * Special version of error reporting using a static buffer so we don't use
  * the normal error reporting which uses dynamic memory e.g. recursivly calls
@@ -92,6 +131,421 @@ static abufhead* GetPmHeader(POOLMEM* pm_ptr) noexcept
   return static_cast<abufhead*>(static_cast<void*>(pm_ptr - HEAD_SIZE));
 }
 
+static POOLMEM* GetPmBuffer(abufhead* head) noexcept
+{
+  return static_cast<POOLMEM*>(static_cast<void*>(head)) + HEAD_SIZE;
+}
+
+static void* AllocOrDie(std::size_t size) noexcept
+{
+  void* ptr = malloc(size);
+  if (ptr == NULL) {
+    MemPoolErrorMessage(__FILE__, __LINE__,
+                        T_("Out of memory requesting %d bytes\n"), (int)size);
+  }
+  return ptr;
+}
+
+namespace {
+/* The classes match the common requests: the pool sizes of GetPoolMemory()
+ * and powers of two above that.  The bigger classes have some headroom, so
+ * that a default block (64512 bytes) or a network buffer of
+ * DEFAULT_NETWORK_BUFFER_SIZE plus the compression overhead still fits. */
+constexpr int32_t class_capacity[] = {
+    128,
+    BALIGN(MAX_NAME_LENGTH + 2),
+    256,
+    512,
+    1024,
+    2048,
+    4096,
+    8192 + 128,
+    16384 + 256,
+    32768 + 512,
+    65536 + 1024,
+    131072 + 2048,
+    262144 + 4096,
+    524288 + 8192,
+    1048576 + 16384,
+};
+constexpr int num_classes = sizeof(class_capacity) / sizeof(class_capacity[0]);
+// the classes before this one are carved out of slabs
+constexpr int first_large_class = 7;
+constexpr std::size_t slab_size = 64 * 1024;
+
+// a thread keeps at most this many bytes of free buffers of every class
+constexpr std::size_t thread_cache_bytes = 256 * 1024;
+constexpr int max_thread_cached = 32;
+// slabs and buffers that were not needed for this long are given back
+constexpr time_t idle_release_interval = 60;
+
+int ClassFor(int32_t size)
+{
+  for (int cls = 0; cls < num_classes; ++cls) {
+    if (size <= class_capacity[cls]) { return cls; }
+  }
+  return -1;
+}
+
+constexpr std::size_t Stride(int cls)
+{
+  return HEAD_SIZE + class_capacity[cls];
+}
+
+constexpr int ThreadCacheSize(int cls)
+{
+  std::size_t fit = thread_cache_bytes / Stride(cls);
+  return fit < max_thread_cached ? static_cast<int>(fit) : max_thread_cached;
+}
+}  // namespace
+
+struct slab {
+  slab* prev{nullptr};
+  slab* next{nullptr};
+  abufhead* free_list{nullptr}; /* next pointer is kept in the buffer */
+  std::size_t free{0};
+  std::size_t capacity{0};
+};
+
+namespace {
+struct slab_list {
+  slab* head{nullptr};
+  std::size_t size{0};
+
+  void push(slab* s)
+  {
+    s->prev = nullptr;
+    s->next = head;
+    if (head) { head->prev = s; }
+    head = s;
+    size += 1;
+  }
+  void remove(slab* s)
+  {
+    if (s->prev) {
+      s->prev->next = s->next;
+    } else {
+      head = s->next;
+    }
+    if (s->next) { s->next->prev = s->prev; }
+    s->prev = s->next = nullptr;
+    size -= 1;
+  }
+};
+
+struct size_class {
+  std::mutex mutex;
+  slab_list partial;            /* slabs with some free buffers */
+  slab_list empty;              /* slabs without any buffer in use */
+  std::vector<abufhead*> large; /* free buffers of the large classes */
+  std::size_t min_unused{0};    /* fewest empty slabs/large buffers since
+                                 * the last release */
+  uint64_t held_bytes{0};
+  uint64_t cached_bytes{0};
+};
+
+struct allocator {
+  size_class classes[num_classes];
+  std::atomic<time_t> next_release{0};
+  std::atomic<uint64_t> huge_bytes{0};
+  std::atomic<uint64_t> released_bytes{0};
+  std::atomic<uint64_t> mapped_bytes{0};
+};
+
+// never destroyed, buffers may still be freed while the daemon exits
+allocator& Allocator()
+{
+  static allocator* alloc = new allocator;
+  return *alloc;
+}
+
+std::size_t Unused(int cls, size_class& sc)
+{
+  return cls < first_large_class ? sc.empty.size : sc.large.size();
+}
+
+// Takes up to count buffers of the class from the shared state.
+int TakeBuffers(int cls, abufhead** out, int count)
+{
+  size_class& sc = Allocator().classes[cls];
+  int taken = 0;
+  slab* fresh = nullptr;
+  if (cls < first_large_class) {
+    {
+      std::unique_lock lock(sc.mutex);
+      if (!sc.partial.head && !sc.empty.head) {
+        lock.unlock();
+        // never call malloc() with the lock held, it might report an error
+        void* mem = AllocOrDie(slab_size);
+        fresh = new (mem) slab;
+        std::size_t first = BALIGN(sizeof(slab));
+        fresh->capacity = (slab_size - first) / Stride(cls);
+        for (std::size_t i = fresh->capacity; i-- > 0;) {
+          auto* head = static_cast<abufhead*>(static_cast<void*>(
+              static_cast<char*>(mem) + first + i * Stride(cls)));
+          head->owner = fresh;
+          *reinterpret_cast<abufhead**>(GetPmBuffer(head)) = fresh->free_list;
+          fresh->free_list = head;
+        }
+        fresh->free = fresh->capacity;
+        lock.lock();
+        sc.empty.push(fresh);
+        sc.held_bytes += slab_size;
+        sc.cached_bytes += fresh->capacity * Stride(cls);
+      }
+
+      while (taken < count) {
+        slab* s = sc.partial.head;
+        if (!s) {
+          s = sc.empty.head;
+          if (!s) { break; }
+          sc.empty.remove(s);
+          sc.partial.push(s);
+          if (sc.empty.size < sc.min_unused) { sc.min_unused = sc.empty.size; }
+        }
+        while (taken < count && s->free > 0) {
+          abufhead* head = s->free_list;
+          s->free_list = *reinterpret_cast<abufhead**>(GetPmBuffer(head));
+          s->free -= 1;
+          out[taken++] = head;
+        }
+        if (s->free == 0) { sc.partial.remove(s); }
+      }
+      sc.cached_bytes -= taken * Stride(cls);
+    }
+  } else {
+    {
+      std::unique_lock lock(sc.mutex);
+      while (taken < count && !sc.large.empty()) {
+        out[taken++] = sc.large.back();
+        sc.large.pop_back();
+      }
+      if (sc.large.size() < sc.min_unused) { sc.min_unused = sc.large.size(); }
+      sc.cached_bytes -= taken * Stride(cls);
+      if (taken == 0) { sc.held_bytes += Stride(cls); }
+    }
+    if (taken == 0) {
+      auto* head = static_cast<abufhead*>(AllocOrDie(Stride(cls)));
+      head->owner = nullptr;
+      out[taken++] = head;
+    }
+  }
+  return taken;
+}
+
+void ReleaseUnused(bool everything);
+
+// Gives buffers of the class back to the shared state.
+void ReturnBuffers(int cls, abufhead** buffers, int count)
+{
+  allocator& alloc = Allocator();
+  size_class& sc = alloc.classes[cls];
+  {
+    std::unique_lock lock(sc.mutex);
+    for (int i = 0; i < count; ++i) {
+      abufhead* head = buffers[i];
+      if (cls < first_large_class) {
+        slab* s = head->owner;
+        *reinterpret_cast<abufhead**>(GetPmBuffer(head)) = s->free_list;
+        s->free_list = head;
+        s->free += 1;
+        if (s->free == 1) { sc.partial.push(s); }
+        if (s->free == s->capacity) {
+          sc.partial.remove(s);
+          sc.empty.push(s);
+        }
+      } else {
+        sc.large.push_back(head);
+      }
+    }
+    sc.cached_bytes += count * Stride(cls);
+  }
+
+  time_t now = time(nullptr);
+  time_t next = alloc.next_release.load(std::memory_order_relaxed);
+  if (now >= next
+      && alloc.next_release.compare_exchange_strong(
+          next, now + idle_release_interval, std::memory_order_relaxed)) {
+    // the first call only starts the clock
+    if (next != 0) { ReleaseUnused(false); }
+  }
+}
+
+/* Frees the slabs and buffers that nobody needed since the last call (or all
+ * unused ones) and asks the c library to give the memory back to the os. */
+void ReleaseUnused(bool everything)
+{
+  allocator& alloc = Allocator();
+  uint64_t released = 0;
+  for (int cls = 0; cls < num_classes; ++cls) {
+    size_class& sc = alloc.classes[cls];
+    std::vector<void*> to_free;
+    {
+      std::unique_lock lock(sc.mutex);
+      std::size_t unused = Unused(cls, sc);
+      std::size_t num = everything ? unused : std::min(sc.min_unused, unused);
+      for (std::size_t i = 0; i < num; ++i) {
+        if (cls < first_large_class) {
+          slab* s = sc.empty.head;
+          sc.empty.remove(s);
+          sc.cached_bytes -= s->capacity * Stride(cls);
+          sc.held_bytes -= slab_size;
+          released += slab_size;
+          to_free.push_back(s);
+        } else {
+          to_free.push_back(sc.large.back());
+          sc.large.pop_back();
+          sc.cached_bytes -= Stride(cls);
+          sc.held_bytes -= Stride(cls);
+          released += Stride(cls);
+        }
+      }
+      sc.min_unused = Unused(cls, sc);
+    }
+    for (void* mem : to_free) { free(mem); }
+  }
+
+  if (released > 0) {
+    alloc.released_bytes.fetch_add(released, std::memory_order_relaxed);
+#if defined(__GLIBC__)
+    malloc_trim(0);
+#endif
+  }
+}
+
+struct thread_cache {
+  abufhead* buffers[num_classes][max_thread_cached];
+  int count[num_classes]{};
+
+  ~thread_cache();
+};
+
+// trivially destructible, so it is still usable while the thread exits
+thread_local bool thread_cache_gone = false;
+thread_local thread_cache cache;
+
+thread_cache::~thread_cache()
+{
+  thread_cache_gone = true;
+  for (int cls = 0; cls < num_classes; ++cls) {
+    if (count[cls] > 0) { ReturnBuffers(cls, buffers[cls], count[cls]); }
+  }
+}
+
+abufhead* AllocateBuffer(int cls)
+{
+  abufhead* head;
+  if (thread_cache_gone || ThreadCacheSize(cls) == 0) {
+    TakeBuffers(cls, &head, 1);
+    return head;
+  }
+  int& count = cache.count[cls];
+  if (count == 0) {
+    count = TakeBuffers(cls, cache.buffers[cls],
+                        std::max(1, ThreadCacheSize(cls) / 2));
+  }
+  return cache.buffers[cls][--count];
+}
+
+void FreeBuffer(int cls, abufhead* head)
+{
+  if (thread_cache_gone || ThreadCacheSize(cls) == 0) {
+    ReturnBuffers(cls, &head, 1);
+    return;
+  }
+  int& count = cache.count[cls];
+  if (count == ThreadCacheSize(cls)) {
+    // keep the most recently used half
+    int keep = count / 2;
+    ReturnBuffers(cls, cache.buffers[cls], count - keep);
+    std::copy(cache.buffers[cls] + count - keep, cache.buffers[cls] + count,
+              cache.buffers[cls]);
+    count = keep;
+  }
+  cache.buffers[cls][count++] = head;
+}
+}  // namespace
+
+namespace {
+#if !defined(HAVE_WIN32)
+constexpr std::size_t huge_page_size = 2 * 1024 * 1024;
+std::atomic<bool> huge_page_buffers{false};
+
+std::size_t MappedLength(int32_t size)
+{
+  std::size_t len = HEAD_SIZE + static_cast<std::size_t>(size);
+  return (len + huge_page_size - 1) / huge_page_size * huge_page_size;
+}
+
+/* Maps len bytes from the reserved huge pages, or if there are none as
+ * transparent huge pages, and faults them all in right away.  The kernel
+ * takes pages from the numa node of the thread that touches them first, so
+ * the buffer ends up on the node of the caller. */
+void* MapPages(std::size_t len)
+{
+#  if defined(MAP_HUGETLB) && defined(MAP_POPULATE)
+  void* mapped
+      = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+  if (mapped != MAP_FAILED) { return mapped; }
+#  endif
+
+  // map a huge page more, so that the buffer can start at a boundary
+  void* raw = mmap(nullptr, len + huge_page_size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (raw == MAP_FAILED) { return nullptr; }
+  char* start = static_cast<char*>(raw);
+  std::size_t skip = (huge_page_size
+                      - reinterpret_cast<uintptr_t>(start) % huge_page_size)
+                     % huge_page_size;
+  if (skip > 0) { munmap(start, skip); }
+  munmap(start + skip + len, huge_page_size - skip);
+  char* mem = start + skip;
+#  if defined(MADV_HUGEPAGE)
+  madvise(mem, len, MADV_HUGEPAGE);
+#  endif
+  std::size_t page_size = sysconf(_SC_PAGESIZE);
+  for (std::size_t offset = 0; offset < len; offset += page_size) {
+    mem[offset] = 0;
+  }
+  return mem;
+}
+
+void UnmapBuffer(abufhead* head)
+{
+  std::size_t len = MappedLength(head->ablen);
+  Allocator().mapped_bytes.fetch_sub(len, std::memory_order_relaxed);
+  munmap(head, len);
+}
+#endif
+}  // namespace
+
+void SetHugePageBuffers([[maybe_unused]] bool enabled) noexcept
+{
+#if !defined(HAVE_WIN32)
+  huge_page_buffers.store(enabled, std::memory_order_relaxed);
+#endif
+}
+
+POOLMEM* GetBufferMemory(int32_t size) noexcept
+{
+#if !defined(POOLMEM_USE_MALLOC) && !defined(HAVE_WIN32)
+  // smaller buffers would waste most of their pages
+  if (huge_page_buffers.load(std::memory_order_relaxed)
+      && static_cast<std::size_t>(size) >= huge_page_size / 2) {
+    std::size_t len = MappedLength(size);
+    if (void* mem = MapPages(len)) {
+      auto* head = static_cast<abufhead*>(mem);
+      head->owner = mapped_owner;
+      head->ablen = size;
+      Allocator().mapped_bytes.fetch_add(len, std::memory_order_relaxed);
+      return GetPmBuffer(head);
+    }
+  }
+#endif
+  return GetMemory(size);
+}
+
 POOLMEM* GetPoolMemory(int pool) noexcept
 {
   static constexpr int32_t pool_init_size[] = {
@@ -108,14 +562,19 @@ POOLMEM* GetPoolMemory(int pool) noexcept
 
 POOLMEM* GetMemory(int32_t size) noexcept
 {
-  char* buf = static_cast<char*>(malloc(size + HEAD_SIZE));
-  if (buf == NULL) {
-    MemPoolErrorMessage(__FILE__, __LINE__,
-                        T_("Out of memory requesting %d bytes\n"), size);
+  abufhead* head;
+#if !defined(POOLMEM_USE_MALLOC)
+  if (int cls = ClassFor(size); cls >= 0) {
+    head = AllocateBuffer(cls);
+  } else
+#endif
+  {
+    head = static_cast<abufhead*>(AllocOrDie(size + HEAD_SIZE));
+    head->owner = nullptr;
+    Allocator().huge_bytes.fetch_add(size, std::memory_order_relaxed);
   }
-  POOLMEM* pm_ptr = static_cast<POOLMEM*>(buf + HEAD_SIZE);
-  GetPmHeader(pm_ptr)->ablen = size;
-  return pm_ptr;
+  head->ablen = size;
+  return GetPmBuffer(head);
 }
 
 int32_t SizeofPoolMemory(POOLMEM* obuf) noexcept
@@ -126,11 +585,40 @@ int32_t SizeofPoolMemory(POOLMEM* obuf) noexcept
 POOLMEM* ReallocPoolMemory(POOLMEM* obuf, int32_t size) noexcept
 {
   struct abufhead* old_abuf_ptr = GetPmHeader(obuf);
+  int32_t old_size = old_abuf_ptr->ablen;
+#if !defined(HAVE_WIN32)
+  if (old_abuf_ptr->owner == mapped_owner) {
+    if (MappedLength(size) == MappedLength(old_size)) {
+      old_abuf_ptr->ablen = size;
+      return obuf;
+    }
+    POOLMEM* new_pm_ptr = GetBufferMemory(size);
+    memcpy(new_pm_ptr, obuf, std::min(old_size, size));
+    FreePoolMemory(obuf);
+    return new_pm_ptr;
+  }
+#endif
+#if !defined(POOLMEM_USE_MALLOC)
+  int old_cls = ClassFor(old_size);
+  int new_cls = ClassFor(size);
+  if (old_cls >= 0 && old_cls == new_cls) {
+    // the buffer already has room for it
+    old_abuf_ptr->ablen = size;
+    return obuf;
+  }
+  if (old_cls >= 0 || new_cls >= 0) {
+    POOLMEM* new_pm_ptr = GetMemory(size);
+    memcpy(new_pm_ptr, obuf, std::min(old_size, size));
+    FreePoolMemory(obuf);
+    return new_pm_ptr;
+  }
+#endif
   char* buf = static_cast<char*>(realloc(old_abuf_ptr, size + HEAD_SIZE));
   if (buf == NULL) {
     MemPoolErrorMessage(__FILE__, __LINE__,
                         T_("Out of memory requesting %d bytes\n"), size);
   }
+  Allocator().huge_bytes.fetch_add(size - old_size, std::memory_order_relaxed);
   POOLMEM* new_pm_ptr = static_cast<POOLMEM*>(buf + HEAD_SIZE);
   GetPmHeader(new_pm_ptr)->ablen = size;
   return new_pm_ptr;
@@ -142,7 +630,53 @@ POOLMEM* CheckPoolMemorySize(POOLMEM* obuf, int32_t size) noexcept
   return ReallocPoolMemory(obuf, size);
 }
 
-void FreePoolMemory(POOLMEM* obuf) noexcept { free(GetPmHeader(obuf)); }
+void FreePoolMemory(POOLMEM* obuf) noexcept
+{
+  abufhead* head = GetPmHeader(obuf);
+#if !defined(HAVE_WIN32)
+  if (head->owner == mapped_owner) {
+    UnmapBuffer(head);
+    return;
+  }
+#endif
+#if !defined(POOLMEM_USE_MALLOC)
+  if (int cls = ClassFor(head->ablen); cls >= 0) {
+    FreeBuffer(cls, head);
+    return;
+  }
+#endif
+  Allocator().huge_bytes.fetch_sub(head->ablen, std::memory_order_relaxed);
+  free(head);
+}
+
+pool_memory_stats GetPoolMemoryStats() noexcept
+{
+  allocator& alloc = Allocator();
+  pool_memory_stats stats{};
+  for (auto& sc : alloc.classes) {
+    std::unique_lock lock(sc.mutex);
+    stats.held_bytes += sc.held_bytes;
+    stats.cached_bytes += sc.cached_bytes;
+  }
+  stats.huge_bytes = alloc.huge_bytes.load(std::memory_order_relaxed);
+  stats.released_bytes = alloc.released_bytes.load(std::memory_order_relaxed);
+  stats.mapped_bytes = alloc.mapped_bytes.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void ReleaseIdlePoolMemory() noexcept
+{
+  if (!thread_cache_gone) {
+    for (int cls = 0; cls < num_classes; ++cls) {
+      if (cache.count[cls] > 0) {
+        ReturnBuffers(cls, cache.buffers[cls], cache.count[cls]);
+        cache.count[cls] = 0;
+      }
+    }
+  }
+  ReleaseUnused(true);
+}
+
 
 /*
  * Concatenate a string (str) onto a pool memory buffer pm
@@ -41,6 +41,23 @@ POOLMEM* CheckPoolMemorySize(POOLMEM* buf, int32_t size) noexcept;
 void FreePoolMemory(POOLMEM* buf) noexcept;
 inline void FreeMemory(POOLMEM* buf) noexcept { FreePoolMemory(buf); }
 
+/* For big data buffers like device blocks: when enabled, buffers of at
+ * least a megabyte get 2 MiB pages of their own, taken from the numa node
+ * of the calling thread.  Everything else works as with GetMemory(). */
+void SetHugePageBuffers(bool enabled) noexcept;
+POOLMEM* GetBufferMemory(int32_t size) noexcept;
+
+struct pool_memory_stats {
+  uint64_t held_bytes;     /* slabs and buffers kept in size classes */
+  uint64_t cached_bytes;   /* part of held_bytes ready for reuse */
+  uint64_t huge_bytes;     /* buffers bigger than the biggest class */
+  uint64_t released_bytes; /* given back since the start */
+  uint64_t mapped_bytes;   /* pages of buffers from GetBufferMemory() */
+};
+pool_memory_stats GetPoolMemoryStats() noexcept;
+// give all cached buffers that are not in use back to the os
+void ReleaseIdlePoolMemory() noexcept;
+
 // Macro to simplify free/reset pointers
 #define FreeAndNullPoolMemory(a) \
   do {                           \
@@ -31,6 +31,8 @@
  * Kern Sibbald, April 2000
  */
 
+#include <algorithm>
+#include <atomic>
 #include <vector>
 #if !defined(HAVE_MSVC)
 #  include <unistd.h>
@@ -49,6 +51,7 @@
 #include "lib/messages_resource.h"
 #include "lib/message_destination_info.h"
 #include "lib/message_queue_item.h"
+#include "lib/message_delivery.h"
 #include "lib/thread_specific_data.h"
 #include "lib/bpipe.h"
 
@@ -291,26 +294,31 @@ static void MakeUniqueMailFilename(JobControlRecord* jcr,
   Dmsg1(850, "mailname=%s\n", name);
 }
 
-static Bpipe* open_mail_pipe(JobControlRecord* jcr,
-                             POOLMEM*& cmd,
-                             MessageDestinationInfo* d)
+// Returns false if there is no mail command to use
+static bool MakeMailCommand(JobControlRecord* jcr,
+                            POOLMEM*& cmd,
+                            MessageDestinationInfo* d)
 {
-  Bpipe* bpipe;
-
   if (!d->mail_cmd_.empty()) {
     cmd = edit_job_codes(jcr, cmd, d->mail_cmd_.c_str(), d->where_.c_str(),
                          message_job_code_callback);
   } else {
 #ifdef HAVE_WIN32
-    return nullptr;
+    return false;
 #else
     Mmsg(cmd, "/usr/lib/sendmail -F BAREOS %s", d->where_.c_str());
 #endif
   }
+  return true;
+}
+
+static Bpipe* OpenMailCommand(const char* cmd, bool add_subject)
+{
+  Bpipe* bpipe;
 
   if ((bpipe = OpenBpipe(cmd, 120, "rw"))) {
     // If we had to use sendmail, add subject
-    if (d->mail_cmd_.empty()) {
+    if (add_subject) {
       fprintf(bpipe->wfd, "Subject: %s\r\n\r\n", T_("BAREOS Message"));
     }
   } else {
@@ -322,6 +330,17 @@ static Bpipe* open_mail_pipe(JobControlRecord* jcr,
   return bpipe;
 }
 
+static Bpipe* open_mail_pipe(JobControlRecord* jcr,
+                             POOLMEM*& cmd,
+                             MessageDestinationInfo* d)
+{
+  if (!MakeMailCommand(jcr, cmd, d)) { return nullptr; }
+  return OpenMailCommand(cmd, d->mail_cmd_.empty());
+}
+
+static void FlushCatalogDelivery();
+static void StopMessageDelivery();
+
 /*
  * Close the messages for this Messages resource, which means to close
  * any open files, and dispatch any pending email messages.
@@ -335,6 +354,9 @@ void CloseMsg(JobControlRecord* jcr)
 
   Dmsg1(580, "Close_msg jcr=%p\n", jcr);
 
+  // queued catalog messages refer to the jcr
+  if (jcr) { FlushCatalogDelivery(); }
+
   if (jcr == NULL) { /* NULL -> global chain */
     msgs = daemon_msgs;
   } else {
@@ -478,6 +500,7 @@ void CloseMsg(JobControlRecord* jcr)
 void TermMsg()
 {
   Dmsg0(850, "Enter TermMsg\n");
+  StopMessageDelivery();
   CloseMsg(NULL);     /* close global chain */
   delete daemon_msgs; /* f ree the resources */
   daemon_msgs = NULL;
@@ -603,6 +626,151 @@ void RegisterSyslogCallback(SyslogCallback c) { SendToSyslog = c; }
 static DbLogInsertCallback SendToDbLog = NULL;
 void SetDbLogInsertCallback(DbLogInsertCallback f) { SendToDbLog = f; }
 
+static DbLogBatchInsertCallback SendBatchToDbLog = NULL;
+void SetDbLogBatchInsertCallback(DbLogBatchInsertCallback f)
+{
+  SendBatchToDbLog = f;
+}
+
+namespace {
+struct operator_message {
+  std::string cmd;
+  bool add_subject;
+  std::string text;
+};
+
+struct syslog_message {
+  int priority;
+  std::string text;
+};
+
+struct catalog_message {
+  JobControlRecord* jcr;
+  utime_t mtime;
+  std::string text;
+};
+
+/* Senders wait when this many operator or syslog messages are queued.  A
+ * catalog message is written by its sender instead, as the sender might
+ * hold the database lock the delivery thread waits for. */
+constexpr std::size_t message_delivery_capacity = 1000;
+}  // namespace
+
+// Runs cmd once and feeds it the texts of all the messages
+static void SendOperatorMail(const operator_message* first,
+                             const operator_message* last)
+{
+  Bpipe* bpipe = OpenMailCommand(first->cmd.c_str(), first->add_subject);
+  if (!bpipe) { return; }
+
+  for (const operator_message* m = first; m != last; ++m) {
+    fputs(m->text.c_str(), bpipe->wfd);
+  }
+  int status = CloseBpipe(bpipe);
+  if (status != 0) {
+    BErrNo be;
+    be.SetErrno(status);
+    DeliveryError(T_("Msg delivery error: Operator mail program "
+                     "terminated in error.\n"
+                     "CMD=%s\nERR=%s\n"),
+                  first->cmd.c_str(), be.bstrerror());
+  }
+}
+
+// successive messages for the same command are sent as one mail
+static message_delivery_queue<operator_message> operator_delivery{
+    "operator", message_delivery_capacity,
+    [](std::vector<operator_message>& batch) {
+      const operator_message* first = batch.data();
+      const operator_message* end = batch.data() + batch.size();
+      while (first != end) {
+        const operator_message* last = first + 1;
+        while (last != end && last->cmd == first->cmd
+               && last->add_subject == first->add_subject) {
+          ++last;
+        }
+        SendOperatorMail(first, last);
+        first = last;
+      }
+    }};
+
+static message_delivery_queue<syslog_message> syslog_delivery{
+    "syslog", message_delivery_capacity,
+    [](std::vector<syslog_message>& batch) {
+      for (auto& m : batch) { SendToSyslog(m.priority, m.text.c_str()); }
+    }};
+
+static bool LogToCatalog(JobControlRecord* jcr, utime_t mtime, const char* msg)
+{
+  if (SendToDbLog && !SendToDbLog(jcr, mtime, msg)) {
+    DeliveryError(
+        T_("Msg delivery error: Unable to store data in database.\n"));
+    return false;
+  }
+  return true;
+}
+
+// the messages of each job in the batch go into the catalog together
+static void LogBatchToCatalog(std::vector<catalog_message>& batch)
+{
+  if (!SendBatchToDbLog) {
+    for (auto& m : batch) { LogToCatalog(m.jcr, m.mtime, m.text.c_str()); }
+    return;
+  }
+
+  std::stable_sort(batch.begin(), batch.end(),
+                   [](const catalog_message& a, const catalog_message& b) {
+                     return std::less<JobControlRecord*>{}(a.jcr, b.jcr);
+                   });
+  std::vector<db_log_message> messages;
+  auto first = batch.begin();
+  while (first != batch.end()) {
+    messages.clear();
+    auto last = first;
+    for (; last != batch.end() && last->jcr == first->jcr; ++last) {
+      messages.push_back({last->mtime, last->text.c_str()});
+    }
+    if (!SendBatchToDbLog(first->jcr, messages)) {
+      DeliveryError(
+          T_("Msg delivery error: Unable to store data in database.\n"));
+    }
+    first = last;
+  }
+}
+
+static message_delivery_queue<catalog_message> catalog_delivery{
+    "catalog", message_delivery_capacity, LogBatchToCatalog};
+
+static std::atomic<bool> message_delivery_started{false};
+
+void StartMessageDelivery()
+{
+  operator_delivery.Start();
+  syslog_delivery.Start();
+  catalog_delivery.Start();
+  message_delivery_started = true;
+}
+
+static void StopMessageDelivery()
+{
+  message_delivery_started = false;
+  operator_delivery.Stop();
+  syslog_delivery.Stop();
+  catalog_delivery.Stop();
+}
+
+std::vector<message_delivery_stats> GetMessageDeliveryStats()
+{
+  std::vector<message_delivery_stats> stats;
+  if (!message_delivery_started) { return stats; }
+  stats.push_back(operator_delivery.Stats());
+  stats.push_back(syslog_delivery.Stats());
+  stats.push_back(catalog_delivery.Stats());
+  return stats;
+}
+
+static void FlushCatalogDelivery() { catalog_delivery.Flush(); }
+
 // Handle sending the message to the appropriate place
 void DispatchMessage(JobControlRecord* jcr,
                      int type,
@@ -613,7 +781,6 @@ void DispatchMessage(JobControlRecord* jcr,
   POOLMEM* mcmd;
   int len, dtlen;
   MessagesResource* msgs;
-  Bpipe* bpipe;
   const char* mode;
   bool dt_conversion = false;
 
@@ -686,6 +853,13 @@ void DispatchMessage(JobControlRecord* jcr,
     return;
   }
 
+  /* The process ends after these, so they are not queued.  Catalog messages
+   * are only queued for job message resources, CloseMsg() waits for them
+   * before the jcr goes away. */
+  bool may_queue = message_delivery_started && type != M_ABORT
+                   && type != M_ERROR_TERM;
+  bool may_queue_catalog = may_queue && jcr && msgs == jcr->jcr_msgs;
+
   for (MessageDestinationInfo* d : msgs->dest_chain_) {
     if (BitIsSet(type, d->msg_types_)) {
       /* See if a specific timestamp format was specified for this log resource.
@@ -705,9 +879,9 @@ void DispatchMessage(JobControlRecord* jcr,
           if (!jcr || !jcr->db) { break; }
 
           if (SendToDbLog) {
-            if (!SendToDbLog(jcr, mtime, msg)) {
-              DeliveryError(T_(
-                  "Msg delivery error: Unable to store data in database.\n"));
+            catalog_message m{jcr, mtime, msg};
+            if (!may_queue_catalog || !catalog_delivery.Put(m, false)) {
+              LogToCatalog(jcr, mtime, msg);
             }
           }
           break;
@@ -743,25 +917,24 @@ void DispatchMessage(JobControlRecord* jcr,
 
           /* Dispatch based on our internal message type to a matching syslog
            * one. */
+          if (may_queue) {
+            syslog_message m{
+                d->syslog_facility_ | MessageTypeToLogPriority(type), msg};
+            if (syslog_delivery.Put(m, true)) { break; }
+          }
           SendToSyslog(d->syslog_facility_ | MessageTypeToLogPriority(type),
                        msg);
           break;
         case MessageDestinationCode::kOperator:
           Dmsg1(850, "OPERATOR for following msg: %s\n", msg);
           mcmd = GetPoolMemory(PM_MESSAGE);
-          if ((bpipe = open_mail_pipe(jcr, mcmd, d))) {
-            int status;
-            fputs(dt, bpipe->wfd);
-            fputs(msg, bpipe->wfd);
-            // Messages to the operator go one at a time
-            status = CloseBpipe(bpipe);
-            if (status != 0) {
-              BErrNo be;
-              be.SetErrno(status);
-              DeliveryError(T_("Msg delivery error: Operator mail program "
-                               "terminated in error.\n"
-                               "CMD=%s\nERR=%s\n"),
-                            mcmd, be.bstrerror());
+          if (MakeMailCommand(jcr, mcmd, d)) {
+            /* Messages to the operator go one at a time, unless several
+             * for the same command are waiting in the queue */
+            operator_message m{mcmd, d->mail_cmd_.empty(),
+                               std::string(dt) + msg};
+            if (!may_queue || !operator_delivery.Put(m, true)) {
+              SendOperatorMail(&m, &m + 1);
             }
           }
           FreePoolMemory(mcmd);
@@ -55,6 +55,17 @@ void SetLogTimestampFormat(const char* format);
 using DbLogInsertCallback = std::function<
     bool(JobControlRecord* jcr, utime_t mtime, const char* msg)>;
 void SetDbLogInsertCallback(DbLogInsertCallback f);
+/* Inserts several messages of one job at once.  Queued catalog messages are
+ * handed to it job by job in their order; without it each one is inserted
+ * with the DbLogInsertCallback on its own. */
+struct db_log_message {
+  utime_t mtime;
+  const char* msg;
+};
+using DbLogBatchInsertCallback
+    = std::function<bool(JobControlRecord* jcr,
+                         const std::vector<db_log_message>& messages)>;
+void SetDbLogBatchInsertCallback(DbLogBatchInsertCallback f);
 
 class MessagesResource;
 
@@ -94,4 +105,20 @@ void SetDbType(const char* name);
 using SyslogCallback = std::function<void(int mode, const char* msg)>;
 void RegisterSyslogCallback(SyslogCallback c);
 
+/* Once started, messages to operators, syslog and the catalog are delivered
+ * by one thread per destination type instead of the thread sending them.
+ * TermMsg() delivers what is left and stops the threads. */
+void StartMessageDelivery();
+
+struct message_delivery_stats {
+  const char* destination;
+  uint64_t queued{0};    /* handed to the delivery thread */
+  uint64_t delivered{0}; /* by the delivery thread */
+  uint64_t inline_delivered{0}; /* by the sender, the queue was full */
+  uint64_t waits{0};            /* senders that had to wait for space */
+  std::size_t max_depth{0};
+  std::size_t max_batch{0}; /* most messages delivered in one go */
+};
+std::vector<message_delivery_stats> GetMessageDeliveryStats();
+
 #endif  // BAREOS_LIB_MESSAGE_H_
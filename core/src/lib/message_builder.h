@@ -0,0 +1,105 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+#ifndef BAREOS_LIB_MESSAGE_BUILDER_H_
+#define BAREOS_LIB_MESSAGE_BUILDER_H_
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+
+/* Builds a protocol message in a POOLMEM like Bsnprintf() would, but without
+ * a format string: every piece is appended with its own overload, so a
+ * mismatch between format and argument cannot happen and nothing has to be
+ * parsed at runtime.  Numbers are written with std::to_chars(), chars and
+ * strings are copied as they are (also a char of zero, which separates the
+ * fields of attribute records).  The buffer only grows when the message does
+ * not fit into it, and it is always terminated by a zero that is not part of
+ * size().
+ *
+ *   MessageBuilder m(sd->msg);
+ *   m << jcr->JobFiles << ' ' << stream << " 0";
+ *   sd->message_length = m.size(); */
+class MessageBuilder {
+ public:
+  explicit MessageBuilder(POOLMEM*& buf)
+      : buf_{buf}, capacity_{static_cast<std::size_t>(SizeofPoolMemory(buf))}
+  {
+    Reserve(0);
+    buf_[0] = 0;
+  }
+
+  template <typename T,
+            std::enable_if_t<std::is_integral_v<T>
+                                 && !std::is_same_v<T, char>
+                                 && !std::is_same_v<T, bool>,
+                             int> = 0>
+  MessageBuilder& operator<<(T value)
+  {
+    constexpr std::size_t max_digits = 21; /* 64 bits with sign */
+    Reserve(max_digits);
+    auto result = std::to_chars(buf_ + size_, buf_ + size_ + max_digits, value);
+    size_ = result.ptr - buf_;
+    buf_[size_] = 0;
+    return *this;
+  }
+
+  MessageBuilder& operator<<(char c)
+  {
+    Reserve(1);
+    buf_[size_++] = c;
+    buf_[size_] = 0;
+    return *this;
+  }
+
+  MessageBuilder& operator<<(std::string_view text)
+  {
+    Reserve(text.size());
+    memcpy(buf_ + size_, text.data(), text.size());
+    size_ += text.size();
+    buf_[size_] = 0;
+    return *this;
+  }
+
+  MessageBuilder& operator<<(const char* text)
+  {
+    return *this << std::string_view{text ? text : ""};
+  }
+
+  int32_t size() const { return static_cast<int32_t>(size_); }
+
+ private:
+  void Reserve(std::size_t additional)
+  {
+    std::size_t needed = size_ + additional + 1;
+    if (needed <= capacity_) { return; }
+    needed = std::max(needed, capacity_ + capacity_ / 2);
+    buf_ = CheckPoolMemorySize(buf_, static_cast<int32_t>(needed));
+    capacity_ = SizeofPoolMemory(buf_);
+  }
+
+  POOLMEM*& buf_;
+  std::size_t capacity_;
+  std::size_t size_{0};
+};
+
+#endif  // BAREOS_LIB_MESSAGE_BUILDER_H_
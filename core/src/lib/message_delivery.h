@@ -0,0 +1,172 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * bounded queue with a thread that delivers what is put into it
+ *
+ * The thread takes everything queued at once, so slow destinations get
+ * their messages in batches and can coalesce them.
+ */
+
+#ifndef BAREOS_LIB_MESSAGE_DELIVERY_H_
+#define BAREOS_LIB_MESSAGE_DELIVERY_H_
+
+#include "lib/message.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+template <typename T> class message_delivery_queue {
+ public:
+  using deliver_function = std::function<void(std::vector<T>& batch)>;
+
+  message_delivery_queue(const char* name,
+                         std::size_t capacity,
+                         deliver_function deliver)
+      : capacity_{capacity}, deliver_{std::move(deliver)}
+  {
+    stats_.destination = name;
+  }
+  ~message_delivery_queue() { Stop(); }
+
+  void Start()
+  {
+    std::unique_lock lock(mutex_);
+    if (running_) { return; }
+    running_ = true;
+    stopping_ = false;
+    thread_ = std::thread([this] { Run(); });
+  }
+
+  /* Queues value, waiting for space if wait is set.  Returns false (and
+   * leaves value alone) if the caller has to deliver it itself: the thread
+   * is not running, the queue is full and wait is not set, or the caller is
+   * the delivery thread itself. */
+  bool Put(T& value, bool wait)
+  {
+    std::unique_lock lock(mutex_);
+    if (!running_ || stopping_ || std::this_thread::get_id() == thread_id_) {
+      return false;
+    }
+    if (queue_.size() >= capacity_) {
+      if (!wait) {
+        stats_.inline_delivered += 1;
+        return false;
+      }
+      stats_.waits += 1;
+      not_full_.wait(lock, [this] {
+        return queue_.size() < capacity_ || stopping_;
+      });
+      if (stopping_) { return false; }
+    }
+    queue_.push_back(std::move(value));
+    stats_.queued += 1;
+    if (queue_.size() > stats_.max_depth) { stats_.max_depth = queue_.size(); }
+    if (queue_.size() == 1) { not_empty_.notify_one(); }
+    return true;
+  }
+
+  // waits until everything queued before the call was delivered
+  void Flush()
+  {
+    std::unique_lock lock(mutex_);
+    if (!running_ || std::this_thread::get_id() == thread_id_) { return; }
+    uint64_t target = stats_.queued;
+    drained_.wait(lock, [this, target] {
+      return stats_.delivered >= target || !running_;
+    });
+  }
+
+  // delivers everything still queued and ends the thread
+  void Stop()
+  {
+    {
+      std::unique_lock lock(mutex_);
+      if (!running_ || stopping_) { return; }
+      stopping_ = true;
+    }
+    not_empty_.notify_one();
+    not_full_.notify_all();
+    thread_.join();
+
+    std::unique_lock lock(mutex_);
+    running_ = false;
+    drained_.notify_all();
+  }
+
+  bool Running()
+  {
+    std::unique_lock lock(mutex_);
+    return running_;
+  }
+
+  message_delivery_stats Stats()
+  {
+    std::unique_lock lock(mutex_);
+    return stats_;
+  }
+
+ private:
+  void Run()
+  {
+    std::vector<T> batch;
+    std::unique_lock lock(mutex_);
+    thread_id_ = std::this_thread::get_id();
+    for (;;) {
+      not_empty_.wait(lock, [this] { return !queue_.empty() || stopping_; });
+      if (queue_.empty()) { break; }
+
+      batch.assign(std::make_move_iterator(queue_.begin()),
+                   std::make_move_iterator(queue_.end()));
+      queue_.clear();
+      not_full_.notify_all();
+      if (batch.size() > stats_.max_batch) { stats_.max_batch = batch.size(); }
+
+      lock.unlock();
+      deliver_(batch);
+      lock.lock();
+
+      stats_.delivered += batch.size();
+      batch.clear();
+      drained_.notify_all();
+    }
+    thread_id_ = std::thread::id{};
+  }
+
+  std::mutex mutex_;
+  std::condition_variable not_empty_;
+  std::condition_variable not_full_;
+  std::condition_variable drained_;
+  std::deque<T> queue_;
+  std::size_t capacity_;
+  deliver_function deliver_;
+  std::thread thread_;
+  std::thread::id thread_id_{};
+  bool running_{false};
+  bool stopping_{false};
+  message_delivery_stats stats_{};
+};
+
+#endif  // BAREOS_LIB_MESSAGE_DELIVERY_H_
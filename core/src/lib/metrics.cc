@@ -0,0 +1,185 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "include/bareos.h"
+#include "lib/metrics.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+namespace metrics {
+
+namespace {
+struct registry {
+  std::mutex mutex;
+  std::vector<const metric*> metrics;
+};
+
+// constructed on first use, so it outlives all metrics registered into it
+registry& GetRegistry()
+{
+  static registry r;
+  return r;
+}
+
+void AppendDouble(std::string& out, double value)
+{
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%.15g", value);
+  out += buf;
+}
+}  // namespace
+
+metric::metric(const char* name, const char* help, const char* type)
+    : name_{name}, help_{help}, type_{type}
+{
+  registry& r = GetRegistry();
+  std::lock_guard lock(r.mutex);
+  r.metrics.push_back(this);
+}
+
+metric::~metric()
+{
+  registry& r = GetRegistry();
+  std::lock_guard lock(r.mutex);
+  r.metrics.erase(std::remove(r.metrics.begin(), r.metrics.end(), this),
+                  r.metrics.end());
+}
+
+void metric::Render(std::string& out) const
+{
+  out += "# TYPE ";
+  out += name_;
+  out += ' ';
+  out += type_;
+  out += "\n# HELP ";
+  out += name_;
+  out += ' ';
+  out += help_;
+  out += '\n';
+  RenderSamples(out);
+}
+
+void counter::RenderSamples(std::string& out) const
+{
+  out += name_;
+  out += "_total ";
+  out += std::to_string(Value());
+  out += '\n';
+}
+
+void gauge::RenderSamples(std::string& out) const
+{
+  out += name_;
+  out += ' ';
+  out += std::to_string(Value());
+  out += '\n';
+}
+
+void callback_gauge::RenderSamples(std::string& out) const
+{
+  out += name_;
+  out += ' ';
+  AppendDouble(out, callback_());
+  out += '\n';
+}
+
+histogram::histogram(const char* name,
+                     const char* help,
+                     std::initializer_list<double> bounds)
+    : metric(name, help, "histogram")
+    , bounds_{bounds}
+    , buckets_{std::make_unique<std::atomic<uint64_t>[]>(bounds.size() + 1)}
+{
+  ASSERT(std::is_sorted(bounds_.begin(), bounds_.end()));
+}
+
+void histogram::Observe(double value)
+{
+  // the last bucket is +Inf
+  std::size_t bucket
+      = std::lower_bound(bounds_.begin(), bounds_.end(), value)
+        - bounds_.begin();
+  buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+
+  uint64_t old_bits = sum_bits_.load(std::memory_order_relaxed);
+  uint64_t new_bits;
+  do {
+    double sum;
+    memcpy(&sum, &old_bits, sizeof(sum));
+    sum += value;
+    memcpy(&new_bits, &sum, sizeof(sum));
+  } while (!sum_bits_.compare_exchange_weak(old_bits, new_bits,
+                                            std::memory_order_relaxed));
+  count_.fetch_add(1, std::memory_order_relaxed);
+}
+
+double histogram::Sum() const
+{
+  uint64_t bits = sum_bits_.load(std::memory_order_relaxed);
+  double sum;
+  memcpy(&sum, &bits, sizeof(sum));
+  return sum;
+}
+
+void histogram::RenderSamples(std::string& out) const
+{
+  /* The buckets are read one by one while others may observe, so the total
+   * of the buckets is used as +Inf bucket and count to keep them
+   * consistent. */
+  uint64_t cumulative = 0;
+  for (std::size_t i = 0; i <= bounds_.size(); ++i) {
+    cumulative += buckets_[i].load(std::memory_order_relaxed);
+    out += name_;
+    out += "_bucket{le=\"";
+    if (i < bounds_.size()) {
+      AppendDouble(out, bounds_[i]);
+    } else {
+      out += "+Inf";
+    }
+    out += "\"} ";
+    out += std::to_string(cumulative);
+    out += '\n';
+  }
+  out += name_;
+  out += "_count ";
+  out += std::to_string(cumulative);
+  out += '\n';
+  out += name_;
+  out += "_sum ";
+  AppendDouble(out, Sum());
+  out += '\n';
+}
+
+std::string Render()
+{
+  std::string out;
+  registry& r = GetRegistry();
+  {
+    std::lock_guard lock(r.mutex);
+    for (const metric* m : r.metrics) { m->Render(out); }
+  }
+  out += "# EOF\n";
+  return out;
+}
+
+}  // namespace metrics
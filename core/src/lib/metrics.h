@@ -0,0 +1,165 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Registry of in-daemon metrics, exported in the OpenMetrics text format
+ *
+ * Metrics are meant to be defined as static objects next to the code that
+ * updates them, e.g.
+ *
+ *   static metrics::counter bytes_written{"bareos_sd_written_bytes",
+ *                                         "Bytes written to devices"};
+ *   bytes_written.Add(len);
+ *
+ * Updating a metric is a relaxed atomic operation, only registering and
+ * rendering take the lock of the registry.  Rates like bytes/s are left to
+ * the scraper, which derives them from the counters.
+ */
+
+#ifndef BAREOS_LIB_METRICS_H_
+#define BAREOS_LIB_METRICS_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace metrics {
+
+class metric {
+ public:
+  metric(const char* name, const char* help, const char* type);
+  virtual ~metric();
+  metric(const metric&) = delete;
+  metric& operator=(const metric&) = delete;
+
+  // appends the HELP, TYPE and sample lines of this metric to out
+  void Render(std::string& out) const;
+
+ protected:
+  virtual void RenderSamples(std::string& out) const = 0;
+
+  const char* name_;
+  const char* help_;
+  const char* type_;
+};
+
+// only ever goes up, exported as name_total
+class counter : public metric {
+ public:
+  counter(const char* name, const char* help) : metric(name, help, "counter")
+  {
+  }
+
+  void Add(uint64_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); }
+  uint64_t Value() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  void RenderSamples(std::string& out) const override;
+
+  std::atomic<uint64_t> value_{0};
+};
+
+class gauge : public metric {
+ public:
+  gauge(const char* name, const char* help) : metric(name, help, "gauge") {}
+
+  void Set(int64_t v) { value_.store(v, std::memory_order_relaxed); }
+  void Add(int64_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); }
+  void Sub(int64_t n = 1) { value_.fetch_sub(n, std::memory_order_relaxed); }
+  int64_t Value() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  void RenderSamples(std::string& out) const override;
+
+  std::atomic<int64_t> value_{0};
+};
+
+/* A gauge whose value is only computed when it is rendered, for values that
+ * are already kept somewhere else (like the length of a queue). */
+class callback_gauge : public metric {
+ public:
+  using callback = std::function<double()>;
+  callback_gauge(const char* name, const char* help, callback cb)
+      : metric(name, help, "gauge"), callback_{std::move(cb)}
+  {
+  }
+
+ private:
+  void RenderSamples(std::string& out) const override;
+
+  callback callback_;
+};
+
+/* Counts observations in buckets with fixed upper bounds, bounds have to be
+ * given in increasing order. */
+class histogram : public metric {
+ public:
+  histogram(const char* name,
+            const char* help,
+            std::initializer_list<double> bounds);
+
+  void Observe(double value);
+  uint64_t Count() const { return count_.load(std::memory_order_relaxed); }
+  double Sum() const;
+
+ private:
+  void RenderSamples(std::string& out) const override;
+
+  std::vector<double> bounds_;
+  std::unique_ptr<std::atomic<uint64_t>[]> buckets_; /* not cumulative */
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> sum_bits_{0}; /* a double */
+};
+
+// bounds in seconds for histograms of durations
+#define METRICS_SECONDS_BUCKETS \
+  {0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 5, 10, 60, 300, 1800}
+
+// observes the time from its construction to its destruction in seconds
+class scoped_timer {
+ public:
+  explicit scoped_timer(histogram& h)
+      : histogram_{h}, start_{std::chrono::steady_clock::now()}
+  {
+  }
+  ~scoped_timer()
+  {
+    std::chrono::duration<double> elapsed
+        = std::chrono::steady_clock::now() - start_;
+    histogram_.Observe(elapsed.count());
+  }
+
+ private:
+  histogram& histogram_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+// all registered metrics in the OpenMetrics text format, including # EOF
+std::string Render();
+
+}  // namespace metrics
+
+#endif  // BAREOS_LIB_METRICS_H_
@@ -0,0 +1,196 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "include/bareos.h"
+#include "lib/berrno.h"
+#include "lib/metrics.h"
+#include "lib/metrics_server.h"
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#ifndef HAVE_WIN32
+#  include <unistd.h>
+#endif
+
+#ifdef HAVE_POLL_H
+#  include <poll.h>
+#elif HAVE_SYS_POLL_H
+#  include <sys/poll.h>
+#endif
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef HAVE_WIN32
+#  define socketClose(fd) ::closesocket(fd)
+#else
+#  define socketClose(fd) ::close(fd)
+#endif
+
+static std::atomic<bool> quit{false};
+static std::thread server_thread;
+static std::vector<int> listen_fds;
+
+static void SendAll(int fd, const std::string& data)
+{
+  std::size_t sent = 0;
+  while (sent < data.size()) {
+    ssize_t n = send(fd, data.data() + sent, data.size() - sent, 0);
+    if (n <= 0) { return; }
+    sent += n;
+  }
+}
+
+static void HandleRequest(int fd)
+{
+  // a scraper sends a short request, anything not done in time is dropped
+#ifdef HAVE_WIN32
+  DWORD timeout = 5000;
+#else
+  struct timeval timeout = {5, 0};
+#endif
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, (sockopt_val_t)&timeout,
+             sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, (sockopt_val_t)&timeout,
+             sizeof(timeout));
+
+  std::string request;
+  char buf[1024];
+  while (request.find("\r\n\r\n") == std::string::npos
+         && request.size() < 16 * 1024) {
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0) { return; }
+    request.append(buf, n);
+  }
+
+  std::string status;
+  std::string type = "text/plain; charset=utf-8";
+  std::string body;
+  if (request.rfind("GET /metrics ", 0) == 0
+      || request.rfind("GET /metrics?", 0) == 0) {
+    status = "200 OK";
+    type = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+    body = metrics::Render();
+  } else if (request.rfind("GET ", 0) == 0) {
+    status = "404 Not Found";
+    body = "only /metrics is served here\n";
+  } else {
+    status = "405 Method Not Allowed";
+    body = "only GET is supported\n";
+  }
+
+  SendAll(fd, "HTTP/1.1 " + status + "\r\nContent-Type: " + type
+                  + "\r\nContent-Length: " + std::to_string(body.size())
+                  + "\r\nConnection: close\r\n\r\n" + body);
+}
+
+static void MetricsServer()
+{
+  std::vector<struct pollfd> pfds(listen_fds.size());
+  for (std::size_t i = 0; i < listen_fds.size(); ++i) {
+    pfds[i].fd = listen_fds[i];
+    pfds[i].events = POLLIN;
+  }
+
+  while (!quit) {
+    int status = poll(pfds.data(), pfds.size(), 1000);
+    if (status < 0) {
+      if (errno == EINTR) { continue; }
+      BErrNo be;
+      Emsg1(M_ERROR, 0, T_("Metrics server poll failed: %s\n"),
+            be.bstrerror());
+      break;
+    }
+    for (auto& pfd : pfds) {
+      if (!(pfd.revents & POLLIN)) { continue; }
+      int fd = accept(pfd.fd, nullptr, nullptr);
+      if (fd < 0) { continue; }
+      HandleRequest(fd);
+      socketClose(fd);
+    }
+  }
+
+  for (int fd : listen_fds) { socketClose(fd); }
+  listen_fds.clear();
+}
+
+bool StartMetricsServer(const char* address, uint32_t port)
+{
+  if (port == 0 || server_thread.joinable()) { return true; }
+
+  struct addrinfo hints {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  struct addrinfo* res = nullptr;
+  std::string service = std::to_string(port);
+  int status = getaddrinfo(address, service.c_str(), &hints, &res);
+  if (status != 0) {
+    Emsg2(M_ERROR, 0, T_("Cannot resolve metrics address %s: %s\n"),
+          NPRT(address), gai_strerror(status));
+    return false;
+  }
+
+  for (struct addrinfo* ai = res; ai; ai = ai->ai_next) {
+    int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) { continue; }
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (sockopt_val_t)&reuse,
+               sizeof(reuse));
+#ifdef IPV6_V6ONLY
+    if (ai->ai_family == AF_INET6) {
+      int v6only = 1;
+      setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, (sockopt_val_t)&v6only,
+                 sizeof(v6only));
+    }
+#endif
+    if (bind(fd, ai->ai_addr, ai->ai_addrlen) < 0 || listen(fd, 5) < 0) {
+      BErrNo be;
+      Emsg3(M_WARNING, 0, T_("Cannot listen for metrics on %s:%u: %s\n"),
+            NPRT(address), port, be.bstrerror());
+      socketClose(fd);
+      continue;
+    }
+    listen_fds.push_back(fd);
+  }
+  freeaddrinfo(res);
+
+  if (listen_fds.empty()) {
+    Emsg2(M_ERROR, 0,
+          T_("Metrics server not started, nothing bound to %s:%u\n"),
+          NPRT(address), port);
+    return false;
+  }
+
+  quit = false;
+  server_thread = std::thread(MetricsServer);
+  return true;
+}
+
+void StopMetricsServer()
+{
+  if (!server_thread.joinable()) { return; }
+  quit = true;
+  server_thread.join();
+}
@@ -0,0 +1,36 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * minimal HTTP server that answers GET /metrics with metrics::Render()
+ */
+
+#ifndef BAREOS_LIB_METRICS_SERVER_H_
+#define BAREOS_LIB_METRICS_SERVER_H_
+
+#include <cstdint>
+
+/* Starts a thread that listens on address:port.  Returns false (after
+ * logging why) if nothing could be bound.  A port of 0 does nothing. */
+bool StartMetricsServer(const char* address, uint32_t port);
+void StopMetricsServer();
+
+#endif  // BAREOS_LIB_METRICS_SERVER_H_
@@ -24,11 +24,15 @@
 /**
  * This code implements a cache with the current mounted filesystems for which
  * its uses the mostly in kernel mount information and export the different OS
- * specific interfaces using a generic interface. We use a linked list cache
- * which is accessed using a binary search on the device id and we keep the
- * previous cache hit as most of the time we get called quite a lot with most
- * of the time the same device so keeping the previous cache hit we have a
- * very optimized code path.
+ * specific interfaces using a generic interface. We use a hash table on the
+ * device id and we keep the previous cache hit as most of the time we get
+ * called quite a lot with most of the time the same device so keeping the
+ * previous cache hit we have a very optimized code path.
+ *
+ * On Linux the kernel tells through poll() on /proc/self/mounts when the
+ * mount table changed, so we only rescan it then.  Elsewhere the mountlist
+ * gets rescanned every MNTENT_RESCAN_INTERVAL seconds and when a device is
+ * not found.
  *
  * This interface is implemented for the following OS-es:
  *
@@ -56,13 +60,19 @@
 
 #include "include/bareos.h"
 #include "mntent_cache.h"
-#include "lib/dlist.h"
 
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <unordered_map>
+
+#if defined(HAVE_LINUX_OS)
+#  include <fcntl.h>
+#  include <poll.h>
+#  include <unistd.h>
+#endif
 
 #if defined(HAVE_GETMNTENT)
 #  if defined(HAVE_LINUX_OS) || defined(HAVE_AIX_OS)
@@ -82,33 +92,23 @@
 // Protected data by mutex lock.
 static pthread_mutex_t mntent_cache_lock = PTHREAD_MUTEX_INITIALIZER;
 static mntent_cache_entry_t* previous_cache_hit = NULL;
-static dlist<mntent_cache_entry_t>* mntent_cache_entries = NULL;
+static std::unordered_map<uint32_t, mntent_cache_entry_t*>* mntent_cache_entries
+    = NULL;
 
 // Last time a rescan of the mountlist took place.
 static time_t last_rescan = 0;
 
+#if defined(HAVE_LINUX_OS)
+// Signals POLLPRI once for every change of the mount table.
+static int mount_table_fd = -1;
+#endif
+
 static const char* skipped_fs_types[] = {
 #if defined(HAVE_LINUX_OS)
     "rootfs",  // "nsfs", "tmpfs",
 #endif
     NULL};
 
-// Simple comparison function for binary search and insert.
-static int CompareMntentMapping(mntent_cache_entry_t* e1,
-                                mntent_cache_entry_t* e2)
-{
-  mntent_cache_entry_t *mce1, *mce2;
-
-  mce1 = e1;
-  mce2 = e2;
-
-  if (mce1->dev == mce2->dev) {
-    return 0;
-  } else {
-    return (mce1->dev < mce2->dev) ? -1 : 1;
-  }
-}
-
 // Free the members of the mntent_cache structure not the structure itself.
 static inline void DestroyMntentCacheEntry(mntent_cache_entry_t* mce)
 {
@@ -118,6 +118,16 @@ static inline void DestroyMntentCacheEntry(mntent_cache_entry_t* mce)
   free(mce->special);
 }
 
+/**
+ * Lookup an entry in the cache.
+ * This function should be called with a lock on the mntent_cache.
+ */
+static inline mntent_cache_entry_t* LookupMntentMapping(uint32_t dev)
+{
+  auto found = mntent_cache_entries->find(dev);
+  return (found != mntent_cache_entries->end()) ? found->second : NULL;
+}
+
 /**
  * Add a new entry to the cache.
  * This function should be called with a write lock on the mntent_cache.
@@ -140,17 +150,14 @@ static mntent_cache_entry_t* add_mntent_mapping(uint32_t dev,
   if (mntopts) { mce->mntopts = strdup(mntopts); }
 
 
-  auto retval = mntent_cache_entries->binary_insert(mce, CompareMntentMapping);
-  if (retval != mce) {
-    if (retval) {
-      Dmsg4(200, "failed to insert: %s (%s), already exists as %s (%s)!\n",
-            mce->mountpoint, mce->fstype, retval->mountpoint, mce->fstype);
-    } else {
-      Dmsg2(50, "failed to insert: %s (%s); something went wrong!\n",
-            mce->mountpoint, mce->fstype);
-    }
+  auto [found, inserted] = mntent_cache_entries->try_emplace(dev, mce);
+  if (!inserted) {
+    Dmsg4(200, "failed to insert: %s (%s), already exists as %s (%s)!\n",
+          mce->mountpoint, mce->fstype, found->second->mountpoint,
+          found->second->fstype);
     DestroyMntentCacheEntry(mce);
     free(mce);
+    mce = found->second;
   } else {
     Dmsg2(250, "inserted %s (%s) into mountpoint cache!\n", mce->mountpoint,
           mce->fstype);
@@ -168,16 +175,14 @@ static mntent_cache_entry_t* update_mntent_mapping(uint32_t dev,
                                                    const char* fstype,
                                                    const char* mntopts)
 {
-  mntent_cache_entry_t lookup, *mce;
+  mntent_cache_entry_t* mce = LookupMntentMapping(dev);
 
-  lookup.dev = dev;
-  mce = (mntent_cache_entry_t*)mntent_cache_entries->binary_search(
-      &lookup, CompareMntentMapping);
   if (mce) {
     // See if the info changed.
     if (!bstrcmp(mce->special, special)) {
       free(mce->special);
       mce->special = strdup(special);
+      mce->unsupported = 0;
     }
 
     if (!bstrcmp(mce->mountpoint, mountpoint)) {
@@ -188,11 +193,13 @@ static mntent_cache_entry_t* update_mntent_mapping(uint32_t dev,
     if (!bstrcmp(mce->fstype, fstype)) {
       free(mce->fstype);
       mce->fstype = strdup(fstype);
+      mce->unsupported = 0;
     }
 
     if (!bstrcmp(mce->mntopts, mntopts)) {
       free(mce->mntopts);
       mce->mntopts = strdup(mntopts);
+      mce->unsupported = 0;
     }
   } else {
     mce = add_mntent_mapping(dev, special, mountpoint, fstype, mntopts);
@@ -332,32 +339,76 @@ static void refresh_mount_cache([[maybe_unused]] mntent_cache_entry_t*
  */
 static inline void InitializeMntentCache(void)
 {
-  mntent_cache_entries = new dlist<mntent_cache_entry_t>();
+  mntent_cache_entries
+      = new std::unordered_map<uint32_t, mntent_cache_entry_t*>();
+  mntent_cache_entries->reserve(NR_MNTENT_CACHE_ENTRIES);
+
+#if defined(HAVE_LINUX_OS)
+  /* Open the mount table before reading it, so that no change between
+   * reading it and watching it gets lost. */
+  if (mount_table_fd < 0) {
+    mount_table_fd = open("/proc/self/mounts", O_RDONLY | O_CLOEXEC);
+  }
+#endif
 
   // Refresh the cache.
   refresh_mount_cache(add_mntent_mapping);
 }
 
+// See if changes of the mount table get noticed without rescanning it.
+static inline bool MountTableWatched(void)
+{
+#if defined(HAVE_LINUX_OS)
+  return mount_table_fd >= 0;
+#else
+  return false;
+#endif
+}
+
+/**
+ * See if the mount table changed since the last call.
+ * This function should be called with a write lock on the mntent_cache.
+ */
+static bool MountTableChanged(void)
+{
+#if defined(HAVE_LINUX_OS)
+  struct pollfd pfd;
+
+  pfd.fd = mount_table_fd;
+  pfd.events = POLLPRI;
+  pfd.revents = 0;
+  if (poll(&pfd, 1, 0) < 0) { return true; }
+
+  return (pfd.revents & (POLLPRI | POLLERR)) != 0;
+#else
+  return true;
+#endif
+}
+
 /**
  * Repopulate the cache with new data.
  * This function should be called with a write lock on the mntent_cache.
  */
 static void RepopulateMntentCache(void)
 {
-  mntent_cache_entry_t *mce, *next_mce;
+  mntent_cache_entry_t* mce;
 
   // Reset validated flag on all entries in the cache.
-  foreach_dlist (mce, mntent_cache_entries) { mce->validated = false; }
+  for (auto& [dev, entry] : *mntent_cache_entries) { entry->validated = false; }
 
   // Refresh the cache.
   refresh_mount_cache(update_mntent_mapping);
 
   /* Remove any entry that is not validated in
    * the previous refresh run. */
-  mce = (mntent_cache_entry_t*)mntent_cache_entries->first();
-  while (mce) {
-    next_mce = (mntent_cache_entry_t*)mntent_cache_entries->next(mce);
-    if (!mce->validated) {
+  auto it = mntent_cache_entries->begin();
+  while (it != mntent_cache_entries->end()) {
+    mce = it->second;
+    if (mce->validated) {
+      ++it;
+    } else {
+      it = mntent_cache_entries->erase(it);
+
       // Invalidate the previous cache hit if we are removing it.
       if (previous_cache_hit == mce) { previous_cache_hit = NULL; }
 
@@ -368,34 +419,38 @@ static void RepopulateMntentCache(void)
        * yet. The put_mntent_mapping function will
        * handle these dangling entries. */
       if (mce->reference_count == 0) {
-        mntent_cache_entries->remove(mce);
         DestroyMntentCacheEntry(mce);
         free(mce);
       } else {
         mce->destroyed = true;
-        mntent_cache_entries->remove(mce);
       }
     }
-    mce = next_mce;
   }
 }
 
 // Flush the current content from the cache.
 void FlushMntentCache(void)
 {
-  mntent_cache_entry_t* mce;
-
   // Lock the cache.
   lock_mutex(mntent_cache_lock);
 
   if (mntent_cache_entries) {
     previous_cache_hit = NULL;
-    foreach_dlist (mce, mntent_cache_entries) { DestroyMntentCacheEntry(mce); }
-    mntent_cache_entries->destroy();
+    for (auto& [dev, mce] : *mntent_cache_entries) {
+      DestroyMntentCacheEntry(mce);
+      free(mce);
+    }
     delete mntent_cache_entries;
     mntent_cache_entries = NULL;
   }
 
+#if defined(HAVE_LINUX_OS)
+  if (mount_table_fd >= 0) {
+    close(mount_table_fd);
+    mount_table_fd = -1;
+  }
+#endif
+
   unlock_mutex(mntent_cache_lock);
 }
 
@@ -422,7 +477,7 @@ void ReleaseMntentMapping(mntent_cache_entry_t* mce)
 // Find a mapping in the cache.
 mntent_cache_entry_t* find_mntent_mapping(uint32_t dev)
 {
-  mntent_cache_entry_t lookup, *mce = NULL;
+  mntent_cache_entry_t* mce = NULL;
   time_t now;
 
   // Lock the cache.
@@ -439,6 +494,11 @@ mntent_cache_entry_t* find_mntent_mapping(uint32_t dev)
   if (!mntent_cache_entries) {
     InitializeMntentCache();
     last_rescan = time(NULL);
+  } else if (MountTableWatched()) {
+    if (MountTableChanged()) {
+      RepopulateMntentCache();
+      last_rescan = time(NULL);
+    }
   } else {
     /* We rescan the mountlist when called when more then
      * MNTENT_RESCAN_INTERVAL seconds have past since the
@@ -451,17 +511,15 @@ mntent_cache_entry_t* find_mntent_mapping(uint32_t dev)
     }
   }
 
-  lookup.dev = dev;
-  mce = (mntent_cache_entry_t*)mntent_cache_entries->binary_search(
-      &lookup, CompareMntentMapping);
+  mce = LookupMntentMapping(dev);
 
   /* If we fail to lookup the mountpoint its probably a mountpoint added
    * after we did our initial scan. Lets rescan the mountlist and try
-   * the lookup again. */
-  if (!mce) {
+   * the lookup again.  A watched mount table did not change, so the
+   * device just is not a mountpoint (e.g. a btrfs subvolume). */
+  if (!mce && !MountTableWatched()) {
     RepopulateMntentCache();
-    mce = (mntent_cache_entry_t*)mntent_cache_entries->binary_search(
-        &lookup, CompareMntentMapping);
+    mce = LookupMntentMapping(dev);
   }
 
   /* Store the last successfull lookup as the previous_cache_hit.
@@ -475,3 +533,42 @@ ok_out:
   unlock_mutex(mntent_cache_lock);
   return mce;
 }
+
+/**
+ * Remember that the filesystem with the given device does not support
+ * features (MNTENT_NO_* bits), so callers can skip the calls for all other
+ * files on it.  This is forgotten when the mount changes.
+ */
+void MarkMntentUnsupported(uint32_t dev, uint32_t features)
+{
+  mntent_cache_entry_t* mce = find_mntent_mapping(dev);
+  if (!mce) { return; }
+
+  lock_mutex(mntent_cache_lock);
+  mce->unsupported |= features;
+  unlock_mutex(mntent_cache_lock);
+
+  ReleaseMntentMapping(mce);
+}
+
+/**
+ * See if all of features were marked unsupported for the device.  As this
+ * gets asked for every file, it never rescans the mountlist.
+ */
+bool MntentUnsupported(uint32_t dev, uint32_t features)
+{
+  mntent_cache_entry_t* mce = NULL;
+  bool retval = false;
+
+  lock_mutex(mntent_cache_lock);
+
+  if (previous_cache_hit && previous_cache_hit->dev == dev) {
+    mce = previous_cache_hit;
+  } else if (mntent_cache_entries) {
+    mce = LookupMntentMapping(dev);
+  }
+  if (mce) { retval = (mce->unsupported & features) == features; }
+
+  unlock_mutex(mntent_cache_lock);
+  return retval;
+}
@@ -28,7 +28,8 @@
 
 /*
  * Don't use the mountlist data when its older than this amount
- * of seconds but perform a rescan of the mountlist.
+ * of seconds but perform a rescan of the mountlist.  Not used when
+ * the OS tells about changes of the mountlist.
  */
 #define MNTENT_RESCAN_INTERVAL 1800
 
@@ -38,16 +39,20 @@
  */
 #define NR_MNTENT_CACHE_ENTRIES 256
 
-// Number of pages to allocate for the big_buffer used by htable.
-#define NR_MNTENT_HTABLE_PAGES 32
+/*
+ * Bits of mntent_cache_entry_t::unsupported, set when a call on the
+ * filesystem failed because it does not support the feature at all.
+ */
+#define MNTENT_NO_XATTR 0x01
+#define MNTENT_NO_ACL 0x02
 
 struct mntent_cache_entry_t {
-  dlink<mntent_cache_entry_t> link;
   uint32_t dev{0};
   char* special{nullptr};
   char* mountpoint{nullptr};
   char* fstype{nullptr};
   char* mntopts{nullptr};
+  uint32_t unsupported{0}; /* See MNTENT_NO_*, reset when the mount changes */
   int reference_count{0};
   bool validated{false};
   bool destroyed{false};
@@ -56,5 +61,7 @@ struct mntent_cache_entry_t {
 mntent_cache_entry_t* find_mntent_mapping(uint32_t dev);
 void ReleaseMntentMapping(mntent_cache_entry_t* mce);
 void FlushMntentCache(void);
+void MarkMntentUnsupported(uint32_t dev, uint32_t features);
+bool MntentUnsupported(uint32_t dev, uint32_t features);
 
 #endif  // BAREOS_LIB_MNTENT_CACHE_H_
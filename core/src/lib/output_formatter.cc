@@ -34,6 +34,7 @@
 #include "lib/output_formatter.h"
 
 #include <cassert>
+#include <string>
 #include <utf8.h>
 
 const char* json_error_message_template
@@ -81,6 +82,7 @@ OutputFormatter::~OutputFormatter()
   json_object_clear(result_json);
   json_decref(result_json);
   delete result_stack_json;
+  if (stream_array_json) { json_decref(stream_array_json); }
   json_object_clear(message_object_json);
   json_decref(message_object_json);
 #endif
@@ -181,6 +183,10 @@ void OutputFormatter::ObjectEnd(const char* name, const char* fmt)
     case API_MODE_JSON:
       result_stack_json->pop();
       Dmsg1(800, "result stack: %d\n", result_stack_json->size());
+      if (stream_array_json
+          && result_stack_json->last() == stream_array_json) {
+        JsonStreamItems(false);
+      }
       break;
 #endif
     default:
@@ -224,6 +230,11 @@ void OutputFormatter::ArrayStart(const char* name, const char* fmt)
         return;
       }
 
+      if (streaming && !stream_started && json_object_current == result_json) {
+        JsonStreamArrayStart(lname.c_str());
+        break;
+      }
+
       json_object_existing
           = json_object_get(json_object_current, lname.c_str());
       if (json_object_existing) {
@@ -257,6 +268,10 @@ void OutputFormatter::ArrayEnd(const char* name, const char* fmt)
   switch (api) {
 #if HAVE_JANSSON
     case API_MODE_JSON:
+      if (stream_array_json
+          && result_stack_json->last() == stream_array_json) {
+        JsonStreamArrayEnd();
+      }
       result_stack_json->pop();
       Dmsg1(800, "result stack: %d\n", result_stack_json->size());
       break;
@@ -805,7 +820,11 @@ void OutputFormatter::FinalizeResult([[maybe_unused]] bool result)
   switch (api) {
 #if HAVE_JANSSON
     case API_MODE_JSON:
-      JsonFinalizeResult(result);
+      if (stream_started) {
+        JsonStreamFinalizeResult(result);
+      } else {
+        JsonFinalizeResult(result);
+      }
       break;
 #endif
     default:
@@ -813,6 +832,10 @@ void OutputFormatter::FinalizeResult([[maybe_unused]] bool result)
       break;
   }
 
+#if HAVE_JANSSON
+  streaming = false;
+#endif
+
   // Clear any pending filters.
   ClearFilters();
 
@@ -837,6 +860,7 @@ bool OutputFormatter::JsonArrayItemAdd(json_t* value)
   }
   if (json_is_array(json_array_current)) {
     json_array_append_new(json_array_current, value);
+    if (json_array_current == stream_array_json) { JsonStreamItems(false); }
   } else {
     /* nameless objects only are indented to be added to arrays.
      * We do a workaround here, but this will only keep the last added
@@ -955,20 +979,189 @@ bool OutputFormatter::JsonSendErrorMessage(const char* message)
   return send_func(send_ctx, "%s", json_error_message.c_str());
 }
 
+bool OutputFormatter::JsonSend(const char* string)
+{
+  size_t string_length = strlen(string);
+  Dmsg1(800, "message length (json): %lld\n", string_length);
+  // send json string, on failure, send json error message
+  if (send_func(send_ctx, "%s", string)) { return true; }
+
+  /* If send failed, include short messages in error messages.
+   * As messages can get quite long, don't show long messages. */
+  PoolMem ErrorMsg;
+  ErrorMsg.bsprintf("Failed to send json message (length=%lld). ",
+                    string_length);
+  if (string_length < max_message_length_shown_in_error) {
+    ErrorMsg.strcat("Message: ");
+    ErrorMsg.strcat(string);
+    ErrorMsg.strcat("\n");
+  } else {
+    ErrorMsg.strcat("Maybe result message to long?\n");
+  }
+  Dmsg0(100, ErrorMsg.c_str());
+  JsonSendErrorMessage(ErrorMsg.c_str());
+  return false;
+}
+
+void OutputFormatter::JsonAddMeta()
+{
+  if (!HasFilters()) { return; }
+
+  json_t* meta_obj = json_object();
+  json_object_set_new(result_json, "meta", meta_obj);
+
+  json_t* range_obj = json_object();
+  for (of_filter_tuple* tuple : filters) {
+    if (tuple->type == OF_FILTER_LIMIT) {
+      json_object_set_new(range_obj, "limit",
+                          json_integer(tuple->u.limit_filter.limit));
+    }
+    if (tuple->type == OF_FILTER_OFFSET) {
+      json_object_set_new(range_obj, "offset",
+                          json_integer(tuple->u.offset_filter.offset));
+    }
+  }
+  json_object_set_new(range_obj, "filtered",
+                      json_integer(get_num_rows_filtered()));
+  json_object_set_new(meta_obj, "range", range_obj);
+}
+
+static void FreeJsonString(char* string)
+{
+#  if JANSSON_VERSION_HEX >= 0x020800
+  json_free_t my_free;
+  json_get_alloc_funcs(nullptr, &my_free);
+  my_free(string);
+#  else
+  free(string);
+#  endif
+}
+
+static std::string JsonDump(json_t* json, size_t flags)
+{
+  std::string result;
+  if (char* string = json_dumps(json, flags | JSON_ENCODE_ANY)) {
+    result = string;
+    FreeJsonString(string);
+  } else {
+    // json_dumps return NULL on failure (this should not happen).
+    Emsg0(M_ERROR, 0, "Failed to generate json string.\n");
+  }
+  return result;
+}
+
+// the members of a JSON object without the braces around them
+static std::string JsonDumpMembers(json_t* object, size_t flags)
+{
+  if (json_object_size(object) == 0) { return std::string{}; }
+  std::string members = JsonDump(object, flags);
+  if (members.size() < 2) { return std::string{}; }
+  return members.substr(1, members.size() - 2);
+}
+
+void OutputFormatter::JsonStreamArrayStart(const char* name)
+{
+  size_t flags = compact ? UA_JSON_FLAGS_COMPACT : UA_JSON_FLAGS_NORMAL;
+  std::string start = "{\"jsonrpc\": \"2.0\", \"id\": "
+                      + (request_id ? std::to_string(*request_id) : "null")
+                      + ", \"result\": {";
+  std::string members = JsonDumpMembers(result_json, flags);
+  if (!members.empty()) { start += members + ", "; }
+  start += "\"" + std::string{name} + "\": [";
+
+  // everything sent is no longer kept
+  json_object_clear(result_json);
+  stream_started = true;
+  stream_first_item = true;
+  stream_array_json = json_array();
+  result_stack_json->push(stream_array_json);
+  JsonSend(start.c_str());
+}
+
+void OutputFormatter::JsonStreamItems(bool all)
+{
+  size_t size = json_array_size(stream_array_json);
+  if (size == 0 || (!all && size < stream_batch_items)) { return; }
+
+  size_t flags = compact ? UA_JSON_FLAGS_COMPACT : UA_JSON_FLAGS_NORMAL;
+  std::string items;
+  for (size_t i = 0; i < size; ++i) {
+    if (!stream_first_item) { items += ", "; }
+    items += JsonDump(json_array_get(stream_array_json, i), flags);
+    stream_first_item = false;
+  }
+  json_array_clear(stream_array_json);
+  JsonSend(items.c_str());
+}
+
+void OutputFormatter::JsonStreamArrayEnd()
+{
+  JsonStreamItems(true);
+  JsonSend("]");
+  json_decref(stream_array_json);
+  stream_array_json = nullptr;
+}
+
+/* Sends what is left of the result after its first array was streamed.  As
+ * the result has been sent already, errors are reported by an additional
+ * error member instead of the result member. */
+void OutputFormatter::JsonStreamFinalizeResult(bool result)
+{
+  size_t flags = compact ? UA_JSON_FLAGS_COMPACT : UA_JSON_FLAGS_NORMAL;
+  if (stream_array_json) { JsonStreamArrayEnd(); }
+
+  bool failed = !result || JsonHasErrorMessage();
+  if (!failed) { JsonAddMeta(); }
+
+  std::string end;
+  std::string members = JsonDumpMembers(result_json, flags);
+  if (!members.empty()) { end += ", " + members; }
+  end += "}";
+  if (failed) {
+    end += ", \"error\": {\"code\": 1, \"message\": \"failed\", "
+           "\"data\": {\"messages\": "
+           + JsonDump(message_object_json, flags) + "}}";
+  }
+  end += "}";
+  JsonSend(end.c_str());
+
+  JsonResetResult();
+}
+
+void OutputFormatter::JsonResetResult()
+{
+  while (result_stack_json->pop()) {}
+
+  if (stream_array_json) {
+    json_decref(stream_array_json);
+    stream_array_json = nullptr;
+  }
+  stream_started = false;
+
+  json_object_clear(result_json);
+  json_decref(result_json);
+  result_json = nullptr;
+  result_json = json_object();
+  result_stack_json->push(result_json);
+
+  json_object_clear(message_object_json);
+  json_decref(message_object_json);
+  message_object_json = nullptr;
+  message_object_json = json_object();
+}
+
 void OutputFormatter::JsonFinalizeResult(bool result)
 {
   json_t* msg_obj = json_object();
   json_t* error_obj = NULL;
   json_t* data_obj = NULL;
-  json_t* meta_obj = NULL;
-  json_t* range_obj = NULL;
-  PoolMem ErrorMsg;
   char* string;
 
   /* We mimic json-rpc result and error messages,
    * To make it easier to implement real json-rpc later on. */
   json_object_set_new(msg_obj, "jsonrpc", json_string("2.0"));
-  json_object_set_new(msg_obj, "id", json_null());
+  json_object_set_new(msg_obj, "id",
+                      request_id ? json_integer(*request_id) : json_null());
 
   if (!result || JsonHasErrorMessage()) {
     error_obj = json_object();
@@ -981,26 +1174,7 @@ void OutputFormatter::JsonFinalizeResult(bool result)
     json_object_set_new(msg_obj, "error", error_obj);
   } else {
     json_object_set(msg_obj, "result", result_json);
-    if (HasFilters()) {
-      meta_obj = json_object();
-      json_object_set_new(result_json, "meta", meta_obj);
-
-      range_obj = json_object();
-
-      for (of_filter_tuple* tuple : filters) {
-        if (tuple->type == OF_FILTER_LIMIT) {
-          json_object_set_new(range_obj, "limit",
-                              json_integer(tuple->u.limit_filter.limit));
-        }
-        if (tuple->type == OF_FILTER_OFFSET) {
-          json_object_set_new(range_obj, "offset",
-                              json_integer(tuple->u.offset_filter.offset));
-        }
-      }
-      json_object_set_new(range_obj, "filtered",
-                          json_integer(get_num_rows_filtered()));
-      json_object_set_new(meta_obj, "range", range_obj);
-    }
+    JsonAddMeta();
   }
 
   if (compact) {
@@ -1012,46 +1186,12 @@ void OutputFormatter::JsonFinalizeResult(bool result)
     // json_dumps return NULL on failure (this should not happen).
     Emsg0(M_ERROR, 0, "Failed to generate json string.\n");
   } else {
-    size_t string_length = strlen(string);
-    Dmsg1(800, "message length (json): %lld\n", string_length);
-    // send json string, on failure, send json error message
-    if (!send_func(send_ctx, "%s", string)) {
-      /* If send failed, include short messages in error messages.
-       * As messages can get quite long, don't show long messages. */
-      ErrorMsg.bsprintf("Failed to send json message (length=%lld). ",
-                        string_length);
-      if (string_length < max_message_length_shown_in_error) {
-        ErrorMsg.strcat("Message: ");
-        ErrorMsg.strcat(string);
-        ErrorMsg.strcat("\n");
-      } else {
-        ErrorMsg.strcat("Maybe result message to long?\n");
-      }
-      Dmsg0(100, ErrorMsg.c_str());
-      JsonSendErrorMessage(ErrorMsg.c_str());
-    }
-#  if JANSSON_VERSION_HEX >= 0x020800
-    json_free_t my_free;
-    json_get_alloc_funcs(nullptr, &my_free);
-    my_free(string);
-#  else
-    free(string);
-#  endif
+    JsonSend(string);
+    FreeJsonString(string);
   }
 
   /* cleanup and reinitialize */
-  while (result_stack_json->pop()) {}
-
-  json_object_clear(result_json);
-  json_decref(result_json);
-  result_json = nullptr;
-  result_json = json_object();
-  result_stack_json->push(result_json);
-
-  json_object_clear(message_object_json);
-  json_decref(message_object_json);
-  message_object_json = nullptr;
-  message_object_json = json_object();
+  JsonResetResult();
 
   json_object_clear(msg_obj);
   json_decref(msg_obj);
@@ -53,6 +53,8 @@ typedef struct json_t json_t;
 #include "lib/alist.h"
 #include "lib/api_mode.h"
 #include <stdint.h>
+#include <optional>
+#include <string>
 
 class PoolMem;
 
@@ -126,10 +128,20 @@ class OutputFormatter {
   PoolMem* result_message_plain = nullptr;
   static const unsigned int max_message_length_shown_in_error = 1024;
   int num_rows_filtered = 0;
+  std::optional<uint64_t> request_id;
 #if HAVE_JANSSON
   json_t* result_json = nullptr;
   alist<json_t*>* result_stack_json = nullptr;
   json_t* message_object_json = nullptr;
+
+  /* With streaming set, the items of the first array of the result are sent
+   * as soon as there are stream_batch_items of them instead of keeping the
+   * whole result in memory until FinalizeResult(). */
+  static const std::size_t stream_batch_items = 100;
+  bool streaming = false;
+  bool stream_started = false; /* the start of the result has been sent */
+  bool stream_first_item = true;
+  json_t* stream_array_json = nullptr;
 #endif
 
  private:
@@ -150,6 +162,13 @@ class OutputFormatter {
 
 #if HAVE_JANSSON
   bool JsonSendErrorMessage(const char* message);
+  bool JsonSend(const char* string);
+  void JsonAddMeta();
+  void JsonResetResult();
+  void JsonStreamArrayStart(const char* name);
+  void JsonStreamItems(bool all);
+  void JsonStreamArrayEnd();
+  void JsonStreamFinalizeResult(bool result);
 #endif
 
  public:
@@ -170,6 +189,18 @@ class OutputFormatter {
   void SetCompact(bool value) { compact = value; }
   bool GetCompact() { return compact; }
 
+  /* The id of the JSON-RPC response of the next FinalizeResult(), null if
+   * there is none. */
+  void SetRequestId(std::optional<uint64_t> id) { request_id = id; }
+
+  /* Send long lists in JSON mode while they are produced, only until the
+   * next FinalizeResult(). */
+#if HAVE_JANSSON
+  void SetStreaming(bool value) { streaming = value; }
+#else
+  void SetStreaming(bool) {}
+#endif
+
   void Decoration(const char* fmt, ...);
 
   void ArrayStart(const char* name, const char* fmt = NULL);
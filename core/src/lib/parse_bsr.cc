@@ -454,13 +454,21 @@ static storagedaemon::BootStrapRecord* store_findex(
     findex->findex = lc->u.pint32_val;
     findex->findex2 = lc->u2.pint32_val;
 
-    // Add it to the end of the chain
+    /* Keep the chain sorted by the start index, the matching code relies on
+     * that.  Bootstraps written by the director are already sorted, so this
+     * is an append to the tail unless the bootstrap was written by hand. */
+    storagedaemon::BsrFileIndex* tail = bsr->FileIndexTail;
     if (!bsr->FileIndex) {
+      bsr->FileIndex = bsr->FileIndexTail = findex;
+    } else if (tail->findex <= findex->findex) {
+      tail->next = bsr->FileIndexTail = findex;
+    } else if (findex->findex < bsr->FileIndex->findex) {
+      findex->next = bsr->FileIndex;
       bsr->FileIndex = findex;
     } else {
-      // Add to end of chain
       storagedaemon::BsrFileIndex* bs = bsr->FileIndex;
-      for (; bs->next; bs = bs->next) {}
+      while (bs->next->findex <= findex->findex) { bs = bs->next; }
+      findex->next = bs->next;
       bs->next = findex;
     }
     token = LexGetToken(lc, BCT_ALL);
@@ -260,30 +260,27 @@ bool ConfigurationParser::AppendToResourcesChain(BareosResource* new_resource,
     return false;
   }
 
-  if (!config_resources_container_->configuration_resources_[rindex]) {
-    config_resources_container_->configuration_resources_[rindex]
-        = new_resource;
+  ConfigResourcesContainer& container = *config_resources_container_;
+  if (container.FindInIndex(rindex, new_resource->resource_name_)) {
+    Emsg2(M_ERROR, 0,
+          T_("Attempt to define second %s resource named \"%s\" is not "
+             "permitted.\n"),
+          resource_definitions_[rindex].name, new_resource->resource_name_);
+    return false;
+  }
+
+  BareosResource* last = container.Tail(rindex);
+  if (!last) {
+    container.configuration_resources_[rindex] = new_resource;
     Dmsg3(900, "Inserting first %s res: %s index=%d\n", ResToStr(rcode),
           new_resource->resource_name_, rindex);
   } else {  // append
-    BareosResource* last = nullptr;
-    BareosResource* current
-        = config_resources_container_->configuration_resources_[rindex];
-    do {
-      if (bstrcmp(current->resource_name_, new_resource->resource_name_)) {
-        Emsg2(M_ERROR, 0,
-              T_("Attempt to define second %s resource named \"%s\" is not "
-                 "permitted.\n"),
-              resource_definitions_[rindex].name, new_resource->resource_name_);
-        return false;
-      }
-      last = current;
-      current = last->next_;
-    } while (current);
     last->next_ = new_resource;
     Dmsg3(900, T_("Inserting %s res: %s index=%d\n"), ResToStr(rcode),
           new_resource->resource_name_, rindex);
   }
+  container.SetTail(rindex, new_resource);
+  container.AddToIndex(rindex, new_resource);
   return true;
 }
 
@@ -548,6 +545,8 @@ bool ConfigurationParser::RemoveResource(int rcode, const char* name)
               name);
         last->next_ = res->next_;
       }
+      config_resources_container_->RemoveFromIndex(rindex, name);
+      config_resources_container_->SetTail(rindex, nullptr);
       res->next_ = nullptr;
       FreeResourceCb_(res, rcode);
       return true;
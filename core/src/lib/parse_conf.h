@@ -39,6 +39,9 @@
 #include <functional>
 #include <memory>
 #include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 struct ResourceItem;
 class ConfigParserStateMachine;
@@ -428,6 +431,11 @@ class ConfigResourcesContainer {
  private:
   std::chrono::time_point<std::chrono::system_clock> timestamp_{};
   ConfigurationParser* config_ = nullptr;
+  /* Resources by name per resource type, kept up to date by
+   * AppendToResourcesChain() and RemoveResource(). */
+  std::vector<std::unordered_map<std::string, BareosResource*>> index_;
+  // Last resource of every list, so appending does not walk it.
+  std::vector<BareosResource*> tails_;
 
  public:
   BareosResource** configuration_resources_ = nullptr;
@@ -439,6 +447,8 @@ class ConfigResourcesContainer {
         = (BareosResource**)malloc(num * sizeof(BareosResource*));
 
     for (int i = 0; i < num; i++) { configuration_resources_[i] = nullptr; }
+    index_.resize(num);
+    tails_.resize(num, nullptr);
     Dmsg1(10, "ConfigResourcesContainer: new configuration_resources_ %p\n",
           configuration_resources_);
   }
@@ -457,6 +467,29 @@ class ConfigResourcesContainer {
   }
   void SetTimestampToNow() { timestamp_ = std::chrono::system_clock::now(); }
   std::string TimeStampAsString() { return TPAsString(timestamp_); }
+
+  BareosResource* FindInIndex(int rcode, const char* name) const
+  {
+    auto found = index_[rcode].find(name);
+    return found == index_[rcode].end() ? nullptr : found->second;
+  }
+  void AddToIndex(int rcode, BareosResource* res)
+  {
+    index_[rcode].emplace(res->resource_name_, res);
+  }
+  void RemoveFromIndex(int rcode, const char* name)
+  {
+    index_[rcode].erase(name);
+  }
+  // The last resource of type rcode, nullptr if there is none.
+  BareosResource* Tail(int rcode)
+  {
+    BareosResource*& tail = tails_[rcode];
+    if (!tail) { tail = configuration_resources_[rcode]; }
+    while (tail && tail->next_) { tail = tail->next_; }
+    return tail;
+  }
+  void SetTail(int rcode, BareosResource* res) { tails_[rcode] = res; }
 };
 
 
@@ -66,7 +66,7 @@ void ConfigurationParser::b_LockRes(const char* file, int line) const
   }
 #endif
 
-  if ((errstat = RwlWritelock(&res_lock_)) != 0) {
+  if ((errstat = RwlWritelock(&res_lock_, file, line)) != 0) {
     Emsg3(M_ABORT, 0, T_("RwlWritelock failure at %s:%d:  ERR=%s\n"), file,
           line, strerror(errstat));
   }
@@ -94,26 +94,14 @@ BareosResource* ConfigurationParser::GetResWithName(int rcode,
                                                     const char* name,
                                                     bool lock) const
 {
-  BareosResource* res;
   int rindex = rcode;
 
+  if (!name) { return nullptr; }
   if (lock) {
     ResLocker _{this};
-
-    res = config_resources_container_->configuration_resources_[rindex];
-    while (res) {
-      if (bstrcmp(res->resource_name_, name)) { break; }
-      res = res->next_;
-    }
-  } else {
-    res = config_resources_container_->configuration_resources_[rindex];
-    while (res) {
-      if (bstrcmp(res->resource_name_, name)) { break; }
-      res = res->next_;
-    }
+    return config_resources_container_->FindInIndex(rindex, name);
   }
-
-  return res;
+  return config_resources_container_->FindInIndex(rindex, name);
 }
 
 /*
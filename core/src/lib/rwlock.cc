@@ -31,6 +31,7 @@
  */
 
 #include "include/bareos.h"
+#include "lib/lock_profile.h"
 
 /*
  * Initialize a read/write lock
@@ -119,13 +120,24 @@ static void RwlWriteRelease(void* arg)
 }
 
 // Lock for read access, wait until locked (or error).
-int RwlReadlock(brwlock_t* rwl)
+int RwlReadlock(brwlock_t* rwl, libbareos::source_location loc)
+{
+  return RwlReadlock(rwl, loc.file_name(), loc.line());
+}
+
+int RwlReadlock(brwlock_t* rwl, const char* file, int line)
 {
   int status;
 
   if (rwl->valid != RWLOCK_VALID) { return EINVAL; }
+  bool sampled = lock_profile::Enabled() && lock_profile::Sample();
+  uint64_t start = sampled ? lock_profile::Now() : 0;
   if ((status = pthread_mutex_lock(&rwl->mutex)) != 0) { return status; }
+  const char* holder_file = nullptr;
+  uint32_t holder_line = 0;
   if (rwl->w_active) {
+    holder_file = rwl->writer_file ? rwl->writer_file : "an unknown writer";
+    holder_line = rwl->writer_file ? rwl->writer_line : 0;
     rwl->r_wait++; /* indicate that we are waiting */
     pthread_cleanup_push(RwlReadRelease, (void*)rwl);
     while (rwl->w_active) {
@@ -137,6 +149,11 @@ int RwlReadlock(brwlock_t* rwl)
   }
   if (status == 0) { rwl->r_active++; /* we are running */ }
   pthread_mutex_unlock(&rwl->mutex);
+  if (sampled && status == 0) {
+    lock_profile::RecordAcquisition(rwl, file, line,
+                                    lock_profile::Now() - start, holder_file,
+                                    holder_line);
+  }
   return status;
 }
 
@@ -176,18 +193,33 @@ int RwlReadunlock(brwlock_t* rwl)
  * Lock for write access, wait until locked (or error).
  *   Multiple nested write locking is permitted.
  */
-int RwlWritelock(brwlock_t* rwl)
+int RwlWritelock(brwlock_t* rwl, libbareos::source_location loc)
+{
+  return RwlWritelock(rwl, loc.file_name(), loc.line());
+}
+
+int RwlWritelock(brwlock_t* rwl, const char* file, int line)
 {
   int status;
 
   if (rwl->valid != RWLOCK_VALID) { return EINVAL; }
+  bool sampled = lock_profile::Enabled() && lock_profile::Sample();
+  uint64_t start = sampled ? lock_profile::Now() : 0;
   if ((status = pthread_mutex_lock(&rwl->mutex)) != 0) { return status; }
   if (rwl->w_active && pthread_equal(rwl->writer_id, pthread_self())) {
     rwl->w_active++;
     pthread_mutex_unlock(&rwl->mutex);
     return 0;
   }
+  const char* holder_file = nullptr;
+  uint32_t holder_line = 0;
   if (rwl->w_active || rwl->r_active > 0) {
+    if (rwl->w_active && rwl->writer_file) {
+      holder_file = rwl->writer_file;
+      holder_line = rwl->writer_line;
+    } else {
+      holder_file = rwl->w_active ? "an unknown writer" : "readers";
+    }
     rwl->w_wait++; /* indicate that we are waiting */
     pthread_cleanup_push(RwlWriteRelease, (void*)rwl);
     while (rwl->w_active || rwl->r_active > 0) {
@@ -201,8 +233,16 @@ int RwlWritelock(brwlock_t* rwl)
   if (status == 0) {
     rwl->w_active++;                 /* we are running */
     rwl->writer_id = pthread_self(); /* save writer thread's id */
+    bool profiled = lock_profile::Enabled();
+    rwl->writer_file = profiled ? file : nullptr;
+    rwl->writer_line = profiled ? line : 0;
   }
   pthread_mutex_unlock(&rwl->mutex);
+  if (sampled && status == 0) {
+    lock_profile::RecordAcquisition(rwl, file, line,
+                                    lock_profile::Now() - start, holder_file,
+                                    holder_line);
+  }
   return status;
 }
 
@@ -223,6 +263,7 @@ int RwlWritetrylock(brwlock_t* rwl)
   } else {
     rwl->w_active = 1;               /* we are running */
     rwl->writer_id = pthread_self(); /* save writer thread's id */
+    rwl->writer_file = nullptr;
   }
   status2 = pthread_mutex_unlock(&rwl->mutex);
   return (status == 0 ? status2 : status);
@@ -33,6 +33,7 @@
 #define BAREOS_LIB_RWLOCK_H_
 
 #include <pthread.h>
+#include <cstdint>
 #include "lib/source_location.h"
 
 struct brwlock_t {
@@ -40,6 +41,8 @@ struct brwlock_t {
   pthread_cond_t read = PTHREAD_COND_INITIALIZER;  /* wait for read */
   pthread_cond_t write = PTHREAD_COND_INITIALIZER; /* wait for write */
   pthread_t writer_id{};                           /* writer's thread id */
+  const char* writer_file{}; /* where the writer locked it, if profiled */
+  uint32_t writer_line{};
   int priority{}; /* used in deadlock detection */
   int valid{};    /* set when valid */
   int r_active{}; /* readers active */
@@ -54,10 +57,16 @@ static constexpr int RWLOCK_VALID{0xfacade};
 int RwlInit(brwlock_t* rwl, int priority = 0);
 int RwlDestroy(brwlock_t* rwl);
 bool RwlIsInit(brwlock_t* rwl);
-int RwlReadlock(brwlock_t* rwl);
+int RwlReadlock(brwlock_t* rwl,
+                libbareos::source_location loc
+                = libbareos::source_location::current());
+int RwlReadlock(brwlock_t* rwl, const char* file, int line);
 int RwlReadtrylock(brwlock_t* rwl);
 int RwlReadunlock(brwlock_t* rwl);
-int RwlWritelock(brwlock_t* rwl);
+int RwlWritelock(brwlock_t* rwl,
+                 libbareos::source_location loc
+                 = libbareos::source_location::current());
+int RwlWritelock(brwlock_t* rwl, const char* file, int line);
 int RwlWritetrylock(brwlock_t* rwl);
 int RwlWriteunlock(brwlock_t* rwl);
 void RwlAssertWriterIsMe(brwlock_t* rwl,
@@ -0,0 +1,139 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * cumulative per job timers for the stages of a data pipeline
+ *
+ * Every stage accumulates the time spent in it and, separately, the time it
+ * was stalled waiting for a neighbouring stage together with the number of
+ * such stalls.  Stages may run in different threads, so all counters are
+ * atomic.  The stages are given by an enum class that ends with kCount.
+ */
+
+#ifndef BAREOS_LIB_STAGE_TIMER_H_
+#define BAREOS_LIB_STAGE_TIMER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+template <typename Stage> class stage_timers {
+ public:
+  using clock = std::chrono::steady_clock;
+  static constexpr std::size_t num_stages
+      = static_cast<std::size_t>(Stage::kCount);
+
+  // waits shorter than this are not counted as stall
+  static constexpr clock::duration stall_threshold
+      = std::chrono::milliseconds(1);
+
+  void Add(Stage stage, clock::duration d)
+  {
+    busy_ns_[Index(stage)].fetch_add(Ns(d), std::memory_order_relaxed);
+  }
+
+  void AddWait(Stage stage, clock::duration d)
+  {
+    if (d < stall_threshold) { return; }
+    stalled_ns_[Index(stage)].fetch_add(Ns(d), std::memory_order_relaxed);
+    stalls_[Index(stage)].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // adds the time from its creation to its destruction to a stage
+  class timer {
+   public:
+    timer(stage_timers& timers, Stage stage, bool wait = false)
+        : timers_{timers}, stage_{stage}, wait_{wait}, start_{clock::now()}
+    {
+    }
+    ~timer()
+    {
+      auto elapsed = clock::now() - start_;
+      if (wait_) {
+        timers_.AddWait(stage_, elapsed);
+      } else {
+        timers_.Add(stage_, elapsed);
+      }
+    }
+
+   private:
+    stage_timers& timers_;
+    Stage stage_;
+    bool wait_;
+    clock::time_point start_;
+  };
+
+  timer Time(Stage stage) { return timer{*this, stage}; }
+  timer TimeWait(Stage stage) { return timer{*this, stage, true}; }
+
+  uint64_t BusyNs(Stage stage) const
+  {
+    return busy_ns_[Index(stage)].load(std::memory_order_relaxed);
+  }
+  uint64_t StalledNs(Stage stage) const
+  {
+    return stalled_ns_[Index(stage)].load(std::memory_order_relaxed);
+  }
+  uint64_t Stalls(Stage stage) const
+  {
+    return stalls_[Index(stage)].load(std::memory_order_relaxed);
+  }
+
+  /* Renders all stages that were used as "name=1.234s" separated by blanks,
+   * stalls are appended as "(stalled 3x 0.100s)". */
+  std::string Format(const char* const (&names)[num_stages]) const
+  {
+    std::string out;
+    char buf[128];
+    for (std::size_t i = 0; i < num_stages; ++i) {
+      Stage stage = static_cast<Stage>(i);
+      uint64_t busy = BusyNs(stage), stalls = Stalls(stage);
+      if (busy == 0 && stalls == 0) { continue; }
+      int len = snprintf(buf, sizeof(buf), "%s%s=%.3fs", out.empty() ? "" : " ",
+                         names[i], busy / 1e9);
+      if (stalls > 0) {
+        snprintf(buf + len, sizeof(buf) - len, " (stalled %llux %.3fs)",
+                 static_cast<unsigned long long>(stalls),
+                 StalledNs(stage) / 1e9);
+      }
+      out += buf;
+    }
+    return out;
+  }
+
+ private:
+  static std::size_t Index(Stage stage)
+  {
+    return static_cast<std::size_t>(stage);
+  }
+  static uint64_t Ns(clock::duration d)
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+  }
+
+  std::atomic<uint64_t> busy_ns_[num_stages]{};
+  std::atomic<uint64_t> stalled_ns_[num_stages]{};
+  std::atomic<uint64_t> stalls_[num_stages]{};
+};
+
+#endif  // BAREOS_LIB_STAGE_TIMER_H_
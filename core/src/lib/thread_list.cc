@@ -204,6 +204,13 @@ static void WorkerThread(
 }
 
 bool ThreadList::CreateAndAddNewThread(ConfigurationParser* config, void* data)
+{
+  return CreateAndAddNewThread(config, data, impl_->ThreadInvokedHandler_);
+}
+
+bool ThreadList::CreateAndAddNewThread(ConfigurationParser* config,
+                                       void* data,
+                                       ThreadHandler handler)
 {
   std::lock_guard<std::mutex> lg(impl_->l->thread_list_mutex_);
 
@@ -211,9 +218,8 @@ bool ThreadList::CreateAndAddNewThread(ConfigurationParser* config, void* data)
   bool success{false};
 
   try {
-    std::thread thr{std::thread(WorkerThread, impl_->l,
-                                impl_->ThreadInvokedHandler_, config, data,
-                                run_condition)};
+    std::thread thr{std::thread(WorkerThread, impl_->l, std::move(handler),
+                                config, data, run_condition)};
 
     if (run_condition->WaitUntilThreadIsRunning()
         == IsRunningCondition::Result::kIsRunning) {
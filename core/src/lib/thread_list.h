@@ -43,6 +43,10 @@ class ThreadList {
             ShutdownCallback ShutdownCallback = nullptr);
 
   bool CreateAndAddNewThread(ConfigurationParser* config, void* data);
+  // like above, but the thread runs handler instead of the one from Init()
+  bool CreateAndAddNewThread(ConfigurationParser* config,
+                             void* data,
+                             ThreadHandler handler);
   bool ShutdownAndWaitForThreadsToFinish();
   std::size_t Size() const;
 
@@ -0,0 +1,130 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * worker threads shared by all thread pools
+ */
+
+#include "lib/thread_pool.h"
+#include "lib/thread_specific_data.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace worker_threads {
+namespace {
+// idle threads exit after this long without work
+constexpr std::chrono::seconds idle_timeout{60};
+
+std::size_t default_max_idle()
+{
+  return std::max(16u, 2 * std::thread::hardware_concurrency());
+}
+
+struct worker {
+  std::condition_variable wakeup;
+  std::optional<task> work;
+};
+
+struct shared_state {
+  std::mutex mutex;
+  std::vector<worker*> idle;
+  std::size_t max_idle{default_max_idle()};
+  std::size_t threads{0};
+  std::uint64_t started{0};
+  std::uint64_t reused{0};
+  std::uint64_t tasks_run{0};
+};
+
+/* never destroyed, so that detached workers can still use it while the
+ * program exits */
+shared_state& state()
+{
+  static shared_state* s = new shared_state;
+  return *s;
+}
+
+void work(task first)
+{
+  shared_state& s = state();
+  worker self;
+  self.work.emplace(std::move(first));
+
+  std::unique_lock lock(s.mutex);
+  for (;;) {
+    std::optional<task> t = std::move(self.work);
+    self.work.reset();
+    lock.unlock();
+
+    t.value()();
+    t.reset();
+    // the next task might belong to some other job
+    SetJcrInThreadSpecificData(nullptr);
+
+    lock.lock();
+    s.tasks_run += 1;
+    if (s.idle.size() >= s.max_idle) { break; }
+
+    s.idle.push_back(&self);
+    if (!self.wakeup.wait_for(lock, idle_timeout,
+                              [&self] { return self.work.has_value(); })) {
+      s.idle.erase(std::find(s.idle.begin(), s.idle.end(), &self));
+      break;
+    }
+  }
+  s.threads -= 1;
+}
+}  // namespace
+
+void run(task t)
+{
+  shared_state& s = state();
+  {
+    std::unique_lock lock(s.mutex);
+    if (!s.idle.empty()) {
+      // the most recently used thread is the most likely to be cache hot
+      worker* w = s.idle.back();
+      s.idle.pop_back();
+      w->work.emplace(std::move(t));
+      s.reused += 1;
+      w->wakeup.notify_one();
+      return;
+    }
+    s.threads += 1;
+    s.started += 1;
+  }
+  try {
+    std::thread(work, std::move(t)).detach();
+  } catch (...) {
+    std::unique_lock lock(s.mutex);
+    s.threads -= 1;
+    throw;
+  }
+}
+
+thread_pool_stats stats()
+{
+  shared_state& s = state();
+  std::unique_lock lock(s.mutex);
+  return thread_pool_stats{s.threads, s.idle.size(), s.max_idle,
+                           s.started, s.reused,      s.tasks_run};
+}
+}  // namespace worker_threads
@@ -27,6 +27,7 @@
 #define BAREOS_LIB_THREAD_POOL_H_
 
 #include <vector>
+#include <cstdint>
 #include <thread>
 #include <optional>
 #include <deque>
@@ -83,127 +84,74 @@ class task {
   std::unique_ptr<impl_base> ptr;
 };
 
+/* Statistics of the worker threads shared by all thread_pools of the
+ * process. */
+struct thread_pool_stats {
+  std::size_t threads{};       // currently alive
+  std::size_t idle{};          // waiting for work
+  std::size_t max_idle{};      // idle threads kept around
+  std::uint64_t started{};     // threads started since program start
+  std::uint64_t reused{};      // tasks that got an idle thread
+  std::uint64_t tasks_run{};   // tasks finished
+};
+
+/* Hands every task to a worker thread of its own; the task can block for as
+ * long as it wants.  The threads are shared by all pools of the process, so
+ * idle ones get reused across jobs instead of every job growing its own set.
+ * Threads that stay idle for too long, or that are not needed because enough
+ * others are idle already, exit. */
+namespace worker_threads {
+void run(task t);
+thread_pool_stats stats();
+}  // namespace worker_threads
+
 struct thread_pool {
   // f does not need to be copyable
   template <typename F> void borrow_thread(F&& f)
   {
-    with_free_threads(1, [f = std::move(f)](work_unit& unit) mutable {
-      unit.submit(std::move(f));
-    });
+    run(task{[f = std::move(f)]() mutable { f(); }});
   }
 
   // f needs to be copyable here
   template <typename F> void borrow_threads(std::size_t size, F&& f)
   {
-    with_free_threads(
-        size, [f = std::move(f)](work_unit& unit) mutable { unit.submit(f); });
+    for (std::size_t i = 0; i < size; ++i) {
+      run(task{[f]() mutable { f(); }});
+    }
   }
 
+  thread_pool() = default;
+  thread_pool(const thread_pool&) = delete;
+  thread_pool& operator=(const thread_pool&) = delete;
+
+  // waits for all borrowed threads to finish
   ~thread_pool()
   {
-    for (auto& sync : units) { sync->lock()->close(); }
-
-    for (auto& thread : threads) { thread.join(); }
+    std::unique_lock lock(mutex);
+    finished.wait(lock, [this] { return running == 0; });
   }
 
  private:
-  template <typename ThreadFn>
-  void with_free_threads(std::size_t size, ThreadFn f)
+  void run(task t)
   {
-    std::size_t found = 0;
-    for (std::size_t i = 0; i < threads.size() && found < size; ++i) {
-      if (auto locked = units[i]->try_lock();
-          locked && locked.value()->is_waiting()) {
-        f(*locked.value());
-        found += 1;
-      }
-    }
-
-    // if there were not enough free threads, we need to create new ones
-    for (std::size_t i = found; i < size; ++i) {
-      auto idx = threads.size();
-      add_thread();
-
-      ASSERT(idx == threads.size() - 1);
-      f(*units[idx]->lock());
-    }
-  }
-
-  class work_unit {
-   public:
-    template <typename F> void submit(F f)
     {
-      ASSERT(state == work_state::WAITING);
-      fun = std::move(f);
-      state = work_state::WORKING;
-      state_changed.notify_all();
+      std::unique_lock lock(mutex);
+      running += 1;
     }
-
-    void close()
-    {
-      state = work_state::CLOSED;
-      fun.reset();
-      state_changed.notify_all();
-    }
-
-    bool is_waiting() const { return state == work_state::WAITING; }
-
-    bool is_closed() const { return state == work_state::CLOSED; }
-
-    void do_work()
-    {
-      ASSERT(state == work_state::WORKING);
-      ASSERT(fun.has_value());
-      fun.value()();
-      fun.reset();
-      state = work_state::WAITING;
-      state_changed.notify_all();
-    }
-
-    std::condition_variable state_changed;
-
-   private:
-    enum class work_state
-    {
-      WORKING,
-      WAITING,
-      CLOSED
-    };
-    work_state state{work_state::WAITING};
-    std::optional<task> fun;
-  };
-
-  std::vector<std::unique_ptr<synchronized<work_unit>>> units;
-  std::vector<std::thread> threads{};
-
-  void add_thread()
-  {
-    // sync will live at least as long as threads, so its ok to *NOT* use
-    // a shared ptr here.
-    auto& sync
-        = units.emplace_back(std::make_unique<synchronized<work_unit>>());
-    threads.emplace_back(
-        [](thread_pool* pool, synchronized<work_unit>* unit) {
-          pool->pool_work(*unit);
-        },
-        this, sync.get());
+    worker_threads::run(
+        task{[this, t = std::optional<task>{std::move(t)}]() mutable {
+          t.value()();
+          t.reset();  // the task must be gone once the pool is destroyed
+
+          std::unique_lock lock(mutex);
+          running -= 1;
+          finished.notify_all();
+        }});
   }
 
-  void pool_work(synchronized<work_unit>& unit)
-  {
-    auto locked = unit.lock();
-    for (;;) {
-      // the state is either WAITING/CLOSED or WORKING
-      locked.wait(locked->state_changed,
-                  [](const work_unit& w) { return !w.is_waiting(); });
-
-      // state is either CLOSED or WORKING
-      if (locked->is_closed()) { return; }
-
-      // state is WORKING
-      locked->do_work();
-    }
-  }
+  std::mutex mutex;
+  std::condition_variable finished;
+  std::size_t running{0};
 };
 
 struct work_group {
@@ -65,7 +65,18 @@ class Tls {
   virtual int TlsBsockWriten(BareosSocket* bsock, char* ptr, int32_t nbytes)
       = 0;
   virtual int TlsBsockReadn(BareosSocket* bsock, char* ptr, int32_t nbytes) = 0;
+  // as TlsBsockReadn(), but returns once at least one byte was read
+  virtual int TlsBsockRead(BareosSocket* bsock, char* ptr, int32_t nbytes) = 0;
+  /* Sends nbytes of the file fd starting at offset straight from the kernel,
+   * only possible if kTLS is used for sending (see KtlsSendStatus()). */
+  virtual int TlsBsockSendfile(BareosSocket* bsock,
+                               int fd,
+                               int64_t offset,
+                               int32_t nbytes)
+      = 0;
   virtual bool TlsBsockConnect(BareosSocket* bsock) = 0;
+  // data that was already read from the socket but not handed out yet
+  virtual bool TlsBsockHasPendingData() = 0;
   virtual void TlsBsockShutdown(BareosSocket* bsock) = 0;
   virtual void TlsLogConninfo(JobControlRecord* jcr,
                               const char* host,
@@ -91,6 +102,8 @@ class Tls {
   virtual void SetDhFile(const std::string& dhfile_) = 0;
   virtual void SetVerifyPeer(const bool& verify_peer) = 0;
   virtual void SetEnableKtls(bool ktls) = 0;
+  // seconds a session can be resumed, 0 disables resumption
+  virtual void SetSessionLifetime(int64_t seconds) = 0;
   virtual void SetTcpFileDescriptor(const int& fd) = 0;
 };
 
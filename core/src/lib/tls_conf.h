@@ -48,6 +48,7 @@ class TlsResource {
   bool tls_enable_{false};
   bool tls_require_{false};
   bool enable_ktls_{false}; /* enable support for ktls */
+  utime_t session_lifetime_{0}; /* TLS sessions can be resumed that long */
 
   bool IsTlsConfigured() const;
   TlsPolicy GetPolicy() const;
@@ -25,6 +25,7 @@
 class TlsConfigCert {
  public:
   bool verify_peer_ = false; /* TLS Verify Peer Certificate */
+  bool skip_cram_md5_ = false; /* verified certificate replaces CRAM-MD5 */
   std::string ca_certfile_;  /* TLS CA Certificate File */
   std::string ca_certdir_;   /* TLS CA Certificate Directory */
   std::string crlfile_;      /* TLS CA Certificate Revocation List File */
@@ -271,6 +271,16 @@ bool TlsOpenSsl::TlsBsockAccept(BareosSocket* bsock)
   return d_->OpensslBsockSessionStart(bsock, true);
 }
 
+bool TlsOpenSsl::TlsBsockHasPendingData()
+{
+  if (!d_->openssl_) { return false; }
+#if (OPENSSL_VERSION_NUMBER >= 0x10100000L)
+  return SSL_has_pending(d_->openssl_) == 1;
+#else
+  return SSL_pending(d_->openssl_) > 0;
+#endif
+}
+
 void TlsOpenSsl::TlsBsockShutdown(BareosSocket* bsock)
 {
   /* SSL_shutdown must be called twice to fully complete the process -
@@ -345,6 +355,20 @@ int TlsOpenSsl::TlsBsockReadn(BareosSocket* bsock, char* ptr, int32_t nbytes)
 {
   return d_->OpensslBsockReadwrite(bsock, ptr, nbytes, false);
 }
+
+int TlsOpenSsl::TlsBsockRead(BareosSocket* bsock, char* ptr, int32_t nbytes)
+{
+  return d_->OpensslBsockReadwrite(bsock, ptr, nbytes, false, true);
+}
+
+int TlsOpenSsl::TlsBsockSendfile(BareosSocket* bsock,
+                                 int fd,
+                                 int64_t offset,
+                                 int32_t nbytes)
+{
+  return d_->OpensslBsockSendfile(bsock, fd, offset, nbytes);
+}
+
 bool TlsOpenSsl::KtlsSendStatus() { return d_->KtlsSendStatus(); }
 
 bool TlsOpenSsl::KtlsRecvStatus() { return d_->KtlsRecvStatus(); }
@@ -46,7 +46,13 @@ class TlsOpenSsl : public Tls {
   bool TlsBsockAccept(BareosSocket* bsock) override;
   int TlsBsockWriten(BareosSocket* bsock, char* ptr, int32_t nbytes) override;
   int TlsBsockReadn(BareosSocket* bsock, char* ptr, int32_t nbytes) override;
+  int TlsBsockRead(BareosSocket* bsock, char* ptr, int32_t nbytes) override;
+  int TlsBsockSendfile(BareosSocket* bsock,
+                       int fd,
+                       int64_t offset,
+                       int32_t nbytes) override;
   bool TlsBsockConnect(BareosSocket* bsock) override;
+  bool TlsBsockHasPendingData() override;
   void TlsBsockShutdown(BareosSocket* bsock) override;
 
   std::string TlsCipherGetName() const override;
@@ -70,6 +76,7 @@ class TlsOpenSsl : public Tls {
   void SetDhFile(const std::string& dhfile_) override;
   void SetVerifyPeer(const bool& verify_peer) override;
   void SetEnableKtls(bool ktls) override;
+  void SetSessionLifetime(int64_t seconds) override;
   void SetTcpFileDescriptor(const int& fd) override;
 
   bool KtlsSendStatus() override;
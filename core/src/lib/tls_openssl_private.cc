@@ -36,6 +36,7 @@
 #include "include/compiler_macro.h"
 
 #include <openssl/err.h>
+#include <openssl/rand.h>
 #include <openssl/ssl.h>
 #include <algorithm>
 #include <array>
@@ -48,6 +49,43 @@ static synchronized<std::unordered_map<const SSL_CTX*, PskCredentials>>
     client_cred;
 static std::mutex file_access_mutex_;
 
+/* Sessions of earlier client connections, per peer and identity.  Every one
+ * is only resumed once, like TLS 1.3 wants it. */
+static constexpr std::size_t max_cached_sessions = 1024;
+static synchronized<std::unordered_map<std::string, SSL_SESSION*>>
+    client_sessions;
+
+/* Every connection has its own SSL_CTX, so the daemon has to share the key of
+ * its session tickets between them for a session to be resumed at all.  It
+ * is renewed once it is older than the session lifetime. */
+struct ticket_key {
+  time_t created{0};
+  unsigned char keys[80]{};
+};
+static synchronized<ticket_key> ticket_keys;
+
+static void SetTicketKeys(SSL_CTX* ctx, int64_t lifetime)
+{
+#if (OPENSSL_VERSION_NUMBER >= 0x10100000L)
+  auto locked = ticket_keys.lock();
+  time_t now = time(nullptr);
+  if (locked->created == 0 || now - locked->created >= lifetime) {
+    if (RAND_bytes(locked->keys, sizeof(locked->keys)) != 1) {
+      Dmsg0(100, "Could not create session ticket keys\n");
+      return;
+    }
+    locked->created = now;
+  }
+  if (SSL_CTX_set_tlsext_ticket_keys(ctx, locked->keys, sizeof(locked->keys))
+      != 1) {
+    Dmsg0(100, "Could not set session ticket keys\n");
+  }
+#else
+  (void)ctx;
+  (void)lifetime;
+#endif
+}
+
 /* No anonymous ciphers, no <128 bit ciphers, no export ciphers, no MD5 ciphers
  */
 static constexpr std::string_view tls_default_ciphers_{
@@ -250,11 +288,27 @@ bool TlsOpenSslPrivate::init()
     SSL_CTX_set_verify(openssl_ctx_, SSL_VERIFY_NONE, NULL);
   }
 
+  if (session_lifetime_ > 0) {
+    // the sessions are kept across connections in client_sessions
+    SSL_CTX_set_session_cache_mode(
+        openssl_ctx_, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(openssl_ctx_, TlsOpenSslPrivate::NewSessionCb);
+    SSL_CTX_set_timeout(openssl_ctx_, session_lifetime_);
+    SetTicketKeys(openssl_ctx_, session_lifetime_);
+  } else {
+    SSL_CTX_set_session_cache_mode(openssl_ctx_, SSL_SESS_CACHE_OFF);
+    SSL_CTX_set_options(openssl_ctx_, SSL_OP_NO_TICKET);
+#if (OPENSSL_VERSION_NUMBER >= 0x10101000L)
+    SSL_CTX_set_num_tickets(openssl_ctx_, 0);
+#endif
+  }
+
   openssl_ = SSL_new(openssl_ctx_);
   if (!openssl_) {
     OpensslPostErrors(M_FATAL, T_("Error creating new SSL object"));
     return false;
   }
+  SSL_set_app_data(openssl_, this);
 
   /* Non-blocking partial writes */
   SSL_set_mode(openssl_, SSL_MODE_ENABLE_PARTIAL_WRITE
@@ -300,7 +354,8 @@ int TlsOpenSslPrivate::OpensslVerifyPeer(int preverify_ok,
 int TlsOpenSslPrivate::OpensslBsockReadwrite(BareosSocket* bsock,
                                              char* ptr,
                                              int nbytes,
-                                             bool write)
+                                             bool write,
+                                             bool partial)
 {
   if (!openssl_) {
     Dmsg0(100, "Attempt to write on a non initialized tls connection\n");
@@ -364,7 +419,7 @@ int TlsOpenSslPrivate::OpensslBsockReadwrite(BareosSocket* bsock,
     }
 
     /* Everything done? */
-    if (nleft == 0) { goto cleanup; }
+    if (nleft == 0 || (partial && nleft < nbytes)) { goto cleanup; }
 
     /* Timeout/Termination, let's take what we can get */
     if (bsock->IsTimedOut() || bsock->IsTerminated()) { goto cleanup; }
@@ -381,6 +436,82 @@ cleanup:
   return nbytes - nleft;
 }
 
+/* Same as OpensslBsockReadwrite() for writing, but the bytes come from the
+ * file fd and are encrypted by the kernel without passing through userspace.
+ * Returns -1 (with errno ENOSYS) if kTLS is not used for sending. */
+int TlsOpenSslPrivate::OpensslBsockSendfile(BareosSocket* bsock,
+                                            int fd,
+                                            int64_t offset,
+                                            int nbytes)
+{
+#if (OPENSSL_VERSION_NUMBER >= 0x30000000L) && !defined(OPENSSL_NO_KTLS)
+  if (!openssl_ || !KtlsSendStatus()) {
+    errno = ENOSYS;
+    return -1;
+  }
+
+  bsock->timer_start = watchdog_time;
+  bsock->ClearTimedOut();
+  bsock->SetKillable(false);
+
+  int nleft = nbytes;
+
+  while (nleft > 0) {
+    ossl_ssize_t nwritten = SSL_sendfile(openssl_, fd, offset, nleft, 0);
+
+    int ssl_error = SSL_get_error(openssl_, nwritten);
+    if (ssl_error != SSL_ERROR_NONE) {
+      Dmsg1(50, "SSL_get_error() returned error value %d\n", ssl_error);
+    }
+    switch (ssl_error) {
+      case SSL_ERROR_NONE:
+        nleft -= nwritten;
+        offset += nwritten;
+        break;
+      case SSL_ERROR_SYSCALL:
+        if (nwritten == -1) {
+          if (errno == EINTR) { continue; }
+          if (errno == EAGAIN) {
+            WaitForWritableFd(bsock->fd_, 10000, false);
+            continue;
+          }
+        }
+        OpensslPostErrors(bsock->get_jcr(), M_FATAL,
+                          T_("TLS sendfile failure."));
+        goto cleanup;
+      case SSL_ERROR_WANT_WRITE:
+        WaitForWritableFd(bsock->fd_, 10000, false);
+        break;
+      default:
+        OpensslPostErrors(bsock->get_jcr(), M_FATAL,
+                          T_("TLS sendfile failure."));
+        goto cleanup;
+    }
+
+    if (bsock->UseBwlimit()) {
+      if (nwritten > 0) { bsock->ControlBwlimit(nwritten); }
+    }
+
+    /* Timeout/Termination, let's take what we can get */
+    if (bsock->IsTimedOut() || bsock->IsTerminated()) { goto cleanup; }
+  }
+
+cleanup:
+  /* Clear timer */
+  bsock->timer_start = 0;
+  bsock->SetKillable(true);
+
+  return nbytes - nleft;
+#else
+  (void)bsock;
+  (void)fd;
+  (void)offset;
+  (void)nbytes;
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
 bool TlsOpenSslPrivate::OpensslBsockSessionStart(BareosSocket* bsock,
                                                  bool server)
 {
@@ -392,6 +523,8 @@ bool TlsOpenSslPrivate::OpensslBsockSessionStart(BareosSocket* bsock,
   bsock->ClearTimedOut();
   bsock->SetKillable(false);
 
+  if (!server) { ResumeClientSession(bsock); }
+
   for (;;) {
     int err_accept;
     if (server) {
@@ -407,6 +540,8 @@ bool TlsOpenSslPrivate::OpensslBsockSessionStart(BareosSocket* bsock,
     switch (ssl_error) {
       case SSL_ERROR_NONE:
         bsock->SetTlsEstablished();
+        Dmsg1(150, "TLS session %s\n",
+              SSL_session_reused(openssl_) ? "resumed" : "established");
         status = true;
         goto cleanup;
       case SSL_ERROR_ZERO_RETURN:
@@ -448,6 +583,61 @@ cleanup:
   return status;
 }
 
+/* Offers the session of the last connection to the same peer with the same
+ * identity, which spares the peer the key exchange and certificate checks.
+ * Both sides still authenticate each other afterwards. */
+void TlsOpenSslPrivate::ResumeClientSession(BareosSocket* bsock)
+{
+  if (session_lifetime_ <= 0 || !bsock->host()) { return; }
+
+  session_key_ = bsock->host();
+  session_key_ += ':';
+  session_key_ += std::to_string(bsock->port());
+  {
+    auto locked = client_cred.lock();
+    if (auto iter = locked->find(openssl_ctx_); iter != locked->end()) {
+      session_key_ += ':';
+      session_key_ += iter->second.get_identity();
+    }
+  }
+
+  SSL_SESSION* session = nullptr;
+  {
+    auto locked = client_sessions.lock();
+    if (auto iter = locked->find(session_key_); iter != locked->end()) {
+      session = iter->second;
+      locked->erase(iter);
+    }
+  }
+  if (session) {
+    SSL_set_session(openssl_, session);
+    SSL_SESSION_free(session);
+  }
+}
+
+// Remembers the newest session of a client connection
+int TlsOpenSslPrivate::NewSessionCb(SSL* ssl, SSL_SESSION* session)
+{ /* static */
+  auto* self = static_cast<TlsOpenSslPrivate*>(SSL_get_app_data(ssl));
+  if (!self || self->session_key_.empty()) { return 0; }
+#if (OPENSSL_VERSION_NUMBER >= 0x10101000L)
+  if (!SSL_SESSION_is_resumable(session)) { return 0; }
+#endif
+
+  auto locked = client_sessions.lock();
+  auto [iter, inserted] = locked->try_emplace(self->session_key_, session);
+  if (!inserted) {
+    SSL_SESSION_free(iter->second);
+    iter->second = session;
+  } else if (locked->size() > max_cached_sessions) {
+    auto other = locked->begin() == iter ? std::next(iter) : locked->begin();
+    SSL_SESSION_free(other->second);
+    locked->erase(other);
+  }
+
+  return 1; /* we keep the reference */
+}
+
 bool TlsOpenSslPrivate::KtlsSendStatus()
 {
 #if (OPENSSL_VERSION_NUMBER >= 0x30000000L)
@@ -636,6 +826,12 @@ void TlsOpenSsl::SetEnableKtls(bool ktls)
   d_->enable_ktls_ = ktls;
 }
 
+void TlsOpenSsl::SetSessionLifetime(int64_t seconds)
+{
+  Dmsg1(100, "Set session lifetime:\t<%lld>\n", (long long)seconds);
+  d_->session_lifetime_ = seconds;
+}
+
 void TlsOpenSsl::SetTcpFileDescriptor(const int& fd)
 {
   Dmsg1(100, "Set tcp filedescriptor: <%d>\n", fd);
@@ -45,8 +45,14 @@ class TlsOpenSslPrivate {
   int OpensslBsockReadwrite(BareosSocket* bsock,
                             char* ptr,
                             int nbytes,
-                            bool write);
+                            bool write,
+                            bool partial = false);
+  int OpensslBsockSendfile(BareosSocket* bsock,
+                           int fd,
+                           int64_t offset,
+                           int nbytes);
   bool OpensslBsockSessionStart(BareosSocket* bsock, bool server);
+  void ResumeClientSession(BareosSocket* bsock);
 
   bool KtlsSendStatus();
   bool KtlsRecvStatus();
@@ -64,6 +70,7 @@ class TlsOpenSslPrivate {
                                     const char* identity,
                                     unsigned char* psk,
                                     unsigned int max_psk_len);
+  static int NewSessionCb(SSL* ssl, SSL_SESSION* session);
   static unsigned int psk_client_cb(SSL* ssl,
                                     const char* /*hint*/,
                                     char* identity,
@@ -93,6 +100,8 @@ class TlsOpenSslPrivate {
   std::string ciphersuites_;
   bool verify_peer_{};
   bool enable_ktls_{false};
+  int64_t session_lifetime_{7200}; /* seconds, 0 = no resumption */
+  std::string session_key_; /* peer and identity of a client connection */
   std::shared_ptr<ConfigResourcesContainer>
       config_table_{};  // config table being used
 };
@@ -50,7 +50,10 @@
      "If this directive is specified, DH key exchange will be used for the ephemeral keying, " \
      "allowing for forward secrecy of communications." }, \
   { "TlsProtocol", CFG_TYPE_STDSTR, ITEM(res, protocol_), 0, CFG_ITEM_PLATFORM_SPECIFIC, NULL, \
-     "20.0.0-", "OpenSSL Configuration: Protocol"}
+     "20.0.0-", "OpenSSL Configuration: Protocol"}, \
+  { "TlsSessionLifetime", CFG_TYPE_TIME, ITEM(res, session_lifetime_), 0, CFG_ITEM_DEFAULT, "7200", \
+     "24.0.0-", "How long a TLS session can be resumed by the next connection to the same peer, " \
+     "which makes its handshake a lot cheaper. 0 disables session resumption."}
 
 // TLS Settings for Certificate only
 #define TLS_CERT_CONFIG(res)                                                \
@@ -70,7 +73,11 @@
      NULL, "Path of a PEM encoded private key. It must correspond to the " \
      "specified \"TLS Certificate\"."}, \
   { "TlsAllowedCn", CFG_TYPE_STR_VECTOR, ITEM(res, tls_cert_.allowed_certificate_common_names_), 0, 0, NULL, \
-     NULL, "\"Common Name\"s (CNs) of the allowed peer certificates." }
+     NULL, "\"Common Name\"s (CNs) of the allowed peer certificates." }, \
+  { "TlsSkipCramMd5", CFG_TYPE_BOOL, ITEM(res, tls_cert_.skip_cram_md5_), 0, CFG_ITEM_DEFAULT, "false", \
+     "24.0.0-", "Skip the CRAM-MD5 authentication if the TLS handshake already verified the certificate " \
+     "of the peer and its name (see \"TLS Verify Peer\"). Both ends of the connection have to set it, " \
+     "otherwise they fail to authenticate each other." }
 
 /* clang-format on */
 #endif  // BAREOS_LIB_TLS_RESOURCE_ITEMS_H_
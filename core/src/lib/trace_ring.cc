@@ -0,0 +1,261 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "include/bareos.h"
+#include "lib/trace_ring.h"
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+std::atomic<uint32_t> trace_categories{~uint32_t{0}};
+
+const char* TraceCategoryName(trace_category category)
+{
+  switch (category) {
+    case trace_category::kBlock:
+      return "block";
+    case trace_category::kRecord:
+      return "record";
+    case trace_category::kBackup:
+      return "backup";
+    default:
+      return "?";
+  }
+}
+
+namespace {
+struct trace_ring {
+  trace_detail::entry entries[trace_ring_entries];
+  std::atomic<uint64_t> next{0};
+  std::atomic<bool> owned{false};
+  uint32_t thread{0};
+};
+
+/* Rings are never freed, a ring of a thread that ended is handed to the next
+ * new thread, so the last entries of ended threads survive for a while. */
+std::mutex rings_mutex;
+std::vector<trace_ring*> rings;
+uint32_t threads_seen = 0;
+
+trace_ring* AcquireRing()
+{
+  std::lock_guard lock(rings_mutex);
+  trace_ring* ring = nullptr;
+  for (trace_ring* r : rings) {
+    if (!r->owned.load(std::memory_order_acquire)) {
+      ring = r;
+      break;
+    }
+  }
+  if (!ring) {
+    ring = new trace_ring;
+    rings.push_back(ring);
+  }
+  ring->owned.store(true, std::memory_order_relaxed);
+  ring->thread = ++threads_seen;
+  return ring;
+}
+
+struct ring_owner {
+  trace_ring* ring{nullptr};
+  ~ring_owner()
+  {
+    if (ring) { ring->owned.store(false, std::memory_order_release); }
+  }
+};
+
+thread_local ring_owner my_ring;
+}  // namespace
+
+namespace trace_detail {
+entry& NextEntry()
+{
+  trace_ring* ring = my_ring.ring;
+  if (!ring) { ring = my_ring.ring = AcquireRing(); }
+  uint64_t next = ring->next.load(std::memory_order_relaxed);
+  entry& e = ring->entries[next % trace_ring_entries];
+  e.thread = ring->thread;
+  return e;
+}
+
+void Commit()
+{
+  trace_ring* ring = my_ring.ring;
+  ring->next.store(ring->next.load(std::memory_order_relaxed) + 1,
+                   std::memory_order_release);
+}
+
+uint64_t Now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+/* The stored argument types decide how an argument is printed, the
+ * conversion of the format only picks the base of integers. */
+std::string Format(const entry& e)
+{
+  std::string out;
+  char spec[32];
+  char buf[256];
+  int arg = 0;
+
+  for (const char* p = e.fmt; *p; ++p) {
+    if (*p != '%') {
+      out += *p;
+      continue;
+    }
+    if (p[1] == '%') {
+      out += '%';
+      ++p;
+      continue;
+    }
+
+    // keep flags, width and precision, the length is known from the type
+    std::size_t n = 0;
+    spec[n++] = '%';
+    ++p;
+    while (*p && strchr("-+ #0123456789.", *p) && n < sizeof(spec) - 4) {
+      spec[n++] = *p++;
+    }
+    while (*p && strchr("hlLqjzt", *p)) { ++p; }
+    if (!*p) { break; }
+    char conversion = *p;
+
+    if (arg >= e.num_args) {
+      out += "<?>";
+      continue;
+    }
+    uint64_t value = e.args[arg];
+    arg_type type = e.types[arg];
+    arg++;
+
+    switch (type) {
+      case arg_type::kString: {
+        const char* str = reinterpret_cast<const char*>(value);
+        spec[n++] = 's';
+        spec[n] = '\0';
+        snprintf(buf, sizeof(buf), spec, str ? str : "(null)");
+        break;
+      }
+      case arg_type::kPointer:
+        spec[n++] = 'p';
+        spec[n] = '\0';
+        snprintf(buf, sizeof(buf), spec, reinterpret_cast<void*>(value));
+        break;
+      case arg_type::kDouble: {
+        double d;
+        memcpy(&d, &value, sizeof(d));
+        spec[n++] = strchr("eEfFgGaA", conversion) ? conversion : 'g';
+        spec[n] = '\0';
+        snprintf(buf, sizeof(buf), spec, d);
+        break;
+      }
+      case arg_type::kSigned:
+      case arg_type::kUnsigned:
+        spec[n++] = 'l';
+        spec[n++] = 'l';
+        if (strchr("xXo", conversion)) {
+          spec[n++] = conversion;
+        } else {
+          spec[n++] = type == arg_type::kSigned ? 'd' : 'u';
+        }
+        spec[n] = '\0';
+        if (type == arg_type::kSigned) {
+          snprintf(buf, sizeof(buf), spec, static_cast<long long>(value));
+        } else {
+          snprintf(buf, sizeof(buf), spec,
+                   static_cast<unsigned long long>(value));
+        }
+        break;
+    }
+    out += buf;
+  }
+  return out;
+}
+}  // namespace trace_detail
+
+std::size_t DumpTraceRings(FILE* fp)
+{
+  std::vector<trace_detail::entry> all;
+  {
+    std::lock_guard lock(rings_mutex);
+    std::vector<trace_detail::entry> copy;
+    for (trace_ring* ring : rings) {
+      /* The slot after the newest one may be written right now.  Whatever
+       * the thread overwrote while we copied is dropped afterwards. */
+      uint64_t next = ring->next.load(std::memory_order_acquire);
+      uint64_t first = next > trace_ring_entries - 1
+                           ? next - (trace_ring_entries - 1)
+                           : 0;
+      copy.clear();
+      for (uint64_t i = first; i < next; ++i) {
+        copy.push_back(ring->entries[i % trace_ring_entries]);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      uint64_t next_after = ring->next.load(std::memory_order_relaxed);
+      uint64_t overwritten = next_after > next ? next_after - next : 0;
+      if (overwritten >= copy.size()) { continue; }
+      all.insert(all.end(), copy.begin() + overwritten, copy.end());
+    }
+  }
+
+  std::stable_sort(all.begin(), all.end(), [](const auto& a, const auto& b) {
+    return a.time < b.time;
+  });
+
+  // the entries have steady clock time stamps, print them as wall clock time
+  int64_t steady_now = trace_detail::Now();
+  int64_t wall_now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::system_clock::now().time_since_epoch())
+                         .count();
+  for (auto& e : all) {
+    int64_t wall = wall_now - (steady_now - static_cast<int64_t>(e.time));
+    time_t secs = wall / 1000000000;
+    char dt[MAX_TIME_LENGTH];
+    bstrftime(dt, sizeof(dt), secs, "%d-%b %H:%M:%S");
+
+    std::string text = trace_detail::Format(e);
+    if (text.empty() || text.back() != '\n') { text += '\n'; }
+    fprintf(fp, "%s.%06d %s: %s[%u] %s:%u %s", dt,
+            static_cast<int>((wall / 1000) % 1000000), my_name,
+            TraceCategoryName(e.category), e.thread, get_basename(e.file),
+            e.line, text.c_str());
+  }
+  return all.size();
+}
+
+bool DumpTraceRingsToTraceFile()
+{
+  PoolMem fn(PM_FNAME);
+  Mmsg(fn, "%s/%s.trace", TRACEFILEDIRECTORY, my_name);
+
+  FILE* fp = fopen(fn.c_str(), "a+b");
+  if (!fp) { return false; }
+  fprintf(fp, "==== %s: trace ring dump ====\n", my_name);
+  std::size_t entries = DumpTraceRings(fp);
+  fprintf(fp, "==== %s: %d trace ring entries ====\n", my_name, (int)entries);
+  fclose(fp);
+  return true;
+}
@@ -0,0 +1,165 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Always-on tracing of hot paths into per thread ring buffers
+ *
+ * Dtrace(category, fmt, ...) stores the format, the location and up to six
+ * arguments in binary form in a ring buffer of the calling thread, which
+ * neither locks nor formats anything.  The last trace_ring_entries entries of
+ * every thread are only formatted when they are dumped, e.g. by setdebug
+ * with trace=1.  %s arguments have to be string literals (or other strings
+ * that are never freed) as they are only read at dump time.
+ *
+ * Define BAREOS_DISABLE_TRACE_RING to compile all trace points out.
+ */
+
+#ifndef BAREOS_LIB_TRACE_RING_H_
+#define BAREOS_LIB_TRACE_RING_H_
+
+#include "include/dll_import_export.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+enum class trace_category : uint8_t
+{
+  kBlock,
+  kRecord,
+  kBackup,
+  kCount
+};
+
+// one bit per trace_category, all are on by default
+BAREOS_IMPORT std::atomic<uint32_t> trace_categories;
+
+inline bool TraceEnabled(trace_category category)
+{
+  return trace_categories.load(std::memory_order_relaxed)
+         & (1u << static_cast<unsigned>(category));
+}
+
+const char* TraceCategoryName(trace_category category);
+
+constexpr std::size_t trace_ring_entries = 1024; /* per thread */
+
+namespace trace_detail {
+constexpr int max_args = 6;
+
+enum class arg_type : uint8_t
+{
+  kSigned,
+  kUnsigned,
+  kDouble,
+  kPointer,
+  kString
+};
+
+struct entry {
+  uint64_t time; /* steady clock in ns */
+  const char* file;
+  const char* fmt;
+  uint32_t line;
+  uint32_t thread; /* set by NextEntry() */
+  trace_category category;
+  uint8_t num_args;
+  arg_type types[max_args];
+  uint64_t args[max_args];
+};
+
+// the slot the calling thread writes next, Commit() makes it visible
+entry& NextEntry();
+void Commit();
+uint64_t Now();
+
+template <typename T> void Encode(entry& e, int i, T value)
+{
+  if constexpr (std::is_same_v<T, const char*> || std::is_same_v<T, char*>) {
+    e.types[i] = arg_type::kString;
+    e.args[i] = reinterpret_cast<uintptr_t>(value);
+  } else if constexpr (std::is_pointer_v<T>) {
+    e.types[i] = arg_type::kPointer;
+    e.args[i] = reinterpret_cast<uintptr_t>(value);
+  } else if constexpr (std::is_floating_point_v<T>) {
+    double d = value;
+    e.types[i] = arg_type::kDouble;
+    memcpy(&e.args[i], &d, sizeof(d));
+  } else if constexpr (std::is_enum_v<T>) {
+    Encode(e, i, static_cast<std::underlying_type_t<T>>(value));
+  } else if constexpr (std::is_signed_v<T>) {
+    e.types[i] = arg_type::kSigned;
+    e.args[i] = static_cast<uint64_t>(static_cast<int64_t>(value));
+  } else {
+    static_assert(std::is_integral_v<T>, "unsupported trace argument");
+    e.types[i] = arg_type::kUnsigned;
+    e.args[i] = static_cast<uint64_t>(value);
+  }
+}
+
+template <typename... Args>
+void Record(trace_category category,
+            const char* file,
+            int line,
+            const char* fmt,
+            Args... args)
+{
+  static_assert(sizeof...(Args) <= max_args, "too many trace arguments");
+  entry& e = NextEntry();
+  e.time = Now();
+  e.file = file;
+  e.fmt = fmt;
+  e.line = line;
+  e.category = category;
+  e.num_args = sizeof...(Args);
+  int i = 0;
+  (Encode(e, i++, args), ...);
+  Commit();
+}
+
+// formats e like printf would have done it
+std::string Format(const entry& e);
+}  // namespace trace_detail
+
+#if defined(BAREOS_DISABLE_TRACE_RING)
+#  define Dtrace(category, ...) \
+    do {                        \
+    } while (0)
+#else
+#  define Dtrace(category, ...)                                       \
+    do {                                                              \
+      if (TraceEnabled(trace_category::category)) {                   \
+        trace_detail::Record(trace_category::category, __FILE__,      \
+                             __LINE__, __VA_ARGS__);                  \
+      }                                                               \
+    } while (0)
+#endif
+
+// writes the entries of all threads to fp, sorted by time
+std::size_t DumpTraceRings(FILE* fp);
+
+// appends the entries of all threads to the trace file of the daemon
+bool DumpTraceRingsToTraceFile();
+
+#endif  // BAREOS_LIB_TRACE_RING_H_
@@ -30,16 +30,18 @@
 #include "lib/util.h"
 #include "lib/fnmatch.h"
 
-#define B_PAGE_SIZE 4096
-#define MAX_PAGES 2400
-#define MAX_BUF_SIZE (MAX_PAGES * B_PAGE_SIZE) /* approx 10MB */
+#include <algorithm>
+#include <functional>
+#include <string_view>
+
+/* File names are packed into blocks of this size */
+#define NAME_BLOCK_SIZE (64 * 1024)
 
 /* Forward referenced subroutines */
 static tree_node* search_and_insert_tree_node(char* fname,
                                               tree_node_type type,
                                               TREE_ROOT* root,
                                               tree_node* parent);
-template <typename T> static T* tree_alloc(TREE_ROOT* root, int size);
 
 // NOTE !!!!! we turn off Debug messages for performance reasons.
 #undef Dmsg0
@@ -51,31 +53,47 @@ template <typename T> static T* tree_alloc(TREE_ROOT* root, int size);
 #define Dmsg2(n, f, a1, a2)
 #define Dmsg3(n, f, a1, a2, a3)
 
-// This subroutine gets a big buffer.
-static void MallocBuf(TREE_ROOT* root, int size)
-{
-  struct s_mem* mem;
+/*
+ * A tree node is about half the size of a node that carries its own links
+ * and child set.  All nodes live in chunks owned by the root and refer to
+ * each other by 32 bit indices, every distinct file name is stored only once
+ * and the children of a directory are an array of indices that gets sorted by
+ * name before it is walked.  While building the tree a single hash table of
+ * (parent, name) finds existing entries of big directories, so their child
+ * arrays never have to be searched.
+ */
 
-  mem = (struct s_mem*)malloc(size);
+/* Empty and deleted entries of the lookup table. */
+static constexpr tree_index lookup_empty = 0; /* the root is nobody's child */
+static constexpr tree_index lookup_deleted = UINT32_MAX;
+
+/* The lookup tables grow as needed, don't start with a huge one. */
+static constexpr int max_initial_count = 1'000'000;
+
+/* Only directories with at least this many children are in the lookup table,
+ * smaller ones are searched directly. */
+static constexpr uint32_t min_hashed_children = 16;
+
+static void* tree_alloc(TREE_ROOT* root, std::size_t size)
+{
   root->total_size += size;
-  root->blocks++;
-  mem->next = root->mem;
-  root->mem = mem;
-  mem->mem = mem->first;
-  mem->rem = (char*)mem + size - (char*)mem->mem;
-  Dmsg2(200, "malloc buf size=%d rem=%d\n", size, mem->rem);
+  if (root->mapped) {
+    // what does not fit into the file any more goes into memory
+    if (void* mem = root->mapped->allocate(size)) { return mem; }
+  }
+  return root->mem.allocate(size);
 }
 
-/*
- * Note, we allocate a big buffer in the tree root
- * from which we allocate nodes. This runs more
- * than 100 times as fast as directly using malloc()
- * for each of the nodes.
- */
-TREE_ROOT* new_tree(int count)
+static std::size_t HashSize(std::size_t count)
+{
+  std::size_t size = 64;
+  while (size < count + count / 2) { size <<= 1; }
+  return size;
+}
+
+TREE_ROOT* new_tree(int count, const char* map_directory)
 {
   TREE_ROOT* root;
-  uint32_t size;
 
   if (count < 1000) { /* minimum tree size */
     count = 1000;
@@ -83,88 +101,312 @@ TREE_ROOT* new_tree(int count)
   root = static_cast<TREE_ROOT*>(malloc(sizeof(TREE_ROOT)));
   root = new (root) TREE_ROOT();
 
-  // Assume filename + node  = 40 characters average length
-  size = count * (BALIGN(sizeof(tree_node)) + 40);
-  if (count > 1000000 || size > (MAX_BUF_SIZE / 2)) { size = MAX_BUF_SIZE; }
-  Dmsg2(400, "count=%d size=%d\n", count, size);
-  MallocBuf(root, size);
+  Dmsg1(400, "count=%d\n", count);
+  count = std::min(count, max_initial_count);
+  root->lookup.resize(HashSize(count));
+  root->lookup_tags.resize(root->lookup.size());
+  root->names.resize(HashSize(count / 2));
+  root->total_size = sizeof(TREE_ROOT)
+                     + root->lookup.size() * (sizeof(tree_index) + 1)
+                     + root->names.size() * sizeof(const char*);
   root->cached_path_len = -1;
   root->cached_path = GetPoolMemory(PM_FNAME);
   root->type = tree_node_type::Root;
   root->fname = "";
+  if (map_directory) {
+    root->mapped = std::make_unique<MappedBuffer>();
+    if (!root->mapped->Open(map_directory)) { root->mapped.reset(); }
+  }
   return root;
 }
 
 // Create a new tree node.
 static tree_node* new_tree_node(TREE_ROOT* root)
 {
-  tree_node* node;
-  int size = sizeof(tree_node);
-  node = tree_alloc<tree_node>(root, size);
-  node = new (node) tree_node();
+  tree_index index = root->num_nodes;
+  ASSERT(index != lookup_deleted);
+
+  if ((index >> tree_chunk_shift) >= root->chunks.size()) {
+    root->chunks.push_back(static_cast<tree_node*>(
+        tree_alloc(root, tree_chunk_nodes * sizeof(tree_node))));
+  }
+  root->num_nodes++;
+
+  tree_node* node = new (TreeNodeAt(root, index)) tree_node();
+  node->index = index;
   node->delta_seq = -1;
   return node;
 }
 
-// This routine can be called to release the previously allocated tree node.
-static void FreeTreeNode(TREE_ROOT* root)
+static int NodeCompare(const char* fname1, const char* fname2)
 {
-  int asize = BALIGN(sizeof(tree_node));
-  root->mem->rem += asize;
-  root->mem->mem = (char*)root->mem->mem - asize;
+  if (fname1[0] > fname2[0]) {
+    return 1;
+  } else if (fname1[0] < fname2[0]) {
+    return -1;
+  }
+
+  return strcmp(fname1, fname2);
 }
 
-void TreeRemoveNode(TREE_ROOT* root, tree_node* node)
+static int ChildCapacity(uint32_t num_children)
 {
-  int asize = BALIGN(sizeof(tree_node));
-  node->parent->child.remove(node);
-  if (((char*)root->mem->mem - asize) == (char*)node) {
-    FreeTreeNode(root);
-  } else {
-    Dmsg0(0, "Can't release tree node\n");
+  int log2 = 1;
+  while ((uint32_t{1} << log2) < num_children) { log2++; }
+  return log2;
+}
+
+// Take a child array of 2^log2 entries, reusing a released one if possible.
+static tree_index* AllocChildren(TREE_ROOT* root, int log2)
+{
+  tree_index* children = root->free_children[log2];
+  if (children) {
+    memcpy(&root->free_children[log2], children, sizeof(tree_index*));
+    return children;
   }
+  return static_cast<tree_index*>(
+      tree_alloc(root, sizeof(tree_index) << log2));
 }
 
-/*
- * Allocate bytes for filename in tree structure.
- * Keep the pointers properly aligned by allocating
- * sizes that are aligned.
- */
-template <typename T> static T* tree_alloc(TREE_ROOT* root, int size)
+static void ReleaseChildren(TREE_ROOT* root, tree_index* children, int log2)
+{
+  memcpy(children, &root->free_children[log2], sizeof(tree_index*));
+  root->free_children[log2] = children;
+}
+
+static void AddChild(TREE_ROOT* root, tree_node* parent, tree_node* node)
 {
-  T* buf;
-  int asize = BALIGN(size);
+  uint32_t count = parent->num_children;
+  if (count == 0 || (count >= 2 && (count & (count - 1)) == 0)) {
+    // the array is full (arrays hold at least two entries)
+    int log2 = count == 0 ? 1 : ChildCapacity(count) + 1;
+    tree_index* children = AllocChildren(root, log2);
+    if (count > 0) {
+      memcpy(children, parent->children, count * sizeof(tree_index));
+      ReleaseChildren(root, parent->children, log2 - 1);
+    }
+    parent->children = children;
+  }
 
-  if (root->mem->rem < asize) {
-    uint32_t mb_size;
-    if (root->total_size >= (MAX_BUF_SIZE / 2)) {
-      mb_size = MAX_BUF_SIZE;
-    } else {
-      mb_size = MAX_BUF_SIZE / 2;
+  if (parent->children_sorted && count > 0
+      && NodeCompare(TreeNodeAt(root, parent->children[count - 1])->fname,
+                     node->fname)
+             > 0) {
+    parent->children_sorted = false;
+  }
+  parent->children[count] = node->index;
+  parent->num_children++;
+}
+
+static void RemoveChild(tree_node* parent, tree_node* node)
+{
+  tree_index* end = parent->children + parent->num_children;
+  tree_index* pos = std::find(parent->children, end, node->index);
+  if (pos == end) { return; }
+
+  // keeps the order, so a sorted array stays sorted
+  std::copy(pos + 1, end, pos);
+  parent->num_children--;
+}
+
+void TreeSortChildren(TREE_ROOT* root, tree_node* node)
+{
+  std::sort(node->children, node->children + node->num_children,
+            [root](tree_index a, tree_index b) {
+              return NodeCompare(TreeNodeAt(root, a)->fname,
+                                 TreeNodeAt(root, b)->fname)
+                     < 0;
+            });
+  node->children_sorted = true;
+}
+
+static inline uint64_t LookupHash(tree_index parent, const char* name)
+{
+  uint64_t h = (uint64_t{parent} << 32) ^ reinterpret_cast<uintptr_t>(name);
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+/* Find the slot of the child name (an interned name) of parent, or the one
+ * where it has to be inserted if there is none.  Every slot has a tag with
+ * some bits of its hash (0 for unused slots), so most of the nodes that do
+ * not match never have to be looked at. */
+static std::size_t FindLookupSlot(TREE_ROOT* root,
+                                  tree_index parent,
+                                  const char* name,
+                                  uint8_t& tag)
+{
+  uint64_t hash = LookupHash(parent, name);
+  std::size_t mask = root->lookup.size() - 1;
+  std::size_t insert_at = SIZE_MAX;
+  tag = static_cast<uint8_t>(hash >> 57) + 1;
+
+  for (std::size_t i = hash & mask;; i = (i + 1) & mask) {
+    uint8_t slot_tag = root->lookup_tags[i];
+    if (slot_tag == 0) { return insert_at != SIZE_MAX ? insert_at : i; }
+    if (slot_tag != tag) { continue; }
+
+    tree_index index = root->lookup[i];
+    if (index == lookup_deleted) {
+      if (insert_at == SIZE_MAX) { insert_at = i; }
+      continue;
+    }
+    tree_node* node = TreeNodeAt(root, index);
+    if (node->parent_index == parent && node->fname == name) { return i; }
+  }
+}
+
+static inline bool LookupSlotUsed(TREE_ROOT* root, std::size_t slot)
+{
+  return root->lookup[slot] != lookup_empty
+         && root->lookup[slot] != lookup_deleted;
+}
+
+static void GrowLookup(TREE_ROOT* root);
+
+static void SetLookupSlot(TREE_ROOT* root,
+                          std::size_t slot,
+                          uint8_t tag,
+                          tree_index index)
+{
+  if (root->lookup_tags[slot] == 0) { root->lookup_used++; }
+  root->lookup_tags[slot] = tag;
+  root->lookup[slot] = index;
+  if (root->lookup_used * 4 >= root->lookup.size() * 3) { GrowLookup(root); }
+}
+
+static void AddToLookup(TREE_ROOT* root, tree_node* node)
+{
+  uint8_t tag;
+  std::size_t slot
+      = FindLookupSlot(root, node->parent_index, node->fname, tag);
+  SetLookupSlot(root, slot, tag, node->index);
+}
+
+static void GrowLookup(TREE_ROOT* root)
+{
+  std::vector<tree_index> old(root->lookup.size() * 2, lookup_empty);
+  old.swap(root->lookup);
+  root->lookup_tags.assign(root->lookup.size(), 0);
+  root->total_size += old.size() * (sizeof(tree_index) + 1);
+  root->lookup_used = 0;
+
+  for (tree_index index : old) {
+    if (index == lookup_empty || index == lookup_deleted) { continue; }
+    AddToLookup(root, TreeNodeAt(root, index));
+  }
+}
+
+// Find the child with the given (interned) name.
+static tree_node* FindChild(TREE_ROOT* root,
+                            tree_node* parent,
+                            const char* name)
+{
+  if (parent->num_children < min_hashed_children) {
+    for (uint32_t i = 0; i < parent->num_children; ++i) {
+      tree_node* child = TreeNodeAt(root, parent->children[i]);
+      if (child->fname == name) { return child; }
+    }
+    return nullptr;
+  }
+
+  uint8_t tag;
+  std::size_t slot = FindLookupSlot(root, parent->index, name, tag);
+  if (!LookupSlotUsed(root, slot)) { return nullptr; }
+  return TreeNodeAt(root, root->lookup[slot]);
+}
+
+static inline std::size_t NameHash(std::string_view name)
+{
+  return std::hash<std::string_view>{}(name);
+}
+
+static const char** FindName(TREE_ROOT* root, std::string_view name)
+{
+  std::size_t mask = root->names.size() - 1;
+  for (std::size_t i = NameHash(name) & mask;; i = (i + 1) & mask) {
+    const char** slot = &root->names[i];
+    if (!*slot || *slot == name) { return slot; }
+  }
+}
+
+static void GrowNames(TREE_ROOT* root)
+{
+  std::vector<const char*> old(root->names.size() * 2, nullptr);
+  old.swap(root->names);
+  root->total_size += old.size() * sizeof(const char*);
+
+  for (const char* name : old) {
+    if (name) { *FindName(root, name) = name; }
+  }
+}
+
+static const char* copy_string(std::string_view str, TREE_ROOT* root)
+{
+  std::size_t size = str.size() + 1;
+  char* buf;
+
+  if (size > NAME_BLOCK_SIZE / 4) {
+    buf = static_cast<char*>(tree_alloc(root, size));
+  } else {
+    if (root->name_rem < size) {
+      root->name_mem = static_cast<char*>(tree_alloc(root, NAME_BLOCK_SIZE));
+      root->name_rem = NAME_BLOCK_SIZE;
     }
-    MallocBuf(root, mb_size);
+    buf = root->name_mem;
+    root->name_mem += size;
+    root->name_rem -= size;
   }
-  root->mem->rem -= asize;
-  buf = static_cast<T*>(root->mem->mem);
-  root->mem->mem = (char*)root->mem->mem + asize;
+  memcpy(buf, str.data(), str.size());
+  buf[str.size()] = '\0';
   return buf;
 }
 
-// This routine frees the whole tree
-void FreeTree(TREE_ROOT* root)
+// Return the one copy of this name that is used by all nodes of the tree.
+static const char* InternName(TREE_ROOT* root, std::string_view name)
+{
+  const char** slot = FindName(root, name);
+  if (*slot) { return *slot; }
+
+  *slot = copy_string(name, root);
+  root->num_names++;
+  if (root->num_names * 4 >= root->names.size() * 3) {
+    const char* interned = *slot;
+    GrowNames(root);
+    return interned;
+  }
+  return *slot;
+}
+
+void TreeRemoveNode(TREE_ROOT* root, tree_node* node)
 {
-  struct s_mem *mem, *rel;
+  tree_node* parent = TreeParent(root, node);
+  uint8_t tag;
+  std::size_t slot = FindLookupSlot(root, parent->index, node->fname, tag);
+  if (root->lookup[slot] == node->index) {
+    root->lookup[slot] = lookup_deleted;
+  }
+  RemoveChild(parent, node);
 
-  std::destroy_at(&root->hardlinks);
-  for (mem = root->mem; mem;) {
-    rel = mem;
-    mem = mem->next;
-    free(rel);
+  if (node->index + 1 == root->num_nodes) {
+    root->num_nodes--;
+  } else {
+    Dmsg0(0, "Can't release tree node\n");
   }
+}
+
+// This routine frees the whole tree
+void FreeTree(TREE_ROOT* root)
+{
   if (root->cached_path) {
     FreePoolMemory(root->cached_path);
     root->cached_path = NULL;
   }
+  std::destroy_at(root);
   free(root);
   return;
 }
@@ -175,8 +417,8 @@ void TreeAddDeltaPart(TREE_ROOT* root,
                       JobId_t JobId,
                       int32_t FileIndex)
 {
-  struct delta_list* elt
-      = tree_alloc<delta_list>(root, sizeof(struct delta_list));
+  struct delta_list* elt = static_cast<delta_list*>(
+      tree_alloc(root, sizeof(struct delta_list)));
 
   elt->next = node->delta_list;
   elt->JobId = JobId;
@@ -289,68 +531,43 @@ tree_node* make_tree_path(char* path, TREE_ROOT* root)
   return node;
 }
 
-static int NodeCompare(void* item1, void* item2)
-{
-  tree_node* tn1 = (tree_node*)item1;
-  tree_node* tn2 = (tree_node*)item2;
-
-  if (tn1->fname[0] > tn2->fname[0]) {
-    return 1;
-  } else if (tn1->fname[0] < tn2->fname[0]) {
-    return -1;
-  }
-
-  return strcmp(tn1->fname, tn2->fname);
-}
-
-static const char* copy_string(std::string_view str, TREE_ROOT* root)
-{
-  char* buf = tree_alloc<char>(root, str.size() + 1);
-  memcpy(buf, str.data(), str.size());
-  buf[str.size()] = '\0';
-  return buf;
-}
-
 // See if the fname already exists. If not insert a new node for it.
 static tree_node* search_and_insert_tree_node(char* fname,
                                               tree_node_type type,
                                               TREE_ROOT* root,
                                               tree_node* parent)
 {
-  tree_node *node, *found_node;
-
-  node = new_tree_node(root);
-  node->fname = fname;
-  found_node = (tree_node*)parent->child.insert(node, NodeCompare);
-  if (found_node != node) { /* already in list */
-    FreeTreeNode(root);     /* free node allocated above */
+  const char* name = InternName(root, fname);
+  tree_node* found_node = FindChild(root, parent, name);
+  if (found_node) { /* already in tree */
     found_node->inserted = false;
     return found_node;
   }
 
-  // It was not found, but is now inserted
-  node->fname = copy_string(fname, root);
-  node->parent = parent;
+  // It was not found, so insert it
+  tree_node* node = new_tree_node(root);
+  node->fname = name;
+  node->parent_index = parent->index;
   node->type = type;
+  AddChild(root, parent, node);
 
-  // Maintain a linear chain of nodes
-  if (!root->first) {
-    root->first = node;
-    root->last = node;
-  } else {
-    root->last->next = node;
-    root->last = node;
+  if (parent->num_children == min_hashed_children) {
+    for (uint32_t i = 0; i < parent->num_children; ++i) {
+      AddToLookup(root, TreeNodeAt(root, parent->children[i]));
+    }
+  } else if (parent->num_children > min_hashed_children) {
+    AddToLookup(root, node);
   }
 
   node->inserted = true; /* inserted into tree */
   return node;
 }
 
-static void TreeGetpathItem(tree_node* node, POOLMEM*& path)
+static void TreeGetpathItem(TREE_ROOT* root, tree_node* node, POOLMEM*& path)
 {
   if (!node) { return; }
 
-  TreeGetpathItem(node->parent, path);
+  TreeGetpathItem(root, TreeParent(root, node), path);
 
   /* Fixup for Win32. If we have a Win32 directory and
    * there is only a / in the buffer, remove it since
@@ -371,7 +588,7 @@ static void TreeGetpathItem(tree_node* node, POOLMEM*& path)
   }
 }
 
-POOLMEM* tree_getpath(tree_node* node)
+POOLMEM* tree_getpath(TREE_ROOT* root, tree_node* node)
 {
   POOLMEM* path;
 
@@ -382,7 +599,7 @@ POOLMEM* tree_getpath(tree_node* node)
   PmStrcpy(path, "");
 
   // Fill the path with the full path.
-  TreeGetpathItem(node, path);
+  TreeGetpathItem(root, node, path);
 
   return path;
 }
@@ -395,7 +612,8 @@ tree_node* tree_cwd(char* path, TREE_ROOT* root, tree_node* node)
   // Handle relative path
   if (path[0] == '.' && path[1] == '.'
       && (IsPathSeparator(path[2]) || path[2] == '\0')) {
-    tree_node* parent = node->parent ? node->parent : node;
+    tree_node* parent = TreeParent(root, node);
+    if (!parent) { parent = node; }
     if (path[2] == 0) {
       return parent;
     } else {
@@ -418,7 +636,7 @@ tree_node* tree_relcwd(char* path, TREE_ROOT* root, tree_node* node)
 {
   char* p;
   int len;
-  tree_node* cd;
+  tree_node* cd = nullptr;
   char save_char;
   int match;
 
@@ -433,20 +651,24 @@ tree_node* tree_relcwd(char* path, TREE_ROOT* root, tree_node* node)
 
   Dmsg2(100, "tree_relcwd: len=%d path=%s\n", len, path);
 
-  foreach_child (cd, node) {
-    Dmsg1(100, "tree_relcwd: test cd=%s\n", cd->fname);
-    if (cd->fname[0] == path[0] && len == (int)strlen(cd->fname)
-        && bstrncmp(cd->fname, path, len)) {
+  for (tree_node* child : TreeChildren(root, node)) {
+    Dmsg1(100, "tree_relcwd: test cd=%s\n", child->fname);
+    if (child->fname[0] == path[0] && len == (int)strlen(child->fname)
+        && bstrncmp(child->fname, path, len)) {
+      cd = child;
       break;
     }
 
     // fnmatch has no len in call so we truncate the string
     save_char = path[len];
     path[len] = 0;
-    match = fnmatch(path, cd->fname, 0) == 0;
+    match = fnmatch(path, child->fname, 0) == 0;
     path[len] = save_char;
 
-    if (match) { break; }
+    if (match) {
+      cd = child;
+      break;
+    }
   }
 
   if (!cd || (cd->type == tree_node_type::File && !TreeNodeHasChild(cd))) {
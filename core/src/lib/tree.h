@@ -29,27 +29,17 @@
 #define BAREOS_LIB_TREE_H_
 
 #include "lib/htable.h"
-#include "lib/rblist.h"
+#include "lib/mapped_buffer.h"
+#include "lib/monotonic_buffer.h"
 
 #include "include/config.h"
 
-struct s_mem {
-  struct s_mem* next; /* next buffer */
-  int rem;            /* remaining bytes */
-  void* mem;          /* memory pointer */
-  char first[1];      /* first byte */
-};
-
-#define USE_DLIST
-
-#define foreach_child(var, list) \
-  for ((var) = NULL;             \
-       (*((tree_node**)&(var)) = (tree_node*)(list->child.next(var)));)
-
-#define TreeNodeHasChild(node) ((node)->child.size() > 0)
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
 
-#define first_child(node) \
-        ((tree_node *)(node->child.first())
+#define TreeNodeHasChild(node) ((node)->num_children > 0)
 
 struct delta_list {
   struct delta_list* next;
@@ -66,6 +56,9 @@ enum class tree_node_type : int8_t
   File,
 };
 
+/* Nodes refer to each other by their index in the tree, the root is 0. */
+using tree_index = uint32_t;
+
 /**
  * Keep this node as small as possible because
  *   there is one for each file.
@@ -79,16 +72,21 @@ struct tree_node {
       , soft_link{false}
       , inserted{false}
       , loaded{false}
+      , children_sorted{true}
+      , size_high{0}
   {
   }
-  /* KEEP sibling as the first member to avoid having to
-   *  do initialization of child */
-  rblink sibling;
-  rblist child;
-  const char* fname{}; /* file name */
-  int32_t FileIndex{}; /* file index */
-  uint32_t JobId{};    /* JobId */
-  int32_t delta_seq{}; /* current delta sequence */
+  const char* fname{};             /* file name (shared by equal names) */
+  tree_index* children{};          /* indices of the children */
+  struct delta_list* delta_list{}; /* delta parts for this node */
+  uint64_t fhinfo{};               /* NDMP Fh_info */
+  uint64_t fhnode{};               /* NDMP Fh_node */
+  int32_t FileIndex{};             /* file index */
+  uint32_t JobId{};                /* JobId */
+  int32_t delta_seq{};             /* current delta sequence */
+  tree_index index{};              /* index of this node */
+  tree_index parent_index{};       /* index of the parent */
+  uint32_t num_children{};         /* number of children */
   tree_node_type type;
   unsigned int extract : 1; /* extract item */
   unsigned int
@@ -97,13 +95,27 @@ struct tree_node {
   unsigned int soft_link : 1; /* set if is soft link */
   unsigned int inserted : 1;  /* set when node newly inserted */
   unsigned int loaded : 1;    /* set when the dir is in the tree */
-  tree_node* parent{};
-  tree_node* next{};               /* next hash of FileIndex */
-  struct delta_list* delta_list{}; /* delta parts for this node */
-  uint64_t fhinfo{};               /* NDMP Fh_info */
-  uint64_t fhnode{};               /* NDMP Fh_node */
+  unsigned int children_sorted : 1; /* children are ordered by name */
+  unsigned int size_high : 16;      /* file size, see TreeNodeSize() */
+  uint32_t size_low{};
 };
 
+/* The size of a regular file, kept in the 48 bits the node has to spare.
+ * Bigger files are counted with the biggest size that fits. */
+constexpr uint64_t tree_node_max_size = (uint64_t{1} << 48) - 1;
+
+inline uint64_t TreeNodeSize(const tree_node* node)
+{
+  return (uint64_t{node->size_high} << 32) | node->size_low;
+}
+
+inline void TreeNodeSetSize(tree_node* node, uint64_t size)
+{
+  if (size > tree_node_max_size) { size = tree_node_max_size; }
+  node->size_high = size >> 32;
+  node->size_low = static_cast<uint32_t>(size);
+}
+
 /* hardlink hashtable entry */
 struct s_hl_entry {
   uint64_t key;
@@ -114,21 +126,93 @@ typedef struct s_hl_entry HL_ENTRY;
 
 using HardlinkTable = htable<uint64_t, HL_ENTRY, MonotonicBuffer::Size::Small>;
 
+/* number of nodes in one allocation of the tree root */
+constexpr std::size_t tree_chunk_shift = 12;
+constexpr std::size_t tree_chunk_nodes = std::size_t{1} << tree_chunk_shift;
+
 struct s_tree_root : public tree_node {
-  tree_node* first{};         /* first entry in the tree */
-  tree_node* last{};          /* last entry in tree */
-  s_mem* mem{};               /* tree memory */
-  uint32_t total_size{};      /* total bytes allocated */
-  uint32_t blocks{};          /* total mallocs */
-  int cached_path_len{};      /* length of cached path */
-  char* cached_path{};        /* cached current path */
-  tree_node* cached_parent{}; /* cached parent for above path */
-  HardlinkTable hardlinks;    /* references to first occurence of hardlinks */
+  std::vector<tree_node*> chunks{}; /* node storage, tree_chunk_nodes each */
+  tree_index num_nodes{1};          /* nodes in the tree including the root */
+  uint64_t num_entries{1};          /* nodes that are not NewDir, with root */
+  uint64_t num_marked{};            /* of those, marked to be extracted */
+  uint64_t marked_bytes{};          /* size of the marked files */
+  MonotonicBuffer mem{};            /* tree memory */
+  std::unique_ptr<MappedBuffer> mapped{}; /* tree memory in a file, if set */
+  char* name_mem{};                 /* free space for file names */
+  std::size_t name_rem{};           /* bytes left at name_mem */
+  std::vector<const char*> names{}; /* interned file names (hashed) */
+  std::size_t num_names{};          /* used entries in names */
+  std::vector<tree_index> lookup{}; /* children by parent and name (hashed) */
+  std::vector<uint8_t> lookup_tags{}; /* hash bits of the lookup entries */
+  std::size_t lookup_used{};          /* used entries in lookup */
+  tree_index* free_children[32]{};  /* child arrays for reuse, by log2 size */
+  uint64_t total_size{};            /* total bytes allocated */
+  int cached_path_len{};            /* length of cached path */
+  char* cached_path{};              /* cached current path */
+  tree_node* cached_parent{};       /* cached parent for above path */
+  HardlinkTable hardlinks;          /* references to first occurence of
+                                       hardlinks */
 };
 typedef struct s_tree_root TREE_ROOT;
 
+inline tree_node* TreeNodeAt(TREE_ROOT* root, tree_index index)
+{
+  if (index == 0) { return root; }
+  return root->chunks[index >> tree_chunk_shift]
+         + (index & (tree_chunk_nodes - 1));
+}
+
+inline tree_node* TreeParent(TREE_ROOT* root, tree_node* node)
+{
+  if (node->index == 0) { return nullptr; }
+  return TreeNodeAt(root, node->parent_index);
+}
+
+void TreeSortChildren(TREE_ROOT* root, tree_node* node);
+
+/**
+ * The children of a node ordered by name, for use in a range based for loop:
+ *   for (tree_node* child : TreeChildren(root, node)) { ... }
+ */
+class TreeChildren {
+ public:
+  class iterator {
+   public:
+    iterator(TREE_ROOT* root, const tree_index* pos) : root_{root}, pos_{pos}
+    {
+    }
+    tree_node* operator*() const { return TreeNodeAt(root_, *pos_); }
+    iterator& operator++()
+    {
+      ++pos_;
+      return *this;
+    }
+    bool operator!=(const iterator& other) const { return pos_ != other.pos_; }
+
+   private:
+    TREE_ROOT* root_;
+    const tree_index* pos_;
+  };
+
+  TreeChildren(TREE_ROOT* root, tree_node* node) : root_{root}, node_{node}
+  {
+    if (!node_->children_sorted) { TreeSortChildren(root_, node_); }
+  }
+  iterator begin() const { return iterator{root_, node_->children}; }
+  iterator end() const
+  {
+    return iterator{root_, node_->children + node_->num_children};
+  }
+
+ private:
+  TREE_ROOT* root_;
+  tree_node* node_;
+};
+
 /* External interface */
-TREE_ROOT* new_tree(int count);
+/* With map_directory the nodes, names and child arrays are put into a memory
+ * mapped file there, see MappedBuffer. */
+TREE_ROOT* new_tree(int count, const char* map_directory = nullptr);
 tree_node* insert_tree_node(char* path,
                             char* fname,
                             tree_node_type type,
@@ -142,7 +226,7 @@ void TreeAddDeltaPart(TREE_ROOT* root,
                       JobId_t JobId,
                       int32_t FileIndex);
 void FreeTree(TREE_ROOT* root);
-POOLMEM* tree_getpath(tree_node* node);
+POOLMEM* tree_getpath(TREE_ROOT* root, tree_node* node);
 void TreeRemoveNode(TREE_ROOT* root, tree_node* node);
 
 /**
@@ -150,7 +234,9 @@ void TreeRemoveNode(TREE_ROOT* root, tree_node* node);
  *   traversed in the order the entries were inserted into the
  *   tree.
  */
-#define FirstTreeNode(r) (r)->first
-#define NextTreeNode(n) (n)->next
+#define FirstTreeNode(r) ((r)->num_nodes > 1 ? TreeNodeAt((r), 1) : nullptr)
+#define NextTreeNode(r, n)                                             \
+  ((n)->index + 1 < (r)->num_nodes ? TreeNodeAt((r), (n)->index + 1) \
+                                   : nullptr)
 
 #endif  // BAREOS_LIB_TREE_H_
@@ -0,0 +1,212 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "include/bareos.h"
+#include "lib/tree_find.h"
+
+#include <algorithm>
+#include <fnmatch.h>
+#include <string>
+#include <unordered_map>
+
+namespace {
+
+// at most 16M buckets (64MB), a trigram hash bucket per name otherwise
+constexpr int max_bucket_bits = 24;
+constexpr int min_bucket_bits = 10;
+
+/* The runs of bytes a pattern matches literally, following fnmatch() without
+ * flags: a backslash quotes the next character; *, ? and bracket expressions
+ * match something else. */
+std::vector<std::string> LiteralRuns(const char* pattern)
+{
+  std::vector<std::string> runs(1);
+  for (const char* p = pattern; *p; ++p) {
+    switch (*p) {
+      case '\\':
+        if (p[1]) { ++p; }
+        runs.back() += *p;
+        break;
+      case '*':
+      case '?':
+        runs.emplace_back();
+        break;
+      case '[': {
+        runs.emplace_back();
+        // an unterminated bracket is a literal; ending the run is just safe
+        const char* q = p + 1;
+        if (*q == '!' || *q == '^') { ++q; }
+        if (*q == ']') { ++q; }
+        while (*q && *q != ']') { ++q; }
+        if (*q) { p = q; }
+        break;
+      }
+      default:
+        runs.back() += *p;
+        break;
+    }
+  }
+  return runs;
+}
+
+// sorted a &= sorted b
+void Intersect(std::vector<uint32_t>& a, const uint32_t* b, const uint32_t* end)
+{
+  auto out = a.begin();
+  for (auto in = a.begin(); in != a.end() && b != end;) {
+    if (*in < *b) {
+      ++in;
+    } else if (*b < *in) {
+      ++b;
+    } else {
+      *out++ = *in++;
+      ++b;
+    }
+  }
+  a.erase(out, a.end());
+}
+
+}  // namespace
+
+uint32_t TreeNameIndex::Bucket(const char* trigram) const
+{
+  auto byte = [trigram](int i) {
+    return static_cast<uint32_t>(static_cast<unsigned char>(trigram[i]));
+  };
+  uint32_t key = (byte(0) << 16) | (byte(1) << 8) | byte(2);
+  return (key * 0x9E3779B1u) >> (32 - bucket_bits_);
+}
+
+void TreeNameIndex::Build(TREE_ROOT* root)
+{
+  root_ = root;
+  num_nodes_ = root->num_nodes;
+  names_.clear();
+
+  // equal names share their fname, so the pointer identifies a name
+  std::unordered_map<const char*, uint32_t> ids;
+  ids.reserve(root->num_names);
+  std::vector<uint32_t> node_name(num_nodes_, UINT32_MAX);
+  std::vector<uint32_t> count;
+  for (tree_index i = 1; i < num_nodes_; ++i) {
+    const char* fname = TreeNodeAt(root, i)->fname;
+    if (!fname) { continue; }
+    auto [it, inserted] = ids.try_emplace(fname, names_.size());
+    if (inserted) {
+      names_.push_back(fname);
+      count.push_back(0);
+    }
+    node_name[i] = it->second;
+    count[it->second]++;
+  }
+
+  name_nodes_.assign(names_.size() + 1, 0);
+  for (std::size_t id = 0; id < names_.size(); ++id) {
+    name_nodes_[id + 1] = name_nodes_[id] + count[id];
+  }
+  nodes_.resize(name_nodes_.back());
+  std::vector<uint32_t> fill(name_nodes_.begin(), name_nodes_.end() - 1);
+  for (tree_index i = 1; i < num_nodes_; ++i) {
+    if (node_name[i] != UINT32_MAX) { nodes_[fill[node_name[i]]++] = i; }
+  }
+
+  bucket_bits_ = min_bucket_bits;
+  while (bucket_bits_ < max_bucket_bits
+         && (std::size_t{1} << bucket_bits_) < names_.size()) {
+    bucket_bits_++;
+  }
+  std::size_t num_buckets = std::size_t{1} << bucket_bits_;
+
+  // every name once per bucket, counted first and then filled in
+  std::vector<uint32_t> buckets;
+  auto name_buckets = [this, &buckets](uint32_t id) {
+    buckets.clear();
+    const char* name = names_[id];
+    for (std::size_t i = 0; name[i] && name[i + 1] && name[i + 2]; ++i) {
+      buckets.push_back(Bucket(name + i));
+    }
+    std::sort(buckets.begin(), buckets.end());
+    buckets.erase(std::unique(buckets.begin(), buckets.end()), buckets.end());
+  };
+
+  bucket_names_.assign(num_buckets + 1, 0);
+  for (uint32_t id = 0; id < names_.size(); ++id) {
+    name_buckets(id);
+    for (uint32_t bucket : buckets) { bucket_names_[bucket + 1]++; }
+  }
+  for (std::size_t b = 0; b < num_buckets; ++b) {
+    bucket_names_[b + 1] += bucket_names_[b];
+  }
+  postings_.resize(bucket_names_.back());
+  fill.assign(bucket_names_.begin(), bucket_names_.end() - 1);
+  for (uint32_t id = 0; id < names_.size(); ++id) {
+    name_buckets(id);
+    for (uint32_t bucket : buckets) { postings_[fill[bucket]++] = id; }
+  }
+}
+
+std::vector<uint32_t> TreeNameIndex::Candidates(const char* pattern) const
+{
+  std::vector<uint32_t> buckets;
+  for (const std::string& run : LiteralRuns(pattern)) {
+    for (std::size_t i = 0; i + 3 <= run.size(); ++i) {
+      buckets.push_back(Bucket(run.c_str() + i));
+    }
+  }
+  std::sort(buckets.begin(), buckets.end());
+  buckets.erase(std::unique(buckets.begin(), buckets.end()), buckets.end());
+
+  std::vector<uint32_t> ids;
+  if (buckets.empty()) {
+    ids.resize(names_.size());
+    for (uint32_t id = 0; id < ids.size(); ++id) { ids[id] = id; }
+    return ids;
+  }
+
+  // the shortest lists first, so the candidates get few early on
+  auto size = [this](uint32_t b) {
+    return bucket_names_[b + 1] - bucket_names_[b];
+  };
+  std::sort(buckets.begin(), buckets.end(),
+            [&size](uint32_t a, uint32_t b) { return size(a) < size(b); });
+  ids.assign(postings_.begin() + bucket_names_[buckets[0]],
+             postings_.begin() + bucket_names_[buckets[0] + 1]);
+  for (std::size_t i = 1; i < buckets.size() && !ids.empty(); ++i) {
+    Intersect(ids, postings_.data() + bucket_names_[buckets[i]],
+              postings_.data() + bucket_names_[buckets[i] + 1]);
+  }
+  return ids;
+}
+
+std::vector<tree_index> TreeNameIndex::Find(TREE_ROOT* root,
+                                            const char* pattern)
+{
+  if (root != root_ || root->num_nodes != num_nodes_) { Build(root); }
+
+  std::vector<tree_index> found;
+  for (uint32_t id : Candidates(pattern)) {
+    if (fnmatch(pattern, names_[id], 0) != 0) { continue; }
+    found.insert(found.end(), nodes_.begin() + name_nodes_[id],
+                 nodes_.begin() + name_nodes_[id + 1]);
+  }
+  std::sort(found.begin(), found.end());
+  return found;
+}
@@ -0,0 +1,60 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#ifndef BAREOS_LIB_TREE_FIND_H_
+#define BAREOS_LIB_TREE_FIND_H_
+
+#include "lib/tree.h"
+
+#include <cstdint>
+#include <vector>
+
+/* Finds the nodes of a restore tree by a fnmatch() pattern on their name
+ * without looking at every node.  Every distinct name is listed under the
+ * trigrams (three consecutive bytes) it contains; the literal parts of a
+ * pattern then select the few names that can match, and only those are
+ * matched against it.  A pattern without three literal bytes in a row
+ * (like "*.c") is matched against every distinct name, which still is less
+ * work than matching every node.
+ *
+ * The index is built by the first Find() and again once nodes were added to
+ * the tree. */
+class TreeNameIndex {
+ public:
+  // indices of the nodes with a matching name, in the order of the tree
+  std::vector<tree_index> Find(TREE_ROOT* root, const char* pattern);
+
+ private:
+  void Build(TREE_ROOT* root);
+  std::vector<uint32_t> Candidates(const char* pattern) const;
+  uint32_t Bucket(const char* trigram) const;
+
+  TREE_ROOT* root_{};
+  tree_index num_nodes_{};            /* of the tree when it was built */
+  std::vector<const char*> names_{};  /* distinct names */
+  std::vector<uint32_t> name_nodes_{}; /* start in nodes_, by name id */
+  std::vector<tree_index> nodes_{};    /* nodes by name, in tree order */
+  int bucket_bits_{};
+  std::vector<uint32_t> bucket_names_{}; /* start in postings_, by bucket */
+  std::vector<uint32_t> postings_{};     /* name ids by trigram bucket */
+};
+
+#endif  // BAREOS_LIB_TREE_FIND_H_
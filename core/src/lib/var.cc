@@ -2422,6 +2422,193 @@ var_rc_t var_expand(var_t* var,
   return VAR_RC(rc);
 }
 
+/* the pieces of a template, see var_compile() */
+typedef enum
+{
+  VAR_PIECE_TEXT,     /* plain text, copied as it is */
+  VAR_PIECE_VARIABLE, /* a variable construct */
+  VAR_PIECE_INPUT     /* a loop construct and everything after it */
+} var_piece_type_t;
+
+typedef struct {
+  var_piece_type_t type;
+  int offset;
+  int len;
+} var_piece_t;
+
+struct var_template_st {
+  char* src;
+  int src_len;
+  var_piece_t* pieces;
+  int npieces;
+};
+
+/* value callback of the syntax check, nothing is defined there */
+static var_rc_t var_undefined_value(var_t*,
+                                    void*,
+                                    const char*,
+                                    int,
+                                    int,
+                                    int,
+                                    const char**,
+                                    int*,
+                                    int*)
+{
+  return VAR_ERR_UNDEFINED_VARIABLE;
+}
+
+/* compile a template for var_execute() */
+var_rc_t var_compile(var_t* var,
+                     const char* src_ptr,
+                     int src_len,
+                     var_template_t** tpl_ptr)
+{
+  var_parse_t ctx;
+  tokenbuf_t output;
+  var_t check;
+  var_template_t* tpl;
+  const char* p;
+  const char* end;
+  int rc;
+
+  /* argument sanity checks */
+  if (var == NULL || src_ptr == NULL || src_len == 0 || tpl_ptr == NULL)
+    return VAR_RC(VAR_ERR_INVALID_ARGUMENT);
+
+  ctx.lower = NULL;
+  ctx.force_expand = 0;
+  ctx.rel_lookup_flag = 0;
+  ctx.rel_lookup_cnt = 0;
+  ctx.index_this = 0;
+
+  /* parse the whole template once with all variables undefined, which
+     finds every syntax error without looking up a single value */
+  check = *var;
+  check.cb_value_fct = var_undefined_value;
+  check.cb_operation_fct = NULL;
+  tokenbuf_init(&output);
+  rc = parse_input(&check, &ctx, src_ptr, src_ptr + src_len, &output, 0);
+  tokenbuf_free(&output);
+  if (rc < 0) return VAR_RC((var_rc_t)rc);
+
+  if ((tpl = (var_template_t*)malloc(sizeof(var_template_t))) == NULL)
+    return VAR_RC(VAR_ERR_OUT_OF_MEMORY);
+  tpl->src = (char*)malloc(src_len + 1);
+  /* a template has at most one piece more than variable constructs */
+  tpl->pieces = (var_piece_t*)malloc(sizeof(var_piece_t) * (src_len + 1));
+  tpl->npieces = 0;
+  tpl->src_len = src_len;
+  if (tpl->src == NULL || tpl->pieces == NULL) {
+    var_template_free(tpl);
+    return VAR_RC(VAR_ERR_OUT_OF_MEMORY);
+  }
+  memcpy(tpl->src, src_ptr, src_len);
+  tpl->src[src_len] = EOS;
+
+  /* split the template the way parse_input() walks through it */
+  p = tpl->src;
+  end = tpl->src + src_len;
+  while (p != end) {
+    var_piece_t* piece = &tpl->pieces[tpl->npieces++];
+    piece->offset = p - tpl->src;
+    if (var->syntax.index_open != EOS && *p == var->syntax.index_open) {
+      piece->type = VAR_PIECE_INPUT;
+      rc = end - p;
+    } else if ((rc = parse_text(var, &ctx, p, end)) != 0) {
+      piece->type = VAR_PIECE_TEXT;
+    } else {
+      piece->type = VAR_PIECE_VARIABLE;
+      tokenbuf_init(&output);
+      rc = ParseVariable(&check, &ctx, p, end, &output);
+      tokenbuf_free(&output);
+    }
+    if (rc <= 0) {
+      var_template_free(tpl);
+      return VAR_RC(rc < 0 ? (var_rc_t)rc
+                           : VAR_ERR_INPUT_ISNT_TEXT_NOR_VARIABLE);
+    }
+    piece->len = rc;
+    p += rc;
+  }
+
+  *tpl_ptr = tpl;
+  return VAR_OK;
+}
+
+/* expand a template compiled by var_compile() */
+var_rc_t var_execute(var_t* var,
+                     const var_template_t* tpl,
+                     char** dst_ptr,
+                     int* dst_len,
+                     int force_expand)
+{
+  var_parse_t ctx;
+  tokenbuf_t output;
+  tokenbuf_t result;
+  const char* end;
+  int i;
+  int rc = VAR_OK;
+
+  /* argument sanity checks */
+  if (var == NULL || tpl == NULL || dst_ptr == NULL)
+    return VAR_RC(VAR_ERR_INVALID_ARGUMENT);
+
+  ctx.lower = NULL;
+  ctx.force_expand = force_expand;
+  ctx.rel_lookup_flag = 0;
+  ctx.rel_lookup_cnt = 0;
+  ctx.index_this = 0;
+
+  tokenbuf_init(&output);
+  end = tpl->src + tpl->src_len;
+  for (i = 0; i < tpl->npieces && rc >= 0; i++) {
+    const var_piece_t* piece = &tpl->pieces[i];
+    const char* p = tpl->src + piece->offset;
+
+    switch (piece->type) {
+      case VAR_PIECE_TEXT:
+        if (!tokenbuf_append(&output, p, piece->len))
+          rc = VAR_ERR_OUT_OF_MEMORY;
+        break;
+      case VAR_PIECE_VARIABLE:
+        tokenbuf_init(&result);
+        rc = ParseVariable(var, &ctx, p, end, &result);
+        if (rc >= 0 && !tokenbuf_merge(&output, &result))
+          rc = VAR_ERR_OUT_OF_MEMORY;
+        tokenbuf_free(&result);
+        break;
+      case VAR_PIECE_INPUT:
+        /* parse_input() frees the output on errors itself */
+        rc = parse_input(var, &ctx, p, end, &output, 0);
+        if (rc < 0) tokenbuf_init(&output);
+        break;
+    }
+  }
+
+  /* always EOS-Terminate output like var_expand() */
+  if (rc >= 0 && !tokenbuf_append(&output, "\0", 1))
+    rc = VAR_ERR_OUT_OF_MEMORY;
+  if (rc < 0) {
+    tokenbuf_free(&output);
+    return VAR_RC((var_rc_t)rc);
+  }
+  output.end--;
+
+  *dst_ptr = (char*)output.begin;
+  if (dst_len != NULL) *dst_len = (output.end - output.begin);
+  return VAR_OK;
+}
+
+/* destroy a template compiled by var_compile() */
+var_rc_t var_template_free(var_template_t* tpl)
+{
+  if (tpl == NULL) return VAR_RC(VAR_ERR_INVALID_ARGUMENT);
+  free(tpl->src);
+  free(tpl->pieces);
+  free(tpl);
+  return VAR_OK;
+}
+
 /* format and expand a string */
 var_rc_t var_formatv(var_t* var,
                      char** dst_ptr,
@@ -78,6 +78,9 @@ typedef enum
 struct var_st;
 typedef struct var_st var_t;
 
+struct var_template_st;
+typedef struct var_template_st var_template_t;
+
 enum class var_config_t
 {
   VAR_CONFIG_SYNTAX,
@@ -144,6 +147,19 @@ var_rc_t var_format(var_t* var,
                     int force_expand,
                     const char* fmt,
                     ...);
+/* var_compile() checks the syntax of a template once and splits it into
+   its text and variable constructs, var_execute() expands the result like
+   var_expand() would expand the template source. */
+var_rc_t var_compile(var_t* var,
+                     const char* src_ptr,
+                     int src_len,
+                     var_template_t** tpl_ptr);
+var_rc_t var_execute(var_t* var,
+                     const var_template_t* tpl,
+                     char** dst_ptr,
+                     int* dst_len,
+                     int force_expand);
+var_rc_t var_template_free(var_template_t* tpl);
 const char* var_strerror(var_t* var, var_rc_t rc);
 
 #endif  // BAREOS_LIB_VAR_H_
@@ -34,6 +34,8 @@
 #include "lib/thread_specific_data.h"
 #include "lib/watchdog.h"
 
+#include <algorithm>
+
 
 /* Exported globals */
 utime_t watchdog_time = 0;        /* this has granularity of SLEEP_TIME */
@@ -42,6 +44,7 @@ utime_t watchdog_sleep_time = 60; /* examine things every 60 seconds */
 /* Locals */
 static pthread_mutex_t timer_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t timer = PTHREAD_COND_INITIALIZER;
+static bool woken = false; /* protected by timer_mutex */
 
 /* Forward referenced functions */
 extern "C" void* watchdog_thread(void* arg);
@@ -49,14 +52,33 @@ extern "C" void* watchdog_thread(void* arg);
 static void wd_lock();
 static void wd_unlock();
 
+/*
+ * The timers wait in a hierarchical timer wheel.  Level 0 has a slot for
+ * each of the next 64 seconds, level 1 one for each of the following 64
+ * rounds of level 0 and so on.  Registering and unregistering a timer only
+ * links it into or out of its slot.  Whenever level 0 starts a new round,
+ * the timers of the next slot of level 1 get spread over level 0, and the
+ * same for the higher levels.
+ */
+static constexpr int kWheelBits = 6;
+static constexpr utime_t kWheelSlots = utime_t{1} << kWheelBits;
+static constexpr int kWheelLevels = 4;
+static constexpr utime_t kWheelSpan = utime_t{1} << (kWheelBits * kWheelLevels);
+
+struct timer_wheel {
+  dlist<watchdog_t> slots[kWheelLevels][kWheelSlots];
+  dlist<watchdog_t> inactive; /* one shot timers that fired */
+  utime_t time{0};            /* next second to fire the timers of */
+};
+
 /* Static globals */
 static bool quit = false;
 static bool wd_is_init = false;
 static brwlock_t lock; /* watchdog lock */
 
 static pthread_t wd_tid;
-static dlist<watchdog_t>* wd_queue;
-static dlist<watchdog_t>* wd_inactive;
+static timer_wheel* wheel;
+static utime_t next_wakeup = 0; /* of the watchdog thread */
 
 /*
  * Returns: 0 if the current thread is NOT the watchdog
@@ -71,6 +93,102 @@ bool IsWatchdog()
   }
 }
 
+// Needs the watchdog lock
+static void WheelInsert(watchdog_t* wd)
+{
+  utime_t delta
+      = wd->next_fire > wheel->time ? wd->next_fire - wheel->time : 0;
+  if (delta >= kWheelSpan) { delta = kWheelSpan - 1; }
+  utime_t fire = wheel->time + delta;
+
+  int level = 0;
+  while (level < kWheelLevels - 1
+         && delta >= utime_t{1} << (kWheelBits * (level + 1))) {
+    level++;
+  }
+  wd->list = &wheel->slots[level][(fire >> (kWheelBits * level))
+                                  & (kWheelSlots - 1)];
+  wd->list->append(wd);
+}
+
+static void MoveAll(dlist<watchdog_t>& from, dlist<watchdog_t>& to)
+{
+  while (!from.empty()) {
+    watchdog_t* wd = from.first();
+    from.remove(wd);
+    to.append(wd);
+  }
+}
+
+/* After the clock jumped, let the wheel start over at now instead of
+ * turning it through every second in between. */
+static void RestartWheel(utime_t now)
+{
+  dlist<watchdog_t> active;
+  for (auto& level : wheel->slots) {
+    for (auto& slot : level) { MoveAll(slot, active); }
+  }
+  wheel->time = now;
+  while (!active.empty()) {
+    watchdog_t* wd = active.first();
+    active.remove(wd);
+    WheelInsert(wd);
+  }
+}
+
+// Fires the timers that are due at now, needs the watchdog lock
+static void TurnWheel(utime_t now)
+{
+  if (now + 1 < wheel->time || now - wheel->time > kWheelSlots * kWheelSlots) {
+    RestartWheel(now);
+  }
+
+  for (; wheel->time <= now; wheel->time++) {
+    utime_t t = wheel->time;
+    for (int level = kWheelLevels - 1; level > 0; level--) {
+      if (t & ((utime_t{1} << (kWheelBits * level)) - 1)) { continue; }
+      utime_t index = (t >> (kWheelBits * level)) & (kWheelSlots - 1);
+      auto& slot = wheel->slots[level][index];
+      while (!slot.empty()) {
+        watchdog_t* wd = slot.first();
+        slot.remove(wd);
+        WheelInsert(wd);
+      }
+    }
+
+    auto& due = wheel->slots[0][t & (kWheelSlots - 1)];
+    while (!due.empty()) {
+      watchdog_t* p = due.first();
+      due.remove(p);
+      p->list = nullptr;
+
+      /* Run the callback */
+      Dmsg2(3400, "Watchdog callback p=0x%p fire=%d\n", p, p->next_fire);
+      p->callback(p);
+
+      /* Reschedule (or move to inactive list if it's a one-shot timer) */
+      if (p->one_shot) {
+        p->list = &wheel->inactive;
+        p->list->append(p);
+      } else {
+        p->next_fire = now + p->interval;
+        WheelInsert(p);
+      }
+    }
+  }
+}
+
+/* The next second with timers in level 0, or the start of the next round
+ * of level 0, needs the watchdog lock */
+static utime_t NextFire()
+{
+  utime_t round_end = (wheel->time | (kWheelSlots - 1)) + 1;
+  for (utime_t t = wheel->time; t < round_end; t++) {
+    if (!wheel->slots[0][t & (kWheelSlots - 1)].empty()) { return t; }
+  }
+  return round_end;
+}
+
 /*
  * Start watchdog thread
  *
@@ -91,8 +209,10 @@ int StartWatchdog(void)
     Jmsg1(NULL, M_ABORT, 0, T_("Unable to initialize watchdog lock. ERR=%s\n"),
           be.bstrerror(errstat));
   }
-  wd_queue = new dlist<watchdog_t>();
-  wd_inactive = new dlist<watchdog_t>();
+  wheel = new timer_wheel;
+  wheel->time = watchdog_time;
+  next_wakeup = 0;
+  quit = false;
   wd_is_init = true;
 
   if ((status = pthread_create(&wd_tid, NULL, watchdog_thread, NULL)) != 0) {
@@ -102,15 +222,25 @@ int StartWatchdog(void)
 }
 
 /*
- * Wake watchdog timer thread so that it walks the
- *  queue and adjusts its wait time (or exits).
+ * Wake watchdog timer thread so that it turns the
+ *  wheel and adjusts its wait time (or exits).
  */
 static void ping_watchdog()
 {
   lock_mutex(timer_mutex);
+  woken = true;
   pthread_cond_signal(&timer);
   unlock_mutex(timer_mutex);
-  Bmicrosleep(0, 100);
+}
+
+static void FreeAll(dlist<watchdog_t>& list)
+{
+  while (!list.empty()) {
+    watchdog_t* p = list.first();
+    list.remove(p);
+    if (p->destructor != NULL) { p->destructor(p); }
+    free(p);
+  }
 }
 
 /*
@@ -122,7 +252,6 @@ static void ping_watchdog()
 int StopWatchdog(void)
 {
   int status;
-  watchdog_t* p;
 
   if (!wd_is_init) { return 0; }
 
@@ -131,25 +260,12 @@ int StopWatchdog(void)
 
   status = pthread_join(wd_tid, NULL);
 
-  while (!wd_queue->empty()) {
-    watchdog_t* item = wd_queue->first();
-    wd_queue->remove(item);
-    p = item;
-    if (p->destructor != NULL) { p->destructor(p); }
-    free(p);
-  }
-  delete wd_queue;
-  wd_queue = NULL;
-
-  while (!wd_inactive->empty()) {
-    watchdog_t* item = wd_inactive->first();
-    wd_inactive->remove(item);
-    p = item;
-    if (p->destructor != NULL) { p->destructor(p); }
-    free(p);
+  for (auto& level : wheel->slots) {
+    for (auto& slot : level) { FreeAll(slot); }
   }
-  delete wd_inactive;
-  wd_inactive = NULL;
+  FreeAll(wheel->inactive);
+  delete wheel;
+  wheel = NULL;
   RwlDestroy(&lock);
   wd_is_init = false;
 
@@ -168,6 +284,7 @@ watchdog_t* NewWatchdog(void)
   wd->callback = NULL;
   wd->destructor = NULL;
   wd->data = NULL;
+  wd->list = NULL;
 
   return wd;
 }
@@ -186,19 +303,20 @@ bool RegisterWatchdog(watchdog_t* wd)
   }
 
   wd_lock();
-  wd->next_fire = watchdog_time + wd->interval;
-  wd_queue->append(wd);
+  wd->next_fire = time(NULL) + wd->interval;
+  WheelInsert(wd);
+  // the thread only needs to know about timers that fire before it wakes up
+  bool wake = wd->next_fire < next_wakeup;
   Dmsg3(800, "Registered watchdog %p, interval %d%s\n", wd, wd->interval,
         wd->one_shot ? " one shot" : "");
   wd_unlock();
-  ping_watchdog();
+  if (wake) { ping_watchdog(); }
 
   return false;
 }
 
 bool UnregisterWatchdog(watchdog_t* wd)
 {
-  watchdog_t* p;
   bool ok = false;
 
   if (!wd_is_init) {
@@ -208,50 +326,36 @@ bool UnregisterWatchdog(watchdog_t* wd)
   }
 
   wd_lock();
-  foreach_dlist (p, wd_queue) {
-    if (wd == p) {
-      wd_queue->remove(wd);
-      Dmsg1(800, "Unregistered watchdog %p\n", wd);
-      ok = true;
-      goto get_out;
-    }
-  }
-
-  foreach_dlist (p, wd_inactive) {
-    if (wd == p) {
-      wd_inactive->remove(wd);
-      Dmsg1(800, "Unregistered inactive watchdog %p\n", wd);
-      ok = true;
-      goto get_out;
-    }
+  if (wd->list) {
+    Dmsg2(800, "Unregistered %swatchdog %p\n",
+          wd->list == &wheel->inactive ? "inactive " : "", wd);
+    wd->list->remove(wd);
+    wd->list = NULL;
+    ok = true;
+  } else {
+    Dmsg1(800, "Failed to unregister watchdog %p\n", wd);
   }
-
-  Dmsg1(800, "Failed to unregister watchdog %p\n", wd);
-
-get_out:
   wd_unlock();
-  ping_watchdog();
+
+  /* A timer that is gone does not need to wake the watchdog thread,
+   * it just finds nothing to do when it wakes up. */
   return ok;
 }
 
 /*
- * This is the thread that walks the watchdog queue
- *  and when a queue item fires, the callback is
- *  invoked.  If it is a one shot, the queue item
+ * This is the thread that turns the timer wheel
+ *  and when a timer fires, the callback is
+ *  invoked.  If it is a one shot, the timer
  *  is moved to the inactive queue.
  */
 extern "C" void* watchdog_thread(void*)
 {
   struct timespec timeout;
-  struct timeval tv;
-  utime_t next_time;
 
   SetJcrInThreadSpecificData(nullptr);
   Dmsg0(800, "NicB-reworked watchdog thread entered\n");
 
   while (!quit) {
-    watchdog_t* p;
-
     /*  NOTE. lock_jcr_chain removed, but the message below
      *   was left until we are sure there are no deadlocks.
      *
@@ -263,42 +367,23 @@ extern "C" void* watchdog_thread(void*)
      *   lock in the same order, we get a deadlock -- each holds
      *   the other's needed lock. */
     wd_lock();
-
-  walk_list:
     watchdog_time = time(NULL);
-    next_time = watchdog_time + watchdog_sleep_time;
-    foreach_dlist (p, wd_queue) {
-      if (p->next_fire <= watchdog_time) {
-        /* Run the callback */
-        Dmsg2(3400, "Watchdog callback p=0x%p fire=%d\n", p, p->next_fire);
-        p->callback(p);
-
-        /* Reschedule (or move to inactive list if it's a one-shot timer) */
-        if (p->one_shot) {
-          wd_queue->remove(p);
-          wd_inactive->append(p);
-          goto walk_list;
-        } else {
-          p->next_fire = watchdog_time + p->interval;
-        }
-      }
-      if (p->next_fire <= next_time) { next_time = p->next_fire; }
-    }
+    TurnWheel(watchdog_time);
+    next_wakeup = std::min(NextFire(), watchdog_time + watchdog_sleep_time);
+    timeout.tv_sec = next_wakeup;
+    timeout.tv_nsec = 0;
     wd_unlock();
 
     // Wait sleep time or until someone wakes us
-    gettimeofday(&tv, NULL);
-    timeout.tv_nsec = tv.tv_usec * 1000;
-    timeout.tv_sec = tv.tv_sec + next_time - time(NULL);
-    while (timeout.tv_nsec >= 1000000000) {
-      timeout.tv_nsec -= 1000000000;
-      timeout.tv_sec++;
-    }
-
-    Dmsg1(1900, "pthread_cond_timedwait %d\n", timeout.tv_sec - tv.tv_sec);
+    Dmsg1(1900, "pthread_cond_timedwait %d\n", next_wakeup - watchdog_time);
     /* Note, this unlocks mutex during the sleep */
     lock_mutex(timer_mutex);
-    pthread_cond_timedwait(&timer, &timer_mutex, &timeout);
+    while (!woken) {
+      if (pthread_cond_timedwait(&timer, &timer_mutex, &timeout) == ETIMEDOUT) {
+        break;
+      }
+    }
+    woken = false;
     unlock_mutex(timer_mutex);
   }
 
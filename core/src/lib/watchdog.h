@@ -32,6 +32,8 @@
 #include "include/bc_types.h"
 #include "include/dll_import_export.h"
 
+template <typename T> class dlist;
+
 enum
 {
   TYPE_CHILD = 1,
@@ -50,6 +52,7 @@ struct s_watchdog_t {
   /* Private data below - don't touch outside of watchdog.c */
   dlink<s_watchdog_t> link;
   utime_t next_fire;
+  dlist<s_watchdog_t>* list; /* the one it is linked into, if any */
 };
 typedef struct s_watchdog_t watchdog_t;
 
@@ -18,6 +18,7 @@
    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
    02110-1301, USA.
 */
+#include <algorithm>
 #include <cstring>
 #if defined(XXHASH_ENABLE_DISPATCH)
 #  include <xxh_x86dispatch.h>
@@ -70,7 +71,105 @@ bool XxhashDigest::Finalize(uint8_t* data, uint32_t* length)
   return true;
 }
 
+class Xxh3TreeDigest : public Digest {
+  XxhashDigestState root{};
+  std::vector<uint8_t> partial; /* start of a chunk that is not full yet */
+
+ public:
+  Xxh3TreeDigest(JobControlRecord* t_jcr, crypto_digest_t t_type);
+  virtual bool Update(const uint8_t* data, uint32_t length) override;
+  virtual bool Finalize(uint8_t* data, uint32_t* length) override;
+  bool AddChunkHash(const Xxh128Hash& hash);
+  bool AddChunkHashes(const std::vector<Xxh128Hash>& hashes);
+};
+
+Xxh3TreeDigest::Xxh3TreeDigest(JobControlRecord* t_jcr, crypto_digest_t t_type)
+    : Digest(t_jcr, t_type)
+{
+  if (XXH3_128bits_reset(*root) == XXH_ERROR) { throw DigestInitException{}; }
+  partial.reserve(xxh3_tree_chunk_size);
+}
+
+bool Xxh3TreeDigest::AddChunkHash(const Xxh128Hash& hash)
+{
+  XXH128_canonical_t canonical{};
+  XXH128_canonicalFromHash(&canonical, XXH128_hash_t{hash.low64, hash.high64});
+  return XXH3_128bits_update(*root, &canonical, sizeof(canonical)) == XXH_OK;
+}
+
+bool Xxh3TreeDigest::AddChunkHashes(const std::vector<Xxh128Hash>& hashes)
+{
+  // the chunks have to follow the ones hashed before
+  if (!partial.empty()) { return false; }
+  for (auto& hash : hashes) {
+    if (!AddChunkHash(hash)) { return false; }
+  }
+  return true;
+}
+
+bool Xxh3TreeDigest::Update(const uint8_t* data, uint32_t length)
+{
+  if (!partial.empty()) {
+    std::size_t missing = xxh3_tree_chunk_size - partial.size();
+    std::size_t take = std::min<std::size_t>(missing, length);
+    partial.insert(partial.end(), data, data + take);
+    data += take;
+    length -= take;
+    if (partial.size() < xxh3_tree_chunk_size) { return true; }
+    if (!AddChunkHash(Xxh128(partial.data(), partial.size()))) { return false; }
+    partial.clear();
+  }
+
+  for (; length >= xxh3_tree_chunk_size;
+       data += xxh3_tree_chunk_size, length -= xxh3_tree_chunk_size) {
+    if (!AddChunkHash(Xxh128(data, xxh3_tree_chunk_size))) { return false; }
+  }
+  partial.insert(partial.end(), data, data + length);
+  return true;
+}
+
+bool Xxh3TreeDigest::Finalize(uint8_t* data, uint32_t* length)
+{
+  if (!partial.empty()) {
+    if (!AddChunkHash(Xxh128(partial.data(), partial.size()))) { return false; }
+    partial.clear();
+  }
+
+  const XXH128_hash_t hash = XXH3_128bits_digest(*root);
+  XXH128_canonical_t canonical{};
+  XXH128_canonicalFromHash(&canonical, hash);
+  *length = sizeof(canonical);
+  std::memcpy(data, &canonical, sizeof(canonical));
+  return true;
+}
+
 DIGEST* XxhashDigestNew(JobControlRecord* jcr, crypto_digest_t type)
 {
+  if (type == CRYPTO_DIGEST_XXH3_TREE) { return new Xxh3TreeDigest(jcr, type); }
   return new XxhashDigest(jcr, type);
 }
+
+Xxh128Hash Xxh128(const void* data, std::size_t size)
+{
+  const XXH128_hash_t hash = XXH3_128bits(data, size);
+  return {hash.low64, hash.high64};
+}
+
+std::vector<Xxh128Hash> Xxh3TreeChunkHashes(const void* data, std::size_t size)
+{
+  auto* p = static_cast<const uint8_t*>(data);
+  std::vector<Xxh128Hash> hashes;
+  hashes.reserve((size + xxh3_tree_chunk_size - 1) / xxh3_tree_chunk_size);
+  for (std::size_t done = 0; done < size; done += xxh3_tree_chunk_size) {
+    hashes.push_back(
+        Xxh128(p + done, std::min(xxh3_tree_chunk_size, size - done)));
+  }
+  return hashes;
+}
+
+bool Xxh3TreeAddChunkHashes(DIGEST* digest,
+                            const std::vector<Xxh128Hash>& hashes)
+{
+  auto* tree = dynamic_cast<Xxh3TreeDigest*>(digest);
+  return tree && tree->AddChunkHashes(hashes);
+}
@@ -1,7 +1,7 @@
 /*
    BAREOS® - Backup Archiving REcovery Open Sourced
 
-   Copyright (C) 2023-2023 Bareos GmbH & Co. KG
+   Copyright (C) 2023-2024 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -22,8 +22,37 @@
 #ifndef BAREOS_LIB_XXHASH_H_
 #define BAREOS_LIB_XXHASH_H_
 
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
 #include "crypto.h"
 class JobControlRecord;
 
 DIGEST* XxhashDigestNew(JobControlRecord* jcr, crypto_digest_t type);
+
+struct Xxh128Hash {
+  std::uint64_t low64;
+  std::uint64_t high64;
+
+  friend bool operator==(const Xxh128Hash& l, const Xxh128Hash& r)
+  {
+    return l.low64 == r.low64 && l.high64 == r.high64;
+  }
+};
+
+// one shot XXH3 128bit hash of the given memory
+Xxh128Hash Xxh128(const void* data, std::size_t size);
+
+/* The CRYPTO_DIGEST_XXH3_TREE digest hashes every chunk of the data on its
+ * own and then the list of these hashes.  The chunk hashes can be computed
+ * in parallel with Xxh3TreeChunkHashes() and added to the digest in order
+ * with Xxh3TreeAddChunkHashes().  All pieces of data hashed this way but the
+ * last one need to be a multiple of the chunk size. */
+constexpr std::size_t xxh3_tree_chunk_size = 64 * 1024;
+
+std::vector<Xxh128Hash> Xxh3TreeChunkHashes(const void* data,
+                                            std::size_t size);
+bool Xxh3TreeAddChunkHashes(DIGEST* digest,
+                            const std::vector<Xxh128Hash>& hashes);
 #endif  // BAREOS_LIB_XXHASH_H_
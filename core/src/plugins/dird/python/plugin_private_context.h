@@ -27,6 +27,7 @@ struct plugin_private_context {
   bool python_loaded;               // Plugin has python module loaded?
   bool python_default_path_is_set;  // Python plugin default search path is set?
   bool python_path_is_set;          // Python plugin search path is set?
+  bool async_events;                // Deliver events on the delivery thread?
   char* module_path;                // Plugin Module Path
   char* module_name;                // Plugin Module Name
   PyThreadState*
@@ -47,6 +47,7 @@
 #include "module/bareosdir.h"
 #include "lib/plugins.h"
 #include "lib/edit.h"
+#include "lib/message_delivery.h"
 
 namespace directordaemon {
 
@@ -60,7 +61,7 @@ static const int debuglevel = 150;
 #define PLUGIN_USAGE                                                           \
   PLUGIN_NAME                                                                  \
   ":module_name=<python-module-to-load>:module_path=<path-to-python-modules>:" \
-  "instance=<instance_id>:...\n"                                               \
+  "instance=<instance_id>:async_events=<yes|no>:...\n"                         \
   "\n"                                                                         \
   "  module_name: The name of the Python module.\n"                            \
   "  module_path: Python search path for the module.\n"                        \
@@ -68,6 +69,8 @@ static const int debuglevel = 150;
   "' is always checked for modules.\n"                                         \
   "  instance:    Default is ’0’.\n"                                       \
   "               Increment the number, when using more than one plugin.\n"    \
+  "  async_events: Deliver the events on a separate thread in batches.\n"      \
+  "               Default is 'no'.\n"                                          \
   "  Additional parameters are plugin specific."
 
 
@@ -115,6 +118,18 @@ static PluginFunctions pluginFuncs
  */
 static PyThreadState* mainThreadState{nullptr};
 
+/* Events of the plugin instances with async_events=yes, delivered to Python
+ * by a single thread so the threads of the jobs never wait for the GIL. */
+struct queued_event {
+  PluginContext* plugin_ctx;
+  uint32_t event_type;
+};
+
+static void DeliverEvents(std::vector<queued_event>& batch);
+
+static message_delivery_queue<queued_event>* event_queue{nullptr};
+static constexpr std::size_t event_queue_capacity = 1024;
+
 /* functions common to all plugins */
 #include "plugins/include/python_plugins_common.inc"
 #include "plugins/include/python_plugin_modules_common.inc"
@@ -214,12 +229,21 @@ loadPlugin(PluginApiDefinition* lbareos_plugin_interface_version,
 #endif
 
   mainThreadState = PyEval_SaveThread();
+
+  event_queue = new message_delivery_queue<queued_event>(
+      "python-dir events", event_queue_capacity, DeliverEvents);
+
   return bRC_OK;
 }
 
 // External entry point to unload the plugin
 BAREOS_EXPORT bRC unloadPlugin()
 {
+  if (event_queue) {
+    delete event_queue;
+    event_queue = nullptr;
+  }
+
   /* Terminate Python if it was initialized correctly */
   if (mainThreadState) {
     PyEval_RestoreThread(mainThreadState);
@@ -267,6 +291,9 @@ static bRC freePlugin(PluginContext* plugin_ctx)
 
   if (!plugin_priv_ctx) { return bRC_Error; }
 
+  // Events of this instance may still be queued.
+  if (plugin_priv_ctx->async_events) { event_queue->Flush(); }
+
   // Stop any sub interpreter started per plugin instance.
   PyEval_AcquireThread(plugin_priv_ctx->interpreter);
 
@@ -291,6 +318,32 @@ static bRC freePlugin(PluginContext* plugin_ctx)
 }
 
 
+/* Hands a batch of queued events to Python, taking the interpreter of a
+ * plugin instance once for all its events that follow each other. */
+static void DeliverEvents(std::vector<queued_event>& batch)
+{
+  std::size_t i = 0;
+  while (i < batch.size()) {
+    PluginContext* plugin_ctx = batch[i].plugin_ctx;
+    plugin_private_context* plugin_priv_ctx
+        = (plugin_private_context*)plugin_ctx->plugin_private_context;
+
+    PyEval_AcquireThread(plugin_priv_ctx->interpreter);
+    Bareosdir_set_plugin_context(plugin_ctx);
+    for (; i < batch.size() && batch[i].plugin_ctx == plugin_ctx; i++) {
+      bDirEvent event{batch[i].event_type};
+
+      if (Bareosdir_PyHandlePluginEvent(plugin_ctx, &event, nullptr)
+          != bRC_OK) {
+        Dmsg(plugin_ctx, debuglevel,
+             LOGPREFIX "Python failed to handle queued event %d\n",
+             event.eventType);
+      }
+    }
+    PyEval_ReleaseThread(plugin_priv_ctx->interpreter);
+  }
+}
+
 static bRC handlePluginEvent(PluginContext* plugin_ctx,
                              bDirEvent* event,
                              void* value)
@@ -316,6 +369,16 @@ static bRC handlePluginEvent(PluginContext* plugin_ctx,
       break;
   }
 
+  /* With async_events the loaded module gets all other events later from the
+   * delivery thread, their result is not returned to the core. */
+  if (!event_dispatched && plugin_priv_ctx->async_events
+      && plugin_priv_ctx->python_loaded) {
+    queued_event queued{plugin_ctx, event->eventType};
+
+    event_queue->Start();
+    if (event_queue->Put(queued, true)) { return bRC_OK; }
+  }
+
   /* See if we have been triggered in the previous switch if not we have to
    * always dispatch the event. If we already processed the event internally
    * we only do a dispatch to the python entry point when that internal
@@ -446,6 +509,9 @@ static bRC parse_plugin_definition(PluginContext* plugin_ctx,
           case argument_module_name:
             str_destination = &plugin_priv_ctx->module_name;
             break;
+          case argument_async_events:
+            bool_destination = &plugin_priv_ctx->async_events;
+            break;
           default:
             break;
         }
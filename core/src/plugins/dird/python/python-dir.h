@@ -42,7 +42,8 @@ enum plugin_argument_type
   argument_none,
   argument_instance,
   argument_module_path,
-  argument_module_name
+  argument_module_name,
+  argument_async_events
 };
 
 struct plugin_argument {
@@ -54,6 +55,7 @@ static plugin_argument plugin_arguments[]
     = {{"instance", argument_instance},
        {"module_path", argument_module_path},
        {"module_name", argument_module_name},
+       {"async_events", argument_async_events},
        {NULL, argument_none}};
 
 } /* namespace directordaemon */
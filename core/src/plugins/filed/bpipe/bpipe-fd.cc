@@ -35,6 +35,20 @@
 #include "filed/fd_plugins.h"
 #include "plugins/include/common.h"
 #include "lib/bpipe.h"
+#include "lib/edit.h"
+
+#if !defined(HAVE_WIN32)
+#  ifdef HAVE_POLL_H
+#    include <poll.h>
+#  elif HAVE_SYS_POLL_H
+#    include <sys/poll.h>
+#  endif
+#  include <algorithm>
+#  include <condition_variable>
+#  include <mutex>
+#  include <thread>
+#  include <vector>
+#endif
 
 namespace filedaemon {
 
@@ -46,10 +60,16 @@ static const int debuglevel = 150;
 #define PLUGIN_VERSION "2"
 #define PLUGIN_DESCRIPTION "Bareos Pipe File Daemon Plugin"
 #define PLUGIN_USAGE                                                   \
-  "bpipe:file=<filepath>:reader=<readprogram>:writer=<writeprogram>\n" \
+  "bpipe:file=<filepath>:reader=<readprogram>:writer=<writeprogram>"   \
+  "[:buffer=<size>]\n"                                                 \
   " readprogram runs on backup and its stdout is saved\n"              \
   " writeprogram runs on restore and gets restored data into stdin\n"  \
-  " the data is internally stored as filepath (e.g. mybackup/backup1)"
+  " the data is internally stored as filepath (e.g. mybackup/backup1)\n" \
+  " buffer is the amount of data read ahead resp. written behind\n"    \
+  " (default 1m, 0 disables it)"
+
+static const uint64_t default_buffer_size = 1024 * 1024;
+static const uint64_t max_buffer_size = 1024 * 1024 * 1024;
 
 /* Forward referenced functions */
 static bRC newPlugin(PluginContext* ctx);
@@ -71,6 +91,8 @@ static bRC getXattr(PluginContext* ctx, xattr_pkt* xp);
 static bRC setXattr(PluginContext* ctx, xattr_pkt* xp);
 
 static char* apply_rp_codes(PluginContext* ctx);
+static bool parse_buffer_size(const char* value, uint64_t* size);
+static void start_buffer(PluginContext* ctx, bool writing);
 static bRC parse_plugin_definition(PluginContext* ctx, void* value);
 static bRC plugin_has_all_arguments(PluginContext* ctx);
 
@@ -97,14 +119,18 @@ static PluginFunctions pluginFuncs
        endBackupFile, startRestoreFile, endRestoreFile, pluginIO, createFile,
        setFileAttributes, checkFile, getAcl, setAcl, getXattr, setXattr};
 
+class PipeBuffer;
+
 // Plugin private context
 struct plugin_ctx {
   boffset_t offset;
   Bpipe* pfd;           /* bpipe() descriptor */
+  PipeBuffer* buffer;   /* Read ahead resp. write behind of pfd */
   char* plugin_options; /* Override of plugin options passed in */
   char* fname;          /* Filename to "backup/restore" */
   char* reader;         /* Reader program for backup */
   char* writer;         /* Writer program for backup */
+  char* buffer_size;    /* Size of buffer, NULL for the default */
 
   char where[512];
   int replace;
@@ -116,7 +142,8 @@ enum plugin_argument_type
   argument_none = 0,
   argument_file,
   argument_reader,
-  argument_writer
+  argument_writer,
+  argument_buffer
 };
 
 struct plugin_argument {
@@ -128,8 +155,189 @@ struct plugin_argument {
 static plugin_argument plugin_arguments[] = {{"file=", argument_file, 4},
                                              {"reader=", argument_reader, 6},
                                              {"writer=", argument_writer, 6},
+                                             {"buffer=", argument_buffer, 6},
                                              {NULL, argument_none, 0}};
 
+#if !defined(HAVE_WIN32)
+/**
+ * A thread that moves the data between the pipe and a ring buffer, so the
+ * program and the File Daemon do not wait for each other.  On backup it
+ * reads ahead of pluginIO(IO_READ), on restore it writes behind
+ * pluginIO(IO_WRITE).  The thread is the only one touching the free part of
+ * the ring when reading and the filled part when writing, so it does the
+ * actual I/O without holding the mutex.
+ */
+class PipeBuffer {
+ public:
+  PipeBuffer(int fd, bool writing, std::size_t size)
+      : fd_{fd}, writing_{writing}, ring_(size)
+  {
+#  if defined(F_SETPIPE_SZ)
+    // best effort, a larger pipe lets the program run ahead even further
+    fcntl(fd_, F_SETPIPE_SZ, static_cast<int>(std::min(size, ring_max_pipe)));
+#  endif
+    thread_ = std::thread([this] { writing_ ? WriteBehind() : ReadAhead(); });
+  }
+  ~PipeBuffer() { Finish(); }
+
+  /* Copies up to count bytes read from the pipe into buf.  Returns 0 at the
+   * end of the data and -1 (with the errno in io_errno) on a read error. */
+  ssize_t Read(char* buf, std::size_t count, int& io_errno)
+  {
+    std::unique_lock lock(mutex_);
+    changed_.wait(lock, [this] { return filled_ > 0 || done_; });
+    if (filled_ == 0) {
+      io_errno = error_;
+      return error_ ? -1 : 0;
+    }
+    std::size_t n = std::min(count, filled_);
+    CopyOut(buf, n);
+    changed_.notify_all();
+    return n;
+  }
+
+  /* Queues count bytes of buf for the pipe.  Returns -1 (with the errno in
+   * io_errno) once writing to the pipe failed. */
+  ssize_t Write(const char* buf, std::size_t count, int& io_errno)
+  {
+    std::size_t written = 0;
+    std::unique_lock lock(mutex_);
+    while (written < count) {
+      changed_.wait(lock, [this] { return filled_ < ring_.size() || done_; });
+      if (done_) {
+        io_errno = error_;
+        return -1;
+      }
+      std::size_t n = std::min(count - written, ring_.size() - filled_);
+      CopyIn(buf + written, n);
+      written += n;
+      changed_.notify_all();
+    }
+    return written;
+  }
+
+  /* Ends the thread, after everything queued was written when writing.
+   * Returns the errno of the first failed read or write, if any. */
+  int Finish()
+  {
+    {
+      std::unique_lock lock(mutex_);
+      stopping_ = true;
+    }
+    changed_.notify_all();
+    if (thread_.joinable()) { thread_.join(); }
+    return error_;
+  }
+
+ private:
+  static constexpr std::size_t ring_max_pipe = 1024 * 1024;
+  static constexpr int poll_interval = 1000; /* ms */
+
+  // Both need mutex_ to be held.
+  void CopyOut(char* buf, std::size_t n)
+  {
+    std::size_t first = std::min(n, ring_.size() - head_);
+    memcpy(buf, ring_.data() + head_, first);
+    memcpy(buf + first, ring_.data(), n - first);
+    head_ = (head_ + n) % ring_.size();
+    filled_ -= n;
+  }
+  void CopyIn(const char* buf, std::size_t n)
+  {
+    std::size_t tail = (head_ + filled_) % ring_.size();
+    std::size_t first = std::min(n, ring_.size() - tail);
+    memcpy(ring_.data() + tail, buf, first);
+    memcpy(ring_.data(), buf + first, n - first);
+    filled_ += n;
+  }
+
+  // Waits until the pipe can be read, false if the buffer got stopped.
+  bool WaitReadable()
+  {
+    struct pollfd pfd = {fd_, POLLIN, 0};
+    for (;;) {
+      int status = poll(&pfd, 1, poll_interval);
+      if (status > 0 || (status < 0 && errno != EINTR)) { return true; }
+      std::unique_lock lock(mutex_);
+      if (stopping_) { return false; }
+    }
+  }
+
+  void ReadAhead()
+  {
+    std::unique_lock lock(mutex_);
+    while (!stopping_) {
+      changed_.wait(lock,
+                    [this] { return filled_ < ring_.size() || stopping_; });
+      if (stopping_) { break; }
+      std::size_t tail = (head_ + filled_) % ring_.size();
+      std::size_t room = std::min(ring_.size() - filled_, ring_.size() - tail);
+      lock.unlock();
+
+      ssize_t n = -1;
+      if (WaitReadable()) {
+        do {
+          n = read(fd_, ring_.data() + tail, room);
+        } while (n < 0 && errno == EINTR);
+      } else {
+        n = 0;
+      }
+      int read_errno = errno;
+
+      lock.lock();
+      if (n <= 0) {
+        if (n < 0) { error_ = read_errno; }
+        break;
+      }
+      filled_ += n;
+      changed_.notify_all();
+    }
+    done_ = true;
+    changed_.notify_all();
+  }
+
+  void WriteBehind()
+  {
+    std::unique_lock lock(mutex_);
+    for (;;) {
+      changed_.wait(lock, [this] { return filled_ > 0 || stopping_; });
+      if (filled_ == 0) { break; }
+      std::size_t n = std::min(filled_, ring_.size() - head_);
+      lock.unlock();
+
+      ssize_t written;
+      do {
+        written = write(fd_, ring_.data() + head_, n);
+      } while (written < 0 && errno == EINTR);
+      int write_errno = errno;
+
+      lock.lock();
+      if (written < 0) {
+        error_ = write_errno;
+        break;
+      }
+      head_ = (head_ + written) % ring_.size();
+      filled_ -= written;
+      changed_.notify_all();
+    }
+    done_ = true;
+    changed_.notify_all();
+  }
+
+  int fd_;
+  bool writing_;
+  std::vector<char> ring_;
+  std::size_t head_{0};
+  std::size_t filled_{0};
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  std::thread thread_;
+  int error_{0};
+  bool done_{false};
+  bool stopping_{false};
+};
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -196,6 +404,12 @@ static bRC freePlugin(PluginContext* ctx)
 
   if (p_ctx->writer) { free(p_ctx->writer); }
 
+  if (p_ctx->buffer_size) { free(p_ctx->buffer_size); }
+
+#if !defined(HAVE_WIN32)
+  delete p_ctx->buffer;
+#endif
+
   if (p_ctx->plugin_options) { free(p_ctx->plugin_options); }
 
   free(p_ctx); /* free our private context */
@@ -313,6 +527,7 @@ static bRC pluginIO(PluginContext* ctx, io_pkt* io)
           return bRC_Error;
         }
         if (writer_codes) { free(writer_codes); }
+        start_buffer(ctx, true);
       } else {
         p_ctx->pfd = OpenBpipe(p_ctx->reader, 0, "r", false);
         Dmsg(ctx, debuglevel, "bpipe-fd: IO_OPEN fd=%p reader=%s\n", p_ctx->pfd,
@@ -326,6 +541,7 @@ static bRC pluginIO(PluginContext* ctx, io_pkt* io)
                strerror(io->io_errno));
           return bRC_Error;
         }
+        start_buffer(ctx, false);
       }
       sleep(1); /* let pipe connect */
       break;
@@ -335,9 +551,20 @@ static bRC pluginIO(PluginContext* ctx, io_pkt* io)
         Dmsg(ctx, debuglevel, "bpipe-fd: Logic error: NULL read FD\n");
         return bRC_Error;
       }
-      io->status = fread(io->buf, 1, io->count, p_ctx->pfd->rfd);
-      if (io->status == 0 && ferror(p_ctx->pfd->rfd)) {
-        io->io_errno = errno;
+#if !defined(HAVE_WIN32)
+      if (p_ctx->buffer) {
+        io->status = p_ctx->buffer->Read(io->buf, io->count, io->io_errno);
+      } else
+#endif
+      {
+        io->status = fread(io->buf, 1, io->count, p_ctx->pfd->rfd);
+        if (io->status == 0 && ferror(p_ctx->pfd->rfd)) {
+          io->io_errno = errno;
+          io->status = -1;
+        }
+      }
+      if (io->status < 0) {
+        io->status = 0;
         Jmsg(ctx, M_FATAL, "bpipe-fd: Pipe read error: ERR=%s\n",
              strerror(io->io_errno));
         Dmsg(ctx, debuglevel, "bpipe-fd: Pipe read error: ERR=%s\n",
@@ -351,9 +578,20 @@ static bRC pluginIO(PluginContext* ctx, io_pkt* io)
         Dmsg(ctx, debuglevel, "bpipe-fd: Logic error: NULL write FD\n");
         return bRC_Error;
       }
-      io->status = fwrite(io->buf, 1, io->count, p_ctx->pfd->wfd);
-      if (io->status == 0 && ferror(p_ctx->pfd->wfd)) {
-        io->io_errno = errno;
+#if !defined(HAVE_WIN32)
+      if (p_ctx->buffer) {
+        io->status = p_ctx->buffer->Write(io->buf, io->count, io->io_errno);
+      } else
+#endif
+      {
+        io->status = fwrite(io->buf, 1, io->count, p_ctx->pfd->wfd);
+        if (io->status == 0 && ferror(p_ctx->pfd->wfd)) {
+          io->io_errno = errno;
+          io->status = -1;
+        }
+      }
+      if (io->status < 0) {
+        io->status = 0;
         Jmsg(ctx, M_FATAL, "bpipe-fd: Pipe write error: ERR=%s\n",
              strerror(io->io_errno));
         Dmsg(ctx, debuglevel, "bpipe-fd: Pipe write error: ERR=%s\n",
@@ -368,7 +606,27 @@ static bRC pluginIO(PluginContext* ctx, io_pkt* io)
              "bpipe-fd: Logic error: NULL FD on bpipe close\n");
         return bRC_Error;
       }
+#if !defined(HAVE_WIN32)
+      if (p_ctx->buffer) {
+        // Writes what is still queued, read errors were reported by IO_READ.
+        bool writing = p_ctx->pfd->wfd != NULL;
+        int buffer_errno = p_ctx->buffer->Finish();
+        delete p_ctx->buffer;
+        p_ctx->buffer = NULL;
+        if (writing && buffer_errno) {
+          io->io_errno = buffer_errno;
+          CloseBpipe(p_ctx->pfd);
+          p_ctx->pfd = NULL;
+          Jmsg(ctx, M_FATAL, "bpipe-fd: Pipe write error: ERR=%s\n",
+               strerror(io->io_errno));
+          Dmsg(ctx, debuglevel, "bpipe-fd: Pipe write error: ERR=%s\n",
+               strerror(io->io_errno));
+          return bRC_Error;
+        }
+      }
+#endif
       io->status = CloseBpipe(p_ctx->pfd);
+      p_ctx->pfd = NULL;
       if (io->status) {
         Jmsg(ctx, M_FATAL,
              "bpipe-fd: Error closing stream for pseudo file %s: %d\n",
@@ -559,6 +817,32 @@ static inline void SetStringIfNull(char** destination, char* value)
   }
 }
 
+// Size of the read ahead resp. write behind buffer, e.g. 512k or 4m.
+static bool parse_buffer_size(const char* value, uint64_t* size)
+{
+  return size_to_uint64(value, size) && *size <= max_buffer_size;
+}
+
+/**
+ * Put a PipeBuffer between the just opened pipe and pluginIO(), unless it
+ * is disabled with buffer=0.
+ */
+static void start_buffer(PluginContext* ctx, bool writing)
+{
+#if !defined(HAVE_WIN32)
+  plugin_ctx* p_ctx = (plugin_ctx*)ctx->plugin_private_context;
+  uint64_t size = default_buffer_size;
+
+  if (p_ctx->buffer_size) { parse_buffer_size(p_ctx->buffer_size, &size); }
+  if (size == 0) { return; }
+
+  int fd = fileno(writing ? p_ctx->pfd->wfd : p_ctx->pfd->rfd);
+  p_ctx->buffer = new PipeBuffer(fd, writing, size);
+  Dmsg(ctx, debuglevel, "bpipe-fd: using a %llu byte buffer\n",
+       (unsigned long long)size);
+#endif
+}
+
 // Always set destination to value and clean any previous one.
 static inline void SetString(char** destination, char* value)
 {
@@ -574,6 +858,7 @@ static inline void SetString(char** destination, char* value)
  * The definition is in this form:
  *
  * bpipe:file=<filepath>:read=<readprogram>:write=<writeprogram>
+ *   [:buffer=<size>]
  */
 static bRC parse_plugin_definition(PluginContext* ctx, void* value)
 {
@@ -731,6 +1016,22 @@ static bRC parse_plugin_definition(PluginContext* ctx, void* value)
             case argument_writer:
               str_destination = &p_ctx->writer;
               break;
+            case argument_buffer: {
+              uint64_t size;
+              if (!parse_buffer_size(argument_value, &size)) {
+                Jmsg(ctx, M_FATAL,
+                     "bpipe-fd: buffer argument (%s) is not a size of at "
+                     "most 1g. Please fix your plugin definition\n",
+                     argument_value);
+                Dmsg(ctx, debuglevel,
+                     "bpipe-fd: buffer argument (%s) is not a size of at "
+                     "most 1g. Please fix your plugin definition\n",
+                     argument_value);
+                goto bail_out;
+              }
+              str_destination = &p_ctx->buffer_size;
+              break;
+            }
             default:
               break;
           }
@@ -33,9 +33,20 @@
 #include "lib/berrno.h"
 #include "lib/edit.h"
 #include "lib/serial.h"
+#include "lib/gfapi_async_io.h"
 
 #include <glusterfs/api/glfs.h>
 
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
 
 /* avoid missing config.h problem on Debian 8 and Ubuntu 16:
    compat-errno.h includes not existing config.h when
@@ -60,9 +71,12 @@ static const int debuglevel = 150;
 #define PLUGIN_DESCRIPTION "Bareos GlusterFS GFAPI File Daemon Plugin"
 #define PLUGIN_USAGE                                               \
   "gfapi:volume=gluster[+transport]\\://[server[:port]]/volname[/" \
-  "dir][?socket=...]:snapdir=<snapdir>:gffilelist=<file>"
+  "dir][?socket=...]:snapdir=<snapdir>:gffilelist=<file>:queuedepth=<n>:" \
+  "dirprefetch=<n>"
 
 #define GLFS_PATH_MAX 4096
+#define GLFS_PREFETCH_ENTRIES 4096 /* Entries read ahead per directory */
+#define GLFS_PREFETCH_LISTINGS 64  /* Directories read ahead at most */
 
 // Forward referenced functions
 static bRC newPlugin(PluginContext* ctx);
@@ -111,13 +125,206 @@ static PluginFunctions pluginFuncs
        endBackupFile, startRestoreFile, endRestoreFile, pluginIO, createFile,
        setFileAttributes, checkFile, getAcl, setAcl, getXattr, setXattr};
 
+struct gfapi_dir_entry {
+  std::string name;
+  struct stat statp;
+};
+
+/**
+ * The first GLFS_PREFETCH_ENTRIES entries of a directory, the rest is read
+ * from gdir which is positioned right after them.
+ */
+struct gfapi_dir_listing {
+  glfs_fd_t* gdir{nullptr}; /* NULL when glfs_opendir() failed */
+  int error{0};             /* errno of glfs_opendir() */
+  std::vector<gfapi_dir_entry> entries;
+  std::size_t next{0}; /* Next entry to hand out */
+};
+
+static void FreeDirListing(gfapi_dir_listing* listing, bool close_gdir)
+{
+  if (!listing) { return; }
+  if (close_gdir && listing->gdir) { glfs_closedir(listing->gdir); }
+  delete listing;
+}
+
+// Reads the listing of the directory path (an absolute path) on glfs.
+static gfapi_dir_listing* ReadDirListing(glfs_t* glfs, const std::string& path)
+{
+  gfapi_dir_listing* listing = new gfapi_dir_listing;
+
+  listing->gdir = glfs_opendir(glfs, path.c_str());
+  if (!listing->gdir) {
+    listing->error = errno;
+    return listing;
+  }
+
+  while (listing->entries.size() < GLFS_PREFETCH_ENTRIES) {
+    struct stat st;
+    struct dirent* entry;
+
+#ifndef HAVE_GLFS_READDIRPLUS
+    alignas(struct dirent) char dirent_buffer[512];
+
+    entry = NULL;
+    glfs_readdirplus_r(listing->gdir, &st, (dirent*)dirent_buffer, &entry);
+#else
+    entry = glfs_readdirplus(listing->gdir, &st);
+#endif
+    if (!entry) { break; }
+
+    listing->entries.push_back(gfapi_dir_entry{entry->d_name, st});
+  }
+
+  return listing;
+}
+
+/**
+ * Reads the directories of the crawl ahead with a pool of threads, so the
+ * round trips to the Gluster servers of several directories overlap with
+ * each other and with the backup of the files.  When the crawl enters a
+ * directory, its sub directories get queued in front of everything else as
+ * they are the ones the depth first crawl enters next.  Everything below a
+ * directory is dropped when the crawl leaves it.
+ */
+class gfapi_dir_prefetch {
+ public:
+  gfapi_dir_prefetch(glfs_t* glfs, int threads) : glfs_{glfs}
+  {
+    for (int i = 0; i < threads; i++) {
+      threads_.emplace_back([this] { Run(); });
+    }
+  }
+
+  ~gfapi_dir_prefetch()
+  {
+    {
+      std::unique_lock lock(mutex_);
+      stopping_ = true;
+    }
+    work_.notify_all();
+    for (auto& thread : threads_) { thread.join(); }
+    for (auto& done : done_) { FreeDirListing(done.second, true); }
+  }
+
+  // Queue all sub directories of listing (the one of path) for read ahead.
+  void Submit(const std::string& path, const gfapi_dir_listing* listing)
+  {
+    std::unique_lock lock(mutex_);
+    auto pos = pending_.begin();
+    for (const gfapi_dir_entry& entry : listing->entries) {
+      if (!S_ISDIR(entry.statp.st_mode) || IsDot(entry.name)) { continue; }
+      if (pending_.size() + done_.size() >= GLFS_PREFETCH_LISTINGS) { break; }
+      std::string subdir = path + "/" + entry.name;
+      if (done_.count(subdir) || in_progress_.count(subdir)) { continue; }
+      pos = pending_.insert(pos, std::move(subdir)) + 1;
+    }
+    work_.notify_all();
+  }
+
+  // The listing of path, read now if it was not read ahead.
+  gfapi_dir_listing* Open(const std::string& path)
+  {
+    std::unique_lock lock(mutex_);
+    for (auto it = pending_.begin(); it != pending_.end(); ++it) {
+      if (*it == path) {
+        pending_.erase(it);
+        break;
+      }
+    }
+    ready_.wait(lock, [this, &path] { return !in_progress_.count(path); });
+
+    auto found = done_.find(path);
+    if (found == done_.end()) {
+      lock.unlock();
+      return ReadDirListing(glfs_, path);
+    }
+    gfapi_dir_listing* listing = found->second;
+    done_.erase(found);
+    work_.notify_all();
+    return listing;
+  }
+
+  // Drop everything read ahead below path.
+  void Forget(const std::string& path)
+  {
+    std::unique_lock lock(mutex_);
+    std::string prefix = path + "/";
+    for (auto it = pending_.begin(); it != pending_.end();) {
+      it = IsBelow(*it, prefix) ? pending_.erase(it) : it + 1;
+    }
+    for (auto it = done_.lower_bound(prefix);
+         it != done_.end() && IsBelow(it->first, prefix);) {
+      FreeDirListing(it->second, true);
+      it = done_.erase(it);
+    }
+    for (const std::string& busy : in_progress_) {
+      if (IsBelow(busy, prefix)) { discard_.insert(busy); }
+    }
+    work_.notify_all();
+  }
+
+ private:
+  static bool IsDot(const std::string& name)
+  {
+    return name.empty() || name == "." || name == "..";
+  }
+
+  static bool IsBelow(const std::string& path, const std::string& prefix)
+  {
+    return path.compare(0, prefix.size(), prefix) == 0;
+  }
+
+  void Run()
+  {
+    std::unique_lock lock(mutex_);
+    for (;;) {
+      work_.wait(lock, [this] {
+        return stopping_
+               || (!pending_.empty()
+                   && done_.size() + in_progress_.size()
+                          < GLFS_PREFETCH_LISTINGS);
+      });
+      if (stopping_) { break; }
+
+      std::string path = std::move(pending_.front());
+      pending_.pop_front();
+      in_progress_.insert(path);
+      lock.unlock();
+
+      gfapi_dir_listing* listing = ReadDirListing(glfs_, path);
+
+      lock.lock();
+      in_progress_.erase(path);
+      if (discard_.erase(path) || stopping_) {
+        FreeDirListing(listing, true);
+      } else {
+        done_.emplace(path, listing);
+      }
+      ready_.notify_all();
+    }
+  }
+
+  glfs_t* glfs_;
+  std::mutex mutex_;
+  std::condition_variable work_;
+  std::condition_variable ready_;
+  std::vector<std::thread> threads_;
+  std::deque<std::string> pending_;
+  std::set<std::string> in_progress_;
+  std::set<std::string> discard_;
+  std::map<std::string, gfapi_dir_listing*> done_;
+  bool stopping_{false};
+};
+
 /**
  * If we recurse into a subdir we push the current directory onto
  * a stack so we can pop it after we have processed the subdir.
  */
 struct dir_stack_entry {
-  struct stat statp; /* Stat struct of directory */
-  glfs_fd_t* gdir;   /* Gluster directory handle */
+  struct stat statp;          /* Stat struct of directory */
+  glfs_fd_t* gdir;            /* Gluster directory handle */
+  gfapi_dir_listing* listing; /* Entries read ahead of gdir */
 };
 // Plugin private context
 struct plugin_ctx {
@@ -132,6 +339,8 @@ struct plugin_ctx {
   char* basedir;           /* Basedir to start backup in */
   char* snapdir;           /* Specific snapdir to use while doing backup */
   int serverport;          /* Gluster management server portnr */
+  int queue_depth;         /* Asynchronous reads/writes in flight */
+  int dir_prefetch;        /* Threads reading directories ahead */
   char flags[FOPTS_BYTES]; /* Bareos internal flags */
   int32_t type;            /* FT_xx for this file */
   struct stat statp;       /* Stat struct for next file to save */
@@ -152,7 +361,10 @@ struct plugin_ctx {
   PathList* path_list;    /* Hash table with directories created on restore. */
   glfs_t* glfs;           /* Gluster volume handle */
   glfs_fd_t* gdir;        /* Gluster directory handle */
+  gfapi_dir_listing* listing;   /* Entries of gdir read ahead */
+  gfapi_dir_prefetch* prefetch; /* Reads directories ahead */
   glfs_fd_t* gfd;         /* Gluster file handle */
+  gfapi_async_io* async_io; /* Asynchronous I/O on gfd */
   FILE* file_list_handle; /* File handle to file with files to backup */
 };
 
@@ -162,7 +374,9 @@ enum plugin_argument_type
   argument_none,
   argument_volume_spec,
   argument_snapdir,
-  argument_gf_file_list
+  argument_gf_file_list,
+  argument_queue_depth,
+  argument_dir_prefetch
 };
 
 struct plugin_argument {
@@ -174,6 +388,8 @@ static plugin_argument plugin_arguments[]
     = {{"volume", argument_volume_spec},
        {"snapdir", argument_snapdir},
        {"gffilelist", argument_gf_file_list},
+       {"queuedepth", argument_queue_depth},
+       {"dirprefetch", argument_dir_prefetch},
        {NULL, argument_none}};
 
 enum gluster_find_type
@@ -373,11 +589,28 @@ static bRC freePlugin(PluginContext* ctx)
     p_ctx->path_list = NULL;
   }
 
+  if (p_ctx->async_io) {
+    delete p_ctx->async_io;
+    p_ctx->async_io = NULL;
+  }
+
   if (p_ctx->dir_stack) {
+    for (auto* stack_entry : *p_ctx->dir_stack) {
+      FreeDirListing(stack_entry->listing, false);
+    }
     p_ctx->dir_stack->destroy();
     delete p_ctx->dir_stack;
   }
 
+  FreeDirListing(p_ctx->listing, false);
+  p_ctx->listing = NULL;
+
+  // Needs the Gluster volume handle until all its threads are gone.
+  if (p_ctx->prefetch) {
+    delete p_ctx->prefetch;
+    p_ctx->prefetch = NULL;
+  }
+
   if (p_ctx->glfs) {
     glfs_fini(p_ctx->glfs);
     p_ctx->glfs = NULL;
@@ -504,6 +737,7 @@ static bRC get_next_file_to_backup(PluginContext* ctx)
           stack_entry = (struct dir_stack_entry*)p_ctx->dir_stack->pop();
           memcpy(&p_ctx->statp, &stack_entry->statp, sizeof(p_ctx->statp));
           p_ctx->gdir = stack_entry->gdir;
+          p_ctx->listing = stack_entry->listing;
           free(stack_entry);
         } else {
           return bRC_OK;
@@ -629,16 +863,28 @@ static bRC get_next_file_to_backup(PluginContext* ctx)
         }
       }
     } else {
+      const char* name = NULL;
+      gfapi_dir_listing* listing = p_ctx->listing;
+
+      // First the entries read ahead, then the rest of the directory.
+      if (listing && listing->next < listing->entries.size()) {
+        gfapi_dir_entry& prefetched = listing->entries[listing->next++];
+
+        memcpy(&p_ctx->statp, &prefetched.statp, sizeof(p_ctx->statp));
+        name = prefetched.name.c_str();
+      } else {
 #ifndef HAVE_GLFS_READDIRPLUS
-      entry = NULL;
-      glfs_readdirplus_r(p_ctx->gdir, &p_ctx->statp,
-                         (dirent*)p_ctx->dirent_buffer, &entry);
+        entry = NULL;
+        glfs_readdirplus_r(p_ctx->gdir, &p_ctx->statp,
+                           (dirent*)p_ctx->dirent_buffer, &entry);
 #else
-      entry = glfs_readdirplus(p_ctx->gdir, &p_ctx->statp);
+        entry = glfs_readdirplus(p_ctx->gdir, &p_ctx->statp);
 #endif
+        if (entry) { name = entry->d_name; }
+      }
 
       // No more entries in this directory ?
-      if (!entry) {
+      if (!name) {
         status = glfs_stat(p_ctx->glfs, p_ctx->cwd, &p_ctx->statp);
         if (status != 0) {
           BErrNo be;
@@ -650,6 +896,9 @@ static bRC get_next_file_to_backup(PluginContext* ctx)
 
         glfs_closedir(p_ctx->gdir);
         p_ctx->gdir = NULL;
+        FreeDirListing(p_ctx->listing, false);
+        p_ctx->listing = NULL;
+        if (p_ctx->prefetch) { p_ctx->prefetch->Forget(p_ctx->cwd); }
         p_ctx->type = FT_DIREND;
 
         PmStrcpy(p_ctx->next_filename, p_ctx->cwd);
@@ -661,14 +910,13 @@ static bRC get_next_file_to_backup(PluginContext* ctx)
       }
 
       // Skip `.', `..', and excluded file names.
-      if (entry->d_name[0] == '\0'
-          || (entry->d_name[0] == '.'
-              && (entry->d_name[1] == '\0'
-                  || (entry->d_name[1] == '.' && entry->d_name[2] == '\0')))) {
+      if (name[0] == '\0'
+          || (name[0] == '.'
+              && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))) {
         continue;
       }
 
-      Mmsg(p_ctx->next_filename, "%s/%s", p_ctx->cwd, entry->d_name);
+      Mmsg(p_ctx->next_filename, "%s/%s", p_ctx->cwd, name);
     }
 
     // Determine the FileType.
@@ -777,14 +1025,26 @@ static bRC startBackupFile(PluginContext* ctx, save_pkt* sp)
                 sizeof(struct dir_stack_entry));
             memcpy(&new_entry->statp, &p_ctx->statp, sizeof(new_entry->statp));
             new_entry->gdir = p_ctx->gdir;
+            new_entry->listing = p_ctx->listing;
             p_ctx->dir_stack->push(new_entry);
           }
 
-          // Open this directory for processing.
-          p_ctx->gdir = glfs_opendir(p_ctx->glfs, ".");
+          /* Open this directory for processing, by taking what was read
+           * ahead when prefetching directories. */
+          p_ctx->listing = NULL;
+          if (p_ctx->prefetch) {
+            p_ctx->listing = p_ctx->prefetch->Open(p_ctx->next_filename);
+            p_ctx->gdir = p_ctx->listing->gdir;
+            errno = p_ctx->listing->error;
+          } else {
+            p_ctx->gdir = glfs_opendir(p_ctx->glfs, ".");
+          }
           if (!p_ctx->gdir) {
             BErrNo be;
 
+            FreeDirListing(p_ctx->listing, false);
+            p_ctx->listing = NULL;
+
             Jmsg(ctx, M_ERROR, "gfapi-fd: glfs_opendir(%s) failed: %s\n",
                  p_ctx->next_filename, be.bstrerror());
             p_ctx->type = FT_NOOPEN;
@@ -796,12 +1056,16 @@ static bRC startBackupFile(PluginContext* ctx, save_pkt* sp)
               entry = (struct dir_stack_entry*)p_ctx->dir_stack->pop();
               memcpy(&p_ctx->statp, &entry->statp, sizeof(p_ctx->statp));
               p_ctx->gdir = entry->gdir;
+              p_ctx->listing = entry->listing;
               free(entry);
 
               glfs_chdir(p_ctx->glfs, "..");
             }
           } else {
             glfs_getcwd(p_ctx->glfs, p_ctx->cwd, SizeofPoolMemory(p_ctx->cwd));
+            if (p_ctx->prefetch) {
+              p_ctx->prefetch->Submit(p_ctx->cwd, p_ctx->listing);
+            }
           }
         }
       }
@@ -1038,6 +1302,7 @@ static bRC parse_plugin_definition(PluginContext* ctx, void* value)
     for (i = 0; plugin_arguments[i].name; i++) {
       if (Bstrcasecmp(argument, plugin_arguments[i].name)) {
         char** str_destination = NULL;
+        int* int_destination = NULL;
 
         switch (plugin_arguments[i].type) {
           case argument_volume_spec:
@@ -1049,6 +1314,12 @@ static bRC parse_plugin_definition(PluginContext* ctx, void* value)
           case argument_gf_file_list:
             str_destination = &p_ctx->gf_file_list;
             break;
+          case argument_queue_depth:
+            int_destination = &p_ctx->queue_depth;
+            break;
+          case argument_dir_prefetch:
+            int_destination = &p_ctx->dir_prefetch;
+            break;
           default:
             break;
         }
@@ -1062,6 +1333,10 @@ static bRC parse_plugin_definition(PluginContext* ctx, void* value)
           }
         }
 
+        if (int_destination && (!keep_existing || !*int_destination)) {
+          *int_destination = str_to_int64(argument_value);
+        }
+
         // When we have a match break the loop.
         break;
       }
@@ -1462,6 +1737,11 @@ static bRC setup_backup(PluginContext* ctx, void* value)
      * done processing that sub directory. */
     p_ctx->dir_stack = new alist<dir_stack_entry*>(10, owned_by_alist);
 
+    if (p_ctx->dir_prefetch > 0 && !p_ctx->prefetch) {
+      p_ctx->prefetch
+          = new gfapi_dir_prefetch(p_ctx->glfs, p_ctx->dir_prefetch);
+    }
+
     /* Setup the directory we need to start scanning by setting the filetype
      * to FT_DIRBEGIN e.g. same as recursing into directory and let the recurse
      * logic do the rest of the work. */
@@ -1520,11 +1800,18 @@ static bRC pluginIO(PluginContext* ctx, io_pkt* io)
         io->io_errno = errno;
         goto bail_out;
       }
+      if (p_ctx->queue_depth > 0) {
+        p_ctx->async_io = new gfapi_async_io(p_ctx->gfd, p_ctx->queue_depth);
+      }
       io->status = 0;
       break;
     case IO_READ:
       if (p_ctx->gfd) {
-        io->status = glfs_read(p_ctx->gfd, io->buf, io->count, 0);
+        if (p_ctx->async_io) {
+          io->status = p_ctx->async_io->Read(io->buf, io->count);
+        } else {
+          io->status = glfs_read(p_ctx->gfd, io->buf, io->count, 0);
+        }
         if (io->status < 0) {
           io->io_errno = errno;
           goto bail_out;
@@ -1537,7 +1824,11 @@ static bRC pluginIO(PluginContext* ctx, io_pkt* io)
       break;
     case IO_WRITE:
       if (p_ctx->gfd) {
-        io->status = glfs_write(p_ctx->gfd, io->buf, io->count, 0);
+        if (p_ctx->async_io) {
+          io->status = p_ctx->async_io->Write(io->buf, io->count);
+        } else {
+          io->status = glfs_write(p_ctx->gfd, io->buf, io->count, 0);
+        }
         if (io->status < 0) {
           io->io_errno = errno;
           goto bail_out;
@@ -1550,8 +1841,21 @@ static bRC pluginIO(PluginContext* ctx, io_pkt* io)
       break;
     case IO_CLOSE:
       if (p_ctx->gfd) {
+        // A write behind that failed fails the close.
+        bool written = true;
+
+        if (p_ctx->async_io) {
+          written = p_ctx->async_io->Finish();
+          io->io_errno = errno;
+          delete p_ctx->async_io;
+          p_ctx->async_io = NULL;
+        }
         io->status = glfs_close(p_ctx->gfd);
         p_ctx->gfd = NULL;
+        if (!written) {
+          io->status = -1;
+          goto bail_out;
+        }
         if (io->status < 0) {
           io->io_errno = errno;
           goto bail_out;
@@ -1564,6 +1868,11 @@ static bRC pluginIO(PluginContext* ctx, io_pkt* io)
       break;
     case IO_SEEK:
       if (p_ctx->gfd) {
+        if (p_ctx->async_io && !p_ctx->async_io->Finish()) {
+          io->status = -1;
+          io->io_errno = errno;
+          goto bail_out;
+        }
         io->status = glfs_lseek(p_ctx->gfd, io->offset, io->whence);
         if (io->status < 0) {
           io->io_errno = errno;
@@ -0,0 +1,86 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+
+#ifndef BAREOS_PLUGINS_FILED_GRPC_BACKUP_BATCH_H_
+#define BAREOS_PLUGINS_FILED_GRPC_BACKUP_BATCH_H_
+
+#include "plugin.grpc.pb.h"
+#include "plugin.pb.h"
+
+/* Answers a startBackupFiles call with the unary calls of the service, in the
+ * order the core would make them.  Files without data are ended right away,
+ * together with their acl and xattributes if asked for.  The batch stops
+ * after the first file with data, once the plugin is done, or when it is
+ * full. */
+inline grpc::Status FillBackupBatch(
+    bareos::plugin::Plugin::Service& service,
+    grpc::ServerContext* ctx,
+    const bareos::plugin::startBackupFilesRequest& request,
+    bareos::plugin::startBackupFilesResponse& response)
+{
+  namespace bp = bareos::plugin;
+
+  while (static_cast<uint32_t>(response.files_size()) < request.max_files()) {
+    bp::backupFile* file = response.add_files();
+    grpc::Status status = service.startBackupFile(ctx, &request.request(),
+                                                  file->mutable_start());
+    if (!status.ok()) { return status; }
+
+    switch (file->start().result()) {
+      case bp::SBF_OK:
+        break;
+      case bp::SBF_Skip:
+        continue;
+      default:
+        return grpc::Status::OK;
+    }
+
+    if (file->start().has_file()) {
+      if (!file->start().file().no_read()) { return grpc::Status::OK; }
+
+      bp::getAclRequest acl_req;
+      acl_req.set_file(file->start().file().file());
+      if (request.with_acl()
+          && !service.getAcl(ctx, &acl_req, file->mutable_acl()).ok()) {
+        file->clear_acl();
+      }
+
+      bp::getXattrRequest xattr_req;
+      xattr_req.set_file(file->start().file().file());
+      if (request.with_xattributes()
+          && !service.getXattr(ctx, &xattr_req, file->mutable_xattributes())
+                  .ok()) {
+        file->clear_xattributes();
+      }
+    }
+
+    bp::endBackupFileRequest end_req;
+    bp::endBackupFileResponse end_resp;
+    status = service.endBackupFile(ctx, &end_req, &end_resp);
+    if (!status.ok()) { return status; }
+    file->set_end(end_resp.result());
+    if (end_resp.result() != bp::EBF_More) { break; }
+  }
+  return grpc::Status::OK;
+}
+
+#endif  // BAREOS_PLUGINS_FILED_GRPC_BACKUP_BATCH_H_
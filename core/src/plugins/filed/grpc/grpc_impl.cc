@@ -32,6 +32,7 @@
 #include <grpcpp/create_channel_posix.h>
 
 #include "plugins/filed/grpc/grpc_impl.h"
+#include "plugins/filed/grpc/shared_memory.h"
 #include <fcntl.h>
 #include <thread>
 #include <grpcpp/impl/codegen/channel_interface.h>
@@ -42,6 +43,7 @@
 #include <aio.h>
 
 #include <chrono>
+#include <deque>
 
 #include "bareos_api.h"
 
@@ -859,9 +861,12 @@ class PluginClient {
   {
   }
 
-  bRC Setup()
+  bRC Setup(size_t max_shared_memory_size, size_t* shared_memory_size)
   {
     bp::SetupRequest req;
+    req.set_max_shared_memory_size(max_shared_memory_size);
+    req.set_max_backup_batch_size(max_backup_batch_size);
+    req.set_max_file_attributes_batch_size(max_file_attributes_batch_size);
     bp::SetupResponse resp;
     grpc::ClientContext ctx;
 
@@ -869,11 +874,22 @@ class PluginClient {
 
     if (!status.ok()) { return bRC_Error; }
 
+    *shared_memory_size = resp.shared_memory_size();
+    backup_batch_size_
+        = std::min(resp.backup_batch_size(), max_backup_batch_size);
+    file_attributes_batch_size_ = std::min(resp.file_attributes_batch_size(),
+                                           max_file_attributes_batch_size);
+    DebugLog(100,
+             FMT_STRING("backup batches of {} files, attribute batches of {}"),
+             backup_batch_size_, file_attributes_batch_size_);
+
     return bRC_OK;
   }
 
   bRC handlePluginEvent(filedaemon::bEventType type, void* data)
   {
+    if (FlushFileAttributes() == bRC_Error) { return bRC_Error; }
+
     bp::handlePluginEventRequest req;
     auto* event = req.mutable_to_handle();
 
@@ -1065,6 +1081,10 @@ class PluginClient {
 
   bRC startBackupFile(filedaemon::save_pkt* pkt)
   {
+    batched_end_.reset();
+    batched_acl_.clear();
+    batched_xattributes_.clear();
+
     bp::startBackupFileRequest req;
     req.set_no_read(pkt->no_read);
     req.set_portable(pkt->portable);
@@ -1074,12 +1094,67 @@ class PluginClient {
     req.set_cmd(inner.data(), inner.size());
     req.set_flags(pkt->flags, sizeof(pkt->flags));
 
+    if (backup_batch_size_ > 0) {
+      if (backup_batch_.empty() && !FetchBackupBatch(req, *pkt)) {
+        return bRC_Error;
+      }
+      if (!backup_batch_.empty()) {
+        bp::backupFile file = std::move(backup_batch_.front());
+        backup_batch_.pop_front();
+        if (file.end() != bp::END_BACKUP_FILE_RESULT_UNSPECIFIED) {
+          batched_end_ = file.end();
+          batched_acl_ = std::move(*file.mutable_acl()->mutable_content()
+                                        ->mutable_data());
+          auto* xattributes
+              = file.mutable_xattributes()->mutable_attributes();
+          batched_xattributes_.assign(
+              std::make_move_iterator(xattributes->begin()),
+              std::make_move_iterator(xattributes->end()));
+        }
+        return ApplyStartBackupFile(file.start(), pkt);
+      }
+    }
+
     bp::startBackupFileResponse resp;
     grpc::ClientContext ctx;
     grpc::Status status = stub_->startBackupFile(&ctx, req, &resp);
 
     if (!status.ok()) { return bRC_Error; }
 
+    return ApplyStartBackupFile(resp, pkt);
+  }
+
+  // fills the batch with the files following the current one
+  bool FetchBackupBatch(const bp::startBackupFileRequest& file_req,
+                        const filedaemon::save_pkt& pkt)
+  {
+    bp::startBackupFilesRequest req;
+    *req.mutable_request() = file_req;
+    req.set_max_files(backup_batch_size_);
+    req.set_with_acl(BitIsSet(FO_ACL, pkt.flags));
+    req.set_with_xattributes(BitIsSet(FO_XATTR, pkt.flags));
+
+    bp::startBackupFilesResponse resp;
+    grpc::ClientContext ctx;
+    grpc::Status status = stub_->startBackupFiles(&ctx, req, &resp);
+
+    if (!status.ok()) {
+      DebugLog(50, FMT_STRING("rpc did not succeed for startBackupFiles ({}): "
+                              "Err={}"),
+               int(status.error_code()), status.error_message());
+      return false;
+    }
+
+    DebugLog(100, FMT_STRING("received a batch of {} files"),
+             resp.files_size());
+    backup_batch_.assign(std::make_move_iterator(resp.mutable_files()->begin()),
+                         std::make_move_iterator(resp.mutable_files()->end()));
+    return true;
+  }
+
+  bRC ApplyStartBackupFile(const bp::startBackupFileResponse& resp,
+                           filedaemon::save_pkt* pkt)
+  {
     switch (resp.result()) {
       case bareos::plugin::SBF_OK: {
         if (resp.has_file()) {
@@ -1243,13 +1318,18 @@ class PluginClient {
 
   bRC endBackupFile()
   {
-    bp::endBackupFileRequest req;
-
     bp::endBackupFileResponse resp;
-    grpc::ClientContext ctx;
-    grpc::Status status = stub_->endBackupFile(&ctx, req, &resp);
+    if (batched_end_) {
+      // the plugin already ended this file in the batch
+      resp.set_result(*batched_end_);
+      batched_end_.reset();
+    } else {
+      bp::endBackupFileRequest req;
+      grpc::ClientContext ctx;
+      grpc::Status status = stub_->endBackupFile(&ctx, req, &resp);
 
-    if (!status.ok()) { return bRC_Error; }
+      if (!status.ok()) { return bRC_Error; }
+    }
 
     switch (resp.result()) {
       case bareos::plugin::EBF_Done:
@@ -1360,11 +1440,12 @@ class PluginClient {
       reader = stub->FileRead(&ctx, req);
     }
 
-    bool next(size_t* size)
+    bool next(size_t* size, bool* in_shared_memory)
     {
       bp::fileReadResponse resp;
       if (!reader->Read(&resp)) { return false; }
       *size = resp.size();
+      *in_shared_memory = resp.in_shared_memory();
       return true;
     }
 
@@ -1382,10 +1463,11 @@ class PluginClient {
 
   read_iter FileRead(size_t size) { return read_iter{stub_.get(), size, core}; }
 
-  bRC FileWrite(size_t size, size_t* num_bytes_written)
+  bRC FileWrite(size_t size, size_t* num_bytes_written, bool in_shared_memory)
   {
     bp::fileWriteRequest req;
     req.set_bytes_written(size);
+    req.set_in_shared_memory(in_shared_memory);
 
     bp::fileWriteResponse resp;
     grpc::ClientContext ctx;
@@ -1546,6 +1628,16 @@ class PluginClient {
                                 extended_attributes.size());
     req.set_where(where.data(), where.size());
 
+    if (file_attributes_batch_size_ > 0) {
+      *pending_attributes_.add_files() = std::move(req);
+      *do_in_core = false;
+      if (static_cast<uint32_t>(pending_attributes_.files_size())
+          < file_attributes_batch_size_) {
+        return bRC_OK;
+      }
+      return FlushFileAttributes();
+    }
+
     bp::setFileAttributesResponse resp;
     grpc::ClientContext ctx;
     grpc::Status status = stub_->setFileAttributes(&ctx, req, &resp);
@@ -1556,8 +1648,33 @@ class PluginClient {
 
     return bRC_OK;
   }
+
+  /* Sends the attributes collected for setFileAttributesBatch.  This is done
+   * before anything else that could depend on them, e.g. an acl. */
+  bRC FlushFileAttributes()
+  {
+    if (pending_attributes_.files_size() == 0) { return bRC_OK; }
+
+    bp::setFileAttributesBatchResponse resp;
+    grpc::ClientContext ctx;
+    grpc::Status status
+        = stub_->setFileAttributesBatch(&ctx, pending_attributes_, &resp);
+    int count = pending_attributes_.files_size();
+    pending_attributes_.Clear();
+
+    if (!status.ok()) {
+      ::JobLog(core, M_ERROR,
+               FMT_STRING("could not set the attributes of {} files: Err={}"),
+               count, status.error_message());
+      return bRC_Error;
+    }
+
+    return bRC_OK;
+  }
   bRC checkFile(std::string_view name)
   {
+    if (FlushFileAttributes() == bRC_Error) { return bRC_Error; }
+
     bp::checkFileRequest req;
     req.set_file(name.data(), name.size());
     bp::checkFileResponse resp;
@@ -1573,6 +1690,8 @@ class PluginClient {
 
   bRC setAcl(std::string_view file, std::string_view content)
   {
+    if (FlushFileAttributes() == bRC_Error) { return bRC_Error; }
+
     bp::setAclRequest req;
     req.set_file(file.data(), file.size());
     req.mutable_content()->set_data(content.data(), content.size());
@@ -1588,18 +1707,23 @@ class PluginClient {
 
   bRC getAcl(std::string_view file, char** buffer, size_t* size)
   {
-    bp::getAclRequest req;
-    req.set_file(file.data(), file.size());
-
     bp::getAclResponse resp;
-    grpc::ClientContext ctx;
-    grpc::Status status = stub_->getAcl(&ctx, req, &resp);
+    if (batched_end_) {
+      // sent with the batch
+      resp.mutable_content()->set_data(std::move(batched_acl_));
+    } else {
+      bp::getAclRequest req;
+      req.set_file(file.data(), file.size());
 
-    if (!status.ok()) {
-      DebugLog(50,
-               FMT_STRING("rpc did not succeed for event getAcl ({}): Err={}"),
-               int(status.error_code()), status.error_message());
-      return bRC_Error;
+      grpc::ClientContext ctx;
+      grpc::Status status = stub_->getAcl(&ctx, req, &resp);
+
+      if (!status.ok()) {
+        DebugLog(
+            50, FMT_STRING("rpc did not succeed for event getAcl ({}): Err={}"),
+            int(status.error_code()), status.error_message());
+        return bRC_Error;
+      }
     }
 
     auto& data = resp.content().data();
@@ -1615,6 +1739,8 @@ class PluginClient {
                std::string_view key,
                std::string_view value)
   {
+    if (FlushFileAttributes() == bRC_Error) { return bRC_Error; }
+
     bp::setXattrRequest req;
     req.set_file(file.data(), file.size());
     auto* xattr = req.mutable_attribute();
@@ -1639,7 +1765,13 @@ class PluginClient {
     // The idea here is that we grab all xattributes at once
     // and then trickle them out for each call
 
-    if (current_xattr_index == std::numeric_limits<size_t>::max()) {
+    if (current_xattr_index == std::numeric_limits<size_t>::max()
+        && batched_end_) {
+      // sent with the batch
+      xattribute_cache = std::move(batched_xattributes_);
+      batched_xattributes_.clear();
+      current_xattr_index = 0;
+    } else if (current_xattr_index == std::numeric_limits<size_t>::max()) {
       // we need to grab them now
       bp::getXattrRequest req;
       req.set_file(file.data(), file.size());
@@ -1690,6 +1822,19 @@ class PluginClient {
   size_t current_xattr_index{std::numeric_limits<size_t>::max()};
   std::vector<bp::Xattribute> xattribute_cache{};
 
+  static constexpr uint32_t max_backup_batch_size = 1024;
+  static constexpr uint32_t max_file_attributes_batch_size = 1024;
+
+  uint32_t backup_batch_size_{0};
+  std::deque<bp::backupFile> backup_batch_{};
+  // end result, acl and xattributes of a file the batch already ended
+  std::optional<bp::EndBackupFileResult> batched_end_{};
+  std::string batched_acl_{};
+  std::vector<bp::Xattribute> batched_xattributes_{};
+
+  uint32_t file_attributes_batch_size_{0};
+  bp::setFileAttributesBatchRequest pending_attributes_{};
+
   template <typename... Args>
   void DebugLog(Severity severity,
                 fmt::format_string<Args...> fmt,
@@ -1706,6 +1851,7 @@ struct grpc_connection_members {
   std::vector<std::unique_ptr<grpc::Service>> services;
   std::shared_ptr<grpc::Channel> channel;
   std::unique_ptr<grpc::Server> server;
+  std::optional<shared_memory> shm{};
 
   grpc_connection_members() = delete;
 };
@@ -2129,7 +2275,7 @@ struct grpc_connection_builder {
 
     DebugLog(100, FMT_STRING("a connection for me.  Finishing setup..."));
 
-    if (con->Setup() == bRC_Error) {
+    if (con->Setup(parent_io.grpc_io.get()) == bRC_Error) {
       DebugLog(100, FMT_STRING("... unsuccessfully."));
       return std::nullopt;
     }
@@ -2382,9 +2528,28 @@ bRC grpc_connection::pluginIO(filedaemon::io_pkt* pkt, int iosock)
 
       size_t bytes_read = 0;
       size_t current = 0;
-      while (iter.next(&current)) {
+      bool in_shared_memory = false;
+      bool shared_memory_used = false;
+      while (iter.next(&current, &in_shared_memory)) {
         DebugLog(100, FMT_STRING("received {} bytes"), current);
-        if (!full_read(iosock, pkt->buf + bytes_read, current)) {
+        if (shared_memory_used) {
+          JobLog(nullptr, M_FATAL,
+                 FMT_STRING("plugin sent data after its shared memory chunk"));
+          return bRC_Error;
+        }
+        if (in_shared_memory) {
+          const auto& shm = members->shm;
+          if (!shm || current > shm->size()
+              || bytes_read + current > (size_t)pkt->count) {
+            JobLog(nullptr, M_FATAL,
+                   FMT_STRING("plugin sent bad shared memory chunk of {} "
+                              "bytes ({} were already read)"),
+                   current, bytes_read);
+            return bRC_Error;
+          }
+          memcpy(pkt->buf + bytes_read, shm->data(), current);
+          shared_memory_used = true;
+        } else if (!full_read(iosock, pkt->buf + bytes_read, current)) {
           JobLog(nullptr, M_FATAL,
                  FMT_STRING("could not read additional {} bytes from socket "
                             "({} were already read): Err={}"),
@@ -2412,6 +2577,19 @@ bRC grpc_connection::pluginIO(filedaemon::io_pkt* pkt, int iosock)
       return bRC_OK;
     } break;
     case filedaemon::IO_WRITE: {
+      if (const auto& shm = members->shm;
+          shm && (size_t)pkt->count <= shm->size()) {
+        DebugLog(100, FMT_STRING("writing {} bytes into shared memory"),
+                 pkt->count);
+        memcpy(shm->data(), pkt->buf, pkt->count);
+
+        size_t bytes_written = 0;
+        auto res = client->FileWrite(pkt->count, &bytes_written, true);
+        if (res == bRC_Error) { return res; }
+        pkt->status = bytes_written;
+        return res;
+      }
+
       DebugLog(100, FMT_STRING("writing {} bytes into socket"), pkt->count);
 
 
@@ -2427,7 +2605,7 @@ bRC grpc_connection::pluginIO(filedaemon::io_pkt* pkt, int iosock)
       }
 
       size_t bytes_written = 0;
-      auto res = client->FileWrite(pkt->count, &bytes_written);
+      auto res = client->FileWrite(pkt->count, &bytes_written, false);
       if (res == bRC_Error) {
         aio_cancel(control.aio_fildes, &control);
         return res;
@@ -2509,10 +2687,42 @@ bRC grpc_connection::setFileAttributes(filedaemon::restore_pkt* pkt)
 
   return res;
 }
-bRC grpc_connection::Setup()
+// file data chunks are at most as large as the socket buffers of the core
+static constexpr size_t max_shared_memory_size = 4 * 1024 * 1024;
+
+bRC grpc_connection::Setup(int io_socket)
 {
   PluginClient* client = &members->client;
-  return client->Setup();
+
+  size_t shared_memory_size = 0;
+  if (client->Setup(max_shared_memory_size, &shared_memory_size) == bRC_Error) {
+    return bRC_Error;
+  }
+  if (shared_memory_size == 0) {
+    DebugLog(100, FMT_STRING("plugin does not use shared memory"));
+    return bRC_OK;
+  }
+
+  std::optional fd = receive_fd(io_socket, -1);
+  if (!fd) {
+    JobLog(nullptr, M_FATAL,
+           FMT_STRING("plugin wanted to use shared memory, but did not send "
+                      "an fd: Err={}"),
+           strerror(errno));
+    return bRC_Error;
+  }
+
+  members->shm = shared_memory::map(*fd);
+  if (!members->shm || members->shm->size() < shared_memory_size) {
+    JobLog(nullptr, M_FATAL,
+           FMT_STRING("could not map shared memory of {} bytes: Err={}"),
+           shared_memory_size, strerror(errno));
+    return bRC_Error;
+  }
+
+  DebugLog(100, FMT_STRING("using {} bytes of shared memory"),
+           members->shm->size());
+  return bRC_OK;
 }
 bRC grpc_connection::checkFile(const char* fname)
 {
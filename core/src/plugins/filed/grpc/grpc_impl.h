@@ -106,7 +106,8 @@ struct grpc_connection_members;
 
 class grpc_connection {
  public:
-  bRC Setup();
+  // the io socket is used to receive the shared memory of the plugin
+  bRC Setup(int io_socket);
 
   bRC handlePluginEvent(filedaemon::bEventType type, void* data);
 
@@ -25,6 +25,7 @@
 #include "bareos.pb.h"
 #include "common.pb.h"
 #include "plugin.pb.h"
+#include "backup_batch.h"
 #include "test_module.h"
 
 #include <sys/sendfile.h>
@@ -39,10 +40,57 @@
 #pragma GCC diagnostic ignored "-Wunused-parameter"
 #pragma GCC diagnostic ignored "-Wunused-variable"
 
+static bool send_fd(int unix_socket, int fd)
+{
+  struct msghdr msg = {};
+  char buf[CMSG_SPACE(sizeof(fd))] = {};
+  char name_buf[sizeof(fd)];
+  memcpy(name_buf, &fd, sizeof(fd));
+  iovec io = {.iov_base = name_buf, .iov_len = sizeof(name_buf)};
+
+  msg.msg_iov = &io;
+  msg.msg_iovlen = 1;
+  msg.msg_control = buf;
+  msg.msg_controllen = sizeof(buf);
+
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fd));
+
+  memcpy(CMSG_DATA(cmsg), &fd, sizeof(fd));
+
+  msg.msg_controllen = CMSG_SPACE(sizeof(fd));
+
+  if (sendmsg(unix_socket, &msg, MSG_NOSIGNAL) < 0) {
+    DebugLog(50, FMT_STRING("could not send fd {}. Err={}"), fd,
+             strerror(errno));
+    return false;
+  }
+
+  return true;
+}
+
 auto PluginService::Setup(ServerContext*,
-                          const bp::SetupRequest*,
-                          bp::SetupResponse*) -> Status
+                          const bp::SetupRequest* request,
+                          bp::SetupResponse* response) -> Status
 {
+  if (auto size = std::min<uint64_t>(request->max_shared_memory_size(),
+                                     shared_memory_size);
+      size > 0) {
+    if (auto region = shared_memory::create(size);
+        region && send_fd(io, region->fd())) {
+      DebugLog(100, FMT_STRING("sent {} bytes of shared memory"), size);
+      response->set_shared_memory_size(size);
+      shm = std::move(region);
+    } else {
+      DebugLog(50, FMT_STRING("not using shared memory: Err={}"),
+               strerror(errno));
+    }
+  }
+  response->set_backup_batch_size(
+      std::min(request->max_backup_batch_size(), backup_batch_size));
+
   auto events = std::array{
       bc::EventType::Event_JobStart,       bc::EventType::Event_JobEnd,
       bc::EventType::Event_PluginCommand,  bc::EventType::Event_BackupCommand,
@@ -343,6 +391,13 @@ auto PluginService::endBackupFile(ServerContext*,
   //                 "No file is currently open!");
   // }
 }
+auto PluginService::startBackupFiles(ServerContext* context,
+                                     const bp::startBackupFilesRequest* request,
+                                     bp::startBackupFilesResponse* response)
+    -> Status
+{
+  return FillBackupBatch(*this, context, *request, *response);
+}
 auto PluginService::startRestoreFile(ServerContext*,
                                      const bp::startRestoreFileRequest* request,
                                      bp::startRestoreFileResponse* response)
@@ -545,6 +600,24 @@ auto PluginService::FileRead(ServerContext* ctx,
   DebugLog(100, FMT_STRING("reading from file {} in {} chunks"),
            current_file->get(), max_size);
 
+  if (shm) {
+    auto res = read(current_file->get(), shm->data(),
+                    std::min<uint64_t>(max_size, shm->size()));
+    if (res < 0) {
+      JobLog(bareos::core::JMsgType::JMSG_FATAL,
+             FMT_STRING("Could not read chunk from {}: Err={}"),
+             current_file->get(), strerror(errno));
+      return grpc::Status(grpc::StatusCode::INTERNAL,
+                          "Error while reading file");
+    }
+    bp::fileReadResponse resp;
+    resp.set_size(res);
+    resp.set_in_shared_memory(true);
+    writer->Write(resp);
+
+    return Status::OK;
+  }
+
   auto res = sendfile(io, current_file->get(), nullptr, max_size);
 
   if (res < 0) {
@@ -573,6 +646,22 @@ auto PluginService::FileWrite(ServerContext*,
 
   auto num_bytes = request->bytes_written();
 
+  if (request->in_shared_memory()) {
+    if (!shm || num_bytes > shm->size()) {
+      return Status(grpc::StatusCode::INVALID_ARGUMENT,
+                    "data does not fit into the shared memory");
+    }
+    if (!full_write(current_file->get(), shm->data(), num_bytes)) {
+      JobLog(bareos::core::JMsgType::JMSG_FATAL,
+             FMT_STRING("Could not write {} bytes to {}: Err={}"), num_bytes,
+             current_file->get(), strerror(errno));
+      return grpc::Status(grpc::StatusCode::INTERNAL,
+                          "Error while writing chunk");
+    }
+    response->set_bytes_written(num_bytes);
+    return Status::OK;
+  }
+
   auto togo = num_bytes;
 
   std::vector<char> buffer;
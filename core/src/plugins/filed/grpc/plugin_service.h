@@ -27,6 +27,7 @@
 #include <optional>
 #include "plugin.grpc.pb.h"
 #include "plugin.pb.h"
+#include "shared_memory.h"
 
 namespace bp = bareos::plugin;
 
@@ -84,6 +85,9 @@ class PluginService : public bp::Plugin::Service {
   Status endBackupFile(ServerContext*,
                        const bp::endBackupFileRequest* request,
                        bp::endBackupFileResponse* response) override;
+  Status startBackupFiles(ServerContext*,
+                          const bp::startBackupFilesRequest* request,
+                          bp::startBackupFilesResponse* response) override;
   Status startRestoreFile(ServerContext*,
                           const bp::startRestoreFileRequest* request,
                           bp::startRestoreFileResponse* response) override;
@@ -150,6 +154,13 @@ class PluginService : public bp::Plugin::Service {
   std::vector<prepared_file> files_to_backup{};
   std::optional<raii_fd> current_file{};
 
+  // the largest file data chunk the plugin places into shared memory
+  static constexpr uint64_t shared_memory_size = 1024 * 1024;
+  std::optional<shared_memory> shm{};
+
+  // the most files answered with a single startBackupFiles call
+  static constexpr uint32_t backup_batch_size = 256;
+
   int io;
   std::promise<void> shutdown;
 };
@@ -28,6 +28,7 @@
 #include "filed/fd_plugins.h"
 #include "include/filetypes.h"
 #include "plugin.pb.h"
+#include "backup_batch.h"
 #include "test_module_python.h"
 
 #include <sys/sendfile.h>
@@ -152,8 +153,8 @@ bool send_fd(int unix_socket, int fd)
 #pragma GCC diagnostic ignored "-Wunused-variable"
 
 auto PluginService::Setup(ServerContext*,
-                          const bp::SetupRequest*,
-                          bp::SetupResponse*) -> Status
+                          const bp::SetupRequest* request,
+                          bp::SetupResponse* response) -> Status
 {
   auto events = std::array{
       bc::EventType::Event_JobStart,       bc::EventType::Event_JobEnd,
@@ -174,6 +175,22 @@ auto PluginService::Setup(ServerContext*,
     return grpc::Status(grpc::StatusCode::INTERNAL,
                         "newPlugin returned bad value");
   }
+
+  if (auto size = std::min<uint64_t>(request->max_shared_memory_size(),
+                                     shared_memory_size);
+      size > 0) {
+    if (auto region = shared_memory::create(size);
+        region && send_fd(io, region->fd())) {
+      DebugLog(100, FMT_STRING("sent {} bytes of shared memory"), size);
+      response->set_shared_memory_size(size);
+      shm = std::move(region);
+    } else {
+      DebugLog(50, FMT_STRING("not using shared memory: Err={}"),
+               strerror(errno));
+    }
+  }
+  response->set_backup_batch_size(
+      std::min(request->max_backup_batch_size(), backup_batch_size));
   return Status::OK;
 }
 
@@ -770,6 +787,13 @@ auto PluginService::endBackupFile(ServerContext*,
 
   return Status::OK;
 }
+auto PluginService::startBackupFiles(ServerContext* context,
+                                     const bp::startBackupFilesRequest* request,
+                                     bp::startBackupFilesResponse* response)
+    -> Status
+{
+  return FillBackupBatch(*this, context, *request, *response);
+}
 auto PluginService::startRestoreFile(ServerContext*,
                                      const bp::startRestoreFileRequest* request,
                                      bp::startRestoreFileResponse*) -> Status
@@ -895,8 +919,14 @@ auto PluginService::FileRead(ServerContext*,
 {
   filedaemon::io_pkt pkt;
   pkt.func = filedaemon::IO_READ;
-  pkt.count = request->num_bytes();
-  pkt.buf = buffer(request->num_bytes());
+  if (shm) {
+    // the plugin reads straight into the shared memory
+    pkt.count = std::min<uint64_t>(request->num_bytes(), shm->size());
+    pkt.buf = shm->data();
+  } else {
+    pkt.count = request->num_bytes();
+    pkt.buf = buffer(request->num_bytes());
+  }
 
   auto res = funcs.pluginIO(ctx, &pkt);
 
@@ -904,6 +934,17 @@ auto PluginService::FileRead(ServerContext*,
     return Status(grpc::StatusCode::INTERNAL, "bad response");
   }
 
+  if (shm) {
+    if (pkt.status < 0 || pkt.status > pkt.count) {
+      return Status(grpc::StatusCode::INTERNAL, "bad read size");
+    }
+    bp::fileReadResponse resp;
+    resp.set_size(pkt.status);
+    resp.set_in_shared_memory(true);
+    writer->Write(resp);
+    return Status::OK;
+  }
+
   auto _ = non_blocking{io};
 
   if (_.error()) {
@@ -967,10 +1008,20 @@ auto PluginService::FileWrite(ServerContext*,
   filedaemon::io_pkt pkt;
   pkt.func = filedaemon::IO_WRITE;
   pkt.count = request->bytes_written();
-  pkt.buf = buffer(request->bytes_written());
 
-  if (!full_read(io, pkt.buf, pkt.count)) {
-    return Status(grpc::StatusCode::INTERNAL, "io socket read not successful");
+  if (request->in_shared_memory()) {
+    if (!shm || request->bytes_written() > shm->size()) {
+      return Status(grpc::StatusCode::INVALID_ARGUMENT,
+                    "data does not fit into the shared memory");
+    }
+    pkt.buf = shm->data();
+  } else {
+    pkt.buf = buffer(request->bytes_written());
+
+    if (!full_read(io, pkt.buf, pkt.count)) {
+      return Status(grpc::StatusCode::INTERNAL,
+                    "io socket read not successful");
+    }
   }
 
   auto res = funcs.pluginIO(ctx, &pkt);
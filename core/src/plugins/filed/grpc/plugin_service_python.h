@@ -27,6 +27,7 @@
 #include <optional>
 #include "plugin.grpc.pb.h"
 #include "plugin.pb.h"
+#include "shared_memory.h"
 
 #include "filed/fd_plugins.h"
 
@@ -93,6 +94,9 @@ class PluginService : public bp::Plugin::Service {
   Status endBackupFile(ServerContext*,
                        const bp::endBackupFileRequest* request,
                        bp::endBackupFileResponse* response) override;
+  Status startBackupFiles(ServerContext*,
+                          const bp::startBackupFilesRequest* request,
+                          bp::startBackupFilesResponse* response) override;
   Status startRestoreFile(ServerContext*,
                           const bp::startRestoreFileRequest* request,
                           bp::startRestoreFileResponse* response) override;
@@ -142,6 +146,13 @@ class PluginService : public bp::Plugin::Service {
 
   std::promise<void> shutdown;
 
+  // the largest file data chunk the plugin places into shared memory
+  static constexpr uint64_t shared_memory_size = 1024 * 1024;
+  std::optional<shared_memory> shm{};
+
+  // the most files answered with a single startBackupFiles call
+  static constexpr uint32_t backup_batch_size = 256;
+
   std::vector<char> vec;
 
   char* buffer(size_t size)
@@ -0,0 +1,106 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#ifndef BAREOS_PLUGINS_FILED_GRPC_SHARED_MEMORY_H_
+#define BAREOS_PLUGINS_FILED_GRPC_SHARED_MEMORY_H_
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <optional>
+#include <utility>
+
+/* A memory region shared between the core and the plugin for the file data.
+ * The plugin creates it and sends its fd over the io socket, the core maps
+ * it.  Data that is placed into it is announced with the in_shared_memory
+ * fields of the file read/write messages and always starts at its
+ * beginning, so there is only ever one chunk in flight. */
+class shared_memory {
+ public:
+  shared_memory(const shared_memory&) = delete;
+  shared_memory& operator=(const shared_memory&) = delete;
+  shared_memory(shared_memory&& other) { *this = std::move(other); }
+  shared_memory& operator=(shared_memory&& other)
+  {
+    std::swap(fd_, other.fd_);
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    return *this;
+  }
+
+  ~shared_memory()
+  {
+    if (data_) { munmap(data_, size_); }
+    if (fd_ >= 0) { close(fd_); }
+  }
+
+  static std::optional<shared_memory> create(std::size_t size)
+  {
+#if defined(__linux__)
+    int fd = memfd_create("bareos-grpc-io", MFD_CLOEXEC);
+    if (fd < 0) { return std::nullopt; }
+    if (ftruncate(fd, size) < 0) {
+      close(fd);
+      return std::nullopt;
+    }
+    return map(fd);
+#else
+    (void)size;
+    return std::nullopt;
+#endif
+  }
+
+  // takes ownership of fd
+  static std::optional<shared_memory> map(int fd)
+  {
+    struct stat s;
+    if (fstat(fd, &s) < 0 || s.st_size <= 0) {
+      close(fd);
+      return std::nullopt;
+    }
+    void* data = mmap(nullptr, s.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      fd, 0);
+    if (data == MAP_FAILED) {
+      close(fd);
+      return std::nullopt;
+    }
+    return shared_memory{fd, static_cast<char*>(data),
+                         static_cast<std::size_t>(s.st_size)};
+  }
+
+  int fd() const { return fd_; }
+  char* data() const { return data_; }
+  std::size_t size() const { return size_; }
+
+ private:
+  shared_memory(int fd, char* data, std::size_t size)
+      : fd_{fd}, data_{data}, size_{size}
+  {
+  }
+
+  int fd_{-1};
+  char* data_{nullptr};
+  std::size_t size_{0};
+};
+
+#endif  // BAREOS_PLUGINS_FILED_GRPC_SHARED_MEMORY_H_
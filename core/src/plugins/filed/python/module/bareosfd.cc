@@ -531,17 +531,20 @@ static inline PyIoPacket* NativeToPyIoPacket(io_pkt* io)
     pIoPkt->whence = io->whence;
     pIoPkt->offset = io->offset;
     pIoPkt->filedes = io->filedes;
-
-    if (io->func == IO_WRITE && io->count > 0) {
-      /* Only initialize the buffer with read data when we are writing and
-       * there is data.*/
-      pIoPkt->buf = PyByteArray_FromStringAndSize(io->buf, io->count);
-      if (!pIoPkt->buf) {
+    pIoPkt->stream = io->stream;
+
+    /* The plugin reads into or writes from the core buffer directly via
+     * buffer, buf is only created when the plugin asks for it. */
+    pIoPkt->buf = NULL;
+    pIoPkt->buffer = NULL;
+    pIoPkt->io = io;
+    if ((io->func == IO_READ || io->func == IO_WRITE) && io->count > 0) {
+      pIoPkt->buffer = PyMemoryView_FromMemory(
+          io->buf, io->count, io->func == IO_READ ? PyBUF_WRITE : PyBUF_READ);
+      if (!pIoPkt->buffer) {
         Py_DECREF((PyObject*)pIoPkt);
         return (PyIoPacket*)NULL;
       }
-    } else {
-      pIoPkt->buf = NULL;
     }
     /* These must be set by the Python function but we initialize them to zero
      * to be sure they have some valid setting an not random data.  */
@@ -564,22 +567,21 @@ static inline bool PyIoPacketToNative(PyIoPacket* pIoPkt, io_pkt* io)
   io->filedes = pIoPkt->filedes;
 
   if (io->func == IO_READ && io->status > 0) {
-    // Only copy back the data when doing a read and there is data.
+    if (io->status > io->count) { return false; }
+
+    /* Only copy back the data when doing a read and there is data.  Without
+     * a buf the plugin read into buffer. */
     if (PyByteArray_Check(pIoPkt->buf)) {
       char* buf;
 
-      if (PyByteArray_Size(pIoPkt->buf) > io->count || io->status > io->count) {
-        return false;
-      }
+      if (PyByteArray_Size(pIoPkt->buf) > io->count) { return false; }
 
       if (!(buf = PyByteArray_AsString(pIoPkt->buf))) { return false; }
       memcpy(io->buf, buf, io->status);
     } else if (PyBytes_Check(pIoPkt->buf)) {
       char* buf;
 
-      if (PyBytes_Size(pIoPkt->buf) > io->count || io->status > io->count) {
-        return false;
-      }
+      if (PyBytes_Size(pIoPkt->buf) > io->count) { return false; }
 
       if (!(buf = PyBytes_AsString(pIoPkt->buf))) { return false; }
       memcpy(io->buf, buf, io->status);
@@ -589,6 +591,23 @@ static inline bool PyIoPacketToNative(PyIoPacket* pIoPkt, io_pkt* io)
   return true;
 }
 
+/* The core buffer is reused after plugin_io() returned, so the memoryview
+ * of it has to end here even if the plugin kept a reference. */
+static inline void ReleaseIoPacketBuffer(PyIoPacket* pIoPkt)
+{
+  pIoPkt->io = NULL;
+  if (!pIoPkt->buffer) { return; }
+
+  PyObject* pRetVal = PyObject_CallMethod(pIoPkt->buffer, "release", NULL);
+  if (pRetVal) {
+    Py_DECREF(pRetVal);
+  } else {
+    // still exported, e.g. by a memoryview of the memoryview
+    PyErr_Clear();
+  }
+  Py_CLEAR(pIoPkt->buffer);
+}
+
 /**
  * Do actual I/O. Bareos calls this after startBackupFile
  * or after startRestoreFile to do the actual file
@@ -613,6 +632,7 @@ static bRC PyPluginIO(PluginContext* plugin_ctx, io_pkt* io)
 
     pRetVal = PyObject_CallFunctionObjArgs(pFunc, (PyObject*)pIoPkt, NULL);
     if (!pRetVal) {
+      ReleaseIoPacketBuffer(pIoPkt);
       Py_DECREF((PyObject*)pIoPkt);
       goto bail_out;
     } else {
@@ -620,10 +640,12 @@ static bRC PyPluginIO(PluginContext* plugin_ctx, io_pkt* io)
       Py_DECREF(pRetVal);
 
       if (!PyIoPacketToNative(pIoPkt, io)) {
+        ReleaseIoPacketBuffer(pIoPkt);
         Py_DECREF((PyObject*)pIoPkt);
         goto bail_out;
       }
     }
+    ReleaseIoPacketBuffer(pIoPkt);
     Py_DECREF((PyObject*)pIoPkt);
   } else {
     Dmsg(plugin_ctx, debuglevel,
@@ -1393,6 +1415,13 @@ static PyObject* PyBareosSetValue(PyObject*, PyObject* args)
       }
       break;
     }
+    case bVarBackupStreams: {
+      int value = PyLong_AsLong(pyValue);
+      if (!PyErr_Occurred()) {
+        retval = bareos_core_functions->setBareosValue(plugin_ctx, var, &value);
+      }
+      break;
+    }
     default:
       Dmsg(plugin_ctx, debuglevel,
            LOGPREFIX "PyBareosSetValue unknown variable requested %d\n", var);
@@ -2204,6 +2233,9 @@ static int PyIoPacket_init(PyIoPacket* self, PyObject* args, PyObject* kwds)
   self->offset = 0;
   self->win32 = false;
   self->filedes = kInvalidFiledescriptor;
+  self->stream = 0;
+  self->buffer = NULL;
+  self->io = NULL;
 
   if (!PyArg_ParseTupleAndKeywords(
           args, kwds, "|Hiiiosiiiilci", kwlist, &self->func, &self->count,
@@ -2220,9 +2252,93 @@ static int PyIoPacket_init(PyIoPacket* self, PyObject* args, PyObject* kwds)
 static void PyIoPacket_dealloc(PyIoPacket* self)
 {
   if (self->buf) { Py_XDECREF(self->buf); }
+  Py_XDECREF(self->buffer);
   PyObject_Del(self);
 }
 
+// Creates buf from the core buffer the first time it is used when writing.
+static PyObject* PyIoPacket_get_buf(PyIoPacket* self, void*)
+{
+  if (!self->buf && self->io && self->io->func == IO_WRITE
+      && self->io->count > 0) {
+    self->buf = PyByteArray_FromStringAndSize(self->io->buf, self->io->count);
+    if (!self->buf) { return NULL; }
+  }
+
+  if (!self->buf) { Py_RETURN_NONE; }
+  Py_INCREF(self->buf);
+  return self->buf;
+}
+
+static int PyIoPacket_set_buf(PyIoPacket* self, PyObject* value, void*)
+{
+  PyObject* old = self->buf;
+  Py_XINCREF(value);
+  self->buf = value;
+  Py_XDECREF(old);
+  return 0;
+}
+
+// Reads into the core buffer with the GIL released.
+static PyObject* PyIoPacket_ReadFrom(PyIoPacket* self, PyObject* args)
+{
+  int fd;
+  if (!PyArg_ParseTuple(args, "i:read_from", &fd)) { return NULL; }
+  if (!self->io || self->io->func != IO_READ) {
+    PyErr_SetString(PyExc_RuntimeError,
+                    "read_from() only works while plugin_io() reads");
+    return NULL;
+  }
+
+  char* buf = self->io->buf;
+  int32_t count = self->io->count;
+  ssize_t status;
+  int error = 0;
+  Py_BEGIN_ALLOW_THREADS;
+  do {
+    status = read(fd, buf, count);
+  } while (status < 0 && errno == EINTR);
+  if (status < 0) { error = errno; }
+  Py_END_ALLOW_THREADS;
+
+  self->status = status;
+  self->io_errno = error;
+  return PyLong_FromSsize_t(status);
+}
+
+// Writes the core buffer with the GIL released.
+static PyObject* PyIoPacket_WriteTo(PyIoPacket* self, PyObject* args)
+{
+  int fd;
+  if (!PyArg_ParseTuple(args, "i:write_to", &fd)) { return NULL; }
+  if (!self->io || self->io->func != IO_WRITE) {
+    PyErr_SetString(PyExc_RuntimeError,
+                    "write_to() only works while plugin_io() writes");
+    return NULL;
+  }
+
+  const char* buf = self->io->buf;
+  int32_t count = self->io->count;
+  ssize_t status = 0;
+  int error = 0;
+  Py_BEGIN_ALLOW_THREADS;
+  while (status < count) {
+    ssize_t written = write(fd, buf + status, count - status);
+    if (written < 0) {
+      if (errno == EINTR) { continue; }
+      error = errno;
+      status = -1;
+      break;
+    }
+    status += written;
+  }
+  Py_END_ALLOW_THREADS;
+
+  self->status = status;
+  self->io_errno = error;
+  return PyLong_FromSsize_t(status);
+}
+
 // Python specific handlers for PyAclPacket structure mapping.
 
 // Representation.
@@ -364,14 +364,33 @@ typedef struct {
   int64_t offset;              /* Lseek argument */
   bool win32;                  /* Win32 GetLastError returned */
   int filedes;                 /* filedescriptor for read/write in core */
+  int32_t stream;              /* backup stream, see bVarBackupStreams */
+  PyObject* buffer;            /* memoryview of the core buffer */
+  io_pkt* io;                  /* core packet during plugin_io() */
 } PyIoPacket;
 
 // Forward declarations of type specific functions.
 static void PyIoPacket_dealloc(PyIoPacket* self);
 static int PyIoPacket_init(PyIoPacket* self, PyObject* args, PyObject* kwds);
 static PyObject* PyIoPacket_repr(PyIoPacket* self);
+static PyObject* PyIoPacket_get_buf(PyIoPacket* self, void* closure);
+static int PyIoPacket_set_buf(PyIoPacket* self, PyObject* value, void* closure);
+static PyObject* PyIoPacket_ReadFrom(PyIoPacket* self, PyObject* args);
+static PyObject* PyIoPacket_WriteTo(PyIoPacket* self, PyObject* args);
 
 static PyMethodDef PyIoPacket_methods[] = {
+    {"read_from", (PyCFunction)PyIoPacket_ReadFrom, METH_VARARGS,
+     "Read up to count bytes from a file descriptor into buffer without "
+     "holding the GIL and set status and io_errno"},
+    {"write_to", (PyCFunction)PyIoPacket_WriteTo, METH_VARARGS,
+     "Write buffer to a file descriptor without holding the GIL and set "
+     "status and io_errno"},
+    {} /* Sentinel */
+};
+
+static PyGetSetDef PyIoPacket_getset[] = {
+    {(char*)"buf", (getter)PyIoPacket_get_buf, (setter)PyIoPacket_set_buf,
+     (char*)"Read/write buffer (copy of buffer when writing)", NULL},
     {} /* Sentinel */
 };
 
@@ -384,8 +403,6 @@ static PyMemberDef PyIoPacket_members[]
         (char*)"Open flags"},
        {(char*)"mode", T_INT, offsetof(PyIoPacket, mode), 0,
         (char*)"Permissions for created files"},
-       {(char*)"buf", T_OBJECT, offsetof(PyIoPacket, buf), 0,
-        (char*)"Read/write buffer"},
        {(char*)"fname", T_STRING, offsetof(PyIoPacket, fname), 0,
         (char*)"Open filename"},
        {(char*)"status", T_INT, offsetof(PyIoPacket, status), 0,
@@ -402,6 +419,10 @@ static PyMemberDef PyIoPacket_members[]
         (char*)"Win32 GetLastError returned"},
        {(char*)"filedes", T_INT, offsetof(PyIoPacket, filedes), 0,
         (char*)"file descriptor of current file"},
+       {(char*)"stream", T_INT, offsetof(PyIoPacket, stream), READONLY,
+        (char*)"Backup stream of the file, 0 unless bVarBackupStreams is set"},
+       {(char*)"buffer", T_OBJECT, offsetof(PyIoPacket, buffer), READONLY,
+        (char*)"memoryview of the core buffer, only valid during plugin_io()"},
        {NULL, 0, 0, 0, NULL}};
 
 IGNORE_MISSING_INITIALIZERS_ON
@@ -416,6 +437,7 @@ static PyTypeObject PyIoPacketType = {
     .tp_doc       = "io_pkt object",
     .tp_methods   = PyIoPacket_methods,
     .tp_members   = PyIoPacket_members,
+    .tp_getset    = PyIoPacket_getset,
     .tp_init      = (initproc)PyIoPacket_init,
 };
 /* clang-format on */
@@ -687,6 +709,7 @@ MOD_INIT(bareosfd)
   EXPORT_ENUM_VALUE(pDictbVariable, bVarPrefixLinks);
   EXPORT_ENUM_VALUE(pDictbVariable, bVarCheckChanges);
   EXPORT_ENUM_VALUE(pDictbVariable, bVarUsedConfig);
+  EXPORT_ENUM_VALUE(pDictbVariable, bVarBackupStreams);
   if (PyModule_AddObject(m, bVariable, pDictbVariable)) {
     return MOD_ERROR_VAL;
   }
@@ -186,6 +186,12 @@ class BareosFdPluginPostgreSQL(BareosFdPluginBaseclass):  # noqa
         self.db_name = None
         self.start_fast = False
         self.stop_wait_wal_archive = True
+        # files read ahead in parallel by the fd while the data dir is saved
+        self.parallel_streams = 1
+        self.streams_active = False
+        self.complete_pending = False
+        # (fileType, file) of every backup stream with an open file
+        self.stream_files = {}
         self.switch_wal = True
         # keep the timeout in sync with your PG checkpoint/archive timeout parameters
         self.switch_wal_timeout = 60
@@ -1098,6 +1104,20 @@ class BareosFdPluginPostgreSQL(BareosFdPluginBaseclass):  # noqa
         if "stop_wait_wal_archive" in self.options:
             self.stop_wait_wal_archive = bool(self.options["stop_wait_wal_archive"])
 
+        if "parallel_streams" in self.options:
+            try:
+                self.parallel_streams = int(self.options["parallel_streams"])
+            except ValueError as err:
+                bareosfd.JobMessage(
+                    bareosfd.M_FATAL,
+                    (
+                        f"check_options: Plugin option parallel_streams"
+                        f" {self.options['parallel_streams']} is not an integer.\n"
+                        f"{err}\n"
+                    ),
+                )
+                return bareosfd.bRC_Error
+
         # TODO handle ssl_context support in connection
         # Normally not needed as the bareos-fd has to be located on host within
         # the pg cluster: as such using socket is preferably.
@@ -1212,13 +1232,23 @@ class BareosFdPluginPostgreSQL(BareosFdPluginBaseclass):  # noqa
                 )
                 return bareosfd.bRC_OK
 
+            # with backup streams, files of other streams may still be open
+            self.file = None
             result = super().plugin_io_open(IOP)
             if self.file is not None:
                 if result == bareosfd.bRC_OK and not self.file.closed:
                     IOP.filedes = self.file.fileno()
                     IOP.status = bareosfd.iostat_do_in_core
+            if IOP.stream:
+                self.stream_files[IOP.stream] = (self.fileType, self.file)
             return result
-        elif IOP.func == bareosfd.IO_READ:
+
+        if IOP.stream in self.stream_files:
+            self.fileType, self.file = self.stream_files[IOP.stream]
+            if IOP.func == bareosfd.IO_CLOSE:
+                del self.stream_files[IOP.stream]
+
+        if IOP.func == bareosfd.IO_READ:
             if self.fname in self.virtual_files:
                 bareosfd.DebugMessage(
                     250,
@@ -1393,6 +1423,20 @@ class BareosFdPluginPostgreSQL(BareosFdPluginBaseclass):  # noqa
                 continue
             self.paths_to_backup.append(setting)
 
+        # Let the fd read the files of the cluster ahead on several streams,
+        # end_backup_file() switches back before the backup gets completed.
+        if self.parallel_streams > 1:
+            result = bareosfd.SetValue(
+                bareosfd.bVarBackupStreams, self.parallel_streams
+            )
+            if result != bareosfd.bRC_OK:
+                bareosfd.JobMessage(
+                    bareosfd.M_FATAL,
+                    f"Could not set {self.parallel_streams} backup streams\n",
+                )
+                return bareosfd.bRC_Error
+            self.streams_active = True
+
         return bareosfd.bRC_OK
 
     def start_backup_file(self, savepkt):
@@ -1402,6 +1446,12 @@ class BareosFdPluginPostgreSQL(BareosFdPluginBaseclass):  # noqa
         We distinguish normal files from the virtuals and ROP.
         """
         bareosfd.DebugMessage(100, "start_backup_file called\n")
+        if not self.paths_to_backup and self.complete_pending:
+            # all files read ahead are saved now
+            self.complete_pending = False
+            result = self.__complete_full_backup()
+            if result != bareosfd.bRC_More:
+                return bareosfd.bRC_Stop if result == bareosfd.bRC_OK else result
         if not self.paths_to_backup:
             bareosfd.DebugMessage(100, "No files to backup\n")
             return bareosfd.bRC_Skip
@@ -1760,21 +1810,34 @@ class BareosFdPluginPostgreSQL(BareosFdPluginBaseclass):  # noqa
             return bareosfd.bRC_More
 
         if self.is_full_backup and self.is_backup_running:
-            self.__complete_backup_job()
-            # Now we can also create the Restore object with the right timestamp
-            # We start by ROP so it is the last object in backup and first in restore
-            self.virtual_files = [
-                "ROP",
-                self.backup_label_filename,
-                self.recovery_filename,
-            ]
-            if self.tablespace_map_filename is not None:
-                self.virtual_files.append(self.tablespace_map_filename)
-            self.paths_to_backup += self.virtual_files
-            return self.__check_for_wal_files()
+            if self.streams_active:
+                # The fd may still be reading files we announced before, they
+                # have to be saved before pg_backup_stop() is called.
+                bareosfd.SetValue(bareosfd.bVarBackupStreams, 1)
+                self.streams_active = False
+                self.complete_pending = True
+                return bareosfd.bRC_More
+            return self.__complete_full_backup()
 
         return bareosfd.bRC_OK
 
+    def __complete_full_backup(self):
+        """
+        Stop the backup in the cluster and add the virtual files and WAL files
+        """
+        self.__complete_backup_job()
+        # Now we can also create the Restore object with the right timestamp
+        # We start by ROP so it is the last object in backup and first in restore
+        self.virtual_files = [
+            "ROP",
+            self.backup_label_filename,
+            self.recovery_filename,
+        ]
+        if self.tablespace_map_filename is not None:
+            self.virtual_files.append(self.tablespace_map_filename)
+        self.paths_to_backup += self.virtual_files
+        return self.__check_for_wal_files()
+
     def end_backup_job(self):
         """
         Called if backup job ends, before ClientAfterJob
@@ -339,9 +339,9 @@ class BareosFdPluginBaseclass(object):
             bareosfd.DebugMessage(
                 200, "Reading %d from file %s\n" % (IOP.count, self.FNAME)
             )
-            IOP.buf = bytearray(IOP.count)
             try:
-                IOP.status = self.file.readinto(IOP.buf)
+                # read straight into the buffer of the file daemon
+                IOP.status = self.file.readinto(IOP.buffer) if IOP.buffer else 0
                 IOP.io_errno = 0
             except Exception as e:
                 bareosfd.JobMessage(
@@ -364,7 +364,8 @@ class BareosFdPluginBaseclass(object):
     def plugin_io_write(self, IOP):
         bareosfd.DebugMessage(200, "Writing buffer to file %s\n" % (self.FNAME))
         try:
-            self.file.write(IOP.buf)
+            if IOP.buffer:
+                self.file.write(IOP.buffer)
         except Exception as e:
             bareosfd.JobMessage(
                 M_ERROR,
@@ -122,6 +122,7 @@ class BareosFdPluginVMware(BareosFdPluginBaseclass.BareosFdPluginBaseclass):
             "do_io_in_core",
             "vadp_dumper_multithreading",
             "vadp_dumper_sectors_per_call",
+            "vadp_dumper_parallel_readers",
             "vadp_dumper_query_allocated_blocks_chunk_size",
             "fallback_to_full_cbt",
             "restore_allow_disks_mismatch",
@@ -380,6 +381,14 @@ class BareosFdPluginVMware(BareosFdPluginBaseclass.BareosFdPluginBaseclass):
                 self.options["vadp_dumper_sectors_per_call"]
             )
 
+        if not self._check_option_integer_positive("vadp_dumper_parallel_readers"):
+            return bareosfd.bRC_Error
+
+        if self.options.get("vadp_dumper_parallel_readers"):
+            self.vadp.dumper_parallel_readers = int(
+                self.options["vadp_dumper_parallel_readers"]
+            )
+
         if not self._check_option_integer_positive(
             "vadp_dumper_query_allocated_blocks_chunk_size"
         ):
@@ -961,7 +970,7 @@ class BareosFdPluginVMware(BareosFdPluginBaseclass.BareosFdPluginBaseclass):
             return bareosfd.bRC_OK
 
         elif IOP.func == bareosfd.IO_READ:
-            IOP.buf = bytearray(IOP.count)
+            # IOP.buffer is the buffer of the file daemon, no copy needed
             if self.data_stream:
                 # backup nvram file
                 bareosfd.DebugMessage(
@@ -969,14 +978,14 @@ class BareosFdPluginVMware(BareosFdPluginBaseclass.BareosFdPluginBaseclass):
                     "plugin_io[IO_READ]: backup nvram: %s IOP.count=%s\n"
                     % (os.path.basename(self.FNAME), IOP.count),
                 )
-                IOP.status = self.data_stream.readinto(IOP.buf)
+                IOP.status = self.data_stream.readinto(IOP.buffer)
                 bareosfd.DebugMessage(
                     100,
                     "plugin_io[IO_READ]: backup nvram: IOP.status=%s IOP.io_errno=%s\n"
                     % (IOP.status, IOP.io_errno),
                 )
             else:
-                IOP.status = self.vadp.dumper_process.stdout.readinto(IOP.buf)
+                IOP.status = self.vadp.dumper_process.stdout.readinto(IOP.buffer)
             IOP.io_errno = 0
 
             return bareosfd.bRC_OK
@@ -989,7 +998,7 @@ class BareosFdPluginVMware(BareosFdPluginBaseclass.BareosFdPluginBaseclass):
                     "plugin_io[IO_WRITE]: restore nvram: %s\n"
                     % (os.path.basename(self.FNAME)),
                 )
-                IOP.status = self.data_stream.write(IOP.buf)
+                IOP.status = self.data_stream.write(IOP.buffer)
                 bareosfd.DebugMessage(
                     100,
                     "plugin_io[IO_WRITE]: restore nvram: IOP.status=%s IOP.io_errno=%s\n"
@@ -999,7 +1008,7 @@ class BareosFdPluginVMware(BareosFdPluginBaseclass.BareosFdPluginBaseclass):
                 return bareosfd.bRC_OK
 
             try:
-                self.vadp.dumper_process.stdin.write(IOP.buf)
+                self.vadp.dumper_process.stdin.write(IOP.buffer)
                 IOP.status = IOP.count
                 IOP.io_errno = 0
             except IOError as e:
@@ -1246,6 +1255,7 @@ class BareosVADPWrapper(object):
         self.dumper_verbose = False
         self.dumper_multithreading = True
         self.dumper_sectors_per_call = 16384
+        self.dumper_parallel_readers = 0
         self.dumper_query_allocated_blocks_chunk_size = 1024
         self.vm_nvram_path = None
         self.vm_nvram_content = None
@@ -2686,6 +2696,8 @@ class BareosVADPWrapper(object):
             bareos_vadp_dumper_opts[cmd] += " -m"
 
         bareos_vadp_dumper_opts[cmd] += " -s %s" % self.dumper_sectors_per_call
+        if cmd == "dump" and self.dumper_parallel_readers > 1:
+            bareos_vadp_dumper_opts[cmd] += " -p %s" % self.dumper_parallel_readers
         bareos_vadp_dumper_opts[cmd] += (
             " -k %s" % self.dumper_query_allocated_blocks_chunk_size
         )
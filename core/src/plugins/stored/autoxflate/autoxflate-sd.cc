@@ -31,11 +31,21 @@
 #include "stored/device_control_record.h"
 #include "lib/serial.h"
 #include "lib/compression.h"
+#include "lib/thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
 
 #if defined(HAVE_LIBZ)
 #  include <zlib.h>
 #endif
 
+#if defined(HAVE_ZSTD)
+#  include <zstd.h>
+#endif
+
 #include "fastlz/fastlzlib.h"
 
 using namespace storagedaemon;
@@ -63,6 +73,7 @@ using namespace storagedaemon;
 #define COMPRESSOR_NAME_FZLZ (char*)"FASTLZ"
 #define COMPRESSOR_NAME_FZ4L (char*)"LZ4"
 #define COMPRESSOR_NAME_FZ4H (char*)"LZ4HC"
+#define COMPRESSOR_NAME_ZSTD (char*)"ZSTD"
 #define COMPRESSOR_NAME_UNSET (char*)"unknown"
 
 // Forward referenced functions
@@ -78,7 +89,9 @@ static bRC handle_write_translation(PluginContext* ctx, void* value);
 
 static bool SetupAutoDeflation(PluginContext* ctx, DeviceControlRecord* dcr);
 static bool SetupAutoInflation(PluginContext* ctx, DeviceControlRecord* dcr);
-static bool AutoDeflateRecord(PluginContext* ctx, DeviceControlRecord* dcr);
+static bool AutoDeflateRecord(PluginContext* ctx,
+                              DeviceControlRecord* dcr,
+                              bool may_defer);
 static bool AutoInflateRecord(PluginContext* ctx, DeviceControlRecord* dcr);
 
 // Pointers to Bareos functions
@@ -100,17 +113,48 @@ static PluginFunctions pluginFuncs
        freePlugin, /* free plugin instance */
        getPluginValue, setPluginValue, handlePluginEvent};
 
+// Of the records compressed on the deflate workers
+struct deferred_deflate_counters {
+  std::atomic<uint64_t> bytes_in{0};
+  std::atomic<uint64_t> bytes_out{0};
+  std::atomic<uint64_t> failed{0}; /**< Records written uncompressed */
+};
+
 // Plugin private context
 struct plugin_ctx {
   // Counters for compression/decompression ratio
-  uint64_t deflate_bytes_in;
-  uint64_t deflate_bytes_out;
-  uint64_t inflate_bytes_in;
-  uint64_t inflate_bytes_out;
+  uint64_t deflate_bytes_in{0};
+  uint64_t deflate_bytes_out{0};
+  uint64_t inflate_bytes_in{0};
+  uint64_t inflate_bytes_out{0};
+  // shared with the deflate workers, which may outlive the plugin instance
+  std::shared_ptr<deferred_deflate_counters> deferred{
+      std::make_shared<deferred_deflate_counters>()};
 };
 
 static int const debuglevel = 200;
 
+/* Threads shared by all jobs that compress their records on other threads
+ * than their own (AutoDeflateBufferSize).  They are started with the first
+ * such job and never stopped, jobs only ever wait for their own records. */
+struct deflate_workers {
+  work_group group;
+  std::mutex submit_mutex{};
+  unsigned int threads;
+
+  deflate_workers()
+      : group(1024), threads{std::max(std::thread::hardware_concurrency(), 1u)}
+  {
+    auto* pool = new thread_pool;
+    pool->borrow_threads(threads, [this] { group.work_until_completion(); });
+  }
+};
+
+static deflate_workers& DeflateWorkers()
+{
+  static deflate_workers* workers = new deflate_workers;
+  return *workers;
+}
 
 // Does the mode contain OUT
 static bool AutoxflateModeContainsOut(IODirection mode)
@@ -187,10 +231,7 @@ static bRC newPlugin(PluginContext* ctx)
   bareos_core_functions->getBareosValue(ctx, bsdVarJobId, (void*)&JobId);
   Dmsg(ctx, debuglevel, "autoxflate-sd: newPlugin JobId=%d\n", JobId);
 
-  p_ctx = (struct plugin_ctx*)malloc(sizeof(struct plugin_ctx));
-  if (!p_ctx) { return bRC_Error; }
-
-  memset(p_ctx, 0, sizeof(struct plugin_ctx));
+  p_ctx = new plugin_ctx;
   ctx->plugin_private_context = (void*)p_ctx; /* set our context pointer */
 
   /* Only register plugin events we are interested in.
@@ -221,7 +262,7 @@ static bRC freePlugin(PluginContext* ctx)
     return bRC_Error;
   }
 
-  if (p_ctx) { free(p_ctx); }
+  delete p_ctx;
   ctx->plugin_private_context = NULL;
 
   return bRC_OK;
@@ -268,6 +309,15 @@ static bRC handleJobEnd(PluginContext* ctx)
 
   if (!p_ctx) { goto bail_out; }
 
+  p_ctx->deflate_bytes_in += p_ctx->deferred->bytes_in.exchange(0);
+  p_ctx->deflate_bytes_out += p_ctx->deferred->bytes_out.exchange(0);
+  if (uint64_t failed = p_ctx->deferred->failed.exchange(0)) {
+    Jmsg(ctx, M_WARNING,
+         T_("autoxflate-sd: %llu records could not be compressed and were "
+            "written as they were\n"),
+         static_cast<unsigned long long>(failed));
+  }
+
   if (p_ctx->inflate_bytes_in) {
     Dmsg(ctx, debuglevel, "autoxflate-sd: inflate ratio: %lld/%lld = %0.2f%%\n",
          p_ctx->inflate_bytes_out, p_ctx->inflate_bytes_in,
@@ -400,7 +450,7 @@ static bRC handle_read_translation(PluginContext* ctx, void* value)
 
   if (!record_was_swapped) {
     if (AutoxflateModeContainsIn(dcr->autodeflate)) {
-      record_was_swapped = AutoDeflateRecord(ctx, dcr);
+      record_was_swapped = AutoDeflateRecord(ctx, dcr, false);
     }
   }
 
@@ -422,7 +472,7 @@ static bRC handle_write_translation(PluginContext* ctx, void* value)
   }
   if (!record_was_swapped) {
     if (AutoxflateModeContainsOut(dcr->autodeflate)) {
-      record_was_swapped = AutoDeflateRecord(ctx, dcr);
+      record_was_swapped = AutoDeflateRecord(ctx, dcr, true);
     }
   }
   return bRC_OK;
@@ -511,12 +561,38 @@ static bool SetupAutoDeflation(PluginContext* ctx, DeviceControlRecord* dcr)
       }
       break;
     }
+#if defined(HAVE_ZSTD)
+    case COMPRESS_ZSTD: {
+      compressorname = COMPRESSOR_NAME_ZSTD;
+
+      if (size_t zstat = ZSTD_CCtx_setParameter(
+              (ZSTD_CCtx*)jcr->compress.workset.pZSTD, ZSTD_c_compressionLevel,
+              dcr->device_resource->autodeflate_level);
+          ZSTD_isError(zstat)) {
+        Jmsg(ctx, M_FATAL,
+             T_("autoxflate-sd: Compression ZSTD_CCtx_setParameter error: "
+                "%s\n"),
+             ZSTD_getErrorName(zstat));
+        jcr->setJobStatusWithPriorityCheck(JS_ErrorTerminated);
+        goto bail_out;
+      }
+      break;
+    }
+#endif
     default:
       break;
   }
 
   Jmsg(ctx, M_INFO, T_("autoxflate-sd: Compressor on device %s is %s\n"),
        dcr->dev_name, compressorname);
+  dcr->max_deferred_bytes = dcr->device_resource->autodeflate_buffer_size;
+  if (dcr->max_deferred_bytes) {
+    Jmsg(ctx, M_INFO,
+         T_("autoxflate-sd: Compressing up to %llu bytes at once on %u "
+            "threads\n"),
+         static_cast<unsigned long long>(dcr->max_deferred_bytes),
+         DeflateWorkers().threads);
+  }
   retval = true;
 
 bail_out:
@@ -552,15 +628,139 @@ static bool SetupAutoInflation(PluginContext*, DeviceControlRecord* dcr)
   return true;
 }
 
+/**
+ * Fills in the compression header of a record compressed with the
+ * configured algorithm and maps its stream to the compressed one.  The
+ * compressed data comes after the header, and for sparse data after the
+ * offset which gets copied from the original record.
+ */
+static void FinishDeflatedRecord(uint32_t algorithm,
+                                 uint16_t level,
+                                 const DeviceRecord* rec,
+                                 DeviceRecord* nrec)
+{
+  ser_declare;
+  comp_stream_header ch;
+
+  // Map the streams.
+  switch (rec->maskedStream) {
+    case STREAM_FILE_DATA:
+      nrec->Stream = STREAM_COMPRESSED_DATA;
+      nrec->maskedStream = STREAM_COMPRESSED_DATA;
+      break;
+    case STREAM_WIN32_DATA:
+      nrec->Stream = STREAM_WIN32_COMPRESSED_DATA;
+      nrec->maskedStream = STREAM_WIN32_COMPRESSED_DATA;
+      break;
+    case STREAM_SPARSE_DATA:
+      nrec->Stream = STREAM_SPARSE_COMPRESSED_DATA;
+      nrec->maskedStream = STREAM_SPARSE_COMPRESSED_DATA;
+      break;
+    default:
+      break;
+  }
+
+  // Generate a compression header.
+  ch.magic = algorithm;
+  ch.level = level;
+  ch.version = COMP_HEAD_VERSION;
+  ch.size = nrec->data_len;
+
+  switch (nrec->maskedStream) {
+    case STREAM_COMPRESSED_DATA:
+    case STREAM_WIN32_COMPRESSED_DATA:
+      SerBegin(nrec->data, sizeof(comp_stream_header));
+      ser_uint32(ch.magic);
+      ser_uint32(ch.size);
+      ser_uint16(ch.level);
+      ser_uint16(ch.version);
+      SerEnd(nrec->data, sizeof(comp_stream_header));
+      nrec->data_len += sizeof(comp_stream_header);
+      break;
+    case STREAM_SPARSE_COMPRESSED_DATA:
+      // Copy the sparse offset from the original.
+      memcpy(nrec->data, rec->data, OFFSET_FADDR_SIZE);
+      SerBegin(nrec->data + OFFSET_FADDR_SIZE, sizeof(comp_stream_header));
+      ser_uint32(ch.magic);
+      ser_uint32(ch.size);
+      ser_uint16(ch.level);
+      ser_uint16(ch.version);
+      SerEnd(nrec->data + OFFSET_FADDR_SIZE, sizeof(comp_stream_header));
+      nrec->data_len += OFFSET_FADDR_SIZE + sizeof(comp_stream_header);
+      break;
+  }
+}
+
+/**
+ * Copy a record that AutoDeflateRecord() would compress and let a deflate
+ * worker compress the copy.  The job writes the result once the worker is
+ * done, after the records that came before it.
+ */
+static void DeferAutoDeflateRecord(PluginContext* ctx,
+                                   DeviceControlRecord* dcr,
+                                   const DeviceRecord* rec)
+{
+  struct plugin_ctx* p_ctx = (struct plugin_ctx*)ctx->plugin_private_context;
+
+  DeviceRecord* copy = bareos_core_functions->new_record(true);
+  bareos_core_functions->CopyRecordState(copy, const_cast<DeviceRecord*>(rec));
+  copy->Stream = rec->Stream;
+  copy->maskedStream = rec->maskedStream;
+  copy->data = CheckPoolMemorySize(copy->data, rec->data_len);
+  memcpy(copy->data, rec->data, rec->data_len);
+  copy->data_len = rec->data_len;
+
+  uint32_t algorithm = dcr->device_resource->autodeflate_algorithm;
+  uint16_t level = dcr->device_resource->autodeflate_level;
+  std::shared_ptr<deferred_deflate_counters> counters = p_ctx->deferred;
+
+  auto deflate = [copy, algorithm, level, counters]() -> DeviceRecord* {
+    std::size_t offset = sizeof(comp_stream_header);
+    if (copy->maskedStream == STREAM_SPARSE_DATA) {
+      offset += OFFSET_FADDR_SIZE;
+    }
+    std::size_t capacity
+        = RequiredCompressionOutputBufferSize(algorithm, copy->data_len);
+
+    DeviceRecord* nrec = bareos_core_functions->new_record(true);
+    bareos_core_functions->CopyRecordState(nrec, copy);
+    nrec->data = CheckPoolMemorySize(nrec->data, offset + capacity);
+
+    result compressed = ThreadlocalCompress(
+        algorithm, level, copy->data, copy->data_len, nrec->data + offset,
+        capacity);
+    if (compressed.holds_error()) {
+      counters->failed++;
+      bareos_core_functions->FreeRecord(nrec);
+      return copy;
+    }
+
+    nrec->data_len = compressed.value_unchecked();
+    FinishDeflatedRecord(algorithm, level, copy, nrec);
+    counters->bytes_in += copy->data_len;
+    counters->bytes_out += nrec->data_len;
+    bareos_core_functions->FreeRecord(copy);
+    return nrec;
+  };
+
+  deflate_workers& workers = DeflateWorkers();
+  std::future<DeviceRecord*> translated;
+  {
+    std::unique_lock lock(workers.submit_mutex);
+    translated = workers.group.submit(std::move(deflate));
+  }
+  dcr->DeferRecord(std::move(translated), rec->data_len);
+}
+
 /**
  * Perform automatic compression of certain stream types when enabled in the
  * config.
  */
-static bool AutoDeflateRecord(PluginContext* ctx, DeviceControlRecord* dcr)
+static bool AutoDeflateRecord(PluginContext* ctx,
+                              DeviceControlRecord* dcr,
+                              bool may_defer)
 {
-  ser_declare;
   bool retval = false;
-  comp_stream_header ch;
   DeviceRecord *rec, *nrec = nullptr;
   struct plugin_ctx* p_ctx;
   unsigned char* data = NULL;
@@ -583,6 +783,16 @@ static bool AutoDeflateRecord(PluginContext* ctx, DeviceControlRecord* dcr)
 
   if (!IsUncompressedStreamWeHandle(rec->maskedStream)) { goto bail_out; }
 
+  if (may_defer && dcr->max_deferred_bytes) {
+    DeferAutoDeflateRecord(ctx, dcr, rec);
+    if (intermediate_value) {
+      bareos_core_functions->FreeRecord(dcr->after_rec);
+      dcr->after_rec = nullptr;
+    }
+    retval = true;
+    goto bail_out;
+  }
+
   // Clone the data from the original DeviceRecord to the converted one.
   nrec = bareos_core_functions->new_record(/* with_data = */ false);
   bareos_core_functions->CopyRecordState(nrec, rec);
@@ -620,53 +830,8 @@ static bool AutoDeflateRecord(PluginContext* ctx, DeviceControlRecord* dcr)
     goto bail_out;
   }
 
-  // Map the streams.
-  switch (rec->maskedStream) {
-    case STREAM_FILE_DATA:
-      nrec->Stream = STREAM_COMPRESSED_DATA;
-      nrec->maskedStream = STREAM_COMPRESSED_DATA;
-      break;
-    case STREAM_WIN32_DATA:
-      nrec->Stream = STREAM_WIN32_COMPRESSED_DATA;
-      nrec->maskedStream = STREAM_WIN32_COMPRESSED_DATA;
-      break;
-    case STREAM_SPARSE_DATA:
-      nrec->Stream = STREAM_SPARSE_COMPRESSED_DATA;
-      nrec->maskedStream = STREAM_SPARSE_COMPRESSED_DATA;
-      break;
-    default:
-      break;
-  }
-
-  // Generate a compression header.
-  ch.magic = dcr->device_resource->autodeflate_algorithm;
-  ch.level = dcr->device_resource->autodeflate_level;
-  ch.version = COMP_HEAD_VERSION;
-  ch.size = nrec->data_len;
-
-  switch (nrec->maskedStream) {
-    case STREAM_COMPRESSED_DATA:
-    case STREAM_WIN32_COMPRESSED_DATA:
-      SerBegin(nrec->data, sizeof(comp_stream_header));
-      ser_uint32(ch.magic);
-      ser_uint32(ch.size);
-      ser_uint16(ch.level);
-      ser_uint16(ch.version);
-      SerEnd(nrec->data, sizeof(comp_stream_header));
-      nrec->data_len += sizeof(comp_stream_header);
-      break;
-    case STREAM_SPARSE_COMPRESSED_DATA:
-      // Copy the sparse offset from the original.
-      memcpy(nrec->data, rec->data, OFFSET_FADDR_SIZE);
-      SerBegin(nrec->data + OFFSET_FADDR_SIZE, sizeof(comp_stream_header));
-      ser_uint32(ch.magic);
-      ser_uint32(ch.size);
-      ser_uint16(ch.level);
-      ser_uint16(ch.version);
-      SerEnd(nrec->data + OFFSET_FADDR_SIZE, sizeof(comp_stream_header));
-      nrec->data_len += OFFSET_FADDR_SIZE + sizeof(comp_stream_header);
-      break;
-  }
+  FinishDeflatedRecord(dcr->device_resource->autodeflate_algorithm,
+                       dcr->device_resource->autodeflate_level, rec, nrec);
 
   Dmsg(ctx, 400,
        "AutoDeflateRecord: From datastream %d to %d from original size %ld to "
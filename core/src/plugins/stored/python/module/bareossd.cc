@@ -45,6 +45,8 @@
 #include "bareossd.h"
 #include "lib/edit.h"
 
+#include <algorithm>
+
 namespace storagedaemon {
 
 static const int debuglevel = 150;
@@ -457,5 +459,48 @@ static PyObject* PyBareosGetInstanceCount(PyObject*, PyObject* args)
   return pRetVal;
 }
 
+/**
+ * Callback function which is exposed as a part of the additional methods which
+ * allow a Python plugin to restrict the record translation events it receives
+ * to records of the given streams.  These events are generated for every
+ * record, so filtering them before Python gets called saves taking the
+ * interpreter lock for all other records.  An empty sequence passes all
+ * records again.
+ */
+static PyObject* PyBareosSetRecordStreams(PyObject*, PyObject* args)
+{
+  PluginContext* plugin_ctx = plugin_context;
+  PyObject *pyStreams, *pySeq;
+
+  if (!PyArg_ParseTuple(args, "O:BareosSetRecordStreams", &pyStreams)) {
+    return NULL;
+  }
+  RETURN_RUNTIME_ERROR_IF_BFUNC_OR_BAREOS_PLUGIN_CTX_UNSET()
+
+  pySeq = PySequence_Fast(pyStreams, "Expected a sequence of streams");
+  if (!pySeq) { return NULL; }
+
+  std::vector<int32_t> streams;
+  Py_ssize_t len = PySequence_Fast_GET_SIZE(pySeq);
+  for (Py_ssize_t i = 0; i < len; i++) {
+    long stream = PyLong_AsLong(PySequence_Fast_GET_ITEM(pySeq, i));
+    if (stream == -1 && PyErr_Occurred()) {
+      Py_DECREF(pySeq);
+      return NULL;
+    }
+    streams.push_back(static_cast<int32_t>(stream));
+  }
+  Py_DECREF(pySeq);
+
+  std::sort(streams.begin(), streams.end());
+  streams.erase(std::unique(streams.begin(), streams.end()), streams.end());
+
+  plugin_private_context* plugin_priv_ctx
+      = (plugin_private_context*)plugin_ctx->plugin_private_context;
+  plugin_priv_ctx->record_streams = std::move(streams);
+
+  return ConvertbRCRetvalToPythonRetval(bRC_OK);
+}
+
 
 } /* namespace storagedaemon*/
@@ -51,6 +51,7 @@ static PyObject* PyBareosJobMessage(PyObject* self, PyObject* args);
 static PyObject* PyBareosRegisterEvents(PyObject* self, PyObject* args);
 static PyObject* PyBareosUnRegisterEvents(PyObject* self, PyObject* args);
 static PyObject* PyBareosGetInstanceCount(PyObject* self, PyObject* args);
+static PyObject* PyBareosSetRecordStreams(PyObject* self, PyObject* args);
 
 static PyMethodDef Methods[]
     = {{"GetValue", PyBareosGetValue, METH_VARARGS, "Get a Plugin value"},
@@ -64,6 +65,8 @@ static PyMethodDef Methods[]
         "Unregister Plugin Events"},
        {"GetInstanceCount", PyBareosGetInstanceCount, METH_VARARGS,
         "Get number of instances of current plugin"},
+       {"SetRecordStreams", PyBareosSetRecordStreams, METH_VARARGS,
+        "Only pass record translation events of these streams"},
        {NULL, NULL, 0, NULL}};
 
 
@@ -22,6 +22,8 @@
 #ifndef BAREOS_PLUGINS_STORED_PYTHON_PLUGIN_PRIVATE_CONTEXT_H_
 #define BAREOS_PLUGINS_STORED_PYTHON_PLUGIN_PRIVATE_CONTEXT_H_
 
+#include <vector>
+
 // Plugin private context
 struct plugin_private_context {
   int64_t instance;                 // Instance number of plugin
@@ -34,6 +36,9 @@ struct plugin_private_context {
       interpreter;    // Python interpreter for this instance of the plugin
   PyObject* pModule;  // Python Module entry point
   PyObject* pyModuleFunctionsDict;  // Python Dictionary
+  std::vector<int32_t> record_streams;  // Sorted streams of the record
+                                        // translation events passed to python,
+                                        // empty = all
 };
 
 
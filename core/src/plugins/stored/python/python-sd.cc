@@ -43,11 +43,15 @@
 #define LOGPREFIX PLUGIN_NAME "-" PLUGIN_DAEMON ": "
 
 #include "stored/stored.h"
+#include "stored/device_control_record.h"
+#include "include/streams.h"
 
 #include "python-sd.h"
 #include "module/bareossd.h"
 #include "lib/edit.h"
 
+#include <algorithm>
+
 namespace storagedaemon {
 
 static const int debuglevel = 150;
@@ -239,10 +243,7 @@ BAREOS_EXPORT bRC unloadPlugin()
 static bRC newPlugin(PluginContext* plugin_ctx)
 {
   struct plugin_private_context* plugin_priv_ctx
-      = (struct plugin_private_context*)malloc(
-          sizeof(struct plugin_private_context));
-  if (!plugin_priv_ctx) { return bRC_Error; }
-  memset(plugin_priv_ctx, 0, sizeof(struct plugin_private_context));
+      = new plugin_private_context{};
   plugin_ctx->plugin_private_context
       = (void*)plugin_priv_ctx; /* set our context pointer */
 
@@ -286,13 +287,27 @@ static bRC freePlugin(PluginContext* plugin_ctx)
   PyEval_ReleaseThread(mainThreadState);
 #endif
 
-  free(plugin_priv_ctx);
+  delete plugin_priv_ctx;
   plugin_ctx->plugin_private_context = NULL;
 
   return bRC_OK;
 }
 
 
+// See if the record of a record translation event passes the stream filter.
+static bool WantsRecord(plugin_private_context* plugin_priv_ctx,
+                        DeviceControlRecord* dcr)
+{
+  const std::vector<int32_t>& streams = plugin_priv_ctx->record_streams;
+  if (streams.empty() || !dcr || !dcr->before_rec) { return true; }
+
+  // continuation records carry the negated stream
+  int32_t stream = dcr->before_rec->Stream;
+  if (stream < 0) { stream = -stream; }
+  return std::binary_search(streams.begin(), streams.end(),
+                            stream & STREAMMASK_TYPE);
+}
+
 static bRC handlePluginEvent(PluginContext* plugin_ctx,
                              bSdEvent* event,
                              void* value)
@@ -314,6 +329,14 @@ static bRC handlePluginEvent(PluginContext* plugin_ctx,
       event_dispatched = true;
       retval = parse_plugin_definition(plugin_ctx, value, plugin_options);
       break;
+    case bSdEventReadRecordTranslation:
+    case bSdEventWriteRecordTranslation:
+      /* These come for every record, only take the interpreter lock for
+       * the streams the plugin asked for. */
+      if (!WantsRecord(plugin_priv_ctx, (DeviceControlRecord*)value)) {
+        return bRC_OK;
+      }
+      break;
     default:
       break;
   }
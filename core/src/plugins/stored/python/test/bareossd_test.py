@@ -54,6 +54,10 @@ class TestBareosFd(unittest.TestCase):
     def test_GetInstanceCount(self):
         self.assertRaises(RuntimeError, bareossd.GetInstanceCount)
 
+    def test_SetRecordStreams(self):
+        self.assertRaises(TypeError, bareossd.SetRecordStreams)
+        self.assertRaises(RuntimeError, bareossd.SetRecordStreams, [1])
+
 
 if __name__ == "__main__":
     unittest.main()
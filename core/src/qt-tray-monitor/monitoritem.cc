@@ -27,11 +27,15 @@
 #include "lib/bsock_tcp.h"
 #include "lib/bnet.h"
 
+#include <algorithm>
+
 MonitorItem::MonitorItem(QObject* parent)
     : QObject(parent), d(new MonitorItemPrivate)
 {
   /* Run this class only in the context of
-     MonitorItemThread because of the networking */
+     MonitorItemThread because of the networking.
+     Only GetStatus() may also run on a thread of its status pool,
+     while MonitorItemThread waits for it. */
   Q_ASSERT(QThread::currentThreadId()
            == MonitorItemThread::instance()->getThreadId());
 }
@@ -315,6 +319,10 @@ void MonitorItem::get_list(const char* cmd, QStringList& lst)
 
 void MonitorItem::GetStatus()
 {
+  Q_ASSERT(QThread::currentThreadId()
+               == MonitorItemThread::instance()->getThreadId()
+           || MonitorItemThread::instance()->isPollingItems());
+
   switch (d->type) {
     case R_DIRECTOR:
       docmd("status dir");
@@ -328,8 +336,29 @@ void MonitorItem::GetStatus()
     default:
       break;
   }
+
+  if (d->state != Error) {
+    d->failedPolls = 0;
+    d->nextPoll = 0;
+    return;
+  }
+
+  /* wait twice the refresh interval after the first failure and twice as
+   * long after every further one, at most 10 minutes */
+  const int max_delay = 600;
+  d->failedPolls = std::min(d->failedPolls + 1, 16);
+  int delay = d->refreshInterval;
+  for (int i = 0; i < d->failedPolls && delay < max_delay; i++) { delay *= 2; }
+  delay = std::min(delay, max_delay);
+  if (delay <= d->refreshInterval) { return; }
+
+  d->nextPoll = time(NULL) + delay;
+  emit appendText(QString::fromUtf8(get_name()),
+                  QString("Next try in %1 seconds.").arg(delay));
 }
 
+bool MonitorItem::PollDue(time_t now) const { return now >= d->nextPoll; }
+
 void MonitorItem::connectToMainWindow(QObject* mainWindow)
 {
   connect(this, SIGNAL(showStatusbarMessage(QString)), mainWindow,
@@ -351,6 +380,7 @@ void* MonitorItem::resource() const { return d->resource; }
 BareosSocket* MonitorItem::DSock() const { return d->DSock; }
 MonitorItem::StateEnum MonitorItem::state() const { return d->state; }
 int MonitorItem::connectTimeout() const { return d->connectTimeout; }
+int MonitorItem::refreshInterval() const { return d->refreshInterval; }
 
 void MonitorItem::setType(Rescode type) { d->type = type; }
 void MonitorItem::setResource(BareosResource* resource)
@@ -363,3 +393,7 @@ void MonitorItem::setConnectTimeout(int timeout)
 {
   d->connectTimeout = timeout;
 }
+void MonitorItem::setRefreshInterval(int interval)
+{
+  d->refreshInterval = interval;
+}
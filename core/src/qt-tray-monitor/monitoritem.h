@@ -84,18 +84,21 @@ class MonitorItem : public QObject {
   void connectToMainWindow(QObject* mainWindow);
   void get_list(const char* cmd, QStringList& lst);
   void GetStatus();
+  bool PollDue(time_t now) const;
 
   Rescode type() const;
   void* resource() const;
   BareosSocket* DSock() const;
   StateEnum state() const;
   int connectTimeout() const;
+  int refreshInterval() const;
 
   void setType(Rescode type);
   void setResource(BareosResource* resource);
   void setDSock(BareosSocket* DSock);
   void setState(StateEnum state);
   void setConnectTimeout(int timeout);
+  void setRefreshInterval(int interval);
 
  private:
   Q_DISABLE_COPY(MonitorItem);
@@ -118,6 +121,9 @@ class MonitorItemPrivate {
       , resource(NULL)
       , DSock(NULL)
       , connectTimeout(0)
+      , refreshInterval(0)
+      , failedPolls(0)
+      , nextPoll(0)
       , state(MonitorItem::Idle)
   {
   }
@@ -126,6 +132,12 @@ class MonitorItemPrivate {
   BareosResource* resource;
   BareosSocket* DSock;
   int connectTimeout;
+  int refreshInterval;
+
+  /* A daemon that cannot be reached is polled less and less often, so that
+   * it does not cost a connect timeout every refresh. */
+  int failedPolls;
+  time_t nextPoll; /* 0 = on every refresh */
 
   MonitorItem::StateEnum state;
 };
@@ -19,6 +19,8 @@
    02110-1301, USA.
 */
 #include <QDebug>
+#include <QRunnable>
+#include <QThreadPool>
 #include <QTimer>
 
 #include "mainwindow.h"
@@ -28,6 +30,7 @@
 #include "tray_conf.h"
 #include "lib/parse_conf.h"
 
+#include <algorithm>
 #include <cassert>
 
 MonitorItemThread* MonitorItemThread::monitorItemThreadSingleton;
@@ -37,6 +40,7 @@ MonitorItemThread::MonitorItemThread(QObject* parent)
     : QThread(parent)
     , monitor(NULL)
     , refreshTimer(new QTimer(this))
+    , statusPool(new QThreadPool(this))
     , isRefreshing(false)
 {
   threadId = currentThreadId();
@@ -121,6 +125,7 @@ QStringList MonitorItemThread::createRes(const cl_opts& cl)
     item->setType(R_DIRECTOR);
     item->setResource(dird);
     item->setConnectTimeout(monitor->DIRConnectTimeout);
+    item->setRefreshInterval(monitor->RefreshInterval);
     if (!cl.do_connection_test_only_) {
       item->connectToMainWindow(MainWindow::instance());
     }
@@ -135,6 +140,7 @@ QStringList MonitorItemThread::createRes(const cl_opts& cl)
     item->setType(R_CLIENT);
     item->setResource(filed);
     item->setConnectTimeout(monitor->FDConnectTimeout);
+    item->setRefreshInterval(monitor->RefreshInterval);
     if (!cl.do_connection_test_only_) {
       item->connectToMainWindow(MainWindow::instance());
     }
@@ -149,6 +155,7 @@ QStringList MonitorItemThread::createRes(const cl_opts& cl)
     item->setType(R_STORAGE);
     item->setResource(stored);
     item->setConnectTimeout(monitor->SDConnectTimeout);
+    item->setRefreshInterval(monitor->RefreshInterval);
     if (!cl.do_connection_test_only_) {
       item->connectToMainWindow(MainWindow::instance());
     }
@@ -178,16 +185,39 @@ QStringList MonitorItemThread::createRes(const cl_opts& cl)
   return tabRefs;
 }
 
+namespace {
+class StatusPoll : public QRunnable {
+ public:
+  explicit StatusPoll(MonitorItem* t_item) : item(t_item) {}
+  void run() override { item->GetStatus(); }
+
+ private:
+  MonitorItem* item;
+};
+}  // namespace
+
 void MonitorItemThread::onRefreshItems()
 {
   if (!isRefreshing) {
     isRefreshing = true;
-    for (int i = 0; i < items.count(); i++) { items[i]->GetStatus(); }
+    /* Poll the daemons in parallel, so that one which does not answer does
+     * not hold back the status of all others.  The items stay owned by this
+     * thread, which waits until all polls are done; their signals reach the
+     * main window queued as before. */
+    statusPool->setMaxThreadCount(std::max(1, items.count()));
+    time_t now = time(NULL);
+    for (int i = 0; i < items.count(); i++) {
+      MonitorItem* item = items[i];
+      if (item->PollDue(now)) { statusPool->start(new StatusPoll(item)); }
+    }
+    statusPool->waitForDone();
     emit refreshItemsReady();
     isRefreshing = false;
   }
 }
 
+bool MonitorItemThread::isPollingItems() const { return isRefreshing; }
+
 bool MonitorItemThread::doConnectionTest()
 {
   int failed = 0;
@@ -28,6 +28,7 @@
 
 class MonitorItem;
 class MonitorResource;
+class QThreadPool;
 class QTimer;
 
 class MonitorItemThread : public QThread {
@@ -42,6 +43,7 @@ class MonitorItemThread : public QThread {
   MonitorResource* getMonitor() const;
   MonitorItem* getDirector() const;
   bool doConnectionTest();
+  bool isPollingItems() const;
 
  protected:
   virtual void run() override;
@@ -59,6 +61,7 @@ class MonitorItemThread : public QThread {
 
   QList<MonitorItem*> items;
   QTimer* refreshTimer;
+  QThreadPool* statusPool;
   bool isRefreshing;
 
  public slots:
@@ -32,6 +32,8 @@
 #include "stored/autochanger.h"
 #include "stored/blocksize_boundaries.h"
 #include "stored/bsr.h"
+#include "stored/buffer_budget.h"
+#include "stored/cpu_affinity.h"
 #include "stored/device_control_record.h"
 #include "stored/job.h"
 #include "stored/label.h"
@@ -76,6 +78,7 @@ static int const rdebuglevel = 100;
 
 /* Forward referenced functions */
 static void AttachDcrToDev(DeviceControlRecord* dcr);
+static bool AllocateReservedDcrBuffers(DeviceControlRecord* dcr);
 static void DetachDcrFromDev(DeviceControlRecord* dcr);
 static void SetDcrFromVol(DeviceControlRecord* dcr, VolumeList* vol);
 
@@ -100,6 +103,8 @@ bool AcquireDeviceForRead(DeviceControlRecord* dcr)
   int vol_label_status;
   int retry = 0;
 
+  PinJobThread(dcr);
+  if (!AllocateReservedDcrBuffers(dcr)) { return false; }
   Enter(rdebuglevel);
   dev = dcr->dev;
   dev->Lock_read_acquire();
@@ -164,7 +169,7 @@ bool AcquireDeviceForRead(DeviceControlRecord* dcr)
 
     dev->dunblock(DEV_UNLOCKED);
 
-    LockReservations();
+    LockReservations(vol->MediaType);
     memset(&rctx, 0, sizeof(ReserveContext));
     jcr->sd_impl->read_dcr = dcr;
     rctx.any_drive = true;
@@ -177,7 +182,7 @@ bool AcquireDeviceForRead(DeviceControlRecord* dcr)
     // Search for a new device
     status = SearchResForDevice(jcr, rctx);
     ClearReserveMessages(jcr); /* release queued messages */
-    UnlockReservations();
+    UnlockReservations(vol->MediaType);
 
     if (status == 1) { /* found new device to use */
       /* Switching devices, so acquire lock on new device, then release the old
@@ -411,6 +416,8 @@ DeviceControlRecord* AcquireDeviceForAppend(DeviceControlRecord* dcr)
   bool retval = false;
   bool have_vol = false;
 
+  PinJobThread(dcr);
+  if (!AllocateReservedDcrBuffers(dcr)) { return NULL; }
   Enter(200);
   InitDeviceWaitTimers(dcr);
 
@@ -594,6 +601,7 @@ bool ReleaseDevice(DeviceControlRecord* dcr)
 
   Dmsg3(100, "%d writers, %d reserve, dev=%s\n", dev->num_writers,
         dev->NumReserved(), dev->print_name());
+  if (!dev->IsBusy()) { dev->last_released = now; }
 
   // If no writers, close if file or !CAP_ALWAYS_OPEN
   if (dev->num_writers == 0
@@ -661,6 +669,7 @@ bool ReleaseDevice(DeviceControlRecord* dcr)
     dev->Unlock();
   }
 
+  UnpinJobThread(dcr);
   if (dcr->keep_dcr) {
     DetachDcrFromDev(dcr);
   } else {
@@ -685,11 +694,58 @@ bool CleanDevice(DeviceControlRecord* dcr)
   return retval;
 }
 
+static void FreeDcrBuffers(DeviceControlRecord* dcr)
+{
+  if (dcr->block) {
+    FreeBlock(dcr->block);
+    dcr->block = NULL;
+  }
+  if (dcr->rec) {
+    FreeRecord(dcr->rec);
+    dcr->rec = NULL;
+  }
+  if (dcr->buffer_bytes) {
+    ReleaseJobBuffers(dcr->jcr, dcr->buffer_bytes);
+    dcr->buffer_bytes = 0;
+  }
+}
+
+/* Gives the dcr a block for dev and a record, charging the block to the
+ * Maximum Job Buffer Memory.  Only waits for it if wait is set. */
+static bool AllocateDcrBuffers(DeviceControlRecord* dcr, Device* dev, bool wait)
+{
+  FreeDcrBuffers(dcr);
+
+  JobControlRecord* jcr = dcr->jcr;
+  if (jcr && jcr->sd_impl) {
+    uint64_t bytes = BlockBufferSize(dev);
+    if (!ChargeJobBuffers(jcr, bytes, wait)) { return false; }
+    dcr->buffer_bytes = bytes;
+  }
+  dcr->block = new_block(dev);
+  dcr->rec = new_record();
+  return true;
+}
+
+/* A reserved device control record only gets its buffers when the job
+ * acquires the device. */
+static bool AllocateReservedDcrBuffers(DeviceControlRecord* dcr)
+{
+  if (dcr->block) { return true; }
+  if (!AllocateDcrBuffers(dcr, dcr->dev, true)) {
+    Jmsg(dcr->jcr, M_FATAL, 0,
+         T_("Job canceled while waiting for buffer memory.\n"));
+    return false;
+  }
+  return true;
+}
+
 // Setup DeviceControlRecord with a new device.
 void SetupNewDcrDevice(JobControlRecord* jcr,
                        DeviceControlRecord* dcr,
                        Device* dev,
-                       BlockSizeBoundaries* blocksizes)
+                       BlockSizeBoundaries* blocksizes,
+                       bool allocate_buffers)
 {
   dcr->jcr = jcr; /* point back to jcr */
 
@@ -701,14 +757,11 @@ void SetupNewDcrDevice(JobControlRecord* jcr,
       dev->max_block_size = blocksizes->max_block_size;
     }
 
-    if (dcr->block) { FreeBlock(dcr->block); }
-    dcr->block = new_block(dev);
-
-    if (dcr->rec) {
-      FreeRecord(dcr->rec);
-      dcr->rec = NULL;
+    if (allocate_buffers) {
+      AllocateDcrBuffers(dcr, dev, false);
+    } else {
+      FreeDcrBuffers(dcr);
     }
-    dcr->rec = new_record();
 
     if (dcr->attached_to_dev) { DetachDcrFromDev(dcr); }
 
@@ -802,9 +855,9 @@ void FreeDeviceControlRecord(DeviceControlRecord* dcr)
 
   LockedDetachDcrFromDev(dcr);
 
-  if (dcr->block) { FreeBlock(dcr->block); }
-
-  if (dcr->rec) { FreeRecord(dcr->rec); }
+  dcr->DiscardDeferredRecords();
+  FreeDcrBuffers(dcr);
+  UnpinJobThread(dcr);
 
   if (jcr && jcr->sd_impl->dcr == dcr) { jcr->sd_impl->dcr = NULL; }
 
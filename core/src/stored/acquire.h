@@ -36,7 +36,8 @@ bool CleanDevice(DeviceControlRecord* dcr);
 void SetupNewDcrDevice(JobControlRecord* jcr,
                        DeviceControlRecord* dcr,
                        Device* dev,
-                       BlockSizeBoundaries* blocksizes);
+                       BlockSizeBoundaries* blocksizes,
+                       bool allocate_buffers = true);
 void FreeDeviceControlRecord(DeviceControlRecord* dcr);
 
 } /* namespace storagedaemon */
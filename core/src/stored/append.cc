@@ -34,26 +34,38 @@
 #include "stored/stored_globals.h"
 #include "stored/stored_jcr_impl.h"
 #include "stored/label.h"
+#include "stored/mac.h"
+#include "stored/sd_plugins.h"
 #include "stored/spool.h"
 #include "lib/bget_msg.h"
+#include "lib/bsock_striped.h"
 #include "lib/edit.h"
 #include "include/jcr.h"
 #include "include/streams.h"
 #include "lib/berrno.h"
 #include "lib/crypto.h"
+#include "include/fcntl_def.h"
 #include "lib/berrno.h"
 #include <algorithm>
 
 #include <algorithm>
+#include <atomic>
 #include <thread>
 #include <variant>
 #include <deque>
 #include <utility>
 #include <condition_variable>
+#include <mutex>
 #include "lib/channel.h"
 
 namespace storagedaemon {
 
+const char* const append_stage_names[] = {"receive",     "block",
+                                          "spool-write", "spool-read",
+                                          "device",      "attributes"};
+static_assert(std::size(append_stage_names)
+              == static_cast<std::size_t>(append_stage::kCount));
+
 /* Responses sent to the daemon */
 static char OK_data[] = "3000 OK data\n";
 static char OK_append[] = "3000 OK append data\n";
@@ -84,13 +96,20 @@ DeviceRecord ProcessedFileData::GetData()
 
 ProcessedFile::ProcessedFile(int32_t fileindex) : fileindex_(fileindex) {}
 
-void ProcessedFile::SendAttributesToDirector(JobControlRecord* jcr)
+bool ProcessedFile::SendAttributesToDirector(JobControlRecord* jcr)
+{
+  return std::all_of(attributes_.begin(), attributes_.end(),
+                     [jcr](ProcessedFileData& attribute) {
+                       DeviceRecord devicerecord = attribute.GetData();
+                       return SendAttrsToDir(jcr, &devicerecord);
+                     });
+}
+
+void ProcessedFile::CollectAttributes(std::vector<DeviceRecord>& records)
 {
-  std::for_each(attributes_.begin(), attributes_.end(),
-                [jcr](ProcessedFileData& attribute) {
-                  DeviceRecord devicerecord = attribute.GetData();
-                  SendAttrsToDir(jcr, &devicerecord);
-                });
+  for (auto& attribute : attributes_) {
+    records.push_back(attribute.GetData());
+  }
 }
 
 void ProcessedFile::AddAttribute(DeviceRecord* record)
@@ -98,27 +117,43 @@ void ProcessedFile::AddAttribute(DeviceRecord* record)
   attributes_.emplace_back(ProcessedFileData(record));
 }
 
+static bool IsAttributeStream(int32_t stream)
+{
+  int32_t masked_stream = stream & STREAMMASK_TYPE;
+  return masked_stream == STREAM_UNIX_ATTRIBUTES
+         || masked_stream == STREAM_UNIX_ATTRIBUTES_EX
+         || masked_stream == STREAM_RESTORE_OBJECT
+         || CryptoDigestStreamType(masked_stream) != CRYPTO_DIGEST_NONE;
+}
+
 bool IsAttribute(DeviceRecord* record)
 {
-  return record->maskedStream == STREAM_UNIX_ATTRIBUTES
-         || record->maskedStream == STREAM_UNIX_ATTRIBUTES_EX
-         || record->maskedStream == STREAM_RESTORE_OBJECT
-         || CryptoDigestStreamType(record->maskedStream) != CRYPTO_DIGEST_NONE;
+  return IsAttributeStream(record->maskedStream);
 }
 
+// Returns false if the attributes could not be sent to the director
 static bool SaveFullyProcessedFilesAttributes(
     JobControlRecord* jcr,
     std::vector<ProcessedFile>& processed_files)
 {
-  if (!processed_files.empty()) {
-    std::for_each(
-        processed_files.begin(), processed_files.end(),
-        [jcr](ProcessedFile& file) { file.SendAttributesToDirector(jcr); });
-    jcr->JobFiles = processed_files.back().GetFileIndex();
-    processed_files.clear();
-    return true;
+  if (processed_files.empty()) { return true; }
+
+  auto timer = jcr->sd_impl->stage_times.Time(append_stage::kAttributes);
+  bool sent;
+  if (jcr->sd_impl->batch_attributes) {
+    std::vector<DeviceRecord> records;
+    for (auto& file : processed_files) { file.CollectAttributes(records); }
+    sent = SendAttrsToDir(jcr, records);
+  } else {
+    sent = std::all_of(processed_files.begin(), processed_files.end(),
+                       [jcr](ProcessedFile& file) {
+                         return file.SendAttributesToDirector(jcr);
+                       });
   }
-  return false;
+  if (!sent) { return false; }
+  jcr->JobFiles = processed_files.back().GetFileIndex();
+  processed_files.clear();
+  return true;
 }
 
 class MessageHandler {
@@ -141,81 +176,377 @@ class MessageHandler {
     std::string msg;
   };
 
-  using result_type = std::variant<signal_type, message_type, error_type>;
+  // The content of the message is still waiting to be read from the socket.
+  struct pending_type {
+    std::size_t size;
+  };
+
+  using result_type
+      = std::variant<signal_type, message_type, error_type, pending_type>;
 
-  MessageHandler(BareosSocket* t_fd)
-      : MessageHandler{t_fd,
-                       // 500 msg reserves at most 256MB in size
-                       // probably much less because of signals
-                       channel::CreateBufferedChannel<result_type>(500)}
+  // 500 msg reserves at most 256MB in size
+  // probably much less because of signals
+  static constexpr std::size_t channel_capacity = 500;
+
+  /* With a striped receiver the messages come from its data connections,
+   * t_fd is then only used to answer. */
+  MessageHandler(BareosSocket* t_fd, StripedReceiver* t_striped = nullptr)
+      : MessageHandler{
+          t_fd, t_striped,
+          channel::CreateSpscChannel<result_type>(channel_capacity)}
   {
   }
 
-  std::optional<result_type> get_msg() { return output.get(); }
+  /* When receiving directly, the content of a message can be left in the
+   * socket (see pending_type) and read into its final place by the caller
+   * with socket()->RecvContent(). */
+  std::optional<result_type> get_msg(bool leave_content = false)
+  {
+    if (!direct) {
+      if (may_overflow) {
+        if (auto msg = TakeOverflowed()) { return msg; }
+      }
+      auto msg = output.get();
+      if (msg) { queued--; }
+      return msg;
+    }
+
+    // First hand out everything the receive thread got before it stopped.
+    if (!output.closed()) {
+      if (auto msg = output.get()) { return msg; }
+      receive_thread.join();
+    }
+
+    return ReceiveMessage(leave_content);
+  }
+
+  /* Stop the receive thread and read all next messages directly. The
+   * thread might wait for room in the channel, so we cannot join it here. */
+  void ReceiveDirectly()
+  {
+    stop_receiving = true;
+    direct = true;
+  }
+
+  /* Instead of making the client wait while the job does not take any
+   * messages (i.e. while it despools), keep them in the file name; but
+   * at most limit bytes of them (0 means no limit). */
+  bool OverflowInto(JobControlRecord* jcr, const char* name, uint64_t limit)
+  {
+    std::unique_lock lock(overflow_mutex);
+    if (direct) { return false; }
+    if (overflow.fd >= 0) { return true; }
+
+    int tfd = open(name, O_CREAT | O_TRUNC | O_RDWR | O_BINARY, 0640);
+    if (tfd < 0) { return false; }
+
+    overflow.jcr = jcr;
+    overflow.name = name;
+    overflow.fd = tfd;
+    overflow.limit = limit;
+    may_overflow = true;
+    return true;
+  }
+
+  bool overflows() const { return may_overflow; }
+  bool striped() const { return striped_receiver != nullptr; }
+
+  BareosSocket* socket() { return fd; }
 
   const char* error()
   {
+    if (striped_receiver) {
+      if (auto striped_error = striped_receiver->error()) {
+        last_striped_error = std::move(striped_error).value();
+        return last_striped_error.c_str();
+      }
+    }
     if (fd->IsError()) { return fd->bstrerror(); }
     return nullptr;
   }
 
   BareosSocket* close_and_get_sock()
   {
+    {
+      std::unique_lock lock(overflow_mutex);
+      stop_receiving = true;
+    }
+    overflow_drained.notify_all();
     output.close();
-    receive_thread.join();
+    if (receive_thread.joinable()) { receive_thread.join(); }
+
+    if (overflow.fd >= 0) {
+      close(overflow.fd);
+      overflow.fd = -1;
+      SecureErase(overflow.jcr, overflow.name.c_str());
+      if (overflow.total > 0) {
+        char ed1[50];
+        Jmsg(overflow.jcr, M_INFO, 0,
+             T_("Kept %s bytes received while despooling in %s.\n"),
+             edit_uint64_with_commas(overflow.total, ed1),
+             overflow.name.c_str());
+      }
+    }
     return fd;
   }
 
  private:
   MessageHandler(BareosSocket* t_fd,
+                 StripedReceiver* t_striped,
                  std::pair<channel::input<result_type>,
                            channel::output<result_type>> chan_pair)
       : fd{t_fd}
+      , striped_receiver{t_striped}
       , input{std::move(chan_pair.first)}
       , output{std::move(chan_pair.second)}
       , receive_thread{enlist, this}
   {
   }
 
+  struct overflow_header {
+    uint32_t kind;  // index of the alternative in result_type
+    int32_t value;  // signal number or type of the error
+    uint64_t size;  // of the content following this header
+  };
+
+  struct overflow_file {
+    JobControlRecord* jcr{nullptr};
+    std::string name;
+    int fd{-1};
+    uint64_t limit{0};
+    uint64_t read_pos{0};
+    uint64_t write_pos{0};
+    uint64_t total{0};
+    // new messages go into the file until everything in it was handed out
+    bool active{false};
+  };
+
   BareosSocket* fd;
+  StripedReceiver* striped_receiver;
+  std::string last_striped_error;
   channel::input<result_type> input;
   channel::output<result_type> output;
+  std::atomic<bool> stop_receiving{false};
+  bool direct{false};
+
+  /* Messages put into the channel but not handed out yet; as long as the
+   * channel is not full, putting a message into it never waits. */
+  std::atomic<std::size_t> queued{0};
+  std::atomic<bool> may_overflow{false};
+  std::mutex overflow_mutex;
+  std::condition_variable overflow_drained;
+  overflow_file overflow;
 
   // receive_thread has to be defined last!
   // The thread created will try to access this class immediately after
   // being created!  As such everything else has to be initialized.
   std::thread receive_thread;
-  void do_work()
+  result_type ReceiveMessage(bool leave_content)
   {
+    PoolMem msg(PM_MESSAGE);
     POOLMEM* save = fd->msg;
+    fd->msg = msg.addr();
+    int n = leave_content ? BgetMsgLength(fd) : BgetMsg(fd);
+    // fd->msg might have been relocated
+    msg.addr() = fd->msg;
+    fd->msg = save;
+
+    if (n == BNET_SIGNAL) {
+      return signal_type{fd->message_length};
+    } else if (n == BNET_HARDEOF) {
+      return error_type{error_type::type::HARDEOF, fd->bstrerror()};
+    } else if (n < 0) {
+      return error_type{error_type::type::INTERNAL_ERROR, fd->bstrerror()};
+    }
+
+    std::size_t length = n;
+    if (leave_content) { return pending_type{length}; }
+    return message_type{length, std::move(msg)};
+  }
+
+  static bool WriteAll(int tfd, const void* data, std::size_t size)
+  {
+    auto* p = static_cast<const char*>(data);
+    while (size > 0) {
+      ssize_t n = write(tfd, p, size);
+      if (n < 0 && errno == EINTR) { continue; }
+      if (n <= 0) { return false; }
+      p += n;
+      size -= n;
+    }
+    return true;
+  }
+
+  static bool ReadAll(int tfd, void* data, std::size_t size)
+  {
+    auto* p = static_cast<char*>(data);
+    while (size > 0) {
+      ssize_t n = read(tfd, p, size);
+      if (n < 0 && errno == EINTR) { continue; }
+      if (n <= 0) { return false; }
+      p += n;
+      size -= n;
+    }
+    return true;
+  }
+
+  // Needs overflow_mutex to be held.
+  bool WriteOverflowed(const result_type& result)
+  {
+    overflow_header hdr{static_cast<uint32_t>(result.index()), 0, 0};
+    const char* content = nullptr;
+    if (auto* signal = std::get_if<signal_type>(&result)) {
+      hdr.value = *signal;
+    } else if (auto* message = std::get_if<message_type>(&result)) {
+      hdr.size = message->size;
+      content = message->data.c_str();
+    } else if (auto* error = std::get_if<error_type>(&result)) {
+      hdr.value = static_cast<int32_t>(error->type);
+      hdr.size = error->msg.size();
+      content = error->msg.c_str();
+    } else {
+      // pending messages only exist when receiving directly
+      return false;
+    }
+
+    uint64_t size = sizeof(hdr) + hdr.size;
+    if (overflow.limit > 0 && overflow.write_pos + size > overflow.limit) {
+      return false;
+    }
+
+    if (lseek(overflow.fd, overflow.write_pos, SEEK_SET) < 0
+        || !WriteAll(overflow.fd, &hdr, sizeof(hdr))
+        || (hdr.size > 0 && !WriteAll(overflow.fd, content, hdr.size))) {
+      BErrNo be;
+      Dmsg2(50, "Could not write to %s: %s\n", overflow.name.c_str(),
+            be.bstrerror());
+      return false;
+    }
+
+    overflow.write_pos += size;
+    overflow.total += size;
+    return true;
+  }
+
+  /* Hand out the oldest message kept in the file; everything in the file
+   * was received after what is still in the channel. */
+  std::optional<result_type> TakeOverflowed()
+  {
+    std::unique_lock lock(overflow_mutex);
+    if (!overflow.active || queued > 0) { return std::nullopt; }
+
+    std::optional<result_type> result;
+    overflow_header hdr{};
+    if (lseek(overflow.fd, overflow.read_pos, SEEK_SET) < 0
+        || !ReadAll(overflow.fd, &hdr, sizeof(hdr))) {
+      result.emplace(error_type{error_type::type::INTERNAL_ERROR,
+                                "could not read " + overflow.name});
+    } else if (hdr.kind == 0) {
+      result.emplace(signal_type{hdr.value});
+    } else if (hdr.kind == 1) {
+      PoolMem data(PM_MESSAGE);
+      data.check_size(hdr.size + 1);
+      if (ReadAll(overflow.fd, data.addr(), hdr.size)) {
+        data.addr()[hdr.size] = 0;
+        result.emplace(message_type{hdr.size, std::move(data)});
+      }
+    } else if (hdr.kind == 2) {
+      std::string msg(hdr.size, '\0');
+      if (ReadAll(overflow.fd, msg.data(), hdr.size)) {
+        using error_kind = decltype(error_type::type);
+        result.emplace(error_type{static_cast<error_kind>(hdr.value),
+                                  std::move(msg)});
+      }
+    }
+    if (!result) {
+      result.emplace(error_type{error_type::type::INTERNAL_ERROR,
+                                "corrupt message in " + overflow.name});
+    }
+
+    overflow.read_pos += sizeof(hdr) + hdr.size;
+    if (overflow.read_pos >= overflow.write_pos) {
+      // everything was handed out; the next messages go to the channel again
+      overflow.read_pos = overflow.write_pos = 0;
+      overflow.active = false;
+      lock.unlock();
+      overflow_drained.notify_all();
+    }
+    return result;
+  }
+
+  bool PutMessage(result_type&& result)
+  {
+    if (may_overflow) {
+      std::unique_lock lock(overflow_mutex);
+      if (overflow.active || queued >= channel_capacity) {
+        if (WriteOverflowed(result)) {
+          overflow.active = true;
+          return true;
+        }
+        // the file is full, so wait until everything in it was handed out
+        overflow_drained.wait(
+            lock, [this] { return !overflow.active || stop_receiving; });
+        if (stop_receiving) { return false; }
+      }
+      queued++;
+    } else {
+      queued++;
+    }
+
+    return input.emplace(std::move(result));
+  }
+
+  // Like do_work(), but the messages come from the striped receiver.
+  void ReceiveStriped()
+  {
     bool cont = true;
-    for (int res = 0; cont; res = fd->WaitData(0, 100'000)) {
-      if (res == fd->DataAvailable) {
-        PoolMem msg(PM_MESSAGE);
-        fd->msg = msg.addr();
-        result_type result;
-        int n = BgetMsg(fd);
-        // fd->msg might have been relocated
-        msg.addr() = fd->msg;
-        if (n < 0) {
-          if (n == BNET_SIGNAL) {
-            result = signal_type{fd->message_length};
-            // break; /* end of data */
-          } else if (n == BNET_HARDEOF) {
-            result = error_type{error_type::type::HARDEOF, fd->bstrerror()};
-            cont = false;
-          } else {
-            result
-                = error_type{error_type::type::INTERNAL_ERROR, fd->bstrerror()};
-            cont = false;
-          }
-        } else {
-          std::size_t length = n;
-          result = message_type{length, std::move(msg)};
+    while (cont && !stop_receiving && !input.closed()) {
+      PoolMem msg(PM_MESSAGE);
+      int32_t signal = 0;
+      auto n = striped_receiver->Receive(msg, signal,
+                                         std::chrono::milliseconds(100));
+      if (!n) {
+        input.try_update_status();
+        continue;
+      }
+
+      result_type result;
+      if (*n == BNET_SIGNAL) {
+        if (signal == BNET_HEARTBEAT || signal == BNET_HB_RESPONSE) {
+          continue;
         }
-        fd->msg = nullptr;
+        result = signal_type{signal};
+      } else if (*n < 0) {
+        auto type = *n == BNET_HARDEOF ? error_type::type::HARDEOF
+                                       : error_type::type::INTERNAL_ERROR;
+        result = error_type{type, striped_receiver->error().value_or(
+                                      "data connections ended")};
+        cont = false;
+      } else {
+        result = message_type{static_cast<std::size_t>(*n), std::move(msg)};
+      }
+
+      if (!PutMessage(std::move(result))) {
+        Dmsg1(20, "Tried to put message into queue; but it did not succeed.\n");
+        cont = false;
+      }
+    }
+
+    input.close();
+  }
+
+  void do_work()
+  {
+    if (striped_receiver) { return ReceiveStriped(); }
 
-        if (!input.emplace(std::move(result))) {
+    bool cont = true;
+    for (int res = 0; cont && !stop_receiving;
+         res = fd->WaitData(0, 100'000)) {
+      if (res == fd->DataAvailable) {
+        result_type result = ReceiveMessage(false);
+        if (std::holds_alternative<error_type>(result)) { cont = false; }
+
+        if (!PutMessage(std::move(result))) {
           if (input.closed()) {
             Dmsg1(20, "Tried to put message into closed queue.\n");
           } else {
@@ -235,8 +566,6 @@ class MessageHandler {
     }
 
     input.close();
-
-    fd->msg = save;
   }
 
   static void enlist(MessageHandler* handler) { handler->do_work(); }
@@ -327,7 +656,58 @@ static bool SetupDCR(JobControlRecord* jcr,
   return true;
 }
 
-// Append Data sent from File daemon
+/* Data records can be received directly into the device block unless a
+ * plugin wants to translate them or they get mirrored, which needs them in
+ * memory. */
+static bool CanReceiveDirectly(JobControlRecord* jcr)
+{
+  return me->direct_data_receive && jcr->sd_impl->dcr
+         && !jcr->sd_impl->remote_replicate
+         && !IsPluginEventEnabled(jcr, bSdEventWriteRecordTranslation);
+}
+
+/* Let the receive thread keep reading from the client while the job
+ * despools. */
+static void ReceiveWhileDespooling(JobControlRecord* jcr,
+                                   MessageHandler& handler)
+{
+  DeviceControlRecord* dcr = jcr->sd_impl->dcr;
+  if (!dcr || !dcr->spooling
+      || !dcr->dev->device_resource->spool_while_despooling) {
+    return;
+  }
+
+  PoolMem name(PM_FNAME);
+  MakeReceiveSpoolFilename(dcr, name.addr());
+  if (handler.OverflowInto(jcr, name.c_str(), dcr->max_job_spool_size)) {
+    Dmsg1(100, "Receiving into %s while despooling\n", name.c_str());
+  } else {
+    BErrNo be;
+    Jmsg(jcr, M_WARNING, 0,
+         T_("Open of %s failed, the client will wait while despooling. "
+            "ERR=%s\n"),
+         name.c_str(), be.bstrerror());
+  }
+}
+
+/* We make sure the file_index is advancing sequentially.  An incomplete job
+ * that gets rerun or resumed can start the file_index at any number,
+ * otherwise it must start at 1. */
+bool FileIndexIsSequential(bool rerunning,
+                           int32_t file_index,
+                           int32_t last_file_index)
+{
+  if (file_index <= 0) { return false; }
+  if (rerunning && last_file_index == 0) { return true; }
+  return file_index == last_file_index || file_index == last_file_index + 1;
+}
+
+/* Append Data sent from File daemon
+ *
+ * All data of a job goes through the single dcr in jcr->sd_impl->dcr, i.e.
+ * to one device and one volume at a time; reservation, spooling, the JobMedia
+ * records and the bootstrap all depend on that.  To use several drives for
+ * one big fileset, split it into several jobs that run concurrently. */
 bool DoAppendData(JobControlRecord* jcr, BareosSocket* bs, const char* what)
 {
   int32_t n, file_index, stream, last_file_index, job_elapsed;
@@ -401,7 +781,34 @@ bool DoAppendData(JobControlRecord* jcr, BareosSocket* bs, const char* what)
           cloned->fd_, cloned->errmsg);
     return false;
   }
-  MessageHandler handler(cloned);
+  // the clone only writes, so bs may read ahead the many small messages
+  bs->EnableReceiveBuffer();
+  /* The data connections the FD announced with "append data" (see
+   * AppendDataCmd()); the job connection then only carries the replies. */
+  std::vector<BareosSocket*> data_connections;
+  std::unique_ptr<StripedReceiver> striped;
+  if (bs == jcr->file_bsock && jcr->sd_impl->expected_data_connections > 0) {
+    std::swap(data_connections, *jcr->sd_impl->data_connections.lock());
+    for (BareosSocket* sock : data_connections) { sock->SetJcr(jcr); }
+    striped = std::make_unique<StripedReceiver>(
+        data_connections, 16 * data_connections.size());
+    Jmsg(jcr, M_INFO, 0, T_("Receiving data over %d connections.\n"),
+         static_cast<int>(data_connections.size()));
+  }
+
+  MessageHandler handler(cloned, striped.get());
+  bool receive_directly = false;
+  ReceiveWhileDespooling(jcr, handler);
+
+  /* The director asked to write the backup to a second storage daemon as
+   * well (see ReplicateCmd()), every record is sent there once written. */
+  bool mirroring = ok && bs == jcr->file_bsock
+                   && jcr->sd_impl->remote_replicate && jcr->store_bsock;
+  if (mirroring) {
+    Jmsg(jcr, M_INFO, 0, T_("Mirroring the backup to a second storage.\n"));
+    if (!StartReplicateSession(jcr)) { ok = mirroring = false; }
+  }
+  bool mirrored_any = false;
 
   for (last_file_index = 0; ok && !jcr->IsJobCanceled();) {
     /* Read Stream header from the daemon.
@@ -411,7 +818,10 @@ bool DoAppendData(JobControlRecord* jcr, BareosSocket* bs, const char* what)
      * - stream     (Bareos number to distinguish parts of data)
      * - info       (Info for Storage daemon -- compressed, encrypted, ...)
      *               info is not currently used, so is read, but ignored! */
-    auto msg = handler.get_msg();
+    auto msg = [&] {
+      auto wait = jcr->sd_impl->stage_times.TimeWait(append_stage::kReceive);
+      return handler.get_msg();
+    }();
     if (!msg) {
       Jmsg2(jcr, M_FATAL, 0,
             T_("Internal Error reading data header from %s.\n"), what);
@@ -422,6 +832,7 @@ bool DoAppendData(JobControlRecord* jcr, BareosSocket* bs, const char* what)
     using signal_type = MessageHandler::signal_type;
     using message_type = MessageHandler::message_type;
     using error_type = MessageHandler::error_type;
+    using pending_type = MessageHandler::pending_type;
 
     if (auto* error = std::get_if<error_type>(&msg.value())) {
       Jmsg2(jcr, M_FATAL, 0, T_("Error reading data header from %s. ERR=%s\n"),
@@ -451,17 +862,7 @@ bool DoAppendData(JobControlRecord* jcr, BareosSocket* bs, const char* what)
 
     Dmsg2(890, "<filed: Header FilInx=%d stream=%d\n", file_index, stream);
 
-    /* We make sure the file_index is advancing sequentially.
-     * An incomplete job can start the file_index at any number.
-     * otherwise, it must start at 1. */
-
-    bool incomplete_job_rerun_fileindex_positive
-        = jcr->rerunning && file_index > 0 && last_file_index == 0;
-    bool fileindex_is_sequential = file_index > 0
-                                   && (file_index == last_file_index
-                                       || file_index == last_file_index + 1);
-
-    if (!incomplete_job_rerun_fileindex_positive && !fileindex_is_sequential) {
+    if (!FileIndexIsSequential(jcr->rerunning, file_index, last_file_index)) {
       Jmsg3(jcr, M_FATAL, 0,
             T_("FileIndex=%d from %s not positive or sequential=%d\n"),
             file_index, what, last_file_index);
@@ -481,8 +882,24 @@ bool DoAppendData(JobControlRecord* jcr, BareosSocket* bs, const char* what)
      * We save the original data pointer from the record so we can restore
      * that after the loop ends. */
     POOLMEM* rec_data = nullptr;
+    bool new_stream = true;
     while (!jcr->IsJobCanceled()) {
-      auto msg2 = handler.get_msg();
+      /* Receiving directly stops the receive thread, which would also
+       * stop receiving while the job despools. */
+      if (!receive_directly && !handler.overflows() && !handler.striped()
+          && CanReceiveDirectly(jcr)) {
+        Dmsg0(100, "Receiving data directly into the device blocks\n");
+        handler.ReceiveDirectly();
+        receive_directly = true;
+      }
+
+      /* Attributes are also sent to the director, so they have to be kept
+       * in memory. */
+      auto msg2 = [&] {
+        auto wait
+            = jcr->sd_impl->stage_times.TimeWait(append_stage::kReceive);
+        return handler.get_msg(receive_directly && !IsAttributeStream(stream));
+      }();
 
       if (!msg2) {
         Jmsg2(jcr, M_FATAL, 0, T_("Internal Error reading data from %s.\n"),
@@ -508,8 +925,15 @@ bool DoAppendData(JobControlRecord* jcr, BareosSocket* bs, const char* what)
         break;
       }
 
-      auto content2 = std::get<message_type>(std::move(msg2).value());
-      n = content2.size;
+      std::optional<message_type> content2;
+      std::size_t size;
+      if (auto* pending = std::get_if<pending_type>(&msg2.value())) {
+        size = pending->size;
+      } else {
+        content2 = std::get<message_type>(std::move(msg2).value());
+        size = content2->size;
+      }
+      n = size;
 
       if (!jcr->sd_impl->dcr) {
         Jmsg(jcr, M_INFO, 0,
@@ -518,6 +942,7 @@ bool DoAppendData(JobControlRecord* jcr, BareosSocket* bs, const char* what)
           ok = false;
           break;
         }
+        ReceiveWhileDespooling(jcr, handler);
       }
 
       if (rec_data == nullptr) { rec_data = jcr->sd_impl->dcr->rec->data; }
@@ -527,9 +952,13 @@ bool DoAppendData(JobControlRecord* jcr, BareosSocket* bs, const char* what)
       jcr->sd_impl->dcr->rec->Stream = stream;
       jcr->sd_impl->dcr->rec->maskedStream
           = stream & STREAMMASK_TYPE; /* strip high bits */
-      jcr->sd_impl->dcr->rec->data_len = content2.size;
-      jcr->sd_impl->dcr->rec->data
-          = content2.data.addr(); /* use message buffer */
+      jcr->sd_impl->dcr->rec->data_len = size;
+      if (content2) {
+        jcr->sd_impl->dcr->rec->data
+            = content2->data.addr(); /* use message buffer */
+      } else {
+        jcr->sd_impl->dcr->rec->data = rec_data; /* data goes to the block */
+      }
 
       Dmsg4(850, "before writ_rec FI=%d SessId=%d Strm=%s len=%d\n",
             jcr->sd_impl->dcr->rec->FileIndex,
@@ -538,7 +967,11 @@ bool DoAppendData(JobControlRecord* jcr, BareosSocket* bs, const char* what)
                             jcr->sd_impl->dcr->rec->FileIndex),
             jcr->sd_impl->dcr->rec->data_len);
 
-      ok = jcr->sd_impl->dcr->WriteRecord();
+      if (content2) {
+        ok = jcr->sd_impl->dcr->WriteRecord();
+      } else {
+        ok = jcr->sd_impl->dcr->ReceiveRecord(handler.socket());
+      }
       if (!ok) {
         Dmsg2(90, "Got WriteBlockToDev error on device %s. %s\n",
               jcr->sd_impl->dcr->dev->print_name(),
@@ -546,6 +979,14 @@ bool DoAppendData(JobControlRecord* jcr, BareosSocket* bs, const char* what)
         break;
       }
 
+      if (mirroring) {
+        ok = SendRecordToRemoteSd(jcr, jcr->sd_impl->dcr->rec,
+                                  new_stream && mirrored_any, new_stream);
+        if (!ok) { break; }
+        mirrored_any = true;
+        new_stream = false;
+      }
+
       if (IsAttribute(jcr->sd_impl->dcr->rec)) {
         file_currently_processed.AddAttribute(jcr->sd_impl->dcr->rec);
       }
@@ -556,14 +997,20 @@ bool DoAppendData(JobControlRecord* jcr, BareosSocket* bs, const char* what)
           = jcr->sd_impl->dcr->VolMediaId != current_volumeid && block_changed;
 
       if (AttributesAreSpooled(jcr)) {
-        SaveFullyProcessedFilesAttributes(jcr, processed_files);
+        if (!SaveFullyProcessedFilesAttributes(jcr, processed_files)) {
+          ok = false;
+          break;
+        }
       } else {
         if (block_changed) {
           current_block_number = jcr->sd_impl->dcr->block->BlockNumber;
-          if (SaveFullyProcessedFilesAttributes(jcr, processed_files)) {
-            if (checkpoints_enabled) {
-              checkpoint_handler.SetReadyForCheckpoint();
-            }
+          bool files_done = !processed_files.empty();
+          if (!SaveFullyProcessedFilesAttributes(jcr, processed_files)) {
+            ok = false;
+            break;
+          }
+          if (files_done && checkpoints_enabled) {
+            checkpoint_handler.SetReadyForCheckpoint();
           }
         }
 
@@ -596,6 +1043,9 @@ bool DoAppendData(JobControlRecord* jcr, BareosSocket* bs, const char* what)
     }
   }
 
+  // the mirror ends up incomplete if this job failed
+  if (mirroring && !EndReplicateSession(jcr)) { ok = false; }
+
   {
     // delete the copy
     auto* copy = handler.close_and_get_sock();
@@ -603,6 +1053,16 @@ bool DoAppendData(JobControlRecord* jcr, BareosSocket* bs, const char* what)
     delete copy;
   }
 
+  if (striped) {
+    striped->Stop();
+    striped.reset();
+    for (BareosSocket* sock : data_connections) {
+      sock->close();
+      delete sock;
+    }
+    jcr->sd_impl->expected_data_connections = 0;
+  }
+
   // Create Job status for end of session label
   jcr->setJobStatusWithPriorityCheck(ok ? JS_Terminated : JS_ErrorTerminated);
 
@@ -655,7 +1115,10 @@ bool DoAppendData(JobControlRecord* jcr, BareosSocket* bs, const char* what)
         if (file_currently_processed.GetFileIndex() > 0) {
           processed_files.push_back(std::move(file_currently_processed));
         }
-        SaveFullyProcessedFilesAttributes(jcr, processed_files);
+        if (!SaveFullyProcessedFilesAttributes(jcr, processed_files)) {
+          jcr->setJobStatusWithPriorityCheck(JS_ErrorTerminated);
+          ok = false;
+        }
       }
     }
 
@@ -689,6 +1152,11 @@ bool DoAppendData(JobControlRecord* jcr, BareosSocket* bs, const char* what)
        T_("Elapsed time=%02d:%02d:%02d, Transfer rate=%s Bytes/second\n"),
        job_elapsed / 3600, job_elapsed % 3600 / 60, job_elapsed % 60,
        edit_uint64_with_suffix(jcr->JobBytes / job_elapsed, ec));
+  if (std::string stages
+      = jcr->sd_impl->stage_times.Format(append_stage_names);
+      !stages.empty()) {
+    Jmsg(jcr, M_INFO, 0, T_("Append stages: %s\n"), stages.c_str());
+  }
 
   if ((!ok || jcr->IsJobCanceled()) && !jcr->is_JobStatus(JS_Incomplete)) {
     DiscardAttributeSpool(jcr);
@@ -719,4 +1187,24 @@ bool SendAttrsToDir(JobControlRecord* jcr, DeviceRecord* rec)
   }
   return true;
 }
+
+// Send the attributes of several files in as few messages as possible
+bool SendAttrsToDir(JobControlRecord* jcr,
+                    const std::vector<DeviceRecord>& records)
+{
+  if (!jcr->sd_impl->no_attributes && !records.empty()) {
+    BareosSocket* dir = jcr->dir_bsock;
+    if (AttributesAreSpooled(jcr)) { dir->SetSpooling(); }
+    Dmsg1(850, "Send %d attributes to dir.\n", (int)records.size());
+    if (!jcr->sd_impl->dcr->DirUpdateFileAttributeBatch(records.data(),
+                                                        records.size())) {
+      Jmsg(jcr, M_FATAL, 0, T_("Error updating file attributes. ERR=%s\n"),
+           dir->bstrerror());
+      dir->ClearSpooling();
+      return false;
+    }
+    dir->ClearSpooling();
+  }
+  return true;
+}
 } /* namespace storagedaemon */
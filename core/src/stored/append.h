@@ -48,7 +48,8 @@ class ProcessedFile {
   ProcessedFile() = default;
   explicit ProcessedFile(int32_t fileindex);
 
-  void SendAttributesToDirector(JobControlRecord* jcr);
+  bool SendAttributesToDirector(JobControlRecord* jcr);
+  void CollectAttributes(std::vector<DeviceRecord>& records);
   void AddAttribute(DeviceRecord* record);
   int32_t GetFileIndex() { return fileindex_; }
   const std::vector<ProcessedFileData>& GetAttributes() const
@@ -61,9 +62,14 @@ class ProcessedFile {
   std::vector<ProcessedFileData> attributes_;
 };
 
+bool FileIndexIsSequential(bool rerunning,
+                           int32_t file_index,
+                           int32_t last_file_index);
 bool DoAppendData(JobControlRecord* jcr, BareosSocket* bs, const char* what);
 bool IsAttribute(DeviceRecord* record);
 bool SendAttrsToDir(JobControlRecord* jcr, DeviceRecord* rec);
+bool SendAttrsToDir(JobControlRecord* jcr,
+                    const std::vector<DeviceRecord>& records);
 }  // namespace storagedaemon
 
 #endif  // BAREOS_STORED_APPEND_H_
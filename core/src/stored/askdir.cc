@@ -40,6 +40,7 @@
 #include "stored/wait.h"
 #include "stored/dev.h"
 #include "lib/edit.h"
+#include "lib/message_builder.h"
 #include "lib/util.h"
 #include "lib/berrno.h"
 #include "lib/bsock.h"
@@ -65,13 +66,31 @@ static char Create_job_media[]
     = "CatReq Job=%s CreateJobMedia"
       " FirstIndex=%u LastIndex=%u StartFile=%u EndFile=%u"
       " StartBlock=%u EndBlock=%u Copy=%d Strip=%d MediaId=%s\n";
+static char Create_job_media_batch[]
+    = "CatReq Job=%s CreateJobMediaBatch Count=%u\n";
+static char Job_media_batch_record[] = "%u %u %u %u %u %u %d %d %s\n";
+
+/* JobMedia records for new files on a volume are sent together once there
+ * are this many, at the latest at the next checkpoint or volume change. */
+static constexpr std::size_t max_queued_jobmedia = 100;
 
 static char Update_filelist[] = "Catreq Job=%s UpdateFileList\n";
 
 static char Update_jobrecord[]
     = "Catreq Job=%s UpdateJobRecord JobFiles=%lu JobBytes=%llu\n";
 
-static char FileAttributes[] = "UpdCat Job=%s FileAttributes ";
+/* The attribute messages are "UpdCat Job=<job> FileAttributes " and
+ * "UpdCat Job=<job> FileAttributesBatch " followed by binary data.  They are
+ * sent for every file, so they are built without Bsnprintf(). */
+
+/* Limits for a single FileAttributesBatch message.  The size limit keeps
+ * the message well below the maximal network packet size. */
+static constexpr std::size_t max_batch_records = 1000;
+static constexpr std::size_t max_batch_size = 256 * 1024;
+
+/* Serialized size of VolSessionId, VolSessionTime, FileIndex, Stream and
+ * data length in front of each record. */
+static constexpr std::size_t record_header_size = 5 * sizeof(uint32_t);
 
 
 /* Responses received from the Director */
@@ -337,33 +356,54 @@ bail_out:
   return ok;
 }
 
-// After writing a Volume, create the JobMedia record.
-bool StorageDaemonDeviceControlRecord::DirCreateJobmediaRecord(bool zero)
+// Remember the JobMedia record for what was written since the last one.
+void StorageDaemonDeviceControlRecord::QueueJobmediaRecord(bool zero)
 {
-  BareosSocket* dir = jcr->dir_bsock;
-  char ed1[50];
-
-  // If system job, do not update catalog
-  if (jcr->is_JobType(JT_SYSTEM)) { return true; }
-
   // Throw out records where FI is zero -- i.e. nothing done
   if (!zero && VolFirstIndex == 0 && (StartBlock != 0 || EndBlock != 0)) {
     Dmsg0(debuglevel, "JobMedia FI=0 StartBlock!=0 record suppressed\n");
-    return true;
+    return;
   }
 
-  if (!WroteVol) { return true; /* nothing written to tape */ }
+  if (!WroteVol) { return; /* nothing written to tape */ }
 
   WroteVol = false;
   if (zero) {
     // Send dummy place holder to avoid purging
-    dir->fsend(Create_job_media, jcr->Job, 0, 0, 0, 0, 0, 0, 0, 0,
-               edit_uint64(VolMediaId, ed1));
+    queued_jobmedia_.push_back({0, 0, 0, 0, 0, 0, 0, 0, VolMediaId});
   } else {
-    dir->fsend(Create_job_media, jcr->Job, VolFirstIndex, VolLastIndex,
-               StartFile, EndFile, StartBlock, EndBlock, Copy, Stripe,
-               edit_uint64(VolMediaId, ed1));
+    queued_jobmedia_.push_back({VolFirstIndex, VolLastIndex, StartFile,
+                                EndFile, StartBlock, EndBlock, Copy, Stripe,
+                                VolMediaId});
   }
+}
+
+// Send the queued JobMedia records in one message.
+bool StorageDaemonDeviceControlRecord::SendQueuedJobmediaRecords()
+{
+  if (queued_jobmedia_.empty()) { return true; }
+
+  BareosSocket* dir = jcr->dir_bsock;
+  char ed1[50];
+
+  if (queued_jobmedia_.size() == 1) {
+    const queued_jobmedia& jm = queued_jobmedia_.front();
+    dir->fsend(Create_job_media, jcr->Job, jm.FirstIndex, jm.LastIndex,
+               jm.StartFile, jm.EndFile, jm.StartBlock, jm.EndBlock, jm.Copy,
+               jm.Stripe, edit_uint64(jm.MediaId, ed1));
+  } else {
+    PoolMem message(PM_MESSAGE), record(PM_NAME);
+    Mmsg(message, Create_job_media_batch, jcr->Job,
+         static_cast<uint32_t>(queued_jobmedia_.size()));
+    for (const queued_jobmedia& jm : queued_jobmedia_) {
+      Mmsg(record, Job_media_batch_record, jm.FirstIndex, jm.LastIndex,
+           jm.StartFile, jm.EndFile, jm.StartBlock, jm.EndBlock, jm.Copy,
+           jm.Stripe, edit_uint64(jm.MediaId, ed1));
+      message.strcat(record);
+    }
+    dir->fsend("%s", message.c_str());
+  }
+  queued_jobmedia_.clear();
   Dmsg1(debuglevel, ">dird %s", dir->msg);
 
   if (dir->recv() <= 0) {
@@ -383,6 +423,30 @@ bool StorageDaemonDeviceControlRecord::DirCreateJobmediaRecord(bool zero)
   return true;
 }
 
+/**
+ * After writing a Volume, create the JobMedia record.  The records queued
+ * with DirQueueJobmediaRecord() are sent along with it.
+ */
+bool StorageDaemonDeviceControlRecord::DirCreateJobmediaRecord(bool zero)
+{
+  // If system job, do not update catalog
+  if (jcr->is_JobType(JT_SYSTEM)) { return true; }
+
+  QueueJobmediaRecord(zero);
+  return SendQueuedJobmediaRecords();
+}
+
+// Create the JobMedia record for a new file on the same volume.
+bool StorageDaemonDeviceControlRecord::DirQueueJobmediaRecord()
+{
+  // If system job, do not update catalog
+  if (jcr->is_JobType(JT_SYSTEM)) { return true; }
+
+  QueueJobmediaRecord(false);
+  if (queued_jobmedia_.size() < max_queued_jobmedia) { return true; }
+  return SendQueuedJobmediaRecords();
+}
+
 /**
  * Update File Attribute data
  * We do the following:
@@ -411,12 +475,14 @@ bool StorageDaemonDeviceControlRecord::DirUpdateFileAttributes(
   return true;
 #endif
 
+  {
+    MessageBuilder message(dir->msg);
+    message << "UpdCat Job=" << jcr->Job << " FileAttributes ";
+    dir->message_length = message.size();
+  }
   dir->msg = CheckPoolMemorySize(
-      dir->msg, sizeof(FileAttributes) + MAX_NAME_LENGTH + sizeof(DeviceRecord)
-                    + record->data_len + 1);
-  dir->message_length
-      = Bsnprintf(dir->msg, sizeof(FileAttributes) + MAX_NAME_LENGTH + 1,
-                  FileAttributes, jcr->Job);
+      dir->msg, dir->message_length + sizeof(DeviceRecord) + record->data_len
+                    + 1);
   SerBegin(dir->msg + dir->message_length, 0);
   ser_uint32(record->VolSessionId);
   ser_uint32(record->VolSessionTime);
@@ -430,6 +496,66 @@ bool StorageDaemonDeviceControlRecord::DirUpdateFileAttributes(
   return dir->send();
 }
 
+/**
+ * Same as DirUpdateFileAttributes(), but puts as many records as possible
+ * into a single FileAttributesBatch message, whose body is just the
+ * serialized records one after the other.  Only used when the Director told
+ * us in the job command that it understands these messages.
+ */
+bool StorageDaemonDeviceControlRecord::DirUpdateFileAttributeBatch(
+    const DeviceRecord* records,
+    std::size_t count)
+{
+  BareosSocket* dir = jcr->dir_bsock;
+  ser_declare;
+
+#ifdef NO_ATTRIBUTES_TEST
+  return true;
+#endif
+
+  std::size_t i = 0;
+  while (i < count) {
+    // records that do not fit into a batch are sent on their own
+    if (record_header_size + records[i].data_len > max_batch_size) {
+      DeviceRecord record = records[i++];
+      if (!DirUpdateFileAttributes(&record)) { return false; }
+      continue;
+    }
+
+    {
+      MessageBuilder message(dir->msg);
+      message << "UpdCat Job=" << jcr->Job << " FileAttributesBatch ";
+      dir->message_length = message.size();
+    }
+    std::size_t batched = 0, batch_size = 0;
+    while (i < count && batched < max_batch_records) {
+      const DeviceRecord& record = records[i];
+      std::size_t size = record_header_size + record.data_len;
+      if (batch_size + size > max_batch_size) { break; }
+
+      dir->msg = CheckPoolMemorySize(dir->msg, dir->message_length + size + 1);
+      SerBegin(dir->msg + dir->message_length, 0);
+      ser_uint32(record.VolSessionId);
+      ser_uint32(record.VolSessionTime);
+      ser_int32(record.FileIndex);
+      ser_int32(record.Stream);
+      ser_uint32(record.data_len);
+      SerBytes(record.data, record.data_len);
+      dir->message_length = SerLength(dir->msg);
+
+      batch_size += size;
+      ++batched;
+      ++i;
+    }
+
+    Dmsg2(1800, ">dird %d attributes in %d bytes\n", (int)batched,
+          dir->message_length);
+    if (!dir->send()) { return false; }
+  }
+
+  return true;
+}
+
 /**
  * Request the sysop to create an appendable volume
  *
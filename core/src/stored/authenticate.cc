@@ -194,6 +194,32 @@ bool AuthenticateFiledaemon(JobControlRecord* jcr)
   return true;
 }
 
+/**
+ * Authenticate an additional data connection of a File daemon.
+ *
+ * The connection is not the one of the job, so the outcome neither changes
+ * whether the job is authenticated nor does a failure fail the job.
+ */
+bool AuthenticateFiledaemonDataConnection(JobControlRecord* jcr,
+                                          BareosSocket* fd)
+{
+  s_password password;
+
+  password.encoding = p_encoding_md5;
+  password.value = jcr->sd_auth_key;
+
+  if (!fd->AuthenticateInboundConnection(nullptr, my_config, jcr->client_name,
+                                         password, me)) {
+    Jmsg1(jcr, M_WARNING, 0,
+          T_("Authorization problem: Two way security handshake failed with "
+             "data connection of File daemon at %s\n"),
+          fd->who());
+    return false;
+  }
+
+  return true;
+}
+
 /**
  * Authenticate with a remote file daemon.
  *
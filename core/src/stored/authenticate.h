@@ -28,6 +28,8 @@ bool AuthenticateDirector(JobControlRecord* jcr);
 bool AuthenticateStoragedaemon(JobControlRecord* jcr);
 bool AuthenticateWithStoragedaemon(JobControlRecord* jcr);
 bool AuthenticateFiledaemon(JobControlRecord* jcr);
+bool AuthenticateFiledaemonDataConnection(JobControlRecord* jcr,
+                                          BareosSocket* fd);
 bool AuthenticateWithFiledaemon(JobControlRecord* jcr);
 
 } /* namespace storagedaemon */
@@ -44,7 +44,7 @@
 namespace storagedaemon {
 
 /* Forward referenced functions */
-static bool LockChanger(DeviceControlRecord* dcr);
+static bool LockChanger(DeviceControlRecord* dcr, bool whole_changer = false);
 static bool UnlockChanger(DeviceControlRecord* dcr);
 static bool UnloadOtherDrive(DeviceControlRecord* dcr,
                              slot_number_t slot,
@@ -360,24 +360,21 @@ slot_number_t GetAutochangerLoadedSlot(DeviceControlRecord* dcr, bool lock_set)
   return loaded_slot;
 }
 
-static bool LockChanger(DeviceControlRecord* dcr)
+/* Without "Maximum Concurrent Operations" this allows one changer operation
+ * at a time, otherwise operations on different drives can overlap. */
+static bool LockChanger(DeviceControlRecord* dcr, bool whole_changer)
 {
   AutochangerResource* changer_res = dcr->device_resource->changer_res;
 
   if (changer_res) {
-    int errstat;
     Dmsg1(200, "Locking changer %s\n", changer_res->resource_name_);
-    if ((errstat = RwlWritelock(&changer_res->changer_lock)) != 0) {
-      BErrNo be;
-      Jmsg(dcr->jcr, M_ERROR_TERM, 0,
-           T_("Lock failure on autochanger. ERR=%s\n"), be.bstrerror(errstat));
-    }
+    changer_res->operations->Lock(whole_changer ? nullptr : dcr->dev);
 
     /* We just locked the changer for exclusive use so let any plugin know we
      * have. */
     if (GeneratePluginEvent(dcr->jcr, bSdEventChangerLock, dcr) != bRC_OK) {
       Dmsg0(100, "Locking changer: bSdEventChangerLock failed\n");
-      RwlWriteunlock(&changer_res->changer_lock);
+      changer_res->operations->Unlock();
       return false;
     }
   }
@@ -390,17 +387,10 @@ static bool UnlockChanger(DeviceControlRecord* dcr)
   AutochangerResource* changer_res = dcr->device_resource->changer_res;
 
   if (changer_res) {
-    int errstat;
-
     GeneratePluginEvent(dcr->jcr, bSdEventChangerUnlock, dcr);
 
     Dmsg1(200, "Unlocking changer %s\n", changer_res->resource_name_);
-    if ((errstat = RwlWriteunlock(&changer_res->changer_lock)) != 0) {
-      BErrNo be;
-      Jmsg(dcr->jcr, M_ERROR_TERM, 0,
-           T_("Unlock failure on autochanger. ERR=%s\n"),
-           be.bstrerror(errstat));
-    }
+    changer_res->operations->Unlock();
   }
 
   return true;
@@ -513,6 +503,15 @@ static bool UnloadOtherDrive(DeviceControlRecord* dcr,
   for (auto* device_resource : changer->device_resources) {
     dev = device_resource->dev;
     if (!dev) { continue; }
+
+    /* A drive another operation is loading or unloading right now cannot
+     * hold the slot we want when that operation is done. */
+    if (!changer->operations->ClaimDrive(dev)) {
+      Dmsg1(100, "Skipping %s, changer operation running\n",
+            dev->print_name());
+      continue;
+    }
+
     dev_save = dcr->dev;
     dcr->SetDev(dev);
 
@@ -522,6 +521,7 @@ static bool UnloadOtherDrive(DeviceControlRecord* dcr,
 
     if (slotnumber_not_set && slot_not_loaded_in_autochanger) {
       dcr->SetDev(dev_save);
+      changer->operations->ReleaseDrive(dev);
       continue;
     }
 
@@ -530,6 +530,7 @@ static bool UnloadOtherDrive(DeviceControlRecord* dcr,
       found = true;
       break;
     }
+    changer->operations->ReleaseDrive(dev);
   }
   if (!found) {
     Dmsg1(100, "Slot=%hd not found in another device\n", slot);
@@ -545,8 +546,9 @@ static bool UnloadOtherDrive(DeviceControlRecord* dcr,
   }
 
   for (int i = 0; i < 3; i++) {
+    uint64_t releases = DeviceReleases();
     if (dev->IsBusy() || dev->IsBlocked()) {
-      WaitForDevice(dcr->jcr, retries);
+      WaitForDevice(dcr->jcr, retries, releases);
       continue;
     }
     break;
@@ -696,7 +698,7 @@ bool AutochangerCmd(DeviceControlRecord* dcr,
   }
 
   changer = GetPoolMemory(PM_FNAME);
-  LockChanger(dcr);
+  LockChanger(dcr, true);
   changer = edit_device_codes(dcr, changer,
                               dcr->device_resource->changer_command, cmd);
   dir->fsend(T_("3306 Issuing autochanger \"%s\" command.\n"), cmd);
@@ -776,7 +778,7 @@ bool AutochangerTransferCmd(DeviceControlRecord* dcr,
   }
 
   changer = GetPoolMemory(PM_FNAME);
-  LockChanger(dcr);
+  LockChanger(dcr, true);
   changer = transfer_edit_device_codes(dcr, changer,
                                        dcr->device_resource->changer_command,
                                        "transfer", src_slot, dst_slot);
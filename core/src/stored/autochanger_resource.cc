@@ -26,13 +26,99 @@
 #include "stored/device_resource.h"
 #include "stored/stored_globals.h"
 
+#include <algorithm>
+
 namespace storagedaemon {
 
+void ChangerOperations::Lock(const Device* drive)
+{
+  std::unique_lock lock(mutex_);
+  auto self = std::this_thread::get_id();
+
+  if (auto found = running_.find(self); found != running_.end()) {
+    found->second.depth++;
+    return;
+  }
+
+  released_.wait(lock, [this, drive, self] {
+    if (!drive) { return running_.empty(); }
+    return running_.size() < max_concurrent_ && !InUseByOther(drive, self);
+  });
+
+  operation& op = running_[self];
+  if (drive) {
+    op.drives.push_back(drive);
+  } else {
+    op.whole_changer = true;
+  }
+}
+
+void ChangerOperations::Unlock()
+{
+  {
+    std::unique_lock lock(mutex_);
+    auto found = running_.find(std::this_thread::get_id());
+    if (found == running_.end() || --found->second.depth > 0) { return; }
+    running_.erase(found);
+  }
+  released_.notify_all();
+}
+
+bool ChangerOperations::ClaimDrive(const Device* drive)
+{
+  std::unique_lock lock(mutex_);
+  auto self = std::this_thread::get_id();
+  auto found = running_.find(self);
+  if (found == running_.end()) { return false; }
+
+  operation& op = found->second;
+  if (op.whole_changer) { return true; }
+  if (std::find(op.drives.begin(), op.drives.end(), drive) != op.drives.end()) {
+    return true;
+  }
+  if (InUseByOther(drive, self)) { return false; }
+  op.drives.push_back(drive);
+  return true;
+}
+
+void ChangerOperations::ReleaseDrive(const Device* drive)
+{
+  {
+    std::unique_lock lock(mutex_);
+    auto found = running_.find(std::this_thread::get_id());
+    if (found == running_.end()) { return; }
+
+    // the drive the operation was started for stays claimed
+    auto& drives = found->second.drives;
+    auto it = std::find(drives.begin(), drives.end(), drive);
+    if (it == drives.begin() || it == drives.end()) { return; }
+    drives.erase(it);
+  }
+  released_.notify_all();
+}
+
+bool ChangerOperations::InUseByOther(const Device* drive,
+                                     std::thread::id self) const
+{
+  for (auto& [id, op] : running_) {
+    if (id == self) { continue; }
+    if (op.whole_changer
+        || std::find(op.drives.begin(), op.drives.end(), drive)
+               != op.drives.end()) {
+      return true;
+    }
+  }
+  return false;
+}
+
 AutochangerResource::AutochangerResource()
     : BareosResource()
     , device_resources(nullptr)
     , changer_name(nullptr)
     , changer_command(nullptr)
+    , max_concurrent_operations(1)
+    , unload_idle_drives_after(0)
+    , operations(nullptr)
 {
   return;
 }
@@ -44,7 +130,9 @@ AutochangerResource& AutochangerResource::operator=(
   device_resources = rhs.device_resources;
   changer_name = rhs.changer_name;
   changer_command = rhs.changer_command;
-  changer_lock = rhs.changer_lock;
+  max_concurrent_operations = rhs.max_concurrent_operations;
+  unload_idle_drives_after = rhs.unload_idle_drives_after;
+  operations = rhs.operations;
   return *this;
 }
 
@@ -26,11 +26,51 @@
 
 #include "lib/bareos_resource.h"
 
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 template <typename T> class alist;
 
 namespace storagedaemon {
+class Device;
 class DeviceResource;
 
+/**
+ * The operations running on one autochanger. An operation belongs to the
+ * thread that started it and can be entered recursively. Operations on
+ * different drives run at the same time up to the configured limit, an
+ * operation on the whole changer (drive == nullptr) runs alone.
+ */
+class ChangerOperations {
+ public:
+  explicit ChangerOperations(uint32_t max_concurrent)
+      : max_concurrent_{max_concurrent ? max_concurrent : 1}
+  {
+  }
+  void Lock(const Device* drive);
+  void Unlock();
+  // Add a drive to the operation of this thread unless somebody else uses it
+  bool ClaimDrive(const Device* drive);
+  void ReleaseDrive(const Device* drive);
+
+ private:
+  struct operation {
+    std::vector<const Device*> drives;
+    bool whole_changer{false};
+    int depth{1};
+  };
+
+  bool InUseByOther(const Device* drive, std::thread::id self) const;
+
+  uint32_t max_concurrent_;
+  std::mutex mutex_;
+  std::condition_variable released_;
+  std::map<std::thread::id, operation> running_;
+};
+
 class AutochangerResource : public BareosResource {
  public:
   AutochangerResource();
@@ -43,10 +83,13 @@ class AutochangerResource : public BareosResource {
 
 
   alist<DeviceResource*>*
-      device_resources;   /**< List of DeviceResource device pointers */
-  char* changer_name;     /**< Changer device name */
-  char* changer_command;  /**< Changer command  -- external program */
-  brwlock_t changer_lock; /**< One changer operation at a time */
+      device_resources;  /**< List of DeviceResource device pointers */
+  char* changer_name;    /**< Changer device name */
+  char* changer_command; /**< Changer command  -- external program */
+
+  uint32_t max_concurrent_operations; /**< Changer operations at a time */
+  utime_t unload_idle_drives_after;   /**< Unload unused drives after */
+  ChangerOperations* operations;      /**< Running changer operations */
 };
 } /* namespace storagedaemon */
 
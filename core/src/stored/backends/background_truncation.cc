@@ -0,0 +1,147 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "include/bareos.h"
+#include "background_truncation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+
+namespace storagedaemon {
+
+static constexpr int debug_info = 100;
+
+BackgroundTruncation::BackgroundTruncation(Remover remover,
+                                           std::size_t threads,
+                                           std::size_t batch_size)
+    : remover_{std::move(remover)}
+    , batch_size_{std::max<std::size_t>(1, batch_size)}
+{
+  for (std::size_t i = 0; i < threads; ++i) {
+    workers_.emplace_back([this]() { Work(); });
+  }
+}
+
+BackgroundTruncation::~BackgroundTruncation()
+{
+  {
+    std::lock_guard lock{mutex_};
+    stop_ = true;
+  }
+  queued_.notify_all();
+  for (auto& worker : workers_) { worker.join(); }
+}
+
+void BackgroundTruncation::Enqueue(const std::string& volume,
+                                   const std::vector<std::string>& chunks)
+{
+  if (chunks.empty()) { return; }
+  {
+    std::lock_guard lock{mutex_};
+    queue_[volume].insert(chunks.begin(), chunks.end());
+  }
+  Dmsg2(debug_info, "Removing %zu chunks of volume %s in the background\n",
+        chunks.size(), volume.c_str());
+  queued_.notify_all();
+}
+
+bool BackgroundTruncation::Claim(const std::string& volume,
+                                 const std::string& chunk)
+{
+  const auto key = std::make_pair(volume, chunk);
+  std::unique_lock lock{mutex_};
+  removed_.wait(lock, [this, &key]() { return removing_.count(key) == 0; });
+  auto found = queue_.find(volume);
+  if (found == queue_.end() || found->second.erase(chunk) == 0) {
+    return false;
+  }
+  if (found->second.empty()) { queue_.erase(found); }
+  return true;
+}
+
+bool BackgroundTruncation::IsStale(const std::string& volume,
+                                   const std::string& chunk) const
+{
+  std::lock_guard lock{mutex_};
+  if (removing_.count(std::make_pair(volume, chunk)) > 0) { return true; }
+  auto found = queue_.find(volume);
+  return found != queue_.end() && found->second.count(chunk) > 0;
+}
+
+std::size_t BackgroundTruncation::size() const
+{
+  std::lock_guard lock{mutex_};
+  std::size_t count = removing_.size();
+  for (const auto& [volume, chunks] : queue_) { count += chunks.size(); }
+  return count;
+}
+
+void BackgroundTruncation::Work()
+{
+  std::unique_lock lock{mutex_};
+  while (true) {
+    queued_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+    if (queue_.empty()) { return; }
+
+    /* Highest chunks first, so an interrupted truncation leaves the start of
+     * the volume behind and not a gap. */
+    auto entry = queue_.begin();
+    const std::string volume = entry->first;
+    std::set<std::string>& chunks = entry->second;
+    std::vector<std::string> batch;
+    while (!chunks.empty() && batch.size() < batch_size_) {
+      auto last = std::prev(chunks.end());
+      removing_.emplace(volume, *last);
+      batch.push_back(*last);
+      chunks.erase(last);
+    }
+    if (chunks.empty()) { queue_.erase(entry); }
+
+    lock.unlock();
+    auto result = remover_(volume, batch);
+    lock.lock();
+
+    for (const std::string& chunk : batch) {
+      removing_.erase(std::make_pair(volume, chunk));
+    }
+    if (result) {
+      failures_.erase(volume);
+    } else if (int failures = ++failures_[volume];
+               failures < max_attempts && !stop_) {
+      Dmsg3(debug_info, "Attempt %d to remove chunks of %s failed: %s",
+            failures, volume.c_str(), result.error().c_str());
+      queue_[volume].insert(batch.begin(), batch.end());
+      removed_.notify_all();
+      queued_.wait_for(lock, std::chrono::seconds(failures),
+                       [this]() { return stop_; });
+      continue;
+    } else {
+      Emsg2(M_ERROR, 0,
+            T_("Could not remove the chunks of truncated volume %s: %s"),
+            volume.c_str(), result.error().c_str());
+      failures_.erase(volume);
+    }
+    removed_.notify_all();
+  }
+}
+
+}  // namespace storagedaemon
@@ -0,0 +1,87 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#ifndef BAREOS_STORED_BACKENDS_BACKGROUND_TRUNCATION_H_
+#define BAREOS_STORED_BACKENDS_BACKGROUND_TRUNCATION_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "tl/expected.hpp"
+
+namespace storagedaemon {
+
+/* Removes the chunks of truncated volumes in the background, so a recycled
+ * volume can be labeled and written to right away instead of waiting for
+ * every chunk to be deleted.
+ *
+ * A chunk that gets written again before it was removed is taken out of the
+ * queue by Claim(); until then the remote chunk is stale and has to be
+ * treated as not existing. */
+class BackgroundTruncation {
+ public:
+  using Remover = std::function<tl::expected<void, std::string>(
+      const std::string& volume,
+      const std::vector<std::string>& chunks)>;
+
+  BackgroundTruncation(Remover remover,
+                       std::size_t threads,
+                       std::size_t batch_size);
+  ~BackgroundTruncation();  // after all queued chunks are removed
+  BackgroundTruncation(const BackgroundTruncation&) = delete;
+  BackgroundTruncation& operator=(const BackgroundTruncation&) = delete;
+
+  void Enqueue(const std::string& volume,
+               const std::vector<std::string>& chunks);
+  /* Before a chunk is written: waits while it is being removed and returns
+   * whether it was still queued, i.e. the remote chunk is stale. */
+  bool Claim(const std::string& volume, const std::string& chunk);
+  // queued or being removed
+  bool IsStale(const std::string& volume, const std::string& chunk) const;
+  std::size_t size() const;
+
+ private:
+  static constexpr int max_attempts = 3;
+
+  void Work();
+
+  Remover remover_;
+  std::size_t batch_size_;
+  mutable std::mutex mutex_{};
+  std::condition_variable queued_{};
+  std::condition_variable removed_{};
+  std::map<std::string, std::set<std::string>> queue_{}; /**< By volume */
+  std::set<std::pair<std::string, std::string>> removing_{};
+  std::map<std::string, int> failures_{}; /**< By volume */
+  bool stop_{false};
+  std::vector<std::thread> workers_{};
+};
+
+}  // namespace storagedaemon
+
+#endif  // BAREOS_STORED_BACKENDS_BACKGROUND_TRUNCATION_H_
@@ -39,10 +39,129 @@
 
 #include "stored/stored_globals.h"
 
+#include <algorithm>
+#include <list>
+#include <memory>
+
 namespace storagedaemon {
 
 static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 
+namespace {
+/* Chunks read from the backing store, shared by all chunked devices of the
+ * storage daemon. This way concurrent restore jobs reading the same volume
+ * through different devices download every chunk only once. Entries are
+ * keyed by volume name (which is unique) and chunk number; the least
+ * recently used entry is dropped when the cache is full.
+ *
+ * Chunks get registered with BeginRead() before they are read from the
+ * backing store. If an upload of them finishes or their volume gets
+ * truncated in the meantime the read data is outdated and Put() will not
+ * add it to the cache. */
+class ChunkCache {
+  struct pending_read {
+    std::string key;
+    uint16_t chunk;
+    bool outdated;
+  };
+
+ public:
+  using read_handle = std::list<pending_read>::iterator;
+
+  void Reserve(std::size_t entries)
+  {
+    std::unique_lock lock(mut);
+    capacity = std::max(capacity, entries);
+  }
+
+  read_handle BeginRead(std::string key, uint16_t chunk)
+  {
+    std::unique_lock lock(mut);
+    return reads.insert(reads.end(),
+                        pending_read{std::move(key), chunk, false});
+  }
+
+  bool Contains(const std::string& key, uint16_t chunk)
+  {
+    std::unique_lock lock(mut);
+    return find(key, chunk) != lru.end();
+  }
+
+  bool Get(const std::string& key,
+           uint16_t chunk,
+           char* buffer,
+           uint32_t* buflen)
+  {
+    std::unique_lock lock(mut);
+    auto it = find(key, chunk);
+    if (it == lru.end()) { return false; }
+
+    lru.splice(lru.begin(), lru, it);
+    memcpy(buffer, it->data.get(), it->size);
+    *buflen = it->size;
+    return true;
+  }
+
+  // Finish a read, data is null if it failed.
+  void Put(read_handle read, std::unique_ptr<char[]> data, uint32_t size)
+  {
+    std::unique_lock lock(mut);
+    if (data && !read->outdated && capacity > 0
+        && find(read->key, read->chunk) == lru.end()) {
+      lru.push_front(
+          entry{std::move(read->key), read->chunk, std::move(data), size});
+      while (lru.size() > capacity) { lru.pop_back(); }
+    }
+    reads.erase(read);
+  }
+
+  void Invalidate(const std::string& key, uint16_t chunk)
+  {
+    std::unique_lock lock(mut);
+    for (auto& read : reads) {
+      if (read.chunk == chunk && read.key == key) { read.outdated = true; }
+    }
+    if (auto it = find(key, chunk); it != lru.end()) { lru.erase(it); }
+  }
+
+  void InvalidateVolume(const std::string& key)
+  {
+    std::unique_lock lock(mut);
+    for (auto& read : reads) {
+      if (read.key == key) { read.outdated = true; }
+    }
+    lru.remove_if([&key](const entry& e) { return e.key == key; });
+  }
+
+ private:
+  struct entry {
+    std::string key;
+    uint16_t chunk;
+    std::unique_ptr<char[]> data;
+    uint32_t size;
+  };
+
+  // there are only a couple of entries, so a linear search is good enough
+  std::list<entry>::iterator find(const std::string& key, uint16_t chunk)
+  {
+    return std::find_if(lru.begin(), lru.end(), [&](const entry& e) {
+      return e.chunk == chunk && e.key == key;
+    });
+  }
+
+  std::mutex mut{};
+  std::size_t capacity{0};
+  std::list<entry> lru{};
+  std::list<pending_read> reads{};
+};
+
+ChunkCache& chunk_cache()
+{
+  static ChunkCache cache;
+  return cache;
+}
+}  // namespace
+
 /*
  * This implements a device abstraction that provides so called chunked
  * volumes. These chunks are kept in memory and flushed to the backing
@@ -71,11 +190,25 @@ static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
  * ChunkedVolumeSize() - Get the current size of a volume.
  * LoadChunk() - Make sure we have the right chunk in memory.
  *
+ * When reading a volume with readahead_ set, the next chunks are read from
+ * the backing store in the background and put into a chunk cache that is
+ * shared with the other chunked devices.
+ *
+ * Without readahead_, a backend that sets ranged_reads_ only gets asked for
+ * the part of a chunk around the offset being read, restores of single files
+ * need only a few blocks of each chunk. The range grows with every further
+ * read of the chunk, so reading a chunk as a whole still takes few requests.
+ *
  * It also demands that the inheriting class implements the
  * following methods:
  *
  * FlushRemoteChunk() - Flush a chunk to the remote backing store.
- * ReadRemoteChunk() - Read a chunk from the remote backing store.
+ * ReadRemoteChunk() - Read a chunk from the remote backing store. When
+ *                     the request has a length, only that range of the chunk
+ *                     is needed. The data is put at its offset in the buffer
+ *                     and rbuflen is set to the end of the data read. A
+ *                     backend reading the whole chunk instead sets offset and
+ *                     length of the request to 0.
  * RemoteVolumeSize - Return the current size of a volume.
  * TruncateRemoteVolume() - Truncate a chunked volume on the
  *                                    remote backing store.
@@ -418,7 +551,7 @@ bool ChunkedDevice::DequeueChunk()
           new_request->chunk, new_request->volname,
           edit_pthread(pthread_self(), ed1, sizeof(ed1)));
 
-    if (!FlushRemoteChunk(new_request)) {
+    if (!UploadChunk(new_request)) {
       chunk_io_request* enqueued_request;
 
       /* See if we have a maximum number of retries to upload chunks to the
@@ -487,6 +620,20 @@ bool ChunkedDevice::DequeueChunk()
   }
 }
 
+/*
+ * Upload a chunk to the backing store and drop it from the chunk cache.
+ * Devices without read-ahead may still write volumes that others cache.
+ * The cache is only invalidated once the upload is over, as a device that
+ * reads the chunk during the upload could cache the old content again.
+ * A failed upload may have replaced part of the chunk as well.
+ */
+bool ChunkedDevice::UploadChunk(chunk_io_request* request)
+{
+  bool uploaded = FlushRemoteChunk(request);
+  chunk_cache().Invalidate(request->volname, request->chunk);
+  return uploaded;
+}
+
 /*
  * Internal method for flushing a chunk to the backing store.
  * The retry logic is in the io-threads but if those are not
@@ -513,7 +660,7 @@ bool ChunkedDevice::FlushChunk(bool release_chunk, bool move_to_next_chunk)
   } else {
     // no multithreading
     Dmsg1(100, "Try to flush chunk number: %d\n", request.chunk);
-    retval = FlushRemoteChunk(&request);
+    retval = UploadChunk(&request);
   }
 
   // Clear the need flushing flag.
@@ -549,9 +696,44 @@ bool ChunkedDevice::ReadChunk()
   request.wbuflen = current_chunk_->chunk_size;
   request.rbuflen = &current_chunk_->buflen;
   request.release = false;
+  request.offset = 0;
+  request.length = 0;
 
   current_chunk_->end_offset
       = current_chunk_->start_offset + (current_chunk_->chunk_size - 1);
+  current_chunk_->read_start = 0;
+  current_chunk_->read_partial = false;
+
+  // Only read ahead when restoring, appending never reads more than one chunk.
+  if (readahead_ > 0 && !current_chunk_->writing) {
+    bool cached = ReadCachedChunk(request.chunk);
+    QueuePrefetch(request.chunk + 1);
+    if (cached) {
+      Dmsg2(200, "Using cached chunk %d of volume %s\n", request.chunk,
+            current_volname_);
+      return true;
+    }
+  }
+
+  /* Restores without readahead only read the parts of the chunk they need,
+   * appending rewrites the whole chunk so it needs all of it. */
+  if (ranged_reads_ && readahead_ == 0 && !current_chunk_->writing) {
+    boffset_t wanted_offset = offset_ - current_chunk_->start_offset;
+    if (wanted_offset < 0 || wanted_offset >= current_chunk_->chunk_size) {
+      wanted_offset = 0;
+    }
+    current_chunk_->read_start = wanted_offset;
+    current_chunk_->read_window = 0;
+    current_chunk_->read_partial = true;
+    current_chunk_->buflen = wanted_offset;
+    if (!ReadChunkRange(wanted_offset, 1)) {
+      current_chunk_->buflen = 0;
+      current_chunk_->read_start = 0;
+      current_chunk_->read_partial = false;
+      return false;
+    }
+    return true;
+  }
 
   if (!ReadRemoteChunk(&request)) {
     // If the chunk doesn't exist on the backing store it has a size of 0 bytes.
@@ -562,6 +744,211 @@ bool ChunkedDevice::ReadChunk()
   return true;
 }
 
+/* Make sure count bytes starting at wanted_offset of the current chunk were
+ * read, as far as the chunk has them. Only chunks that were partially read
+ * are missing any data. */
+bool ChunkedDevice::ReadChunkRange(uint32_t wanted_offset, size_t count)
+{
+  chunk_descriptor* chunk = current_chunk_;
+  uint64_t wanted_end = std::min<uint64_t>(uint64_t{wanted_offset} + count,
+                                           chunk->chunk_size);
+
+  if (wanted_offset >= chunk->read_start
+      && (!chunk->read_partial || wanted_end <= chunk->buflen)) {
+    return true;
+  }
+
+  chunk_io_request request;
+  request.chunk = chunk->start_offset / chunk->chunk_size;
+  request.volname = current_volname_;
+  request.buffer = chunk->buffer;
+  request.wbuflen = chunk->chunk_size;
+  request.rbuflen = &chunk->buflen;
+  request.release = false;
+
+  uint32_t read_start = chunk->read_start;
+  uint32_t buflen = chunk->buflen;
+  if (wanted_offset >= chunk->read_start && wanted_offset <= chunk->buflen) {
+    // Continue after the data we already have.
+    request.offset = chunk->buflen;
+    chunk->read_window
+        = chunk->read_window
+              ? std::min<uint64_t>(2 * uint64_t{chunk->read_window},
+                                   chunk->chunk_size)
+              : PARTIAL_READ_SIZE;
+  } else {
+    // Skipped over or back, the data we have is of no use.
+    request.offset = wanted_offset;
+    chunk->read_start = wanted_offset;
+    chunk->read_window = PARTIAL_READ_SIZE;
+  }
+  request.length = std::min<uint64_t>(
+      std::max<uint64_t>(chunk->read_window, wanted_end - request.offset),
+      chunk->chunk_size - request.offset);
+
+  Dmsg3(200, "Reading %u bytes at offset %u of chunk %d\n", request.length,
+        request.offset, request.chunk);
+  if (!ReadRemoteChunk(&request)) {
+    chunk->read_start = read_start;
+    chunk->buflen = buflen;
+    return false;
+  }
+
+  if (request.length == 0) {
+    // The backend read the whole chunk.
+    chunk->read_start = 0;
+    chunk->read_partial = false;
+  } else {
+    chunk->read_partial = chunk->buflen == request.offset + request.length
+                          && chunk->buflen < chunk->chunk_size;
+  }
+
+  return true;
+}
+
+/* Get a chunk from the chunk cache. If it is currently read ahead we wait
+ * for that to finish, if it is only queued we read it ourself. */
+bool ChunkedDevice::ReadCachedChunk(uint16_t chunk)
+{
+  {
+    std::unique_lock lock(prefetch_mutex_);
+    if (prefetch_volname_ == current_volname_) {
+      prefetch_queue_.erase(
+          std::remove(prefetch_queue_.begin(), prefetch_queue_.end(), chunk),
+          prefetch_queue_.end());
+      prefetch_cond_.wait(lock, [this, chunk] {
+        return std::find(prefetch_running_.begin(), prefetch_running_.end(),
+                         chunk)
+               == prefetch_running_.end();
+      });
+    }
+  }
+
+  return chunk_cache().Get(current_volname_, chunk,
+                           current_chunk_->buffer, &current_chunk_->buflen);
+}
+
+// Queue the readahead_ chunks starting at first_chunk for reading ahead.
+void ChunkedDevice::QueuePrefetch(uint16_t first_chunk)
+{
+  std::unique_lock lock(prefetch_mutex_);
+
+  if (prefetch_volname_ != current_volname_) {
+    prefetch_volname_ = current_volname_;
+    prefetch_queue_.clear();
+    prefetch_end_ = MAX_CHUNKS;
+  }
+
+  // Chunks before first_chunk were skipped by the reader.
+  prefetch_queue_.erase(
+      std::remove_if(prefetch_queue_.begin(), prefetch_queue_.end(),
+                     [first_chunk](uint16_t c) { return c < first_chunk; }),
+      prefetch_queue_.end());
+
+  uint32_t last_chunk
+      = std::min<uint32_t>(first_chunk + readahead_, prefetch_end_);
+  for (uint32_t chunk = first_chunk; chunk < last_chunk; chunk++) {
+    auto queued = [chunk](const auto& list) {
+      return std::find(list.begin(), list.end(), chunk) != list.end();
+    };
+    if (queued(prefetch_queue_) || queued(prefetch_running_)
+        || chunk_cache().Contains(prefetch_volname_, chunk)) {
+      continue;
+    }
+    prefetch_queue_.push_back(chunk);
+  }
+
+  if (prefetch_queue_.empty()) { return; }
+
+  if (prefetch_threads_.empty()) {
+    // Keep the chunks of two windows so the reader still finds its chunks
+    // when another device reads ahead at the same time.
+    chunk_cache().Reserve(2 * readahead_);
+
+    std::size_t num_threads = std::min<std::size_t>(
+        readahead_, std::max<std::size_t>(io_threads_, 1));
+    for (std::size_t i = 0; i < num_threads; i++) {
+      prefetch_threads_.emplace_back([this] { PrefetchChunks(); });
+    }
+    Dmsg2(100, "Started %d read-ahead threads for volume %s\n",
+          static_cast<int>(num_threads), current_volname_);
+  }
+
+  prefetch_cond_.notify_all();
+}
+
+// Thread runner that reads the queued chunks into the chunk cache.
+void ChunkedDevice::PrefetchChunks()
+{
+  std::unique_lock lock(prefetch_mutex_);
+
+  while (1) {
+    prefetch_cond_.wait(
+        lock, [this] { return prefetch_stop_ || !prefetch_queue_.empty(); });
+    if (prefetch_stop_) { return; }
+
+    uint16_t chunk = prefetch_queue_.front();
+    prefetch_queue_.pop_front();
+    prefetch_running_.push_back(chunk);
+    std::string volname = prefetch_volname_;
+    lock.unlock();
+
+    auto cache_read = chunk_cache().BeginRead(volname, chunk);
+    std::unique_ptr<char[]> buffer{new char[current_chunk_->chunk_size]};
+    uint32_t buflen = 0;
+
+    chunk_io_request request{};
+    request.volname = volname.c_str();
+    request.chunk = chunk;
+    request.buffer = buffer.get();
+    request.wbuflen = current_chunk_->chunk_size;
+    request.rbuflen = &buflen;
+    request.release = false;
+
+    Dmsg2(200, "Reading ahead chunk %d of volume %s\n", chunk,
+          volname.c_str());
+    bool read = ReadRemoteChunk(&request);
+    if (!read) { buffer.reset(); }
+    chunk_cache().Put(cache_read, std::move(buffer), buflen);
+
+    lock.lock();
+    prefetch_running_.erase(std::remove(prefetch_running_.begin(),
+                                        prefetch_running_.end(), chunk),
+                            prefetch_running_.end());
+
+    /* Most likely we went past the end of the volume, so don't try to read
+     * any chunks after this one. */
+    if (!read && volname == prefetch_volname_ && chunk < prefetch_end_) {
+      prefetch_end_ = chunk;
+      prefetch_queue_.erase(
+          std::remove_if(prefetch_queue_.begin(), prefetch_queue_.end(),
+                         [chunk](uint16_t c) { return c >= chunk; }),
+          prefetch_queue_.end());
+    }
+    prefetch_cond_.notify_all();
+  }
+}
+
+// Stop reading ahead, waits until the chunks currently read are done.
+void ChunkedDevice::StopPrefetch()
+{
+  if (prefetch_threads_.empty()) { return; }
+
+  {
+    std::unique_lock lock(prefetch_mutex_);
+    prefetch_stop_ = true;
+    prefetch_queue_.clear();
+  }
+  prefetch_cond_.notify_all();
+
+  for (auto& thread : prefetch_threads_) { thread.join(); }
+  prefetch_threads_.clear();
+
+  std::unique_lock lock(prefetch_mutex_);
+  prefetch_stop_ = false;
+  prefetch_volname_.clear();
+}
+
 /*
  * Setup a chunked volume for reading or writing.
  * return:
@@ -681,6 +1068,11 @@ ssize_t ChunkedDevice::ReadChunked(int, void* buffer, size_t count)
         && current_chunk_->end_offset >= (boffset_t)((offset_ + count) - 1)) {
       wanted_offset = (offset_ % current_chunk_->chunk_size);
 
+      if (!ReadChunkRange(wanted_offset, count)) {
+        retval = -1;
+        goto bail_out;
+      }
+
       bytes_left
           = MIN((ssize_t)count, (current_chunk_->buflen - wanted_offset));
       Dmsg2(200, "Reading complete %d byte read-request from chunk offset %d\n",
@@ -709,6 +1101,10 @@ ssize_t ChunkedDevice::ReadChunked(int, void* buffer, size_t count)
         // See how much is left in this chunk.
         if (offset_ <= current_chunk_->end_offset) {
           wanted_offset = (offset_ % current_chunk_->chunk_size);
+          if (!ReadChunkRange(wanted_offset, count - offset)) {
+            retval = -1;
+            goto bail_out;
+          }
           bytes_left = MIN((ssize_t)(count - offset),
                            (ssize_t)(current_chunk_->buflen - wanted_offset));
 
@@ -741,6 +1137,11 @@ ssize_t ChunkedDevice::ReadChunked(int, void* buffer, size_t count)
               goto bail_out;
           }
         } else {
+          if (!ReadChunkRange(0, count - offset)) {
+            retval = -1;
+            goto bail_out;
+          }
+
           /* Calculate how much data we can read from the just freshly read
            * chunk. */
           bytes_left = MIN((ssize_t)(count - offset),
@@ -892,6 +1293,8 @@ int ChunkedDevice::CloseChunk()
 {
   int retval = -1;
 
+  StopPrefetch();
+
   if (current_chunk_->opened) {
     if (current_chunk_->need_flushing) {
       if (FlushChunk(true /* release */, false /* move_to_next_chunk */)) {
@@ -917,6 +1320,8 @@ int ChunkedDevice::CloseChunk()
     current_chunk_->opened = false;
     current_chunk_->chunk_setup = false;
     current_chunk_->buflen = 0;
+    current_chunk_->read_start = 0;
+    current_chunk_->read_partial = false;
     current_chunk_->start_offset = -1;
     current_chunk_->end_offset = -1;
   } else {
@@ -932,10 +1337,14 @@ bool ChunkedDevice::TruncateChunkedVolume(DeviceControlRecord* dcr)
   if (current_chunk_->opened) {
     if (!TruncateRemoteVolume(dcr)) { return false; }
 
+    chunk_cache().InvalidateVolume(getVolCatName());
+
     // Reinitialize the initial chunk.
     current_chunk_->start_offset = 0;
     current_chunk_->end_offset = (current_chunk_->chunk_size - 1);
     current_chunk_->buflen = 0;
+    current_chunk_->read_start = 0;
+    current_chunk_->read_partial = false;
     current_chunk_->chunk_setup = true;
     current_chunk_->need_flushing = false;
 
@@ -1157,6 +1566,8 @@ bool ChunkedDevice::LoadChunk()
   // If the wrong chunk is loaded populate the chunk buffer with the right data.
   if (start_offset != current_chunk_->start_offset) {
     current_chunk_->buflen = 0;
+    current_chunk_->read_start = 0;
+    current_chunk_->read_partial = false;
     current_chunk_->start_offset = start_offset;
 
     /* See if we are using io-threads or not and the ordered CircularBuffer is
@@ -1297,6 +1708,7 @@ bool ChunkedDevice::DeviceStatus(DeviceStatusInformation* dst)
 
 ChunkedDevice::~ChunkedDevice()
 {
+  StopPrefetch();
   if (thread_ids_) { StopThreads(); }
 
   if (cb_) {
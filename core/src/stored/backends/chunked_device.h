@@ -31,7 +31,13 @@
 #include <sys/types.h>
 #include "stored/dev.h"
 #include "ordered_cbuf.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <optional>
+#include <string>
+#include <thread>
+#include <vector>
 
 template <typename T> class alist;
 
@@ -56,6 +62,13 @@ struct DeviceStatusInformation;
  */
 #define DEFAULT_CHUNK_SIZE 10 * 1024 * 1024
 
+/*
+ * When only parts of a chunk are read, the first range read from the backing
+ * store has this size. Every further range of the same chunk is twice the
+ * size of the one before.
+ */
+#define PARTIAL_READ_SIZE 1024 * 1024
+
 /*
  * Maximum number of chunks per volume.
  * When you change this make sure you update the %04d format
@@ -90,6 +103,8 @@ struct chunk_io_request {
   uint32_t* rbuflen;   /* Size of the actual valid data in the chunk (Read) */
   uint8_t tries; /* Number of times the flush was tried to the backing store */
   bool release;  /* Should we release the data to which the buffer points ? */
+  uint32_t offset; /* Start of the range to read within the chunk (Read) */
+  uint32_t length; /* Size of the range to read, 0 for the whole chunk (Read) */
 };
 
 struct chunk_descriptor {
@@ -98,6 +113,9 @@ struct chunk_descriptor {
   uint32_t buflen;        /* Size of the actual valid data in the chunk */
   boffset_t start_offset; /* Start offset of the current chunk */
   boffset_t end_offset;   /* End offset of the current chunk */
+  uint32_t read_start;  /* Start of the valid data after a partial read */
+  uint32_t read_window; /* Size of the last range read from the chunk */
+  bool read_partial;    /* Data after buflen was not read yet */
   bool need_flushing; /* Data is dirty and needs flushing to backing store */
   bool chunk_setup;   /* Chunk is initialized and ready for use */
   bool writing;       /* We are currently writing */
@@ -152,6 +170,16 @@ class ChunkedDevice : public Device {
   alist<thread_handle*>* thread_ids_{};
   chunk_descriptor* current_chunk_{};
 
+  // Read-ahead of chunks while reading a volume (readahead_ > 0).
+  std::mutex prefetch_mutex_{};
+  std::condition_variable prefetch_cond_{};
+  std::string prefetch_volname_{};
+  std::deque<uint16_t> prefetch_queue_{};
+  std::vector<uint16_t> prefetch_running_{};
+  std::vector<std::thread> prefetch_threads_{};
+  uint16_t prefetch_end_{MAX_CHUNKS};
+  bool prefetch_stop_{};
+
   // Private Methods
   char* allocate_chunkbuffer();
   void FreeChunkbuffer(char* buffer);
@@ -159,18 +187,26 @@ class ChunkedDevice : public Device {
   bool StartIoThreads();
   void StopThreads();
   bool EnqueueChunk(chunk_io_request* request);
+  bool UploadChunk(chunk_io_request* request);
   bool FlushChunk(bool release_chunk, bool move_to_next_chunk);
   bool ReadChunk();
+  bool ReadChunkRange(uint32_t wanted_offset, size_t count);
   bool is_written();
+  bool ReadCachedChunk(uint16_t chunk);
+  void QueuePrefetch(uint16_t first_chunk);
+  void PrefetchChunks();
+  void StopPrefetch();
 
  protected:
   // Protected Members
   uint8_t io_threads_{};
   uint8_t io_slots_{};
   uint8_t retries_{};
+  uint8_t readahead_{};
   uint64_t chunk_size_{};
   boffset_t offset_{};
   bool use_mmap_{};
+  bool ranged_reads_{}; /* ReadRemoteChunk() can read parts of a chunk */
 
   // Protected Methods
   std::optional<InflightLease> getInflightLease(chunk_io_request* request);
@@ -27,6 +27,7 @@
 #include "stored/stored_conf.h"
 #include "stored/stored_globals.h"
 #include <sys/stat.h>
+#include <optional>
 #if defined(HAVE_WIN32)
 #  include <shlwapi.h>  // for PathIsRelativeA()
 #endif
@@ -51,8 +52,9 @@ class BPipeHandle {
   BPipeHandle(const char* prog,
               std::chrono::seconds wait,
               const char* mode,
-              const std::unordered_map<std::string, std::string>& env_vars = {})
-      : bpipe(OpenBpipe(prog, wait.count(), mode, true, env_vars))
+              const std::unordered_map<std::string, std::string>& env_vars = {},
+              bool dup_stderr = true)
+      : bpipe(OpenBpipe(prog, wait.count(), mode, dup_stderr, env_vars))
   {
     if (!bpipe) { throw std::runtime_error("opening Bpipe"); }
   }
@@ -76,10 +78,11 @@ class BPipeHandle {
       const char* prog,
       std::chrono::seconds wait,
       const char* mode,
-      const std::unordered_map<std::string, std::string>& env_vars = {})
+      const std::unordered_map<std::string, std::string>& env_vars = {},
+      bool dup_stderr = true)
   {
     try {
-      return BPipeHandle(prog, wait, mode, env_vars);
+      return BPipeHandle(prog, wait, mode, env_vars, dup_stderr);
     } catch (const std::runtime_error& e) {
       return tl::unexpected(e.what());
     }
@@ -141,8 +144,234 @@ bool is_valid_env_name(const std::string& name)
                         [](char c) { return is_ascii_alnum(c) || c == '_'; });
 }
 
+/* The fields of a session request are separated by tabs and the request
+ * ends with a newline, so a name put into it has tabs, newlines, carriage
+ * returns and backslashes escaped as \t, \n, \r and \\ (the escapes
+ * printf %b reads). */
+std::string SessionField(std::string_view field)
+{
+  std::string escaped;
+  escaped.reserve(field.size());
+  for (char c : field) {
+    switch (c) {
+      case '\\':
+        escaped += "\\\\";
+        break;
+      case '\t':
+        escaped += "\\t";
+        break;
+      case '\n':
+        escaped += "\\n";
+        break;
+      case '\r':
+        escaped += "\\r";
+        break;
+      default:
+        escaped += c;
+        break;
+    }
+  }
+  return escaped;
+}
+
 }  // namespace
 
+/* A long running "<program> session" process.  Requests are single lines of
+ * tab separated fields, optionally followed by data.  The program answers
+ * with "ok" (plus tab separated values) or "error<TAB><message>" for each
+ * request.  See the developer guide for the details. */
+class CrudStorage::Session {
+  BPipeHandle bph;
+  bool broken{false};
+
+  explicit Session(BPipeHandle&& handle) : bph{std::move(handle)} {}
+
+  std::optional<std::string> read_line()
+  {
+    auto rfh = bph.getReadFd();
+    std::string line;
+    for (;;) {
+      int c = fgetc(rfh);
+      if (c == EOF) {
+        if (ferror(rfh) && errno == EINTR) {
+          clearerr(rfh);
+          continue;
+        }
+        return std::nullopt;
+      }
+      if (c == '\n') { return line; }
+      line.push_back(static_cast<char>(c));
+    }
+  }
+
+  bool write_data(const char* data, std::size_t size)
+  {
+    auto wfh = bph.getWriteFd();
+    constexpr size_t max_write_size{256 * 1024};
+    while (size > 0) {
+      const size_t write_size = std::min(max_write_size, size);
+      if (auto has_written = fwrite(data, 1, write_size, wfh);
+          has_written != write_size) {
+        if (errno != EINTR) { return false; }
+        clearerr(wfh);
+        data += has_written;
+        size -= has_written;
+        continue;
+      }
+      bph.reset_timeout();
+      data += write_size;
+      size -= write_size;
+    }
+    return true;
+  }
+
+  tl::unexpected<std::string> fail(std::string message)
+  {
+    broken = true;
+    return tl::unexpected(std::move(message));
+  }
+
+ public:
+  static tl::expected<std::unique_ptr<Session>, std::string> start(
+      const std::string& program,
+      std::chrono::seconds timeout,
+      const std::unordered_map<std::string, std::string>& env_vars)
+  {
+    std::string cmdline = fmt::format("\"{}\" session", program);
+    // stderr must not end up in the responses
+    auto bph{BPipeHandle::create(cmdline.c_str(), timeout, "rw", env_vars,
+                                 false)};
+    if (!bph) { return tl::unexpected(bph.error()); }
+
+    std::unique_ptr<Session> session{new Session(std::move(*bph))};
+
+    // the program starts by announcing the protocol version it speaks
+    auto greeting = session->read_line();
+    if (!greeting || *greeting != "session 1") {
+      return tl::unexpected(
+          fmt::format("\"{}\" does not support sessions (greeting: '{}')\n",
+                      cmdline, greeting.value_or("")));
+    }
+    Dmsg0(debug_info, "started session for %s\n", program.c_str());
+    return session;
+  }
+
+  // the timer kills sessions that were idle for too long
+  bool usable() { return !broken && !bph.timed_out(); }
+
+  // returns the values of the "ok" response
+  tl::expected<std::string, std::string> request(const std::string& line,
+                                                 gsl::span<const char> data
+                                                 = {})
+  {
+    bph.reset_timeout();
+    if (!write_data(line.data(), line.size()) || !write_data("\n", 1)
+        || !write_data(data.data(), data.size())
+        || fflush(bph.getWriteFd()) != 0) {
+      return fail(fmt::format("session: could not send request '{}' (errno={})",
+                              line, errno));
+    }
+
+    auto response = read_line();
+    if (!response) {
+      return fail(fmt::format("session: no response for request '{}'", line));
+    }
+    bph.reset_timeout();
+
+    if (*response == "ok") { return std::string{}; }
+    if (response->rfind("ok\t", 0) == 0) { return response->substr(3); }
+    if (response->rfind("error\t", 0) == 0) {
+      return tl::unexpected(response->substr(6));
+    }
+    return fail(fmt::format("session: bad response '{}' for request '{}'",
+                            *response, line));
+  }
+
+  tl::expected<void, std::string> read_data(gsl::span<char> buffer)
+  {
+    auto rfh = bph.getReadFd();
+    size_t total_read{0};
+    while (total_read < buffer.size_bytes()) {
+      const size_t bytes_read = fread(buffer.data() + total_read, 1,
+                                      buffer.size_bytes() - total_read, rfh);
+      total_read += bytes_read;
+      bph.reset_timeout();
+      if (total_read < buffer.size_bytes()) {
+        if (ferror(rfh) && errno == EINTR) {
+          clearerr(rfh);
+          continue;
+        }
+        return fail(fmt::format("session: got only {} of {} bytes", total_read,
+                                buffer.size_bytes()));
+      }
+    }
+    return {};
+  }
+
+  void discard() { broken = true; }
+};
+
+CrudStorage::CrudStorage() = default;
+CrudStorage::~CrudStorage() = default;
+
+auto CrudStorage::acquire_session()
+    -> tl::expected<std::unique_ptr<Session>, std::string>
+{
+  std::unique_lock lock(m_session_mutex);
+  for (;;) {
+    while (!m_idle_sessions.empty()) {
+      auto session = std::move(m_idle_sessions.back());
+      m_idle_sessions.pop_back();
+      if (session->usable()) { return session; }
+      m_open_sessions -= 1;
+    }
+
+    if (m_open_sessions < m_max_sessions) {
+      m_open_sessions += 1;
+      lock.unlock();
+      auto session = Session::start(m_program, m_program_timeout, m_env_vars);
+      if (!session) {
+        lock.lock();
+        m_open_sessions -= 1;
+        m_session_released.notify_one();
+      }
+      return session;
+    }
+
+    m_session_released.wait(lock);
+  }
+}
+
+void CrudStorage::release_session(std::unique_ptr<Session> session)
+{
+  std::unique_ptr<Session> closed;
+  {
+    std::lock_guard lock(m_session_mutex);
+    if (session->usable()) {
+      m_idle_sessions.push_back(std::move(session));
+    } else {
+      m_open_sessions -= 1;
+      closed = std::move(session);
+    }
+  }
+  m_session_released.notify_one();
+}
+
+tl::expected<void, std::string> CrudStorage::set_max_sessions(
+    std::size_t max_sessions)
+{
+  m_max_sessions = max_sessions;
+  if (max_sessions == 0) { return {}; }
+
+  auto session = acquire_session();
+  if (!session) {
+    m_max_sessions = 0;
+    return tl::unexpected(session.error());
+  }
+  release_session(std::move(*session));
+  return {};
+}
+
 tl::expected<void, std::string> CrudStorage::set_program(
     const std::string& program)
 {
@@ -232,6 +461,27 @@ auto CrudStorage::stat(std::string_view obj_name, std::string_view obj_part)
     -> tl::expected<Stat, std::string>
 {
   Dmsg1(debug_trace, "stat %s called\n", obj_name.data());
+  if (m_max_sessions > 0) {
+    auto session = acquire_session();
+    if (!session) { return tl::unexpected(session.error()); }
+    auto result = (*session)->request(
+        fmt::format("stat\t{}\t{}", SessionField(obj_name),
+                    SessionField(obj_part)));
+    release_session(std::move(*session));
+    if (!result) {
+      return tl::unexpected(fmt::format("stat of {}/{} failed: {}\n", obj_name,
+                                        obj_part, result.error()));
+    }
+    Stat stat;
+    if (sscanf(result->c_str(), "%zu", &stat.size) != 1) {
+      return tl::unexpected(fmt::format(
+          "could not parse stat response '{}' for {}/{}\n", *result, obj_name,
+          obj_part));
+    }
+    Dmsg1(debug_trace, "stat returns %zu\n", stat.size);
+    return stat;
+  }
+
   std::string cmdline
       = fmt::format("\"{}\" stat \"{}\" \"{}\"", m_program, obj_name, obj_part);
   auto bph{
@@ -292,6 +542,21 @@ tl::expected<void, std::string> CrudStorage::upload(std::string_view obj_name,
                                                     gsl::span<char> obj_data)
 {
   Dmsg1(debug_trace, "upload %s/%s called\n", obj_name.data(), obj_part.data());
+  if (m_max_sessions > 0) {
+    auto session = acquire_session();
+    if (!session) { return tl::unexpected(session.error()); }
+    auto result = (*session)->request(
+        fmt::format("upload\t{}\t{}\t{}", SessionField(obj_name),
+                    SessionField(obj_part), obj_data.size()),
+        obj_data);
+    release_session(std::move(*session));
+    if (!result) {
+      return tl::unexpected(fmt::format("Upload of {}/{} failed: {}\n",
+                                        obj_name, obj_part, result.error()));
+    }
+    return {};
+  }
+
   std::string cmdline = fmt::format("\"{}\" upload \"{}\" \"{}\"", m_program,
                                     obj_name, obj_part);
 
@@ -349,6 +614,36 @@ tl::expected<gsl::span<char>, std::string> CrudStorage::download(
 {
   Dmsg1(debug_trace, "download %s/%s called\n", obj_name.data(),
         obj_part.data());
+  if (m_max_sessions > 0) {
+    auto session = acquire_session();
+    if (!session) { return tl::unexpected(session.error()); }
+    auto result = (*session)->request(
+        fmt::format("download\t{}\t{}", SessionField(obj_name),
+                    SessionField(obj_part)));
+    size_t size{0};
+    if (result && sscanf(result->c_str(), "%zu", &size) != 1) {
+      result = tl::unexpected(fmt::format("bad response '{}'", *result));
+      (*session)->discard();
+    } else if (result && size != buffer.size_bytes()) {
+      // we cannot skip the data, so this session is lost
+      result = tl::unexpected(fmt::format("got {} bytes, expected {}", size,
+                                          buffer.size_bytes()));
+      (*session)->discard();
+    }
+    if (result) {
+      if (auto read = (*session)->read_data(buffer); !read) {
+        result = tl::unexpected(read.error());
+      }
+    }
+    release_session(std::move(*session));
+    if (!result) {
+      return tl::unexpected(fmt::format("Download of {}/{} failed: {}\n",
+                                        obj_name, obj_part, result.error()));
+    }
+    Dmsg1(debug_trace, "read %zu bytes\n", size);
+    return buffer;
+  }
+
   // download data from somewhere
   std::string cmdline = fmt::format("\"{}\" download \"{}\" \"{}\"", m_program,
                                     obj_name, obj_part);
@@ -397,10 +692,123 @@ tl::expected<gsl::span<char>, std::string> CrudStorage::download(
   return buffer;
 }
 
+tl::expected<gsl::span<char>, std::string> CrudStorage::download_range(
+    std::string_view obj_name,
+    std::string_view obj_part,
+    std::size_t offset,
+    gsl::span<char> buffer)
+{
+  Dmsg4(debug_trace, "download of %zu bytes at %zu of %s/%s called\n",
+        buffer.size_bytes(), offset, obj_name.data(), obj_part.data());
+  auto result = run_download_range(obj_name, obj_part, offset, buffer);
+  if (result) {
+    m_ranged_downloads = Support::Yes;
+  } else if (m_ranged_downloads == Support::Unknown
+             && stat(obj_name, obj_part)) {
+    Dmsg1(debug_info, "%s does not support ranged downloads\n",
+          m_program.c_str());
+    m_ranged_downloads = Support::No;
+  }
+  return result;
+}
+
+auto CrudStorage::run_download_range(std::string_view obj_name,
+                                     std::string_view obj_part,
+                                     std::size_t offset,
+                                     gsl::span<char> buffer)
+    -> tl::expected<gsl::span<char>, std::string>
+{
+  if (m_max_sessions > 0) {
+    auto session = acquire_session();
+    if (!session) { return tl::unexpected(session.error()); }
+    auto result = (*session)->request(
+        fmt::format("downloadrange\t{}\t{}\t{}\t{}", SessionField(obj_name),
+                    SessionField(obj_part), offset, buffer.size_bytes()));
+    size_t size{0};
+    if (result && sscanf(result->c_str(), "%zu", &size) != 1) {
+      result = tl::unexpected(fmt::format("bad response '{}'", *result));
+      (*session)->discard();
+    } else if (result && size > buffer.size_bytes()) {
+      // we cannot skip the data, so this session is lost
+      result = tl::unexpected(fmt::format("got {} bytes, expected at most {}",
+                                          size, buffer.size_bytes()));
+      (*session)->discard();
+    }
+    if (result) {
+      if (auto read = (*session)->read_data(buffer.first(size)); !read) {
+        result = tl::unexpected(read.error());
+      }
+    }
+    release_session(std::move(*session));
+    if (!result) {
+      return tl::unexpected(fmt::format("Download of {}/{} failed: {}\n",
+                                        obj_name, obj_part, result.error()));
+    }
+    Dmsg1(debug_trace, "read %zu bytes\n", size);
+    return buffer.first(size);
+  }
+
+  std::string cmdline
+      = fmt::format("\"{}\" downloadrange \"{}\" \"{}\" {} {}", m_program,
+                    obj_name, obj_part, offset, buffer.size_bytes());
+  auto bph{
+      BPipeHandle::create(cmdline.c_str(), m_program_timeout, "r", m_env_vars)};
+  if (!bph) { return tl::unexpected(bph.error()); }
+  auto rfh = bph->getReadFd();
+  size_t total_read{0};
+  constexpr size_t max_read_size{256 * 1024};
+  while (total_read < buffer.size_bytes()) {
+    const size_t read_size
+        = std::min(buffer.size_bytes() - total_read, max_read_size);
+    const size_t bytes_read
+        = fread(buffer.data() + total_read, 1, read_size, rfh);
+    bph->reset_timeout();
+    total_read += bytes_read;
+    if (bytes_read < read_size) {
+      // the object ends before the range does
+      if (feof(rfh)) { break; }
+      if (ferror(rfh)) {
+        if (errno == EINTR) {
+          clearerr(rfh);
+          continue;
+        }
+        return tl::unexpected(fmt::format(
+            "stream error after reading {} of {} bytes while downloading {}/{}",
+            total_read, buffer.size_bytes(), obj_name, obj_part));
+      }
+    }
+  }
+  if (total_read == buffer.size_bytes() && fgetc(rfh) != EOF) {
+    return tl::unexpected(fmt::format(
+        "additional data after expected end of stream while downloading {}/{}",
+        obj_name, obj_part));
+  }
+  if (auto ret = bph->close(); ret != 0) {
+    return tl::unexpected(fmt::format(
+        "Download failed with returncode={} after data was received\n", ret));
+  }
+  Dmsg1(debug_trace, "read %zu bytes\n", total_read);
+  return buffer.first(total_read);
+}
+
 tl::expected<void, std::string> CrudStorage::remove(std::string_view obj_name,
                                                     std::string_view obj_part)
 {
   Dmsg1(debug_trace, "remove %s/%s called\n", obj_name.data(), obj_part.data());
+  if (m_max_sessions > 0) {
+    auto session = acquire_session();
+    if (!session) { return tl::unexpected(session.error()); }
+    auto result = (*session)->request(
+        fmt::format("remove\t{}\t{}", SessionField(obj_name),
+                    SessionField(obj_part)));
+    release_session(std::move(*session));
+    if (!result) {
+      return tl::unexpected(fmt::format("Removing {}/{} failed: {}\n",
+                                        obj_name, obj_part, result.error()));
+    }
+    return {};
+  }
+
   std::string cmdline = fmt::format("\"{}\" remove \"{}\" \"{}\"", m_program,
                                     obj_name, obj_part);
   auto bph{
@@ -22,9 +22,14 @@
 #ifndef BAREOS_STORED_BACKENDS_CRUD_STORAGE_H_
 #define BAREOS_STORED_BACKENDS_CRUD_STORAGE_H_
 
+#include <atomic>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
 #include <string_view>
 #include <unordered_map>
+#include <vector>
 #include <gsl/span>
 #include <chrono>
 #include "lib/bstringlist.h"
@@ -38,9 +43,44 @@ class CrudStorage {
   std::chrono::seconds m_program_timeout{30};
   std::unordered_map<std::string, std::string> m_env_vars{};
 
+  /* Programs that do not know the downloadrange operation are found out by
+   * the first ranged download that fails for an object that exists. */
+  enum class Support
+  {
+    Unknown,
+    Yes,
+    No
+  };
+  std::atomic<Support> m_ranged_downloads{Support::Unknown};
+
+  /* Instead of running the program once per operation, up to
+   * m_max_sessions long running "<program> session" processes get
+   * requests over stdin/stdout. */
+  class Session;
+  std::size_t m_max_sessions{0};
+  std::size_t m_open_sessions{0};
+  std::vector<std::unique_ptr<Session>> m_idle_sessions{};
+  std::mutex m_session_mutex{};
+  std::condition_variable m_session_released{};
+
+  tl::expected<std::unique_ptr<Session>, std::string> acquire_session();
+  void release_session(std::unique_ptr<Session> session);
+  tl::expected<gsl::span<char>, std::string> run_download_range(
+      std::string_view obj_name,
+      std::string_view obj_part,
+      std::size_t offset,
+      gsl::span<char> buffer);
+
  public:
+  CrudStorage();
+  ~CrudStorage();
+  CrudStorage(const CrudStorage&) = delete;
+  CrudStorage& operator=(const CrudStorage&) = delete;
+
   tl::expected<void, std::string> set_program(const std::string& program);
   void set_program_timeout(std::chrono::seconds timeout);
+  // 0 disables sessions; checks that the program supports them otherwise
+  tl::expected<void, std::string> set_max_sessions(std::size_t max_sessions);
   tl::expected<BStringList, std::string> get_supported_options();
   tl::expected<void, std::string> set_option(const std::string& name,
                                              const std::string& value);
@@ -55,6 +95,18 @@ class CrudStorage {
   tl::expected<gsl::span<char>, std::string> download(std::string_view obj_name,
                                                       std::string_view obj_part,
                                                       gsl::span<char> buffer);
+  /* reads up to buffer.size() bytes starting at offset, fewer at the end of
+   * the object and none after it */
+  tl::expected<gsl::span<char>, std::string> download_range(
+      std::string_view obj_name,
+      std::string_view obj_part,
+      std::size_t offset,
+      gsl::span<char> buffer);
+  // false once the program turned out not to support ranged downloads
+  bool ranged_downloads() const
+  {
+    return m_ranged_downloads != Support::No;
+  }
   tl::expected<void, std::string> remove(std::string_view obj_name,
                                          std::string_view obj_part);
 };
@@ -0,0 +1,98 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include <array>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "chunker.h"
+
+namespace dedup {
+namespace {
+constexpr std::array<std::uint64_t, 256> MakeGearTable()
+{
+  // splitmix64; this must never change as otherwise data chunked by
+  // older versions will not match anymore.
+  std::array<std::uint64_t, 256> table{};
+  std::uint64_t state = 0x6261'7265'6f73'6364;  // "bareoscd"
+  for (auto& entry : table) {
+    state += 0x9e37'79b9'7f4a'7c15;
+    std::uint64_t z = state;
+    z = (z ^ (z >> 30)) * 0xbf58'476d'1ce4'e5b9;
+    z = (z ^ (z >> 27)) * 0x94d0'49bb'1331'11eb;
+    entry = z ^ (z >> 31);
+  }
+  return table;
+}
+
+constexpr auto gear = MakeGearTable();
+
+constexpr std::uint64_t HighBits(unsigned count)
+{
+  return ~std::uint64_t{0} << (64 - count);
+}
+};  // namespace
+
+chunker::chunker(std::size_t avg_size)
+{
+  if (avg_size < min_avg_size || avg_size > max_avg_size) {
+    throw std::invalid_argument("chunk size " + std::to_string(avg_size)
+                                + " is not in range ["
+                                + std::to_string(min_avg_size) + ", "
+                                + std::to_string(max_avg_size) + "]");
+  }
+
+  unsigned bits = 0;
+  while ((std::size_t{2} << bits) <= avg_size) { bits += 1; }
+
+  avg_size_ = std::size_t{1} << bits;
+  min_size_ = avg_size_ / 4;
+  max_size_ = avg_size_ * 8;
+  // the gear hash shifts left, so its high bits depend on the most bytes.
+  // Before reaching the average size we use a harder to hit mask,
+  // afterwards an easier one, which keeps chunk sizes closer to the average.
+  mask_small_ = HighBits(bits + 2);
+  mask_large_ = HighBits(bits - 2);
+}
+
+std::size_t chunker::next_chunk(const char* data, std::size_t size) const
+{
+  if (size <= min_size_) { return size; }
+
+  auto* bytes = reinterpret_cast<const unsigned char*>(data);
+  std::size_t normal = std::min(size, avg_size_);
+  std::size_t end = std::min(size, max_size_);
+
+  std::uint64_t hash = 0;
+  std::size_t i = min_size_;
+  for (; i < normal; ++i) {
+    hash = (hash << 1) + gear[bytes[i]];
+    if ((hash & mask_small_) == 0) { return i + 1; }
+  }
+  for (; i < end; ++i) {
+    hash = (hash << 1) + gear[bytes[i]];
+    if ((hash & mask_large_) == 0) { return i + 1; }
+  }
+
+  return end;
+}
+};  // namespace dedup
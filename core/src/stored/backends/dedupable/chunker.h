@@ -0,0 +1,54 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#ifndef BAREOS_STORED_BACKENDS_DEDUPABLE_CHUNKER_H_
+#define BAREOS_STORED_BACKENDS_DEDUPABLE_CHUNKER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace dedup {
+/* Content defined chunking (FastCDC with normalized chunking).  The cut
+ * points only depend on the data itself, so inserting or removing bytes
+ * in a file only changes the chunks around the modification. */
+class chunker {
+ public:
+  static constexpr std::size_t min_avg_size = 256;
+  static constexpr std::size_t max_avg_size = 16 * 1024 * 1024;
+
+  // throws std::invalid_argument if avg_size is out of bounds
+  chunker(std::size_t avg_size);
+
+  // size of the first chunk of [data, data + size)
+  std::size_t next_chunk(const char* data, std::size_t size) const;
+
+  std::size_t avg_size() const { return avg_size_; }
+
+ private:
+  std::size_t min_size_;
+  std::size_t avg_size_;
+  std::size_t max_size_;
+  std::uint64_t mask_small_;
+  std::uint64_t mask_large_;
+};
+};  // namespace dedup
+
+#endif  // BAREOS_STORED_BACKENDS_DEDUPABLE_CHUNKER_H_
@@ -21,6 +21,7 @@
 #include <stdexcept>
 
 #include "device_options.h"
+#include "chunker.h"
 #include "stored/backends/util.h"
 #include <cstdint>
 #include "lib/edit.h"
@@ -56,6 +57,27 @@ auto device_option_parser::parse(std::string_view str) -> parse_result
         + std::to_string(result.options.blocksize) + ").");
   }
 
+  if (auto iter = options.find("chunksize"); iter != options.end()) {
+    auto& val = iter->second;
+
+    std::uint64_t chunksize;
+    if (!size_to_uint64(val.data(), &chunksize)) {
+      throw std::invalid_argument("bad chunk size: " + val);
+    }
+
+    if (chunksize < chunker::min_avg_size
+        || chunksize > chunker::max_avg_size) {
+      throw std::invalid_argument(
+          "chunk size " + val + " is not in range ["
+          + std::to_string(chunker::min_avg_size) + ", "
+          + std::to_string(chunker::max_avg_size) + "]");
+    }
+
+    result.options.chunksize = chunksize;
+
+    options.erase(iter);
+  }
+
   if (options.size() > 0) {
     std::string unknown = "Unknown options: ";
     for (auto [opt, _] : options) {
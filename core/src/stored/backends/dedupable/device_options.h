@@ -29,6 +29,7 @@
 namespace dedup {
 struct device_options {
   std::size_t blocksize{4096};
+  std::size_t chunksize{0}; /* 0 = no content defined chunking */
 };
 
 struct device_option_parser {
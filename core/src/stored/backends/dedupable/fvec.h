@@ -32,6 +32,7 @@ extern "C" {
 }
 #include <system_error>
 #include <limits>
+#include <algorithm>
 #include <cstring>
 #include <utility>
 
@@ -59,7 +60,7 @@ template <std::size_t Size> constexpr std::size_t MinGrowthSize()
 
 template <std::size_t Size> constexpr std::size_t MaxGrowthSize()
 {
-  // We want to grow at most 10MiB each time.
+  // We want to grow at most 100MiB each time.
   std::size_t max_growth_size = 1024ull * 1024ull * 100ull;
 
   return max_growth_size / Size;
@@ -112,6 +113,7 @@ template <typename T> class fvec : access {
     std::swap(count, other.count);
     std::swap(fd, other.fd);
     std::swap(prot, other.prot);
+    std::swap(preallocation, other.preallocation);
 
     return *this;
   }
@@ -122,13 +124,7 @@ template <typename T> class fvec : access {
 
   template <typename... Args> reference emplace_back(Args&&... args)
   {
-    auto cap = capacity();
-    if (count >= cap) {
-      // grow by ~50% each time
-      auto add = (cap >> 1) + 1;
-      if (add > max_growth_size) { add = max_growth_size; }
-      reserve(cap + add);
-    }
+    reserve(count + 1);
     new (&buffer[count]) T(std::forward<Args>(args)...);
     count += 1;
     return buffer[count - 1];
@@ -166,11 +162,16 @@ template <typename T> class fvec : access {
 
     auto diff = min_new_size - bytes_allocated;
 
-    if (diff < min_growth_size) { diff = min_growth_size; }
+    // grow by ~50% each time, so that appending to the vector only needs
+    // a logarithmic number of file extensions and remaps
+    auto geometric = std::min(bytes_allocated >> 1, max_growth_bytes);
+    if (diff < geometric) { diff = geometric; }
+    if (diff < min_growth_bytes) { diff = min_growth_bytes; }
+    if (diff < preallocation) { diff = preallocation; }
 
     auto size = bytes_allocated;
-    auto new_size = size + diff;
-    grow_file(new_size);
+    auto new_size = page_aligned(size + diff);
+    grow_file(size, new_size);
 
     auto* res = MAP_FAILED;
 #ifdef MREMAP_MAYMOVE
@@ -288,6 +289,13 @@ template <typename T> class fvec : access {
     bytes_allocated = new_size;
   }
 
+  // grow the file in allocated extents of (at least) this size
+  void preallocate(size_type extent_size)
+  {
+    preallocation = page_aligned(extent_size);
+  }
+  bool preallocates() const { return preallocation > 0; }
+
   void flush()
   {
     auto size = useful_bytes();
@@ -308,6 +316,7 @@ template <typename T> class fvec : access {
   size_type count{0};
   int fd{-1};
   int prot;
+  size_type preallocation{0};
 
   size_type page_aligned(size_type size)
   {
@@ -316,8 +325,10 @@ template <typename T> class fvec : access {
   }
   size_type useful_bytes() { return count * element_size; }
 
-  static constexpr std::size_t min_growth_size = MinGrowthSize<element_size>();
-  static constexpr std::size_t max_growth_size = MaxGrowthSize<element_size>();
+  static constexpr std::size_t min_growth_bytes
+      = MinGrowthSize<element_size>() * element_size;
+  static constexpr std::size_t max_growth_bytes
+      = MaxGrowthSize<element_size>() * element_size;
 
   template <typename... Args> static std::system_error error(Args&&... args)
   {
@@ -325,8 +336,17 @@ template <typename T> class fvec : access {
                              std::forward<Args>(args)...);
   }
 
-  void grow_file(std::size_t new_size)
+  void grow_file(std::size_t size, std::size_t new_size)
   {
+    if (preallocation > 0) {
+      // a full disk fails here and not when the mapping gets written
+      int err = posix_fallocate(fd, size, new_size - size);
+      if (err == 0) { return; }
+      if (err == ENOSPC) {
+        errno = err;
+        throw error("fallocate (new size = " + std::to_string(new_size) + ")");
+      }
+    }
     if (ftruncate(fd, new_size) != 0) {
       throw error("ftruncate/allocate (new size = " + std::to_string(new_size)
                   + ")");
@@ -362,7 +382,7 @@ template <typename T> class fvec : access {
       // that we can map something
       auto new_cap = 1024;
       filesize = new_cap * element_size;
-      grow_file(filesize);
+      grow_file(0, filesize);
     }
 
     buffer = reinterpret_cast<T*>(
@@ -37,6 +37,8 @@ config config_from_data(
     const std::unordered_map<std::uint32_t, std::string>& block_names,
     const std::unordered_map<std::uint32_t, std::string>& part_names,
     const std::unordered_map<std::uint32_t, std::string>& data_names,
+    const std::optional<config::index_file>& index_names,
+    const std::optional<config::chunk_file>& chunk_names,
     const data& backing)
 {
   config new_conf;
@@ -44,6 +46,8 @@ config config_from_data(
   auto& bfs = new_conf.bfiles;
   auto& pfs = new_conf.pfiles;
   auto& dfs = new_conf.dfiles;
+  auto& ifs = new_conf.ifiles;
+  auto& cfs = new_conf.cfiles;
 
   bfs.push_back(config::block_file{
       .relpath = block_names.at(0),
@@ -74,6 +78,23 @@ config config_from_data(
     });
   }
 
+  if (backing.has_index) {
+    ifs.push_back(config::index_file{
+        .relpath = index_names->relpath,
+        .extent_relpath = index_names->extent_relpath,
+        .Blocks = backing.ranges.size(),
+        .Extents = backing.extents.size(),
+    });
+  }
+
+  if (backing.chunking) {
+    cfs.push_back(config::chunk_file{
+        .relpath = chunk_names->relpath,
+        .Count = backing.chunks.size(),
+        .AvgSize = backing.chunking->avg_size(),
+    });
+  }
+
   return new_conf;
 }
 
@@ -131,6 +152,29 @@ void WriteFile(int fd, const std::vector<char>& written)
   }
 }
 
+// overwrites the file from the start, leaving no stale bytes behind
+void OverwriteFile(int fd, const std::vector<char>& written, std::size_t& size)
+{
+  std::size_t progress = 0;
+  while (progress < written.size()) {
+    auto res = pwrite(fd, written.data() + progress, written.size() - progress,
+                      progress);
+    if (res < 0) {
+      std::string errctx = "while writing";
+      throw std::system_error(errno, std::generic_category(), errctx);
+    } else if (res == 0) {
+      break;
+    } else {
+      progress += res;
+    }
+  }
+  if (progress < size && ftruncate(fd, progress) != 0) {
+    std::string errctx = "while truncating";
+    throw std::system_error(errno, std::generic_category(), errctx);
+  }
+  size = progress;
+}
+
 int OpenRelative(open_context ctx, const char* path)
 {
   int fd = openat(ctx.dird, path, ctx.flags);
@@ -169,9 +213,36 @@ block_header from_dedup(block b)
       .VolSessionTime = b.VolSessionTime,
   };
 }
+
+bool WriteRegion(data& backing, part region, chunked_writer& stream)
+{
+  auto didx = region.FileIdx.load();
+
+  auto dfile = backing.idx_to_dfile.find(didx);
+  if (dfile == backing.idx_to_dfile.end()) {
+    throw std::runtime_error("Trying to read from unknown file index "
+                             + std::to_string(didx)
+                             + "; known file indices are ...");
+  }
+
+  auto dbegin = region.Begin.load();
+  auto dsize = region.Size.load();
+
+  auto& vec = backing.datafiles[dfile->second];
+
+  if (vec.size() < dbegin + dsize) {
+    throw std::runtime_error(
+        "Trying to read region [" + std::to_string(dbegin) + ", "
+        + std::to_string(dbegin + dsize) + ") from file __ but only"
+        + std::to_string(vec.size()) + " bytes are used.");
+  }
+
+  return stream.write(vec.data() + dbegin, dsize);
+}
 };  // namespace
 
-volume::volume(open_type type, const char* path) : sys_path{path}
+volume::volume(open_type type, const char* path, std::size_t preallocation)
+    : sys_path{path}
 {
   bool read_only = type == open_type::ReadOnly;
   int flags = (read_only) ? O_RDONLY : O_RDWR;
@@ -185,7 +256,7 @@ volume::volume(open_type type, const char* path) : sys_path{path}
     throw std::system_error(errno, std::generic_category(), errctx);
   }
 
-  raii_fd conf_fd = openat(dird, "config", flags);
+  conf_fd = openat(dird, "config", flags);
 
   if (!conf_fd) {
     std::string errctx = "Cannot open '";
@@ -194,17 +265,21 @@ volume::volume(open_type type, const char* path) : sys_path{path}
     throw std::system_error(errno, std::generic_category(), errctx);
   }
   auto content = LoadFile(conf_fd.fileno());
+  conf_size = content.size();
   auto conf = config::deserialize(content.data(), content.size());
 
   for (auto& bf : conf.bfiles) { block_names[bf.Idx] = bf.relpath; }
   for (auto& pf : conf.pfiles) { record_names[pf.Idx] = pf.relpath; }
   for (auto& df : conf.dfiles) { data_names[df.Idx] = df.relpath; }
+  if (conf.ifiles.size() > 0) { index_names = conf.ifiles[0]; }
+  if (conf.cfiles.size() > 0) { chunk_names = conf.cfiles[0]; }
 
   backing.emplace(
       open_context{
           .read_only = read_only,
           .flags = flags,
           .dird = dird,
+          .preallocation = read_only ? 0 : preallocation,
       },
       conf);
 }
@@ -240,7 +315,8 @@ data::data(open_context ctx, const config& conf)
 			       " but write permissions requested.");
     }
     auto idx = datafiles.size();
-    datafiles.emplace_back(ctx.read_only, fd.fileno(), df.Size);
+    auto& vec = datafiles.emplace_back(ctx.read_only, fd.fileno(), df.Size);
+    if (ctx.preallocation > 0) { vec.preallocate(ctx.preallocation); }
 
     idx_to_dfile[df.Idx] = idx;
     bsize_to_idx[df.BlockSize] = df.Idx;
@@ -249,23 +325,59 @@ data::data(open_context ctx, const config& conf)
   if (bsize_to_idx.find(1) == bsize_to_idx.end()) {
     throw std::runtime_error("bad config (no datafile with BlockSize 1).");
   }
-}
 
-void volume::update_config()
-{
-  raii_fd conf_fd = openat(dird, "config", O_WRONLY);
+  // volumes created by older versions do not have an index; these are read
+  // through the part file instead.
+  if (conf.ifiles.size() > 1) {
+    throw std::runtime_error("bad config (num indexfiles ("
+                             + std::to_string(conf.ifiles.size()) + ") > 1)");
+  } else if (conf.ifiles.size() == 1) {
+    auto& xf = conf.ifiles[0];
+    if (xf.Blocks != bf.End) {
+      throw std::runtime_error("bad config (index covers "
+                               + std::to_string(xf.Blocks) + " of "
+                               + std::to_string(bf.End) + " blocks)");
+    }
 
-  if (!conf_fd) {
-    std::string errctx = "Could not open dedup config file";
-    throw std::system_error(errno, std::generic_category(), errctx);
+    raii_fd rfd = OpenRelative(ctx, xf.relpath.c_str());
+    raii_fd efd = OpenRelative(ctx, xf.extent_relpath.c_str());
+    ranges = decltype(ranges){ctx.read_only, rfd.fileno(), xf.Blocks};
+    extents = decltype(extents){ctx.read_only, efd.fileno(), xf.Extents};
+    fds.emplace_back(std::move(rfd));
+    fds.emplace_back(std::move(efd));
+    has_index = true;
   }
 
+  if (conf.cfiles.size() > 1) {
+    throw std::runtime_error("bad config (num chunkfiles ("
+                             + std::to_string(conf.cfiles.size()) + ") > 1)");
+  } else if (conf.cfiles.size() == 1) {
+    auto& cf = conf.cfiles[0];
+    chunking.emplace(cf.AvgSize);
+
+    raii_fd cfd = OpenRelative(ctx, cf.relpath.c_str());
+    chunks = decltype(chunks){ctx.read_only, cfd.fileno(), cf.Count};
+    fds.emplace_back(std::move(cfd));
+
+    if (!ctx.read_only) {
+      chunk_index.reserve(chunks.size());
+      for (std::size_t i = 0; i < chunks.size(); ++i) {
+        auto& c = chunks[i];
+        chunk_index.emplace(Xxh128Hash{c.HashLow, c.HashHigh}, i);
+      }
+    }
+  }
+}
+
+void volume::update_config()
+{
   config conf = config_from_data(block_names, record_names, data_names,
-                                 backing.value());
+                                 index_names, chunk_names, backing.value());
 
   auto serialized = config::serialize(conf);
 
-  WriteFile(conf_fd.fileno(), serialized);
+  // this runs once per committed block, so the file stays open
+  OverwriteFile(conf_fd.fileno(), serialized, conf_size);
 }
 
 std::size_t volume::blockcount() { return backing->blocks.size(); }
@@ -281,9 +393,12 @@ save_state volume::BeginBlock(block_header header)
 
   s.block_size = backing->blocks.size();
   s.part_size = backing->parts.size();
+  s.extent_size = backing->extents.size();
+  s.chunk_size = backing->chunks.size();
 
   for (auto& vec : backing->datafiles) { s.data_sizes.push_back(vec.size()); }
 
+  chunk_refs.clear();
   current_block.emplace(header);
 
   return s;
@@ -296,6 +411,7 @@ void volume::CommitBlock(save_state&& s)
   }
   auto start = s.part_size;
   auto count = backing->parts.size() - s.part_size;
+  if (backing->has_index) { IndexBlock(start, count); }
   backing->blocks.push_back(to_dedup(current_block.value(), start, count));
 
   update_config();
@@ -316,6 +432,28 @@ void volume::AbortBlock(save_state s)
 {
   backing->blocks.resize_uninitialized(s.block_size);
   backing->parts.resize_uninitialized(s.part_size);
+  if (backing->has_index) {
+    backing->ranges.resize_uninitialized(s.block_size);
+    backing->extents.resize_uninitialized(s.extent_size);
+  }
+  if (backing->chunking) {
+    auto& chunks = backing->chunks;
+    for (auto idx : chunk_refs) {
+      if (idx < s.chunk_size) {
+        chunks[idx].RefCount = chunks[idx].RefCount - 1;
+      }
+    }
+    for (auto idx = s.chunk_size; idx < chunks.size(); ++idx) {
+      auto& c = chunks[idx];
+      auto found
+          = backing->chunk_index.find(Xxh128Hash{c.HashLow, c.HashHigh});
+      if (found != backing->chunk_index.end() && found->second == idx) {
+        backing->chunk_index.erase(found);
+      }
+    }
+    chunks.resize_uninitialized(s.chunk_size);
+  }
+  chunk_refs.clear();
   ASSERT(s.data_sizes.size() == backing->datafiles.size());
 
   for (std::size_t i = 0; i < s.data_sizes.size(); ++i) {
@@ -325,6 +463,82 @@ void volume::AbortBlock(save_state s)
   if (current_block) { current_block.reset(); }
 }
 
+void volume::IndexBlock(std::size_t begin, std::size_t count)
+{
+  auto& extents = backing->extents;
+  auto first = extents.size();
+
+  for (auto cur = begin; cur != begin + count; ++cur) {
+    auto p = backing->parts[cur];
+    if (extents.size() > first) {
+      auto& last = extents[extents.size() - 1];
+      std::uint64_t merged_size = std::uint64_t{last.Size} + p.Size;
+      if (last.FileIdx == p.FileIdx && last.Begin + last.Size == p.Begin
+          && merged_size <= std::numeric_limits<std::uint32_t>::max()) {
+        last.Size = static_cast<std::uint32_t>(merged_size);
+        continue;
+      }
+    }
+    extents.push_back(p);
+  }
+
+  backing->ranges.push_back(extent_range{
+      .Begin = first,
+      .Count = SafeCast(extents.size() - first),
+  });
+}
+
+void volume::PushChunks(std::uint32_t FileIdx,
+                        const char* data,
+                        std::size_t size)
+{
+  auto& vec = backing->datafiles[backing->idx_to_dfile[FileIdx]];
+  auto& chunks = backing->chunks;
+
+  while (size > 0) {
+    auto chunk_size = backing->chunking->next_chunk(data, size);
+    auto fingerprint = Xxh128(data, chunk_size);
+
+    auto [found, inserted]
+        = backing->chunk_index.try_emplace(fingerprint, chunks.size());
+
+    std::size_t idx = found->second;
+    if (!inserted) {
+      // xxh128 is not collision resistant, so make sure that we really
+      // got the same data.
+      auto& c = chunks[idx];
+      auto& cvec = backing->datafiles[backing->idx_to_dfile[c.FileIdx]];
+      if (c.Size != chunk_size
+          || std::memcmp(cvec.data() + c.Begin, data, chunk_size) != 0) {
+        idx = chunks.size();
+        inserted = true;
+      }
+    }
+
+    if (inserted) {
+      char* start = vec.alloc_uninit(chunk_size);
+      std::memcpy(start, data, chunk_size);
+      chunks.push_back(chunk{
+          .HashLow = fingerprint.low64,
+          .HashHigh = fingerprint.high64,
+          .FileIdx = FileIdx,
+          .Size = SafeCast(chunk_size),
+          .Begin = static_cast<std::uint64_t>(start - vec.data()),
+          .RefCount = 0,
+      });
+    }
+
+    auto& c = chunks[idx];
+    c.RefCount = c.RefCount + 1;
+    chunk_refs.push_back(idx);
+    backing->parts.push_back(
+        part{.FileIdx = c.FileIdx, .Size = c.Size, .Begin = c.Begin});
+
+    data += chunk_size;
+    size -= chunk_size;
+  }
+}
+
 auto volume::reserve_parts(record_header header) -> std::vector<reserved_part>
 {
   if (header.Stream < 0) {
@@ -390,6 +604,14 @@ void volume::PushRecord(record_header header,
     backing->parts.push_back(part{.FileIdx = it->second,
                                   .Size = SafeCast(sizeof(header)),
                                   .Begin = (start - vec.data())});
+
+    if (backing->chunking) {
+      // chunks are not aligned, so they all go into the unaligned file.
+      // Split records do not need any reserved space as every part of
+      // them is chunked on its own.
+      PushChunks(it->second, data, size);
+      return;
+    }
   }
 
 
@@ -432,7 +654,8 @@ void volume::PushRecord(record_header header,
 
 void volume::create_new(int creation_mode,
                         const char* path,
-                        std::size_t blocksize)
+                        std::size_t blocksize,
+                        std::size_t chunksize)
 {
   int dir_mode
       = creation_mode | S_IXUSR;  // directories need execute permissions
@@ -455,7 +678,7 @@ void volume::create_new(int creation_mode,
     throw std::system_error(errno, std::generic_category(), errctx);
   }
 
-  auto conf = config::make_default(blocksize);
+  auto conf = config::make_default(blocksize, chunksize);
 
   auto data = config::serialize(conf);
 
@@ -504,12 +727,42 @@ void volume::create_new(int creation_mode,
       throw std::system_error(errno, std::generic_category(), errctx);
     }
   }
+  for (auto& ifile : conf.ifiles) {
+    for (auto& relpath : {ifile.relpath, ifile.extent_relpath}) {
+      if (raii_fd index_fd
+          = openat(dird.fileno(), relpath.c_str(), flags, creation_mode);
+          !index_fd) {
+        std::string errctx = "Cannot open '";
+        errctx += path;
+        errctx += "/";
+        errctx += relpath;
+        errctx += "'";
+        throw std::system_error(errno, std::generic_category(), errctx);
+      }
+    }
+  }
+  for (auto& cfile : conf.cfiles) {
+    if (raii_fd chunk_fd
+        = openat(dird.fileno(), cfile.relpath.c_str(), flags, creation_mode);
+        !chunk_fd) {
+      std::string errctx = "Cannot open '";
+      errctx += path;
+      errctx += "/";
+      errctx += cfile.relpath;
+      errctx += "'";
+      throw std::system_error(errno, std::generic_category(), errctx);
+    }
+  }
 }
 
 void volume::reset()
 {
   backing->blocks.clear();
   backing->parts.clear();
+  backing->ranges.clear();
+  backing->extents.clear();
+  backing->chunks.clear();
+  backing->chunk_index.clear();
   for (auto& vec : backing->datafiles) { vec.clear(); }
 
   update_config();
@@ -520,13 +773,34 @@ void volume::truncate()
   reset();
   backing->blocks.resize_to_fit();
   backing->parts.resize_to_fit();
+  if (backing->has_index) {
+    backing->ranges.resize_to_fit();
+    backing->extents.resize_to_fit();
+  }
+  if (backing->chunking) { backing->chunks.resize_to_fit(); }
   for (auto& vec : backing->datafiles) { vec.resize_to_fit(); }
 }
 
+// the data files grew by whole extents, cut them back to what is used
+void volume::release_preallocation()
+{
+  for (auto& vec : backing->datafiles) {
+    if (vec.preallocates()) {
+      vec.resize_to_fit();
+      vec.preallocate(0);
+    }
+  }
+}
+
 void volume::flush()
 {
   backing->blocks.flush();
   backing->parts.flush();
+  if (backing->has_index) {
+    backing->ranges.flush();
+    backing->extents.flush();
+  }
+  if (backing->chunking) { backing->chunks.flush(); }
   for (auto& vec : backing->datafiles) { vec.flush(); }
 }
 
@@ -561,34 +835,29 @@ std::size_t volume::ReadBlock(std::size_t blocknum,
 
   if (!stream.write(&header, sizeof(header))) { return 0; }
 
-  for (auto cur = begin; cur != end; ++cur) {
-    auto part = backing->parts[cur];
-    // auto rheader = from_dedup(record);
-
-    auto didx = part.FileIdx.load();
-
-    auto dfile = backing->idx_to_dfile.find(didx);
-    if (dfile == backing->idx_to_dfile.end()) {
-      throw std::runtime_error("Trying to read from unknown file index "
-                               + std::to_string(didx)
-                               + "; known file indices are ...");
-    }
-
-    // if (!stream.write(&rheader, sizeof(rheader))) { return 0; }
-
-    auto dbegin = part.Begin.load();
-    auto dsize = part.Size.load();
-
-    auto& vec = backing->datafiles[dfile->second];
+  if (backing->has_index) {
+    auto range = backing->ranges[blocknum];
+    auto ebegin = range.Begin.load();
+    auto eend = ebegin + range.Count;
 
-    if (vec.size() < dbegin + dsize) {
+    if (backing->extents.size() < eend) {
       throw std::runtime_error(
-          "Trying to read region [" + std::to_string(dbegin) + ", "
-          + std::to_string(dbegin + dsize) + ") from file __ but only"
-          + std::to_string(vec.size()) + " bytes are used.");
+          "Trying to read extents [" + std::to_string(ebegin) + ", "
+          + std::to_string(eend) + ") but only "
+          + std::to_string(backing->extents.size()) + " extents exist.");
     }
 
-    if (!stream.write(vec.data() + dbegin, dsize)) { return 0; }
+    for (auto cur = ebegin; cur != eend; ++cur) {
+      if (!WriteRegion(backing.value(), backing->extents[cur], stream)) {
+        return 0;
+      }
+    }
+  } else {
+    for (auto cur = begin; cur != end; ++cur) {
+      if (!WriteRegion(backing.value(), backing->parts[cur], stream)) {
+        return 0;
+      }
+    }
   }
 
   return size - stream.leftover();
@@ -687,11 +956,60 @@ struct serializable_data_file {
   }
 };
 
+struct serializable_index_file {
+  net_string RelPath;
+  net_string ExtentRelPath;
+  net<decltype(config::index_file::Blocks)> Blocks;
+  net<decltype(config::index_file::Extents)> Extents;
+
+  serializable_index_file() = default;
+  serializable_index_file(const config::index_file& xf,
+                          std::vector<char>& string_area)
+      : RelPath(string_area, xf.relpath.data(), xf.relpath.size())
+      , ExtentRelPath(string_area,
+                      xf.extent_relpath.data(),
+                      xf.extent_relpath.size())
+      , Blocks{xf.Blocks}
+      , Extents{xf.Extents}
+  {
+  }
+  config::index_file unserialize(std::string_view string_area)
+  {
+    return {
+        RelPath.unserialize(string_area),
+        ExtentRelPath.unserialize(string_area),
+        Blocks,
+        Extents,
+    };
+  }
+};
+
+struct serializable_chunk_file {
+  net_string RelPath;
+  net<decltype(config::chunk_file::Count)> Count;
+  net<decltype(config::chunk_file::AvgSize)> AvgSize;
+
+  serializable_chunk_file() = default;
+  serializable_chunk_file(const config::chunk_file& cf,
+                          std::vector<char>& string_area)
+      : RelPath(string_area, cf.relpath.data(), cf.relpath.size())
+      , Count{cf.Count}
+      , AvgSize{cf.AvgSize}
+  {
+  }
+  config::chunk_file unserialize(std::string_view string_area)
+  {
+    return {RelPath.unserialize(string_area), Count, AvgSize};
+  }
+};
+
 struct config_header {
   enum version : std::uint64_t
   {
     v0,  // for testing purposes if needed
     v1,
+    v2,  // v1 + block index
+    v3,  // v2 + chunk file
   };
   net_u64 version;
   net<std::uint32_t> string_size{};
@@ -699,6 +1017,16 @@ struct config_header {
   net<std::uint32_t> num_partfiles{};
   net<std::uint32_t> num_datafiles{};
 };
+
+// follows the config_header since v2
+struct config_header_v2 {
+  net<std::uint32_t> num_indexfiles{};
+};
+
+// follows the config_header_v2 since v3
+struct config_header_v3 {
+  net<std::uint32_t> num_chunkfiles{};
+};
 };  // namespace
 
 
@@ -707,7 +1035,9 @@ std::vector<char> config::serialize(const config& conf)
   std::vector<char> serial;
 
   config_header hdr;
-  hdr.version = config_header::version::v1;
+  hdr.version = config_header::version::v3;
+  config_header_v2 hdr2;
+  config_header_v3 hdr3;
 
   std::vector<serializable_block_file> bfs;
   for (auto bfile : conf.bfiles) { bfs.emplace_back(bfile, serial); }
@@ -715,6 +1045,10 @@ std::vector<char> config::serialize(const config& conf)
   for (auto pfile : conf.pfiles) { pfs.emplace_back(pfile, serial); }
   std::vector<serializable_data_file> dfs;
   for (auto dfile : conf.dfiles) { dfs.emplace_back(dfile, serial); }
+  std::vector<serializable_index_file> ifs;
+  for (auto ifile : conf.ifiles) { ifs.emplace_back(ifile, serial); }
+  std::vector<serializable_chunk_file> cfs;
+  for (auto cfile : conf.cfiles) { cfs.emplace_back(cfile, serial); }
 
   hdr.string_size = serial.size();
 
@@ -733,7 +1067,25 @@ std::vector<char> config::serialize(const config& conf)
     serial.insert(serial.end(), as_char, as_char + sizeof(df));
     hdr.num_datafiles = hdr.num_datafiles + 1;
   }
+  for (auto& xf : ifs) {
+    auto* as_char = reinterpret_cast<const char*>(&xf);
+    serial.insert(serial.end(), as_char, as_char + sizeof(xf));
+    hdr2.num_indexfiles = hdr2.num_indexfiles + 1;
+  }
+  for (auto& cf : cfs) {
+    auto* as_char = reinterpret_cast<const char*>(&cf);
+    serial.insert(serial.end(), as_char, as_char + sizeof(cf));
+    hdr3.num_chunkfiles = hdr3.num_chunkfiles + 1;
+  }
 
+  {
+    auto* as_char = reinterpret_cast<const char*>(&hdr3);
+    serial.insert(serial.begin(), as_char, as_char + sizeof(hdr3));
+  }
+  {
+    auto* as_char = reinterpret_cast<const char*>(&hdr2);
+    serial.insert(serial.begin(), as_char, as_char + sizeof(hdr2));
+  }
   {
     auto* as_char = reinterpret_cast<const char*>(&hdr);
     serial.insert(serial.begin(), as_char, as_char + sizeof(hdr));
@@ -742,8 +1094,13 @@ std::vector<char> config::serialize(const config& conf)
   return serial;
 }
 
-config config::make_default(std::uint64_t BlockSize)
+config config::make_default(std::uint64_t BlockSize, std::uint64_t ChunkSize)
 {
+  std::vector<chunk_file> cfiles;
+  if (ChunkSize > 0) {
+    cfiles.push_back({"chunks", 0, chunker{ChunkSize}.avg_size()});
+  }
+
   return config{
     .bfiles = {
       {"blocks", 0, 0, 0},
@@ -754,16 +1111,25 @@ config config::make_default(std::uint64_t BlockSize)
     .dfiles = {
       {"aligned.data", 0, BlockSize, 0, false},
       {"unaligned.data", 0, 1, 1, false},
-    }
+    },
+    .ifiles = {
+      {"index", "extents", 0, 0},
+    },
+    .cfiles = std::move(cfiles),
   };
 }
 
 namespace {
-config deserialize_config_v1(chunked_reader stream, config_header& hdr)
+config deserialize_config_v1(chunked_reader stream,
+                             config_header& hdr,
+                             std::uint32_t num_indexfiles = 0,
+                             std::uint32_t num_chunkfiles = 0)
 {
   config conf;
 
-  if (hdr.version != config_header::version::v1) {
+  if (hdr.version != config_header::version::v1
+      && hdr.version != config_header::version::v2
+      && hdr.version != config_header::version::v3) {
     throw std::runtime_error(
         "Internal error: trying to deserialize wrong config version.");
   }
@@ -777,6 +1143,12 @@ config deserialize_config_v1(chunked_reader stream, config_header& hdr)
   if (hdr.num_datafiles != 2) {
     throw std::runtime_error("bad config file (num datafiles != 2)");
   }
+  if (num_indexfiles > 1) {
+    throw std::runtime_error("bad config file (num indexfiles > 1)");
+  }
+  if (num_chunkfiles > 1) {
+    throw std::runtime_error("bad config file (num chunkfiles > 1)");
+  }
 
   const char* string_begin = stream.get(hdr.string_size);
   if (!string_begin) { throw std::runtime_error("config file to small."); }
@@ -808,6 +1180,24 @@ config deserialize_config_v1(chunked_reader stream, config_header& hdr)
     conf.dfiles.push_back(df.unserialize(string_area));
   }
 
+  for (std::size_t i = 0; i < num_indexfiles; ++i) {
+    serializable_index_file xf;
+    if (!stream.read(&xf, sizeof(xf))) {
+      throw std::runtime_error("config file to small.");
+    }
+
+    conf.ifiles.push_back(xf.unserialize(string_area));
+  }
+
+  for (std::size_t i = 0; i < num_chunkfiles; ++i) {
+    serializable_chunk_file cf;
+    if (!stream.read(&cf, sizeof(cf))) {
+      throw std::runtime_error("config file to small.");
+    }
+
+    conf.cfiles.push_back(cf.unserialize(string_area));
+  }
+
   if (!stream.finished()) { throw std::runtime_error("config file to big."); }
 
   return conf;
@@ -827,6 +1217,23 @@ config config::deserialize(const char* data, std::size_t size)
     case config_header::version::v1: {
       return deserialize_config_v1(std::move(stream), hdr);
     } break;
+    case config_header::version::v2: {
+      config_header_v2 hdr2;
+      if (!stream.read(&hdr2, sizeof(hdr2))) {
+        throw std::runtime_error("config file to small.");
+      }
+      return deserialize_config_v1(std::move(stream), hdr, hdr2.num_indexfiles);
+    } break;
+    case config_header::version::v3: {
+      config_header_v2 hdr2;
+      config_header_v3 hdr3;
+      if (!stream.read(&hdr2, sizeof(hdr2))
+          || !stream.read(&hdr3, sizeof(hdr3))) {
+        throw std::runtime_error("config file to small.");
+      }
+      return deserialize_config_v1(std::move(stream), hdr, hdr2.num_indexfiles,
+                                   hdr3.num_chunkfiles);
+    } break;
     default: {
       throw std::runtime_error("bad config version (version = "
                                + std::to_string(hdr.version.load()) + ")");
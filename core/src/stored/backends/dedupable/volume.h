@@ -31,7 +31,9 @@
 #include <vector>
 #include "fvec.h"
 #include "util.h"
+#include "chunker.h"
 #include "lib/util.h"
+#include "lib/xxhash.h"
 
 #include "lib/network_order.h"
 
@@ -48,6 +50,7 @@ struct open_context {
   bool read_only;
   int flags;
   int dird;
+  std::size_t preallocation; /* of the data files, 0 = none */
 };
 
 };  // namespace
@@ -68,11 +71,35 @@ struct part {
   net_u64 Begin;   /* offset into datafile from where to start reading */
 };
 
+/* Consecutive parts of a block usually lie back to back in the same data
+ * file (e.g. a record header followed by its unaligned payload).  The index
+ * stores them merged into extents, so that reading a block only needs to
+ * look at as few regions as possible. */
+using extent = part;
+
+struct extent_range {
+  net_u64 Begin; /* first extent of the block */
+  net_u32 Count; /* number of extents in the block */
+};
+
+/* A deduplicated piece of record payload.  Parts of blocks written with
+ * content defined chunking refer to the data of these chunks. */
+struct chunk {
+  net_u64 HashLow;  /* xxh128 of the chunk data */
+  net_u64 HashHigh; /* xxh128 of the chunk data */
+  net_u32 FileIdx;  /* which data file has the data */
+  net_u32 Size;     /* size of the chunk */
+  net_u64 Begin;    /* offset into datafile */
+  net_u64 RefCount; /* number of parts referencing this chunk */
+};
+
 class volume;
 
 struct save_state {
   std::size_t block_size{0};
   std::size_t part_size{0};
+  std::size_t extent_size{0};
+  std::size_t chunk_size{0};
   std::vector<std::size_t> data_sizes;
 
   save_state() = default;
@@ -105,13 +132,30 @@ struct config {
     bool ReadOnly;
   };
 
+  struct index_file {
+    std::string relpath;        /* one extent_range per block */
+    std::string extent_relpath; /* the extents themselves */
+    std::uint64_t Blocks;
+    std::uint64_t Extents;
+  };
+
+  struct chunk_file {
+    std::string relpath;
+    std::uint64_t Count;
+    std::uint64_t AvgSize; /* average size used by the chunker */
+  };
+
   std::vector<block_file> bfiles;
   std::vector<part_file> pfiles;
   std::vector<data_file> dfiles;
+  std::vector<index_file> ifiles; /* empty for volumes without index */
+  std::vector<chunk_file> cfiles; /* empty if chunking is disabled */
 
   static std::vector<char> serialize(const config& conf);
   static config deserialize(const char* data, std::size_t size);
-  static config make_default(std::uint64_t BlockSize);
+  // ChunkSize = 0 disables content defined chunking
+  static config make_default(std::uint64_t BlockSize,
+                             std::uint64_t ChunkSize = 0);
 };
 
 class data {
@@ -124,10 +168,22 @@ class data {
 
   fvec<part> parts;
   fvec<block> blocks;
+  bool has_index{false};
+  fvec<extent_range> ranges;
+  fvec<extent> extents;
   std::vector<fvec<char>> datafiles;
   std::unordered_map<std::uint32_t, std::size_t> idx_to_dfile;
   bsize_map bsize_to_idx;
 
+  struct fingerprint_hash {
+    std::size_t operator()(Xxh128Hash h) const { return h.low64; }
+  };
+
+  std::optional<chunker> chunking;
+  fvec<chunk> chunks;
+  // only filled if the volume was opened for writing
+  std::unordered_map<Xxh128Hash, std::size_t, fingerprint_hash> chunk_index;
+
   data(open_context ctx, const config& conf);
 };
 
@@ -169,14 +225,15 @@ class volume {
     ReadOnly
   };
 
-  volume(open_type type, const char* path);
+  volume(open_type type, const char* path, std::size_t preallocation = 0);
 
   const char* path() const { return sys_path.c_str(); }
   int fileno() const { return dird; }
 
   static void create_new(int creation_mode,
                          const char* path,
-                         std::size_t blocksize);
+                         std::size_t blocksize,
+                         std::size_t chunksize = 0);
 
 
   // writing interface
@@ -192,15 +249,20 @@ class volume {
   void reset();
   void flush();
   void truncate();
+  void release_preallocation();
   std::size_t blockcount();
 
  private:
   std::string sys_path;
   int dird;
+  raii_fd conf_fd;
+  std::size_t conf_size{0};
 
   std::unordered_map<std::uint32_t, std::string> block_names;
   std::unordered_map<std::uint32_t, std::string> record_names;
   std::unordered_map<std::uint32_t, std::string> data_names;
+  std::optional<config::index_file> index_names;
+  std::optional<config::chunk_file> chunk_names;
 
   std::optional<data> backing;
   void update_config();
@@ -217,6 +279,11 @@ class volume {
   std::unordered_map<urid, std::vector<reserved_part>, urid_hash> unfinished;
 
   std::vector<reserved_part> reserve_parts(record_header header);
+  void IndexBlock(std::size_t begin, std::size_t count);
+
+  // chunks whose RefCount was increased by the current block
+  std::vector<std::size_t> chunk_refs;
+  void PushChunks(std::uint32_t FileIdx, const char* data, std::size_t size);
 };
 };  // namespace dedup
 
@@ -127,7 +127,8 @@ int dedup_device::d_open(const char* path, int, int mode)
       //       even though it knows that it already exists.
       //       E.g. when relabeling because of a truncate command.
       try {
-        dedup::volume::create_new(mode, path, parsed.options.blocksize);
+        dedup::volume::create_new(mode, path, parsed.options.blocksize,
+                                  parsed.options.chunksize);
       } catch (const std::exception& ex) {
         Dmsg3(200,
               "Could not create new volume %s while opening as %s. "
@@ -142,7 +143,8 @@ int dedup_device::d_open(const char* path, int, int mode)
     auto& opened_volume
         = (read_only)
               ? openvol.emplace(dedup::volume::open_type::ReadOnly, path)
-              : openvol.emplace(dedup::volume::open_type::ReadWrite, path);
+              : openvol.emplace(dedup::volume::open_type::ReadWrite, path,
+                                device_resource->preallocation_size);
 
     return opened_volume.fileno();
   } catch (const std::exception& ex) {
@@ -327,6 +329,7 @@ int dedup_device::d_close(int dird)
 
   std::string volname = openvol->path();
   try {
+    openvol->release_preallocation();
     openvol.reset();
     return 0;
   } catch (const std::exception& ex) {
@@ -386,9 +389,11 @@ bool dedup_device::d_truncate(DeviceControlRecord* dcr)
   try {
     auto parsed = dedup::device_option_parser::parse(dev_options ?: "");
     dedup::volume::create_new(s.st_mode, path.c_str(),
-                              parsed.options.blocksize);
+                              parsed.options.blocksize,
+                              parsed.options.chunksize);
     auto& opened_volume
-        = openvol.emplace(dedup::volume::open_type::ReadWrite, path.c_str());
+        = openvol.emplace(dedup::volume::open_type::ReadWrite, path.c_str(),
+                          device_resource->preallocation_size);
     Device::fd = opened_volume.fileno();
   } catch (const std::exception& ex) {
     Emsg0(M_ERROR, 0, T_("Could not recreate %s. ERR=%s\n"), path.c_str(),
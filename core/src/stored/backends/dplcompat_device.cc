@@ -32,8 +32,11 @@
 #include <fmt/format.h>
 #include <gsl/gsl>
 #include "util.h"
+#include "option_conversion.h"
 
 namespace utl = backends::util;
+using utl::fetch_value;
+using utl::get_converter;
 using namespace std::literals::string_literals;
 
 namespace {
@@ -56,86 +59,12 @@ bool is_chunk_name(const std::string& name)
 static const utl::options option_defaults{
     {"chunksize", "10485760"},  // 10 MB
     {"iothreads", "0"},        {"ioslots", "10"}, {"retries", "0"},
+    {"readahead", "0"},
     {"program_timeout", "0"},  // use default in crud_storage
+    {"program_sessions", "0"},
+    {"truncate_threads", "2"},  // 0 truncates volumes while waiting
 };
 
-// delete this, so only specializations will be considered
-template <typename T> void convert_value(T&, const std::string&) = delete;
-
-template <>
-[[maybe_unused]] void convert_value<>(unsigned long long& to,
-                                      const std::string& from)
-{
-  to = std::stoull(from);
-}
-
-template <>
-[[maybe_unused]] void convert_value<>(unsigned long& to,
-                                      const std::string& from)
-{
-  to = std::stoul(from);
-}
-
-template <> void convert_value<>(uint8_t& to, const std::string& from)
-{
-  to = gsl::narrow<uint8_t>(std::stoul(from));
-}
-
-template <> void convert_value<>(uint32_t& to, const std::string& from)
-{
-  to = gsl::narrow<uint32_t>(std::stoul(from));
-}
-
-
-template <> void convert_value<>(std::string& to, const std::string& from)
-{
-  to = from;
-}
-
-template <typename T>
-tl::expected<utl::options*, std::string> convert(utl::options* options,
-                                                 const std::string& key,
-                                                 T& target)
-{
-  auto node_handle = options->extract(key);
-  if (node_handle.empty()) {
-    return tl::unexpected(
-        fmt::format("no value provided for option '{}'\n", key));
-  }
-  auto value = node_handle.mapped();
-
-  try {
-    convert_value(target, value);
-  } catch (std::invalid_argument& e) {
-    return tl::unexpected(fmt::format(
-        "invalid argument '{}' for option '{}': {}\n", value, key, e.what()));
-  } catch (std::out_of_range& e) {
-    return tl::unexpected(
-        fmt::format("value '{}' for option '{}' is out of range: {}\n", value,
-                    key, e.what()));
-  } catch (gsl::narrowing_error& e) {
-    return tl::unexpected(
-        fmt::format("value '{}' for option '{}' would be truncated: {}\n",
-                    value, key, e.what()));
-  }
-  return options;
-}
-
-std::optional<std::string> fetch_value(utl::options& options,
-                                       const std::string& key)
-{
-  auto node_handle = options.extract(key);
-  if (node_handle.empty()) { return std::nullopt; }
-  return node_handle.mapped();
-}
-
-template <typename T> auto get_converter(const std::string& key, T& target)
-{
-  return [&key, &target](utl::options* options) {
-    return convert(options, key, target);
-  };
-}
-
 }  // namespace
 
 namespace storagedaemon {
@@ -171,19 +100,26 @@ tl::expected<void, std::string> DropletCompatibleDevice::setup_impl()
 
   std::string program;
   uint32_t program_timeout{0};
+  uint32_t program_sessions{0};
+  uint32_t truncate_threads{0};
 
   if (auto conversion_result
       = tl::expected<utl::options*, std::string>{&options}
             .and_then(get_converter("iothreads", io_threads_))
             .and_then(get_converter("ioslots", io_slots_))
             .and_then(get_converter("retries", retries_))
+            .and_then(get_converter("readahead", readahead_))
             .and_then(get_converter("chunksize", chunk_size_))
             .and_then(get_converter("program", program))
-            .and_then(get_converter("program_timeout", program_timeout));
+            .and_then(get_converter("program_timeout", program_timeout))
+            .and_then(get_converter("program_sessions", program_sessions))
+            .and_then(get_converter("truncate_threads", truncate_threads));
       !conversion_result) {
     return tl::unexpected(conversion_result.error());
   }
 
+  ranged_reads_ = true;
+
   if (program.empty()) {
     return tl::unexpected("Option 'program' is required\n"s);
   }
@@ -215,6 +151,32 @@ tl::expected<void, std::string> DropletCompatibleDevice::setup_impl()
     return tl::unexpected(fmt::format("Unknown options encountered: {}\n",
                                       option_names.Join(", ")));
   }
+
+  // needs the options to be set, as it already starts a session
+  if (auto result = m_storage.set_max_sessions(program_sessions); !result) {
+    return tl::unexpected(
+        fmt::format("Cannot use program sessions.\nCause: {}\n",
+                    result.error()));
+  }
+
+  if (truncate_threads > 0) {
+    m_truncation = std::make_unique<BackgroundTruncation>(
+        [this](const std::string& volume,
+               const std::vector<std::string>& chunks) {
+          return RemoveChunks(volume, chunks);
+        },
+        truncate_threads, 100);
+  }
+  return {};
+}
+
+tl::expected<void, std::string> DropletCompatibleDevice::RemoveChunks(
+    const std::string& volume,
+    const std::vector<std::string>& chunks)
+{
+  for (const std::string& chunk : chunks) {
+    if (auto res = m_storage.remove(volume, chunk); !res) { return res; }
+  }
   return {};
 }
 
@@ -244,6 +206,10 @@ bool DropletCompatibleDevice::FlushRemoteChunk(chunk_io_request* request)
   }
 
 
+  // a chunk of a truncated volume that was not removed yet gets overwritten
+  const bool stale = m_truncation
+                     && m_truncation->Claim(request->volname, obj_chunk);
+
   /* Check on the remote backing store if the chunk already exists.
    * We only upload this chunk if it is bigger then the chunk that exists
    * on the remote backing store. When using io-threads it could happen
@@ -251,7 +217,8 @@ bool DropletCompatibleDevice::FlushRemoteChunk(chunk_io_request* request)
    * chunk is reused in a next backup job. We only want the chunk with
    * the biggest amount of valid data to persist as we only append to
    * chunks. */
-  auto obj_stat = m_storage.stat(obj_name, obj_chunk);
+  auto obj_stat = stale ? tl::unexpected("stale"s)
+                        : m_storage.stat(obj_name, obj_chunk);
 
   if (obj_stat && obj_stat->size > request->wbuflen) {
     Dmsg1(debug_info,
@@ -279,6 +246,31 @@ bool DropletCompatibleDevice::ReadRemoteChunk(chunk_io_request* request)
   const std::string obj_chunk = get_chunk_name(request);
   Dmsg1(debug_trace, "Reading chunk %s\n", obj_name.data());
 
+  if (m_truncation && m_truncation->IsStale(request->volname, obj_chunk)) {
+    Mmsg(errmsg, T_("Chunk %s/%s was truncated\n"), obj_name.data(),
+         obj_chunk.c_str());
+    Dmsg1(debug_info, "%s", errmsg);
+    dev_errno = EIO;
+    return false;
+  }
+
+  if (request->length > 0 && m_storage.ranged_downloads()) {
+    if (auto obj_data = m_storage.download_range(
+            obj_name, obj_chunk, request->offset,
+            {request->buffer + request->offset, request->length})) {
+      *request->rbuflen = request->offset + obj_data->size_bytes();
+      return true;
+    } else if (m_storage.ranged_downloads()) {
+      PmStrcpy(errmsg, obj_data.error().c_str());
+      Dmsg1(debug_info, "%s", errmsg);
+      dev_errno = EIO;
+      return false;
+    }
+  }
+  // read the whole chunk, also when the program cannot download ranges
+  request->offset = 0;
+  request->length = 0;
+
   // check object metadata
   auto obj_stat = m_storage.stat(obj_name, obj_chunk);
   if (!obj_stat) {
@@ -317,14 +309,21 @@ bool DropletCompatibleDevice::TruncateRemoteVolume(DeviceControlRecord*)
     dev_errno = EIO;
     return false;
   }
+  std::vector<std::string> chunks;
   for (const auto& [chunk_name, stat] : *chunk_map) {
-    if (is_chunk_name(chunk_name)) {
-      if (auto res = m_storage.remove(vol_name, chunk_name); !res) {
-        PmStrcpy(errmsg, chunk_map.error().c_str());
-        dev_errno = EIO;
-        return false;
-      }
-    }
+    if (is_chunk_name(chunk_name)) { chunks.push_back(chunk_name); }
+  }
+
+  /* The volume counts as empty right away, the chunks it still has are
+   * overwritten or removed later. */
+  if (m_truncation) {
+    m_truncation->Enqueue(vol_name, chunks);
+    return true;
+  }
+  if (auto res = RemoveChunks(vol_name, chunks); !res) {
+    PmStrcpy(errmsg, res.error().c_str());
+    dev_errno = EIO;
+    return false;
   }
   return true;
 }
@@ -337,12 +336,17 @@ ssize_t DropletCompatibleDevice::RemoteVolumeSize()
     dev_errno = EIO;
     return false;
   }
-  if (chunk_map->empty()) { return -1; }
+  const char* vol_name = getVolCatName();
+  bool found{false};
   ssize_t total_size{0};
   for (const auto& [name, stat] : *chunk_map) {
-    if (is_chunk_name(name)) { total_size += stat.size; }
+    if (is_chunk_name(name)
+        && !(m_truncation && m_truncation->IsStale(vol_name, name))) {
+      found = true;
+      total_size += stat.size;
+    }
   }
-  return total_size;
+  return found ? total_size : -1;
 }
 
 
@@ -25,6 +25,8 @@
 #include "chunked_device.h"
 #include <gsl/span>
 #include <map>
+#include <memory>
+#include "background_truncation.h"
 #include "crud_storage.h"
 #include <tl/expected.hpp>
 
@@ -35,8 +37,12 @@ class DropletCompatibleDevice : public ChunkedDevice {
   /* maximun number of chunks in a volume (0000 to 9999) */
   static constexpr int max_chunks_ = 10000;
   CrudStorage m_storage;
+  std::unique_ptr<BackgroundTruncation> m_truncation; /**< Uses m_storage */
   bool m_setup_succeeded{false};
   tl::expected<void, std::string> setup_impl();
+  tl::expected<void, std::string> RemoveChunks(
+      const std::string& volume,
+      const std::vector<std::string>& chunks);
 
   // Interface from ChunkedDevice
   bool CheckRemoteConnection() override;
@@ -65,6 +65,7 @@ enum device_option_type
   argument_iothreads,
   argument_ioslots,
   argument_retries,
+  argument_readahead,
   argument_mmap
 };
 
@@ -84,6 +85,7 @@ static device_option device_options[]
        {"iothreads=", argument_iothreads, 10},
        {"ioslots=", argument_ioslots, 8},
        {"retries=", argument_retries, 8},
+       {"readahead=", argument_readahead, 10},
        {"mmap", argument_mmap, 4},
        {NULL, argument_none, 0}};
 
@@ -550,6 +552,62 @@ bool DropletDevice::ReadRemoteChunk(chunk_io_request* request)
   int tries = 0;
   bool success = false;
 
+  /* A range is read right away, the request fails if the chunk does not
+   * exist and returns less data at its end. */
+  if (request->length > 0) {
+    do {
+      memset(&dpl_options, 0, sizeof(dpl_options));
+      dpl_options.mask |= DPL_OPTION_NOALLOC;
+
+      dpl_range.start = request->offset;
+      dpl_range.end = request->offset + request->length - 1;
+      char* buffer = request->buffer + request->offset;
+      unsigned int buflen = request->length;
+      if (sysmd) { dpl_sysmd_free(sysmd); }
+      sysmd = dpl_sysmd_dup(&sysmd_);
+      status = dpl_fget(ctx_,               /* context */
+                        chunk_name.c_str(), /* locator */
+                        &dpl_options,       /* options */
+                        NULL,               /* condition */
+                        &dpl_range,         /* range */
+                        &buffer,            /* data_bufp */
+                        &buflen,            /* data_lenp */
+                        NULL,               /* metadatap */
+                        sysmd);             /* sysmdp */
+
+      switch (status) {
+        case DPL_SUCCESS:
+          *request->rbuflen = request->offset + buflen;
+          success = true;
+          dev_errno = 0;
+          break;
+        case DPL_ERANGEUNAVAIL:
+          // The range starts after the end of the chunk.
+          *request->rbuflen = request->offset;
+          success = true;
+          dev_errno = 0;
+          break;
+        case DPL_ENOENT:
+        case DPL_EINVAL:
+          Mmsg1(errmsg, T_("Failed to open %s doesn't exist\n"),
+                chunk_name.c_str());
+          Dmsg1(100, "%s", errmsg);
+          dev_errno = EIO;
+          goto bail_out;
+        default:
+          Mmsg2(errmsg, T_("Failed to read %s using dpl_fget(): ERR=%s.\n"),
+                chunk_name.c_str(), dpl_status_str(status));
+          Dmsg1(100, "%s", errmsg);
+          dev_errno = DropletErrnoToSystemErrno(status);
+          Bmicrosleep(INFLIGT_RETRY_TIME, 0);
+          ++tries;
+      }
+    } while (!success && tries < NUMBER_OF_RETRIES);
+
+    retval = success;
+    goto bail_out;
+  }
+
   do {
     if (sysmd) { dpl_sysmd_free(sysmd); }
     sysmd = dpl_sysmd_dup(&sysmd_);
@@ -780,6 +838,11 @@ bool DropletDevice::initialize()
               retries_ = value & 0xFF;
               done = true;
               break;
+            case argument_readahead:
+              size_to_uint64(bp + device_options[i].compare_size, &value);
+              readahead_ = value & 0xFF;
+              done = true;
+              break;
             case argument_mmap:
               use_mmap_ = true;
               done = true;
@@ -806,6 +869,8 @@ bool DropletDevice::initialize()
     }
   }
 
+  ranged_reads_ = true;
+
   // See if we need to setup a new context for this device.
   if (!ctx_) {
     char* bp;
@@ -41,6 +41,7 @@
 #include "stored/autochanger.h"
 #include "lib/scsi_lli.h"
 #include "lib/berrno.h"
+#include "lib/edit.h"
 #include "lib/util.h"
 
 namespace storagedaemon {
@@ -1342,6 +1343,73 @@ bool generic_tape_device::UnmountBackend(DeviceControlRecord* dcr, int timeout)
   return retval;
 }
 
+/* Bytes written with every block size tried at the start of a new volume.
+ * Only the time spent in write() counts, so a slow client does not matter. */
+static constexpr uint64_t block_size_trial_bytes = 512 * 1024 * 1024;
+
+void generic_tape_device::StartBlockSizeTrials()
+{
+  trials_.clear();
+  current_trial_ = 0;
+
+  uint32_t smallest = std::max<uint32_t>(min_block_size, DEFAULT_BLOCK_SIZE);
+  for (uint32_t size = max_block_size; size >= smallest; size /= 2) {
+    if (size % TAPE_BSIZE != 0) { break; }
+    trials_.push_back(block_size_trial{size});
+  }
+  if (trials_.size() < 2) { trials_.clear(); }
+}
+
+void generic_tape_device::FinishBlockSizeTrials(DeviceControlRecord* dcr)
+{
+  auto rate = [](const block_size_trial& t) {
+    return t.write_time ? t.bytes * 1000000 / t.write_time : 0;
+  };
+  const block_size_trial* best = &trials_.front();
+  for (auto& trial : trials_) {
+    if (rate(trial) > rate(*best)) { best = &trial; }
+  }
+
+  char ed1[50];
+  tuned_block_size_ = best->size;
+  Jmsg(dcr->jcr, M_INFO, 0,
+       T_("Writing Volume \"%s\" on %s with blocks of %u bytes (%s B/s).\n"),
+       trial_volume_.c_str(), print_name(), best->size,
+       edit_uint64_with_suffix(rate(*best), ed1));
+  trials_.clear();
+}
+
+uint32_t generic_tape_device::NextWriteBlockSize(DeviceControlRecord* dcr,
+                                                 uint32_t len)
+{
+  if (!device_resource->adaptive_block_size
+      || min_block_size == max_block_size) {
+    return 0;
+  }
+
+  if (trial_volume_ != VolHdr.VolumeName) {
+    trial_volume_ = VolHdr.VolumeName;
+    trials_.clear();
+    // only new volumes, appending to the end of one keeps what we have
+    if (VolCatInfo.VolCatBytes < block_size_trial_bytes) {
+      StartBlockSizeTrials();
+    }
+  }
+  if (trials_.empty()) { return tuned_block_size_; }
+
+  block_size_trial& trial = trials_[current_trial_];
+  if (len == trial.size) {
+    trial.bytes += len;
+    trial.write_time += last_tick;
+  }
+  if (trial.bytes >= block_size_trial_bytes
+      && ++current_trial_ == trials_.size()) {
+    FinishBlockSizeTrials(dcr);
+    return tuned_block_size_;
+  }
+  return trials_[current_trial_].size;
+}
+
 int generic_tape_device::d_open(const char* pathname, int flags, int mode)
 {
   return ::open(pathname, flags, mode);
@@ -30,6 +30,9 @@
 
 #include "stored/dev.h"
 
+#include <string>
+#include <vector>
+
 namespace storagedaemon {
 
 class generic_tape_device : public Device {
@@ -73,11 +76,26 @@ class generic_tape_device : public Device {
   virtual ssize_t d_read(int fd, void* buffer, size_t count) override;
   virtual ssize_t d_write(int fd, const void* buffer, size_t count) override;
   virtual bool d_truncate(DeviceControlRecord* dcr) override;
+  uint32_t NextWriteBlockSize(DeviceControlRecord* dcr, uint32_t len) override;
 
  private:
   bool do_mount(DeviceControlRecord* dcr, int mount, int dotimeout);
   void OsClrError();
   void HandleError(int func);
+
+  // Adaptive Block Size: write throughput of the block sizes tried
+  struct block_size_trial {
+    uint32_t size{};
+    uint64_t bytes{};
+    btime_t write_time{}; /**< usec */
+  };
+  void StartBlockSizeTrials();
+  void FinishBlockSizeTrials(DeviceControlRecord* dcr);
+
+  std::string trial_volume_;
+  std::vector<block_size_trial> trials_;
+  std::size_t current_trial_{};
+  uint32_t tuned_block_size_{}; /**< fastest size found, 0 if none */
 };
 
 } /* namespace storagedaemon */
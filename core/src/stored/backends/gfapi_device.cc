@@ -33,6 +33,7 @@
 #  include "stored/backends/gfapi_device.h"
 #  include "lib/edit.h"
 #  include "lib/berrno.h"
+#  include "lib/gfapi_async_io.h"
 
 namespace storagedaemon {
 
@@ -42,7 +43,8 @@ enum device_option_type
   argument_none = 0,
   argument_uri,
   argument_logfile,
-  argument_loglevel
+  argument_loglevel,
+  argument_queuedepth
 };
 
 struct device_option {
@@ -54,6 +56,8 @@ struct device_option {
 static device_option device_options[] = {{"uri=", argument_uri, 4},
                                          {"logfile=", argument_logfile, 8},
                                          {"loglevel=", argument_loglevel, 9},
+                                         {"queuedepth=", argument_queuedepth,
+                                          11},
                                          {NULL, argument_none, 0}};
 
 /**
@@ -299,6 +303,10 @@ int gfapi_device::d_open(const char*, int flags, int mode)
               gfapi_loglevel_
                   = strtol(bp + device_options[i].compare_size, NULL, 10);
               break;
+            case argument_queuedepth:
+              queue_depth_
+                  = strtol(bp + device_options[i].compare_size, NULL, 10);
+              break;
             default:
               Mmsg1(errmsg, T_("Unable to parse device option: %s\n"), bp);
               Emsg0(M_FATAL, 0, errmsg);
@@ -368,6 +376,7 @@ int gfapi_device::d_open(const char*, int flags, int mode)
 
   // See if we don't have a file open already.
   if (gfd_) {
+    async_io_.reset();
     glfs_close(gfd_);
     gfd_ = NULL;
   }
@@ -417,6 +426,10 @@ int gfapi_device::d_open(const char*, int flags, int mode)
 
   if (!gfd_) { goto bail_out; }
 
+  if (queue_depth_ > 0) {
+    async_io_ = std::make_unique<gfapi_async_io>(gfd_, queue_depth_);
+  }
+
   return 0;
 
 bail_out:
@@ -433,6 +446,7 @@ bail_out:
 ssize_t gfapi_device::d_read(int, void* buffer, size_t count)
 {
   if (gfd_) {
+    if (async_io_) { return async_io_->Read(buffer, count); }
     return glfs_read(gfd_, buffer, count, 0);
   } else {
     errno = EBADF;
@@ -444,6 +458,7 @@ ssize_t gfapi_device::d_read(int, void* buffer, size_t count)
 ssize_t gfapi_device::d_write(int, const void* buffer, size_t count)
 {
   if (gfd_) {
+    if (async_io_) { return async_io_->Write(buffer, count); }
     return glfs_write(gfd_, buffer, count, 0);
   } else {
     errno = EBADF;
@@ -451,13 +466,27 @@ ssize_t gfapi_device::d_write(int, const void* buffer, size_t count)
   }
 }
 
+/* Waits for the asynchronous I/O still in flight, false (with errno set) if a
+ * write behind failed. */
+bool gfapi_device::FinishAsyncIo()
+{
+  return !async_io_ || async_io_->Finish();
+}
+
 int gfapi_device::d_close(int)
 {
   if (gfd_) {
     int status;
+    bool written = FinishAsyncIo();
+    int error = errno;
 
+    async_io_.reset();
     status = glfs_close(gfd_);
     gfd_ = NULL;
+    if (!written) {
+      errno = error;
+      return -1;
+    }
     return status;
   } else {
     errno = EBADF;
@@ -472,6 +501,7 @@ boffset_t gfapi_device::d_lseek(DeviceControlRecord*,
                                 int whence)
 {
   if (gfd_) {
+    if (!FinishAsyncIo()) { return -1; }
     return glfs_lseek(gfd_, offset, whence);
   } else {
     errno = EBADF;
@@ -484,7 +514,7 @@ bool gfapi_device::d_truncate(DeviceControlRecord*)
   struct stat st;
 
   if (gfd_) {
-    if (glfs_ftruncate(gfd_, 0) != 0) {
+    if (!FinishAsyncIo() || glfs_ftruncate(gfd_, 0) != 0) {
       BErrNo be;
 
       Mmsg2(errmsg, T_("Unable to truncate device %s. ERR=%s\n"), prt_name,
@@ -510,6 +540,7 @@ bool gfapi_device::d_truncate(DeviceControlRecord*)
     }
 
     if (st.st_size != 0) { /* glfs_truncate() didn't work */
+      async_io_.reset();
       glfs_close(gfd_);
       glfs_unlink(glfs_, virtual_filename_);
 
@@ -529,6 +560,10 @@ bool gfapi_device::d_truncate(DeviceControlRecord*)
 
       // Reset proper owner
       glfs_chown(glfs_, virtual_filename_, st.st_uid, st.st_gid);
+
+      if (queue_depth_ > 0) {
+        async_io_ = std::make_unique<gfapi_async_io>(gfd_, queue_depth_);
+      }
     }
   }
 
@@ -538,6 +573,7 @@ bool gfapi_device::d_truncate(DeviceControlRecord*)
 gfapi_device::~gfapi_device()
 {
   if (gfd_) {
+    async_io_.reset();
     glfs_close(gfd_);
     gfd_ = NULL;
   }
@@ -30,10 +30,14 @@
 
 #include <glusterfs/api/glfs.h>
 
+#include <memory>
+
 #if defined GLFS_FTRUNCATE_HAS_FOUR_ARGS
 #  define glfs_ftruncate(fd, offset) glfs_ftruncate(fd, offset, NULL, NULL)
 #endif
 
+class gfapi_async_io;
+
 namespace storagedaemon {
 
 class gfapi_device : public Device {
@@ -47,10 +51,14 @@ class gfapi_device : public Device {
   char* volumename_;
   char* basedir_;
   int serverport_;
+  int queue_depth_{0};
   glfs_t* glfs_;
   glfs_fd_t* gfd_;
+  std::unique_ptr<gfapi_async_io> async_io_; /* When queuedepth= is set */
   POOLMEM* virtual_filename_;
 
+  bool FinishAsyncIo();
+
  public:
   gfapi_device();
   ~gfapi_device();
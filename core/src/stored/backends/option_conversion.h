@@ -0,0 +1,124 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#ifndef BAREOS_STORED_BACKENDS_OPTION_CONVERSION_H_
+#define BAREOS_STORED_BACKENDS_OPTION_CONVERSION_H_
+
+/* Conversion of the parsed device options of a backend into its settings,
+ * chained like
+ *
+ *   tl::expected<options*, std::string>{&options}
+ *       .and_then(get_converter("iothreads", io_threads_))
+ *       .and_then(get_converter("chunksize", chunk_size_));
+ *
+ * Every converted option is removed, so the options left in the end are
+ * unknown. */
+
+#include "util.h"
+
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <fmt/format.h>
+#include <gsl/gsl>
+#include <tl/expected.hpp>
+
+namespace backends::util {
+
+// delete this, so only specializations will be considered
+template <typename T> void convert_value(T&, const std::string&) = delete;
+
+template <>
+[[maybe_unused]] inline void convert_value<>(unsigned long long& to,
+                                             const std::string& from)
+{
+  to = std::stoull(from);
+}
+
+template <>
+[[maybe_unused]] inline void convert_value<>(unsigned long& to,
+                                             const std::string& from)
+{
+  to = std::stoul(from);
+}
+
+template <> inline void convert_value<>(uint8_t& to, const std::string& from)
+{
+  to = gsl::narrow<uint8_t>(std::stoul(from));
+}
+
+template <> inline void convert_value<>(uint32_t& to, const std::string& from)
+{
+  to = gsl::narrow<uint32_t>(std::stoul(from));
+}
+
+template <>
+inline void convert_value<>(std::string& to, const std::string& from)
+{
+  to = from;
+}
+
+template <typename T>
+tl::expected<options*, std::string> convert(options* opts,
+                                            const std::string& key,
+                                            T& target)
+{
+  auto node_handle = opts->extract(key);
+  if (node_handle.empty()) {
+    return tl::unexpected(
+        fmt::format("no value provided for option '{}'\n", key));
+  }
+  auto value = node_handle.mapped();
+
+  try {
+    convert_value(target, value);
+  } catch (std::invalid_argument& e) {
+    return tl::unexpected(fmt::format(
+        "invalid argument '{}' for option '{}': {}\n", value, key, e.what()));
+  } catch (std::out_of_range& e) {
+    return tl::unexpected(
+        fmt::format("value '{}' for option '{}' is out of range: {}\n", value,
+                    key, e.what()));
+  } catch (gsl::narrowing_error& e) {
+    return tl::unexpected(
+        fmt::format("value '{}' for option '{}' would be truncated: {}\n",
+                    value, key, e.what()));
+  }
+  return opts;
+}
+
+inline std::optional<std::string> fetch_value(options& opts,
+                                              const std::string& key)
+{
+  auto node_handle = opts.extract(key);
+  if (node_handle.empty()) { return std::nullopt; }
+  return node_handle.mapped();
+}
+
+template <typename T> auto get_converter(const std::string& key, T& target)
+{
+  return [&key, &target](options* opts) { return convert(opts, key, target); };
+}
+
+}  // namespace backends::util
+
+#endif  // BAREOS_STORED_BACKENDS_OPTION_CONVERSION_H_
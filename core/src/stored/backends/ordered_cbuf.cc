@@ -79,7 +79,16 @@ void* ordered_circbuf::enqueue(void* data,
 {
   struct ocbuf_item *new_item, *item;
 
-  if (pthread_mutex_lock(&lock_) != 0) { return NULL; }
+  /* Allocate the item before taking the lock, all io threads and producers
+   * contend for it. */
+  new_item = (struct ocbuf_item*)malloc(sizeof(struct ocbuf_item));
+  new_item->data = data;
+  new_item->data_size = data_size;
+
+  if (pthread_mutex_lock(&lock_) != 0) {
+    free(new_item);
+    return NULL;
+  }
 
   // See if we should use a reserved slot and there are actually slots reserved.
   if (!use_reserved_slot || !reserved_) {
@@ -99,10 +108,6 @@ void* ordered_circbuf::enqueue(void* data,
    * right actions to update the already existing item with the new
    * data in the new item. The compare function callback is used to binary
    * insert the item at the right location in the ordered circular list. */
-  new_item = (struct ocbuf_item*)malloc(sizeof(struct ocbuf_item));
-  new_item->data = data;
-  new_item->data_size = data_size;
-
   item = (struct ocbuf_item*)data_->binary_insert(new_item, compare);
   if (item == new_item) {
     size_++;
@@ -112,9 +117,6 @@ void* ordered_circbuf::enqueue(void* data,
      * item on the ordered circular list. */
     update(item->data, new_item->data);
 
-    // Release the unused ocbuf_item.
-    free(new_item);
-
     /* Update data to point to the data that was attached to the original
      * ocbuf_item. */
     data = item->data;
@@ -128,6 +130,9 @@ void* ordered_circbuf::enqueue(void* data,
 
   pthread_mutex_unlock(&lock_);
 
+  // Release the unused ocbuf_item.
+  if (item != new_item) { free(new_item); }
+
   /* Return the data that is current e.g. either the new data passed in or
    * the already existing data on the ordered circular list. */
   return data;
@@ -140,7 +145,7 @@ void* ordered_circbuf::dequeue(bool reserve_slot,
                                int timeout)
 {
   void* data = NULL;
-  struct ocbuf_item* item;
+  struct ocbuf_item* item = NULL;
 
   if (pthread_mutex_lock(&lock_) != 0) { return NULL; }
 
@@ -195,19 +200,25 @@ void* ordered_circbuf::dequeue(bool reserve_slot,
   if (!item) { goto bail_out; }
 
   data_->remove(item);
-  if (reserve_slot) { reserved_++; }
   size_--;
 
-  // Let all waiting producers know there is room.
-  pthread_cond_broadcast(&notfull_);
+  /* Let all waiting producers know there is room.  A reserved slot keeps
+   * the room for a requeue of the item, so then there is none. */
+  if (reserve_slot) {
+    reserved_++;
+  } else {
+    pthread_cond_broadcast(&notfull_);
+  }
 
-  // Extract the payload and drop the placeholder.
+  // Extract the payload.
   data = item->data;
-  free(item);
 
 bail_out:
   pthread_mutex_unlock(&lock_);
 
+  // Drop the placeholder.
+  if (item) { free(item); }
+
   return data;
 }
 
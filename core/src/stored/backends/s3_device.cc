@@ -0,0 +1,458 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "include/bareos.h"
+
+#include "stored/stored.h"
+#include "stored/sd_backends.h"
+#include "chunked_device.h"
+#include "lib/bstringlist.h"
+#include "lib/edit.h"
+#include "s3_device.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <optional>
+#include <tuple>
+#include <fmt/format.h>
+#include <gsl/gsl>
+#include "util.h"
+#include "option_conversion.h"
+
+namespace utl = backends::util;
+using utl::fetch_value;
+using utl::get_converter;
+using namespace std::literals::string_literals;
+
+namespace {
+static constexpr int debug_info = 100;
+static constexpr int debug_trace = 120;
+
+std::string get_chunk_name(storagedaemon::chunk_io_request* request)
+{
+  return fmt::format(FMT_STRING("{:04d}"), request->chunk);
+}
+bool is_chunk_name(const std::string& name)
+{
+  if (name.length() != 4) { return false; }
+  for (char c : name) {
+    if (c < '0' || c > '9') { return false; }
+  }
+  return true;
+}
+
+static const utl::options option_defaults{
+    {"chunksize", "10485760"},  // 10 MB
+    {"iothreads", "0"},
+    {"ioslots", "10"},
+    {"retries", "0"},
+    {"readahead", "0"},
+    {"region", "us-east-1"},
+    {"prefix", ""},
+    {"storage_class", ""},
+    {"path_style", "yes"},
+    {"http2", "yes"},
+    {"verify_peer", "yes"},
+    {"ca_file", ""},
+    {"connections", "0"},       // enough for all io- and readahead threads
+    {"part_size", "16777216"},  // 16 MiB
+    {"request_retries", "3"},
+    {"timeout", "300"},
+    {"truncate_threads", "2"},  // 0 truncates volumes while waiting
+};
+
+tl::expected<bool, std::string> to_bool(const std::string& key,
+                                        const std::string& value)
+{
+  if (Bstrcasecmp(value.c_str(), "yes") || Bstrcasecmp(value.c_str(), "true")
+      || value == "1") {
+    return true;
+  }
+  if (Bstrcasecmp(value.c_str(), "no") || Bstrcasecmp(value.c_str(), "false")
+      || value == "0") {
+    return false;
+  }
+  return tl::unexpected(
+      fmt::format("invalid argument '{}' for option '{}'\n", value, key));
+}
+
+}  // namespace
+
+namespace storagedaemon {
+
+bool S3Device::setup()
+{
+  if (m_setup_succeeded) { return true; }
+  if (auto result = setup_impl()) {
+    return m_setup_succeeded = true;
+  } else {
+    PmStrcpy(errmsg, result.error().c_str());
+    Emsg0(M_FATAL, 0, errmsg);
+    return false;
+  }
+}
+
+tl::expected<void, std::string> S3Device::setup_impl()
+{
+  auto res = utl::parse_options(dev_options);
+  if (std::holds_alternative<utl::error>(res)) {
+    return tl::unexpected(
+        fmt::format("device option error: {}\n", std::get<utl::error>(res)));
+  }
+  auto options = std::get<utl::options>(res);
+
+  // apply default values
+  options.merge(utl::options(option_defaults));
+
+  Dmsg0(debug_info, "dev_options: %s\n", dev_options);
+  for (const auto& [key, value] : options) {
+    // keep the secret key out of the debug output
+    Dmsg0(debug_trace, "'%s' = '%s'\n", key.c_str(),
+          key == "secret_key" ? "***" : value.c_str());
+  }
+
+  S3Storage::Config config;
+  std::string path_style, http2, verify_peer;
+  uint32_t connections{0};
+  uint32_t request_retries{0};
+  uint32_t timeout{0};
+  uint32_t truncate_threads{0};
+  uint64_t part_size{0};
+
+  if (auto conversion_result
+      = tl::expected<utl::options*, std::string>{&options}
+            .and_then(get_converter("iothreads", io_threads_))
+            .and_then(get_converter("ioslots", io_slots_))
+            .and_then(get_converter("retries", retries_))
+            .and_then(get_converter("readahead", readahead_))
+            .and_then(get_converter("chunksize", chunk_size_))
+            .and_then(get_converter("region", config.region))
+            .and_then(get_converter("prefix", config.prefix))
+            .and_then(get_converter("storage_class", config.storage_class))
+            .and_then(get_converter("path_style", path_style))
+            .and_then(get_converter("http2", http2))
+            .and_then(get_converter("verify_peer", verify_peer))
+            .and_then(get_converter("ca_file", config.ca_file))
+            .and_then(get_converter("connections", connections))
+            .and_then(get_converter("part_size", part_size))
+            .and_then(get_converter("request_retries", request_retries))
+            .and_then(get_converter("timeout", timeout))
+            .and_then(get_converter("truncate_threads", truncate_threads));
+      !conversion_result) {
+    return tl::unexpected(conversion_result.error());
+  }
+
+  ranged_reads_ = true;
+
+  if (auto value = fetch_value(options, "endpoint")) {
+    config.endpoint = *value;
+  } else {
+    return tl::unexpected("Option 'endpoint' is required\n"s);
+  }
+  if (auto value = fetch_value(options, "bucket")) {
+    config.bucket = *value;
+  } else {
+    return tl::unexpected("Option 'bucket' is required\n"s);
+  }
+
+  // the credentials can also come from the environment, like for aws-cli
+  if (auto value = fetch_value(options, "access_key")) {
+    config.access_key = *value;
+  } else if (const char* env = getenv("AWS_ACCESS_KEY_ID")) {
+    config.access_key = env;
+  }
+  if (auto value = fetch_value(options, "secret_key")) {
+    config.secret_key = *value;
+  } else if (const char* env = getenv("AWS_SECRET_ACCESS_KEY")) {
+    config.secret_key = env;
+  }
+
+  for (auto [key, value, target] :
+       {std::tuple{"path_style", &path_style, &config.path_style},
+        std::tuple{"http2", &http2, &config.http2},
+        std::tuple{"verify_peer", &verify_peer, &config.verify_peer}}) {
+    auto flag = to_bool(key, *value);
+    if (!flag) { return tl::unexpected(flag.error()); }
+    *target = *flag;
+  }
+
+  /* Every io-thread and readahead thread up- or downloads one chunk at a
+   * time, big chunks use more connections in parallel. */
+  config.connections
+      = connections > 0
+            ? connections
+            : std::max<std::size_t>(4, io_threads_ + readahead_ + 1);
+  config.part_size = part_size;
+  config.retries = request_retries;
+  config.timeout = std::chrono::seconds{timeout};
+
+  // OptionConsumer should have consumed all options at this point
+  if (!options.empty()) {
+    BStringList option_names;
+    for (const auto& [name, value] : options) { option_names.push_back(name); }
+    return tl::unexpected(fmt::format("Unknown options encountered: {}\n",
+                                      option_names.Join(", ")));
+  }
+
+  if (auto result = m_storage.configure(std::move(config)); !result) {
+    return result;
+  }
+  if (truncate_threads > 0) {
+    m_truncation = std::make_unique<BackgroundTruncation>(
+        [this](const std::string& volume,
+               const std::vector<std::string>& chunks) {
+          return m_storage.remove_batch(volume, chunks);
+        },
+        truncate_threads, max_chunks_);
+  }
+  return {};
+}
+
+bool S3Device::CheckRemoteConnection()
+{
+  Dmsg0(debug_trace, "CheckRemoteConnection called\n");
+  if (!setup()) { return false; }
+  if (auto result = m_storage.test_connection(); !result) {
+    PmStrcpy(errmsg, result.error().c_str());
+    Dmsg1(debug_info, "%s", errmsg);
+    return false;
+  }
+  return true;
+}
+
+bool S3Device::FlushRemoteChunk(chunk_io_request* request)
+{
+  const std::string_view obj_name{request->volname};
+  const std::string obj_chunk = get_chunk_name(request);
+  if (request->wbuflen == 0) {
+    Dmsg1(debug_info, "Not flushing empty chunk %s/%s\n", obj_name.data(),
+          obj_chunk.c_str());
+    return true;
+  }
+  Dmsg1(debug_trace, "Flushing chunk %s/%s\n", obj_name.data(),
+        obj_chunk.c_str());
+
+  auto inflight_lease = getInflightLease(request);
+  if (!inflight_lease) {
+    Dmsg0(debug_info, "Could not acquire inflight lease for %s %s\n",
+          obj_name.data(), obj_chunk.c_str());
+    return false;
+  }
+
+
+  // a chunk of a truncated volume that was not removed yet gets overwritten
+  const bool stale = m_truncation
+                     && m_truncation->Claim(request->volname, obj_chunk);
+
+  /* Check on the remote backing store if the chunk already exists.
+   * We only upload this chunk if it is bigger then the chunk that exists
+   * on the remote backing store. When using io-threads it could happen
+   * that there are multiple flush requests for the same chunk when a
+   * chunk is reused in a next backup job. We only want the chunk with
+   * the biggest amount of valid data to persist as we only append to
+   * chunks. */
+  auto obj_stat = stale ? tl::unexpected("stale"s)
+                        : m_storage.stat(obj_name, obj_chunk);
+
+  if (obj_stat && obj_stat->size > request->wbuflen) {
+    Dmsg1(debug_info,
+          "Not uploading chunk %s with size %d, as chunk with size %d is "
+          "already present\n",
+          obj_name.data(), obj_stat->size, request->wbuflen);
+    return true;
+  }
+
+  auto obj_data = gsl::span{request->buffer, request->wbuflen};
+  Dmsg1(debug_info, "Uploading %zu bytes of data\n", request->wbuflen);
+  if (auto result = m_storage.upload(obj_name, obj_chunk, obj_data)) {
+    return true;
+  } else {
+    PmStrcpy(errmsg, result.error().c_str());
+    dev_errno = EIO;
+    return false;
+  }
+}
+
+// Internal method for reading a chunk from the remote backing store.
+bool S3Device::ReadRemoteChunk(chunk_io_request* request)
+{
+  const std::string_view obj_name{request->volname};
+  const std::string obj_chunk = get_chunk_name(request);
+  Dmsg1(debug_trace, "Reading chunk %s\n", obj_name.data());
+
+  if (m_truncation && m_truncation->IsStale(request->volname, obj_chunk)) {
+    Mmsg(errmsg, T_("Chunk %s/%s was truncated\n"), obj_name.data(),
+         obj_chunk.c_str());
+    Dmsg1(debug_info, "%s", errmsg);
+    dev_errno = EIO;
+    return false;
+  }
+
+  if (request->length > 0) {
+    if (auto obj_data = m_storage.download_range(
+            obj_name, obj_chunk, request->offset,
+            {request->buffer + request->offset, request->length})) {
+      *request->rbuflen = request->offset + obj_data->size_bytes();
+      return true;
+    } else {
+      PmStrcpy(errmsg, obj_data.error().c_str());
+      Dmsg1(debug_info, "%s", errmsg);
+      dev_errno = EIO;
+      return false;
+    }
+  }
+
+  // the download tells the size, so there is no need to stat first
+  if (auto obj_data = m_storage.download(obj_name, obj_chunk,
+                                         {request->buffer, request->wbuflen})) {
+    *request->rbuflen = obj_data->size_bytes();
+    return true;
+  } else {
+    PmStrcpy(errmsg, obj_data.error().c_str());
+    Dmsg1(debug_info, "%s", errmsg);
+    dev_errno = EIO;
+    return false;
+  }
+}
+
+bool S3Device::TruncateRemoteVolume(DeviceControlRecord*)
+{
+  const char* vol_name = getVolCatName();
+  const auto chunk_map = m_storage.list(vol_name);
+  if (!chunk_map) {
+    PmStrcpy(errmsg, chunk_map.error().c_str());
+    dev_errno = EIO;
+    return false;
+  }
+  std::vector<std::string> chunks;
+  for (const auto& [chunk_name, stat] : *chunk_map) {
+    if (is_chunk_name(chunk_name)) { chunks.push_back(chunk_name); }
+  }
+
+  /* The volume counts as empty right away, the chunks it still has are
+   * overwritten or removed later. */
+  if (m_truncation) {
+    m_truncation->Enqueue(vol_name, chunks);
+    return true;
+  }
+  if (auto res = m_storage.remove_batch(vol_name, chunks); !res) {
+    PmStrcpy(errmsg, res.error().c_str());
+    dev_errno = EIO;
+    return false;
+  }
+  return true;
+}
+
+ssize_t S3Device::RemoteVolumeSize()
+{
+  const auto chunk_map = m_storage.list(getVolCatName());
+  if (!chunk_map) {
+    PmStrcpy(errmsg, chunk_map.error().c_str());
+    dev_errno = EIO;
+    return false;
+  }
+  const char* vol_name = getVolCatName();
+  bool found{false};
+  ssize_t total_size{0};
+  for (const auto& [name, stat] : *chunk_map) {
+    if (is_chunk_name(name)
+        && !(m_truncation && m_truncation->IsStale(vol_name, name))) {
+      found = true;
+      total_size += stat.size;
+    }
+  }
+  return found ? total_size : -1;
+}
+
+
+bool S3Device::d_flush(DeviceControlRecord*)
+{
+  return WaitUntilChunksWritten();
+};
+
+int S3Device::d_open(const char* pathname, int flags, int mode)
+{
+  if (!setup()) {
+    dev_errno = EIO;
+    Emsg0(M_FATAL, 0, "%s", errmsg);
+  }
+  return SetupChunk(pathname, flags, mode);
+}
+
+ssize_t S3Device::d_read(int t_fd, void* buffer, size_t count)
+{
+  return ReadChunked(t_fd, buffer, count);
+}
+
+ssize_t S3Device::d_write(int t_fd,
+                                         const void* buffer,
+                                         size_t count)
+{
+  return WriteChunked(t_fd, buffer, count);
+}
+
+int S3Device::d_close(int) { return CloseChunk(); }
+
+int S3Device::d_ioctl(int, ioctl_req_t, char*) { return -1; }
+
+boffset_t S3Device::d_lseek(DeviceControlRecord*,
+                                           boffset_t offset,
+                                           int whence)
+{
+  switch (whence) {
+    case SEEK_SET:
+      offset_ = offset;
+      break;
+    case SEEK_CUR:
+      offset_ += offset;
+      break;
+    case SEEK_END: {
+      ssize_t volumesize;
+
+      volumesize = ChunkedVolumeSize();
+
+      Dmsg1(debug_info, "Current volumesize: %lld\n", volumesize);
+
+      if (volumesize >= 0) {
+        offset_ = volumesize + offset;
+      } else {
+        return -1;
+      }
+      break;
+    }
+    default:
+      return -1;
+  }
+
+  if (!LoadChunk()) { return -1; }
+
+  return offset_;
+}
+
+bool S3Device::d_truncate(DeviceControlRecord* dcr)
+{
+  return TruncateChunkedVolume(dcr);
+}
+
+REGISTER_SD_BACKEND(s3, S3Device)
+
+} /* namespace storagedaemon */
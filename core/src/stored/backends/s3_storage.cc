@@ -0,0 +1,964 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+#include "include/bareos.h"
+#include <fmt/format.h>
+#include "s3_storage.h"
+
+#include <curl/curl.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <ctime>
+#include <optional>
+#include <thread>
+
+namespace {
+constexpr int debug_info = 110;
+constexpr int debug_trace = 130;
+
+std::string Hex(const unsigned char* data, std::size_t length)
+{
+  static constexpr char digits[] = "0123456789abcdef";
+  std::string out;
+  out.reserve(2 * length);
+  for (std::size_t i = 0; i < length; ++i) {
+    out += digits[data[i] >> 4];
+    out += digits[data[i] & 0xf];
+  }
+  return out;
+}
+
+std::string Sha256Hex(std::string_view data)
+{
+  unsigned char md[EVP_MAX_MD_SIZE];
+  unsigned int length = 0;
+  EVP_Digest(data.data(), data.size(), md, &length, EVP_sha256(), nullptr);
+  return Hex(md, length);
+}
+
+std::string HmacSha256(std::string_view key, std::string_view data)
+{
+  unsigned char md[EVP_MAX_MD_SIZE];
+  unsigned int length = 0;
+  HMAC(EVP_sha256(), key.data(), static_cast<int>(key.size()),
+       reinterpret_cast<const unsigned char*>(data.data()), data.size(), md,
+       &length);
+  return std::string(reinterpret_cast<char*>(md), length);
+}
+
+// percent encoding as required by the signature
+std::string UriEncode(std::string_view str, bool keep_slash)
+{
+  static constexpr char digits[] = "0123456789ABCDEF";
+  std::string out;
+  for (unsigned char c : str) {
+    if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~'
+        || (keep_slash && c == '/')) {
+      out += static_cast<char>(c);
+    } else {
+      out += '%';
+      out += digits[c >> 4];
+      out += digits[c & 0xf];
+    }
+  }
+  return out;
+}
+
+// the content of all <tag> elements, S3 does not use attributes on them
+std::vector<std::string_view> XmlElements(std::string_view xml,
+                                          std::string_view tag)
+{
+  std::vector<std::string_view> elements;
+  const std::string open = fmt::format("<{}>", tag);
+  const std::string close = fmt::format("</{}>", tag);
+  std::size_t pos = 0;
+  while ((pos = xml.find(open, pos)) != std::string_view::npos) {
+    std::size_t begin = pos + open.size();
+    std::size_t end = xml.find(close, begin);
+    if (end == std::string_view::npos) { break; }
+    elements.push_back(xml.substr(begin, end - begin));
+    pos = end + close.size();
+  }
+  return elements;
+}
+
+std::string XmlUnescape(std::string_view text)
+{
+  static constexpr std::pair<std::string_view, char> entities[]
+      = {{"&amp;", '&'},
+         {"&lt;", '<'},
+         {"&gt;", '>'},
+         {"&quot;", '"'},
+         {"&apos;", '\''}};
+  std::string out;
+  for (std::size_t i = 0; i < text.size(); ++i) {
+    bool replaced = false;
+    if (text[i] == '&') {
+      for (auto [entity, c] : entities) {
+        if (text.substr(i, entity.size()) == entity) {
+          out += c;
+          i += entity.size() - 1;
+          replaced = true;
+          break;
+        }
+      }
+    }
+    if (!replaced) { out += text[i]; }
+  }
+  return out;
+}
+
+std::string XmlEscape(std::string_view text)
+{
+  std::string out;
+  for (char c : text) {
+    switch (c) {
+      case '&':
+        out += "&amp;";
+        break;
+      case '<':
+        out += "&lt;";
+        break;
+      case '>':
+        out += "&gt;";
+        break;
+      default:
+        out += c;
+    }
+  }
+  return out;
+}
+
+std::string Md5Base64(std::string_view data)
+{
+  unsigned char md[EVP_MAX_MD_SIZE];
+  unsigned int length = 0;
+  EVP_Digest(data.data(), data.size(), md, &length, EVP_md5(), nullptr);
+  unsigned char encoded[4 * ((EVP_MAX_MD_SIZE + 2) / 3) + 1];
+  int encoded_length = EVP_EncodeBlock(encoded, md, static_cast<int>(length));
+  return std::string(reinterpret_cast<char*>(encoded), encoded_length);
+}
+
+std::string FirstElement(std::string_view xml, std::string_view tag)
+{
+  auto elements = XmlElements(xml, tag);
+  return elements.empty() ? std::string{} : XmlUnescape(elements.front());
+}
+
+void InitCurl()
+{
+  static std::once_flag initialized;
+  std::call_once(initialized, []() { curl_global_init(CURL_GLOBAL_ALL); });
+}
+}  // namespace
+
+struct S3Storage::Request {
+  std::string method{"GET"};
+  std::string key{}; /**< Empty for the bucket itself */
+  std::map<std::string, std::string> query{};
+  std::map<std::string, std::string> headers{}; /**< Lowercase names */
+  std::string_view body{};
+  gsl::span<char> target{}; /**< Downloads go here, if set */
+};
+
+struct S3Storage::Response {
+  long status{0};
+  std::map<std::string, std::string> headers{}; /**< Lowercase names */
+  std::string body{};        /**< Unless downloaded into the target */
+  std::size_t received{0};   /**< Into the target */
+  bool overflow{false};
+  gsl::span<char> target{};
+
+  std::string error() const
+  {
+    std::string code = FirstElement(body, "Code");
+    std::string message = FirstElement(body, "Message");
+    if (code.empty()) { return fmt::format("HTTP status {}", status); }
+    return fmt::format("HTTP status {} {}: {}", status, code, message);
+  }
+};
+
+// lets the connections share the connection cache, dns and tls sessions
+class S3Storage::Share {
+ public:
+  Share() : m_share{curl_share_init()}
+  {
+    if (!m_share) { return; }
+    curl_share_setopt(m_share, CURLSHOPT_LOCKFUNC, &Share::lock);
+    curl_share_setopt(m_share, CURLSHOPT_UNLOCKFUNC, &Share::unlock);
+    curl_share_setopt(m_share, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+  }
+  ~Share()
+  {
+    if (m_share) { curl_share_cleanup(m_share); }
+  }
+  Share(const Share&) = delete;
+  Share& operator=(const Share&) = delete;
+
+  CURLSH* get() const { return m_share; }
+
+ private:
+  CURLSH* m_share;
+  std::mutex m_locks[CURL_LOCK_DATA_LAST]{};
+
+  static void lock(CURL*, curl_lock_data data, curl_lock_access, void* share)
+  {
+    static_cast<Share*>(share)->m_locks[data].lock();
+  }
+  static void unlock(CURL*, curl_lock_data data, void* share)
+  {
+    static_cast<Share*>(share)->m_locks[data].unlock();
+  }
+};
+
+class S3Storage::Connection {
+ public:
+  Connection() : m_handle{curl_easy_init()} {}
+  ~Connection()
+  {
+    if (m_handle) { curl_easy_cleanup(m_handle); }
+  }
+  Connection(const Connection&) = delete;
+  Connection& operator=(const Connection&) = delete;
+
+  CURL* get() const { return m_handle; }
+
+ private:
+  CURL* m_handle;
+};
+
+S3Storage::S3Storage() = default;
+S3Storage::~S3Storage()
+{
+  // the connections use the share
+  m_idle_connections.clear();
+}
+
+tl::expected<void, std::string> S3Storage::configure(Config config)
+{
+  InitCurl();
+
+  std::string_view endpoint{config.endpoint};
+  while (!endpoint.empty() && endpoint.back() == '/') {
+    endpoint.remove_suffix(1);
+  }
+  std::size_t scheme_end = endpoint.find("://");
+  if (scheme_end == std::string_view::npos) {
+    return tl::unexpected(
+        fmt::format("endpoint '{}' is not a http or https url\n", endpoint));
+  }
+  std::string scheme{endpoint.substr(0, scheme_end)};
+  std::string host{endpoint.substr(scheme_end + 3)};
+  if ((scheme != "http" && scheme != "https") || host.empty()
+      || host.find('/') != std::string::npos) {
+    return tl::unexpected(
+        fmt::format("endpoint '{}' is not a http or https url\n", endpoint));
+  }
+  if (config.bucket.empty()) {
+    return tl::unexpected(std::string{"no bucket configured\n"});
+  }
+  if (config.access_key.empty() || config.secret_key.empty()) {
+    return tl::unexpected(std::string{"no access key or secret key\n"});
+  }
+  // all parts but the last one of a multipart upload need at least 5 MiB
+  constexpr std::size_t min_part_size = 5 * 1024 * 1024;
+  if (config.part_size < min_part_size) {
+    return tl::unexpected(fmt::format("part size {} is smaller than {}\n",
+                                      config.part_size, min_part_size));
+  }
+  if (config.connections == 0) { config.connections = 1; }
+
+  m_config = std::move(config);
+  m_scheme = std::move(scheme);
+  m_host = std::move(host);
+  m_share = std::make_unique<Share>();
+  return {};
+}
+
+auto S3Storage::acquire_connection() -> std::unique_ptr<Connection>
+{
+  std::unique_lock lock{m_connection_mutex};
+  m_connection_released.wait(lock, [this]() {
+    return !m_idle_connections.empty()
+           || m_open_connections < m_config.connections;
+  });
+  if (!m_idle_connections.empty()) {
+    auto connection = std::move(m_idle_connections.back());
+    m_idle_connections.pop_back();
+    return connection;
+  }
+  ++m_open_connections;
+  return std::make_unique<Connection>();
+}
+
+void S3Storage::release_connection(std::unique_ptr<Connection> connection)
+{
+  {
+    std::lock_guard lock{m_connection_mutex};
+    if (connection && connection->get()) {
+      m_idle_connections.push_back(std::move(connection));
+    } else {
+      --m_open_connections;
+    }
+  }
+  m_connection_released.notify_one();
+}
+
+std::string S3Storage::object_key(std::string_view obj_name,
+                                  std::string_view obj_part) const
+{
+  return fmt::format("{}{}/{}", m_config.prefix, obj_name, obj_part);
+}
+
+static std::size_t WriteResponse(char* data,
+                                 std::size_t size,
+                                 std::size_t count,
+                                 void* user)
+{
+  auto* response = static_cast<S3Storage::Response*>(user);
+  std::size_t length = size * count;
+  if (response->target.empty() || response->status >= 300) {
+    response->body.append(data, length);
+    return length;
+  }
+  if (response->received + length > response->target.size()) {
+    response->overflow = true;
+    return 0;
+  }
+  memcpy(response->target.data() + response->received, data, length);
+  response->received += length;
+  return length;
+}
+
+static std::size_t ReadHeader(char* data,
+                              std::size_t size,
+                              std::size_t count,
+                              void* user)
+{
+  auto* response = static_cast<S3Storage::Response*>(user);
+  std::size_t length = size * count;
+  std::string_view line{data, length};
+  while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) {
+    line.remove_suffix(1);
+  }
+
+  // a new status line, e.g. after "100 Continue"
+  if (line.substr(0, 5) == "HTTP/") {
+    response->headers.clear();
+    std::size_t blank = line.find(' ');
+    if (blank != std::string_view::npos) {
+      response->status = strtol(std::string{line.substr(blank + 1)}.c_str(),
+                                nullptr, 10);
+    }
+    return length;
+  }
+
+  std::size_t colon = line.find(':');
+  if (colon == std::string_view::npos) { return length; }
+  std::string name{line.substr(0, colon)};
+  for (char& c : name) { c = tolower(static_cast<unsigned char>(c)); }
+  std::string_view value = line.substr(colon + 1);
+  while (!value.empty() && value.front() == ' ') { value.remove_prefix(1); }
+  response->headers[name] = value;
+  return length;
+}
+
+static std::size_t ReadBody(char* data,
+                            std::size_t size,
+                            std::size_t count,
+                            void* user)
+{
+  auto* body = static_cast<std::string_view*>(user);
+  std::size_t length = std::min(size * count, body->size());
+  memcpy(data, body->data(), length);
+  body->remove_prefix(length);
+  return length;
+}
+
+auto S3Storage::perform_once(Connection& connection, Request& request)
+    -> tl::expected<Response, std::string>
+{
+  CURL* curl = connection.get();
+  curl_easy_reset(curl);
+
+  // the url and the canonical request of the signature (AWS Signature V4)
+  std::string host
+      = m_config.path_style ? m_host : fmt::format("{}.{}", m_config.bucket,
+                                                   m_host);
+  std::string path = m_config.path_style
+                         ? fmt::format("/{}", m_config.bucket)
+                         : std::string{};
+  if (!request.key.empty() || !m_config.path_style) {
+    path += '/';
+    path += UriEncode(request.key, true);
+  }
+  std::string query;
+  for (const auto& [name, value] : request.query) {
+    if (!query.empty()) { query += '&'; }
+    query += UriEncode(name, false);
+    query += '=';
+    query += UriEncode(value, false);
+  }
+
+  // only plain http needs the checksum of the data
+  std::string payload_hash
+      = m_scheme == "https" ? "UNSIGNED-PAYLOAD" : Sha256Hex(request.body);
+
+  char amz_date[sizeof("20240101T000000Z")];
+  time_t now = time(nullptr);
+  struct tm tm;
+  gmtime_r(&now, &tm);
+  strftime(amz_date, sizeof(amz_date), "%Y%m%dT%H%M%SZ", &tm);
+  std::string_view date{amz_date, 8};
+
+  std::map<std::string, std::string> headers = request.headers;
+  headers["host"] = host;
+  headers["x-amz-content-sha256"] = payload_hash;
+  headers["x-amz-date"] = amz_date;
+  std::string canonical_headers;
+  std::string signed_headers;
+  for (const auto& [name, value] : headers) {
+    canonical_headers += fmt::format("{}:{}\n", name, value);
+    if (!signed_headers.empty()) { signed_headers += ';'; }
+    signed_headers += name;
+  }
+  std::string canonical_request
+      = fmt::format("{}\n{}\n{}\n{}\n{}\n{}", request.method,
+                    path.empty() ? "/" : path, query, canonical_headers,
+                    signed_headers, payload_hash);
+  std::string scope
+      = fmt::format("{}/{}/s3/aws4_request", date, m_config.region);
+  std::string string_to_sign
+      = fmt::format("AWS4-HMAC-SHA256\n{}\n{}\n{}", amz_date, scope,
+                    Sha256Hex(canonical_request));
+  std::string key = HmacSha256("AWS4" + m_config.secret_key, date);
+  key = HmacSha256(key, m_config.region);
+  key = HmacSha256(key, "s3");
+  key = HmacSha256(key, "aws4_request");
+  std::string signature = HmacSha256(key, string_to_sign);
+
+  curl_slist* header_list = nullptr;
+  for (const auto& [name, value] : headers) {
+    if (name == "host") { continue; }
+    std::string line = fmt::format("{}: {}", name, value);
+    header_list = curl_slist_append(header_list, line.c_str());
+  }
+  std::string authorization = fmt::format(
+      "Authorization: AWS4-HMAC-SHA256 Credential={}/{}, SignedHeaders={}, "
+      "Signature={}",
+      m_config.access_key, scope, signed_headers,
+      Hex(reinterpret_cast<const unsigned char*>(signature.data()),
+          signature.size()));
+  header_list = curl_slist_append(header_list, authorization.c_str());
+  // do not wait for "100 Continue" before sending the data
+  header_list = curl_slist_append(header_list, "Expect:");
+
+  std::string url = fmt::format("{}://{}{}", m_scheme, host, path);
+  if (!query.empty()) { url += '?' + query; }
+  Dmsg2(debug_trace, "%s %s\n", request.method.c_str(), url.c_str());
+
+  Response response;
+  response.target = request.target;
+  std::string_view body = request.body;
+  char error_buffer[CURL_ERROR_SIZE] = "";
+
+  if (m_share && m_share->get()) {
+    curl_easy_setopt(curl, CURLOPT_SHARE, m_share->get());
+  }
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, header_list);
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+  curl_easy_setopt(curl, CURLOPT_HTTP_VERSION,
+                   m_config.http2 ? long{CURL_HTTP_VERSION_2TLS}
+                                  : long{CURL_HTTP_VERSION_1_1});
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER,
+                   m_config.verify_peer ? 1L : 0L);
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST,
+                   m_config.verify_peer ? 2L : 0L);
+  if (!m_config.ca_file.empty()) {
+    curl_easy_setopt(curl, CURLOPT_CAINFO, m_config.ca_file.c_str());
+  }
+  curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 30L);
+  // give up on transfers that did not make any progress for the timeout
+  curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+  curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME,
+                   static_cast<long>(m_config.timeout.count()));
+  curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, error_buffer);
+  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, &ReadHeader);
+  curl_easy_setopt(curl, CURLOPT_HEADERDATA, &response);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &WriteResponse);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+
+  if (request.method == "HEAD") {
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+  } else if (request.method == "PUT") {
+    curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
+    curl_easy_setopt(curl, CURLOPT_READFUNCTION, &ReadBody);
+    curl_easy_setopt(curl, CURLOPT_READDATA, &body);
+    curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE,
+                     static_cast<curl_off_t>(body.size()));
+  } else if (request.method == "POST") {
+    curl_easy_setopt(curl, CURLOPT_POST, 1L);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body.data());
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE,
+                     static_cast<curl_off_t>(body.size()));
+  } else if (request.method != "GET") {
+    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, request.method.c_str());
+  }
+
+  CURLcode result = curl_easy_perform(curl);
+  curl_slist_free_all(header_list);
+
+  if (result != CURLE_OK && !response.overflow) {
+    return tl::unexpected(
+        fmt::format("{} {} failed: {}\n", request.method, url,
+                    *error_buffer ? error_buffer : curl_easy_strerror(result)));
+  }
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response.status);
+  return response;
+}
+
+// retries requests that failed because of the network or the server
+auto S3Storage::perform(Request& request) -> tl::expected<Response, std::string>
+{
+  tl::expected<Response, std::string> result;
+  for (std::size_t attempt = 0; attempt <= m_config.retries; ++attempt) {
+    if (attempt > 0) {
+      auto backoff
+          = std::chrono::seconds{1 << std::min<std::size_t>(attempt, 5)};
+      Dmsg3(debug_info, "Retrying %s of %s in %lld seconds\n",
+            request.method.c_str(), request.key.c_str(),
+            static_cast<long long>(backoff.count()));
+      std::this_thread::sleep_for(backoff);
+    }
+
+    auto connection = acquire_connection();
+    if (!connection->get()) {
+      release_connection(nullptr);
+      return tl::unexpected(std::string{"cannot create a curl handle\n"});
+    }
+    result = perform_once(*connection, request);
+    release_connection(std::move(connection));
+
+    // 429 and 503 are sent when the server wants clients to slow down
+    if (result && result->status < 500 && result->status != 429) { break; }
+  }
+  return result;
+}
+
+template <typename F>
+tl::expected<void, std::string> S3Storage::run_parallel(std::size_t count, F fn)
+{
+  std::size_t threads = std::min(count, m_config.connections);
+  std::atomic<std::size_t> next{0};
+  std::mutex error_mutex;
+  std::optional<std::string> error;
+
+  auto work = [&]() {
+    std::size_t i;
+    while ((i = next++) < count) {
+      if (auto result = fn(i); !result) {
+        std::lock_guard lock{error_mutex};
+        if (!error) { error = result.error(); }
+        next = count;
+      }
+    }
+  };
+
+  if (threads <= 1) {
+    work();
+  } else {
+    std::vector<std::thread> workers;
+    for (std::size_t i = 0; i < threads; ++i) { workers.emplace_back(work); }
+    for (auto& worker : workers) { worker.join(); }
+  }
+  if (error) { return tl::unexpected(*error); }
+  return {};
+}
+
+tl::expected<void, std::string> S3Storage::test_connection()
+{
+  Request request;
+  request.method = "HEAD";
+  auto response = perform(request);
+  if (!response) { return tl::unexpected(response.error()); }
+  if (response->status != 200) {
+    return tl::unexpected(fmt::format("cannot access bucket {}: {}\n",
+                                      m_config.bucket, response->error()));
+  }
+  return {};
+}
+
+auto S3Storage::stat(std::string_view obj_name, std::string_view obj_part)
+    -> tl::expected<Stat, std::string>
+{
+  Dmsg2(debug_trace, "stat %s/%s called\n", obj_name.data(), obj_part.data());
+  Request request;
+  request.method = "HEAD";
+  request.key = object_key(obj_name, obj_part);
+  auto response = perform(request);
+  if (!response) { return tl::unexpected(response.error()); }
+  if (response->status != 200) {
+    return tl::unexpected(fmt::format("stat of {} failed: {}\n", request.key,
+                                      response->error()));
+  }
+  Stat stat;
+  stat.size
+      = strtoull(response->headers["content-length"].c_str(), nullptr, 10);
+  Dmsg1(debug_trace, "stat returns %zu\n", stat.size);
+  return stat;
+}
+
+auto S3Storage::list(std::string_view obj_name)
+    -> tl::expected<std::map<std::string, Stat>, std::string>
+{
+  Dmsg1(debug_trace, "list %s called\n", obj_name.data());
+  const std::string prefix = fmt::format("{}{}/", m_config.prefix, obj_name);
+  std::map<std::string, Stat> objects;
+  std::string continuation;
+  bool truncated = false;
+  do {
+    Request request;
+    request.query["list-type"] = "2";
+    request.query["prefix"] = prefix;
+    if (!continuation.empty()) {
+      request.query["continuation-token"] = continuation;
+    }
+    auto response = perform(request);
+    if (!response) { return tl::unexpected(response.error()); }
+    if (response->status != 200) {
+      return tl::unexpected(fmt::format("listing {} failed: {}\n", prefix,
+                                        response->error()));
+    }
+
+    for (std::string_view contents : XmlElements(response->body, "Contents")) {
+      std::string key = FirstElement(contents, "Key");
+      if (key.size() <= prefix.size()
+          || key.find('/', prefix.size()) != std::string::npos) {
+        continue;
+      }
+      Stat stat;
+      stat.size = strtoull(FirstElement(contents, "Size").c_str(), nullptr, 10);
+      objects[key.substr(prefix.size())] = stat;
+    }
+    truncated = FirstElement(response->body, "IsTruncated") == "true";
+    continuation = FirstElement(response->body, "NextContinuationToken");
+  } while (truncated && !continuation.empty());
+  return objects;
+}
+
+tl::expected<void, std::string> S3Storage::upload(std::string_view obj_name,
+                                                  std::string_view obj_part,
+                                                  gsl::span<char> obj_data)
+{
+  Dmsg3(debug_trace, "upload %s/%s (%zu bytes) called\n", obj_name.data(),
+        obj_part.data(), obj_data.size());
+  std::string key = object_key(obj_name, obj_part);
+  if (obj_data.size() > m_config.part_size) {
+    return upload_multipart(key, obj_data);
+  }
+
+  Request request;
+  request.method = "PUT";
+  request.key = key;
+  request.body = {obj_data.data(), obj_data.size()};
+  if (!m_config.storage_class.empty()) {
+    request.headers["x-amz-storage-class"] = m_config.storage_class;
+  }
+  auto response = perform(request);
+  if (!response) { return tl::unexpected(response.error()); }
+  if (response->status != 200) {
+    return tl::unexpected(
+        fmt::format("upload of {} failed: {}\n", key, response->error()));
+  }
+  return {};
+}
+
+tl::expected<void, std::string> S3Storage::upload_multipart(
+    const std::string& key,
+    gsl::span<char> obj_data)
+{
+  Request initiate;
+  initiate.method = "POST";
+  initiate.key = key;
+  initiate.query["uploads"] = "";
+  if (!m_config.storage_class.empty()) {
+    initiate.headers["x-amz-storage-class"] = m_config.storage_class;
+  }
+  auto initiated = perform(initiate);
+  if (!initiated) { return tl::unexpected(initiated.error()); }
+  std::string upload_id = FirstElement(initiated->body, "UploadId");
+  if (initiated->status != 200 || upload_id.empty()) {
+    return tl::unexpected(fmt::format("starting the upload of {} failed: {}\n",
+                                      key, initiated->error()));
+  }
+
+  const std::size_t part_size = m_config.part_size;
+  const std::size_t parts = (obj_data.size() + part_size - 1) / part_size;
+  Dmsg3(debug_info, "Uploading %s in %zu parts, upload id %s\n", key.c_str(),
+        parts, upload_id.c_str());
+  std::vector<std::string> etags(parts);
+  auto uploaded = run_parallel(
+      parts, [&](std::size_t i) -> tl::expected<void, std::string> {
+        Request request;
+        request.method = "PUT";
+        request.key = key;
+        request.query["partNumber"] = std::to_string(i + 1);
+        request.query["uploadId"] = upload_id;
+        std::size_t begin = i * part_size;
+        auto part = obj_data.subspan(
+            begin, std::min(part_size, obj_data.size() - begin));
+        request.body = {part.data(), part.size()};
+        auto response = perform(request);
+        if (!response) { return tl::unexpected(response.error()); }
+        if (response->status != 200 || response->headers["etag"].empty()) {
+          return tl::unexpected(
+              fmt::format("upload of part {} of {} failed: {}\n", i + 1, key,
+                          response->error()));
+        }
+        etags[i] = response->headers["etag"];
+        return {};
+      });
+
+  tl::expected<Response, std::string> completed;
+  if (uploaded) {
+    std::string parts_xml = "<CompleteMultipartUpload>";
+    for (std::size_t i = 0; i < parts; ++i) {
+      parts_xml += fmt::format(
+          "<Part><PartNumber>{}</PartNumber><ETag>{}</ETag></Part>", i + 1,
+          etags[i]);
+    }
+    parts_xml += "</CompleteMultipartUpload>";
+
+    Request complete;
+    complete.method = "POST";
+    complete.key = key;
+    complete.query["uploadId"] = upload_id;
+    complete.headers["content-type"] = "application/xml";
+    complete.body = parts_xml;
+    completed = perform(complete);
+    // the server may report errors after it already sent status 200
+    if (completed && completed->status == 200
+        && completed->body.find("<Error>") == std::string::npos) {
+      return {};
+    }
+  }
+
+  // the parts of failed uploads would otherwise be kept (and billed)
+  Request abort;
+  abort.method = "DELETE";
+  abort.key = key;
+  abort.query["uploadId"] = upload_id;
+  static_cast<void>(perform(abort));
+
+  if (!uploaded) { return uploaded; }
+  if (!completed) { return tl::unexpected(completed.error()); }
+  return tl::unexpected(fmt::format("completing the upload of {} failed: {}\n",
+                                    key, completed->error()));
+}
+
+auto S3Storage::download(std::string_view obj_name,
+                         std::string_view obj_part,
+                         gsl::span<char> buffer)
+    -> tl::expected<gsl::span<char>, std::string>
+{
+  Dmsg2(debug_trace, "download %s/%s called\n", obj_name.data(),
+        obj_part.data());
+  const std::size_t part_size = m_config.part_size;
+  std::string key = object_key(obj_name, obj_part);
+
+  /* The first part tells the size of the object, the rest of bigger
+   * objects gets downloaded by ranged requests in parallel. */
+  Request first;
+  first.key = key;
+  first.headers["range"] = fmt::format("bytes=0-{}", part_size - 1);
+  first.target = buffer.first(std::min(part_size, buffer.size()));
+  auto response = perform(first);
+  if (!response) { return tl::unexpected(response.error()); }
+  if (response->overflow) {
+    return tl::unexpected(fmt::format("{} does not fit into {} bytes\n", key,
+                                      buffer.size()));
+  }
+
+  // the first part was the whole object
+  if (response->status == 200) { return buffer.first(response->received); }
+  // ranges of empty objects are not satisfiable
+  if (response->status == 416) { return buffer.first(0); }
+  if (response->status != 206) {
+    return tl::unexpected(
+        fmt::format("download of {} failed: {}\n", key, response->error()));
+  }
+
+  // Content-Range: bytes 0-16777215/104857600
+  const std::string& range = response->headers["content-range"];
+  std::size_t slash = range.rfind('/');
+  if (slash == std::string::npos) {
+    return tl::unexpected(fmt::format(
+        "download of {} failed: bad content range '{}'\n", key, range));
+  }
+  std::size_t size = strtoull(range.c_str() + slash + 1, nullptr, 10);
+  if (size > buffer.size()) {
+    return tl::unexpected(
+        fmt::format("{} ({} bytes) does not fit into {} bytes\n", key, size,
+                    buffer.size()));
+  }
+  if (size <= response->received) { return buffer.first(size); }
+
+  const std::size_t rest = size - part_size;
+  const std::size_t parts = (rest + part_size - 1) / part_size;
+  auto downloaded = run_parallel(
+      parts, [&](std::size_t i) -> tl::expected<void, std::string> {
+        std::size_t begin = (i + 1) * part_size;
+        std::size_t length = std::min(part_size, size - begin);
+        Request request;
+        request.key = key;
+        request.headers["range"]
+            = fmt::format("bytes={}-{}", begin, begin + length - 1);
+        request.target = buffer.subspan(begin, length);
+        auto part = perform(request);
+        if (!part) { return tl::unexpected(part.error()); }
+        if (part->overflow || part->status != 206 || part->received != length) {
+          return tl::unexpected(
+              fmt::format("download of {} bytes at {} of {} failed: {}\n",
+                          length, begin, key, part->error()));
+        }
+        return {};
+      });
+  if (!downloaded) { return tl::unexpected(downloaded.error()); }
+  return buffer.first(size);
+}
+
+auto S3Storage::download_range(std::string_view obj_name,
+                               std::string_view obj_part,
+                               std::size_t offset,
+                               gsl::span<char> buffer)
+    -> tl::expected<gsl::span<char>, std::string>
+{
+  Dmsg4(debug_trace, "download of %zu bytes at %zu of %s/%s called\n",
+        buffer.size(), offset, obj_name.data(), obj_part.data());
+  if (buffer.empty()) { return buffer; }
+  const std::size_t part_size = m_config.part_size;
+  std::string key = object_key(obj_name, obj_part);
+
+  const std::size_t parts = (buffer.size() + part_size - 1) / part_size;
+  std::vector<std::size_t> received(parts, 0);
+  auto downloaded = run_parallel(
+      parts, [&](std::size_t i) -> tl::expected<void, std::string> {
+        std::size_t begin = i * part_size;
+        std::size_t length = std::min(part_size, buffer.size() - begin);
+        Request request;
+        request.key = key;
+        request.headers["range"] = fmt::format(
+            "bytes={}-{}", offset + begin, offset + begin + length - 1);
+        request.target = buffer.subspan(begin, length);
+        auto part = perform(request);
+        if (!part) { return tl::unexpected(part.error()); }
+        // the range starts after the end of the object
+        if (part->status == 416) { return {}; }
+        // the whole object was sent, which is only what we want from its start
+        bool whole = part->status == 200 && offset + begin == 0;
+        if (part->overflow || (part->status != 206 && !whole)) {
+          return tl::unexpected(
+              fmt::format("download of {} bytes at {} of {} failed: {}\n",
+                          length, offset + begin, key, part->error()));
+        }
+        received[i] = part->received;
+        return {};
+      });
+  if (!downloaded) { return tl::unexpected(downloaded.error()); }
+
+  // the object ends with the first part that came back short
+  std::size_t size = 0;
+  for (std::size_t i = 0; i < parts; ++i) {
+    size += received[i];
+    if (received[i] < std::min(part_size, buffer.size() - i * part_size)) {
+      break;
+    }
+  }
+  return buffer.first(size);
+}
+
+tl::expected<void, std::string> S3Storage::remove(std::string_view obj_name,
+                                                  std::string_view obj_part)
+{
+  Dmsg2(debug_trace, "remove %s/%s called\n", obj_name.data(), obj_part.data());
+  Request request;
+  request.method = "DELETE";
+  request.key = object_key(obj_name, obj_part);
+  auto response = perform(request);
+  if (!response) { return tl::unexpected(response.error()); }
+  if (response->status != 200 && response->status != 204
+      && response->status != 404) {
+    return tl::unexpected(fmt::format("removing {} failed: {}\n", request.key,
+                                      response->error()));
+  }
+  return {};
+}
+
+tl::expected<void, std::string> S3Storage::remove_batch(
+    std::string_view obj_name,
+    const std::vector<std::string>& obj_parts)
+{
+  Dmsg2(debug_trace, "remove_batch %s (%zu parts) called\n", obj_name.data(),
+        obj_parts.size());
+  constexpr std::size_t max_keys = 1000;  // per request
+  const std::size_t batches = (obj_parts.size() + max_keys - 1) / max_keys;
+  return run_parallel(
+      batches, [&](std::size_t i) -> tl::expected<void, std::string> {
+        std::string delete_xml = "<Delete><Quiet>true</Quiet>";
+        std::size_t end = std::min(obj_parts.size(), (i + 1) * max_keys);
+        for (std::size_t j = i * max_keys; j < end; ++j) {
+          delete_xml += fmt::format(
+              "<Object><Key>{}</Key></Object>",
+              XmlEscape(object_key(obj_name, obj_parts[j])));
+        }
+        delete_xml += "</Delete>";
+
+        Request request;
+        request.method = "POST";
+        request.query["delete"] = "";
+        request.headers["content-type"] = "application/xml";
+        request.headers["content-md5"] = Md5Base64(delete_xml);
+        request.body = delete_xml;
+        auto response = perform(request);
+        if (!response) { return tl::unexpected(response.error()); }
+        // in quiet mode the body only lists the objects that were not deleted
+        auto errors = XmlElements(response->body, "Error");
+        if (response->status != 200 || !errors.empty()) {
+          std::string detail
+              = errors.empty() ? response->error()
+                               : fmt::format("{}: {}",
+                                             FirstElement(errors[0], "Key"),
+                                             FirstElement(errors[0], "Code"));
+          return tl::unexpected(fmt::format("removing parts of {} failed: {}\n",
+                                            obj_name, detail));
+        }
+        return {};
+      });
+}
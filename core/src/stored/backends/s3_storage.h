@@ -0,0 +1,134 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#ifndef BAREOS_STORED_BACKENDS_S3_STORAGE_H_
+#define BAREOS_STORED_BACKENDS_S3_STORAGE_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <gsl/span>
+#include "tl/expected.hpp"
+
+/* Object storage access over the S3 protocol, with the same operations as
+ * CrudStorage.  Objects are named <prefix><obj_name>/<obj_part>, the layout
+ * of the droplet backend.
+ *
+ * Requests use a pool of connections that are kept open between requests.
+ * Objects bigger than the part size are uploaded as multipart uploads and
+ * downloaded by ranged requests, with up to the maximum number of
+ * connections in parallel. */
+class S3Storage {
+ public:
+  struct Stat {
+    size_t size{0};
+  };
+
+  struct Config {
+    std::string endpoint{}; /**< e.g. https://s3.example.com:9000 */
+    std::string region{"us-east-1"};
+    std::string bucket{};
+    std::string prefix{}; /**< Prepended to all object names */
+    std::string access_key{};
+    std::string secret_key{};
+    std::string storage_class{};
+    bool path_style{true}; /**< host/bucket/key, else bucket.host/key */
+    bool http2{true};      /**< If the endpoint offers it */
+    bool verify_peer{true};
+    std::string ca_file{};
+    std::size_t connections{4};
+    std::size_t part_size{16 * 1024 * 1024};
+    std::size_t retries{3}; /**< Of requests failing with 5xx or timeouts */
+    std::chrono::seconds timeout{300}; /**< Without any progress */
+  };
+
+  S3Storage();
+  ~S3Storage();
+  S3Storage(const S3Storage&) = delete;
+  S3Storage& operator=(const S3Storage&) = delete;
+
+  tl::expected<void, std::string> configure(Config config);
+  tl::expected<void, std::string> test_connection();
+  tl::expected<Stat, std::string> stat(std::string_view obj_name,
+                                       std::string_view obj_part);
+  tl::expected<std::map<std::string, Stat>, std::string> list(
+      std::string_view obj_name);
+  tl::expected<void, std::string> upload(std::string_view obj_name,
+                                         std::string_view obj_part,
+                                         gsl::span<char> obj_data);
+  // fails if the object does not fit into the buffer
+  tl::expected<gsl::span<char>, std::string> download(std::string_view obj_name,
+                                                      std::string_view obj_part,
+                                                      gsl::span<char> buffer);
+  /* reads up to buffer.size() bytes starting at offset, fewer at the end of
+   * the object and none after it */
+  tl::expected<gsl::span<char>, std::string> download_range(
+      std::string_view obj_name,
+      std::string_view obj_part,
+      std::size_t offset,
+      gsl::span<char> buffer);
+  tl::expected<void, std::string> remove(std::string_view obj_name,
+                                         std::string_view obj_part);
+  // with multi-object deletes of up to 1000 objects, several in parallel
+  tl::expected<void, std::string> remove_batch(
+      std::string_view obj_name,
+      const std::vector<std::string>& obj_parts);
+
+  // of a single request, defined in s3_storage.cc
+  struct Request;
+  struct Response;
+
+ private:
+  class Connection;
+  class Share;
+
+  Config m_config{};
+  std::string m_scheme{};
+  std::string m_host{}; /**< With the port */
+
+  std::unique_ptr<Share> m_share;
+  std::size_t m_open_connections{0};
+  std::vector<std::unique_ptr<Connection>> m_idle_connections{};
+  std::mutex m_connection_mutex{};
+  std::condition_variable m_connection_released{};
+
+  std::unique_ptr<Connection> acquire_connection();
+  void release_connection(std::unique_ptr<Connection> connection);
+
+  std::string object_key(std::string_view obj_name,
+                         std::string_view obj_part) const;
+  tl::expected<Response, std::string> perform(Request& request);
+  tl::expected<Response, std::string> perform_once(Connection& connection,
+                                                   Request& request);
+
+  tl::expected<void, std::string> upload_multipart(const std::string& key,
+                                                   gsl::span<char> obj_data);
+  // runs fn(0) .. fn(count - 1) on up to the maximum number of connections
+  template <typename F>
+  tl::expected<void, std::string> run_parallel(std::size_t count, F fn);
+};
+
+#endif  // BAREOS_STORED_BACKENDS_S3_STORAGE_H_
@@ -41,8 +41,275 @@
 #include "lib/berrno.h"
 #include "lib/util.h"
 
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+/* Direct IO needs O_DIRECT and the reservation of space without changing the
+ * size of the file. */
+#if defined(HAVE_LINUX_OS) && defined(O_DIRECT) && defined(FALLOC_FL_KEEP_SIZE)
+#  define HAVE_DIRECT_IO 1
+#endif
+
 namespace storagedaemon {
 
+#if defined(FALLOC_FL_KEEP_SIZE)
+/* Reserves the space of the volume up to end, in steps of at least step
+ * bytes but not beyond limit (0 for none), without changing its size.
+ * Volumes that grow by reserved steps end up in few large extents, even
+ * when many of them grow at the same time. */
+static bool ReserveSpace(int fd,
+                         boffset_t& reserved_end,
+                         boffset_t end,
+                         boffset_t step,
+                         boffset_t limit)
+{
+  if (end <= reserved_end) { return true; }
+  boffset_t ahead = reserved_end + step;
+  if (limit > 0 && ahead > limit) { ahead = limit; }
+  if (ahead > end
+      && fallocate(fd, FALLOC_FL_KEEP_SIZE, reserved_end, ahead - reserved_end)
+             == 0) {
+    reserved_end = ahead;
+    return true;
+  }
+  // what is left may still be enough
+  if (fallocate(fd, FALLOC_FL_KEEP_SIZE, reserved_end, end - reserved_end)
+      == 0) {
+    reserved_end = end;
+    return true;
+  }
+  return false;
+}
+
+// gives back the space reserved behind the end of the volume
+static void ReleaseSpace(int fd, boffset_t& reserved_end)
+{
+  struct stat st;
+  if (fstat(fd, &st) != 0 || reserved_end <= st.st_size) { return; }
+  // not every filesystem punches holes behind the end, all truncate there
+  if (ftruncate(fd, st.st_size) != 0) {
+    BErrNo be;
+    Dmsg1(100, "Cannot release the space reserved for writing: ERR=%s\n",
+          be.bstrerror());
+  }
+  reserved_end = st.st_size;
+}
+#endif
+
+#if defined(HAVE_DIRECT_IO)
+/**
+ * Writes a volume with O_DIRECT, past the page cache.  The blocks get
+ * collected in aligned buffers, a thread writes out a full one while the
+ * next one fills up.  Only the unaligned end goes through the page cache
+ * when the writer gets flushed, it gets overwritten with the next aligned
+ * write.  The space for the collected data gets reserved when it is taken,
+ * so that a full filesystem fails the write of the block that does not fit
+ * and not a later one.
+ */
+class DirectWriter {
+ public:
+  DirectWriter(int direct_fd,
+               int fd,
+               boffset_t reserved_end,
+               boffset_t reserve_step)
+      : direct_fd_{direct_fd}
+      , fd_{fd}
+      , reserved_end_{reserved_end}
+      , reserve_step_{reserve_step}
+  {
+    for (buffer& buf : buffers_) {
+      buf.data = static_cast<char*>(std::aligned_alloc(alignment, buffer_size));
+    }
+    thread_ = std::thread([this]() { Run(); });
+  }
+
+  ~DirectWriter()
+  {
+    {
+      std::lock_guard lock{mutex_};
+      stop_ = true;
+    }
+    cond_.notify_all();
+    thread_.join();
+    for (buffer& buf : buffers_) { std::free(buf.data); }
+  }
+
+  bool valid() const { return buffers_[0].data && buffers_[1].data; }
+  boffset_t Position() const { return pos_; }
+
+  // only when flushed
+  bool SetPosition(boffset_t pos);
+  ssize_t Write(const void* data, size_t count, boffset_t limit);
+  bool Flush();
+  void ReleaseReservation() { ReleaseSpace(fd_, reserved_end_); }
+
+ private:
+  struct buffer {
+    char* data{nullptr};
+    size_t len{0};
+    boffset_t offset{0}; /**< Aligned */
+  };
+
+  static constexpr size_t alignment = 4096;
+  static constexpr size_t buffer_size = 4 * 1024 * 1024;
+
+  bool WaitIdle();
+  void Run();
+  static bool WriteFully(int fd, const char* data, size_t len, boffset_t at);
+
+  int direct_fd_;
+  int fd_;
+  boffset_t reserved_end_;
+  boffset_t reserve_step_;
+  boffset_t pos_{0};
+  bool dirty_{false};
+  buffer buffers_[2]{};
+  buffer* current_{&buffers_[0]};
+
+  std::mutex mutex_{};
+  std::condition_variable cond_{};
+  buffer* pending_{nullptr}; /**< Handed to the thread */
+  int error_{0};
+  bool stop_{false};
+  std::thread thread_{};
+};
+
+bool DirectWriter::SetPosition(boffset_t pos)
+{
+  current_->offset = pos - pos % alignment;
+  current_->len = pos - current_->offset;
+  pos_ = pos;
+  dirty_ = false;
+  if (current_->len == 0) { return true; }
+
+  // the start of the block gets written again with the first aligned write
+  ssize_t got = pread(fd_, current_->data, current_->len, current_->offset);
+  if (got < 0) { return false; }
+  memset(current_->data + got, 0, current_->len - got);
+  return true;
+}
+
+ssize_t DirectWriter::Write(const void* data, size_t count, boffset_t limit)
+{
+  if (!ReserveSpace(fd_, reserved_end_, pos_ + count, reserve_step_, limit)) {
+    return -1;
+  }
+
+  const char* from = static_cast<const char*>(data);
+  size_t left = count;
+  dirty_ = true;
+  while (left > 0) {
+    size_t n = std::min(left, buffer_size - current_->len);
+    memcpy(current_->data + current_->len, from, n);
+    current_->len += n;
+    pos_ += n;
+    from += n;
+    left -= n;
+    if (current_->len < buffer_size) { break; }
+
+    if (!WaitIdle()) { return -1; }
+    buffer* next = current_ == &buffers_[0] ? &buffers_[1] : &buffers_[0];
+    next->offset = current_->offset + buffer_size;
+    next->len = 0;
+    {
+      std::lock_guard lock{mutex_};
+      pending_ = current_;
+    }
+    cond_.notify_all();
+    current_ = next;
+  }
+  return count;
+}
+
+bool DirectWriter::Flush()
+{
+  if (!WaitIdle()) { return false; }
+  if (!dirty_) { return true; }
+
+  size_t aligned = current_->len - current_->len % alignment;
+  size_t tail = current_->len - aligned;
+  if (aligned > 0
+      && !WriteFully(direct_fd_, current_->data, aligned, current_->offset)) {
+    return false;
+  }
+  if (tail > 0
+      && !WriteFully(fd_, current_->data + aligned, tail,
+                     current_->offset + aligned)) {
+    return false;
+  }
+  memmove(current_->data, current_->data + aligned, tail);
+  current_->offset += aligned;
+  current_->len = tail;
+  dirty_ = false;
+  return true;
+}
+
+// waits for the thread to write out the pending buffer
+bool DirectWriter::WaitIdle()
+{
+  std::unique_lock lock{mutex_};
+  cond_.wait(lock, [this]() { return pending_ == nullptr; });
+  if (error_) {
+    errno = error_;
+    return false;
+  }
+  return true;
+}
+
+void DirectWriter::Run()
+{
+  std::unique_lock lock{mutex_};
+  while (true) {
+    cond_.wait(lock, [this]() { return pending_ || stop_; });
+    if (!pending_) { return; }
+
+    buffer* buf = pending_;
+    lock.unlock();
+    bool ok = WriteFully(direct_fd_, buf->data, buf->len, buf->offset);
+    int err = errno;
+    lock.lock();
+    if (!ok && !error_) { error_ = err ? err : EIO; }
+    pending_ = nullptr;
+    cond_.notify_all();
+  }
+}
+
+bool DirectWriter::WriteFully(int fd,
+                              const char* data,
+                              size_t len,
+                              boffset_t at)
+{
+  while (len > 0) {
+    ssize_t written = pwrite(fd, data, len, at);
+    if (written < 0 && errno == EINTR) { continue; }
+    if (written <= 0) {
+      if (written == 0) { errno = ENOSPC; }
+      return false;
+    }
+    data += written;
+    len -= written;
+    at += written;
+  }
+  return true;
+}
+#else
+// without direct IO support there is never a writer
+class DirectWriter {
+ public:
+  boffset_t Position() const { return 0; }
+  bool SetPosition(boffset_t) { return true; }
+  ssize_t Write(const void*, size_t, boffset_t) { return -1; }
+  bool Flush() { return true; }
+  void ReleaseReservation() {}
+};
+#endif
+
+unix_file_device::unix_file_device() = default;
+unix_file_device::~unix_file_device() { close(nullptr); }
+
 // (Un)mount the device (For a FILE device)
 static bool do_mount(DeviceControlRecord* dcr, bool mount, int dotimeout)
 {
@@ -216,20 +483,190 @@ bool unix_file_device::ScanForVolumeImpl(DeviceControlRecord* dcr)
 
 int unix_file_device::d_open(const char* pathname, int flags, int mode)
 {
-  return ::open(pathname, flags, mode);
+  int new_fd = ::open(pathname, flags, mode);
+  if (new_fd < 0) { return new_fd; }
+
+  bool writable = (flags & O_ACCMODE) != O_RDONLY;
+  if (writable && device_resource->preallocation_size > 0) {
+    StartPreallocation(new_fd);
+  }
+  if (!device_resource->direct_io) { return new_fd; }
+
+  if (writable) {
+    StartDirectWriter(pathname, new_fd);
+  } else {
+#if defined(HAVE_POSIX_FADVISE)
+    posix_fadvise(new_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    read_since_drop_ = 0;
+  }
+  return new_fd;
+}
+
+/* Opens the volume a second time with O_DIRECT, for the aligned writes.
+ * Everything else keeps using the normal descriptor. */
+bool unix_file_device::StartDirectWriter(const char* pathname, int buffered_fd)
+{
+#if defined(HAVE_DIRECT_IO)
+  direct_path_ = pathname;
+  direct_fd_ = ::open(pathname, O_WRONLY | O_DIRECT | O_CLOEXEC);
+  if (direct_fd_ < 0) {
+    BErrNo be;
+    Dmsg2(50, "Cannot open %s with O_DIRECT, writing buffered: ERR=%s\n",
+          pathname, be.bstrerror());
+    return false;
+  }
+
+  // without reserving space a full disk would only show up later
+  struct stat st;
+  bool reserved = fstat(buffered_fd, &st) == 0
+                  && fallocate(buffered_fd, FALLOC_FL_KEEP_SIZE, st.st_size,
+                               4096)
+                         == 0;
+  if (!reserved && errno != ENOSPC) {
+    BErrNo be;
+    Dmsg2(50, "Cannot reserve space in %s, writing buffered: ERR=%s\n",
+          pathname, be.bstrerror());
+    ::close(direct_fd_);
+    direct_fd_ = -1;
+    return false;
+  }
+
+  constexpr boffset_t default_step = 64 * 1024 * 1024;
+  boffset_t step = device_resource->preallocation_size > 0
+                       ? device_resource->preallocation_size
+                       : default_step;
+  direct_writer_ = std::make_unique<DirectWriter>(
+      direct_fd_, buffered_fd, st.st_size + (reserved ? 4096 : 0), step);
+  boffset_t pos = ::lseek(buffered_fd, 0, SEEK_CUR);
+  if (!direct_writer_->valid() || pos < 0
+      || !direct_writer_->SetPosition(pos)) {
+    direct_writer_.reset();
+    ::close(direct_fd_);
+    direct_fd_ = -1;
+    return false;
+  }
+  return true;
+#else
+  Dmsg1(50, "Direct IO is not available, writing %s buffered\n", pathname);
+  return false;
+#endif
+}
+
+// file volumes never grow beyond the maximum volume bytes
+boffset_t unix_file_device::PreallocationLimit() const
+{
+  return static_cast<boffset_t>(VolCatInfo.VolCatMaxBytes);
+}
+
+void unix_file_device::StartPreallocation(int t_fd)
+{
+#if defined(FALLOC_FL_KEEP_SIZE)
+  struct stat st;
+  if (fstat(t_fd, &st) == 0) {
+    preallocated_end_ = st.st_size;
+    preallocate_ = true;
+  }
+#endif
+}
+
+void unix_file_device::Preallocate(int t_fd, size_t count)
+{
+#if defined(FALLOC_FL_KEEP_SIZE)
+  boffset_t pos = ::lseek(t_fd, 0, SEEK_CUR);
+  if (pos < 0 || pos + static_cast<boffset_t>(count) <= preallocated_end_) {
+    return;
+  }
+  if (!ReserveSpace(t_fd, preallocated_end_, pos + count,
+                    device_resource->preallocation_size,
+                    PreallocationLimit())) {
+    // the write itself tells whether the disk is full
+    BErrNo be;
+    Dmsg2(100, "Cannot preallocate %s, stop preallocating: ERR=%s\n",
+          prt_name, be.bstrerror());
+    preallocate_ = false;
+  }
+#endif
+}
+
+void unix_file_device::StopPreallocation(int t_fd)
+{
+#if defined(FALLOC_FL_KEEP_SIZE)
+  if (preallocated_end_ > 0) { ReleaseSpace(t_fd, preallocated_end_); }
+#endif
+  preallocated_end_ = 0;
+  preallocate_ = false;
+}
+
+// writes out what the writer collected, false with errno set on errors
+bool unix_file_device::StopDirectWriter()
+{
+  if (!direct_writer_) { return true; }
+  bool ok = direct_writer_->Flush();
+  int err = errno;
+  direct_writer_->ReleaseReservation();
+  direct_writer_.reset();
+  ::close(direct_fd_);
+  direct_fd_ = -1;
+  errno = err;
+  return ok;
+}
+
+// restores read volumes once, keep them from pushing all else out
+void unix_file_device::DropReadPages(int t_fd, ssize_t count)
+{
+#if defined(HAVE_POSIX_FADVISE)
+  constexpr size_t drop_interval = 8 * 1024 * 1024;
+  if (count <= 0) { return; }
+  read_since_drop_ += count;
+  if (read_since_drop_ < drop_interval) { return; }
+  read_since_drop_ = 0;
+  boffset_t pos = ::lseek(t_fd, 0, SEEK_CUR);
+  if (pos > 0) { posix_fadvise(t_fd, 0, pos, POSIX_FADV_DONTNEED); }
+#endif
 }
 
 ssize_t unix_file_device::d_read(int t_fd, void* buffer, size_t count)
 {
-  return ::read(t_fd, buffer, count);
+  if (!direct_writer_) {
+    ssize_t got = ::read(t_fd, buffer, count);
+    if (device_resource->direct_io) { DropReadPages(t_fd, got); }
+    return got;
+  }
+
+  // reading back what was just written, e.g. the label
+  if (!direct_writer_->Flush()) { return -1; }
+  boffset_t pos = direct_writer_->Position();
+  if (::lseek(t_fd, pos, SEEK_SET) < 0) { return -1; }
+  ssize_t got = ::read(t_fd, buffer, count);
+  if (got > 0) { pos += got; }
+  int err = errno;
+  if (!direct_writer_->SetPosition(pos)) { return -1; }
+  errno = err;
+  return got;
 }
 
 ssize_t unix_file_device::d_write(int t_fd, const void* buffer, size_t count)
 {
+  if (direct_writer_) {
+    return direct_writer_->Write(buffer, count, PreallocationLimit());
+  }
+  if (preallocate_) { Preallocate(t_fd, count); }
   return ::write(t_fd, buffer, count);
 }
 
-int unix_file_device::d_close(int t_fd) { return ::close(t_fd); }
+int unix_file_device::d_close(int t_fd)
+{
+  bool ok = StopDirectWriter();
+  int err = errno;
+  StopPreallocation(t_fd);
+  int status = ::close(t_fd);
+  if (!ok) {
+    errno = err;
+    return -1;
+  }
+  return status;
+}
 
 int unix_file_device::d_ioctl(int, ioctl_req_t, char*) { return -1; }
 
@@ -237,7 +674,18 @@ boffset_t unix_file_device::d_lseek(DeviceControlRecord*,
                                     boffset_t offset,
                                     int whence)
 {
-  return ::lseek(fd, offset, whence);
+  if (!direct_writer_) { return ::lseek(fd, offset, whence); }
+
+  // the position of the writer is ahead of the one of the descriptor
+  if (whence == SEEK_CUR) {
+    if (offset == 0) { return direct_writer_->Position(); }
+    offset += direct_writer_->Position();
+    whence = SEEK_SET;
+  }
+  if (!direct_writer_->Flush()) { return -1; }
+  boffset_t pos = ::lseek(fd, offset, whence);
+  if (pos >= 0 && !direct_writer_->SetPosition(pos)) { return -1; }
+  return pos;
 }
 
 bool unix_file_device::d_truncate(DeviceControlRecord* dcr)
@@ -245,6 +693,17 @@ bool unix_file_device::d_truncate(DeviceControlRecord* dcr)
   struct stat st;
   PoolMem archive_name(PM_FNAME);
 
+  /* The writer reserved space behind the end of the volume, truncating
+   * frees that as well. */
+  bool direct = direct_writer_ != nullptr;
+  if (direct && !StopDirectWriter()) {
+    BErrNo be;
+
+    Mmsg2(errmsg, T_("Unable to write device %s. ERR=%s\n"), prt_name,
+          be.bstrerror());
+    return false;
+  }
+
   // When secure erase is configured never truncate the file.
   if (!me->secure_erase_cmdline) {
     if (ftruncate(fd, 0) != 0) {
@@ -314,6 +773,9 @@ bool unix_file_device::d_truncate(DeviceControlRecord* dcr)
   (void)!chown(archive_name.c_str(), st.st_uid, st.st_gid);
 
 bail_out:
+  // truncating freed the preallocated space as well
+  if (preallocate_) { preallocated_end_ = 0; }
+  if (direct) { StartDirectWriter(direct_path_.c_str(), fd); }
   return true;
 }
 
@@ -30,12 +30,17 @@
 
 #include "stored/dev.h"
 
+#include <memory>
+#include <string>
+
 namespace storagedaemon {
 
+class DirectWriter;
+
 class unix_file_device : public Device {
  public:
-  unix_file_device() = default;
-  ~unix_file_device() { close(nullptr); }
+  unix_file_device();
+  ~unix_file_device();
 
   // Interface from Device
   SeekMode GetSeekMode() const override { return SeekMode::BYTES; }
@@ -52,6 +57,22 @@ class unix_file_device : public Device {
   ssize_t d_read(int fd, void* buffer, size_t count) override;
   ssize_t d_write(int fd, const void* buffer, size_t count) override;
   bool d_truncate(DeviceControlRecord* dcr) override;
+
+ private:
+  bool StartDirectWriter(const char* pathname, int buffered_fd);
+  bool StopDirectWriter();
+  void DropReadPages(int t_fd, ssize_t count);
+  boffset_t PreallocationLimit() const;
+  void StartPreallocation(int t_fd);
+  void Preallocate(int t_fd, size_t count);
+  void StopPreallocation(int t_fd);
+
+  std::unique_ptr<DirectWriter> direct_writer_{}; /**< Direct IO only */
+  std::string direct_path_{};
+  int direct_fd_{-1};
+  size_t read_since_drop_{0};
+  boffset_t preallocated_end_{0};
+  bool preallocate_{false};
 };
 
 } /* namespace storagedaemon */
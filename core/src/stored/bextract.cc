@@ -58,6 +58,14 @@
 #include "include/jcr.h"
 #include "lib/compression.h"
 #include "lib/serial.h"
+#include "lib/channel.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
 
 namespace storagedaemon {
 extern bool ParseSdConfig(const char* configfile, int exit_code);
@@ -70,28 +78,33 @@ static void DoExtract(char* devname,
                       BootStrapRecord* bsr,
                       DirectorResource* director);
 static bool RecordCb(DeviceControlRecord* dcr, DeviceRecord* rec);
+static bool ProcessRecord(JobControlRecord* jcr, DeviceRecord* rec);
 
 static Device* dev = nullptr;
 static DeviceControlRecord* g_dcr;
-static BareosFilePacket g_bfd;
-static JobControlRecord* g_jcr;
 static FindFilesPacket* ff;
-static bool extract = false;
-static int non_support_data = 0;
-static long total = 0;
-static Attributes* attr;
+static std::atomic<int> non_support_data{0};
+static std::atomic<long> total{0};
 static char* where;
-static uint32_t num_files = 0;
-static int prog_name_msg = 0;
+static std::atomic<uint32_t> num_files{0};
+static std::atomic<int> prog_name_msg{0};
 static int win32_data_msg = 0;
+static int extract_jobs = 1;
+
+/* The state of the file being extracted.  With more than one extract job
+ * every worker thread extracts its own files, see ExtractWorkers. */
+static thread_local BareosFilePacket g_bfd;
+static thread_local JobControlRecord* g_jcr;
+static thread_local bool extract = false;
+static thread_local Attributes* attr;
 
-static AclData acl_data;
-static XattrData xattr_data;
-static alist<DelayedDataStream*>* delayed_streams = nullptr;
+static thread_local AclData acl_data;
+static thread_local XattrData xattr_data;
+static thread_local alist<DelayedDataStream*>* delayed_streams = nullptr;
 
-static char* wbuf;            /* write buffer address */
-static uint32_t wsize;        /* write size */
-static uint64_t fileAddr = 0; /* file write address */
+static thread_local char* wbuf;            /* write buffer address */
+static thread_local uint32_t wsize;        /* write size */
+static thread_local uint64_t fileAddr = 0; /* file write address */
 
 
 int main(int argc, char* argv[])
@@ -199,6 +212,12 @@ int main(int argc, char* argv[])
   bextract_app.add_flag("-p,--ignore-errors", forge_on,
                         "Proceed inspite of IO errors.");
 
+  bextract_app
+      .add_option("-j,--jobs", extract_jobs,
+                  "Number of threads decompressing and writing files.")
+      ->check(CLI::PositiveNumber)
+      ->type_name("<n>");
+
   AddVerboseOption(bextract_app);
 
   std::string VolumeNames;
@@ -245,7 +264,7 @@ int main(int argc, char* argv[])
 
 
   ReadCryptoCache(me->working_directory, "bareos-sd",
-                  GetFirstPortHostOrder(me->SDaddrs));
+                  GetFirstPortHostOrder(me->SDaddrs), true);
 
   if (!got_inc) {                      /* If no include file, */
     AddFnameToIncludeList(ff, 0, "/"); /*   include everything */
@@ -258,7 +277,7 @@ int main(int argc, char* argv[])
   if (prog_name_msg) {
     Pmsg1(000,
           T_("%d Program Name and/or Program Data Stream records ignored.\n"),
-          prog_name_msg);
+          prog_name_msg.load());
   }
   if (win32_data_msg) {
     Pmsg1(000,
@@ -386,6 +405,201 @@ static void ClosePreviousStream(void)
   SetAttributes(g_jcr, attr, &g_bfd);
 }
 
+static void SetupExtractJcr(JobControlRecord* jcr)
+{
+  free(jcr->where);
+  jcr->where = strdup(where);
+
+  jcr->buf_size = DEFAULT_NETWORK_BUFFER_SIZE;
+
+  uint32_t decompress_buf_size;
+
+  SetupDecompressionBuffers(jcr, &decompress_buf_size);
+  if (decompress_buf_size > 0) {
+    // See if we need to create a new compression buffer or make sure the
+    // existing is big enough.
+    if (!jcr->compress.inflate_buffer) {
+      jcr->compress.inflate_buffer = GetMemory(decompress_buf_size);
+      jcr->compress.inflate_buffer_size = decompress_buf_size;
+    } else {
+      if (decompress_buf_size > jcr->compress.inflate_buffer_size) {
+        jcr->compress.inflate_buffer = ReallocPoolMemory(
+            jcr->compress.inflate_buffer, decompress_buf_size);
+        jcr->compress.inflate_buffer_size = decompress_buf_size;
+      }
+    }
+  }
+}
+
+// Sets up the file state of the calling thread for extracting with g_jcr
+static void InitExtractState()
+{
+  binit(&g_bfd);
+  extract = false;
+  fileAddr = 0;
+  attr = new_attr(g_jcr);
+  acl_data.last_fname = GetPoolMemory(PM_FNAME);
+  xattr_data.last_fname = GetPoolMemory(PM_FNAME);
+}
+
+static void TermExtractState()
+{
+  /* If output file is still open, it was the last one in the
+   * archive since we just hit an end of file, so close the file. */
+  if (IsBopen(&g_bfd)) { ClosePreviousStream(); }
+  FreeAttr(attr);
+
+  FreePoolMemory(acl_data.last_fname);
+  FreePoolMemory(xattr_data.last_fname);
+
+  if (delayed_streams) {
+    DropDelayedDataStreams();
+    delete delayed_streams;
+    delayed_streams = nullptr;
+  }
+}
+
+namespace {
+struct extract_record {
+  int32_t FileIndex{0};
+  int32_t Stream{0};
+  int32_t maskedStream{0};
+  uint32_t data_len{0};
+  PoolMem data{PM_MESSAGE};
+};
+
+/* Extracts the files on several threads, so that decompressing and writing
+ * one file does not wait for the others.  The records are still read by one
+ * thread, all records of a file go to the worker that got its attributes.
+ * Directories and links are only handed out once the workers caught up, as
+ * they change or refer to what was extracted before them. */
+class ExtractWorkers {
+ public:
+  ExtractWorkers(int count, DirectorResource* director)
+  {
+    for (int i = 0; i < count; ++i) {
+      auto w = std::make_unique<worker>();
+      w->jcr = SetupDummyJcr("bextract", nullptr, director);
+      SetupExtractJcr(w->jcr);
+      auto [in, out]
+          = channel::CreateBufferedChannel<extract_record>(queue_length);
+      w->input.emplace(std::move(in));
+      w->output.emplace(std::move(out));
+      workers_.push_back(std::move(w));
+    }
+    for (auto& w : workers_) {
+      w->thread = std::thread([this, w = w.get()] { Work(*w); });
+    }
+  }
+
+  ~ExtractWorkers() { Finish(); }
+
+  // false once a worker failed to extract a record
+  bool Dispatch(const DeviceRecord* rec)
+  {
+    if (rec->FileIndex < 0) { return true; /* we don't want labels */ }
+
+    if (rec->maskedStream == STREAM_UNIX_ATTRIBUTES
+        || rec->maskedStream == STREAM_UNIX_ATTRIBUTES_EX) {
+      if (!UnpackAttributesRecord(g_jcr, rec->Stream, rec->data, rec->data_len,
+                                  attr)) {
+        Emsg0(M_ERROR_TERM, 0, T_("Cannot continue.\n"));
+      }
+      if (attr->type != FT_REG && attr->type != FT_REGE) { WaitIdle(); }
+      current_ = workers_[next_].get();
+      next_ = (next_ + 1) % workers_.size();
+    } else if (!current_) {
+      current_ = workers_.front().get();
+    }
+
+    extract_record copy;
+    copy.FileIndex = rec->FileIndex;
+    copy.Stream = rec->Stream;
+    copy.maskedStream = rec->maskedStream;
+    copy.data_len = rec->data_len;
+    copy.data.check_size(rec->data_len + 1);
+    memcpy(copy.data.c_str(), rec->data, rec->data_len);
+
+    {
+      std::unique_lock lock(mutex_);
+      in_flight_ += 1;
+    }
+    if (!current_->input->emplace(std::move(copy))) {
+      std::unique_lock lock(mutex_);
+      in_flight_ -= 1;
+      return false;
+    }
+    return !failed_;
+  }
+
+  // waits for the workers to extract everything they got
+  void Finish()
+  {
+    for (auto& w : workers_) { w->input->close(); }
+    for (auto& w : workers_) {
+      if (w->thread.joinable()) { w->thread.join(); }
+    }
+    for (auto& w : workers_) {
+      CleanupCompression(w->jcr);
+      FreePlugins(w->jcr);
+      FreeJcr(w->jcr);
+    }
+    workers_.clear();
+  }
+
+ private:
+  static constexpr std::size_t queue_length = 64;
+
+  struct worker {
+    JobControlRecord* jcr{nullptr};
+    std::optional<channel::input<extract_record>> input;
+    std::optional<channel::output<extract_record>> output;
+    std::thread thread;
+  };
+
+  void Work(worker& w)
+  {
+    g_jcr = w.jcr;
+    InitExtractState();
+    while (std::optional<extract_record> received = w.output->get()) {
+      if (!failed_) {
+        DeviceRecord rec;
+        rec.FileIndex = received->FileIndex;
+        rec.Stream = received->Stream;
+        rec.maskedStream = received->maskedStream;
+        rec.data_len = received->data_len;
+        rec.data = received->data.c_str();
+        if (!ProcessRecord(w.jcr, &rec)) { failed_ = true; }
+      }
+      std::unique_lock lock(mutex_);
+      if (--in_flight_ == 0) { idle_.notify_all(); }
+    }
+    TermExtractState();
+  }
+
+  void WaitIdle()
+  {
+    std::unique_lock lock(mutex_);
+    idle_.wait(lock, [this] { return in_flight_ == 0; });
+  }
+
+  std::vector<std::unique_ptr<worker>> workers_;
+  worker* current_{nullptr};
+  std::size_t next_{0};
+  std::mutex mutex_;
+  std::condition_variable idle_;
+  std::size_t in_flight_{0};
+  std::atomic<bool> failed_{false};
+};
+}  // namespace
+
+static bool DispatchRecordCb(DeviceControlRecord*,
+                             DeviceRecord* rec,
+                             ExtractWorkers* workers)
+{
+  return workers->Dispatch(rec);
+}
+
 static void DoExtract(char* devname,
                       std::string VolumeName,
                       BootStrapRecord* bsr,
@@ -421,47 +635,18 @@ static void DoExtract(char* devname,
     Emsg1(M_ERROR_TERM, 0, T_("%s must be a directory.\n"), where);
   }
 
-  free(g_jcr->where);
-  g_jcr->where = strdup(where);
-  attr = new_attr(g_jcr);
-
-  g_jcr->buf_size = DEFAULT_NETWORK_BUFFER_SIZE;
+  SetupExtractJcr(g_jcr);
+  InitExtractState();
 
-  uint32_t decompress_buf_size;
-
-  SetupDecompressionBuffers(g_jcr, &decompress_buf_size);
-  if (decompress_buf_size > 0) {
-    // See if we need to create a new compression buffer or make sure the
-    // existing is big enough.
-    if (!g_jcr->compress.inflate_buffer) {
-      g_jcr->compress.inflate_buffer = GetMemory(decompress_buf_size);
-      g_jcr->compress.inflate_buffer_size = decompress_buf_size;
-    } else {
-      if (decompress_buf_size > g_jcr->compress.inflate_buffer_size) {
-        g_jcr->compress.inflate_buffer = ReallocPoolMemory(
-            g_jcr->compress.inflate_buffer, decompress_buf_size);
-        g_jcr->compress.inflate_buffer_size = decompress_buf_size;
-      }
-    }
+  if (extract_jobs > 1) {
+    ExtractWorkers workers(extract_jobs, director);
+    ReadRecords(g_dcr, DispatchRecordCb, MountNextReadVolume, &workers);
+    workers.Finish();
+  } else {
+    ReadRecords(g_dcr, RecordCb, MountNextReadVolume);
   }
 
-  acl_data.last_fname = GetPoolMemory(PM_FNAME);
-  xattr_data.last_fname = GetPoolMemory(PM_FNAME);
-
-  ReadRecords(g_dcr, RecordCb, MountNextReadVolume);
-
-  /* If output file is still open, it was the last one in the
-   * archive since we just hit an end of file, so close the file. */
-  if (IsBopen(&g_bfd)) { ClosePreviousStream(); }
-  FreeAttr(attr);
-
-  FreePoolMemory(acl_data.last_fname);
-  FreePoolMemory(xattr_data.last_fname);
-
-  if (delayed_streams) {
-    DropDelayedDataStreams();
-    delete delayed_streams;
-  }
+  TermExtractState();
 
 
   CleanDevice(g_jcr->sd_impl->dcr);
@@ -476,7 +661,7 @@ static void DoExtract(char* devname,
   UnloadSdPlugins();
 
 
-  printf(T_("%u files restored.\n"), num_files);
+  printf(T_("%u files restored.\n"), num_files.load());
 
   return;
 }
@@ -503,9 +688,14 @@ static bool StoreData(BareosFilePacket* bfd, char* data, const int32_t length)
 
 // Called here for each record from ReadRecords()
 static bool RecordCb(DeviceControlRecord* dcr, DeviceRecord* rec)
+{
+  return ProcessRecord(dcr->jcr, rec);
+}
+
+// Extracts the record into the state of the calling thread
+static bool ProcessRecord(JobControlRecord* jcr, DeviceRecord* rec)
 {
   int status;
-  JobControlRecord* jcr = dcr->jcr;
 
   if (rec->FileIndex < 0) { return true; /* we don't want labels */ }
 
@@ -606,7 +796,7 @@ static bool RecordCb(DeviceControlRecord* dcr, DeviceRecord* rec)
           wsize = rec->data_len;
         }
         total += wsize;
-        Dmsg2(8, "Write %u bytes, total=%u\n", wsize, total);
+        Dmsg2(8, "Write %u bytes, total=%u\n", wsize, total.load());
         StoreData(&g_bfd, wbuf, wsize);
         fileAddr += wsize;
       }
@@ -651,7 +841,7 @@ static bool RecordCb(DeviceControlRecord* dcr, DeviceRecord* rec)
         if (DecompressData(jcr, attr->ofname, rec->maskedStream, &wbuf, &wsize,
                            false)) {
           Dmsg2(100, "Write uncompressed %d bytes, total before write=%d\n",
-                wsize, total);
+                wsize, total.load());
           StoreData(&g_bfd, wbuf, wsize);
           total += wsize;
           fileAddr += wsize;
@@ -668,6 +858,7 @@ static bool RecordCb(DeviceControlRecord* dcr, DeviceRecord* rec)
     case STREAM_SHA256_DIGEST:
     case STREAM_SHA512_DIGEST:
     case STREAM_XXH128_DIGEST:
+    case STREAM_XXH3_TREE_DIGEST:
       break;
 
     case STREAM_SIGNED_DIGEST:
@@ -31,6 +31,7 @@
 
 #include "include/bareos.h"
 #include "stored/stored.h"
+#include "stored/block_index.h"
 #include "stored/crc32/crc32.h"
 #include "stored/dev.h"
 #include "stored/device.h"
@@ -38,10 +39,14 @@
 #include "stored/label.h"
 #include "stored/socket_server.h"
 #include "stored/spool.h"
+#include "stored/stored_jcr_impl.h"
+#include "stored/write_scheduler.h"
 #include "lib/berrno.h"
 #include "lib/edit.h"
 #include "include/jcr.h"
 #include "lib/serial.h"
+#include "lib/metrics.h"
+#include "lib/trace_ring.h"
 
 namespace storagedaemon {
 
@@ -49,6 +54,15 @@ static bool TerminateWritingVolume(DeviceControlRecord* dcr);
 static bool DoNewFileBookkeeping(DeviceControlRecord* dcr);
 static void RereadLastBlock(DeviceControlRecord* dcr);
 
+static metrics::counter written_bytes{"bareos_sd_device_written_bytes",
+                                      "Bytes written to devices"};
+static metrics::counter written_blocks{"bareos_sd_device_written_blocks",
+                                       "Blocks written to devices"};
+static metrics::counter read_bytes{"bareos_sd_device_read_bytes",
+                                   "Bytes read from devices"};
+static metrics::counter read_blocks{"bareos_sd_device_read_blocks",
+                                    "Blocks read from devices"};
+
 bool forge_on = false; /* proceed inspite of I/O errors */
 
 /**
@@ -115,6 +129,15 @@ void DumpBlock(DeviceBlock* b, const char* msg)
   }
 }
 
+// The size of the buffer of new blocks for dev
+uint32_t BlockBufferSize(Device* dev)
+{
+  if (dev->max_block_size == 0) {
+    return dev->device_resource->label_block_size;
+  }
+  return dev->max_block_size;
+}
+
 /**
  * Create a new block structure.
  * We pass device so that the block can inherit the
@@ -126,20 +149,20 @@ DeviceBlock* new_block(Device* dev)
 
   memset(block, 0, sizeof(DeviceBlock));
 
+  block->buf_len = BlockBufferSize(dev);
   if (dev->max_block_size == 0) {
-    block->buf_len = dev->device_resource->label_block_size;
     Dmsg1(100,
           "created new block of blocksize %d (dev->device->label_block_size) "
           "as dev->max_block_size is zero\n",
           block->buf_len);
   } else {
-    block->buf_len = dev->max_block_size;
     Dmsg1(100, "created new block of blocksize %d (dev->max_block_size)\n",
           block->buf_len);
   }
   block->dev = dev;
   block->block_len = block->buf_len; /* default block size */
-  block->buf = GetMemory(block->buf_len);
+  block->buf = GetBufferMemory(block->buf_len);
+  block->file_addr = -1;
   EmptyBlock(block);
   block->BlockVer = BLOCK_VER; /* default write version */
   Dmsg1(650, "Returning new block=%x\n", block);
@@ -153,7 +176,7 @@ DeviceBlock* dup_block(DeviceBlock* eblock)
   int buf_len = SizeofPoolMemory(eblock->buf);
 
   memcpy(block, eblock, sizeof(DeviceBlock));
-  block->buf = GetMemory(buf_len);
+  block->buf = GetBufferMemory(buf_len);
   memcpy(block->buf, eblock->buf, buf_len);
   return block;
 }
@@ -190,6 +213,7 @@ void EmptyBlock(DeviceBlock* block)
   block->write_failed = false;
   block->block_read = false;
   block->FirstIndex = block->LastIndex = 0;
+  block->prepared_len = 0;
 }
 
 /**
@@ -504,8 +528,9 @@ static bool DoNewFileBookkeeping(DeviceControlRecord* dcr)
   Device* dev = dcr->dev;
   JobControlRecord* jcr = dcr->jcr;
 
-  // Create a JobMedia record so restore can seek
-  if (!dcr->DirCreateJobmediaRecord(false)) {
+  /* Create a JobMedia record so restore can seek, it is sent along with the
+   * next ones */
+  if (!dcr->DirQueueJobmediaRecord()) {
     Dmsg0(50, "Error from create_job_media.\n");
     dev->dev_errno = EIO;
     Jmsg2(jcr, M_FATAL, 0,
@@ -547,6 +572,55 @@ static const bool no_tape_write_test = true;
 static const bool no_tape_write_test = false;
 #endif
 
+/* On devices with CAP_ADJWRITESIZE set, a block that is not full gets
+ * written with the min or fixed block size. */
+static uint32_t WriteLength(Device* dev, DeviceBlock* block)
+{
+  uint32_t wlen = block->binbuf;
+  if (wlen == block->buf_len) { return wlen; }
+
+  Dmsg2(250, "binbuf=%d buf_len=%d\n", block->binbuf, block->buf_len);
+  if (!dev->HasCap(CAP_ADJWRITESIZE)) {
+    Dmsg1(400, "%s: block write size is not adjustable", dev->print_name());
+    return wlen;
+  }
+
+  if (dev->min_block_size == dev->max_block_size) {
+    // Fixed block size
+    return block->buf_len; /* fixed block size already rounded */
+  } else if (wlen < dev->min_block_size) {
+    // Min block size
+    return ((dev->min_block_size + TAPE_BSIZE - 1) / TAPE_BSIZE) * TAPE_BSIZE;
+  }
+  // Ensure size is rounded
+  return ((wlen + TAPE_BSIZE - 1) / TAPE_BSIZE) * TAPE_BSIZE;
+}
+
+/* Zeroes the padding up to the write length and serializes the header with
+ * the checksum.  This only depends on the block, so WriteBlockToDevice() does
+ * it before it locks the device and concurrent appends do not wait for the
+ * checksums of each other.  Doing it again only redoes what changed since.
+ *
+ * Returns the length to write. */
+static uint32_t PrepareBlockForWrite(Device* dev, DeviceBlock* block)
+{
+  uint32_t wlen = WriteLength(dev, block);
+  if (block->prepared_len != block->binbuf
+      || block->prepared_number != block->BlockNumber) {
+    if (wlen > block->binbuf) {
+      memset(block->bufp, 0, wlen - block->binbuf); /* clear garbage */
+    }
+    block->prepared_checksum = SerBlockHeader(block, dev->DoChecksum());
+    block->prepared_len = block->binbuf;
+    block->prepared_number = block->BlockNumber;
+    block->prepared_wlen = wlen;
+  } else if (wlen > block->prepared_wlen) {
+    memset(block->buf + block->prepared_wlen, 0, wlen - block->prepared_wlen);
+    block->prepared_wlen = wlen;
+  }
+  return wlen;
+}
+
 /**
  * Write a block to the device
  *
@@ -605,34 +679,8 @@ bool DeviceControlRecord::WriteBlockToDev()
     return false;
   }
 
-  /* Clear to the end of the buffer if it is not full,
-   * and on devices with CAP_ADJWRITESIZE set, apply min and fixed blocking. */
-  if (wlen != block->buf_len) {
-    uint32_t blen = wlen; /* current buffer length */
-
-    Dmsg2(250, "binbuf=%d buf_len=%d\n", block->binbuf, block->buf_len);
-
-    if (!dev->HasCap(CAP_ADJWRITESIZE)) {
-      Dmsg1(400, "%s: block write size is not adjustable", dev->print_name());
-    } else {
-      /* (dev->HasCap(CAP_ADJWRITESIZE)) */
-      if (dev->min_block_size == dev->max_block_size) {
-        // Fixed block size
-        wlen = block->buf_len; /* fixed block size already rounded */
-      } else if (wlen < dev->min_block_size) {
-        // Min block size
-        wlen = ((dev->min_block_size + TAPE_BSIZE - 1) / TAPE_BSIZE)
-               * TAPE_BSIZE;
-      } else {
-        // Ensure size is rounded
-        wlen = ((wlen + TAPE_BSIZE - 1) / TAPE_BSIZE) * TAPE_BSIZE;
-      }
-
-      if (wlen - blen > 0) {
-        memset(block->bufp, 0, wlen - blen); /* clear garbage */
-      }
-    }
-  }
+  wlen = PrepareBlockForWrite(dev, block);
+  checksum = block->prepared_checksum;
 
   Dmsg5(400,
         "dev=%s: writing %d bytes as block of %d bytes. Block sizes: min=%d, "
@@ -640,8 +688,6 @@ bool DeviceControlRecord::WriteBlockToDev()
         dev->print_name(), block->binbuf, wlen, dev->min_block_size,
         dev->max_block_size);
 
-  checksum = SerBlockHeader(block, dev->DoChecksum());
-
   // Limit maximum Volume size to value specified by user
   hit_max1 = (dev->max_volume_size > 0)
              && ((dev->VolCatInfo.VolCatBytes + block->binbuf))
@@ -794,6 +840,7 @@ bool DeviceControlRecord::WriteBlockToDev()
   }
 
   bool block_seek = dev->GetSeekMode() == SeekMode::FILE_BLOCK;
+  BlockIndexAddBlock(dcr, dev->file_addr, wlen);
 
   // if this is the first write to this volume (from this job) create a null
   // jobmedia entry to prevent the volume from getting recycled.
@@ -846,7 +893,18 @@ bool DeviceControlRecord::WriteBlockToDev()
   dev->file_size += wlen;
 
   Dmsg2(1300, "WriteBlock: wrote block %d bytes=%d\n", dev->block_num, wlen);
+  written_bytes.Add(wlen);
+  written_blocks.Add();
+  Dtrace(kBlock, "write block %u len=%d file=%u block=%u",
+         block->BlockNumber - 1, wlen, dev->file, dev->block_num);
   EmptyBlock(block);
+
+  // the size of despooled blocks was fixed when they were spooled
+  if (!dcr->despooling) {
+    if (uint32_t size = dev->NextWriteBlockSize(dcr, wlen)) {
+      block->buf_len = std::min<uint32_t>(size, SizeofPoolMemory(block->buf));
+    }
+  }
   return true;
 }
 
@@ -863,11 +921,21 @@ bool DeviceControlRecord::WriteBlockToDevice()
   DeviceControlRecord* dcr = this;
 
   if (dcr->spooling) {
+    auto timer = jcr->sd_impl->stage_times.Time(append_stage::kSpoolWrite);
     status = WriteBlockToSpoolFile(dcr);
     return status;
   }
 
+  if (block->binbuf > WRITE_BLKHDR_LENGTH) {
+    auto timer = jcr->sd_impl->stage_times.Time(append_stage::kBlockBuild);
+    PrepareBlockForWrite(dev, block);
+  }
+
   if (!dcr->IsDevLocked()) { /* device already locked? */
+    auto wait
+        = jcr->sd_impl->stage_times.TimeWait(append_stage::kDeviceWrite);
+    // waits for the share of the job before it keeps others off the device
+    ScheduleWrite(jcr, block->binbuf);
     // Note, do not change this to dcr->r_dlock
     dev->rLock(); /* no, lock it */
   }
@@ -883,8 +951,10 @@ bool DeviceControlRecord::WriteBlockToDevice()
       Dmsg0(100, "Canceled\n");
       goto bail_out;
     }
-    /* Create a jobmedia record for this job */
-    if (!dcr->DirCreateJobmediaRecord(false)) {
+    /* Create a jobmedia record for this job, the ones for new files on the
+     * same volume are sent together */
+    if (!(dcr->NewVol ? dcr->DirCreateJobmediaRecord(false)
+                      : dcr->DirQueueJobmediaRecord())) {
       dev->dev_errno = EIO;
       Jmsg2(jcr, M_FATAL, 0,
             T_("Could not create JobMedia record for Volume=\"%s\" Job=%s\n"),
@@ -902,7 +972,12 @@ bool DeviceControlRecord::WriteBlockToDevice()
     }
   }
 
-  if (!dcr->WriteBlockToDev()) {
+  bool written;
+  {
+    auto timer = jcr->sd_impl->stage_times.Time(append_stage::kDeviceWrite);
+    written = dcr->WriteBlockToDev();
+  }
+  if (!written) {
     if (jcr->IsJobCanceled() || jcr->is_JobType(JT_SYSTEM)) {
       status = false;
     } else {
@@ -1035,6 +1110,13 @@ reread:
   // successful read (status > 0)
 
   block->read_len = status; /* save length read */
+  /* Remember where the block is on a plain file volume, so that the records
+   * in it can be sent straight from the file (see SendFileRange()). */
+  block->file_addr = -1;
+  if (dev->device_resource->device_type == DeviceType::B_FILE_DEV) {
+    boffset_t pos = dev->d_lseek(dcr, (boffset_t)0, SEEK_CUR);
+    if (pos >= status) { block->file_addr = pos - status; }
+  }
   if (block->read_len == 80
       && (dcr->VolCatInfo.LabelType != B_BAREOS_LABEL
           || dcr->device_resource->label_type != B_BAREOS_LABEL)) {
@@ -1106,7 +1188,7 @@ reread:
     dev->max_block_size = block->block_len;
     block->buf_len = block->block_len;
     FreeMemory(block->buf);
-    block->buf = GetMemory(block->buf_len);
+    block->buf = GetBufferMemory(block->buf_len);
     EmptyBlock(block);
     looping++;
     goto reread; /* re-read block with correct block size */
@@ -1176,6 +1258,10 @@ reread:
   }
   Dmsg2(250, "Exit read_block read_len=%d block_len=%d\n", block->read_len,
         block->block_len);
+  read_bytes.Add(block->block_len);
+  read_blocks.Add();
+  Dtrace(kBlock, "read block %u len=%u file=%u block=%u", block->BlockNumber,
+         block->block_len, dev->file, dev->block_num);
   block->block_read = true;
   return ReadStatus::Ok;
 }
@@ -104,6 +104,11 @@ struct DeviceBlock {
   int32_t LastIndex;       /* last index this block */
   char* bufp;              /* pointer into buffer */
   POOLMEM* buf;            /* actual data buffer */
+  int64_t file_addr;       /* volume address of buf, -1 if not a plain file */
+  uint32_t prepared_len;   /* binbuf the header was serialized for, or 0 */
+  uint32_t prepared_number; /* BlockNumber the header was serialized for */
+  uint32_t prepared_wlen;  /* padded with zeros up to this length */
+  uint32_t prepared_checksum; /* of the serialized header */
 };
 
 inline uint32_t BlockWriteNavail(DeviceBlock* block)
@@ -112,6 +117,7 @@ inline uint32_t BlockWriteNavail(DeviceBlock* block)
 }
 
 void DumpBlock(DeviceBlock* b, const char* msg);
+uint32_t BlockBufferSize(Device* dev);
 DeviceBlock* new_block(Device* dev);
 DeviceBlock* dup_block(DeviceBlock* eblock);
 void InitBlockWrite(DeviceBlock* block);
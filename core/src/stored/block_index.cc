@@ -0,0 +1,327 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * index of the blocks of disk volumes (Device: Block Index Directory)
+ *
+ * For every block written to a volume, the session and the range of file
+ * indexes it contains are appended to <Block Index Directory>/<volume>.idx.
+ * When a restore has to forward space on the volume, the index tells it the
+ * first block that can contain a wanted record, so it does not have to read
+ * all of the blocks in front of it.
+ *
+ * The index always describes the contiguous range of the volume starting at
+ * header.start; whenever a block is written somewhere else it is started
+ * again.  It is only used as long as the label time of the volume matches,
+ * so relabeled volumes never use the index of their previous content.
+ */
+
+#include "include/bareos.h"
+#include "include/fcntl_def.h"
+#include "stored/block.h"
+#include "stored/block_index.h"
+#include "stored/bsr.h"
+#include "stored/dev.h"
+#include "stored/device_control_record.h"
+#include "stored/device_resource.h"
+#include "lib/berrno.h"
+
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include <vector>
+
+namespace storagedaemon {
+
+static constexpr int debuglevel = 100;
+
+namespace {
+// the index is never moved to other machines, so it uses the native layout
+constexpr char index_id[8] = "BBIDX01";
+
+struct index_header {
+  char id[8];
+  int64_t label_btime;
+  uint64_t start;  // address of the first indexed block
+};
+
+struct index_entry {
+  uint64_t addr;
+  uint32_t len;
+  uint32_t VolSessionId;
+  uint32_t VolSessionTime;
+  int32_t FirstIndex;
+  int32_t LastIndex;
+  uint32_t reserved;
+};
+
+// the device is not indexed until it is closed again
+constexpr int index_disabled = -2;
+
+bool UseBlockIndex(Device* dev)
+{
+  return dev->device_resource && dev->device_resource->block_index_directory
+         && dev->GetSeekMode() == SeekMode::BYTES
+         && dev->VolHdr.VolumeName[0] != 0;
+}
+
+void MakeIndexName(Device* dev, PoolMem& name)
+{
+  Mmsg(name, "%s/%s.idx", dev->device_resource->block_index_directory,
+       dev->VolHdr.VolumeName);
+}
+
+bool ReadAt(int fd, uint64_t pos, void* data, std::size_t size)
+{
+  if (lseek(fd, pos, SEEK_SET) < 0) { return false; }
+  auto* p = static_cast<char*>(data);
+  while (size > 0) {
+    ssize_t n = read(fd, p, size);
+    if (n < 0 && errno == EINTR) { continue; }
+    if (n <= 0) { return false; }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool WriteAll(int fd, const void* data, std::size_t size)
+{
+  auto* p = static_cast<const char*>(data);
+  while (size > 0) {
+    ssize_t n = write(fd, p, size);
+    if (n < 0 && errno == EINTR) { continue; }
+    if (n <= 0) { return false; }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool ReadHeader(int fd, Device* dev, index_header& hdr)
+{
+  return ReadAt(fd, 0, &hdr, sizeof(hdr))
+         && memcmp(hdr.id, index_id, sizeof(hdr.id)) == 0
+         && hdr.label_btime == dev->VolHdr.label_btime;
+}
+
+// Returns the number of complete entries after the header.
+uint64_t NumEntries(int fd)
+{
+  off_t size = lseek(fd, 0, SEEK_END);
+  if (size < static_cast<off_t>(sizeof(index_header))) { return 0; }
+  return (size - sizeof(index_header)) / sizeof(index_entry);
+}
+
+uint64_t EntryPos(uint64_t num)
+{
+  return sizeof(index_header) + num * sizeof(index_entry);
+}
+
+bool StartIndex(Device* dev, const char* name, uint64_t addr)
+{
+  if (dev->block_index_fd >= 0) { close(dev->block_index_fd); }
+  dev->block_index_fd
+      = open(name, O_CREAT | O_TRUNC | O_WRONLY | O_BINARY, 0640);
+  if (dev->block_index_fd < 0) { return false; }
+
+  index_header hdr{};
+  memcpy(hdr.id, index_id, sizeof(hdr.id));
+  hdr.label_btime = dev->VolHdr.label_btime;
+  hdr.start = addr;
+  dev->block_index_end = addr;
+  return WriteAll(dev->block_index_fd, &hdr, sizeof(hdr));
+}
+
+// Continue an existing index if it ends where the next block is written.
+bool ContinueIndex(Device* dev, const char* name, uint64_t addr)
+{
+  int fd = open(name, O_RDWR | O_BINARY);
+  if (fd < 0) { return false; }
+
+  index_header hdr;
+  uint64_t end = 0;
+  bool ok = ReadHeader(fd, dev, hdr);
+  uint64_t num = ok ? NumEntries(fd) : 0;
+  if (ok) {
+    end = hdr.start;
+    index_entry last;
+    if (num > 0) {
+      ok = ReadAt(fd, EntryPos(num - 1), &last, sizeof(last));
+      end = last.addr + last.len;
+    }
+  }
+
+  // a partially written last entry is overwritten by the next one
+  if (!ok || end != addr || lseek(fd, EntryPos(num), SEEK_SET) < 0) {
+    close(fd);
+    return false;
+  }
+
+  dev->block_index_fd = fd;
+  dev->block_index_end = end;
+  return true;
+}
+}  // namespace
+
+void BlockIndexAddBlock(DeviceControlRecord* dcr, uint64_t addr, uint32_t len)
+{
+  Device* dev = dcr->dev;
+  if (dev->block_index_fd == index_disabled || !UseBlockIndex(dev)) { return; }
+
+  PoolMem name(PM_FNAME);
+  MakeIndexName(dev, name);
+
+  bool ok = true;
+  if (dev->block_index_fd < 0) {
+    if (!ContinueIndex(dev, name.c_str(), addr)) {
+      ok = StartIndex(dev, name.c_str(), addr);
+    }
+  } else if (dev->block_index_end != addr) {
+    Dmsg2(debuglevel, "Block written to %llu instead of %llu, new index\n",
+          static_cast<unsigned long long>(addr),
+          static_cast<unsigned long long>(dev->block_index_end));
+    ok = StartIndex(dev, name.c_str(), addr);
+  }
+
+  if (ok) {
+    DeviceBlock* block = dcr->block;
+    index_entry entry{addr,
+                      len,
+                      block->VolSessionId,
+                      block->VolSessionTime,
+                      block->FirstIndex,
+                      block->LastIndex,
+                      0};
+    ok = WriteAll(dev->block_index_fd, &entry, sizeof(entry));
+  }
+
+  if (!ok) {
+    BErrNo be;
+    Jmsg(dcr->jcr, M_WARNING, 0,
+         T_("Could not write block index %s, removing it. ERR=%s\n"),
+         name.c_str(), be.bstrerror());
+    if (dev->block_index_fd >= 0) { close(dev->block_index_fd); }
+    dev->block_index_fd = index_disabled;
+    unlink(name.c_str());
+    return;
+  }
+  dev->block_index_end = addr + len;
+}
+
+void BlockIndexClose(Device* dev)
+{
+  if (dev->block_index_fd >= 0) { close(dev->block_index_fd); }
+  dev->block_index_fd = -1;
+  dev->block_index_end = 0;
+}
+
+uint64_t BlockIndexStartAddr(DeviceControlRecord* dcr,
+                             BootStrapRecord* bsr,
+                             uint64_t bsr_addr)
+{
+  Device* dev = dcr->dev;
+  if (!bsr || !UseBlockIndex(dev)) { return bsr_addr; }
+
+  // Only bootstrap records for a single session can be looked up.
+  if (!bsr->sessid || bsr->sessid->next
+      || bsr->sessid->sessid != bsr->sessid->sessid2 || !bsr->sesstime
+      || bsr->sesstime->next) {
+    return bsr_addr;
+  }
+
+  int32_t findex = 0;
+  if (!bsr->FileIndex) {
+    findex = 1;
+  } else {
+    for (BsrFileIndex* fi = bsr->FileIndex; fi; fi = fi->next) {
+      if (!fi->done && (findex == 0 || fi->findex < findex)) {
+        findex = fi->findex;
+      }
+    }
+    if (findex == 0) { return bsr_addr; }
+  }
+
+  PoolMem name(PM_FNAME);
+  MakeIndexName(dev, name);
+  int fd = open(name.c_str(), O_RDONLY | O_BINARY);
+  if (fd < 0) { return bsr_addr; }
+
+  index_header hdr;
+  if (!ReadHeader(fd, dev, hdr) || bsr_addr < hdr.start) {
+    close(fd);
+    return bsr_addr;
+  }
+
+  // find the first block at or behind bsr_addr
+  uint64_t num = NumEntries(fd);
+  uint64_t lo = 0, hi = num;
+  index_entry entry;
+  while (lo < hi) {
+    uint64_t mid = lo + (hi - lo) / 2;
+    if (!ReadAt(fd, EntryPos(mid), &entry, sizeof(entry))) {
+      close(fd);
+      return bsr_addr;
+    }
+    if (entry.addr < bsr_addr) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  uint32_t sessid = bsr->sessid->sessid;
+  uint32_t sesstime = bsr->sesstime->sesstime;
+  std::vector<index_entry> entries(1024);
+  std::optional<uint64_t> found;
+  uint64_t end = hdr.start;
+  if (lo > 0 && ReadAt(fd, EntryPos(lo - 1), &entry, sizeof(entry))) {
+    end = entry.addr + entry.len;
+  }
+  for (uint64_t pos = lo; !found && pos < num;) {
+    std::size_t count = std::min<uint64_t>(entries.size(), num - pos);
+    if (!ReadAt(fd, EntryPos(pos), entries.data(),
+                count * sizeof(index_entry))) {
+      close(fd);
+      return bsr_addr;
+    }
+    for (std::size_t i = 0; i < count; ++i) {
+      const index_entry& e = entries[i];
+      if (e.VolSessionId == sessid && e.VolSessionTime == sesstime
+          && e.LastIndex >= findex) {
+        found = e.addr;
+        break;
+      }
+      end = e.addr + e.len;
+    }
+    pos += count;
+  }
+  close(fd);
+
+  /* Nothing behind bsr_addr in the index is wanted, so everything wanted
+   * has to be behind the indexed part. */
+  uint64_t addr = found ? *found : std::max(bsr_addr, end);
+  Dmsg4(debuglevel, "Block index %s: FileIndex %d of %u at %llu\n",
+        name.c_str(), findex, sessid, static_cast<unsigned long long>(addr));
+  return addr;
+}
+
+} /* namespace storagedaemon */
@@ -0,0 +1,49 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * index of the blocks of disk volumes (Device: Block Index Directory)
+ */
+
+#ifndef BAREOS_STORED_BLOCK_INDEX_H_
+#define BAREOS_STORED_BLOCK_INDEX_H_
+
+#include <cstdint>
+
+namespace storagedaemon {
+
+class Device;
+class DeviceControlRecord;
+struct BootStrapRecord;
+
+// Remember the block just written to addr on the volume.
+void BlockIndexAddBlock(DeviceControlRecord* dcr, uint64_t addr, uint32_t len);
+void BlockIndexClose(Device* dev);
+
+/* Returns the address at which reading has to start to find the records
+ * of bsr; this is bsr_addr if there is no usable index. */
+uint64_t BlockIndexStartAddr(DeviceControlRecord* dcr,
+                             BootStrapRecord* bsr,
+                             uint64_t bsr_addr);
+
+} /* namespace storagedaemon */
+
+#endif  // BAREOS_STORED_BLOCK_INDEX_H_
@@ -233,7 +233,7 @@ int main(int argc, char* argv[])
   LoadSdPlugins(me->plugin_directory, me->plugin_names);
 
   ReadCryptoCache(me->working_directory, "bareos-sd",
-                  GetFirstPortHostOrder(me->SDaddrs));
+                  GetFirstPortHostOrder(me->SDaddrs), true);
 
   if (ff->included_files_list == nullptr) { AddFnameToIncludeList(ff, 0, "/"); }
 
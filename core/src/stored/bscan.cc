@@ -57,6 +57,9 @@
 #include "lib/version.h"
 #include "lib/compression.h"
 
+#include <map>
+#include <string>
+
 /* Dummy functions */
 namespace storagedaemon {
 extern bool ParseSdConfig(const char* configfile, int exit_code);
@@ -131,6 +134,20 @@ static int num_media = 0;
 static int num_files = 0;
 static int num_restoreobjects = 0;
 
+/* With --jobs the file records are inserted in batches, so they have to be
+ * kept until their digest (which follows the attributes) was read. */
+static uint32_t batch_connections = 0;
+struct pending_file {
+  AttributesDbRecord ar;
+  std::string fname;
+  std::string lname;
+  std::string attr;
+  std::string digest;
+};
+static std::map<JobId_t, pending_file> pending_files;
+static void FlushPendingFile(BareosDb* db, JobId_t JobId);
+static void FlushPendingFiles(BareosDb* db);
+
 int main(int argc, char* argv[])
 {
   setlocale(LC_ALL, "");
@@ -202,6 +219,13 @@ int main(int argc, char* argv[])
       ->type_name("<user>")
       ->capture_default_str();
 
+  bscan_app
+      .add_option("-j,--jobs", batch_connections,
+                  "Insert the file records in batches, merged through "
+                  "<number> parallel database connections (0 inserts every "
+                  "file record on its own).")
+      ->type_name("<number>");
+
   bscan_app.add_flag("-m,--update-volume-info", update_vol_info,
                      "Update media info in database.");
 
@@ -260,7 +284,7 @@ int main(int argc, char* argv[])
   LoadSdPlugins(me->plugin_directory, me->plugin_names);
 
   ReadCryptoCache(me->working_directory, "bareos-sd",
-                  GetFirstPortHostOrder(me->SDaddrs));
+                  GetFirstPortHostOrder(me->SDaddrs), true);
 
   /* Check if -w option given, otherwise use resource for working directory
    */
@@ -318,6 +342,14 @@ int main(int argc, char* argv[])
   }
   if (!db->OpenDatabase(nullptr)) { Emsg0(M_ERROR_TERM, 0, db->strerror()); }
   Dmsg0(200, "Database opened\n");
+  if (batch_connections > 0) {
+    if (db->BatchInsertAvailable()) {
+      db->SetBatchPartitions(batch_connections);
+    } else {
+      Pmsg0(000, T_("Batch insert is not available, ignoring --jobs.\n"));
+      batch_connections = 0;
+    }
+  }
   if (g_verbose) {
     Pmsg2(000, T_("Using Database: %s, User: %s\n"), db_name.c_str(),
           db_user.c_str());
@@ -420,6 +452,7 @@ static void do_scan()
   ReadRecords(bjcr->sd_impl->read_dcr, RecordCb, BscanMountNextReadVolume);
 
   if (update_db) {
+    FlushPendingFiles(db);
     db->WriteBatchFileRecords(bjcr); /* used by bulk batch file insert */
   }
 
@@ -688,6 +721,8 @@ static bool RecordCb(DeviceControlRecord* dcr, DeviceRecord* rec)
             break;
           }
 
+          if (update_db) { FlushPendingFile(db, mjcr->JobId); }
+
           // Do the final update to the Job record
           UpdateJobRecord(db, &jr, &elabel, rec);
 
@@ -1023,7 +1058,16 @@ static bool CreateFileAttributesRecord(BareosDb* t_db,
                                        char* ap,
                                        DeviceRecord* rec)
 {
+  static PoolMem lstat(PM_NAME);
   DeviceControlRecord* dcr = mjcr->sd_impl->read_dcr;
+  // The catalog keeps the text form
+  if (IsBinaryStat(ap)) {
+    if (!StatToText(ap, lstat)) {
+      Pmsg1(0, T_("Malformed attributes of %s\n"), fname);
+      return false;
+    }
+    ap = lstat.c_str();
+  }
   ar.fname = fname;
   ar.link = lname;
   ar.ClientId = mjcr->ClientId;
@@ -1041,6 +1085,19 @@ static bool CreateFileAttributesRecord(BareosDb* t_db,
 
   if (!update_db) { return true; }
 
+  if (batch_connections > 0) {
+    FlushPendingFile(t_db, mjcr->JobId);
+    pending_file& pending = pending_files[mjcr->JobId];
+    pending.ar = ar;
+    pending.ar.FileType = type;
+    pending.fname = fname;
+    pending.lname = lname ? lname : "";
+    pending.attr = ap;
+    mjcr->FileId = 0;
+    if (g_verbose > 1) { Pmsg1(000, T_("Queued File record: %s\n"), fname); }
+    return true;
+  }
+
   if (DbLocker _{t_db}; !t_db->CreateFileAttributesRecord(bjcr, &ar)) {
     Pmsg1(0, T_("Could not create File Attributes record. ERR=%s\n"),
           t_db->strerror());
@@ -1401,6 +1458,16 @@ static bool UpdateDigestRecord(BareosDb* t_db,
     return false;
   }
 
+  if (update_db && batch_connections > 0) {
+    if (auto found = pending_files.find(mjcr->JobId);
+        found != pending_files.end()) {
+      found->second.digest = digest;
+      found->second.ar.DigestType = type;
+    }
+    FreeJcr(mjcr);
+    return true;
+  }
+
   if (!update_db || mjcr->FileId == 0) {
     FreeJcr(mjcr);
     return true;
@@ -1446,3 +1513,31 @@ static JobControlRecord* create_jcr(JobDbRecord* t_jr,
 
   return jobjcr;
 }
+
+// Insert the file record of JobId that waited for its digest
+static void FlushPendingFile(BareosDb* t_db, JobId_t JobId)
+{
+  auto found = pending_files.find(JobId);
+  if (found == pending_files.end()) { return; }
+
+  pending_file& pending = found->second;
+  pending.ar.fname = pending.fname.data();
+  pending.ar.link = pending.lname.data();
+  pending.ar.attr = pending.attr.data();
+  pending.ar.Digest = pending.digest.empty() ? nullptr : pending.digest.data();
+
+  if (DbLocker _{t_db}; !t_db->CreateAttributesRecord(bjcr, &pending.ar)) {
+    Pmsg1(0, T_("Could not create File Attributes record. ERR=%s\n"),
+          t_db->strerror());
+  } else if (g_verbose > 1) {
+    Pmsg1(000, T_("Created File record: %s\n"), pending.fname.c_str());
+  }
+  pending_files.erase(found);
+}
+
+static void FlushPendingFiles(BareosDb* t_db)
+{
+  while (!pending_files.empty()) {
+    FlushPendingFile(t_db, pending_files.begin()->first);
+  }
+}
@@ -698,8 +698,10 @@ static int MatchSessid(BootStrapRecord* bsr,
  * When reading the Volume, the Volume Findex (rec->FileIndex) always
  *   are found in sequential order. Thus we can make optimizations.
  *
- *  ***FIXME*** optimizations
- * We could optimize by removing the recursion.
+ * The FileIndex chain is sorted by its start index, so the walk starts after
+ * the leading ranges that are already done and stops at the first range that
+ * starts behind rec->FileIndex.  For the usual sequential read this looks at
+ * one or two ranges per record, no matter how many ranges the bsr has.
  */
 static int MatchFindex(BootStrapRecord* bsr,
                        BsrFileIndex* findex,
@@ -707,18 +709,24 @@ static int MatchFindex(BootStrapRecord* bsr,
                        bool done)
 {
   if (!findex) { return 1; /* no specification matches all */ }
-  if (!findex->done) {
-    if (findex->findex <= rec->FileIndex && findex->findex2 >= rec->FileIndex) {
-      Dmsg3(dbglevel, "Match on findex=%d. bsrFIs=%d,%d\n", rec->FileIndex,
-            findex->findex, findex->findex2);
-      return 1;
+  if (bsr->FileIndexCursor) { findex = bsr->FileIndexCursor; }
+  while (findex->done && findex->next) { findex = findex->next; }
+  bsr->FileIndexCursor = findex;
+
+  for (; findex; findex = findex->next) {
+    if (!findex->done) {
+      if (rec->FileIndex < findex->findex) {
+        return 0; /* none of the following ranges can match or be done */
+      }
+      if (findex->findex2 >= rec->FileIndex) {
+        Dmsg3(dbglevel, "Match on findex=%d. bsrFIs=%d,%d\n", rec->FileIndex,
+              findex->findex, findex->findex2);
+        return 1;
+      }
+      findex->done = true;
     }
-    if (rec->FileIndex > findex->findex2) { findex->done = true; }
-  }
-  if (findex->next) {
-    return MatchFindex(bsr, findex->next, rec, findex->done && done);
   }
-  if (findex->done && done) {
+  if (done) {
     bsr->done = true;
     bsr->root->Reposition = true;
     Dmsg1(dbglevel, "bsr done from findex %d\n", rec->FileIndex);
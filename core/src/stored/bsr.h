@@ -161,7 +161,9 @@ struct BootStrapRecord {
   BsrJobid* JobId;
   BsrJob* job;
   BsrClient* client;
-  BsrFileIndex* FileIndex;
+  BsrFileIndex* FileIndex;       /* sorted by findex */
+  BsrFileIndex* FileIndexTail;   /* last one in FileIndex */
+  BsrFileIndex* FileIndexCursor; /* all before it are done */
   BsrJobType* JobType;
   BsrJoblevel* JobLevel;
   BsrStream* stream;
@@ -325,7 +325,7 @@ int main(int margc, char* margv[])
   LoadSdPlugins(me->plugin_directory, me->plugin_names);
 
   ReadCryptoCache(me->working_directory, "bareos-sd",
-                  GetFirstPortHostOrder(me->SDaddrs));
+                  GetFirstPortHostOrder(me->SDaddrs), true);
 
   g_dcr = new BTAPE_DCR;
   g_jcr = SetupJcr("btape", archive_name.data(), bsr, director, g_dcr, "",
@@ -0,0 +1,127 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * limits the memory of the block buffers of all jobs together
+ */
+
+#include "include/bareos.h"
+#include "include/jcr.h"
+#include "stored/buffer_budget.h"
+#include "stored/stored_jcr_impl.h"
+#include "lib/edit.h"
+#include "lib/metrics.h"
+#include "lib/status_packet.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+namespace storagedaemon {
+
+namespace {
+
+metrics::gauge buffer_bytes{"bareos_sd_job_buffer_bytes",
+                            "Memory of the block buffers of all jobs"};
+metrics::counter buffer_waits{
+    "bareos_sd_job_buffer_waits",
+    "Times a job waited for the Maximum Job Buffer Memory"};
+
+std::mutex budget_mutex;
+std::condition_variable budget_released;
+uint64_t budget = 0; /**< 0 is unlimited */
+uint64_t used = 0;
+uint32_t waiting = 0;
+
+}  // namespace
+
+void ConfigureBufferBudget(uint64_t bytes)
+{
+  std::unique_lock lock(budget_mutex);
+  budget = bytes;
+  lock.unlock();
+  budget_released.notify_all();
+}
+
+bool ChargeJobBuffers(JobControlRecord* jcr, uint64_t bytes, bool wait)
+{
+  auto over_budget = [bytes] {
+    return budget && used > 0 && used + bytes > budget;
+  };
+
+  std::unique_lock lock(budget_mutex);
+  if (wait && jcr->sd_impl->buffer_bytes == 0 && over_budget()) {
+    lock.unlock();
+    char ed1[50];
+    Jmsg(jcr, M_INFO, 0,
+         T_("Waiting for %s bytes of the Maximum Job Buffer Memory.\n"),
+         edit_uint64_with_suffix(bytes, ed1));
+    buffer_waits.Add();
+
+    lock.lock();
+    waiting++;
+    while (over_budget()) {
+      if (jcr->IsJobCanceled()) {
+        waiting--;
+        return false;
+      }
+      budget_released.wait_for(lock, std::chrono::seconds(1));
+    }
+    waiting--;
+  }
+  jcr->sd_impl->buffer_bytes += bytes;
+  used += bytes;
+  buffer_bytes.Add(bytes);
+  return true;
+}
+
+void ReleaseJobBuffers(JobControlRecord* jcr, uint64_t bytes)
+{
+  std::unique_lock lock(budget_mutex);
+  jcr->sd_impl->buffer_bytes -= bytes;
+  used -= bytes;
+  buffer_bytes.Sub(bytes);
+  lock.unlock();
+  budget_released.notify_all();
+}
+
+uint64_t JobBufferBytes(JobControlRecord* jcr)
+{
+  std::unique_lock lock(budget_mutex);
+  return jcr->sd_impl->buffer_bytes;
+}
+
+void ListBufferBudget(StatusPacket* sp)
+{
+  char ed1[50], ed2[50];
+  PoolMem msg(PM_MESSAGE);
+
+  std::unique_lock lock(budget_mutex);
+  if (!budget || sp->api) { return; }
+  int len = Mmsg(msg,
+                 T_("Job buffer memory: %s of %s bytes used, %u jobs "
+                    "waiting.\n"),
+                 edit_uint64_with_suffix(used, ed1),
+                 edit_uint64_with_suffix(budget, ed2), waiting);
+  sp->send(msg, len);
+}
+
+} /* namespace storagedaemon */
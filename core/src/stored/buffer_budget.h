@@ -0,0 +1,53 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * limits the memory of the block buffers of all jobs together
+ */
+#ifndef BAREOS_STORED_BUFFER_BUDGET_H_
+#define BAREOS_STORED_BUFFER_BUDGET_H_
+
+#include <cstdint>
+
+class JobControlRecord;
+class StatusPacket;
+
+namespace storagedaemon {
+
+/* The block buffers of its device control records are most of the memory of
+ * a job.  A reservation only picks the device, the buffers are allocated
+ * when the job acquires the device.  With a Maximum Job Buffer Memory, a job
+ * that has no buffers yet waits there until the other jobs leave enough of
+ * the budget.  Jobs that already have buffers always get more, so that jobs
+ * reading and writing at the same time do not wait for each other. */
+void ConfigureBufferBudget(uint64_t bytes);
+
+/* false when the job got canceled while it waited for the budget, jobs that
+ * must not wait exceed it instead */
+bool ChargeJobBuffers(JobControlRecord* jcr, uint64_t bytes, bool wait);
+void ReleaseJobBuffers(JobControlRecord* jcr, uint64_t bytes);
+
+uint64_t JobBufferBytes(JobControlRecord* jcr);
+void ListBufferBudget(StatusPacket* sp);
+
+} /* namespace storagedaemon */
+
+#endif  // BAREOS_STORED_BUFFER_BUDGET_H_
@@ -0,0 +1,136 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * pins the job threads using a device to the cpus near it
+ */
+
+#include "include/bareos.h"
+#include "stored/stored.h"
+#include "stored/cpu_affinity.h"
+#include "stored/device_control_record.h"
+#include "stored/stored_jcr_impl.h"
+#include "lib/berrno.h"
+
+#if defined(HAVE_LINUX_OS)
+#  include <sched.h>
+#endif
+
+namespace storagedaemon {
+
+bool ParseCpuList(const char* list, std::vector<int>& cpus, std::string& error)
+{
+  cpus.clear();
+  const char* p = list;
+  while (*p) {
+    char* end;
+    long first = strtol(p, &end, 10);
+    long last = first;
+    if (end == p || first < 0) {
+      error = std::string{"Invalid cpu list \""} + list + "\"";
+      return false;
+    }
+    p = end;
+    if (*p == '-') {
+      last = strtol(p + 1, &end, 10);
+      if (end == p + 1 || last < first) {
+        error = std::string{"Invalid cpu range in \""} + list + "\"";
+        return false;
+      }
+      p = end;
+    }
+#if defined(HAVE_LINUX_OS)
+    if (last >= CPU_SETSIZE) {
+      error = std::string{"Cpu number too big in \""} + list + "\"";
+      return false;
+    }
+#endif
+    for (long cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(static_cast<int>(cpu));
+    }
+    if (*p == ',') {
+      ++p;
+    } else if (*p) {
+      error = std::string{"Invalid cpu list \""} + list + "\"";
+      return false;
+    }
+  }
+  if (cpus.empty()) {
+    error = "Empty cpu list";
+    return false;
+  }
+  return true;
+}
+
+void PinJobThread(DeviceControlRecord* dcr)
+{
+  JobControlRecord* jcr = dcr->jcr;
+  const char* list = dcr->device_resource->cpu_affinity;
+  if (!list || !jcr || !jcr->sd_impl || jcr->sd_impl->pinned_dcr) { return; }
+
+#if defined(HAVE_LINUX_OS)
+  std::vector<int> cpus;
+  std::string error;
+  if (!ParseCpuList(list, cpus, error)) { return; }
+
+  pthread_t thread = pthread_self();
+  cpu_set_t old_set, new_set;
+  CPU_ZERO(&new_set);
+  for (int cpu : cpus) { CPU_SET(cpu, &new_set); }
+  if (pthread_getaffinity_np(thread, sizeof(old_set), &old_set) != 0) {
+    return;
+  }
+  if (int status = pthread_setaffinity_np(thread, sizeof(new_set), &new_set);
+      status != 0) {
+    BErrNo be;
+    Jmsg(jcr, M_WARNING, 0, T_("Cannot run on the cpus %s of %s: ERR=%s\n"),
+         list, dcr->dev->print_name(), be.bstrerror(status));
+    return;
+  }
+
+  auto& unpinned = jcr->sd_impl->unpinned_cpus;
+  unpinned.clear();
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &old_set)) { unpinned.push_back(cpu); }
+  }
+  jcr->sd_impl->pinned_thread = thread;
+  jcr->sd_impl->pinned_dcr = dcr;
+  Dmsg2(100, "Job thread runs on cpus %s of %s\n", list,
+        dcr->dev->print_name());
+#endif
+}
+
+void UnpinJobThread(DeviceControlRecord* dcr)
+{
+  JobControlRecord* jcr = dcr->jcr;
+  if (!jcr || !jcr->sd_impl || jcr->sd_impl->pinned_dcr != dcr) { return; }
+
+#if defined(HAVE_LINUX_OS)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : jcr->sd_impl->unpinned_cpus) { CPU_SET(cpu, &set); }
+  pthread_setaffinity_np(jcr->sd_impl->pinned_thread, sizeof(set), &set);
+#endif
+  jcr->sd_impl->unpinned_cpus.clear();
+  jcr->sd_impl->pinned_dcr = nullptr;
+}
+
+} /* namespace storagedaemon */
@@ -0,0 +1,48 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * pins the job threads using a device to the cpus near it
+ */
+#ifndef BAREOS_STORED_CPU_AFFINITY_H_
+#define BAREOS_STORED_CPU_AFFINITY_H_
+
+#include <string>
+#include <vector>
+
+namespace storagedaemon {
+
+class DeviceControlRecord;
+
+// cpus listed like "0-7,16-23", as by the Cpu Affinity of a device
+bool ParseCpuList(const char* list, std::vector<int>& cpus, std::string& error);
+
+/* A job that acquires a device with a Cpu Affinity runs its thread on these
+ * cpus until it releases the device again.  Threads started by the job
+ * after that, like the one receiving from the file daemon, inherit them, and
+ * the block buffers allocated on acquire come from the numa node of these
+ * cpus.  A job keeps the affinity of the first device it acquires. */
+void PinJobThread(DeviceControlRecord* dcr);
+void UnpinJobThread(DeviceControlRecord* dcr);
+
+} /* namespace storagedaemon */
+
+#endif  // BAREOS_STORED_CPU_AFFINITY_H_
@@ -546,6 +546,10 @@ uint32_t crc32_16bytes_prefetch(const void* data, size_t length, uint32_t previo
 /// compute CRC32 using the fastest algorithm for large datasets on modern CPUs
 uint32_t crc32_fast(const void* data, size_t length, uint32_t previousCrc32)
 {
+  static const bool use_hardware = crc32_hardware_supported();
+  if (use_hardware)
+    return crc32_hardware(data, length, previousCrc32);
+
 #ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_16
   return crc32_16bytes (data, length, previousCrc32);
 #elif defined(CRC32_USE_LOOKUP_TABLE_SLICING_BY_8)
@@ -64,3 +64,10 @@ uint32_t crc32_16bytes (const void* data, size_t length, uint32_t previousCrc32
 /// compute CRC32 (Slicing-by-16 algorithm, prefetch upcoming data blocks)
 uint32_t crc32_16bytes_prefetch(const void* data, size_t length, uint32_t previousCrc32 = 0, size_t prefetchAhead = 256);
 #endif
+
+/// true if the running cpu can compute CRC32 in hardware
+/// (PCLMULQDQ on x86-64, CRC32 instructions on aarch64)
+bool     crc32_hardware_supported();
+/// compute CRC32 with the help of the cpu, falls back to crc32_16bytes
+/// if crc32_hardware_supported() is false
+uint32_t crc32_hardware(const void* data, size_t length, uint32_t previousCrc32 = 0);
@@ -0,0 +1,228 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * hardware accelerated crc32 (same polynomial as crc32.cc)
+ */
+
+#include "crc32.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#  define CRC32_X86_PCLMUL
+#  include <immintrin.h>
+#  if defined(_MSC_VER)
+#    include <intrin.h>
+#  endif
+#elif defined(__aarch64__) && defined(__BYTE_ORDER__) \
+    && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#  define CRC32_ARMV8
+#  include <arm_acle.h>
+#  if defined(__linux__)
+#    include <sys/auxv.h>
+#    include <asm/hwcap.h>
+#  endif
+#endif
+
+#if defined(_MSC_VER)
+#  define CRC32_TARGET(features)
+#elif defined(__clang__) && defined(CRC32_ARMV8)
+#  define CRC32_TARGET(features) __attribute__((target("crc")))
+#elif defined(CRC32_ARMV8)
+#  define CRC32_TARGET(features) __attribute__((target("+crc")))
+#else
+#  define CRC32_TARGET(features) __attribute__((target(features)))
+#endif
+
+namespace {
+
+#if defined(CRC32_X86_PCLMUL)
+inline __m128i load(const uint8_t* p)
+{
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+CRC32_TARGET("pclmul")
+inline __m128i fold(__m128i x, __m128i k, __m128i data)
+{
+  __m128i lo = _mm_clmulepi64_si128(x, k, 0x00);
+  __m128i hi = _mm_clmulepi64_si128(x, k, 0x11);
+  return _mm_xor_si128(_mm_xor_si128(hi, lo), data);
+}
+
+/* Folding with carry-less multiplication, see Intel's "Fast CRC Computation
+ * for Generic Polynomials Using PCLMULQDQ Instruction".  The constants are
+ * the bit-reflected ones for the zlib polynomial given at the end of the
+ * paper.  Works on the raw (not inverted) crc; length has to be a multiple
+ * of 16 and at least 64. */
+CRC32_TARGET("pclmul,sse4.1")
+uint32_t crc32_pclmul_fold(const uint8_t* buf, size_t len, uint32_t crc)
+{
+  alignas(16) static const uint64_t k1k2[] = {0x0154442bd4, 0x01c6e41596};
+  alignas(16) static const uint64_t k3k4[] = {0x01751997d0, 0x00ccaa009e};
+  alignas(16) static const uint64_t k5k0[] = {0x0163cd6124, 0x0000000000};
+  alignas(16) static const uint64_t poly[] = {0x01db710641, 0x01f7011641};
+
+  __m128i x1 = load(buf + 0x00);
+  __m128i x2 = load(buf + 0x10);
+  __m128i x3 = load(buf + 0x20);
+  __m128i x4 = load(buf + 0x30);
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(crc)));
+  buf += 64;
+  len -= 64;
+
+  // fold four 128 bit lanes in parallel
+  __m128i k = _mm_load_si128(reinterpret_cast<const __m128i*>(k1k2));
+  while (len >= 64) {
+    x1 = fold(x1, k, load(buf + 0x00));
+    x2 = fold(x2, k, load(buf + 0x10));
+    x3 = fold(x3, k, load(buf + 0x20));
+    x4 = fold(x4, k, load(buf + 0x30));
+    buf += 64;
+    len -= 64;
+  }
+
+  // fold the lanes into a single one
+  k = _mm_load_si128(reinterpret_cast<const __m128i*>(k3k4));
+  x1 = fold(x1, k, x2);
+  x1 = fold(x1, k, x3);
+  x1 = fold(x1, k, x4);
+
+  while (len >= 16) {
+    x1 = fold(x1, k, load(buf));
+    buf += 16;
+    len -= 16;
+  }
+
+  // fold 128 to 64 bits
+  __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+  x2 = _mm_clmulepi64_si128(x1, k, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+  k = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(k5k0));
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), k, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  // barrett reduction to 32 bits
+  k = _mm_load_si128(reinterpret_cast<const __m128i*>(poly));
+  x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), k, 0x10);
+  x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask), k, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+}
+
+bool cpu_has_crc32()
+{
+#  if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 1);
+  constexpr int kPclmul = 1 << 1, kSse41 = 1 << 19;
+  return (info[2] & kPclmul) && (info[2] & kSse41);
+#  else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+#  endif
+}
+
+#elif defined(CRC32_ARMV8)
+// the armv8 crc32 instructions use the zlib polynomial; raw (not inverted) crc
+CRC32_TARGET("crc")
+uint32_t crc32_armv8(const uint8_t* buf, size_t len, uint32_t crc)
+{
+  while (len > 0 && (reinterpret_cast<uintptr_t>(buf) & 7) != 0) {
+    crc = __crc32b(crc, *buf++);
+    --len;
+  }
+  while (len >= 32) {
+    uint64_t v[4];
+    std::memcpy(v, buf, sizeof(v));
+    crc = __crc32d(crc, v[0]);
+    crc = __crc32d(crc, v[1]);
+    crc = __crc32d(crc, v[2]);
+    crc = __crc32d(crc, v[3]);
+    buf += 32;
+    len -= 32;
+  }
+  while (len >= 8) {
+    uint64_t v;
+    std::memcpy(&v, buf, sizeof(v));
+    crc = __crc32d(crc, v);
+    buf += 8;
+    len -= 8;
+  }
+  while (len > 0) {
+    crc = __crc32b(crc, *buf++);
+    --len;
+  }
+  return crc;
+}
+
+bool cpu_has_crc32()
+{
+#  if defined(__ARM_FEATURE_CRC32) || defined(__APPLE__)
+  return true;
+#  elif defined(__linux__) && defined(HWCAP_CRC32)
+  return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#  else
+  return false;
+#  endif
+}
+#endif
+
+}  // namespace
+
+bool crc32_hardware_supported()
+{
+#if defined(CRC32_X86_PCLMUL) || defined(CRC32_ARMV8)
+  static const bool supported = cpu_has_crc32();
+  return supported;
+#else
+  return false;
+#endif
+}
+
+uint32_t crc32_hardware(const void* data, size_t length, uint32_t previousCrc32)
+{
+  if (!crc32_hardware_supported()) {
+    return crc32_16bytes(data, length, previousCrc32);
+  }
+
+  const uint8_t* current = static_cast<const uint8_t*>(data);
+  uint32_t crc = ~previousCrc32;
+
+#if defined(CRC32_X86_PCLMUL)
+  if (length >= 64) {
+    size_t chunk = length & ~size_t{15};
+    crc = crc32_pclmul_fold(current, chunk, crc);
+    current += chunk;
+    length -= chunk;
+  }
+  // the (less than 16 byte) tail is done by the slicing-by-16 code
+  return crc32_16bytes(current, length, ~crc);
+#elif defined(CRC32_ARMV8)
+  return ~crc32_armv8(current, length, crc);
+#else
+  return crc32_16bytes(current, length, ~crc);
+#endif
+}
@@ -73,6 +73,7 @@
 #include "include/fcntl_def.h"
 #include "include/bareos.h"
 #include "stored/block.h"
+#include "stored/block_index.h"
 #include "stored/stored.h"
 #include "stored/autochanger.h"
 #include "stored/bsr.h"
@@ -82,6 +83,7 @@
 #include "lib/btimers.h"
 #include "include/jcr.h"
 #include "lib/berrno.h"
+#include "lib/lock_profile.h"
 
 #ifndef O_NONBLOCK
 #  define O_NONBLOCK 0
@@ -251,6 +253,8 @@ static void InitiateDevice(JobControlRecord* jcr, Device* dev)
           be.bstrerror(errstat));
     Jmsg0(jcr, M_ERROR_TERM, 0, dev->errmsg);
   }
+  lock_profile::NameLock(&dev->mutex_,
+                         std::string{"device "} + dev->print_name());
 
   if ((errstat = pthread_cond_init(&dev->wait, NULL)) != 0) {
     BErrNo be;
@@ -909,6 +913,7 @@ bool Device::close(DeviceControlRecord* dcr)
     retval = false;
   }
 
+  BlockIndexClose(this);
   unmount(dcr, 1); /* do unmount if required */
 
   // Clean up device packet so it can be reused.
@@ -1112,6 +1117,7 @@ const char* Device::name() const { return device_resource->resource_name_; }
 Device::~Device()
 {
   Dmsg1(900, "term dev: %s\n", print_name());
+  lock_profile::ForgetLock(&mutex_);
 
   if (archive_device_string) {
     FreeMemory(archive_device_string);
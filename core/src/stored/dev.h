@@ -227,6 +227,8 @@ class Device {
   int dev_prev_blocked{};     /**< Previous blocked state */
   int num_waiting{};          /**< Number of threads waiting */
   int num_writers{};          /**< Number of writing threads */
+  uint64_t lock_acquisitions{}; /**< Times Lock() got mutex_ */
+  uint64_t lock_contentions{};  /**< Of them, times it had to wait for it */
   char capabilities[CAP_BYTES]{}; /**< Capabilities mask */
   char state[ST_BYTES]{};     /**< State mask */
   int dev_errno{};            /**< Our own errno */
@@ -259,6 +261,7 @@ class Device {
   uint64_t volume_capacity{}; /**< Advisory capacity */
   uint64_t max_spool_size{};  /**< Maximum spool file size */
   uint64_t spool_size{};      /**< Current spool size for this device */
+  uint64_t memory_spool_size{}; /**< Part of spool_size held in memory */
   uint32_t max_rewind_wait{}; /**< Max secs to allow for rewind */
   uint32_t max_open_wait{};   /**< Max secs to allow for open */
   uint32_t max_open_vols{};   /**< Max simultaneous open volumes */
@@ -268,6 +271,8 @@ class Device {
   VolumeReservationItem* vol{};        /**< Pointer to Volume reservation item */
   btimer_t* tid{};            /**< Timer id */
   int fd{-1};                 /**< File descriptor */
+  int block_index_fd{-1};     /**< Block index of the volume being written */
+  uint64_t block_index_end{}; /**< Address behind the last indexed block */
 
   VolumeCatalogInfo VolCatInfo;       /**< Volume Catalog Information */
   Volume_Label VolHdr;                /**< Actual volume label */
@@ -283,6 +288,7 @@ class Device {
   int wait_sec{};
   int rem_wait_sec{};
   int num_wait{};
+  utime_t last_released{}; /**< When the last job released the device */
 
   btime_t last_timer{}; /**< Used by read/write/seek to get stats (usec) */
   btime_t last_tick{};  /**< Contains last read/write time (usec) */
@@ -456,6 +462,12 @@ public:
   virtual bool DeviceStatus(DeviceStatusInformation*) { return false; }
   virtual SeekMode GetSeekMode() const = 0;
   virtual bool CanReadConcurrently() const { return false; }
+  /* Called after a block of len bytes was written, returns the size the next
+   * block should have (0 keeps it). */
+  virtual uint32_t NextWriteBlockSize(DeviceControlRecord*, uint32_t /* len */)
+  {
+    return 0;
+  }
 
   // Low level operations
   virtual int d_ioctl(int fd, ioctl_req_t request, char* mt_com = NULL) = 0;
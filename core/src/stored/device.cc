@@ -48,16 +48,22 @@
  */
 
 #include "include/bareos.h" /* pull in global headers */
+#include "stored/block_index.h"
 #include "stored/bsr.h"
 #include "stored/stored.h" /* pull in Storage Daemon headers */
 #include "stored/device.h"
 #include "stored/device_control_record.h"
+#include "stored/acquire.h"
+#include "stored/sd_device_control_record.h"
+#include "stored/sd_plugins.h"
 #include "stored/stored_jcr_impl.h"
 #include "stored/match_bsr.h"
 #include "lib/edit.h"
 #include "include/jcr.h"
 #include "lib/berrno.h"
 
+#include <mutex>
+
 namespace storagedaemon {
 
 /**
@@ -303,7 +309,13 @@ BootStrapRecord* PositionDeviceToFirstFile(JobControlRecord* jcr,
   if (jcr->sd_impl->read_session.bsr) {
     jcr->sd_impl->read_session.bsr->Reposition = true;
     bsr = find_next_bsr(jcr->sd_impl->read_session.bsr, dev);
-    if (GetBsrStartAddr(bsr, &file, &block) > 0) {
+    uint64_t bsr_addr = GetBsrStartAddr(bsr, &file, &block);
+    uint64_t addr = BlockIndexStartAddr(dcr, bsr, bsr_addr);
+    if (addr != bsr_addr) {
+      file = addr >> 32;
+      block = static_cast<uint32_t>(addr);
+    }
+    if (addr > 0) {
       Jmsg(jcr, M_INFO, 0,
            T_("Forward spacing Volume \"%s\" to file:block %u:%u.\n"),
            dev->VolHdr.VolumeName, file, block);
@@ -348,6 +360,12 @@ bool TryDeviceRepositioning(JobControlRecord* jcr,
     /* TODO: use dev->file_addr ? */
     uint64_t dev_addr = (((uint64_t)dev->file) << 32) | dev->block_num;
     uint64_t bsr_addr = GetBsrStartAddr(bsr, &file, &block);
+    uint64_t addr = BlockIndexStartAddr(dcr, bsr, bsr_addr);
+    if (addr != bsr_addr) {
+      bsr_addr = addr;
+      file = addr >> 32;
+      block = static_cast<uint32_t>(addr);
+    }
 
     if (dev_addr > bsr_addr) { return false; }
     Dmsg4(500, "Try_Reposition from (file:block) %u:%u to %u:%u\n", dev->file,
@@ -358,4 +376,33 @@ bool TryDeviceRepositioning(JobControlRecord* jcr,
   return false;
 }
 
+/**
+ * Devices without work to do at startup only get created when a job or a
+ * command first needs them.  The creation is serialized, so concurrent
+ * reservations of the same device end up with the same Device.
+ *
+ * Returns: the device, nullptr if it cannot be set up
+ */
+Device* InitDevice(JobControlRecord* jcr, DeviceResource* device_resource)
+{
+  static std::mutex init_mutex;
+  std::lock_guard lock(init_mutex);
+
+  if (device_resource->dev) { return device_resource->dev; }
+
+  Dmsg1(90, "calling FactoryCreateDevice %s\n",
+        device_resource->archive_device_string);
+  Device* dev = FactoryCreateDevice(jcr, device_resource);
+  device_resource->dev = dev;
+  if (!dev) { return nullptr; }
+
+  if (jcr) {
+    DeviceControlRecord* dcr = new StorageDaemonDeviceControlRecord;
+    SetupNewDcrDevice(jcr, dcr, dev, nullptr, false);
+    GeneratePluginEvent(jcr, bSdEventDeviceInit, dcr);
+    FreeDeviceControlRecord(dcr);
+  }
+  return dev;
+}
+
 } /* namespace storagedaemon */
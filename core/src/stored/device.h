@@ -24,6 +24,7 @@
 
 namespace storagedaemon {
 
+Device* InitDevice(JobControlRecord* jcr, DeviceResource* device_resource);
 bool FirstOpenDevice(DeviceControlRecord* dcr);
 bool FixupDeviceBlockWriteError(DeviceControlRecord* dcr, int retries = 4);
 void SetStartVolPosition(DeviceControlRecord* dcr);
@@ -42,6 +42,11 @@
 #include "stored/io_direction.h"
 #include "stored/volume_catalog_info.h"
 
+#include <deque>
+#include <future>
+
+class BareosSocket;
+
 namespace storagedaemon {
 
 #define CHECK_BLOCK_NUMBERS true
@@ -82,12 +87,14 @@ class DeviceControlRecord {
   DeviceResource* device_resource{};    /**< Pointer to device resource */
   DeviceBlock* block{};            /**< Pointer to current block */
   DeviceRecord* rec{};             /**< Pointer to record being processed */
+  uint64_t buffer_bytes{};         /**< Of block, charged to the jcr */
   DeviceRecord* before_rec{};      /**< Pointer to record before translation */
   DeviceRecord* after_rec{};       /**< Pointer to record after translation */
   pthread_t tid{};                 /**< Thread running this dcr */
   bool spool_data{};         /**< Set to spool data */
   int spool_fd{};            /**< Fd if spooling */
   bool spooling{};           /**< Set when actually spooling */
+  bool memory_spool{};       /**< Set when spooling to memory */
   bool despooling{};         /**< Set when despooling */
   bool despool_wait{};       /**< Waiting for despooling */
   bool NewVol{};             /**< Set if new Volume mounted */
@@ -97,6 +104,7 @@ class DeviceControlRecord {
   bool any_volume{};         /**< Any OK for dir_find_next... */
   bool attached_to_dev{};    /**< Set when attached to dev */
   bool keep_dcr{};           /**< Do not free dcr in release_dcr */
+  bool shared_read{};        /**< Device may be read for a group, see shared_read.h */
   IODirection autodeflate{IODirection::NONE};
   IODirection autoinflate{IODirection::NONE};
   uint32_t VolFirstIndex{};        /**< First file index this Volume */
@@ -120,6 +128,15 @@ class DeviceControlRecord {
   int Stripe{};                       /**< RAIT stripe */
   VolumeCatalogInfo VolCatInfo;       /**< Catalog info for desired volume */
 
+  // A record a plugin translates on another thread, see DeferRecord()
+  struct DeferredRecord {
+    std::future<DeviceRecord*> record;
+    uint32_t size; /**< Of the record before the translation */
+  };
+  std::deque<DeferredRecord> deferred_records; /**< In write order */
+  uint64_t deferred_bytes{};     /**< Sum of their sizes */
+  uint64_t max_deferred_bytes{}; /**< Waits for the oldest one above this */
+
   DeviceControlRecord();
   virtual ~DeviceControlRecord() = default;
 
@@ -155,7 +172,17 @@ class DeviceControlRecord {
     return true;
   }
   virtual bool DirCreateJobmediaRecord(bool /* zero */) { return true; }
+  /* Like DirCreateJobmediaRecord(false), but the record may be sent later
+   * together with others. */
+  virtual bool DirQueueJobmediaRecord()
+  {
+    return DirCreateJobmediaRecord(false);
+  }
   virtual bool DirUpdateFileAttributes(DeviceRecord*) { return true; }
+  virtual bool DirUpdateFileAttributeBatch(const DeviceRecord*, std::size_t)
+  {
+    return true;
+  }
   virtual bool DirAskSysopToMountVolume(int mode);
   virtual bool DirAskSysopToCreateAppendableVolume() { return true; }
   virtual bool DirGetVolumeInfo(enum get_vol_info_rw writing);
@@ -169,6 +196,21 @@ class DeviceControlRecord {
 
   // Methods in record.c
   bool WriteRecord();
+  bool ReceiveRecord(BareosSocket* sock);
+  bool WriteDeferredRecords(bool all = false);
+  void DiscardDeferredRecords();
+
+  /* Instead of setting after_rec a write translation plugin can hand in the
+   * future result of a translation, e.g. one that runs on a worker thread.
+   * WriteRecord() writes the translated records to the block in the order
+   * they were handed in, and all of them before the next record that did
+   * not get deferred.  The plugin has to copy the data of before_rec, it
+   * is reused once WriteRecord() returns. */
+  void DeferRecord(std::future<DeviceRecord*> record, uint32_t size)
+  {
+    deferred_records.push_back({std::move(record), size});
+    deferred_bytes += size;
+  }
 
   // Methods in reserve.c
   void ClearReserved();
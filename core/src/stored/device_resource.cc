@@ -59,6 +59,10 @@ DeviceResource::DeviceResource(const DeviceResource& other)
   if (other.spool_directory) {
     spool_directory = strdup(other.spool_directory);
   }
+  if (other.block_index_directory) {
+    block_index_directory = strdup(other.block_index_directory);
+  }
+  if (other.cpu_affinity) { cpu_affinity = strdup(other.cpu_affinity); }
   device_type = other.device_type;
   label_type = other.label_type;
   access_mode = other.access_mode;
@@ -83,6 +87,7 @@ DeviceResource::DeviceResource(const DeviceResource& other)
   max_concurrent_jobs = other.max_concurrent_jobs;
   autodeflate_algorithm = other.autodeflate_algorithm;
   autodeflate_level = other.autodeflate_level;
+  autodeflate_buffer_size = other.autodeflate_buffer_size;
   autodeflate = other.autodeflate;
   autoinflate = other.autoinflate;
   vol_poll_interval = other.vol_poll_interval;
@@ -90,6 +95,13 @@ DeviceResource::DeviceResource(const DeviceResource& other)
   volume_capacity = other.volume_capacity;
   max_spool_size = other.max_spool_size;
   max_job_spool_size = other.max_job_spool_size;
+  despool_read_ahead = other.despool_read_ahead;
+  memory_spool_size = other.memory_spool_size;
+  spool_while_despooling = other.spool_while_despooling;
+  adaptive_block_size = other.adaptive_block_size;
+  volume_per_job = other.volume_per_job;
+  direct_io = other.direct_io;
+  preallocation_size = other.preallocation_size;
 
   if (other.mount_point) { mount_point = strdup(other.mount_point); }
   if (other.mount_command) { mount_command = strdup(other.mount_command); }
@@ -115,6 +127,7 @@ DeviceResource& DeviceResource::operator=(const DeviceResource& rhs)
   changer_command = rhs.changer_command;
   alert_command = rhs.alert_command;
   spool_directory = rhs.spool_directory;
+  block_index_directory = rhs.block_index_directory;
   device_type = rhs.device_type;
   label_type = rhs.label_type;
   access_mode = rhs.access_mode;
@@ -139,6 +152,7 @@ DeviceResource& DeviceResource::operator=(const DeviceResource& rhs)
   max_concurrent_jobs = rhs.max_concurrent_jobs;
   autodeflate_algorithm = rhs.autodeflate_algorithm;
   autodeflate_level = rhs.autodeflate_level;
+  autodeflate_buffer_size = rhs.autodeflate_buffer_size;
   autodeflate = rhs.autodeflate;
   autoinflate = rhs.autoinflate;
   vol_poll_interval = rhs.vol_poll_interval;
@@ -146,6 +160,14 @@ DeviceResource& DeviceResource::operator=(const DeviceResource& rhs)
   volume_capacity = rhs.volume_capacity;
   max_spool_size = rhs.max_spool_size;
   max_job_spool_size = rhs.max_job_spool_size;
+  despool_read_ahead = rhs.despool_read_ahead;
+  memory_spool_size = rhs.memory_spool_size;
+  spool_while_despooling = rhs.spool_while_despooling;
+  adaptive_block_size = rhs.adaptive_block_size;
+  volume_per_job = rhs.volume_per_job;
+  direct_io = rhs.direct_io;
+  preallocation_size = rhs.preallocation_size;
+  cpu_affinity = rhs.cpu_affinity;
 
   mount_point = rhs.mount_point;
   mount_command = rhs.mount_command;
@@ -200,6 +222,13 @@ void DeviceResource::MultipliedDeviceRestoreNumberedName()
   temporarily_swapped_numbered_name = nullptr;
 }
 
+bool DeviceResource::IsNamed(const char* name) const
+{
+  if (bstrcmp(resource_name_, name)) { return true; }
+  return volume_per_job && multiplied_device_resource
+         && multiplied_device_resource_base_name == name;
+}
+
 void DeviceResource::CreateAndAssignSerialNumber(uint16_t number)
 {
   if (multiplied_device_resource_base_name.empty()) {
@@ -43,6 +43,7 @@ class DeviceResource : public BareosResource {
   char* changer_command;       /**< Changer command  -- external program */
   char* alert_command;         /**< Alert command -- external program */
   char* spool_directory;       /**< Spool file directory */
+  char* block_index_directory{nullptr}; /**< Directory of the block indexes */
   std::string device_type{DeviceType::B_UNKNOWN_DEV};
   uint32_t label_type{B_BAREOS_LABEL};
   IODirection access_mode{
@@ -69,6 +70,7 @@ class DeviceResource : public BareosResource {
   uint32_t max_concurrent_jobs{0};   /**< Maximum concurrent jobs this drive */
   uint32_t autodeflate_algorithm{0}; /**< Compression algorithm to use for
                                      compression */
+  uint32_t autodeflate_buffer_size{0}; /**< Compressed on shared threads */
   uint16_t autodeflate_level{6}; /**< Compression level to use for compression
                                  algorithm which uses levels */
   IODirection autodeflate{IODirection::NONE}; /**< auto deflation in this IO
@@ -81,6 +83,14 @@ class DeviceResource : public BareosResource {
   int64_t volume_capacity{0};        /**< Advisory capacity */
   int64_t max_spool_size{0};         /**< Max spool size for all jobs */
   int64_t max_job_spool_size{0};     /**< Max spool size for any single job */
+  uint32_t despool_read_ahead{0};    /**< Spooled blocks read ahead */
+  int64_t memory_spool_size{0};      /**< Tape jobs spool this much to memory */
+  bool spool_while_despooling{false}; /**< Keep receiving while despooling */
+  bool adaptive_block_size{false};    /**< Pick the fastest block size */
+  bool volume_per_job{false};         /**< One device (volume) per job */
+  bool direct_io{false};              /**< File volumes bypass the page cache */
+  uint64_t preallocation_size{0};     /**< Volumes grow in extents this big */
+  char* cpu_affinity{nullptr};        /**< Cpus of the jobs using it */
 
   char* mount_point;     /**< Mount point for require mount devices */
   char* mount_command;   /**< Mount command */
@@ -103,6 +113,8 @@ class DeviceResource : public BareosResource {
   void CreateAndAssignSerialNumber(uint16_t number);
   void MultipliedDeviceRestoreBaseName();
   void MultipliedDeviceRestoreNumberedName();
+  // Also true for the configured name of a device split by VolumePerJob
+  bool IsNamed(const char* name) const;
   bool Validate() override;
 
  private:
@@ -47,6 +47,7 @@
 #include "stored/autochanger.h"
 #include "stored/blocksize_boundaries.h"
 #include "stored/bsr.h"
+#include "stored/device.h"
 #include "stored/device_control_record.h"
 #include "stored/sd_device_control_record.h"
 #include "stored/fd_cmds.h"
@@ -67,6 +68,7 @@
 #include "lib/bnet.h"
 #include "lib/bsock.h"
 #include "lib/bsock_tcp.h"
+#include "lib/bsock_compression.h"
 #include "lib/edit.h"
 #include "lib/parse_bsr.h"
 #include "lib/parse_conf.h"
@@ -74,6 +76,7 @@
 #include "lib/util.h"
 #include "lib/watchdog.h"
 #include "lib/qualified_resource_name_type_converter.h"
+#include "lib/trace_ring.h"
 #include "include/jcr.h"
 
 #include <memory>
@@ -119,6 +122,7 @@ static char ERROR_bootstrap[] = "3904 Error bootstrap\n";
 static char OK_replicate[] = "3000 OK replicate\n";
 static char BADcmd[] = "3991 Bad %s command: %s\n";
 static char OKBandwidth[] = "2000 OK Bandwidth\n";
+static char OKcompress[] = "3000 OK compress\n";
 static char OKpassive[] = "2000 OK passive client\n";
 static char OKpluginoptions[] = "2000 OK plugin options\n";
 static char OKsecureerase[] = "2000 OK SDSecureEraseCmd %s \n";
@@ -131,6 +135,7 @@ static char setdevice_autoselect[] = "setdevice device=%127s autoselect=%d";
 static bool BootstrapCmd(JobControlRecord* jcr);
 static bool CancelCmd(JobControlRecord* cjcr);
 static bool ChangerCmd(JobControlRecord* jcr);
+static bool CompressCmd(JobControlRecord* jcr);
 static bool LabelCmd(JobControlRecord* jcr);
 static bool ListenCmd(JobControlRecord* jcr);
 static bool MountCmd(JobControlRecord* jcr);
@@ -185,6 +190,7 @@ static struct s_sd_dir_cmds cmds[] = {
     {"autochanger", ChangerCmd, false},
     {"bootstrap", BootstrapCmd, false},
     {"cancel", CancelCmd, false},
+    {"compress=", CompressCmd, false}, /**< Compress messages to the Director */
     {"finish", FinishCmd, false}, /**< End of backup */
     {"JobId=", job_cmd, false},   /**< Start Job */
     {"label", LabelCmd, false},   /**< Label a tape */
@@ -338,6 +344,28 @@ static bool SecureerasereqCmd(JobControlRecord* jcr)
       (me->secure_erase_cmdline ? me->secure_erase_cmdline : "*None*"));
 }
 
+/**
+ * Compress the messages on the Director connection from now on, in reply to
+ * the compression the job command offered.
+ */
+static bool CompressCmd(JobControlRecord* jcr)
+{
+  BareosSocket* dir = jcr->dir_bsock;
+  char algorithm[32];
+  const char* supported = MessageCompression::Algorithm();
+
+  if (sscanf(dir->msg, "compress=%31s", algorithm) != 1 || !supported
+      || !bstrcmp(algorithm, supported)) {
+    PmStrcpy(jcr->errmsg, dir->msg);
+    dir->fsend(T_("3991 Bad compress command: %s\n"), jcr->errmsg);
+    return false;
+  }
+
+  // the reply is the last uncompressed message
+  if (!dir->fsend(OKcompress)) { return false; }
+  return dir->EnableMessageCompression();
+}
+
 // Set bandwidth limit as requested by the Director
 static bool SetbandwidthCmd(JobControlRecord* jcr)
 {
@@ -394,6 +422,8 @@ static bool SetdebugCmd(JobControlRecord* jcr)
 
   debug_level = level;
   SetTrace(trace_flag);
+  // the trace rings are written out together with switching on the trace file
+  if (trace_flag) { DumpTraceRingsToTraceFile(); }
   if (scan == 3) {
     SetTimestamp(timestamp_flag);
     Dmsg4(50, "level=%d trace=%d timestamp=%d tracefilename=%s\n", level,
@@ -842,11 +872,8 @@ static DeviceControlRecord* FindDevice(JobControlRecord* jcr,
     DeviceResource* device_resource;
     foreach_res (device_resource, R_DEVICE) {
       // Find resource, and make sure we were able to open it
-      if (bstrcmp(device_resource->resource_name_, devname.c_str())) {
-        if (!device_resource->dev) {
-          device_resource->dev = FactoryCreateDevice(jcr, device_resource);
-        }
-        if (!device_resource->dev) {
+      if (device_resource->IsNamed(devname.c_str())) {
+        if (!InitDevice(jcr, device_resource)) {
           Jmsg(jcr, M_WARNING, 0,
                T_("\n"
                   "     Device \"%s\" requested by DIR could not be opened or "
@@ -870,10 +897,7 @@ static DeviceControlRecord* FindDevice(JobControlRecord* jcr,
           for (auto* device_resource : changer->device_resources) {
             Dmsg1(100, "Try changer device %s\n",
                   device_resource->resource_name_);
-            if (!device_resource->dev) {
-              device_resource->dev = FactoryCreateDevice(jcr, device_resource);
-            }
-            if (!device_resource->dev) {
+            if (!InitDevice(jcr, device_resource)) {
               Dmsg1(100, "Device %s could not be opened. Skipped\n",
                     devname.c_str());
               Jmsg(jcr, M_WARNING, 0,
@@ -1607,6 +1631,12 @@ static bool ReplicateCmd(JobControlRecord* jcr)
     return false;
   }
 
+  /* A backup mirrored to another storage daemon keeps the key the file
+   * daemon authenticates with. */
+  std::string own_auth_key;
+  if (!jcr->NoClientUsed() && jcr->sd_auth_key) {
+    own_auth_key = jcr->sd_auth_key;
+  }
   SetStorageAuthKeyAndTlsPolicy(jcr, sd_auth_key.c_str(), tls_policy);
 
   Dmsg3(110, "Open storage: %s:%d ssl=%d\n", stored_addr, stored_port,
@@ -1672,6 +1702,9 @@ static bool ReplicateCmd(JobControlRecord* jcr)
     Dmsg0(110, "Authenticated with SD.\n");
 
     jcr->sd_impl->remote_replicate = true;
+    if (!own_auth_key.empty()) {
+      SetStorageAuthKeyAndTlsPolicy(jcr, own_auth_key.data(), tls_policy);
+    }
 
     storage_daemon_socket.release(); /* jcr->store_bsock */
     return dir->fsend(OK_replicate);
@@ -87,6 +87,10 @@ static char NOT_opened[] = "3902 Error session not opened\n";
 static char OK_end[] = "3000 OK end\n";
 static char OK_close[] = "3000 OK close Status = %d\n";
 static char OK_open[] = "3000 OK open ticket = %d\n";
+/* Older File daemons still read the ticket from this and then just do not
+ * open any data connections. */
+static char OK_open_data_connections[]
+    = "3000 OK open ticket = %d data connections\n";
 static char ERROR_append[] = "3903 Error append data\n";
 
 /* Responses sent to the Director */
@@ -152,6 +156,76 @@ void* HandleFiledConnection(BareosSocket* fd, char* job_name)
   return NULL;
 }
 
+/**
+ * After receiving a connection, if it is an additional data connection of a
+ * File daemon job (see StorageDataConnections of the client), this routine
+ * is called.  The connection waits in the job until it appends its data.
+ */
+void* HandleFiledDataConnection(BareosSocket* fd, char* job_name, int index)
+{
+  JobControlRecord* jcr;
+
+  if (!(jcr = get_jcr_by_full_name(job_name))) {
+    Jmsg1(NULL, M_ERROR, 0,
+          T_("FD data connection failed: Job name not found: %s\n"),
+          job_name);
+    fd->close();
+    delete fd;
+    return NULL;
+  }
+
+  Dmsg2(50, "Found Job %s for data connection %d\n", job_name, index);
+
+  if (!jcr->authenticated || !jcr->file_bsock) {
+    Jmsg2(jcr, M_ERROR, 0,
+          T_("Data connection %d for Job %s before the job connected.\n"),
+          index, jcr->Job);
+    fd->close();
+    delete fd;
+    FreeJcr(jcr);
+    return NULL;
+  }
+
+  if (!AuthenticateFiledaemonDataConnection(jcr, fd)) {
+    Dmsg2(50, "Authentication of data connection %d failed Job %s\n", index,
+          jcr->Job);
+    fd->close();
+    delete fd;
+    FreeJcr(jcr);
+    return NULL;
+  }
+
+  jcr->sd_impl->data_connections.lock()->push_back(fd);
+  jcr->sd_impl->data_connection_wait.notify_all();
+  FreeJcr(jcr);
+
+  return NULL;
+}
+
+// Close the data connections nobody took care of.
+void FreeDataConnections(JobControlRecord* jcr)
+{
+  auto locked = jcr->sd_impl->data_connections.lock();
+  for (BareosSocket* sock : *locked) {
+    sock->close();
+    delete sock;
+  }
+  locked->clear();
+}
+
+/* The data connections authenticate before the FD sends "append data", but
+ * they might not be registered yet. */
+static bool WaitForDataConnections(JobControlRecord* jcr, int32_t count)
+{
+  auto timeout = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+  auto locked = jcr->sd_impl->data_connections.lock();
+  return locked.wait_until(
+      jcr->sd_impl->data_connection_wait, timeout,
+      [count](const std::vector<BareosSocket*>& connections) {
+        return connections.size() >= static_cast<std::size_t>(count);
+      });
+}
+
 /**
  * Run a File daemon Job -- File daemon already authorized
  * Director sends us this command.
@@ -251,11 +325,23 @@ void DoFdCommands(JobControlRecord* jcr)
 static bool AppendDataCmd(JobControlRecord* jcr)
 {
   BareosSocket* fd = jcr->file_bsock;
+  int32_t connections = 0;
 
   Dmsg1(120, "Append data: %s", fd->msg);
   if (jcr->sd_impl->session_opened) {
     Dmsg1(110, "<filed: %s", fd->msg);
     jcr->setJobType(JT_BACKUP);
+    if (sscanf(fd->msg, "append data %*d connections=%d", &connections) == 1
+        && connections > 0) {
+      if (!WaitForDataConnections(jcr, connections)) {
+        Mmsg(jcr->errmsg, T_("Only %d of %d data connections arrived.\n"),
+             static_cast<int>(jcr->sd_impl->data_connections.lock()->size()),
+             connections);
+        fd->fsend(ERROR_append);
+        return false;
+      }
+      jcr->sd_impl->expected_data_connections = connections;
+    }
     if (DoAppendData(jcr, fd, "FD")) {
       return true;
     } else {
@@ -298,7 +384,7 @@ static bool AppendOpenSession(JobControlRecord* jcr)
   jcr->sd_impl->session_opened = true;
 
   /* Send "Ticket" to File Daemon */
-  fd->fsend(OK_open, jcr->VolSessionId);
+  fd->fsend(OK_open_data_connections, jcr->VolSessionId);
   Dmsg1(110, ">filed: %s", fd->msg);
 
   return true;
@@ -24,6 +24,8 @@
 namespace storagedaemon {
 
 void* HandleFiledConnection(BareosSocket* fd, char* job_name);
+void* HandleFiledDataConnection(BareosSocket* fd, char* job_name, int index);
+void FreeDataConnections(JobControlRecord* jcr);
 void RunJob(JobControlRecord* jcr);
 void DoFdCommands(JobControlRecord* jcr);
 
@@ -0,0 +1,136 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * unload ahead: put back the tapes of autochanger drives that no job used for
+ * "Unload Idle Drives After", so that the next load does not have to wait
+ * for the unload
+ */
+
+#include "include/bareos.h"
+#include "stored/stored.h"
+#include "stored/stored_globals.h"
+#include "stored/acquire.h"
+#include "stored/autochanger.h"
+#include "stored/idle_unload.h"
+#include "stored/job.h"
+#include "stored/sd_device_control_record.h"
+#include "stored/sd_plugins.h"
+#include "stored/stored_jcr_impl.h"
+#include "lib/parse_conf.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace storagedaemon {
+
+namespace {
+constexpr std::chrono::seconds idle_check_interval{30};
+
+std::mutex idle_mutex;
+std::condition_variable idle_wakeup;
+std::thread idle_thread;
+bool idle_quit = false;
+
+void UnloadIdleDrives(JobControlRecord* jcr, AutochangerResource* changer)
+{
+  utime_t now = (utime_t)time(nullptr);
+
+  for (auto* device_resource : changer->device_resources) {
+    Device* dev = device_resource->dev;
+    if (!dev) { continue; }
+
+    dev->Lock();
+    if (dev->IsBusy() || dev->IsBlocked() || !dev->last_released
+        || now - dev->last_released < changer->unload_idle_drives_after
+        || !IsSlotNumberValid(dev->GetSlot())) {
+      dev->Unlock();
+      continue;
+    }
+
+    Dmsg2(100, "Unloading idle drive %s slot %hd\n", dev->print_name(),
+          dev->GetSlot());
+    DeviceControlRecord* dcr = new StorageDaemonDeviceControlRecord;
+    jcr->sd_impl->dcr = dcr;
+    SetupNewDcrDevice(jcr, dcr, dev, nullptr);
+    UnloadAutochanger(dcr, dev->GetSlot());
+    FreeDeviceControlRecord(dcr);
+    jcr->sd_impl->dcr = nullptr;
+
+    dev->last_released = 0;
+    dev->Unlock();
+  }
+}
+
+void UnloadIdleDrivesThread()
+{
+  JobControlRecord* jcr = NewStoredJcr();
+  NewPlugins(jcr); /* instantiate plugins */
+  jcr->setJobType(JT_SYSTEM);
+
+  std::unique_lock lock(idle_mutex);
+  while (!idle_wakeup.wait_for(lock, idle_check_interval,
+                               [] { return idle_quit; })) {
+    if (!init_done) { continue; }
+
+    lock.unlock();
+    AutochangerResource* changer;
+    foreach_res (changer, R_AUTOCHANGER) {
+      if (changer->unload_idle_drives_after) { UnloadIdleDrives(jcr, changer); }
+    }
+    lock.lock();
+  }
+  lock.unlock();
+
+  FreePlugins(jcr); /* release instantiated plugins */
+  FreeJcr(jcr);
+}
+}  // namespace
+
+void StartUnloadIdleDrivesThread()
+{
+  bool wanted = false;
+  AutochangerResource* changer;
+  foreach_res (changer, R_AUTOCHANGER) {
+    if (changer->unload_idle_drives_after) { wanted = true; }
+  }
+  if (!wanted) { return; }
+
+  std::unique_lock lock(idle_mutex);
+  if (idle_thread.joinable()) { return; }
+  idle_quit = false;
+  idle_thread = std::thread(UnloadIdleDrivesThread);
+}
+
+void StopUnloadIdleDrivesThread()
+{
+  {
+    std::unique_lock lock(idle_mutex);
+    if (!idle_thread.joinable()) { return; }
+    idle_quit = true;
+  }
+  idle_wakeup.notify_all();
+  idle_thread.join();
+}
+
+} /* namespace storagedaemon */
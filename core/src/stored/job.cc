@@ -34,8 +34,11 @@
 #include "stored/stored_jcr_impl.h"
 #include "stored/ndmp_tape.h"
 #include "stored/read_record.h"
+#include "stored/shared_read.h"
 #include "stored/stored_globals.h"
+#include "stored/write_scheduler.h"
 #include "lib/bsock.h"
+#include "lib/bsock_compression.h"
 #include "lib/edit.h"
 #include "lib/parse_bsr.h"
 #include "lib/parse_conf.h"
@@ -54,10 +57,12 @@ static char jobcmd[]
       "type=%d level=%d FileSet=%127s NoAttr=%d SpoolAttr=%d FileSetMD5=%127s "
       "SpoolData=%d PreferMountedVols=%d SpoolSize=%127s "
       "rerunning=%d VolSessionId=%d VolSessionTime=%d Quota=%llu "
-      "Protocol=%d BackupFormat=%127s\n";
+      "Protocol=%d BackupFormat=%127s AttrBatch=%d Priority=%d "
+      "ReadGroup=%127s ReadGroupSize=%u\n";
 
 /* Responses sent to Director daemon */
-static char OK_job[] = "3000 OK Job SDid=%u SDtime=%u Authorization=%s\n";
+static char OK_job[]
+    = "3000 OK Job SDid=%u SDtime=%u Authorization=%s%s%s\n";
 static char OK_nextrun[] = "3000 OK Job Authorization=%s\n";
 static char BAD_job[] = "3915 Bad Job command. stat=%d CMD: %s\n";
 static char Job_end[]
@@ -80,8 +85,11 @@ bool job_cmd(JobControlRecord* jcr)
   char spool_size[MAX_NAME_LENGTH];
   BareosSocket* dir = jcr->dir_bsock;
   PoolMem job_name, client_name, job, fileset_name, fileset_md5, backup_format;
+  PoolMem read_group;
+  uint32_t read_group_size = 0;
   int32_t JobType, level, spool_attributes, no_attributes, spool_data;
-  int32_t PreferMountedVols, rerunning, protocol;
+  int32_t PreferMountedVols, rerunning, protocol, attr_batch = 0;
+  int32_t priority = 0;
   int status;
   uint64_t quota = 0;
   JobControlRecord* ojcr;
@@ -94,8 +102,10 @@ bool job_cmd(JobControlRecord* jcr)
                   &no_attributes, &spool_attributes, fileset_md5.c_str(),
                   &spool_data, &PreferMountedVols, spool_size, &rerunning,
                   &jcr->VolSessionId, &jcr->VolSessionTime, &quota, &protocol,
-                  backup_format.c_str());
-  if (status != 19) {
+                  backup_format.c_str(), &attr_batch, &priority,
+                  read_group.c_str(), &read_group_size);
+  // older Directors do not send AttrBatch, Priority and ReadGroup
+  if (status < 19 || status > 23) {
     PmStrcpy(jcr->errmsg, dir->msg);
     dir->fsend(BAD_job, status, jcr->errmsg);
     Dmsg1(100, ">dird: %s", dir->msg);
@@ -140,6 +150,12 @@ bool job_cmd(JobControlRecord* jcr)
   jcr->setJobType(JobType);
   jcr->setJobLevel(level);
   jcr->sd_impl->no_attributes = no_attributes;
+  jcr->sd_impl->batch_attributes = attr_batch;
+  jcr->JobPriority = priority;
+  if (status == 23 && !bstrcmp(read_group.c_str(), "none")) {
+    jcr->sd_impl->read_group = read_group.c_str();
+    jcr->sd_impl->read_group_size = read_group_size;
+  }
   jcr->sd_impl->spool_attributes = spool_attributes;
   jcr->sd_impl->spool_data = spool_data;
   jcr->sd_impl->spool_size = str_to_int64(spool_size);
@@ -161,7 +177,11 @@ bool job_cmd(JobControlRecord* jcr)
     return false;
   }
   jcr->sd_auth_key = strdup(auth_key);
-  dir->fsend(OK_job, jcr->VolSessionId, jcr->VolSessionTime, auth_key);
+  /* Offer message compression, the director answers with a compress command
+   * if it wants it.  Older directors do not look past the key. */
+  const char* compression = MessageCompression::Algorithm();
+  dir->fsend(OK_job, jcr->VolSessionId, jcr->VolSessionTime, auth_key,
+             compression ? " compress=" : "", compression ? compression : "");
   memset(auth_key, 0, sizeof(auth_key));
   Dmsg2(50, ">dird jid=%u: %s", (uint32_t)jcr->JobId, dir->msg);
 
@@ -362,6 +382,8 @@ void StoredFreeJcr(JobControlRecord* jcr)
 {
   Dmsg0(200, "Start stored FreeJcr\n");
   Dmsg2(800, "End Job JobId=%u %p\n", jcr->JobId, jcr);
+  EndScheduledWrites(jcr);
+  LeaveSharedRead(jcr);
 
   if (jcr->dir_bsock) {
     Dmsg2(800, "Send Terminate jid=%d %p\n", jcr->JobId, jcr);
@@ -381,6 +403,8 @@ void StoredFreeJcr(JobControlRecord* jcr)
     jcr->file_bsock = NULL;
   }
 
+  FreeDataConnections(jcr);
+
   if (jcr->sd_impl->job_name) { FreePoolMemory(jcr->sd_impl->job_name); }
 
   if (jcr->client_name) {
@@ -41,6 +41,10 @@
 #include "lib/version.h"
 #include "lib/serial.h"
 
+#include <map>
+#include <mutex>
+#include <utility>
+
 namespace storagedaemon {
 
 /* Forward referenced functions */
@@ -48,6 +52,73 @@ static void CreateVolumeLabelRecord(DeviceControlRecord* dcr,
                                     Device* dev,
                                     DeviceRecord* rec);
 
+namespace {
+/* The labels of the volume files read before.  As long as the inode, size,
+ * mtime and ctime of a volume file did not change it still has the label
+ * read last time, so mounting it again does not need to read the label
+ * block.  Writing a label drops the entry of the volume. */
+class VolumeLabelCache {
+ public:
+  // fills in dev->VolHdr if the label of the open volume is known
+  bool Get(Device* dev)
+  {
+    struct stat statp;
+    if (!Usable(dev) || fstat(dev->fd, &statp) != 0) { return false; }
+    std::unique_lock lock(mutex_);
+    auto found = labels_.find({statp.st_dev, statp.st_ino});
+    if (found == labels_.end() || !found->second.Matches(statp)) {
+      return false;
+    }
+    dev->VolHdr = found->second.label;
+    return true;
+  }
+
+  void Put(Device* dev)
+  {
+    struct stat statp;
+    if (!Usable(dev) || fstat(dev->fd, &statp) != 0) { return; }
+    std::unique_lock lock(mutex_);
+    if (labels_.size() >= max_labels) { labels_.clear(); }
+    labels_[{statp.st_dev, statp.st_ino}] = cached_label{
+        statp.st_size, statp.st_mtime, statp.st_ctime, dev->VolHdr};
+  }
+
+  void Forget(Device* dev)
+  {
+    struct stat statp;
+    if (!Usable(dev) || fstat(dev->fd, &statp) != 0) { return; }
+    std::unique_lock lock(mutex_);
+    labels_.erase({statp.st_dev, statp.st_ino});
+  }
+
+ private:
+  static constexpr std::size_t max_labels = 16384;
+
+  struct cached_label {
+    off_t size;
+    time_t mtime;
+    time_t ctime;
+    Volume_Label label;
+
+    bool Matches(const struct stat& statp) const
+    {
+      return size == statp.st_size && mtime == statp.st_mtime
+             && ctime == statp.st_ctime;
+    }
+  };
+
+  static bool Usable(Device* dev)
+  {
+    return dev->device_type == DeviceType::B_FILE_DEV && dev->fd >= 0;
+  }
+
+  std::mutex mutex_;
+  std::map<std::pair<dev_t, ino_t>, cached_label> labels_;
+};
+
+VolumeLabelCache label_cache;
+}  // namespace
+
 /**
  * Read the volume label
  *
@@ -79,6 +150,7 @@ int ReadDevVolumeLabel(DeviceControlRecord* dcr)
   int status;
   bool want_ansi_label;
   bool have_ansi_label = false;
+  bool cacheable;
 
   /* We always write the label in an 64512 byte / 63k block.
    * so we never have problems reading the volume label. */
@@ -140,32 +212,41 @@ int ReadDevVolumeLabel(DeviceControlRecord* dcr)
     }
   }
 
-  // Read the Bareos Volume label block
-  record = new_record();
-  EmptyBlock(dcr->block);
-
-  Dmsg0(130, "Big if statement in ReadVolumeLabel\n");
-  if (DeviceControlRecord::ReadStatus::Ok
-      != dcr->ReadBlockFromDev(NO_BLOCK_NUMBER_CHECK)) {
-    Mmsg(jcr->errmsg,
-         T_("Requested Volume \"%s\" on %s is not a Bareos "
-            "labeled Volume, because: ERR=%s"),
-         NPRT(VolName), dcr->dev->print_name(), dcr->dev->print_errmsg());
-    Dmsg1(130, "%s", jcr->errmsg);
-  } else if (!ReadRecordFromBlock(dcr, record)) {
-    Mmsg(jcr->errmsg, T_("Could not read Volume label from block.\n"));
-    Dmsg1(130, "%s", jcr->errmsg);
-  } else if (!UnserVolumeLabel(dcr->dev, record)) {
-    Mmsg(jcr->errmsg, T_("Could not UnSerialize Volume label: ERR=%s\n"),
-         dcr->dev->print_errmsg());
-    Dmsg1(130, "%s", jcr->errmsg);
-  } else if (!bstrcmp(dcr->dev->VolHdr.Id, BareosId)) {
-    Mmsg(jcr->errmsg, T_("Volume Header Id bad: %s\n"), dcr->dev->VolHdr.Id);
-    Dmsg1(130, "%s", jcr->errmsg);
-  } else {
+  // Read the Bareos Volume label block, unless it is known already
+  cacheable = !want_ansi_label && !dcr->dev->HasCap(CAP_CHECKLABELS);
+  if (cacheable && label_cache.Get(dcr->dev)) {
+    Dmsg1(130, "Volume label of %s found in the label cache\n",
+          dcr->dev->print_name());
+    cacheable = false; /* nothing new to remember */
     ok = true;
+  } else {
+    record = new_record();
+    EmptyBlock(dcr->block);
+
+    Dmsg0(130, "Big if statement in ReadVolumeLabel\n");
+    if (DeviceControlRecord::ReadStatus::Ok
+        != dcr->ReadBlockFromDev(NO_BLOCK_NUMBER_CHECK)) {
+      Mmsg(jcr->errmsg,
+           T_("Requested Volume \"%s\" on %s is not a Bareos "
+              "labeled Volume, because: ERR=%s"),
+           NPRT(VolName), dcr->dev->print_name(), dcr->dev->print_errmsg());
+      Dmsg1(130, "%s", jcr->errmsg);
+    } else if (!ReadRecordFromBlock(dcr, record)) {
+      Mmsg(jcr->errmsg, T_("Could not read Volume label from block.\n"));
+      Dmsg1(130, "%s", jcr->errmsg);
+    } else if (!UnserVolumeLabel(dcr->dev, record)) {
+      Mmsg(jcr->errmsg, T_("Could not UnSerialize Volume label: ERR=%s\n"),
+           dcr->dev->print_errmsg());
+      Dmsg1(130, "%s", jcr->errmsg);
+    } else if (!bstrcmp(dcr->dev->VolHdr.Id, BareosId)) {
+      Mmsg(jcr->errmsg, T_("Volume Header Id bad: %s\n"),
+           dcr->dev->VolHdr.Id);
+      Dmsg1(130, "%s", jcr->errmsg);
+    } else {
+      ok = true;
+    }
+    FreeRecord(record); /* finished reading Volume record */
   }
-  FreeRecord(record); /* finished reading Volume record */
 
   if (!dcr->dev->IsVolumeToUnload()) { dcr->dev->ClearUnload(); }
 
@@ -208,6 +289,7 @@ int ReadDevVolumeLabel(DeviceControlRecord* dcr)
   }
 
   dcr->dev->SetLabeled(); /* set has Bareos label */
+  if (cacheable) { label_cache.Put(dcr->dev); }
 
   /* Compare Volume Names */
   Dmsg2(130, "Compare Vol names: VolName=%s hdr=%s\n", VolName ? VolName : "*",
@@ -363,6 +445,7 @@ bool WriteNewVolumeLabelToDev(DeviceControlRecord* dcr,
     }
   }
   Dmsg1(150, "Label type=%d\n", dev->label_type);
+  label_cache.Forget(dev);
 
   /* Let any stored plugin know that we are about to write a new label to the
    * volume. */
@@ -621,6 +704,12 @@ bool WriteSessionLabel(DeviceControlRecord* dcr, int label)
   DeviceBlock* block = dcr->block;
   char buf1[100], buf2[100];
 
+  // the end of the session comes after all data records
+  if (label == EOS_LABEL && !dcr->WriteDeferredRecords(true)) {
+    Dmsg0(130, "Got WriteBlockToDev error writing deferred records.\n");
+    return false;
+  }
+
   rec = new_record();
   Dmsg1(130, "session_label record=%x\n", rec);
   if (label != SOS_LABEL && label != EOS_LABEL) {
@@ -1024,6 +1113,7 @@ bool DeviceControlRecord::RewriteVolumeLabel(bool recycle)
 
   Dmsg2(190, "set append found freshly labeled volume. fd=%d dev=%x\n", dev->fd,
         dev);
+  label_cache.Forget(dev);
 
   // Let any stored plugin know that we are (re)writing the label.
   if (GeneratePluginEvent(jcr, bSdEventLabelWrite, dcr) != bRC_OK) {
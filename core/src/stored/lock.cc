@@ -31,6 +31,7 @@
 #include "lib/edit.h"
 #include "lib/util.h"
 #include "lib/berrno.h"
+#include "lib/metrics.h"
 
 namespace storagedaemon {
 
@@ -170,7 +171,24 @@ void DeviceControlRecord::mUnlock()
 // Device locks N.B.
 void Device::rUnlock() { Unlock(); }
 
-void Device::Lock() { lock_mutex(mutex_); }
+static metrics::counter lock_acquisitions_total{
+    "bareos_sd_device_lock_acquisitions", "Times a device mutex was locked"};
+static metrics::counter lock_contentions_total{
+    "bareos_sd_device_lock_contentions",
+    "Times locking a device mutex had to wait for another thread"};
+
+void Device::Lock()
+{
+  bool contended = pthread_mutex_trylock(&mutex_) != 0;
+  if (contended) { lock_mutex(mutex_); }
+  // counted under the mutex
+  lock_acquisitions++;
+  lock_acquisitions_total.Add();
+  if (contended) {
+    lock_contentions++;
+    lock_contentions_total.Add();
+  }
+}
 
 void Device::Unlock() { unlock_mutex(mutex_); }
 
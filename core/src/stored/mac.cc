@@ -37,15 +37,19 @@
 #include "stored/device_control_record.h"
 #include "stored/stored_jcr_impl.h"
 #include "stored/label.h"
+#include "stored/match_bsr.h"
 #include "stored/mount.h"
 #include "stored/read_record.h"
 #include "stored/sd_stats.h"
+#include "stored/shared_read.h"
 #include "stored/spool.h"
 #include "lib/bget_msg.h"
 #include "lib/bnet.h"
 #include "lib/bsock.h"
 #include "lib/edit.h"
+#include "lib/serial.h"
 #include "include/jcr.h"
+#include "include/streams.h"
 
 namespace storagedaemon {
 
@@ -72,6 +76,14 @@ struct cb_data {
   uint32_t last_VolSessionTime{0};
   int32_t last_FileIndex{0};
   int32_t last_Stream{0};
+
+  // block passthrough, see PassBlockThrough()
+  bool passthrough{false};
+  bool open_record{false}; /* last passed block ended within a record */
+  int32_t open_FileIndex{0};
+  int32_t open_Stream{0};
+  PoolMem attributes{PM_MESSAGE}; /* attributes split over blocks */
+  uint32_t attributes_len{0};
 };
 
 /**
@@ -106,6 +118,123 @@ static bool response(JobControlRecord* jcr,
   return false;
 }
 
+bool StartReplicateSession(JobControlRecord* jcr)
+{
+  BareosSocket* sd = jcr->store_bsock;
+
+  // Set network buffering.
+  if (!sd->SetBufferSize(me->max_network_buffer_size, BNET_SETBUF_WRITE)) {
+    Jmsg(jcr, M_FATAL, 0, T_("Cannot set buffer size SD->SD.\n"));
+    return false;
+  }
+
+  // Let the remote SD know we are about to start the replication.
+  sd->fsend(start_replicate);
+  Dmsg1(110, ">stored: %s", sd->msg);
+
+  // Expect to receive back the Ticket number.
+  if (BgetMsg(sd) >= 0) {
+    Dmsg1(110, "<stored: %s", sd->msg);
+    if (sscanf(sd->msg, OK_start_replicate, &jcr->sd_impl->Ticket) != 1) {
+      Jmsg(jcr, M_FATAL, 0, T_("Bad response to start replicate: %s\n"),
+           sd->msg);
+      return false;
+    }
+    Dmsg1(110, "Got Ticket=%d\n", jcr->sd_impl->Ticket);
+  } else {
+    Jmsg(jcr, M_FATAL, 0,
+         T_("Bad response from stored to start replicate command\n"));
+    return false;
+  }
+
+  // Let the remote SD know we are now really going to send the data.
+  sd->fsend(ReplicateData, jcr->sd_impl->Ticket);
+  Dmsg1(110, ">stored: %s", sd->msg);
+
+  // Expect to get response to the replicate data cmd from Storage daemon
+  return response(jcr, sd, OK_data, "replicate data");
+}
+
+bool SendRecordToRemoteSd(JobControlRecord* jcr,
+                          DeviceRecord* rec,
+                          bool send_eod,
+                          bool send_header)
+{
+  BareosSocket* sd = jcr->store_bsock;
+
+  // Send a EOD when needed.
+  if (send_eod) {
+    if (!sd->signal(BNET_EOD)) { /* indicate end of file data */
+      if (!jcr->IsJobCanceled()) {
+        Jmsg1(jcr, M_FATAL, 0, T_("Network send error to SD. ERR=%s\n"),
+              sd->bstrerror());
+      }
+      return false;
+    }
+  }
+
+  // Send a header when needed.
+  if (send_header) {
+    if (!sd->fsend("%ld %d 0", rec->FileIndex, rec->Stream)) {
+      if (!jcr->IsJobCanceled()) {
+        Jmsg1(jcr, M_FATAL, 0, T_("Network send error to SD. ERR=%s\n"),
+              sd->bstrerror());
+      }
+      return false;
+    }
+  }
+
+  /* Send the record data.
+   * We don't want to copy the data from the record to the socket structure
+   * so we save the original msg pointer and use the record data pointer for
+   * sending and restore the original msg pointer when done. */
+  POOLMEM* msgsave = sd->msg;
+  sd->msg = rec->data;
+  sd->message_length = rec->data_len;
+
+  bool ok = sd->send();
+  sd->msg = msgsave;
+  sd->message_length = 0;
+  if (!ok) {
+    if (!jcr->IsJobCanceled()) {
+      Jmsg1(jcr, M_FATAL, 0, T_("Network send error to SD. ERR=%s\n"),
+            sd->bstrerror());
+    }
+    return false;
+  }
+
+  return true;
+}
+
+bool EndReplicateSession(JobControlRecord* jcr)
+{
+  BareosSocket* sd = jcr->store_bsock;
+
+  /* Send the last EOD to close the last data transfer and a next EOD to
+   * signal the remote we are done. */
+  if (!sd->signal(BNET_EOD) || !sd->signal(BNET_EOD)) {
+    if (!jcr->IsJobCanceled()) {
+      Jmsg1(jcr, M_FATAL, 0, T_("Network send error to SD. ERR=%s\n"),
+            sd->bstrerror());
+    }
+    return false;
+  }
+
+  // Expect to get response that the replicate data succeeded.
+  if (!response(jcr, sd, OK_replicate, "replicate data")) { return false; }
+
+  // End replicate session.
+  sd->fsend(end_replicate);
+  Dmsg1(110, ">stored: %s", sd->msg);
+
+  // Expect to get response to the end replicate cmd from Storage daemon
+  if (!response(jcr, sd, OK_end_replicate, "end replicate")) { return false; }
+
+  /* Inform Storage daemon that we are done */
+  sd->signal(BNET_TERMINATE);
+  return true;
+}
+
 /**
  * Called here for each record from ReadRecords()
  * This function is used when we do a internal clone of a Job e.g.
@@ -120,6 +249,7 @@ static bool CloneRecordInternally(DeviceControlRecord* dcr,
 {
   bool retval = false;
   bool translated_record = false;
+  std::size_t num_deferred;
   JobControlRecord* jcr = dcr->jcr;
   Device* dev = jcr->sd_impl->dcr->dev;
   char buf1[100], buf2[100];
@@ -132,6 +262,14 @@ static bool CloneRecordInternally(DeviceControlRecord* dcr,
    * bscan-ing of virtual and always incremental consolidated jobs
    * works. */
 
+  if (data->open_record && rec->FileIndex > 0) {
+    Jmsg(jcr, M_FATAL, 0,
+         T_("Record of FileIndex=%d inside of a copied block of "
+            "FileIndex=%d.\n"),
+         rec->FileIndex, data->open_FileIndex);
+    return false;
+  }
+
   if (rec->FileIndex < 0) {
     if (rec->FileIndex == SOS_LABEL) {
       if (!data->found_first_sos_label) {
@@ -205,6 +343,7 @@ static bool CloneRecordInternally(DeviceControlRecord* dcr,
         stream_to_ascii(buf2, rec->Stream, rec->FileIndex), rec->data_len);
 
   // Perform record translations.
+  num_deferred = jcr->sd_impl->dcr->deferred_records.size();
   jcr->sd_impl->dcr->before_rec = rec;
   jcr->sd_impl->dcr->after_rec = NULL;
   if (GeneratePluginEvent(jcr, bSdEventWriteRecordTranslation,
@@ -213,6 +352,16 @@ static bool CloneRecordInternally(DeviceControlRecord* dcr,
     goto bail_out;
   }
 
+  // A plugin translates the record on its own time
+  if (jcr->sd_impl->dcr->deferred_records.size() > num_deferred) {
+    retval = jcr->sd_impl->dcr->WriteDeferredRecords();
+    if (!retval) {
+      Jmsg2(jcr, M_FATAL, 0, T_("Fatal append error on device %s: ERR=%s\n"),
+            dev->print_name(), dev->bstrerror());
+    }
+    goto bail_out;
+  }
+
   /* The record got translated when we got an after_rec pointer after calling
    * the bSdEventWriteRecordTranslation plugin event. If no translation has
    * taken place we just point the after_rec pointer to same DeviceRecord as in
@@ -223,6 +372,13 @@ static bool CloneRecordInternally(DeviceControlRecord* dcr,
     translated_record = true;
   }
 
+  // Records deferred before this one go first
+  if (!jcr->sd_impl->dcr->WriteDeferredRecords(true)) {
+    Jmsg2(jcr, M_FATAL, 0, T_("Fatal append error on device %s: ERR=%s\n"),
+          dev->print_name(), dev->bstrerror());
+    goto bail_out;
+  }
+
   while (!WriteRecordToBlock(jcr->sd_impl->dcr, jcr->sd_impl->dcr->after_rec)) {
     Dmsg4(200, "!WriteRecordToBlock blkpos=%u:%u len=%d rem=%d\n", dev->file,
           dev->block_num, jcr->sd_impl->dcr->after_rec->data_len,
@@ -252,8 +408,9 @@ static bool CloneRecordInternally(DeviceControlRecord* dcr,
                         jcr->sd_impl->dcr->after_rec->FileIndex),
         jcr->sd_impl->dcr->after_rec->data_len);
 
-  if (IsAttribute(jcr->sd_impl->dcr->after_rec)) {
-    SendAttrsToDir(jcr, jcr->sd_impl->dcr->after_rec);
+  if (IsAttribute(jcr->sd_impl->dcr->after_rec)
+      && !SendAttrsToDir(jcr, jcr->sd_impl->dcr->after_rec)) {
+    goto bail_out;
   }
 
   retval = true;
@@ -274,6 +431,249 @@ bail_out:
   return retval;
 }
 
+// Forward an attributes record that was passed through to the Director
+static bool SendPassedAttributes(JobControlRecord* jcr,
+                                 int32_t Stream,
+                                 char* attributes,
+                                 uint32_t len)
+{
+  DeviceRecord rec;
+  rec.VolSessionId = jcr->VolSessionId;
+  rec.VolSessionTime = jcr->VolSessionTime;
+  rec.FileIndex = jcr->JobFiles;
+  rec.Stream = Stream;
+  rec.maskedStream = Stream & STREAMMASK_TYPE;
+  rec.data = attributes;
+  rec.data_len = len;
+  return SendAttrsToDir(jcr, &rec);
+}
+
+/**
+ * Do for the records in [start, end) of the write block what
+ * CloneRecordInternally() does for a record, i.e. give them sequential
+ * output FileIndexes and send their attributes to the Director.
+ *
+ * The records are known to be well formed data records, the last one may
+ * be continued in the next block.
+ */
+static bool AccountPassedRecords(JobControlRecord* jcr,
+                                 DeviceBlock* block,
+                                 DeviceBlock* out,
+                                 char* start,
+                                 char* end,
+                                 cb_data* data)
+{
+  ser_declare;
+  char* p = start;
+
+  while (end - p >= WRITE_RECHDR_LENGTH) {
+    int32_t FileIndex, Stream;
+    uint32_t remainder;
+
+    UnserBegin(p, WRITE_RECHDR_LENGTH);
+    unser_int32(FileIndex);
+    unser_int32(Stream);
+    unser_uint32(remainder);
+    bool continuation = Stream < 0;
+    if (continuation) { Stream = -Stream; }
+    char* piece = p + WRITE_RECHDR_LENGTH;
+    uint32_t len = std::min<uint32_t>(remainder, end - piece);
+
+    if (block->VolSessionId != data->last_VolSessionId
+        || block->VolSessionTime != data->last_VolSessionTime
+        || FileIndex != data->last_FileIndex) {
+      jcr->JobFiles++;
+      data->last_VolSessionId = block->VolSessionId;
+      data->last_VolSessionTime = block->VolSessionTime;
+      data->last_FileIndex = FileIndex;
+    }
+    SerBegin(p, sizeof(int32_t));
+    ser_int32(jcr->JobFiles);
+
+    if (out->FirstIndex == 0) { out->FirstIndex = jcr->JobFiles; }
+    out->LastIndex = jcr->JobFiles;
+    jcr->JobBytes += len;
+
+    DeviceRecord probe;
+    probe.maskedStream = Stream & STREAMMASK_TYPE;
+    if (IsAttribute(&probe)) {
+      if (!continuation && len == remainder) {
+        if (!SendPassedAttributes(jcr, Stream, piece, len)) { return false; }
+      } else {
+        if (!continuation) { data->attributes_len = 0; }
+        data->attributes.check_size(data->attributes_len + remainder);
+        memcpy(data->attributes.c_str() + data->attributes_len, piece, len);
+        data->attributes_len += len;
+        if (len == remainder
+            && !SendPassedAttributes(jcr, Stream, data->attributes.c_str(),
+                                     data->attributes_len)) {
+          return false;
+        }
+      }
+    }
+
+    data->open_record = len < remainder;
+    data->open_FileIndex = FileIndex;
+    data->open_Stream = Stream;
+    p = piece + len;
+  }
+  return true;
+}
+
+/**
+ * Called here for each block from ReadRecords() when we do an internal clone
+ * with Block Passthrough On Copy.  If the block only holds data records that
+ * the bsr wants, it is copied into the write block as it is; only the
+ * FileIndexes of the records are changed.  WriteBlockToDevice() then gives it
+ * our session, the next block number and a new checksum.
+ *
+ * A block that ended within a record was passed through, so at least the
+ * rest of that record is taken from the next block, even if the records after
+ * it have to go through CloneRecordInternally().
+ */
+static BlockCbResult PassBlockThrough(DeviceControlRecord* dcr,
+                                      READ_CTX* rctx,
+                                      cb_data* data)
+{
+  JobControlRecord* jcr = dcr->jcr;
+  DeviceControlRecord* write_dcr = jcr->sd_impl->dcr;
+  DeviceBlock* block = dcr->block;
+  DeviceBlock* out = write_dcr->block;
+  BootStrapRecord* bsr = jcr->sd_impl->read_session.bsr;
+  ser_declare;
+
+  if (!data->passthrough || block->BlockVer < 2) {
+    return BlockCbResult::READ_RECORDS;
+  }
+  if (data->open_record) {
+    // blocks of other jobs can be in between
+    if (block->VolSessionId != data->last_VolSessionId
+        || block->VolSessionTime != data->last_VolSessionTime) {
+      return BlockCbResult::READ_RECORDS;
+    }
+  } else if (rctx->rec->remainder) {
+    return BlockCbResult::READ_RECORDS; /* record started in the last block */
+  }
+
+  DeviceRecord match;
+  match.VolSessionId = block->VolSessionId;
+  match.VolSessionTime = block->VolSessionTime;
+  match.File = dcr->dev->EndFile;
+  match.Block = dcr->dev->EndBlock;
+
+  const uint32_t max_len = out->buf_len - WRITE_BLKHDR_LENGTH;
+  char* p = block->bufp;
+  char* end = block->bufp + block->binbuf;
+  char* accepted = p; /* end of the last complete record */
+  bool in_record = data->open_record;
+  bool whole = true;
+  while (end - p >= WRITE_RECHDR_LENGTH) {
+    int32_t FileIndex, Stream;
+    uint32_t remainder;
+
+    UnserBegin(p, WRITE_RECHDR_LENGTH);
+    unser_int32(FileIndex);
+    unser_int32(Stream);
+    unser_uint32(remainder);
+    uint32_t len
+        = std::min<uint32_t>(remainder, end - p - WRITE_RECHDR_LENGTH);
+
+    bool wanted;
+    if (in_record) {
+      wanted = FileIndex == data->open_FileIndex
+               && Stream == -data->open_Stream;
+      Stream = -Stream;
+    } else {
+      wanted = FileIndex > 0 && Stream > 0;
+    }
+    wanted = wanted && remainder < MAX_BLOCK_LENGTH
+             && (p - block->bufp) + WRITE_RECHDR_LENGTH + len <= max_len;
+    if (wanted && bsr) {
+      match.FileIndex = FileIndex;
+      match.Stream = Stream;
+      match.maskedStream = Stream & STREAMMASK_TYPE;
+      wanted = MatchBsr(bsr, &match, &dcr->dev->VolHdr, &rctx->sessrec, jcr)
+               == 1;
+    }
+    if (!wanted) {
+      whole = false;
+      break;
+    }
+
+    p += WRITE_RECHDR_LENGTH + len;
+    in_record = len < remainder; /* only the last one can be continued */
+    if (!in_record) { accepted = p; }
+  }
+  if (whole) { accepted = p; }
+
+  if (accepted == block->bufp) {
+    if (data->open_record) {
+      Jmsg(jcr, M_FATAL, 0,
+           T_("Continuation of FileIndex=%d not found in block %u.\n"),
+           data->open_FileIndex, block->BlockNumber);
+      return BlockCbResult::FAILED;
+    }
+    return BlockCbResult::READ_RECORDS;
+  }
+  if (!whole && !data->open_record) { return BlockCbResult::READ_RECORDS; }
+
+  // records written by CloneRecordInternally() go first
+  if (out->binbuf > WRITE_BLKHDR_LENGTH && !write_dcr->WriteBlockToDevice()) {
+    Jmsg2(jcr, M_FATAL, 0, T_("Fatal append error on device %s: ERR=%s\n"),
+          write_dcr->dev->print_name(), write_dcr->dev->bstrerror());
+    return BlockCbResult::FAILED;
+  }
+
+  uint32_t len = accepted - block->bufp;
+  memcpy(out->bufp, block->bufp, len);
+  out->VolSessionId = jcr->VolSessionId;
+  out->VolSessionTime = jcr->VolSessionTime;
+  if (!AccountPassedRecords(jcr, block, out, out->bufp, out->bufp + len,
+                            data)) {
+    return BlockCbResult::FAILED;
+  }
+  out->bufp += len;
+  out->binbuf += len;
+  dcr->VolLastIndex = data->last_FileIndex;
+
+  Dmsg3(200, "Passed %u bytes of block %u through, whole=%d\n", len,
+        block->BlockNumber, whole);
+
+  if (!whole) {
+    // the rest is read record by record and appended to the write block
+    block->bufp += len;
+    block->binbuf -= len;
+    return BlockCbResult::READ_RECORDS;
+  }
+
+  if (!write_dcr->WriteBlockToDevice()) {
+    Jmsg2(jcr, M_FATAL, 0, T_("Fatal append error on device %s: ERR=%s\n"),
+          write_dcr->dev->print_name(), write_dcr->dev->bstrerror());
+    return BlockCbResult::FAILED;
+  }
+  return BlockCbResult::HANDLED;
+}
+
+// See if the blocks of the job can be written the way they were read
+static bool BlockPassthroughPossible(JobControlRecord* jcr)
+{
+  /* A virtual backup writes the records of several jobs, whose blocks can be
+   * interleaved on the volumes. */
+  if (!jcr->is_JobType(JT_MIGRATE) && !jcr->is_JobType(JT_COPY)) {
+    return false;
+  }
+  if (IsPluginEventEnabled(jcr, bSdEventReadRecordTranslation)
+      || IsPluginEventEnabled(jcr, bSdEventWriteRecordTranslation)) {
+    return false;
+  }
+  // filtering on file names looks at the attributes of every file
+  for (BootStrapRecord* bsr = jcr->sd_impl->read_session.bsr; bsr;
+       bsr = bsr->next) {
+    if (bsr->fileregex) { return false; }
+  }
+  return true;
+}
+
 /**
  * Called here for each record from ReadRecords()
  * This function is used when we do a external clone of a Job e.g.
@@ -286,10 +686,8 @@ static bool CloneRecordToRemoteSd(DeviceControlRecord* dcr,
                                   DeviceRecord* rec,
                                   cb_data* data)
 {
-  POOLMEM* msgsave;
   JobControlRecord* jcr = dcr->jcr;
   char buf1[100], buf2[100];
-  BareosSocket* sd = jcr->store_bsock;
   bool send_eod, send_header;
 
   // If label discard it
@@ -333,48 +731,10 @@ static bool CloneRecordToRemoteSd(DeviceControlRecord* dcr,
     }
   }
 
-  // Send a EOD when needed.
-  if (send_eod) {
-    if (!sd->signal(BNET_EOD)) { /* indicate end of file data */
-      if (!jcr->IsJobCanceled()) {
-        Jmsg1(jcr, M_FATAL, 0, T_("Network send error to SD. ERR=%s\n"),
-              sd->bstrerror());
-      }
-      return false;
-    }
-  }
-
-  // Send a header when needed.
-  if (send_header) {
-    if (!sd->fsend("%ld %d 0", rec->FileIndex, rec->Stream)) {
-      if (!jcr->IsJobCanceled()) {
-        Jmsg1(jcr, M_FATAL, 0, T_("Network send error to SD. ERR=%s\n"),
-              sd->bstrerror());
-      }
-      return false;
-    }
-  }
-
-  /* Send the record data.
-   * We don't want to copy the data from the record to the socket structure
-   * so we save the original msg pointer and use the record data pointer for
-   * sending and restore the original msg pointer when done. */
-  msgsave = sd->msg;
-  sd->msg = rec->data;
-  sd->message_length = rec->data_len;
-
-  if (!sd->send()) {
-    sd->msg = msgsave;
-    sd->message_length = 0;
-    if (!jcr->IsJobCanceled()) {
-      Jmsg1(jcr, M_FATAL, 0, T_("Network send error to SD. ERR=%s\n"),
-            sd->bstrerror());
-    }
+  if (!SendRecordToRemoteSd(jcr, rec, send_eod, send_header)) {
     return false;
   }
-
-  jcr->JobBytes += sd->message_length;
-  sd->msg = msgsave;
+  jcr->JobBytes += rec->data_len;
 
   Dmsg5(200, "wrote_record JobId=%d FI=%s SessId=%d Strm=%s len=%d\n",
         jcr->JobId, FI_to_ascii(buf1, rec->FileIndex), rec->VolSessionId,
@@ -445,6 +805,7 @@ bool DoMacRun(JobControlRecord* jcr)
   const char* Type;
   bool ok = true;
   bool acquire_fail = false;
+  SharedReadRole read_role = SharedReadRole::kAlone;
   BareosSocket* dir = jcr->dir_bsock;
   if (!jcr->sd_impl->dcr) { TryReserveAfterUse(jcr, true); }
   Device* dev = jcr->sd_impl->dcr->dev;
@@ -479,8 +840,6 @@ bool DoMacRun(JobControlRecord* jcr)
 
   // See if we perform both read and write or read only.
   if (jcr->sd_impl->remote_replicate) {
-    BareosSocket* sd;
-
     if (!jcr->sd_impl->read_dcr) {
       Jmsg(jcr, M_FATAL, 0, T_("Read device not properly initialized.\n"));
       goto bail_out;
@@ -491,8 +850,10 @@ bool DoMacRun(JobControlRecord* jcr)
           jcr->sd_impl->NumReadVolumes, Type,
           jcr->sd_impl->VolList->VolumeName);
 
-    // Ready devices for reading.
-    if (!AcquireDeviceForRead(jcr->sd_impl->read_dcr)) {
+    // Ready devices for reading, unless another job reads for us.
+    read_role = JoinSharedRead(jcr);
+    if (read_role != SharedReadRole::kServed
+        && !AcquireDeviceForRead(jcr->sd_impl->read_dcr)) {
       ok = false;
       acquire_fail = true;
       goto bail_out;
@@ -514,39 +875,7 @@ bool DoMacRun(JobControlRecord* jcr)
 
     jcr->sendJobStatus(JS_Running);
 
-    // Set network buffering.
-    sd = jcr->store_bsock;
-    if (!sd->SetBufferSize(me->max_network_buffer_size, BNET_SETBUF_WRITE)) {
-      Jmsg(jcr, M_FATAL, 0, T_("Cannot set buffer size SD->SD.\n"));
-      ok = false;
-      goto bail_out;
-    }
-
-    // Let the remote SD know we are about to start the replication.
-    sd->fsend(start_replicate);
-    Dmsg1(110, ">stored: %s", sd->msg);
-
-    // Expect to receive back the Ticket number.
-    if (BgetMsg(sd) >= 0) {
-      Dmsg1(110, "<stored: %s", sd->msg);
-      if (sscanf(sd->msg, OK_start_replicate, &jcr->sd_impl->Ticket) != 1) {
-        Jmsg(jcr, M_FATAL, 0, T_("Bad response to start replicate: %s\n"),
-             sd->msg);
-        goto bail_out;
-      }
-      Dmsg1(110, "Got Ticket=%d\n", jcr->sd_impl->Ticket);
-    } else {
-      Jmsg(jcr, M_FATAL, 0,
-           T_("Bad response from stored to start replicate command\n"));
-      goto bail_out;
-    }
-
-    // Let the remote SD know we are now really going to send the data.
-    sd->fsend(ReplicateData, jcr->sd_impl->Ticket);
-    Dmsg1(110, ">stored: %s", sd->msg);
-
-    // Expect to get response to the replicate data cmd from Storage daemon
-    if (!response(jcr, sd, OK_data, "replicate data")) {
+    if (!StartReplicateSession(jcr)) {
       ok = false;
       goto bail_out;
     }
@@ -557,37 +886,10 @@ bool DoMacRun(JobControlRecord* jcr)
 
     cb_data data{};
     // Read all data and send it to remote SD.
-    ok = ReadRecords(jcr->sd_impl->read_dcr, CloneRecordToRemoteSd,
-                     MountNextReadVolume, &data);
-
-    /* Send the last EOD to close the last data transfer and a next EOD to
-     * signal the remote we are done. */
-    if (!sd->signal(BNET_EOD) || !sd->signal(BNET_EOD)) {
-      if (!jcr->IsJobCanceled()) {
-        Jmsg1(jcr, M_FATAL, 0, T_("Network send error to SD. ERR=%s\n"),
-              sd->bstrerror());
-      }
-      goto bail_out;
-    }
+    ok = ReadSharedRecords(jcr->sd_impl->read_dcr, CloneRecordToRemoteSd,
+                           MountNextReadVolume, &data);
 
-    // Expect to get response that the replicate data succeeded.
-    if (!response(jcr, sd, OK_replicate, "replicate data")) {
-      ok = false;
-      goto bail_out;
-    }
-
-    // End replicate session.
-    sd->fsend(end_replicate);
-    Dmsg1(110, ">stored: %s", sd->msg);
-
-    // Expect to get response to the end replicate cmd from Storage daemon
-    if (!response(jcr, sd, OK_end_replicate, "end replicate")) {
-      ok = false;
-      goto bail_out;
-    }
-
-    /* Inform Storage daemon that we are done */
-    sd->signal(BNET_TERMINATE);
+    if (!EndReplicateSession(jcr)) { ok = false; }
   } else {
     if (!jcr->sd_impl->read_dcr) {
       Jmsg(jcr, M_FATAL, 0, T_("Read device not properly initialized.\n"));
@@ -601,8 +903,14 @@ bool DoMacRun(JobControlRecord* jcr)
           jcr->sd_impl->VolList->VolumeName);
 
     // Ready devices for reading and writing.
-    if (!AcquireDeviceForAppend(jcr->sd_impl->dcr)
-        || !AcquireDeviceForRead(jcr->sd_impl->read_dcr)) {
+    if (!AcquireDeviceForAppend(jcr->sd_impl->dcr)) {
+      ok = false;
+      acquire_fail = true;
+      goto bail_out;
+    }
+    read_role = JoinSharedRead(jcr);
+    if (read_role != SharedReadRole::kServed
+        && !AcquireDeviceForRead(jcr->sd_impl->read_dcr)) {
       ok = false;
       acquire_fail = true;
       goto bail_out;
@@ -654,8 +962,16 @@ bool DoMacRun(JobControlRecord* jcr)
 
     cb_data data{};
     // Read all data and make a local clone of it.
-    ok = ReadRecords(jcr->sd_impl->read_dcr, CloneRecordInternally,
-                     MountNextReadVolume, &data);
+    if (read_role == SharedReadRole::kAlone) {
+      data.passthrough
+          = me->block_passthrough_on_copy && BlockPassthroughPossible(jcr);
+      ok = ReadRecords(jcr->sd_impl->read_dcr, CloneRecordInternally,
+                       PassBlockThrough, MountNextReadVolume, &data);
+    } else {
+      // the blocks hold the records of other jobs too
+      ok = ReadSharedRecords(jcr->sd_impl->read_dcr, CloneRecordInternally,
+                             MountNextReadVolume, &data);
+    }
   }
 
 bail_out:
@@ -731,7 +1047,7 @@ bail_out:
     if (!ReleaseDevice(jcr->sd_impl->dcr)) { ok = false; }
   }
   if (jcr->sd_impl->read_dcr) {
-    if (!ReleaseDevice(jcr->sd_impl->read_dcr)) { ok = false; }
+    if (!ReleaseReadDevice(jcr->sd_impl->read_dcr)) { ok = false; }
   }
 
   jcr->sendJobStatus(); /* update director */
@@ -28,6 +28,17 @@ namespace storagedaemon {
 
 bool DoMacRun(JobControlRecord* jcr);
 
+/* A replicate session sends records to the storage daemon connected as
+ * jcr->store_bsock, which stores them like data received from a file
+ * daemon.  Every new FileIndex or stream needs a header, all but the first
+ * one preceded by an EOD. */
+bool StartReplicateSession(JobControlRecord* jcr);
+bool SendRecordToRemoteSd(JobControlRecord* jcr,
+                          DeviceRecord* rec,
+                          bool send_eod,
+                          bool send_header);
+bool EndReplicateSession(JobControlRecord* jcr);
+
 } /* namespace storagedaemon  */
 
 #endif  // BAREOS_STORED_MAC_H_
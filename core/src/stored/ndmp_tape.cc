@@ -58,12 +58,16 @@
 #  include "lib/bpoll.h"
 #  include "lib/parse_conf.h"
 #  include "lib/thread_list.h"
+#  include "lib/channel.h"
 #  include "include/filetypes.h"
 #  include "include/streams.h"
 #  include "include/auth_types.h"
 #  include "include/jcr.h"
 
 #  include <algorithm>
+#  include <atomic>
+#  include <optional>
+#  include <thread>
 #  include <netinet/in.h>
 #  include <sys/socket.h>
 #  include <vector>
@@ -98,6 +102,8 @@ struct ndmp_thread_server_args {
  * Internal structure to keep track of private data for a NDMP session.
  * Referenced via (struct ndm_session)->session_handle.
  */
+class NdmpRecordWriter;
+
 struct ndmp_session_handle {
   int fd;                       /* Socket file descriptor */
   char* host;                   /* Host name/IP */
@@ -106,6 +112,10 @@ struct ndmp_session_handle {
   struct sockaddr_in peer_addr; /* Peer's IP address */
   JobControlRecord*
       jcr; /* Internal JobControlRecord bound to this NDMP session */
+  NdmpRecordWriter* writer; /* Queues and aggregates the tape writes */
+  POOLMEM* read_rest;       /* Rest of a record bigger than the NDMP read */
+  uint32_t read_rest_offset;
+  uint32_t read_rest_length;
 };
 
 // Internal structure to keep track of private data.
@@ -331,12 +341,134 @@ bail_out:
 }
 
 
+/**
+ * Writes the NDMP records of a backup for the session thread.  The data of
+ * consecutive tape writes is aggregated into records of up to
+ * NdmpMaximumRecordSize bytes and with NdmpWriteQueueSize set, the records
+ * are written by an own thread, so the session keeps receiving from the
+ * filer while the device writes.  While the writer exists only it uses the
+ * dcr of the job.
+ */
+class NdmpRecordWriter {
+ public:
+  NdmpRecordWriter(JobControlRecord* t_jcr,
+                   std::size_t queue_size,
+                   uint32_t max_record_size)
+      : jcr{t_jcr}, max_record_size_{max_record_size}
+  {
+    if (queue_size > 0) {
+      auto [in, out] = channel::CreateSpscChannel<queued_record>(queue_size);
+      input.emplace(std::move(in));
+      output.emplace(std::move(out));
+      write_thread = std::thread([this] { do_work(); });
+    }
+  }
+
+  ~NdmpRecordWriter() { Finish(); }
+
+  // Copies the data, false once writing failed.
+  bool Write(int stream, const char* data, uint32_t data_length)
+  {
+    if (failed.load(std::memory_order_relaxed)) { return false; }
+
+    if (stream == STREAM_FILE_DATA && max_record_size_ > 0) {
+      if (pending.length > 0
+          && pending.length + data_length > max_record_size_) {
+        if (!FlushPending()) { return false; }
+      }
+      pending.data.check_size(pending.length + data_length);
+      memcpy(pending.data.addr() + pending.length, data, data_length);
+      pending.length += data_length;
+      if (pending.length >= max_record_size_) { return FlushPending(); }
+      return true;
+    }
+
+    if (!FlushPending()) { return false; }
+    queued_record qrec{stream, data_length, PoolMem(PM_MESSAGE)};
+    qrec.data.check_size(data_length);
+    memcpy(qrec.data.addr(), data, data_length);
+    return Emit(std::move(qrec));
+  }
+
+  // Waits until everything was written, false if anything failed.
+  bool Finish()
+  {
+    if (!finished) {
+      finished = true;
+      FlushPending();
+      if (input) { input->close(); }
+      if (write_thread.joinable()) { write_thread.join(); }
+    }
+    return !failed.load();
+  }
+
+ private:
+  struct queued_record {
+    int stream;
+    uint32_t length;
+    PoolMem data;
+  };
+
+  bool FlushPending()
+  {
+    if (pending.length == 0) { return true; }
+    queued_record qrec{STREAM_FILE_DATA, pending.length, PoolMem(PM_MESSAGE)};
+    std::swap(qrec.data, pending.data);
+    pending.length = 0;
+    return Emit(std::move(qrec));
+  }
+
+  bool Emit(queued_record qrec)
+  {
+    if (input) {
+      if (input->emplace(std::move(qrec))) { return true; }
+    } else if (bndmp_write_data_to_block(jcr, qrec.stream, qrec.data.c_str(),
+                                         qrec.length)) {
+      return true;
+    }
+    failed = true;
+    return false;
+  }
+
+  void do_work()
+  {
+    while (std::optional<queued_record> qrec = output->get()) {
+      if (!bndmp_write_data_to_block(jcr, qrec->stream, qrec->data.c_str(),
+                                     qrec->length)) {
+        failed = true;
+        break;
+      }
+    }
+    // let Write() fail from now on
+    output->close();
+  }
+
+  JobControlRecord* jcr;
+  uint32_t max_record_size_;
+  queued_record pending{STREAM_FILE_DATA, 0, PoolMem(PM_MESSAGE)};
+  std::optional<channel::input<queued_record>> input;
+  std::optional<channel::output<queued_record>> output;
+  std::atomic<bool> failed{false};
+  bool finished{false};
+  std::thread write_thread;
+};
+
+static inline bool FinishRecordWriter(ndmp_session_handle* handle)
+{
+  if (!handle->writer) { return true; }
+  bool ok = handle->writer->Finish();
+  delete handle->writer;
+  handle->writer = NULL;
+  return ok;
+}
+
 /**
  * Read a record using the native routines.
  *
  * data_length == 0 = EOF
  */
 static inline bool bndmp_read_data_from_block(JobControlRecord* jcr,
+                                              ndmp_session_handle* handle,
                                               char* data,
                                               uint32_t wanted_data_length,
                                               uint32_t* data_length)
@@ -348,6 +480,16 @@ static inline bool bndmp_read_data_from_block(JobControlRecord* jcr,
 
   if (!rctx) { return false; }
 
+  // First hand out the rest of a record that was aggregated on backup.
+  if (handle->read_rest_length > 0) {
+    uint32_t length = std::min(handle->read_rest_length, wanted_data_length);
+    memcpy(data, handle->read_rest + handle->read_rest_offset, length);
+    handle->read_rest_offset += length;
+    handle->read_rest_length -= length;
+    *data_length = length;
+    return true;
+  }
+
   while (ok && !done) {
     // See if there are any records left to process.
     if (!IsBlockEmpty(rctx->rec)) {
@@ -410,11 +552,19 @@ static inline bool bndmp_read_data_from_block(JobControlRecord* jcr,
       case STREAM_UNIX_ATTRIBUTES:  // Start of the dump, read the next record.
         continue;
       case STREAM_FILE_DATA:  // Normal NDMP data.
+        /* Records written with NdmpMaximumRecordSize hold several NDMP
+         * records, which are handed out one by one. */
         if (wanted_data_length < rec->data_len) {
-          Jmsg0(jcr, M_FATAL, 0,
-                T_("Data read from volume bigger than NDMP databuffer, please "
-                   "increase the NDMP blocksize.\n"));
-          return false;
+          uint32_t rest = rec->data_len - wanted_data_length;
+          handle->read_rest = handle->read_rest
+                                  ? CheckPoolMemorySize(handle->read_rest, rest)
+                                  : GetMemory(rest);
+          memcpy(handle->read_rest, rec->data + wanted_data_length, rest);
+          handle->read_rest_offset = 0;
+          handle->read_rest_length = rest;
+          memcpy(data, rec->data, wanted_data_length);
+          *data_length = wanted_data_length;
+          return true;
         }
         memcpy(data, rec->data, rec->data_len);
         *data_length = rec->data_len;
@@ -644,6 +794,12 @@ extern "C" ndmp9_error bndmp_tape_open(struct ndm_session* sess,
       Jmsg0(jcr, M_FATAL, 0, T_("Creating virtual file attributes failed.\n"));
       goto bail_out;
     }
+
+    FinishRecordWriter(handle);
+    if (me->ndmp_write_queue_size > 0 || me->ndmp_maximum_record_size > 0) {
+      handle->writer = new NdmpRecordWriter(jcr, me->ndmp_write_queue_size,
+                                            me->ndmp_maximum_record_size);
+    }
   } else {
     // will read
     bool ok = true;
@@ -747,11 +903,20 @@ extern "C" ndmp9_error BndmpTapeClose(struct ndm_session* sess)
   if (NDMTA_TAPE_IS_WRITABLE(ta)) {
     /* Write a separator record so on restore we can recognize the different
      * NDMP datastreams from each other.  */
-    if (!bndmp_write_data_to_block(jcr, STREAM_NDMP_SEPARATOR, ndmp_separator,
-                                   13)) {
+    if (handle->writer) {
+      if (!handle->writer->Write(STREAM_NDMP_SEPARATOR, ndmp_separator, 13)) {
+        err = NDMP9_IO_ERR;
+      }
+    } else if (!bndmp_write_data_to_block(jcr, STREAM_NDMP_SEPARATOR,
+                                          ndmp_separator, 13)) {
       err = NDMP9_IO_ERR;
     }
   }
+  if (!FinishRecordWriter(handle)) {
+    jcr->setJobStatusWithPriorityCheck(JS_ErrorTerminated);
+    err = NDMP9_IO_ERR;
+  }
+  handle->read_rest_length = 0;
 
   pthread_cond_signal(
       &jcr->sd_impl->job_end_wait); /* wake any waiting thread */
@@ -830,7 +995,11 @@ extern "C" ndmp9_error bndmp_tape_write(struct ndm_session* sess,
   }
 
   // Turn the NDMP data into a internal record and save it.
-  if (bndmp_write_data_to_block(jcr, STREAM_FILE_DATA, buf, count)) {
+  bool written
+      = handle->writer
+            ? handle->writer->Write(STREAM_FILE_DATA, buf, count)
+            : bndmp_write_data_to_block(jcr, STREAM_FILE_DATA, buf, count);
+  if (written) {
     ta->tape_state.blockno.value++;
     *done_count = count;
     err = NDMP9_NO_ERR;
@@ -881,7 +1050,7 @@ extern "C" ndmp9_error bndmp_tape_read(struct ndm_session* sess,
     return NDMP9_DEV_NOT_OPEN_ERR;
   }
 
-  if (bndmp_read_data_from_block(jcr, buf, count, done_count)) {
+  if (bndmp_read_data_from_block(jcr, handle, buf, count, done_count)) {
     ta->tape_state.blockno.value++;
     if (*done_count == 0) {
       err = NDMP9_EOF_ERR;
@@ -1097,6 +1266,8 @@ bail_out:
   free(sess);
 
   close(handle->fd);
+  FinishRecordWriter(handle);
+  if (handle->read_rest) { FreePoolMemory(handle->read_rest); }
   if (handle->jcr) FreeJcr(handle->jcr);
   if (handle->host) free(handle->host);
   free(handle);
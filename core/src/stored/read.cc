@@ -27,6 +27,7 @@
  */
 
 #include "include/bareos.h"
+#include "include/streams.h"
 #include "stored/stored.h"
 #include "stored/acquire.h"
 #include "stored/bsr.h"
@@ -38,6 +39,11 @@
 #include "lib/bsock.h"
 #include "include/jcr.h"
 #include "stored/stored_globals.h"
+#include "lib/channel.h"
+
+#include <mutex>
+#include <string>
+#include <thread>
 
 namespace storagedaemon {
 
@@ -49,6 +55,141 @@ static char OK_data[] = "3000 OK data\n";
 static char FD_error[] = "3000 error\n";
 static char rec_header[] = "rechdr %ld %ld %ld %ld %ld";
 
+/* A VolumeToCatalog verify compares only the attributes and the digests of
+ * the files with the catalog, the File daemon ignores everything else.  The
+ * data records are therefore not sent; they are still read, so the block
+ * checksums and the record framing of the volumes are verified here. */
+static bool SkipRecordForVerify(JobControlRecord* jcr, const DeviceRecord* rec)
+{
+  if (!jcr->is_JobType(JT_VERIFY)
+      || jcr->getJobLevel() != L_VERIFY_VOLUME_TO_CATALOG) {
+    return false;
+  }
+  switch (rec->maskedStream) {
+    case STREAM_UNIX_ATTRIBUTES:
+    case STREAM_UNIX_ATTRIBUTES_EX:
+    case STREAM_RESTORE_OBJECT:
+    case STREAM_MD5_DIGEST:
+    case STREAM_SHA1_DIGEST:
+    case STREAM_SHA256_DIGEST:
+    case STREAM_SHA512_DIGEST:
+    case STREAM_XXH128_DIGEST:
+    case STREAM_XXH3_TREE_DIGEST:
+      return false;
+    default:
+      return true;
+  }
+}
+
+namespace {
+/* Sends the records to the File daemon on its own thread, so that reading
+ * the next records from the volume does not wait for the network. */
+class RecordSender {
+ public:
+  RecordSender(BareosSocket* t_fd, std::size_t capacity)
+      : RecordSender{t_fd, channel::CreateSpscChannel<queued_record>(
+                               capacity)}
+  {
+  }
+
+  // rec is copied, so it can be reused as soon as this returns
+  bool Queue(const DeviceRecord* rec)
+  {
+    queued_record qrec{rec->VolSessionId, rec->VolSessionTime,
+                       rec->FileIndex,    rec->Stream,
+                       rec->data_len,     PoolMem(PM_MESSAGE)};
+    qrec.data.check_size(rec->data_len + 1);
+    memcpy(qrec.data.addr(), rec->data, rec->data_len);
+    return input.emplace(std::move(qrec));
+  }
+
+  // Wait until everything queued was sent; returns the error if any
+  std::optional<std::string> Finish()
+  {
+    input.close();
+    if (send_thread.joinable()) { send_thread.join(); }
+    std::unique_lock lock(error_mutex);
+    return error;
+  }
+
+  ~RecordSender() { Finish(); }
+
+ private:
+  struct queued_record {
+    uint32_t VolSessionId;
+    uint32_t VolSessionTime;
+    int32_t FileIndex;
+    int32_t Stream;
+    uint32_t data_len;
+    PoolMem data;
+  };
+
+  RecordSender(BareosSocket* t_fd, channel::channel_pair<queued_record> chan)
+      : fd{t_fd}
+      , input{std::move(chan.first)}
+      , output{std::move(chan.second)}
+      , send_thread{enlist, this}
+  {
+  }
+
+  BareosSocket* fd;
+  channel::input<queued_record> input;
+  channel::output<queued_record> output;
+  std::mutex error_mutex;
+  std::optional<std::string> error;
+
+  // send_thread has to be defined last, it uses everything else immediately
+  std::thread send_thread;
+
+  void do_work()
+  {
+    while (std::optional<queued_record> qrec = output.get()) {
+      if (!fd->fsend(rec_header, qrec->VolSessionId, qrec->VolSessionTime,
+                     qrec->FileIndex, qrec->Stream, qrec->data_len)) {
+        SetError();
+        break;
+      }
+
+      POOLMEM* save_msg = fd->msg;
+      fd->msg = qrec->data.addr();
+      fd->message_length = qrec->data_len;
+      bool ok = fd->send();
+      qrec->data.addr() = fd->msg;
+      fd->msg = save_msg;
+      if (!ok) {
+        SetError();
+        break;
+      }
+    }
+    // let Queue() fail from now on
+    output.close();
+  }
+
+  void SetError()
+  {
+    std::unique_lock lock(error_mutex);
+    error.emplace(fd->bstrerror());
+  }
+
+  static void enlist(RecordSender* sender) { sender->do_work(); }
+};
+
+bool QueueRecordCb(DeviceControlRecord* dcr,
+                   DeviceRecord* rec,
+                   void* user_data)
+{
+  if (rec->FileIndex < 0) { return true; }
+  if (SkipRecordForVerify(dcr->jcr, rec)) { return true; }
+
+  auto* sender = static_cast<RecordSender*>(user_data);
+  if (!sender->Queue(rec)) {
+    // the sender stopped; the error is reported by DoReadData()
+    return false;
+  }
+  return true;
+}
+}  // namespace
+
 /**
  * Read Data and send to File Daemon
  *
@@ -91,7 +232,17 @@ bool DoReadData(JobControlRecord* jcr)
   // Tell File daemon we will send data
   fd->fsend(OK_data);
   jcr->sendJobStatus(JS_Running);
-  ok = ReadRecords(dcr, RecordCb, MountNextReadVolume);
+  if (me->restore_send_ahead > 0) {
+    RecordSender sender(fd, me->restore_send_ahead);
+    ok = ReadRecords(dcr, QueueRecordCb, MountNextReadVolume, &sender);
+    if (auto error = sender.Finish()) {
+      Jmsg1(jcr, M_FATAL, 0, T_("Error sending to File daemon. ERR=%s\n"),
+            error->c_str());
+      ok = false;
+    }
+  } else {
+    ok = ReadRecords(dcr, RecordCb, MountNextReadVolume);
+  }
 
   // Send end of data to FD
   fd->signal(BNET_EOD);
@@ -117,6 +268,7 @@ static bool RecordCb(DeviceControlRecord* dcr, DeviceRecord* rec)
   char ec1[50], ec2[50];
 
   if (rec->FileIndex < 0) { return true; }
+  if (SkipRecordForVerify(jcr, rec)) { return true; }
 
   Dmsg5(400, "Send to FD: SessId=%u SessTim=%u FI=%s Strm=%s, len=%d\n",
         rec->VolSessionId, rec->VolSessionTime,
@@ -134,20 +286,26 @@ static bool RecordCb(DeviceControlRecord* dcr, DeviceRecord* rec)
     Dmsg1(400, ">filed: Hdr=%s\n", fd->msg);
   }
 
-  // Send data record to File daemon
-  save_msg = fd->msg;  /* save fd message pointer */
-  fd->msg = rec->data; /* pass data directly to the FD */
-  fd->message_length = rec->data_len;
+  /* Send data record to File daemon.  If it is still on the volume file as a
+   * whole the kernel can send it from there (and encrypt it with kTLS). */
+  if (rec->data_addr >= 0 && dcr->dev->IsOpen() && fd->CanSendFileRange()) {
+    Dmsg2(400, ">filed: send %d bytes data from volume at %lld.\n",
+          rec->data_len, (long long)rec->data_addr);
+    ok = fd->SendFileRange(dcr->dev->fd, rec->data_addr, rec->data_len);
+  } else {
+    save_msg = fd->msg;  /* save fd message pointer */
+    fd->msg = rec->data; /* pass data directly to the FD */
+    fd->message_length = rec->data_len;
 
-  Dmsg1(400, ">filed: send %d bytes data.\n", fd->message_length);
-  if (!fd->send()) {
+    Dmsg1(400, ">filed: send %d bytes data.\n", fd->message_length);
+    ok = fd->send();
+    fd->msg = save_msg; /* restore fd message pointer */
+  }
+  if (!ok) {
     Pmsg1(000, T_("Error sending to FD. ERR=%s\n"), fd->bstrerror());
     Jmsg1(jcr, M_FATAL, 0, T_("Error sending to File daemon. ERR=%s\n"),
           fd->bstrerror());
-
-    ok = false;
   }
-  fd->msg = save_msg; /* restore fd message pointer */
 
   return ok;
 }
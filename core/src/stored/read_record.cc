@@ -42,6 +42,7 @@
 #include "stored/label.h"
 #include "stored/match_bsr.h"
 #include "stored/read_ctx.h"
+#include "stored/read_record.h"
 #include "include/jcr.h"
 
 namespace storagedaemon {
@@ -389,6 +390,21 @@ bool ReadRecords(DeviceControlRecord* dcr,
                                void* user_data),
                  bool mount_cb(DeviceControlRecord* dcr),
                  void* user_data)
+{
+  return ReadRecords(dcr, RecordCb, nullptr, mount_cb, user_data);
+}
+
+/* As above, but each block is first given to BlockCb (if set), which may
+ * process it as a whole or only a part of it. */
+bool ReadRecords(DeviceControlRecord* dcr,
+                 bool RecordCb(DeviceControlRecord* dcr,
+                               DeviceRecord* rec,
+                               void* user_data),
+                 BlockCbResult BlockCb(DeviceControlRecord* dcr,
+                                       READ_CTX* rctx,
+                                       void* user_data),
+                 bool mount_cb(DeviceControlRecord* dcr),
+                 void* user_data)
 {
   JobControlRecord* jcr = dcr->jcr;
   READ_CTX* rctx;
@@ -425,6 +441,16 @@ bool ReadRecords(DeviceControlRecord* dcr,
     rctx->records_processed = 0;
     ClearAllBits(REC_STATE_MAX, rctx->rec->state_bits);
     rctx->lastFileIndex = READ_NO_FILEINDEX;
+
+    if (BlockCb) {
+      BlockCbResult result = BlockCb(dcr, rctx, user_data);
+      if (result == BlockCbResult::FAILED) {
+        ok = false;
+        break;
+      }
+      if (result == BlockCbResult::HANDLED) { continue; }
+    }
+
     Dmsg1(debuglevel, "Block %s empty\n",
           IsBlockEmpty(rctx->rec) ? "is" : "NOT");
 
@@ -50,6 +50,24 @@ bool ReadRecords(DeviceControlRecord* dcr,
                  bool mount_cb(DeviceControlRecord* dcr),
                  void* user_data);
 
+// What ReadRecords() should do with a block after its block callback ran
+enum class BlockCbResult
+{
+  HANDLED,      /**< the callback consumed the whole block */
+  READ_RECORDS, /**< pass the rest of the block record by record */
+  FAILED
+};
+
+bool ReadRecords(DeviceControlRecord* dcr,
+                 bool RecordCb(DeviceControlRecord* dcr,
+                               DeviceRecord* rec,
+                               void* user_data),
+                 BlockCbResult BlockCb(DeviceControlRecord* dcr,
+                                       READ_CTX* rctx,
+                                       void* user_data),
+                 bool mount_cb(DeviceControlRecord* dcr),
+                 void* user_data);
+
 template <typename T>
 inline bool ReadRecords(DeviceControlRecord* dcr,
                         bool RecordCb(DeviceControlRecord* dcr,
@@ -73,6 +91,40 @@ inline bool ReadRecords(DeviceControlRecord* dcr,
       mount_cb, reinterpret_cast<void*>(&capture));
 }
 
+/* Same as above, but every block is first offered to BlockCb, which can
+ * process it without it being split into records. */
+template <typename T>
+inline bool ReadRecords(DeviceControlRecord* dcr,
+                        bool RecordCb(DeviceControlRecord* dcr,
+                                      DeviceRecord* rec,
+                                      T* user_data),
+                        BlockCbResult BlockCb(DeviceControlRecord* dcr,
+                                              READ_CTX* rctx,
+                                              T* user_data),
+                        bool mount_cb(DeviceControlRecord* dcr),
+                        T* user_data)
+{
+  struct callbacks {
+    decltype(RecordCb) record;
+    decltype(BlockCb) block;
+    T* data;
+  } cbs{RecordCb, BlockCb, user_data};
+
+  return ReadRecords(
+      dcr,
+      +[](DeviceControlRecord* inner_dcr, DeviceRecord* inner_rec,
+          void* impl) -> bool {
+        auto* inner = static_cast<callbacks*>(impl);
+        return inner->record(inner_dcr, inner_rec, inner->data);
+      },
+      +[](DeviceControlRecord* inner_dcr, READ_CTX* inner_rctx,
+          void* impl) -> BlockCbResult {
+        auto* inner = static_cast<callbacks*>(impl);
+        return inner->block(inner_dcr, inner_rctx, inner->data);
+      },
+      mount_cb, static_cast<void*>(&cbs));
+}
+
 } /* namespace storagedaemon */
 
 #endif  // BAREOS_STORED_READ_RECORD_H_
@@ -34,14 +34,22 @@
 #include "stored/stored.h"
 #include "stored/device_control_record.h"
 #include "lib/attribs.h"
+#include "lib/bsock.h"
 #include "lib/util.h"
 #include "include/jcr.h"
 #include "lib/crypto.h"
 #include "lib/base64.h"
 #include "lib/serial.h"
+#include "lib/metrics.h"
+#include "lib/trace_ring.h"
 
 namespace storagedaemon {
 
+static metrics::counter records_written{"bareos_sd_written_records",
+                                        "Records put into blocks"};
+static metrics::counter records_read{"bareos_sd_read_records",
+                                     "Records read from blocks"};
+
 /**
  * Convert a FileIndex into a printable
  * ASCII string.  Not reentrant.
@@ -163,6 +171,14 @@ static const char* record_compression_to_str(PoolMem& resultbuffer,
           compression_to_str(resultbuffer, "FZ4H", comp_len, comp_level,
                              comp_version);
           break;
+        case COMPRESS_ZSTD:
+          compression_to_str(resultbuffer, "ZSTD", comp_len, comp_level,
+                             comp_version);
+          break;
+        case COMPRESS_NONE:
+          compression_to_str(resultbuffer, "NONE", comp_len, comp_level,
+                             comp_version);
+          break;
         default:
           tmp.bsprintf(
               T_("Compression algorithm 0x%x found, but not supported!\n"),
@@ -210,6 +226,10 @@ static const char* record_digest_to_str(PoolMem& resultbuffer,
       BinToBase64(digest, sizeof(digest), (char*)rec->data,
                   CRYPTO_DIGEST_XXH128_SIZE, true);
       break;
+    case STREAM_XXH3_TREE_DIGEST:
+      BinToBase64(digest, sizeof(digest), (char*)rec->data,
+                  CRYPTO_DIGEST_XXH3_TREE_SIZE, true);
+      break;
     default:
       return "";
   }
@@ -544,6 +564,7 @@ void EmptyRecord(DeviceRecord* rec)
   rec->VolSessionId = rec->VolSessionTime = 0;
   rec->FileIndex = rec->Stream = 0;
   rec->data_len = rec->remainder = 0;
+  rec->data_addr = -1;
 
   ClearBit(REC_PARTIAL_RECORD, rec->state_bits);
   ClearBit(REC_BLOCK_EMPTY, rec->state_bits);
@@ -559,6 +580,7 @@ void CopyRecordState(DeviceRecord* dst, DeviceRecord* src)
   int32_t Stream, maskedStream;
   uint32_t data_len;
   POOLMEM* data;
+  int64_t data_addr;
 
   // Preserve some important fields all other can be overwritten.
   Stream = dst->Stream;
@@ -566,6 +588,7 @@ void CopyRecordState(DeviceRecord* dst, DeviceRecord* src)
   data = dst->data;
   data_len = dst->data_len;
   own_mempool = dst->own_mempool;
+  data_addr = dst->data_addr;
 
   memcpy(dst, src, sizeof(DeviceRecord));
 
@@ -574,6 +597,7 @@ void CopyRecordState(DeviceRecord* dst, DeviceRecord* src)
   dst->data = data;
   dst->data_len = data_len;
   dst->own_mempool = own_mempool;
+  dst->data_addr = data_addr;
 }
 
 // Free the record entity
@@ -631,6 +655,130 @@ static inline ssize_t WriteDataToBlock(DeviceBlock* block,
   return len;
 }
 
+// Same as WriteDataToBlock() but the data is received from source.
+static inline ssize_t ReceiveDataToBlock(DeviceBlock* block,
+                                         const DeviceRecord* rec,
+                                         BareosSocket* source)
+{
+  uint32_t len;
+
+  len = MIN(rec->remainder, BlockWriteNavail(block));
+  if (len == 0) { return 0; }
+  if (source->RecvContent(block->bufp, len) != (int32_t)len) { return -1; }
+  block->bufp += len;
+  block->binbuf += len;
+  return len;
+}
+
+/* The header of a BB02 record as it is in the block, all fields in network
+ * byte order.  Records that fit into a block as a whole are packed and
+ * unpacked through it with one copy each instead of field by field. */
+struct record_header {
+  int32_t FileIndex;
+  int32_t Stream;
+  uint32_t data_len;
+};
+static_assert(sizeof(record_header) == RECHDR2_LENGTH);
+
+// Packs a new record that fits into the block, see WriteRecordToBlock()
+static inline void PackWholeRecord(DeviceBlock* block, const DeviceRecord* rec)
+{
+  const record_header header{static_cast<int32_t>(htonl(rec->FileIndex)),
+                             static_cast<int32_t>(htonl(rec->Stream)),
+                             htonl(rec->data_len)};
+  memcpy(block->bufp, &header, sizeof(header));
+  memcpy(block->bufp + sizeof(header), rec->data, rec->data_len);
+  block->bufp += sizeof(header) + rec->data_len;
+  block->binbuf += sizeof(header) + rec->data_len;
+
+  block->VolSessionId = rec->VolSessionId;
+  block->VolSessionTime = rec->VolSessionTime;
+  if (rec->FileIndex > 0) {
+    if (block->FirstIndex == 0) { block->FirstIndex = rec->FileIndex; }
+    block->LastIndex = rec->FileIndex;
+  }
+}
+
+/**
+ * Write a translated record to the block, writing out the block whenever it
+ * is full.
+ */
+static bool AppendRecordToBlock(DeviceControlRecord* dcr, DeviceRecord* rec)
+{
+  JobControlRecord* jcr = dcr->jcr;
+  char buf1[100], buf2[100];
+  auto build_block = [dcr, rec] {
+    auto timer
+        = dcr->jcr->sd_impl->stage_times.Time(append_stage::kBlockBuild);
+    return WriteRecordToBlock(dcr, rec);
+  };
+
+  while (!build_block()) {
+    Dmsg2(850, "!WriteRecordToBlock data_len=%d rem=%d\n", rec->data_len,
+          rec->remainder);
+    if (!dcr->WriteBlockToDevice()) {
+      Dmsg2(90, "Got WriteBlockToDev error on device %s. %s\n",
+            dcr->dev->print_name(), dcr->dev->bstrerror());
+      return false;
+    }
+  }
+
+  jcr->JobBytes += rec->data_len; /* increment bytes this job */
+  if (jcr->sd_impl->RemainingQuota
+      && jcr->JobBytes > jcr->sd_impl->RemainingQuota) {
+    Jmsg0(jcr, M_FATAL, 0, T_("Quota Exceeded. Job Terminated.\n"));
+    return false;
+  }
+
+  Dmsg4(850, "WriteRecord FI=%s SessId=%d Strm=%s len=%d\n",
+        FI_to_ascii(buf1, rec->FileIndex), rec->VolSessionId,
+        stream_to_ascii(buf2, rec->Stream, rec->FileIndex), rec->data_len);
+
+  return true;
+}
+
+/**
+ * Write the deferred records whose translation is done, and wait for the
+ * oldest ones while they take more than max_deferred_bytes.  With all set
+ * every deferred record gets written.
+ *
+ * Returns: false means the block could not be written to tape/disk.
+ */
+bool DeviceControlRecord::WriteDeferredRecords(bool all)
+{
+  while (!deferred_records.empty()) {
+    DeferredRecord& oldest = deferred_records.front();
+    if (!all && deferred_bytes <= max_deferred_bytes
+        && oldest.record.wait_for(std::chrono::seconds(0))
+               != std::future_status::ready) {
+      break;
+    }
+
+    DeviceRecord* translated = oldest.record.get();
+    deferred_bytes -= oldest.size;
+    deferred_records.pop_front();
+
+    bool ok = AppendRecordToBlock(this, translated);
+    FreeRecord(translated);
+    if (!ok) {
+      DiscardDeferredRecords();
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Wait for the deferred records and drop them
+void DeviceControlRecord::DiscardDeferredRecords()
+{
+  for (DeferredRecord& deferred : deferred_records) {
+    FreeRecord(deferred.record.get());
+  }
+  deferred_records.clear();
+  deferred_bytes = 0;
+}
+
 /**
  * Write a Record to the block
  *
@@ -641,7 +789,7 @@ bool DeviceControlRecord::WriteRecord()
 {
   bool retval = false;
   bool translated_record = false;
-  char buf1[100], buf2[100];
+  std::size_t num_deferred = deferred_records.size();
 
   // Perform record translations.
   before_rec = rec;
@@ -651,6 +799,11 @@ bool DeviceControlRecord::WriteRecord()
     goto bail_out;
   }
 
+  // A plugin translates the record on its own time
+  if (deferred_records.size() > num_deferred) {
+    return WriteDeferredRecords();
+  }
+
   /* The record got translated when we got an after_rec pointer after calling
    * the bSdEventWriteRecordTranslation plugin event. If no translation has
    * taken place we just point the after_rec pointer to same DeviceRecord as in
@@ -661,27 +814,10 @@ bool DeviceControlRecord::WriteRecord()
     translated_record = true;
   }
 
-  while (!WriteRecordToBlock(this, after_rec)) {
-    Dmsg2(850, "!WriteRecordToBlock data_len=%d rem=%d\n", after_rec->data_len,
-          after_rec->remainder);
-    if (!WriteBlockToDevice()) {
-      Dmsg2(90, "Got WriteBlockToDev error on device %s. %s\n",
-            dev->print_name(), dev->bstrerror());
-      goto bail_out;
-    }
-  }
-
-  jcr->JobBytes += after_rec->data_len; /* increment bytes this job */
-  if (jcr->sd_impl->RemainingQuota
-      && jcr->JobBytes > jcr->sd_impl->RemainingQuota) {
-    Jmsg0(jcr, M_FATAL, 0, T_("Quota Exceeded. Job Terminated.\n"));
-    goto bail_out;
-  }
+  // Records deferred before this one go first
+  if (!WriteDeferredRecords(true)) { goto bail_out; }
 
-  Dmsg4(850, "WriteRecord FI=%s SessId=%d Strm=%s len=%d\n",
-        FI_to_ascii(buf1, after_rec->FileIndex), after_rec->VolSessionId,
-        stream_to_ascii(buf2, after_rec->Stream, after_rec->FileIndex),
-        after_rec->data_len);
+  if (!AppendRecordToBlock(this, after_rec)) { goto bail_out; }
 
   retval = true;
 
@@ -695,6 +831,56 @@ bail_out:
   return retval;
 }
 
+/**
+ * Receive a Record into the block
+ *
+ * Like WriteRecord(), but the rec->data_len bytes of data are received from
+ * sock directly into the block instead of being copied from rec->data.
+ * No record translation takes place, so this must only be used when no
+ * plugin wants to translate the records of this job.
+ *
+ * Returns: false means the data could not be received or the block could
+ *          not be written to tape/disk.
+ *          true on success (all bytes written to the block).
+ */
+bool DeviceControlRecord::ReceiveRecord(BareosSocket* sock)
+{
+  char buf1[100], buf2[100];
+
+  auto build_block = [this, sock] {
+    auto timer = jcr->sd_impl->stage_times.Time(append_stage::kBlockBuild);
+    return WriteRecordToBlock(this, rec, sock);
+  };
+  while (!build_block()) {
+    if (sock->IsError()) {
+      Dmsg1(90, "Got network error receiving record data. %s\n",
+            sock->bstrerror());
+      rec->state = st_none;
+      return false;
+    }
+    Dmsg2(850, "!WriteRecordToBlock data_len=%d rem=%d\n", rec->data_len,
+          rec->remainder);
+    if (!WriteBlockToDevice()) {
+      Dmsg2(90, "Got WriteBlockToDev error on device %s. %s\n",
+            dev->print_name(), dev->bstrerror());
+      return false;
+    }
+  }
+
+  jcr->JobBytes += rec->data_len; /* increment bytes this job */
+  if (jcr->sd_impl->RemainingQuota
+      && jcr->JobBytes > jcr->sd_impl->RemainingQuota) {
+    Jmsg0(jcr, M_FATAL, 0, T_("Quota Exceeded. Job Terminated.\n"));
+    return false;
+  }
+
+  Dmsg4(850, "ReceiveRecord FI=%s SessId=%d Strm=%s len=%d\n",
+        FI_to_ascii(buf1, rec->FileIndex), rec->VolSessionId,
+        stream_to_ascii(buf2, rec->Stream, rec->FileIndex), rec->data_len);
+
+  return true;
+}
+
 /**
  * Write a Record to the block
  *
@@ -708,8 +894,13 @@ bail_out:
  *  been transferred the last time (when remainder is
  *  non-zero), and 2. The remaining bytes to write may not
  *  all fit into the block.
+ *
+ *  If source is given, the data is received from that socket
+ *  instead of being copied from rec->data.
  */
-bool WriteRecordToBlock(DeviceControlRecord* dcr, DeviceRecord* rec)
+bool WriteRecordToBlock(DeviceControlRecord* dcr,
+                        DeviceRecord* rec,
+                        BareosSocket* source)
 {
   ssize_t n;
   char buf1[100], buf2[100];
@@ -732,6 +923,20 @@ bool WriteRecordToBlock(DeviceControlRecord* dcr, DeviceRecord* rec)
 
     switch (rec->state) {
       case st_none:
+        /* A record that fits with at least one data byte behind its header
+         * is copied in one go, the result is the same as going through the
+         * states below. */
+        if (!source && BlockWriteNavail(block) > WRITE_RECHDR_LENGTH
+            && BlockWriteNavail(block) - WRITE_RECHDR_LENGTH
+                   >= rec->data_len) {
+          PackWholeRecord(block, rec);
+          rec->remainder = 0;
+          records_written.Add();
+          Dtrace(kRecord, "write record FI=%d Stream=%d len=%u",
+                 rec->FileIndex, rec->Stream, rec->data_len);
+          return true;
+        }
+
         // Figure out what to do
         rec->state = st_header;
         rec->remainder = rec->data_len; /* length of data remaining to write */
@@ -789,7 +994,13 @@ bool WriteRecordToBlock(DeviceControlRecord* dcr, DeviceRecord* rec)
          * Part of it may have already been transferred, and we
          * may not have enough room to transfer the whole this time. */
         if (rec->remainder > 0) {
-          n = WriteDataToBlock(block, rec);
+          if (source) {
+            n = ReceiveDataToBlock(block, rec, source);
+            // the caller finds out about the error from the socket
+            if (n < 0) { return false; }
+          } else {
+            n = WriteDataToBlock(block, rec);
+          }
           if (n < 0) {
             /* error appending data to block should be impossible
              * unless something is broken */
@@ -809,6 +1020,9 @@ bool WriteRecordToBlock(DeviceControlRecord* dcr, DeviceRecord* rec)
 
         rec->remainder = 0; /* did whole transfer */
         rec->state = st_none;
+        records_written.Add();
+        Dtrace(kRecord, "write record FI=%d Stream=%d len=%u", rec->FileIndex,
+               rec->Stream, rec->data_len);
         return true;
 
       default:
@@ -838,6 +1052,49 @@ uint64_t GetRecordAddress(const DeviceRecord* rec)
   return ((uint64_t)rec->File) << 32 | rec->Block;
 }
 
+/* Unpacks a BB02 record that is in the block as a whole and does not
+ * continue a previous one, see ReadRecordFromBlock().  Returns false if the
+ * record needs the general path. */
+static inline bool UnpackWholeRecord(DeviceBlock* block, DeviceRecord* rec)
+{
+  if (block->BlockVer == 1 || rec->remainder != 0
+      || block->binbuf < RECHDR2_LENGTH) {
+    return false;
+  }
+
+  record_header header;
+  memcpy(&header, block->bufp, sizeof(header));
+  const int32_t Stream = static_cast<int32_t>(ntohl(header.Stream));
+  const uint32_t data_bytes = ntohl(header.data_len);
+  if (Stream < 0 || data_bytes >= MAX_BLOCK_LENGTH
+      || data_bytes > block->binbuf - RECHDR2_LENGTH) {
+    return false;
+  }
+
+  rec->VolSessionId = block->VolSessionId;
+  rec->VolSessionTime = block->VolSessionTime;
+  rec->FileIndex = static_cast<int32_t>(ntohl(header.FileIndex));
+  rec->Stream = Stream;
+  rec->maskedStream = Stream & STREAMMASK_TYPE;
+  if (rec->FileIndex > 0) {
+    if (block->FirstIndex == 0) { block->FirstIndex = rec->FileIndex; }
+    block->LastIndex = rec->FileIndex;
+  }
+
+  block->bufp += RECHDR2_LENGTH;
+  block->binbuf -= RECHDR2_LENGTH;
+  rec->data_addr = block->file_addr >= 0
+                       ? block->file_addr + (block->bufp - block->buf)
+                       : -1;
+  rec->data = CheckPoolMemorySize(rec->data, data_bytes);
+  memcpy(rec->data, block->bufp, data_bytes);
+  block->bufp += data_bytes;
+  block->binbuf -= data_bytes;
+  rec->data_len = data_bytes;
+  rec->remainder = 0;
+  return true;
+}
+
 /**
  * Read a Record from the block
  *
@@ -867,6 +1124,14 @@ bool ReadRecordFromBlock(DeviceControlRecord* dcr, DeviceRecord* rec)
   rec->Block = ((Device*)(dcr->block->dev))->EndBlock;
   rec->File = ((Device*)(dcr->block->dev))->EndFile;
 
+  if (UnpackWholeRecord(dcr->block, rec)) {
+    Dmsg4(450, "Rtn full rd_rec_blk FI=%s SessId=%d Strm=%s len=%d\n",
+          FI_to_ascii(buf1, rec->FileIndex), rec->VolSessionId,
+          stream_to_ascii(buf2, rec->Stream, rec->FileIndex), rec->data_len);
+    records_read.Add();
+    return true;
+  }
+
   /* Get the header. There is always a full header, otherwise we find it in the
    * next block. */
   Dmsg3(450, "Block=%d Ver=%d size=%u\n", dcr->block->BlockNumber,
@@ -975,8 +1240,13 @@ bool ReadRecordFromBlock(DeviceControlRecord* dcr, DeviceRecord* rec)
    * data record may have previously been transferred,
    * 2. The current block may not contain the whole data
    * record. */
+  rec->data_addr = -1;
   if (remlen >= data_bytes) {
     // Got whole record
+    if (rec->data_len == 0 && dcr->block->file_addr >= 0) {
+      rec->data_addr
+          = dcr->block->file_addr + (dcr->block->bufp - dcr->block->buf);
+    }
     memcpy(rec->data + rec->data_len, dcr->block->bufp, data_bytes);
     dcr->block->bufp += data_bytes;
     dcr->block->binbuf -= data_bytes;
@@ -998,6 +1268,7 @@ bool ReadRecordFromBlock(DeviceControlRecord* dcr, DeviceRecord* rec)
   Dmsg4(450, "Rtn full rd_rec_blk FI=%s SessId=%d Strm=%s len=%d\n",
         FI_to_ascii(buf1, rec->FileIndex), rec->VolSessionId,
         stream_to_ascii(buf2, rec->Stream, rec->FileIndex), rec->data_len);
+  records_read.Add();
 
   return true; /* transferred full record */
 }
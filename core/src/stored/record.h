@@ -32,6 +32,7 @@
 #include "lib/dlist.h"
 
 template <typename T> class dlist;
+class BareosSocket;
 
 namespace storagedaemon {
 
@@ -124,6 +125,8 @@ struct DeviceRecord {
   POOLMEM* data{nullptr};  /**< Record data. This MUST be a memory pool item */
   int32_t match_stat{0};   /**< BootStrapRecord match status */
   bool own_mempool{false}; /**< Do we own the POOLMEM pointed to in data ? */
+  int64_t data_addr{-1};   /**< Volume address of data if it was read in one
+                              piece from a plain file volume, else -1 */
 };
 
 /*
@@ -252,7 +255,9 @@ const char* record_to_str(PoolMem& resultbuffer,
                           JobControlRecord* jcr,
                           const DeviceRecord* rec);
 void DumpRecord(const char* tag, const DeviceRecord* rec);
-bool WriteRecordToBlock(DeviceControlRecord* dcr, DeviceRecord* rec);
+bool WriteRecordToBlock(DeviceControlRecord* dcr,
+                        DeviceRecord* rec,
+                        BareosSocket* source = nullptr);
 bool CanWriteRecordToBlock(DeviceBlock* block, const DeviceRecord* rec);
 bool ReadRecordFromBlock(DeviceControlRecord* dcr, DeviceRecord* rec);
 DeviceRecord* new_record(bool with_data = true);
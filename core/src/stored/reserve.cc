@@ -36,22 +36,35 @@
 #include "stored/sd_device_control_record.h"
 #include "stored/acquire.h"
 #include "stored/autochanger.h"
+#include "stored/device.h"
+#include "stored/shared_read.h"
 #include "stored/stored_jcr_impl.h"
 #include "stored/wait.h"
 #include "lib/berrno.h"
+#include "lib/lock_profile.h"
 #include "lib/util.h"
 #include "lib/bsock.h"
 #include "include/jcr.h"
 #include "lib/parse_conf.h"
 
 #include <cinttypes>
+#include <map>
+#include <set>
+#include <string_view>
 
 namespace storagedaemon {
 
 const int debuglevel = 150;
 
 /* Global static variables */
-static std::mutex* reservation_mutex = nullptr;
+/* A reservation only looks at the devices and Volumes of the Media Types the
+ * job asked for, so jobs wanting different Media Types do not have to wait
+ * for each other. */
+struct reservation_locks {
+  lock_profile::mutex mutex{"reservations"}; /* protects by_media_type */
+  std::map<std::string, lock_profile::mutex, std::less<>> by_media_type;
+};
+static reservation_locks* reservations = nullptr;
 
 /* Forward referenced functions */
 static int CanReserveDrive(DeviceControlRecord* dcr, ReserveContext& rctx);
@@ -88,33 +101,67 @@ bool use_cmd(JobControlRecord* jcr)
   return true;
 }
 
-/**
- * This allows a given thread to recursively call LockReservations.
- * It must, of course, call unlock_... the same number of times.
- */
 void InitReservationsLock()
 {
   // in a normal daemon this should never happen, but some tools do this
   // whenever they create a new jcr, so we have to guard against it!
-  if (reservation_mutex) { return; }
+  if (reservations) { return; }
 
-  reservation_mutex = new std::mutex;
+  reservations = new reservation_locks;
 
   InitVolListLock();
 }
 
 void TermReservationsLock()
 {
-  ASSERT(reservation_mutex);
-  delete reservation_mutex;
-  reservation_mutex = nullptr;
+  ASSERT(reservations);
+  delete reservations;
+  reservations = nullptr;
   TermVolListLock();
 }
 
-// This applies to a drive and to Volumes
-void LockReservations() { reservation_mutex->lock(); }
+static lock_profile::mutex& MediaTypeLock(std::string_view media_type)
+{
+  std::unique_lock lock(reservations->mutex);
+  auto& locks = reservations->by_media_type;
+  auto found = locks.find(media_type);
+  if (found == locks.end()) {
+    std::string name{media_type};
+    found = locks.try_emplace(name, "reservations of " + name).first;
+  }
+  return found->second;
+}
+
+// This applies to the drives and Volumes of a Media Type
+void LockReservations(const char* media_type)
+{
+  MediaTypeLock(media_type).lock();
+}
+
+void UnlockReservations(const char* media_type)
+{
+  MediaTypeLock(media_type).unlock();
+}
+
+namespace {
+// Locks the reservations of all Media Types of a job, always in the same order
+class MediaTypeLocker {
+ public:
+  explicit MediaTypeLocker(const std::vector<director_storage>& storages)
+  {
+    std::set<std::string_view> media_types;
+    for (auto& store : storages) { media_types.insert(store.media_type); }
+    for (auto media_type : media_types) {
+      locks_.emplace_back(MediaTypeLock(media_type));
+    }
+  }
+
+  void unlock() { locks_.clear(); }
 
-void UnlockReservations() { reservation_mutex->unlock(); }
+ private:
+  std::vector<std::unique_lock<lock_profile::mutex>> locks_;
+};
+}  // namespace
 
 void DeviceControlRecord::SetReserved()
 {
@@ -140,13 +187,19 @@ void DeviceControlRecord::ClearReserved()
  */
 void DeviceControlRecord::UnreserveDevice()
 {
+  bool released = false;
+
   dev->Lock();
   if (IsReserved()) {
     ClearReserved();
+    released = true;
     reserved_volume = false;
 
-    // If we set read mode in reserving, remove it
-    if (dev->CanRead()) { dev->ClearRead(); }
+    /* If we set read mode in reserving, remove it, unless someone else reads
+     * the device for us */
+    if (dev->CanRead() && !(shared_read && SharedReadInProgress(dev))) {
+      dev->ClearRead();
+    }
 
     if (dev->num_writers < 0) {
       Jmsg1(jcr, M_ERROR, 0, T_("Hey! num_writers=%d!!!!\n"), dev->num_writers);
@@ -158,6 +211,9 @@ void DeviceControlRecord::UnreserveDevice()
     }
   }
   dev->Unlock();
+
+  // Jobs waiting for a device can try this one now
+  if (released) { ReleaseDeviceCond(); }
 }
 
 bool TryReserveAfterUse(JobControlRecord* jcr, bool append)
@@ -196,7 +252,9 @@ bool TryReserveAfterUse(JobControlRecord* jcr, bool append)
   rctx.append = append;
 
   for (; !fail && !jcr->IsJobCanceled();) {
-    std::unique_lock reservation_lock(*reservation_mutex);
+    // releases from now on end the waits below
+    uint64_t releases = DeviceReleases();
+    MediaTypeLocker reservation_lock(jcr->sd_impl->dirstores);
     ClearReserveMessages(jcr);
     rctx.suitable_device = false;
     rctx.have_volume = false;
@@ -245,11 +303,11 @@ bool TryReserveAfterUse(JobControlRecord* jcr, bool append)
      * jobs, we will simply try again, and most likely succeed.
      * This can happen if one job reserves a drive or finishes using
      * a drive at the same time a second job wants it. */
-    if (repeat++ > 1) {   /* try algorithm 3 times */
-      Bmicrosleep(30, 0); /* wait a bit */
+    if (repeat++ > 1) { /* try algorithm 3 times */
+      WaitForDevice(jcr, wait_for_device_retries, releases, 30);
       Dmsg0(debuglevel, "repeat reserve algorithm\n");
     } else if (!rctx.suitable_device
-               || !WaitForDevice(jcr, wait_for_device_retries)) {
+               || !WaitForDevice(jcr, wait_for_device_retries, releases)) {
       Dmsg0(debuglevel, "Fail. !suitable_device || !WaitForDevice\n");
       fail = true;
     }
@@ -565,7 +623,7 @@ int SearchResForDevice(JobControlRecord* jcr, ReserveContext& rctx)
             rctx.device_resource->resource_name_, rctx.device_name);
 
       // Find resource, and make sure we were able to open it
-      if (bstrcmp(rctx.device_name, rctx.device_resource->resource_name_)) {
+      if (rctx.device_resource->IsNamed(rctx.device_name)) {
         status = ReserveDevice(jcr, rctx);
         if (status != 1) { /* Try another device_resource */
           continue;
@@ -654,10 +712,7 @@ static int ReserveDevice(JobControlRecord* jcr, ReserveContext& rctx)
   }
 
   // Make sure device_resource exists -- i.e. we can stat() it
-  if (!rctx.device_resource->dev) {
-    rctx.device_resource->dev = FactoryCreateDevice(jcr, rctx.device_resource);
-  }
-  if (!rctx.device_resource->dev) {
+  if (!InitDevice(jcr, rctx.device_resource)) {
     if (rctx.device_resource->changer_res) {
       Jmsg(jcr, M_WARNING, 0,
            T_("\n"
@@ -684,7 +739,8 @@ static int ReserveDevice(JobControlRecord* jcr, ReserveContext& rctx)
   }
 
   ASSERT(dcr);
-  SetupNewDcrDevice(jcr, dcr, rctx.device_resource->dev, NULL);
+  // the buffers wait for AcquireDeviceForAppend() or ForRead()
+  SetupNewDcrDevice(jcr, dcr, rctx.device_resource->dev, NULL, false);
 
   if (rctx.store->append) { dcr->SetWillWrite(); }
 
@@ -800,6 +856,10 @@ static bool ReserveDeviceForRead(DeviceControlRecord* dcr)
   }
 
   if (dev->IsBusy()) {
+    if (ReserveSharedReadDevice(dcr)) {
+      ok = true;
+      goto bail_out;
+    }
     Dmsg4(debuglevel,
           "Device %s is busy ST_READREADY=%d num_writers=%d reserved=%d.\n",
           dev->print_name(), BitIsSet(ST_READREADY, dev->state) ? 1 : 0,
@@ -819,6 +879,7 @@ static bool ReserveDeviceForRead(DeviceControlRecord* dcr)
   dev->ClearAppend();
   dev->SetRead();
   dcr->SetReserved();
+  NoteReadDevice(dcr);
   ok = true;
 
 bail_out:
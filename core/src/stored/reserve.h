@@ -38,6 +38,8 @@
 #ifndef BAREOS_STORED_RESERVE_H_
 #define BAREOS_STORED_RESERVE_H_
 
+#include "lib/source_location.h"
+
 #include <vector>
 #include <string>
 #include <string_view>
@@ -84,10 +86,11 @@ class ReserveContext {
 
 void InitReservationsLock();
 void TermReservationsLock();
-void LockReservations();
+void LockReservations(const char* media_type);
 bool TryReserveAfterUse(JobControlRecord* jcr, bool append);
-void UnlockReservations();
-void LockVolumes();
+void UnlockReservations(const char* media_type);
+void LockVolumes(libbareos::source_location loc
+                 = libbareos::source_location::current());
 void UnlockVolumes();
 void LockReadVolumes();
 void UnlockReadVolumes();
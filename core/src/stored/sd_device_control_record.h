@@ -26,20 +26,44 @@
 
 #include "stored/device_control_record.h"
 
+#include <vector>
+
 namespace storagedaemon {
 
+// A JobMedia record that was not sent to the director yet
+struct queued_jobmedia {
+  uint32_t FirstIndex;
+  uint32_t LastIndex;
+  uint32_t StartFile;
+  uint32_t EndFile;
+  uint32_t StartBlock;
+  uint32_t EndBlock;
+  int Copy;
+  int Stripe;
+  int64_t MediaId;
+};
+
 class StorageDaemonDeviceControlRecord : public DeviceControlRecord {
  public:
   bool DirFindNextAppendableVolume() override;
   bool DirUpdateVolumeInfo(is_labeloperation label) override;
   bool DirCreateJobmediaRecord(bool zero) override;
+  bool DirQueueJobmediaRecord() override;
   bool DirUpdateFileAttributes(DeviceRecord* record) override;
+  bool DirUpdateFileAttributeBatch(const DeviceRecord* records,
+                                   std::size_t count) override;
   bool DirAskSysopToMountVolume(int mode) override;
   bool DirAskSysopToCreateAppendableVolume() override;
   bool DirGetVolumeInfo(enum get_vol_info_rw writing) override;
   bool DirAskToUpdateFileList() override;
   bool DirAskToUpdateJobRecord() override;
   DeviceControlRecord* get_new_spooling_dcr() override;
+
+ private:
+  void QueueJobmediaRecord(bool zero);
+  bool SendQueuedJobmediaRecords();
+
+  std::vector<queued_jobmedia> queued_jobmedia_;
 };
 
 
@@ -359,6 +359,20 @@ bail_out:
   return rc;
 }
 
+// See if any plugin of the job wants to get the event.
+bool IsPluginEventEnabled(JobControlRecord* jcr, bSdEventType eventType)
+{
+  if (!sd_plugin_list || !jcr || !jcr->plugin_ctx_list) { return false; }
+
+  for (auto* ctx : jcr->plugin_ctx_list) {
+    if (IsEventEnabled(ctx, eventType) && !IsPluginDisabled(ctx)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
 // Print to file the plugin info.
 void DumpSdPlugin(Plugin* plugin, FILE* fp)
 {
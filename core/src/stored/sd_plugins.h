@@ -173,6 +173,7 @@ bRC GeneratePluginEvent(JobControlRecord* jcr,
                         bSdEventType event,
                         void* value = NULL,
                         bool reverse = false);
+bool IsPluginEventEnabled(JobControlRecord* jcr, bSdEventType event);
 #endif
 
 // Plugin definitions
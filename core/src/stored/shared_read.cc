@@ -0,0 +1,505 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * copy and migration jobs that read the same volume once for all of them
+ */
+
+#include "include/bareos.h"
+#include "stored/stored.h"
+#include "stored/acquire.h"
+#include "stored/bsr.h"
+#include "stored/device_control_record.h"
+#include "stored/read_record.h"
+#include "stored/shared_read.h"
+#include "stored/stored_jcr_impl.h"
+#include "stored/wait.h"
+#include "include/jcr.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace storagedaemon {
+
+static const int debuglevel = 150;
+
+namespace {
+
+// How long the reader waits for more jobs of its group
+constexpr auto gather_time = std::chrono::seconds(60);
+
+struct session {
+  uint32_t first_id{};
+  uint32_t last_id{};
+  uint32_t time{};
+};
+
+struct member {
+  JobControlRecord* jcr{};
+  bool joined{};   /**< Waits in ReadSharedRecords() */
+  bool served{};   /**< Its records are read for it */
+  bool failed{};   /**< Gets no more records */
+  bool finished{}; /**< All its records were read */
+  bool ok{};
+  bool (*record_cb)(DeviceControlRecord*, DeviceRecord*, void*){};
+  void* user_data{};
+  std::vector<session> sessions{};
+};
+
+enum class group_state
+{
+  kGathering,
+  kReading,
+  kDone
+};
+
+struct read_group {
+  uint32_t size{};
+  Device* dev{};
+  std::string volume{};
+  group_state state{group_state::kGathering};
+  JobControlRecord* reader{};
+  std::list<member> members{};
+  std::chrono::steady_clock::time_point last_change{};
+};
+
+std::mutex groups_mutex;
+std::condition_variable groups_changed;
+std::map<std::string, read_group> groups;
+
+// the volume of a job that reads only one, else nullptr
+const char* SingleVolume(JobControlRecord* jcr)
+{
+  VolumeList* vol = jcr->sd_impl->VolList;
+  if (!vol || vol->next) { return nullptr; }
+  return vol->VolumeName;
+}
+
+member* FindMember(read_group& group, JobControlRecord* jcr)
+{
+  for (member& m : group.members) {
+    if (m.jcr == jcr) { return &m; }
+  }
+  return nullptr;
+}
+
+member& AddMember(read_group& group, JobControlRecord* jcr)
+{
+  if (member* m = FindMember(group, jcr)) { return *m; }
+  group.members.push_back(member{});
+  group.members.back().jcr = jcr;
+  group.last_change = std::chrono::steady_clock::now();
+  groups_changed.notify_all();
+  return group.members.back();
+}
+
+read_group* FindGroup(JobControlRecord* jcr)
+{
+  if (jcr->sd_impl->read_group.empty()) { return nullptr; }
+  auto found = groups.find(jcr->sd_impl->read_group);
+  return found == groups.end() ? nullptr : &found->second;
+}
+
+/* The sessions a job wants from the volume.  The records of a session go to
+ * the job that wants it, so no two jobs of a group can want the same one. */
+bool GetSessions(member& m, const std::string& volume)
+{
+  m.sessions.clear();
+  for (BootStrapRecord* bsr = m.jcr->sd_impl->read_session.bsr; bsr;
+       bsr = bsr->next) {
+    if (!bsr->sessid || !bsr->sesstime || !bsr->volume
+        || volume != bsr->volume->VolumeName) {
+      return false;
+    }
+    for (BsrSessionId* id = bsr->sessid; id; id = id->next) {
+      for (BsrSessionTime* time = bsr->sesstime; time; time = time->next) {
+        m.sessions.push_back(session{id->sessid, id->sessid2, time->sesstime});
+      }
+    }
+  }
+  return !m.sessions.empty();
+}
+
+bool SessionsOverlap(const member& a, const member& b)
+{
+  for (const session& x : a.sessions) {
+    for (const session& y : b.sessions) {
+      if (x.time == y.time && x.first_id <= y.last_id
+          && y.first_id <= x.last_id) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// the jobs a record may go to, while the reader reads for them
+struct dispatch {
+  std::vector<member*> members{};
+  member* last{}; /**< Got the record before */
+
+  member* Find(uint32_t id, uint32_t time)
+  {
+    if (last && Wants(*last, id, time)) { return last; }
+    for (member* m : members) {
+      if (Wants(*m, id, time)) { return last = m; }
+    }
+    return nullptr;
+  }
+
+  bool AnyLeft() const
+  {
+    for (member* m : members) {
+      if (!m->failed) { return true; }
+    }
+    return false;
+  }
+
+  static bool Wants(const member& m, uint32_t id, uint32_t time)
+  {
+    for (const session& s : m.sessions) {
+      if (s.time == time && s.first_id <= id && id <= s.last_id) {
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+bool DispatchRecord(DeviceControlRecord*, DeviceRecord* rec, void* impl)
+{
+  auto* to = static_cast<dispatch*>(impl);
+  member* m = to->Find(rec->VolSessionId, rec->VolSessionTime);
+  if (!m || m->failed) { return true; }
+
+  if (m->jcr->IsJobCanceled()) {
+    m->failed = true;
+  } else {
+    // the callbacks change these to the ones of the job they write
+    int32_t FileIndex = rec->FileIndex;
+    uint32_t VolSessionId = rec->VolSessionId;
+    uint32_t VolSessionTime = rec->VolSessionTime;
+    if (!m->record_cb(m->jcr->sd_impl->read_dcr, rec, m->user_data)) {
+      m->failed = true;
+    }
+    rec->FileIndex = FileIndex;
+    rec->VolSessionId = VolSessionId;
+    rec->VolSessionTime = VolSessionTime;
+  }
+  return to->AnyLeft();
+}
+
+BootStrapRecord* LastBsr(BootStrapRecord* bsr)
+{
+  while (bsr->next) { bsr = bsr->next; }
+  return bsr;
+}
+
+void SetRoot(BootStrapRecord* first, BootStrapRecord* root)
+{
+  for (BootStrapRecord* bsr = first; bsr; bsr = bsr->next) { bsr->root = root; }
+}
+
+bool ReadForGroup(DeviceControlRecord* dcr,
+                  read_group& group,
+                  member& me,
+                  std::unique_lock<std::mutex>& lock,
+                  bool mount_cb(DeviceControlRecord* dcr))
+{
+  JobControlRecord* jcr = dcr->jcr;
+
+  auto joined = [&group]() {
+    uint32_t count = 1;
+    for (const member& m : group.members) { count += m.joined ? 1 : 0; }
+    return count;
+  };
+  while (joined() < group.size && !jcr->IsJobCanceled()
+         && std::chrono::steady_clock::now() - group.last_change
+                < gather_time) {
+    groups_changed.wait_for(lock, std::chrono::seconds(1));
+  }
+
+  group.state = group_state::kReading;
+  dispatch to;
+  if (GetSessions(me, group.volume)) {
+    to.members.push_back(&me);
+    for (member& m : group.members) {
+      if (m.joined && GetSessions(m, group.volume)) {
+        bool overlaps = false;
+        for (member* other : to.members) {
+          overlaps = overlaps || SessionsOverlap(m, *other);
+        }
+        if (!overlaps) {
+          m.served = true;
+          to.members.push_back(&m);
+        }
+      }
+    }
+  }
+  me.served = true;
+  groups_changed.notify_all();
+  lock.unlock();
+
+  bool ok;
+  if (to.members.size() < 2) {
+    Dmsg1(debuglevel, "JobId=%u reads for no other job\n", jcr->JobId);
+    ok = ReadRecords(dcr, me.record_cb, mount_cb, me.user_data);
+    lock.lock();
+    me.failed = !ok;
+  } else {
+    Jmsg(jcr, M_INFO, 0, T_("Reading volume %s for %d jobs.\n"),
+         group.volume.c_str(), static_cast<int>(to.members.size()));
+
+    // one bsr for all of them, every record is read once
+    BootStrapRecord* root = jcr->sd_impl->read_session.bsr;
+    BootStrapRecord* last = LastBsr(root);
+    for (std::size_t i = 1; i < to.members.size(); ++i) {
+      JobControlRecord* served = to.members[i]->jcr;
+      Jmsg(served, M_INFO, 0, T_("JobId %u reads volume %s for this job.\n"),
+           jcr->JobId, group.volume.c_str());
+      BootStrapRecord* first = served->sd_impl->read_session.bsr;
+      last->next = first;
+      first->prev = last;
+      SetRoot(first, root);
+      last = LastBsr(first);
+    }
+
+    ok = ReadRecords(dcr, DispatchRecord, mount_cb, &to);
+
+    for (std::size_t i = 1; i < to.members.size(); ++i) {
+      BootStrapRecord* first = to.members[i]->jcr->sd_impl->read_session.bsr;
+      first->prev->next = nullptr;
+      first->prev = nullptr;
+      SetRoot(first, first);
+    }
+    lock.lock();
+  }
+
+  for (member* m : to.members) {
+    m->finished = true;
+    m->ok = ok && !m->failed;
+  }
+  groups_changed.notify_all();
+  return ok && !me.failed;
+}
+
+bool WaitForReader(DeviceControlRecord* dcr,
+                   read_group& group,
+                   member& me,
+                   std::unique_lock<std::mutex>& lock,
+                   bool mount_cb(DeviceControlRecord* dcr))
+{
+  JobControlRecord* jcr = dcr->jcr;
+
+  me.joined = true;
+  group.last_change = std::chrono::steady_clock::now();
+  groups_changed.notify_all();
+  while (!me.finished
+         && (group.state == group_state::kGathering || me.served)) {
+    if (group.state == group_state::kGathering && jcr->IsJobCanceled()) {
+      me.joined = false;
+      groups_changed.notify_all();
+      return false;
+    }
+    groups_changed.wait_for(lock, std::chrono::seconds(1));
+  }
+  if (me.served) { return me.ok; }
+
+  // the reader started without us, read on our own once it is done
+  me.joined = false;
+  while (group.state != group_state::kDone) {
+    if (jcr->IsJobCanceled()) { return false; }
+    groups_changed.wait_for(lock, std::chrono::seconds(1));
+  }
+  lock.unlock();
+
+  Jmsg(jcr, M_INFO, 0, T_("Reading volume %s without the other jobs.\n"),
+       group.volume.c_str());
+  dcr->shared_read = false;
+  if (!AcquireDeviceForRead(dcr)) { return false; }
+  return ReadRecords(dcr, me.record_cb, mount_cb, me.user_data);
+}
+
+}  // namespace
+
+bool ReserveSharedReadDevice(DeviceControlRecord* dcr)
+{
+  JobControlRecord* jcr = dcr->jcr;
+  const char* volume = SingleVolume(jcr);
+  if (!volume) { return false; }
+
+  std::lock_guard lock(groups_mutex);
+  read_group* group = FindGroup(jcr);
+  if (!group || group->state != group_state::kGathering
+      || group->dev != dcr->dev || group->volume != volume) {
+    return false;
+  }
+  AddMember(*group, jcr);
+  dcr->shared_read = true;
+  dcr->SetReserved();
+  Dmsg3(debuglevel, "JobId=%u shares the read of %s on %s\n", jcr->JobId,
+        volume, dcr->dev->print_name());
+  return true;
+}
+
+void NoteReadDevice(DeviceControlRecord* dcr)
+{
+  JobControlRecord* jcr = dcr->jcr;
+  const char* volume = SingleVolume(jcr);
+  if (jcr->sd_impl->read_group.empty() || !volume) { return; }
+
+  std::lock_guard lock(groups_mutex);
+  read_group& group = groups[jcr->sd_impl->read_group];
+  if (!group.dev) {
+    group.size = jcr->sd_impl->read_group_size;
+    group.dev = dcr->dev;
+    group.volume = volume;
+  }
+  AddMember(group, jcr);
+  dcr->shared_read = true;
+}
+
+bool SharedReadInProgress(Device* dev)
+{
+  std::lock_guard lock(groups_mutex);
+  for (auto& [name, group] : groups) {
+    if (group.dev == dev && group.reader
+        && group.state != group_state::kDone) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Called before a job acquires its read device.  The first job of a read
+ * group to get here reads for the group, the others get their records from
+ * it in ReadSharedRecords() and must not acquire the device.
+ */
+SharedReadRole JoinSharedRead(JobControlRecord* jcr)
+{
+  DeviceControlRecord* dcr = jcr->sd_impl->read_dcr;
+  if (!dcr || !dcr->shared_read) { return SharedReadRole::kAlone; }
+
+  SharedReadRole role = SharedReadRole::kAlone;
+  std::unique_lock lock(groups_mutex);
+  read_group* group = FindGroup(jcr);
+  if (group && group->dev == dcr->dev) {
+    AddMember(*group, jcr);
+    if (group->state == group_state::kGathering) {
+      role = group->reader ? SharedReadRole::kServed : SharedReadRole::kReader;
+      if (!group->reader) { group->reader = jcr; }
+    } else {
+      // too late, the device is read for the others now
+      while (group->state != group_state::kDone && !jcr->IsJobCanceled()) {
+        groups_changed.wait_for(lock, std::chrono::seconds(1));
+      }
+    }
+  }
+  lock.unlock();
+
+  if (role == SharedReadRole::kAlone) { dcr->shared_read = false; }
+  Dmsg2(debuglevel, "JobId=%u read role=%d\n", jcr->JobId,
+        static_cast<int>(role));
+  return role;
+}
+
+/**
+ * Like ReadRecords(), but for a job of a read group this is where the reader
+ * reads the volume for all of them and the others wait for it.
+ */
+bool ReadSharedRecords(DeviceControlRecord* dcr,
+                       bool RecordCb(DeviceControlRecord* dcr,
+                                     DeviceRecord* rec,
+                                     void* user_data),
+                       bool mount_cb(DeviceControlRecord* dcr),
+                       void* user_data)
+{
+  JobControlRecord* jcr = dcr->jcr;
+  std::unique_lock lock(groups_mutex);
+  read_group* group = dcr->shared_read ? FindGroup(jcr) : nullptr;
+  member* me = group ? FindMember(*group, jcr) : nullptr;
+  if (!me || !group->reader) {
+    lock.unlock();
+    return ReadRecords(dcr, RecordCb, mount_cb, user_data);
+  }
+
+  me->record_cb = RecordCb;
+  me->user_data = user_data;
+  if (group->reader == jcr) {
+    return ReadForGroup(dcr, *group, *me, lock, mount_cb);
+  }
+  return WaitForReader(dcr, *group, *me, lock, mount_cb);
+}
+
+/**
+ * Releases the read device of a job.  A job that got its records from the
+ * reader only gives up its reservation.
+ */
+bool ReleaseReadDevice(DeviceControlRecord* dcr)
+{
+  JobControlRecord* jcr = dcr->jcr;
+  if (!dcr->shared_read) { return ReleaseDevice(dcr); }
+
+  bool reader;
+  {
+    std::lock_guard lock(groups_mutex);
+    read_group* group = FindGroup(jcr);
+    reader = !group || group->reader == jcr;
+  }
+
+  if (reader) {
+    bool ok = ReleaseDevice(dcr);
+    std::lock_guard lock(groups_mutex);
+    if (read_group* group = FindGroup(jcr)) {
+      group->state = group_state::kDone;
+      groups_changed.notify_all();
+    }
+    return ok;
+  }
+
+  Device* dev = dcr->dev;
+  dev->Lock();
+  dcr->ClearReserved();
+  dev->Unlock();
+  ReleaseDeviceCond();
+  FreeDeviceControlRecord(dcr);
+  return true;
+}
+
+void LeaveSharedRead(JobControlRecord* jcr)
+{
+  std::lock_guard lock(groups_mutex);
+  read_group* group = FindGroup(jcr);
+  if (!group) { return; }
+
+  if (group->reader == jcr) { group->state = group_state::kDone; }
+  group->members.remove_if([jcr](const member& m) { return m.jcr == jcr; });
+  if (group->members.empty()) { groups.erase(jcr->sd_impl->read_group); }
+  groups_changed.notify_all();
+}
+
+} /* namespace storagedaemon */
@@ -0,0 +1,94 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * copy and migration jobs that read the same volume once for all of them
+ */
+#ifndef BAREOS_STORED_SHARED_READ_H_
+#define BAREOS_STORED_SHARED_READ_H_
+
+class JobControlRecord;
+
+namespace storagedaemon {
+
+class Device;
+class DeviceControlRecord;
+class DeviceRecord;
+
+/* The director puts copy jobs it starts together and whose data is on the
+ * same single volume into a read group.  The first of them reserves a device
+ * for reading the volume as usual, the others reserve the same device
+ * although it is busy.  The first job of the group to run reads the volume
+ * and the records of every session go to the callback of the job that reads
+ * it, so the volume is read once for the whole group.
+ *
+ * The reader waits until all jobs of the group have joined, or until none
+ * joined for a minute.  Jobs that come later read the volume on their own
+ * after the reader released the device. */
+enum class SharedReadRole
+{
+  kAlone,  /**< Reads its volumes itself */
+  kReader, /**< Acquires the device and reads for the group */
+  kServed  /**< Gets its records from the reader */
+};
+
+// Called with the device locked by the read reservation of a job
+bool ReserveSharedReadDevice(DeviceControlRecord* dcr);
+void NoteReadDevice(DeviceControlRecord* dcr);
+// Called with the device locked: is a group reading it
+bool SharedReadInProgress(Device* dev);
+
+SharedReadRole JoinSharedRead(JobControlRecord* jcr);
+bool ReadSharedRecords(DeviceControlRecord* dcr,
+                       bool RecordCb(DeviceControlRecord* dcr,
+                                     DeviceRecord* rec,
+                                     void* user_data),
+                       bool mount_cb(DeviceControlRecord* dcr),
+                       void* user_data);
+bool ReleaseReadDevice(DeviceControlRecord* dcr);
+void LeaveSharedRead(JobControlRecord* jcr);
+
+template <typename T>
+inline bool ReadSharedRecords(DeviceControlRecord* dcr,
+                              bool RecordCb(DeviceControlRecord* dcr,
+                                            DeviceRecord* rec,
+                                            T* user_data),
+                              bool mount_cb(DeviceControlRecord* dcr),
+                              T* user_data)
+{
+  struct callback {
+    decltype(RecordCb) record;
+    T* data;
+  } cb{RecordCb, user_data};
+
+  return ReadSharedRecords(
+      dcr,
+      +[](DeviceControlRecord* inner_dcr, DeviceRecord* inner_rec,
+          void* impl) -> bool {
+        auto* inner = static_cast<callback*>(impl);
+        return inner->record(inner_dcr, inner_rec, inner->data);
+      },
+      mount_cb, static_cast<void*>(&cb));
+}
+
+} /* namespace storagedaemon */
+
+#endif  // BAREOS_STORED_SHARED_READ_H_
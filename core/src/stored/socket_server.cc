@@ -67,6 +67,7 @@ void* HandleConnectionRequest(ConfigurationParser* config, void* arg)
   BareosSocket* bs = (BareosSocket*)arg;
   char name[MAX_NAME_LENGTH];
   char tbuf[MAX_TIME_LENGTH];
+  int index;
 
   if (!TryTlsHandshakeAsAServer(bs, config)) {
     bs->signal(BNET_TERMINATE);
@@ -96,6 +97,16 @@ void* HandleConnectionRequest(ConfigurationParser* config, void* arg)
 
   Dmsg1(110, "Conn: %s", bs->msg);
 
+  /* See if this is an additional data connection of a File daemon job.
+   * This has to come first as the FD hello below matches it too. */
+  if (sscanf(bs->msg, "Hello Start Job %127s data connection %d", name,
+             &index)
+      == 2) {
+    Dmsg1(110, "Got a FD data connection at %s\n",
+          bstrftimes(tbuf, sizeof(tbuf), (utime_t)time(NULL)));
+    return HandleFiledDataConnection(bs, name, index);
+  }
+
   // See if this is a File daemon connection. If so call FD handler.
   if (sscanf(bs->msg, "Hello Start Job %127s", name) == 1) {
     Dmsg1(110, "Got a FD connection at %s\n",
@@ -37,10 +37,19 @@
 #include "lib/berrno.h"
 #include "lib/bsock.h"
 #include "lib/edit.h"
+#include "lib/metrics.h"
 #include "lib/status_packet.h"
 #include "lib/util.h"
+#include "lib/channel.h"
 #include "include/jcr.h"
 
+#include <chrono>
+#include <memory>
+#include <thread>
+#ifdef HAVE_MEMFD_CREATE
+#  include <sys/mman.h>
+#endif
+
 namespace storagedaemon {
 
 /* Forward referenced subroutines */
@@ -55,6 +64,15 @@ static bool CloseAttrSpoolFile(JobControlRecord* jcr, BareosSocket* bs);
 static bool WriteSpoolHeader(DeviceControlRecord* dcr);
 static bool WriteSpoolData(DeviceControlRecord* dcr);
 
+static metrics::histogram despool_seconds{"bareos_sd_despool_seconds",
+                                          "Time needed to despool data",
+                                          METRICS_SECONDS_BUCKETS};
+static metrics::counter despooled_bytes{"bareos_sd_despooled_bytes",
+                                        "Bytes despooled to devices"};
+static metrics::counter memory_spool_bursts{
+    "bareos_sd_memory_spool_bursts",
+    "Times data spooled to memory was written to a tape device"};
+
 struct spool_stats_t {
   uint32_t data_jobs; /* current jobs spooling data */
   uint32_t attr_jobs;
@@ -64,6 +82,10 @@ struct spool_stats_t {
   int64_t max_attr_size;
   int64_t data_size; /* current data size (all jobs running) */
   int64_t attr_size;
+  uint32_t memory_jobs; /* of data_jobs spooling to memory */
+  uint64_t memory_bursts; /* writes of memory spools to the devices */
+  int64_t memory_burst_bytes;
+  int64_t memory_burst_msecs; /* the devices spent writing them */
 };
 
 static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -103,6 +125,24 @@ void ListSpoolStats(StatusPacket* sp)
 
     sp->send(msg, len);
   }
+  if (spool_stats.memory_jobs || spool_stats.memory_bursts) {
+    /* Every burst starts and stops the drive once, so the average burst
+     * size tells how long the drive streamed at a time. */
+    uint64_t bursts = spool_stats.memory_bursts;
+    int64_t msecs = spool_stats.memory_burst_msecs;
+    char ed3[30];
+    len = Mmsg(msg,
+               T_("Memory spooling: %u active jobs; %llu bursts, %s "
+                  "bytes/burst, %s bytes/second while writing.\n"),
+               spool_stats.memory_jobs, static_cast<unsigned long long>(bursts),
+               edit_uint64_with_suffix(
+                   bursts ? spool_stats.memory_burst_bytes / bursts : 0, ed1),
+               edit_uint64_with_suffix(
+                   msecs ? spool_stats.memory_burst_bytes * 1000 / msecs : 0,
+                   ed3));
+
+    sp->send(msg, len);
+  }
   if (spool_stats.attr_jobs || spool_stats.max_attr_size) {
     len = Mmsg(msg,
                T_("Attr spooling: %u active jobs, %s bytes; %u total jobs, %s "
@@ -116,11 +156,61 @@ void ListSpoolStats(StatusPacket* sp)
   }
 }
 
+/* Tape jobs without data spooling collect their data in memory, if the
+ * device has a Memory Spool Size, so that it reaches the drive in bursts
+ * that keep it streaming. */
+static bool UseMemorySpool([[maybe_unused]] DeviceControlRecord* dcr)
+{
+#ifdef HAVE_MEMFD_CREATE
+  return dcr->device_resource->memory_spool_size > 0 && dcr->dev->IsTape();
+#else
+  return false;
+#endif
+}
+
+static bool OpenMemorySpool([[maybe_unused]] DeviceControlRecord* dcr)
+{
+#ifdef HAVE_MEMFD_CREATE
+  int spool_fd = memfd_create("bareos-spool", MFD_CLOEXEC);
+  if (spool_fd < 0) {
+    BErrNo be;
+
+    Jmsg(dcr->jcr, M_WARNING, 0,
+         T_("Cannot spool data to memory, writing it directly: ERR=%s\n"),
+         be.bstrerror());
+    return false;
+  }
+  dcr->spool_fd = spool_fd;
+  dcr->memory_spool = true;
+  dcr->jcr->sd_impl->spool_attributes = true;
+  Dmsg1(100, "Created memory spool fd=%d\n", spool_fd);
+  return true;
+#else
+  return false;
+#endif
+}
+
 bool BeginDataSpool(DeviceControlRecord* dcr)
 {
   bool status = true;
 
-  if (dcr->jcr->sd_impl->spool_data) {
+  if (!dcr->jcr->sd_impl->spool_data && UseMemorySpool(dcr)) {
+    Dmsg0(100, "Turning on memory spooling\n");
+    if (OpenMemorySpool(dcr)) {
+      char ec1[30];
+      dcr->spool_data = true;
+      dcr->spooling = true;
+      Jmsg(dcr->jcr, M_INFO, 0,
+           T_("Spooling data to memory, writing it in bursts of up to %s "
+              "bytes ...\n"),
+           edit_uint64_with_suffix(dcr->device_resource->memory_spool_size,
+                                   ec1));
+      lock_mutex(mutex);
+      spool_stats.data_jobs++;
+      spool_stats.memory_jobs++;
+      unlock_mutex(mutex);
+    }
+  } else if (dcr->jcr->sd_impl->spool_data) {
     Dmsg0(100, "Turning on data spooling\n");
     dcr->spool_data = true;
     status = OpenDataSpoolFile(dcr);
@@ -164,19 +254,26 @@ bool CommitDataSpool(DeviceControlRecord* dcr)
   return true;
 }
 
-static void MakeUniqueDataSpoolFilename(DeviceControlRecord* dcr,
-                                        POOLMEM*& name)
+static const char* SpoolDirectory(DeviceControlRecord* dcr)
 {
-  const char* dir;
-
   if (dcr->dev->device_resource->spool_directory) {
-    dir = dcr->dev->device_resource->spool_directory;
-  } else {
-    dir = working_directory;
+    return dcr->dev->device_resource->spool_directory;
   }
+  return working_directory;
+}
+
+static void MakeUniqueDataSpoolFilename(DeviceControlRecord* dcr,
+                                        POOLMEM*& name)
+{
+  Mmsg(name, "%s/%s.data.%u.%s.%s.spool", SpoolDirectory(dcr), my_name,
+       dcr->jcr->JobId, dcr->jcr->Job, dcr->device_resource->resource_name_);
+}
 
-  Mmsg(name, "%s/%s.data.%u.%s.%s.spool", dir, my_name, dcr->jcr->JobId,
-       dcr->jcr->Job, dcr->device_resource->resource_name_);
+// File for the messages received while the job is despooling
+void MakeReceiveSpoolFilename(DeviceControlRecord* dcr, POOLMEM*& name)
+{
+  Mmsg(name, "%s/%s.receive.%u.%s.%s.spool", SpoolDirectory(dcr), my_name,
+       dcr->jcr->JobId, dcr->jcr->Job, dcr->device_resource->resource_name_);
 }
 
 static bool OpenDataSpoolFile(DeviceControlRecord* dcr)
@@ -211,13 +308,19 @@ static bool CloseDataSpoolFile(DeviceControlRecord* dcr, bool end_of_spool)
   dcr->spool_fd = -1;
   dcr->spooling = false;
 
-  MakeUniqueDataSpoolFilename(dcr, name);
-  SecureErase(dcr->jcr, name);
-  Dmsg1(100, "Deleted spool file: %s\n", name);
+  // the memory goes away with the descriptor
+  bool memory_spool = dcr->memory_spool;
+  dcr->memory_spool = false;
+  if (!memory_spool) {
+    MakeUniqueDataSpoolFilename(dcr, name);
+    SecureErase(dcr->jcr, name);
+    Dmsg1(100, "Deleted spool file: %s\n", name);
+  }
   FreePoolMemory(name);
 
   lock_mutex(mutex);
   spool_stats.data_jobs--;
+  if (memory_spool) { spool_stats.memory_jobs--; }
   if (end_of_spool) { spool_stats.total_data_jobs++; }
   if (spool_stats.data_size < dcr->job_spool_size) {
     spool_stats.data_size = 0;
@@ -228,6 +331,7 @@ static bool CloseDataSpoolFile(DeviceControlRecord* dcr, bool end_of_spool)
 
   lock_mutex(dcr->dev->spool_mutex);
   dcr->dev->spool_size -= dcr->job_spool_size;
+  if (memory_spool) { dcr->dev->memory_spool_size -= dcr->job_spool_size; }
   dcr->job_spool_size = 0;
   unlock_mutex(dcr->dev->spool_mutex);
 
@@ -236,6 +340,167 @@ static bool CloseDataSpoolFile(DeviceControlRecord* dcr, bool end_of_spool)
 
 static const char* spool_name = "*spool*";
 
+/* Reads the header of the next spooled block.  Returns RB_OK, RB_EOT or
+ * RB_ERROR, in which case errmsg says what went wrong. */
+static int ReadSpoolHeader(int fd,
+                           spool_hdr& hdr,
+                           uint32_t max_len,
+                           PoolMem& errmsg)
+{
+  uint32_t rlen = sizeof(hdr);
+  ssize_t status = read(fd, (char*)&hdr, (size_t)rlen);
+  if (status == 0) {
+    Dmsg0(100, "EOT on spool read.\n");
+    return RB_EOT;
+  } else if (status != (ssize_t)rlen) {
+    if (status == -1) {
+      BErrNo be;
+
+      Mmsg(errmsg, T_("Spool header read error. ERR=%s\n"), be.bstrerror());
+    } else {
+      Mmsg(errmsg, T_("Spool header read error. Wanted %u bytes, got %d\n"),
+           rlen, (int)status);
+    }
+    return RB_ERROR;
+  }
+  if (hdr.len > max_len) {
+    Mmsg(errmsg, T_("Spool block too big. Max %u bytes, got %u\n"), max_len,
+         hdr.len);
+    return RB_ERROR;
+  }
+  return RB_OK;
+}
+
+static int ReadSpoolData(int fd, char* buf, uint32_t len, PoolMem& errmsg)
+{
+  ssize_t status = read(fd, buf, (size_t)len);
+  if (status != (ssize_t)len) {
+    Mmsg(errmsg, T_("Spool data read error. Wanted %u bytes, got %d\n"), len,
+         (int)status);
+    return RB_ERROR;
+  }
+  return RB_OK;
+}
+
+static int SpoolReadFailed(DeviceControlRecord* dcr, const PoolMem& errmsg)
+{
+  Pmsg1(000, "%s", errmsg.c_str());
+  Jmsg1(dcr->jcr, M_FATAL, 0, "%s", errmsg.c_str());
+  dcr->jcr->setJobStatus(JS_FatalError); /* override any Incomplete */
+  return RB_ERROR;
+}
+
+// Setup write pointers of the block that got the data of hdr
+static void SetupSpooledBlock(DeviceControlRecord* dcr, const spool_hdr& hdr)
+{
+  DeviceBlock* block = dcr->block;
+
+  block->binbuf = hdr.len;
+  block->bufp = block->buf + block->binbuf;
+  block->FirstIndex = hdr.FirstIndex;
+  block->LastIndex = hdr.LastIndex;
+  block->VolSessionId = dcr->jcr->VolSessionId;
+  block->VolSessionTime = dcr->jcr->VolSessionTime;
+  Dmsg2(800, "Read block FI=%d LI=%d\n", block->FirstIndex, block->LastIndex);
+}
+
+static int ReadBlockFromSpoolFile(DeviceControlRecord* dcr)
+{
+  spool_hdr hdr;
+  PoolMem errmsg(PM_MESSAGE);
+  DeviceBlock* block = dcr->block;
+
+  int status = ReadSpoolHeader(dcr->spool_fd, hdr, block->buf_len, errmsg);
+  if (status == RB_OK) {
+    status = ReadSpoolData(dcr->spool_fd, block->buf, hdr.len, errmsg);
+  }
+  if (status == RB_ERROR) { return SpoolReadFailed(dcr, errmsg); }
+  if (status == RB_EOT) { return RB_EOT; }
+
+  SetupSpooledBlock(dcr, hdr);
+  return RB_OK;
+}
+
+namespace {
+struct spooled_block {
+  int status{RB_OK};
+  spool_hdr hdr{};
+  std::unique_ptr<char[]> data;
+  PoolMem errmsg{PM_MESSAGE};
+};
+
+/* Reads the spool file ahead of the device on its own thread (Device:
+ * Despool Read Ahead), so that the drive keeps streaming while the spool
+ * disk is slow for a moment. */
+class SpoolReadAhead {
+ public:
+  SpoolReadAhead(int t_fd, uint32_t t_max_len, std::size_t num_blocks)
+      : SpoolReadAhead{t_fd, t_max_len,
+                       channel::CreateSpscChannel<spooled_block>(
+                           num_blocks)}
+  {
+  }
+
+  ~SpoolReadAhead()
+  {
+    output.close();
+    if (read_thread.joinable()) { read_thread.join(); }
+  }
+
+  /* Reads the next spooled block into the block of dcr; same return values
+   * as ReadBlockFromSpoolFile() */
+  int ReadBlock(DeviceControlRecord* dcr)
+  {
+    std::optional<spooled_block> next = output.get();
+    if (!next) { return RB_EOT; }
+    if (next->status == RB_ERROR) { return SpoolReadFailed(dcr, next->errmsg); }
+    if (next->status == RB_EOT) { return RB_EOT; }
+
+    memcpy(dcr->block->buf, next->data.get(), next->hdr.len);
+    SetupSpooledBlock(dcr, next->hdr);
+    return RB_OK;
+  }
+
+ private:
+  SpoolReadAhead(int t_fd,
+                 uint32_t t_max_len,
+                 channel::channel_pair<spooled_block> chan_pair)
+      : fd{t_fd}
+      , max_len{t_max_len}
+      , input{std::move(chan_pair.first)}
+      , output{std::move(chan_pair.second)}
+      , read_thread{enlist, this}
+  {
+  }
+
+  void do_work()
+  {
+    for (;;) {
+      spooled_block next;
+      next.status = ReadSpoolHeader(fd, next.hdr, max_len, next.errmsg);
+      if (next.status == RB_OK) {
+        next.data.reset(new char[next.hdr.len]);
+        next.status
+            = ReadSpoolData(fd, next.data.get(), next.hdr.len, next.errmsg);
+      }
+      bool last = next.status != RB_OK;
+      if (!input.emplace(std::move(next)) || last) { break; }
+    }
+    input.close();
+  }
+
+  static void enlist(SpoolReadAhead* reader) { reader->do_work(); }
+
+  int fd;
+  uint32_t max_len;
+  channel::input<spooled_block> input;
+  channel::output<spooled_block> output;
+
+  // read_thread has to be defined last, as it starts to work immediately
+  std::thread read_thread;
+};
+}  // namespace
+
 /**
  * NB! This routine locks the device, but if committing will
  *     not unlock it. If not committing, it will be unlocked.
@@ -311,12 +576,28 @@ static bool DespoolData(DeviceControlRecord* dcr, bool commit)
 
   SetNewFileParameters(dcr);
 
+  std::optional<SpoolReadAhead> read_ahead;
+  if (uint32_t num_blocks = dcr->dev->device_resource->despool_read_ahead) {
+    Dmsg1(100, "Reading %u spooled blocks ahead\n", num_blocks);
+    read_ahead.emplace(rdcr->spool_fd, rdcr->block->buf_len, num_blocks);
+  }
+
+  // time spent writing to the device vs. waiting for the spool file
+  using clock = std::chrono::steady_clock;
+  clock::duration write_time{0}, read_time{0};
+
   while (ok) {
     if (jcr->IsJobCanceled()) {
       ok = false;
       break;
     }
-    status = ReadBlockFromSpoolFile(rdcr);
+    auto read_start = clock::now();
+    status = read_ahead ? read_ahead->ReadBlock(rdcr)
+                        : ReadBlockFromSpoolFile(rdcr);
+    auto write_start = clock::now();
+    read_time += write_start - read_start;
+    jcr->sd_impl->stage_times.Add(append_stage::kSpoolRead,
+                                  write_start - read_start);
     if (status == RB_EOT) {
       break;
     } else if (status == RB_ERROR) {
@@ -324,6 +605,7 @@ static bool DespoolData(DeviceControlRecord* dcr, bool commit)
       break;
     }
     ok = dcr->WriteBlockToDevice();
+    write_time += clock::now() - write_start;
     if (!ok) {
       Jmsg2(jcr, M_FATAL, 0, T_("Fatal append error on device %s: ERR=%s\n"),
             dcr->dev->print_name(), dcr->dev->bstrerror());
@@ -368,10 +650,34 @@ static bool DespoolData(DeviceControlRecord* dcr, bool commit)
        edit_uint64_with_suffix(
            jcr->sd_impl->dcr->job_spool_size / despool_elapsed, ec1));
 
+  read_ahead.reset();
+  auto busy_time = write_time + read_time;
+  despool_seconds.Observe(
+      std::chrono::duration<double>(busy_time).count());
+  despooled_bytes.Add(jcr->sd_impl->dcr->job_spool_size);
+  if (busy_time.count() > 0) {
+    int streaming = static_cast<int>(100 * write_time / busy_time);
+    Jmsg(jcr, M_INFO, 0,
+         T_("Despooling kept device %s busy %d%% of the time (Despool Read "
+            "Ahead = %u).\n"),
+         dcr->dev->print_name(), streaming,
+         dcr->dev->device_resource->despool_read_ahead);
+  }
+  if (dcr->memory_spool) {
+    memory_spool_bursts.Add(1);
+    lock_mutex(mutex);
+    spool_stats.memory_bursts++;
+    spool_stats.memory_burst_bytes += jcr->sd_impl->dcr->job_spool_size;
+    spool_stats.memory_burst_msecs
+        += std::chrono::duration_cast<std::chrono::milliseconds>(write_time)
+               .count();
+    unlock_mutex(mutex);
+  }
+
   dcr->block = block; /* reset block */
 
   // See if we are using secure erase.
-  if (me->secure_erase_cmdline) {
+  if (me->secure_erase_cmdline && !dcr->memory_spool) {
     CloseDataSpoolFile(dcr, false);
     BeginDataSpool(dcr);
   } else {
@@ -393,6 +699,9 @@ static bool DespoolData(DeviceControlRecord* dcr, bool commit)
     unlock_mutex(mutex);
     lock_mutex(dcr->dev->spool_mutex);
     dcr->dev->spool_size -= dcr->job_spool_size;
+    if (dcr->memory_spool) {
+      dcr->dev->memory_spool_size -= dcr->job_spool_size;
+    }
     dcr->job_spool_size = 0; /* zap size in input dcr */
     unlock_mutex(dcr->dev->spool_mutex);
   }
@@ -420,63 +729,6 @@ static bool DespoolData(DeviceControlRecord* dcr, bool commit)
  *          RB_EOT when file done
  *          RB_ERROR on error
  */
-static int ReadBlockFromSpoolFile(DeviceControlRecord* dcr)
-{
-  uint32_t rlen;
-  ssize_t status;
-  spool_hdr hdr;
-  DeviceBlock* block = dcr->block;
-  JobControlRecord* jcr = dcr->jcr;
-
-  rlen = sizeof(hdr);
-  status = read(dcr->spool_fd, (char*)&hdr, (size_t)rlen);
-  if (status == 0) {
-    Dmsg0(100, "EOT on spool read.\n");
-    return RB_EOT;
-  } else if (status != (ssize_t)rlen) {
-    if (status == -1) {
-      BErrNo be;
-
-      Jmsg(dcr->jcr, M_FATAL, 0, T_("Spool header read error. ERR=%s\n"),
-           be.bstrerror());
-    } else {
-      Pmsg2(000, T_("Spool read error. Wanted %u bytes, got %d\n"), rlen,
-            status);
-      Jmsg2(jcr, M_FATAL, 0,
-            T_("Spool header read error. Wanted %u bytes, got %d\n"), rlen,
-            status);
-    }
-    jcr->setJobStatus(JS_FatalError); /* override any Incomplete */
-    return RB_ERROR;
-  }
-  rlen = hdr.len;
-  if (rlen > block->buf_len) {
-    Pmsg2(000, T_("Spool block too big. Max %u bytes, got %u\n"),
-          block->buf_len, rlen);
-    Jmsg2(jcr, M_FATAL, 0, T_("Spool block too big. Max %u bytes, got %u\n"),
-          block->buf_len, rlen);
-    jcr->setJobStatus(JS_FatalError); /* override any Incomplete */
-    return RB_ERROR;
-  }
-  status = read(dcr->spool_fd, (char*)block->buf, (size_t)rlen);
-  if (status != (ssize_t)rlen) {
-    Pmsg2(000, T_("Spool data read error. Wanted %u bytes, got %d\n"), rlen,
-          status);
-    Jmsg2(dcr->jcr, M_FATAL, 0,
-          T_("Spool data read error. Wanted %u bytes, got %d\n"), rlen, status);
-    jcr->setJobStatus(JS_FatalError); /* override any Incomplete */
-    return RB_ERROR;
-  }
-  /* Setup write pointers */
-  block->binbuf = rlen;
-  block->bufp = block->buf + block->binbuf;
-  block->FirstIndex = hdr.FirstIndex;
-  block->LastIndex = hdr.LastIndex;
-  block->VolSessionId = dcr->jcr->VolSessionId;
-  block->VolSessionTime = dcr->jcr->VolSessionTime;
-  Dmsg2(800, "Read block FI=%d LI=%d\n", block->FirstIndex, block->LastIndex);
-  return RB_OK;
-}
 
 /**
  * Write a block to the spool file
@@ -488,6 +740,7 @@ bool WriteBlockToSpoolFile(DeviceControlRecord* dcr)
 {
   uint32_t wlen, hlen; /* length to write */
   bool despool = false;
+  bool memory_full = false;
   DeviceBlock* block = dcr->block;
 
   if (dcr->jcr->IsJobCanceled()) { return false; }
@@ -501,7 +754,14 @@ bool WriteBlockToSpoolFile(DeviceControlRecord* dcr)
   lock_mutex(dcr->dev->spool_mutex);
   dcr->job_spool_size += hlen + wlen;
   dcr->dev->spool_size += hlen + wlen;
-  if ((dcr->max_job_spool_size > 0
+  if (dcr->memory_spool) {
+    dcr->dev->memory_spool_size += hlen + wlen;
+    memory_full = dcr->dev->memory_spool_size
+                  >= static_cast<uint64_t>(
+                      dcr->device_resource->memory_spool_size);
+  }
+  if (memory_full
+      || (dcr->max_job_spool_size > 0
        && dcr->job_spool_size >= dcr->max_job_spool_size)
       || (dcr->dev->max_spool_size > 0
           && dcr->dev->spool_size >= dcr->dev->max_spool_size)) {
@@ -516,7 +776,14 @@ bool WriteBlockToSpoolFile(DeviceControlRecord* dcr)
   unlock_mutex(mutex);
   if (despool) {
     char ec1[30], ec2[30];
-    if (dcr->max_job_spool_size > 0) {
+    if (memory_full) {
+      Jmsg(dcr->jcr, M_INFO, 0,
+           T_("Memory spool of device full: DevMemorySpoolSize=%s "
+              "MemorySpoolSize=%s\n"),
+           edit_uint64_with_commas(dcr->dev->memory_spool_size, ec1),
+           edit_uint64_with_commas(dcr->device_resource->memory_spool_size,
+                                   ec2));
+    } else if (dcr->max_job_spool_size > 0) {
       Jmsg(dcr->jcr, M_INFO, 0,
            T_("User specified Job spool size reached: "
               "JobSpoolSize=%s MaxJobSpoolSize=%s\n"),
@@ -538,11 +805,11 @@ bool WriteBlockToSpoolFile(DeviceControlRecord* dcr)
     lock_mutex(dcr->dev->spool_mutex);
     dcr->job_spool_size += hlen + wlen;
     dcr->dev->spool_size += hlen + wlen;
+    if (dcr->memory_spool) { dcr->dev->memory_spool_size += hlen + wlen; }
     unlock_mutex(dcr->dev->spool_mutex);
     Jmsg(dcr->jcr, M_INFO, 0, T_("Spooling data again ...\n"));
   }
 
-
   if (!WriteSpoolHeader(dcr)) { return false; }
   if (!WriteSpoolData(dcr)) { return false; }
 
@@ -33,6 +33,7 @@ bool BeginAttributeSpool(JobControlRecord* jcr);
 bool DiscardAttributeSpool(JobControlRecord* jcr);
 bool CommitAttributeSpool(JobControlRecord* jcr);
 bool WriteBlockToSpoolFile(DeviceControlRecord* dcr);
+void MakeReceiveSpoolFilename(DeviceControlRecord* dcr, POOLMEM*& name);
 void ListSpoolStats(StatusPacket* sp);
 
 } /* namespace storagedaemon */
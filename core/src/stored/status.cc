@@ -34,8 +34,11 @@
 #include "stored/stored_jcr_impl.h"
 #include "stored/spool.h"
 #include "stored/status.h"
+#include "stored/buffer_budget.h"
+#include "stored/write_scheduler.h"
 #include "lib/status_packet.h"
 #include "lib/edit.h"
+#include "lib/lock_profile.h"
 #include "include/jcr.h"
 #include "lib/parse_conf.h"
 #include "lib/bsock.h"
@@ -92,6 +95,12 @@ static void OutputStatus(JobControlRecord* jcr,
   }
 
   ListSpoolStats(sp);
+  ListWriteScheduler(sp);
+  ListBufferBudget(sp);
+  if (std::string profile = lock_profile::Report();
+      !sp->api && !profile.empty()) {
+    sp->send(profile);
+  }
   if (!sp->api) {
     len = PmStrcpy(msg, "====\n\n");
     sp->send(msg, len);
@@ -404,7 +413,7 @@ static void ListStatusHeader(StatusPacket* sp)
   int len;
   PoolMem msg(PM_MESSAGE);
   char dt[MAX_TIME_LENGTH];
-  char b1[35];
+  char b1[35], b2[35], b3[35], b4[35], b5[35];
 
   len = Mmsg(msg, T_("%s Version: %s (%s) %s \n"), my_name,
              kBareosVersionStrings.Full, kBareosVersionStrings.Date,
@@ -461,6 +470,29 @@ static void ListStatusHeader(StatusPacket* sp)
              edit_uint64_with_commas(me->max_bandwidth_per_job / 1024, b1));
   sp->send(msg, len);
 
+  pool_memory_stats pool_mem = GetPoolMemoryStats();
+  len = Mmsg(msg,
+             T_(" Pool memory: held=%s cached=%s huge=%s released=%s "
+                "mapped=%s\n"),
+             edit_uint64_with_commas(pool_mem.held_bytes, b1),
+             edit_uint64_with_commas(pool_mem.cached_bytes, b2),
+             edit_uint64_with_commas(pool_mem.huge_bytes, b3),
+             edit_uint64_with_commas(pool_mem.released_bytes, b4),
+             edit_uint64_with_commas(pool_mem.mapped_bytes, b5));
+  sp->send(msg, len);
+
+  for (auto& delivery : GetMessageDeliveryStats()) {
+    len = Mmsg(msg,
+               T_(" Message delivery (%s): queued=%s waits=%s inline=%s "
+                  "max depth=%d max batch=%d\n"),
+               delivery.destination,
+               edit_uint64_with_commas(delivery.queued, b1),
+               edit_uint64_with_commas(delivery.waits, b2),
+               edit_uint64_with_commas(delivery.inline_delivered, b3),
+               (int)delivery.max_depth, (int)delivery.max_batch);
+    sp->send(msg, len);
+  }
+
 
   if (me->secure_erase_cmdline) {
     len = Mmsg(msg, T_(" secure erase command='%s'\n"),
@@ -561,6 +593,7 @@ static void SendDeviceStatus(Device* dev, StatusPacket* sp)
   int len;
   bool found = false;
   PoolMem msg(PM_MESSAGE);
+  char ed1[50], ed2[50];
 
   if (debug_level > 5) {
     len = Mmsg(msg, T_("Configured device capabilities:\n"));
@@ -600,6 +633,11 @@ static void SendDeviceStatus(Device* dev, StatusPacket* sp)
              dev->num_writers, dev->NumReserved(), dev->blocked());
   sp->send(msg, len);
 
+  len = Mmsg(msg, T_("  lock acquisitions=%s contentions=%s\n"),
+             edit_uint64(dev->lock_acquisitions, ed1),
+             edit_uint64(dev->lock_contentions, ed2));
+  sp->send(msg, len);
+
   len = Mmsg(msg, T_("Attached Jobs: "));
   sp->send(msg, len);
   dev->Lock();
@@ -688,6 +726,9 @@ static void ListRunningJobs(StatusPacket* sp)
                    dcr->spooling, dcr->despooling, dcr->despool_wait);
         sp->send(msg, len);
       }
+      len = Mmsg(msg, T_("    Buffers=%s\n"),
+                 edit_uint64_with_suffix(JobBufferBytes(jcr), b1));
+      sp->send(msg, len);
 
       jcr->UpdateJobStats();
 
@@ -698,6 +739,12 @@ static void ListRunningJobs(StatusPacket* sp)
                  edit_uint64_with_commas(jcr->AverageRate, b3),
                  edit_uint64_with_commas(jcr->LastRate, b4));
       sp->send(msg, len);
+      if (std::string stages
+          = jcr->sd_impl->stage_times.Format(append_stage_names);
+          !stages.empty()) {
+        len = Mmsg(msg, T_("    Stages: %s\n"), stages.c_str());
+        sp->send(msg, len);
+      }
 
       found = true;
       if (jcr->file_bsock) {
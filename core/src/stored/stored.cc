@@ -39,6 +39,7 @@
 #include "stored/autochanger.h"
 #include "stored/bsr.h"
 #include "stored/device.h"
+#include "stored/idle_unload.h"
 #include "stored/stored_jcr_impl.h"
 #include "stored/job.h"
 #include "stored/label.h"
@@ -49,6 +50,9 @@
 #include "stored/socket_server.h"
 #include "stored/stored_globals.h"
 #include "stored/wait.h"
+#include "stored/buffer_budget.h"
+#include "stored/cpu_affinity.h"
+#include "stored/write_scheduler.h"
 #include "lib/berrno.h"
 #include "lib/bsock.h"
 #include "lib/bnet_network_dump.h"
@@ -58,9 +62,16 @@
 #include "lib/parse_conf.h"
 #include "lib/thread_specific_data.h"
 #include "lib/util.h"
+#include "lib/lock_profile.h"
+#include "lib/metrics_server.h"
 #include "lib/watchdog.h"
 #include "include/jcr.h"
 
+#include <future>
+#include <map>
+#include <thread>
+#include <vector>
+
 namespace storagedaemon {
 extern bool ParseSdConfig(const char* configfile, int exit_code);
 }
@@ -296,12 +307,16 @@ int main(int argc, char* argv[])
   InitJcrChain();
   UnlockJcrChain();
   StartWatchdog(); /* start watchdog thread */
+  StartMessageDelivery();
+  StartMetricsServer(me->metrics_address, me->metrics_port);
+  lock_profile::SetSampling(me->lock_profile_sampling);
   if (me->jcr_watchdog_time) {
     InitJcrSubsystem(
         me->jcr_watchdog_time); /* start JobControlRecord watchdogs etc. */
   }
 
   StartStatisticsThread();
+  StartUnloadIdleDrivesThread();
 
 #if HAVE_NDMP
   // Separate thread that handles NDMP connections
@@ -380,6 +395,25 @@ static int CheckResources()
            device_resource->resource_name_, configfile_name.c_str());
       OK = false;
     }
+    std::vector<int> cpus;
+    if (std::string error;
+        device_resource->cpu_affinity
+        && !ParseCpuList(device_resource->cpu_affinity, cpus, error)) {
+      Jmsg(nullptr, M_ERROR, 0, T_("%s in Device \"%s\" in %s\n"),
+           error.c_str(), device_resource->resource_name_,
+           configfile_name.c_str());
+      OK = false;
+    }
+  }
+
+  ConfigureBufferBudget(me->max_job_buffer_memory);
+  SetHugePageBuffers(me->huge_page_buffers);
+  if (std::string error; !ConfigureWriteScheduler(
+          me->max_write_bandwidth, me->max_writes_per_second,
+          me->priority_write_weights, error)) {
+    Jmsg(nullptr, M_ERROR, 0, T_("%s in %s\n"), error.c_str(),
+         configfile_name.c_str());
+    OK = false;
   }
 
   if (OK) { OK = InitAutochangers(); }
@@ -484,50 +518,47 @@ get_out2:
 }
 
 
-/**
- * Here we attempt to init and open each device. This is done once at startup in
- * a separate thread.
- */
-extern "C" void* device_initialization(void*)
+static JobControlRecord* NewInitializationJcr()
 {
-  DeviceResource* device_resource = nullptr;
-  DeviceControlRecord* dcr;
-  JobControlRecord* jcr;
-  Device* dev;
-  int errstat;
-
-  ResLocker _{my_config};
-
-  pthread_detach(pthread_self());
-  jcr = NewStoredJcr();
+  JobControlRecord* jcr = NewStoredJcr();
   NewPlugins(jcr); /* instantiate plugins */
   jcr->setJobType(JT_SYSTEM);
 
   // Initialize job end condition variable
-  errstat = pthread_cond_init(&jcr->sd_impl->job_end_wait, nullptr);
+  int errstat = pthread_cond_init(&jcr->sd_impl->job_end_wait, nullptr);
   if (errstat != 0) {
     BErrNo be;
     Jmsg1(jcr, M_ABORT, 0,
           T_("Unable to init job endstart cond variable: ERR=%s\n"),
           be.bstrerror(errstat));
   }
+  return jcr;
+}
 
-  foreach_res (device_resource, R_DEVICE) {
-    Dmsg1(90, "calling FactoryCreateDevice %s\n",
-          device_resource->archive_device_string);
-    dev = FactoryCreateDevice(nullptr, device_resource);
-    Dmsg1(10, "SD init done %s\n", device_resource->archive_device_string);
-    if (!dev) {
-      Jmsg1(nullptr, M_ERROR, 0, T_("Could not initialize %s\n"),
-            device_resource->archive_device_string);
-      continue;
-    }
+/* Only devices that have to do something before the first job gets created at
+ * startup, the others are created by InitDevice() when first used. */
+static bool NeedsStartupInitialization(DeviceResource* device_resource)
+{
+  return device_resource->changer_res
+         || BitIsSet(CAP_AUTOMOUNT, device_resource->cap_bits)
+         || (BitIsSet(CAP_ALWAYSOPEN, device_resource->cap_bits)
+             && device_resource->device_type == DeviceType::B_TAPE_DEV);
+}
+
+/* Asks the autochanger what is loaded, then opens the device and reads the
+ * label.  The devices are blocked by the calling thread, each one stays so
+ * until it is done and a job reserving it waits till then. */
+static void InitializeDevices(const std::vector<Device*>& devices)
+{
+  JobControlRecord* jcr = NewInitializationJcr();
+
+  for (Device* dev : devices) {
+    DeviceResource* device_resource = dev->device_resource;
 
-    dcr = new StorageDaemonDeviceControlRecord;
+    DeviceControlRecord* dcr = new StorageDaemonDeviceControlRecord;
     jcr->sd_impl->dcr = dcr;
     SetupNewDcrDevice(jcr, dcr, dev, nullptr);
     jcr->sd_impl->dcr->SetWillWrite();
-    GeneratePluginEvent(jcr, bSdEventDeviceInit, dcr);
     if (dev->AttachedToAutochanger()) {
       // If autochanger set slot in dev structure
       GetAutochangerLoadedSlot(dcr);
@@ -539,9 +570,6 @@ extern "C" void* device_initialization(void*)
         Jmsg1(nullptr, M_ERROR, 0, T_("Could not open device %s\n"),
               dev->print_name());
         Dmsg1(20, "Could not open device %s\n", dev->print_name());
-        FreeDeviceControlRecord(dcr);
-        jcr->sd_impl->dcr = nullptr;
-        continue;
       }
     }
 
@@ -559,9 +587,74 @@ extern "C" void* device_initialization(void*)
     }
     FreeDeviceControlRecord(dcr);
     jcr->sd_impl->dcr = nullptr;
+    dev->dunblock();
   }
   FreeJcr(jcr);
+}
+
+/**
+ * Here we create the devices that need to be initialized at startup. This is
+ * done once at startup in a separate thread.
+ *
+ * As soon as the devices exist, the director may send jobs. Their loaded slots,
+ * opening and labels are handled in the background, one thread per autochanger
+ * and per device outside of one, as the commands of an autochanger are
+ * serialized by its lock anyway.
+ */
+extern "C" void* device_initialization(void*)
+{
+  DeviceResource* device_resource = nullptr;
+  std::map<AutochangerResource*, std::vector<Device*>> changer_devices;
+  std::vector<std::vector<Device*>> groups;
+
+  pthread_detach(pthread_self());
+  JobControlRecord* jcr = NewInitializationJcr();
+
+  {
+    ResLocker _{my_config};
+    foreach_res (device_resource, R_DEVICE) {
+      if (!NeedsStartupInitialization(device_resource)) {
+        Dmsg1(90, "Deferring initialization of %s\n",
+              device_resource->archive_device_string);
+        continue;
+      }
+      Device* dev = InitDevice(jcr, device_resource);
+      Dmsg1(10, "SD init done %s\n", device_resource->archive_device_string);
+      if (!dev) {
+        Jmsg1(nullptr, M_ERROR, 0, T_("Could not initialize %s\n"),
+              device_resource->archive_device_string);
+        continue;
+      }
+
+      if (device_resource->changer_res) {
+        changer_devices[device_resource->changer_res].push_back(dev);
+      } else {
+        groups.push_back({dev});
+      }
+    }
+  }
+  FreeJcr(jcr);
+
+  for (auto& [changer, devices] : changer_devices) {
+    groups.push_back(std::move(devices));
+  }
+
+  /* Commands are accepted once every thread blocked its devices, so no job
+   * grabs one before it is initialized. */
+  std::vector<std::thread> threads;
+  for (auto& devices : groups) {
+    std::promise<void> blocked;
+    std::future<void> devices_blocked = blocked.get_future();
+    threads.emplace_back([&devices, blocked = std::move(blocked)]() mutable {
+      for (Device* dev : devices) { dev->dblock(BST_DOING_ACQUIRE); }
+      blocked.set_value();
+      InitializeDevices(devices);
+    });
+    devices_blocked.wait();
+  }
   init_done = true;
+
+  for (auto& thread : threads) { thread.join(); }
   return nullptr;
 }
 
@@ -585,10 +678,12 @@ static
   in_here = true;
   debug_level = 0; /* turn off any debug */
   StopStatisticsThread();
+  StopUnloadIdleDrivesThread();
 #if HAVE_NDMP
   if (me->ndmp_enable) { StopNdmpThreadServer(); }
 #endif
   StopSocketServer();
+  StopMetricsServer();
 
   StopWatchdog();
 
@@ -99,17 +99,49 @@ static ResourceItem store_items[] = {
   {"HeartbeatInterval", CFG_TYPE_TIME, ITEM(res_store, heartbeat_interval), 0, CFG_ITEM_DEFAULT, "0", NULL, NULL},
   {"CheckpointInterval", CFG_TYPE_TIME, ITEM(res_store, checkpoint_interval), 0, CFG_ITEM_DEFAULT, "0", NULL, NULL},
   {"MaximumNetworkBufferSize", CFG_TYPE_PINT32, ITEM(res_store, max_network_buffer_size), 0, 0, NULL, NULL, NULL},
+  {"DirectDataReceive", CFG_TYPE_BOOL, ITEM(res_store, direct_data_receive), 0, CFG_ITEM_DEFAULT, "false", "24.0.0-",
+   "Receive the file data sent by clients directly into the device blocks instead of buffering every network message first."
+   "  This saves copying all data once, but receiving and writing the data does not overlap anymore."
+   "  It is not used for jobs with plugins that translate records (e.g. autoxflate)."},
+  {"RestoreSendAhead", CFG_TYPE_PINT32, ITEM(res_store, restore_send_ahead), 0, CFG_ITEM_DEFAULT, "0", "24.0.0-",
+   "Number of records a restore reads from the volumes ahead of what was sent to the client, so that reading the"
+   " volumes and sending the data overlap.  0 sends every record before the next one is read."},
   {"ClientConnectWait", CFG_TYPE_TIME, ITEM(res_store, client_wait), 0, CFG_ITEM_DEFAULT, "1800" /* 30 minutes */, NULL, NULL},
   {"VerId", CFG_TYPE_STR, ITEM(res_store, verid), 0, 0, NULL, NULL, NULL},
   {"MaximumBandwidthPerJob", CFG_TYPE_SPEED, ITEM(res_store, max_bandwidth_per_job), 0, 0, NULL, NULL, NULL},
   {"AllowBandwidthBursting", CFG_TYPE_BOOL, ITEM(res_store, allow_bw_bursting), 0, CFG_ITEM_DEFAULT, "false", NULL, NULL},
+  {"MaximumWriteBandwidth", CFG_TYPE_SPEED, ITEM(res_store, max_write_bandwidth), 0, 0, NULL, "24.0.0-",
+   "Bandwidth all jobs together write to the devices with.  Jobs writing at the same time share it by the weights of"
+   " their priorities (see Priority Write Weights).  0 does not limit it."},
+  {"MaximumWritesPerSecond", CFG_TYPE_PINT32, ITEM(res_store, max_writes_per_second), 0, 0, NULL, "24.0.0-",
+   "Number of blocks all jobs together write to the devices per second, shared like the Maximum Write Bandwidth."
+   "  0 does not limit it."},
+  {"MaximumJobBufferMemory", CFG_TYPE_SIZE64, ITEM(res_store, max_job_buffer_memory), 0, 0, NULL, "24.0.0-",
+   "Memory the block buffers of all jobs together may use.  A job only gets its buffers when it acquires its device,"
+   " and waits there while the running jobs use the budget.  0 does not limit it."},
+  {"HugePageBuffers", CFG_TYPE_BOOL, ITEM(res_store, huge_page_buffers), 0, CFG_ITEM_DEFAULT, "false", "24.0.0-",
+   "Block and network buffers of at least 1 MiB get 2 MiB pages of their own, from the reserved huge pages if there"
+   " are any, else as transparent huge pages.  The pages come from the NUMA node of the thread allocating them."},
+  {"PriorityWriteWeights", CFG_TYPE_ALIST_STR, ITEM(res_store, priority_write_weights), 0, 0, NULL, "24.0.0-",
+   "Share of the write limits of the jobs by priority, as <priority>:<weight>.  A job gets the weight of the lowest"
+   " listed priority at least as big as its own, jobs of priorities above all listed ones get weight 1."},
   {"NdmpEnable", CFG_TYPE_BOOL, ITEM(res_store, ndmp_enable), 0, CFG_ITEM_DEFAULT, "false", NULL, NULL},
   {"NdmpSnooping", CFG_TYPE_BOOL, ITEM(res_store, ndmp_snooping), 0, CFG_ITEM_DEFAULT, "false", NULL, NULL},
   {"NdmpLogLevel", CFG_TYPE_PINT32, ITEM(res_store, ndmploglevel), 0, CFG_ITEM_DEFAULT, "4", NULL, NULL},
   {"NdmpAddress", CFG_TYPE_ADDRESSES_ADDRESS, ITEM(res_store, NDMPaddrs), 0, CFG_ITEM_DEFAULT, "10000", NULL, NULL},
   {"NdmpAddresses", CFG_TYPE_ADDRESSES, ITEM(res_store, NDMPaddrs), 0, CFG_ITEM_DEFAULT, "10000", NULL, NULL},
   {"NdmpPort", CFG_TYPE_ADDRESSES_PORT, ITEM(res_store, NDMPaddrs), 0, CFG_ITEM_DEFAULT, "10000", NULL, NULL},
+  {"NdmpWriteQueueSize", CFG_TYPE_PINT32, ITEM(res_store, ndmp_write_queue_size), 0, CFG_ITEM_DEFAULT, "0", "24.0.0-",
+   "Number of records an NDMP backup queues for an own thread that writes them to the device, so that receiving from"
+   " the filer and writing overlap.  0 writes every record before the next one is received."},
+  {"NdmpMaximumRecordSize", CFG_TYPE_SIZE32, ITEM(res_store, ndmp_maximum_record_size), 0, CFG_ITEM_DEFAULT, "0", "24.0.0-",
+   "Aggregate the tape writes of NDMP backups into records of up to this size.  0 stores every tape write of the"
+   " filer as a record of its own.  Volumes written with it can only be restored by a Storage Daemon of this version"
+   " or later."},
   {"AutoXFlateOnReplication", CFG_TYPE_BOOL, ITEM(res_store, autoxflateonreplication), 0, CFG_ITEM_DEFAULT, "false", "13.4.0-", NULL},
+  {"BlockPassthroughOnCopy", CFG_TYPE_BOOL, ITEM(res_store, block_passthrough_on_copy), 0, CFG_ITEM_DEFAULT, "false", "24.0.0-",
+   "Copy and migration jobs that read and write in this daemon copy the blocks of the copied job as a whole, instead"
+   " of splitting them into records and blocking them again. Only used when no plugin translates records."},
   {"AbsoluteJobTimeout", CFG_TYPE_PINT32, ITEM(res_store, jcr_watchdog_time), 0, 0, NULL, "14.2.0-", "Absolute time after which a Job gets terminated regardless of its progress" },
   {"CollectDeviceStatistics", CFG_TYPE_BOOL, ITEM(res_store, collect_dev_stats), 0, CFG_ITEM_DEPRECATED | CFG_ITEM_DEFAULT, "false", NULL, NULL},
   {"CollectJobStatistics", CFG_TYPE_BOOL, ITEM(res_store, collect_job_stats), 0, CFG_ITEM_DEPRECATED | CFG_ITEM_DEFAULT, "false", NULL, NULL},
@@ -118,6 +150,13 @@ static ResourceItem store_items[] = {
   {"FileDeviceConcurrentRead", CFG_TYPE_BOOL, ITEM(res_store, filedevice_concurrent_read), 0, CFG_ITEM_DEFAULT, "false", NULL, NULL},
   {"SecureEraseCommand", CFG_TYPE_STR, ITEM(res_store, secure_erase_cmdline), 0, 0, NULL, "15.2.1-",
       "Specify command that will be called when bareos unlinks files."},
+  {"MetricsPort", CFG_TYPE_PINT32, ITEM(res_store, metrics_port), 0, CFG_ITEM_DEFAULT, "0", "24.0.0-",
+   "Port on which metrics are served over HTTP in the OpenMetrics format (GET /metrics). 0 disables the endpoint."},
+  {"MetricsAddress", CFG_TYPE_STR, ITEM(res_store, metrics_address), 0, CFG_ITEM_DEFAULT, "localhost", "24.0.0-",
+   "Address on which the metrics endpoint listens."},
+  {"LockProfileSampling", CFG_TYPE_PINT32, ITEM(res_store, lock_profile_sampling), 0, CFG_ITEM_DEFAULT, "0", "24.0.0-",
+   "Sample one in this many lock acquisitions of every thread for the lock contention profile shown by status. 0 switches"
+   " the profile off."},
   {"LogTimestampFormat", CFG_TYPE_STR, ITEM(res_store, log_timestamp_format), 0, CFG_ITEM_DEFAULT, "%d-%b %H:%M", "15.2.3-", NULL},
     TLS_COMMON_CONFIG(res_store),
     TLS_CERT_CONFIG(res_store),
@@ -196,12 +235,44 @@ static ResourceItem dev_items[] = {
       "64512" /* DEFAULT_BLOCK_SIZE */, NULL, NULL},
   {"MinimumBlockSize", CFG_TYPE_PINT32, ITEM(res_dev, min_block_size), 0, 0, NULL, NULL, NULL},
   {"MaximumBlockSize", CFG_TYPE_MAXBLOCKSIZE, ITEM(res_dev, max_block_size), 0, CFG_ITEM_DEFAULT, "1048576", NULL, NULL},
+  {"AdaptiveBlockSize", CFG_TYPE_BOOL, ITEM(res_dev, adaptive_block_size), 0, CFG_ITEM_DEFAULT, "false", "24.0.0-",
+      "At the start of every new tape volume, measure how fast the drive writes blocks between Minimum Block Size "
+      "(at least 64 KiB) and Maximum Block Size, and write the rest of the volume with the fastest. Blocks never get "
+      "larger than Maximum Block Size, so the volumes stay readable with it."},
   {"MaximumFileSize", CFG_TYPE_SIZE64, ITEM(res_dev, max_file_size), 0, CFG_ITEM_DEFAULT, "1000000000", NULL, NULL},
   {"VolumeCapacity", CFG_TYPE_SIZE64, ITEM(res_dev, volume_capacity), 0, 0, NULL, NULL, NULL},
   {"MaximumConcurrentJobs", CFG_TYPE_PINT32, ITEM(res_dev, max_concurrent_jobs), 0, CFG_ITEM_DEFAULT, "1", NULL, NULL},
+  {"VolumePerJob", CFG_TYPE_BOOL, ITEM(res_dev, volume_per_job), 0, CFG_ITEM_DEFAULT, "false", "24.0.0-",
+      "Only for file devices: instead of letting up to Maximum Concurrent Jobs jobs write into the same volume, split the "
+      "device into that many devices of one job each, so every job writes its own volume. The devices are still "
+      "selected by the name of this resource. Restores then do not have to read the blocks of the other jobs."},
+  {"DirectIo", CFG_TYPE_BOOL, ITEM(res_dev, direct_io), 0, CFG_ITEM_DEFAULT, "false", "24.0.0-",
+      "Only for file devices: write volumes with O_DIRECT, past the page cache of the operating system, and drop "
+      "the pages of volumes read for restores. Keeps backups from pushing everything else out of memory."},
+  {"PreallocationSize", CFG_TYPE_SIZE64, ITEM(res_dev, preallocation_size), 0, CFG_ITEM_DEFAULT, "0", "24.0.0-",
+      "Only for file and dedupable devices: reserve the space of growing volumes in steps of this size, but not "
+      "beyond their Maximum Volume Bytes, so they end up in few large extents. What is left is given back when the "
+      "volume gets closed. 0 disables it."},
+  {"CpuAffinity", CFG_TYPE_STR, ITEM(res_dev, cpu_affinity), 0, 0, NULL, "24.0.0-",
+      "Cpus the jobs using this device run on while they have it, like 0-7,16-23. Pick the cpus of the NUMA node "
+      "the controller of the device is attached to: the block buffers of the jobs then come from that node too. "
+      "Only supported on Linux."},
   {"SpoolDirectory", CFG_TYPE_DIR, ITEM(res_dev, spool_directory), 0, 0, NULL, NULL, NULL},
+  {"BlockIndexDirectory", CFG_TYPE_DIR, ITEM(res_dev, block_index_directory), 0, 0, NULL, "24.0.0-",
+      "Keep an index of the blocks of every volume written by this (disk) device in this directory. Restores "
+      "use it to position directly to the first block with wanted data instead of reading all blocks in front of it."},
   {"MaximumSpoolSize", CFG_TYPE_SIZE64, ITEM(res_dev, max_spool_size), 0, 0, NULL, NULL, NULL},
   {"MaximumJobSpoolSize", CFG_TYPE_SIZE64, ITEM(res_dev, max_job_spool_size), 0, 0, NULL, NULL, NULL},
+  {"DespoolReadAhead", CFG_TYPE_PINT32, ITEM(res_dev, despool_read_ahead), 0, CFG_ITEM_DEFAULT, "0", "24.0.0-",
+      "Number of spooled blocks read ahead on a separate thread while despooling, so that the device "
+      "does not have to wait for the spool disk. 0 reads the spool file in turn with writing to the device."},
+  {"MemorySpoolSize", CFG_TYPE_SIZE64, ITEM(res_dev, memory_spool_size), 0, CFG_ITEM_DEFAULT, "0", "24.0.0-",
+      "Jobs writing to this tape device without data spooling collect up to this much data in memory and write it "
+      "to the drive in one burst, so that a slow client does not make the drive stop and reposition after every "
+      "block. The limit is shared by all jobs of the device. 0 writes every block when it arrives."},
+  {"SpoolWhileDespooling", CFG_TYPE_BOOL, ITEM(res_dev, spool_while_despooling), 0, CFG_ITEM_DEFAULT, "false", "24.0.0-",
+      "Keep receiving data from the client while the job despools. What the job cannot take in the meantime "
+      "is kept in a file in the Spool Directory, so the client does not have to wait for the device."},
   {"DriveIndex", CFG_TYPE_PINT16, ITEM(res_dev, drive_index), 0, 0, NULL, NULL, NULL},
   {"MountPoint", CFG_TYPE_STRNAME, ITEM(res_dev, mount_point), 0, 0, NULL, NULL, NULL},
   {"MountCommand", CFG_TYPE_STRNAME, ITEM(res_dev, mount_command), 0, 0, NULL, NULL, NULL},
@@ -214,6 +285,9 @@ static ResourceItem dev_items[] = {
   {"AutoDeflate", CFG_TYPE_IODIRECTION, ITEM(res_dev, autodeflate), 0, 0, NULL, "13.4.0-", NULL},
   {"AutoDeflateAlgorithm", CFG_TYPE_CMPRSALGO, ITEM(res_dev, autodeflate_algorithm), 0, 0, NULL, "13.4.0-", NULL},
   {"AutoDeflateLevel", CFG_TYPE_PINT16, ITEM(res_dev, autodeflate_level), 0, CFG_ITEM_DEFAULT, "6", "13.4.0-",NULL},
+  {"AutoDeflateBufferSize", CFG_TYPE_SIZE32, ITEM(res_dev, autodeflate_buffer_size), 0, CFG_ITEM_DEFAULT, "0", "24.0.0-",
+      "Data records a job writes to this device get compressed by the autoxflate plugin on threads shared by all "
+      "jobs, with up to this much data per job being compressed at once. 0 compresses them on the thread of the job."},
   {"AutoInflate", CFG_TYPE_IODIRECTION, ITEM(res_dev, autoinflate), 0, 0, NULL, "13.4.0-", NULL},
   {"CollectStatistics", CFG_TYPE_BOOL, ITEM(res_dev, collectstats), 0, CFG_ITEM_DEFAULT, "true", NULL, NULL},
   {"EofOnErrorIsEot", CFG_TYPE_BOOL, ITEM(res_dev, eof_on_error_is_eot), 0, CFG_ITEM_DEFAULT, NULL, "18.2.4-",
@@ -231,6 +305,12 @@ static ResourceItem autochanger_items[] = {
   {"Device", CFG_TYPE_ALIST_RES, ITEM(res_changer, device_resources), R_DEVICE, CFG_ITEM_REQUIRED, NULL, NULL, NULL},
   {"ChangerDevice", CFG_TYPE_STRNAME, ITEM(res_changer, changer_name), 0, CFG_ITEM_REQUIRED, NULL, NULL, NULL},
   {"ChangerCommand", CFG_TYPE_STRNAME, ITEM(res_changer, changer_command), 0, CFG_ITEM_REQUIRED, NULL, NULL, NULL},
+  {"MaximumConcurrentOperations", CFG_TYPE_PINT32, ITEM(res_changer, max_concurrent_operations), 0, CFG_ITEM_DEFAULT, "1", "24.0.0-",
+      "Number of changer commands (load, unload) that may run at the same time for different drives of this autochanger. "
+      "Only raise this if the library can move several tapes at once."},
+  {"UnloadIdleDrivesAfter", CFG_TYPE_TIME, ITEM(res_changer, unload_idle_drives_after), 0, CFG_ITEM_DEFAULT, "0", "24.0.0-",
+      "Unload the tape of a drive after it was not used by any job for this long, so that the next load does not have to wait for the unload. "
+      "0 disables this."},
   {nullptr, 0, 0, nullptr, 0, 0, nullptr, nullptr, nullptr}
 };
 
@@ -269,7 +349,8 @@ static s_io_kw io_directions[] = {
 static s_kw compression_algorithms[]
     = {{"gzip", COMPRESS_GZIP},   {"lzo", COMPRESS_LZO1X},
        {"lzfast", COMPRESS_FZFZ}, {"lz4", COMPRESS_FZ4L},
-       {"lz4hc", COMPRESS_FZ4H},  {NULL, 0}};
+       {"lz4hc", COMPRESS_FZ4H},  {"zstd", COMPRESS_ZSTD},
+       {NULL, 0}};
 
 static void StoreAuthenticationType(LEX* lc, ResourceItem* item, int index, int)
 {
@@ -466,6 +547,44 @@ static void MultiplyDevice(DeviceResource& multiplied_device_resource)
   }
 }
 
+/* A device with VolumePerJob becomes MaximumConcurrentJobs devices of one job
+ * each, which are then created like the ones of Count. */
+static void SplitVolumePerJobDevices(ConfigurationParser& config)
+{
+  BareosResource* p = nullptr;
+  while ((p = config.GetNextRes(R_DEVICE, p))) {
+    DeviceResource& d = dynamic_cast<DeviceResource&>(*p);
+    if (!d.volume_per_job || d.max_concurrent_jobs == 1) { continue; }
+    if (d.count > 1) {
+      Jmsg1(nullptr, M_ERROR_TERM, 0,
+            T_("device %s: Volume Per Job cannot be combined with Count.\n"),
+            d.resource_name_);
+    }
+    if (d.max_concurrent_jobs == 0) {
+      Jmsg1(nullptr, M_ERROR_TERM, 0,
+            T_("device %s: Volume Per Job needs a limited "
+               "'Maximum Concurrent Jobs'.\n"),
+            d.resource_name_);
+    }
+    d.count = d.max_concurrent_jobs;
+    d.max_concurrent_jobs = 1;
+  }
+}
+
+static void CheckVolumePerJobDevices(ConfigurationParser& config)
+{
+  BareosResource* p = nullptr;
+  while ((p = config.GetNextRes(R_DEVICE, p))) {
+    DeviceResource& d = dynamic_cast<DeviceResource&>(*p);
+    if (d.volume_per_job && d.device_type != DeviceType::B_FILE_DEV) {
+      Jmsg1(nullptr, M_ERROR_TERM, 0,
+            T_("device %s: Volume Per Job is only supported for file "
+               "devices.\n"),
+            d.resource_name_);
+    }
+  }
+}
+
 static void MultiplyConfiguredDevices(ConfigurationParser& config)
 {
   BareosResource* p = nullptr;
@@ -590,8 +709,10 @@ static void CheckAndLoadDeviceBackends(ConfigurationParser& config)
 
 static void ConfigReadyCallback(ConfigurationParser& config)
 {
+  SplitVolumePerJobDevices(config);
   MultiplyConfiguredDevices(config);
   GuessMissingDeviceTypes(config);
+  CheckVolumePerJobDevices(config);
   CheckAndLoadDeviceBackends(config);
   CheckDropletDevices(config);
 }
@@ -793,6 +914,7 @@ static bool SaveResource(int type, ResourceItem* items, int pass)
                 res_store->resource_name_);
         } else {
           p->plugin_names = res_store->plugin_names;
+          p->priority_write_weights = res_store->priority_write_weights;
           p->messages = res_store->messages;
           p->backend_directories = res_store->backend_directories;
           p->tls_cert_.allowed_certificate_common_names_ = std::move(
@@ -811,12 +933,7 @@ static bool SaveResource(int type, ResourceItem* items, int pass)
 
           for (auto* q : p->device_resources) { q->changer_res = p; }
 
-          int errstat;
-          if ((errstat = RwlInit(&p->changer_lock, PRIO_SD_ACH_ACCESS)) != 0) {
-            BErrNo be;
-            Jmsg1(NULL, M_ERROR_TERM, 0, T_("Unable to init lock: ERR=%s\n"),
-                  be.bstrerror(errstat));
-          }
+          p->operations = new ChangerOperations(p->max_concurrent_operations);
         }
         break;
       }
@@ -922,7 +1039,7 @@ static void FreeResource(BareosResource* res, int type)
       if (p->changer_name) { free(p->changer_name); }
       if (p->changer_command) { free(p->changer_command); }
       if (p->device_resources) { delete p->device_resources; }
-      RwlDestroy(&p->changer_lock);
+      if (p->operations) { delete p->operations; }
       delete p;
       break;
     }
@@ -935,10 +1052,12 @@ static void FreeResource(BareosResource* res, int type)
       if (p->working_directory) { free(p->working_directory); }
       if (p->plugin_directory) { free(p->plugin_directory); }
       if (p->plugin_names) { delete p->plugin_names; }
+      if (p->priority_write_weights) { delete p->priority_write_weights; }
       if (p->scripts_directory) { free(p->scripts_directory); }
       if (p->verid) { free(p->verid); }
       if (p->secure_erase_cmdline) { free(p->secure_erase_cmdline); }
       if (p->log_timestamp_format) { free(p->log_timestamp_format); }
+      if (p->metrics_address) { free(p->metrics_address); }
       delete p;
       break;
     }
@@ -953,6 +1072,7 @@ static void FreeResource(BareosResource* res, int type)
       if (p->changer_command) { free(p->changer_command); }
       if (p->alert_command) { free(p->alert_command); }
       if (p->spool_directory) { free(p->spool_directory); }
+      if (p->block_index_directory) { free(p->block_index_directory); }
       if (p->mount_point) { free(p->mount_point); }
       if (p->mount_command) { free(p->mount_command); }
       if (p->unmount_command) { free(p->unmount_command); }
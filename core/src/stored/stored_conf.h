@@ -117,6 +117,11 @@ class StorageResource
   utime_t checkpoint_interval = {0};    /**< Interval to save */
   utime_t client_wait = {0};            /**< Time to wait for FD to connect */
   uint32_t max_network_buffer_size = 0; /**< Max network buf size */
+  uint32_t restore_send_ahead = 0;     /**< Records queued for the FD */
+  uint32_t ndmp_write_queue_size = 0;  /**< NDMP records queued for writing */
+  uint32_t ndmp_maximum_record_size = 0; /**< Aggregate NDMP tape writes */
+  bool direct_data_receive = false;     /**< Receive data into the blocks */
+  bool block_passthrough_on_copy = false; /**< Copy whole blocks in MAC jobs */
   bool autoxflateonreplication
       = false; /**< Perform autoxflation when replicating data
                 */
@@ -135,6 +140,15 @@ class StorageResource
   char* log_timestamp_format = nullptr; /**< Timestamp format to use in generic
                                  logging messages */
   uint64_t max_bandwidth_per_job = 0;   /**< Bandwidth limitation (global) */
+  uint64_t max_write_bandwidth = 0;     /**< Of all jobs together */
+  uint32_t max_writes_per_second = 0;   /**< Of all jobs together */
+  uint64_t max_job_buffer_memory = 0;   /**< Of all jobs together */
+  bool huge_page_buffers = false;       /**< For block and network buffers */
+  alist<const char*>* priority_write_weights
+      = nullptr; /**< Shares of the writes by job priority */
+  char* metrics_address = nullptr;      /**< Address of the metrics endpoint */
+  uint32_t metrics_port = 0;            /**< Port of the metrics endpoint */
+  uint32_t lock_profile_sampling = 0;   /**< 0 or one in how many locks */
 
   bool just_in_time_reservation{false};
 
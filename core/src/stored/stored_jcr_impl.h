@@ -26,6 +26,7 @@
 
 #include "stored/read_ctx.h"
 #include "stored/stored_conf.h"
+#include "lib/stage_timer.h"
 #include "lib/thread_util.h"
 #include "stored/reserve.h"
 
@@ -60,6 +61,21 @@ struct DeviceWaitTimes {
   int32_t num_wait{};
 };
 
+// the stages a record goes through while a job appends data
+enum class append_stage
+{
+  kReceive,     /**< waiting for data from the FD */
+  kBlockBuild,  /**< putting records into blocks */
+  kSpoolWrite,  /**< writing blocks to the spool file */
+  kSpoolRead,   /**< reading blocks back from the spool file */
+  kDeviceWrite, /**< writing blocks to the device */
+  kAttributes,  /**< sending attributes to the director */
+  kCount
+};
+
+extern const char* const append_stage_names[
+    static_cast<std::size_t>(append_stage::kCount)];
+
 }  // namespace storagedaemon
 
 
@@ -70,6 +86,9 @@ struct StoredJcrImpl {
   pthread_cond_t job_end_wait = PTHREAD_COND_INITIALIZER;   /**< Wait for Job to end */
   synchronized<bool> client_available;
   std::condition_variable job_start_wait; /**< Wait for Client (FD/SD) to start Job */
+  synchronized<std::vector<BareosSocket*>> data_connections; /**< Extra data connections of the FD */
+  std::condition_variable data_connection_wait; /**< Wait for data connections */
+  int32_t expected_data_connections{}; /**< Data connections announced by the FD */
   storagedaemon::DeviceControlRecord* read_dcr{}; /**< Device context for reading */
   storagedaemon::DeviceControlRecord* dcr{};      /**< Device context record */
   POOLMEM* job_name{};            /**< Base Job name (not unique) */
@@ -77,6 +96,8 @@ struct StoredJcrImpl {
   POOLMEM* fileset_md5{};         /**< MD5 for FileSet */
   POOLMEM* backup_format{};       /**< Backup format used when doing a NDMP backup */
   storagedaemon::VolumeList* VolList{}; /**< List to read */
+  std::string read_group{};       /**< Copies sharing the read, see shared_read.h */
+  uint32_t read_group_size{};     /**< Number of them */
   int32_t NumWriteVolumes{};      /**< Number of volumes written */
   int32_t NumReadVolumes{};       /**< Total number of volumes to read */
   int32_t CurReadVolume{};        /**< Current read volume number */
@@ -87,7 +108,12 @@ struct StoredJcrImpl {
   bool ignore_label_errors{};     /**< Ignore Volume label errors */
   bool spool_attributes{};        /**< Set if spooling attributes */
   bool no_attributes{};           /**< Set if no attributes wanted */
+  bool batch_attributes{};        /**< Director accepts attribute batches */
   int64_t spool_size{};           /**< Spool size for this job */
+  uint64_t buffer_bytes{};        /**< Of its blocks, see buffer_budget.h */
+  storagedaemon::DeviceControlRecord* pinned_dcr{}; /**< Whose Cpu Affinity the job has */
+  pthread_t pinned_thread{};      /**< Running on it */
+  std::vector<int> unpinned_cpus{}; /**< Of the thread before */
   bool spool_data{};              /**< Set to spool data */
   storagedaemon::DirectorResource* director{}; /**< Director resource */
   alist<const char*>* plugin_options{};        /**< Specific Plugin Options sent by DIR */
@@ -100,6 +126,7 @@ struct StoredJcrImpl {
 
   storagedaemon::ReadSession read_session;
   storagedaemon::DeviceWaitTimes device_wait_times;
+  stage_timers<storagedaemon::append_stage> stage_times; /**< Append pipeline */
 };
 /* clang-format on */
 
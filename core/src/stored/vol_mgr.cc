@@ -2,7 +2,7 @@
    BAREOS® - Backup Archiving REcovery Open Sourced
 
    Copyright (C) 2000-2013 Free Software Foundation Europe e.V.
-   Copyright (C) 2015-2023 Bareos GmbH & Co. KG
+   Copyright (C) 2015-2024 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -33,8 +33,13 @@
 #include "stored/stored_globals.h"
 #include "stored/device_control_record.h"
 #include "stored/autochanger.h"
+#include "stored/wait.h"
 #include "include/jcr.h"
 #include "lib/berrno.h"
+#include "lib/lock_profile.h"
+
+#include <string_view>
+#include <unordered_map>
 
 namespace storagedaemon {
 
@@ -43,6 +48,10 @@ const int debuglevel = 150;
 static brwlock_t vol_list_lock;
 static dlist<VolumeReservationItem>* vol_list = NULL;
 static dlist<VolumeReservationItem>* read_vol_list = NULL;
+/* vol_list by VolumeName, so that finding a Volume does not walk the list.
+ * Protected by vol_list_lock, like vol_list. */
+static std::unordered_map<std::string_view, VolumeReservationItem*>* vol_index
+    = nullptr;
 static pthread_mutex_t read_vol_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /* Global static variables */
@@ -99,17 +108,19 @@ void InitVolListLock()
     Emsg1(M_ABORT, 0, T_("Unable to initialize volume list lock. ERR=%s\n"),
           be.bstrerror(errstat));
   }
+  lock_profile::NameLock(&vol_list_lock, "vol_list");
 }
 
 void TermVolListLock() { RwlDestroy(&vol_list_lock); }
 
 // This allows a given thread to recursively call to LockVolumes()
-void LockVolumes()
+void LockVolumes(libbareos::source_location loc)
 {
   int errstat;
 
   vol_list_lock_count++;
-  if ((errstat = RwlWritelock(&vol_list_lock)) != 0) {
+  if ((errstat = RwlWritelock(&vol_list_lock, loc.file_name(), loc.line()))
+      != 0) {
     BErrNo be;
     Emsg2(M_ABORT, 0, "RwlWritelock failure. stat=%d: ERR=%s\n", errstat,
           be.bstrerror(errstat));
@@ -193,7 +204,7 @@ void RemoveReadVolume(JobControlRecord* jcr, const char* VolumeName)
     FreeVolItem(fvol);
   }
   UnlockReadVolumes();
-  // pthread_cond_broadcast(&wait_next_vol);
+  ReleaseDeviceCond();
 }
 
 /**
@@ -421,10 +432,14 @@ VolumeReservationItem* reserve_volume(DeviceControlRecord* dcr,
     /* Read volumes on file based devices are not inserted into the write volume
      * list. */
     goto get_out;
+  } else if (auto found = vol_index->find(VolumeName);
+             found != vol_index->end()) {
+    vol = found->second;
   } else {
-    // Now try to insert the new Volume
+    // Now insert the new Volume
     vol = (VolumeReservationItem*)vol_list->binary_insert(nvol,
                                                           CompareByVolumename);
+    vol_index->emplace(vol->vol_name, vol);
   }
 
   if (vol != nvol) {
@@ -652,15 +667,14 @@ void ReadVolWalkEnd(VolumeReservationItem* vol)
  */
 static VolumeReservationItem* find_volume(const char* VolumeName)
 {
-  VolumeReservationItem vol, *fvol;
+  VolumeReservationItem* fvol = nullptr;
 
   if (vol_list->empty()) { return NULL; }
   /* Do not lock reservations here */
   LockVolumes();
-  vol.vol_name = strdup(VolumeName);
-  fvol = (VolumeReservationItem*)vol_list->binary_search(&vol,
-                                                         CompareByVolumename);
-  free(vol.vol_name);
+  if (auto found = vol_index->find(VolumeName); found != vol_index->end()) {
+    fvol = found->second;
+  }
   Dmsg2(debuglevel, "find_vol=%s found=%d\n", VolumeName, fvol != NULL);
 
   if (debug_level >= debuglevel) { DebugListVolumes("find_volume"); }
@@ -747,6 +761,7 @@ bool FreeVolume(Device* dev)
     if (vol->IsWriting() || !me->filedevice_concurrent_read
         || !dev->CanReadConcurrently()) {
       vol_list->remove(vol);
+      vol_index->erase(vol->vol_name);
     }
     Dmsg2(debuglevel, "=== remove volume %s dev=%s\n", vol->vol_name,
           dev->print_name());
@@ -757,7 +772,7 @@ bool FreeVolume(Device* dev)
     Dmsg1(debuglevel, "=== cannot clear swapping vol=%s\n", vol->vol_name);
   }
   UnlockVolumes();
-  // pthread_cond_broadcast(&wait_next_vol);
+  ReleaseDeviceCond();
 
   return true;
 }
@@ -765,7 +780,11 @@ bool FreeVolume(Device* dev)
 // Create the Volume list
 void CreateVolumeLists()
 {
-  if (vol_list == NULL) { vol_list = new dlist<VolumeReservationItem>(); }
+  if (vol_list == NULL) {
+    vol_list = new dlist<VolumeReservationItem>();
+    vol_index
+        = new std::unordered_map<std::string_view, VolumeReservationItem*>;
+  }
   if (read_vol_list == NULL) {
     read_vol_list = new dlist<VolumeReservationItem>();
   }
@@ -795,6 +814,8 @@ void FreeVolumeLists()
 {
   if (vol_list) {
     LockVolumes();
+    delete vol_index;
+    vol_index = nullptr;
     FreeVolumeList("vol_list", vol_list);
     delete vol_list;
     vol_list = NULL;
@@ -44,6 +44,7 @@ const int debuglevel = 400;
 
 static pthread_mutex_t device_release_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t wait_device_release = PTHREAD_COND_INITIALIZER;
+static uint64_t device_releases = 0; /* protected by device_release_mutex */
 
 /**
  * Wait for SysOp to mount a tape on a specific device
@@ -200,6 +201,13 @@ int WaitForSysop(DeviceControlRecord* dcr)
   return status;
 }
 
+uint64_t DeviceReleases()
+{
+  lock_mutex(device_release_mutex);
+  uint64_t releases = device_releases;
+  unlock_mutex(device_release_mutex);
+  return releases;
+}
 
 /**
  * Wait for any device to be released, then we return, so
@@ -212,12 +220,22 @@ int WaitForSysop(DeviceControlRecord* dcr)
  *          false if the total wait time has expired.
  */
 bool WaitForDevice(JobControlRecord* jcr, int& retries)
+{
+  return WaitForDevice(jcr, retries, DeviceReleases());
+}
+
+/* Same, but a device released since the caller got releases_seen from
+ * DeviceReleases(), i.e. while it looked at the devices, ends the wait at
+ * once instead of being missed. */
+bool WaitForDevice(JobControlRecord* jcr,
+                   int& retries,
+                   uint64_t releases_seen,
+                   int max_wait_time)
 {
   struct timeval tv;
   struct timespec timeout;
   int status = 0;
   bool ok = true;
-  const int max_wait_time = 1 * 60; /* wait 1 minute */
   char ed1[50];
 
   Dmsg0(debuglevel, "Enter WaitForDevice\n");
@@ -236,8 +254,11 @@ bool WaitForDevice(JobControlRecord* jcr, int& retries)
   Dmsg0(debuglevel, "Going to wait for a device.\n");
 
   /* Wait required time */
-  status = pthread_cond_timedwait(&wait_device_release, &device_release_mutex,
-                                  &timeout);
+  while (device_releases == releases_seen && status != ETIMEDOUT
+         && !jcr->IsJobCanceled()) {
+    status = pthread_cond_timedwait(&wait_device_release,
+                                    &device_release_mutex, &timeout);
+  }
   Dmsg1(debuglevel, "Wokeup from sleep on device status=%d\n", status);
 
   unlock_mutex(device_release_mutex);
@@ -246,6 +267,12 @@ bool WaitForDevice(JobControlRecord* jcr, int& retries)
 }
 
 // Signal the above WaitForDevice function.
-void ReleaseDeviceCond() { pthread_cond_broadcast(&wait_device_release); }
+void ReleaseDeviceCond()
+{
+  lock_mutex(device_release_mutex);
+  device_releases += 1;
+  pthread_cond_broadcast(&wait_device_release);
+  unlock_mutex(device_release_mutex);
+}
 
 } /* namespace storagedaemon */
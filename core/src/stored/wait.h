@@ -1,7 +1,7 @@
 /*
    BAREOS® - Backup Archiving REcovery Open Sourced
 
-   Copyright (C) 2018-2020 Bareos GmbH & Co. KG
+   Copyright (C) 2018-2024 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -35,7 +35,13 @@ enum
 };
 
 int WaitForSysop(DeviceControlRecord* dcr);
+// Number of ReleaseDeviceCond() calls so far
+uint64_t DeviceReleases();
 bool WaitForDevice(JobControlRecord* jcr, int& retries);
+bool WaitForDevice(JobControlRecord* jcr,
+                   int& retries,
+                   uint64_t releases_seen,
+                   int max_wait_time = 60);
 void ReleaseDeviceCond();
 
 } /* namespace storagedaemon */
@@ -0,0 +1,257 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * shares the device writes of the jobs of the storage daemon
+ *
+ * Start-time fair queuing: every write of a job gets the tag at which the
+ * previous write of the job finished in virtual time, or the current virtual
+ * time if the job was idle, and finishes cost / weight later.  The waiting
+ * write with the smallest tag goes next as soon as the time the ones before
+ * it needed at the configured limits is over.
+ */
+
+#include "include/bareos.h"
+#include "include/jcr.h"
+#include "stored/write_scheduler.h"
+#include "lib/alist.h"
+#include "lib/edit.h"
+#include "lib/metrics.h"
+#include "lib/status_packet.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace storagedaemon {
+
+namespace {
+
+using clock = std::chrono::steady_clock;
+
+metrics::histogram queue_delay{"bareos_sd_write_queue_delay_seconds",
+                               "Time blocks waited for the write scheduler",
+                               METRICS_SECONDS_BUCKETS};
+
+// jobs that were not told their priority have the default one
+constexpr int32_t kDefaultPriority = 10;
+
+struct flow {
+  std::string job{};
+  int32_t priority{};
+  double weight{1};
+  double finish{0}; /**< Virtual time the last write finishes */
+  uint32_t waiting{0};
+  uint64_t writes{0};
+  uint64_t bytes{0};
+  clock::duration delay{}; /**< Waited in total */
+};
+
+class WriteScheduler {
+ public:
+  std::atomic<bool> enabled{false};
+
+  bool Configure(uint64_t bytes_per_second,
+                 uint32_t writes_per_second,
+                 alist<const char*>* priority_weights,
+                 std::string& error);
+  void Schedule(JobControlRecord* jcr, uint32_t bytes);
+  void End(JobControlRecord* jcr);
+  void List(StatusPacket* sp);
+
+ private:
+  double Weight(int32_t priority) const;
+  // seconds the write takes at the limits
+  double Cost(uint32_t bytes) const
+  {
+    double cost = 0;
+    if (bytes_per_second_) { cost = double(bytes) / bytes_per_second_; }
+    if (writes_per_second_) {
+      cost = std::max(cost, 1.0 / writes_per_second_);
+    }
+    return cost;
+  }
+
+  uint64_t bytes_per_second_{0};
+  uint32_t writes_per_second_{0};
+  std::vector<std::pair<int32_t, double>> weights_{}; /**< By priority */
+
+  std::mutex mutex_{};
+  std::condition_variable next_{};
+  double virtual_time_{0};
+  clock::time_point busy_until_{};
+  uint64_t next_ticket_{0};
+  std::set<std::pair<double, uint64_t>> queue_{}; /**< Start tag, ticket */
+  std::map<uint32_t, flow> flows_{};              /**< By JobId */
+};
+
+bool WriteScheduler::Configure(uint64_t bytes_per_second,
+                               uint32_t writes_per_second,
+                               alist<const char*>* priority_weights,
+                               std::string& error)
+{
+  std::vector<std::pair<int32_t, double>> weights;
+  if (priority_weights) {
+    for (const char* entry : priority_weights) {
+      char* end;
+      long priority = strtol(entry, &end, 10);
+      double weight = 0;
+      if (*end == ':') { weight = strtod(end + 1, &end); }
+      if (*end != '\0' || priority < 1 || !(weight > 0)) {
+        error = "Invalid priority write weight \"";
+        error += entry;
+        error += "\", expected <priority>:<weight>";
+        return false;
+      }
+      weights.emplace_back(static_cast<int32_t>(priority), weight);
+    }
+  }
+  std::sort(weights.begin(), weights.end());
+
+  std::unique_lock lock(mutex_);
+  bytes_per_second_ = bytes_per_second;
+  writes_per_second_ = writes_per_second;
+  weights_ = std::move(weights);
+  enabled = bytes_per_second || writes_per_second;
+  return true;
+}
+
+double WriteScheduler::Weight(int32_t priority) const
+{
+  for (auto& [max_priority, weight] : weights_) {
+    if (priority <= max_priority) { return weight; }
+  }
+  return 1;
+}
+
+void WriteScheduler::Schedule(JobControlRecord* jcr, uint32_t bytes)
+{
+  std::unique_lock lock(mutex_);
+  auto [it, inserted] = flows_.try_emplace(jcr->JobId);
+  flow& f = it->second;
+  if (inserted) {
+    f.job = jcr->Job;
+    f.priority = jcr->JobPriority ? jcr->JobPriority : kDefaultPriority;
+    f.weight = Weight(f.priority);
+  }
+
+  double cost = Cost(bytes);
+  double start = std::max(virtual_time_, f.finish);
+  f.finish = start + cost / f.weight;
+  auto ticket = std::make_pair(start, next_ticket_++);
+  queue_.insert(ticket);
+  f.waiting++;
+
+  auto enqueued = clock::now();
+  while (*queue_.begin() != ticket || clock::now() < busy_until_) {
+    if (*queue_.begin() == ticket) {
+      next_.wait_until(lock, busy_until_);
+    } else {
+      next_.wait(lock);
+    }
+  }
+  queue_.erase(queue_.begin());
+  virtual_time_ = start;
+
+  // time the limits left unused is not saved up for later
+  auto now = clock::now();
+  busy_until_ = std::max(now, busy_until_)
+                + std::chrono::duration_cast<clock::duration>(
+                    std::chrono::duration<double>(cost));
+  f.waiting--;
+  f.writes++;
+  f.bytes += bytes;
+  f.delay += now - enqueued;
+  lock.unlock();
+
+  next_.notify_all();
+  queue_delay.Observe(std::chrono::duration<double>(now - enqueued).count());
+}
+
+void WriteScheduler::End(JobControlRecord* jcr)
+{
+  std::unique_lock lock(mutex_);
+  flows_.erase(jcr->JobId);
+}
+
+void WriteScheduler::List(StatusPacket* sp)
+{
+  char ed1[50], ed2[50];
+  PoolMem msg(PM_MESSAGE);
+  int len;
+
+  std::unique_lock lock(mutex_);
+  len = Mmsg(msg,
+             T_("Write scheduling: %s bytes/second, %u writes/second; "
+                "%llu waiting writes.\n"),
+             bytes_per_second_ ? edit_uint64_with_suffix(bytes_per_second_, ed1)
+                               : T_("unlimited"),
+             writes_per_second_, static_cast<unsigned long long>(queue_.size()));
+  sp->send(msg, len);
+
+  for (auto& [jobid, f] : flows_) {
+    double delay = std::chrono::duration<double>(f.delay).count();
+    len = Mmsg(msg,
+               T_("  JobId=%u Job=%s Priority=%d Weight=%.2f: %llu writes, %s "
+                  "bytes, %.3f seconds average delay, %u waiting\n"),
+               jobid, f.job.c_str(), f.priority, f.weight,
+               static_cast<unsigned long long>(f.writes),
+               edit_uint64_with_suffix(f.bytes, ed2),
+               f.writes ? delay / f.writes : 0.0, f.waiting);
+    sp->send(msg, len);
+  }
+}
+
+WriteScheduler scheduler;
+
+}  // namespace
+
+bool ConfigureWriteScheduler(uint64_t bytes_per_second,
+                             uint32_t writes_per_second,
+                             alist<const char*>* priority_weights,
+                             std::string& error)
+{
+  return scheduler.Configure(bytes_per_second, writes_per_second,
+                             priority_weights, error);
+}
+
+void ScheduleWrite(JobControlRecord* jcr, uint32_t bytes)
+{
+  if (scheduler.enabled) { scheduler.Schedule(jcr, bytes); }
+}
+
+void EndScheduledWrites(JobControlRecord* jcr)
+{
+  if (scheduler.enabled) { scheduler.End(jcr); }
+}
+
+void ListWriteScheduler(StatusPacket* sp)
+{
+  if (scheduler.enabled && !sp->api) { scheduler.List(sp); }
+}
+
+} /* namespace storagedaemon */
@@ -0,0 +1,59 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * shares the device writes of the jobs of the storage daemon
+ */
+#ifndef BAREOS_STORED_WRITE_SCHEDULER_H_
+#define BAREOS_STORED_WRITE_SCHEDULER_H_
+
+#include <cstdint>
+#include <string>
+
+template <typename T> class alist;
+class JobControlRecord;
+class StatusPacket;
+
+namespace storagedaemon {
+
+/* The blocks all jobs write to the devices are limited to a bandwidth and a
+ * number of writes per second.  Jobs that write at the same time share the
+ * limit by weighted fair queuing: each one gets a share proportional to the
+ * weight of its priority, so a small job of a high priority is not starved by
+ * the bulk writes of others.  Weights are given as "priority:weight", a job
+ * gets the weight of the lowest listed priority value at least as big as its
+ * own, or 1.  Without a limit blocks are written as soon as they are ready. */
+bool ConfigureWriteScheduler(uint64_t bytes_per_second,
+                             uint32_t writes_per_second,
+                             alist<const char*>* priority_weights,
+                             std::string& error);
+
+// waits until the job may write a block of this size to its device
+void ScheduleWrite(JobControlRecord* jcr, uint32_t bytes);
+
+// forgets about the job once it does not write anymore
+void EndScheduledWrites(JobControlRecord* jcr);
+
+void ListWriteScheduler(StatusPacket* sp);
+
+} /* namespace storagedaemon */
+
+#endif  // BAREOS_STORED_WRITE_SCHEDULER_H_
@@ -56,3 +56,32 @@ TEST(AppendProcessedFileTest, AddDeviceRecordCopiesDataContentNotPointer)
 
   FreePoolMemory(test_msg);
 }
+
+TEST(AppendFileIndexTest, NewJobStartsAtOne)
+{
+  using storagedaemon::FileIndexIsSequential;
+  EXPECT_TRUE(FileIndexIsSequential(false, 1, 0));
+  EXPECT_FALSE(FileIndexIsSequential(false, 5, 0));
+  EXPECT_FALSE(FileIndexIsSequential(false, 0, 0));
+  EXPECT_TRUE(FileIndexIsSequential(false, 1, 1));
+  EXPECT_TRUE(FileIndexIsSequential(false, 2, 1));
+  EXPECT_FALSE(FileIndexIsSequential(false, 3, 1));
+  EXPECT_FALSE(FileIndexIsSequential(false, 1, 2));
+}
+
+// a resumed backup continues the session after the last file saved before
+TEST(AppendFileIndexTest, ResumedJobContinuesFileIndex)
+{
+  using storagedaemon::FileIndexIsSequential;
+  const int32_t saved_before = 1234;
+  int32_t last_file_index = 0;
+  for (int32_t file_index = saved_before + 1; file_index < saved_before + 10;
+       ++file_index) {
+    EXPECT_TRUE(FileIndexIsSequential(true, file_index, last_file_index));
+    EXPECT_TRUE(FileIndexIsSequential(true, file_index, file_index));
+    last_file_index = file_index;
+  }
+  EXPECT_FALSE(FileIndexIsSequential(true, saved_before + 20, last_file_index));
+  EXPECT_FALSE(FileIndexIsSequential(true, 1, last_file_index));
+  EXPECT_FALSE(FileIndexIsSequential(true, -1, 0));
+}
@@ -0,0 +1,191 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#  include "gtest/gtest.h"
+#else
+#  include "gtest/gtest.h"
+#  include "include/bareos.h"
+#endif
+
+#include <sys/stat.h>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include "lib/attribs.h"
+
+static std::string TextForm(struct stat& statp, int32_t LinkFI, int stream)
+{
+  char buf[512];
+  EncodeStat(buf, &statp, sizeof(statp), LinkFI, stream);
+  return buf;
+}
+
+static std::string BinaryForm(struct stat& statp, int32_t LinkFI, int stream)
+{
+  char buf[512];
+  EncodeStatBinary(buf, &statp, sizeof(statp), LinkFI, stream);
+  return buf;
+}
+
+static void ExpectRoundTrip(struct stat statp, int32_t LinkFI, int stream)
+{
+  std::string binary = BinaryForm(statp, LinkFI, stream);
+  ASSERT_TRUE(IsBinaryStat(binary.c_str()));
+
+  struct stat decoded;
+  int32_t decoded_LinkFI = 0;
+  EXPECT_EQ(DecodeStat(binary.data(), &decoded, sizeof(decoded),
+                       &decoded_LinkFI),
+            stream);
+  EXPECT_EQ(decoded_LinkFI, LinkFI);
+  EXPECT_EQ(decoded.st_dev, statp.st_dev);
+  EXPECT_EQ(decoded.st_ino, statp.st_ino);
+  EXPECT_EQ(decoded.st_mode, statp.st_mode);
+  EXPECT_EQ(decoded.st_nlink, statp.st_nlink);
+  EXPECT_EQ(decoded.st_uid, statp.st_uid);
+  EXPECT_EQ(decoded.st_gid, statp.st_gid);
+  EXPECT_EQ(decoded.st_rdev, statp.st_rdev);
+  EXPECT_EQ(decoded.st_size, statp.st_size);
+  EXPECT_EQ(decoded.st_blksize, statp.st_blksize);
+  EXPECT_EQ(decoded.st_blocks, statp.st_blocks);
+  EXPECT_EQ(decoded.st_atime, statp.st_atime);
+  EXPECT_EQ(decoded.st_mtime, statp.st_mtime);
+  EXPECT_EQ(decoded.st_ctime, statp.st_ctime);
+
+  PoolMem text(PM_MESSAGE);
+  ASSERT_TRUE(StatToText(binary.c_str(), text));
+  EXPECT_EQ(std::string(text.c_str()), TextForm(statp, LinkFI, stream));
+}
+
+static struct stat SomeStat()
+{
+  struct stat statp {};
+  statp.st_dev = 64769;
+  statp.st_ino = 1837465;
+  statp.st_mode = S_IFREG | 0644;
+  statp.st_nlink = 1;
+  statp.st_uid = 1000;
+  statp.st_gid = 100;
+  statp.st_size = 48213;
+  statp.st_blksize = 4096;
+  statp.st_blocks = 96;
+  statp.st_atime = 1728900000;
+  statp.st_mtime = 1728800000;
+  statp.st_ctime = 1728800001;
+  return statp;
+}
+
+TEST(binary_attributes, RoundTrip)
+{
+  struct stat zero {};
+  ExpectRoundTrip(zero, 0, 0);
+  ExpectRoundTrip(SomeStat(), 0, 1);
+  ExpectRoundTrip(SomeStat(), 4711, 26);
+}
+
+TEST(binary_attributes, FullAndNegativeValues)
+{
+  struct stat statp = SomeStat();
+  statp.st_ino = std::numeric_limits<decltype(statp.st_ino)>::max();
+  statp.st_dev = std::numeric_limits<decltype(statp.st_dev)>::max();
+  statp.st_size = std::numeric_limits<decltype(statp.st_size)>::max();
+  statp.st_blocks = std::numeric_limits<decltype(statp.st_blocks)>::max();
+  statp.st_atime = std::numeric_limits<decltype(statp.st_atime)>::min();
+  statp.st_mtime = -1;
+  statp.st_ctime = std::numeric_limits<decltype(statp.st_ctime)>::max();
+  ExpectRoundTrip(statp, std::numeric_limits<int32_t>::min(), -1);
+  ExpectRoundTrip(statp, std::numeric_limits<int32_t>::max(), 0x7fffffff);
+}
+
+TEST(binary_attributes, ZigzagEdges)
+{
+  /* zigzag maps 63 and -64 to the largest one digit values, 64 and -65 are
+   * the first ones that need two digits */
+  for (int64_t value :
+       {int64_t{0}, int64_t{-1}, int64_t{1}, int64_t{63}, int64_t{-64},
+        int64_t{64}, int64_t{-65}, int64_t{8064}, int64_t{-8065},
+        std::numeric_limits<int64_t>::max(),
+        std::numeric_limits<int64_t>::min(),
+        std::numeric_limits<int64_t>::max() / 127,
+        std::numeric_limits<int64_t>::min() / 127}) {
+    struct stat statp = SomeStat();
+    statp.st_size = value;
+    statp.st_mtime = value;
+    ExpectRoundTrip(statp, 7, 1);
+  }
+
+  struct stat statp {};
+  statp.st_size = 63;
+  std::string one_digit = BinaryForm(statp, 0, 0);
+  statp.st_size = 64;
+  EXPECT_EQ(BinaryForm(statp, 0, 0).size(), one_digit.size() + 1);
+}
+
+TEST(binary_attributes, TruncatedIsRejected)
+{
+  struct stat statp = SomeStat();
+  std::string binary = BinaryForm(statp, 12, 1);
+  PoolMem text(PM_MESSAGE);
+  for (std::size_t length = 0; length < binary.size(); ++length) {
+    std::string truncated = binary.substr(0, length);
+    EXPECT_FALSE(StatToText(truncated.c_str(), text)) << length;
+
+    struct stat decoded;
+    int32_t LinkFI = -1;
+    DecodeStat(truncated.data(), &decoded, sizeof(decoded), &LinkFI);
+    if (length > 0) { EXPECT_EQ(LinkFI, 0) << length; }
+  }
+  EXPECT_TRUE(StatToText(binary.c_str(), text));
+}
+
+TEST(binary_attributes, OverlongFieldIsRejected)
+{
+  PoolMem text(PM_MESSAGE);
+
+  // eleven digits do not fit into 64 bits, even if the last one is zero
+  std::string eleven(1, kBinaryStatVersion);
+  eleven += std::string(10, '\x80') + '\x01' + std::string(15, '\x01');
+  EXPECT_FALSE(StatToText(eleven.c_str(), text));
+
+  // the largest tenth digit is too much as well
+  std::string too_large(1, kBinaryStatVersion);
+  too_large += std::string(9, '\xfe') + '\x7f' + std::string(15, '\x01');
+  EXPECT_FALSE(StatToText(too_large.c_str(), text));
+
+  // but ten digits can hold all 64 bits
+  struct stat statp {};
+  statp.st_ino = std::numeric_limits<decltype(statp.st_ino)>::max();
+  statp.st_size = std::numeric_limits<decltype(statp.st_size)>::min();
+  std::string binary = BinaryForm(statp, 0, 0);
+  EXPECT_TRUE(StatToText(binary.c_str(), text));
+}
+
+TEST(binary_attributes, NotBinary)
+{
+  struct stat statp = SomeStat();
+  std::string text_form = TextForm(statp, 0, 1);
+  EXPECT_FALSE(IsBinaryStat(text_form.c_str()));
+  PoolMem text(PM_MESSAGE);
+  EXPECT_FALSE(StatToText(text_form.c_str(), text));
+}
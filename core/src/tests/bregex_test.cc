@@ -0,0 +1,172 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#  include "gtest/gtest.h"
+#else
+#  include "gtest/gtest.h"
+#  include "include/bareos.h"
+#endif
+
+/* gtest may include the system <regex.h>, whose flags and syntax bits
+ * bregex.h defines differently */
+#undef RE_NREGS
+#undef REG_EXTENDED
+#undef REG_ICASE
+#undef REG_NOSUB
+#undef REG_NEWLINE
+#undef REG_NOTBOL
+#undef REG_NOMATCH
+#undef RE_NO_BK_PARENS
+#undef RE_NO_BK_VBAR
+#undef RE_BK_PLUS_QM
+#undef RE_CONTEXT_INDEP_OPS
+#undef RE_SYNTAX_AWK
+#undef RE_SYNTAX_EGREP
+#undef RE_SYNTAX_GREP
+#include "lib/bregex.h"
+
+#include <random>
+#include <string>
+
+// regexec() has to give the same results as the backtracker it replaced
+static void ExpectSameAsBacktracking(const std::string& pattern,
+                                     const std::string& text,
+                                     int cflags)
+{
+  regex_t preg;
+  if (regcomp(&preg, pattern.c_str(), cflags) != 0) { return; }
+
+  constexpr std::size_t nmatch = 5;
+  regmatch_t expected[nmatch], got[nmatch];
+  int expected_rc
+      = RegexecBacktracking(&preg, text.c_str(), nmatch, expected, 0);
+  int rc = regexec(&preg, text.c_str(), nmatch, got, 0);
+  EXPECT_EQ(rc, expected_rc) << "'" << pattern << "' on '" << text << "'";
+  EXPECT_EQ(regexec(&preg, text.c_str(), 0, nullptr, 0), expected_rc)
+      << "'" << pattern << "' on '" << text << "' without submatches";
+  if (rc == 0 && expected_rc == 0) {
+    EXPECT_EQ(got[0].rm_so, expected[0].rm_so) << pattern << " " << text;
+    EXPECT_EQ(got[0].rm_eo, expected[0].rm_eo) << pattern << " " << text;
+  }
+  regfree(&preg);
+}
+
+TEST(bregex, IgnoreCase)
+{
+  regex_t preg;
+  ASSERT_EQ(regcomp(&preg, "[ab]+\\.*$", REG_EXTENDED | REG_ICASE), 0);
+  EXPECT_EQ(regexec(&preg, "a.BAabbBB", 0, nullptr, 0), 0);
+  regmatch_t pmatch[2];
+  ASSERT_EQ(regexec(&preg, "a.BAabbBB", 2, pmatch, 0), 0);
+  EXPECT_EQ(pmatch[0].rm_so, 2);
+  EXPECT_EQ(pmatch[0].rm_eo, 9);
+  regfree(&preg);
+
+  ASSERT_EQ(regcomp(&preg, "\\.TXT$", REG_EXTENDED | REG_ICASE), 0);
+  EXPECT_EQ(regexec(&preg, "/home/README.txt", 0, nullptr, 0), 0);
+  EXPECT_EQ(regexec(&preg, "/HOME/NOTES.TXT", 0, nullptr, 0), 0);
+  EXPECT_NE(regexec(&preg, "/home/notes.txt.gz", 0, nullptr, 0), 0);
+  regfree(&preg);
+
+  ASSERT_EQ(regcomp(&preg, "\\.TXT$", REG_EXTENDED), 0);
+  EXPECT_NE(regexec(&preg, "/home/README.txt", 0, nullptr, 0), 0);
+  regfree(&preg);
+}
+
+TEST(bregex, Submatches)
+{
+  regex_t preg;
+  ASSERT_EQ(regcomp(&preg, "^/var/(log|spool)/(.*)$", REG_EXTENDED), 0);
+  regmatch_t pmatch[4];
+  ASSERT_EQ(regexec(&preg, "/var/log/messages", 4, pmatch, 0), 0);
+  EXPECT_EQ(pmatch[1].rm_so, 5);
+  EXPECT_EQ(pmatch[1].rm_eo, 8);
+  EXPECT_EQ(pmatch[2].rm_so, 9);
+  EXPECT_EQ(pmatch[2].rm_eo, 17);
+  regfree(&preg);
+}
+
+/* The backtracker fails repetitions of groups that can match the empty
+ * string and takes exponential time on nested ones, so only groups that
+ * always consume a character are repeated, and not within each other. */
+struct random_pattern {
+  std::string text{};
+  bool nullable{true};
+};
+
+static random_pattern RandomPattern(std::mt19937& gen,
+                                    int depth,
+                                    bool in_repeat)
+{
+  static constexpr const char* atoms[]
+      = {"a", "b", "B", ".", "\\.", "[ab]", "[^a]", "[A-Z]", "\\w", "\\W"};
+  static constexpr const char* repeats[] = {"", "", "*", "+", "?"};
+  random_pattern pattern;
+  for (int n = 1 + gen() % 4; n > 0; --n) {
+    random_pattern part;
+    std::string repeat = repeats[gen() % std::size(repeats)];
+    if (depth < 2 && gen() % 5 == 0) {
+      bool repeated = !in_repeat && !repeat.empty();
+      random_pattern alt = RandomPattern(gen, depth + 1, in_repeat || repeated);
+      part.text = "(" + alt.text;
+      part.nullable = alt.nullable;
+      if (gen() % 2) {
+        alt = RandomPattern(gen, depth + 1, in_repeat || repeated);
+        part.text += "|" + alt.text;
+        part.nullable = part.nullable || alt.nullable;
+      }
+      part.text += ")";
+      if (part.nullable || in_repeat) { repeat = ""; }
+    } else {
+      part.text = atoms[gen() % std::size(atoms)];
+      part.nullable = false;
+    }
+    if (repeat == "*" || repeat == "?") { part.nullable = true; }
+    pattern.text += part.text + repeat;
+    pattern.nullable = pattern.nullable && part.nullable;
+  }
+  return pattern;
+}
+
+static std::string RandomPattern(std::mt19937& gen)
+{
+  std::string pattern = RandomPattern(gen, 0, false).text;
+  if (gen() % 3 == 0) { pattern = "^" + pattern; }
+  if (gen() % 3 == 0) { pattern += "$"; }
+  return pattern;
+}
+
+TEST(bregex, SameAsBacktracking)
+{
+  static constexpr char alphabet[] = {'a', 'b', 'A', 'B', '.', '/', ' ', 'x'};
+  std::mt19937 gen(4711);
+  for (int i = 0; i < 2000; ++i) {
+    std::string pattern = RandomPattern(gen);
+    std::string text;
+    for (int n = gen() % 12; n > 0; --n) {
+      text += alphabet[gen() % std::size(alphabet)];
+    }
+    ExpectSameAsBacktracking(pattern, text, REG_EXTENDED);
+    ExpectSameAsBacktracking(pattern, text, REG_EXTENDED | REG_ICASE);
+  }
+}
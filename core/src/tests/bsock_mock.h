@@ -67,6 +67,8 @@ class BareosSocketMock : public BareosSocket {
                     int,
                     bool));
   MOCK_METHOD0(recv, int32_t());
+  MOCK_METHOD0(RecvLength, int32_t());
+  MOCK_METHOD2(RecvContent, int32_t(char*, int32_t));
   MOCK_METHOD0(send, bool());
   MOCK_METHOD2(read_nbytes, int32_t(char*, int32_t));
   MOCK_METHOD2(write_nbytes, int32_t(char*, int32_t));
@@ -0,0 +1,112 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#  include "gtest/gtest.h"
+#else
+#  include "gtest/gtest.h"
+#  include "include/bareos.h"
+#endif
+
+#include "findlib/change_source.h"
+
+TEST(changed_directories, parents_are_added)
+{
+  ChangedDirectories changed;
+  changed.Add("/home/user/docs/");
+
+  EXPECT_TRUE(changed.Contains("/home/user/docs/"));
+  EXPECT_TRUE(changed.Contains("/home/user/"));
+  EXPECT_TRUE(changed.Contains("/home/"));
+  EXPECT_TRUE(changed.Contains("/"));
+  EXPECT_FALSE(changed.Contains("/home/user/docs/old/"));
+  EXPECT_FALSE(changed.Contains("/home/other/"));
+  EXPECT_FALSE(changed.Contains("/var/"));
+  EXPECT_EQ(changed.size(), 4u);
+
+  changed.Add("/home/other/");
+  EXPECT_TRUE(changed.Contains("/home/other/"));
+  EXPECT_EQ(changed.size(), 5u);
+}
+
+TEST(changed_directories, subtrees)
+{
+  ChangedDirectories changed;
+  changed.AddSubtree("/srv/moved/");
+
+  EXPECT_TRUE(changed.Contains("/srv/"));
+  EXPECT_TRUE(changed.Contains("/srv/moved/"));
+  EXPECT_TRUE(changed.Contains("/srv/moved/a/"));
+  EXPECT_TRUE(changed.Contains("/srv/moved/a/b/"));
+  EXPECT_FALSE(changed.Contains("/srv/other/"));
+  EXPECT_FALSE(changed.Contains("/srv/moved2/"));
+}
+
+namespace {
+// covers everything below /data/, where only /data/changed/ changed
+class TestSource : public ChangeSource {
+ public:
+  TestSource() { changed_.Add("/data/changed/"); }
+
+  bool Covers(const char* dirname, const struct stat&) const override
+  {
+    return std::string_view{dirname}.rfind("/data/", 0) == 0;
+  }
+  bool MayHaveChanged(const char* dirname,
+                      const struct stat&) const override
+  {
+    return changed_.Contains(dirname);
+  }
+  void SaveState(JobControlRecord*) override { saved_ = true; }
+
+  bool saved_{false};
+
+ private:
+  ChangedDirectories changed_;
+};
+}  // namespace
+
+TEST(change_sources, skipped_directories)
+{
+  ChangeSources sources;
+  EXPECT_TRUE(sources.empty());
+  auto source = std::make_unique<TestSource>();
+  TestSource* test_source = source.get();
+  sources.Add(std::move(source));
+  EXPECT_FALSE(sources.empty());
+
+  struct stat statp {};
+  EXPECT_TRUE(sources.MayHaveChanged("/data/", statp));
+  EXPECT_TRUE(sources.MayHaveChanged("/data/changed/", statp));
+  EXPECT_FALSE(sources.MayHaveChanged("/data/same/", statp));
+  // not covered by any source
+  EXPECT_TRUE(sources.MayHaveChanged("/etc/", statp));
+
+  EXPECT_TRUE(sources.InSkippedDirectory("/data/same/file"));
+  EXPECT_TRUE(sources.InSkippedDirectory("/data/same/sub/file"));
+  EXPECT_FALSE(sources.InSkippedDirectory("/data/same"));
+  EXPECT_FALSE(sources.InSkippedDirectory("/data/changed/file"));
+  EXPECT_FALSE(sources.InSkippedDirectory("/data/samefile"));
+  EXPECT_FALSE(sources.InSkippedDirectory("/etc/passwd"));
+
+  sources.SaveState(nullptr);
+  EXPECT_TRUE(test_source->saved_);
+}
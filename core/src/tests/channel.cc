@@ -29,6 +29,7 @@
 #  include "include/bareos.h"
 #endif
 
+#include <algorithm>
 #include <vector>
 #include <thread>
 #include <random>
@@ -188,3 +189,142 @@ TEST(channel, NoFalsePutsOrGets)
     EXPECT_EQ(data_in[i], data_out[i]);
   }
 }
+
+template <typename T>
+static void CheckTransfer(channel::channel_pair<T> chan,
+                          bool blocking,
+                          std::size_t size = 100'000)
+{
+  std::vector<T> input = RandomData(size);
+  std::vector<T> output;
+  auto [in, out] = std::move(chan);
+  std::thread sender, receiver;
+  if (blocking) {
+    sender = std::thread{&SendDataBlocking<T>, std::cref(input), std::move(in)};
+    receiver = std::thread{&ReceiveDataBlocking<T>, std::ref(output),
+                           std::move(out)};
+  } else {
+    sender = std::thread{&SendDataNonBlocking<T>, std::cref(input),
+                         std::move(in)};
+    receiver = std::thread{&ReceiveDataNonBlocking<T>, std::ref(output),
+                           std::move(out)};
+  }
+
+  sender.join();
+  receiver.join();
+
+  ASSERT_EQ(input.size(), output.size());
+  for (std::size_t i = 0; i < input.size(); ++i) {
+    EXPECT_EQ(input[i], output[i]) << "input and output differ at index " << i;
+  }
+}
+
+TEST(channel, SpscConsistency)
+{
+  CheckTransfer(channel::CreateSpscChannel<int>(40), true);
+  CheckTransfer(channel::CreateSpscChannel<int>(40), false, 10'000);
+  CheckTransfer(channel::CreateSpscChannel<int>(1), true, 10'000);
+}
+
+TEST(channel, MpmcConsistency)
+{
+  CheckTransfer(channel::CreateMpmcChannel<int>(40), true);
+  CheckTransfer(channel::CreateMpmcChannel<int>(40), false, 10'000);
+  CheckTransfer(channel::CreateMpmcChannel<int>(1), true, 10'000);
+}
+
+TEST(channel, LockFreeConsistentState)
+{
+  std::pair<channel::channel_pair<int>, channel::channel_pair<int>> chans{
+      channel::CreateSpscChannel<int>(2), channel::CreateMpmcChannel<int>(2)};
+  for (auto* chan : {&chans.first, &chans.second}) {
+    auto& [in, out] = *chan;
+    ASSERT_TRUE(in.emplace(1));
+    ASSERT_TRUE(in.emplace(2));
+    EXPECT_FALSE(in.try_emplace(3));
+    EXPECT_FALSE(in.closed());
+    in.close();
+    EXPECT_TRUE(in.closed());
+    EXPECT_EQ(out.get(), 1);
+    EXPECT_EQ(out.get(), 2);
+    EXPECT_FALSE(out.get().has_value());
+    EXPECT_TRUE(out.closed());
+  }
+
+  auto [in, out] = channel::CreateSpscChannel<int>(2);
+  out.close();
+  in.try_update_status();
+  EXPECT_TRUE(in.closed());
+  EXPECT_FALSE(in.emplace(1));
+}
+
+TEST(channel, PutManyGetAll)
+{
+  std::size_t size = 100'000;
+  std::vector<int> input = RandomData(size);
+  std::vector<int> output;
+  auto [in, out] = channel::CreateSpscChannel<int>(64);
+
+  std::thread sender{[&input, in = std::move(in)]() mutable {
+    for (std::size_t i = 0; i < input.size(); i += 100) {
+      std::vector<int> batch(input.begin() + i, input.begin() + i + 100);
+      ASSERT_TRUE(in.put_many(batch));
+      EXPECT_TRUE(batch.empty());
+    }
+  }};
+
+  std::vector<int> batch;
+  while (out.get_all(batch)) {
+    EXPECT_FALSE(batch.empty());
+    EXPECT_LE(batch.size(), 64u);
+    output.insert(output.end(), batch.begin(), batch.end());
+  }
+  sender.join();
+
+  EXPECT_EQ(input, output);
+}
+
+TEST(channel, MpmcManyProducersAndConsumers)
+{
+  constexpr int num_threads = 4;
+  constexpr int per_producer = 25'000;
+  auto [in, out] = channel::CreateMpmcChannel<int>(16);
+
+  std::vector<std::thread> producers;
+  for (int p = 0; p < num_threads; ++p) {
+    producers.emplace_back([p, in = in.clone()]() mutable {
+      for (int i = 0; i < per_producer; ++i) {
+        ASSERT_TRUE(in.emplace(p * per_producer + i));
+      }
+    });
+  }
+  in.close();
+
+  std::vector<std::vector<int>> received(num_threads);
+  std::vector<std::thread> consumers;
+  for (int c = 0; c < num_threads; ++c) {
+    consumers.emplace_back([&received, c, out = out.clone()]() mutable {
+      for (auto v = out.get(); v; v = out.get()) {
+        received[c].push_back(*v);
+      }
+    });
+  }
+  out.close();
+
+  for (auto& t : producers) { t.join(); }
+  for (auto& t : consumers) { t.join(); }
+
+  std::vector<int> all;
+  for (auto& r : received) {
+    // values of one producer arrive in order at each consumer
+    std::vector<int> last(num_threads, -1);
+    for (int v : r) {
+      EXPECT_GT(v, last[v / per_producer]);
+      last[v / per_producer] = v;
+    }
+    all.insert(all.end(), r.begin(), r.end());
+  }
+  std::sort(all.begin(), all.end());
+  ASSERT_EQ(all.size(), std::size_t{num_threads * per_producer});
+  for (std::size_t i = 0; i < all.size(); ++i) { ASSERT_EQ(all[i], int(i)); }
+}
@@ -0,0 +1,99 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#endif
+
+#include "gtest/gtest.h"
+#include "stored/backends/dedupable/chunker.h"
+
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+using namespace dedup;
+
+static std::vector<char> RandomBytes(std::size_t size, unsigned seed)
+{
+  std::mt19937 gen(seed);
+  std::vector<char> data(size);
+  for (auto& c : data) { c = static_cast<char>(gen()); }
+  return data;
+}
+
+static std::vector<std::size_t> cut_points(const chunker& c,
+                                           const std::vector<char>& data)
+{
+  std::vector<std::size_t> cuts;
+  std::size_t pos = 0;
+  while (pos < data.size()) {
+    auto size = c.next_chunk(data.data() + pos, data.size() - pos);
+    EXPECT_GT(size, 0u);
+    pos += size;
+    cuts.push_back(pos);
+  }
+  return cuts;
+}
+
+TEST(chunker, bad_sizes)
+{
+  EXPECT_THROW(chunker{0}, std::invalid_argument);
+  EXPECT_THROW(chunker{chunker::max_avg_size + 1}, std::invalid_argument);
+  EXPECT_EQ(chunker{5000}.avg_size(), 4096u);
+}
+
+TEST(chunker, chunk_sizes)
+{
+  chunker c{4096};
+  auto data = RandomBytes(4 * 1024 * 1024, 1);
+  auto cuts = cut_points(c, data);
+
+  std::size_t last = 0;
+  for (auto cut : cuts) {
+    if (cut != data.size()) {
+      EXPECT_GE(cut - last, 1024u);
+      EXPECT_LE(cut - last, 8u * 4096u);
+    }
+    last = cut;
+  }
+
+  double avg = static_cast<double>(data.size()) / cuts.size();
+  EXPECT_GT(avg, 2048.0);
+  EXPECT_LT(avg, 8192.0);
+}
+
+TEST(chunker, cut_points_survive_insertion)
+{
+  chunker c{4096};
+  auto data = RandomBytes(1024 * 1024, 2);
+  auto shifted = data;
+  shifted.insert(shifted.begin() + 1000, 17, 'x');
+
+  auto cuts = cut_points(c, data);
+  std::set<std::size_t> shifted_cuts;
+  for (auto cut : cut_points(c, shifted)) { shifted_cuts.insert(cut - 17); }
+
+  // apart from the first few, all chunks should be found again
+  std::size_t found = 0;
+  for (auto cut : cuts) { found += shifted_cuts.count(cut); }
+  EXPECT_GE(found + 3, cuts.size());
+}
@@ -0,0 +1,214 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#  include "gtest/gtest.h"
+#else
+#  include "gtest/gtest.h"
+#  include "include/bareos.h"
+#endif
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "lib/crypto_cache.h"
+
+class CryptoCache : public ::testing::Test {
+ protected:
+  void SetUp() override
+  {
+    char templ[] = "/tmp/crypto_cache_XXXXXX";
+    ASSERT_NE(mkdtemp(templ), nullptr);
+    dir = templ;
+    file = dir + "/bareos-sd.9103.cryptoc";
+  }
+
+  void TearDown() override
+  {
+    FlushCryptoCache();
+    unlink(file.c_str());
+    rmdir(dir.c_str());
+  }
+
+  std::string Lookup(const char* VolumeName)
+  {
+    char* key = lookup_crypto_cache_entry(VolumeName);
+    if (!key) { return "<none>"; }
+    std::string value = key;
+    free(key);
+    return value;
+  }
+
+  std::vector<char> FileContent()
+  {
+    std::ifstream in(file, std::ios::binary);
+    return {std::istreambuf_iterator<char>(in),
+            std::istreambuf_iterator<char>()};
+  }
+
+  void WriteFile(const void* data, std::size_t size)
+  {
+    std::ofstream out(file, std::ios::binary | std::ios::trunc);
+    out.write(static_cast<const char*>(data), size);
+  }
+
+  std::string dir;
+  std::string file;
+};
+
+static s_crypto_cache_hdr Header(int32_t version, int32_t nr_entries)
+{
+  s_crypto_cache_hdr hdr{};
+  bstrncpy(hdr.id, "BAREOS Crypto Cache\n", sizeof(hdr.id));
+  hdr.version = version;
+  hdr.nr_entries = nr_entries;
+  return hdr;
+}
+
+static crypto_cache_entry_t Entry(const char* VolumeName,
+                                  const char* EncryptionKey,
+                                  utime_t added)
+{
+  crypto_cache_entry_t entry{};
+  bstrncpy(entry.VolumeName, VolumeName, sizeof(entry.VolumeName));
+  bstrncpy(entry.EncryptionKey, EncryptionKey, sizeof(entry.EncryptionKey));
+  entry.added = added;
+  return entry;
+}
+
+TEST_F(CryptoCache, RoundTrip)
+{
+  EXPECT_TRUE(UpdateCryptoCache("Full-0001", "key1"));
+  EXPECT_TRUE(UpdateCryptoCache("Full-0002", "key2"));
+  EXPECT_FALSE(UpdateCryptoCache("Full-0001", "key1"));
+  WriteCryptoCache(file.c_str());
+
+  // updates of a mapped cache go into the file
+  EXPECT_TRUE(UpdateCryptoCache("Full-0002", "key2b"));
+  for (int i = 0; i < 40; ++i) {
+    std::string name = "Incr-" + std::to_string(i);
+    EXPECT_TRUE(UpdateCryptoCache(name.c_str(), "incr"));
+  }
+  WriteCryptoCache(file.c_str());
+  FlushCryptoCache();
+  EXPECT_EQ(Lookup("Full-0001"), "<none>");
+
+  ReadCryptoCache(file.c_str());
+  EXPECT_EQ(Lookup("Full-0001"), "key1");
+  EXPECT_EQ(Lookup("Full-0002"), "key2b");
+  EXPECT_EQ(Lookup("Incr-39"), "incr");
+  EXPECT_EQ(Lookup("Full-0003"), "<none>");
+}
+
+TEST_F(CryptoCache, ConvertsVersion1)
+{
+  struct legacy_entry {
+    void* next;
+    void* prev;
+    char VolumeName[MAX_NAME_LENGTH];
+    char EncryptionKey[MAX_NAME_LENGTH];
+    utime_t added;
+  };
+  std::vector<char> content;
+  auto hdr = Header(1, 2);
+  content.insert(content.end(), reinterpret_cast<char*>(&hdr),
+                 reinterpret_cast<char*>(&hdr + 1));
+  for (const char* name : {"Old-0001", "Old-0002"}) {
+    legacy_entry entry{};
+    bstrncpy(entry.VolumeName, name, sizeof(entry.VolumeName));
+    bstrncpy(entry.EncryptionKey, name + 4, sizeof(entry.EncryptionKey));
+    entry.added = time(NULL);
+    content.insert(content.end(), reinterpret_cast<char*>(&entry),
+                   reinterpret_cast<char*>(&entry + 1));
+  }
+  WriteFile(content.data(), content.size());
+
+  ReadCryptoCache(file.c_str());
+  EXPECT_EQ(Lookup("Old-0001"), "0001");
+  EXPECT_EQ(Lookup("Old-0002"), "0002");
+
+  WriteCryptoCache(file.c_str());
+  FlushCryptoCache();
+  auto converted = FileContent();
+  ASSERT_GE(converted.size(), sizeof(s_crypto_cache_hdr));
+  EXPECT_EQ(reinterpret_cast<s_crypto_cache_hdr*>(converted.data())->version,
+            2);
+
+  ReadCryptoCache(file.c_str());
+  EXPECT_EQ(Lookup("Old-0001"), "0001");
+  EXPECT_EQ(Lookup("Old-0002"), "0002");
+}
+
+TEST_F(CryptoCache, ExpiresOldEntries)
+{
+  utime_t now = time(NULL);
+  struct {
+    s_crypto_cache_hdr hdr;
+    crypto_cache_entry_t entries[3];
+  } content{Header(2, 3),
+            {Entry("Expired", "old", now - CRYPTO_CACHE_MAX_AGE - 10),
+             Entry("Recent", "new", now - 10), Entry("", "", 0)}};
+  WriteFile(&content, sizeof(content));
+
+  ReadCryptoCache(file.c_str());
+  EXPECT_EQ(Lookup("Expired"), "old");
+  EXPECT_TRUE(UpdateCryptoCache("Recent", "new"));
+  EXPECT_EQ(Lookup("Expired"), "<none>");
+  EXPECT_EQ(Lookup("Recent"), "new");
+
+  // the expired slot is cleared in the file as well
+  FlushCryptoCache();
+  ReadCryptoCache(file.c_str());
+  EXPECT_EQ(Lookup("Expired"), "<none>");
+  EXPECT_EQ(Lookup("Recent"), "new");
+}
+
+TEST_F(CryptoCache, ReadOnlyLeavesTheFileAlone)
+{
+  utime_t now = time(NULL);
+  // a duplicate entry gets cleared when the file is mapped
+  struct {
+    s_crypto_cache_hdr hdr;
+    crypto_cache_entry_t entries[2];
+  } content{Header(2, 2), {Entry("Vol", "one", now), Entry("Vol", "two", now)}};
+  WriteFile(&content, sizeof(content));
+  auto before = FileContent();
+
+  ReadCryptoCache(file.c_str(), true);
+  EXPECT_NE(Lookup("Vol"), "<none>");
+  FlushCryptoCache();
+  EXPECT_EQ(FileContent(), before);
+
+  // nor is a broken file removed
+  auto hdr = Header(7, 0);
+  WriteFile(&hdr, sizeof(hdr));
+  ReadCryptoCache(file.c_str(), true);
+  EXPECT_EQ(Lookup("Vol"), "<none>");
+  EXPECT_EQ(access(file.c_str(), F_OK), 0);
+
+  ReadCryptoCache(file.c_str());
+  EXPECT_NE(access(file.c_str(), F_OK), 0);
+}
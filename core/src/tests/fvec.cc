@@ -172,3 +172,30 @@ TEST_F(fvec_fixture, PushWithChecks)
     FAIL() << "Error: " << ec.what() << "\n";
   }
 }
+
+TEST_F(fvec_fixture, Preallocation)
+{
+  int fd = fileno(backing.get());
+  constexpr std::size_t extent_size = 8 * 1024 * 1024;
+
+  try {
+    fvec<char> v(access::rdwr, fd);
+    v.preallocate(extent_size);
+    EXPECT_TRUE(v.preallocates());
+
+    std::vector<char> chunk(1024 * 1024, 'x');
+    v.append_range(chunk.data(), chunk.size());
+    EXPECT_GE(file_size(fd), extent_size);
+
+    struct stat s;
+    ASSERT_EQ(fstat(fd, &s), 0);
+    EXPECT_GE(static_cast<std::size_t>(s.st_blocks) * 512, extent_size);
+
+    v.resize_to_fit();
+    EXPECT_EQ(file_size(fd), chunk.size());
+  } catch (const std::system_error& ec) {
+    FAIL() << "Error: " << ec.code() << " - " << ec.what() << "\n";
+  } catch (const std::exception& ec) {
+    FAIL() << "Error: " << ec.what() << "\n";
+  }
+}
@@ -0,0 +1,98 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#  include "gtest/gtest.h"
+#else
+#  include "gtest/gtest.h"
+#  include "include/bareos.h"
+#endif
+
+#include "findlib/hardlink.h"
+
+#include <random>
+#include <string>
+#include <unordered_map>
+
+TEST(LinkHash, ForgetsFileAfterAllLinks)
+{
+  LinkHash links;
+  CurLink& first = links.Lookup(Hardlink{1, 42}, 3, "/a");
+  first.FileIndex = 7;
+  links.SetDigest(first, 3, "0123456789abcdef", 16);
+
+  CurLink& second = links.Lookup(Hardlink{1, 42}, 3, "/b");
+  EXPECT_EQ(second.FileIndex, 7u);
+  EXPECT_STREQ(links.name(second), "/a");
+  EXPECT_EQ(std::string(links.digest(second), second.digest_len),
+            "0123456789abcdef");
+  links.LinkSeen(second);
+  EXPECT_EQ(links.size(), 1u);
+
+  links.LinkSeen(links.Lookup(Hardlink{1, 42}, 3, "/c"));
+  EXPECT_EQ(links.size(), 0u);
+
+  // a new file with the same inode
+  CurLink& again = links.Lookup(Hardlink{1, 42}, 2, "/d");
+  EXPECT_EQ(again.FileIndex, 0u);
+  EXPECT_STREQ(links.name(again), "/d");
+  EXPECT_EQ(links.digest(again), nullptr);
+}
+
+TEST(LinkHash, RenameBeforeBackup)
+{
+  LinkHash links;
+  CurLink& link = links.Lookup(Hardlink{2, 5}, 2, "/first");
+  links.SetName(link, "/second");
+  EXPECT_STREQ(links.name(links.Lookup(Hardlink{2, 5}, 2, "/x")), "/second");
+}
+
+TEST(LinkHash, MatchesReferenceMap)
+{
+  std::mt19937 rng(4711);
+  LinkHash links;
+  std::unordered_map<uint64_t, std::string> reference;
+
+  for (int round = 0; round < 200000; ++round) {
+    uint64_t ino = rng() % 5000;
+    Hardlink key{static_cast<Hardlink::device_type>(ino % 3),
+                 static_cast<Hardlink::inode_type>(ino)};
+    std::string name = "/data/" + std::to_string(round);
+
+    CurLink& link = links.Lookup(key, 2, name.c_str());
+    auto [it, inserted] = reference.try_emplace(ino, name);
+    ASSERT_STREQ(links.name(link), it->second.c_str());
+    if (inserted) {
+      link.FileIndex = round + 1;
+    } else {
+      // the second link forgets the file
+      links.LinkSeen(link);
+      reference.erase(it);
+    }
+    ASSERT_EQ(links.size(), reference.size());
+  }
+
+  for (auto& [ino, name] : reference) {
+    Hardlink key{static_cast<Hardlink::device_type>(ino % 3),
+                 static_cast<Hardlink::inode_type>(ino)};
+    EXPECT_STREQ(links.name(links.Lookup(key, 2, "/new")), name.c_str());
+  }
+}
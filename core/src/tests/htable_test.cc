@@ -35,6 +35,10 @@
 #endif
 
 #include "lib/htable.h"
+#include "lib/flat_htable.h"
+
+#include <string>
+#include <vector>
 
 struct HTABLEJCR {
 #ifndef TEST_NON_CHAR
@@ -90,6 +94,80 @@ TEST(htable, htable)
   EXPECT_EQ(count, NITEMS);
 }
 
+struct FlatItem {
+  char* key;
+  int value;
+};
+
+TEST(htable, flat_htable)
+{
+  // start small, so that the table has to grow a few times
+  flat_htable<char*, FlatItem, MonotonicBuffer::Size::Medium> table(10);
+  char mkey[30];
+  for (int i = 0; i < NITEMS; i++) {
+    int len = sprintf(mkey, "%d", i) + 1;
+    auto* item = (FlatItem*)table.hash_malloc(sizeof(FlatItem));
+    item->key = table.hash_malloc(len);
+    memcpy(item->key, mkey, len);
+    item->value = i;
+    EXPECT_TRUE(table.insert(item->key, item));
+  }
+  EXPECT_EQ(table.size(), (uint32_t)NITEMS);
+
+  FlatItem duplicate{mkey, -1};
+  EXPECT_FALSE(table.insert(mkey, &duplicate));
+  EXPECT_EQ(table.size(), (uint32_t)NITEMS);
+
+  for (int i = 0; i < NITEMS; i += 97) {
+    sprintf(mkey, "%d", i);
+    FlatItem* item = table.lookup(mkey);
+    ASSERT_NE(item, nullptr);
+    EXPECT_EQ(item->value, i);
+  }
+  sprintf(mkey, "%d", NITEMS);
+  EXPECT_EQ(table.lookup(mkey), nullptr);
+
+  int count = 0;
+  FlatItem* item;
+  foreach_htable (item, &table) {
+    count++;
+  }
+  EXPECT_EQ(count, NITEMS);
+}
+
+TEST(htable, flat_htable_keys)
+{
+  struct Item {
+    uint64_t id;
+  };
+  flat_htable<uint64_t, Item, MonotonicBuffer::Size::Small> by_id;
+  std::vector<Item> ids(1000);
+  for (uint64_t i = 0; i < ids.size(); ++i) {
+    // keys that only differ in the high bits must not collide
+    ids[i].id = i << 40;
+    EXPECT_TRUE(by_id.insert(ids[i].id, &ids[i]));
+  }
+  for (auto& item : ids) { EXPECT_EQ(by_id.lookup(item.id), &item); }
+  EXPECT_EQ(by_id.lookup(1), nullptr);
+
+  flat_htable<htable_binary_key, Item, MonotonicBuffer::Size::Small> by_data;
+  std::vector<std::string> data;
+  for (int i = 0; i < 1000; ++i) {
+    data.push_back(std::string(i % 50, 'a') + std::to_string(i));
+  }
+  for (std::size_t i = 0; i < data.size(); ++i) {
+    htable_binary_key key{(uint8_t*)data[i].data(), (uint32_t)data[i].size()};
+    EXPECT_TRUE(by_data.insert(key, &ids[i]));
+  }
+  for (std::size_t i = 0; i < data.size(); ++i) {
+    std::string copy = data[i];
+    htable_binary_key key{(uint8_t*)copy.data(), (uint32_t)copy.size()};
+    EXPECT_EQ(by_data.lookup(key), &ids[i]);
+    key.len -= 1;
+    EXPECT_NE(by_data.lookup(key), &ids[i]);
+  }
+}
+
 struct RbListJobControlRecord {
   char* buf;
 };
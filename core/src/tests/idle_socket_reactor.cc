@@ -0,0 +1,83 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation, which is
+   listed in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#  include "gtest/gtest.h"
+#else
+#  include "gtest/gtest.h"
+#  include "include/bareos.h"
+#endif
+
+#include "lib/idle_socket_reactor.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <future>
+
+class IdleSocketReactorTest : public ::testing::Test {
+ protected:
+  void SetUp() override
+  {
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    ASSERT_TRUE(reactor.Start());
+  }
+  void TearDown() override
+  {
+    reactor.Stop();
+    close(fds[0]);
+    close(fds[1]);
+  }
+
+  int fds[2]{-1, -1};
+  IdleSocketReactor reactor;
+};
+
+TEST_F(IdleSocketReactorTest, ResumesOnceDataArrives)
+{
+  std::promise<bool> resumed;
+  ASSERT_TRUE(reactor.Park(fds[0], [&resumed](bool stop) {
+    resumed.set_value(stop);
+  }));
+  EXPECT_EQ(reactor.Parked(), 1u);
+
+  auto result = resumed.get_future();
+  EXPECT_EQ(result.wait_for(std::chrono::milliseconds(100)),
+            std::future_status::timeout);
+
+  ASSERT_EQ(write(fds[1], "x", 1), 1);
+  ASSERT_EQ(result.wait_for(std::chrono::seconds(10)),
+            std::future_status::ready);
+  EXPECT_FALSE(result.get());
+  EXPECT_EQ(reactor.Parked(), 0u);
+}
+
+TEST_F(IdleSocketReactorTest, StopAbandonsParkedSockets)
+{
+  bool stopped = false;
+  ASSERT_TRUE(reactor.Park(fds[0], [&stopped](bool stop) { stopped = stop; }));
+
+  reactor.Stop();
+  EXPECT_TRUE(stopped);
+  EXPECT_FALSE(reactor.Park(fds[0], [](bool) {}));
+}
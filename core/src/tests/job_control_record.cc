@@ -140,3 +140,46 @@ TEST_F(JobControlRecordTest, get_job_by_session_not_found)
   found_jcr = GetJcrBySession({11, 103});
   EXPECT_FALSE(found_jcr.get());
 }
+
+TEST(job_control_record_chain, lookups_follow_changed_keys)
+{
+  std::vector<JobControlRecord*> jobs;
+  for (int i = 0; i < 3; i++) {
+    JobControlRecord* jcr = new_jcr(callback);
+    snprintf(jcr->Job, sizeof(jcr->Job), "%d-chain", 200 + i);
+    jcr->JobId = 200 + i;
+    jcr->VolSessionId = 20 + i;
+    jcr->VolSessionTime = 200 + i;
+    register_jcr(jcr);
+    jobs.push_back(jcr);
+  }
+
+  JobControlRecord* found = get_jcr_by_id(201);
+  EXPECT_EQ(found, jobs[1]);
+  FreeJcr(found);
+  char name[]{"202-chain"};
+  found = get_jcr_by_full_name(name);
+  EXPECT_EQ(found, jobs[2]);
+  FreeJcr(found);
+  found = get_jcr_by_session(20, 200);
+  EXPECT_EQ(found, jobs[0]);
+  FreeJcr(found);
+
+  // the index entries of 201 are stale now
+  jobs[1]->JobId = 301;
+  jobs[1]->VolSessionId = 31;
+  EXPECT_EQ(get_jcr_by_id(201), nullptr);
+  EXPECT_EQ(get_jcr_by_session(21, 201), nullptr);
+  found = get_jcr_by_id(301);
+  EXPECT_EQ(found, jobs[1]);
+  FreeJcr(found);
+  found = get_jcr_by_session(31, 201);
+  EXPECT_EQ(found, jobs[1]);
+  FreeJcr(found);
+
+  FreeJcr(jobs[0]);
+  EXPECT_EQ(get_jcr_by_id(200), nullptr);
+  FreeJcr(jobs[1]);
+  FreeJcr(jobs[2]);
+  EXPECT_EQ(get_jcr_by_full_name(name), nullptr);
+}
@@ -32,10 +32,14 @@
 #include "lib/bstringlist.h"
 #include "lib/watchdog.h"
 #include "lib/bnet_server_tcp.h"
+#include "lib/bsock_tcp.h"
+#include "tests/bareos_test_sockets.h"
 #include "tests/init_openssl.h"
 
 #include "include/jcr.h"
 #include <signal.h>
+#include <chrono>
+#include <thread>
 
 static void InitSignalHandler()
 {
@@ -197,6 +201,15 @@ static void EnsureKtlsRecv(BareosSocket* sock)
   EXPECT_TRUE(sock->tls_conn->KtlsRecvStatus());
 }
 
+static void EnsureSendFileRange(BareosSocket* sock)
+{
+  EXPECT_TRUE(sock->tls_conn);
+  if (!sock->tls_conn) { return; }
+  // with kTLS sending the kernel encrypts, so files can go out directly
+  EXPECT_EQ(sock->CanSendFileRange(), sock->tls_conn->KtlsSendStatus());
+  EXPECT_TRUE(sock->CanSendFileRange());
+}
+
 enum test
 {
   test_v12_send,
@@ -205,6 +218,7 @@ enum test
   test_v13_recv,
   test_v12_256_send,
   test_v13_256_send,
+  test_v13_sendfile,
 };
 
 #if HAVE_LINUX_OS
@@ -260,6 +274,11 @@ bool IsTestDisabled(test T)
       return true;
     }
 #endif
+#if defined(DISABLE_KTLS_13_SEND)
+    case test_v13_sendfile: {
+      return true;
+    }
+#endif
 
     default: {
       return false;
@@ -332,3 +351,74 @@ TEST(ktls, v13_256_send)
                        [](BareosSocket* sock) { EnsureKtlsSend(sock); });
   }
 }
+
+TEST(ktls, v13_sendfile)
+{
+  if (IsTestDisabled(test_v13_sendfile)) {
+    GTEST_SKIP();
+  } else {
+    InitOpenSsl();
+    do_connection_test("configs/ktls/bareos/", "configs/ktls/13/",
+                       [](BareosSocket* sock) { EnsureSendFileRange(sock); });
+  }
+}
+
+/* Compares sending a file through msg with send() to SendFileRange() on a
+ * plain connection; the file is sent in pieces of the size of a typical
+ * restore record. */
+TEST(ktls, sendfile_benchmark)
+{
+  std::unique_ptr<TestSockets> test_sockets(
+      create_connected_server_and_client_bareos_socket());
+  ASSERT_NE(test_sockets.get(), nullptr);
+
+  char path[] = "/tmp/ktls_sendfile_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  unlink(path);
+
+  constexpr uint32_t piece_size = 64 * 1024;
+  constexpr uint64_t file_size = 256 * 1024 * 1024;
+  std::vector<char> piece(piece_size, 'x');
+  for (uint64_t written = 0; written < file_size; written += piece_size) {
+    ASSERT_EQ(write(fd, piece.data(), piece_size),
+              static_cast<ssize_t>(piece_size));
+  }
+
+  auto run = [&](const char* name, auto send_piece) {
+    uint64_t received = 0;
+    std::thread receiver([&] {
+      while (received < file_size) {
+        int32_t n = test_sockets->server->recv();
+        if (n <= 0) { break; }
+        received += n;
+      }
+    });
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t offset = 0; offset < file_size; offset += piece_size) {
+      if (!send_piece(offset)) { break; }
+    }
+    receiver.join();
+    std::chrono::duration<double> elapsed
+        = std::chrono::steady_clock::now() - start;
+    EXPECT_EQ(received, file_size) << name;
+    std::cout << name << ": " << file_size / elapsed.count() / (1024 * 1024)
+              << " MiB/s\n";
+  };
+
+  BareosSocketTCP* client = test_sockets->client.get();
+  run("send", [&](uint64_t offset) {
+    client->msg = CheckPoolMemorySize(client->msg, piece_size);
+    if (pread(fd, client->msg, piece_size, offset)
+        != static_cast<ssize_t>(piece_size)) {
+      return false;
+    }
+    client->message_length = piece_size;
+    return client->send();
+  });
+  run("SendFileRange", [&](uint64_t offset) {
+    return client->SendFileRange(fd, offset, piece_size);
+  });
+
+  close(fd);
+}
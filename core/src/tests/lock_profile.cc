@@ -0,0 +1,119 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#  include "gtest/gtest.h"
+#else
+#  include "gtest/gtest.h"
+#  include "include/bareos.h"
+#endif
+
+#include "lib/lock_profile.h"
+#include "lib/rwlock.h"
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+class lock_profile_test : public ::testing::Test {
+ protected:
+  void SetUp() override
+  {
+    lock_profile::Reset();
+    lock_profile::SetSampling(1);
+  }
+  void TearDown() override
+  {
+    lock_profile::SetSampling(0);
+    lock_profile::Reset();
+  }
+};
+
+TEST_F(lock_profile_test, is_empty_when_switched_off)
+{
+  lock_profile::SetSampling(0);
+  pthread_mutex_t m = PTHREAD_MUTEX_INITIALIZER;
+  lock_mutex(m);
+  unlock_mutex(m);
+  EXPECT_EQ(lock_profile::Report(), "");
+}
+
+TEST_F(lock_profile_test, records_waits_and_holders_of_mutexes)
+{
+  pthread_mutex_t m = PTHREAD_MUTEX_INITIALIZER;
+  lock_profile::NameLock(&m, "test mutex");
+
+  lock_mutex(m);
+  int holder_line = __LINE__ - 1;
+  std::thread waiter([&m] {
+    lock_mutex(m);
+    unlock_mutex(m);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  unlock_mutex(m);
+  waiter.join();
+
+  std::string report = lock_profile::Report();
+  EXPECT_NE(report.find("test mutex: sampled=2 waited=1"), std::string::npos)
+      << report;
+  EXPECT_NE(report.find("held by " + std::string{__FILE__} + ":"
+                        + std::to_string(holder_line) + ": 1"),
+            std::string::npos)
+      << report;
+  lock_profile::ForgetLock(&m);
+}
+
+TEST_F(lock_profile_test, records_waits_for_writers_of_rwlocks)
+{
+  brwlock_t rwl;
+  ASSERT_EQ(RwlInit(&rwl), 0);
+  lock_profile::NameLock(&rwl, "test rwlock");
+
+  ASSERT_EQ(RwlWritelock(&rwl), 0);
+  std::thread reader([&rwl] {
+    RwlReadlock(&rwl);
+    RwlReadunlock(&rwl);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  RwlWriteunlock(&rwl);
+  reader.join();
+
+  std::string report = lock_profile::Report();
+  EXPECT_NE(report.find("test rwlock: sampled=2 waited=1"), std::string::npos)
+      << report;
+  EXPECT_NE(report.find("held by " + std::string{__FILE__}), std::string::npos)
+      << report;
+  lock_profile::ForgetLock(&rwl);
+  RwlDestroy(&rwl);
+}
+
+TEST_F(lock_profile_test, samples_one_in_n)
+{
+  lock_profile::SetSampling(4);
+  lock_profile::mutex m{"sampled mutex"};
+  for (int i = 0; i < 8; ++i) {
+    m.lock();
+    m.unlock();
+  }
+  EXPECT_NE(lock_profile::Report().find("sampled mutex: sampled=2 waited=0"),
+            std::string::npos);
+}
@@ -0,0 +1,104 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#  include "gtest/gtest.h"
+#else
+#  include "gtest/gtest.h"
+#  include "include/bareos.h"
+#endif
+
+#include "lib/message_delivery.h"
+
+#include <atomic>
+#include <vector>
+
+TEST(message_delivery, delivers_in_order)
+{
+  std::vector<int> delivered;
+  message_delivery_queue<int> queue{
+      "test", 10, [&delivered](std::vector<int>& batch) {
+        delivered.insert(delivered.end(), batch.begin(), batch.end());
+      }};
+
+  int value = 0;
+  EXPECT_FALSE(queue.Put(value, true)) << "not started yet";
+
+  queue.Start();
+  for (int i = 0; i < 1000; ++i) {
+    value = i;
+    ASSERT_TRUE(queue.Put(value, true));
+  }
+  queue.Flush();
+  ASSERT_EQ(delivered.size(), 1000u);
+  for (int i = 0; i < 1000; ++i) { EXPECT_EQ(delivered[i], i); }
+
+  message_delivery_stats stats = queue.Stats();
+  EXPECT_EQ(stats.queued, 1000u);
+  EXPECT_EQ(stats.delivered, 1000u);
+  EXPECT_LE(stats.max_depth, 10u);
+  EXPECT_EQ(stats.inline_delivered, 0u);
+}
+
+TEST(message_delivery, full_queue_without_waiting)
+{
+  std::mutex blocker;
+  std::unique_lock hold(blocker);
+  message_delivery_queue<int> queue{
+      "test", 2, [&blocker](std::vector<int>&) {
+        std::unique_lock wait_for_test(blocker);
+      }};
+  queue.Start();
+
+  int value = 1;
+  /* the first one keeps the delivery thread busy, then the queue fills up;
+   * the thread might not have taken the first one yet */
+  int accepted = 0;
+  while (queue.Put(value, false)) { ++accepted; }
+  EXPECT_GE(accepted, 2);
+  EXPECT_LE(accepted, 3);
+  EXPECT_EQ(queue.Stats().inline_delivered, 1u);
+
+  hold.unlock();
+  queue.Stop();
+  EXPECT_EQ(queue.Stats().delivered, static_cast<uint64_t>(accepted));
+  EXPECT_FALSE(queue.Put(value, true)) << "stopped";
+}
+
+TEST(message_delivery, delivery_thread_cannot_queue)
+{
+  std::atomic<int> refused{0};
+  message_delivery_queue<int>* self = nullptr;
+  message_delivery_queue<int> queue{
+      "test", 10, [&self, &refused](std::vector<int>& batch) {
+        for (int v : batch) {
+          if (!self->Put(v, true)) { refused++; }
+        }
+      }};
+  self = &queue;
+  queue.Start();
+
+  int value = 1;
+  ASSERT_TRUE(queue.Put(value, true));
+  queue.Flush();
+  EXPECT_EQ(refused, 1);
+}
@@ -0,0 +1,139 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#  include "gtest/gtest.h"
+#else
+#  include "gtest/gtest.h"
+#  include "include/bareos.h"
+#endif
+
+#include "lib/metrics.h"
+#include "lib/metrics_server.h"
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+
+static bool Contains(const std::string& haystack, const std::string& needle)
+{
+  return haystack.find(needle) != std::string::npos;
+}
+
+TEST(metrics, renders_counters_and_gauges)
+{
+  metrics::counter c{"test_counter", "a counter"};
+  metrics::gauge g{"test_gauge", "a gauge"};
+  metrics::callback_gauge cb{"test_callback", "computed", [] { return 2.5; }};
+  c.Add(3);
+  c.Add();
+  g.Set(10);
+  g.Sub(3);
+
+  std::string out = metrics::Render();
+  EXPECT_TRUE(Contains(out, "# TYPE test_counter counter\n"));
+  EXPECT_TRUE(Contains(out, "# HELP test_counter a counter\n"));
+  EXPECT_TRUE(Contains(out, "test_counter_total 4\n"));
+  EXPECT_TRUE(Contains(out, "test_gauge 7\n"));
+  EXPECT_TRUE(Contains(out, "test_callback 2.5\n"));
+  EXPECT_EQ(out.substr(out.size() - 6), "# EOF\n");
+}
+
+TEST(metrics, unregisters_destroyed_metrics)
+{
+  {
+    metrics::counter c{"test_short_lived", "gone soon"};
+  }
+  EXPECT_FALSE(Contains(metrics::Render(), "test_short_lived"));
+}
+
+TEST(metrics, histogram_buckets_are_cumulative)
+{
+  metrics::histogram h{"test_histogram", "a histogram", {1, 10}};
+  h.Observe(0.5);
+  h.Observe(1);
+  h.Observe(5);
+  h.Observe(100);
+
+  std::string out = metrics::Render();
+  EXPECT_TRUE(Contains(out, "test_histogram_bucket{le=\"1\"} 2\n"));
+  EXPECT_TRUE(Contains(out, "test_histogram_bucket{le=\"10\"} 3\n"));
+  EXPECT_TRUE(Contains(out, "test_histogram_bucket{le=\"+Inf\"} 4\n"));
+  EXPECT_TRUE(Contains(out, "test_histogram_count 4\n"));
+  EXPECT_TRUE(Contains(out, "test_histogram_sum 106.5\n"));
+}
+
+TEST(metrics, counts_from_many_threads)
+{
+  metrics::counter c{"test_threads", "updated concurrently"};
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([&c] {
+      for (int j = 0; j < 10000; ++j) { c.Add(); }
+    });
+  }
+  for (auto& t : threads) { t.join(); }
+  EXPECT_EQ(c.Value(), 40000u);
+}
+
+static std::string Get(uint16_t port, const std::string& request)
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  std::string response;
+  if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+    send(fd, request.data(), request.size(), 0);
+    char buf[4096];
+    ssize_t n;
+    while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) { response.append(buf, n); }
+  }
+  close(fd);
+  return response;
+}
+
+TEST(metrics, serves_metrics_over_http)
+{
+  metrics::counter c{"test_http", "served"};
+  c.Add(42);
+
+  constexpr uint16_t port = 39471;
+  if (!StartMetricsServer("127.0.0.1", port)) {
+    GTEST_SKIP() << "port " << port << " is not available";
+  }
+
+  std::string response = Get(port, "GET /metrics HTTP/1.1\r\nHost: x\r\n\r\n");
+  EXPECT_EQ(response.rfind("HTTP/1.1 200 OK\r\n", 0), 0u) << response;
+  EXPECT_TRUE(Contains(response, "application/openmetrics-text"));
+  EXPECT_TRUE(Contains(response, "test_http_total 42\n"));
+
+  response = Get(port, "GET / HTTP/1.1\r\n\r\n");
+  EXPECT_EQ(response.rfind("HTTP/1.1 404", 0), 0u) << response;
+
+  StopMetricsServer();
+}
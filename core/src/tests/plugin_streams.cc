@@ -0,0 +1,143 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#  include "gtest/gtest.h"
+#else
+#  include "gtest/gtest.h"
+#  include "include/bareos.h"
+#endif
+
+
+#include "include/fcntl_def.h"
+#include "filed/plugin_streams.h"
+
+#include <atomic>
+#include <cstring>
+#include <string>
+
+using namespace filedaemon;
+
+namespace {
+// A plugin file of `size` bytes, each byte is its offset modulo 251.
+struct fake_file {
+  std::size_t size{0};
+  std::size_t pos{0};
+  bool fail_open{false};
+  std::atomic<int> opens{0};
+  std::atomic<int> closes{0};
+};
+
+fake_file* fake;
+
+bRC FakeIo(PluginContext*, io_pkt* io)
+{
+  switch (io->func) {
+    case IO_OPEN:
+      fake->opens += 1;
+      if (fake->fail_open) {
+        io->status = -1;
+        io->io_errno = ENOENT;
+        return bRC_Error;
+      }
+      io->status = 0;
+      return bRC_OK;
+    case IO_READ: {
+      std::size_t num = std::min<std::size_t>(io->count, fake->size - fake->pos);
+      for (std::size_t i = 0; i < num; ++i) {
+        io->buf[i] = static_cast<char>((fake->pos + i) % 251);
+      }
+      io->offset = fake->pos;
+      fake->pos += num;
+      io->status = num;
+      return bRC_OK;
+    }
+    case IO_CLOSE:
+      fake->closes += 1;
+      io->status = 0;
+      return bRC_OK;
+  }
+  return bRC_Error;
+}
+}  // namespace
+
+TEST(PluginStreamReader, ReadsWholeFile)
+{
+  fake_file file;
+  file.size = 1000 * 1000 + 17;
+  fake = &file;
+
+  PluginStreamReader reader(nullptr, FakeIo, 1, 128 * 1024);
+  reader.Open("/fake", O_RDONLY, 0);
+  int io_errno;
+  ASSERT_EQ(reader.OpenStatus(io_errno), 0);
+
+  std::size_t total = 0;
+  char buf[10000];
+  for (;;) {
+    boffset_t offset = -1;
+    ssize_t num = reader.Read(buf, sizeof(buf), offset, io_errno);
+    ASSERT_GE(num, 0);
+    if (num == 0) { break; }
+    ASSERT_EQ(static_cast<std::size_t>(offset), total);
+    for (ssize_t i = 0; i < num; ++i) {
+      ASSERT_EQ(buf[i], static_cast<char>((total + i) % 251));
+    }
+    total += num;
+  }
+  EXPECT_EQ(total, file.size);
+  boffset_t offset;
+  EXPECT_EQ(reader.Read(buf, sizeof(buf), offset, io_errno), 0);
+
+  EXPECT_EQ(reader.Close(io_errno), 0);
+  EXPECT_EQ(file.closes, 1);
+}
+
+TEST(PluginStreamReader, ClosesWhenNotRead)
+{
+  fake_file file;
+  file.size = 10 * 1000 * 1000;
+  fake = &file;
+
+  {
+    PluginStreamReader reader(nullptr, FakeIo, 2, 64 * 1024);
+    reader.Open("/fake", O_RDONLY, 0);
+  }
+  EXPECT_EQ(file.opens, 1);
+  EXPECT_EQ(file.closes, 1);
+  // stopped reading ahead once the buffer was full
+  EXPECT_LT(file.pos, file.size);
+}
+
+TEST(PluginStreamReader, ReportsFailedOpen)
+{
+  fake_file file;
+  file.fail_open = true;
+  fake = &file;
+
+  PluginStreamReader reader(nullptr, FakeIo, 1, 64 * 1024);
+  reader.Open("/missing", O_RDONLY, 0);
+  int io_errno;
+  EXPECT_LT(reader.OpenStatus(io_errno), 0);
+  EXPECT_EQ(io_errno, ENOENT);
+  EXPECT_EQ(reader.Close(io_errno), 0);
+  EXPECT_EQ(file.closes, 0);
+}
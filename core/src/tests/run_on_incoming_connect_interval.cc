@@ -218,6 +218,12 @@ class MockDatabase : public BareosDb {
   {
     return true;
   }
+  virtual bool SqlQueryPrepared(const prepared_statement&,
+                                const SqlParameters&,
+                                int) override
+  {
+    return true;
+  }
   virtual const char* sql_strerror(void) override { return ""; }
   virtual void SqlDataSeek(int) override {}
   virtual int SqlAffectedRows(void) override { return 0; }
@@ -228,6 +234,12 @@ class MockDatabase : public BareosDb {
   virtual SQL_FIELD* SqlFetchField(void) override { return nullptr; }
   virtual bool SqlFieldIsNotNull(int) override { return true; }
   virtual bool SqlFieldIsNumeric(int) override { return true; }
+  virtual bool SqlCopyRows(
+      const char*,
+      const std::vector<std::vector<std::string>>&) override
+  {
+    return true;
+  }
   virtual bool SqlBatchStartFileTable(JobControlRecord*) override
   {
     return true;
@@ -0,0 +1,169 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#  include "gtest/gtest.h"
+#else
+#  include "gtest/gtest.h"
+#  include "include/bareos.h"
+#endif
+
+#include <set>
+#include <thread>
+#include <vector>
+#include "lib/alist.h"
+#include "lib/crypto.h"
+
+class SealedBlocks : public ::testing::Test {
+ protected:
+  void SetUp() override
+  {
+    session = crypto_session_new(CRYPTO_CIPHER_AES_256_GCM, &no_recipients);
+    ASSERT_NE(session, nullptr);
+    uint32_t block_size = 0;
+    encrypt = crypto_cipher_new(session, true, &block_size);
+    ASSERT_NE(encrypt, nullptr);
+    EXPECT_EQ(block_size, 1u);
+    decrypt = crypto_cipher_new(session, false, &block_size);
+    ASSERT_NE(decrypt, nullptr);
+  }
+
+  void TearDown() override
+  {
+    if (decrypt) { CryptoCipherFree(decrypt); }
+    if (encrypt) { CryptoCipherFree(encrypt); }
+    if (session) { CryptoSessionFree(session); }
+  }
+
+  std::vector<uint8_t> Seal(const std::vector<uint8_t>& data)
+  {
+    std::vector<uint8_t> block(data.size() + CRYPTO_SEALED_OVERHEAD);
+    uint32_t written = 0;
+    EXPECT_TRUE(CryptoCipherSealBlock(encrypt, data.data(), data.size(),
+                                      block.data(), &written));
+    EXPECT_EQ(written, block.size());
+    return block;
+  }
+
+  bool Open(std::vector<uint8_t> block, std::vector<uint8_t>& data)
+  {
+    uint32_t written = 0;
+    if (!CryptoCipherOpenBlock(decrypt, block.data(), block.size(),
+                               &written)) {
+      return false;
+    }
+    auto* start = block.data() + CRYPTO_SEALED_HEADER_SIZE;
+    data.assign(start, start + written);
+    return true;
+  }
+
+  alist<X509_KEYPAIR*> no_recipients{};
+  CRYPTO_SESSION* session{nullptr};
+  CIPHER_CONTEXT* encrypt{nullptr};
+  CIPHER_CONTEXT* decrypt{nullptr};
+};
+
+static std::vector<uint8_t> TestData(std::size_t size, uint8_t seed)
+{
+  std::vector<uint8_t> data(size);
+  for (std::size_t i = 0; i < size; ++i) {
+    data[i] = static_cast<uint8_t>(i * 31 + seed);
+  }
+  return data;
+}
+
+TEST_F(SealedBlocks, OpenedInAnyOrder)
+{
+  ASSERT_TRUE(CryptoCipherSealsBlocks(encrypt));
+
+  std::vector<std::vector<uint8_t>> plain;
+  std::vector<std::vector<uint8_t>> sealed;
+  for (uint8_t i = 0; i < 4; ++i) {
+    plain.push_back(TestData(1000 + i * 4096, i));
+    sealed.push_back(Seal(plain.back()));
+  }
+
+  for (std::size_t i : {3, 1, 2, 0}) {
+    std::vector<uint8_t> opened;
+    ASSERT_TRUE(Open(sealed[i], opened));
+    EXPECT_EQ(opened, plain[i]);
+  }
+}
+
+TEST_F(SealedBlocks, SameDataSealsDifferently)
+{
+  auto data = TestData(512, 7);
+  auto first = Seal(data);
+  auto second = Seal(data);
+  EXPECT_NE(first, second);
+
+  std::vector<uint8_t> opened;
+  ASSERT_TRUE(Open(second, opened));
+  EXPECT_EQ(opened, data);
+}
+
+TEST_F(SealedBlocks, TamperedBlocksAreRejected)
+{
+  auto sealed = Seal(TestData(256, 3));
+  std::vector<uint8_t> opened;
+
+  for (std::size_t pos :
+       {std::size_t{3}, std::size_t{11}, std::size_t{CRYPTO_SEALED_HEADER_SIZE},
+        sealed.size() - 1}) {
+    auto tampered = sealed;
+    tampered[pos] ^= 0x01;
+    EXPECT_FALSE(Open(tampered, opened)) << "flipped byte " << pos;
+  }
+
+  auto truncated = sealed;
+  truncated.pop_back();
+  EXPECT_FALSE(Open(truncated, opened));
+
+  ASSERT_TRUE(Open(sealed, opened));
+}
+
+TEST_F(SealedBlocks, SealedByManyThreads)
+{
+  constexpr std::size_t threads = 4, blocks_per_thread = 100;
+  std::vector<std::vector<std::vector<uint8_t>>> sealed(threads);
+  std::vector<std::thread> workers;
+  for (std::size_t t = 0; t < threads; ++t) {
+    workers.emplace_back([this, t, &sealed] {
+      for (std::size_t i = 0; i < blocks_per_thread; ++i) {
+        sealed[t].push_back(Seal(TestData(100, static_cast<uint8_t>(t))));
+      }
+    });
+  }
+  for (auto& worker : workers) { worker.join(); }
+
+  std::set<std::vector<uint8_t>> numbers;
+  for (std::size_t t = 0; t < threads; ++t) {
+    for (auto& block : sealed[t]) {
+      numbers.emplace(block.begin() + 4,
+                      block.begin() + CRYPTO_SEALED_HEADER_SIZE);
+      std::vector<uint8_t> opened;
+      ASSERT_TRUE(Open(block, opened));
+      EXPECT_EQ(opened, TestData(100, static_cast<uint8_t>(t)));
+    }
+  }
+  EXPECT_EQ(numbers.size(), threads * blocks_per_thread);
+}
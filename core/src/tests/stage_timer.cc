@@ -0,0 +1,81 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#  include "gtest/gtest.h"
+#else
+#  include "gtest/gtest.h"
+#  include "include/bareos.h"
+#endif
+
+#include "lib/stage_timer.h"
+
+#include <thread>
+
+enum class test_stage
+{
+  kFirst,
+  kSecond,
+  kUnused,
+  kCount
+};
+
+static const char* const names[] = {"first", "second", "unused"};
+
+TEST(stage_timer, accumulates_per_stage)
+{
+  stage_timers<test_stage> timers;
+  timers.Add(test_stage::kFirst, std::chrono::milliseconds(1500));
+  timers.Add(test_stage::kFirst, std::chrono::milliseconds(500));
+  timers.Add(test_stage::kSecond, std::chrono::milliseconds(250));
+
+  EXPECT_EQ(timers.BusyNs(test_stage::kFirst), 2000000000u);
+  EXPECT_EQ(timers.Format(names), "first=2.000s second=0.250s");
+}
+
+TEST(stage_timer, counts_only_long_waits_as_stalls)
+{
+  stage_timers<test_stage> timers;
+  timers.AddWait(test_stage::kSecond, std::chrono::microseconds(10));
+  timers.AddWait(test_stage::kSecond, std::chrono::milliseconds(100));
+  timers.AddWait(test_stage::kSecond, std::chrono::milliseconds(200));
+
+  EXPECT_EQ(timers.Stalls(test_stage::kSecond), 2u);
+  EXPECT_EQ(timers.Format(names), "second=0.000s (stalled 2x 0.300s)");
+}
+
+TEST(stage_timer, scoped_timers)
+{
+  stage_timers<test_stage> timers;
+  {
+    auto timer = timers.Time(test_stage::kFirst);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  {
+    auto wait = timers.TimeWait(test_stage::kSecond);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  EXPECT_GE(timers.BusyNs(test_stage::kFirst), 5000000u);
+  EXPECT_EQ(timers.BusyNs(test_stage::kSecond), 0u);
+  EXPECT_EQ(timers.Stalls(test_stage::kSecond), 1u);
+  EXPECT_EQ(timers.Stalls(test_stage::kUnused), 0u);
+}
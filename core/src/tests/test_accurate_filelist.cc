@@ -0,0 +1,148 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#  include "gtest/gtest.h"
+#else
+#  include "gtest/gtest.h"
+#  include "include/bareos.h"
+#endif
+
+#include "filed/filed.h"
+#include "filed/accurate.h"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace filedaemon {
+
+namespace {
+struct test_file {
+  std::string name;
+  std::string lstat;
+  std::string chksum;
+  int32_t delta_seq;
+};
+
+std::vector<test_file> MakeFiles(std::size_t count)
+{
+  std::vector<test_file> files;
+  for (std::size_t i = 0; i < count; ++i) {
+    std::string dir = "/data/dir" + std::to_string(i / 37) + "/";
+    std::string ino = std::to_string(1000 + i);
+    files.push_back(
+        {dir + "file" + std::to_string(i),
+         /* same layout as EncodeStat() */
+         "gD Dp" + std::to_string(i % 10) + " IH/ B A A A " + ino + " BAA I "
+             + "BmFb4H BmFb4H BmFb4H A A C",
+         i % 3 ? "" : "d41d8cd98f00b204e9800998ecf8427e",
+         static_cast<int32_t>(i % 5)});
+  }
+  // not encoded like EncodeStat() would do it, has to be kept verbatim
+  files.push_back({"/data/odd", "AA  -A B ", "", -1});
+  files.push_back({"/data/empty", "", "", 0});
+  return files;
+}
+
+void AddFiles(BareosAccurateFilelist& list,
+              const std::vector<test_file>& files)
+{
+  for (auto& f : files) {
+    list.AddFile(const_cast<char*>(f.name.c_str()), f.name.size(),
+                 const_cast<char*>(f.lstat.c_str()), f.lstat.size(),
+                 const_cast<char*>(f.chksum.c_str()), f.chksum.size(),
+                 f.delta_seq);
+  }
+}
+}  // namespace
+
+TEST(accurate_filelist, compact_finds_everything)
+{
+  auto files = MakeFiles(10000);
+  std::shuffle(files.begin(), files.end(), std::mt19937{42});
+
+  BareosAccurateFilelistCompact list(nullptr, files.size());
+  AddFiles(list, files);
+  ASSERT_TRUE(list.EndLoad());
+
+  std::vector<bool> filenr_used(files.size());
+  for (auto& f : files) {
+    accurate_payload* payload
+        = list.lookup_payload(const_cast<char*>(f.name.c_str()));
+    ASSERT_NE(payload, nullptr) << f.name;
+    EXPECT_EQ(payload->lstat, f.lstat) << f.name;
+    EXPECT_EQ(payload->chksum, f.chksum) << f.name;
+    EXPECT_EQ(payload->delta_seq, f.delta_seq) << f.name;
+    ASSERT_LT(payload->filenr, files.size());
+    EXPECT_FALSE(filenr_used[payload->filenr]);
+    filenr_used[payload->filenr] = true;
+  }
+
+  for (const char* missing : {"", "/", "/data/dir0/file", "/data/dir0/file00",
+                              "/data/zzz", "/zzz"}) {
+    EXPECT_EQ(list.lookup_payload(const_cast<char*>(missing)), nullptr)
+        << missing;
+  }
+}
+
+TEST(accurate_filelist, compact_removes_duplicates)
+{
+  auto files = MakeFiles(100);
+  auto first = files;
+  for (auto& f : files) { f.delta_seq += 100; }
+  files.insert(files.begin(), first.begin(), first.end());
+
+  BareosAccurateFilelistCompact list(nullptr, files.size());
+  AddFiles(list, files);
+  ASSERT_TRUE(list.EndLoad());
+
+  // like the hash table, the first entry with a name wins
+  for (auto& f : first) {
+    accurate_payload* payload
+        = list.lookup_payload(const_cast<char*>(f.name.c_str()));
+    ASSERT_NE(payload, nullptr) << f.name;
+    EXPECT_EQ(payload->delta_seq, f.delta_seq) << f.name;
+    EXPECT_LT(payload->filenr, first.size());
+  }
+}
+
+TEST(accurate_filelist, compact_marks_files_as_seen)
+{
+  auto files = MakeFiles(100);
+
+  BareosAccurateFilelistCompact list(nullptr, files.size());
+  AddFiles(list, files);
+  ASSERT_TRUE(list.EndLoad());
+
+  for (auto& f : files) {
+    accurate_payload* payload
+        = list.lookup_payload(const_cast<char*>(f.name.c_str()));
+    ASSERT_NE(payload, nullptr);
+    list.MarkFileAsSeen(payload);
+    list.UnmarkFileAsSeen(payload);
+  }
+  list.MarkAllFilesAsSeen();
+  list.UnmarkAllFilesAsSeen();
+}
+
+}  // namespace filedaemon
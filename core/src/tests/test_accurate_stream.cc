@@ -0,0 +1,126 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#  include "gtest/gtest.h"
+#else
+#  include "gtest/gtest.h"
+#  include "include/bareos.h"
+#endif
+#include "lib/accurate_stream.h"
+
+#include <string>
+#include <vector>
+
+struct test_file {
+  std::string fname;
+  std::string lstat;
+  std::string chksum;
+  uint32_t delta_seq;
+};
+
+static const std::vector<test_file> files{
+    {"/etc/", "A A IH/ A A A A A A A A A A A A A", "", 0},
+    {"/etc/passwd", "gB BAR IGk B A A A O3 BAA I BmXPuf BmXPuf BmXPuf A A C",
+     "r4Z7q8rb2p1M0pV6jQq5rA", 0},
+    {"/etc/ssh/sshd_config", "gB BAS IGg B A A A tO BAA I Bl Bl Bl A A C", "",
+     3},
+    {"/home/user/", "A A IH/ A A A A A A A A A A A A A", "", 0},
+    {"/home/user/a", "", "", 1234567},
+};
+
+static std::vector<test_file> ReadMessage(std::vector<char> message,
+                                          bool& error)
+{
+  std::vector<test_file> read;
+  AccurateStreamReader reader(message.data(), message.size());
+  accurate_stream_entry entry;
+  while (reader.Next(entry)) {
+    EXPECT_EQ(entry.lstat[entry.lstat_length], '\0');
+    EXPECT_EQ(entry.chksum[entry.chksum_length], '\0');
+    read.push_back({entry.fname, std::string(entry.lstat, entry.lstat_length),
+                    std::string(entry.chksum, entry.chksum_length),
+                    static_cast<uint32_t>(entry.delta_seq)});
+  }
+  error = reader.Error();
+  return read;
+}
+
+TEST(AccurateStream, RoundTrip)
+{
+  AccurateStreamWriter writer;
+  for (const auto& file : files) {
+    EXPECT_FALSE(
+        writer.Add(file.fname, file.lstat, file.chksum, file.delta_seq));
+  }
+
+  bool error = true;
+  std::vector<test_file> read
+      = ReadMessage({writer.data(), writer.data() + writer.size()}, error);
+  EXPECT_FALSE(error);
+  ASSERT_EQ(read.size(), files.size());
+  for (std::size_t i = 0; i < files.size(); ++i) {
+    EXPECT_EQ(read[i].fname, files[i].fname);
+    EXPECT_EQ(read[i].lstat, files[i].lstat);
+    EXPECT_EQ(read[i].chksum, files[i].chksum);
+    EXPECT_EQ(read[i].delta_seq, files[i].delta_seq);
+  }
+}
+
+TEST(AccurateStream, SharedPrefixesAreNotRepeated)
+{
+  AccurateStreamWriter writer;
+  writer.Add("/a/long/directory/name/", "", "", 0);
+  uint32_t first = writer.size();
+  writer.Add("/a/long/directory/name/file", "", "", 0);
+  EXPECT_EQ(writer.size() - first, first - 23 + 4);
+}
+
+TEST(AccurateStream, MessagesStartOver)
+{
+  AccurateStreamWriter writer;
+  writer.Add("/etc/passwd", "", "", 0);
+  writer.Clear();
+  EXPECT_TRUE(writer.empty());
+  writer.Add("/etc/group", "", "", 0);
+
+  bool error = true;
+  std::vector<test_file> read
+      = ReadMessage({writer.data(), writer.data() + writer.size()}, error);
+  EXPECT_FALSE(error);
+  ASSERT_EQ(read.size(), 1u);
+  EXPECT_EQ(read[0].fname, "/etc/group");
+}
+
+TEST(AccurateStream, TruncatedMessagesAreDetected)
+{
+  AccurateStreamWriter writer;
+  for (const auto& file : files) {
+    writer.Add(file.fname, file.lstat, file.chksum, file.delta_seq);
+  }
+
+  for (uint32_t length = 1; length < writer.size(); ++length) {
+    bool error = false;
+    std::vector<test_file> read
+        = ReadMessage({writer.data(), writer.data() + length}, error);
+    EXPECT_LT(read.size(), files.size()) << length;
+  }
+}
@@ -0,0 +1,151 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#  include "gtest/gtest.h"
+#else
+#  include "gtest/gtest.h"
+#  include "include/bareos.h"
+#endif
+#include "stored/backends/background_truncation.h"
+
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using storagedaemon::BackgroundTruncation;
+
+namespace {
+struct Removed {
+  std::mutex mutex;
+  std::set<std::string> chunks;
+
+  tl::expected<void, std::string> Add(const std::string& volume,
+                                      const std::vector<std::string>& batch)
+  {
+    std::lock_guard lock{mutex};
+    for (const auto& chunk : batch) { chunks.insert(volume + "/" + chunk); }
+    return {};
+  }
+};
+
+void WaitUntilEmpty(const BackgroundTruncation& truncation)
+{
+  while (truncation.size() > 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+}  // namespace
+
+TEST(BackgroundTruncation, RemovesAllChunks)
+{
+  Removed removed;
+  BackgroundTruncation truncation(
+      [&removed](const std::string& volume,
+                 const std::vector<std::string>& chunks) {
+        return removed.Add(volume, chunks);
+      },
+      4, 3);
+  std::vector<std::string> chunks;
+  for (int i = 0; i < 100; ++i) { chunks.push_back(std::to_string(1000 + i)); }
+  truncation.Enqueue("vol1", chunks);
+  truncation.Enqueue("vol2", {"0000", "0001"});
+  WaitUntilEmpty(truncation);
+  EXPECT_EQ(removed.chunks.size(), 102u);
+  EXPECT_EQ(removed.chunks.count("vol2/0001"), 1u);
+  EXPECT_FALSE(truncation.IsStale("vol1", "1000"));
+}
+
+TEST(BackgroundTruncation, ClaimedChunksAreKept)
+{
+  Removed removed;
+  std::promise<void> gate;
+  std::shared_future<void> opened = gate.get_future().share();
+  BackgroundTruncation truncation(
+      [&removed, opened](const std::string& volume,
+                         const std::vector<std::string>& chunks) {
+        opened.wait();
+        return removed.Add(volume, chunks);
+      },
+      1, 1);
+  truncation.Enqueue("vol", {"0000", "0001", "0002"});
+
+  // the worker is stuck removing the highest chunk
+  while (!truncation.IsStale("vol", "0002") || truncation.size() != 3) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_TRUE(truncation.Claim("vol", "0000"));
+  EXPECT_FALSE(truncation.Claim("vol", "0000"));
+  EXPECT_FALSE(truncation.IsStale("vol", "0000"));
+  EXPECT_TRUE(truncation.IsStale("vol", "0001"));
+
+  auto claimed = std::async(std::launch::async, [&truncation]() {
+    return truncation.Claim("vol", "0002");
+  });
+  EXPECT_EQ(claimed.wait_for(std::chrono::milliseconds(50)),
+            std::future_status::timeout);
+  gate.set_value();
+  // it was removed, not overwritten while queued
+  EXPECT_FALSE(claimed.get());
+
+  WaitUntilEmpty(truncation);
+  EXPECT_EQ(removed.chunks, (std::set<std::string>{"vol/0001", "vol/0002"}));
+}
+
+TEST(BackgroundTruncation, RetriesFailedRemovals)
+{
+  Removed removed;
+  int calls = 0;
+  std::mutex calls_mutex;
+  BackgroundTruncation truncation(
+      [&](const std::string& volume, const std::vector<std::string>& chunks)
+          -> tl::expected<void, std::string> {
+        {
+          std::lock_guard lock{calls_mutex};
+          if (++calls == 1) { return tl::unexpected("unavailable\n"); }
+        }
+        return removed.Add(volume, chunks);
+      },
+      1, 10);
+  truncation.Enqueue("vol", {"0000"});
+  WaitUntilEmpty(truncation);
+  EXPECT_EQ(calls, 2);
+  EXPECT_EQ(removed.chunks.count("vol/0000"), 1u);
+}
+
+TEST(BackgroundTruncation, FinishesQueueWhenDestroyed)
+{
+  Removed removed;
+  {
+    BackgroundTruncation truncation(
+        [&removed](const std::string& volume,
+                   const std::vector<std::string>& chunks) {
+          return removed.Add(volume, chunks);
+        },
+        2, 1);
+    truncation.Enqueue("vol", {"0000", "0001", "0002", "0003"});
+  }
+  EXPECT_EQ(removed.chunks.size(), 4u);
+}
@@ -33,6 +33,8 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <cstdlib>
+#include <vector>
 
 #include <thread>
 #include <future>
@@ -46,6 +48,8 @@
 
 #include "lib/tls_openssl.h"
 #include "lib/bsock_tcp.h"
+#include "lib/bsock_compression.h"
+#include "lib/bsock_striped.h"
 #include "lib/bnet.h"
 #include "lib/bstringlist.h"
 #include "lib/version.h"
@@ -451,3 +455,295 @@ TEST(BNet, FormatAndSendResponseMessage)
   std::string test("1000 Test123");
   EXPECT_STREQ(args.JoinReadable().c_str(), test.c_str());
 }
+
+TEST(BNet, ReceiveMessageInParts)
+{
+  std::unique_ptr<TestSockets> test_sockets(
+      create_connected_server_and_client_bareos_socket());
+  EXPECT_NE(test_sockets.get(), nullptr)
+      << "Could not create Bareos test sockets.";
+  if (!test_sockets) { return; }
+
+  std::string data("0123456789abcdef");
+  PmStrcpy(test_sockets->client->msg, data.c_str());
+  test_sockets->client->message_length = data.size();
+  ASSERT_TRUE(test_sockets->client->send());
+  ASSERT_TRUE(test_sockets->client->signal(BNET_EOD));
+  ASSERT_TRUE(test_sockets->client->fsend("after"));
+
+  ASSERT_EQ(test_sockets->server->RecvLength(), (int32_t)data.size());
+
+  char buf[16];
+  EXPECT_EQ(test_sockets->server->RecvContent(buf, 10), 10);
+  EXPECT_EQ(test_sockets->server->RecvContent(buf + 10, 6), 6);
+  EXPECT_EQ(std::string(buf, sizeof(buf)), data);
+
+  EXPECT_EQ(test_sockets->server->RecvLength(), BNET_SIGNAL);
+  EXPECT_EQ(test_sockets->server->message_length, BNET_EOD);
+
+  // the normal receive still works afterwards
+  EXPECT_EQ(test_sockets->server->recv(), 5);
+  EXPECT_STREQ(test_sockets->server->msg, "after");
+}
+
+TEST(BNet, CompressedMessages)
+{
+  if (!MessageCompression::Algorithm()) {
+    GTEST_SKIP() << "built without a compression library";
+  }
+  std::unique_ptr<TestSockets> test_sockets(
+      create_connected_server_and_client_bareos_socket());
+  ASSERT_NE(test_sockets.get(), nullptr)
+      << "Could not create Bareos test sockets.";
+  ASSERT_TRUE(test_sockets->client->EnableMessageCompression());
+  ASSERT_TRUE(test_sockets->server->EnableMessageCompression());
+
+  // larger than a single packet, split and compressed packet by packet
+  std::string large;
+  for (int i = 0; large.size() < 2500000; ++i) {
+    large += "/home/user/file" + std::to_string(i) + "\n";
+  }
+  std::string random(1000, '\0');
+  for (char& c : random) { c = static_cast<char>(std::rand()); }
+
+  auto send = [&test_sockets](const std::string& data) {
+    test_sockets->client->msg = CheckPoolMemorySize(test_sockets->client->msg,
+                                                    data.size() + 1);
+    memcpy(test_sockets->client->msg, data.data(), data.size());
+    test_sockets->client->message_length = data.size();
+    return test_sockets->client->send();
+  };
+  // sent by another thread, the receiver has to empty the socket meanwhile
+  auto sender = std::async(std::launch::async, [&] {
+    return send(large) && test_sockets->client->fsend("short") && send(random)
+           && test_sockets->client->signal(BNET_EOD)
+           && send(large.substr(0, 5000));
+  });
+
+  std::string received;
+  int32_t n;
+  while (received.size() < large.size()
+         && (n = test_sockets->server->recv()) > 0) {
+    received.append(test_sockets->server->msg, n);
+  }
+  EXPECT_EQ(received, large);
+  EXPECT_EQ(test_sockets->server->recv(), 5);
+  EXPECT_STREQ(test_sockets->server->msg, "short");
+  ASSERT_EQ(test_sockets->server->recv(), 1000);
+  EXPECT_EQ(std::string(test_sockets->server->msg, 1000), random);
+  EXPECT_EQ(test_sockets->server->recv(), BNET_SIGNAL);
+  EXPECT_EQ(test_sockets->server->message_length, BNET_EOD);
+
+  // a compressed message can be read in parts as well
+  ASSERT_EQ(test_sockets->server->RecvLength(), 5000);
+  std::vector<char> buf(5000);
+  EXPECT_EQ(test_sockets->server->RecvContent(buf.data(), 1000), 1000);
+  EXPECT_EQ(test_sockets->server->RecvContent(buf.data() + 1000, 4000), 4000);
+  EXPECT_EQ(std::string(buf.data(), buf.size()), large.substr(0, 5000));
+  EXPECT_TRUE(sender.get());
+}
+
+TEST(BNet, BufferedReceive)
+{
+  std::unique_ptr<TestSockets> test_sockets(
+      create_connected_server_and_client_bareos_socket());
+  ASSERT_NE(test_sockets.get(), nullptr)
+      << "Could not create Bareos test sockets.";
+  // small, so that messages and headers cross the end of the buffer
+  test_sockets->server->EnableReceiveBuffer(100);
+
+  std::string large(1000, 'x');
+  auto sender = std::async(std::launch::async, [&] {
+    bool ok = true;
+    for (int i = 0; ok && i < 100; ++i) {
+      ok = test_sockets->client->fsend("message %d", i);
+    }
+    return ok && test_sockets->client->signal(BNET_EOD)
+           && test_sockets->client->fsend("%s", large.c_str())
+           && test_sockets->client->fsend("0123456789")
+           && test_sockets->client->fsend("last");
+  });
+
+  std::string_view view;
+  for (int i = 0; i < 100; ++i) {
+    std::string expected = "message " + std::to_string(i);
+    if (i % 2) {
+      ASSERT_EQ(test_sockets->server->recv(), (int32_t)expected.size());
+      EXPECT_STREQ(test_sockets->server->msg, expected.c_str());
+    } else {
+      ASSERT_EQ(test_sockets->server->RecvView(view),
+                (int32_t)expected.size());
+      EXPECT_EQ(view, expected);
+    }
+  }
+  EXPECT_EQ(test_sockets->server->RecvView(view), BNET_SIGNAL);
+  EXPECT_EQ(test_sockets->server->message_length, BNET_EOD);
+  EXPECT_TRUE(view.empty());
+
+  // larger than the buffer, so it ends up in msg
+  ASSERT_EQ(test_sockets->server->RecvView(view), (int32_t)large.size());
+  EXPECT_EQ(view, large);
+  EXPECT_EQ(view.data(), test_sockets->server->msg);
+
+  ASSERT_EQ(test_sockets->server->RecvLength(), 10);
+  char buf[10];
+  EXPECT_EQ(test_sockets->server->RecvContent(buf, 4), 4);
+  EXPECT_EQ(test_sockets->server->RecvContent(buf + 4, 6), 6);
+  EXPECT_EQ(std::string(buf, sizeof(buf)), "0123456789");
+
+  EXPECT_EQ(test_sockets->server->WaitData(10), BareosSocket::DataAvailable);
+  EXPECT_EQ(test_sockets->server->recv(), 4);
+  EXPECT_STREQ(test_sockets->server->msg, "last");
+  EXPECT_TRUE(sender.get());
+  EXPECT_FALSE(test_sockets->server->HasPendingData());
+}
+
+TEST(BNet, SendMessageFromParts)
+{
+  std::unique_ptr<TestSockets> test_sockets(
+      create_connected_server_and_client_bareos_socket());
+  EXPECT_NE(test_sockets.get(), nullptr)
+      << "Could not create Bareos test sockets.";
+  if (!test_sockets) { return; }
+
+  PmStrcpy(test_sockets->client->msg, "head");
+  test_sockets->client->message_length = 4;
+  std::string payload(100, 'x');
+  ASSERT_TRUE(test_sockets->client->SendV(
+      {{test_sockets->client->msg, 4}, {payload.data(), payload.size()},
+       {"", 0}, {"tail", 4}}));
+  ASSERT_TRUE(test_sockets->client->SendV({}));
+
+  // msg is not touched by SendV
+  EXPECT_STREQ(test_sockets->client->msg, "head");
+
+  ASSERT_EQ(test_sockets->server->recv(), 108);
+  EXPECT_EQ(std::string(test_sockets->server->msg, 108),
+            "head" + payload + "tail");
+  EXPECT_EQ(test_sockets->server->recv(), 0);
+}
+
+TEST(BNet, SendFileRange)
+{
+  std::unique_ptr<TestSockets> test_sockets(
+      create_connected_server_and_client_bareos_socket());
+  EXPECT_NE(test_sockets.get(), nullptr)
+      << "Could not create Bareos test sockets.";
+  if (!test_sockets) { return; }
+
+  char path[] = "/tmp/bsock_send_file_range_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  unlink(path);
+
+  // bigger than a single packet
+  std::string content(3'000'000, '\0');
+  for (std::size_t i = 0; i < content.size(); ++i) {
+    content[i] = 'a' + i % 23;
+  }
+  ASSERT_EQ(write(fd, content.data(), content.size()),
+            static_cast<ssize_t>(content.size()));
+
+#if defined(HAVE_LINUX_OS)
+  EXPECT_TRUE(test_sockets->client->CanSendFileRange());
+#endif
+
+  const std::size_t offset = 10;
+  std::string received;
+  std::thread receiver([&] {
+    while (received.size() < content.size() - offset) {
+      int32_t n = test_sockets->server->recv();
+      if (n <= 0) { break; }
+      received.append(test_sockets->server->msg, n);
+    }
+  });
+  EXPECT_TRUE(test_sockets->client->SendFileRange(fd, offset,
+                                                  content.size() - offset));
+  receiver.join();
+  EXPECT_EQ(received, content.substr(offset));
+
+  // the generic implementation reads the range itself
+  EXPECT_TRUE(test_sockets->client->BareosSocket::SendFileRange(fd, 3, 5));
+  ASSERT_EQ(test_sockets->server->recv(), 5);
+  EXPECT_EQ(std::string(test_sockets->server->msg, 5), content.substr(3, 5));
+
+  ASSERT_TRUE(test_sockets->client->SendFileRange(fd, 0, 0));
+  EXPECT_EQ(test_sockets->server->recv(), 0);
+
+  // ranges beyond the end of the file fail
+  EXPECT_FALSE(test_sockets->client->BareosSocket::SendFileRange(
+      fd, content.size() - 1, 2));
+
+  close(fd);
+}
+
+TEST(BNet, StripedConnections)
+{
+  std::unique_ptr<TestSockets> job(
+      create_connected_server_and_client_bareos_socket());
+  ASSERT_NE(job.get(), nullptr) << "Could not create Bareos test sockets.";
+
+  std::vector<std::unique_ptr<TestSockets>> data;
+  std::vector<BareosSocket*> senders, receivers;
+  for (int i = 0; i < 3; ++i) {
+    data.emplace_back(create_connected_server_and_client_bareos_socket());
+    ASSERT_NE(data.back().get(), nullptr);
+    senders.push_back(data.back()->client.get());
+    receivers.push_back(data.back()->server.get());
+  }
+
+  StripedSender sender(senders, 2);
+  StripedReceiver receiver(receivers, 4);
+  BareosSocket* job_sock = job->client.get();
+  job_sock->SetStripedSender(&sender);
+
+  // the big one is split into several frames
+  std::string expected;
+  std::vector<std::string> messages{"first", std::string(2'500'000, 'x'), "",
+                                    "last"};
+  std::thread producer([&] {
+    for (int round = 0; round < 50; ++round) {
+      for (auto& message : messages) {
+        EXPECT_TRUE(job_sock->send(message.data(), message.size()));
+      }
+      EXPECT_TRUE(job->client->signal(BNET_HEARTBEAT));
+    }
+    EXPECT_TRUE(job->client->signal(BNET_EOD));
+  });
+  for (int round = 0; round < 50; ++round) {
+    for (auto& message : messages) { expected += message; }
+  }
+
+  std::string received;
+  std::vector<int32_t> signals;
+  PoolMem msg(PM_MESSAGE);
+  for (;;) {
+    int32_t signal = 0;
+    auto n = receiver.Receive(msg, signal, std::chrono::seconds(10));
+    ASSERT_TRUE(n.has_value());
+    if (*n == BNET_SIGNAL) {
+      signals.push_back(signal);
+      if (signal == BNET_EOD) { break; }
+      continue;
+    }
+    ASSERT_GE(*n, 0);
+    received.append(msg.c_str(), *n);
+  }
+  producer.join();
+  job->client->SetStripedSender(nullptr);
+
+  EXPECT_EQ(received, expected);
+  EXPECT_EQ(signals.size(), 51u);
+  EXPECT_FALSE(sender.Finish().has_value());
+
+  // every connection ended cleanly, so there is nothing more
+  int32_t signal = 0;
+  auto n = receiver.Receive(msg, signal, std::chrono::seconds(10));
+  ASSERT_TRUE(n.has_value());
+  EXPECT_EQ(*n, BNET_HARDEOF);
+  EXPECT_FALSE(receiver.error().has_value());
+  receiver.Stop();
+
+  // nothing went over the job connection itself
+  EXPECT_EQ(job->server->WaitData(0, 100'000), BareosSocket::Timeout);
+}
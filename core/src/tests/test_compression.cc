@@ -0,0 +1,92 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#  include "gtest/gtest.h"
+#else
+#  include "gtest/gtest.h"
+#  include "include/bareos.h"
+#endif
+
+#include "lib/compression.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+static std::vector<char> RandomBytes(std::size_t size)
+{
+  std::mt19937 gen32;
+  std::vector<char> data(size);
+  for (auto& c : data) { c = static_cast<char>(gen32()); }
+  return data;
+}
+
+TEST(compression, random_data_is_incompressible)
+{
+  auto data = RandomBytes(64 * 1024);
+  EXPECT_TRUE(LooksIncompressible(data.data(), data.size()));
+}
+
+TEST(compression, text_is_compressible)
+{
+  std::string text;
+  while (text.size() < 64 * 1024) {
+    text += "The quick brown fox jumps over the lazy dog. 0123456789\n";
+  }
+  EXPECT_FALSE(LooksIncompressible(text.data(), text.size()));
+
+  std::vector<char> zeros(64 * 1024);
+  EXPECT_FALSE(LooksIncompressible(zeros.data(), zeros.size()));
+}
+
+TEST(compression, small_blocks_are_always_compressed)
+{
+  auto data = RandomBytes(1024);
+  EXPECT_FALSE(LooksIncompressible(data.data(), data.size()));
+}
+
+TEST(compression, bypass_learns_from_results)
+{
+  std::vector<char> zeros(64 * 1024);
+  CompressionBypass bypass;
+
+  EXPECT_FALSE(bypass.Skip(zeros.data(), zeros.size()));
+  for (int i = 0; i < 4; ++i) { bypass.Learn(1000, 1000); }
+
+  // only every 16th block is still tried
+  int compressed = 0;
+  for (int i = 0; i < 32; ++i) {
+    if (!bypass.Skip(zeros.data(), zeros.size())) { compressed++; }
+  }
+  EXPECT_EQ(compressed, 2);
+
+  // a block that compresses well resets the learned state
+  bypass.Learn(1000, 100);
+  EXPECT_FALSE(bypass.Skip(zeros.data(), zeros.size()));
+}
+
+TEST(compression, useless_compression)
+{
+  EXPECT_TRUE(CompressionWasUseless(1000, 1000));
+  EXPECT_TRUE(CompressionWasUseless(1000, 990));
+  EXPECT_FALSE(CompressionWasUseless(1000, 900));
+}
@@ -195,6 +195,38 @@ TEST_F(ConfigParser_Dir, foreach_res_and_reload)
   t2.join();
 }  // namespace directordaemon
 
+TEST_F(ConfigParser_Dir, GetResWithNameFindsEveryResource)
+{
+  std::string path_to_config_file
+      = std::string("configs/bareos-configparser-tests");
+  std::unique_ptr<ConfigurationParser> dir_conf{
+      InitDirConfig(path_to_config_file.c_str(), M_ERROR_TERM)};
+  my_config = dir_conf.get();
+  ASSERT_TRUE(my_config->ParseConfig());
+
+  // every resource in the lists is found by its name
+  for (int rcode = 0; rcode < my_config->r_num_; rcode++) {
+    for (BareosResource* res = my_config->GetNextRes(rcode, nullptr); res;
+         res = my_config->GetNextRes(rcode, res)) {
+      EXPECT_EQ(my_config->GetResWithName(rcode, res->resource_name_), res)
+          << my_config->ResToStr(rcode) << " " << res->resource_name_;
+    }
+  }
+  EXPECT_EQ(my_config->GetResWithName(R_CLIENT, "no such client"), nullptr);
+
+  BareosResource* client = my_config->GetNextRes(R_CLIENT, nullptr);
+  ASSERT_NE(client, nullptr);
+  std::string name{client->resource_name_};
+  ASSERT_TRUE(my_config->RemoveResource(R_CLIENT, name.c_str()));
+  EXPECT_EQ(my_config->GetResWithName(R_CLIENT, name.c_str()), nullptr);
+
+  // a reload gets a new index together with the new resources
+  auto backup = my_config->BackupResourcesContainer();
+  EXPECT_EQ(my_config->GetResWithName(R_CLIENT, name.c_str()), nullptr);
+  ASSERT_TRUE(my_config->ParseConfig());
+  EXPECT_NE(my_config->GetResWithName(R_CLIENT, name.c_str()), nullptr);
+}
+
 TEST_F(ConfigParser_Dir, runscript_test)
 {
   std::string path_to_config_file
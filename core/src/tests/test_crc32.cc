@@ -28,6 +28,7 @@
 
 #include <array>
 #include <numeric>
+#include <vector>
 #include "stored/crc32/crc32.h"
 
 
@@ -73,3 +74,29 @@ TEST(crc32, label_block)
   ASSERT_EQ(0xcb678ddd,
             crc32_fast(label_block.data() + 4, label_block.size() - 4));
 }
+
+TEST(crc32, hardware_matches_table)
+{
+  if (!crc32_hardware_supported()) {
+    GTEST_SKIP() << "cpu has no crc32 support";
+  }
+
+  std::vector<uint8_t> buf(1024 * 1024 + 64);
+  std::iota(buf.begin(), buf.end(), 0x17);
+
+  for (size_t offset : {0, 1, 3, 8, 15}) {
+    for (size_t len : {0, 1, 15, 16, 17, 63, 64, 65, 127, 128, 200, 4095,
+                       64 * 1024, 1024 * 1024}) {
+      EXPECT_EQ(crc32_16bytes(buf.data() + offset, len),
+                crc32_hardware(buf.data() + offset, len))
+          << "offset " << offset << ", length " << len;
+    }
+  }
+}
+
+TEST(crc32, hardware_continues_previous_crc)
+{
+  static const char* buf = "The quick brown fox jumps over the lazy dog";
+  uint32_t crc = crc32_hardware(buf, 10);
+  EXPECT_EQ(0x414fa339, crc32_hardware(buf + 10, strlen(buf) - 10, crc));
+}
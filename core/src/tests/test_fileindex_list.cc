@@ -26,6 +26,7 @@
 #  include "include/bareos.h"
 #endif
 
+#include "cats/cats.h"
 #include "dird/bsr.h"
 
 #include <algorithm>
@@ -207,3 +208,115 @@ TEST(fileindex_list, gap_list_duplicates_random_order)
   std::shuffle(fileIds.begin(), fileIds.end(), std::default_random_engine{});
   EXPECT_EQ(ToBsrStringLocal(fileIds), ToBsrStringBareos(fileIds));
 }
+
+TEST(fileindex_list, write_findex_of_one_volume)
+{
+  RestoreBootstrapRecord bsr;
+  for (int fid : {20, 21, 22, 5, 6, 40, 7, 41, 90}) {
+    AddFindex(&bsr, kJobId_1, fid);
+  }
+  EXPECT_EQ(bsr.fi->GetRanges().size(), 4);
+
+  uint32_t first = 6;
+  uint32_t last = 40;
+  auto buffer = std::string{};
+  EXPECT_EQ(write_findex(bsr.fi.get(), first, last, buffer), 6);
+  EXPECT_EQ(buffer, "FileIndex=6-7\nFileIndex=20-22\nFileIndex=40\n");
+  EXPECT_EQ(first, 6);
+  EXPECT_EQ(last, 40);
+
+  first = 50;
+  last = 80;
+  buffer.clear();
+  EXPECT_EQ(write_findex(bsr.fi.get(), first, last, buffer), 0);
+  EXPECT_EQ(buffer, "");
+}
+
+static void AddVolume(RestoreBootstrapRecord& bsr,
+                      const char* volume,
+                      const char* storage,
+                      uint64_t start_addr)
+{
+  bsr.VolParams = static_cast<VolumeParameters*>(
+      realloc(bsr.VolParams, (bsr.VolCount + 1) * sizeof(VolumeParameters)));
+  VolumeParameters* vol = new (&bsr.VolParams[bsr.VolCount++])
+      VolumeParameters{};
+  bstrncpy(vol->VolumeName, volume, sizeof(vol->VolumeName));
+  bstrncpy(vol->Storage, storage, sizeof(vol->Storage));
+  vol->StartAddr = start_addr;
+}
+
+static std::string PlanString(const std::vector<RestoreVolumeSegment>& plan)
+{
+  std::string str;
+  for (const RestoreVolumeSegment& segment : plan) {
+    if (!str.empty()) { str += " "; }
+    str += std::to_string(segment.bsr->JobId) + ":"
+           + segment.bsr->VolParams[segment.vol].VolumeName + "@"
+           + std::to_string(segment.bsr->VolParams[segment.vol].StartAddr);
+  }
+  return str;
+}
+
+static std::vector<RestoreVolumeSegment> AllSegments(
+    std::vector<RestoreBootstrapRecord*> jobs)
+{
+  std::vector<RestoreVolumeSegment> segments;
+  for (RestoreBootstrapRecord* bsr : jobs) {
+    for (int i = 0; i < bsr->VolCount; ++i) { segments.push_back({bsr, i}); }
+  }
+  return segments;
+}
+
+TEST(restore_plan, reads_each_volume_once_by_address)
+{
+  RestoreBootstrapRecord full{1}, incr1{2}, incr2{3};
+  AddVolume(full, "A", "Tape", 100);
+  AddVolume(full, "B", "Tape", 0);
+  AddVolume(incr1, "B", "Tape", 500);
+  AddVolume(incr2, "A", "Tape", 900);
+
+  EXPECT_EQ(PlanString(PlanRestoreReads(AllSegments({&full, &incr1, &incr2}))),
+            "1:A@100 3:A@900 1:B@0 2:B@500");
+}
+
+TEST(restore_plan, keeps_the_storage)
+{
+  RestoreBootstrapRecord full{1}, incr1{2}, incr2{3};
+  AddVolume(full, "A", "Tape", 0);
+  AddVolume(incr1, "D", "Disk", 0);
+  AddVolume(incr2, "B", "Tape", 0);
+
+  EXPECT_EQ(PlanString(PlanRestoreReads(AllSegments({&full, &incr1, &incr2}))),
+            "1:A@0 3:B@0 2:D@0");
+}
+
+TEST(restore_plan, keeps_continued_files_in_order)
+{
+  RestoreBootstrapRecord full{1}, incr{2};
+  AddVolume(full, "B", "Tape", 0);
+  AddVolume(full, "A", "Tape", 0);
+  AddVolume(incr, "A", "Tape", 700);
+
+  EXPECT_EQ(PlanString(PlanRestoreReads(AllSegments({&full, &incr}))),
+            "1:B@0 1:A@0 2:A@700");
+}
+
+TEST(restore_plan, gives_up_on_contradicting_orders)
+{
+  RestoreBootstrapRecord one{1}, two{2};
+  AddVolume(one, "A", "Tape", 0);
+  AddVolume(one, "B", "Tape", 0);
+  AddVolume(two, "B", "Tape", 100);
+  AddVolume(two, "A", "Tape", 100);
+
+  auto segments = AllSegments({&one, &two});
+  EXPECT_EQ(PlanString(PlanRestoreReads(segments)), PlanString(segments));
+
+  RestoreBootstrapRecord back{3};
+  AddVolume(back, "A", "Tape", 0);
+  AddVolume(back, "B", "Tape", 0);
+  AddVolume(back, "A", "Tape", 100);
+  segments = AllSegments({&back});
+  EXPECT_EQ(PlanString(PlanRestoreReads(segments)), PlanString(segments));
+}
@@ -0,0 +1,83 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#  include "gtest/gtest.h"
+#else
+#  include "gtest/gtest.h"
+#  include "include/bareos.h"
+#endif
+#include "lib/mapped_buffer.h"
+#include "lib/tree.h"
+
+#include <cstdint>
+#include <string>
+
+#if defined(HAVE_POSIX_FALLOCATE) && !defined(HAVE_WIN32)
+TEST(MappedBuffer, AllocationsAreAlignedAndDistinct)
+{
+  MappedBuffer buffer;
+  ASSERT_TRUE(buffer.Open("/tmp"));
+
+  char* previous = nullptr;
+  for (std::size_t size : {1, 7, 100, 4096, 100 * 1024 * 1024, 3}) {
+    char* mem = static_cast<char*>(buffer.allocate(size));
+    ASSERT_NE(mem, nullptr);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(mem) % alignof(max_align_t), 0u);
+    memset(mem, 'x', size);
+    if (previous) { EXPECT_EQ(*previous, 'x'); }
+    previous = mem;
+  }
+  EXPECT_GE(buffer.file_size(), std::size_t{100 * 1024 * 1024});
+}
+
+TEST(MappedBuffer, TreeInAFile)
+{
+  TREE_ROOT* root = new_tree(1000, "/tmp");
+  ASSERT_NE(root->mapped, nullptr);
+
+  std::string path = "/data/";
+  tree_node* dir = make_tree_path(path.data(), root);
+  for (int i = 0; i < 20000; ++i) {
+    std::string name = "file" + std::to_string(i);
+    tree_node* node = insert_tree_node(path.data(), name.data(),
+                                       tree_node_type::File, root, dir);
+    node->FileIndex = i + 1;
+  }
+
+  EXPECT_GT(root->mapped->file_size(), 0u);
+  int files = 0;
+  for (tree_node* child : TreeChildren(root, dir)) {
+    EXPECT_EQ(std::string{"file"} + std::to_string(child->FileIndex - 1),
+              child->fname);
+    files += 1;
+  }
+  EXPECT_EQ(files, 20000);
+  FreeTree(root);
+}
+#endif
+
+TEST(MappedBuffer, DirectoryMustExist)
+{
+  MappedBuffer buffer;
+  EXPECT_FALSE(buffer.Open("/nonexistent/directory"));
+  EXPECT_EQ(buffer.allocate(16), nullptr);
+}
@@ -0,0 +1,89 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#  include "gtest/gtest.h"
+#else
+#  include "gtest/gtest.h"
+#  include "include/bareos.h"
+#endif
+#include "lib/bsnprintf.h"
+#include "lib/message_builder.h"
+
+#include <limits>
+#include <string>
+
+class MessageBuilderTest : public ::testing::Test {
+ protected:
+  void SetUp() override { buf = GetPoolMemory(PM_MESSAGE); }
+  void TearDown() override { FreePoolMemory(buf); }
+
+  std::string Formatted(const char* fmt, ...)
+  {
+    char expected[512];
+    va_list ap;
+    va_start(ap, fmt);
+    int length = Bvsnprintf(expected, sizeof(expected), fmt, ap);
+    va_end(ap);
+    return std::string(expected, length);
+  }
+
+  POOLMEM* buf{};
+};
+
+TEST_F(MessageBuilderTest, same_as_bsnprintf)
+{
+  MessageBuilder message(buf);
+  message << uint32_t{17} << ' ' << 2 << " 0";
+  EXPECT_EQ(std::string(buf, message.size()), Formatted("%ld %d 0", 17, 2));
+  EXPECT_EQ(buf[message.size()], 0);
+}
+
+TEST_F(MessageBuilderTest, limits)
+{
+  MessageBuilder message(buf);
+  message << std::numeric_limits<int64_t>::min() << ' '
+          << std::numeric_limits<uint64_t>::max() << ' '
+          << std::numeric_limits<int32_t>::min();
+  EXPECT_EQ(std::string(buf, message.size()),
+            "-9223372036854775808 18446744073709551615 -2147483648");
+}
+
+TEST_F(MessageBuilderTest, attribute_record_keeps_zeros)
+{
+  MessageBuilder message(buf);
+  message << 1 << ' ' << 3 << ' ' << "/etc/passwd" << '\0' << "P0 A" << '\0'
+          << "" << '\0' << static_cast<const char*>(nullptr) << '\0' << 0u
+          << '\0';
+  EXPECT_EQ(std::string(buf, message.size()),
+            Formatted("%ld %d %s%c%s%c%c%s%c%u%c", 1, 3, "/etc/passwd", 0,
+                      "P0 A", 0, 0, "", 0, 0u, 0));
+}
+
+TEST_F(MessageBuilderTest, grows_the_buffer)
+{
+  std::string name(3 * SizeofPoolMemory(buf), 'x');
+  MessageBuilder message(buf);
+  message << "UpdCat Job=" << name << " FileAttributes ";
+  EXPECT_EQ(std::string(buf, message.size()),
+            "UpdCat Job=" + name + " FileAttributes ");
+  EXPECT_GT(SizeofPoolMemory(buf), message.size());
+}
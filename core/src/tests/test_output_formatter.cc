@@ -26,6 +26,77 @@
 #  include "include/bareos.h"
 #endif
 
+#define NEED_JANSSON_NAMESPACE
 #include "lib/output_formatter.h"
 
+#include <cstdarg>
+#include <string>
+
 TEST(output_formatter, constructor_destructor) {}
+
+#if HAVE_JANSSON
+static bool CollectOutput(void* ctx, const char* fmt, ...)
+{
+  PoolMem string;
+  va_list arg_ptr;
+  va_start(arg_ptr, fmt);
+  string.Bvsprintf(fmt, arg_ptr);
+  va_end(arg_ptr);
+  static_cast<std::string*>(ctx)->append(string.c_str());
+  return true;
+}
+
+static std::string ListJobs(bool streaming, bool failed, std::size_t rows)
+{
+  std::string output;
+  OutputFormatter send(CollectOutput, &output, nullptr, nullptr, API_MODE_JSON);
+  send.SetStreaming(streaming);
+  send.ObjectKeyValue("before", "value");
+  send.ArrayStart("jobs");
+  for (std::size_t i = 1; i <= rows; ++i) {
+    send.ObjectStart();
+    send.ObjectKeyValue("jobid", i);
+    send.ObjectKeyValue("name", "job");
+    send.ObjectEnd();
+  }
+  send.ArrayEnd("jobs");
+  send.ObjectKeyValue("after", 1);
+  send.AddLimitFilterTuple(rows);
+  if (failed) {
+    PoolMem message("no catalog");
+    send.message(MSG_TYPE_ERROR, message);
+  }
+  send.FinalizeResult(true);
+  return output;
+}
+
+static json_t* Parse(const std::string& output)
+{
+  json_error_t error;
+  json_t* json = json_loads(output.c_str(), 0, &error);
+  EXPECT_NE(json, nullptr) << error.text << ": " << output;
+  return json;
+}
+
+TEST(output_formatter, streamed_result_is_the_same)
+{
+  for (std::size_t rows : {0, 1, 250}) {
+    json_t* expected = Parse(ListJobs(false, false, rows));
+    json_t* streamed = Parse(ListJobs(true, false, rows));
+    EXPECT_TRUE(json_equal(expected, streamed));
+    json_decref(expected);
+    json_decref(streamed);
+  }
+}
+
+TEST(output_formatter, streamed_result_reports_errors)
+{
+  json_t* streamed = Parse(ListJobs(true, true, 250));
+  json_t* error = json_object_get(streamed, "error");
+  ASSERT_NE(error, nullptr);
+  EXPECT_EQ(json_integer_value(json_object_get(error, "code")), 1);
+  json_t* jobs = json_object_get(json_object_get(streamed, "result"), "jobs");
+  EXPECT_EQ(json_array_size(jobs), 250);
+  json_decref(streamed);
+}
+#endif
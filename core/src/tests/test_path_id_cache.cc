@@ -0,0 +1,113 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#  include "gtest/gtest.h"
+#else
+#  include "gtest/gtest.h"
+#  include "include/bareos.h"
+#endif
+#include "cats/path_id_cache.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST(PathIdCache, FindsWhatWasInserted)
+{
+  PathIdCache cache;
+  EXPECT_EQ(cache.Find("/etc/"), 0u);
+  cache.Insert("/etc/", 7);
+  cache.Insert("/home/", 8);
+  EXPECT_EQ(cache.Find("/etc/"), 7u);
+  EXPECT_EQ(cache.Find("/home/"), 8u);
+  EXPECT_EQ(cache.Find("/etc"), 0u);
+  cache.Insert("/etc/", 9);
+  EXPECT_EQ(cache.Find("/etc/"), 9u);
+  EXPECT_EQ(cache.size(), 2u);
+}
+
+TEST(PathIdCache, DropsLeastRecentlyUsed)
+{
+  // a single entry per shard
+  PathIdCache cache{1};
+  std::vector<std::string> paths;
+  for (uint32_t i = 1; i <= 1000; ++i) {
+    paths.push_back("/dir" + std::to_string(i) + "/");
+    cache.Insert(paths.back(), i);
+  }
+  EXPECT_LE(cache.size(), 16u);
+  EXPECT_EQ(cache.Find(paths.back()), 1000u);
+  EXPECT_EQ(cache.Find(paths.front()), 0u);
+}
+
+TEST(PathIdCache, KeepsRecentlyFound)
+{
+  PathIdCache cache{16 * 2};
+  cache.Insert("/keep/", 1);
+  for (uint32_t i = 2; i < 10000; ++i) {
+    EXPECT_EQ(cache.Find("/keep/"), 1u);
+    cache.Insert("/dir" + std::to_string(i) + "/", i);
+  }
+  EXPECT_EQ(cache.Find("/keep/"), 1u);
+}
+
+TEST(PathIdCache, ForgetsEverythingWhenCleared)
+{
+  PathIdCache cache;
+  cache.Insert("/etc/", 7);
+  cache.Insert("/home/", 8);
+  cache.Clear();
+  EXPECT_EQ(cache.size(), 0u);
+  EXPECT_EQ(cache.Find("/etc/"), 0u);
+  cache.Insert("/etc/", 9);
+  EXPECT_EQ(cache.Find("/etc/"), 9u);
+}
+
+TEST(PathIdCache, SharedPerCatalog)
+{
+  auto key = PathIdCache::CatalogKey("bareos", "localhost", 5432, nullptr);
+  auto other = PathIdCache::CatalogKey("bareos", "otherhost", 5432, nullptr);
+  auto cache = PathIdCache::ForCatalog(key);
+  EXPECT_EQ(cache, PathIdCache::ForCatalog(key));
+  EXPECT_NE(cache, PathIdCache::ForCatalog(other));
+}
+
+TEST(PathIdCache, ConcurrentAccess)
+{
+  PathIdCache cache{1024};
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < 4; ++t) {
+    threads.emplace_back([&cache, t] {
+      for (uint32_t i = 1; i < 20000; ++i) {
+        std::string path = "/dir" + std::to_string(i % 2000) + "/";
+        uint32_t id = cache.Find(path);
+        if (id == 0) {
+          cache.Insert(path, i % 2000 + 1);
+        } else {
+          EXPECT_EQ(id, i % 2000 + 1) << t;
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) { thread.join(); }
+  EXPECT_LE(cache.size(), 1024u);
+}
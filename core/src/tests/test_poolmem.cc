@@ -1,7 +1,7 @@
 /*
    BAREOS® - Backup Archiving REcovery Open Sourced
 
-   Copyright (C) 2021-2022 Bareos GmbH & Co. KG
+   Copyright (C) 2021-2024 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -25,6 +25,9 @@
 #include "lib/mem_pool.h"
 #include "include/baconfig.h"
 
+#include <thread>
+#include <vector>
+
 TEST(poolmem, alloc)
 {
   POOLMEM* pm0 = GetPoolMemory(PM_NOPOOL);
@@ -440,3 +443,122 @@ TEST(poolmem, class)
   EXPECT_EQ(pm_string.strlen(), 150);
   EXPECT_EQ(pm_string.MaxSize(), 193);
 }
+
+TEST(poolmem, sizeclasses)
+{
+  for (int32_t size : {0, 1, 127, 128, 129, 130, 4096, 4097, 64512, 266240,
+                       266241, 2 * 1024 * 1024}) {
+    POOLMEM* pm = GetMemory(size);
+    ASSERT_NE(pm, nullptr);
+    EXPECT_EQ(SizeofPoolMemory(pm), size);
+    memset(pm, 'x', size);
+
+    // BnetSend() stores the packet length directly in front of the buffer
+    int32_t* hdr = (int32_t*)(pm - sizeof(int32_t));
+    *hdr = -1;
+    EXPECT_EQ(SizeofPoolMemory(pm), size);
+
+    FreeMemory(pm);
+  }
+}
+
+TEST(poolmem, reallocwithinclass)
+{
+  POOLMEM* pm = GetMemory(300);
+  memcpy(pm, "abc", 4);
+  bool size_classes = GetPoolMemoryStats().held_bytes > 0;
+
+  // 300 and 500 are in the same class, so the buffer can stay
+  POOLMEM* grown = ReallocPoolMemory(pm, 500);
+  if (size_classes) { EXPECT_EQ(grown, pm); }
+  EXPECT_EQ(SizeofPoolMemory(grown), 500);
+
+  POOLMEM* moved = ReallocPoolMemory(grown, 100'000);
+  EXPECT_EQ(SizeofPoolMemory(moved), 100'000);
+  EXPECT_STREQ(moved, "abc");
+
+  POOLMEM* huge = ReallocPoolMemory(moved, 4 * 1024 * 1024);
+  EXPECT_STREQ(huge, "abc");
+
+  POOLMEM* shrunk = ReallocPoolMemory(huge, 10);
+  EXPECT_EQ(SizeofPoolMemory(shrunk), 10);
+  EXPECT_STREQ(shrunk, "abc");
+
+  FreeMemory(shrunk);
+}
+
+TEST(poolmem, releaseidle)
+{
+  std::vector<POOLMEM*> buffers;
+  for (int i = 0; i < 1000; ++i) { buffers.push_back(GetMemory(4096)); }
+  for (POOLMEM* pm : buffers) { FreeMemory(pm); }
+
+  pool_memory_stats before = GetPoolMemoryStats();
+  if (before.held_bytes == 0) {
+    GTEST_SKIP() << "size classes are disabled in sanitizer builds";
+  }
+  EXPECT_GE(before.held_bytes, 1000u * 4096);
+
+  ReleaseIdlePoolMemory();
+  pool_memory_stats after = GetPoolMemoryStats();
+  EXPECT_LT(after.held_bytes, before.held_bytes - 1000u * 4096);
+  EXPECT_GT(after.released_bytes, before.released_bytes);
+}
+
+TEST(poolmem, otherthreadfrees)
+{
+  constexpr int num = 10'000;
+  std::vector<POOLMEM*> buffers(num);
+  std::thread producer{[&buffers] {
+    for (int i = 0; i < num; ++i) {
+      buffers[i] = GetMemory(i % 5000);
+      memset(buffers[i], i & 0xff, i % 5000);
+    }
+  }};
+  producer.join();
+
+  std::thread consumer{[&buffers] {
+    for (int i = 0; i < num; ++i) {
+      int32_t size = i % 5000;
+      EXPECT_EQ(SizeofPoolMemory(buffers[i]), size);
+      if (size > 0) {
+        EXPECT_EQ(buffers[i][size - 1], static_cast<char>(i & 0xff));
+      }
+      FreeMemory(buffers[i]);
+    }
+  }};
+  consumer.join();
+}
+
+TEST(poolmem, bufferpages)
+{
+  SetHugePageBuffers(true);
+  POOLMEM* small = GetBufferMemory(64 * 1024);
+  POOLMEM* big = GetBufferMemory(1536 * 1024);
+  pool_memory_stats stats = GetPoolMemoryStats();
+  bool mapped = stats.mapped_bytes > 0;
+
+  EXPECT_EQ(SizeofPoolMemory(small), 64 * 1024);
+  EXPECT_EQ(SizeofPoolMemory(big), 1536 * 1024);
+  if (mapped) { EXPECT_EQ(stats.mapped_bytes, 2u * 1024 * 1024); }
+  memset(big, 'x', 1536 * 1024);
+  memcpy(big, "abc", 4);
+
+  // still fits into the pages it has
+  POOLMEM* grown = ReallocPoolMemory(big, 2000 * 1024);
+  if (mapped) { EXPECT_EQ(grown, big); }
+  EXPECT_STREQ(grown, "abc");
+
+  POOLMEM* moved = ReallocPoolMemory(grown, 3 * 1024 * 1024);
+  EXPECT_EQ(SizeofPoolMemory(moved), 3 * 1024 * 1024);
+  EXPECT_STREQ(moved, "abc");
+  EXPECT_EQ(moved[1536 * 1024 - 1], 'x');
+  if (mapped) {
+    EXPECT_EQ(GetPoolMemoryStats().mapped_bytes, 4u * 1024 * 1024);
+  }
+
+  FreeMemory(moved);
+  FreeMemory(small);
+  EXPECT_EQ(GetPoolMemoryStats().mapped_bytes, 0u);
+  SetHugePageBuffers(false);
+}
@@ -0,0 +1,92 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#  include "gtest/gtest.h"
+#else
+#  include "gtest/gtest.h"
+#  include "include/bareos.h"
+#endif
+#include "lib/tree_find.h"
+
+#include <fnmatch.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::vector<tree_index> FindAll(TREE_ROOT* root, const char* pattern)
+{
+  std::vector<tree_index> found;
+  for (tree_node* node = FirstTreeNode(root); node;
+       node = NextTreeNode(root, node)) {
+    if (fnmatch(pattern, node->fname, 0) == 0) { found.push_back(node->index); }
+  }
+  return found;
+}
+
+TREE_ROOT* MakeTree()
+{
+  TREE_ROOT* root = new_tree(1000);
+  for (const char* dir : {"/home/user/src/", "/home/user/doc/", "/etc/"}) {
+    std::string path = dir;
+    tree_node* parent = make_tree_path(path.data(), root);
+    for (int i = 0; i < 500; ++i) {
+      for (const char* suffix : {".c", ".h", ".txt", "[1]"}) {
+        std::string name = "file" + std::to_string(i) + suffix;
+        insert_tree_node(path.data(), name.data(), tree_node_type::File, root,
+                         parent);
+      }
+    }
+  }
+  return root;
+}
+
+}  // namespace
+
+TEST(TreeNameIndex, FindsWhatFnmatchFinds)
+{
+  TREE_ROOT* root = MakeTree();
+  TreeNameIndex index;
+  for (const char* pattern :
+       {"file17.c", "file1*.h", "*.txt", "*", "?ile4??.c", "src", "user",
+        "file1[23].c", "file2[!0-8]*", "file3\\[1\\]", "file3[1]", "[",
+        "file[", "nothing*here", "*9.t?t", ""}) {
+    EXPECT_EQ(index.Find(root, pattern), FindAll(root, pattern)) << pattern;
+  }
+  FreeTree(root);
+}
+
+TEST(TreeNameIndex, RebuildsAfterInsert)
+{
+  TREE_ROOT* root = MakeTree();
+  TreeNameIndex index;
+  EXPECT_TRUE(index.Find(root, "newfile").empty());
+
+  std::string path = "/etc/";
+  tree_node* parent = tree_cwd(path.data(), root, root);
+  ASSERT_NE(parent, nullptr);
+  std::string name = "newfile";
+  insert_tree_node(path.data(), name.data(), tree_node_type::File, root,
+                   parent);
+  EXPECT_EQ(index.Find(root, "newfile").size(), 1u);
+  FreeTree(root);
+}
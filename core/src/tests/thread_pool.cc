@@ -0,0 +1,96 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#  include "gtest/gtest.h"
+#else
+#  include "gtest/gtest.h"
+#  include "include/bareos.h"
+#endif
+
+#include <atomic>
+#include <chrono>
+
+#include "lib/thread_pool.h"
+
+TEST(thread_pool, destructor_waits_for_borrowed_threads)
+{
+  std::atomic<int> done{0};
+  {
+    thread_pool pool;
+    pool.borrow_threads(4, [&done] {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      done += 1;
+    });
+  }
+  EXPECT_EQ(done.load(), 4);
+}
+
+TEST(thread_pool, borrowed_threads_run_concurrently)
+{
+  // every task waits for all others; this only finishes if none is queued
+  constexpr int num_tasks = 8;
+  std::mutex mut;
+  std::condition_variable cv;
+  int arrived = 0;
+  {
+    thread_pool pool;
+    pool.borrow_threads(num_tasks, [&] {
+      std::unique_lock lock(mut);
+      arrived += 1;
+      cv.notify_all();
+      cv.wait(lock, [&] { return arrived == num_tasks; });
+    });
+  }
+  EXPECT_EQ(arrived, num_tasks);
+}
+
+// a worker only becomes idle after the pool saw its task finish
+static std::size_t WaitForIdleThread()
+{
+  for (int i = 0; i < 1000; ++i) {
+    if (auto idle = worker_threads::stats().idle; idle > 0) { return idle; }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return 0;
+}
+
+TEST(thread_pool, threads_are_shared_between_pools)
+{
+  {
+    thread_pool pool;
+    pool.borrow_thread([] {});
+  }
+  ASSERT_GE(WaitForIdleThread(), 1u);
+  auto before = worker_threads::stats();
+
+  for (int i = 0; i < 10; ++i) {
+    {
+      thread_pool pool;
+      pool.borrow_thread([] {});
+    }
+    WaitForIdleThread();
+  }
+  auto after = worker_threads::stats();
+  EXPECT_EQ(after.started, before.started);
+  EXPECT_EQ(after.reused, before.reused + 10);
+}
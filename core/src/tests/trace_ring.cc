@@ -0,0 +1,106 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#  include "gtest/gtest.h"
+#else
+#  include "gtest/gtest.h"
+#  include "include/bareos.h"
+#endif
+
+#include "lib/trace_ring.h"
+
+#include <cstdio>
+#include <string>
+#include <thread>
+
+static std::string Dump()
+{
+  FILE* fp = tmpfile();
+  DumpTraceRings(fp);
+  rewind(fp);
+  std::string result;
+  char buf[4096];
+  std::size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) { result.append(buf, n); }
+  fclose(fp);
+  return result;
+}
+
+static std::string FormatOne(trace_category category,
+                             const char* fmt,
+                             uint64_t a,
+                             uint64_t b)
+{
+  trace_detail::entry e{};
+  e.fmt = fmt;
+  e.category = category;
+  e.num_args = 2;
+  trace_detail::Encode(e, 0, static_cast<int32_t>(a));
+  trace_detail::Encode(e, 1, static_cast<uint32_t>(b));
+  return trace_detail::Format(e);
+}
+
+TEST(trace_ring, formats_like_printf)
+{
+  EXPECT_EQ(FormatOne(trace_category::kBlock, "a=%d b=%u", -5, 7),
+            "a=-5 b=7");
+  EXPECT_EQ(FormatOne(trace_category::kBlock, "%5d|%-4x|%%", 12, 255),
+            "   12|ff  |%");
+  EXPECT_EQ(FormatOne(trace_category::kBlock, "%lld %llu %d", 1, 2),
+            "1 2 <?>");
+
+  trace_detail::entry e{};
+  e.fmt = "%s %.2f %d";
+  e.num_args = 3;
+  trace_detail::Encode(e, 0, "name");
+  trace_detail::Encode(e, 1, 1.5);
+  trace_detail::Encode(e, 2, int64_t{-1} << 40);
+  EXPECT_EQ(trace_detail::Format(e), "name 1.50 -1099511627776");
+}
+
+TEST(trace_ring, dumps_entries_of_all_threads)
+{
+  Dtrace(kRecord, "main thread %d", 1);
+  std::thread t([] {
+    for (int i = 0; i < 3 * static_cast<int>(trace_ring_entries); ++i) {
+      Dtrace(kBlock, "other thread %d", i);
+    }
+  });
+  t.join();
+
+  std::string dump = Dump();
+  EXPECT_NE(dump.find("record"), std::string::npos);
+  EXPECT_NE(dump.find("main thread 1\n"), std::string::npos);
+  EXPECT_NE(dump.find(std::to_string(3 * trace_ring_entries - 1) + "\n"),
+            std::string::npos);
+  // only the newest entries of the other thread are kept
+  EXPECT_EQ(dump.find("other thread 0\n"), std::string::npos);
+}
+
+TEST(trace_ring, categories_can_be_disabled)
+{
+  uint32_t old = trace_categories.exchange(0);
+  Dtrace(kBackup, "disabled %d", 42);
+  trace_categories = old;
+  EXPECT_EQ(Dump().find("disabled 42"), std::string::npos);
+}
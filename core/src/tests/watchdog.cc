@@ -0,0 +1,107 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#  include "gtest/gtest.h"
+#else
+#  include "gtest/gtest.h"
+#  include "include/bareos.h"
+#endif
+
+#include "lib/watchdog.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+static void CountFired(watchdog_t* wd)
+{
+  static_cast<std::atomic<int>*>(wd->data)->fetch_add(1);
+}
+
+static watchdog_t* StartTimer(std::atomic<int>& fired,
+                              utime_t interval,
+                              bool one_shot)
+{
+  watchdog_t* wd = NewWatchdog();
+  wd->callback = CountFired;
+  wd->one_shot = one_shot;
+  wd->interval = interval;
+  wd->data = &fired;
+  RegisterWatchdog(wd);
+  return wd;
+}
+
+static void StopTimer(watchdog_t* wd)
+{
+  UnregisterWatchdog(wd);
+  free(wd);
+}
+
+TEST(watchdog, fires_one_shot_timers_once)
+{
+  StartWatchdog();
+  std::atomic<int> fired{0};
+  watchdog_t* wd = StartTimer(fired, 1, true);
+  std::this_thread::sleep_for(std::chrono::milliseconds(3500));
+  EXPECT_EQ(fired, 1);
+  EXPECT_TRUE(UnregisterWatchdog(wd)); /* from the inactive timers */
+  free(wd);
+  StopWatchdog();
+}
+
+TEST(watchdog, fires_repeating_timers_until_unregistered)
+{
+  StartWatchdog();
+  std::atomic<int> fired{0};
+  watchdog_t* wd = StartTimer(fired, 1, false);
+  std::this_thread::sleep_for(std::chrono::milliseconds(3500));
+  StopTimer(wd);
+  int stopped_at = fired;
+  EXPECT_GE(stopped_at, 2);
+  std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+  EXPECT_EQ(fired, stopped_at);
+  StopWatchdog();
+}
+
+TEST(watchdog, does_not_fire_timers_that_are_not_due)
+{
+  StartWatchdog();
+  std::atomic<int> fired{0};
+  std::vector<watchdog_t*> timers;
+  // spread over all levels of the wheel
+  for (utime_t interval : {100, 5000, 300000, 20000000}) {
+    timers.push_back(StartTimer(fired, interval, true));
+  }
+  watchdog_t* soon = StartTimer(fired, 1, true);
+  std::this_thread::sleep_for(std::chrono::milliseconds(2500));
+  EXPECT_EQ(fired, 1);
+  for (watchdog_t* wd : timers) { EXPECT_TRUE(UnregisterWatchdog(wd)); }
+  for (watchdog_t* wd : timers) { free(wd); }
+  StopTimer(soon);
+
+  watchdog_t* never_registered = NewWatchdog();
+  EXPECT_FALSE(UnregisterWatchdog(never_registered));
+  free(never_registered);
+  StopWatchdog();
+}
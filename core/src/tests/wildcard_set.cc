@@ -0,0 +1,115 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#  include "gtest/gtest.h"
+#else
+#  include "gtest/gtest.h"
+#  include "include/bareos.h"
+#endif
+
+#include "findlib/wildcard_set.h"
+#include "lib/fnmatch.h"
+
+#include <string>
+#include <vector>
+
+static const std::vector<std::string> patterns{
+    "*.o",       "*.TMP",     "/home/*",     "/home/user/.cache",
+    "*/core",    "*",         "core*",       "/var/log/*.log",
+    "*~",        "**.bak",    "/tmp/**",     "[a-c]*.c",
+    "file?.txt", "\\*.star",  "/exact/name", ""};
+
+static const std::vector<std::string> names{
+    "",
+    "main.o",
+    "/src/main.o",
+    "/src/main.O",
+    "/home/user",
+    "/home/user/file",
+    "/home/user/.cache",
+    "/HOME/USER/.CACHE",
+    "/home/user/.cache/x",
+    "/data/core",
+    "core",
+    "core.1234",
+    "/var/log/syslog.log",
+    "/var/log/old/syslog.log",
+    "notes~",
+    "/x/notes.bak",
+    "/tmp/a/b",
+    "b.c",
+    "/src/b.c",
+    "file1.txt",
+    "*.star",
+    "/exact/name",
+    "/exact/name/",
+    "REPORT.tmp",
+    "/x/report.TMP"};
+
+static bool AnyFnmatch(const std::vector<std::string>& pats,
+                       const std::string& name,
+                       int flags)
+{
+  for (const auto& pattern : pats) {
+    if (fnmatch(pattern.c_str(), name.c_str(), flags) == 0) { return true; }
+  }
+  return false;
+}
+
+// every single pattern has to behave exactly like fnmatch()
+TEST(WildcardSet, MatchesLikeFnmatch)
+{
+  for (int flags : {0, FNM_CASEFOLD, FNM_PATHNAME, FNM_CASEFOLD | FNM_PATHNAME,
+                    FNM_LEADING_DIR}) {
+    for (const auto& pattern : patterns) {
+      WildcardSet set(flags);
+      set.Add(pattern.c_str());
+      for (const auto& name : names) {
+        EXPECT_EQ(set.Matches(name.c_str()),
+                  fnmatch(pattern.c_str(), name.c_str(), flags) == 0)
+            << "pattern=\"" << pattern << "\" name=\"" << name
+            << "\" flags=" << flags;
+      }
+    }
+  }
+}
+
+TEST(WildcardSet, MatchesAnyPattern)
+{
+  for (int flags : {0, FNM_CASEFOLD, FNM_PATHNAME}) {
+    WildcardSet set(flags);
+    for (const auto& pattern : patterns) { set.Add(pattern.c_str()); }
+    EXPECT_EQ(set.size(), patterns.size());
+    for (const auto& name : names) {
+      EXPECT_EQ(set.Matches(name.c_str()), AnyFnmatch(patterns, name, flags))
+          << "name=\"" << name << "\" flags=" << flags;
+    }
+  }
+}
+
+TEST(WildcardSet, EmptySetMatchesNothing)
+{
+  WildcardSet set(0);
+  EXPECT_EQ(set.size(), 0u);
+  EXPECT_FALSE(set.Matches(""));
+  EXPECT_FALSE(set.Matches("/any/file"));
+}
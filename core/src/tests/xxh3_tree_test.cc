@@ -0,0 +1,130 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#  include "gtest/gtest.h"
+#else
+#  include "gtest/gtest.h"
+#  include "include/bareos.h"
+#endif
+
+#include <cstring>
+#include <random>
+#include <vector>
+#include "lib/crypto.h"
+#include "lib/xxhash.h"
+
+static std::vector<uint8_t> TestData(std::size_t size)
+{
+  std::mt19937 gen(size);
+  std::vector<uint8_t> data(size);
+  for (auto& byte : data) { byte = static_cast<uint8_t>(gen()); }
+  return data;
+}
+
+static std::vector<uint8_t> Finish(DIGEST* digest)
+{
+  std::vector<uint8_t> value(CRYPTO_DIGEST_MAX_SIZE);
+  uint32_t length = value.size();
+  EXPECT_TRUE(CryptoDigestFinalize(digest, value.data(), &length));
+  value.resize(length);
+  CryptoDigestFree(digest);
+  return value;
+}
+
+static std::vector<uint8_t> SerialDigest(const std::vector<uint8_t>& data)
+{
+  DIGEST* digest = crypto_digest_new(nullptr, CRYPTO_DIGEST_XXH3_TREE);
+  EXPECT_TRUE(CryptoDigestUpdate(digest, data.data(), data.size()));
+  return Finish(digest);
+}
+
+/* Hashes the blocks like SendPlainData(): whole chunks by chunk hashes,
+ * everything from the first short block on serially. */
+static std::vector<uint8_t> BlockDigest(const std::vector<uint8_t>& data,
+                                        const std::vector<std::size_t>& blocks)
+{
+  DIGEST* digest = crypto_digest_new(nullptr, CRYPTO_DIGEST_XXH3_TREE);
+  bool serial = false;
+  std::size_t done = 0;
+  for (std::size_t size : blocks) {
+    if (size % xxh3_tree_chunk_size != 0) { serial = true; }
+    if (serial) {
+      EXPECT_TRUE(CryptoDigestUpdate(digest, data.data() + done, size));
+    } else {
+      EXPECT_TRUE(Xxh3TreeAddChunkHashes(
+          digest, Xxh3TreeChunkHashes(data.data() + done, size)));
+    }
+    done += size;
+  }
+  EXPECT_EQ(done, data.size());
+  return Finish(digest);
+}
+
+TEST(xxh3_tree, ChunkHashesOfWholeBlocks)
+{
+  constexpr std::size_t block = 2 * xxh3_tree_chunk_size;
+  auto data = TestData(3 * block + 1234);
+  EXPECT_EQ(BlockDigest(data, {block, block, block, 1234}), SerialDigest(data));
+  EXPECT_EQ(BlockDigest(data, {3 * block + 1234}), SerialDigest(data));
+}
+
+TEST(xxh3_tree, ShortBlocksInTheMiddle)
+{
+  constexpr std::size_t block = 2 * xxh3_tree_chunk_size;
+  auto data = TestData(4 * block);
+  std::vector<std::vector<std::size_t>> splits = {
+      {block, 1000, block - 1000, block, block},
+      {block - 1, 1, block, block, block},
+      {block, block, xxh3_tree_chunk_size + 7, xxh3_tree_chunk_size - 7, block},
+      {1, block, block, block, block - 1},
+  };
+  for (auto& blocks : splits) {
+    EXPECT_EQ(BlockDigest(data, blocks), SerialDigest(data));
+  }
+
+  // the chunk hashes of a short block that is not the last are different
+  DIGEST* digest = crypto_digest_new(nullptr, CRYPTO_DIGEST_XXH3_TREE);
+  EXPECT_TRUE(Xxh3TreeAddChunkHashes(
+      digest, Xxh3TreeChunkHashes(data.data(), block - 1)));
+  EXPECT_TRUE(Xxh3TreeAddChunkHashes(
+      digest, Xxh3TreeChunkHashes(data.data() + block - 1, 1)));
+  EXPECT_NE(Finish(digest), SerialDigest(std::vector<uint8_t>(
+                                data.begin(), data.begin() + block)));
+}
+
+TEST(xxh3_tree, RandomBlockSizes)
+{
+  std::mt19937 gen(4711);
+  auto data = TestData(40 * xxh3_tree_chunk_size + 99);
+  auto expected = SerialDigest(data);
+  for (int i = 0; i < 20; ++i) {
+    std::vector<std::size_t> blocks;
+    for (std::size_t left = data.size(); left > 0;) {
+      std::size_t size = gen() % 3 ? 2 * xxh3_tree_chunk_size
+                                   : gen() % (3 * xxh3_tree_chunk_size) + 1;
+      blocks.push_back(std::min(size, left));
+      left -= blocks.back();
+    }
+    EXPECT_EQ(BlockDigest(data, blocks), expected);
+  }
+}
@@ -0,0 +1,441 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Writes and reads synthetic volumes through any storage backend
+ *
+ * Unlike the speed test of btape this works with every Device: the blocks
+ * go through WriteBlockToDev() and ReadBlockFromDev() of the configured
+ * device, so chunked backends (droplet, dplcompat) and the dedupable backend
+ * are measured with their io threads, chunk sizes and uploads.
+ */
+
+#define STORAGE_DAEMON
+
+#include "include/bareos.h"
+#include "include/exit_codes.h"
+#include "include/streams.h"
+#include "stored/block.h"
+#include "stored/butil.h"
+#include "stored/device_control_record.h"
+#include "stored/device_resource.h"
+#include "include/jcr.h"
+#include "stored/label.h"
+#include "stored/record.h"
+#include "stored/stored_jcr_impl.h"
+#include "stored/stored_conf.h"
+#include "stored/stored_globals.h"
+#include "lib/parse_conf.h"
+
+#include "lib/edit.h"
+#include "lib/cli.h"
+#include "lib/version.h"
+
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <random>
+
+using namespace storagedaemon;
+
+namespace {
+using bench_clock = std::chrono::steady_clock;
+
+// counts durations in buckets of powers of two microseconds
+class latency_histogram {
+ public:
+  void Add(bench_clock::duration d)
+  {
+    uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(d)
+                      .count();
+    std::size_t bucket = 0;
+    while (bucket + 1 < buckets_.size() && (uint64_t{1} << bucket) < us) {
+      bucket += 1;
+    }
+    buckets_[bucket] += 1;
+    count_ += 1;
+    if (us > max_us_) { max_us_ = us; }
+  }
+
+  // the upper bound of the bucket the given fraction of all durations is in
+  uint64_t Percentile(double fraction) const
+  {
+    uint64_t needed = static_cast<uint64_t>(fraction * count_);
+    uint64_t seen = 0;
+    for (std::size_t i = 0; i < buckets_.size(); ++i) {
+      seen += buckets_[i];
+      if (seen > needed) { return uint64_t{1} << i; }
+    }
+    return max_us_;
+  }
+
+  void Print(const char* what) const
+  {
+    if (count_ == 0) { return; }
+    std::cout << what << " latency per block (us):\n";
+    for (std::size_t i = 0; i < buckets_.size(); ++i) {
+      if (buckets_[i] == 0) { continue; }
+      char line[100];
+      snprintf(line, sizeof(line), "  <= %9llu %10llu %6.2f%%\n",
+               static_cast<unsigned long long>(uint64_t{1} << i),
+               static_cast<unsigned long long>(buckets_[i]),
+               100.0 * buckets_[i] / count_);
+      std::cout << line;
+    }
+    std::cout << "  p50 <= " << Percentile(0.5) << " p90 <= "
+              << Percentile(0.9) << " p99 <= " << Percentile(0.99)
+              << " max = " << max_us_ << "\n";
+  }
+
+ private:
+  std::array<uint64_t, 32> buckets_{};
+  uint64_t count_{0};
+  uint64_t max_us_{0};
+};
+
+struct bench_options {
+  std::string device_name;
+  uint64_t block_size{0};
+  uint64_t volume_size{1024 * 1024 * 1024};
+  uint32_t volumes{1};
+  uint64_t chunk_size{0};
+  uint32_t io_threads{0};
+  std::string device_options;
+  bool zero{false};
+  bool skip_read{false};
+  bool keep{false};
+};
+
+struct bench_result {
+  uint64_t bytes{0};
+  bench_clock::duration time{};
+  bench_clock::duration close{};
+  latency_histogram latency;
+};
+
+double Rate(const bench_result& result)
+{
+  double seconds = std::chrono::duration<double>(result.time).count();
+  return seconds > 0 ? result.bytes / seconds / 1'000'000 : 0;
+}
+
+double Seconds(bench_clock::duration d)
+{
+  return std::chrono::duration<double>(d).count();
+}
+
+void PrintResult(const char* what, const bench_result& result)
+{
+  char size[50], line[200];
+  snprintf(line, sizeof(line),
+           "  %s %sB in %.2f s = %.1f MB/s (close took %.2f s)\n", what,
+           edit_uint64_with_suffix(result.bytes, size), Seconds(result.time),
+           Rate(result), Seconds(result.close));
+  std::cout << line;
+}
+
+/* The device resource as setup_to_access_device() finds it, the options of
+ * the command line are applied before the device gets created from it. */
+DeviceResource* ConfigureDevice(const bench_options& options)
+{
+  DeviceResource* found = nullptr;
+  DeviceResource* device_resource;
+  foreach_res (device_resource, R_DEVICE) {
+    if (options.device_name == device_resource->resource_name_
+        || options.device_name == device_resource->archive_device_string) {
+      found = device_resource;
+      break;
+    }
+  }
+  if (!found) { return nullptr; }
+
+  if (options.block_size) { found->max_block_size = options.block_size; }
+
+  std::string device_options
+      = found->device_options ? found->device_options : "";
+  auto append = [&device_options](const std::string& option) {
+    if (!device_options.empty()) { device_options += ","; }
+    device_options += option;
+  };
+  if (options.chunk_size) {
+    append("chunksize=" + std::to_string(options.chunk_size));
+  }
+  if (options.io_threads) {
+    append("iothreads=" + std::to_string(options.io_threads));
+  }
+  if (!options.device_options.empty()) { append(options.device_options); }
+  if (found->device_options) { free(found->device_options); }
+  found->device_options
+      = device_options.empty() ? nullptr : strdup(device_options.c_str());
+  return found;
+}
+
+// different data in every 4k so that nothing can be deduplicated
+void MixData(char* data, uint32_t size, uint64_t block)
+{
+  for (uint32_t offset = 0; offset + sizeof(block) <= size; offset += 4096) {
+    memcpy(data + offset, &block, sizeof(block));
+  }
+}
+
+bool WriteVolume(DeviceControlRecord* dcr,
+                 const bench_options& options,
+                 const char* volume,
+                 bench_result& result)
+{
+  Device* dev = dcr->dev;
+  bstrncpy(dcr->VolumeName, volume, sizeof(dcr->VolumeName));
+  if (!WriteNewVolumeLabelToDev(dcr, volume, "Default", false)) {
+    std::cerr << "Could not label volume " << volume << ": "
+              << dev->bstrerror() << "\n";
+    return false;
+  }
+  dev->SetAppend();
+
+  DeviceBlock* block = dcr->block;
+  DeviceRecord* rec = new_record();
+  rec->data_len = block->buf_len - 100;
+  rec->data = CheckPoolMemorySize(rec->data, rec->data_len);
+  rec->FileIndex = 1;
+  rec->Stream = STREAM_FILE_DATA;
+  rec->maskedStream = STREAM_FILE_DATA;
+  if (options.zero) {
+    memset(rec->data, 0, rec->data_len);
+  } else {
+    std::mt19937_64 random;
+    for (uint32_t i = 0; i + sizeof(uint64_t) <= rec->data_len;
+         i += sizeof(uint64_t)) {
+      uint64_t value = random();
+      memcpy(rec->data + i, &value, sizeof(value));
+    }
+  }
+
+  bool ok = true;
+  uint64_t blocks = 0;
+  uint64_t written = 0;
+  auto start = bench_clock::now();
+  while (ok && written < options.volume_size) {
+    if (!options.zero) { MixData(rec->data, rec->data_len, ++blocks); }
+    auto before = bench_clock::now();
+    ok = WriteRecordToBlock(dcr, rec) && dcr->WriteBlockToDev();
+    result.latency.Add(bench_clock::now() - before);
+    written += rec->data_len;
+  }
+  result.bytes += written;
+  if (!ok) {
+    std::cerr << "Writing to volume " << volume
+              << " failed: " << dev->bstrerror() << "\n";
+  }
+
+  // chunked devices upload what is left when they get closed
+  auto before_close = bench_clock::now();
+  ok = dev->close(dcr) && ok;
+  auto end = bench_clock::now();
+  result.close += end - before_close;
+  result.time += end - start;
+
+  FreeRecord(rec);
+  return ok;
+}
+
+bool ReadVolume(DeviceControlRecord* dcr,
+                const char* volume,
+                bench_result& result)
+{
+  Device* dev = dcr->dev;
+  bstrncpy(dcr->VolumeName, volume, sizeof(dcr->VolumeName));
+  dcr->setVolCatName(volume);
+  dev->setVolCatName(volume);
+  if (!dev->open(dcr, DeviceMode::OPEN_READ_ONLY)
+      || ReadDevVolumeLabel(dcr) != VOL_OK) {
+    std::cerr << "Could not open volume " << volume
+              << " for reading: " << dev->bstrerror() << "\n";
+    return false;
+  }
+
+  bool ok = true;
+  auto start = bench_clock::now();
+  for (;;) {
+    auto before = bench_clock::now();
+    auto status = dcr->ReadBlockFromDev(NO_BLOCK_NUMBER_CHECK);
+    if (status != DeviceControlRecord::ReadStatus::Ok) {
+      ok = status != DeviceControlRecord::ReadStatus::Error;
+      break;
+    }
+    result.latency.Add(bench_clock::now() - before);
+    result.bytes += dcr->block->block_len;
+  }
+  if (!ok) {
+    std::cerr << "Reading volume " << volume
+              << " failed: " << dev->bstrerror() << "\n";
+  }
+
+  auto before_close = bench_clock::now();
+  dev->close(dcr);
+  auto end = bench_clock::now();
+  result.close += end - before_close;
+  result.time += end - start;
+  return ok;
+}
+
+void TruncateVolume(DeviceControlRecord* dcr, const char* volume)
+{
+  Device* dev = dcr->dev;
+  bstrncpy(dcr->VolumeName, volume, sizeof(dcr->VolumeName));
+  dcr->setVolCatName(volume);
+  dev->setVolCatName(volume);
+  if (!dev->open(dcr, DeviceMode::OPEN_READ_WRITE) || !dev->d_truncate(dcr)) {
+    std::cerr << "Could not truncate volume " << volume << ": "
+              << dev->bstrerror() << "\n";
+  }
+  dev->close(dcr);
+}
+}  // namespace
+
+int main(int argc, const char* argv[])
+{
+  CLI::App app;
+  std::string desc(1024, '\0');
+  kBareosVersionStrings.FormatCopyright(desc.data(), desc.size(), 2024);
+  desc.resize(strlen(desc.c_str()));
+  desc += "The Bareos Storage Backend Benchmark";
+  InitCLIApp(app, desc, 0);
+  AddDebugOptions(app);
+  MyNameIs(argc, argv, "bbench-sd");
+
+  bench_options options;
+  std::string config;
+  app.add_option("-c,--config", config,
+                 "Use <path> as configuration file or directory.")
+      ->check(CLI::ExistingPath)
+      ->type_name("<path>");
+
+  app.add_option("--devicename,devicename", options.device_name,
+                 "Specify the device name (either as name of a Bareos "
+                 "Storage Daemon Device resource or identical to the Archive "
+                 "Device in a Bareos Storage Daemon Device resource).")
+      ->required();
+
+  bool k_is_1000 = false;
+  app.add_option("-b,--blocksize", options.block_size,
+                 "Write blocks of this size instead of the Maximum Block Size "
+                 "of the device.")
+      ->transform(CLI::AsSizeValue{k_is_1000})
+      ->check(CLI::Range(uint64_t{DEFAULT_BLOCK_SIZE},
+                         uint64_t{MAX_BLOCK_LENGTH}));
+
+  app.add_option("-s,--volume-size", options.volume_size,
+                 "Write this much data to each volume.")
+      ->transform(CLI::AsSizeValue{k_is_1000})
+      ->check(CLI::PositiveNumber);
+
+  app.add_option("-n,--volumes", options.volumes,
+                 "Number of volumes to write.")
+      ->check(CLI::PositiveNumber);
+
+  app.add_option("-C,--chunksize", options.chunk_size,
+                 "Add chunksize=<size> to the device options.")
+      ->transform(CLI::AsSizeValue{k_is_1000})
+      ->check(CLI::PositiveNumber);
+
+  app.add_option("-t,--io-threads", options.io_threads,
+                 "Add iothreads=<n> to the device options.")
+      ->check(CLI::Range(0, 255));
+
+  app.add_option("-o,--device-options", options.device_options,
+                 "Add these options to the device options.")
+      ->type_name("<options>");
+
+  app.add_flag("-z,--zero", options.zero,
+               "Write zeros instead of data that cannot be compressed or "
+               "deduplicated.");
+
+  app.add_flag("-w,--write-only", options.skip_read,
+               "Do not read the volumes back.");
+
+  app.add_flag("-k,--keep", options.keep,
+               "Keep the volumes instead of truncating them at the end.");
+
+  CLI11_PARSE(app, argc, argv);
+
+  my_config = InitSdConfig(config.c_str(), M_ERROR_TERM);
+  ParseSdConfig(config.c_str(), M_ERROR_TERM);
+
+  DeviceResource* device_resource = ConfigureDevice(options);
+  if (!device_resource) {
+    std::cerr << "Could not find device \"" << options.device_name << "\"\n";
+    return BEXIT_FAILURE;
+  }
+
+  std::vector<std::string> volumes;
+  for (uint32_t i = 0; i < options.volumes; ++i) {
+    volumes.push_back("bbench-" + std::to_string(getpid()) + "-"
+                      + std::to_string(i));
+  }
+
+  DeviceControlRecord* dcr = new DeviceControlRecord;
+  JobControlRecord* jcr
+      = SetupJcr("bbench-sd", options.device_name.data(), nullptr, nullptr,
+                 dcr, volumes.front(), false); /* write device */
+  if (!jcr) { return BEXIT_FAILURE; }
+  Device* dev = jcr->sd_impl->dcr->dev;
+  if (!dev) { return BEXIT_FAILURE; }
+
+  char size[50], block[50];
+  std::cout << "Writing " << volumes.size() << " volume(s) of "
+            << edit_uint64_with_suffix(options.volume_size, size)
+            << "B in blocks of "
+            << edit_uint64_with_suffix(dcr->block->buf_len, block)
+            << "B to " << dev->print_name() << " ("
+            << device_resource->device_type << ")\n";
+  if (device_resource->device_options) {
+    std::cout << "Device options: " << device_resource->device_options << "\n";
+  }
+
+  bool ok = true;
+  bench_result written, read;
+  for (const std::string& volume : volumes) {
+    ok = WriteVolume(dcr, options, volume.c_str(), written) && ok;
+  }
+  std::cout << "Results:\n";
+  PrintResult("write", written);
+
+  if (ok && !options.skip_read) {
+    for (const std::string& volume : volumes) {
+      ok = ReadVolume(dcr, volume.c_str(), read) && ok;
+    }
+    PrintResult("read ", read);
+  }
+
+  written.latency.Print("Write");
+  read.latency.Print("Read");
+
+  if (!options.keep) {
+    for (const std::string& volume : volumes) {
+      TruncateVolume(dcr, volume.c_str());
+    }
+  }
+
+  FreeJcr(jcr);
+  delete dev;
+
+  return ok ? BEXIT_SUCCESS : BEXIT_FAILURE;
+}
@@ -38,6 +38,8 @@
 #include "lib/edit.h"
 #include "stored/acquire.h"
 #include "lib/compression.h"
+#include "lib/xxhash.h"
+#include "stored/backends/dedupable/chunker.h"
 
 #include "lib/cli.h"
 #include "lib/version.h"
@@ -45,6 +47,7 @@
 #include <cassert>
 #include <array>
 #include <iostream>
+#include <optional>
 #include <unordered_set>
 
 struct dedup_unit {
@@ -82,6 +85,25 @@ template <> struct std::hash<dedup_unit> {
   }
 };
 
+struct chunk_unit {
+  std::size_t data_size;
+  Xxh128Hash digest;
+
+  chunk_unit(const char* data, std::size_t dsize)
+      : data_size{dsize}, digest{Xxh128(data, dsize)}
+  {
+  }
+
+  friend bool operator==(const chunk_unit& l, const chunk_unit& r)
+  {
+    return l.data_size == r.data_size && l.digest == r.digest;
+  }
+};
+
+template <> struct std::hash<chunk_unit> {
+  std::size_t operator()(const chunk_unit& c) const { return c.digest.low64; }
+};
+
 namespace {
 std::string device_name;
 storagedaemon::DirectorResource* dir = nullptr;
@@ -90,6 +112,9 @@ std::size_t total_size{0};
 std::size_t real_size{0};
 std::size_t num_records{0};
 std::unordered_set<dedup_unit> dedup_units;
+std::size_t chunk_size{0};
+std::optional<dedup::chunker> chunking;
+std::unordered_set<chunk_unit> chunk_units;
 bool verbose_status{false};
 bool enable_decompression{false};
 
@@ -98,6 +123,23 @@ void OutputBlockSize(std::size_t blocksize)
   std::cout << "Using block size " << SizeAsSiPrefixFormat(blocksize) << "\n";
 }
 
+void OutputChunkSize(std::size_t chunksize)
+{
+  std::cout << "Using content defined chunks of average size "
+            << SizeAsSiPrefixFormat(chunksize) << "\n";
+}
+
+// same chunking as the dedupable backend uses
+void CountChunks(const char* buf, std::size_t size)
+{
+  while (size > 0) {
+    auto csize = chunking->next_chunk(buf, size);
+    if (chunk_units.emplace(buf, csize).second) { real_size += csize; }
+    buf += csize;
+    size -= csize;
+  }
+}
+
 void OutputStatus()
 {
   char before[edit::min_buffer_size];
@@ -135,6 +177,13 @@ bool RecordCallback(storagedaemon::DeviceControlRecord* dcr,
   }
 
   total_size += size;
+
+  if (chunking) {
+    CountChunks(buf, size);
+    if (verbose_status && (num_records % 100000 == 0)) { OutputStatus(); }
+    return true;
+  }
+
   auto num_units = size / block_size;
 
   for (std::size_t unit = 0; unit < num_units; ++unit) {
@@ -287,6 +336,14 @@ int main(int argc, const char* argv[])
       ->transform(CLI::AsSizeValue{k_is_1000})
       ->check(CLI::PositiveNumber);
 
+  app.add_option("-C,--chunksize", chunk_size,
+                 "Estimate content defined chunking (as done by the dedupable\n"
+                 "backend with Chunk Size set) with this average chunk size\n"
+                 "instead of fixed size blocks.")
+      ->transform(CLI::AsSizeValue{k_is_1000})
+      ->check(CLI::Range(dedup::chunker::min_avg_size,
+                         dedup::chunker::max_avg_size));
+
   app.add_flag("-v,--verbose", verbose_status);
 
   CLI11_PARSE(app, argc, argv);
@@ -310,7 +367,12 @@ int main(int argc, const char* argv[])
     }
   }
 
-  OutputBlockSize(block_size);
+  if (chunk_size > 0) {
+    chunking.emplace(chunk_size);
+    OutputChunkSize(chunking->avg_size());
+  } else {
+    OutputBlockSize(block_size);
+  }
   read_records(volumes);
 
   OutputStatus();
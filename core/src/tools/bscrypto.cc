@@ -331,7 +331,7 @@ int main(int argc, char* const* argv)
 
   if (dump_cache) {
     // Load any keys currently in the cache.
-    ReadCryptoCache(cache_file.c_str());
+    ReadCryptoCache(cache_file.c_str(), true);
 
     // Dump the content of the cache.
     DumpCryptoCache(STDOUT_FILENO);
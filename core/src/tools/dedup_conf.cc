@@ -80,6 +80,39 @@ void print_config(const dedup::config& conf)
                 << (datafile.ReadOnly ? "\"yes\"" : "\"no\"") << ", "
                 << "\"Index\": " << datafile.Idx << " }";
     }
+    std::cout << "],\n";
+  }
+  {
+    std::cout << " \"index files\": [";
+    bool first = true;
+    for (auto& indexfile : conf.ifiles) {
+      if (first) {
+        first = false;
+      } else {
+        std::cout << ",\n                 ";
+      }
+      std::cout << "{ "
+                << "\"Name\": \"" << indexfile.relpath << "\", "
+                << "\"Extents Name\": \"" << indexfile.extent_relpath << "\", "
+                << "\"Blocks\": " << indexfile.Blocks << ", "
+                << "\"Extents\": " << indexfile.Extents << " }";
+    }
+    std::cout << "],\n";
+  }
+  {
+    std::cout << " \"chunk files\": [";
+    bool first = true;
+    for (auto& chunkfile : conf.cfiles) {
+      if (first) {
+        first = false;
+      } else {
+        std::cout << ",\n                 ";
+      }
+      std::cout << "{ "
+                << "\"Name\": \"" << chunkfile.relpath << "\", "
+                << "\"Count\": " << chunkfile.Count << ", "
+                << "\"AvgSize\": " << chunkfile.AvgSize << " }";
+    }
     std::cout << "]\n";
   }
   std::cout << "}\n";
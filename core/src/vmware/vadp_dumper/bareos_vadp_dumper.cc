@@ -174,6 +174,7 @@ static bool local_vmdk = false;
 static bool do_query_allocated = true;
 static uint64 ChunkSize = VIXDISKLIB_MIN_CHUNK_SIZE;
 static bool multi_threaded = false;
+static int nr_readers = 0; /* parallel VDDK handles reading the disk */
 static bool restore_meta_data = false;
 static uint64_t sectors_per_call = DEFAULT_SECTORS_PER_CALL;
 static uint64_t absolute_start_offset = 0;
@@ -185,6 +186,7 @@ static char* disktype = NULL;
 static VixDiskLibConnectParams* cnxParams = nullptr;
 static VixDiskLibConnection connection = NULL;
 static VixDiskLibHandle read_diskHandle = NULL;
+static VixDiskLibHandle* reader_diskHandles = NULL;
 static VixDiskLibHandle write_diskHandle = NULL;
 static VixDiskLibInfo* info = NULL;
 static json_t* json_config = NULL;
@@ -413,6 +415,17 @@ static inline void cleanup_vixdisklib()
   VixDiskLib_Cleanup(cnxParams, &numCleanedUp, &numRemaining);
 }
 
+static inline void close_reader_handles()
+{
+  if (!reader_diskHandles) { return; }
+
+  for (int i = 0; i < nr_readers; i++) {
+    if (reader_diskHandles[i]) { VixDiskLib_Close(reader_diskHandles[i]); }
+  }
+  free(reader_diskHandles);
+  reader_diskHandles = NULL;
+}
+
 // Generic cleanup function.
 static void cleanup(void)
 {
@@ -425,6 +438,8 @@ static void cleanup(void)
     read_diskHandle = NULL;
   }
 
+  close_reader_handles();
+
   if (write_diskHandle) {
     VixDiskLib_Close(write_diskHandle);
     write_diskHandle = NULL;
@@ -761,23 +776,42 @@ bail_out:
 }
 
 // Read data from a VMDK using the VDDP functions.
-static size_t read_from_vmdk(size_t sector_offset, size_t nbyte, void* buf)
+static size_t read_from_handle(VixDiskLibHandle diskHandle,
+                               size_t sector_offset,
+                               size_t nbyte,
+                               void* buf)
 {
   VixError err;
 
-  err = VixDiskLib_Read(read_diskHandle, sector_offset,
-                        nbyte / DEFAULT_SECTOR_SIZE, (uint8*)buf);
+  err = VixDiskLib_Read(diskHandle, sector_offset, nbyte / DEFAULT_SECTOR_SIZE,
+                        (uint8*)buf);
   if (VIX_FAILED(err)) {
     char* error_txt;
 
     error_txt = VixDiskLib_GetErrorText(err, NULL);
     fprintf(stderr, "VMDK Read error: %s [%lu]\n", error_txt, err);
+    VixDiskLib_FreeErrorText(error_txt);
     return -1;
   }
 
   return nbyte;
 }
 
+static size_t read_from_vmdk(size_t sector_offset, size_t nbyte, void* buf)
+{
+  return read_from_handle(read_diskHandle, sector_offset, nbyte, buf);
+}
+
+// Read data from a VMDK using the handle of one of the parallel readers.
+static size_t read_from_vmdk_reader(int reader,
+                                    size_t sector_offset,
+                                    size_t nbyte,
+                                    void* buf)
+{
+  return read_from_handle(reader_diskHandles[reader], sector_offset, nbyte,
+                          buf);
+}
+
 // Write data to a VMDK using the VDDP functions.
 static size_t write_to_vmdk(size_t sector_offset, size_t nbyte, void* buf)
 {
@@ -1173,6 +1207,27 @@ bail_out:
   return false;
 }
 
+// Write the header of a CBT record into the output stream.
+static size_t write_cbt_header(size_t start_offset, size_t nbyte, void* buf)
+{
+  // Write the CBT info into the output stream.
+  if (robust_writer(STDOUT_FILENO, buf, nbyte) != nbyte) {
+    fprintf(stderr,
+            "Failed to write runtime_cbt_encoding structure to output "
+            "datastream\n");
+    return 0;
+  }
+
+  if (raw_disk_fd != -1) {
+    lseek(raw_disk_fd, start_offset, SEEK_SET);
+    if (verbose) {
+      fprintf(stderr, "Log: RAWFILE: Adusting seek position in file\n");
+    }
+  }
+
+  return nbyte;
+}
+
 /* Process a single cbt record. */
 static bool process_single_cbt(std::vector<uint8>& buffer,
                                uint64 start_offset,
@@ -1192,21 +1247,15 @@ static bool process_single_cbt(std::vector<uint8>& buffer,
   }
 
 
-  // Write the CBT info into the output stream.
-  if (robust_writer(STDOUT_FILENO, (char*)&rce, rce_size) != rce_size) {
-    fprintf(stderr,
-            "Failed to write runtime_cbt_encoding structure to output "
-            "datastream\n");
+  /* With parallel readers the data of earlier CBT records may still be
+   * queued, so the header has to go through the copy thread as well. */
+  if (nr_readers > 0) {
+    send_header_to_copy_thread(start_offset, &rce, rce_size);
+  } else if (write_cbt_header(start_offset, rce_size, &rce)
+             != static_cast<size_t>(rce_size)) {
     return false;
   }
 
-  if (raw_disk_fd != -1) {
-    lseek(raw_disk_fd, start_offset, SEEK_SET);
-    if (verbose) {
-      fprintf(stderr, "Log: RAWFILE: Adusting seek position in file\n");
-    }
-  }
-
   bool retval = true;
   /* Calculate the start offset and read as many sectors as defined by the
    * length element of the JSON structure. */
@@ -1271,7 +1320,7 @@ static bool process_single_cbt(std::vector<uint8>& buffer,
     offset_length -= sectors_to_read * DEFAULT_SECTOR_SIZE;
   }
 
-  if (multi_threaded) {
+  if (multi_threaded && nr_readers == 0) {
     /* we need to wait until the thread has finished writing
      * all data that we have given him to write -- otherwise both this thread
      * and the copy thread would write to stdout at the same time! */
@@ -1532,6 +1581,12 @@ static inline bool process_cbt(const char* key, vec allocated, json_t* cbt)
     }
   }
 
+  // the headers went through the copy thread, so everything is written in order
+  if (nr_readers > 0 && !flush_copy_thread()) {
+    fprintf(stderr, "Failed to read or write data with parallel readers\n");
+    return false;
+  }
+
   if (verbose) {
     fprintf(stderr, "Total Changed Data: %llu, Total Saved Data: %llu\n",
             static_cast<long long unsigned>(changed_count),
@@ -1749,7 +1804,23 @@ static inline bool dump_vmdk_stream(const char* json_work_file)
   }
 
   // Setup multi threading if requested.
-  if (multi_threaded) {
+  if (nr_readers > 0) {
+    /* Every reader gets its own handle, VDDK connections have quite some
+     * latency per read and disjoint CBT extents can be read in parallel. */
+    json_t* disk_params = json_object_get(json_config, DISK_PARAMS_KEY);
+    reader_diskHandles
+        = (VixDiskLibHandle*)calloc(nr_readers, sizeof(VixDiskLibHandle));
+    for (int i = 0; i < nr_readers; i++) {
+      do_vixdisklib_open(DISK_PARAMS_KEY, NULL, disk_params, true, false,
+                         &reader_diskHandles[i]);
+    }
+
+    if (!setup_parallel_copy_thread(nr_readers, read_from_vmdk_reader,
+                                    write_to_stream, write_cbt_header)) {
+      fprintf(stderr, "Failed to initialize multithreading\n");
+      exit(1);
+    }
+  } else if (multi_threaded) {
     if (!setup_copy_thread(read_from_vmdk, write_to_stream)) {
       fprintf(stderr, "Failed to initialize multithreading\n");
       exit(1);
@@ -1852,6 +1923,11 @@ static inline bool dump_vmdk_stream(const char* json_work_file)
   retval = process_cbt(CBT_DISKCHANGEINFO_KEY, std::move(blocks), value);
 
 bail_out:
+  if (nr_readers > 0) {
+    cleanup_copy_thread();
+    close_reader_handles();
+  }
+
   if (read_diskHandle) {
     VixDiskLib_Close(read_diskHandle);
     read_diskHandle = NULL;
@@ -1901,7 +1977,8 @@ void usage(const char* program_name)
 {
   fprintf(stderr,
           "Usage: %s [-d <vmdk_diskname>] [-f force_transport] [-s "
-          "sectors_per_call] [-t disktype] [-k chunksize] [-CcDlMmRSvQ] dump "
+          "sectors_per_call] [-t disktype] [-k chunksize] [-p readers] "
+          "[-CcDlMmRSvQ] dump "
           "<workfile> | "
           "restore <workfile> | show\n",
           program_name);
@@ -1915,6 +1992,9 @@ void usage(const char* program_name)
   fprintf(stderr, "   -l - Write to a local VMDK\n");
   fprintf(stderr, "   -M - Save metadata of VMDK on dump action\n");
   fprintf(stderr, "   -m - Use multithreading\n");
+  fprintf(stderr,
+          "   -p - Read with this many parallel VDDK handles on dump action "
+          "(implies -m)\n");
   fprintf(stderr, "   -r - RAW Image disk name\n");
   fprintf(stderr, "   -R - Restore metadata of VMDK on restore action\n");
   fprintf(stderr, "   -S - Cleanup on Start\n");
@@ -1934,7 +2014,7 @@ int main(int argc, char** argv)
   int ch;
 
   program_name = argv[0];
-  while ((ch = getopt(argc, argv, "CcDd:r:f:hlMmRSs:Qk:t:v?")) != -1) {
+  while ((ch = getopt(argc, argv, "CcDd:r:f:hlMmp:RSs:Qk:t:v?")) != -1) {
     switch (ch) {
       case 'C':
         create_disk = true;
@@ -1989,6 +2069,17 @@ int main(int argc, char** argv)
       case 'm':
         multi_threaded = true;
         break;
+      case 'p':
+        nr_readers = atoi(optarg);
+        if (nr_readers <= 0) {
+          fprintf(stderr,
+                  "The number of parallel readers has to be a number > 0 "
+                  "(got '%s')!\n",
+                  optarg);
+          exit(1);
+        }
+        multi_threaded = true;
+        break;
       case 'R':
         restore_meta_data = true;
         break;
@@ -51,11 +51,38 @@ static void* copy_thread(void* data)
 
     while (save_data) {
       auto total_length = save_data->data_len;
-      cnt = context->output_function(save_data->sector_offset,
-                                     save_data->data_len, save_data->data);
+
+      if (context->nr_readers > 0) {
+        // Items are queued in order but read in parallel.
+        assert(0 == pthread_mutex_lock(&context->lock));
+        while (!save_data->ready) {
+          assert(0 == pthread_cond_wait(&context->read_done, &context->lock));
+        }
+        bool read_failed = context->read_failed;
+        assert(0 == pthread_mutex_unlock(&context->lock));
+
+        /* Keep on dequeueing after a failure so flush_copy_thread() returns
+         * and the main thread can report the error. */
+        if (read_failed) {
+          context->cb->dequeue();
+          save_data = (CP_THREAD_SAVE_DATA*)context->cb->peek();
+          continue;
+        }
+      }
+
+      IO_FUNCTION* output_function = save_data->is_header
+                                         ? context->header_function
+                                         : context->output_function;
+      cnt = output_function(save_data->sector_offset, save_data->data_len,
+                            save_data->data);
       // dequeue invalidates save_data!
       context->cb->dequeue();
-      if (cnt < total_length) { return NULL; }
+      if (cnt < total_length) {
+        if (context->nr_readers == 0) { return NULL; }
+        assert(0 == pthread_mutex_lock(&context->lock));
+        context->read_failed = true;
+        assert(0 == pthread_mutex_unlock(&context->lock));
+      }
       save_data = (CP_THREAD_SAVE_DATA*)context->cb->peek();
     }
 
@@ -78,6 +105,40 @@ static void* copy_thread(void* data)
   return NULL;
 }
 
+// Reader thread of a parallel copy thread, data is its reader number.
+static void* reader_thread(void* data)
+{
+  CP_THREAD_CTX* context = cp_thread;
+  int reader = (int)(intptr_t)data;
+
+  assert(0 == pthread_mutex_lock(&context->lock));
+  for (;;) {
+    while (context->nr_unread == 0 && !context->readers_end) {
+      assert(0 == pthread_cond_wait(&context->read_queued, &context->lock));
+    }
+    if (context->nr_unread == 0) { break; }
+
+    CP_THREAD_SAVE_DATA* save_data = &context->save_data[context->next_read];
+    context->next_read = (context->next_read + 1) % context->nr_save_elements;
+    context->nr_unread--;
+
+    if (!save_data->is_header) {
+      assert(0 == pthread_mutex_unlock(&context->lock));
+      size_t cnt = context->parallel_input_function(
+          reader, save_data->sector_offset, save_data->data_len,
+          save_data->data);
+      assert(0 == pthread_mutex_lock(&context->lock));
+      if (cnt != save_data->data_len) { context->read_failed = true; }
+    }
+
+    save_data->ready = true;
+    assert(0 == pthread_cond_broadcast(&context->read_done));
+  }
+  assert(0 == pthread_mutex_unlock(&context->lock));
+
+  return NULL;
+}
+
 // Create a copy thread.
 bool setup_copy_thread(IO_FUNCTION* input_function,
                        IO_FUNCTION* output_function)
@@ -86,6 +147,7 @@ bool setup_copy_thread(IO_FUNCTION* input_function,
   CP_THREAD_CTX* new_context;
 
   new_context = (CP_THREAD_CTX*)malloc(sizeof(CP_THREAD_CTX));
+  memset(new_context, 0, sizeof(CP_THREAD_CTX));
   new_context->do_end = false;
   new_context->flushed = false;
   new_context->cb = new circbuf;
@@ -126,21 +188,54 @@ bail_out:
   return false;
 }
 
-/*
- * Read a new piece of data via the input_function and put it onto the circular
- * buffer.
- */
-bool send_to_copy_thread(size_t sector_offset, size_t nbyte)
+// Create a copy thread with nr_readers reader threads.
+bool setup_parallel_copy_thread(int nr_readers,
+                                PARALLEL_IO_FUNCTION* input_function,
+                                IO_FUNCTION* output_function,
+                                IO_FUNCTION* header_function)
 {
-  int slotnr;
-  circbuf* cb = cp_thread->cb;
-  CP_THREAD_SAVE_DATA* save_data;
+  if (!setup_copy_thread(NULL, output_function)) { return false; }
+
+  CP_THREAD_CTX* context = cp_thread;
+  if (pthread_cond_init(&context->read_queued, NULL) != 0) { goto bail_out; }
+  if (pthread_cond_init(&context->read_done, NULL) != 0) {
+    pthread_cond_destroy(&context->read_queued);
+    goto bail_out;
+  }
+
+  /* The copy thread does not look at these before the first item got
+   * enqueued, which happens after we return. */
+  context->parallel_input_function = input_function;
+  context->header_function = header_function;
+  context->reader_ids = (pthread_t*)malloc(nr_readers * sizeof(pthread_t));
+  for (int i = 0; i < nr_readers; i++) {
+    if (pthread_create(&context->reader_ids[i], NULL, reader_thread,
+                       (void*)(intptr_t)i)
+        != 0) {
+      break;
+    }
+    context->nr_readers++;
+  }
+  if (context->nr_readers > 0) { return true; }
+
+  free(context->reader_ids);
+  context->reader_ids = NULL;
+  pthread_cond_destroy(&context->read_done);
+  pthread_cond_destroy(&context->read_queued);
+
+bail_out:
+  cleanup_copy_thread();
+  return false;
+}
 
+// Get the slot for the next item, allocating nbyte for it if needed.
+static CP_THREAD_SAVE_DATA* next_save_data(size_t nbyte)
+{
   /* Find out which next slot will be used on the Circular Buffer.
    * The method will block when the circular buffer is full until a slot is
    * available. */
-  slotnr = cb->next_slot();
-  save_data = &cp_thread->save_data[slotnr];
+  int slotnr = cp_thread->cb->next_slot();
+  CP_THREAD_SAVE_DATA* save_data = &cp_thread->save_data[slotnr];
 
   // If this is the first time we use this slot we need to allocate some memory.
   if (save_data->capacity < nbyte) {
@@ -152,6 +247,40 @@ bool send_to_copy_thread(size_t sector_offset, size_t nbyte)
     save_data->capacity = nbyte;
   }
 
+  return save_data;
+}
+
+// Queue the item for the readers and the copy thread.
+static void queue_for_readers(CP_THREAD_SAVE_DATA* save_data)
+{
+  save_data->ready = false;
+
+  assert(0 == pthread_mutex_lock(&cp_thread->lock));
+  cp_thread->nr_unread++;
+  assert(0 == pthread_cond_signal(&cp_thread->read_queued));
+  assert(0 == pthread_mutex_unlock(&cp_thread->lock));
+
+  cp_thread->cb->enqueue(save_data);
+}
+
+/*
+ * Read a new piece of data via the input_function and put it onto the circular
+ * buffer.
+ */
+bool send_to_copy_thread(size_t sector_offset, size_t nbyte)
+{
+  circbuf* cb = cp_thread->cb;
+  CP_THREAD_SAVE_DATA* save_data = next_save_data(nbyte);
+
+  save_data->is_header = false;
+  if (cp_thread->nr_readers > 0) {
+    // One of the readers fills in the data.
+    save_data->sector_offset = sector_offset;
+    save_data->data_len = nbyte;
+    queue_for_readers(save_data);
+    return true;
+  }
+
   save_data->data_len
       = cp_thread->input_function(sector_offset, nbyte, save_data->data);
 
@@ -164,8 +293,28 @@ bool send_to_copy_thread(size_t sector_offset, size_t nbyte)
   return true;
 }
 
-// Flush the copy thread.
-void flush_copy_thread()
+// Put data for the header function onto the circular buffer.
+bool send_header_to_copy_thread(size_t sector_offset,
+                                const void* data,
+                                size_t nbyte)
+{
+  assert(cp_thread->nr_readers > 0);
+
+  CP_THREAD_SAVE_DATA* save_data = next_save_data(nbyte);
+  memcpy(save_data->data, data, nbyte);
+  save_data->sector_offset = sector_offset;
+  save_data->data_len = nbyte;
+  save_data->is_header = true;
+  queue_for_readers(save_data);
+
+  return true;
+}
+
+/*
+ * Flush the copy thread.  Returns false if a reader or the output of a
+ * parallel copy thread failed since it was set up.
+ */
+bool flush_copy_thread()
 {
   CP_THREAD_CTX* context = cp_thread;
 
@@ -186,8 +335,11 @@ void flush_copy_thread()
   }
 
   context->flushed = false;
+  bool failed = context->read_failed;
 
   assert(0 == pthread_mutex_unlock(&context->lock));
+
+  return !failed;
 }
 
 // Cleanup all data allocated for the copy thread.
@@ -211,6 +363,21 @@ void cleanup_copy_thread()
     pthread_join(cp_thread->thread_id, NULL);
   }
 
+  // Stop the reader threads.
+  if (cp_thread->reader_ids) {
+    assert(0 == pthread_mutex_lock(&cp_thread->lock));
+    cp_thread->readers_end = true;
+    assert(0 == pthread_cond_broadcast(&cp_thread->read_queued));
+    assert(0 == pthread_mutex_unlock(&cp_thread->lock));
+
+    for (int i = 0; i < cp_thread->nr_readers; i++) {
+      pthread_join(cp_thread->reader_ids[i], NULL);
+    }
+    free(cp_thread->reader_ids);
+    pthread_cond_destroy(&cp_thread->read_done);
+    pthread_cond_destroy(&cp_thread->read_queued);
+  }
+
   // Free all data allocated along the way.
   for (slotnr = 0; slotnr < cp_thread->nr_save_elements; slotnr++) {
     if (cp_thread->save_data[slotnr].data) {
@@ -1,7 +1,7 @@
 /*
    BAREOS® - Backup Archiving REcovery Open Sourced
 
-   Copyright (C) 2014-2023 Bareos GmbH & Co. KG
+   Copyright (C) 2014-2024 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -29,11 +29,19 @@
 
 typedef size_t(IO_FUNCTION)(size_t sector_offset, size_t nbyte, void* buf);
 
+// Input function of parallel reader nr reader (0 .. nr_readers - 1).
+typedef size_t(PARALLEL_IO_FUNCTION)(int reader,
+                                     size_t sector_offset,
+                                     size_t nbyte,
+                                     void* buf);
+
 struct CP_THREAD_SAVE_DATA {
   size_t capacity;      /* capacity */
   size_t sector_offset; /* Sector offset where to write data */
   size_t data_len;      /* Length of Data */
   void* data;           /* Data */
+  bool is_header;       /* Data goes to the header function */
+  bool ready;           /* Data was read by one of the readers */
 };
 
 struct CP_THREAD_CTX {
@@ -48,12 +56,33 @@ struct CP_THREAD_CTX {
   pthread_cond_t flush;         /* Flush data from the Circular buffer */
   IO_FUNCTION* input_function;  /* IO function that performs the output I/O */
   IO_FUNCTION* output_function; /* IO function that performs the output I/O */
+  IO_FUNCTION* header_function; /* Writes the items queued as header */
+  PARALLEL_IO_FUNCTION* parallel_input_function; /* Input of the readers */
+  int nr_readers;               /* Number of reader threads */
+  pthread_t* reader_ids;        /* Ids of the reader threads */
+  int next_read;                /* Next slot one of the readers reads */
+  int nr_unread;                /* Slots queued but not taken by a reader */
+  bool readers_end;             /* If set, the reader threads stop */
+  bool read_failed;             /* One of the readers failed */
+  pthread_cond_t read_queued;   /* Slot queued for the readers */
+  pthread_cond_t read_done;     /* Slot read by one of the readers */
 };
 
 bool setup_copy_thread(IO_FUNCTION* input_function,
                        IO_FUNCTION* output_function);
+/* Like setup_copy_thread() but the data is read by nr_readers threads in
+ * parallel.  The copy thread still writes everything in the order it was
+ * sent, so the reads of later pieces overlap with the ones before. */
+bool setup_parallel_copy_thread(int nr_readers,
+                                PARALLEL_IO_FUNCTION* input_function,
+                                IO_FUNCTION* output_function,
+                                IO_FUNCTION* header_function);
 bool send_to_copy_thread(size_t sector_offset, size_t nbyte);
-void flush_copy_thread();
+// Queue nbyte of data for the header function of a parallel copy thread.
+bool send_header_to_copy_thread(size_t sector_offset,
+                                const void* data,
+                                size_t nbyte);
+bool flush_copy_thread();
 void cleanup_copy_thread();
 
 #endif  // BAREOS_VMWARE_VADP_DUMPER_COPY_THREAD_H_
@@ -1752,13 +1752,18 @@ int stat(const char* filename, struct stat* sb)
       HANDLE h = INVALID_HANDLE_VALUE;
 
       /* The GetFileInformationByHandleEx need a file handle so we have to
-       * open the file or directory read-only. */
+       * open the file.  Only opening it for its attributes is cheaper, does
+       * not trigger on-access virus scans and also works while somebody
+       * else has it open for writing. */
+      const DWORD access = FILE_READ_ATTRIBUTES;
+      const DWORD share
+          = FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE;
       if (p_CreateFileW) {
-        h = p_CreateFileW(utf16.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
-                          OPEN_EXISTING, 0, NULL);
+        h = p_CreateFileW(utf16.c_str(), access, share, NULL, OPEN_EXISTING, 0,
+                          NULL);
       } else {
-        h = CreateFileA(win32_fname.c_str(), GENERIC_READ, FILE_SHARE_READ,
-                        NULL, OPEN_EXISTING, 0, NULL);
+        h = CreateFileA(win32_fname.c_str(), access, share, NULL,
+                        OPEN_EXISTING, 0, NULL);
       }
 
       if (h != INVALID_HANDLE_VALUE) {
@@ -2078,6 +2083,10 @@ struct passwd* getpwuid(uid_t) { return NULL; }
 struct group* getgrgid(uid_t) { return NULL; }
 
 // Implement opendir/readdir/closedir on top of window's API
+#ifndef FIND_FIRST_EX_LARGE_FETCH
+#  define FIND_FIRST_EX_LARGE_FETCH 0x00000002
+#endif
+
 typedef struct _dir {
   WIN32_FIND_DATAA data_a; /* window's file info (ansii version) */
   WIN32_FIND_DATAW data_w; /* window's file info (wchar version) */
@@ -2118,7 +2127,16 @@ DIR* opendir(const char* path)
   // convert to wchar_t
   if (p_FindFirstFileW) {
     std::wstring utf16 = make_win32_path_UTF8_2_wchar(dir_path.c_str());
-    rval->dirh = p_FindFirstFileW(utf16.c_str(), &rval->data_w);
+    /* Without the short names and with large fetches the entries of big
+     * directories come a lot faster. */
+    rval->dirh = FindFirstFileExW(utf16.c_str(), FindExInfoBasic,
+                                  &rval->data_w, FindExSearchNameMatch, NULL,
+                                  FIND_FIRST_EX_LARGE_FETCH);
+    if (rval->dirh == INVALID_HANDLE_VALUE
+        && GetLastError() == ERROR_INVALID_PARAMETER) {
+      // windows before 7 knows neither of them
+      rval->dirh = p_FindFirstFileW(utf16.c_str(), &rval->data_w);
+    }
     if (rval->dirh != INVALID_HANDLE_VALUE) { rval->valid_w = 1; }
   } else if (p_FindFirstFileA) {
     rval->dirh = p_FindFirstFileA(rval->spec, &rval->data_a);
@@ -0,0 +1,324 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * directories with changes, taken from the NTFS change journals
+ */
+
+#include "include/bareos.h"
+#include "include/jcr.h"
+#include "filed/filed.h"
+#include "filed/filed_globals.h"
+#include "filed/change_sources.h"
+#include "lib/berrno.h"
+#include "win32/filed/change_journal.h"
+
+#include <winioctl.h>
+
+#include <algorithm>
+#include <array>
+#include <unordered_map>
+
+namespace filedaemon {
+
+namespace {
+
+// lower case, with / as separator and a trailing /, like they get compared
+std::wstring NormalizePath(std::wstring path)
+{
+  if (path.rfind(L"\\\\?\\", 0) == 0) { path.erase(0, 4); }
+  std::replace(path.begin(), path.end(), L'\\', L'/');
+  if (!path.empty()) {
+    CharLowerBuffW(path.data(), static_cast<DWORD>(path.size()));
+  }
+  if (path.empty() || path.back() != L'/') { path.push_back(L'/'); }
+  return path;
+}
+
+class Handle {
+ public:
+  explicit Handle(HANDLE handle) : handle_{handle} {}
+  Handle(const Handle&) = delete;
+  Handle& operator=(const Handle&) = delete;
+  ~Handle()
+  {
+    if (handle_ != INVALID_HANDLE_VALUE) { CloseHandle(handle_); }
+  }
+
+  HANDLE get() const { return handle_; }
+  bool valid() const { return handle_ != INVALID_HANDLE_VALUE; }
+
+ private:
+  HANDLE handle_;
+};
+
+const char* Win32Error()
+{
+  static thread_local BErrNo be;
+  be.SetErrno(b_errno_win32);
+  return be.bstrerror();
+}
+
+// the folders on the volume other volumes are mounted at
+std::vector<std::wstring> VolumeMountPoints(const std::wstring& root)
+{
+  std::vector<std::wstring> mount_points;
+  std::array<wchar_t, 50> volume_name;
+  if (!GetVolumeNameForVolumeMountPointW(root.c_str(), volume_name.data(),
+                                         volume_name.size())) {
+    return mount_points;
+  }
+
+  std::array<wchar_t, MAX_PATH + 1> name;
+  HANDLE find = FindFirstVolumeMountPointW(volume_name.data(), name.data(),
+                                           name.size());
+  if (find == INVALID_HANDLE_VALUE) { return mount_points; }
+  do {
+    mount_points.push_back(NormalizePath(root + name.data()));
+  } while (FindNextVolumeMountPointW(find, name.data(), name.size()));
+  FindVolumeMountPointClose(find);
+  return mount_points;
+}
+
+std::wstring FinalPath(HANDLE handle)
+{
+  std::wstring path(MAX_PATH, L'\0');
+  DWORD flags = FILE_NAME_NORMALIZED | VOLUME_NAME_DOS;
+  DWORD length = GetFinalPathNameByHandleW(handle, path.data(),
+                                           static_cast<DWORD>(path.size()),
+                                           flags);
+  if (length >= path.size()) {
+    path.resize(length + 1);
+    length = GetFinalPathNameByHandleW(
+        handle, path.data(), static_cast<DWORD>(path.size()), flags);
+  }
+  if (length == 0 || length >= path.size()) { return std::wstring{}; }
+  path.resize(length);
+  return path;
+}
+
+}  // namespace
+
+void ChangeJournals::Open(JobControlRecord* jcr,
+                          const std::vector<std::wstring>& volumes,
+                          const char* prev_job)
+{
+  for (const std::wstring& mount_point : volumes) {
+    // only volumes with a drive letter, like C: or C:\ .
+    if (mount_point.size() < 2 || mount_point.size() > 3
+        || mount_point[1] != L':') {
+      continue;
+    }
+    std::wstring root = mount_point.substr(0, 2) + L"\\";
+    wchar_t drive = NormalizePath(root)[0];
+    auto same_drive = [drive](const volume& vol) { return vol.drive == drive; };
+    if (std::any_of(volumes_.begin(), volumes_.end(), same_drive)) { continue; }
+
+    std::wstring device = L"\\\\.\\" + mount_point.substr(0, 2);
+    Handle handle{CreateFileW(device.c_str(), GENERIC_READ,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                              OPEN_EXISTING, 0, NULL)};
+    if (!handle.valid()) {
+      Dmsg2(100, "Cannot open volume %c: ERR=%s\n", (char)drive, Win32Error());
+      continue;
+    }
+
+    USN_JOURNAL_DATA_V0 journal{};
+    DWORD returned = 0;
+    if (!DeviceIoControl(handle.get(), FSCTL_QUERY_USN_JOURNAL, NULL, 0,
+                         &journal, sizeof(journal), &returned, NULL)) {
+      Jmsg(jcr, M_INFO, 0, T_("No change journal on %c:, ERR=%s\n"),
+           (char)toupper(drive), Win32Error());
+      continue;
+    }
+
+    volume& vol = volumes_.emplace_back();
+    vol.drive = drive;
+    vol.journal_id = journal.UsnJournalID;
+    vol.next_usn = journal.NextUsn;
+
+    if (!prev_job || !*prev_job) { continue; }
+
+    unsigned long long saved_id = 0;
+    long long saved_usn = 0;
+    change_state state;
+    if (!ReadChangeState(ChangeStateFile(jcr, "usn", std::string(1, drive)),
+                         state)
+        || state.job != prev_job
+        || sscanf(state.position.c_str(), "%llu %lld", &saved_id, &saved_usn)
+               != 2
+        || saved_id != vol.journal_id || saved_usn < journal.FirstUsn
+        || saved_usn > journal.NextUsn) {
+      Jmsg(jcr, M_INFO, 0,
+           T_("Change journal of %c: does not go back to job %s, looking at "
+              "all files.\n"),
+           (char)toupper(drive), prev_job);
+      continue;
+    }
+
+    vol.mount_points = VolumeMountPoints(root);
+    if (ReadChanges(jcr, handle.get(), vol, saved_usn)) {
+      vol.changes_read = true;
+      Jmsg(jcr, M_INFO, 0,
+           T_("Change journal of %c: lists changes in %llu directories.\n"),
+           (char)toupper(drive),
+           static_cast<unsigned long long>(vol.changed_dirs.size()));
+    } else {
+      vol.changed_dirs = ChangedDirectories{};
+    }
+  }
+}
+
+bool ChangeJournals::ReadChanges(JobControlRecord* jcr,
+                                 void* handle,
+                                 volume& vol,
+                                 int64_t since_usn)
+{
+  /* the directories that got an entry changed and changed directories,
+   * true for directories that got moved here with everything below */
+  std::unordered_map<DWORDLONG, bool> dir_ids;
+
+  READ_USN_JOURNAL_DATA_V0 read{};
+  read.StartUsn = since_usn;
+  read.ReasonMask = 0xFFFFFFFF;
+  read.UsnJournalID = vol.journal_id;
+  std::vector<char> buffer(1024 * 1024);
+
+  while (read.StartUsn < vol.next_usn) {
+    if (jcr->IsJobCanceled()) { return false; }
+
+    DWORD returned = 0;
+    if (!DeviceIoControl(handle, FSCTL_READ_USN_JOURNAL, &read, sizeof(read),
+                         buffer.data(), static_cast<DWORD>(buffer.size()),
+                         &returned, NULL)) {
+      Jmsg(jcr, M_WARNING, 0,
+           T_("Cannot read the change journal of %c:, ERR=%s\n"),
+           (char)toupper(vol.drive), Win32Error());
+      return false;
+    }
+    if (returned <= sizeof(USN)) { break; }
+
+    for (DWORD offset = sizeof(USN); offset < returned;) {
+      auto* record = reinterpret_cast<USN_RECORD_V2*>(buffer.data() + offset);
+      if (record->RecordLength == 0) { break; }
+      offset += record->RecordLength;
+
+      // version 3 records with 128 bit ids are only written by ReFS
+      if (record->MajorVersion != 2) {
+        Jmsg(jcr, M_WARNING, 0,
+             T_("Unsupported record version %d in the change journal of "
+                "%c:\n"),
+             record->MajorVersion, (char)toupper(vol.drive));
+        return false;
+      }
+      if (record->Usn >= vol.next_usn) { continue; }
+
+      dir_ids.emplace(record->ParentFileReferenceNumber, false);
+      if (record->FileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+        bool moved = record->Reason & USN_REASON_RENAME_NEW_NAME;
+        dir_ids[record->FileReferenceNumber] |= moved;
+      }
+    }
+    read.StartUsn = *reinterpret_cast<USN*>(buffer.data());
+  }
+
+  // directories that got deleted since are not there anymore
+  for (auto [id, moved] : dir_ids) {
+    FILE_ID_DESCRIPTOR descriptor{};
+    descriptor.dwSize = sizeof(descriptor);
+    descriptor.Type = FileIdType;
+    descriptor.FileId.QuadPart = static_cast<LONGLONG>(id);
+    Handle dir{OpenFileById(handle, &descriptor, FILE_READ_ATTRIBUTES,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE
+                                | FILE_SHARE_DELETE,
+                            NULL, FILE_FLAG_BACKUP_SEMANTICS)};
+    if (!dir.valid()) { continue; }
+
+    std::wstring path = FinalPath(dir.get());
+    if (path.empty()) { continue; }
+    std::string dirname = FromUtf16(NormalizePath(std::move(path)));
+    if (moved) {
+      vol.changed_dirs.AddSubtree(dirname);
+    } else {
+      vol.changed_dirs.Add(dirname);
+    }
+  }
+
+  return true;
+}
+
+const ChangeJournals::volume* ChangeJournals::CoveringVolume(
+    const char* dirname) const
+{
+  if (!dirname[0] || dirname[1] != ':') { return nullptr; }
+
+  std::wstring path = NormalizePath(FromUtf8(dirname));
+  for (const volume& vol : volumes_) {
+    if (vol.drive != path[0]) { continue; }
+    if (!vol.changes_read) { return nullptr; }
+    for (const std::wstring& mount_point : vol.mount_points) {
+      if (path.compare(0, mount_point.size(), mount_point) == 0) {
+        return nullptr;
+      }
+    }
+    return &vol;
+  }
+  return nullptr;
+}
+
+bool ChangeJournals::Covers(const char* dirname, const struct stat&) const
+{
+  return CoveringVolume(dirname) != nullptr;
+}
+
+bool ChangeJournals::MayHaveChanged(const char* dirname,
+                                    const struct stat&) const
+{
+  const volume* vol = CoveringVolume(dirname);
+  if (!vol) { return true; }
+  return vol->changed_dirs.Contains(
+      FromUtf16(NormalizePath(FromUtf8(dirname))));
+}
+
+void ChangeJournals::SaveState(JobControlRecord* jcr)
+{
+  for (const volume& vol : volumes_) {
+    char position[64];
+    snprintf(position, sizeof(position), "%llu %lld",
+             static_cast<unsigned long long>(vol.journal_id),
+             static_cast<long long>(vol.next_usn));
+    WriteChangeState(
+        jcr, ChangeStateFile(jcr, "usn", std::string(1, vol.drive)), position);
+  }
+}
+
+std::unique_ptr<ChangeSource> NewUsnChangeSource(
+    JobControlRecord* jcr,
+    const std::vector<std::wstring>& volumes,
+    const char* prev_job)
+{
+  auto journals = std::make_unique<ChangeJournals>();
+  journals->Open(jcr, volumes, prev_job);
+  if (journals->empty()) { return nullptr; }
+  return journals;
+}
+
+}  // namespace filedaemon
@@ -0,0 +1,98 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * directories with changes, taken from the NTFS change journals
+ */
+
+#ifndef BAREOS_WIN32_FILED_CHANGE_JOURNAL_H_
+#define BAREOS_WIN32_FILED_CHANGE_JOURNAL_H_
+
+#include "findlib/change_source.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class JobControlRecord;
+
+namespace filedaemon {
+
+/* NTFS records every change of a volume in its change (USN) journal.  At the
+ * start of every backup the position of each journal is taken and saved in
+ * the working directory together with the job once the backup terminated.
+ * An incremental then only reads the records written since the saved
+ * position and can skip all directories in which nothing changed, instead
+ * of looking at every file.
+ *
+ * A volume is only used if its saved position was taken by the job the
+ * incremental is based on and the journal was neither recreated nor did it
+ * drop these records in the meantime.  Directories on other volumes or below
+ * volume mount points are not covered. */
+class ChangeJournals : public ChangeSource {
+ public:
+  /* Takes the positions of the journals of the volumes (mount points like
+   * C:\) and, unless prev_job is empty, collects the directories changed
+   * since the positions saved by that job. */
+  void Open(JobControlRecord* jcr,
+            const std::vector<std::wstring>& volumes,
+            const char* prev_job);
+
+  // whether no volume has a change journal
+  bool empty() const { return volumes_.empty(); }
+
+  // directory names like c:/dir/
+  bool Covers(const char* dirname, const struct stat& statp) const override;
+  bool MayHaveChanged(const char* dirname,
+                      const struct stat& statp) const override;
+
+  // saves the positions taken by Open() for the next backup
+  void SaveState(JobControlRecord* jcr) override;
+
+ private:
+  struct volume {
+    wchar_t drive{};             /**< Drive letter, lower case */
+    uint64_t journal_id{};       /**< Id of the journal instance */
+    int64_t next_usn{};          /**< Position at the start of this backup */
+    bool changes_read{false};    /**< changed_dirs is complete */
+    ChangedDirectories changed_dirs{};        /**< Lower case names */
+    std::vector<std::wstring> mount_points{}; /**< Other volumes */
+  };
+
+  bool ReadChanges(JobControlRecord* jcr,
+                   void* handle,
+                   volume& vol,
+                   int64_t since_usn);
+  const volume* CoveringVolume(const char* dirname) const;
+
+  std::vector<volume> volumes_{};
+};
+
+// nullptr if none of the volumes has a change journal
+std::unique_ptr<ChangeSource> NewUsnChangeSource(
+    JobControlRecord* jcr,
+    const std::vector<std::wstring>& volumes,
+    const char* prev_job);
+
+}  // namespace filedaemon
+
+#endif  // BAREOS_WIN32_FILED_CHANGE_JOURNAL_H_
@@ -38,6 +38,7 @@
 #  include "include/jcr.h"
 #  include "lib/berrno.h"
 #  include "findlib/find.h"
+#  include "lib/fnmatch.h"
 #  define FILE_DAEMON 1
 #  include "filed/fd_plugins.h"
 #  include "fill_proc_address.h"
@@ -527,7 +528,7 @@ bool VSSClientGeneric::Initialize(DWORD dwContext, bool bDuringRestore)
     }
 
     // Wait for the async operation to finish and checks the result
-    if (!WaitAndCheckForAsyncOperation(pAsync1.p)) {
+    if (!WaitAndCheckForAsyncOperation(pAsync1.p, "GatherWriterMetadata")) {
       // Error message already printed
       errno = b_errno_win32;
       return false;
@@ -563,10 +564,39 @@ bool VSSClientGeneric::Initialize(DWORD dwContext, bool bDuringRestore)
     // over it to get the correct paths, i.e. with Find[First|Next]File.
     // This is currently only used for debugging so it should be ok!
 
+    std::vector<VSS_ID> disabled_writers;
+    std::string disabled_names;
+
     for (UINT i = 0; i < cWriters; ++i) {
       Dmsg1(500, "VSS Writer: %u\n", i);
       VSS_CALL(pVssObj, GetWriterMetadata, i, &idInstance, &pMetadata);
 
+      {
+        VSS_ID idWriter;
+        BSTR bstrWriterName;
+        VSS_USAGE_TYPE usage;
+        VSS_SOURCE_TYPE source;
+        VSS_CALL(pMetadata, GetIdentity, &idInstance, &idWriter,
+                 &bstrWriterName, &usage, &source);
+
+        char* writer_name = BSTR_2_str(bstrWriterName);
+        SysFreeString(bstrWriterName);
+        bool use_writer = UseWriter(writer_name);
+        if (!use_writer) {
+          Dmsg1(100, "VSS: leaving out writer %s\n", writer_name);
+          disabled_writers.push_back(idWriter);
+          if (!disabled_names.empty()) { disabled_names += ", "; }
+          disabled_names += writer_name;
+        }
+        free(writer_name);
+
+        // the files of writers that are left out do not matter
+        if (!use_writer) {
+          pMetadata->Release();
+          continue;
+        }
+      }
+
       UINT cIncludeFiles, cExcludeFiles, cComponents;
 
       VSS_CALL(pMetadata, GetFileCounts, &cIncludeFiles, &cExcludeFiles,
@@ -702,6 +732,16 @@ bool VSSClientGeneric::Initialize(DWORD dwContext, bool bDuringRestore)
 
     Dmsg1(150, "VSS: Found %llu files to exclude and %llu files to include.\n",
           excluded_files.size(), included_files.size());
+
+    /* Writers that are left out are not asked to freeze and thaw, which
+     * is what takes long with many of them. */
+    if (!disabled_writers.empty()) {
+      VSS_CALL(pVssObj, DisableWriterClasses, disabled_writers.data(),
+               static_cast<UINT>(disabled_writers.size()));
+      Jmsg(jcr_, M_INFO, 0, T_("VSS: Leaving out %llu writers: %s\n"),
+           static_cast<unsigned long long>(disabled_writers.size()),
+           disabled_names.c_str());
+    }
   }
 
   // We are during restore now?
@@ -713,34 +753,81 @@ bool VSSClientGeneric::Initialize(DWORD dwContext, bool bDuringRestore)
   return true;
 }
 
-bool VSSClientGeneric::WaitAndCheckForAsyncOperation(IVssAsync* pAsync)
+// Whether the writer of that name takes part in the snapshots.
+bool VSSClientGeneric::UseWriter(const char* writer_name) const
+{
+  auto matches = [writer_name](const std::vector<std::string>& patterns) {
+    return std::any_of(patterns.begin(), patterns.end(),
+                       [writer_name](const std::string& pattern) {
+                         return fnmatch(pattern.c_str(), writer_name,
+                                        FNM_CASEFOLD)
+                                == 0;
+                       });
+  };
+  return (include_writers.empty() || matches(include_writers))
+         && !matches(exclude_writers);
+}
+
+/* Waits for an asynchronous VSS operation by polling its status, so that a
+ * canceled job does not wait for it and the job log shows which operation
+ * is taking long.  IVssAsync::Wait() cannot time out on all versions. */
+bool VSSClientGeneric::WaitAndCheckForAsyncOperation(IVssAsync* pAsync,
+                                                     const char* operation)
 {
+  using namespace std::chrono;
+  constexpr auto poll_interval = milliseconds(200);
+  constexpr auto progress_interval = seconds(30);
+  constexpr auto timeout = minutes(10);
+
   HRESULT hrReturned = S_OK;
-  std::chrono::milliseconds timeout = std::chrono::minutes(10);
+  auto start = steady_clock::now();
+  auto next_progress = start + progress_interval;
 
-  HRESULT wait = pAsync->Wait(
-      static_cast<DWORD>(timeout.count()));  // wait at most 10 minutes
-  if (FAILED(wait)) {
-    JmsgVssApiStatus(jcr_, M_FATAL, wait, "async wait");
-    return false;
-  }
+  for (;;) {
+    HRESULT hr = pAsync->QueryStatus(&hrReturned, NULL);
+    if (FAILED(hr)) {
+      JmsgVssApiStatus(jcr_, M_FATAL, hr, "query async status");
+      return false;
+    }
+    if (hrReturned != VSS_S_ASYNC_PENDING) { break; }
 
-  HRESULT hr = pAsync->QueryStatus(&hrReturned, NULL);
+    auto now = steady_clock::now();
+    if (jcr_ && jcr_->IsJobCanceled()) {
+      pAsync->Cancel();
+      Jmsg(jcr_, M_WARNING, 0, T_("VSS: %s canceled with the job.\n"),
+           operation);
+      return false;
+    }
+    if (now - start >= timeout) {
+      pAsync->Cancel();
+      Jmsg(jcr_, M_FATAL, 0, T_("VSS: %s did not finish within %lld s.\n"),
+           operation,
+           static_cast<long long>(duration_cast<seconds>(timeout).count()));
+      return false;
+    }
+    if (now >= next_progress) {
+      Jmsg(jcr_, M_INFO, 0, T_("VSS: %s still running after %lld s.\n"),
+           operation,
+           static_cast<long long>(
+               duration_cast<seconds>(now - start).count()));
+      next_progress += progress_interval;
+    }
 
-  if (FAILED(hr)) {
-    JmsgVssApiStatus(jcr_, M_FATAL, wait, "query async status");
-    return false;
+    Bmicrosleep(0, duration_cast<microseconds>(poll_interval).count());
   }
 
+  Dmsg2(100, "VSS: %s took %lld ms\n", operation,
+        static_cast<long long>(
+            duration_cast<milliseconds>(steady_clock::now() - start).count()));
+
   if (hrReturned != VSS_S_ASYNC_FINISHED) {
     Jmsg(jcr_, M_WARNING, 0,
-         "WaitAndCheckForAsyncOperation: QueryStatus did not return "
+         "WaitAndCheckForAsyncOperation: %s did not return "
          "ASYNC_FINISHED: %lu\n",
-         hrReturned);
+         operation, hrReturned);
     return false;
   }
   return true;
-  // Add all drive letters that need to be snapshotted.
 }
 
 // Add all drive letters that need to be snapshotted.
@@ -897,7 +984,7 @@ bool VSSClientGeneric::CreateSnapshots(const std::vector<std::wstring>& volumes,
   }
 
   // Wait for the async operation to finish and checks the result.
-  if (!WaitAndCheckForAsyncOperation(pAsync1.p)) {
+  if (!WaitAndCheckForAsyncOperation(pAsync1.p, "PrepareForBackup")) {
     errno = b_errno_win32;
     return false;
   }
@@ -917,7 +1004,7 @@ bool VSSClientGeneric::CreateSnapshots(const std::vector<std::wstring>& volumes,
   }
 
   // Waits for the async operation to finish and checks the result.
-  if (!WaitAndCheckForAsyncOperation(pAsync2.p)) {
+  if (!WaitAndCheckForAsyncOperation(pAsync2.p, "DoSnapshotSet")) {
     errno = b_errno_win32;
     return false;
   }
@@ -955,7 +1042,7 @@ bool VSSClientGeneric::CloseBackup()
   hr = pVssObj->BackupComplete(&pAsync.p);
   if (SUCCEEDED(hr)) {
     // Wait for the async operation to finish and checks the result.
-    WaitAndCheckForAsyncOperation(pAsync.p);
+    WaitAndCheckForAsyncOperation(pAsync.p, "BackupComplete");
     bRet = true;
   } else {
     JmsgVssApiStatus(jcr_, M_ERROR, hr, "BackupComplete");
@@ -1109,7 +1196,7 @@ bool VSSClientGeneric::CheckWriterStatus()
   }
 
   // Waits for the async operation to finish and checks the result
-  if (!WaitAndCheckForAsyncOperation(pAsync.p)) {
+  if (!WaitAndCheckForAsyncOperation(pAsync.p, "GatherWriterStatus")) {
     errno = b_errno_win32;
     return false;
   }
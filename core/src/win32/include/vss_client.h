@@ -107,9 +107,16 @@ class VSSClient {
   std::unordered_map<std::wstring, std::wstring> mount_to_vol_w{};
   std::unordered_map<std::wstring, std::wstring> vol_to_vss_w{};
 
+  /* Names of the writers to use and to leave out, they may contain
+   * wildcards.  Without include_writers all writers are used. */
+  std::vector<std::string> include_writers{};
+  std::vector<std::string> exclude_writers{};
+
  private:
   virtual bool Initialize(DWORD dwContext, bool bDuringRestore = FALSE) = 0;
-  virtual bool WaitAndCheckForAsyncOperation(IVssAsync* pAsync) = 0;
+  virtual bool WaitAndCheckForAsyncOperation(IVssAsync* pAsync,
+                                             const char* operation)
+      = 0;
   virtual void QuerySnapshotSet(GUID snapshotSetID) = 0;
 
  protected:
@@ -166,7 +173,9 @@ class VSSClientVista : public VSSClient {
 
  private:
   virtual bool Initialize(DWORD dwContext, bool bDuringRestore) override;
-  virtual bool WaitAndCheckForAsyncOperation(IVssAsync* pAsync) override;
+  virtual bool WaitAndCheckForAsyncOperation(IVssAsync* pAsync,
+                                             const char* operation) override;
+  bool UseWriter(const char* writer_name) const;
   virtual void QuerySnapshotSet(GUID snapshotSetID) override;
   bool CheckWriterStatus();
 };
@@ -84,7 +84,31 @@ class DirectorConsoleJson(DirectorConsole):
             bareos.exceptions.JsonRpcInvalidJsonReceivedException:
                 if an invalid JSON-RPC result is received.
         """
-        json = self.call_fullresult(command)
+        return self._get_result(self.call_fullresult(command))
+
+    def call_pipelined(self, commands, window=16):
+        """Calls several commands on the Bareos Director without waiting.
+
+        See :py:func:`bareos.bsock.lowlevel.LowLevel.call_pipelined`.
+
+        Returns:
+            list: Results (dict) in the order of the commands.
+
+        Raises:
+            bareos.exceptions.JsonRpcErrorReceivedException:
+                if an JSON-RPC error object is received.
+            bareos.exceptions.JsonRpcInvalidJsonReceivedException:
+                if an invalid JSON-RPC result is received.
+        """
+        resultstrings = super(DirectorConsoleJson, self).call_pipelined(
+            commands, window
+        )
+        return [
+            self._get_result(self._parse_result(resultstring))
+            for resultstring in resultstrings
+        ]
+
+    def _get_result(self, json):
         if json == None:
             return
         if "result" in json:
@@ -105,7 +129,9 @@ class DirectorConsoleJson(DirectorConsole):
             bareos.exceptions.JsonRpcInvalidJsonReceivedException:
                 if an invalid JSON-RPC result is received.
         """
-        resultstring = super(DirectorConsoleJson, self).call(command)
+        return self._parse_result(super(DirectorConsoleJson, self).call(command))
+
+    def _parse_result(self, resultstring):
         data = None
         if resultstring:
             try:
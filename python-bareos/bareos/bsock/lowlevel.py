@@ -464,6 +464,63 @@ class LowLevel(object):
                 raise
         return result
 
+    def call_pipelined(self, commands, window=16):
+        """Call several Bareos commands without waiting for each result.
+
+        Up to window commands are sent ahead,
+        each prefixed by a request tag (``@<id>``),
+        which the Director returns as the first message of the result.
+        The commands must not ask for input.
+
+        Args:
+           commands (list): Commands to execute. A command can itself be a list.
+           window (int): Maximum number of commands in flight.
+
+        Returns:
+            list: Results (bytes) in the order of the commands.
+
+        Raises:
+            bareos.exceptions.ConnectionLostError:
+                if a result does not start with the expected request tag.
+        """
+        commands = [
+            " ".join(command) if isinstance(command, list) else command
+            for command in commands
+        ]
+        results = []
+        sent = 0
+        while len(results) < len(commands):
+            while sent < len(commands) and sent - len(results) < max(window, 1):
+                self.send(bytearray("@%d %s" % (sent, commands[sent]), "utf-8"))
+                sent += 1
+            tag = self.recv_request_tag()
+            if tag != len(results):
+                raise bareos.exceptions.ConnectionLostError(
+                    "expected result of request %d, got %s" % (len(results), tag)
+                )
+            results.append(self.recv_msg())
+        return results
+
+    def recv_request_tag(self):
+        """Receive the request tag that starts the result of a pipelined command.
+
+        Returns:
+            int: Id of the request or None, if the message is no request tag.
+        """
+        while True:
+            try:
+                msg = self.recv()
+            except bareos.exceptions.SignalReceivedException as e:
+                # e.g. the prompt sent after switching the API mode
+                self.__set_status(e.signal)
+                if not self.is_connected():
+                    raise bareos.exceptions.ConnectionLostError("connection terminated")
+                continue
+            match = re.match(b"^@(\\d+)$", bytes(msg).rstrip(b"\0"))
+            if match:
+                return int(match.group(1))
+            return None
+
     def send_command(self, command):
         """Alias for :py:func:`call`.
 
@@ -55,6 +55,35 @@ _EOT_
   remove)
     exec rm "$storage_path/$2.$3"
     ;;
+  session)
+    echo "session 1"
+    while IFS=$'\t' read -r op volume part size; do
+      volume=$(printf '%b' "$volume")
+      part=$(printf '%b' "$part")
+      file="$storage_path/$volume.$part"
+      case "$op" in
+        stat | download)
+          if [ ! -f "$file" ]; then
+            printf 'error\t%s does not exist\n' "$file"
+            continue
+          fi
+          printf 'ok\t%d\n' "$(get_filesize "$file")"
+          if [ "$op" = download ]; then cat "$file"; fi
+          ;;
+        upload)
+          head -c "$size" >"$file"
+          echo ok
+          ;;
+        remove)
+          rm "$file"
+          echo ok
+          ;;
+        *)
+          printf 'error\tunknown operation %s\n' "$op"
+          ;;
+      esac
+    done
+    ;;
   *)
     exit 2
     ;;